@@ -0,0 +1,132 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_ACCESS_HEATMAP_H_
+#define TCMALLOC_ACCESS_HEATMAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "absl/time/time.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/sizemap.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Estimates, per size class, how many of the live bytes were not accessed over
+// a whole round, to find the classes that hold mostly cold objects.
+//
+// Each round marks the pages of the live sampled allocations idle, and the
+// next one reads back which of them are still idle.  Sampled objects sit on
+// spans of their own, so their pages are not touched by accesses to other
+// objects.  Only the objects which were already live at the previous round are
+// counted; their bytes are weighted as in heap profiles.  Objects allocated
+// from the page heap directly are counted under size class 0.
+//
+// BeginRound(), Record() and EndRound() must not be called concurrently; the
+// other methods may be called from any thread.
+class AccessHeatmap {
+ public:
+  constexpr AccessHeatmap() = default;
+  AccessHeatmap(const AccessHeatmap&) = delete;
+  AccessHeatmap& operator=(const AccessHeatmap&) = delete;
+
+  // When the previous round marked pages idle, or absl::InfinitePast() if it
+  // did not.
+  absl::Time last_round() const { return last_round_; }
+
+  void BeginRound() {
+    for (Pending& p : pending_) {
+      p = {};
+    }
+  }
+
+  // Records `bytes` of live objects of `size_class`, `idle_bytes` of which
+  // were not accessed since the previous round.
+  void Record(size_t size_class, uint64_t bytes, uint64_t idle_bytes) {
+    TC_ASSERT_LT(size_class, kNumClasses);
+    pending_[size_class].bytes += bytes;
+    pending_[size_class].idle_bytes += idle_bytes;
+  }
+
+  // Publishes the round started by BeginRound().  `available` is false if the
+  // kernel does not expose idle pages, in which case the previous results are
+  // kept.
+  void EndRound(absl::Time now, bool available) {
+    rounds_.Add(1);
+    if (!available) {
+      unavailable_rounds_.Add(1);
+      last_round_ = absl::InfinitePast();
+      return;
+    }
+    for (size_t i = 0; i < kNumClasses; ++i) {
+      heat_[i].bytes.store(pending_[i].bytes, std::memory_order_relaxed);
+      heat_[i].idle_bytes.store(pending_[i].idle_bytes,
+                                std::memory_order_relaxed);
+    }
+    last_round_ = now;
+  }
+
+  uint64_t bytes(size_t size_class) const {
+    return heat_[size_class].bytes.load(std::memory_order_relaxed);
+  }
+  uint64_t idle_bytes(size_t size_class) const {
+    return heat_[size_class].idle_bytes.load(std::memory_order_relaxed);
+  }
+
+  void PrintInPbtxt(PbtxtRegion& region, const SizeMap& sizemap) const {
+    region.PrintI64("rounds", rounds_.value());
+    region.PrintI64("unavailable_rounds", unavailable_rounds_.value());
+    for (size_t i = 0; i < kNumClasses; ++i) {
+      const uint64_t b = bytes(i);
+      if (b == 0) continue;
+      PbtxtRegion entry = region.CreateSubRegion("size_class");
+      entry.PrintI64("size_class", i);
+      entry.PrintI64("object_size", sizemap.class_to_size(i));
+      entry.PrintI64("bytes", b);
+      entry.PrintI64("idle_bytes", idle_bytes(i));
+    }
+  }
+
+ private:
+  struct Heat {
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> idle_bytes{0};
+  };
+
+  struct Pending {
+    uint64_t bytes = 0;
+    uint64_t idle_bytes = 0;
+  };
+
+  Heat heat_[kNumClasses] = {};
+  Pending pending_[kNumClasses] = {};
+  absl::Time last_round_ = absl::InfinitePast();
+
+  StatsCounter rounds_;
+  StatsCounter unavailable_rounds_;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_ACCESS_HEATMAP_H_
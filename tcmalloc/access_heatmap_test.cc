@@ -0,0 +1,73 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/access_heatmap.h"
+
+#include <memory>
+
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+TEST(AccessHeatmapTest, PublishesRounds) {
+  auto heatmap = std::make_unique<AccessHeatmap>();
+  EXPECT_EQ(heatmap->last_round(), absl::InfinitePast());
+
+  const absl::Time t1 = absl::FromUnixSeconds(1000);
+  heatmap->BeginRound();
+  heatmap->Record(1, 100, 25);
+  heatmap->Record(1, 100, 75);
+  heatmap->Record(2, 50, 0);
+  // Nothing is visible before the round ends.
+  EXPECT_EQ(heatmap->bytes(1), 0);
+  heatmap->EndRound(t1, /*available=*/true);
+  EXPECT_EQ(heatmap->last_round(), t1);
+  EXPECT_EQ(heatmap->bytes(1), 200);
+  EXPECT_EQ(heatmap->idle_bytes(1), 100);
+  EXPECT_EQ(heatmap->bytes(2), 50);
+  EXPECT_EQ(heatmap->idle_bytes(2), 0);
+
+  // A round replaces the previous one.
+  const absl::Time t2 = t1 + absl::Seconds(30);
+  heatmap->BeginRound();
+  heatmap->Record(2, 10, 10);
+  heatmap->EndRound(t2, /*available=*/true);
+  EXPECT_EQ(heatmap->last_round(), t2);
+  EXPECT_EQ(heatmap->bytes(1), 0);
+  EXPECT_EQ(heatmap->bytes(2), 10);
+  EXPECT_EQ(heatmap->idle_bytes(2), 10);
+}
+
+TEST(AccessHeatmapTest, UnavailableRoundKeepsResults) {
+  auto heatmap = std::make_unique<AccessHeatmap>();
+  const absl::Time t = absl::FromUnixSeconds(1000);
+  heatmap->BeginRound();
+  heatmap->Record(3, 64, 32);
+  heatmap->EndRound(t, /*available=*/true);
+
+  heatmap->BeginRound();
+  heatmap->Record(3, 1, 1);
+  heatmap->EndRound(t + absl::Seconds(30), /*available=*/false);
+  EXPECT_EQ(heatmap->bytes(3), 64);
+  EXPECT_EQ(heatmap->idle_bytes(3), 32);
+  // The pages were not all marked, so the next round must not read them.
+  EXPECT_EQ(heatmap->last_round(), absl::InfinitePast());
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -0,0 +1,214 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_ACCESS_HINT_AUDITOR_H_
+#define TCMALLOC_ACCESS_HINT_AUDITOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Checks the hot/cold hints passed to operator new against how the memory is
+// actually accessed.
+//
+// Call sites are identified by the return address of the hinted operator new,
+// and are folded into a fixed-size table of saturating counters, one table per
+// hint.  Each live sampled allocation whose pages went idle moves its site's
+// counter up, each one whose pages were touched moves it down.  A site with a
+// cold hint whose counter reaches -kMinVotes is observed to be hot, and a site
+// with a hot hint whose counter reaches kMinVotes is observed to be cold.
+//
+// Record() must not be called concurrently; IsCold() may be called from any
+// thread.
+class AccessHintAuditor {
+ public:
+  static constexpr size_t kTableSize = 1024;
+  // Counters saturate at +/-kMaxVotes and verdicts require at least kMinVotes
+  // in one direction.
+  static constexpr int8_t kMaxVotes = 16;
+  static constexpr int8_t kMinVotes = 4;
+  // The number of mispredicted sites listed by Print and PrintInPbtxt.
+  static constexpr int kMaxPrintedSites = 16;
+
+  constexpr AccessHintAuditor() = default;
+  AccessHintAuditor(const AccessHintAuditor&) = delete;
+  AccessHintAuditor& operator=(const AccessHintAuditor&) = delete;
+
+  // Records that a live object allocated from `site` with a cold hint (or a
+  // hot one) was, or was not, left idle for a full staleness scan period.
+  void Record(const void* site, bool hinted_cold, bool idle) {
+    Site& s = sites_[hinted_cold][Index(site)];
+    const uintptr_t key = reinterpret_cast<uintptr_t>(site);
+    int8_t v = s.votes.load(std::memory_order_relaxed);
+    if (s.key.load(std::memory_order_relaxed) != key) {
+      // Another site holds the slot.  Wear down its evidence before taking
+      // over, so that one stray sample does not evict a confident verdict.
+      if (v >= kMinVotes || v <= -kMinVotes) {
+        s.votes.store(v > 0 ? v - 1 : v + 1, std::memory_order_relaxed);
+        return;
+      }
+      v = 0;
+      s.votes.store(0, std::memory_order_relaxed);
+      s.key.store(key, std::memory_order_release);
+    }
+    if (idle) {
+      if (v < kMaxVotes) s.votes.store(v + 1, std::memory_order_relaxed);
+    } else {
+      if (v > -kMaxVotes) s.votes.store(v - 1, std::memory_order_relaxed);
+    }
+  }
+
+  // Records one pass over the live sampled allocations, which found `samples`
+  // hinted objects old enough to judge.  `available` is false if the kernel
+  // does not expose page staleness, in which case nothing was recorded.
+  void RecordAudit(size_t samples, bool available) {
+    audits_.Add(1);
+    if (available) {
+      audited_samples_.Add(samples);
+    } else {
+      unavailable_audits_.Add(1);
+    }
+  }
+
+  // The period of the kernel's staleness scan, or 0 if no page has been seen
+  // to go stale yet.
+  uint64_t stale_scan_seconds() const {
+    return stale_scan_seconds_.load(std::memory_order_relaxed);
+  }
+  void set_stale_scan_seconds(uint64_t seconds) {
+    stale_scan_seconds_.store(seconds, std::memory_order_relaxed);
+  }
+
+  // Returns whether allocations from `site` should be placed on cold memory,
+  // given the hint they were made with.  The hint is overridden only for sites
+  // with a confident verdict against it.
+  bool IsCold(const void* site, bool hinted_cold) const {
+    const Site& s = sites_[hinted_cold][Index(site)];
+    if (s.key.load(std::memory_order_acquire) !=
+        reinterpret_cast<uintptr_t>(site)) {
+      return hinted_cold;
+    }
+    const int8_t v = s.votes.load(std::memory_order_relaxed);
+    if (hinted_cold) return v > -kMinVotes;
+    return v >= kMinVotes;
+  }
+
+  void Print(Printer& out) const {
+    out.printf(
+        "Access hint audits: %zu (%zu without page staleness), %zu samples, "
+        "%zu s scan period\n",
+        audits_.value(), unavailable_audits_.value(), audited_samples_.value(),
+        static_cast<size_t>(stale_scan_seconds()));
+    for (bool hinted_cold : {true, false}) {
+      const Summary summary = Summarize(hinted_cold);
+      out.printf("Access hint sites: %zu %s-hinted, %zu observed %s\n",
+                 summary.sites, hinted_cold ? "cold" : "hot",
+                 summary.mispredicted, hinted_cold ? "hot" : "cold");
+      int printed = 0;
+      for (const Site& s : sites_[hinted_cold]) {
+        if (printed == kMaxPrintedSites) break;
+        if (!Mispredicted(s, hinted_cold)) continue;
+        const uintptr_t key = s.key.load(std::memory_order_relaxed);
+        out.printf("  %s-hinted site %p observed %s (%d votes)\n",
+                   hinted_cold ? "cold" : "hot", reinterpret_cast<void*>(key),
+                   hinted_cold ? "hot" : "cold",
+                   s.votes.load(std::memory_order_relaxed));
+        ++printed;
+      }
+    }
+  }
+
+  void PrintInPbtxt(PbtxtRegion& region) const {
+    region.PrintI64("audits", audits_.value());
+    region.PrintI64("unavailable_audits", unavailable_audits_.value());
+    region.PrintI64("audited_samples", audited_samples_.value());
+    region.PrintI64("stale_scan_seconds", stale_scan_seconds());
+    const Summary cold = Summarize(true), hot = Summarize(false);
+    region.PrintI64("cold_hinted_sites", cold.sites);
+    region.PrintI64("cold_hinted_sites_observed_hot", cold.mispredicted);
+    region.PrintI64("hot_hinted_sites", hot.sites);
+    region.PrintI64("hot_hinted_sites_observed_cold", hot.mispredicted);
+    for (bool hinted_cold : {true, false}) {
+      int printed = 0;
+      for (const Site& s : sites_[hinted_cold]) {
+        if (printed == kMaxPrintedSites) break;
+        if (!Mispredicted(s, hinted_cold)) continue;
+        PbtxtRegion entry = region.CreateSubRegion("mispredicted_site");
+        entry.PrintI64("address", s.key.load(std::memory_order_relaxed));
+        entry.PrintBool("hinted_cold", hinted_cold);
+        entry.PrintI64("votes", s.votes.load(std::memory_order_relaxed));
+        ++printed;
+      }
+    }
+  }
+
+ private:
+  struct Site {
+    std::atomic<uintptr_t> key{0};
+    // Positive votes are for idle memory, negative ones for accessed memory.
+    std::atomic<int8_t> votes{0};
+  };
+
+  struct Summary {
+    size_t sites = 0;
+    size_t mispredicted = 0;
+  };
+
+  static size_t Index(const void* site) {
+    uint64_t hash = reinterpret_cast<uintptr_t>(site);
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 32;
+    return hash % kTableSize;
+  }
+
+  static bool Mispredicted(const Site& s, bool hinted_cold) {
+    if (s.key.load(std::memory_order_relaxed) == 0) return false;
+    const int8_t v = s.votes.load(std::memory_order_relaxed);
+    return hinted_cold ? v <= -kMinVotes : v >= kMinVotes;
+  }
+
+  Summary Summarize(bool hinted_cold) const {
+    Summary summary;
+    for (const Site& s : sites_[hinted_cold]) {
+      if (s.key.load(std::memory_order_relaxed) == 0) continue;
+      ++summary.sites;
+      if (Mispredicted(s, hinted_cold)) ++summary.mispredicted;
+    }
+    return summary;
+  }
+
+  // Indexed by whether the site's hint was cold.
+  Site sites_[2][kTableSize] = {};
+
+  std::atomic<uint64_t> stale_scan_seconds_{0};
+
+  StatsCounter audits_;
+  StatsCounter unavailable_audits_;
+  StatsCounter audited_samples_;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_ACCESS_HINT_AUDITOR_H_
@@ -0,0 +1,98 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/access_hint_auditor.h"
+
+#include <string.h>
+
+#include <memory>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "tcmalloc/internal/logging.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+const void* Site(uintptr_t n) { return reinterpret_cast<const void*>(n); }
+
+TEST(AccessHintAuditorTest, OverridesAfterEnoughVotes) {
+  auto auditor = std::make_unique<AccessHintAuditor>();
+  const void* cold_but_hot = Site(0x1000);
+  const void* hot_but_cold = Site(0x2000);
+  const void* cold = Site(0x3000);
+
+  for (int i = 0; i < AccessHintAuditor::kMinVotes; ++i) {
+    EXPECT_TRUE(auditor->IsCold(cold_but_hot, true));
+    EXPECT_FALSE(auditor->IsCold(hot_but_cold, false));
+    auditor->Record(cold_but_hot, true, /*idle=*/false);
+    auditor->Record(hot_but_cold, false, /*idle=*/true);
+    auditor->Record(cold, true, /*idle=*/true);
+  }
+  EXPECT_FALSE(auditor->IsCold(cold_but_hot, true));
+  EXPECT_TRUE(auditor->IsCold(hot_but_cold, false));
+  EXPECT_TRUE(auditor->IsCold(cold, true));
+
+  // Verdicts only apply to the hint they were learned for.
+  EXPECT_FALSE(auditor->IsCold(cold, false));
+  EXPECT_TRUE(auditor->IsCold(hot_but_cold, true));
+}
+
+TEST(AccessHintAuditorTest, Saturates) {
+  auto auditor = std::make_unique<AccessHintAuditor>();
+  const void* site = Site(0x4000);
+  for (int i = 0; i < 10 * AccessHintAuditor::kMaxVotes; ++i) {
+    auditor->Record(site, true, /*idle=*/false);
+  }
+  EXPECT_FALSE(auditor->IsCold(site, true));
+
+  // Counters saturate, so a site whose behavior changes is re-learned after a
+  // bounded number of samples.
+  for (int i = 0; i < AccessHintAuditor::kMaxVotes; ++i) {
+    auditor->Record(site, true, /*idle=*/true);
+  }
+  EXPECT_TRUE(auditor->IsCold(site, true));
+}
+
+TEST(AccessHintAuditorTest, Stats) {
+  auto auditor = std::make_unique<AccessHintAuditor>();
+  const void* site = Site(0x5000);
+  for (int i = 0; i < AccessHintAuditor::kMinVotes; ++i) {
+    auditor->Record(site, true, /*idle=*/false);
+  }
+  auditor->Record(Site(0x6000), false, /*idle=*/false);
+  auditor->RecordAudit(AccessHintAuditor::kMinVotes + 1, true);
+  auditor->RecordAudit(0, false);
+  auditor->set_stale_scan_seconds(120);
+
+  std::string buffer(4096, '\0');
+  Printer printer(&buffer[0], buffer.size());
+  auditor->Print(printer);
+  buffer.resize(strlen(buffer.c_str()));
+  EXPECT_THAT(buffer, testing::HasSubstr("Access hint audits: 2 (1 without "
+                                         "page staleness), 5 samples, 120 s "
+                                         "scan period"));
+  EXPECT_THAT(buffer, testing::HasSubstr(
+                          "Access hint sites: 1 cold-hinted, 1 observed hot"));
+  EXPECT_THAT(buffer, testing::HasSubstr(
+                          "Access hint sites: 1 hot-hinted, 0 observed cold"));
+  EXPECT_THAT(buffer, testing::HasSubstr("cold-hinted site 0x5000 observed "
+                                         "hot (-4 votes)"));
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -0,0 +1,94 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/adaptive_sampling.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "absl/time/time.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/parameters.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+int64_t Clamp(int64_t interval, int64_t base) {
+  constexpr int64_t kMaxScale = AdaptiveSamplingInterval::kMaxScale;
+  return std::clamp(interval, std::max<int64_t>(base / kMaxScale, 1),
+                    base * kMaxScale);
+}
+
+}  // namespace
+
+int64_t AdaptiveSamplingInterval::interval() const {
+  const int64_t base = Parameters::profile_sampling_interval();
+  if (base <= 0 || Parameters::profile_sampling_target_rate() <= 0) {
+    return base;
+  }
+  const int64_t adapted = interval_.load(std::memory_order_relaxed);
+  // The base interval may have changed since the last update.
+  return adapted > 0 ? Clamp(adapted, base) : base;
+}
+
+void AdaptiveSamplingInterval::Update(absl::Time now, int64_t samples) {
+  const absl::Duration elapsed = now - last_update_;
+  const int64_t taken = samples - last_samples_;
+  last_update_ = now;
+  last_samples_ = samples;
+
+  const int64_t base = Parameters::profile_sampling_interval();
+  const int32_t target = Parameters::profile_sampling_target_rate();
+  if (base <= 0 || target <= 0) {
+    interval_.store(0, std::memory_order_relaxed);
+    return;
+  }
+  if (elapsed <= absl::ZeroDuration() || elapsed == absl::InfiniteDuration()) {
+    return;
+  }
+
+  // The sample rate is inversely proportional to the interval, so the
+  // interval that would have met the target is proportional to the rate.
+  const double rate = taken / absl::ToDoubleSeconds(elapsed);
+  rate_.store(rate, std::memory_order_relaxed);
+  const double scale = std::clamp(rate / target, 0.5, 2.0);
+  const int64_t current = interval();
+  interval_.store(Clamp(static_cast<int64_t>(current * scale), base),
+                  std::memory_order_relaxed);
+}
+
+void AdaptiveSamplingInterval::Print(Printer& out) const {
+  const int32_t target = Parameters::profile_sampling_target_rate();
+  if (target <= 0) return;
+  out.printf(
+      "MALLOC: adaptive sampling interval %lld bytes; %.1f samples/s "
+      "(target %d)\n",
+      interval(), rate_.load(std::memory_order_relaxed), target);
+}
+
+void AdaptiveSamplingInterval::PrintInPbtxt(PbtxtRegion& region) const {
+  region.PrintI64("interval", interval());
+  region.PrintDouble("samples_per_second",
+                     rate_.load(std::memory_order_relaxed));
+  region.PrintI64("target_samples_per_second",
+                  Parameters::profile_sampling_target_rate());
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,75 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_ADAPTIVE_SAMPLING_H_
+#define TCMALLOC_ADAPTIVE_SAMPLING_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "absl/time/time.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Scales the profile sampling interval so that the process takes about
+// Parameters::profile_sampling_target_rate() samples per second.
+//
+// The background thread measures the sample rate and moves the interval
+// towards the one that would have met the target, by at most a factor of 2 per
+// update.  Threads pick up the new interval when they next choose a sampling
+// point, and weigh their samples by the interval they sampled with, so
+// profiles remain unbiased while the interval changes.  The interval is kept
+// within kMaxScale of Parameters::profile_sampling_interval(), which bounds
+// both the cost of sampling and the variance of profiles.
+class AdaptiveSamplingInterval {
+ public:
+  static constexpr int64_t kMaxScale = 16;
+
+  constexpr AdaptiveSamplingInterval() = default;
+  AdaptiveSamplingInterval(const AdaptiveSamplingInterval&) = delete;
+  AdaptiveSamplingInterval& operator=(const AdaptiveSamplingInterval&) =
+      delete;
+
+  // Returns the interval to sample at: the adapted one while a target rate is
+  // set, otherwise Parameters::profile_sampling_interval().
+  int64_t interval() const;
+
+  // Adapts the interval to the sample rate since the last call, given that
+  // `samples` samples were taken in total by `now`.  Called periodically by
+  // the background thread.
+  void Update(absl::Time now, int64_t samples);
+
+  void Print(Printer& out) const;
+  void PrintInPbtxt(PbtxtRegion& region) const;
+
+ private:
+  // 0 until the first update with a target rate set.
+  std::atomic<int64_t> interval_{0};
+  // Sample rate measured by the last update, in samples per second.
+  std::atomic<double> rate_{0};
+
+  // Only accessed by the background thread.
+  absl::Time last_update_ = absl::InfinitePast();
+  int64_t last_samples_ = 0;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_ADAPTIVE_SAMPLING_H_
@@ -0,0 +1,118 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/adaptive_sampling.h"
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "tcmalloc/parameters.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+class AdaptiveSamplingIntervalTest : public testing::Test {
+ protected:
+  static constexpr int64_t kBase = 1 << 20;
+
+  AdaptiveSamplingIntervalTest()
+      : old_interval_(Parameters::profile_sampling_interval()),
+        old_target_(Parameters::profile_sampling_target_rate()) {
+    Parameters::set_profile_sampling_interval(kBase);
+    Parameters::set_profile_sampling_target_rate(100);
+  }
+
+  ~AdaptiveSamplingIntervalTest() override {
+    Parameters::set_profile_sampling_interval(old_interval_);
+    Parameters::set_profile_sampling_target_rate(old_target_);
+  }
+
+  // Advances by a second, in which `samples` samples were taken.
+  void Step(int64_t samples) {
+    now_ += absl::Seconds(1);
+    samples_ += samples;
+    adaptive_.Update(now_, samples_);
+  }
+
+  AdaptiveSamplingInterval adaptive_;
+  absl::Time now_ = absl::Now();
+  int64_t samples_ = 0;
+
+ private:
+  const int64_t old_interval_;
+  const int32_t old_target_;
+};
+
+TEST_F(AdaptiveSamplingIntervalTest, Disabled) {
+  Parameters::set_profile_sampling_target_rate(0);
+  adaptive_.Update(now_, 0);
+  Step(1000);
+  EXPECT_EQ(adaptive_.interval(), kBase);
+}
+
+TEST_F(AdaptiveSamplingIntervalTest, TracksTarget) {
+  // The first update only establishes the baseline.
+  adaptive_.Update(now_, 0);
+  EXPECT_EQ(adaptive_.interval(), kBase);
+
+  // Twice the target rate doubles the interval.
+  Step(200);
+  EXPECT_EQ(adaptive_.interval(), 2 * kBase);
+  // Meeting the target keeps it.
+  Step(100);
+  EXPECT_EQ(adaptive_.interval(), 2 * kBase);
+  // Changes are limited to a factor of 2 per update.
+  Step(1000);
+  EXPECT_EQ(adaptive_.interval(), 4 * kBase);
+  Step(25);
+  EXPECT_EQ(adaptive_.interval(), 2 * kBase);
+}
+
+TEST_F(AdaptiveSamplingIntervalTest, Bounded) {
+  adaptive_.Update(now_, 0);
+  for (int i = 0; i < 20; ++i) {
+    Step(0);
+  }
+  EXPECT_EQ(adaptive_.interval(),
+            kBase / AdaptiveSamplingInterval::kMaxScale);
+
+  for (int i = 0; i < 20; ++i) {
+    Step(1000000);
+  }
+  EXPECT_EQ(adaptive_.interval(),
+            kBase * AdaptiveSamplingInterval::kMaxScale);
+
+  // The bounds follow the base interval.
+  Parameters::set_profile_sampling_interval(kBase / 2);
+  EXPECT_EQ(adaptive_.interval(),
+            kBase / 2 * AdaptiveSamplingInterval::kMaxScale);
+}
+
+TEST_F(AdaptiveSamplingIntervalTest, Reset) {
+  adaptive_.Update(now_, 0);
+  Step(400);
+  EXPECT_NE(adaptive_.interval(), kBase);
+
+  Parameters::set_profile_sampling_target_rate(0);
+  Step(400);
+  Parameters::set_profile_sampling_target_rate(100);
+  EXPECT_EQ(adaptive_.interval(), kBase);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
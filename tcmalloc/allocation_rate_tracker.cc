@@ -0,0 +1,222 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/allocation_rate_tracker.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+uint32_t SaturatingDelta(int64_t now, int64_t then) {
+  return std::clamp<int64_t>(now - then, 0,
+                             std::numeric_limits<uint32_t>::max());
+}
+
+// Heap partition of a size class.  Cold and page-level allocations are
+// counted in partition 0.
+int PartitionOf(size_t size_class) {
+  return size_class < kExpandedClassesStart ? size_class / kNumBaseClasses : 0;
+}
+
+bool IsCold(size_t size_class) { return size_class >= kExpandedClassesStart; }
+
+}  // namespace
+
+void AllocationRateTracker::Update(absl::Time now) {
+  absl::MutexLock l(&mu_);
+  if (epochs_ == nullptr) {
+    epochs_ = static_cast<Epoch*>(tc_globals.arena().Alloc(
+        sizeof(Epoch) * kEpochs, std::align_val_t{alignof(Epoch)}));
+  } else if (now - epoch_start_ < kEpochLength) {
+    return;
+  } else {
+    Epoch& epoch = epochs_[closed_ % kEpochs];
+    epoch.start = epoch_start_;
+    epoch.duration = now - epoch_start_;
+    for (size_t i = 0; i < kNumClasses; ++i) {
+      epoch.allocated_objects[i] = SaturatingDelta(
+          counts_[i].allocated_objects.value(), last_allocated_objects_[i]);
+      epoch.freed_objects[i] = SaturatingDelta(counts_[i].freed_objects.value(),
+                                               last_freed_objects_[i]);
+    }
+    epoch.large_allocated_bytes = std::max<int64_t>(
+        counts_[0].allocated_bytes.value() - last_large_allocated_bytes_, 0);
+    epoch.large_freed_bytes = std::max<int64_t>(
+        counts_[0].freed_bytes.value() - last_large_freed_bytes_, 0);
+    for (size_t t = 0; t < kNumTokens; ++t) {
+      epoch.token_allocated_bytes[t] = std::max<int64_t>(
+          token_counts_[t].allocated_bytes.value() -
+              last_token_allocated_bytes_[t],
+          0);
+      epoch.token_freed_bytes[t] = std::max<int64_t>(
+          token_counts_[t].freed_bytes.value() - last_token_freed_bytes_[t],
+          0);
+    }
+    ++closed_;
+  }
+
+  // Start a new epoch.  If the history was disabled for a while, the epoch
+  // closed above covers the gap, as its duration shows.
+  epoch_start_ = now;
+  for (size_t i = 0; i < kNumClasses; ++i) {
+    last_allocated_objects_[i] = counts_[i].allocated_objects.value();
+    last_freed_objects_[i] = counts_[i].freed_objects.value();
+  }
+  last_large_allocated_bytes_ = counts_[0].allocated_bytes.value();
+  last_large_freed_bytes_ = counts_[0].freed_bytes.value();
+  for (size_t t = 0; t < kNumTokens; ++t) {
+    last_token_allocated_bytes_[t] = token_counts_[t].allocated_bytes.value();
+    last_token_freed_bytes_[t] = token_counts_[t].freed_bytes.value();
+  }
+}
+
+void AllocationRateTracker::GetHistory(
+    std::vector<MallocExtension::AllocationRateEpoch>& history) const {
+  absl::MutexLock l(&mu_);
+  if (epochs_ == nullptr) return;
+
+  const size_t retained = std::min(closed_, kEpochs);
+  history.reserve(history.size() + retained);
+  for (size_t n = closed_ - retained; n < closed_; ++n) {
+    const Epoch& epoch = epochs_[n % kEpochs];
+    MallocExtension::AllocationRateEpoch& out = history.emplace_back();
+    out.start = epoch.start;
+    out.duration = epoch.duration;
+    for (size_t i = 0; i < kNumClasses; ++i) {
+      if (epoch.allocated_objects[i] == 0 && epoch.freed_objects[i] == 0) {
+        continue;
+      }
+      const size_t size = i == 0 ? 0 : tc_globals.sizemap().class_to_size(i);
+      const uint64_t allocated_bytes =
+          i == 0 ? epoch.large_allocated_bytes
+                 : uint64_t{epoch.allocated_objects[i]} * size;
+      const uint64_t freed_bytes =
+          i == 0 ? epoch.large_freed_bytes
+                 : uint64_t{epoch.freed_objects[i]} * size;
+      out.size_classes.push_back({
+          .size = size,
+          .partition = PartitionOf(i),
+          .cold = IsCold(i),
+          .allocated_objects = epoch.allocated_objects[i],
+          .allocated_bytes = allocated_bytes,
+          .freed_objects = epoch.freed_objects[i],
+          .freed_bytes = freed_bytes,
+      });
+    }
+    for (size_t t = 0; t < kNumTokens; ++t) {
+      if (epoch.token_allocated_bytes[t] == 0 &&
+          epoch.token_freed_bytes[t] == 0) {
+        continue;
+      }
+      out.alloc_tokens.push_back({
+          .token_id = static_cast<TokenId>(t),
+          .allocated_bytes = epoch.token_allocated_bytes[t],
+          .freed_bytes = epoch.token_freed_bytes[t],
+      });
+    }
+  }
+}
+
+void AllocationRateTracker::PrintAllocTokens(Printer& out) const {
+  static constexpr double MiB = 1048576.0;
+  out.printf("------------------------------------------------\n");
+  out.printf("Alloc token usage, estimated from sampled allocations\n");
+  out.printf("------------------------------------------------\n");
+  for (size_t t = 0; t < kNumTokens; ++t) {
+    const Counts& counts = token_counts_[t];
+    const int64_t allocated_bytes = counts.allocated_bytes.value();
+    if (allocated_bytes == 0) continue;
+    const int64_t live_bytes = allocated_bytes - counts.freed_bytes.value();
+    const int64_t live_objects =
+        counts.allocated_objects.value() - counts.freed_objects.value();
+    out.printf(
+        "token %2u: %12lld live bytes (%7.1f MiB) in %10lld objects; "
+        "%14lld bytes allocated\n",
+        t, live_bytes, live_bytes / MiB, live_objects, allocated_bytes);
+  }
+}
+
+void AllocationRateTracker::PrintInPbtxt(PbtxtRegion& region) const {
+  {
+    absl::MutexLock l(&mu_);
+    region.PrintI64("retained_epochs", std::min(closed_, kEpochs));
+  }
+  region.PrintI64("epoch_seconds", absl::ToInt64Seconds(kEpochLength));
+
+  // Totals since startup, estimated from sampled allocations.
+  int64_t partition_totals[kNormalPartitions][4] = {};
+  for (size_t i = 0; i < kNumClasses; ++i) {
+    const Counts& counts = counts_[i];
+    const int64_t values[4] = {
+        counts.allocated_objects.value(), counts.allocated_bytes.value(),
+        counts.freed_objects.value(), counts.freed_bytes.value()};
+    if (values[0] == 0 && values[2] == 0) continue;
+    for (int j = 0; j < 4; ++j) {
+      partition_totals[PartitionOf(i)][j] += values[j];
+    }
+
+    PbtxtRegion entry = region.CreateSubRegion("size_class");
+    entry.PrintI64("size_class", i);
+    entry.PrintI64("size", i == 0 ? 0 : tc_globals.sizemap().class_to_size(i));
+    entry.PrintI64("partition", PartitionOf(i));
+    entry.PrintBool("cold", IsCold(i));
+    entry.PrintI64("allocated_objects", values[0]);
+    entry.PrintI64("allocated_bytes", values[1]);
+    entry.PrintI64("freed_objects", values[2]);
+    entry.PrintI64("freed_bytes", values[3]);
+  }
+  for (size_t p = 0; p < kNormalPartitions; ++p) {
+    PbtxtRegion entry = region.CreateSubRegion("partition");
+    entry.PrintI64("partition", p);
+    entry.PrintI64("allocated_objects", partition_totals[p][0]);
+    entry.PrintI64("allocated_bytes", partition_totals[p][1]);
+    entry.PrintI64("freed_objects", partition_totals[p][2]);
+    entry.PrintI64("freed_bytes", partition_totals[p][3]);
+  }
+  for (size_t t = 0; t < kNumTokens; ++t) {
+    const Counts& counts = token_counts_[t];
+    if (counts.allocated_objects.value() == 0 &&
+        counts.freed_objects.value() == 0) {
+      continue;
+    }
+    PbtxtRegion entry = region.CreateSubRegion("alloc_token");
+    entry.PrintI64("token_id", t);
+    entry.PrintI64("allocated_objects", counts.allocated_objects.value());
+    entry.PrintI64("allocated_bytes", counts.allocated_bytes.value());
+    entry.PrintI64("freed_objects", counts.freed_objects.value());
+    entry.PrintI64("freed_bytes", counts.freed_bytes.value());
+    entry.PrintI64("live_bytes",
+                   counts.allocated_bytes.value() - counts.freed_bytes.value());
+  }
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,140 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_ALLOCATION_RATE_TRACKER_H_
+#define TCMALLOC_ALLOCATION_RATE_TRACKER_H_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/base/const_init.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Tracks the allocation and deallocation traffic of each size class and alloc
+// token (TokenId) and, while Parameters::allocation_rate_history() is enabled,
+// keeps a ring of it over the last kEpochs epochs of kEpochLength.
+//
+// The traffic is estimated from sampled allocations, each of which stands for
+// weight / (requested_size + 1) objects as in heap profiles.  This keeps the
+// allocation fast path free of counters, at the cost of precision for rarely
+// used size classes.  Index 0, which is not a size class, counts page-level
+// allocations.
+class AllocationRateTracker {
+ public:
+  static constexpr absl::Duration kEpochLength = absl::Seconds(10);
+  static constexpr size_t kEpochs = 360;
+  static constexpr size_t kNumTokens =
+      static_cast<size_t>(TokenId::kNoAllocToken) + 1;
+
+  constexpr AllocationRateTracker() : mu_(absl::kConstInit) {}
+  AllocationRateTracker(const AllocationRateTracker&) = delete;
+  AllocationRateTracker& operator=(const AllocationRateTracker&) = delete;
+
+  // Records a sampled allocation or deallocation from `size_class` with
+  // `token` that stands for `objects` objects of `size` bytes.
+  void RecordAllocation(size_t size_class, TokenId token, double objects,
+                        size_t size) {
+    Record(counts_[size_class].allocated_objects,
+           counts_[size_class].allocated_bytes, objects, size);
+    Counts& token_counts = token_counts_[static_cast<size_t>(token)];
+    Record(token_counts.allocated_objects, token_counts.allocated_bytes,
+           objects, size);
+  }
+  void RecordDeallocation(size_t size_class, TokenId token, double objects,
+                          size_t size) {
+    Record(counts_[size_class].freed_objects, counts_[size_class].freed_bytes,
+           objects, size);
+    Counts& token_counts = token_counts_[static_cast<size_t>(token)];
+    Record(token_counts.freed_objects, token_counts.freed_bytes, objects,
+           size);
+  }
+
+  // Closes the current epoch once kEpochLength has passed since it started.
+  // Called periodically by the background thread while the history is
+  // enabled.
+  void Update(absl::Time now) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Appends the retained epochs to `history`, oldest first.
+  void GetHistory(
+      std::vector<MallocExtension::AllocationRateEpoch>& history) const
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Prints the estimated live and allocated bytes of each alloc token.
+  void PrintAllocTokens(Printer& out) const;
+
+  void PrintInPbtxt(PbtxtRegion& region) const ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  struct Counts {
+    StatsCounter allocated_objects;
+    StatsCounter allocated_bytes;
+    StatsCounter freed_objects;
+    StatsCounter freed_bytes;
+  };
+
+  // Objects of a size class have a fixed size, so epochs only keep the byte
+  // counts of page-level allocations.  Object counts saturate.
+  struct Epoch {
+    absl::Time start;
+    absl::Duration duration;
+    uint64_t large_allocated_bytes;
+    uint64_t large_freed_bytes;
+    uint32_t allocated_objects[kNumClasses];
+    uint32_t freed_objects[kNumClasses];
+    uint64_t token_allocated_bytes[kNumTokens];
+    uint64_t token_freed_bytes[kNumTokens];
+  };
+
+  static void Record(StatsCounter& objects_counter, StatsCounter& bytes_counter,
+                     double objects, size_t size) {
+    objects_counter.Add(std::llround(objects));
+    bytes_counter.Add(std::llround(objects * size));
+  }
+
+  Counts counts_[kNumClasses];
+  Counts token_counts_[kNumTokens];
+
+  mutable absl::Mutex mu_;
+  // Allocated from the arena the first time the history is enabled.
+  Epoch* epochs_ ABSL_GUARDED_BY(mu_) = nullptr;
+  // Number of epochs ever closed.
+  size_t closed_ ABSL_GUARDED_BY(mu_) = 0;
+  absl::Time epoch_start_ ABSL_GUARDED_BY(mu_);
+  // counts_ as of epoch_start_.
+  int64_t last_allocated_objects_[kNumClasses] ABSL_GUARDED_BY(mu_) = {};
+  int64_t last_freed_objects_[kNumClasses] ABSL_GUARDED_BY(mu_) = {};
+  int64_t last_large_allocated_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+  int64_t last_large_freed_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+  int64_t last_token_allocated_bytes_[kNumTokens] ABSL_GUARDED_BY(mu_) = {};
+  int64_t last_token_freed_bytes_[kNumTokens] ABSL_GUARDED_BY(mu_) = {};
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_ALLOCATION_RATE_TRACKER_H_
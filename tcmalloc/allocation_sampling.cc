@@ -14,25 +14,34 @@
 
 #include "tcmalloc/allocation_sampling.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <utility>
+#include <vector>
 
+#include "absl/algorithm/container.h"
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
 #include "absl/debugging/stacktrace.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "tcmalloc/access_heatmap.h"
+#include "tcmalloc/access_hint_auditor.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/cpu_cache.h"
 #include "tcmalloc/error_reporting.h"
 #include "tcmalloc/guarded_allocations.h"
+#include "tcmalloc/huge_page_filler.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/exponential_biased.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/page_idle.h"
+#include "tcmalloc/internal/pageflags.h"
 #include "tcmalloc/internal/sampled_allocation.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/malloc_hook.h"
@@ -42,6 +51,7 @@
 #include "tcmalloc/span.h"
 #include "tcmalloc/stack_trace_table.h"
 #include "tcmalloc/static_vars.h"
+#include "tcmalloc/stats.h"
 #include "tcmalloc/tcmalloc_policy.h"
 #include "tcmalloc/thread_cache.h"
 
@@ -53,10 +63,215 @@ std::unique_ptr<const ProfileBase> DumpHeapProfile(Static& state) {
   profile->SetStartTime(absl::Now());
   state.sampled_allocation_recorder().Iterate(
       [&](const SampledAllocation& sampled_allocation) {
-        profile->AddTrace(1.0, sampled_allocation.sampled_stack);
+        profile->AddTrace(1.0, state.stack_depot().Restore(
+                                   sampled_allocation.sampled_stack,
+                                   sampled_allocation.stack_id));
       });
   return profile;
 }
 
+std::unique_ptr<const ProfileBase> DumpHeapProfileDelta(
+    Static& state, std::vector<AllocHandle>& live,
+    std::vector<AllocHandle>& removed) {
+  TC_ASSERT(absl::c_is_sorted(live));
+  auto profile = std::make_unique<StackTraceTable>(ProfileType::kHeap);
+  profile->SetStartTime(absl::Now());
+  // We cannot allocate while iterating over the recorder, so survivors are
+  // marked in storage sized up front.
+  std::vector<bool> survived(live.size(), false);
+  state.sampled_allocation_recorder().Iterate(
+      [&](const SampledAllocation& sampled_allocation) {
+        const StackTraceInfo& stack = sampled_allocation.sampled_stack;
+        auto it = absl::c_lower_bound(live, stack.sampled_alloc_handle);
+        if (it != live.end() && *it == stack.sampled_alloc_handle) {
+          survived[it - live.begin()] = true;
+        } else {
+          profile->AddTrace(1.0, state.stack_depot().Restore(
+                                     stack, sampled_allocation.stack_id));
+        }
+      });
+
+  removed.clear();
+  std::vector<AllocHandle> next;
+  next.reserve(live.size());
+  for (size_t i = 0; i < live.size(); ++i) {
+    (survived[i] ? next : removed).push_back(live[i]);
+  }
+  profile->Iterate([&](const Profile::Sample& sample) {
+    next.push_back(sample.alloc_handle);
+  });
+  absl::c_sort(next);
+  live = std::move(next);
+  return profile;
+}
+
+namespace {
+
+// Returns the unused bytes pinned by a sampled page heap allocation: the
+// rounding up of its span and, while the hugepage it starts on is shared in
+// the HugePageFiller, its share of that hugepage's free but backed pages.
+double PageHeapAllocationUnusedBytes(Static& state, const StackTrace& stack) {
+  double unused = stack.allocated_size > stack.requested_size
+                      ? stack.allocated_size - stack.requested_size
+                      : 0;
+  if (stack.span_start_address == nullptr ||
+      stack.guarded_status == Profile::Sample::GuardedStatus::Guarded) {
+    return unused;
+  }
+
+  const Length span_pages = BytesToLengthCeil(stack.allocated_size);
+  PageHeapSpinLockHolder l;
+  const PageTracker* pt = static_cast<const PageTracker*>(
+      state.pagemap().GetHugepage(PageIdContaining(stack.span_start_address)));
+  if (pt == nullptr || pt->used_pages() == Length(0) ||
+      pt->free_pages() <= pt->released_pages()) {
+    return unused;
+  }
+  const Length backed_free = pt->free_pages() - pt->released_pages();
+  unused += static_cast<double>(backed_free.in_bytes()) *
+            std::min(span_pages, pt->used_pages()).raw_num() /
+            pt->used_pages().raw_num();
+  return unused;
+}
+
+}  // namespace
+
+std::unique_ptr<const ProfileBase> DumpRealizedFragmentationProfile(
+    Static& state) {
+  // The sampled object of a size class lives on a span of its own, so it
+  // stands for the unsampled objects of its size class: each is charged the
+  // free objects and tail of the spans of the size class, spread over the
+  // allocated objects.
+  double span_unused_per_object[kNumClasses] = {};
+  for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+    const auto& central_freelist = state.central_freelist(size_class);
+    const size_t capacity = central_freelist.GetSpanStats().obj_capacity;
+    const size_t free_objects = central_freelist.length();
+    if (capacity <= free_objects) continue;
+    const size_t size = state.sizemap().class_to_size(size_class);
+    span_unused_per_object[size_class] =
+        static_cast<double>(free_objects * size +
+                            central_freelist.OverheadBytes()) /
+        (capacity - free_objects);
+  }
+
+  // Likewise, their spans are charged the free but backed pages of the page
+  // heap in proportion to their size.
+  double page_unused_per_byte = 0;
+  {
+    PageHeapSpinLockHolder l;
+    const BackingStats stats = state.page_allocator().stats();
+    const uint64_t used =
+        stats.system_bytes - stats.free_bytes - stats.unmapped_bytes;
+    if (used > 0) {
+      page_unused_per_byte = static_cast<double>(stats.free_bytes) / used;
+    }
+  }
+
+  auto profile =
+      std::make_unique<StackTraceTable>(ProfileType::kRealizedFragmentation);
+  profile->SetStartTime(absl::Now());
+  state.sampled_allocation_recorder().Iterate(
+      [&](const SampledAllocation& sampled_allocation) {
+        StackTrace stack = state.stack_depot().Restore(
+            sampled_allocation.sampled_stack, sampled_allocation.stack_id);
+        double unused;
+        if (stack.size_class != 0) {
+          const double span_unused = span_unused_per_object[stack.size_class];
+          unused = span_unused +
+                   page_unused_per_byte *
+                       (state.sizemap().class_to_size(stack.size_class) +
+                        span_unused);
+        } else {
+          unused = PageHeapAllocationUnusedBytes(state, stack);
+        }
+        // StackTraceTable reports allocated_size times the number of objects
+        // the sample stands for.
+        stack.allocated_size = std::llround(unused);
+        if (stack.allocated_size == 0) return;
+        profile->AddTrace(1.0, stack);
+      });
+  return profile;
+}
+
+void AuditAccessHints(Static& state, PageFlagsBase& pageflags,
+                      absl::Time now) {
+  AccessHintAuditor& auditor = state.access_hint_auditor();
+  // Objects that have not yet lived through a full staleness scan look hot no
+  // matter how they are accessed, so they are only judged once old enough.
+  const uint64_t scan_seconds = auditor.stale_scan_seconds();
+  const absl::Duration min_age = 2 * absl::Seconds(scan_seconds);
+  uint64_t observed_scan_seconds = 0;
+  size_t samples = 0;
+  bool available = true;
+  state.sampled_allocation_recorder().Iterate(
+      [&](const SampledAllocation& sampled_allocation) {
+        const StackTraceInfo& stack = sampled_allocation.sampled_stack;
+        if (!available || stack.access_site == nullptr ||
+            stack.span_start_address == nullptr) {
+          return;
+        }
+        std::optional<PageStats> stats =
+            pageflags.Get(stack.span_start_address, stack.allocated_size);
+        if (!stats.has_value()) {
+          available = false;
+          return;
+        }
+        if (stats->stale_scan_seconds != 0) {
+          observed_scan_seconds = stats->stale_scan_seconds;
+        }
+        // Until some page has been seen to go stale, we cannot tell idle
+        // memory from a kernel that does not scan for it.
+        if (scan_seconds == 0 || now - stack.allocation_time < min_age) {
+          return;
+        }
+        const bool hinted_cold =
+            hot_cold_t{stack.access_hint} < Parameters::min_hot_access_hint();
+        const bool idle = 2 * stats->bytes_stale >= stack.allocated_size;
+        auditor.Record(stack.access_site, hinted_cold, idle);
+        ++samples;
+      });
+  if (observed_scan_seconds != 0) {
+    auditor.set_stale_scan_seconds(observed_scan_seconds);
+  }
+  auditor.RecordAudit(samples, available);
+}
+
+void UpdateAccessHeatmap(Static& state, PageIdleBase& page_idle,
+                         absl::Time now) {
+  AccessHeatmap& heatmap = state.access_heatmap();
+  // Objects allocated since the previous round were not marked idle by it.
+  const absl::Time marked = heatmap.last_round();
+  bool available = true;
+  heatmap.BeginRound();
+  state.sampled_allocation_recorder().Iterate(
+      [&](const SampledAllocation& sampled_allocation) {
+        const StackTraceInfo& stack = sampled_allocation.sampled_stack;
+        if (!available || stack.span_start_address == nullptr ||
+            stack.allocated_size == 0) {
+          return;
+        }
+        if (stack.allocation_time < marked) {
+          std::optional<size_t> idle = page_idle.GetIdleBytes(
+              stack.span_start_address, stack.allocated_size);
+          if (!idle.has_value()) {
+            available = false;
+            return;
+          }
+          const uint64_t bytes = StackTraceTable::SampleCount(1.0, stack) *
+                                 stack.allocated_size;
+          heatmap.Record(stack.size_class, bytes,
+                         static_cast<uint64_t>(static_cast<double>(bytes) *
+                                               *idle / stack.allocated_size));
+        }
+        if (page_idle.MarkIdle(stack.span_start_address,
+                               stack.allocated_size) !=
+            absl::StatusCode::kOk) {
+          available = false;
+        }
+      });
+  heatmap.EndRound(now, available);
+}
+
 }  // namespace tcmalloc::tcmalloc_internal
 GOOGLE_MALLOC_SECTION_END
@@ -15,24 +15,36 @@
 #ifndef TCMALLOC_ALLOCATION_SAMPLING_H_
 #define TCMALLOC_ALLOCATION_SAMPLING_H_
 
+#include <cmath>
 #include <cstddef>
 #include <memory>
 #include <optional>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/debugging/stacktrace.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "tcmalloc/common.h"
 #include "tcmalloc/error_reporting.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/frame_pointer_unwinder.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/page_idle.h"
+#include "tcmalloc/internal/pageflags.h"
 #include "tcmalloc/internal/percpu.h"
+#include "tcmalloc/lifetime_predictor.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/malloc_hook.h"
 #include "tcmalloc/malloc_hook_invoke.h"
 #include "tcmalloc/pagemap.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/sampler.h"
+#include "tcmalloc/sizemap.h"
 #include "tcmalloc/span.h"
+#include "tcmalloc/stack_depot.h"
 #include "tcmalloc/tcmalloc_policy.h"
+#include "tcmalloc/tenant_tracker.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc::tcmalloc_internal {
@@ -40,6 +52,31 @@ namespace tcmalloc::tcmalloc_internal {
 class Static;
 
 std::unique_ptr<const ProfileBase> DumpHeapProfile(Static& state);
+
+// Like DumpHeapProfile, but only reports samples whose handles are not in
+// `live`, the sorted handles reported by the previous call.  Moves the handles
+// in `live` whose samples have been freed since into `removed`, and updates
+// `live` to the handles of all samples currently recorded.
+std::unique_ptr<const ProfileBase> DumpHeapProfileDelta(
+    Static& state, std::vector<AllocHandle>& live,
+    std::vector<AllocHandle>& removed);
+
+// Returns a profile of the sampled live objects, with each sample's
+// allocated_size replaced by the unused bytes attributed to the object (see
+// ProfileType::kRealizedFragmentation).  Samples with none are omitted.
+std::unique_ptr<const ProfileBase> DumpRealizedFragmentationProfile(
+    Static& state);
+
+// Checks the page staleness of the live sampled allocations made with a
+// hot/cold hint, and records in state.access_hint_auditor() whether each
+// call site's memory is accessed the way its hint said it would be.
+void AuditAccessHints(Static& state, PageFlagsBase& pageflags, absl::Time now);
+
+// Reads back which pages of the live sampled allocations went unaccessed since
+// the previous call, records them per size class in state.access_heatmap(),
+// and marks the pages idle again for the next call.
+void UpdateAccessHeatmap(Static& state, PageIdleBase& page_idle,
+                         absl::Time now);
 #if !TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
 // For RSEQ enabled builds, we declare the sampler in percpu.h so that we can
 // reference its address in percpu_tcmalloc.h without creating a circular
@@ -93,8 +130,18 @@ ABSL_ATTRIBUTE_NOINLINE sized_ptr_t SampleifyAllocation(
 
   StackTrace stack_trace;
   stack_trace.requested_size = requested_size;
-  // Grab the stack trace outside the heap lock.
-  stack_trace.depth = absl::GetStackTrace(stack_trace.stack, kMaxStackDepth, 0);
+  // Grab the stack trace outside the heap lock.  A frame pointer walk that
+  // stops right away means this binary lacks frame pointers, so fall back to
+  // the regular unwinder.
+  stack_trace.depth = 0;
+  if (Parameters::frame_pointer_unwinding()) {
+    stack_trace.depth = GetStackTraceWithFramePointers(stack_trace.stack,
+                                                       kMaxStackDepth, 0);
+  }
+  if (stack_trace.depth <= 1) {
+    stack_trace.depth =
+        absl::GetStackTrace(stack_trace.stack, kMaxStackDepth, 0);
+  }
 
   if (policy.has_explicit_alignment()) {
     stack_trace.requested_alignment = policy.align();
@@ -104,8 +151,11 @@ ABSL_ATTRIBUTE_NOINLINE sized_ptr_t SampleifyAllocation(
 
   stack_trace.requested_size_returning = policy.size_returning();
   stack_trace.access_hint = static_cast<uint8_t>(policy.access());
+  stack_trace.access_site = policy.access_site();
   stack_trace.weight = weight;
+  stack_trace.sampling_interval = Sampler::GetSampleInterval();
   stack_trace.token_id = policy.token_id();
+  stack_trace.tenant = current_tenant;
 
   // How many allocations does this sample represent, given the sampling
   // frequency (weight) and its size.
@@ -117,12 +167,27 @@ ABSL_ATTRIBUTE_NOINLINE sized_ptr_t SampleifyAllocation(
 
   const MemoryTag tag =
       Parameters::heap_partitioning_mode() == HeapPartitioningMode::kFull &&
-              policy.partition() == 1
+              policy.partition() != 0
           ? MemoryTag::kSampledP1
           : MemoryTag::kSampled;
   size_t capacity = 0;
+  stack_trace.size_class = size_class;
   if (size_class != 0) {
     state.per_size_class_counts()[size_class].Add(allocation_estimate);
+    if (policy.lifetime() != LifetimePrediction::kUnknown) {
+      // The caller told us how long the object lives, which is better than
+      // any prediction.
+      state.central_freelist(size_class)
+          .RecordLifetimePrediction(policy.lifetime());
+    } else if (Parameters::span_lifetime_prediction()) {
+      // The sampled object itself lives on its own span, but the prediction
+      // for its call site stands in for the unsampled objects of this size
+      // class around it.
+      state.central_freelist(size_class)
+          .RecordLifetimePrediction(state.lifetime_predictor().Predict(
+              LifetimePredictor::HashStack(
+                  absl::MakeSpan(stack_trace.stack, stack_trace.depth))));
+    }
 
     stack_trace.allocated_size = state.sizemap().class_to_size(size_class);
     stack_trace.cold_allocated = IsExpandedSizeClass(size_class);
@@ -170,6 +235,13 @@ ABSL_ATTRIBUTE_NOINLINE sized_ptr_t SampleifyAllocation(
   // A span must be provided or created by this point.
   TC_ASSERT_NE(span, nullptr);
 
+  state.allocation_rate_tracker().RecordAllocation(
+      size_class, stack_trace.token_id, allocation_estimate,
+      stack_trace.allocated_size);
+  state.tenant_tracker().RecordAllocation(
+      stack_trace.tenant,
+      std::llround(allocation_estimate * stack_trace.allocated_size));
+
   // TODO(b/414876446): Add entropy to the handles generated.
   stack_trace.sampled_alloc_handle =
       AllocHandle(state.sampled_alloc_handle_generator.fetch_add(
@@ -186,6 +258,14 @@ ABSL_ATTRIBUTE_NOINLINE sized_ptr_t SampleifyAllocation(
     state.sampled_internal_fragmentation_.Add(
         allocation_estimate * (stack_trace.allocated_size - requested_size));
   }
+  if (const size_t pow2_rounding = SizeMap::Pow2RoundingCost(
+          requested_size, stack_trace.allocated_size);
+      pow2_rounding > 0) {
+    state.sampled_pow2_rounding_.Add(allocation_estimate * pow2_rounding);
+  }
+  state.size_class_fragmentation().RecordAllocation(
+      size_class, requested_size, stack_trace.allocated_size,
+      allocation_estimate);
 
   MallocHook::SampledAlloc sampled_alloc = {
       .handle = stack_trace.sampled_alloc_handle,
@@ -211,8 +291,10 @@ ABSL_ATTRIBUTE_NOINLINE sized_ptr_t SampleifyAllocation(
   // The SampledAllocation object is visible to readers after this. Readers only
   // care about its various metadata (e.g. stack trace, weight) to generate the
   // heap profile, and won't need any information from Span::Sample() next.
+  const StackDepot::Id stack_id = state.stack_depot().Intern(
+      absl::MakeSpan(stack_trace.stack, stack_trace.depth));
   SampledAllocation* sampled_allocation =
-      state.sampled_allocation_recorder().Register(std::move(stack_trace));
+      state.sampled_allocation_recorder().Register(stack_trace, stack_id);
   // No pageheap_lock required. The span is freshly allocated and no one else
   // can access it. It is visible after we return from this allocation path.
   span->Sample(sampled_allocation);
@@ -291,6 +373,9 @@ void MaybeUnsampleAllocation(Static& state, Policy policy,
 
   TC_ASSERT_EQ(state.pagemap().sizeclass(PageIdContainingTagged(ptr)), 0);
 
+  const StackDepot::Id stack_id = sampled_allocation->stack_id;
+  const absl::Span<void* const> allocation_stack =
+      state.stack_depot().Get(stack_id);
   const size_t weight = sampled_allocation->sampled_stack.weight;
   const size_t requested_size =
       sampled_allocation->sampled_stack.requested_size;
@@ -316,8 +401,7 @@ void MaybeUnsampleAllocation(Static& state, Policy policy,
     ReportMismatchedFree(
         state, ptr, sampled_allocation->sampled_stack.allocation_type,
         policy.allocation_type(),
-        absl::MakeSpan(sampled_allocation->sampled_stack.stack,
-                       sampled_allocation->sampled_stack.depth));
+        allocation_stack);
   }
 
   // Check pointer for misalignment.
@@ -329,8 +413,7 @@ void MaybeUnsampleAllocation(Static& state, Policy policy,
           Profile::Sample::GuardedStatus::Guarded) {
     ReportCorruptedFree(
         tc_globals, static_cast<std::align_val_t>(kPageSize), ptr,
-        absl::MakeSpan(sampled_allocation->sampled_stack.stack,
-                       sampled_allocation->sampled_stack.depth));
+        allocation_stack);
   }
 
   if ((size.has_value() || policy.allocation_type() == AllocationType::New)) {
@@ -348,8 +431,7 @@ void MaybeUnsampleAllocation(Static& state, Policy policy,
       ReportMismatchedFree(
           state, ptr, sampled_allocation->sampled_stack.requested_alignment,
           deallocated_alignment,
-          absl::MakeSpan(sampled_allocation->sampled_stack.stack,
-                         sampled_allocation->sampled_stack.depth));
+          allocation_stack);
     }
   }
 
@@ -366,8 +448,7 @@ void MaybeUnsampleAllocation(Static& state, Policy policy,
           sampled_allocation->sampled_stack.requested_alignment,
       .allocated_size = allocated_size,
       .weight = allocation_estimate,
-      .stack = absl::MakeSpan(sampled_allocation->sampled_stack.stack,
-                              sampled_allocation->sampled_stack.depth),
+      .stack = allocation_stack,
       .allocation_time = sampled_allocation->sampled_stack.allocation_time,
       .ptr = ptr,
       .access_hint = sampled_allocation->sampled_stack.access_hint,
@@ -375,7 +456,21 @@ void MaybeUnsampleAllocation(Static& state, Policy policy,
                               ? MallocHook::Access::Cold
                               : MallocHook::Access::Hot,
   };
+  if (allocated_size <= kMaxSize && Parameters::span_lifetime_prediction()) {
+    state.lifetime_predictor().Record(
+        LifetimePredictor::HashStack(allocation_stack),
+        absl::Now() - sampled_allocation->sampled_stack.allocation_time);
+  }
+  state.allocation_rate_tracker().RecordDeallocation(
+      sampled_allocation->sampled_stack.size_class,
+      sampled_allocation->sampled_stack.token_id, allocation_estimate,
+      allocated_size);
+  state.tenant_tracker().RecordDeallocation(
+      sampled_allocation->sampled_stack.tenant,
+      std::llround(allocation_estimate * allocated_size));
   state.sampled_allocation_recorder().Unregister(sampled_allocation);
+  // The sample may be revived from now on, but the depot's frames stay valid.
+  state.stack_depot().Unref(stack_id);
 
   // Adjust our estimate of internal fragmentation.
   TC_ASSERT_LE(requested_size, allocated_size);
@@ -388,6 +483,16 @@ void MaybeUnsampleAllocation(Static& state, Policy policy,
                  sampled_fragmentation);
     state.sampled_internal_fragmentation_.Add(-sampled_fragmentation);
   }
+  if (const size_t pow2_rounding =
+          SizeMap::Pow2RoundingCost(requested_size, allocated_size);
+      pow2_rounding > 0) {
+    const size_t sampled_rounding = allocation_estimate * pow2_rounding;
+    TC_ASSERT_GE(state.sampled_pow2_rounding_.value(), sampled_rounding);
+    state.sampled_pow2_rounding_.Add(-sampled_rounding);
+  }
+  state.size_class_fragmentation().RecordDeallocation(
+      sampled_allocation->sampled_stack.size_class, requested_size,
+      allocated_size, allocation_estimate);
   MallocHook::InvokeSampledDeleteHook(sampled_alloc);
 
   state.deallocation_samples.ReportFree(sampled_alloc_handle);
@@ -50,16 +50,41 @@ void* Arena::Alloc(size_t bytes, std::align_val_t alignment) {
   auto& system_allocator = tc_globals.system_allocator();
   if (free_avail_ < bytes) {
     size_t ask = bytes > kAllocIncrement ? bytes : kAllocIncrement;
-    auto [ptr, actual_size] = system_allocator.Allocate(
-        ask, std::max(kPageSize, align), MemoryTag::kMetadata);
-    free_area_ = reinterpret_cast<char*>(ptr);
-    if (ABSL_PREDICT_FALSE(free_area_ == nullptr)) {
+    size_t block_align = std::max(kPageSize, align);
+    if (numa_partition_ >= 0) {
+      ask = (ask + kHugePageSize - 1) & ~(kHugePageSize - 1);
+      block_align = std::max(kHugePageSize, align);
+    }
+    // The end of the block we are about to discard.
+    const uintptr_t prev_end =
+        reinterpret_cast<uintptr_t>(free_area_) + free_avail_;
+    auto [ptr, actual_size] =
+        system_allocator.Allocate(ask, block_align, MemoryTag::kMetadata);
+    if (ABSL_PREDICT_FALSE(ptr == nullptr)) {
       TC_BUG(
           "FATAL ERROR: Out of memory trying to allocate internal tcmalloc "
           "data (bytes=%v, object-size=%v); is something preventing mmap from "
           "succeeding (sandbox, VSS limitations)?",
           kAllocIncrement, bytes);
     }
+    free_area_ = reinterpret_cast<char*>(ptr);
+
+    if (numa_partition_ >= 0) {
+      // Bind before the block is first touched.
+      system_allocator.BindMetadata(free_area_, actual_size, numa_partition_);
+    }
+
+    // Blocks are usually carved from the metadata region in address order, so
+    // consecutive blocks may share a hugepage.
+    const uintptr_t first_hugepage =
+        reinterpret_cast<uintptr_t>(free_area_) / kHugePageSize;
+    const uintptr_t last_hugepage =
+        (reinterpret_cast<uintptr_t>(free_area_) + actual_size - 1) /
+        kHugePageSize;
+    hugepages_ += last_hugepage - first_hugepage + 1;
+    if (prev_end != 0 && (prev_end - 1) / kHugePageSize == first_hugepage) {
+      hugepages_--;
+    }
 
     if (Parameters::back_small_allocations() &&
         actual_size <= Parameters::back_size_threshold_bytes()) {
@@ -46,8 +46,21 @@ struct ArenaStats {
 
   // The number of blocks allocated by the Arena.
   size_t blocks;
+  // The number of hugepages spanned by the blocks.  Metadata packed into fewer
+  // hugepages needs fewer TLB entries.
+  size_t hugepages;
 };
 
+inline ArenaStats& operator+=(ArenaStats& a, const ArenaStats& b) {
+  a.bytes_allocated += b.bytes_allocated;
+  a.bytes_unallocated += b.bytes_unallocated;
+  a.bytes_unavailable += b.bytes_unavailable;
+  a.bytes_nonresident += b.bytes_nonresident;
+  a.blocks += b.blocks;
+  a.hugepages += b.hugepages;
+  return a;
+}
+
 // Arena allocation; designed for use by tcmalloc internal data structures like
 // spans, profiles, etc.  Always expands.
 //
@@ -56,6 +69,14 @@ class ABSL_CACHELINE_ALIGNED Arena {
  public:
   constexpr Arena() = default;
 
+  // Makes future blocks whole hugepages, bound to the NUMA nodes of
+  // `partition`, so that metadata about the partition's memory is local to it
+  // and packed densely.
+  void set_numa_partition(int partition) {
+    AllocationGuardSpinLockHolder l(arena_lock_);
+    numa_partition_ = partition;
+  }
+
   // Returns a properly aligned byte array of length "bytes".  Crashes if
   // allocation fails.
   ABSL_ATTRIBUTE_RETURNS_NONNULL void* Alloc(
@@ -80,6 +101,7 @@ class ABSL_CACHELINE_ALIGNED Arena {
     s.bytes_unavailable = bytes_unavailable_;
     s.bytes_nonresident = bytes_nonresident_;
     s.blocks = blocks_;
+    s.hugepages = hugepages_;
     return s;
   }
 
@@ -89,6 +111,8 @@ class ABSL_CACHELINE_ALIGNED Arena {
 
   mutable absl::base_internal::SpinLock arena_lock_{
       absl::base_internal::SCHEDULE_KERNEL_ONLY};
+  // NUMA partition the blocks are bound to, or -1 for none.
+  int8_t numa_partition_ ABSL_GUARDED_BY(arena_lock_) = -1;
 
   // Free area from which to carve new objects
   char* free_area_ ABSL_GUARDED_BY(arena_lock_) = nullptr;
@@ -104,6 +128,8 @@ class ABSL_CACHELINE_ALIGNED Arena {
   size_t bytes_nonresident_ ABSL_GUARDED_BY(arena_lock_) = 0;
   // Total number of blocks/free areas managed by this Arena.
   size_t blocks_ ABSL_GUARDED_BY(arena_lock_) = 0;
+  // Total number of hugepages spanned by the blocks.
+  size_t hugepages_ ABSL_GUARDED_BY(arena_lock_) = 0;
 
   Arena(const Arena&) = delete;
   Arena& operator=(const Arena&) = delete;
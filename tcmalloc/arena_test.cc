@@ -90,6 +90,25 @@ TEST(Arena, Stats) {
   EXPECT_EQ(stats_after_alloc2.blocks, 2);
 }
 
+TEST(Arena, NumaPartitionBlocksAreHugepages) {
+  Arena arena;
+  arena.set_numa_partition(0);
+
+  void* ptr = arena.Alloc(1, Align(1));
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % kHugePageSize, 0);
+  ArenaStats stats = arena.stats();
+  EXPECT_EQ(stats.blocks, 1);
+  EXPECT_EQ(stats.hugepages, 1);
+  EXPECT_GE(stats.bytes_unallocated, kHugePageSize - 1);
+
+  // A larger allocation takes whole hugepages.
+  ptr = arena.Alloc(kHugePageSize + 1, Align(1));
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % kHugePageSize, 0);
+  stats = arena.stats();
+  EXPECT_EQ(stats.blocks, 2);
+  EXPECT_EQ(stats.hugepages, 3);
+}
+
 TEST(Arena, ReportUnmapped) {
   Arena arena;
   void* ptr = arena.Alloc(10, Align(1));
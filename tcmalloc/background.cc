@@ -12,8 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <sys/resource.h>
+#include <time.h>
+
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <limits>
 
 #include "absl/base/attributes.h"
@@ -21,203 +26,700 @@
 #include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "tcmalloc/allocation_sampling.h"
+#include "tcmalloc/background_pacer.h"
 #include "tcmalloc/central_freelist.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/cpu_cache.h"
+#include "tcmalloc/global_stats.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/page_idle.h"
+#include "tcmalloc/internal/pageflags.h"
 #include "tcmalloc/internal/percpu.h"
+#include "tcmalloc/internal/sysinfo.h"
 #include "tcmalloc/internal_malloc_extension.h"
+#include "tcmalloc/large_span_cache.h"
 #include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/memory_pressure.h"
+#include "tcmalloc/page_allocator.h"
+#include "tcmalloc/parameter_tuner.h"
 #include "tcmalloc/parameters.h"
+#include "tcmalloc/release_workers.h"
+#include "tcmalloc/signal_safe_pool.h"
+#include "tcmalloc/slow_path_latency.h"
 #include "tcmalloc/static_vars.h"
 #include "tcmalloc/stats.h"
+#include "tcmalloc/thread_cache.h"
+#include "tcmalloc/vma_stats.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+absl::Duration ThreadCpuTime() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+    return absl::ZeroDuration();
+  }
+  return absl::DurationFromTimespec(ts);
+}
 
-// Release memory to the system at a constant rate.
-void MallocExtension_Internal_ProcessBackgroundActions() {
-  using ::tcmalloc::tcmalloc_internal::Parameters;
-  using ::tcmalloc::tcmalloc_internal::tc_globals;
+// Summarizes the state that the background actions act upon.  Allocations
+// served by the per-cpu caches alone do not change the byte counts, but still
+// show up in the number of sampled allocations.
+uint64_t StatsFingerprint(const TCMallocStats& stats) {
+  uint64_t fingerprint = 0;
+  for (uint64_t value :
+       {stats.pageheap.system_bytes, stats.pageheap.free_bytes,
+        stats.pageheap.unmapped_bytes, stats.per_cpu_bytes,
+        stats.sharded_transfer_bytes, stats.transfer_bytes,
+        stats.central_bytes, stats.thread_bytes, stats.large_span_bytes,
+        static_cast<uint64_t>(stats.num_released_total.raw_num()),
+        static_cast<uint64_t>(tc_globals.sampled_alloc_handle_generator.load(
+            std::memory_order_relaxed))}) {
+    fingerprint = BackgroundPacer::Mix(fingerprint, value);
+  }
+  return fingerprint;
+}
 
-  tcmalloc::MallocExtension::MarkThreadIdle();
+// Lowers the priority of the background thread while adaptive pacing is
+// enabled.  We use nice value 19 rather than SCHED_IDLE: the thread
+// holds allocator locks, and SCHED_IDLE could starve it while it does.
+void SetLowPriority(bool low) {
+  // On Linux, PRIO_PROCESS with who == 0 applies to the calling thread only.
+  setpriority(PRIO_PROCESS, 0, low ? 19 : 0);
+}
 
-  absl::Time prev_time = absl::Now();
-  absl::Time last_reclaim = prev_time;
-  absl::Time last_shuffle = prev_time;
-  absl::Time last_size_class_resize = prev_time;
-  absl::Time last_size_class_max_capacity_resize = prev_time;
-  absl::Time last_slab_resize_check = prev_time;
-  absl::Time last_hpaa_hugepage_check = prev_time;
-  absl::Time last_cfl_long_lived_check = prev_time;
+// Returns the objects held by the per-CPU caches of unprotected CPUs and by
+// the transfer caches to the central freelists, so that the spans they pin can
+// empty.  Capacity is kept: the caches refill on demand.
+void DrainCachesForLimit() {
+  if (tc_globals.CpuCacheActive()) {
+    auto& cpu_cache = tc_globals.cpu_cache();
+    for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+      if (!cpu_cache.HasPopulated(cpu) || cpu_cache.IsProtected(cpu)) continue;
+      cpu_cache.Reclaim(cpu);
+    }
+  }
+  // Each plunder returns what the previous one left untouched, so the second
+  // one empties the caches.
+  for (int i = 0; i < 2; ++i) {
+    tc_globals.sharded_transfer_cache().Plunder();
+#ifndef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
+    tc_globals.transfer_cache().TryPlunder();
+#endif
+  }
+}
 
+// What the background actions remember from one step to the next.
+struct BackgroundState {
+  // Set by the first step.
+  bool initialized = false;
+  // Under Parameters::deterministic(), the time of the last step, which
+  // advances by one sleep interval per step.
+  absl::Time step_clock = absl::UnixEpoch();
+  absl::Time prev_time;
+  absl::Time last_reclaim;
+  absl::Time last_cpuset_check;
+  absl::Time last_shuffle;
+  absl::Time last_size_class_resize;
+  absl::Time last_size_class_max_capacity_resize;
+  absl::Time last_slab_resize_check;
+  absl::Time last_hpaa_hugepage_check;
+  absl::Time last_cfl_long_lived_check;
+  absl::Time last_cfl_shard_check;
+  absl::Time last_cfl_empty_span_release;
+  absl::Time last_cfl_mesh_estimate;
+  absl::Time last_cfl_span_sharing_check;
+  absl::Time last_cfl_span_length_check;
+  absl::Time last_cgroup_check;
+  absl::Time last_access_hint_audit;
+  absl::Time last_hugepage_coverage_check;
+  absl::Time last_access_heatmap;
+  absl::Time last_thread_cache_resize;
+  absl::Time last_vma_merge;
+  absl::Time last_large_span_cache_drain;
+  absl::Time last_cgroup_memory_limit_check;
+  absl::Time last_parameter_tuning;
+  absl::Time last_hot_stats;
+  absl::Time last_mlockall_check;
 #ifndef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
-  absl::Time last_transfer_cache_plunder_check = prev_time;
-  absl::Time last_transfer_cache_resize_check = prev_time;
+  absl::Time last_transfer_cache_plunder_check;
+  absl::Time last_transfer_cache_resize_check;
 #endif
+  bool memory_pressure_release = false;
+  bool pacing = false;
 
   // We use a separate release rate smoother from the one used by
   // ReleaseMemoryToSystem because a) we want to maintain a constant background
   // release rate, regardless of whether the user is releasing memory; and b) we
   // want to separately account for pages released by ProcessBackgroundActions.
-  tcmalloc::tcmalloc_internal::ConstantRatePageAllocatorReleaser releaser;
-
-  while (tcmalloc::MallocExtension::GetBackgroundProcessActionsEnabled()) {
-    const absl::Duration sleep_time =
-        tcmalloc::MallocExtension::GetBackgroundProcessSleepInterval();
-
-    // Reclaim inactive per-cpu caches once per cpu_cache_shuffle_period.
-    //
-    // We use a longer 30 sleep cycle reclaim period to make sure that caches
-    // are indeed idle. Reclaim drains entire cache, as opposed to cache shuffle
-    // for instance that only shrinks a cache by a few objects at a time. So, we
-    // might have larger performance degradation if we use a shorter reclaim
-    // interval and drain caches that weren't supposed to.
-    const absl::Duration cpu_cache_reclaim_period = 30 * sleep_time;
-
-    // Shuffle per-cpu caches once per cpu_cache_shuffle_period.
-    const absl::Duration cpu_cache_shuffle_period = 5 * sleep_time;
-
-    const absl::Duration size_class_resize_period = 2 * sleep_time;
-    const absl::Duration size_class_max_capacity_resize_period =
-        29 * sleep_time;
-
-    // See if we should resize the slab once per cpu_cache_slab_resize_period.
-    // This period is coprime to cpu_cache_shuffle_period and
-    // cpu_cache_shuffle_period.
-    const absl::Duration cpu_cache_slab_resize_period = 29 * sleep_time;
+  ConstantRatePageAllocatorReleaser releaser;
+
+  void Init(absl::Time now) {
+    prev_time = now;
+    last_reclaim = now;
+    last_cpuset_check = now;
+    last_shuffle = now;
+    last_size_class_resize = now;
+    last_size_class_max_capacity_resize = now;
+    last_slab_resize_check = now;
+    last_hpaa_hugepage_check = now;
+    last_cfl_long_lived_check = now;
+    last_cfl_shard_check = now;
+    last_cfl_empty_span_release = now;
+    last_cfl_mesh_estimate = now;
+    last_cfl_span_sharing_check = now;
+    last_cfl_span_length_check = now;
+    last_cgroup_check = now;
+    last_access_hint_audit = now;
+    last_hugepage_coverage_check = now;
+    last_access_heatmap = now;
+    last_thread_cache_resize = now;
+    last_vma_merge = now;
+    last_large_span_cache_drain = now;
+    // Apply the cgroup memory limits on the first step rather than after the
+    // first cgroup_check_period.
+    last_cgroup_memory_limit_check = absl::InfinitePast();
+    last_parameter_tuning = now;
+    // Publish the hot stats on the first step.
+    last_hot_stats = absl::InfinitePast();
+    last_mlockall_check = now;
+#ifndef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
+    last_transfer_cache_plunder_check = now;
+    last_transfer_cache_resize_check = now;
+#endif
+    initialized = true;
+  }
+};
+
+// TODO(b/278618299):  We guard various actions under a single lock, since
+// individual operations may not be amenable to concurrent operations.
+ABSL_CONST_INIT absl::Mutex background_mu(absl::kConstInit);
+ABSL_CONST_INIT BackgroundState background_state
+    ABSL_GUARDED_BY(background_mu);
+
+// Runs the background actions that are due, and returns how long to wait
+// before the next step.  The optional actions, which rebalance caches, are
+// left to a later step once budget has been spent.
+absl::Duration BackgroundStep(absl::Duration budget)
+    ABSL_EXCLUSIVE_LOCKS_REQUIRED(background_mu) {
+  BackgroundState& s = background_state;
+  const absl::Duration sleep_time =
+      MallocExtension::GetBackgroundProcessSleepInterval();
+  absl::Duration next_sleep = sleep_time;
+
+  // Deterministic runs decide which actions are due from the number of steps
+  // only, and run them all, without pacing.
+  const bool deterministic = Parameters::deterministic();
+  const absl::Time now =
+      deterministic ? (s.step_clock += sleep_time) : absl::Now();
+  if (!s.initialized) {
+    s.Init(now);
+  }
+  const absl::Time deadline =
+      deterministic ? absl::InfiniteFuture() : now + budget;
+
+  auto& pacer = tc_globals.background_pacer();
+  if ((Parameters::background_adaptive_pacing() && !deterministic) !=
+      s.pacing) {
+    s.pacing = !s.pacing;
+    pacer.Reset();
+  }
+  const absl::Duration cpu_start =
+      s.pacing ? ThreadCpuTime() : absl::ZeroDuration();
+  // Rebalancing caches is optional: with adaptive pacing, it is skipped while
+  // nothing changes and when over the CPU budget.
+  const bool defer_optional = s.pacing && pacer.DeferOptionalActions();
+  auto run_optional = [&]() {
+    return !defer_optional && absl::Now() < deadline;
+  };
+
+  // Reclaim inactive per-cpu caches once per cpu_cache_shuffle_period.
+  //
+  // We use a longer 30 sleep cycle reclaim period to make sure that caches
+  // are indeed idle. Reclaim drains entire cache, as opposed to cache shuffle
+  // for instance that only shrinks a cache by a few objects at a time. So, we
+  // might have larger performance degradation if we use a shorter reclaim
+  // interval and drain caches that weren't supposed to.
+  const absl::Duration cpu_cache_reclaim_period = 30 * sleep_time;
+
+  // Follow changes of the cpuset once per cpuset_check_period, a single
+  // sched_getaffinity call when nothing changed.
+  const absl::Duration cpuset_check_period = 5 * sleep_time;
+
+  // Shuffle per-cpu caches once per cpu_cache_shuffle_period.
+  const absl::Duration cpu_cache_shuffle_period = 5 * sleep_time;
+
+  const absl::Duration size_class_resize_period = 2 * sleep_time;
+  const absl::Duration size_class_max_capacity_resize_period = 29 * sleep_time;
+
+  // See if we should resize the slab once per cpu_cache_slab_resize_period.
+  // This period is coprime to cpu_cache_shuffle_period and
+  // cpu_cache_shuffle_period.
+  const absl::Duration cpu_cache_slab_resize_period = 29 * sleep_time;
+
+  // Without per-cpu caches, move thread cache budget between threads once
+  // per thread_cache_resize_period.
+  const absl::Duration thread_cache_resize_period = 5 * sleep_time;
 
 #ifndef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
-    // We reclaim unused objects from the transfer caches once per
-    // transfer_cache_plunder_period.
-    const absl::Duration transfer_cache_plunder_period = 5 * sleep_time;
-    // Resize transfer caches once per transfer_cache_resize_period.
-    const absl::Duration transfer_cache_resize_period = 2 * sleep_time;
+  // We reclaim unused objects from the transfer caches once per
+  // transfer_cache_plunder_period.
+  const absl::Duration transfer_cache_plunder_period = 5 * sleep_time;
+  // Resize transfer caches once per transfer_cache_resize_period.
+  const absl::Duration transfer_cache_resize_period = 2 * sleep_time;
 #endif
 
-    // Iterate through hugepage trackers in TCMalloc's HugePageFiller. Apply
-    // different treatments (e.g. usermode collapse, custom name sampled VMAs,
-    // etc.) once every hpaa_hugepage_check_period.
-    const absl::Duration hpaa_hugepage_check_period = 5 * sleep_time;
+  // Iterate through hugepage trackers in TCMalloc's HugePageFiller. Apply
+  // different treatments (e.g. usermode collapse, custom name sampled VMAs,
+  // etc.) once every hpaa_hugepage_check_period.
+  const absl::Duration hpaa_hugepage_check_period = 5 * sleep_time;
+
+  // Iterate through all spans and move long-lived spans to the long-lived
+  // section of nonempty_ once every cfl_long_lived_check_period.
+  const absl::Duration cfl_long_lived_check_period = 5 * sleep_time;
+
+  // Shard central freelists whose lock was contended once every
+  // cfl_shard_check_period.
+  const absl::Duration cfl_shard_check_period = 5 * sleep_time;
+
+  // Return the empty spans that central freelists kept but did not reuse once
+  // every cfl_empty_span_release_period.
+  const absl::Duration cfl_empty_span_release_period = 5 * sleep_time;
+
+  // Estimate how many spans meshing would free once every
+  // cfl_mesh_estimate_period.  Sparse spans build up slowly.
+  const absl::Duration cfl_mesh_estimate_period = 30 * sleep_time;
+
+  // Start or stop span sharing between size classes once every
+  // cfl_span_sharing_check_period, based on their traffic since the previous
+  // check.
+  const absl::Duration cfl_span_sharing_check_period = 5 * sleep_time;
+
+  // Adapt the span length of each size class to its traffic once every
+  // cfl_span_length_check_period.
+  const absl::Duration cfl_span_length_check_period = 5 * sleep_time;
+
+  // Re-read the cgroup limits once per cgroup_check_period, so that changes
+  // to the limits of a running container resize the per-cpu caches and the
+  // page heap limits.
+  const absl::Duration cgroup_check_period = 30 * sleep_time;
+
+  // Check the hot/cold hints of sampled allocations against the staleness
+  // of their pages once per access_hint_audit_period.  The kernel's scan
+  // period is typically minutes, so there is no point in checking often.
+  const absl::Duration access_hint_audit_period = 30 * sleep_time;
+
+  // Check whether the hugepages the page allocators keep intact are still
+  // backed by hugepages once per hugepage_coverage_check_period.  The kernel
+  // splits them rarely, and each check reads pageflags for a few hundred
+  // hugepages.
+  const absl::Duration hugepage_coverage_check_period = 60 * sleep_time;
+
+  // Check the VMA count against vm.max_map_count once per vma_merge_period.
+  // Reading /proc/self/maps takes time linear in the number of VMAs.
+  const absl::Duration vma_merge_period = 30 * sleep_time;
+
+  // Run an epoch of the parameter tuner once per parameter_tuning_period.
+  // Each epoch must be long enough to measure the effect of a change.
+  const absl::Duration parameter_tuning_period = 60 * sleep_time;
+
+  // Publish the stats returned by MallocExtension::GetHotStats once per
+  // hot_stats_period.  In between, GetHotStats follows the spans handed out
+  // whole, i.e. large allocations, by itself.
+  const absl::Duration hot_stats_period = 10 * sleep_time;
+
+  // Check whether the application called mlockall(MCL_FUTURE), or undid it,
+  // once per mlockall_check_period.  The release policies follow the mode.
+  const absl::Duration mlockall_check_period = 30 * sleep_time;
+
+  // Drain large span cache shards that went unused for a whole
+  // large_span_cache_drain_period once per period.
+  const absl::Duration large_span_cache_drain_period = 5 * sleep_time;
+
+  // We follow the cache hierarchy in TCMalloc from outermost (per-CPU) to
+  // innermost (the page heap).  Freeing up objects at one layer can help
+  // aid memory coalescing for inner caches.
+
+  if (MallocExtension::PerCpuCachesActive()) {
+    // Accelerate fences as part of this operation by registering this
+    // thread with rseq.  While this is not strictly required to succeed, we
+    // do not expect an inconsistent state for rseq (some threads registered
+    // and some threads unable to).
+    TC_CHECK(subtle::percpu::IsFast());
+
+    // Try to reclaim per-cpu caches once every cpu_cache_reclaim_period
+    // when enabled.
+    if (now - s.last_reclaim >= cpu_cache_reclaim_period) {
+      tc_globals.cpu_cache().TryReclaimingCaches();
+      s.last_reclaim = now;
+    }
 
-    // Iterate through all spans and move long-lived spans to the long-lived
-    // section of nonempty_ once every cfl_long_lived_check_period.
-    const absl::Duration cfl_long_lived_check_period = 5 * sleep_time;
+    // Drain the caches of cpus taken away from the process, and hand their
+    // capacity to the cpus it was given, rather than wait for the reclaim.
+    if (now - s.last_cpuset_check >= cpuset_check_period) {
+      tc_globals.cpu_cache().HandleCpusetChange();
+      s.last_cpuset_check = now;
+    }
 
-    absl::Time now = absl::Now();
+    if (Parameters::per_cpu_caches_cgroup_aware() &&
+        now - s.last_cgroup_check >= cgroup_check_period) {
+      UpdateCacheLimitFromCgroup();
+      s.last_cgroup_check = now;
+    }
 
-    // TODO(b/278618299):  We guard various actions under a single lock, since
-    // individual operations may not be amenable to concurrent operations.
-    {
-      ABSL_CONST_INIT static absl::Mutex mu(absl::kConstInit);
-      absl::MutexLock l(mu);
-
-      // We follow the cache hierarchy in TCMalloc from outermost (per-CPU) to
-      // innermost (the page heap).  Freeing up objects at one layer can help
-      // aid memory coalescing for inner caches.
-
-      if (tcmalloc::MallocExtension::PerCpuCachesActive()) {
-        // Accelerate fences as part of this operation by registering this
-        // thread with rseq.  While this is not strictly required to succeed, we
-        // do not expect an inconsistent state for rseq (some threads registered
-        // and some threads unable to).
-        TC_CHECK(tcmalloc::tcmalloc_internal::subtle::percpu::IsFast());
-
-        // Try to reclaim per-cpu caches once every cpu_cache_reclaim_period
-        // when enabled.
-        if (now - last_reclaim >= cpu_cache_reclaim_period) {
-          tc_globals.cpu_cache().TryReclaimingCaches();
-          last_reclaim = now;
-        }
-
-        if (now - last_shuffle >= cpu_cache_shuffle_period) {
-          tc_globals.cpu_cache().ShuffleCpuCaches();
-          last_shuffle = now;
-        }
-
-        if (now - last_size_class_resize >= size_class_resize_period) {
-          tc_globals.cpu_cache().ResizeSizeClasses();
-          last_size_class_resize = now;
-        }
-
-        if (Parameters::resize_size_class_max_capacity() &&
-            now - last_size_class_max_capacity_resize >=
-                size_class_max_capacity_resize_period) {
-          tc_globals.cpu_cache().ResizeSizeClassMaxCapacities();
-          last_size_class_max_capacity_resize = now;
-        }
-
-        // See if we need to grow the slab once every kCpuCacheSlabResizePeriod
-        // when enabled.
-        if (Parameters::per_cpu_caches_dynamic_slab_enabled() &&
-            now - last_slab_resize_check >= cpu_cache_slab_resize_period) {
-          tc_globals.cpu_cache().ResizeSlabIfNeeded();
-          last_slab_resize_check = now;
-        }
-
-        tc_globals.cpu_cache().ClearTouchedCpus();
-      }
+    // Idle caches found by TryReclaimingCaches are drained a few size
+    // classes at a time on every iteration.
+    if (Parameters::per_cpu_caches_incremental_drain()) {
+      tc_globals.cpu_cache().DrainIdleCachesIncrementally();
+    }
 
-      tc_globals.sharded_transfer_cache().Plunder();
+    if (run_optional() && now - s.last_shuffle >= cpu_cache_shuffle_period) {
+      tc_globals.cpu_cache().ShuffleCpuCaches();
+      s.last_shuffle = now;
+    } else if (Parameters::per_cpu_caches_ranked_shuffle() && run_optional()) {
+      // A ranked shuffle moves capacity over the following iterations.
+      tc_globals.cpu_cache().ContinueShuffleCpuCaches();
+    }
+
+    if (run_optional() &&
+        now - s.last_size_class_resize >= size_class_resize_period) {
+      tc_globals.cpu_cache().ResizeSizeClasses();
+      s.last_size_class_resize = now;
+    }
+
+    if (run_optional() &&
+        (Parameters::resize_size_class_max_capacity() ||
+         Parameters::per_cpu_caches_capacity_controller()) &&
+        now - s.last_size_class_max_capacity_resize >=
+            size_class_max_capacity_resize_period) {
+      tc_globals.cpu_cache().ResizeSizeClassMaxCapacities();
+      s.last_size_class_max_capacity_resize = now;
+    }
+
+    // The working set policy sizes the slab by the largest working set seen
+    // over the resize period, so it is sampled on every iteration.
+    if (run_optional() && Parameters::per_cpu_caches_dynamic_slab_enabled() &&
+        Parameters::per_cpu_caches_dynamic_slab_working_set()) {
+      tc_globals.cpu_cache().SampleSlabWorkingSet();
+    }
+
+    // See if we need to grow the slab once every kCpuCacheSlabResizePeriod
+    // when enabled.
+    if (run_optional() &&
+        Parameters::per_cpu_caches_dynamic_slab_enabled() &&
+        now - s.last_slab_resize_check >= cpu_cache_slab_resize_period) {
+      tc_globals.cpu_cache().ResizeSlabIfNeeded();
+      s.last_slab_resize_check = now;
+    }
+
+    tc_globals.cpu_cache().ClearTouchedCpus();
+  } else if (Parameters::thread_cache_adaptive_sizing() &&
+             now - s.last_thread_cache_resize >= thread_cache_resize_period) {
+    ThreadCache::ResizeThreadCaches();
+    s.last_thread_cache_resize = now;
+  }
+
+  tc_globals.sharded_transfer_cache().Plunder();
+
+  // Return the spans of idle large span cache shards to the page heap,
+  // before they are considered for release below.
+  if (now - s.last_large_span_cache_drain >= large_span_cache_drain_period) {
+    DrainLargeSpanCache();
+    s.last_large_span_cache_drain = now;
+  }
+
+  // Top up the memory reserved for signal handlers.  A no-op unless
+  // ReserveSignalSafeMemory was called.
+  RefillSignalSafePool();
+
+  // Keep the page heap limits at a fraction of the cgroup memory limits,
+  // which containers may change while running.
+  if (now - s.last_cgroup_memory_limit_check >= cgroup_check_period) {
+    UpdateMemoryLimitFromCgroup();
+    s.last_cgroup_memory_limit_check = now;
+  }
 
 #ifndef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
-      // Try to plunder and reclaim unused objects from transfer caches.
-      if (now - last_transfer_cache_plunder_check >=
-          transfer_cache_plunder_period) {
-        tc_globals.transfer_cache().TryPlunder();
-        last_transfer_cache_plunder_check = now;
-      }
+  // Try to plunder and reclaim unused objects from transfer caches.
+  if (now - s.last_transfer_cache_plunder_check >=
+      transfer_cache_plunder_period) {
+    tc_globals.transfer_cache().TryPlunder();
+    s.last_transfer_cache_plunder_check = now;
+  }
 
-      if (now - last_transfer_cache_resize_check >=
-          transfer_cache_resize_period) {
-        tc_globals.transfer_cache().TryResizingCaches();
-        last_transfer_cache_resize_check = now;
-      }
+  if (run_optional() && now - s.last_transfer_cache_resize_check >=
+                             transfer_cache_resize_period) {
+    tc_globals.transfer_cache().TryResizingCaches();
+    tc_globals.sharded_transfer_cache().AdaptShards(
+        tc_globals.transfer_cache());
+    s.last_transfer_cache_resize_check = now;
+  }
 #endif
 
-      if (now - last_hpaa_hugepage_check >= hpaa_hugepage_check_period) {
-        tc_globals.page_allocator().TreatHugepageTrackers(
-            Parameters::usermode_hugepage_collapse());
-        last_hpaa_hugepage_check = now;
-      }
+  if (run_optional() &&
+      now - s.last_hpaa_hugepage_check >= hpaa_hugepage_check_period) {
+    tc_globals.page_allocator().TreatHugepageTrackers(
+        Parameters::usermode_hugepage_collapse());
+    s.last_hpaa_hugepage_check = now;
+  }
 
-      if (Parameters::span_lifetime_tracking() ==
-          tcmalloc::tcmalloc_internal::central_freelist_internal::
-              LifetimeTracking::kEnabled) {
-        if (now - last_cfl_long_lived_check >= cfl_long_lived_check_period) {
-          for (int i = 0; i < tcmalloc::tcmalloc_internal::kNumClasses; ++i) {
-            tc_globals.central_freelist(i).HandleLongLivedSpans();
-          }
-          last_cfl_long_lived_check = now;
-        }
+  if (Parameters::span_lifetime_tracking() ==
+      central_freelist_internal::LifetimeTracking::kEnabled) {
+    if (run_optional() &&
+        now - s.last_cfl_long_lived_check >= cfl_long_lived_check_period) {
+      for (int i = 0; i < kNumClasses; ++i) {
+        tc_globals.central_freelist(i).HandleLongLivedSpans();
       }
+      s.last_cfl_long_lived_check = now;
+    }
+  }
 
-      // If time goes backwards, we would like to cap the release rate at 0.
-      //
-      // TODO(b/495452446): Improve test coverage and possibly move to working
-      // integer space entirely.
-      double calculated_bytes =
-          static_cast<size_t>(Parameters::background_release_rate()) *
-          absl::ToDoubleSeconds(now - prev_time);
-      constexpr double kMaxSsize =
-          static_cast<double>(std::numeric_limits<ssize_t>::max());
-
-      ssize_t bytes_to_release = calculated_bytes >= kMaxSsize
-                                     ? std::numeric_limits<ssize_t>::max()
-                                     : calculated_bytes;
-      bytes_to_release = std::max<ssize_t>(bytes_to_release, 0);
-
-      // If release rate is set to 0, do not release memory to system. However,
-      // if we want to release free and backed hugepages from HugeRegion,
-      // ReleaseMemoryToSystem should be able to release those pages to the
-      // system even with bytes_to_release = 0.
-      if (bytes_to_release > 0 ||
-          Parameters::release_pages_from_huge_region()) {
-        releaser.Release(bytes_to_release,
-                         /*reason=*/tcmalloc::tcmalloc_internal::
-                             PageReleaseReason::kProcessBackgroundActions);
-      }
+  const int cfl_max_shards = Parameters::central_freelist_max_shards();
+  if (run_optional() && cfl_max_shards > 1 &&
+      now - s.last_cfl_shard_check >= cfl_shard_check_period) {
+    for (int i = 0; i < kNumClasses; ++i) {
+      tc_globals.central_freelist(i).ShardIfContended(cfl_max_shards);
+    }
+    s.last_cfl_shard_check = now;
+  }
+
+  if (run_optional() &&
+      now - s.last_cfl_empty_span_release >= cfl_empty_span_release_period) {
+    for (int i = 0; i < kNumClasses; ++i) {
+      tc_globals.central_freelist(i).ReleaseIdleEmptySpans();
+    }
+    s.last_cfl_empty_span_release = now;
+  }
+
+  if (Parameters::span_mesh_estimation() && run_optional() &&
+      now - s.last_cfl_mesh_estimate >= cfl_mesh_estimate_period) {
+    for (int i = 0; i < kNumClasses; ++i) {
+      tc_globals.central_freelist(i).EstimateMeshableSpans();
+    }
+    s.last_cfl_mesh_estimate = now;
+  }
+
+  if (run_optional() && now - s.last_cfl_span_sharing_check >=
+                            cfl_span_sharing_check_period) {
+    // Disabling the parameter stops all borrowing.  Classes are visited from
+    // the largest, so that a class stops borrowing before the next smaller
+    // one considers it as a lender.
+    const bool sharing = Parameters::central_freelist_span_sharing();
+    for (int i = kNumClasses - 1; i > 0; --i) {
+      const size_t lender =
+          sharing ? tc_globals.sizemap().span_sharing_lender(i) : 0;
+      tc_globals.central_freelist(i).UpdateSpanSharing(
+          lender != 0 ? &tc_globals.central_freelist(lender) : nullptr);
+    }
+    s.last_cfl_span_sharing_check = now;
+  }
+
+  if (Parameters::central_freelist_adaptive_span_length() && run_optional() &&
+      now - s.last_cfl_span_length_check >= cfl_span_length_check_period) {
+    for (int i = 0; i < kNumClasses; ++i) {
+      tc_globals.central_freelist(i).AdaptSpanLength();
+    }
+    s.last_cfl_span_length_check = now;
+  }
+
+  if (Parameters::allocation_rate_history()) {
+    tc_globals.allocation_rate_tracker().Update(now);
+  }
+
+  if (run_optional() &&
+      now - s.last_access_hint_audit >= access_hint_audit_period) {
+    PageFlags pageflags;
+    AuditAccessHints(tc_globals, pageflags, now);
+    s.last_access_hint_audit = now;
+  }
+
+  if (run_optional() &&
+      now - s.last_hugepage_coverage_check >= hugepage_coverage_check_period) {
+    PageFlags pageflags;
+    tc_globals.page_allocator().VerifyHugepageCoverage(pageflags);
+    s.last_hugepage_coverage_check = now;
+  }
+
+  // Each heatmap round reports the sampled memory left unaccessed since the
+  // previous one, so the interval is the idleness being measured.
+  const absl::Duration access_heatmap_interval =
+      Parameters::access_heatmap_interval();
+  if (access_heatmap_interval > absl::ZeroDuration() && run_optional() &&
+      now - s.last_access_heatmap >= access_heatmap_interval) {
+    PageIdle page_idle;
+    UpdateAccessHeatmap(tc_globals, page_idle, now);
+    s.last_access_heatmap = now;
+  }
+
+  if (run_optional() && now - s.last_vma_merge >= vma_merge_period) {
+    MergeVmas();
+    s.last_vma_merge = now;
+  }
 
-      prev_time = now;
+  tc_globals.adaptive_sampling_interval().Update(
+      now, tc_globals.sampled_alloc_handle_generator.load(
+               std::memory_order_relaxed));
+
+  // Extracting the stats publishes the ones returned by
+  // MallocExtension::GetHotStats.  Pacing compares them on every step.
+  uint64_t fingerprint = 0;
+  const bool tune = now - s.last_parameter_tuning >= parameter_tuning_period;
+  if (s.pacing || tune || now - s.last_hot_stats >= hot_stats_period) {
+    TCMallocStats stats;
+    ExtractHotStats(stats);
+    s.last_hot_stats = now;
+    fingerprint = StatsFingerprint(stats);
+
+    if (tune) {
+      UpdateParameterTuner(now, stats);
+      s.last_parameter_tuning = now;
     }
+  }
+
+  // Fault in the hugepages queued for eager population before releasing
+  // memory, which would invalidate the ones queued until now.
+  if (Parameters::eager_populate_threshold() > 0) {
+    tc_globals.page_allocator().PopulatePendingHugepages();
+  }
 
-    absl::SleepFor(sleep_time);
+  if (now - s.last_mlockall_check >= mlockall_check_period) {
+    tc_globals.system_allocator().DetectMlockall();
+    s.last_mlockall_check = now;
   }
+
+  // Release what freeing threads left over the HugeCache limits.
+  tc_globals.page_allocator().ReleaseDeferred();
+
+  // Finish the soft limit hit that releasing free pages could not satisfy,
+  // breaking up hugepages only if draining the caches is not enough.
+  if (tc_globals.page_allocator().cache_drain_requested()) {
+    DrainCachesForLimit();
+    tc_globals.page_allocator().ShrinkAfterCacheDrain();
+  }
+
+  // Sample the memory pressure every iteration, as the PSI averages react
+  // within seconds.  The governor scales the release rate below and the
+  // skip-subrelease intervals used by the HugePageFiller.
+  size_t release_rate =
+      static_cast<size_t>(Parameters::background_release_rate());
+  auto& governor = tc_globals.memory_pressure_governor();
+  auto& notifier = tc_globals.memory_pressure_notifier();
+  MemoryPressure pressure;
+  if (Parameters::memory_pressure_release() || notifier.has_callbacks()) {
+    pressure = ReadMemoryPressure();
+  }
+  if (Parameters::memory_pressure_release()) {
+    governor.Update(pressure);
+    release_rate = governor.ScaleReleaseRate(release_rate);
+    s.memory_pressure_release = true;
+  } else if (s.memory_pressure_release) {
+    governor.Reset();
+    s.memory_pressure_release = false;
+  }
+
+  // Tell the application about the pressure before releasing, as dropping its
+  // own caches is often cheaper than releasing and re-faulting ours.
+  if (notifier.has_callbacks()) {
+    MallocExtension::MemoryPressureEvent event;
+    {
+      PageHeapSpinLockHolder l;
+      const BackingStats stats = tc_globals.page_allocator().stats();
+      event.heap_bytes = stats.system_bytes - stats.unmapped_bytes +
+                         tc_globals.metadata_bytes();
+    }
+    event.soft_limit = tc_globals.page_allocator().limit(PageAllocator::kSoft);
+    event.some_avg10 = pressure.some_avg10;
+    notifier.Notify(event, now);
+  }
+
+  // If time goes backwards, we would like to cap the release rate at 0.
+  //
+  // TODO(b/495452446): Improve test coverage and possibly move to working
+  // integer space entirely.
+  double calculated_bytes =
+      release_rate * absl::ToDoubleSeconds(now - s.prev_time);
+  constexpr double kMaxSsize =
+      static_cast<double>(std::numeric_limits<ssize_t>::max());
+
+  ssize_t bytes_to_release = calculated_bytes >= kMaxSsize
+                                 ? std::numeric_limits<ssize_t>::max()
+                                 : calculated_bytes;
+  bytes_to_release = std::max<ssize_t>(bytes_to_release, 0);
+
+  // If release rate is set to 0, do not release memory to system. However,
+  // if we want to release free and backed hugepages from HugeRegion,
+  // ReleaseMemoryToSystem should be able to release those pages to the
+  // system even with bytes_to_release = 0.
+  //
+  // With release workers running, they release on our behalf, one
+  // allocator instance each.
+  auto& release_workers = tc_globals.release_workers();
+  if (bytes_to_release > 0 && release_workers.active()) {
+    release_workers.Distribute(BytesToLengthCeil(bytes_to_release));
+  } else if (bytes_to_release > 0 ||
+             Parameters::release_pages_from_huge_region()) {
+    ScopedSlowPathTimer timer(SlowPath::kBackgroundRelease);
+    s.releaser.Release(bytes_to_release,
+                       /*reason=*/PageReleaseReason::kProcessBackgroundActions);
+  }
+
+  s.prev_time = now;
+
+  if (s.pacing) {
+    next_sleep =
+        pacer.Update(fingerprint, ThreadCpuTime() - cpu_start, sleep_time);
+  }
+  return next_sleep;
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+// Release memory to the system at a constant rate.
+void MallocExtension_Internal_ProcessBackgroundActions() {
+  using ::tcmalloc::tcmalloc_internal::background_mu;
+  using ::tcmalloc::tcmalloc_internal::Parameters;
+
+  tcmalloc::MallocExtension::MarkThreadIdle();
+
+  bool low_priority = false;
+  while (tcmalloc::MallocExtension::GetBackgroundProcessActionsEnabled()) {
+    if (Parameters::background_adaptive_pacing() != low_priority) {
+      low_priority = !low_priority;
+      tcmalloc::tcmalloc_internal::SetLowPriority(low_priority);
+    }
+
+    absl::Duration next_sleep;
+    {
+      absl::MutexLock l(background_mu);
+      next_sleep =
+          tcmalloc::tcmalloc_internal::BackgroundStep(absl::InfiniteDuration());
+    }
+    absl::SleepFor(next_sleep);
+  }
+}
+
+void MallocExtension_Internal_RunBackgroundStep(absl::Duration budget,
+                                                absl::Time* next_wake) {
+  using ::tcmalloc::tcmalloc_internal::background_mu;
+
+  absl::Duration next_sleep =
+      tcmalloc::MallocExtension::GetBackgroundProcessSleepInterval();
+  // Do not wait for a step running on another thread.
+  if (tcmalloc::MallocExtension::GetBackgroundProcessActionsEnabled() &&
+      background_mu.TryLock()) {
+    next_sleep = tcmalloc::tcmalloc_internal::BackgroundStep(budget);
+    background_mu.Unlock();
+  }
+  *next_wake = absl::Now() + next_sleep;
+}
+
+void MallocExtension_Internal_ProcessBackgroundReleaseWorker() {
+  tcmalloc::MallocExtension::MarkThreadIdle();
+  tcmalloc::tcmalloc_internal::tc_globals.release_workers().Run();
 }
@@ -0,0 +1,143 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_BACKGROUND_PACER_H_
+#define TCMALLOC_BACKGROUND_PACER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "absl/time/time.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Paces the background thread (see ProcessBackgroundActions) by the work it
+// finds, with Parameters::background_adaptive_pacing().
+//
+// After each iteration, the thread hashes the allocator's stats into a
+// fingerprint.  While the fingerprint does not change, i.e. while nothing
+// allocates, frees or releases, the thread sleeps twice as long after each
+// iteration, up to 1 << kMaxBackoffShift sleep intervals, and skips its
+// optional actions, which could not find anything to do.  Any change brings it
+// back to the configured interval.
+//
+// The thread's share of CPU time is tracked as a moving average.  Above
+// kCpuBudget, the optional actions, which rebalance caches, are deferred, so
+// that releasing memory, which is not optional, keeps its pace.
+class BackgroundPacer {
+ public:
+  static constexpr int kMaxBackoffShift = 6;
+  static constexpr double kCpuBudget = 0.01;
+  // Weight of the latest iteration in the moving average of the CPU share.
+  static constexpr double kSmoothing = 0.25;
+
+  constexpr BackgroundPacer() = default;
+  BackgroundPacer(const BackgroundPacer&) = delete;
+  BackgroundPacer& operator=(const BackgroundPacer&) = delete;
+
+  // Folds value into fingerprint.
+  static uint64_t Mix(uint64_t fingerprint, uint64_t value) {
+    return (fingerprint ^ value) * uint64_t{0x9e3779b97f4a7c15};
+  }
+
+  // Records an iteration that used busy CPU time, after which the allocator's
+  // state hashed to fingerprint.  Returns how long to sleep before the next
+  // iteration.
+  absl::Duration Update(uint64_t fingerprint, absl::Duration busy,
+                        absl::Duration sleep_time) {
+    iterations_.Add(1);
+    int shift = backoff_shift_.load(std::memory_order_relaxed);
+    if (has_fingerprint_ && fingerprint == fingerprint_) {
+      quiet_iterations_.Add(1);
+      shift = std::min(shift + 1, kMaxBackoffShift);
+    } else {
+      shift = 0;
+    }
+    fingerprint_ = fingerprint;
+    has_fingerprint_ = true;
+    backoff_shift_.store(shift, std::memory_order_relaxed);
+
+    const absl::Duration sleep = sleep_time * (int64_t{1} << shift);
+    const absl::Duration period = busy + sleep;
+    const double share =
+        period > absl::ZeroDuration() ? absl::FDivDuration(busy, period) : 0;
+    const double average = cpu_share_.load(std::memory_order_relaxed);
+    cpu_share_.store(average + kSmoothing * (share - average),
+                     std::memory_order_relaxed);
+    return sleep;
+  }
+
+  // Whether the next iteration should skip its optional actions.  Counts the
+  // iterations that do.
+  bool DeferOptionalActions() {
+    if (backoff_shift() == 0 && cpu_share() <= kCpuBudget) return false;
+    deferred_iterations_.Add(1);
+    return true;
+  }
+
+  // Forgets the previous iterations, e.g. while pacing is disabled.
+  void Reset() {
+    has_fingerprint_ = false;
+    backoff_shift_.store(0, std::memory_order_relaxed);
+    cpu_share_.store(0, std::memory_order_relaxed);
+  }
+
+  int backoff_shift() const {
+    return backoff_shift_.load(std::memory_order_relaxed);
+  }
+  double cpu_share() const { return cpu_share_.load(std::memory_order_relaxed); }
+
+  void Print(Printer& out) const {
+    out.printf(
+        "Background pacing: %zu iterations, %zu quiet, %zu deferred; sleeping "
+        "%d intervals, %.4f%% CPU\n",
+        iterations_.value(), quiet_iterations_.value(),
+        deferred_iterations_.value(), 1 << backoff_shift(),
+        cpu_share() * 100);
+  }
+
+  void PrintInPbtxt(PbtxtRegion& region) const {
+    region.PrintI64("iterations", iterations_.value());
+    region.PrintI64("quiet_iterations", quiet_iterations_.value());
+    region.PrintI64("deferred_iterations", deferred_iterations_.value());
+    region.PrintI64("sleep_intervals", 1 << backoff_shift());
+    region.PrintDouble("cpu_share", cpu_share());
+  }
+
+ private:
+  // Only accessed by the background thread.
+  uint64_t fingerprint_ = 0;
+  bool has_fingerprint_ = false;
+
+  std::atomic<int> backoff_shift_{0};
+  std::atomic<double> cpu_share_{0};
+
+  StatsCounter iterations_;
+  StatsCounter quiet_iterations_;
+  StatsCounter deferred_iterations_;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_BACKGROUND_PACER_H_
@@ -0,0 +1,88 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/background_pacer.h"
+
+#include <stdint.h>
+
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+constexpr absl::Duration kSleep = absl::Seconds(1);
+constexpr absl::Duration kIdle = absl::Microseconds(10);
+
+TEST(BackgroundPacerTest, BacksOffWhileQuiet) {
+  BackgroundPacer pacer;
+  EXPECT_EQ(pacer.Update(1, kIdle, kSleep), kSleep);
+  EXPECT_FALSE(pacer.DeferOptionalActions());
+  EXPECT_EQ(pacer.Update(1, kIdle, kSleep), 2 * kSleep);
+  EXPECT_TRUE(pacer.DeferOptionalActions());
+  EXPECT_EQ(pacer.Update(1, kIdle, kSleep), 4 * kSleep);
+  for (int i = 0; i < 2 * BackgroundPacer::kMaxBackoffShift; ++i) {
+    pacer.Update(1, kIdle, kSleep);
+  }
+  EXPECT_EQ(pacer.Update(1, kIdle, kSleep),
+            kSleep * (1 << BackgroundPacer::kMaxBackoffShift));
+}
+
+TEST(BackgroundPacerTest, ChangesResetBackoff) {
+  BackgroundPacer pacer;
+  pacer.Update(1, kIdle, kSleep);
+  pacer.Update(1, kIdle, kSleep);
+  ASSERT_GT(pacer.backoff_shift(), 0);
+  EXPECT_EQ(pacer.Update(2, kIdle, kSleep), kSleep);
+  EXPECT_EQ(pacer.backoff_shift(), 0);
+  EXPECT_FALSE(pacer.DeferOptionalActions());
+}
+
+TEST(BackgroundPacerTest, DefersOverCpuBudget) {
+  BackgroundPacer pacer;
+  // Each iteration uses 10% of the CPU, and the state keeps changing.
+  for (uint64_t i = 0; i < 20; ++i) {
+    EXPECT_EQ(pacer.Update(i, kSleep / 9, kSleep), kSleep);
+  }
+  EXPECT_GT(pacer.cpu_share(), BackgroundPacer::kCpuBudget);
+  EXPECT_TRUE(pacer.DeferOptionalActions());
+
+  // Cheap iterations bring the average back under budget.
+  for (uint64_t i = 20; i < 60; ++i) {
+    pacer.Update(i, kIdle, kSleep);
+  }
+  EXPECT_LE(pacer.cpu_share(), BackgroundPacer::kCpuBudget);
+  EXPECT_FALSE(pacer.DeferOptionalActions());
+}
+
+TEST(BackgroundPacerTest, Reset) {
+  BackgroundPacer pacer;
+  pacer.Update(1, kSleep, kSleep);
+  pacer.Update(1, kSleep, kSleep);
+  pacer.Reset();
+  EXPECT_EQ(pacer.backoff_shift(), 0);
+  EXPECT_EQ(pacer.cpu_share(), 0);
+  // The next fingerprint is not compared against the one before Reset().
+  EXPECT_EQ(pacer.Update(1, kIdle, kSleep), kSleep);
+}
+
+TEST(BackgroundPacerTest, Mix) {
+  EXPECT_NE(BackgroundPacer::Mix(BackgroundPacer::Mix(0, 1), 2),
+            BackgroundPacer::Mix(BackgroundPacer::Mix(0, 2), 1));
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -14,8 +14,10 @@
 
 #include "tcmalloc/central_freelist.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <new>
 #include <optional>
 
 #include "absl/base/attributes.h"
@@ -27,15 +29,19 @@
 #include "tcmalloc/common.h"
 #include "tcmalloc/error_reporting.h"
 #include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/cache_topology.h"
 #include "tcmalloc/internal/central_freelist_hooks.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/hook_list.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/internal/percpu.h"
 #include "tcmalloc/internal/prefetch.h"
+#include "tcmalloc/lifetime_predictor.h"
 #include "tcmalloc/page_allocator_interface.h"
 #include "tcmalloc/pagemap.h"
 #include "tcmalloc/pages.h"
+#include "tcmalloc/parameters.h"
 #include "tcmalloc/span.h"
 #include "tcmalloc/static_vars.h"
 
@@ -53,6 +59,9 @@ static MemoryTag MemoryTagFromSizeClass(size_t size_class) {
   if (IsExpandedSizeClass(size_class)) {
     return MemoryTag::kCold;
   }
+  if (size_class <= static_cast<size_t>(Parameters::size_class_regions())) {
+    return MemoryTag::kSizeClassed;
+  }
   if (tc_globals.active_partitions() == 1) {
     return MemoryTag::kNormal;
   }
@@ -77,6 +86,10 @@ Length StaticForwarder::class_to_pages(int size_class) {
   return Length(tc_globals.sizemap().class_to_pages(size_class));
 }
 
+size_t StaticForwarder::class_to_colors(int size_class) {
+  return tc_globals.sizemap().class_to_colors(size_class);
+}
+
 size_t StaticForwarder::num_objects_to_move(int size_class) {
   return tc_globals.sizemap().num_objects_to_move(size_class);
 }
@@ -103,28 +116,73 @@ void StaticForwarder::MapObjectsToSpans(absl::Span<void*> batch, Span** spans,
   }
 }
 
-Span* StaticForwarder::AllocateSpan(int size_class, size_t objects_per_span,
-                                    Length pages_per_span) {
-  const MemoryTag tag = MemoryTagFromSizeClass(size_class);
-  const AccessDensityPrediction density = AccessDensity(objects_per_span);
+size_t StaticForwarder::PartitionObjectsOfClass(absl::Span<void*> batch,
+                                                int size_class) {
+  TC_ASSERT_LE(batch.size(), kMaxObjectsToMove);
+  void* foreign[kMaxObjectsToMove];
+  size_t own = 0, num_foreign = 0;
+  for (void* ptr : batch) {
+    if (tc_globals.pagemap().sizeclass(PageIdContaining(ptr)) == size_class) {
+      batch[own++] = ptr;
+    } else {
+      foreign[num_foreign++] = ptr;
+    }
+  }
+  std::copy(foreign, foreign + num_foreign, batch.begin() + own);
+  return own;
+}
 
-  SpanAllocInfo span_alloc_info = {.objects_per_span = objects_per_span,
-                                   .density = density};
+static SpanAllocInfo SpanAllocInfoFor(size_t objects_per_span,
+                                      Length pages_per_span,
+                                      LifetimePrediction lifetime) {
+  const AccessDensityPrediction density = AccessDensity(objects_per_span);
   TC_ASSERT(density == AccessDensityPrediction::kSparse ||
             (density == AccessDensityPrediction::kDense &&
              pages_per_span == Length(1)));
-  Span* span =
-      tc_globals.page_allocator().New(pages_per_span, span_alloc_info, tag);
-  if (ABSL_PREDICT_FALSE(span == nullptr)) {
-    return nullptr;
-  }
-  TC_ASSERT_EQ(tag, GetMemoryTag(span->start_address()));
+  return {.objects_per_span = objects_per_span,
+          .density = density,
+          .lifetime = lifetime};
+}
+
+static void RegisterSpan(Span* absl_nonnull span, int size_class,
+                         Length pages_per_span) {
+  TC_ASSERT_EQ(MemoryTagFromSizeClass(size_class),
+               GetMemoryTag(span->start_address()));
+  TC_ASSERT(MemoryTagFromSizeClass(size_class) != MemoryTag::kSizeClassed ||
+            SizeClassFromRegion(span->start_address()) == size_class);
   TC_ASSERT_EQ(span->num_pages(), pages_per_span);
 
   tc_globals.pagemap().RegisterSizeClass(span, size_class);
+}
+
+Span* StaticForwarder::AllocateSpan(int size_class, size_t objects_per_span,
+                                    Length pages_per_span,
+                                    LifetimePrediction lifetime) {
+  Span* span = tc_globals.page_allocator().New(
+      pages_per_span,
+      SpanAllocInfoFor(objects_per_span, pages_per_span, lifetime),
+      MemoryTagFromSizeClass(size_class), size_class);
+  if (ABSL_PREDICT_FALSE(span == nullptr)) {
+    return nullptr;
+  }
+  RegisterSpan(span, size_class, pages_per_span);
   return span;
 }
 
+size_t StaticForwarder::AllocateSpans(int size_class, size_t objects_per_span,
+                                      Length pages_per_span,
+                                      LifetimePrediction lifetime,
+                                      absl::Span<Span*> spans) {
+  const size_t allocated = tc_globals.page_allocator().NewBatch(
+      pages_per_span,
+      SpanAllocInfoFor(objects_per_span, pages_per_span, lifetime),
+      MemoryTagFromSizeClass(size_class), size_class, spans);
+  for (size_t i = 0; i < allocated; ++i) {
+    RegisterSpan(spans[i], size_class, pages_per_span);
+  }
+  return allocated;
+}
+
 #ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
 static void ReturnSpansToPageHeap(MemoryTag tag, absl::Span<Span*> free_spans,
                                   size_t objects_per_span)
@@ -192,6 +250,33 @@ void StaticForwarder::DeallocateSpans(size_t objects_per_span,
 #endif
 }
 
+void* StaticForwarder::Alloc(size_t size, std::align_val_t alignment) {
+  return tc_globals.arena().Alloc(size, alignment);
+}
+
+unsigned StaticForwarder::CurrentShard(unsigned num_shards) {
+  const int cpu = subtle::percpu::GetRealCpu();
+  if (ABSL_PREDICT_FALSE(cpu < 0)) {
+    return 0;
+  }
+  const CacheTopology& topology = CacheTopology::Instance();
+  const unsigned l3_count = topology.l3_count();
+  if (l3_count >= num_shards) {
+    return topology.GetL3FromCpuId(cpu) * num_shards / l3_count;
+  }
+  // With fewer L3 caches than shards, e.g. on a single socket, spread the
+  // cpus of each cache over the shards instead.
+  return static_cast<unsigned>(cpu) % num_shards;
+}
+
+bool StaticForwarder::prefetch_span_freelists() {
+  return Parameters::refill_prefetch_objects() > 0;
+}
+
+bool StaticForwarder::cache_empty_spans() {
+  return Parameters::central_freelist_empty_spans();
+}
+
 ABSL_ATTRIBUTE_NOINLINE void StaticForwarder::InvokeInsertRangeHookSlow(
     size_t size_class, absl::Span<void*> batch) {
   central_freelist_insert_range_hooks.Invoke(size_class, batch);
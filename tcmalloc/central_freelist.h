@@ -19,10 +19,12 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <limits>
+#include <new>
 
 #include "absl/algorithm/container.h"
 #include "absl/base/attributes.h"
@@ -44,7 +46,12 @@
 #include "tcmalloc/internal/hook_list.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/optimization.h"
+#include "tcmalloc/internal/probes.h"
+#include "tcmalloc/lifetime_predictor.h"
+#include "tcmalloc/lock_contention_profiler.h"
+#include "tcmalloc/mesh_estimator.h"
 #include "tcmalloc/pages.h"
+#include "tcmalloc/slow_path_latency.h"
 #include "tcmalloc/span.h"
 #include "tcmalloc/span_stats.h"
 
@@ -55,19 +62,33 @@ namespace tcmalloc_internal {
 // TODO(b/29448043): Remove latency injection.
 // TODO(b/296824599): AllocationGuardSpinLockHolder adds an AllocationGuard
 // which is not yet compatible with the CentralFreeListTest code.
+//
+// Acquisitions that find the lock held by another thread are reported to the
+// lock contention profile and, if contentions is not null, counted in it.  The
+// check is racy, but it only feeds the sharding heuristics of CentralFreeList
+// and a sampled profile, and the count itself is updated under the lock.
 class ABSL_SCOPED_LOCKABLE CentralFreeListLockHolder {
  public:
-  explicit CentralFreeListLockHolder(absl::base_internal::SpinLock& lock)
+  explicit CentralFreeListLockHolder(
+      absl::base_internal::SpinLock& lock,
+      StatsCounter* absl_nullable contentions = nullptr)
       ABSL_EXCLUSIVE_LOCK_FUNCTION(lock)
-      : lock_(lock) {
+      : contention_(lock), lock_(lock) {
     lock_.lock();
+    contention_.Acquired();
+    if (ABSL_PREDICT_FALSE(contention_.contended()) && contentions != nullptr) {
+      contentions->LossyAdd(1);
+    }
 #ifdef TCMALLOC_INTERNAL_LATENCY_INJECTION
     ScopedDelay delay(ScopedDelay::central_freelist_delay);
 #endif
   }
+  // contention_ is destroyed after the unlock, so sampling happens outside the
+  // critical section.
   ~CentralFreeListLockHolder() ABSL_UNLOCK_FUNCTION() { lock_.unlock(); }
 
  private:
+  LockContentionTimer contention_;
   absl::base_internal::SpinLock& lock_;
 };
 
@@ -105,17 +126,39 @@ class StaticForwarder {
 
   static size_t class_to_size(int size_class);
   static Length class_to_pages(int size_class);
+  static size_t class_to_colors(int size_class);
   static void MapObjectsToSpans(absl::Span<void*> batch,
                                 Span** absl_nonnull spans,
                                 int expected_size_class);
-  [[nodiscard]] static Span* absl_nullable AllocateSpan(int size_class,
-                                                        size_t objects_per_span,
-                                                        Length pages_per_span)
+  // Moves the objects of batch whose span belongs to size_class to its front,
+  // keeping their order, and returns how many there are.
+  static size_t PartitionObjectsOfClass(absl::Span<void*> batch,
+                                        int size_class);
+  [[nodiscard]] static Span* absl_nullable AllocateSpan(
+      int size_class, size_t objects_per_span, Length pages_per_span,
+      LifetimePrediction lifetime) ABSL_LOCKS_EXCLUDED(pageheap_lock);
+  // As AllocateSpan, but allocates up to spans.size() spans at once, storing
+  // them at the front of "spans".  Returns how many were allocated.
+  [[nodiscard]] static size_t AllocateSpans(int size_class,
+                                            size_t objects_per_span,
+                                            Length pages_per_span,
+                                            LifetimePrediction lifetime,
+                                            absl::Span<Span*> spans)
       ABSL_LOCKS_EXCLUDED(pageheap_lock);
   static size_t num_objects_to_move(int size_class);
   static void DeallocateSpans(size_t objects_per_span,
                               absl::Span<Span*> free_spans)
       ABSL_LOCKS_EXCLUDED(pageheap_lock);
+  static void* absl_nonnull Alloc(size_t size, std::align_val_t alignment);
+  // Returns the shard, in [0, num_shards), that the current cpu should use.
+  // Cpus sharing an L3 cache share a shard when there are enough L3 caches.
+  static unsigned CurrentShard(unsigned num_shards);
+  // Whether RemoveRange prefetches the freelist head of the spans it leaves
+  // nonempty, see Parameters::refill_prefetch_objects().
+  static bool prefetch_span_freelists();
+  // Whether spans that become empty are kept for reuse for a while, see
+  // Parameters::central_freelist_empty_spans().
+  static bool cache_empty_spans();
 
  private:
   static void InvokeInsertRangeHookSlow(size_t size_class,
@@ -125,7 +168,9 @@ class StaticForwarder {
 };
 
 // Specifies number of nonempty_ lists that keep track of non-empty spans.
-static constexpr size_t kNumLists = 8;
+// HintedTrackerLists finds the first non-empty list in constant time, so finer
+// occupancy buckets do not lengthen the time spent under lock_.
+static constexpr size_t kNumLists = 32;
 static constexpr size_t kNumListsTotal = kNumLists * 2;
 static_assert(1 << Span::kNonemptyIndexBits >= kNumListsTotal);
 // Specifies the threshold for number of objects per span. The threshold is
@@ -140,6 +185,23 @@ static constexpr size_t kSpanMoveStatBuckets =
 // spans used to fill a batch.
 static constexpr size_t kSpansUsedStatBuckets =
     absl::bit_width(kMaxObjectsToMove);
+// Specifies the most spans that Populate fetches from the page heap at once,
+// when a batch needs more objects than a span holds.
+static constexpr size_t kMaxPopulateSpans = 8;
+// Specifies the most empty spans that a central freelist keeps for reuse, and
+// how long they may stay unused before the background thread returns them to
+// the page heap.
+static constexpr size_t kMaxEmptySpans = 2;
+static constexpr absl::Duration kEmptySpanIdleThreshold = absl::Seconds(5);
+// Specifies the most spans that LeastOccupiedSpans may report.
+static constexpr size_t kMaxLeastOccupiedSpans = 16;
+
+// The allocated objects of a span, see CentralFreeList::LeastOccupiedSpans.
+struct SpanSnapshot {
+  void* start;
+  uint16_t allocated;
+  SpanOccupancy occupancy;
+};
 
 enum class LifetimeTracking : bool { kDisabled = false, kEnabled = true };
 
@@ -202,7 +264,13 @@ class CentralFreeList {
       ABSL_LOCKS_EXCLUDED(lock_);
 
   // Returns the number of free objects in cache.
-  size_t length() const { return static_cast<size_t>(counter_.value()); }
+  size_t length() const {
+    size_t length = static_cast<size_t>(counter_.value());
+    for (const CentralFreeList& shard : extra_shards()) {
+      length += shard.length();
+    }
+    return length;
+  }
 
   // Returns the memory overhead (internal fragmentation) attributable
   // to the freelist.  This is memory lost when the size of elements
@@ -228,6 +296,8 @@ class CentralFreeList {
   void PrintSpanLifetimeStatsInPbtxt(PbtxtRegion& region);
   void PrintNumSpansUsedInPbtxt(PbtxtRegion& region);
   void PrintLongLivedSpansMovedInPbtxt(PbtxtRegion& region);
+  void PrintLifetimePredictions(Printer& out);
+  void PrintLifetimePredictionsInPbtxt(PbtxtRegion& region);
 
   // Get number of spans in the histogram bucket. We record spans in the
   // histogram indexed by absl::bit_width(allocated). So, instead of using the
@@ -236,13 +306,167 @@ class CentralFreeList {
   // histogram.
   size_t NumSpansWith(uint16_t bitwidth) const;
 
-  Forwarder& forwarder() { return forwarder_; }
+  // Shards share the forwarder of the central freelist they were split from.
+  Forwarder& forwarder() {
+    return primary_ == nullptr ? forwarder_ : primary_->forwarder_;
+  }
 
   // Move long-lived spans to long-lived section of nonempty_.
   void HandleLongLivedSpans() ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns to the page heap the empty spans that were kept for reuse and went
+  // unused for kEmptySpanIdleThreshold, or all of them if the forwarder no
+  // longer keeps empty spans.
+  void ReleaseIdleEmptySpans() ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns the number of spans that Populate reused rather than allocating
+  // them from the page heap.
+  size_t empty_span_hits() const;
+
+  // Reports the empty spans kept and reused.
+  void PrintEmptySpanStats(Printer& out);
+  void PrintEmptySpanStatsInPbtxt(PbtxtRegion& region);
+
+  // Estimates how many spans meshing would free, from the allocated objects of
+  // up to kMaxMeshCandidates spans that are at most half full, see
+  // mesh_estimator.h.  Size classes with more than kMaxMeshObjects objects per
+  // span are skipped.
+  void EstimateMeshableSpans() ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns the number of spans sampled, and of pairs of them found meshable,
+  // by the last EstimateMeshableSpans.
+  size_t mesh_candidates() const;
+  size_t meshable_pairs() const;
+
+  // Reports the last meshing estimate.
+  void PrintMeshStats(Printer& out);
+  void PrintMeshStatsInPbtxt(PbtxtRegion& region);
+
+  // Records in spans, sparsest first, up to spans.size() of the sparsest spans
+  // that have at most a quarter of their objects allocated, and returns how
+  // many were recorded.  Size classes with more than kMaxMeshObjects objects
+  // per span report none.  The spans may change as soon as this returns.
+  // REQUIRES: spans.size() <= kMaxLeastOccupiedSpans.
+  size_t LeastOccupiedSpans(absl::Span<SpanSnapshot> spans)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Records the predicted lifetime of a sampled allocation of this size class.
+  // While long-lived predictions dominate, new spans are placed directly in
+  // the long-lived section of nonempty_; while short-lived ones dominate,
+  // allocations prefer spans from the short-lived section.
+  void RecordLifetimePrediction(LifetimePrediction prediction);
   size_t objects_per_span() const { return objects_per_span_; }
+  Length pages_per_span() const { return pages_per_span_; }
+
+  // Number of spans allocated between two AdaptSpanLength calls above which
+  // spans get longer.
+  static constexpr int64_t kMaxRefillsForShortSpans = 8;
+
+  // Picks the length of the spans Populate allocates, between the shortest
+  // valid one and SizeMap's, from the traffic since the previous call: spans
+  // double in length if more than kMaxRefillsForShortSpans of them were
+  // allocated, and halve if at most one was and fewer than half of the
+  // objects of the live spans are in use.  As all spans of a size class have
+  // the same length, Populate only applies a new length once the size class
+  // holds no spans.  Must not be called concurrently with itself.
+  void AdaptSpanLength() ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Maximum number of shards a size class may be split into.
+  static constexpr int kMaxShards = 1 << Span::kCentralFreeListShardBits;
+  // Number of contended lock acquisitions between two ShardIfContended calls
+  // that make a size class worth sharding.
+  static constexpr int64_t kMinContentionsToShard = 1024;
+
+  // Splits this size class over num_shards central freelists, this one
+  // included, each with its own lock and spans.  RemoveRange then serves each
+  // cpu from the shard of its L3 cache, while InsertRange returns objects to
+  // the shard owning their span.  Sharding is permanent.  Returns false if the
+  // size class is already sharded or is not worth sharding.
+  bool EnableShards(int num_shards) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Shards this size class over up to max_shards central freelists if at
+  // least kMinContentionsToShard lock acquisitions found the lock held since
+  // the previous call.  Must not be called concurrently with itself.
+  void ShardIfContended(int max_shards) ABSL_LOCKS_EXCLUDED(lock_);
+
+  int num_shards() const {
+    return num_shards_.load(std::memory_order_acquire);
+  }
+
+  // Returns the number of lock acquisitions, over all shards, that found the
+  // lock held by another thread.
+  size_t lock_contentions() const;
+
+  // Returns the number of objects handed out by RemoveRange, over all shards.
+  size_t objects_removed() const;
+
+  // Reports the number of shards and the lock contention of each.
+  void PrintShardStats(Printer& out);
+  void PrintShardStatsInPbtxt(PbtxtRegion& region);
+
+  // Lets a rarely used size class borrow objects from the spans of `lender`,
+  // the next larger size class, rather than keeping a mostly empty span of
+  // its own.  Borrowing starts if fewer than a quarter of a span's objects
+  // were removed since the previous call, this class holds at most one span
+  // and neither class is already involved in sharing.  It stops once a span's
+  // worth of objects is removed between two calls, or when `lender` changes.
+  // While borrowing, RemoveRange is served by `lender`.  InsertRange returns
+  // borrowed objects to the size class of their span, as they keep showing
+  // up after borrowing stops.  Must not be called concurrently with itself.
+  void UpdateSpanSharing(CentralFreeList* absl_nullable lender)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Whether RemoveRange is currently served by another size class.
+  bool borrowing() const {
+    return lender_.load(std::memory_order_relaxed) != nullptr;
+  }
+  // Whether another size class currently borrows from this one.
+  bool lending() const { return lending_.load(std::memory_order_relaxed); }
+  // Whether another size class ever borrowed from this one, in which case
+  // objects of this class may be freed with the size of the borrowing class.
+  bool lent() const { return lent_.load(std::memory_order_relaxed); }
+
+  // Lets InsertRange return objects of `lender`, the same size class on the
+  // other NUMA partition, which the transfer cache lent out under this size
+  // class.  Never undone, as such objects keep showing up in the caches.
+  void set_numa_lender(CentralFreeList* absl_nonnull lender) {
+    if (numa_lender_.load(std::memory_order_relaxed) != lender) {
+      numa_lender_.store(lender, std::memory_order_release);
+    }
+  }
+
+  // Reports whether this size class borrows and how many objects it borrowed.
+  void PrintSpanSharingStats(Printer& out);
+  void PrintSpanSharingStatsInPbtxt(PbtxtRegion& region);
 
  private:
+  // Shards other than this one.  Empty unless EnableShards was called.
+  absl::Span<CentralFreeList> extra_shards() const {
+    return {shards_, static_cast<size_t>(num_shards() - 1)};
+  }
+
+  CentralFreeList& shard(uint8_t index) {
+    TC_ASSERT_LT(index, num_shards());
+    return index == 0 ? *this : shards_[index - 1];
+  }
+
+  // Shards follow the lifetime predictions of the central freelist they were
+  // split from.
+  int8_t lifetime_votes() const {
+    return (primary_ == nullptr ? this : primary_)
+        ->lifetime_votes_.load(std::memory_order_relaxed);
+  }
+
+  // Releases the objects of batch, whose spans must belong to this shard, to
+  // their spans.  spans holds the span of each object and is clobbered.
+  void ReleaseBatch(absl::Span<void*> batch, Span** absl_nonnull spans)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Groups the objects of batch by the shard owning their span and releases
+  // each group to its shard.
+  void ReleaseBatchToShards(absl::Span<void*> batch,
+                            Span** absl_nonnull spans, int num_shards);
+
   // Release a batch of objects to a span.
   //
   // Returns object's span if it become completely free.
@@ -263,8 +487,24 @@ class CentralFreeList {
   // Allocate a span from the forwarder.
   Span* AllocateSpan();
 
-  // Deallocate spans to the forwarder.
-  void DeallocateSpans(absl::Span<Span* absl_nonnull> spans);
+  // Allocate up to spans.size() spans from the forwarder at once.  Returns
+  // how many were allocated.
+  size_t AllocateSpans(absl::Span<Span*> spans);
+
+  // The lifetime of this size class's spans, for the page allocator.
+  LifetimePrediction PredictedLifetime() const;
+
+  // Deallocate spans to the forwarder.  objects_per_span is read under lock_
+  // by the caller, as the span length may change once they are returned.
+  void DeallocateSpans(absl::Span<Span* absl_nonnull> spans,
+                       uint32_t objects_per_span);
+
+  // Whether spans of `pages` hold at least two objects and waste at most an
+  // eighth of their bytes.
+  bool IsValidSpanLength(Length pages) const;
+
+  // Sets pages_per_span_ and the members derived from it.
+  void SetSpanLength(Length pages);
 
   // Parses nonempty_ and returns span from the
   // list with the lowest possible index. Returns the span if one exists in the
@@ -316,6 +556,24 @@ class CentralFreeList {
   // is higher than that.
   size_t first_nonempty_index_;
   Length pages_per_span_;
+  // Range that AdaptSpanLength picks pages_per_span_ in.  The longest is
+  // SizeMap's.
+  Length min_pages_per_span_;
+  Length max_pages_per_span_;
+  // Length that Populate switches to once the size class holds no spans.
+  Length target_pages_per_span_ ABSL_GUARDED_BY(lock_);
+  // Populate calls that released lock_ to allocate spans, which num_spans()
+  // does not count yet.
+  int populates_in_flight_ ABSL_GUARDED_BY(lock_) = 0;
+  // Value of num_spans_requested_ seen by the previous AdaptSpanLength call.
+  int64_t last_spans_requested_ = 0;
+  // Number of times Populate switched to another span length.
+  StatsCounter span_length_changes_;
+  // Number of object start offsets that new spans rotate through, see
+  // SizeMap::class_to_colors().
+  size_t num_colors_ = 1;
+  // Color of the next span that Populate builds.
+  uint32_t next_color_ ABSL_GUARDED_BY(lock_) = 0;
 
   size_t num_spans() const {
     size_t requested = num_spans_requested_.value();
@@ -419,12 +677,74 @@ class CentralFreeList {
   // nonempty_[kNumLists-1] list, leaving other lists unused.
   HintedTrackerLists<Span, kNumListsTotal> nonempty_ ABSL_GUARDED_BY(lock_);
 
+  // Number of Populate calls since objects were last returned.  A second
+  // Populate in a row means objects are only leaving, so a burst is under way.
+  uint8_t consecutive_populates_ ABSL_GUARDED_BY(lock_) = 0;
+
+  // Spans that became empty, kept rather than returned to the page heap when
+  // the forwarder's cache_empty_spans() is set, so that the next Populate need
+  // not take the page heap's lock.  Their objects stay counted in counter_ and
+  // the spans in num_spans() until they are returned.
+  struct EmptySpan {
+    Span* span;
+    // Clock value when the span became empty.
+    uint64_t empty_since;
+  };
+  EmptySpan empty_spans_[kMaxEmptySpans] ABSL_GUARDED_BY(lock_) = {};
+  uint8_t num_empty_spans_ ABSL_GUARDED_BY(lock_) = 0;
+  // Number of empty spans that Populate reused.
+  StatsCounter empty_span_hits_;
+
+  // Results of the last EstimateMeshableSpans.
+  std::atomic<uint32_t> mesh_candidates_{0};
+  std::atomic<uint32_t> meshable_pairs_{0};
+
   bool use_all_buckets_for_few_object_spans_;
 
   // Tracks the number of long-lived spans moved to the long-lived section of
   // nonempty_ per call to HandleLongLivedSpans.
   StatsCounters<kSpanMoveStatBuckets> long_lived_spans_moved_;
 
+  // Saturating balance of long-lived (positive) and short-lived (negative)
+  // lifetime predictions, see RecordLifetimePrediction.
+  static constexpr int8_t kMaxLifetimeVotes = 8;
+  std::atomic<int8_t> lifetime_votes_{0};
+  // Number of spans placed in the long-lived section when populated, and of
+  // spans picked from the short-lived section ahead of fuller long-lived ones,
+  // because of lifetime predictions.
+  StatsCounter predicted_long_lived_spans_;
+  StatsCounter predicted_short_lived_spans_;
+
+  // Lock acquisitions that found lock_ held by another thread.
+  StatsCounter lock_contentions_;
+  // Value of lock_contentions() seen by the previous ShardIfContended call.
+  int64_t last_lock_contentions_ = 0;
+
+  // Objects handed out by RemoveRange, borrowed ones included.
+  StatsCounter objects_removed_;
+  // Objects handed out by RemoveRange that came from lender_.
+  StatsCounter objects_borrowed_;
+  // Value of objects_removed() seen by the previous UpdateSpanSharing call.
+  int64_t last_objects_removed_ = 0;
+  // The size class serving RemoveRange, or nullptr when not borrowing.
+  std::atomic<CentralFreeList*> lender_{nullptr};
+  // The last size class borrowed from.  Kept after borrowing stops, so that
+  // InsertRange keeps returning its objects.
+  std::atomic<CentralFreeList*> borrowed_from_{nullptr};
+  // See set_numa_lender.
+  std::atomic<CentralFreeList*> numa_lender_{nullptr};
+  std::atomic<bool> lending_{false};
+  std::atomic<bool> lent_{false};
+
+  // Number of shards, including this one.  shards_ holds the other
+  // num_shards_ - 1 shards; it is published before num_shards_ and never
+  // freed.  Shards point back to the central freelist they were split from
+  // through primary_, and shard_index_ is recorded in the spans they own.
+  std::atomic<int> num_shards_{1};
+  CentralFreeList* absl_nullable shards_ = nullptr;
+  CentralFreeList* absl_nullable primary_ = nullptr;
+  uint8_t shard_index_ = 0;
+
   ABSL_ATTRIBUTE_NO_UNIQUE_ADDRESS Forwarder forwarder_;
 };
 
@@ -433,14 +753,46 @@ template <class Forwarder>
 inline void CentralFreeList<Forwarder>::Init(size_t size_class)
     ABSL_NO_THREAD_SAFETY_ANALYSIS {
   size_class_ = size_class;
-  object_size_ = forwarder_.class_to_size(size_class);
+  object_size_ = forwarder().class_to_size(size_class);
   if (object_size_ == 0) {
     return;
   }
-  pages_per_span_ = forwarder_.class_to_pages(size_class);
-  objects_per_span_ =
-      pages_per_span_.in_bytes() / (object_size_ ? object_size_ : 1);
   size_reciprocal_ = Span::CalcReciprocal(object_size_);
+  max_pages_per_span_ = forwarder().class_to_pages(size_class);
+  min_pages_per_span_ = max_pages_per_span_;
+  // Spans of bitmap size classes hold fewer objects when shorter, so they may
+  // shrink as long as they keep at least two objects and waste at most an
+  // eighth of their bytes.
+  if (Span::UseBitmapForSize(object_size_)) {
+    for (Length pages = Length(1); pages < max_pages_per_span_; ++pages) {
+      if (IsValidSpanLength(pages)) {
+        min_pages_per_span_ = pages;
+        break;
+      }
+    }
+  }
+  target_pages_per_span_ = max_pages_per_span_;
+  SetSpanLength(max_pages_per_span_);
+  num_to_move_ = forwarder().num_objects_to_move(size_class);
+}
+
+template <class Forwarder>
+inline bool CentralFreeList<Forwarder>::IsValidSpanLength(Length pages) const {
+  const size_t bytes = pages.in_bytes();
+  return bytes / object_size_ >= 2 && bytes % object_size_ <= bytes / 8;
+}
+
+// Called by Init, or with lock_ held while the size class holds no spans.
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::SetSpanLength(Length pages)
+    ABSL_NO_THREAD_SAFETY_ANALYSIS {
+  pages_per_span_ = pages;
+  objects_per_span_ = pages.in_bytes() / object_size_;
+  // Colors are chosen for the slack of SizeMap's span length.
+  num_colors_ =
+      pages == max_pages_per_span_
+          ? std::max<size_t>(forwarder().class_to_colors(size_class_), 1)
+          : 1;
   use_all_buckets_for_few_object_spans_ = objects_per_span_ <= 2 * kNumLists;
 
   // Records nonempty_ list index associated with the span with
@@ -455,7 +807,6 @@ inline void CentralFreeList<Forwarder>::Init(size_t size_class)
                 std::min<size_t>(absl::bit_width(objects_per_span_), kNumLists);
 
   TC_ASSERT_LE(absl::bit_width(objects_per_span_), kSpanUtilBucketCapacity);
-  num_to_move_ = forwarder_.num_objects_to_move(size_class);
 }
 
 template <class Forwarder>
@@ -522,9 +873,41 @@ inline Span* CentralFreeList<Forwarder>::FirstNonEmptySpan() {
   // Scan nonempty_ lists in the range [first_nonempty_index_, kNumLists) and
   // return the span from a non-empty list if one exists. If all the lists are
   // empty, return nullptr.
+  //
+  // If recent allocations of this size class are predicted to be short-lived,
+  // try the short-lived section first, so that they do not pin long-lived
+  // spans.
+  if (lifetime_votes() < 0) {
+    Span* span = nonempty_.PeekLeast(GetFirstNonEmptyIndex() + kNumLists);
+    if (span != nullptr) {
+      predicted_short_lived_spans_.LossyAdd(1);
+      return span;
+    }
+  }
   return nonempty_.PeekLeast(GetFirstNonEmptyIndex());
 }
 
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::RecordLifetimePrediction(
+    LifetimePrediction prediction) {
+  // Lossy, like the predictions themselves: concurrent updates may be lost.
+  const int8_t v = lifetime_votes_.load(std::memory_order_relaxed);
+  switch (prediction) {
+    case LifetimePrediction::kLongLived:
+      if (v < kMaxLifetimeVotes) {
+        lifetime_votes_.store(v + 1, std::memory_order_relaxed);
+      }
+      break;
+    case LifetimePrediction::kShortLived:
+      if (v > -kMaxLifetimeVotes) {
+        lifetime_votes_.store(v - 1, std::memory_order_relaxed);
+      }
+      break;
+    case LifetimePrediction::kUnknown:
+      break;
+  }
+}
+
 template <class Forwarder>
 inline uint8_t CentralFreeList<Forwarder>::GetFirstNonEmptyIndex() const {
   return first_nonempty_index_;
@@ -541,9 +924,9 @@ inline uint8_t CentralFreeList<Forwarder>::IndexFor(bool is_long_lived_span,
   //
   // The number of objects per span is less than or equal to 2 * kNumlists.
   // We index such spans by just the number of allocated objects.  When the
-  // allocated objects are in the range [1, 8], then we map the spans to buckets
-  // 7, 6, ... 0 respectively.  When the allocated objects are more than
-  // kNumlists, then we map the span to bucket 0.
+  // allocated objects are in the range [1, kNumLists], then we map the spans to
+  // buckets kNumLists - 1, ... 0 respectively.  When the allocated objects are
+  // more than kNumlists, then we map the span to bucket 0.
   ASSUME(allocated > 0);
   size_t lifetime_offset = is_long_lived_span ? 0 : kNumLists;
   if (use_all_buckets_for_few_object_spans_) {
@@ -563,6 +946,9 @@ inline uint8_t CentralFreeList<Forwarder>::IndexFor(bool is_long_lived_span,
   // nonempty_[idx] list using a notation [a, b) -> idx.
   // [1, 2) -> 7, [2, 4) -> 6, [4, 8) -> 5, [8, 16) -> 4, [16, 32) -> 3, [32,
   // 64) -> 2, [64, 128) -> 1, [128, 1024) -> 0.
+  //
+  // With kNumLists = 32, no bucket needs to be clamped, and the same span sizes
+  // use buckets 31 down to 21.
   ASSUME(bitwidth > 0);
   const uint8_t offset = std::min<size_t>(bitwidth, kNumLists);
   const uint8_t index = kNumLists - offset;
@@ -574,28 +960,110 @@ template <class Forwarder>
 inline size_t CentralFreeList<Forwarder>::NumSpansInList(int n) {
   ASSUME(n >= 0);
   ASSUME(n < kNumLists * 2);
+  size_t spans = 0;
+  for (CentralFreeList& shard : extra_shards()) {
+    spans += shard.NumSpansInList(n);
+  }
   CentralFreeListLockHolder h(lock_);
-  return nonempty_.SizeOfList(n);
+  return spans + nonempty_.SizeOfList(n);
 }
 
 template <class Forwarder>
 inline void CentralFreeList<Forwarder>::InsertRange(absl::Span<void*> batch) {
+  ScopedSlowPathTimer timer(SlowPath::kCentralFreeListInsert);
   TC_CHECK(!batch.empty());
   TC_CHECK_LE(batch.size(), kMaxObjectsToMove);
 
-  forwarder_.InvokeInsertRangeHook(size_class_, batch);
+  CentralFreeList* lender = borrowed_from_.load(std::memory_order_acquire);
+  CentralFreeList* numa_lender = numa_lender_.load(std::memory_order_acquire);
+  if (ABSL_PREDICT_FALSE(lender != nullptr || numa_lender != nullptr)) {
+    // Borrowed objects go back to the spans they came from.
+    const size_t own =
+        forwarder().PartitionObjectsOfClass(batch, size_class_);
+    absl::Span<void*> borrowed = batch.subspan(own);
+    if (numa_lender != nullptr && !borrowed.empty()) {
+      const size_t remote =
+          lender == nullptr ? borrowed.size()
+                            : forwarder().PartitionObjectsOfClass(
+                                  borrowed, numa_lender->size_class_);
+      if (remote > 0) {
+        numa_lender->InsertRange(borrowed.first(remote));
+      }
+      borrowed = borrowed.subspan(remote);
+    }
+    if (!borrowed.empty()) {
+      lender->InsertRange(borrowed);
+    }
+    if (own == 0) return;
+    batch = batch.first(own);
+  }
+
+  forwarder().InvokeInsertRangeHook(size_class_, batch);
 
   Span* spans[kMaxObjectsToMove];
   // First, map objects to spans and prefetch spans outside of our mutex
   // (to reduce critical section size and cache misses).
-  forwarder_.MapObjectsToSpans(batch, spans, size_class_);
+  forwarder().MapObjectsToSpans(batch, spans, size_class_);
 
   if (objects_per_span_ == 1) {
     // If there is only 1 object per span, skip CentralFreeList entirely.
-    DeallocateSpans({spans, batch.size()});
+    DeallocateSpans({spans, batch.size()}, /*objects_per_span=*/1);
+    return;
+  }
+
+  const int num_shards = this->num_shards();
+  if (ABSL_PREDICT_FALSE(num_shards > 1)) {
+    ReleaseBatchToShards(batch, spans, num_shards);
+    return;
+  }
+  ReleaseBatch(batch, spans);
+}
+
+template <class Forwarder>
+void CentralFreeList<Forwarder>::ReleaseBatchToShards(absl::Span<void*> batch,
+                                                      Span** spans,
+                                                      int num_shards) {
+  // Batches usually come from a single shard's spans.
+  const uint8_t first = spans[0]->central_freelist_shard();
+  bool same_shard = true;
+  size_t counts[kMaxShards] = {0};
+  for (int i = 0; i < batch.size(); ++i) {
+    const uint8_t index = spans[i]->central_freelist_shard();
+    TC_ASSERT_LT(index, num_shards);
+    same_shard &= index == first;
+    ++counts[index];
+  }
+  if (ABSL_PREDICT_TRUE(same_shard)) {
+    shard(first).ReleaseBatch(batch, spans);
     return;
   }
 
+  // Stable counting sort by shard, which keeps objects of a span together.
+  size_t offsets[kMaxShards];
+  size_t offset = 0;
+  for (int index = 0; index < num_shards; ++index) {
+    offsets[index] = offset;
+    offset += counts[index];
+  }
+  void* objects[kMaxObjectsToMove];
+  Span* owners[kMaxObjectsToMove];
+  for (int i = 0; i < batch.size(); ++i) {
+    const size_t pos = offsets[spans[i]->central_freelist_shard()]++;
+    objects[pos] = batch[i];
+    owners[pos] = spans[i];
+  }
+  offset = 0;
+  for (int index = 0; index < num_shards; ++index) {
+    if (counts[index] == 0) continue;
+    shard(index).ReleaseBatch({&objects[offset], counts[index]},
+                              &owners[offset]);
+    offset += counts[index];
+  }
+}
+
+template <class Forwarder>
+void CentralFreeList<Forwarder>::ReleaseBatch(absl::Span<void*> batch,
+                                              Span** spans) {
 #ifndef TCMALLOC_INTERNAL_LEGACY_LOCKING
   using RunLength = uint8_t;
   RunLength run_lengths[kMaxObjectsToMove] = {0};
@@ -639,7 +1107,8 @@ inline void CentralFreeList<Forwarder>::InsertRange(absl::Span<void*> batch) {
   // Then, release all individual objects into spans under our mutex
   // and collect spans that become completely free.
   {
-    CentralFreeListLockHolder h(lock_);
+    CentralFreeListLockHolder h(lock_, &lock_contentions_);
+    consecutive_populates_ = 0;
 #ifndef TCMALLOC_INTERNAL_LEGACY_LOCKING
     num_same_spans_[same_span].LossyAdd(1);
 #endif
@@ -662,22 +1131,33 @@ inline void CentralFreeList<Forwarder>::InsertRange(absl::Span<void*> batch) {
       i += step;
     }
 
+    // Keep the spans that became empty, up to kMaxEmptySpans, for the next
+    // Populate.
+    if (ABSL_PREDICT_FALSE(free_count > 0) &&
+        num_empty_spans_ < kMaxEmptySpans && forwarder().cache_empty_spans()) {
+      const uint64_t now = forwarder().clock_now();
+      do {
+        empty_spans_[num_empty_spans_++] = {free_spans[--free_count], now};
+      } while (free_count > 0 && num_empty_spans_ < kMaxEmptySpans);
+    }
+
     RecordMultiSpansDeallocated(free_count);
     UpdateObjectCounts(batch.size());
   }
 
   // Then, release all free spans into page heap under its mutex.
   if (ABSL_PREDICT_FALSE(free_count)) {
-    DeallocateSpans(absl::MakeSpan(free_spans, free_count));
+    DeallocateSpans(absl::MakeSpan(free_spans, free_count), objects_per_span);
   }
 }
 
 template <class Forwarder>
-void CentralFreeList<Forwarder>::DeallocateSpans(absl::Span<Span*> spans) {
+void CentralFreeList<Forwarder>::DeallocateSpans(absl::Span<Span*> spans,
+                                                 uint32_t objects_per_span) {
   // Size classes with 1 object per span skip CentralFreeList entirely.
-  if (objects_per_span_ > 1) {
-    const uint64_t now = forwarder_.clock_now();
-    const double frequency = forwarder_.clock_frequency();
+  if (objects_per_span > 1) {
+    const uint64_t now = forwarder().clock_now();
+    const double frequency = forwarder().clock_frequency();
     for (Span* span : spans) {
       const double elapsed = std::max<double>(now - span->AllocTime(), 0);
       const absl::Duration lifetime =
@@ -685,13 +1165,32 @@ void CentralFreeList<Forwarder>::DeallocateSpans(absl::Span<Span*> spans) {
       completed_spans_[LifetimeBucketNum(lifetime)].LossyAdd(1);
     }
   }
-  return forwarder_.DeallocateSpans(objects_per_span_, spans);
+  TCMALLOC_PROBE(central_freelist_span_free, size_class_, spans.size());
+  return forwarder().DeallocateSpans(objects_per_span, spans);
 }
 
 template <class Forwarder>
 inline int CentralFreeList<Forwarder>::RemoveRange(absl::Span<void*> batch) {
   TC_ASSERT(!batch.empty());
 
+  if (CentralFreeList* lender = lender_.load(std::memory_order_acquire);
+      ABSL_PREDICT_FALSE(lender != nullptr)) {
+    const int got = lender->RemoveRange(batch);
+    objects_borrowed_.Add(got);
+    objects_removed_.Add(got);
+    return got;
+  }
+
+  const int num_shards = this->num_shards();
+  if (ABSL_PREDICT_FALSE(num_shards > 1)) {
+    const unsigned index = forwarder().CurrentShard(num_shards);
+    if (index != 0) {
+      return shard(index).RemoveRange(batch);
+    }
+  }
+
+  // Started after dispatching to a shard, which times itself.
+  ScopedSlowPathTimer timer(SlowPath::kCentralFreeListRemove);
   int result = 0;
 
   if (ABSL_PREDICT_FALSE(objects_per_span_ == 1)) {
@@ -706,8 +1205,9 @@ inline int CentralFreeList<Forwarder>::RemoveRange(absl::Span<void*> batch) {
     size_t object_size = object_size_;
     size_t num_spans = 0;
     size_t objects_per_span = objects_per_span_;
+    const bool prefetch = forwarder().prefetch_span_freelists();
 
-    CentralFreeListLockHolder h(lock_);
+    CentralFreeListLockHolder h(lock_, &lock_contentions_);
 
     do {
       num_spans++;
@@ -736,6 +1236,9 @@ inline int CentralFreeList<Forwarder>::RemoveRange(absl::Span<void*> batch) {
       if (span->FreelistEmpty(object_size, objects_per_span)) {
         nonempty_.Remove(span, prev_index);
       } else {
+        // The next RemoveRange is likely to pop from this span again, so start
+        // loading the object holding its freelist head.
+        if (prefetch) span->PrefetchFreelist(object_size);
         // If span allocation changes so that it must be moved to a different
         // nonempty_ list, we remove it from the previous list and add it to the
         // desired list indexed by cur_index.
@@ -755,67 +1258,164 @@ inline int CentralFreeList<Forwarder>::RemoveRange(absl::Span<void*> batch) {
     TC_ASSERT_LE(num_spans, kMaxObjectsToMove);
     span_allocations_tracker_[absl::bit_width(num_spans) - 1].LossyAdd(1);
     UpdateObjectCounts(-result);
+    objects_removed_.LossyAdd(result);
   }
 
-  forwarder_.InvokeRemoveRangeHook(size_class_, batch.subspan(0, result));
+  forwarder().InvokeRemoveRangeHook(size_class_, batch.subspan(0, result));
   return result;
 }
 
 // Fetch memory from the system and add to the central cache freelist.
 template <class Forwarder>
 inline int CentralFreeList<Forwarder>::Populate(absl::Span<void*> batch) {
+  // During a burst, a batch that needs several spans gets them from the page
+  // heap at once, taking the page heap's lock once rather than on each refill.
+  const bool burst = consecutive_populates_ > 0;
+  if (consecutive_populates_ < std::numeric_limits<uint8_t>::max()) {
+    ++consecutive_populates_;
+  }
+  // Spans of the previous length are all gone, none of the new length is
+  // being allocated: the length can change.  Empty spans kept for reuse are
+  // counted in num_spans().
+  if (ABSL_PREDICT_FALSE(target_pages_per_span_ != pages_per_span_) &&
+      num_spans() == 0 && populates_in_flight_ == 0) {
+    SetSpanLength(target_pages_per_span_);
+    span_length_changes_.LossyAdd(1);
+  }
+  Span* spans[kMaxPopulateSpans];
+  size_t num_spans =
+      burst ? std::min(kMaxPopulateSpans,
+                       (batch.size() + objects_per_span_ - 1) /
+                           objects_per_span_)
+            : 1;
+
+  // Reuse the empty spans kept by ReleaseBatch, most recently emptied first,
+  // before going to the page heap.
+  size_t num_reused = 0;
+  while (num_reused < num_spans && num_empty_spans_ > 0) {
+    spans[num_reused++] = empty_spans_[--num_empty_spans_].span;
+  }
+  if (num_reused > 0) {
+    empty_span_hits_.LossyAdd(num_reused);
+  }
+
+  // Reused spans are recolored too, keeping the rotation going.
+  const uint32_t first_color = next_color_;
+  next_color_ += num_spans;
+
   // Release central list lock while operating on pageheap
   // Note, this could result in multiple calls to populate each allocating
   // a new span and the pushing those partially full spans onto nonempty.
+  ++populates_in_flight_;
   lock_.unlock();
 
-  Span* span = AllocateSpan();
-  if (ABSL_PREDICT_FALSE(span == nullptr)) {
+  const size_t num_wanted = num_spans - num_reused;
+  num_spans = num_reused;
+  if (num_wanted == 1) {
+    spans[num_reused] = AllocateSpan();
+    num_spans += spans[num_reused] != nullptr ? 1 : 0;
+  } else if (num_wanted > 1) {
+    num_spans += AllocateSpans(absl::MakeSpan(&spans[num_reused], num_wanted));
+  }
+  if (ABSL_PREDICT_FALSE(num_spans == 0)) {
     lock_.lock();
+    --populates_in_flight_;
     return 0;
   }
 
-  const uint64_t alloc_time = forwarder_.clock_now();
-  int result =
-      span->BuildFreelist(object_size_, objects_per_span_, batch, alloc_time);
-  TC_ASSERT_GT(result, 0);
-  // This is a cheaper check than using FreelistEmpty().
-  bool span_empty = result == objects_per_span_;
+  const uint64_t alloc_time = forwarder().clock_now();
+  uint16_t allocated[kMaxPopulateSpans];
+  int result = 0;
+  for (size_t i = 0; i < num_spans; ++i) {
+    allocated[i] = spans[i]->BuildFreelist(
+        object_size_, objects_per_span_, batch.subspan(result), alloc_time,
+        (first_color + i) % num_colors_);
+    TC_ASSERT_GT(allocated[i], 0);
+    result += allocated[i];
+  }
 
   lock_.lock();
-
-  // Update the histogram once we populate the span.
-  const uint16_t allocated = result;
-  TC_ASSERT_EQ(allocated, span->Allocated());
-  const uint8_t bitwidth = absl::bit_width(allocated);
-  RecordSpanUtil(bitwidth, /*increase=*/true);
-  if (!span_empty) {
-    const uint8_t index =
-        IndexFor(span->is_long_lived_span(), allocated, bitwidth);
-    nonempty_.Add(span, index);
-    span->set_nonempty_index(index);
+  --populates_in_flight_;
+
+  const bool long_lived = lifetime_votes() > 0;
+  for (size_t i = 0; i < num_spans; ++i) {
+    Span* span = spans[i];
+    // Update the histogram once we populate the span.
+    TC_ASSERT_EQ(allocated[i], span->Allocated());
+    const uint8_t bitwidth = absl::bit_width(allocated[i]);
+    RecordSpanUtil(bitwidth, /*increase=*/true);
+    span->set_central_freelist_shard(shard_index_);
+    if (i < num_reused) {
+      // Start a reused span over in the short-lived section, like a new one.
+      // It was never counted as returned.
+      span->set_is_long_lived_span(/*value=*/false);
+    } else {
+      RecordSpanAllocated();
+    }
+    if (long_lived) {
+      span->set_is_long_lived_span(/*value=*/true);
+      predicted_long_lived_spans_.LossyAdd(1);
+    }
+    // This is a cheaper check than using FreelistEmpty().
+    if (allocated[i] != objects_per_span_) {
+      const uint8_t index =
+          IndexFor(span->is_long_lived_span(), allocated[i], bitwidth);
+      nonempty_.Add(span, index);
+      span->set_nonempty_index(index);
+    }
   }
-  RecordSpanAllocated();
   return result;
 }
 
+template <class Forwarder>
+inline LifetimePrediction CentralFreeList<Forwarder>::PredictedLifetime()
+    const {
+  // Let the page allocator keep spans of size classes whose recent objects
+  // were short-lived apart from the long-lived ones.
+  const int8_t votes = lifetime_votes();
+  return votes < 0   ? LifetimePrediction::kShortLived
+         : votes > 0 ? LifetimePrediction::kLongLived
+                     : LifetimePrediction::kUnknown;
+}
+
 template <class Forwarder>
 Span* CentralFreeList<Forwarder>::AllocateSpan() {
-  Span* span =
-      forwarder_.AllocateSpan(size_class_, objects_per_span_, pages_per_span_);
+  Span* span = forwarder().AllocateSpan(size_class_, objects_per_span_,
+                                        pages_per_span_, PredictedLifetime());
+  TCMALLOC_PROBE(central_freelist_span_allocate, size_class_,
+                 pages_per_span_.raw_num());
   if (ABSL_PREDICT_FALSE(span == nullptr)) {
     TC_LOG("tcmalloc: allocation failed %v", pages_per_span_);
   }
   return span;
 }
 
+template <class Forwarder>
+size_t CentralFreeList<Forwarder>::AllocateSpans(absl::Span<Span*> spans) {
+  const size_t allocated =
+      forwarder().AllocateSpans(size_class_, objects_per_span_,
+                                pages_per_span_, PredictedLifetime(), spans);
+  for (size_t i = 0; i < allocated; ++i) {
+    TCMALLOC_PROBE(central_freelist_span_allocate, size_class_,
+                   pages_per_span_.raw_num());
+  }
+  if (ABSL_PREDICT_FALSE(allocated == 0)) {
+    TC_LOG("tcmalloc: allocation failed %v", pages_per_span_);
+  }
+  return allocated;
+}
+
 template <class Forwarder>
 inline size_t CentralFreeList<Forwarder>::OverheadBytes() const {
   if (ABSL_PREDICT_FALSE(object_size_ == 0)) {
     return 0;
   }
   const size_t overhead_per_span = pages_per_span_.in_bytes() % object_size_;
-  return num_spans() * overhead_per_span;
+  size_t spans = num_spans();
+  for (const CentralFreeList& shard : extra_shards()) {
+    spans += shard.num_spans();
+  }
+  return spans * overhead_per_span;
 }
 
 template <class Forwarder>
@@ -826,6 +1426,12 @@ inline SpanStats CentralFreeList<Forwarder>::GetSpanStats() const {
   }
   stats.num_spans_requested = static_cast<size_t>(num_spans_requested_.value());
   stats.num_spans_returned = static_cast<size_t>(num_spans_returned_.value());
+  for (const CentralFreeList& shard : extra_shards()) {
+    stats.num_spans_requested +=
+        static_cast<size_t>(shard.num_spans_requested_.value());
+    stats.num_spans_returned +=
+        static_cast<size_t>(shard.num_spans_returned_.value());
+  }
   stats.obj_capacity = stats.num_live_spans() * objects_per_span_;
   return stats;
 }
@@ -835,14 +1441,22 @@ inline size_t CentralFreeList<Forwarder>::NumSpansWith(
     uint16_t bitwidth) const {
   TC_ASSERT_GT(bitwidth, 0);
   const int bucket = bitwidth - 1;
-  return objects_to_spans_[bucket].value();
+  size_t spans = objects_to_spans_[bucket].value();
+  for (const CentralFreeList& shard : extra_shards()) {
+    spans += shard.objects_to_spans_[bucket].value();
+  }
+  return spans;
 }
 
 template <class Forwarder>
 inline void CentralFreeList<Forwarder>::HandleLongLivedSpans() {
+  for (CentralFreeList& shard : extra_shards()) {
+    shard.HandleLongLivedSpans();
+  }
+
   std::array<Span*, kMaxLongLivedSpansToMove> spans_to_update;
-  uint64_t now = forwarder_.clock_now();
-  double frequency = forwarder_.clock_frequency();
+  uint64_t now = forwarder().clock_now();
+  double frequency = forwarder().clock_frequency();
   // Convert the threshold from absl::Duration to nanoseconds and scale it by
   // frequency to avoid dividing by frequency in the iterator.
   uint64_t threshold =
@@ -874,6 +1488,321 @@ inline void CentralFreeList<Forwarder>::HandleLongLivedSpans() {
   long_lived_spans_moved_[absl::bit_width(i)].LossyAdd(1);
 }
 
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::ReleaseIdleEmptySpans() {
+  for (CentralFreeList& shard : extra_shards()) {
+    shard.ReleaseIdleEmptySpans();
+  }
+
+  const bool keep = forwarder().cache_empty_spans();
+  const uint64_t now = forwarder().clock_now();
+  // Scale the threshold by frequency, as in HandleLongLivedSpans.
+  const uint64_t threshold = absl::ToDoubleSeconds(kEmptySpanIdleThreshold) *
+                             forwarder().clock_frequency();
+  Span* idle[kMaxEmptySpans];
+  size_t num_idle = 0;
+  uint32_t objects_per_span;
+  {
+    CentralFreeListLockHolder h(lock_);
+    objects_per_span = objects_per_span_;
+    size_t num_kept = 0;
+    for (size_t i = 0; i < num_empty_spans_; ++i) {
+      const EmptySpan& e = empty_spans_[i];
+      if (keep && now < e.empty_since + threshold) {
+        empty_spans_[num_kept++] = e;
+      } else {
+        idle[num_idle++] = e.span;
+      }
+    }
+    num_empty_spans_ = num_kept;
+    RecordMultiSpansDeallocated(num_idle);
+  }
+  if (num_idle > 0) {
+    DeallocateSpans(absl::MakeSpan(idle, num_idle), objects_per_span);
+  }
+}
+
+template <class Forwarder>
+inline size_t CentralFreeList<Forwarder>::empty_span_hits() const {
+  size_t hits = empty_span_hits_.value();
+  for (const CentralFreeList& shard : extra_shards()) {
+    hits += shard.empty_span_hits_.value();
+  }
+  return hits;
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::PrintEmptySpanStats(Printer& out) {
+  size_t kept = 0;
+  for (CentralFreeList& shard : extra_shards()) {
+    CentralFreeListLockHolder h(shard.lock_);
+    kept += shard.num_empty_spans_;
+  }
+  {
+    CentralFreeListLockHolder h(lock_);
+    kept += num_empty_spans_;
+  }
+  out.printf("class %3d [ %8zu bytes ] : %zu empty spans kept, %zu reused\n",
+             size_class_, object_size_, kept, empty_span_hits());
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::PrintEmptySpanStatsInPbtxt(
+    PbtxtRegion& region) {
+  region.PrintI64("empty_span_hits", empty_span_hits());
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::EstimateMeshableSpans() {
+  for (CentralFreeList& shard : extra_shards()) {
+    shard.EstimateMeshableSpans();
+  }
+  if (objects_per_span_ < 2 || objects_per_span_ > kMaxMeshObjects) return;
+
+  SpanOccupancy occupancy[kMaxMeshCandidates];
+  size_t n = 0;
+  {
+    CentralFreeListLockHolder h(lock_);
+    nonempty_.Iter(
+        [&](Span& s) GOOGLE_MALLOC_SECTION {
+          if (n >= kMaxMeshCandidates) return;
+          if (2 * s.Allocated() > objects_per_span_) return;
+          s.AllocatedObjects(object_size_, objects_per_span_,
+                             absl::MakeSpan(occupancy[n]));
+          ++n;
+        },
+        0);
+  }
+  mesh_candidates_.store(n, std::memory_order_relaxed);
+  meshable_pairs_.store(CountMeshablePairs({occupancy, n}),
+                        std::memory_order_relaxed);
+}
+
+template <class Forwarder>
+inline size_t CentralFreeList<Forwarder>::mesh_candidates() const {
+  size_t candidates = mesh_candidates_.load(std::memory_order_relaxed);
+  for (const CentralFreeList& shard : extra_shards()) {
+    candidates += shard.mesh_candidates_.load(std::memory_order_relaxed);
+  }
+  return candidates;
+}
+
+template <class Forwarder>
+inline size_t CentralFreeList<Forwarder>::meshable_pairs() const {
+  size_t pairs = meshable_pairs_.load(std::memory_order_relaxed);
+  for (const CentralFreeList& shard : extra_shards()) {
+    pairs += shard.meshable_pairs_.load(std::memory_order_relaxed);
+  }
+  return pairs;
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::PrintMeshStats(Printer& out) {
+  const size_t pairs = meshable_pairs();
+  out.printf(
+      "class %3d [ %8zu bytes ] : %4zu sparse spans sampled, %4zu meshable "
+      "pairs, %8zu bytes reclaimable\n",
+      size_class_, object_size_, mesh_candidates(), pairs,
+      pairs * pages_per_span_.in_bytes());
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::PrintMeshStatsInPbtxt(
+    PbtxtRegion& region) {
+  const size_t pairs = meshable_pairs();
+  region.PrintI64("mesh_candidates", mesh_candidates());
+  region.PrintI64("meshable_pairs", pairs);
+  region.PrintI64("meshable_bytes", pairs * pages_per_span_.in_bytes());
+}
+
+template <class Forwarder>
+inline size_t CentralFreeList<Forwarder>::LeastOccupiedSpans(
+    absl::Span<SpanSnapshot> spans) {
+  TC_ASSERT_LE(spans.size(), kMaxLeastOccupiedSpans);
+  size_t n = 0;
+  for (CentralFreeList& shard : extra_shards()) {
+    n += shard.LeastOccupiedSpans(spans.subspan(n));
+  }
+  if (objects_per_span_ < 2 || objects_per_span_ > kMaxMeshObjects) return n;
+  spans = spans.subspan(n);
+
+  Span* chosen[kMaxLeastOccupiedSpans];
+  size_t num_chosen = 0;
+  CentralFreeListLockHolder h(lock_);
+  nonempty_.Iter(
+      [&](Span& s) GOOGLE_MALLOC_SECTION {
+        const uint16_t allocated = s.Allocated();
+        if (4 * allocated > objects_per_span_) return;
+        if (num_chosen < spans.size()) {
+          chosen[num_chosen++] = &s;
+          return;
+        }
+        // Replace the fullest span chosen so far, if this one is sparser.
+        Span** fullest = std::max_element(
+            chosen, chosen + num_chosen, [](const Span* a, const Span* b) {
+              return a->Allocated() < b->Allocated();
+            });
+        if (fullest != chosen + num_chosen &&
+            allocated < (*fullest)->Allocated()) {
+          *fullest = &s;
+        }
+      },
+      0);
+  std::sort(chosen, chosen + num_chosen, [](const Span* a, const Span* b) {
+    return a->Allocated() < b->Allocated();
+  });
+  for (size_t i = 0; i < num_chosen; ++i) {
+    SpanSnapshot& snapshot = spans[i];
+    snapshot.start = chosen[i]->start_address();
+    snapshot.allocated = chosen[i]->Allocated();
+    chosen[i]->AllocatedObjects(object_size_, objects_per_span_,
+                                absl::MakeSpan(snapshot.occupancy));
+  }
+  return n + num_chosen;
+}
+
+template <class Forwarder>
+inline bool CentralFreeList<Forwarder>::EnableShards(int num_shards) {
+  TC_ASSERT_EQ(primary_, nullptr);
+  num_shards = std::min(num_shards, kMaxShards);
+  // With one object per span, RemoveRange and InsertRange go straight to the
+  // page heap and never take lock_.
+  if (num_shards < 2 || objects_per_span_ <= 1) return false;
+
+  CentralFreeListLockHolder h(lock_);
+  if (this->num_shards() > 1) return false;
+  CentralFreeList* shards = static_cast<CentralFreeList*>(
+      forwarder().Alloc(sizeof(CentralFreeList) * (num_shards - 1),
+                        std::align_val_t{ABSL_CACHELINE_SIZE}));
+  for (int index = 1; index < num_shards; ++index) {
+    CentralFreeList* shard = new (&shards[index - 1]) CentralFreeList();
+    shard->primary_ = this;
+    shard->shard_index_ = index;
+    shard->Init(size_class_);
+  }
+  shards_ = shards;
+  num_shards_.store(num_shards, std::memory_order_release);
+  return true;
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::ShardIfContended(int max_shards) {
+  const int64_t contentions = lock_contentions();
+  const int64_t recent = contentions - last_lock_contentions_;
+  last_lock_contentions_ = contentions;
+  if (recent >= kMinContentionsToShard && num_shards() == 1) {
+    EnableShards(max_shards);
+  }
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::AdaptSpanLength() {
+  const int64_t requested = num_spans_requested_.value();
+  const int64_t recent = requested - last_spans_requested_;
+  last_spans_requested_ = requested;
+  if (min_pages_per_span_ == max_pages_per_span_ || num_shards() > 1) {
+    return;
+  }
+
+  CentralFreeListLockHolder h(lock_);
+  const size_t capacity = num_spans() * objects_per_span_;
+  const size_t free = static_cast<size_t>(counter_.value());
+  Length target = pages_per_span_;
+  if (recent > kMaxRefillsForShortSpans) {
+    target = std::min(max_pages_per_span_, 2 * pages_per_span_);
+    while (target < max_pages_per_span_ && !IsValidSpanLength(target)) {
+      ++target;
+    }
+  } else if (recent <= 1 && capacity > 0 && 2 * free > capacity) {
+    target = std::max(min_pages_per_span_, pages_per_span_ / 2);
+    while (target > min_pages_per_span_ && !IsValidSpanLength(target)) {
+      --target;
+    }
+  }
+  target_pages_per_span_ = target;
+}
+
+template <class Forwarder>
+inline size_t CentralFreeList<Forwarder>::lock_contentions() const {
+  size_t contentions = lock_contentions_.value();
+  for (const CentralFreeList& shard : extra_shards()) {
+    contentions += shard.lock_contentions_.value();
+  }
+  return contentions;
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::PrintShardStats(Printer& out) {
+  out.printf("class %3d [ %8zu bytes ] : %d shards; lock contentions:",
+             size_class_, object_size_, num_shards());
+  out.printf(" %zu", lock_contentions_.value());
+  for (const CentralFreeList& shard : extra_shards()) {
+    out.printf(" %zu", shard.lock_contentions_.value());
+  }
+  out.printf("\n");
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::PrintShardStatsInPbtxt(
+    PbtxtRegion& region) {
+  region.PrintI64("num_shards", num_shards());
+  region.PrintI64("lock_contentions", lock_contentions());
+}
+
+template <class Forwarder>
+inline size_t CentralFreeList<Forwarder>::objects_removed() const {
+  size_t removed = objects_removed_.value();
+  for (const CentralFreeList& shard : extra_shards()) {
+    removed += shard.objects_removed_.value();
+  }
+  return removed;
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::UpdateSpanSharing(
+    CentralFreeList* absl_nullable lender) {
+  const int64_t removed = objects_removed();
+  const int64_t recent = removed - last_objects_removed_;
+  last_objects_removed_ = removed;
+
+  if (CentralFreeList* current = lender_.load(std::memory_order_relaxed);
+      current != nullptr) {
+    if (current != lender ||
+        recent >= static_cast<int64_t>(objects_per_span_)) {
+      lender_.store(nullptr, std::memory_order_release);
+      current->lending_.store(false, std::memory_order_relaxed);
+    }
+    return;
+  }
+
+  if (lender == nullptr || objects_per_span_ < 2 || lending() ||
+      lender->borrowing() || num_shards() > 1 || num_spans() > 1 ||
+      4 * recent >= static_cast<int64_t>(objects_per_span_)) {
+    return;
+  }
+  lender->lent_.store(true, std::memory_order_relaxed);
+  lender->lending_.store(true, std::memory_order_relaxed);
+  // Published before lender_, so that InsertRange sorts out borrowed objects
+  // as soon as RemoveRange may hand them out.
+  borrowed_from_.store(lender, std::memory_order_release);
+  lender_.store(lender, std::memory_order_release);
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::PrintSpanSharingStats(Printer& out) {
+  out.printf("class %3d [ %8zu bytes ] : %s; %zu objects borrowed\n",
+             size_class_, object_size_,
+             borrowing() ? "borrowing" : "not borrowing",
+             objects_borrowed_.value());
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::PrintSpanSharingStatsInPbtxt(
+    PbtxtRegion& region) {
+  region.PrintBool("span_sharing_borrowing", borrowing());
+  region.PrintI64("span_sharing_objects_borrowed", objects_borrowed_.value());
+}
+
 template <class Forwarder>
 inline void CentralFreeList<Forwarder>::PrintSameSpanStats(Printer& out) {
 #ifndef TCMALLOC_INTERNAL_LEGACY_LOCKING
@@ -905,6 +1834,14 @@ inline void CentralFreeList<Forwarder>::PrintSameSpanStatsInPbtxt(
 
 template <class Forwarder>
 inline void CentralFreeList<Forwarder>::PrintSpanUtilStats(Printer& out) {
+  if (min_pages_per_span_ != max_pages_per_span_) {
+    out.printf(
+        "class %3d [ %8zu bytes ] : %zu pages per span (%zu to %zu), "
+        "%zu length changes\n",
+        size_class_, object_size_, pages_per_span_.raw_num(),
+        min_pages_per_span_.raw_num(), max_pages_per_span_.raw_num(),
+        span_length_changes_.value());
+  }
   out.printf("class %3d [ %8zu bytes ] : ", size_class_, object_size_);
   for (size_t i = 1; i <= kSpanUtilBucketCapacity; ++i) {
     out.printf("%6zu < %zu", NumSpansWith(i), 1 << i);
@@ -934,8 +1871,8 @@ inline void CentralFreeList<Forwarder>::PrintSpanUtilStats(Printer& out) {
 
 template <class Forwarder>
 inline void CentralFreeList<Forwarder>::PrintSpanLifetimeStats(Printer& out) {
-  uint64_t now = forwarder_.clock_now();
-  double frequency = forwarder_.clock_frequency();
+  uint64_t now = forwarder().clock_now();
+  double frequency = forwarder().clock_frequency();
   LifetimeHistogram lifetime_histo{};
 
   {
@@ -1004,6 +1941,8 @@ inline void CentralFreeList<Forwarder>::PrintLongLivedSpansMoved(Printer& out) {
 template <class Forwarder>
 inline void CentralFreeList<Forwarder>::PrintSpanUtilStatsInPbtxt(
     PbtxtRegion& region) {
+  region.PrintI64("pages_per_span", pages_per_span_.raw_num());
+  region.PrintI64("span_length_changes", span_length_changes_.value());
   for (size_t i = 1; i <= kSpanUtilBucketCapacity; ++i) {
     PbtxtRegion histogram = region.CreateSubRegion("span_util_histogram");
     histogram.PrintI64("lower_bound", 1 << (i - 1));
@@ -1039,8 +1978,8 @@ inline void CentralFreeList<Forwarder>::PrintNumSpansUsedInPbtxt(
 template <class Forwarder>
 inline void CentralFreeList<Forwarder>::PrintSpanLifetimeStatsInPbtxt(
     PbtxtRegion& region) {
-  uint64_t now = forwarder_.clock_now();
-  double frequency = forwarder_.clock_frequency();
+  uint64_t now = forwarder().clock_now();
+  double frequency = forwarder().clock_frequency();
   LifetimeHistogram lifetime_histo{};
 
   {
@@ -1090,6 +2029,30 @@ inline void CentralFreeList<Forwarder>::PrintLongLivedSpansMovedInPbtxt(
   }
 }
 
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::PrintLifetimePredictions(
+    Printer& out) {
+  out.printf(
+      "class %3d [ %8zu bytes ] : votes %3d, %6zu spans placed long-lived, "
+      "%6zu spans picked short-lived\n",
+      size_class_, object_size_,
+      static_cast<int>(lifetime_votes_.load(std::memory_order_relaxed)),
+      predicted_long_lived_spans_.value(),
+      predicted_short_lived_spans_.value());
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::PrintLifetimePredictionsInPbtxt(
+    PbtxtRegion& region) {
+  PbtxtRegion predictions = region.CreateSubRegion("lifetime_predictions");
+  predictions.PrintI64("votes",
+                       lifetime_votes_.load(std::memory_order_relaxed));
+  predictions.PrintI64("spans_placed_long_lived",
+                       predicted_long_lived_spans_.value());
+  predictions.PrintI64("spans_picked_short_lived",
+                       predicted_short_lived_spans_.value());
+}
+
 }  // namespace central_freelist_internal
 
 using CentralFreeList = central_freelist_internal::CentralFreeList<
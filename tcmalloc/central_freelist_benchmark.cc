@@ -38,9 +38,11 @@
 #include "tcmalloc/internal/bytes.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/lifetime_predictor.h"
 #include "tcmalloc/pagemap.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/span.h"
+#include "tcmalloc/span_stats.h"
 #include "tcmalloc/static_vars.h"
 #include "tcmalloc/tcmalloc_policy.h"
 
@@ -90,6 +92,7 @@ class BenchmarkStaticForwarder
 
   size_t class_to_size(int size_class) const { return class_size_; }
   Length class_to_pages(int size_class) const { return pages_per_span_; }
+  size_t class_to_colors(int size_class) const { return 1; }
   size_t num_objects_to_move(int size_class) const {
     return num_objects_to_move_;
   }
@@ -103,9 +106,48 @@ class BenchmarkStaticForwarder
     }
   }
 
+  size_t PartitionObjectsOfClass(absl::Span<void*> batch, int size_class) {
+    return batch.size();
+  }
+
   [[nodiscard]] Span* AllocateSpan(int size_class, size_t objects_per_span,
-                                   Length pages_per_span) {
+                                   Length pages_per_span, LifetimePrediction) {
+    absl::MutexLock l(mu_);
+    ++lock_acquisitions_;
+    return AllocateSpanLocked(pages_per_span);
+  }
+
+  [[nodiscard]] size_t AllocateSpans(int size_class, size_t objects_per_span,
+                                     Length pages_per_span, LifetimePrediction,
+                                     absl::Span<Span*> spans) {
+    absl::MutexLock l(mu_);
+    ++lock_acquisitions_;
+    size_t allocated = 0;
+    for (; allocated < spans.size(); ++allocated) {
+      spans[allocated] = AllocateSpanLocked(pages_per_span);
+      if (spans[allocated] == nullptr) break;
+    }
+    return allocated;
+  }
+
+  void DeallocateSpans(size_t objects_per_span, absl::Span<Span*> free_spans) {
+    absl::MutexLock l(mu_);
+    for (Span* span : free_spans) {
+      UnregisterSpanLocked(span);
+      free_spans_.push_back(span);
+    }
+  }
+
+  // The number of times the simulated page heap's lock was taken to
+  // allocate spans.
+  int64_t lock_acquisitions() {
     absl::MutexLock l(mu_);
+    return lock_acquisitions_;
+  }
+
+ private:
+  Span* AllocateSpanLocked(Length pages_per_span)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
     if (!free_spans_.empty()) {
       Span* span = free_spans_.back();
       free_spans_.pop_back();
@@ -133,15 +175,6 @@ class BenchmarkStaticForwarder
     return span;
   }
 
-  void DeallocateSpans(size_t objects_per_span, absl::Span<Span*> free_spans) {
-    absl::MutexLock l(mu_);
-    for (Span* span : free_spans) {
-      UnregisterSpanLocked(span);
-      free_spans_.push_back(span);
-    }
-  }
-
- private:
   void RegisterSpanLocked(Span* span) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
     PageId page = span->first_page();
     Length num = span->num_pages();
@@ -168,6 +201,7 @@ class BenchmarkStaticForwarder
   absl::Mutex mu_;
   std::vector<Span*> free_spans_ ABSL_GUARDED_BY(mu_);
   std::vector<Span*> allocated_spans_ ABSL_GUARDED_BY(mu_);
+  int64_t lock_acquisitions_ ABSL_GUARDED_BY(mu_) = 0;
 };
 
 using CentralFreeList =
@@ -478,6 +512,9 @@ void BM_Populate(benchmark::State& state) {
     state.ResumeTiming();
   }
   state.SetItemsProcessed(items_processed);
+  state.counters["page_heap_locks_per_object"] =
+      static_cast<double>(env.forwarder().lock_acquisitions()) /
+      items_processed;
 }
 
 BENCHMARK(BM_Populate)
@@ -634,6 +671,9 @@ void BM_SteadyState(benchmark::State& state) {
   std::vector<void*> to_insert(batch_size);
   std::vector<void*> received(batch_size);
   int64_t items_processed = 0;
+  // Cycles spent in InsertRange and RemoveRange, nearly all of which is spent
+  // holding the central freelist lock.
+  int64_t central_freelist_cycles = 0;
 
   while (state.KeepRunningBatch(batch_size)) {
     for (int i = 0; i < batch_size; ++i) {
@@ -641,8 +681,10 @@ void BM_SteadyState(benchmark::State& state) {
       pool.head = (pool.head + 1) % pool.queue_size;
     }
 
+    const int64_t start = absl::base_internal::CycleClock::Now();
     env.central_freelist().InsertRange(absl::MakeSpan(to_insert));
     int got = env.central_freelist().RemoveRange(absl::MakeSpan(received));
+    central_freelist_cycles += absl::base_internal::CycleClock::Now() - start;
     TC_CHECK_NE(got, 0);
 
     for (int i = 0; i < got; ++i) {
@@ -653,6 +695,19 @@ void BM_SteadyState(benchmark::State& state) {
     items_processed += got;
   }
   state.SetItemsProcessed(items_processed);
+  state.counters["cycles_per_batch"] = benchmark::Counter(
+      static_cast<double>(central_freelist_cycles) * batch_size /
+      std::max<int64_t>(items_processed, 1));
+
+  // Fraction of the capacity of live spans that holds allocated objects: the
+  // denser spans are packed, the less memory is stranded in partial spans.
+  const SpanStats span_stats = env.central_freelist().GetSpanStats();
+  if (span_stats.obj_capacity > 0) {
+    state.counters["span_utilization"] =
+        1. - static_cast<double>(env.central_freelist().length()) /
+                 span_stats.obj_capacity;
+  }
+  state.counters["live_spans"] = span_stats.num_live_spans();
 
   DrainHeldObjects(env, absl::MakeSpan(pool.held_objects), batch_size);
 }
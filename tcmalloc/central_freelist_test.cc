@@ -51,6 +51,7 @@
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/size_class_info.h"
+#include "tcmalloc/lifetime_predictor.h"
 #include "tcmalloc/mock_static_forwarder.h"
 #include "tcmalloc/pagemap.h"
 #include "tcmalloc/pages.h"
@@ -105,8 +106,9 @@ class StaticForwarderTest : public testing::TestWithParam<size_t> {
 };
 
 TEST_P(StaticForwarderTest, Simple) {
-  Span* span = StaticForwarder::AllocateSpan(size_class_, objects_per_span_,
-                                             pages_per_span_);
+  Span* span = StaticForwarder::AllocateSpan(
+      size_class_, objects_per_span_, pages_per_span_,
+      LifetimePrediction::kUnknown);
   ASSERT_NE(span, nullptr);
 
   absl::FixedArray<void*> batch(objects_per_span_);
@@ -206,8 +208,9 @@ class StaticForwarderEnvironment {
 
   void Grow() {
     // Allocate a Span
-    Span* span = StaticForwarder::AllocateSpan(size_class_, objects_per_span_,
-                                               pages_per_span_);
+    Span* span = StaticForwarder::AllocateSpan(
+        size_class_, objects_per_span_, pages_per_span_,
+        LifetimePrediction::kUnknown);
     ASSERT_NE(span, nullptr);
 
     auto d = std::make_unique<SpanData>();
@@ -1163,7 +1166,8 @@ TEST_P(CentralFreeListTest, PassSpanDensityToPageheap) {
   auto test_function = [&](size_t num_objects,
                            AccessDensityPrediction density) {
     std::vector<void*> objects(e.objects_per_span());
-    EXPECT_CALL(e.forwarder(), AllocateSpan(testing::_, testing::_, testing::_))
+    EXPECT_CALL(e.forwarder(),
+                AllocateSpan(testing::_, testing::_, testing::_, testing::_))
         .Times(1);
     const size_t to_fetch = std::min(e.objects_per_span(), e.batch_size());
     const size_t fetched =
@@ -1181,6 +1185,192 @@ TEST_P(CentralFreeListTest, PassSpanDensityToPageheap) {
   test_function(e.objects_per_span(), AccessDensityPrediction::kDense);
 }
 
+TEST_P(CentralFreeListTest, BatchesPopulateDuringBursts) {
+#if ABSL_HAVE_HWADDRESS_SANITIZER
+  GTEST_SKIP()
+      << "Skipping under HWASan, which uses the top bits of the pointer.";
+#endif
+
+  TypeParam e(GetParam().size, GetParam().bytes, GetParam().num_to_move);
+  if (e.objects_per_span() == 1 ||
+      e.batch_size() < 2 * e.objects_per_span() + 1) {
+    GTEST_SKIP() << "A batch fits in two spans";
+  }
+
+  // The first refill takes a single span.
+  EXPECT_CALL(e.forwarder(), AllocateSpan).Times(1);
+  EXPECT_CALL(e.forwarder(), AllocateSpans).Times(0);
+  std::vector<void*> objects(2 * e.batch_size());
+  size_t fetched = e.central_freelist().RemoveRange(
+      absl::MakeSpan(objects).subspan(0, e.batch_size()));
+  ASSERT_EQ(fetched, e.objects_per_span());
+  testing::Mock::VerifyAndClearExpectations(&e.forwarder());
+
+  // Without any objects returned since, the next one fetches all the spans it
+  // needs at once.
+  EXPECT_CALL(e.forwarder(), AllocateSpan).Times(0);
+  EXPECT_CALL(e.forwarder(), AllocateSpans).Times(1);
+  fetched += e.central_freelist().RemoveRange(
+      absl::MakeSpan(objects).subspan(fetched, e.batch_size()));
+  EXPECT_EQ(fetched, e.objects_per_span() + e.batch_size());
+
+  for (size_t returned = 0; returned < fetched;) {
+    const size_t to_return = std::min(fetched - returned, e.batch_size());
+    e.central_freelist().InsertRange({&objects[returned], to_return});
+    returned += to_return;
+  }
+}
+
+TEST_P(CentralFreeListTest, KeepsEmptySpansForReuse) {
+#if ABSL_HAVE_HWADDRESS_SANITIZER
+  GTEST_SKIP()
+      << "Skipping under HWASan, which uses the top bits of the pointer.";
+#endif
+
+  TypeParam e(GetParam().size, GetParam().bytes, GetParam().num_to_move);
+  if (e.objects_per_span() == 1) {
+    GTEST_SKIP() << "Spans of a single object skip the central freelist";
+  }
+  e.forwarder().set_cache_empty_spans(true);
+
+  // The span emptied by the first round is kept, and reused by the second.
+  EXPECT_CALL(e.forwarder(), AllocateSpan).Times(1);
+  EXPECT_CALL(e.forwarder(), DeallocateSpans).Times(0);
+  std::vector<void*> objects(e.batch_size());
+  const size_t to_fetch = std::min(e.objects_per_span(), e.batch_size());
+  for (int round = 0; round < 2; ++round) {
+    ASSERT_EQ(e.central_freelist().RemoveRange(
+                  absl::MakeSpan(objects).subspan(0, to_fetch)),
+              to_fetch);
+    e.central_freelist().InsertRange(
+        absl::MakeSpan(objects).subspan(0, to_fetch));
+  }
+  EXPECT_EQ(e.central_freelist().empty_span_hits(), 1);
+  SpanStats stats = e.central_freelist().GetSpanStats();
+  EXPECT_EQ(stats.num_live_spans(), 1);
+  EXPECT_EQ(e.central_freelist().length(), e.objects_per_span());
+
+  // A recently emptied span is not returned.
+  e.central_freelist().ReleaseIdleEmptySpans();
+  testing::Mock::VerifyAndClearExpectations(&e.forwarder());
+
+  EXPECT_CALL(e.forwarder(), DeallocateSpans).Times(1);
+  e.forwarder().AdvanceClock(
+      central_freelist_internal::kEmptySpanIdleThreshold);
+  e.central_freelist().ReleaseIdleEmptySpans();
+  stats = e.central_freelist().GetSpanStats();
+  EXPECT_EQ(stats.num_live_spans(), 0);
+  EXPECT_EQ(e.central_freelist().length(), 0);
+}
+
+TEST_P(CentralFreeListTest, EstimatesMeshableSpans) {
+#if ABSL_HAVE_HWADDRESS_SANITIZER
+  GTEST_SKIP()
+      << "Skipping under HWASan, which uses the top bits of the pointer.";
+#endif
+
+  TypeParam e(GetParam().size, GetParam().bytes, GetParam().num_to_move);
+  const size_t objects_per_span = e.objects_per_span();
+  if (objects_per_span < 4 || objects_per_span > kMaxMeshObjects) {
+    GTEST_SKIP() << "Size class is not estimated";
+  }
+
+  // Fill two spans.  Sorted by address, the objects of each are contiguous.
+  std::vector<void*> objects;
+  void* batch[kMaxObjectsToMove];
+  while (objects.size() < 2 * objects_per_span) {
+    const size_t want =
+        std::min(e.batch_size(), 2 * objects_per_span - objects.size());
+    const int got =
+        e.central_freelist().RemoveRange(absl::MakeSpan(batch, want));
+    ASSERT_GT(got, 0);
+    objects.insert(objects.end(), batch, batch + got);
+  }
+  absl::c_sort(objects);
+
+  // Both spans hold their first object, and the second span its second one.
+  const size_t first = 0, second = objects_per_span;
+  std::vector<void*> freed;
+  for (size_t i = 0; i < objects.size(); ++i) {
+    if (i != first && i != second && i != second + 1) {
+      freed.push_back(objects[i]);
+    }
+  }
+  for (size_t i = 0; i < freed.size(); i += e.batch_size()) {
+    e.central_freelist().InsertRange(absl::MakeSpan(freed).subspan(
+        i, std::min(e.batch_size(), freed.size() - i)));
+  }
+  e.central_freelist().EstimateMeshableSpans();
+  EXPECT_EQ(e.central_freelist().mesh_candidates(), 2);
+  EXPECT_EQ(e.central_freelist().meshable_pairs(), 0);
+
+  // Once the second span's first object is freed, its remaining object and
+  // the first span's could share a page.
+  e.central_freelist().InsertRange({&objects[second], 1});
+  e.central_freelist().EstimateMeshableSpans();
+  EXPECT_EQ(e.central_freelist().mesh_candidates(), 2);
+  EXPECT_EQ(e.central_freelist().meshable_pairs(), 1);
+
+  e.central_freelist().InsertRange({&objects[first], 1});
+  e.central_freelist().InsertRange({&objects[second + 1], 1});
+}
+
+TEST_P(CentralFreeListTest, LeastOccupiedSpans) {
+#if ABSL_HAVE_HWADDRESS_SANITIZER
+  GTEST_SKIP()
+      << "Skipping under HWASan, which uses the top bits of the pointer.";
+#endif
+
+  TypeParam e(GetParam().size, GetParam().bytes, GetParam().num_to_move);
+  const size_t objects_per_span = e.objects_per_span();
+  if (objects_per_span < 8 || objects_per_span > kMaxMeshObjects) {
+    GTEST_SKIP() << "Size class is not reported";
+  }
+
+  std::vector<void*> objects;
+  void* batch[kMaxObjectsToMove];
+  while (objects.size() < 2 * objects_per_span) {
+    const size_t want =
+        std::min(e.batch_size(), 2 * objects_per_span - objects.size());
+    const int got =
+        e.central_freelist().RemoveRange(absl::MakeSpan(batch, want));
+    ASSERT_GT(got, 0);
+    objects.insert(objects.end(), batch, batch + got);
+  }
+  absl::c_sort(objects);
+
+  // The first span holds one object, the second two.
+  const size_t first = 0, second = objects_per_span;
+  std::vector<void*> freed;
+  for (size_t i = 0; i < objects.size(); ++i) {
+    if (i != first && i != second && i != second + 1) {
+      freed.push_back(objects[i]);
+    }
+  }
+  for (size_t i = 0; i < freed.size(); i += e.batch_size()) {
+    e.central_freelist().InsertRange(absl::MakeSpan(freed).subspan(
+        i, std::min(e.batch_size(), freed.size() - i)));
+  }
+
+  SpanSnapshot spans[kMaxLeastOccupiedSpans];
+  ASSERT_EQ(e.central_freelist().LeastOccupiedSpans(spans), 2);
+  EXPECT_EQ(spans[0].start, objects[first]);
+  EXPECT_EQ(spans[0].allocated, 1);
+  EXPECT_EQ(spans[0].occupancy[0], 1);
+  EXPECT_EQ(spans[1].start, objects[second]);
+  EXPECT_EQ(spans[1].allocated, 2);
+  EXPECT_EQ(spans[1].occupancy[0], 3);
+
+  // Only as many spans as asked for are reported.
+  EXPECT_EQ(e.central_freelist().LeastOccupiedSpans(absl::MakeSpan(spans, 1)),
+            1);
+  EXPECT_EQ(spans[0].start, objects[first]);
+
+  e.central_freelist().InsertRange({&objects[first], 1});
+  e.central_freelist().InsertRange({&objects[second], 1});
+  e.central_freelist().InsertRange({&objects[second + 1], 1});
+}
+
 TEST_P(CentralFreeListTest, SpanLifetimeWithLongLivedSpans) {
 #if ABSL_HAVE_HWADDRESS_SANITIZER
   GTEST_SKIP()
@@ -1276,6 +1466,282 @@ TEST_P(CentralFreeListTest, SpanLifetimeWithLongLivedSpans) {
   }
 }
 
+TEST_P(CentralFreeListTest, LifetimePredictionsSteerSpans) {
+  TypeParam e(GetParam().size, GetParam().bytes, GetParam().num_to_move);
+
+  const int objects_per_span = e.objects_per_span();
+  if (objects_per_span < 3) return;
+
+  auto spans_in_section = [&](bool long_lived) {
+    size_t spans = 0;
+    for (size_t i = 0; i < kNumLists; ++i) {
+      spans += e.central_freelist().NumSpansInList(
+          long_lived ? i : i + kNumLists);
+    }
+    return spans;
+  };
+
+  std::vector<void*> objects;
+  void* batch[kMaxObjectsToMove];
+  auto allocate = [&](size_t n) {
+    while (n > 0) {
+      int got = e.central_freelist().RemoveRange(
+          absl::MakeSpan(batch, std::min(n, e.batch_size())));
+      ASSERT_GT(got, 0);
+      objects.insert(objects.end(), batch, batch + got);
+      n -= got;
+    }
+  };
+
+  // A long-lived prediction places the next span directly in the long-lived
+  // section.
+  e.central_freelist().RecordLifetimePrediction(
+      LifetimePrediction::kLongLived);
+  allocate(1);
+  EXPECT_EQ(spans_in_section(/*long_lived=*/true), 1);
+  EXPECT_EQ(spans_in_section(/*long_lived=*/false), 0);
+
+  // Once short-lived predictions dominate, drain the long-lived span and
+  // populate a short-lived one, then make room in the long-lived span again.
+  e.central_freelist().RecordLifetimePrediction(
+      LifetimePrediction::kShortLived);
+  e.central_freelist().RecordLifetimePrediction(
+      LifetimePrediction::kShortLived);
+  allocate(objects_per_span);
+  EXPECT_EQ(spans_in_section(/*long_lived=*/true), 0);
+  EXPECT_EQ(spans_in_section(/*long_lived=*/false), 1);
+  e.central_freelist().InsertRange({&objects[0], 1});
+  objects.erase(objects.begin());
+  EXPECT_EQ(spans_in_section(/*long_lived=*/true), 1);
+
+  // The short-lived span is preferred, even though the long-lived span is
+  // fuller; otherwise this allocation would have filled the long-lived span.
+  allocate(1);
+  EXPECT_EQ(spans_in_section(/*long_lived=*/true), 1);
+  EXPECT_EQ(spans_in_section(/*long_lived=*/false), 1);
+
+  std::string buffer = PrintToString(1024 * 1024, [&](Printer& printer) {
+    e.central_freelist().PrintLifetimePredictions(printer);
+  });
+  EXPECT_THAT(buffer, testing::HasSubstr("votes  -1,      1 spans placed "
+                                         "long-lived,      1 spans picked "
+                                         "short-lived"));
+
+  for (void* ptr : objects) {
+    e.central_freelist().InsertRange({&ptr, 1});
+  }
+}
+
+TEST_P(CentralFreeListTest, Shards) {
+#if ABSL_HAVE_HWADDRESS_SANITIZER
+  GTEST_SKIP()
+      << "Skipping under HWASan, which uses the top bits of the pointer.";
+#endif
+
+  // Shards are never destroyed, and gmock reports leaked mocks, so use the
+  // fake forwarder directly.
+  FakeCentralFreeListEnvironment<
+      central_freelist_internal::CentralFreeList<FakeStaticForwarder>>
+      e(GetParam().size, GetParam().bytes, GetParam().num_to_move);
+  auto& cfl = e.central_freelist();
+
+  cfl.ShardIfContended(/*max_shards=*/2);
+  EXPECT_EQ(cfl.num_shards(), 1);
+  if (e.objects_per_span() < 2) {
+    EXPECT_FALSE(cfl.EnableShards(2));
+    return;
+  }
+  ASSERT_TRUE(cfl.EnableShards(2));
+  EXPECT_FALSE(cfl.EnableShards(2));
+  EXPECT_EQ(cfl.num_shards(), 2);
+
+  // Cpus of each shard populate a span of their own.
+  void* objects[2];
+  for (unsigned shard = 0; shard < 2; ++shard) {
+    e.forwarder().set_current_shard(shard);
+    ASSERT_EQ(cfl.RemoveRange(absl::MakeSpan(&objects[shard], 1)), 1);
+  }
+  SpanStats stats = cfl.GetSpanStats();
+  EXPECT_EQ(stats.num_spans_requested, 2);
+  EXPECT_EQ(stats.num_spans_returned, 0);
+  EXPECT_EQ(cfl.length(), 2 * (e.objects_per_span() - 1));
+  EXPECT_EQ(cfl.NumSpansWith(1), 2);
+
+  // A batch mixing both shards' objects is returned to the shards owning their
+  // spans, which become free.
+  cfl.InsertRange(absl::MakeSpan(objects));
+  stats = cfl.GetSpanStats();
+  EXPECT_EQ(stats.num_spans_returned, 2);
+  EXPECT_EQ(cfl.length(), 0);
+
+  std::string buffer = PrintToString(1024, [&](Printer& printer) {
+    cfl.PrintShardStats(printer);
+  });
+  EXPECT_THAT(buffer, testing::HasSubstr(": 2 shards; lock contentions: 0 0"));
+}
+
+TEST_P(CentralFreeListTest, AdaptSpanLength) {
+#if ABSL_HAVE_HWADDRESS_SANITIZER
+  GTEST_SKIP()
+      << "Skipping under HWASan, which uses the top bits of the pointer.";
+#endif
+
+  TypeParam e(GetParam().size, GetParam().bytes, GetParam().num_to_move);
+  auto& cfl = e.central_freelist();
+  const Length max_pages = cfl.pages_per_span();
+  if (e.objects_per_span() < 2) return;
+
+  // A single mostly free span allocated in the period asks for shorter spans,
+  // which are only used once the size class holds no spans.
+  void* object;
+  ASSERT_EQ(cfl.RemoveRange(absl::MakeSpan(&object, 1)), 1);
+  cfl.AdaptSpanLength();
+  EXPECT_EQ(cfl.pages_per_span(), max_pages);
+  cfl.InsertRange(absl::MakeSpan(&object, 1));
+  ASSERT_EQ(cfl.RemoveRange(absl::MakeSpan(&object, 1)), 1);
+  cfl.InsertRange(absl::MakeSpan(&object, 1));
+  const Length short_pages = cfl.pages_per_span();
+  EXPECT_LE(short_pages, max_pages);
+  EXPECT_GE(cfl.objects_per_span(), 2);
+  EXPECT_EQ(cfl.GetSpanStats().num_live_spans(), 0);
+  if (short_pages == max_pages) return;
+
+  std::string buffer = PrintToString(1024 * 1024, [&](Printer& printer) {
+    cfl.PrintSpanUtilStats(printer);
+  });
+  EXPECT_THAT(buffer, testing::HasSubstr("1 length changes"));
+
+  // Frequent refills bring spans back to SizeMap's length.
+  std::vector<void*> objects;
+  void* batch[kMaxObjectsToMove];
+  for (int round = 0; round < 16 && cfl.pages_per_span() < max_pages;
+       ++round) {
+    constexpr int64_t kRefills =
+        TypeParam::CentralFreeList::kMaxRefillsForShortSpans + 1;
+    const size_t wanted = kRefills * cfl.objects_per_span();
+    while (objects.size() < wanted) {
+      const int got = cfl.RemoveRange(
+          absl::MakeSpan(batch, std::min(wanted - objects.size(),
+                                         e.batch_size())));
+      ASSERT_GT(got, 0);
+      objects.insert(objects.end(), batch, batch + got);
+    }
+    cfl.AdaptSpanLength();
+    for (void* ptr : objects) {
+      cfl.InsertRange({&ptr, 1});
+    }
+    objects.clear();
+    ASSERT_EQ(cfl.RemoveRange(absl::MakeSpan(&object, 1)), 1);
+    cfl.InsertRange(absl::MakeSpan(&object, 1));
+  }
+  EXPECT_EQ(cfl.pages_per_span(), max_pages);
+}
+
+TEST_P(CentralFreeListTest, SpanSharing) {
+#if ABSL_HAVE_HWADDRESS_SANITIZER
+  GTEST_SKIP()
+      << "Skipping under HWASan, which uses the top bits of the pointer.";
+#endif
+
+  // Objects of the other environment's spans are of another size class for
+  // the fake forwarder.
+  using Environment = FakeCentralFreeListEnvironment<
+      central_freelist_internal::CentralFreeList<FakeStaticForwarder>>;
+  Environment borrower(GetParam().size, GetParam().bytes,
+                       GetParam().num_to_move);
+  Environment lender(GetParam().size, GetParam().bytes,
+                     GetParam().num_to_move);
+  auto& cfl = borrower.central_freelist();
+  auto& lender_cfl = lender.central_freelist();
+
+  cfl.UpdateSpanSharing(&lender_cfl);
+  if (borrower.objects_per_span() < 2) {
+    EXPECT_FALSE(cfl.borrowing());
+    return;
+  }
+  // An idle class starts borrowing.
+  ASSERT_TRUE(cfl.borrowing());
+  EXPECT_TRUE(lender_cfl.lending());
+  EXPECT_TRUE(lender_cfl.lent());
+
+  // Objects come from, and go back to, the lender's spans.
+  void* object;
+  ASSERT_EQ(cfl.RemoveRange(absl::MakeSpan(&object, 1)), 1);
+  EXPECT_EQ(cfl.GetSpanStats().num_spans_requested, 0);
+  EXPECT_EQ(lender_cfl.GetSpanStats().num_spans_requested, 1);
+  cfl.InsertRange(absl::MakeSpan(&object, 1));
+  EXPECT_EQ(lender_cfl.GetSpanStats().num_spans_returned, 1);
+  EXPECT_EQ(lender_cfl.length(), 0);
+
+  // A span's worth of traffic stops borrowing.
+  std::vector<void*> objects;
+  void* batch[kMaxObjectsToMove];
+  while (objects.size() < borrower.objects_per_span()) {
+    const size_t n = std::min(borrower.objects_per_span() - objects.size(),
+                              borrower.batch_size());
+    const int got = cfl.RemoveRange(absl::MakeSpan(batch, n));
+    ASSERT_GT(got, 0);
+    objects.insert(objects.end(), batch, batch + got);
+  }
+  cfl.UpdateSpanSharing(&lender_cfl);
+  EXPECT_FALSE(cfl.borrowing());
+  EXPECT_FALSE(lender_cfl.lending());
+  EXPECT_TRUE(lender_cfl.lent());
+
+  // Borrowed objects still go back to the lender afterwards.
+  for (void* ptr : objects) {
+    cfl.InsertRange({&ptr, 1});
+  }
+  SpanStats stats = lender_cfl.GetSpanStats();
+  EXPECT_EQ(stats.num_spans_requested, stats.num_spans_returned);
+  EXPECT_EQ(cfl.GetSpanStats().num_spans_requested, 0);
+
+  std::string buffer = PrintToString(1024, [&](Printer& printer) {
+    cfl.PrintSpanSharingStats(printer);
+  });
+  EXPECT_THAT(buffer, testing::HasSubstr(": not borrowing; "));
+}
+
+TEST_P(CentralFreeListTest, NumaLender) {
+#if ABSL_HAVE_HWADDRESS_SANITIZER
+  GTEST_SKIP()
+      << "Skipping under HWASan, which uses the top bits of the pointer.";
+#endif
+
+  // Objects of the other environment's spans are of another size class for
+  // the fake forwarder.
+  using Environment = FakeCentralFreeListEnvironment<
+      central_freelist_internal::CentralFreeList<FakeStaticForwarder>>;
+  Environment local(GetParam().size, GetParam().bytes, GetParam().num_to_move);
+  Environment remote(GetParam().size, GetParam().bytes,
+                     GetParam().num_to_move);
+  auto& cfl = local.central_freelist();
+  auto& remote_cfl = remote.central_freelist();
+
+  // The transfer cache lends objects of the remote class, which the caches
+  // then drain under the local class, together with its own objects.
+  cfl.set_numa_lender(&remote_cfl);
+  std::vector<void*> objects;
+  void* batch[kMaxObjectsToMove];
+  for (auto* c : {&remote_cfl, &cfl}) {
+    const int got = c->RemoveRange(absl::MakeSpan(batch, local.batch_size()));
+    ASSERT_GT(got, 0);
+    objects.insert(objects.end(), batch, batch + got);
+  }
+  for (size_t i = 0; i < objects.size(); i += local.batch_size()) {
+    const size_t n = std::min(local.batch_size(), objects.size() - i);
+    cfl.InsertRange(absl::MakeSpan(&objects[i], n));
+  }
+
+  // Each central freelist got back exactly the objects of its own spans.
+  for (auto* c : {&cfl, &remote_cfl}) {
+    const SpanStats stats = c->GetSpanStats();
+    EXPECT_GT(stats.num_spans_requested, 0);
+    EXPECT_EQ(stats.num_spans_requested, stats.num_spans_returned);
+    EXPECT_EQ(c->length(), 0);
+  }
+}
+
 TEST_P(CentralFreeListTest, LongLivedSpansMovedHistogram) {
 #if ABSL_HAVE_HWADDRESS_SANITIZER
   GTEST_SKIP()
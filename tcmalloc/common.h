@@ -36,6 +36,7 @@
 #include "tcmalloc/internal/memory_tag.h"
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/internal/range_tracker.h"
+#include "tcmalloc/lock_contention_profiler.h"
 #include "tcmalloc/malloc_extension.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
@@ -71,6 +72,13 @@ static_assert(sizeof(void*) == 8);
 //   (https://isocpp.org/files/papers/n3778.html), this optimization is less
 //   significant.
 //
+// TCMALLOC_INTERNAL_64K_PAGES
+//   Matches TCMalloc's page to the 64KB base page of aarch64 kernels built with
+//   CONFIG_ARM64_64K_PAGES.  With smaller TCMalloc pages, madvise() and the
+//   residency queries operate on fractions of a kernel page, so neither release
+//   nor the residency accounting is exact.  Hugepages remain 2MB, which such
+//   kernels back with contiguous PTEs rather than 512MB THP.
+//
 // TCMALLOC_INTERNAL_256K_PAGES
 //   This configuration uses an even larger page size (256KB) as the unit of
 //   accounting granularity.
@@ -102,6 +110,8 @@ static_assert(sizeof(void*) == 8);
 #define TCMALLOC_USE_PAGEMAP3
 #elif defined(TCMALLOC_INTERNAL_256K_PAGES)
 #define TCMALLOC_PAGE_SHIFT 18
+#elif defined(TCMALLOC_INTERNAL_64K_PAGES)
+#define TCMALLOC_PAGE_SHIFT 16
 #elif defined(TCMALLOC_INTERNAL_32K_PAGES)
 #define TCMALLOC_PAGE_SHIFT 15
 #else
@@ -114,6 +124,7 @@ static_assert(sizeof(void*) == 8);
 #if defined(TCMALLOC_INTERNAL_SMALL_BUT_SLOW) + \
         defined(TCMALLOC_INTERNAL_8K_PAGES) +   \
         defined(TCMALLOC_INTERNAL_256K_PAGES) + \
+        defined(TCMALLOC_INTERNAL_64K_PAGES) +  \
         defined(TCMALLOC_INTERNAL_32K_PAGES) >  \
     1
 #error "At most 1 variant configuration must be used."
@@ -140,6 +151,17 @@ inline constexpr size_t kMaxCpuCacheSize = 1.5 * 1024 * 1024;
 inline constexpr size_t kDefaultOverallThreadCacheSize =
     8u * kMaxThreadCacheSize;
 inline constexpr size_t kStealAmount = 1 << 16;
+#elif TCMALLOC_PAGE_SHIFT == 16
+inline constexpr size_t kPageShift = 16;
+inline constexpr size_t kNumBaseClasses = 78;
+inline constexpr bool kHasExpandedClasses = true;
+inline constexpr size_t kMaxSize = 256 * 1024;
+inline constexpr size_t kMinThreadCacheSize = kMaxSize * 2;
+inline constexpr size_t kMaxThreadCacheSize = 4 << 20;
+inline constexpr size_t kMaxCpuCacheSize = 1.5 * 1024 * 1024;
+inline constexpr size_t kDefaultOverallThreadCacheSize =
+    8u * kMaxThreadCacheSize;
+inline constexpr size_t kStealAmount = 1 << 16;
 #elif TCMALLOC_PAGE_SHIFT == 18
 inline constexpr size_t kPageShift = 18;
 inline constexpr size_t kNumBaseClasses = 89;
@@ -174,13 +196,19 @@ inline constexpr size_t kNumaPartitions = kSanitizerAddressSpace ? 1 : 2;
 inline constexpr size_t kSecurityPartitions = 1;
 #else
 inline constexpr size_t kNumaPartitions = 1;
-inline constexpr size_t kSecurityPartitions = kSanitizerAddressSpace ? 1 : 2;
+inline constexpr size_t kSecurityPartitions =
+    kSanitizerAddressSpace ? 1 : kMaxSecurityPartitions;
 #endif
 
 inline constexpr size_t kNormalPartitions =
     kNumaPartitions * kSecurityPartitions;
-static_assert(kNormalPartitions <= 2,
-              "Error: There can be at most 2 normal partitions.");
+static_assert(kNormalPartitions <= kMaxSecurityPartitions,
+              "Error: There are more normal partitions than memory tags.");
+
+// Sampled memory is split in two only: partition 0 and all others.  Sampled
+// objects sit on pages of their own, so the later partitions need not be kept
+// apart from each other.
+inline constexpr size_t kSampledPartitions = kSecurityPartitions > 1 ? 2 : 1;
 
 // We have copies of kNumBaseClasses size classes for each NUMA node, followed
 // by any expanded classes.
@@ -251,6 +279,10 @@ enum class AllocationAccess {
 };
 
 inline MemoryTag MultiNormalTag(size_t partition) {
+  if constexpr (kNormalPartitions > 2) {
+    TC_ASSERT_LT(partition, kNormalPartitions);
+    return NormalPartitionTag(partition);
+  }
   switch (partition) {
     case 0:
       return MemoryTag::kNormalP0;
@@ -267,7 +299,14 @@ inline size_t PartitionFromPointer(const void* ptr) {
     return 0;
   }
 
-  switch (GetMemoryTag(ptr)) {
+  const MemoryTag tag = GetMemoryTag(ptr);
+  if constexpr (kNormalPartitions > 2) {
+    if (tag != MemoryTag::kSizeClassed && IsNormalPartitionTag(tag)) {
+      return NormalTagPartition(tag);
+    }
+    return 0;
+  }
+  switch (tag) {
     case MemoryTag::kNormalP1:
       return 1;
     default:
@@ -278,13 +317,19 @@ inline size_t PartitionFromPointer(const void* ptr) {
 // TODO: b/470136917 - Investigate if we can beautify this by avoiding two
 // PartitionFromPointer functions.
 inline size_t PartitionFromPointerFast(void* ptr) {
-  TC_ASSERT(GetMemoryTag(ptr) == MemoryTag::kNormal ||
-            GetMemoryTag(ptr) == MemoryTag::kNormalP1);
+  TC_ASSERT(IsNormalMemory(ptr));
   static_assert((static_cast<uint8_t>(MemoryTag::kNormal) & 2) == 0);
+  static_assert(kSanitizerAddressSpace ||
+                (static_cast<uint8_t>(MemoryTag::kSizeClassed) & 2) == 0);
   static_assert((static_cast<uint8_t>(MemoryTag::kNormalP1) & 2) == 2);
   if constexpr (kNormalPartitions == 1) {
     return 0;
   }
+  if constexpr (kNormalPartitions > 2) {
+    // kSizeClassed decodes as partition 0, so no branch is needed.
+    static_assert(NormalTagPartition(MemoryTag::kSizeClassed) == 0);
+    return NormalTagPartition(GetMemoryTag(ptr));
+  }
   return !!(static_cast<size_t>(GetMemoryTag(ptr)) & 2);
 }
 
@@ -297,6 +342,7 @@ class ABSL_SCOPED_LOCKABLE PageHeapSpinLockHolder {
  public:
   // TODO(b/29448043): Remove latency injection.
   PageHeapSpinLockHolder() ABSL_EXCLUSIVE_LOCK_FUNCTION(pageheap_lock) {
+    contention_.Acquired();
 #ifdef TCMALLOC_INTERNAL_LATENCY_INJECTION
     ScopedDelay delay(ScopedDelay::page_heap_delay);
 #endif
@@ -304,6 +350,9 @@ class ABSL_SCOPED_LOCKABLE PageHeapSpinLockHolder {
   ~PageHeapSpinLockHolder() ABSL_UNLOCK_FUNCTION() = default;
 
  private:
+  // Declared before lock_, so that it is destroyed (and any contention is
+  // recorded) after the lock is released.
+  LockContentionTimer contention_{pageheap_lock};
   AllocationGuardSpinLockHolder lock_{pageheap_lock};
 };
 
@@ -14,18 +14,35 @@
 
 #include "tcmalloc/cpu_cache.h"
 
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <new>
+#include <optional>
+#include <string>
 
 #include "absl/base/attributes.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/resize_and_overwrite.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "tcmalloc/experiment.h"
 #include "tcmalloc/experiment_config.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/cpu_utils.h"
 #include "tcmalloc/internal/environment.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/percpu.h"
+#include "tcmalloc/internal/sysinfo.h"
 #include "tcmalloc/internal_malloc_extension.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/static_vars.h"
@@ -35,6 +52,182 @@ GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
 
+namespace cpu_cache_internal {
+
+size_t ParseCapacityProfile(absl::string_view text,
+                            absl::Span<CapacityProfileEntry> entries) {
+  size_t n = 0;
+  bool saw_header = false;
+  while (!text.empty()) {
+    const size_t eol = text.find('\n');
+    absl::string_view line = text.substr(0, eol);
+    text.remove_prefix(eol == absl::string_view::npos ? text.size() : eol + 1);
+
+    if (!saw_header) {
+      if (absl::StripTrailingAsciiWhitespace(line) != kCapacityProfileHeader) {
+        return 0;
+      }
+      saw_header = true;
+      continue;
+    }
+    line = absl::StripAsciiWhitespace(line);
+    if (line.empty() || line[0] == '#') continue;
+
+    size_t fields[4];
+    for (size_t& field : fields) {
+      line = absl::StripLeadingAsciiWhitespace(line);
+      const size_t end = line.find(' ');
+      if (!absl::SimpleAtoi(line.substr(0, end), &field)) {
+        return 0;
+      }
+      line.remove_prefix(end == absl::string_view::npos ? line.size() : end);
+    }
+    if (!line.empty() || n == entries.size()) {
+      return 0;
+    }
+    entries[n++] = {fields[0], fields[1], fields[2], fields[3]};
+  }
+  return n;
+}
+
+uint64_t CgroupCacheLimit(uint64_t configured, int num_cpus,
+                          const CgroupLimits& limits) {
+  // Fraction of the memory limit that may be held in per-cpu caches.
+  constexpr uint64_t kMemoryFractionDivisor = 32;
+  // Threads under a CPU quota still migrate between cpus, so we expect more
+  // caches than the quota to be warm.
+  constexpr double kWarmCachesPerQuotaCpu = 2;
+  // Below this, per-cpu caches miss too often to be worth having.
+  constexpr uint64_t kMinCacheLimit = 256 << 10;
+
+  if (!limits.memory_bytes.has_value() || num_cpus <= 0) {
+    return configured;
+  }
+
+  uint64_t warm_caches = num_cpus;
+  if (limits.cpus.has_value()) {
+    const double quota_caches = std::ceil(*limits.cpus * kWarmCachesPerQuotaCpu);
+    warm_caches = std::clamp<uint64_t>(quota_caches, 1, warm_caches);
+  }
+
+  const uint64_t budget = *limits.memory_bytes / kMemoryFractionDivisor;
+  const uint64_t limit = std::max(budget / warm_caches, kMinCacheLimit);
+  return std::min(limit, configured);
+}
+
+}  // namespace cpu_cache_internal
+
+void UpdateCacheLimitFromCgroup() {
+  if (!Parameters::per_cpu_caches_cgroup_aware()) {
+    return;
+  }
+
+  ABSL_CONST_INIT static bool applied = false;
+  ABSL_CONST_INIT static CgroupLimits last_limits;
+  ABSL_CONST_INIT static uint64_t configured = 0;
+  ABSL_CONST_INIT static uint64_t derived = 0;
+
+  const CgroupLimits limits = ReadCgroupLimits();
+  if (applied && limits == last_limits) {
+    return;
+  }
+
+  const uint64_t current = tc_globals.cpu_cache().CacheLimit();
+  if (!applied || current != derived) {
+    configured = current;
+  }
+  derived =
+      cpu_cache_internal::CgroupCacheLimit(configured, NumCPUs(), limits);
+  last_limits = limits;
+  applied = true;
+  if (derived != current) {
+    tc_globals.cpu_cache().SetCacheLimit(derived);
+  }
+}
+
+// Reads the capacity profile named by TCMALLOC_PER_CPU_CAPACITY_PROFILE, if
+// any.  This runs before per-CPU caches are active, so it avoids allocating.
+static bool LoadCapacityProfile(cpu_cache_internal::CapacityProfile* profile) {
+  const char* path = thread_safe_getenv("TCMALLOC_PER_CPU_CAPACITY_PROFILE");
+  if (path == nullptr || path[0] == '\0') {
+    return false;
+  }
+
+  // Each line is at most 4 x 20 digits plus separators.
+  ABSL_CONST_INIT static char buffer[kNumClasses * 96];
+  ABSL_CONST_INIT static cpu_cache_internal::CapacityProfileEntry
+      entries[kNumClasses];
+
+  int fd;
+  do {
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) {
+    TC_LOG("Unable to open per-CPU capacity profile %s: %d", path, errno);
+    return false;
+  }
+  size_t len = 0;
+  while (len < sizeof(buffer)) {
+    ssize_t r = read(fd, buffer + len, sizeof(buffer) - len);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) break;
+    len += r;
+  }
+  close(fd);
+
+  const size_t n = cpu_cache_internal::ParseCapacityProfile(
+      absl::string_view(buffer, len), absl::MakeSpan(entries));
+  if (n == 0) {
+    TC_LOG("Ignoring malformed per-CPU capacity profile %s", path);
+    return false;
+  }
+
+  const char* prefill =
+      thread_safe_getenv("TCMALLOC_PER_CPU_CAPACITY_PROFILE_PREFILL");
+  profile->entries = absl::MakeConstSpan(entries, n);
+  profile->prefill = prefill != nullptr && strcmp(prefill, "1") == 0;
+  return true;
+}
+
+// Applies TCMALLOC_MAX_PER_CPU_COLD_CACHE_SIZE, if set, so that the cold size
+// classes get a separate budget from the moment the caches are activated.
+static void LoadColdCacheLimit() {
+  const char* e = thread_safe_getenv("TCMALLOC_MAX_PER_CPU_COLD_CACHE_SIZE");
+  uint64_t v;
+  if (e == nullptr || !absl::SimpleAtoi(e, &v)) {
+    return;
+  }
+  tc_globals.cpu_cache().SetColdCacheLimit(v);
+}
+
+// Protects the cpus listed by TCMALLOC_PROTECTED_CPUS, in the cpulist format
+// used by sysfs, e.g. "2-5,8".
+static void LoadProtectedCpus() {
+  const char* e = thread_safe_getenv("TCMALLOC_PROTECTED_CPUS");
+  if (e == nullptr || e[0] == '\0') {
+    return;
+  }
+  absl::string_view remaining(e);
+  std::optional<CpuSet> cpus = ParseCpulist([&](char* buf, size_t count) {
+    const size_t n = std::min(count, remaining.size());
+    memcpy(buf, remaining.data(), n);
+    remaining.remove_prefix(n);
+    return static_cast<ssize_t>(n);
+  });
+  if (!cpus.has_value()) {
+    TC_LOG("Ignoring malformed TCMALLOC_PROTECTED_CPUS=%s", e);
+    return;
+  }
+  tc_globals.cpu_cache().SetProtectedCpus(*cpus);
+}
+
+// Runs in the child of fork(), which only has the forking thread.
+static void ResetPerCpuCachesInChild() {
+  if (Parameters::per_cpu_caches_reset_after_fork()) {
+    tc_globals.cpu_cache().ResetAfterFork();
+  }
+}
+
 static void ActivatePerCpuCaches() {
   if (tcmalloc::tcmalloc_internal::tc_globals.CpuCacheActive()) {
     // Already active.
@@ -43,8 +236,14 @@ static void ActivatePerCpuCaches() {
 
   if (Parameters::per_cpu_caches() && subtle::percpu::IsFast()) {
     tc_globals.InitIfNecessary();
-    tc_globals.cpu_cache().Activate();
+    LoadColdCacheLimit();
+    LoadProtectedCpus();
+    UpdateCacheLimitFromCgroup();
+    cpu_cache_internal::CapacityProfile profile;
+    tc_globals.cpu_cache().Activate(LoadCapacityProfile(&profile) ? &profile
+                                                                  : nullptr);
     tc_globals.ActivateCpuCache();
+    pthread_atfork(nullptr, nullptr, ResetPerCpuCachesInChild);
     // no need for this thread cache anymore, I guess.
     ThreadCache::BecomeIdle();
     // If there's a problem with this code, let's notice it right away:
@@ -71,6 +270,24 @@ extern "C" bool MallocExtension_Internal_GetPerCpuCachesActive() {
   return tcmalloc::tcmalloc_internal::tc_globals.CpuCacheActive();
 }
 
+extern "C" void MallocExtension_Internal_GetPerCpuCapacityProfile(
+    std::string* ret) {
+  using tcmalloc::tcmalloc_internal::kNumClasses;
+  using tcmalloc::tcmalloc_internal::Printer;
+  using tcmalloc::tcmalloc_internal::tc_globals;
+
+  if (!tc_globals.CpuCacheActive()) {
+    ret->clear();
+    return;
+  }
+  absl::StringResizeAndOverwrite(
+      *ret, kNumClasses * 96, [](char* buffer, size_t buffer_size) {
+        Printer printer(buffer, buffer_size);
+        tc_globals.cpu_cache().PrintCapacityProfile(printer);
+        return std::min(printer.SpaceRequired(), buffer_size);
+      });
+}
+
 extern "C" int32_t MallocExtension_Internal_GetMaxPerCpuCacheSize() {
   return tcmalloc::tcmalloc_internal::Parameters::max_per_cpu_cache_size();
 }
@@ -78,4 +295,14 @@ extern "C" int32_t MallocExtension_Internal_GetMaxPerCpuCacheSize() {
 extern "C" void MallocExtension_Internal_SetMaxPerCpuCacheSize(int32_t value) {
   tcmalloc::tcmalloc_internal::Parameters::set_max_per_cpu_cache_size(value);
 }
+
+extern "C" int32_t MallocExtension_Internal_GetMaxPerCpuColdCacheSize() {
+  return tcmalloc::tcmalloc_internal::Parameters::max_per_cpu_cold_cache_size();
+}
+
+extern "C" void MallocExtension_Internal_SetMaxPerCpuColdCacheSize(
+    int32_t value) {
+  tcmalloc::tcmalloc_internal::Parameters::set_max_per_cpu_cold_cache_size(
+      value);
+}
 GOOGLE_MALLOC_SECTION_END
@@ -21,6 +21,9 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <iterator>
+#include <limits>
 #include <new>
 #include <tuple>
 #include <type_traits>
@@ -37,12 +40,14 @@
 #include "absl/container/fixed_array.h"
 #include "absl/functional/function_ref.h"
 #include "absl/numeric/bits.h"
+#include "absl/strings/string_view.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/experiment.h"
 #include "tcmalloc/experiment_config.h"
 #include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/cache_topology.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/cpu_utils.h"
 #include "tcmalloc/internal/environment.h"
@@ -51,12 +56,16 @@
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/internal/percpu.h"
 #include "tcmalloc/internal/percpu_tcmalloc.h"
+#include "tcmalloc/internal/prefetch.h"
+#include "tcmalloc/internal/probes.h"
 #include "tcmalloc/internal/sysinfo.h"
 #include "tcmalloc/internal/util.h"
 #include "tcmalloc/internal_malloc_extension.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/sizemap.h"
+#include "tcmalloc/slow_allocation_profiler.h"
+#include "tcmalloc/slow_path_latency.h"
 #include "tcmalloc/transfer_cache.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
@@ -146,6 +155,50 @@ class StaticForwarder {
     return Parameters::per_cpu_caches_dynamic_slab_shrink_threshold();
   }
 
+  static bool per_cpu_caches_l3_aware_stealing() {
+    return Parameters::per_cpu_caches_l3_aware_stealing();
+  }
+
+  static bool per_cpu_caches_ranked_shuffle() {
+    return Parameters::per_cpu_caches_ranked_shuffle();
+  }
+
+  static bool per_cpu_caches_dynamic_slab_working_set() {
+    return Parameters::per_cpu_caches_dynamic_slab_working_set();
+  }
+
+  static bool per_cpu_caches_predictive_refill() {
+    return Parameters::per_cpu_caches_predictive_refill();
+  }
+
+  static bool per_cpu_caches_capacity_controller() {
+    return Parameters::per_cpu_caches_capacity_controller();
+  }
+
+  static bool per_cpu_caches_incremental_drain() {
+    return Parameters::per_cpu_caches_incremental_drain();
+  }
+
+  static bool per_cpu_caches_indirect() {
+    return Parameters::per_cpu_caches_indirect();
+  }
+
+  static absl::Duration background_process_sleep_interval() {
+    return Parameters::background_process_sleep_interval();
+  }
+
+  static bool numa_return_remote_frees() {
+    return Parameters::numa_return_remote_frees();
+  }
+
+  static int32_t refill_prefetch_objects() {
+    return Parameters::refill_prefetch_objects();
+  }
+
+  static unsigned GetL3FromCpuId(int cpu) {
+    return CacheTopology::Instance().GetL3FromCpuId(cpu);
+  }
+
   bool reuse_size_classes() const {
     return state_.size_class_configuration() ==
                SizeClassConfiguration::kReuse ||
@@ -239,6 +292,43 @@ struct GetShiftMaxCapacity {
   SlabShiftBounds shift_bounds;
 };
 
+// One line of a per-CPU capacity profile, as written by
+// CpuCache::PrintCapacityProfile.  <object_size> guards against applying a
+// profile produced by a binary with a different size class table.
+struct CapacityProfileEntry {
+  size_t size_class;
+  size_t object_size;
+  // Per-CPU capacity the size class had settled at.
+  size_t capacity;
+  // Value of max_capacity_ for the size class.
+  size_t max_capacity;
+};
+
+// Warm-start state passed to CpuCache::Activate.
+struct CapacityProfile {
+  absl::Span<const CapacityProfileEntry> entries;
+  // Whether to also fill the per-CPU caches with objects when they are first
+  // populated, rather than only growing their capacity.
+  bool prefill = false;
+};
+
+// First line of a capacity profile, identifying the format version.
+inline constexpr char kCapacityProfileHeader[] =
+    "# tcmalloc per-cpu capacity profile v1";
+
+// Parses a profile written by CpuCache::PrintCapacityProfile into <entries>.
+// Returns the number of entries parsed, or 0 if <text> is malformed.
+size_t ParseCapacityProfile(absl::string_view text,
+                            absl::Span<CapacityProfileEntry> entries);
+
+// Returns the per-cpu cache limit for a process confined by the cgroup
+// <limits> on a machine with <num_cpus> cpus, which would otherwise use
+// <configured>.  A fraction of the memory limit is budgeted for all per-cpu
+// caches and spread over the caches expected to be warm at once, which the
+// CPU quota bounds.  The result never exceeds <configured>.
+uint64_t CgroupCacheLimit(uint64_t configured, int num_cpus,
+                          const CgroupLimits& limits);
+
 template <typename Forwarder>
 class CpuCache {
  public:
@@ -286,6 +376,9 @@ class CpuCache {
     // Tracks number of misses recorded as of the end of the last slab resize
     // interval.
     kSlabResize,
+    // Tracks number of misses recorded as of the last MarkCpuParking call that
+    // scheduled the cache for draining.
+    kPark,
     kNumCounts,
   };
 
@@ -308,10 +401,23 @@ class CpuCache {
     std::atomic<size_t> grow_count[kNumPossiblePerCpuShifts];
     std::atomic<size_t> shrink_count[kNumPossiblePerCpuShifts];
     std::atomic<size_t> madvise_failed_bytes;
+    // The shift fitting the largest working set of the last window, with
+    // per_cpu_caches_dynamic_slab_working_set, or zero.
+    std::atomic<uint8_t> working_set_shift;
+    // Windows in a row whose working set fit a smaller slab.  Only accessed by
+    // the thread resizing the slab.
+    int working_set_shrink_windows;
   };
 
+  // Fraction of headroom on top of the working set when sizing the slab with
+  // per_cpu_caches_dynamic_slab_working_set.
+  static constexpr double kSlabWorkingSetHeadroom = 0.25;
+
   // Sets the lower limit on the capacity that can be stolen from the cpu cache.
   static constexpr double kCacheCapacityThreshold = 0.20;
+  // A cpu cache is only stolen from if its misses are below this fraction of
+  // the destination's.
+  static constexpr double kCacheMissThreshold = 0.80;
 
   template <typename... Args>
   explicit constexpr CpuCache(Args&&... u)
@@ -320,11 +426,25 @@ class CpuCache {
   // tcmalloc explicitly initializes its global state (to be safe for
   // use in global constructors) so our constructor must be trivial;
   // do all initialization here instead.
-  void Activate();
+  //
+  // If <profile> is provided, the max capacities of size classes are taken
+  // from it, and per-CPU caches start out at the profiled capacities when they
+  // are first populated instead of growing from zero.
+  void Activate(const CapacityProfile* profile = nullptr);
 
   // For testing
   void Deactivate();
 
+  // Discards the per-CPU caches a child process inherited from fork().
+  // Objects cached by the parent are leaked, as they still back the parent's
+  // pages, and each CPU is repopulated from scratch when the child first runs
+  // on it.  Only the metadata of CPUs the parent used is written to, and their
+  // slabs are madvised away, so that the child faults in zero pages rather
+  // than copying the parent's.
+  //
+  // REQUIRES: the calling thread is the only one in the process.
+  void ResetAfterFork();
+
   // Allocate an object of the given size class.
   // Returns nullptr when allocation fails.
   [[nodiscard]] void* absl_nullable Allocate(size_t size_class);
@@ -337,6 +457,20 @@ class CpuCache {
   // when it's known that no hooks are installed.
   [[nodiscard]] void* absl_nullable AllocateSlowNoHooks(size_t size_class);
 
+#if TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+  // Like AllocateFast, and charges an allocation of <size> bytes to the
+  // sampling countdown of the current cpu.  Also fails if the allocation is
+  // to be sampled, see TcmallocSlab::PopCounted.
+  [[nodiscard]] void* absl_nullable AllocateFastCounted(size_t size_class,
+                                                        size_t size);
+  // See TcmallocSlab::ChargeSampler.
+  using SamplerCharge =
+      subtle::percpu::TcmallocSlab<kNumClasses>::SamplerCharge;
+  SamplerCharge ChargeSampler(uint32_t bytes, int32_t rearm, int32_t& old) {
+    return freelist_.ChargeSampler(bytes, rearm, old);
+  }
+#endif  // TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+
   // Free an object of the given class.
   void Deallocate(void* absl_nonnull ptr, size_t size_class);
   // Separate deallocation fast/slow paths.
@@ -348,6 +482,26 @@ class CpuCache {
   // when it's known that no hooks are installed.
   void DeallocateSlowNoHooks(void* absl_nonnull ptr, size_t size_class);
 
+  // Allocates up to <n> objects of <size_class> into <batch>.  Objects are
+  // popped from the current CPU's slab in a single restartable sequence, and
+  // any shortfall is fetched from the backing transfer cache.  Returns the
+  // number of objects stored in <batch>, which is less than <n> only if the
+  // backing cache could not satisfy the request.
+  //
+  // REQUIRES: no hooks are installed and the thread is registered with rseq.
+  [[nodiscard]] size_t AllocateBatch(size_t size_class,
+                                     void* absl_nonnull* absl_nonnull batch,
+                                     size_t n);
+
+  // Frees the <n> objects of <size_class> in <batch>.  Objects are pushed onto
+  // the current CPU's slab in a single restartable sequence, and whatever does
+  // not fit is released to the backing transfer cache.  The contents of
+  // <batch> are clobbered.
+  //
+  // REQUIRES: no hooks are installed and the thread is registered with rseq.
+  void DeallocateBatch(size_t size_class,
+                       void* absl_nonnull* absl_nonnull batch, size_t n);
+
   // Force all Allocate/DeallocateFast to fail in the current thread
   // if malloc hooks are installed.
   void MaybeForceSlowPath();
@@ -382,6 +536,16 @@ class CpuCache {
   uint64_t CacheLimit() const;
   void SetCacheLimit(uint64_t v);
 
+  // Gives the per-cpu limit of cache size for cold (expanded) size classes.
+  // If it is nonzero when the cache is activated, cold size classes draw their
+  // capacity from a budget of this size that is separate from CacheLimit(), so
+  // that cold allocations cannot take capacity from the other size classes and
+  // vice versa. Zero means cold size classes share CacheLimit(). Once the
+  // budgets are separate, changing the limit resizes the cold budget of each
+  // cpu; lowering it drains cold size classes as needed to fit.
+  uint64_t ColdCacheLimit() const;
+  void SetColdCacheLimit(uint64_t v);
+
   // Shuffles per-cpu caches using the number of underflows and overflows that
   // occurred in the prior interval. It selects the top per-cpu caches
   // with highest misses as candidates, iterates through the other per-cpu
@@ -390,14 +554,141 @@ class CpuCache {
   //
   // TODO(vgogte): There are quite a few knobs that we can play around with in
   // ShuffleCpuCaches.
+  //
+  // With per_cpu_caches_ranked_shuffle, it instead plans to grow every cpu
+  // cache whose misses are above the average, by up to kRankedShuffleMaxGrow
+  // of the cache limit in proportion to how far above the average it is, and
+  // starts carrying out the plan; see ContinueShuffleCpuCaches.
   void ShuffleCpuCaches();
 
+  // Carries out the plan of the last ranked ShuffleCpuCaches, moving at most
+  // kRankedShuffleBytesPerTick of the cache limit per call, so that the
+  // capacity arrives within one shuffle period without stopping many cpus at
+  // once.  Destinations are served from the most to the least missing; each
+  // steals from the cpus with the fewest misses, nearest in the topology
+  // first: the same L3 cache, then the same NUMA partition, then any.  Does
+  // nothing without a pending plan.
+  static constexpr double kRankedShuffleMaxGrow = 0.50;
+  static constexpr double kRankedShuffleBytesPerTick = 1.0;
+  void ContinueShuffleCpuCaches();
+
   // Tries to reclaim inactive per-CPU caches. It iterates through the set of
   // populated cpu caches and reclaims the caches that:
   // (1) had same number of used bytes since the last interval,
   // (2) had no change in the number of misses since the last interval.
+  // With per_cpu_caches_incremental_drain, such caches are only scheduled to
+  // be drained by DrainIdleCachesIncrementally.
   void TryReclaimingCaches();
 
+  // Drains at most kMaxSizeClassesToDrainPerTick size classes in total from
+  // the caches scheduled by TryReclaimingCaches, coldest size class (the one
+  // whose last miss is the oldest) first, so that idle caches return their
+  // objects to the transfer caches a few size classes at a time.  A cache that
+  // sees misses again before it is empty is no longer drained.
+  static constexpr int kMaxSizeClassesToDrainPerTick = 16;
+  void DrainIdleCachesIncrementally();
+
+  struct IncrementalDrainStats {
+    // Number of idle caches scheduled for draining, fully drained, and no
+    // longer drained because they were used again.
+    uint64_t scheduled;
+    uint64_t completed;
+    uint64_t cancelled;
+    // Number of size classes and bytes drained.
+    uint64_t size_classes;
+    uint64_t bytes;
+    // Total time spent draining, and the longest time spent in a single call
+    // to DrainIdleCachesIncrementally.
+    absl::Duration total_time;
+    absl::Duration max_tick_time;
+  };
+
+  // Reports the work done by DrainIdleCachesIncrementally.
+  IncrementalDrainStats GetIncrementalDrainStats() const;
+
+  // Hints that the worker running on <cpu> is about to park, e.g. in epoll,
+  // for about <expected>.  If that is at least the background thread's sleep
+  // interval, the cache is drained instead of waiting for TryReclaimingCaches
+  // to find it idle: with per_cpu_caches_incremental_drain, by
+  // DrainIdleCachesIncrementally unless <cpu> sees misses again first, and
+  // right away otherwise.  Shorter parks are ignored, as the cache would only
+  // be refilled after them.  May be called from any processor.
+  void MarkCpuParking(int cpu, absl::Duration expected);
+
+  struct ParkStats {
+    // Number of MarkCpuParking calls, and of those that drained the cache or
+    // scheduled it for draining.
+    uint64_t hints;
+    uint64_t drains;
+  };
+
+  ParkStats GetParkStats() const;
+
+  // Protects the caches of the cpus in <cpus>, and stops protecting the
+  // others, e.g. cores reserved for latency-critical threads.  The capacity
+  // of a protected cpu is never stolen below CacheLimit(), give or take the
+  // last object shrunk; TryReclaimingCaches and MarkCpuParking leave its
+  // cache alone; and ShuffleCpuCaches grows protected cpus that missed before
+  // any other.  Reclaim() still drains it.  May be called at any time,
+  // including before Activate().
+  void SetProtectedCpus(const CpuSet& cpus);
+  CpuSet GetProtectedCpus() const;
+  bool IsProtected(int cpu) const;
+
+  struct NumaRemoteFreeStats {
+    // Number of overflows of size classes owned by another NUMA partition that
+    // were returned to their home transfer cache, and the objects returned.
+    uint64_t flushes;
+    uint64_t objects;
+  };
+
+  // Reports the objects freed on <cpu> on behalf of another NUMA partition
+  // that were returned home because of numa_return_remote_frees.
+  NumaRemoteFreeStats GetNumaRemoteFreeStats(int cpu) const;
+  NumaRemoteFreeStats GetNumaRemoteFreeStats() const;
+
+  // With per_cpu_caches_predictive_refill, underflows of a size class that
+  // follow each other within kRefillBurstInterval are a burst.  Each of them
+  // grows the size class by a batch, and refills its whole capacity rather
+  // than half of it, so that the refills grow with the burst.  Only one
+  // batch, or what the backing transfer cache holds if more, is fetched on
+  // the strength of the prediction alone.
+  static constexpr absl::Duration kRefillBurstInterval =
+      absl::Microseconds(20);
+
+  struct PredictiveRefillStats {
+    // Number of refills sized for a burst, and the objects they asked for
+    // beyond the usual refill.
+    uint64_t refills;
+    uint64_t extra_objects;
+  };
+
+  PredictiveRefillStats GetPredictiveRefillStats() const;
+
+  // Reports the number of times a thread had to cache the slab of <cpu>
+  // before using it.  The cached slab is dropped whenever the kernel preempts,
+  // migrates or signals the thread, or a remote operation fences the CPU, so
+  // this bounds from above the number of rseq critical sections that aborted
+  // on <cpu>, at no cost to the fast path.
+  uint64_t GetSlabRecaches(int cpu) const;
+  uint64_t GetSlabRecaches() const;
+
+  // Number of objects each CPU's indirect cache holds at most.  The indirect
+  // caches hold objects of the size classes that bypass the slabs, when
+  // per_cpu_caches_indirect is set.
+  static constexpr int kIndirectCacheObjects = 4;
+
+  struct IndirectCacheStats {
+    // Allocations served by, and missing, the indirect caches.
+    uint64_t hits;
+    uint64_t misses;
+    // Frees that pushed the oldest object of a full cache out to the sharded
+    // transfer cache.
+    uint64_t evictions;
+  };
+
+  IndirectCacheStats GetIndirectCacheStats() const;
+
   // Resize size classes for up to kNumCpuCachesToResize cpu caches per
   // interval.
   static constexpr int kNumCpuCachesToResize = 10;
@@ -424,6 +715,25 @@ class CpuCache {
   // array.
   int GetUpdatedMaxCapacities(absl::Span<PerSizeClassMaxCapacity> max_capacity);
 
+  struct CapacityControllerStats {
+    // Number of intervals the capacity controller has run for.
+    uint64_t intervals;
+    // Number of size classes whose maximum capacity changed in the most recent
+    // interval.
+    uint64_t adjusted_size_classes;
+    // Bytes of maximum capacity moved to growing size classes in the most
+    // recent interval, and in total.
+    uint64_t moved_bytes;
+    uint64_t total_moved_bytes;
+    // Number of consecutive intervals, up to the most recent one, in which no
+    // maximum capacity changed.
+    uint64_t stable_intervals;
+  };
+
+  // Reports convergence statistics of the capacity controller used by
+  // GetUpdatedMaxCapacities when per_cpu_caches_capacity_controller is set.
+  CapacityControllerStats GetCapacityControllerStats() const;
+
   // Resizes maximum capacities for the size classes. First, it computes
   // candidates to resize using GetUpdatedMaxCapacities(...), and then updates
   // maximum capacities for size classes for all per-cpu caches. Resizing is a
@@ -452,6 +762,40 @@ class CpuCache {
   // Reports total number of times any CPU has been reclaimed.
   uint64_t GetNumReclaims() const;
 
+  struct CpuCacheStealStats {
+    // Bytes of capacity stolen from CPUs sharing the destination's L3 cache.
+    size_t same_l3_bytes;
+    // Bytes of capacity stolen from CPUs in other L3 cache domains.
+    size_t cross_l3_bytes;
+    // Number of ranked shuffle plans made, and the bytes they still have to
+    // move.
+    uint64_t ranked_plans;
+    size_t ranked_pending_bytes;
+  };
+
+  // Reports how much capacity ShuffleCpuCaches has moved between CPUs, split
+  // by whether source and destination share an L3 cache.
+  CpuCacheStealStats GetStealStats() const;
+
+  // Compares the CPUs the process may run on, as returned by
+  // sched_getaffinity, with those of the previous call, so as to follow
+  // cpuset changes without waiting for idle caches to be reclaimed.  The
+  // caches of CPUs no longer allowed are drained, and the capacity they held
+  // is handed to the CPUs newly allowed, in equal shares.  Capacity freed
+  // while no CPU is added is kept for the next ones.
+  void HandleCpusetChange();
+
+  struct CpusetChangeStats {
+    // Number of cpuset changes seen, and of caches they drained.
+    uint64_t changes;
+    uint64_t drained_cpus;
+    // Bytes of capacity handed to newly allowed CPUs, and still kept for the
+    // next ones.
+    size_t moved_bytes;
+    size_t parked_bytes;
+  };
+  CpusetChangeStats GetCpusetChangeStats() const;
+
   // Reports number of cpus that have touched set to true.
   int CountTouchedCpus() const;
 
@@ -463,14 +807,31 @@ class CpuCache {
 
   // When dynamic slab size is enabled, checks if there is a need to resize
   // the slab based on miss-counts and resizes if so.
+  //
+  // With per_cpu_caches_dynamic_slab_working_set, it instead resizes the slab
+  // straight to the smallest shift that fits the largest working set sampled
+  // by SampleSlabWorkingSet since the last call, plus kSlabWorkingSetHeadroom.
+  // The slab only shrinks once two calls in a row found it too large, so that
+  // a lull between phases does not shrink it.
   void ResizeSlabIfNeeded();
 
+  // Samples the working set of each populated cpu cache for
+  // ResizeSlabIfNeeded: the objects each size class holds, or, for size
+  // classes that are full and overflowed, more than the current slab fits.
+  // Called periodically.
+  void SampleSlabWorkingSet();
+
   // Reports total cache underflows and overflows for <cpu>.
   CpuCacheMissStats GetTotalCacheMissStats(int cpu) const;
 
   // Reports total cache underflows and overflows for all CPUs.
   CpuCacheMissStats GetTotalCacheMissStats() const;
 
+  // Reports the part of the total cache underflows and overflows for <cpu>,
+  // or for all CPUs, that was incurred by cold size classes.
+  CpuCacheMissStats GetTotalColdCacheMissStats(int cpu) const;
+  CpuCacheMissStats GetTotalColdCacheMissStats() const;
+
   // Reports the cache underflows and overflows for <cpu> that were recorded
   // during the previous interval for <miss_count>.
   CpuCacheMissStats GetIntervalCacheMissStats(int cpu,
@@ -509,6 +870,10 @@ class CpuCache {
   void Print(Printer& out) const;
   void PrintInPbtxt(PbtxtRegion& region) const;
 
+  // Writes the current per-size-class capacities in the format accepted by
+  // ParseCapacityProfile.
+  void PrintCapacityProfile(Printer& out) const;
+
   const Forwarder& forwarder() const { return forwarder_; }
 
   Forwarder& forwarder() { return forwarder_; }
@@ -587,10 +952,31 @@ class CpuCache {
     }
   };
 
+  // A few objects of any of the size classes that bypass the slabs, most
+  // recently freed last.  These classes have no room in the slabs, so a
+  // spinlock stands in for the restartable sequences.  It is only contended
+  // when a thread is preempted holding it, or migrates, or the cache is
+  // reclaimed.
+  struct ABSL_CACHELINE_ALIGNED IndirectCache {
+    absl::base_internal::SpinLock lock{
+        absl::base_internal::SCHEDULE_KERNEL_ONLY};
+    int count = 0;
+    void* objects[kIndirectCacheObjects];
+    uint16_t size_classes[kIndirectCacheObjects];
+    // Bytes held, readable without the lock.
+    std::atomic<size_t> bytes;
+    std::atomic<size_t> hits;
+    std::atomic<size_t> misses;
+    std::atomic<size_t> evictions;
+  };
+
   struct ABSL_CACHELINE_ALIGNED ResizeInfo {
     // cache space on this CPU we're not using.  Modify atomically;
     // we don't want to lose space.
     std::atomic<size_t> available;
+    // Unused cache space of the separate budget for cold size classes. Always
+    // zero unless separate_cold_budget_ is set.
+    std::atomic<size_t> cold_available;
     // Size class to steal from for the clock-wise algorithm.
     size_t next_steal = 1;
     // Track whether we have ever populated this CPU.
@@ -608,6 +994,10 @@ class CpuCache {
     MissCounts underflows;
     // Tracks number of overflows on deallocate.
     MissCounts overflows;
+    // Tracks the totals of underflows and overflows incurred by cold size
+    // classes, which are included in underflows and overflows.
+    std::atomic<size_t> cold_underflows;
+    std::atomic<size_t> cold_overflows;
     std::atomic<int64_t> last_miss_cycles[2][kNumClasses];
     // total cache space available on this CPU. This tracks the total
     // allocated and unallocated bytes on this CPU cache.
@@ -619,6 +1009,33 @@ class CpuCache {
     // Tracks last time this CPU was reclaimed.  If last underflow/overflow data
     // appears before this point in time, we ignore the CPU.
     std::atomic<int64_t> last_reclaim;
+    // Whether TryReclaimingCaches or MarkCpuParking scheduled this CPU to be
+    // drained incrementally.
+    std::atomic<bool> drain_pending;
+    // Whether the pending drain was scheduled by MarkCpuParking, so that
+    // misses count from the MissCount::kPark snapshot instead of kReclaim.
+    std::atomic<bool> drain_after_park;
+    // Tracks overflows of size classes owned by another NUMA partition that
+    // were returned to their home transfer cache, and the objects returned.
+    std::atomic<size_t> remote_free_flushes;
+    std::atomic<size_t> remote_free_objects;
+    // Number of times a thread cached the slab of this CPU.
+    std::atomic<size_t> slab_recaches;
+    // See PredictiveRefillStats.
+    std::atomic<size_t> predictive_refills;
+    std::atomic<size_t> predictive_refill_objects;
+    IndirectCache indirect;
+    // Misses of the last shuffle interval, and the capacity still to be moved
+    // here, as of the last ranked shuffle plan.  Only accessed by the thread
+    // shuffling the caches.
+    size_t shuffle_misses = 0;
+    size_t shuffle_want = 0;
+    // Largest shift needed by the working set sampled since the last slab
+    // resize, or zero.  Only accessed by the thread resizing the slab.
+    uint8_t working_set_shift = 0;
+    // Whether the process was allowed to run on this CPU as of the last
+    // HandleCpusetChange.  Only accessed by the thread calling it.
+    bool allowed = false;
   };
 
   // Determines how we distribute memory in the per-cpu cache to the various
@@ -630,6 +1047,14 @@ class CpuCache {
 
   GetShiftMaxCapacity GetMaxCapacityFunctor(uint8_t shift) const;
 
+  // Allocates and frees objects of size classes that bypass the slabs, through
+  // the current CPU's indirect cache if per_cpu_caches_indirect is set.
+  void* absl_nullable AllocateIndirect(size_t size_class);
+  void DeallocateIndirect(void* ptr, size_t size_class);
+  // Returns the objects in <cpu>'s indirect cache to the sharded transfer
+  // cache, and the number of bytes returned.
+  uint64_t ReclaimIndirect(int cpu);
+
   // Fetches objects from backing transfer cache.
   [[nodiscard]] int FetchFromBackingCache(size_t size_class,
                                           absl::Span<void*> batch);
@@ -639,9 +1064,21 @@ class CpuCache {
                              absl::Span<void* absl_nonnull> batch);
 
   [[nodiscard]] void* absl_nullable Refill(int cpu, size_t size_class);
+  // Prefetches the objects of a freshly fetched <batch> of <len> objects that
+  // the per-cpu cache hands out next, up to refill_prefetch_objects() and the
+  // batch size of <size_class>.
+  void PrefetchRefill(size_t size_class, void* const* batch, size_t len) const;
   std::pair<int, bool> CacheCpuSlab();
   void Populate(int cpu);
 
+  // Grows (and optionally fills) the caches of a just-populated <cpu> to the
+  // capacities loaded from the warm-start profile.
+  void WarmStart(int cpu);
+
+  // Loads max capacities and warm-start capacities from <profile>, skipping
+  // entries that do not match this binary's size classes.
+  void ApplyCapacityProfile(const CapacityProfile& profile);
+
   // Returns true if we bypass cpu cache for a <size_class>. We may bypass
   // per-cpu cache when we enable certain configurations of sharded transfer
   // cache.
@@ -656,6 +1093,21 @@ class CpuCache {
   // Returns number of objects to return/request from transfer cache.
   size_t UpdateCapacity(int cpu, size_t size_class, bool overflow);
 
+  // Returns the refill target for an underflow of <size_class> on <cpu> in a
+  // burst, given the <capacity> after growing and the usual <target>.
+  size_t PredictiveRefillCount(int cpu, size_t size_class, size_t capacity,
+                               size_t batch_length, uint32_t successive,
+                               size_t target);
+
+  // Returns the number of objects the transfer cache backing <cpu> holds for
+  // <size_class>.
+  size_t BackingCacheLength(int cpu, size_t size_class);
+
+  // Returns whether objects of <size_class> freed on <cpu> belong to another
+  // NUMA partition and should be returned to their home transfer cache rather
+  // than accumulate in this cpu's cache.
+  bool ReturnRemoteFreesHome(int cpu, size_t size_class) const;
+
   // Tries to grow freelist <size_class> on the current <cpu> by up to
   // <desired_increase> objects if there is available capacity.
   void Grow(int cpu, size_t size_class, size_t desired_increase);
@@ -665,6 +1117,14 @@ class CpuCache {
   // remain the same.
   DynamicSlabResize ShouldResizeSlab();
 
+  // Returns the smallest shift whose slab fits the working set of <cpu> with
+  // headroom, while the slab has shift <current>.
+  uint8_t WorkingSetShift(int cpu, uint8_t current) const;
+
+  // Returns the shift ResizeSlabIfNeeded resizes to with
+  // per_cpu_caches_dynamic_slab_working_set, and starts the next window.
+  uint8_t WorkingSetSlabShift();
+
   // Determine if the <size_class> is a good candidate to be shrunk. We use
   // clock-like algorithm to prioritize size classes for shrinking.
   bool IsGoodCandidateForShrinking(int cpu, size_t size_class);
@@ -687,7 +1147,19 @@ class CpuCache {
   // overflow by 1.
   // <is_alloc> determines whether the associated count corresponds to an
   // underflow or overflow.
-  void RecordCacheMissStat(int cpu, bool is_alloc);
+  void RecordCacheMissStat(int cpu, bool is_alloc, size_t size_class);
+
+  // Returns true if <size_class> draws its capacity from the separate cold
+  // budget rather than from the budget shared by the other size classes.
+  bool UsesColdBudget(size_t size_class) const {
+    return separate_cold_budget_ && IsExpandedSizeClass(size_class);
+  }
+
+  // Returns the unused capacity of <cpu> that <size_class> grows from.
+  std::atomic<size_t>& Available(int cpu, size_t size_class) {
+    return UsesColdBudget(size_class) ? resize_[cpu].cold_available
+                                      : resize_[cpu].available;
+  }
 
   // Tries to steal <bytes> for the destination <cpu>. It iterates through the
   // the set of populated cpu caches and steals the bytes from them. A cpu is
@@ -701,12 +1173,32 @@ class CpuCache {
   // For a given source cpu, we iterate through the size classes to steal from
   // them. Currently, we use a clock-like algorithm to identify the size_class
   // to steal from.
+  //
+  // With L3-aware stealing enabled, we first only consider cpus that share an
+  // L3 cache with <cpu>, and only look at other L3 domains if those could not
+  // provide <bytes>.
   void StealFromOtherCache(int cpu, int max_populated_cpu,
                            absl::Span<CpuMissStat> skip_cpus, size_t bytes);
 
+  // Plans a ranked shuffle; see ShuffleCpuCaches.
+  void PlanRankedShuffle();
+
+  // Returns 0 if <a> and <b> share an L3 cache, 1 if they share a NUMA
+  // partition, and 2 otherwise.
+  int TopologyDistance(int a, int b) const;
+
+  // Steals up to <bytes> of capacity from <src_cpu>, preferring unused
+  // available capacity over shrinking its size classes. Returns acquired bytes.
+  size_t StealFromCpu(int src_cpu, size_t bytes);
+
   // Try to steal one object from cpu/size_class. Return bytes stolen.
   size_t ShrinkOtherCache(int cpu, size_t size_class);
 
+  // Shrinks the capacity of <cpu>'s cold size classes by up to <bytes>,
+  // returning their objects to the backing caches. Returns the capacity taken
+  // back, in bytes.
+  size_t ShrinkColdCaches(int cpu, size_t bytes);
+
   // Resizes capacities of up to kMaxSizeClassesToResize size classes for a
   // single <cpu>.
   void ResizeCpuSizeClasses(int cpu);
@@ -722,6 +1214,30 @@ class CpuCache {
   // madvise-away slab memory, pointed to by <slab_addr> of size <slab_size>.
   void MadviseAwaySlabs(void* slab_addr, size_t slab_size);
 
+  // Calls f(hugepage, huge) for each hugepage lying entirely within the
+  // current slabs and overlapping the slab of <cpu>, or for all of them if
+  // <cpu> is negative.  <huge> is true if at least half of the CPUs whose
+  // slabs the hugepage holds are populated.
+  template <typename F>
+  void ForEachSlabHugepage(int cpu, F f) const;
+
+  // Backs with transparent hugepages only the slab hugepages for which
+  // ForEachSlabHugepage finds enough populated CPUs, so that the slab memory
+  // of hosts with many CPUs grows with the CPUs in use rather than with the
+  // possible ones.
+  void AdviseSlabHugepages(int cpu);
+
+  // (Re)initializes resize_[cpu], with the given budgets.
+  void InitResizeInfo(int cpu, uint64_t max_cache_size,
+                      uint64_t max_cold_cache_size);
+
+  // Computes maximum capacities like GetUpdatedMaxCapacities, using a feedback
+  // controller instead of fixed growth factors. <interval_misses> holds the
+  // maximum capacity misses of each size class during the last interval.
+  int GetControllerMaxCapacities(
+      absl::Span<const size_t> interval_misses,
+      absl::Span<PerSizeClassMaxCapacity> max_capacity);
+
   uint8_t PartitionShift() const;
 
   Freelist freelist_;
@@ -739,6 +1255,65 @@ class CpuCache {
   // caches in a round-robin fashion.
   int next_cpu_cache_steal_ = 0;
 
+  // Capacity each size class is grown to when a cpu is populated, as loaded
+  // from a capacity profile in Activate().  Zero means no warm start.
+  uint16_t warm_start_capacity_[kNumClasses] = {0};
+  bool warm_start_prefill_ = false;
+
+  // Capacity stolen by StealFromOtherCache(), split by whether the source cpu
+  // shares an L3 cache with the destination.
+  std::atomic<size_t> stolen_same_l3_bytes_ = 0;
+  std::atomic<size_t> stolen_cross_l3_bytes_ = 0;
+  std::atomic<uint64_t> ranked_shuffle_plans_ = 0;
+  std::atomic<size_t> ranked_shuffle_pending_bytes_ = 0;
+
+  // Cpuset changes handled by HandleCpusetChange(), and the capacity of the
+  // CPUs it drained that no newly allowed CPU took yet.
+  std::atomic<uint64_t> cpuset_changes_ = 0;
+  std::atomic<uint64_t> cpuset_drained_cpus_ = 0;
+  std::atomic<size_t> cpuset_moved_bytes_ = 0;
+  std::atomic<size_t> cpuset_parked_bytes_ = 0;
+
+  // State of the capacity controller run by GetControllerMaxCapacities().
+  struct CapacityController {
+    // Exponentially smoothed maximum capacity misses per interval of each size
+    // class. Only accessed by the thread resizing maximum capacities.
+    double smoothed_misses[kNumClasses] = {0};
+    std::atomic<uint64_t> intervals = 0;
+    std::atomic<uint64_t> adjusted_size_classes = 0;
+    std::atomic<uint64_t> moved_bytes = 0;
+    std::atomic<uint64_t> total_moved_bytes = 0;
+    std::atomic<uint64_t> stable_intervals = 0;
+  };
+  CapacityController capacity_controller_;
+
+  // Drains up to <max_size_classes> size classes of <cpu>, which is scheduled
+  // for incremental draining, and returns the number of size classes drained.
+  int DrainIdleCacheIncrementally(int cpu, int max_size_classes);
+
+  // Marks <cpu> as drained by Reclaim or DrainIdleCacheIncrementally.
+  // REQUIRES: resize_[cpu].lock is held.
+  void RecordReclaim(int cpu);
+
+  // Work done by DrainIdleCachesIncrementally, see IncrementalDrainStats.
+  struct IncrementalDrain {
+    std::atomic<uint64_t> scheduled = 0;
+    std::atomic<uint64_t> completed = 0;
+    std::atomic<uint64_t> cancelled = 0;
+    std::atomic<uint64_t> size_classes = 0;
+    std::atomic<uint64_t> bytes = 0;
+    std::atomic<uint64_t> total_cycles = 0;
+    std::atomic<uint64_t> max_tick_cycles = 0;
+  };
+  IncrementalDrain incremental_drain_;
+
+  // See ParkStats.
+  std::atomic<uint64_t> park_hints_ = 0;
+  std::atomic<uint64_t> park_drains_ = 0;
+
+  // Bitmap of the protected cpus; see SetProtectedCpus().
+  std::atomic<uint64_t> protected_cpus_[kMaxCpus / 64] = {};
+
   // Provides a hint to ResizeSizeClasses() that records the last CPU for which
   // we resized size classes. We use this to resize size classes for CPUs in a
   // round-robin fashion.
@@ -753,6 +1328,11 @@ class CpuCache {
   // Per-core cache limit in bytes.
   std::atomic<uint64_t> max_per_cpu_cache_size_{kMaxCpuCacheSize};
 
+  // Per-core cache limit in bytes for cold size classes, and whether cold size
+  // classes use it as a separate budget. The latter is decided in Activate().
+  std::atomic<uint64_t> max_per_cpu_cold_cache_size_{0};
+  bool separate_cold_budget_ = false;
+
   ABSL_ATTRIBUTE_NO_UNIQUE_ADDRESS Forwarder forwarder_;
 
   DynamicSlabInfo dynamic_slab_info_{};
@@ -779,6 +1359,16 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* CpuCache<Forwarder>::AllocateFast(
   return freelist_.Pop(size_class);
 }
 
+#if TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+template <class Forwarder>
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void*
+CpuCache<Forwarder>::AllocateFastCounted(size_t size_class, size_t size) {
+  TC_ASSERT_LE(size, kMaxSize);
+  // Avoid missampling 0, as Sampler::TryRecordAllocationFast does.
+  return freelist_.PopCounted(size_class, size + 1);
+}
+#endif  // TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+
 template <class Forwarder>
 void CpuCache<Forwarder>::Deallocate(void* ptr, size_t size_class) {
   if (ABSL_PREDICT_FALSE(!DeallocateFast(ptr, size_class))) {
@@ -806,13 +1396,7 @@ static CpuSet FillActiveCpuMask() {
     allowed_cpus.Zero();
   }
 
-#ifdef PERCPU_USE_RSEQ
-  const bool real_cpus = !subtle::percpu::UsingVirtualCpus();
-#else
-  const bool real_cpus = true;
-#endif
-
-  if (real_cpus) {
+  if (!subtle::percpu::UsingVirtualCpus()) {
     return allowed_cpus;
   }
 
@@ -972,7 +1556,32 @@ inline size_t CpuCache<Forwarder>::GetDynamicSlabFailedBytes() const {
 }
 
 template <class Forwarder>
-inline void CpuCache<Forwarder>::Activate() {
+inline void CpuCache<Forwarder>::ApplyCapacityProfile(
+    const CapacityProfile& profile) {
+  for (const CapacityProfileEntry& entry : profile.entries) {
+    const size_t size_class = entry.size_class;
+    if (size_class == 0 || size_class >= kNumClasses ||
+        forwarder_.class_to_size(size_class) != entry.object_size) {
+      continue;
+    }
+    size_t max_capacity = max_capacity_[size_class].load(
+        std::memory_order_relaxed);
+    if (max_capacity == 0) {
+      // The size class is not in use in this configuration.
+      continue;
+    }
+    if (entry.max_capacity >= forwarder_.num_objects_to_move(size_class) &&
+        entry.max_capacity <= std::numeric_limits<uint16_t>::max()) {
+      max_capacity = entry.max_capacity;
+      max_capacity_[size_class].store(max_capacity, std::memory_order_relaxed);
+    }
+    warm_start_capacity_[size_class] = std::min(entry.capacity, max_capacity);
+  }
+  warm_start_prefill_ = profile.prefill;
+}
+
+template <class Forwarder>
+inline void CpuCache<Forwarder>::Activate(const CapacityProfile* profile) {
   int num_cpus = NumCPUs();
 
   shift_bounds_.initial_shift = kInitialBasePerCpuShift;
@@ -997,29 +1606,58 @@ inline void CpuCache<Forwarder>::Activate() {
   // Deal with size classes that correspond only to partitions that are in
   // use. If NUMA awareness and security partitions are disabled then we may
   // have a smaller shift than would suffice for all of the unused size classes.
-  const int num_size_classes = forwarder_.active_partitions() * kNumBaseClasses;
-  for (int size_class = 0; size_class < num_size_classes; ++size_class) {
-    const size_t capacity = MaxCapacity(size_class);
+  const auto init_max_capacities = [&]() {
+    const int num_size_classes =
+        forwarder_.active_partitions() * kNumBaseClasses;
+    for (int size_class = 0; size_class < num_size_classes; ++size_class) {
+      const size_t capacity = MaxCapacity(size_class);
 #ifndef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
-    // Check that the capacity is greater than the batch size.
-    if (capacity > 0) {
-      TC_CHECK_GE(capacity, forwarder_.num_objects_to_move(size_class));
-    }
+      // Check that the capacity is greater than the batch size.
+      if (capacity > 0) {
+        TC_CHECK_GE(capacity, forwarder_.num_objects_to_move(size_class));
+      }
 #endif
-    max_capacity_[size_class].store(capacity, std::memory_order_relaxed);
-  }
+      max_capacity_[size_class].store(capacity, std::memory_order_relaxed);
+    }
 
-  // Deal with expanded size classes.
-  for (int size_class = kExpandedClassesStart; size_class < kNumClasses;
-       ++size_class) {
-    const size_t capacity = MaxCapacity(size_class);
+    // Deal with expanded size classes.
+    for (int size_class = kExpandedClassesStart; size_class < kNumClasses;
+         ++size_class) {
+      const size_t capacity = MaxCapacity(size_class);
 #ifndef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
-    // Check that the capacity is greater than the batch size.
-    if (capacity > 0) {
-      TC_CHECK_GE(capacity, forwarder_.num_objects_to_move(size_class));
-    }
+      // Check that the capacity is greater than the batch size.
+      if (capacity > 0) {
+        TC_CHECK_GE(capacity, forwarder_.num_objects_to_move(size_class));
+      }
 #endif
-    max_capacity_[size_class].store(capacity, std::memory_order_relaxed);
+      max_capacity_[size_class].store(capacity, std::memory_order_relaxed);
+    }
+  };
+
+  const auto slabs_fit = [&]() {
+    for (uint8_t shift = shift_bounds_.initial_shift;
+         shift <= shift_bounds_.max_shift; ++shift) {
+      const auto [bytes_required, bytes_available] =
+          EstimateSlabBytes({max_capacity_, shift, shift_bounds_});
+      if (bytes_required > bytes_available) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  init_max_capacities();
+  if (profile != nullptr) {
+    ApplyCapacityProfile(*profile);
+    // The profile may come from a binary with a different configuration.  If
+    // the profiled max capacities do not fit, fall back to the defaults.
+    if (!slabs_fit()) {
+      TC_LOG("Ignoring per-CPU capacity profile that does not fit in slabs");
+      init_max_capacities();
+      std::fill(std::begin(warm_start_capacity_),
+                std::end(warm_start_capacity_), 0);
+      warm_start_prefill_ = false;
+    }
   }
 
   // Verify that all the possible shifts will have valid max capacities.
@@ -1039,15 +1677,16 @@ inline void CpuCache<Forwarder>::Activate() {
       sizeof(ResizeInfo) * num_cpus, std::align_val_t{alignof(ResizeInfo)}));
 
   const uint64_t max_cache_size = CacheLimit();
+  const uint64_t max_cold_cache_size =
+      ColdFeatureActive() ? ColdCacheLimit() : 0;
+  separate_cold_budget_ = max_cold_cache_size != 0;
 
   for (int cpu = 0; cpu < num_cpus; ++cpu) {
-    new (&resize_[cpu]) ResizeInfo();
-
-    for (int size_class = 1; size_class < kNumClasses; ++size_class) {
-      resize_[cpu].per_class[size_class].Init();
-    }
-    resize_[cpu].available.store(max_cache_size, std::memory_order_relaxed);
-    resize_[cpu].capacity.store(max_cache_size, std::memory_order_relaxed);
+    InitResizeInfo(cpu, max_cache_size, max_cold_cache_size);
+  }
+  const CpuSet allowed_cpus = FillActiveCpuMask();
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    resize_[cpu].allowed = allowed_cpus.IsSet(cpu);
   }
 
   auto Alloc = [&](size_t size, std::align_val_t alignment) {
@@ -1063,6 +1702,7 @@ inline void CpuCache<Forwarder>::Activate() {
       Alloc, slabs,
       GetShiftMaxCapacity{max_capacity_, per_cpu_shift, shift_bounds_},
       subtle::percpu::ToShiftType(per_cpu_shift));
+  AdviseSlabHugepages(/*cpu=*/-1);
 }
 
 template <class Forwarder>
@@ -1079,6 +1719,37 @@ inline void CpuCache<Forwarder>::Deactivate() {
                      std::align_val_t{alignof(decltype(*resize_))});
 }
 
+template <class Forwarder>
+void CpuCache<Forwarder>::InitResizeInfo(int cpu, uint64_t max_cache_size,
+                                         uint64_t max_cold_cache_size) {
+  new (&resize_[cpu]) ResizeInfo();
+
+  for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+    resize_[cpu].per_class[size_class].Init();
+  }
+  resize_[cpu].available.store(max_cache_size, std::memory_order_relaxed);
+  resize_[cpu].cold_available.store(max_cold_cache_size,
+                                    std::memory_order_relaxed);
+  resize_[cpu].capacity.store(max_cache_size + max_cold_cache_size,
+                              std::memory_order_relaxed);
+}
+
+template <class Forwarder>
+void CpuCache<Forwarder>::ResetAfterFork() {
+  const int num_cpus = NumCPUs();
+  const uint64_t max_cache_size = CacheLimit();
+  const uint64_t max_cold_cache_size =
+      separate_cold_budget_ ? ColdCacheLimit() : 0;
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    // A thread of the parent may have been populating an unpopulated CPU, and
+    // left its lock held.
+    if (!HasPopulated(cpu) && !resize_[cpu].lock.IsHeld()) continue;
+    InitResizeInfo(cpu, max_cache_size, max_cold_cache_size);
+  }
+  const ResizeSlabsInfo info = freelist_.ResetAfterFork();
+  MadviseAwaySlabs(info.old_slabs, info.old_slabs_size);
+}
+
 template <class Forwarder>
 inline int CpuCache<Forwarder>::FetchFromBackingCache(size_t size_class,
                                                       absl::Span<void*> batch) {
@@ -1101,6 +1772,7 @@ inline void CpuCache<Forwarder>::ReleaseToBackingCache(
 
 template <class Forwarder>
 void* CpuCache<Forwarder>::AllocateSlow(size_t size_class) {
+  ScopedSlowPathTimer timer(SlowPath::kCpuCacheAllocate);
   void* ret = AllocateSlowNoHooks(size_class);
   MaybeForceSlowPath();
   return ret;
@@ -1109,12 +1781,13 @@ void* CpuCache<Forwarder>::AllocateSlow(size_t size_class) {
 template <class Forwarder>
 void* CpuCache<Forwarder>::AllocateSlowNoHooks(size_t size_class) {
   if (BypassCpuCache(size_class)) {
-    return forwarder_.sharded_transfer_cache().Pop(size_class);
+    return AllocateIndirect(size_class);
   }
   auto [cpu, cached] = CacheCpuSlab();
   if (ABSL_PREDICT_FALSE(cached)) {
     if (ABSL_PREDICT_FALSE(cpu < 0)) {
       // The cpu is stopped.
+      ScopedSlowAllocationCause cause(SlowAllocationCause::kSlabResize);
       void* ptr = nullptr;
       int r = FetchFromBackingCache(size_class, absl::MakeSpan(&ptr, 1));
 #ifndef NDEBUG
@@ -1128,7 +1801,7 @@ void* CpuCache<Forwarder>::AllocateSlowNoHooks(size_t size_class) {
       return ret;
     }
   }
-  RecordCacheMissStat(cpu, true);
+  RecordCacheMissStat(cpu, true, size_class);
   return Refill(cpu, size_class);
 }
 
@@ -1164,6 +1837,7 @@ inline void* CpuCache<Forwarder>::Refill(int cpu, size_t size_class) {
     if (result == nullptr) {
       i--;
       result = batch[i];
+      PrefetchRefill(size_class, batch, i);
     }
     if (i) {
       i -= freelist_.PushBatch(size_class, batch, i);
@@ -1172,9 +1846,27 @@ inline void* CpuCache<Forwarder>::Refill(int cpu, size_t size_class) {
       }
     }
   } while (got == kMaxObjectsToMove && i == 0 && total < target);
+  TCMALLOC_PROBE(cpu_cache_refill, cpu, size_class, total);
   return result;
 }
 
+template <class Forwarder>
+inline void CpuCache<Forwarder>::PrefetchRefill(size_t size_class,
+                                               void* const* batch,
+                                               size_t len) const {
+  const int32_t depth = forwarder_.refill_prefetch_objects();
+  if (ABSL_PREDICT_TRUE(depth <= 0)) return;
+  // PushBatch stores batch[len - 1] first, so the slab pops batch[0],
+  // batch[1], ... after the object returned by Refill.  The application
+  // writes to them right away, and freshly refilled objects are usually cold.
+  const size_t n =
+      std::min({static_cast<size_t>(depth), len,
+                forwarder_.num_objects_to_move(size_class)});
+  for (size_t j = 0; j < n; ++j) {
+    PrefetchWT0(batch[j]);
+  }
+}
+
 template <class Forwarder>
 inline bool CpuCache<Forwarder>::BypassCpuCache(size_t size_class) const {
   // We bypass per-cpu cache when sharded transfer cache is enabled for large
@@ -1262,12 +1954,28 @@ inline size_t CpuCache<Forwarder>::UpdateCapacity(int cpu, size_t size_class,
   uint32_t successive = 0;
   ResizeInfo& resize = resize_[cpu];
   const int64_t now = absl::base_internal::CycleClock::Now();
+  bool burst = false;
+  if (!overflow && forwarder_.per_cpu_caches_predictive_refill()) {
+    const int64_t last_underflow =
+        resize.last_miss_cycles[0][size_class].load(std::memory_order_relaxed);
+    burst = now - last_underflow <
+            absl::ToDoubleSeconds(kRefillBurstInterval) *
+                absl::base_internal::CycleClock::Frequency();
+  }
   // TODO(ckennelly): Use a strongly typed enum.
   resize.last_miss_cycles[overflow][size_class].store(
       now, std::memory_order_relaxed);
-  bool grow_by_batch =
-      resize.per_class[size_class].Update(overflow, grow_by_one, &successive);
-  if ((grow_by_one || grow_by_batch) && capacity != max_capacity) {
+  bool grow_by_batch = resize.per_class[size_class].Update(
+      overflow, grow_by_one || burst, &successive);
+  // Only a run of underflows is a burst; the first may just be a cold cache.
+  burst = burst && successive > 0;
+  grow_by_batch |= burst;
+  // Objects freed here on behalf of another NUMA partition are only buffered
+  // up to one batch, so that they go home in batches without this cpu's
+  // cache filling up with remote memory.
+  const bool remote_free = overflow && ReturnRemoteFreesHome(cpu, size_class);
+  if ((grow_by_one || grow_by_batch) && capacity != max_capacity &&
+      (!remote_free || capacity < batch_length)) {
     size_t increase = 1;
     if (grow_by_batch) {
       increase = std::min(batch_length, max_capacity - capacity);
@@ -1276,9 +1984,16 @@ inline size_t CpuCache<Forwarder>::UpdateCapacity(int cpu, size_t size_class,
       // what we want to request from transfer cache.
       increase = batch_length - capacity;
     }
+    if (remote_free) {
+      increase = std::min(increase, batch_length - capacity);
+    }
     Grow(cpu, size_class, increase);
     capacity = freelist_.Capacity(cpu, size_class);
   }
+  if (remote_free) {
+    // Return everything we hold, plus the object being freed.
+    return capacity + 1;
+  }
   // We hit the maximum capacity limit when the size class capacity is equal to
   // its maximum allowed capacity. Record a miss due to that so that we can
   // potentially grow the max capacity for this size class later.
@@ -1286,7 +2001,62 @@ inline size_t CpuCache<Forwarder>::UpdateCapacity(int cpu, size_t size_class,
     resize_[cpu].per_class[size_class].RecordMiss(
         PerClassMissType::kMaxCapacityTotal);
   }
-  return TargetOverflowRefillCount(capacity, batch_length, successive);
+  const size_t target =
+      TargetOverflowRefillCount(capacity, batch_length, successive);
+  if (burst) {
+    return PredictiveRefillCount(cpu, size_class, capacity, batch_length,
+                                 successive, target);
+  }
+  return target;
+}
+
+template <class Forwarder>
+inline size_t CpuCache<Forwarder>::PredictiveRefillCount(
+    int cpu, size_t size_class, size_t capacity, size_t batch_length,
+    uint32_t successive, size_t target) {
+  const size_t want =
+      std::min(capacity + 1,
+               (size_t{1} << std::min<uint32_t>(successive, 10)) *
+                   batch_length);
+  if (want <= target) {
+    return target;
+  }
+  // Beyond a batch, only take objects the transfer cache already holds, so
+  // that a wrong guess does not pull objects out of spans.
+  const size_t backing = BackingCacheLength(cpu, size_class);
+  const size_t extra = std::min(want - target, std::max(batch_length, backing));
+  ResizeInfo& resize = resize_[cpu];
+  resize.predictive_refills.store(
+      resize.predictive_refills.load(std::memory_order_relaxed) + 1,
+      std::memory_order_relaxed);
+  resize.predictive_refill_objects.store(
+      resize.predictive_refill_objects.load(std::memory_order_relaxed) + extra,
+      std::memory_order_relaxed);
+  return target + extra;
+}
+
+template <class Forwarder>
+inline size_t CpuCache<Forwarder>::BackingCacheLength(int cpu,
+                                                      size_t size_class) {
+  if (UseBackingShardedTransferCache(size_class)) {
+    return forwarder_.sharded_transfer_cache().tc_length(cpu, size_class);
+  }
+  return forwarder_.transfer_cache().tc_length(size_class);
+}
+
+template <class Forwarder>
+inline bool CpuCache<Forwarder>::ReturnRemoteFreesHome(
+    int cpu, size_t size_class) const {
+  if constexpr (kNumaPartitions == 1) {
+    return false;
+  } else {
+    if (size_class >= kExpandedClassesStart) return false;
+    const auto& numa = forwarder_.numa_topology();
+    if (!numa.numa_aware() || !forwarder_.numa_return_remote_frees()) {
+      return false;
+    }
+    return size_class / kNumBaseClasses != numa.GetCpuPartition(cpu);
+  }
 }
 
 template <class Forwarder>
@@ -1295,6 +2065,9 @@ std::pair<int, bool> CpuCache<Forwarder>::CacheCpuSlab() {
   if (ABSL_PREDICT_FALSE(cached) && ABSL_PREDICT_TRUE(cpu >= 0)) {
     auto& state = resize_[cpu];
     state.touched.store(true, std::memory_order_relaxed);
+    state.slab_recaches.store(
+        state.slab_recaches.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
 
     if (ABSL_PREDICT_FALSE(!state.populated.load(std::memory_order_acquire))) {
       Populate(cpu);
@@ -1310,7 +2083,35 @@ ABSL_ATTRIBUTE_NOINLINE void CpuCache<Forwarder>::Populate(int cpu) {
     return;
   }
   freelist_.InitCpu(cpu, GetMaxCapacityFunctor(freelist_.GetShift()));
+  WarmStart(cpu);
   resize_[cpu].populated.store(true, std::memory_order_release);
+  AdviseSlabHugepages(cpu);
+}
+
+template <class Forwarder>
+void CpuCache<Forwarder>::WarmStart(int cpu) {
+  TC_ASSERT(resize_[cpu].lock.IsHeld());
+  for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
+    const size_t target = warm_start_capacity_[size_class];
+    if (target == 0) continue;
+    Grow(cpu, size_class, target);
+    if (!warm_start_prefill_) continue;
+
+    // Fill up to one batch, which is what the first underflow would fetch.
+    const size_t capacity = freelist_.Capacity(cpu, size_class);
+    const size_t want = std::min(
+        {capacity, forwarder_.num_objects_to_move(size_class),
+         kMaxObjectsToMove});
+    if (want == 0) continue;
+    void* batch[kMaxObjectsToMove];
+    const int got =
+        FetchFromBackingCache(size_class, absl::MakeSpan(batch, want));
+    if (got == 0) continue;
+    // If we have been migrated, PushBatch fails and the objects go back.
+    if (size_t left = got - freelist_.PushBatch(size_class, batch, got)) {
+      ReleaseToBackingCache(size_class, {batch, left});
+    }
+  }
 }
 
 inline size_t subtract_at_least(std::atomic<size_t>* a, size_t min,
@@ -1332,8 +2133,8 @@ inline void CpuCache<Forwarder>::Grow(int cpu, size_t size_class,
                                       size_t desired_increase) {
   const size_t size = forwarder_.class_to_size(size_class);
   const size_t desired_bytes = desired_increase * size;
-  size_t acquired_bytes =
-      subtract_at_least(&resize_[cpu].available, size, desired_bytes);
+  std::atomic<size_t>& available = Available(cpu, size_class);
+  size_t acquired_bytes = subtract_at_least(&available, size, desired_bytes);
   if (acquired_bytes < desired_bytes) {
     resize_[cpu].per_class[size_class].RecordMiss(
         PerClassMissType::kCapacityTotal);
@@ -1350,7 +2151,7 @@ inline void CpuCache<Forwarder>::Grow(int cpu, size_t size_class,
       [&](uint8_t shift) { return GetMaxCapacity(size_class, shift); });
   if (size_t unused = acquired_bytes - increase * size) {
     // return whatever we didn't use to the slack.
-    resize_[cpu].available.fetch_add(unused, std::memory_order_relaxed);
+    available.fetch_add(unused, std::memory_order_relaxed);
   }
 }
 
@@ -1359,8 +2160,9 @@ inline void CpuCache<Forwarder>::TryReclaimingCaches() {
   const int num_cpus = NumCPUs();
 
   for (int cpu = 0; cpu < num_cpus; ++cpu) {
-    // Nothing to reclaim if the cpu is not populated.
-    if (!HasPopulated(cpu)) {
+    // Nothing to reclaim if the cpu is not populated, and protected cpus keep
+    // their caches through lulls.
+    if (!HasPopulated(cpu) || IsProtected(cpu)) {
       continue;
     }
 
@@ -1378,7 +2180,12 @@ inline void CpuCache<Forwarder>::TryReclaimingCaches() {
     // Reclaim the cache if the number of used bytes and total number of misses
     // stayed constant since the last interval.
     if (used_bytes != 0 && used_bytes == prev_used_bytes && misses == 0) {
-      Reclaim(cpu);
+      if (!forwarder_.per_cpu_caches_incremental_drain()) {
+        Reclaim(cpu);
+      } else if (!resize_[cpu].drain_pending.exchange(
+                     true, std::memory_order_relaxed)) {
+        incremental_drain_.scheduled.fetch_add(1, std::memory_order_relaxed);
+      }
     }
 
     // Takes a snapshot of used bytes in the cache at the end of this interval
@@ -1392,73 +2199,310 @@ inline void CpuCache<Forwarder>::TryReclaimingCaches() {
 }
 
 template <class Forwarder>
-int CpuCache<Forwarder>::GetUpdatedMaxCapacities(
-    absl::Span<PerSizeClassMaxCapacity> max_capacity) {
-  // Collect miss stats incurred during the current resize interval for all the
-  // size classes.
-  const int num_cpus = NumCPUs();
-  absl::FixedArray<size_t, 0> total_misses(kNumClasses, 0);
-  int index = 0;
-  for (int cpu = 0; cpu < num_cpus; ++cpu) {
-    index = 0;
-    if (!HasPopulated(cpu)) continue;
-    for (size_t size_class = 0; size_class < kNumClasses; ++size_class) {
-      total_misses[index] +=
-          resize_[cpu].per_class[size_class].GetAndUpdateIntervalMisses(
-              PerClassMissType::kMaxCapacityTotal,
-              PerClassMissType::kMaxCapacityResize);
-
-      ++index;
+inline void CpuCache<Forwarder>::DrainIdleCachesIncrementally() {
+  const int64_t start = absl::base_internal::CycleClock::Now();
+  int budget = kMaxSizeClassesToDrainPerTick;
+  bool drained = false;
+  for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus && budget > 0;
+       ++cpu) {
+    if (!resize_[cpu].drain_pending.load(std::memory_order_relaxed)) {
+      continue;
     }
+    budget -= DrainIdleCacheIncrementally(cpu, budget);
+    drained = true;
+  }
+  if (!drained) {
+    return;
   }
 
-  absl::FixedArray<SizeClassMissStat> miss_stats(kNumClasses);
-  index = 0;
-  for (size_t size_class = 0; size_class < kNumClasses; ++size_class) {
-    miss_stats[index] = SizeClassMissStat{.size_class = size_class,
-                                          .misses = total_misses[index]};
-    ++index;
+  const uint64_t cycles = absl::base_internal::CycleClock::Now() - start;
+  incremental_drain_.total_cycles.fetch_add(cycles, std::memory_order_relaxed);
+  if (cycles >
+      incremental_drain_.max_tick_cycles.load(std::memory_order_relaxed)) {
+    incremental_drain_.max_tick_cycles.store(cycles,
+                                             std::memory_order_relaxed);
   }
+}
 
-  // Sort the collected stats to record size classes with largest number of
-  // misses in the last interval.
-  std::sort(miss_stats.begin(), miss_stats.end(),
-            [](SizeClassMissStat a, SizeClassMissStat b) {
-              // In case of a conflict, prefer growing smaller size classes.
-              if (a.misses == b.misses) {
-                return a.size_class < b.size_class;
-              }
-              return a.misses > b.misses;
-            });
+template <class Forwarder>
+inline int CpuCache<Forwarder>::DrainIdleCacheIncrementally(
+    int cpu, int max_size_classes) {
+  AllocationGuardSpinLockHolder h(resize_[cpu].lock);
+  ResizeInfo& resize = resize_[cpu];
 
-  // Computing number of size classes to resize is a light-weight operation, but
-  // resizing size classes involves stopping all per-cpu caches, and hence is a
-  // heavy-weight operation. So, we try to be aggressive in the number of size
-  // classes we would like to resize when we can, but perform resizing operation
-  // sparingly.
-  constexpr int kMaxCapacitiesToGrow = kNumClasses / 2;
+  // Stop draining if the cache was used since TryReclaimingCaches found it
+  // idle, or since its worker parked; it would only have to refill what we
+  // drain.  The cpu may also have been protected since.
+  const CpuCacheMissStats misses = GetIntervalCacheMissStats(
+      cpu, resize.drain_after_park.load(std::memory_order_relaxed)
+               ? MissCount::kPark
+               : MissCount::kReclaim);
+  if (!HasPopulated(cpu) || IsProtected(cpu) || misses.underflows != 0 ||
+      misses.overflows != 0) {
+    resize.drain_pending.store(false, std::memory_order_relaxed);
+    resize.drain_after_park.store(false, std::memory_order_relaxed);
+    incremental_drain_.cancelled.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+  }
 
-  int grown = 0;
-  int max_capacity_index = 0;
+  struct ColdSizeClass {
+    size_t size_class;
+    int64_t last_miss;
+  };
+  absl::FixedArray<ColdSizeClass> candidates(kNumClasses - 1);
+  size_t num_candidates = 0;
+  for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
+    if (freelist_.Capacity(cpu, size_class) == 0) continue;
+    candidates[num_candidates++] = ColdSizeClass{
+        .size_class = size_class,
+        .last_miss = std::max(
+            resize.last_miss_cycles[0][size_class].load(
+                std::memory_order_relaxed),
+            resize.last_miss_cycles[1][size_class].load(
+                std::memory_order_relaxed))};
+  }
+  std::sort(candidates.begin(), candidates.begin() + num_candidates,
+            [](ColdSizeClass a, ColdSizeClass b) {
+              return a.last_miss < b.last_miss;
+            });
 
-  // We try to grow size class max capacities by batch_size times the growth
-  // factor. The growth factor starts with 5 times the batch size for the size
-  // class that suffers the highest misses, and then gradually shrinks to 1 for
-  // the size class with fifth-highest misses and onwards. There is nothing
-  // interesting about this factor; it may be tuned in the future to increase or
-  // decrease the aggresiveness of the growth.
-  int growth_factor = 5;
-  // Indices in miss_stats corresponding to the size classes we aim to grow
-  // and shrink.
-  int shrink_index = kNumClasses - 1;
-  for (int grow_index = 0; grow_index < kNumClasses; ++grow_index) {
-    // If a size class with largest misses is zero, break. Other size classes
-    // should also have suffered zero misses as well.
-    if (miss_stats[grow_index].misses == 0) break;
+  const size_t to_drain =
+      std::min(num_candidates, static_cast<size_t>(max_size_classes));
+  uint64_t bytes = 0;
+  if (to_drain > 0) {
+    subtle::percpu::ScopedSlabCpuStop<kNumClasses> cpu_stop(freelist_, cpu);
+    for (size_t i = 0; i < to_drain; ++i) {
+      const size_t size_class = candidates[i].size_class;
+      const size_t size = forwarder_.class_to_size(size_class);
+      const size_t batch_length = forwarder_.num_objects_to_move(size_class);
+      const size_t shrunk = freelist_.ShrinkOtherCache(
+          cpu, size_class, freelist_.Capacity(cpu, size_class),
+          [&](size_t size_class, void** batch, size_t count) {
+            bytes += count * size;
+            for (size_t j = 0; j < count; j += batch_length) {
+              const size_t n = std::min(batch_length, count - j);
+              ReleaseToBackingCache(size_class,
+                                    absl::Span<void*>(batch + j, n));
+            }
+          });
+      Available(cpu, size_class)
+          .fetch_add(shrunk * size, std::memory_order_relaxed);
+    }
+  }
+  incremental_drain_.size_classes.fetch_add(to_drain,
+                                            std::memory_order_relaxed);
+  incremental_drain_.bytes.fetch_add(bytes, std::memory_order_relaxed);
 
-    // We grow a size class by its batch_size, while trying to shrink max
-    // capacities of other size classes by the same amount. We shrink each
-    // size classes' max capacity by its batch size too.
+  if (to_drain == num_candidates) {
+    resize.drain_pending.store(false, std::memory_order_relaxed);
+    resize.drain_after_park.store(false, std::memory_order_relaxed);
+    incremental_drain_.completed.fetch_add(1, std::memory_order_relaxed);
+    RecordReclaim(cpu);
+  }
+  return to_drain;
+}
+
+template <class Forwarder>
+inline void CpuCache<Forwarder>::MarkCpuParking(int cpu,
+                                                absl::Duration expected) {
+  park_hints_.fetch_add(1, std::memory_order_relaxed);
+  if (expected < forwarder_.background_process_sleep_interval() ||
+      !HasPopulated(cpu) || IsProtected(cpu)) {
+    return;
+  }
+
+  if (!forwarder_.per_cpu_caches_incremental_drain()) {
+    Reclaim(cpu);
+    park_drains_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  AllocationGuardSpinLockHolder h(resize_[cpu].lock);
+  ResizeInfo& resize = resize_[cpu];
+  // Only MarkCpuParking updates the kPark snapshot, under the lock.
+  UpdateIntervalCacheMissStats(cpu, MissCount::kPark);
+  resize.drain_after_park.store(true, std::memory_order_relaxed);
+  if (!resize.drain_pending.exchange(true, std::memory_order_relaxed)) {
+    incremental_drain_.scheduled.fetch_add(1, std::memory_order_relaxed);
+  }
+  park_drains_.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <class Forwarder>
+inline typename CpuCache<Forwarder>::ParkStats
+CpuCache<Forwarder>::GetParkStats() const {
+  return {
+      park_hints_.load(std::memory_order_relaxed),
+      park_drains_.load(std::memory_order_relaxed),
+  };
+}
+
+template <class Forwarder>
+inline void CpuCache<Forwarder>::SetProtectedCpus(const CpuSet& cpus) {
+  for (int word = 0; word < kMaxCpus / 64; ++word) {
+    uint64_t bits = 0;
+    for (int bit = 0; bit < 64; ++bit) {
+      if (cpus.IsSet(word * 64 + bit)) bits |= uint64_t{1} << bit;
+    }
+    protected_cpus_[word].store(bits, std::memory_order_relaxed);
+  }
+}
+
+template <class Forwarder>
+inline CpuSet CpuCache<Forwarder>::GetProtectedCpus() const {
+  CpuSet cpus;
+  cpus.Zero();
+  for (int cpu = 0; cpu < kMaxCpus; ++cpu) {
+    if (IsProtected(cpu)) cpus.Set(cpu);
+  }
+  return cpus;
+}
+
+template <class Forwarder>
+inline bool CpuCache<Forwarder>::IsProtected(int cpu) const {
+  TC_ASSERT_GE(cpu, 0);
+  TC_ASSERT_LT(cpu, kMaxCpus);
+  return (protected_cpus_[cpu / 64].load(std::memory_order_relaxed) >>
+          (cpu % 64)) &
+         1;
+}
+
+template <class Forwarder>
+inline typename CpuCache<Forwarder>::IncrementalDrainStats
+CpuCache<Forwarder>::GetIncrementalDrainStats() const {
+  const double frequency = absl::base_internal::CycleClock::Frequency();
+  return {
+      incremental_drain_.scheduled.load(std::memory_order_relaxed),
+      incremental_drain_.completed.load(std::memory_order_relaxed),
+      incremental_drain_.cancelled.load(std::memory_order_relaxed),
+      incremental_drain_.size_classes.load(std::memory_order_relaxed),
+      incremental_drain_.bytes.load(std::memory_order_relaxed),
+      absl::Seconds(
+          incremental_drain_.total_cycles.load(std::memory_order_relaxed) /
+          frequency),
+      absl::Seconds(
+          incremental_drain_.max_tick_cycles.load(std::memory_order_relaxed) /
+          frequency)};
+}
+
+template <class Forwarder>
+inline typename CpuCache<Forwarder>::NumaRemoteFreeStats
+CpuCache<Forwarder>::GetNumaRemoteFreeStats(int cpu) const {
+  return {resize_[cpu].remote_free_flushes.load(std::memory_order_relaxed),
+          resize_[cpu].remote_free_objects.load(std::memory_order_relaxed)};
+}
+
+template <class Forwarder>
+inline typename CpuCache<Forwarder>::NumaRemoteFreeStats
+CpuCache<Forwarder>::GetNumaRemoteFreeStats() const {
+  NumaRemoteFreeStats stats = {0, 0};
+  for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+    const NumaRemoteFreeStats cpu_stats = GetNumaRemoteFreeStats(cpu);
+    stats.flushes += cpu_stats.flushes;
+    stats.objects += cpu_stats.objects;
+  }
+  return stats;
+}
+
+template <class Forwarder>
+inline typename CpuCache<Forwarder>::PredictiveRefillStats
+CpuCache<Forwarder>::GetPredictiveRefillStats() const {
+  PredictiveRefillStats stats = {0, 0};
+  for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+    stats.refills +=
+        resize_[cpu].predictive_refills.load(std::memory_order_relaxed);
+    stats.extra_objects +=
+        resize_[cpu].predictive_refill_objects.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::GetSlabRecaches(int cpu) const {
+  return resize_[cpu].slab_recaches.load(std::memory_order_relaxed);
+}
+
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::GetSlabRecaches() const {
+  uint64_t recaches = 0;
+  for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+    recaches += GetSlabRecaches(cpu);
+  }
+  return recaches;
+}
+
+template <class Forwarder>
+int CpuCache<Forwarder>::GetUpdatedMaxCapacities(
+    absl::Span<PerSizeClassMaxCapacity> max_capacity) {
+  // Collect miss stats incurred during the current resize interval for all the
+  // size classes.
+  const int num_cpus = NumCPUs();
+  absl::FixedArray<size_t, 0> total_misses(kNumClasses, 0);
+  int index = 0;
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    index = 0;
+    if (!HasPopulated(cpu)) continue;
+    for (size_t size_class = 0; size_class < kNumClasses; ++size_class) {
+      total_misses[index] +=
+          resize_[cpu].per_class[size_class].GetAndUpdateIntervalMisses(
+              PerClassMissType::kMaxCapacityTotal,
+              PerClassMissType::kMaxCapacityResize);
+
+      ++index;
+    }
+  }
+
+  if (forwarder_.per_cpu_caches_capacity_controller()) {
+    return GetControllerMaxCapacities(total_misses, max_capacity);
+  }
+
+  absl::FixedArray<SizeClassMissStat> miss_stats(kNumClasses);
+  index = 0;
+  for (size_t size_class = 0; size_class < kNumClasses; ++size_class) {
+    miss_stats[index] = SizeClassMissStat{.size_class = size_class,
+                                          .misses = total_misses[index]};
+    ++index;
+  }
+
+  // Sort the collected stats to record size classes with largest number of
+  // misses in the last interval.
+  std::sort(miss_stats.begin(), miss_stats.end(),
+            [](SizeClassMissStat a, SizeClassMissStat b) {
+              // In case of a conflict, prefer growing smaller size classes.
+              if (a.misses == b.misses) {
+                return a.size_class < b.size_class;
+              }
+              return a.misses > b.misses;
+            });
+
+  // Computing number of size classes to resize is a light-weight operation, but
+  // resizing size classes involves stopping all per-cpu caches, and hence is a
+  // heavy-weight operation. So, we try to be aggressive in the number of size
+  // classes we would like to resize when we can, but perform resizing operation
+  // sparingly.
+  constexpr int kMaxCapacitiesToGrow = kNumClasses / 2;
+
+  int grown = 0;
+  int max_capacity_index = 0;
+
+  // We try to grow size class max capacities by batch_size times the growth
+  // factor. The growth factor starts with 5 times the batch size for the size
+  // class that suffers the highest misses, and then gradually shrinks to 1 for
+  // the size class with fifth-highest misses and onwards. There is nothing
+  // interesting about this factor; it may be tuned in the future to increase or
+  // decrease the aggresiveness of the growth.
+  int growth_factor = 5;
+  // Indices in miss_stats corresponding to the size classes we aim to grow
+  // and shrink.
+  int shrink_index = kNumClasses - 1;
+  for (int grow_index = 0; grow_index < kNumClasses; ++grow_index) {
+    // If a size class with largest misses is zero, break. Other size classes
+    // should also have suffered zero misses as well.
+    if (miss_stats[grow_index].misses == 0) break;
+
+    // We grow a size class by its batch_size, while trying to shrink max
+    // capacities of other size classes by the same amount. We shrink each
+    // size classes' max capacity by its batch size too.
     const size_t size_class_to_grow = miss_stats[grow_index].size_class;
     const int to_grow = forwarder_.num_objects_to_move(size_class_to_grow);
 
@@ -1520,6 +2564,133 @@ int CpuCache<Forwarder>::GetUpdatedMaxCapacities(
   return max_capacity_index;
 }
 
+template <class Forwarder>
+int CpuCache<Forwarder>::GetControllerMaxCapacities(
+    absl::Span<const size_t> interval_misses,
+    absl::Span<PerSizeClassMaxCapacity> max_capacity) {
+  // Weight of the latest interval when smoothing misses, so that a single
+  // bursty interval does not move capacity back and forth.
+  constexpr double kMissSmoothing = 0.5;
+  // A size class only gives up capacity to a class whose miss cost is at least
+  // this many times higher, so classes with similar costs do not keep trading
+  // capacity.
+  constexpr double kCostHysteresis = 2.0;
+  constexpr int kMaxCapacitiesToGrow = kNumClasses / 2;
+
+  struct SizeClassCost {
+    size_t size_class;
+    double misses;
+    double cost;
+  };
+  absl::FixedArray<SizeClassCost> costs(kNumClasses);
+  int num_costs = 0;
+  for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
+    double& smoothed = capacity_controller_.smoothed_misses[size_class];
+    smoothed = (1 - kMissSmoothing) * smoothed +
+               kMissSmoothing * interval_misses[size_class];
+
+    const size_t cap =
+        max_capacity_[size_class].load(std::memory_order_relaxed);
+    const size_t size = forwarder_.class_to_size(size_class);
+    if (cap == 0 || size == 0) continue;
+    // The cost of a size class is its misses per byte of maximum capacity.
+    // Growing a class lowers its cost, so capacity settles where the costs of
+    // the size classes are balanced, rather than where the miss counts are.
+    // This keeps large classes, whose objects are expensive to hold, from
+    // being grown as readily as small ones.
+    costs[num_costs++] = SizeClassCost{
+        .size_class = size_class,
+        .misses = smoothed,
+        .cost = smoothed / static_cast<double>(cap * size)};
+  }
+
+  std::sort(costs.begin(), costs.begin() + num_costs,
+            [](const SizeClassCost& a, const SizeClassCost& b) {
+              // In case of a conflict, prefer growing smaller size classes.
+              if (a.cost == b.cost) {
+                return a.size_class < b.size_class;
+              }
+              return a.cost > b.cost;
+            });
+
+  int grown = 0;
+  int max_capacity_index = 0;
+  uint64_t moved_bytes = 0;
+  int shrink_index = num_costs - 1;
+  for (int grow_index = 0; grow_index < num_costs; ++grow_index) {
+    // Smoothed misses decay towards zero, but never reach it; stop once the
+    // remaining classes average less than a miss per interval.
+    if (costs[grow_index].misses < 1) break;
+
+    // Grow by at most a batch per interval, which damps the controller.
+    const size_t size_class_to_grow = costs[grow_index].size_class;
+    const int to_grow = forwarder_.num_objects_to_move(size_class_to_grow);
+
+    // As in GetUpdatedMaxCapacities, the number of objects is conserved, so
+    // the slab layout keeps fitting. Only commit the shrunk capacities once
+    // enough of them were found.
+    int next_capacity_index = max_capacity_index;
+    int target = to_grow;
+    int shrunk = 0;
+    while (shrink_index > grow_index && target > 0) {
+      // The remaining donors only get more expensive.
+      if (costs[shrink_index].cost * kCostHysteresis >=
+          costs[grow_index].cost) {
+        break;
+      }
+
+      size_t size_class_to_shrink = costs[shrink_index].size_class;
+      int batch_size = forwarder_.num_objects_to_move(size_class_to_shrink);
+      size_t cap =
+          max_capacity_[size_class_to_shrink].load(std::memory_order_relaxed);
+      --shrink_index;
+
+      // We retain at least batch_size amount of max capacity for a size
+      // class.
+      if (cap <= batch_size) continue;
+
+      int to_shrink = std::min(target, batch_size);
+      to_shrink = std::min<size_t>(to_shrink, cap - batch_size);
+      if (to_shrink == 0) continue;
+
+      TC_ASSERT_LT(next_capacity_index, max_capacity.size());
+      max_capacity[next_capacity_index] = PerSizeClassMaxCapacity{
+          .size_class = size_class_to_shrink, .max_capacity = cap - to_shrink};
+      ++next_capacity_index;
+      target -= to_shrink;
+      shrunk += to_shrink;
+    }
+
+    if (shrunk == 0) break;
+
+    size_t cap =
+        max_capacity_[size_class_to_grow].load(std::memory_order_relaxed);
+    TC_ASSERT_LT(next_capacity_index, max_capacity.size());
+    max_capacity[next_capacity_index] = PerSizeClassMaxCapacity{
+        .size_class = size_class_to_grow, .max_capacity = cap + shrunk};
+    ++next_capacity_index;
+    max_capacity_index = next_capacity_index;
+    moved_bytes += shrunk * forwarder_.class_to_size(size_class_to_grow);
+
+    if (++grown == kMaxCapacitiesToGrow) break;
+  }
+
+  capacity_controller_.intervals.fetch_add(1, std::memory_order_relaxed);
+  capacity_controller_.adjusted_size_classes.store(max_capacity_index,
+                                                   std::memory_order_relaxed);
+  capacity_controller_.moved_bytes.store(moved_bytes,
+                                         std::memory_order_relaxed);
+  capacity_controller_.total_moved_bytes.fetch_add(moved_bytes,
+                                                   std::memory_order_relaxed);
+  if (max_capacity_index == 0) {
+    capacity_controller_.stable_intervals.fetch_add(1,
+                                                    std::memory_order_relaxed);
+  } else {
+    capacity_controller_.stable_intervals.store(0, std::memory_order_relaxed);
+  }
+  return max_capacity_index;
+}
+
 template <class Forwarder>
 void CpuCache<Forwarder>::MadviseAwaySlabs(void* slab_addr, size_t slab_size) {
   // It is important that we do not MADV_REMOVE the memory, since file-backed
@@ -1555,6 +2726,40 @@ void CpuCache<Forwarder>::MadviseAwaySlabs(void* slab_addr, size_t slab_size) {
   }
 }
 
+template <class Forwarder>
+template <typename F>
+void CpuCache<Forwarder>::ForEachSlabHugepage(int cpu, F f) const {
+  if (resize_ == nullptr) return;
+  const int num_cpus = NumCPUs();
+  const uintptr_t slabs = reinterpret_cast<uintptr_t>(freelist_.GetSlabs());
+  const size_t slab_size = size_t{1} << freelist_.GetShift();
+  // Hugepages shared with other metadata at either end are left alone.
+  uintptr_t begin = (slabs + kHugePageSize - 1) & ~(kHugePageSize - 1);
+  uintptr_t end = (slabs + num_cpus * slab_size) & ~(kHugePageSize - 1);
+  if (cpu >= 0) {
+    begin = std::max(begin, (slabs + cpu * slab_size) & ~(kHugePageSize - 1));
+    end = std::min(end, slabs + (cpu + 1) * slab_size);
+  }
+  for (uintptr_t hp = begin; hp < end; hp += kHugePageSize) {
+    const int first_cpu = (hp - slabs) / slab_size;
+    const int last_cpu = std::min<int>(
+        num_cpus, (hp + kHugePageSize - slabs + slab_size - 1) / slab_size);
+    int populated = 0;
+    for (int c = first_cpu; c < last_cpu; ++c) {
+      populated += HasPopulated(c);
+    }
+    f(reinterpret_cast<void*>(hp), 2 * populated >= last_cpu - first_cpu);
+  }
+}
+
+template <class Forwarder>
+void CpuCache<Forwarder>::AdviseSlabHugepages(int cpu) {
+  ErrnoRestorer errno_restorer;
+  ForEachSlabHugepage(cpu, [](void* hp, bool huge) {
+    madvise(hp, kHugePageSize, huge ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+  });
+}
+
 template <class Forwarder>
 void CpuCache<Forwarder>::ResizeSizeClassMaxCapacities()
     ABSL_NO_THREAD_SAFETY_ANALYSIS {
@@ -1610,6 +2815,7 @@ void CpuCache<Forwarder>::ResizeSizeClassMaxCapacities()
   }
   for (int cpu = 0; cpu < num_cpus; ++cpu) resize_[cpu].lock.unlock();
 
+  AdviseSlabHugepages(/*cpu=*/-1);
   MadviseAwaySlabs(info.old_slabs, info.old_slabs_size);
   const int64_t old_slabs_size = info.old_slabs_size;
   forwarder_.ArenaUpdateAllocatedAndNonresident(-old_slabs_size,
@@ -1670,6 +2876,8 @@ void CpuCache<Forwarder>::ResizeCpuSizeClasses(int cpu) {
         .misses = resize_[cpu].per_class[size_class].GetIntervalMisses(
             PerClassMissType::kCapacityTotal,
             PerClassMissType::kCapacityResize)};
+    // Size classes using the cold budget do not grow from available.
+    if (UsesColdBudget(size_class)) miss_stats[size_class - 1].misses = 0;
   }
 
   // Sort the collected stats to record size classes with largest number of
@@ -1745,6 +2953,12 @@ void CpuCache<Forwarder>::ResizeCpuSizeClasses(int cpu) {
 
 template <class Forwarder>
 inline void CpuCache<Forwarder>::ShuffleCpuCaches() {
+  if (forwarder_.per_cpu_caches_ranked_shuffle()) {
+    PlanRankedShuffle();
+    ContinueShuffleCpuCaches();
+    return;
+  }
+
   // Knobs that we can potentially tune depending on the workloads.
   constexpr double kBytesToStealPercent = 5.0;
   constexpr int kMaxNumStealCpus = 5;
@@ -1783,10 +2997,18 @@ inline void CpuCache<Forwarder>::ShuffleCpuCaches() {
   // entire misses array. This might be compute intensive on servers with high
   // number of cpus (eg. Rome, Milan). We need to investigate the compute
   // required to implement this.
+  //
+  // Protected cpus that missed come first, so that they get capacity before
+  // any other cpu.
   const int num_dest_cpus = std::min(num_populated_cpus, kMaxNumStealCpus);
   std::partial_sort(misses.begin(), misses.begin() + num_dest_cpus,
                     misses.begin() + num_populated_cpus,
-                    [](CpuMissStat a, CpuMissStat b) {
+                    [this](CpuMissStat a, CpuMissStat b) {
+                      const bool a_first = a.misses != 0 && IsProtected(a.cpu);
+                      const bool b_first = b.misses != 0 && IsProtected(b.cpu);
+                      if (a_first != b_first) {
+                        return a_first;
+                      }
                       if (a.misses == b.misses) {
                         return a.cpu < b.cpu;
                       }
@@ -1815,8 +3037,6 @@ template <class Forwarder>
 inline void CpuCache<Forwarder>::StealFromOtherCache(
     int cpu, int max_populated_cpu, absl::Span<CpuMissStat> skip_cpus,
     size_t bytes) {
-  constexpr double kCacheMissThreshold = 0.80;
-
   const CpuCacheMissStats dest_misses =
       GetIntervalCacheMissStats(cpu, MissCount::kShuffle);
 
@@ -1827,96 +3047,273 @@ inline void CpuCache<Forwarder>::StealFromOtherCache(
   }
 
   size_t acquired = 0;
+  const unsigned dest_l3 = forwarder_.GetL3FromCpuId(cpu);
+
+  // With L3-aware stealing, the first pass only steals from cpus in the same
+  // L3 domain as the destination, so that the capacity (and the objects that
+  // later fill it) stays close to the cores that share it.  We only cross
+  // domains in a second pass if the first one came up short.
+  const bool l3_aware = forwarder_.per_cpu_caches_l3_aware_stealing();
+  const int num_passes = l3_aware ? 2 : 1;
 
   // We use next_cpu_cache_steal_ as a hint to start our search for cpu ids to
   // steal from so that we can iterate through the cpus in a nice round-robin
   // fashion.
   int src_cpu = next_cpu_cache_steal_;
 
-  // We iterate through max_populate_cpus number of cpus to steal from.
-  // max_populate_cpus records the max cpu id that has been populated. Note
-  // that, any intermediate changes since the max_populated_cpus was measured
-  // may have populated higher cpu ids, but we do not include those in the
-  // search. The approximation prevents us from doing another pass through the
-  // cpus to just find the latest populated cpu id.
-  //
-  // We break from the loop once we iterate through all the cpus once, or if the
-  // total number of acquired bytes is higher than or equal to the desired bytes
-  // we want to steal.
-  for (int i = 0; i <= max_populated_cpu && acquired < bytes; ++i, ++src_cpu) {
-    if (src_cpu > max_populated_cpu) {
-      src_cpu = 0;
-    }
-    TC_ASSERT_LE(0, src_cpu);
-    TC_ASSERT_LE(src_cpu, max_populated_cpu);
-
-    // We do not steal from the CPUs we want to grow. Maybe we can explore
-    // combining this with stealing from the same CPU later.
-    bool skip = false;
-    for (auto dest : skip_cpus) {
-      if (src_cpu == dest.cpu) {
-        skip = true;
-        break;
+  for (int pass = 0; pass < num_passes && acquired < bytes; ++pass) {
+    src_cpu = next_cpu_cache_steal_;
+
+    // We iterate through max_populate_cpus number of cpus to steal from.
+    // max_populate_cpus records the max cpu id that has been populated. Note
+    // that, any intermediate changes since the max_populated_cpus was measured
+    // may have populated higher cpu ids, but we do not include those in the
+    // search. The approximation prevents us from doing another pass through
+    // the cpus to just find the latest populated cpu id.
+    //
+    // We break from the loop once we iterate through all the cpus once, or if
+    // the total number of acquired bytes is higher than or equal to the
+    // desired bytes we want to steal.
+    for (int i = 0; i <= max_populated_cpu && acquired < bytes;
+         ++i, ++src_cpu) {
+      if (src_cpu > max_populated_cpu) {
+        src_cpu = 0;
       }
+      TC_ASSERT_LE(0, src_cpu);
+      TC_ASSERT_LE(src_cpu, max_populated_cpu);
+
+      const bool same_l3 = forwarder_.GetL3FromCpuId(src_cpu) == dest_l3;
+      if (l3_aware && same_l3 != (pass == 0)) continue;
+
+      // We do not steal from the CPUs we want to grow. Maybe we can explore
+      // combining this with stealing from the same CPU later.
+      bool skip = false;
+      for (auto dest : skip_cpus) {
+        if (src_cpu == dest.cpu) {
+          skip = true;
+          break;
+        }
+      }
+      if (skip) continue;
+
+      // We do not steal from the cache that hasn't been populated yet.
+      if (!HasPopulated(src_cpu)) continue;
+
+      // We do not steal from cache that has capacity less than our lower
+      // capacity threshold.
+      if (Capacity(src_cpu) < kCacheCapacityThreshold * CacheLimit()) continue;
+
+      const CpuCacheMissStats src_misses =
+          GetIntervalCacheMissStats(src_cpu, MissCount::kShuffle);
+
+      // If underflows and overflows from the source cpu are higher, we do not
+      // steal from that cache. We consider the cache as a candidate to steal
+      // from only when its misses are lower than 0.8x that of the dest cache.
+      if (src_misses.underflows >
+              kCacheMissThreshold * dest_misses.underflows ||
+          src_misses.overflows > kCacheMissThreshold * dest_misses.overflows)
+        continue;
+
+      const size_t stolen = StealFromCpu(src_cpu, bytes - acquired);
+      acquired += stolen;
+      (same_l3 ? stolen_same_l3_bytes_ : stolen_cross_l3_bytes_)
+          .fetch_add(stolen, std::memory_order_relaxed);
     }
-    if (skip) continue;
+  }
+  // Record the last cpu id we stole from, which would provide a hint to the
+  // next time we iterate through the cpus for stealing.
+  next_cpu_cache_steal_ = src_cpu;
+
+  // Increment the capacity of the destination cpu cache by the amount of bytes
+  // acquired from source caches.
+  if (acquired) {
+    resize_[cpu].available.fetch_add(acquired, std::memory_order_relaxed);
+    resize_[cpu].capacity.fetch_add(acquired, std::memory_order_relaxed);
+  }
+}
 
-    // We do not steal from the cache that hasn't been populated yet.
-    if (!HasPopulated(src_cpu)) continue;
+template <class Forwarder>
+inline void CpuCache<Forwarder>::PlanRankedShuffle() {
+  // Destinations that would get less than this fraction of the cache limit
+  // are left alone, so that noise in the misses does not move capacity.
+  constexpr double kMinGrow = 0.01;
+
+  const int num_cpus = NumCPUs();
+  size_t total_misses = 0;
+  size_t max_misses = 0;
+  int num_populated_cpus = 0;
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    ResizeInfo& resize = resize_[cpu];
+    resize.shuffle_want = 0;
+    resize.shuffle_misses = 0;
+    if (!HasPopulated(cpu)) continue;
+    const CpuCacheMissStats miss_stats =
+        GetIntervalCacheMissStats(cpu, MissCount::kShuffle);
+    resize.shuffle_misses = miss_stats.underflows + miss_stats.overflows;
+    total_misses += resize.shuffle_misses;
+    max_misses = std::max(max_misses, resize.shuffle_misses);
+    ++num_populated_cpus;
+  }
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    UpdateIntervalCacheMissStats(cpu, MissCount::kShuffle);
+  }
+
+  size_t pending = 0;
+  const double mean =
+      num_populated_cpus > 0
+          ? static_cast<double>(total_misses) / num_populated_cpus
+          : 0;
+  const double max_excess = max_misses - mean;
+  if (num_populated_cpus > 1 && max_excess > 0) {
+    const double limit = CacheLimit();
+    for (int cpu = 0; cpu < num_cpus; ++cpu) {
+      ResizeInfo& resize = resize_[cpu];
+      if (resize.shuffle_misses <= mean) continue;
+      const double want = kRankedShuffleMaxGrow * limit *
+                          (resize.shuffle_misses - mean) / max_excess;
+      if (want < kMinGrow * limit) continue;
+      resize.shuffle_want = static_cast<size_t>(want);
+      pending += resize.shuffle_want;
+    }
+  }
+  ranked_shuffle_plans_.fetch_add(1, std::memory_order_relaxed);
+  ranked_shuffle_pending_bytes_.store(pending, std::memory_order_relaxed);
+}
+
+template <class Forwarder>
+inline void CpuCache<Forwarder>::ContinueShuffleCpuCaches() {
+  if (ranked_shuffle_pending_bytes_.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+
+  const int num_cpus = NumCPUs();
+  absl::FixedArray<CpuMissStat> dests(num_cpus);
+  absl::FixedArray<CpuMissStat> sources(num_cpus);
+  size_t num_dests = 0;
+  size_t num_sources = 0;
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    if (!HasPopulated(cpu)) continue;
+    const ResizeInfo& resize = resize_[cpu];
+    if (resize.shuffle_want != 0) {
+      dests[num_dests++] = {cpu, resize.shuffle_misses};
+    } else {
+      sources[num_sources++] = {cpu, resize.shuffle_misses};
+    }
+  }
+  // Protected destinations are served first.
+  std::sort(dests.begin(), dests.begin() + num_dests,
+            [this](CpuMissStat a, CpuMissStat b) {
+              if (IsProtected(a.cpu) != IsProtected(b.cpu)) {
+                return IsProtected(a.cpu);
+              }
+              if (a.misses == b.misses) return a.cpu < b.cpu;
+              return a.misses > b.misses;
+            });
+  std::sort(sources.begin(), sources.begin() + num_sources,
+            [](CpuMissStat a, CpuMissStat b) {
+              if (a.misses == b.misses) return a.cpu < b.cpu;
+              return a.misses < b.misses;
+            });
+
+  const size_t limit = CacheLimit();
+  size_t budget = static_cast<size_t>(kRankedShuffleBytesPerTick * limit);
+  size_t pending = 0;
+  for (size_t i = 0; i < num_dests; ++i) {
+    const CpuMissStat dest = dests[i];
+    ResizeInfo& resize = resize_[dest.cpu];
+    if (budget == 0) {
+      pending += resize.shuffle_want;
+      continue;
+    }
+    if (resize.available.load(std::memory_order_relaxed) >= kMaxSize) {
+      // We still have enough available capacity, so all size classes can just
+      // grow as they see fit.
+      resize.shuffle_want = 0;
+      continue;
+    }
+
+    const size_t want = std::min(resize.shuffle_want, budget);
+    size_t acquired = 0;
+    for (int distance = 0; distance <= 2 && acquired < want; ++distance) {
+      for (size_t j = 0; j < num_sources && acquired < want; ++j) {
+        const CpuMissStat src = sources[j];
+        // Sources are sorted by misses, so none of the rest qualifies either.
+        if (src.misses > kCacheMissThreshold * dest.misses) break;
+        if (TopologyDistance(dest.cpu, src.cpu) != distance) continue;
+        if (Capacity(src.cpu) < kCacheCapacityThreshold * limit) continue;
+
+        const size_t stolen = StealFromCpu(src.cpu, want - acquired);
+        acquired += stolen;
+        (distance == 0 ? stolen_same_l3_bytes_ : stolen_cross_l3_bytes_)
+            .fetch_add(stolen, std::memory_order_relaxed);
+      }
+    }
+    if (acquired != 0) {
+      resize.available.fetch_add(acquired, std::memory_order_relaxed);
+      resize.capacity.fetch_add(acquired, std::memory_order_relaxed);
+    }
+    budget -= std::min(budget, acquired);
+    // If the sources ran dry, give up on the rest until the next plan.
+    resize.shuffle_want = acquired < want ? 0 : resize.shuffle_want - acquired;
+    pending += resize.shuffle_want;
+  }
+  ranked_shuffle_pending_bytes_.store(pending, std::memory_order_relaxed);
+}
 
-    // We do not steal from cache that has capacity less than our lower
-    // capacity threshold.
-    if (Capacity(src_cpu) < kCacheCapacityThreshold * CacheLimit()) continue;
+template <class Forwarder>
+inline int CpuCache<Forwarder>::TopologyDistance(int a, int b) const {
+  if (forwarder_.GetL3FromCpuId(a) == forwarder_.GetL3FromCpuId(b)) {
+    return 0;
+  }
+  const auto& numa = forwarder_.numa_topology();
+  if (!numa.numa_aware() ||
+      numa.GetCpuPartition(a) == numa.GetCpuPartition(b)) {
+    return 1;
+  }
+  return 2;
+}
 
-    const CpuCacheMissStats src_misses =
-        GetIntervalCacheMissStats(src_cpu, MissCount::kShuffle);
+template <class Forwarder>
+inline size_t CpuCache<Forwarder>::StealFromCpu(int src_cpu, size_t bytes) {
+  if (IsProtected(src_cpu)) {
+    // Only the capacity a protected cpu holds above the cache limit may go.
+    const uint64_t capacity = Capacity(src_cpu);
+    const uint64_t floor = CacheLimit();
+    if (capacity <= floor) {
+      return 0;
+    }
+    bytes = std::min<uint64_t>(bytes, capacity - floor);
+  }
 
-    // If underflows and overflows from the source cpu are higher, we do not
-    // steal from that cache. We consider the cache as a candidate to steal from
-    // only when its misses are lower than 0.8x that of the dest cache.
-    if (src_misses.underflows > kCacheMissThreshold * dest_misses.underflows ||
-        src_misses.overflows > kCacheMissThreshold * dest_misses.overflows)
-      continue;
+  // Try to steal available capacity from the target cpu, if any.
+  // This is cheaper than remote slab operations.
+  size_t acquired = subtract_at_least(&resize_[src_cpu].available, 0, bytes);
+  if (acquired != 0) {
+    resize_[src_cpu].capacity.fetch_sub(acquired, std::memory_order_relaxed);
+    if (acquired >= bytes) {
+      return acquired;
+    }
+  }
 
-    // Try to steal available capacity from the target cpu, if any.
-    // This is cheaper than remote slab operations.
-    size_t stolen =
-        subtract_at_least(&resize_[src_cpu].available, 0, bytes - acquired);
-    if (stolen != 0) {
+  AllocationGuardSpinLockHolder h(resize_[src_cpu].lock);
+  subtle::percpu::ScopedSlabCpuStop<kNumClasses> cpu_stop(freelist_, src_cpu);
+  size_t source_size_class = resize_[src_cpu].next_steal;
+  for (size_t i = 1; i < kNumClasses; ++i, ++source_size_class) {
+    if (source_size_class >= kNumClasses) {
+      source_size_class = 1;
+    }
+    // Capacity of cold size classes belongs to the cold budget.
+    if (UsesColdBudget(source_size_class)) continue;
+    if (size_t stolen = ShrinkOtherCache(src_cpu, source_size_class)) {
       resize_[src_cpu].capacity.fetch_sub(stolen, std::memory_order_relaxed);
       acquired += stolen;
       if (acquired >= bytes) {
-        continue;
-      }
-    }
-
-    AllocationGuardSpinLockHolder h(resize_[src_cpu].lock);
-    subtle::percpu::ScopedSlabCpuStop<kNumClasses> cpu_stop(freelist_, src_cpu);
-    size_t source_size_class = resize_[src_cpu].next_steal;
-    for (size_t i = 1; i < kNumClasses; ++i, ++source_size_class) {
-      if (source_size_class >= kNumClasses) {
-        source_size_class = 1;
-      }
-      if (size_t stolen = ShrinkOtherCache(src_cpu, source_size_class)) {
-        resize_[src_cpu].capacity.fetch_sub(stolen, std::memory_order_relaxed);
-        acquired += stolen;
-        if (acquired >= bytes) {
-          break;
-        }
+        break;
       }
     }
-    resize_[src_cpu].next_steal = source_size_class;
-  }
-  // Record the last cpu id we stole from, which would provide a hint to the
-  // next time we iterate through the cpus for stealing.
-  next_cpu_cache_steal_ = src_cpu;
-
-  // Increment the capacity of the destination cpu cache by the amount of bytes
-  // acquired from source caches.
-  if (acquired) {
-    resize_[cpu].available.fetch_add(acquired, std::memory_order_relaxed);
-    resize_[cpu].capacity.fetch_add(acquired, std::memory_order_relaxed);
   }
+  resize_[src_cpu].next_steal = source_size_class;
+  return acquired;
 }
 
 template <class Forwarder>
@@ -1992,8 +3389,8 @@ inline size_t CpuCache<Forwarder>::StealCapacityForSizeClassWithinCpu(
       source_size_class = 1;
     }
     // Decide if we want to steal source_size_class.
-    // Don't shrink classes we want to grow.
-    bool skip = false;
+    // Don't shrink classes we want to grow, or classes using the cold budget.
+    bool skip = UsesColdBudget(source_size_class);
     for (auto dest : dest_size_classes) {
       if (source_size_class == dest.size_class && dest.misses != 0) {
         skip = true;
@@ -2023,7 +3420,7 @@ void CpuCache<Forwarder>::DeallocateSlow(void* ptr, size_t size_class) {
 template <class Forwarder>
 void CpuCache<Forwarder>::DeallocateSlowNoHooks(void* ptr, size_t size_class) {
   if (BypassCpuCache(size_class)) {
-    return forwarder_.sharded_transfer_cache().Push(size_class, ptr);
+    return DeallocateIndirect(ptr, size_class);
   }
   auto [cpu, cached] = CacheCpuSlab();
   if (ABSL_PREDICT_FALSE(cached)) {
@@ -2035,7 +3432,7 @@ void CpuCache<Forwarder>::DeallocateSlowNoHooks(void* ptr, size_t size_class) {
       return;
     }
   }
-  RecordCacheMissStat(cpu, false);
+  RecordCacheMissStat(cpu, false, size_class);
   const size_t target = UpdateCapacity(cpu, size_class, true);
   size_t total = 0;
   size_t count = 1;
@@ -2053,6 +3450,204 @@ void CpuCache<Forwarder>::DeallocateSlowNoHooks(void* ptr, size_t size_class) {
     if (count != kMaxObjectsToMove) break;
     count = 0;
   } while (total < target);
+  TCMALLOC_PROBE(cpu_cache_overflow, cpu, size_class, total);
+  if (ReturnRemoteFreesHome(cpu, size_class)) {
+    ResizeInfo& resize = resize_[cpu];
+    resize.remote_free_flushes.store(
+        resize.remote_free_flushes.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    resize.remote_free_objects.store(
+        resize.remote_free_objects.load(std::memory_order_relaxed) + total,
+        std::memory_order_relaxed);
+  }
+}
+
+template <class Forwarder>
+void* CpuCache<Forwarder>::AllocateIndirect(size_t size_class) {
+  if (forwarder_.per_cpu_caches_indirect()) {
+    const int cpu = CacheCpuSlab().first;
+    if (ABSL_PREDICT_TRUE(cpu >= 0)) {
+      IndirectCache& cache = resize_[cpu].indirect;
+      AllocationGuardSpinLockHolder h(cache.lock);
+      for (int i = cache.count - 1; i >= 0; --i) {
+        if (cache.size_classes[i] != size_class) continue;
+        void* ret = cache.objects[i];
+        for (int j = i + 1; j < cache.count; ++j) {
+          cache.objects[j - 1] = cache.objects[j];
+          cache.size_classes[j - 1] = cache.size_classes[j];
+        }
+        --cache.count;
+        cache.bytes.store(cache.bytes.load(std::memory_order_relaxed) -
+                              forwarder_.class_to_size(size_class),
+                          std::memory_order_relaxed);
+        cache.hits.store(cache.hits.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+        return ret;
+      }
+      cache.misses.store(cache.misses.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+    }
+  }
+  return forwarder_.sharded_transfer_cache().Pop(size_class);
+}
+
+template <class Forwarder>
+void CpuCache<Forwarder>::DeallocateIndirect(void* ptr, size_t size_class) {
+  if (forwarder_.per_cpu_caches_indirect()) {
+    const int cpu = CacheCpuSlab().first;
+    if (ABSL_PREDICT_TRUE(cpu >= 0)) {
+      IndirectCache& cache = resize_[cpu].indirect;
+      void* evicted = nullptr;
+      size_t evicted_class = 0;
+      {
+        AllocationGuardSpinLockHolder h(cache.lock);
+        size_t bytes = cache.bytes.load(std::memory_order_relaxed);
+        if (cache.count == kIndirectCacheObjects) {
+          evicted = cache.objects[0];
+          evicted_class = cache.size_classes[0];
+          for (int j = 1; j < cache.count; ++j) {
+            cache.objects[j - 1] = cache.objects[j];
+            cache.size_classes[j - 1] = cache.size_classes[j];
+          }
+          --cache.count;
+          bytes -= forwarder_.class_to_size(evicted_class);
+          cache.evictions.store(
+              cache.evictions.load(std::memory_order_relaxed) + 1,
+              std::memory_order_relaxed);
+        }
+        cache.objects[cache.count] = ptr;
+        cache.size_classes[cache.count] = size_class;
+        ++cache.count;
+        cache.bytes.store(bytes + forwarder_.class_to_size(size_class),
+                          std::memory_order_relaxed);
+      }
+      // The sharded transfer cache takes its own lock.
+      if (evicted != nullptr) {
+        forwarder_.sharded_transfer_cache().Push(evicted_class, evicted);
+      }
+      return;
+    }
+  }
+  forwarder_.sharded_transfer_cache().Push(size_class, ptr);
+}
+
+template <class Forwarder>
+uint64_t CpuCache<Forwarder>::ReclaimIndirect(int cpu) {
+  IndirectCache& cache = resize_[cpu].indirect;
+  void* objects[kIndirectCacheObjects];
+  uint16_t size_classes[kIndirectCacheObjects];
+  int count;
+  uint64_t bytes;
+  {
+    AllocationGuardSpinLockHolder h(cache.lock);
+    count = cache.count;
+    std::copy_n(cache.objects, count, objects);
+    std::copy_n(cache.size_classes, count, size_classes);
+    cache.count = 0;
+    bytes = cache.bytes.load(std::memory_order_relaxed);
+    cache.bytes.store(0, std::memory_order_relaxed);
+  }
+  for (int i = 0; i < count; ++i) {
+    forwarder_.sharded_transfer_cache().Push(size_classes[i], objects[i]);
+  }
+  return bytes;
+}
+
+template <class Forwarder>
+inline typename CpuCache<Forwarder>::IndirectCacheStats
+CpuCache<Forwarder>::GetIndirectCacheStats() const {
+  IndirectCacheStats stats = {0, 0, 0};
+  for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+    const IndirectCache& cache = resize_[cpu].indirect;
+    stats.hits += cache.hits.load(std::memory_order_relaxed);
+    stats.misses += cache.misses.load(std::memory_order_relaxed);
+    stats.evictions += cache.evictions.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+template <class Forwarder>
+inline size_t CpuCache<Forwarder>::AllocateBatch(size_t size_class,
+                                                 void** batch, size_t n) {
+  TC_ASSERT_GT(size_class, 0);
+  TC_ASSERT_GT(n, 0);
+  if (BypassCpuCache(size_class)) {
+    size_t got = 0;
+    for (; got < n; ++got) {
+      void* ptr = forwarder_.sharded_transfer_cache().Pop(size_class);
+      if (ptr == nullptr) break;
+      batch[got] = ptr;
+    }
+    return got;
+  }
+
+  size_t got = freelist_.PopBatch(size_class, batch, n);
+  if (ABSL_PREDICT_TRUE(got == n)) {
+    return got;
+  }
+
+  auto [cpu, cached] = CacheCpuSlab();
+  if (ABSL_PREDICT_TRUE(cpu >= 0)) {
+    if (ABSL_PREDICT_FALSE(cached)) {
+      got += freelist_.PopBatch(size_class, batch + got, n - got);
+    }
+    if (got < n) {
+      // Treat the shortfall as a single underflow, so that the capacity of
+      // this size class adapts as it would for a run of Allocate calls.
+      RecordCacheMissStat(cpu, true, size_class);
+      (void)UpdateCapacity(cpu, size_class, false);
+    }
+  }
+
+  // Fetch the remainder directly, rather than routing it through the slab.
+  while (got < n) {
+    const size_t want = std::min(kMaxObjectsToMove, n - got);
+    const int fetched =
+        FetchFromBackingCache(size_class, absl::MakeSpan(batch + got, want));
+    if (fetched == 0) break;
+    got += fetched;
+  }
+  return got;
+}
+
+template <class Forwarder>
+inline void CpuCache<Forwarder>::DeallocateBatch(size_t size_class,
+                                                 void** batch, size_t n) {
+  TC_ASSERT_GT(size_class, 0);
+  TC_ASSERT_GT(n, 0);
+  if (BypassCpuCache(size_class)) {
+    // Hand the objects to the sharded transfer cache a batch at a time, rather
+    // than taking its lock once per object as Push would.
+    for (size_t i = 0; i < n; i += kMaxObjectsToMove) {
+      const size_t count = std::min(kMaxObjectsToMove, n - i);
+      forwarder_.sharded_transfer_cache().InsertRange(
+          size_class, absl::Span<void*>(batch + i, count));
+    }
+    return;
+  }
+
+  // PushBatch leaves any items it could not add at the start of <batch>.
+  size_t remaining = n - freelist_.PushBatch(size_class, batch, n);
+  if (ABSL_PREDICT_TRUE(remaining == 0)) {
+    return;
+  }
+
+  auto [cpu, cached] = CacheCpuSlab();
+  if (ABSL_PREDICT_TRUE(cpu >= 0)) {
+    if (ABSL_PREDICT_FALSE(cached)) {
+      remaining -= freelist_.PushBatch(size_class, batch, remaining);
+    }
+    if (remaining != 0) {
+      RecordCacheMissStat(cpu, false, size_class);
+      (void)UpdateCapacity(cpu, size_class, true);
+      remaining -= freelist_.PushBatch(size_class, batch, remaining);
+    }
+  }
+
+  for (size_t i = 0; i < remaining; i += kMaxObjectsToMove) {
+    const size_t count = std::min(kMaxObjectsToMove, remaining - i);
+    ReleaseToBackingCache(size_class, absl::Span<void*>(batch + i, count));
+  }
 }
 
 template <class Forwarder>
@@ -2082,6 +3677,7 @@ inline uint64_t CpuCache<Forwarder>::UsedBytes(int target_cpu) const {
     int size = forwarder_.class_to_size(size_class);
     total += size * freelist_.Length(target_cpu, size_class);
   }
+  total += resize_[target_cpu].indirect.bytes.load(std::memory_order_relaxed);
   return total;
 }
 
@@ -2123,7 +3719,8 @@ inline uint64_t CpuCache<Forwarder>::TotalObjectsOfClass(
 
 template <class Forwarder>
 inline uint64_t CpuCache<Forwarder>::Unallocated(int cpu) const {
-  return resize_[cpu].available.load(std::memory_order_relaxed);
+  return resize_[cpu].available.load(std::memory_order_relaxed) +
+         resize_[cpu].cold_available.load(std::memory_order_relaxed);
 }
 
 template <class Forwarder>
@@ -2142,6 +3739,67 @@ inline void CpuCache<Forwarder>::SetCacheLimit(uint64_t v) {
   max_per_cpu_cache_size_.store(v, std::memory_order_relaxed);
 }
 
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::ColdCacheLimit() const {
+  return max_per_cpu_cold_cache_size_.load(std::memory_order_relaxed);
+}
+
+template <class Forwarder>
+inline void CpuCache<Forwarder>::SetColdCacheLimit(uint64_t v) {
+  const uint64_t old =
+      max_per_cpu_cold_cache_size_.exchange(v, std::memory_order_relaxed);
+  if (!separate_cold_budget_ || v == old) return;
+
+  for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+    if (v > old) {
+      resize_[cpu].cold_available.fetch_add(v - old,
+                                            std::memory_order_relaxed);
+      resize_[cpu].capacity.fetch_add(v - old, std::memory_order_relaxed);
+    } else {
+      size_t got = subtract_at_least(&resize_[cpu].cold_available, 0, old - v);
+      if (got < old - v) {
+        got += ShrinkColdCaches(cpu, old - v - got);
+      }
+      resize_[cpu].capacity.fetch_sub(got, std::memory_order_relaxed);
+    }
+  }
+}
+
+template <class Forwarder>
+inline size_t CpuCache<Forwarder>::ShrinkColdCaches(int cpu, size_t bytes) {
+  AllocationGuardSpinLockHolder h(resize_[cpu].lock);
+  if (!HasPopulated(cpu)) return 0;
+
+  subtle::percpu::ScopedSlabCpuStop<kNumClasses> cpu_stop(freelist_, cpu);
+  size_t acquired = 0;
+  for (size_t size_class = 1; size_class < kNumClasses && acquired < bytes;
+       ++size_class) {
+    if (!UsesColdBudget(size_class)) continue;
+    const size_t capacity = freelist_.Capacity(cpu, size_class);
+    if (capacity == 0) continue;
+    const size_t size = forwarder_.class_to_size(size_class);
+    const size_t batch_length = forwarder_.num_objects_to_move(size_class);
+    const size_t want = std::min(capacity, (bytes - acquired + size - 1) / size);
+    const size_t shrunk = freelist_.ShrinkOtherCache(
+        cpu, size_class, want,
+        [&](size_t size_class, void** batch, size_t count) {
+          for (size_t i = 0; i < count; i += batch_length) {
+            const size_t n = std::min(batch_length, count - i);
+            ReleaseToBackingCache(size_class, absl::Span<void*>(batch + i, n));
+          }
+        });
+    acquired += shrunk * size;
+  }
+  // Rounding up to whole objects may free more than asked for; the excess
+  // stays in the (smaller) cold budget.
+  if (acquired > bytes) {
+    resize_[cpu].cold_available.fetch_add(acquired - bytes,
+                                          std::memory_order_relaxed);
+    acquired = bytes;
+  }
+  return acquired;
+}
+
 template <class CpuCache>
 struct DrainHandler {
   void operator()(int cpu, size_t size_class, void** batch, size_t count,
@@ -2152,8 +3810,8 @@ struct DrainHandler {
     if (bytes != nullptr) *bytes += count * size;
     // Drain resets capacity to 0, so return the allocated capacity to that
     // CPU's slack.
-    cache.resize_[cpu].available.fetch_add(cap * size,
-                                           std::memory_order_relaxed);
+    cache.Available(cpu, size_class)
+        .fetch_add(cap * size, std::memory_order_relaxed);
     for (size_t i = 0; i < count; i += batch_length) {
       size_t n = std::min(batch_length, count - i);
       cache.ReleaseToBackingCache(size_class, absl::Span<void*>(batch + i, n));
@@ -2175,23 +3833,105 @@ inline uint64_t CpuCache<Forwarder>::Reclaim(int cpu) {
     return 0;
   }
 
-  uint64_t bytes = 0;
+  uint64_t bytes = ReclaimIndirect(cpu);
   freelist_.Drain(cpu, DrainHandler<CpuCache>{*this, &bytes});
+  // A full drain supersedes any pending incremental one.
+  resize_[cpu].drain_pending.store(false, std::memory_order_relaxed);
+  resize_[cpu].drain_after_park.store(false, std::memory_order_relaxed);
+  RecordReclaim(cpu);
+
+  return bytes;
+}
 
+template <class Forwarder>
+inline void CpuCache<Forwarder>::RecordReclaim(int cpu) {
+  TC_ASSERT(resize_[cpu].lock.IsHeld());
   // Record that the reclaim occurred for this CPU.
   resize_[cpu].num_reclaims.store(
       resize_[cpu].num_reclaims.load(std::memory_order_relaxed) + 1,
       std::memory_order_relaxed);
   resize_[cpu].last_reclaim.store(absl::base_internal::CycleClock::Now(),
                                   std::memory_order_relaxed);
-
-  return bytes;
 }
 template <class Forwarder>
 inline uint64_t CpuCache<Forwarder>::GetNumResizes(int cpu) const {
   return resize_[cpu].num_size_class_resizes.load(std::memory_order_relaxed);
 }
 
+template <class Forwarder>
+inline void CpuCache<Forwarder>::HandleCpusetChange() {
+  const CpuSet allowed_cpus = FillActiveCpuMask();
+  // FillActiveCpuMask() returns an empty set if sched_getaffinity failed.
+  if (allowed_cpus.Count() == 0) return;
+
+  const int num_cpus = NumCPUs();
+  bool changed = false;
+  absl::FixedArray<int> added_cpus(num_cpus);
+  int num_added = 0;
+  size_t parked = cpuset_parked_bytes_.load(std::memory_order_relaxed);
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    const bool allowed = allowed_cpus.IsSet(cpu);
+    if (allowed == resize_[cpu].allowed) continue;
+    changed = true;
+    resize_[cpu].allowed = allowed;
+    if (allowed) {
+      added_cpus[num_added++] = cpu;
+      continue;
+    }
+    if (!HasPopulated(cpu)) continue;
+    // Draining returns the capacity of the size classes to available.
+    Reclaim(cpu);
+    parked += StealFromCpu(
+        cpu, resize_[cpu].available.load(std::memory_order_relaxed));
+    cpuset_drained_cpus_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (!changed) return;
+  cpuset_changes_.fetch_add(1, std::memory_order_relaxed);
+
+  const size_t share = num_added > 0 ? parked / num_added : 0;
+  if (share > 0) {
+    for (int i = 0; i < num_added; ++i) {
+      const int cpu = added_cpus[i];
+      resize_[cpu].available.fetch_add(share, std::memory_order_relaxed);
+      resize_[cpu].capacity.fetch_add(share, std::memory_order_relaxed);
+    }
+    parked -= share * num_added;
+    cpuset_moved_bytes_.fetch_add(share * num_added,
+                                  std::memory_order_relaxed);
+  }
+  cpuset_parked_bytes_.store(parked, std::memory_order_relaxed);
+}
+
+template <class Forwarder>
+inline typename CpuCache<Forwarder>::CpusetChangeStats
+CpuCache<Forwarder>::GetCpusetChangeStats() const {
+  return {cpuset_changes_.load(std::memory_order_relaxed),
+          cpuset_drained_cpus_.load(std::memory_order_relaxed),
+          cpuset_moved_bytes_.load(std::memory_order_relaxed),
+          cpuset_parked_bytes_.load(std::memory_order_relaxed)};
+}
+
+template <class Forwarder>
+inline typename CpuCache<Forwarder>::CpuCacheStealStats
+CpuCache<Forwarder>::GetStealStats() const {
+  return {stolen_same_l3_bytes_.load(std::memory_order_relaxed),
+          stolen_cross_l3_bytes_.load(std::memory_order_relaxed),
+          ranked_shuffle_plans_.load(std::memory_order_relaxed),
+          ranked_shuffle_pending_bytes_.load(std::memory_order_relaxed)};
+}
+
+template <class Forwarder>
+inline typename CpuCache<Forwarder>::CapacityControllerStats
+CpuCache<Forwarder>::GetCapacityControllerStats() const {
+  return {
+      capacity_controller_.intervals.load(std::memory_order_relaxed),
+      capacity_controller_.adjusted_size_classes.load(
+          std::memory_order_relaxed),
+      capacity_controller_.moved_bytes.load(std::memory_order_relaxed),
+      capacity_controller_.total_moved_bytes.load(std::memory_order_relaxed),
+      capacity_controller_.stable_intervals.load(std::memory_order_relaxed)};
+}
+
 template <class Forwarder>
 inline uint64_t CpuCache<Forwarder>::GetNumResizes() const {
   uint64_t resizes = 0;
@@ -2262,13 +4002,9 @@ inline std::pair<void*, size_t> CpuCache<Forwarder>::AllocOrReuseSlabs(
   void*& reused_slabs = slabs_by_shift_[slab_offset];
   const size_t size = GetSlabsAllocSize(shift, num_cpus);
   const bool can_reuse = reused_slabs != nullptr;
-  if (can_reuse) {
-    // Enable huge pages for reused slabs.
-    // TODO(b/214241843): we should be able to remove this once the kernel
-    // enables huge zero pages.
-    ErrnoRestorer errno_restorer;
-    madvise(reused_slabs, size, MADV_HUGEPAGE);
-  } else {
+  // Huge pages are enabled again, on the reused slabs of populated CPUs, by
+  // AdviseSlabHugepages.
+  if (!can_reuse) {
     reused_slabs = alloc(size, subtle::percpu::kPhysicalPageAlign);
     // MSan does not see writes in assembly.
     ANNOTATE_MEMORY_IS_INITIALIZED(reused_slabs, size);
@@ -2323,27 +4059,101 @@ CpuCache<Forwarder>::ShouldResizeSlab() {
   return DynamicSlabResize::kNoop;
 }
 
+template <class Forwarder>
+inline uint8_t CpuCache<Forwarder>::WorkingSetShift(int cpu,
+                                                    uint8_t current) const {
+  const bool overflowed =
+      GetIntervalCacheMissStats(cpu, MissCount::kSlabResize).overflows != 0;
+  uint8_t shift = shift_bounds_.initial_shift;
+  for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
+    const size_t length = freelist_.Length(cpu, size_class);
+    if (length == 0) continue;
+    if (length >= GetMaxCapacity(size_class, current)) {
+      // The size class is full: its working set only fits a larger slab if it
+      // overflowed.
+      shift = std::max<uint8_t>(
+          shift, overflowed ? std::min<uint8_t>(current + 1,
+                                                shift_bounds_.max_shift)
+                            : current);
+      continue;
+    }
+    const size_t wanted = std::ceil(length * (1 + kSlabWorkingSetHeadroom));
+    while (shift < shift_bounds_.max_shift &&
+           GetMaxCapacity(size_class, shift) < wanted) {
+      ++shift;
+    }
+  }
+  return shift;
+}
+
+template <class Forwarder>
+inline void CpuCache<Forwarder>::SampleSlabWorkingSet() {
+  const uint8_t current = freelist_.GetShift();
+  for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+    if (!HasPopulated(cpu)) continue;
+    ResizeInfo& resize = resize_[cpu];
+    resize.working_set_shift =
+        std::max(resize.working_set_shift, WorkingSetShift(cpu, current));
+  }
+}
+
+template <class Forwarder>
+inline uint8_t CpuCache<Forwarder>::WorkingSetSlabShift() {
+  const uint8_t current = freelist_.GetShift();
+  uint8_t target = 0;
+  for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+    ResizeInfo& resize = resize_[cpu];
+    target = std::max(target, resize.working_set_shift);
+    resize.working_set_shift = 0;
+    UpdateIntervalCacheMissStats(cpu, MissCount::kSlabResize);
+  }
+  dynamic_slab_info_.working_set_shift.store(target,
+                                             std::memory_order_relaxed);
+  // Nothing was sampled.
+  if (target == 0) return current;
+
+  if (target >= current) {
+    dynamic_slab_info_.working_set_shrink_windows = 0;
+    return target;
+  }
+  if (++dynamic_slab_info_.working_set_shrink_windows < 2) {
+    return current;
+  }
+  dynamic_slab_info_.working_set_shrink_windows = 0;
+  return target;
+}
+
 template <class Forwarder>
 void CpuCache<Forwarder>::ResizeSlabIfNeeded() ABSL_NO_THREAD_SAFETY_ANALYSIS {
   uint8_t per_cpu_shift = freelist_.GetShift();
 
   const int num_cpus = NumCPUs();
-  const DynamicSlabResize resize = ShouldResizeSlab();
-
-  if (resize == DynamicSlabResize::kGrow) {
-    if (per_cpu_shift == shift_bounds_.max_shift) return;
-    ++per_cpu_shift;
-    dynamic_slab_info_
-        .grow_count[ShiftOffset(per_cpu_shift, shift_bounds_.initial_shift)]
-        .fetch_add(1, std::memory_order_relaxed);
-  } else if (resize == DynamicSlabResize::kShrink) {
-    if (per_cpu_shift == shift_bounds_.initial_shift) return;
-    --per_cpu_shift;
-    dynamic_slab_info_
-        .shrink_count[ShiftOffset(per_cpu_shift, shift_bounds_.initial_shift)]
-        .fetch_add(1, std::memory_order_relaxed);
+  if (forwarder_.per_cpu_caches_dynamic_slab_working_set()) {
+    const uint8_t target = WorkingSetSlabShift();
+    if (target == per_cpu_shift) return;
+    (target > per_cpu_shift ? dynamic_slab_info_.grow_count
+                            : dynamic_slab_info_.shrink_count)
+        [ShiftOffset(target, shift_bounds_.initial_shift)]
+            .fetch_add(1, std::memory_order_relaxed);
+    per_cpu_shift = target;
   } else {
-    return;
+    const DynamicSlabResize resize = ShouldResizeSlab();
+
+    if (resize == DynamicSlabResize::kGrow) {
+      if (per_cpu_shift == shift_bounds_.max_shift) return;
+      ++per_cpu_shift;
+      dynamic_slab_info_
+          .grow_count[ShiftOffset(per_cpu_shift, shift_bounds_.initial_shift)]
+          .fetch_add(1, std::memory_order_relaxed);
+    } else if (resize == DynamicSlabResize::kShrink) {
+      if (per_cpu_shift == shift_bounds_.initial_shift) return;
+      --per_cpu_shift;
+      dynamic_slab_info_
+          .shrink_count[ShiftOffset(per_cpu_shift, shift_bounds_.initial_shift)]
+          .fetch_add(1, std::memory_order_relaxed);
+    } else {
+      return;
+    }
   }
 
   const auto new_shift = subtle::percpu::ToShiftType(per_cpu_shift);
@@ -2377,6 +4187,7 @@ void CpuCache<Forwarder>::ResizeSlabIfNeeded() ABSL_NO_THREAD_SAFETY_ANALYSIS {
   }
   for (int cpu = 0; cpu < num_cpus; ++cpu) resize_[cpu].lock.unlock();
 
+  AdviseSlabHugepages(/*cpu=*/-1);
   MadviseAwaySlabs(info.old_slabs, info.old_slabs_size);
   const int64_t old_slabs_size = info.old_slabs_size;
   forwarder_.ArenaUpdateAllocatedAndNonresident(-old_slabs_size,
@@ -2385,11 +4196,38 @@ void CpuCache<Forwarder>::ResizeSlabIfNeeded() ABSL_NO_THREAD_SAFETY_ANALYSIS {
 
 template <class Forwarder>
 inline void CpuCache<Forwarder>::RecordCacheMissStat(const int cpu,
-                                                     const bool is_alloc) {
+                                                     const bool is_alloc,
+                                                     const size_t size_class) {
   MissCounts& misses =
       is_alloc ? resize_[cpu].underflows : resize_[cpu].overflows;
   auto& c = misses[MissCount::kTotal];
   c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  if (IsExpandedSizeClass(size_class)) {
+    auto& cold =
+        is_alloc ? resize_[cpu].cold_underflows : resize_[cpu].cold_overflows;
+    cold.store(cold.load(std::memory_order_relaxed) + 1,
+               std::memory_order_relaxed);
+  }
+}
+
+template <class Forwarder>
+inline typename CpuCache<Forwarder>::CpuCacheMissStats
+CpuCache<Forwarder>::GetTotalColdCacheMissStats(int cpu) const {
+  CpuCacheMissStats stats;
+  stats.underflows =
+      resize_[cpu].cold_underflows.load(std::memory_order_relaxed);
+  stats.overflows = resize_[cpu].cold_overflows.load(std::memory_order_relaxed);
+  return stats;
+}
+
+template <class Forwarder>
+inline typename CpuCache<Forwarder>::CpuCacheMissStats
+CpuCache<Forwarder>::GetTotalColdCacheMissStats() const {
+  CpuCacheMissStats stats;
+  for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+    stats += GetTotalColdCacheMissStats(cpu);
+  }
+  return stats;
 }
 
 template <class Forwarder>
@@ -2572,6 +4410,20 @@ inline void CpuCache<Forwarder>::Print(Printer& out) const {
         populated ? " populated" : "");
   }
 
+  if (subtle::percpu::UsingRseqVirtualCpus()) {
+    int populated = 0;
+    for (int cpu = 0; cpu < num_cpus; ++cpu) {
+      populated += HasPopulated(cpu);
+    }
+    const uint64_t unpopulated = num_cpus - populated;
+    out.printf(
+        "Per-CPU caches use rseq mm_cid virtual CPU IDs: %d of %d caches "
+        "populated, avoiding %u bytes of slabs and up to %u bytes of cache "
+        "capacity\n",
+        populated, num_cpus, unpopulated << freelist_.GetShift(),
+        unpopulated * CacheLimit());
+  }
+
   out.printf("------------------------------------------------\n");
   out.printf("Size class capacity statistics in per-cpu caches\n");
   out.printf("------------------------------------------------\n");
@@ -2621,6 +4473,115 @@ inline void CpuCache<Forwarder>::Print(Printer& out) const {
                      GetNumResizes(cpu));
   }
 
+  out.printf("------------------------------------------------\n");
+  out.printf("Per-CPU slab recaches (rseq restarts and reschedules)\n");
+  out.printf("------------------------------------------------\n");
+  out.printf("Total  :%12u recaches\n", GetSlabRecaches());
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    out.printf("cpu %3d:%12u recaches\n", cpu, GetSlabRecaches(cpu));
+  }
+
+  if (ColdFeatureActive()) {
+    const CpuCacheMissStats cold_stats = GetTotalColdCacheMissStats();
+    out.printf("------------------------------------------------\n");
+    out.printf(
+        "Per-CPU cache cold size classes (per cpu limit: %u bytes, %s)\n",
+        ColdCacheLimit(),
+        separate_cold_budget_ ? "separate budget" : "shared budget");
+    out.printf("------------------------------------------------\n");
+    out.printf("%12u underflows, %12u overflows\n", cold_stats.underflows,
+               cold_stats.overflows);
+  }
+
+  const CpuCacheStealStats steal_stats = GetStealStats();
+  out.printf("------------------------------------------------\n");
+  out.printf("Per-CPU cache capacity stealing\n");
+  out.printf("------------------------------------------------\n");
+  out.printf("%12u bytes stolen within L3 domain\n",
+             steal_stats.same_l3_bytes);
+  out.printf("%12u bytes stolen across L3 domains\n",
+             steal_stats.cross_l3_bytes);
+  out.printf("%12u ranked shuffle plans, %12u bytes pending\n",
+             steal_stats.ranked_plans, steal_stats.ranked_pending_bytes);
+
+  const ParkStats park_stats = GetParkStats();
+  out.printf("------------------------------------------------\n");
+  out.printf("Per-CPU cache parking hints\n");
+  out.printf("------------------------------------------------\n");
+  out.printf("%12u hints, %12u caches drained\n", park_stats.hints,
+             park_stats.drains);
+  out.printf("%12u protected cpus\n", GetProtectedCpus().Count());
+
+  const CpusetChangeStats cpuset_stats = GetCpusetChangeStats();
+  out.printf("------------------------------------------------\n");
+  out.printf("Per-CPU cache cpuset changes\n");
+  out.printf("------------------------------------------------\n");
+  out.printf("%12u changes, %12u caches drained\n", cpuset_stats.changes,
+             cpuset_stats.drained_cpus);
+  out.printf("%12u bytes moved to new cpus, %12u bytes kept\n",
+             cpuset_stats.moved_bytes, cpuset_stats.parked_bytes);
+
+  if (forwarder_.per_cpu_caches_incremental_drain()) {
+    const IncrementalDrainStats drain_stats = GetIncrementalDrainStats();
+    out.printf("------------------------------------------------\n");
+    out.printf("Per-CPU cache incremental draining\n");
+    out.printf("------------------------------------------------\n");
+    out.printf(
+        "%12u caches scheduled, %12u drained, %12u cancelled\n",
+        drain_stats.scheduled, drain_stats.completed, drain_stats.cancelled);
+    out.printf("%12u size classes drained, %12u bytes drained\n",
+               drain_stats.size_classes, drain_stats.bytes);
+    out.printf("%12d us spent draining, %12d us longest tick\n",
+               absl::ToInt64Microseconds(drain_stats.total_time),
+               absl::ToInt64Microseconds(drain_stats.max_tick_time));
+  }
+
+  if (forwarder_.per_cpu_caches_indirect()) {
+    const IndirectCacheStats indirect_stats = GetIndirectCacheStats();
+    out.printf("------------------------------------------------\n");
+    out.printf("Per-CPU indirect caches of size classes bypassing the slabs\n");
+    out.printf("------------------------------------------------\n");
+    out.printf("%12u hits, %12u misses, %12u evictions\n", indirect_stats.hits,
+               indirect_stats.misses, indirect_stats.evictions);
+  }
+
+  if (forwarder_.numa_topology().numa_aware()) {
+    const NumaRemoteFreeStats remote_stats = GetNumaRemoteFreeStats();
+    out.printf("------------------------------------------------\n");
+    out.printf("Per-CPU cache frees of remote NUMA objects (%s)\n",
+               forwarder_.numa_return_remote_frees() ? "returned home"
+                                                     : "cached locally");
+    out.printf("------------------------------------------------\n");
+    out.printf("%12u flushes, %12u objects returned home\n",
+               remote_stats.flushes, remote_stats.objects);
+  }
+
+  if (forwarder_.per_cpu_caches_predictive_refill()) {
+    const PredictiveRefillStats refill_stats = GetPredictiveRefillStats();
+    out.printf("------------------------------------------------\n");
+    out.printf("Per-CPU cache predictive refills\n");
+    out.printf("------------------------------------------------\n");
+    out.printf("%12u refills, %12u extra objects\n", refill_stats.refills,
+               refill_stats.extra_objects);
+  }
+
+  if (forwarder_.per_cpu_caches_capacity_controller()) {
+    const CapacityControllerStats controller_stats =
+        GetCapacityControllerStats();
+    out.printf("------------------------------------------------\n");
+    out.printf("Per-CPU cache capacity controller\n");
+    out.printf("------------------------------------------------\n");
+    out.printf("%12u intervals\n", controller_stats.intervals);
+    out.printf("%12u size classes adjusted in last interval\n",
+               controller_stats.adjusted_size_classes);
+    out.printf("%12u bytes moved in last interval\n",
+               controller_stats.moved_bytes);
+    out.printf("%12u bytes moved in total\n",
+               controller_stats.total_moved_bytes);
+    out.printf("%12u consecutive stable intervals\n",
+               controller_stats.stable_intervals);
+  }
+
   out.printf("------------------------------------------------\n");
   out.printf("Per-CPU cache slab resizing info:\n");
   out.printf("------------------------------------------------\n");
@@ -2637,6 +4598,18 @@ inline void CpuCache<Forwarder>::Print(Printer& out) const {
   out.printf(
       "%12u bytes for which MADVISE_DONTNEED failed\n",
       dynamic_slab_info_.madvise_failed_bytes.load(std::memory_order_relaxed));
+  size_t slab_hugepages = 0, huge_slab_hugepages = 0;
+  ForEachSlabHugepage(/*cpu=*/-1, [&](void*, bool huge) {
+    ++slab_hugepages;
+    huge_slab_hugepages += huge;
+  });
+  out.printf("%12u of %u slab hugepages backed by hugepages\n",
+             huge_slab_hugepages, slab_hugepages);
+  if (forwarder_.per_cpu_caches_dynamic_slab_working_set()) {
+    out.printf("Working set shift: %3d\n",
+               dynamic_slab_info_.working_set_shift.load(
+                   std::memory_order_relaxed));
+  }
 }
 
 template <class Forwarder>
@@ -2662,6 +4635,15 @@ inline void CpuCache<Forwarder>::PrintInPbtxt(PbtxtRegion& region) const {
     entry.PrintI64("overflows", miss_stats.overflows);
     entry.PrintI64("reclaims", reclaims);
     entry.PrintI64("size_class_resizes", resizes);
+    entry.PrintI64("slab_recaches", GetSlabRecaches(cpu));
+    if (ColdFeatureActive()) {
+      const CpuCacheMissStats cold_stats = GetTotalColdCacheMissStats(cpu);
+      entry.PrintI64("cold_underflows", cold_stats.underflows);
+      entry.PrintI64("cold_overflows", cold_stats.overflows);
+      entry.PrintI64(
+          "cold_unused",
+          resize_[cpu].cold_available.load(std::memory_order_relaxed));
+    }
   }
 
   // Record size class capacity statistics.
@@ -2674,6 +4656,8 @@ inline void CpuCache<Forwarder>::PrintInPbtxt(PbtxtRegion& region) const {
     entry.PrintI64("max_capacity", stats.max_capacity);
     entry.PrintI64("max_allowed_capacity",
                    GetMaxCapacity(size_class, freelist_.GetShift()));
+    entry.PrintI64("target_max_capacity",
+                   max_capacity_[size_class].load(std::memory_order_relaxed));
 
     entry.PrintI64("min_last_underflow_ns",
                    absl::ToInt64Nanoseconds(stats.min_last_underflow));
@@ -2699,10 +4683,118 @@ inline void CpuCache<Forwarder>::PrintInPbtxt(PbtxtRegion& region) const {
   region.PrintI64(
       "dynamic_slab_madvise_failed_bytes",
       dynamic_slab_info_.madvise_failed_bytes.load(std::memory_order_relaxed));
+  size_t slab_hugepages = 0, huge_slab_hugepages = 0;
+  ForEachSlabHugepage(/*cpu=*/-1, [&](void*, bool huge) {
+    ++slab_hugepages;
+    huge_slab_hugepages += huge;
+  });
+  region.PrintI64("slab_hugepages", slab_hugepages);
+  region.PrintI64("huge_slab_hugepages", huge_slab_hugepages);
+  region.PrintI64(
+      "dynamic_slab_working_set_shift",
+      dynamic_slab_info_.working_set_shift.load(std::memory_order_relaxed));
+
+  const CpuCacheStealStats steal_stats = GetStealStats();
+  region.PrintI64("stolen_same_l3_bytes", steal_stats.same_l3_bytes);
+  region.PrintI64("stolen_cross_l3_bytes", steal_stats.cross_l3_bytes);
+  region.PrintI64("ranked_shuffle_plans", steal_stats.ranked_plans);
+  region.PrintI64("ranked_shuffle_pending_bytes",
+                  steal_stats.ranked_pending_bytes);
+
+  const CpusetChangeStats cpuset_stats = GetCpusetChangeStats();
+  region.PrintI64("cpuset_changes", cpuset_stats.changes);
+  region.PrintI64("cpuset_drained_cpus", cpuset_stats.drained_cpus);
+  region.PrintI64("cpuset_moved_bytes", cpuset_stats.moved_bytes);
+  region.PrintI64("cpuset_parked_bytes", cpuset_stats.parked_bytes);
+
+  {
+    const IncrementalDrainStats drain_stats = GetIncrementalDrainStats();
+    PbtxtRegion entry = region.CreateSubRegion("incremental_drain");
+    entry.PrintBool("enabled", forwarder_.per_cpu_caches_incremental_drain());
+    entry.PrintI64("scheduled", drain_stats.scheduled);
+    entry.PrintI64("completed", drain_stats.completed);
+    entry.PrintI64("cancelled", drain_stats.cancelled);
+    entry.PrintI64("size_classes", drain_stats.size_classes);
+    entry.PrintI64("bytes", drain_stats.bytes);
+    entry.PrintI64("total_ns", absl::ToInt64Nanoseconds(drain_stats.total_time));
+    entry.PrintI64("max_tick_ns",
+                   absl::ToInt64Nanoseconds(drain_stats.max_tick_time));
+  }
+
+  const ParkStats park_stats = GetParkStats();
+  region.PrintI64("park_hints", park_stats.hints);
+  region.PrintI64("park_drains", park_stats.drains);
+  region.PrintI64("protected_cpus", GetProtectedCpus().Count());
+
+  if (forwarder_.per_cpu_caches_indirect()) {
+    const IndirectCacheStats indirect_stats = GetIndirectCacheStats();
+    PbtxtRegion entry = region.CreateSubRegion("indirect_caches");
+    entry.PrintI64("hits", indirect_stats.hits);
+    entry.PrintI64("misses", indirect_stats.misses);
+    entry.PrintI64("evictions", indirect_stats.evictions);
+  }
+
+  if (forwarder_.numa_topology().numa_aware()) {
+    const NumaRemoteFreeStats remote_stats = GetNumaRemoteFreeStats();
+    PbtxtRegion entry = region.CreateSubRegion("numa_remote_frees");
+    entry.PrintBool("return_home", forwarder_.numa_return_remote_frees());
+    entry.PrintI64("flushes", remote_stats.flushes);
+    entry.PrintI64("objects", remote_stats.objects);
+  }
+
+  if (forwarder_.per_cpu_caches_predictive_refill()) {
+    const PredictiveRefillStats refill_stats = GetPredictiveRefillStats();
+    PbtxtRegion entry = region.CreateSubRegion("predictive_refills");
+    entry.PrintI64("refills", refill_stats.refills);
+    entry.PrintI64("extra_objects", refill_stats.extra_objects);
+  }
+
+  {
+    const CapacityControllerStats controller_stats =
+        GetCapacityControllerStats();
+    PbtxtRegion entry = region.CreateSubRegion("capacity_controller");
+    entry.PrintBool("enabled", forwarder_.per_cpu_caches_capacity_controller());
+    entry.PrintI64("intervals", controller_stats.intervals);
+    entry.PrintI64("adjusted_size_classes",
+                   controller_stats.adjusted_size_classes);
+    entry.PrintI64("moved_bytes", controller_stats.moved_bytes);
+    entry.PrintI64("total_moved_bytes", controller_stats.total_moved_bytes);
+    entry.PrintI64("stable_intervals", controller_stats.stable_intervals);
+  }
+
+  region.PrintI64("cold_cache_limit", ColdCacheLimit());
+  region.PrintBool("cold_cache_separate_budget", separate_cold_budget_);
 
   region.PrintI64("cpu_caches_touched", CountTouchedCpus());
   region.PrintI64("max_cpu_cache_touched", MaxTouchedCpu());
   region.PrintI64("cpu_caches_populated", total_populated);
+  region.PrintBool("cpu_caches_virtual_cpus",
+                   subtle::percpu::UsingRseqVirtualCpus());
+  if (subtle::percpu::UsingRseqVirtualCpus()) {
+    // With mm_cid, caches beyond the process's concurrency are never
+    // populated. Report the slab and cache capacity that this avoids.
+    const uint64_t unpopulated = NumCPUs() - total_populated;
+    region.PrintI64("cpu_caches_unpopulated_slab_bytes",
+                    unpopulated << freelist_.GetShift());
+    region.PrintI64("cpu_caches_unpopulated_capacity_bytes",
+                    unpopulated * CacheLimit());
+  }
+}
+
+template <class Forwarder>
+inline void CpuCache<Forwarder>::PrintCapacityProfile(Printer& out) const {
+  out.printf("%s\n", kCapacityProfileHeader);
+  for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+    const size_t max_capacity =
+        max_capacity_[size_class].load(std::memory_order_relaxed);
+    if (max_capacity == 0) continue;
+    // Round the average up, so that size classes in use on only a few cpus
+    // are still warmed.
+    const SizeClassCapacityStats stats = GetSizeClassCapacityStats(size_class);
+    const size_t capacity = static_cast<size_t>(std::ceil(stats.avg_capacity));
+    out.printf("%d %zu %zu %zu\n", size_class,
+               forwarder_.class_to_size(size_class), capacity, max_capacity);
+  }
 }
 
 template <class Forwarder>
@@ -2711,7 +4803,9 @@ inline uint8_t CpuCache<Forwarder>::PartitionShift() const {
               forwarder_.multiple_non_numa_partitions()),
             "NUMA-awareness should never be enabled with non-NUMA partitions.");
   if (forwarder_.active_partitions() > 1) {
-    return absl::bit_ceil(forwarder_.active_partitions() - 1);
+    // Each partition gets its own range of size classes, so the slab grows by
+    // the number of partitions, rounded up to a power of two.
+    return absl::bit_width(forwarder_.active_partitions() - 1);
   }
   return 0;
 }
@@ -2816,6 +4910,13 @@ class CpuCache final : public cpu_cache_internal::CpuCache<
       cpu_cache_internal::StaticForwarder<State>>::CpuCache;
 };
 
+// When Parameters::per_cpu_caches_cgroup_aware() is set, re-reads the cgroup
+// limits of the process and, if they changed since the last call, applies the
+// limit derived by CgroupCacheLimit() through CpuCache::SetCacheLimit().  A
+// limit set through MallocExtension in the meantime becomes the configured
+// limit for the next derivation.  Must not be called concurrently.
+void UpdateCacheLimitFromCgroup();
+
 template <typename State>
 inline bool UsePerCpuCache(State& state) {
   // We expect a fast path of per-CPU caches being active and the thread being
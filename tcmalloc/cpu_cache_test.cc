@@ -42,6 +42,7 @@
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/affinity.h"
+#include "tcmalloc/internal/cpu_utils.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/internal/percpu.h"
@@ -80,6 +81,17 @@ class CpuCachePeer {
     cpu_cache.RecordCacheMissStat(/*cpu=*/0, /*is_alloc=*/false);
   }
 
+  // Returns the number of slab hugepages, and of those backed by hugepages.
+  template <typename CpuCache>
+  static std::pair<size_t, size_t> SlabHugepages(const CpuCache& cpu_cache) {
+    size_t total = 0, huge = 0;
+    cpu_cache.ForEachSlabHugepage(/*cpu=*/-1, [&](void*, bool is_huge) {
+      ++total;
+      huge += is_huge;
+    });
+    return {total, huge};
+  }
+
   // Validate that we're using >90% of the available slab bytes.
   template <typename CpuCache>
   static void ValidateSlabBytes(const CpuCache& cpu_cache) {
@@ -171,6 +183,36 @@ class TestStaticForwarder {
                : -1.0;
   }
 
+  bool per_cpu_caches_l3_aware_stealing() const { return l3_aware_stealing_; }
+
+  bool per_cpu_caches_ranked_shuffle() const { return ranked_shuffle_; }
+
+  bool per_cpu_caches_dynamic_slab_working_set() const {
+    return dynamic_slab_working_set_;
+  }
+
+  bool per_cpu_caches_predictive_refill() const { return predictive_refill_; }
+
+  bool per_cpu_caches_capacity_controller() const {
+    return capacity_controller_;
+  }
+
+  bool per_cpu_caches_incremental_drain() const { return incremental_drain_; }
+
+  bool per_cpu_caches_indirect() const { return indirect_; }
+
+  absl::Duration background_process_sleep_interval() const {
+    return background_process_sleep_interval_;
+  }
+
+  bool numa_return_remote_frees() const { return numa_return_remote_frees_; }
+
+  int32_t refill_prefetch_objects() const { return refill_prefetch_objects_; }
+
+  unsigned GetL3FromCpuId(int cpu) const {
+    return cpus_per_l3_ > 0 ? cpu / cpus_per_l3_ : 0;
+  }
+
   bool reuse_size_classes() const { return true; }
 
   const SizeMap& sizemap() const {
@@ -256,6 +298,18 @@ class TestStaticForwarder {
   double dynamic_slab_grow_threshold_ = -1;
   double dynamic_slab_shrink_threshold_ = -1;
   DynamicSlab dynamic_slab_ = DynamicSlab::kNoop;
+  bool l3_aware_stealing_ = false;
+  bool ranked_shuffle_ = false;
+  bool dynamic_slab_working_set_ = false;
+  bool predictive_refill_ = false;
+  // Number of consecutive cpus sharing a fake L3 cache; 0 means a single L3.
+  int cpus_per_l3_ = 0;
+  bool capacity_controller_ = false;
+  bool incremental_drain_ = false;
+  bool indirect_ = false;
+  absl::Duration background_process_sleep_interval_ = absl::Seconds(1);
+  bool numa_return_remote_frees_ = false;
+  int32_t refill_prefetch_objects_ = 0;
   std::optional<SizeMap> size_map_;
 
  private:
@@ -382,11 +436,158 @@ TEST(CpuCacheTest, UsesShardedAsBackingCache) {
   cache.Deactivate();
 }
 
+TEST(CpuCacheTest, IndirectCache) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+  CpuCache cache;
+  cache.Activate();
+
+  TestStaticForwarder& forwarder = cache.forwarder();
+  forwarder.SetShardedCacheForLargeClassesOnly(true);
+  forwarder.InitializeShardedManager(/*num_shards=*/1);
+  forwarder.indirect_ = true;
+
+  constexpr int kCpuId = 0;
+  constexpr size_t kSizeClass = 1;
+  ASSERT_TRUE(forwarder.sharded_transfer_cache().should_use(kSizeClass));
+  ScopedFakeCpuId fake_cpu_id(kCpuId);
+
+  // A freed object stays on the cpu, and is handed out again.
+  void* ptr = cache.Allocate(kSizeClass);
+  ASSERT_NE(ptr, nullptr);
+  cache.Deallocate(ptr, kSizeClass);
+  EXPECT_EQ(cache.UsedBytes(kCpuId), forwarder.class_to_size(kSizeClass));
+  EXPECT_EQ(cache.Allocate(kSizeClass), ptr);
+  CpuCache::IndirectCacheStats stats = cache.GetIndirectCacheStats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.evictions, 0);
+  cache.Deallocate(ptr, kSizeClass);
+
+  // Frees into a full cache push its oldest object out.
+  void* ptrs[CpuCache::kIndirectCacheObjects + 1];
+  for (void*& p : ptrs) {
+    p = cache.Allocate(kSizeClass);
+    ASSERT_NE(p, nullptr);
+  }
+  for (void* p : ptrs) {
+    cache.Deallocate(p, kSizeClass);
+  }
+  stats = cache.GetIndirectCacheStats();
+  EXPECT_EQ(stats.evictions, 1);
+  const uint64_t cached_bytes =
+      CpuCache::kIndirectCacheObjects * forwarder.class_to_size(kSizeClass);
+  EXPECT_EQ(cache.UsedBytes(kCpuId), cached_bytes);
+
+  EXPECT_EQ(cache.Reclaim(kCpuId), cached_bytes);
+  EXPECT_EQ(cache.UsedBytes(kCpuId), 0);
+
+  forwarder.SetShardedCacheForLargeClassesOnly(false);
+  cache.Deactivate();
+}
+
 TEST(CpuCacheTest, ResizeInfoNoFalseSharing) {
   const size_t resize_info_size = CpuCachePeer::ResizeInfoSize<CpuCache>();
   EXPECT_EQ(resize_info_size % ABSL_CACHELINE_SIZE, 0) << resize_info_size;
 }
 
+TEST(CpuCacheTest, SlabHugepagesFollowPopulatedCpus) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.Activate();
+
+  // Without populated CPUs, no slab memory is backed by hugepages.
+  const auto [total, huge] = CpuCachePeer::SlabHugepages(cache);
+  EXPECT_EQ(huge, 0);
+  const size_t slab_size = size_t{1} << CpuCachePeer::GetSlabShift(cache);
+  EXPECT_LE(total * kHugePageSize, NumCPUs() * slab_size);
+
+  void* ptr;
+  {
+    tcmalloc_internal::ScopedAffinityMask mask(
+        tcmalloc_internal::AllowedCpus()[0]);
+    ptr = cache.Allocate(/*size_class=*/2);
+    if (mask.Tampered()) {
+      cache.Deallocate(ptr, /*size_class=*/2);
+      cache.Deactivate();
+      return;
+    }
+  }
+  ASSERT_NE(ptr, nullptr);
+  cache.Deallocate(ptr, /*size_class=*/2);
+
+  // A single populated CPU is not enough to back a hugepage shared by several.
+  if (kHugePageSize / slab_size >= 4) {
+    EXPECT_EQ(CpuCachePeer::SlabHugepages(cache).second, 0);
+  }
+
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, CpusetChange) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+  if (subtle::percpu::UsingVirtualCpus()) {
+    GTEST_SKIP() << "Virtual cpu ids do not follow the cpuset";
+  }
+  const std::vector<int> allowed = tcmalloc_internal::AllowedCpus();
+  if (allowed.size() < 2) {
+    GTEST_SKIP() << "Needs at least two cpus";
+  }
+
+  CpuCache cache;
+  cache.Activate();
+  const int cpu = allowed[0];
+
+  void* ptr;
+  {
+    tcmalloc_internal::ScopedAffinityMask mask(cpu);
+    ptr = cache.Allocate(/*size_class=*/2);
+    cache.Deallocate(ptr, /*size_class=*/2);
+    if (mask.Tampered() || !cache.HasPopulated(cpu)) {
+      cache.Deactivate();
+      return;
+    }
+  }
+  const uint64_t capacity = cache.Capacity(cpu);
+  ASSERT_GT(capacity, 0);
+
+  // The first cpu is taken away: its cache is drained, and its capacity kept.
+  {
+    tcmalloc_internal::ScopedAffinityMask mask(allowed[1]);
+    cache.HandleCpusetChange();
+    if (mask.Tampered()) {
+      cache.Deactivate();
+      return;
+    }
+  }
+  EXPECT_EQ(cache.UsedBytes(cpu), 0);
+  auto stats = cache.GetCpusetChangeStats();
+  EXPECT_EQ(stats.changes, 1);
+  EXPECT_EQ(stats.drained_cpus, 1);
+  EXPECT_GT(stats.parked_bytes, 0);
+  EXPECT_EQ(stats.moved_bytes, 0);
+
+  // Given back, it gets the kept capacity of all the cpus taken away.
+  const size_t parked = stats.parked_bytes;
+  cache.HandleCpusetChange();
+  stats = cache.GetCpusetChangeStats();
+  EXPECT_EQ(stats.changes, 2);
+  EXPECT_EQ(stats.parked_bytes + stats.moved_bytes, parked);
+  EXPECT_GE(cache.Capacity(cpu), stats.moved_bytes / (allowed.size() - 1));
+
+  // Nothing changed since.
+  cache.HandleCpusetChange();
+  EXPECT_EQ(cache.GetCpusetChangeStats().changes, 2);
+
+  cache.Deactivate();
+}
+
 TEST(CpuCacheTest, Metadata) {
   if (!subtle::percpu::IsFast()) {
     return;
@@ -709,6 +910,72 @@ void AllocateThenDeallocate(CpuCache& cache, int cpu, size_t size_class,
   objects.clear();
 }
 
+TEST(CpuCacheTest, ColdCacheBudget) {
+  if (!subtle::percpu::IsFast() || !ColdFeatureActive()) {
+    return;
+  }
+
+  const size_t kColdClass = kExpandedClassesStart + 1;
+  const size_t kHotClass = 1;
+  const int kCpu = 0;
+
+  CpuCache cache;
+  const size_t cold_size = cache.forwarder().class_to_size(kColdClass);
+  const uint64_t cold_limit = 8 * cold_size;
+  cache.SetColdCacheLimit(cold_limit);
+  cache.Activate();
+  EXPECT_EQ(cache.ColdCacheLimit(), cold_limit);
+  EXPECT_EQ(cache.Capacity(kCpu), cache.CacheLimit() + cold_limit);
+
+  // Grow the cold size class as far as it goes. Its capacity is bounded by the
+  // cold budget and leaves the capacity of the other size classes untouched.
+  constexpr size_t kPtrs = 1024;
+  std::vector<void*> ptrs(kPtrs);
+  {
+    ScopedFakeCpuId fake_cpu_id(kCpu);
+    for (int i = 0; i < 4; ++i) {
+      for (auto& ptr : ptrs) ptr = cache.Allocate(kColdClass);
+      for (void* ptr : ptrs) cache.Deallocate(ptr, kColdClass);
+    }
+  }
+  EXPECT_GT(cache.GetCapacityOfSizeClass(kCpu, kColdClass), 0);
+  EXPECT_LE(cache.GetCapacityOfSizeClass(kCpu, kColdClass) * cold_size,
+            cold_limit);
+  EXPECT_GE(cache.Unallocated(kCpu), cache.CacheLimit());
+
+  const CpuCache::CpuCacheMissStats cold_misses =
+      cache.GetTotalColdCacheMissStats(kCpu);
+  EXPECT_GT(cold_misses.underflows, 0);
+  EXPECT_GT(cold_misses.overflows, 0);
+
+  // Hot size classes do not contribute to the cold miss stats.
+  {
+    ScopedFakeCpuId fake_cpu_id(kCpu);
+    for (auto& ptr : ptrs) ptr = cache.Allocate(kHotClass);
+    for (void* ptr : ptrs) cache.Deallocate(ptr, kHotClass);
+  }
+  EXPECT_EQ(cache.GetTotalColdCacheMissStats(kCpu).underflows,
+            cold_misses.underflows);
+  EXPECT_GT(cache.GetCapacityOfSizeClass(kCpu, kHotClass), 0);
+
+  // Growing the cold budget makes room for more cold capacity.
+  cache.SetColdCacheLimit(2 * cold_limit);
+  EXPECT_EQ(cache.Capacity(kCpu), cache.CacheLimit() + 2 * cold_limit);
+
+  // Shrinking it drains cold capacity that no longer fits.
+  {
+    ScopedFakeCpuId fake_cpu_id(kCpu);
+    for (auto& ptr : ptrs) ptr = cache.Allocate(kColdClass);
+    for (void* ptr : ptrs) cache.Deallocate(ptr, kColdClass);
+  }
+  cache.SetColdCacheLimit(cold_limit / 2);
+  EXPECT_EQ(cache.Capacity(kCpu), cache.CacheLimit() + cold_limit / 2);
+  EXPECT_LE(cache.GetCapacityOfSizeClass(kCpu, kColdClass) * cold_size,
+            cold_limit / 2);
+
+  cache.Deactivate();
+}
+
 // In this test, we check if we can resize size classes based on the number of
 // misses they encounter. First, we exhaust cache capacity by filling up
 // larger size class as much as possible. Then, we try to allocate objects for
@@ -812,6 +1079,78 @@ TEST(CpuCacheTest, ResizeMaxCapacityTest) {
   cache.Deactivate();
 }
 
+// Checks that the capacity controller grows a size class suffering maximum
+// capacity misses by a single batch per interval, preserves the total number of
+// objects across size classes, and settles once the misses stop.
+TEST(CpuCacheTest, CapacityControllerTest) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.forwarder().capacity_controller_ = true;
+  const size_t max_cpu_cache_size = 128 << 10 << 10;
+  cache.SetCacheLimit(max_cpu_cache_size);
+  cache.Activate();
+
+  constexpr int kCpuId = 0;
+  constexpr int kCpuId1 = 1;
+  constexpr size_t kSizeClass = 2;
+  const uint8_t shift = CpuCachePeer::GetSlabShift(cache);
+  const int base_max_capacity = cache.GetMaxCapacity(kSizeClass, shift);
+  const size_t batch_size = cache.forwarder().num_objects_to_move(kSizeClass);
+
+  size_t old_total_max_capacity = 0;
+  for (int size_class = 0; size_class < kNumClasses; ++size_class) {
+    old_total_max_capacity += cache.GetMaxCapacity(size_class, shift);
+  }
+
+  size_t ops = 0;
+  while (cache.GetCapacityOfSizeClass(kCpuId, kSizeClass) <
+         base_max_capacity) {
+    ops += batch_size;
+    AllocateThenDeallocate(cache, kCpuId, kSizeClass, ops);
+  }
+  AllocateThenDeallocate(cache, kCpuId, kSizeClass, ops + batch_size);
+  ASSERT_GT(cache.GetIntervalSizeClassMisses(
+                kCpuId, kSizeClass, PerClassMissType::kMaxCapacityTotal,
+                PerClassMissType::kMaxCapacityResize),
+            0);
+
+  {
+    ScopedFakeCpuId fake_cpu_id_1(kCpuId1);
+    cache.ResizeSizeClassMaxCapacities();
+  }
+  EXPECT_EQ(cache.GetMaxCapacity(kSizeClass, shift),
+            base_max_capacity + batch_size);
+
+  auto stats = cache.GetCapacityControllerStats();
+  EXPECT_EQ(stats.intervals, 1);
+  EXPECT_GE(stats.adjusted_size_classes, 2);
+  EXPECT_EQ(stats.moved_bytes,
+            batch_size * cache.forwarder().class_to_size(kSizeClass));
+  EXPECT_EQ(stats.stable_intervals, 0);
+
+  // Without further misses, the smoothed misses decay and the controller stops
+  // moving capacity around.
+  for (int i = 0; i < 64; ++i) {
+    ScopedFakeCpuId fake_cpu_id_1(kCpuId1);
+    cache.ResizeSizeClassMaxCapacities();
+  }
+  stats = cache.GetCapacityControllerStats();
+  EXPECT_EQ(stats.intervals, 65);
+  EXPECT_EQ(stats.adjusted_size_classes, 0);
+  EXPECT_GT(stats.stable_intervals, 0);
+
+  size_t new_total_max_capacity = 0;
+  for (int size_class = 0; size_class < kNumClasses; ++size_class) {
+    new_total_max_capacity += cache.GetMaxCapacity(size_class, shift);
+  }
+  EXPECT_EQ(new_total_max_capacity, old_total_max_capacity);
+
+  cache.Deactivate();
+}
+
 static void ResizeMaxCapacities(CpuCache& cache,
                                 const std::atomic<bool>& stop) {
   if (!subtle::percpu::IsFast()) {
@@ -960,6 +1299,59 @@ TEST(CpuCacheTest, StealCpuCache) {
   cache.Deactivate();
 }
 
+TEST(CpuCacheTest, StealCpuCacheL3Aware) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  for (int cpus_per_l3 : {0, 2}) {
+    SCOPED_TRACE(absl::StrFormat("cpus_per_l3: %d", cpus_per_l3));
+    CpuCache cache;
+    TestStaticForwarder& forwarder = cache.forwarder();
+    forwarder.l3_aware_stealing_ = true;
+    forwarder.cpus_per_l3_ = cpus_per_l3;
+    cache.Activate();
+
+    std::vector<std::thread> threads;
+    std::thread shuffle_thread;
+    const int n_threads = NumCPUs();
+    std::atomic<bool> stop(false);
+
+    for (size_t t = 0; t < n_threads; ++t) {
+      threads.push_back(
+          std::thread(StressThread, std::ref(cache), t, std::ref(stop)));
+    }
+    shuffle_thread =
+        std::thread(ShuffleThread, std::ref(cache), std::ref(stop));
+
+    absl::SleepFor(absl::Milliseconds(100));
+    stop = true;
+    for (auto& t : threads) {
+      t.join();
+    }
+    shuffle_thread.join();
+
+    // Check that the total capacity is preserved after the shuffle.
+    size_t capacity = 0;
+    const int num_cpus = NumCPUs();
+    const size_t kTotalCapacity =
+        num_cpus * Parameters::max_per_cpu_cache_size();
+    for (int cpu = 0; cpu < num_cpus; ++cpu) {
+      EXPECT_EQ(cache.Allocated(cpu) + cache.Unallocated(cpu),
+                cache.Capacity(cpu));
+      capacity += cache.Capacity(cpu);
+    }
+    EXPECT_EQ(capacity, kTotalCapacity);
+
+    // With a single L3 domain, nothing can be stolen across domains.
+    if (cpus_per_l3 == 0) {
+      EXPECT_EQ(cache.GetStealStats().cross_l3_bytes, 0);
+    }
+
+    cache.Deactivate();
+  }
+}
+
 // Test that when dynamic slab is enabled, nothing goes horribly wrong and that
 // arena non-resident bytes increases as expected.
 TEST(CpuCacheTest, DynamicSlab) {
@@ -1247,6 +1639,64 @@ TEST_F(DynamicWideSlabTest, DynamicSlabThreshold) {
   EXPECT_EQ(CpuCachePeer::GetSlabShift(cache), shift + 1);
 }
 
+// Test that the working set policy sizes the slab to fit the cached objects,
+// and waits for a second window before shrinking it.
+TEST_F(DynamicWideSlabTest, DynamicSlabWorkingSet) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  TestStaticForwarder& forwarder = cache.forwarder();
+  forwarder.dynamic_slab_enabled_ = true;
+  forwarder.dynamic_slab_working_set_ = true;
+  SizeMap size_map;
+  ASSERT_TRUE(size_map.Init(size_map.CurrentClasses().classes));
+  forwarder.size_map_ = size_map;
+
+  cache.Activate();
+
+  constexpr int kCpuId = 0;
+  constexpr size_t kSizeClass = 1;
+  const uint8_t shift = cache.GetPerCpuSlabShiftBounds().initial_shift;
+  ASSERT_EQ(CpuCachePeer::GetSlabShift(cache), shift);
+
+  // Without samples, the slab is left alone.
+  cache.ResizeSlabIfNeeded();
+  EXPECT_EQ(CpuCachePeer::GetSlabShift(cache), shift);
+
+  // Cache more objects than the slab fits, so that the size class overflows.
+  {
+    ScopedFakeCpuId fake_cpu_id(kCpuId);
+    std::vector<void*> ptrs(4 * cache.GetMaxCapacity(kSizeClass, shift));
+    for (int i = 0; i < 2; ++i) {
+      for (auto& ptr : ptrs) {
+        ptr = cache.Allocate(kSizeClass);
+      }
+      for (void* ptr : ptrs) {
+        cache.Deallocate(ptr, kSizeClass);
+      }
+    }
+  }
+  ASSERT_GE(cache.TotalObjectsOfClass(kSizeClass),
+            cache.GetMaxCapacity(kSizeClass, shift));
+  cache.SampleSlabWorkingSet();
+  cache.ResizeSlabIfNeeded();
+  EXPECT_EQ(CpuCachePeer::GetSlabShift(cache), shift + 1);
+
+  // Once the objects are gone, the slab shrinks back, but only after the
+  // second window.
+  cache.Reclaim(kCpuId);
+  cache.SampleSlabWorkingSet();
+  cache.ResizeSlabIfNeeded();
+  EXPECT_EQ(CpuCachePeer::GetSlabShift(cache), shift + 1);
+  cache.SampleSlabWorkingSet();
+  cache.ResizeSlabIfNeeded();
+  EXPECT_EQ(CpuCachePeer::GetSlabShift(cache), shift);
+
+  cache.Deactivate();
+}
+
 // Test that when dynamic slab parameters change, things still work.
 TEST_F(DynamicWideSlabTest, DynamicSlabParamsChange) {
   if (!subtle::percpu::IsFast()) {
@@ -1481,6 +1931,105 @@ TEST(CpuCacheTest, ColdHotCacheShuffleTest) {
   cache.Deactivate();
 }
 
+TEST(CpuCacheTest, RankedShuffle) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.forwarder().ranked_shuffle_ = true;
+  const size_t max_cpu_cache_size = 1 << 16;
+  cache.SetCacheLimit(max_cpu_cache_size);
+  cache.Activate();
+
+  constexpr int hot_cpu_id = 0;
+  constexpr int cold_cpu_id = 1;
+  constexpr size_t size_class = 2;
+
+  ColdCacheOperations(cache, cold_cpu_id, size_class);
+  HotCacheOperations(cache, hot_cpu_id);
+  cache.ShuffleCpuCaches();
+
+  // The hot cache is the most missing one, so a single shuffle grows it by
+  // its whole share, which the cold cache can afford.
+  EXPECT_EQ(cache.Capacity(hot_cpu_id),
+            max_cpu_cache_size * (1 + CpuCache::kRankedShuffleMaxGrow));
+  EXPECT_EQ(cache.Capacity(cold_cpu_id) + cache.Capacity(hot_cpu_id),
+            2 * max_cpu_cache_size);
+  for (int cpu : {hot_cpu_id, cold_cpu_id}) {
+    EXPECT_EQ(cache.Allocated(cpu) + cache.Unallocated(cpu),
+              cache.Capacity(cpu));
+  }
+  CpuCache::CpuCacheStealStats steal_stats = cache.GetStealStats();
+  EXPECT_EQ(steal_stats.ranked_plans, 1);
+  EXPECT_EQ(steal_stats.ranked_pending_bytes, 0);
+  EXPECT_EQ(steal_stats.same_l3_bytes,
+            max_cpu_cache_size * CpuCache::kRankedShuffleMaxGrow);
+
+  // Without misses since, the next plan moves nothing.
+  const size_t hot_cache_capacity = cache.Capacity(hot_cpu_id);
+  cache.ShuffleCpuCaches();
+  cache.ContinueShuffleCpuCaches();
+  EXPECT_EQ(cache.Capacity(hot_cpu_id), hot_cache_capacity);
+  steal_stats = cache.GetStealStats();
+  EXPECT_EQ(steal_stats.ranked_plans, 2);
+  EXPECT_EQ(steal_stats.ranked_pending_bytes, 0);
+
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, ProtectedCpus) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  const size_t max_cpu_cache_size = 1 << 16;
+  cache.SetCacheLimit(max_cpu_cache_size);
+  cache.Activate();
+
+  constexpr int hot_cpu_id = 0;
+  constexpr int cold_cpu_id = 1;
+  constexpr size_t size_class = 2;
+
+  CpuSet protected_cpus;
+  protected_cpus.Zero();
+  protected_cpus.Set(cold_cpu_id);
+  cache.SetProtectedCpus(protected_cpus);
+  EXPECT_TRUE(cache.IsProtected(cold_cpu_id));
+  EXPECT_FALSE(cache.IsProtected(hot_cpu_id));
+  EXPECT_EQ(cache.GetProtectedCpus().Count(), 1);
+
+  ColdCacheOperations(cache, cold_cpu_id, size_class);
+  HotCacheOperations(cache, hot_cpu_id);
+  cache.ShuffleCpuCaches();
+
+  // The cold cache is at the cache limit, which is the floor of a protected
+  // cpu, so the hot cache does not get any of it.
+  EXPECT_EQ(cache.Capacity(cold_cpu_id), max_cpu_cache_size);
+  EXPECT_EQ(cache.Capacity(hot_cpu_id), max_cpu_cache_size);
+
+  // Nor is the idle cold cache reclaimed.
+  const uint64_t used_bytes = cache.UsedBytes(cold_cpu_id);
+  ASSERT_GT(used_bytes, 0);
+  cache.TryReclaimingCaches();
+  cache.TryReclaimingCaches();
+  EXPECT_EQ(cache.UsedBytes(cold_cpu_id), used_bytes);
+  EXPECT_EQ(cache.GetNumReclaims(cold_cpu_id), 0);
+
+  // Once unprotected, the cold cache gives up capacity as usual.
+  protected_cpus.Zero();
+  cache.SetProtectedCpus(protected_cpus);
+  EXPECT_FALSE(cache.IsProtected(cold_cpu_id));
+  HotCacheOperations(cache, hot_cpu_id);
+  cache.ShuffleCpuCaches();
+  EXPECT_GT(cache.Capacity(hot_cpu_id), max_cpu_cache_size);
+  EXPECT_EQ(cache.Capacity(cold_cpu_id) + cache.Capacity(hot_cpu_id),
+            2 * max_cpu_cache_size);
+
+  cache.Deactivate();
+}
+
 TEST(CpuCacheTest, ReclaimCpuCache) {
   if (!subtle::percpu::IsFast()) {
     return;
@@ -1599,6 +2148,398 @@ TEST(CpuCacheTest, ReclaimCpuCache) {
   cache.Deactivate();
 }
 
+TEST(CpuCacheTest, IncrementalDrain) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.forwarder().incremental_drain_ = true;
+  cache.Activate();
+
+  // Populate more size classes than are drained per tick.
+  constexpr int kCpu = 0;
+  constexpr size_t kNumSizeClasses =
+      CpuCache::kMaxSizeClassesToDrainPerTick + 4;
+  ASSERT_LT(kNumSizeClasses, kNumClasses);
+  for (size_t size_class = 1; size_class <= kNumSizeClasses; ++size_class) {
+    ColdCacheOperations(cache, kCpu, size_class);
+  }
+  const uint64_t used_bytes = cache.UsedBytes(kCpu);
+  ASSERT_GT(used_bytes, 0);
+
+  // The first pass records the used bytes, the second one finds the cache
+  // idle and schedules it for draining instead of reclaiming it.
+  cache.TryReclaimingCaches();
+  cache.TryReclaimingCaches();
+  EXPECT_EQ(cache.UsedBytes(kCpu), used_bytes);
+  EXPECT_EQ(cache.GetNumReclaims(kCpu), 0);
+  EXPECT_EQ(cache.GetIncrementalDrainStats().scheduled, 1);
+
+  auto populated_size_classes = [&]() {
+    size_t n = 0;
+    for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
+      n += cache.GetCapacityOfSizeClass(kCpu, size_class) > 0;
+    }
+    return n;
+  };
+
+  cache.DrainIdleCachesIncrementally();
+  EXPECT_EQ(populated_size_classes(),
+            kNumSizeClasses - CpuCache::kMaxSizeClassesToDrainPerTick);
+  EXPECT_EQ(cache.GetNumReclaims(kCpu), 0);
+
+  cache.DrainIdleCachesIncrementally();
+  EXPECT_EQ(populated_size_classes(), 0);
+  EXPECT_EQ(cache.UsedBytes(kCpu), 0);
+  EXPECT_EQ(cache.GetNumReclaims(kCpu), 1);
+  EXPECT_EQ(cache.Unallocated(kCpu), cache.Capacity(kCpu));
+
+  CpuCache::IncrementalDrainStats stats = cache.GetIncrementalDrainStats();
+  EXPECT_EQ(stats.completed, 1);
+  EXPECT_EQ(stats.cancelled, 0);
+  EXPECT_EQ(stats.size_classes, kNumSizeClasses);
+  EXPECT_EQ(stats.bytes, used_bytes);
+  EXPECT_GE(stats.total_time, stats.max_tick_time);
+
+  // A cache used again after being scheduled is no longer drained.
+  for (size_t size_class = 1; size_class <= kNumSizeClasses; ++size_class) {
+    ColdCacheOperations(cache, kCpu, size_class);
+  }
+  cache.TryReclaimingCaches();
+  cache.TryReclaimingCaches();
+  ColdCacheOperations(cache, kCpu, kNumSizeClasses + 1);
+  cache.DrainIdleCachesIncrementally();
+  EXPECT_GT(cache.UsedBytes(kCpu), 0);
+  stats = cache.GetIncrementalDrainStats();
+  EXPECT_EQ(stats.scheduled, 2);
+  EXPECT_EQ(stats.cancelled, 1);
+
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, ResetAfterFork) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.Activate();
+
+  constexpr int kCpu = 0;
+  constexpr size_t kSizeClass = 2;
+  ColdCacheOperations(cache, kCpu, kSizeClass);
+  ASSERT_TRUE(cache.HasPopulated(kCpu));
+  ASSERT_GT(cache.UsedBytes(kCpu), 0);
+
+  // The objects cached at the time are dropped, not returned.
+  cache.ResetAfterFork();
+  EXPECT_FALSE(cache.HasPopulated(kCpu));
+  EXPECT_EQ(cache.UsedBytes(kCpu), 0);
+  EXPECT_EQ(cache.GetCapacityOfSizeClass(kCpu, kSizeClass), 0);
+  EXPECT_EQ(cache.Unallocated(kCpu), cache.Capacity(kCpu));
+  EXPECT_EQ(cache.GetNumReclaims(kCpu), 0);
+
+  // The cpu is populated again on next use.
+  ColdCacheOperations(cache, kCpu, kSizeClass);
+  EXPECT_TRUE(cache.HasPopulated(kCpu));
+  EXPECT_GT(cache.UsedBytes(kCpu), 0);
+
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, MarkCpuParking) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.Activate();
+
+  constexpr int kCpu = 0;
+  constexpr size_t kSizeClass = 1;
+
+  // Short parks leave the cache alone.
+  ColdCacheOperations(cache, kCpu, kSizeClass);
+  ASSERT_GT(cache.UsedBytes(kCpu), 0);
+  cache.MarkCpuParking(kCpu, absl::Milliseconds(10));
+  EXPECT_GT(cache.UsedBytes(kCpu), 0);
+  EXPECT_EQ(cache.GetNumReclaims(kCpu), 0);
+
+  // Without incremental draining, long parks drain the cache right away.
+  cache.MarkCpuParking(kCpu, absl::Seconds(10));
+  EXPECT_EQ(cache.UsedBytes(kCpu), 0);
+  EXPECT_EQ(cache.GetNumReclaims(kCpu), 1);
+
+  // With it, they schedule the cache to be drained, even if it saw misses
+  // before the park.
+  cache.forwarder().incremental_drain_ = true;
+  ColdCacheOperations(cache, kCpu, kSizeClass);
+  ASSERT_GT(cache.UsedBytes(kCpu), 0);
+  cache.MarkCpuParking(kCpu, absl::Seconds(10));
+  EXPECT_GT(cache.UsedBytes(kCpu), 0);
+  EXPECT_EQ(cache.GetIncrementalDrainStats().scheduled, 1);
+  cache.DrainIdleCachesIncrementally();
+  EXPECT_EQ(cache.UsedBytes(kCpu), 0);
+  EXPECT_EQ(cache.GetNumReclaims(kCpu), 2);
+
+  // A worker that wakes up and allocates before the drain keeps its cache.
+  ColdCacheOperations(cache, kCpu, kSizeClass);
+  cache.MarkCpuParking(kCpu, absl::Seconds(10));
+  ColdCacheOperations(cache, kCpu, kSizeClass + 1);
+  cache.DrainIdleCachesIncrementally();
+  EXPECT_GT(cache.UsedBytes(kCpu), 0);
+  EXPECT_EQ(cache.GetIncrementalDrainStats().cancelled, 1);
+
+  const CpuCache::ParkStats stats = cache.GetParkStats();
+  EXPECT_EQ(stats.hints, 4);
+  EXPECT_EQ(stats.drains, 3);
+
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, AllocateDeallocateBatch) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.Activate();
+
+  const size_t kSizeClass = 2;
+  // Span several transfer cache batches, so that the shortfall is fetched in
+  // more than one call to the backing cache.
+  constexpr size_t kBatch = 3 * kMaxObjectsToMove + 1;
+  void* batch[kBatch];
+  int allowed_cpu_id;
+  {
+    tcmalloc_internal::ScopedAffinityMask mask(
+        tcmalloc_internal::AllowedCpus()[0]);
+    allowed_cpu_id = subtle::percpu::TcmallocTest::VirtualCpuSynchronize();
+
+    ASSERT_EQ(cache.AllocateBatch(kSizeClass, batch, kBatch), kBatch);
+
+    absl::flat_hash_set<void*> seen;
+    for (void* ptr : batch) {
+      ASSERT_NE(ptr, nullptr);
+      EXPECT_TRUE(seen.insert(ptr).second);
+    }
+
+    cache.DeallocateBatch(kSizeClass, batch, kBatch);
+
+    if (mask.Tampered() ||
+        allowed_cpu_id !=
+            subtle::percpu::TcmallocTest::VirtualCpuSynchronize()) {
+      cache.Deactivate();
+      return;
+    }
+  }
+
+  // The empty cache underflows once for the whole batch, and the freshly-grown
+  // cache overflows at most once on the way back.
+  CpuCache::CpuCacheMissStats total_misses =
+      cache.GetTotalCacheMissStats(allowed_cpu_id);
+  EXPECT_EQ(total_misses.underflows, 1);
+  EXPECT_LE(total_misses.overflows, 1);
+  EXPECT_GT(cache.UsedBytes(allowed_cpu_id), 0);
+
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, RefillPrefetch) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  // Prefetch deeper than a batch, which is capped by the batch size.
+  cache.forwarder().refill_prefetch_objects_ = 2 * kMaxObjectsToMove;
+  cache.Activate();
+
+  const size_t kSizeClass = 2;
+  constexpr size_t kObjects = 4 * kMaxObjectsToMove;
+  std::vector<void*> ptrs;
+  absl::flat_hash_set<void*> seen;
+  for (size_t i = 0; i < kObjects; ++i) {
+    void* ptr = cache.Allocate(kSizeClass);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_TRUE(seen.insert(ptr).second);
+    ptrs.push_back(ptr);
+  }
+  for (void* ptr : ptrs) {
+    cache.Deallocate(ptr, kSizeClass);
+  }
+
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, PredictiveRefill) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  const size_t kSizeClass = 2;
+  constexpr size_t kObjects = 32 * kMaxObjectsToMove;
+
+  // Returns the underflows of a burst of kObjects allocations on one cpu, or
+  // nullopt if the thread did not stay on it.
+  auto burst_underflows = [&](bool predictive) -> std::optional<size_t> {
+    CpuCache cache;
+    cache.forwarder().predictive_refill_ = predictive;
+    cache.Activate();
+
+    std::vector<void*> ptrs;
+    ptrs.reserve(kObjects);
+    std::optional<size_t> underflows;
+    {
+      tcmalloc_internal::ScopedAffinityMask mask(
+          tcmalloc_internal::AllowedCpus()[0]);
+      const int cpu = subtle::percpu::TcmallocTest::VirtualCpuSynchronize();
+      for (size_t i = 0; i < kObjects; ++i) {
+        void* ptr = cache.Allocate(kSizeClass);
+        EXPECT_NE(ptr, nullptr);
+        ptrs.push_back(ptr);
+      }
+      if (!mask.Tampered() &&
+          cpu == subtle::percpu::TcmallocTest::VirtualCpuSynchronize()) {
+        underflows = cache.GetTotalCacheMissStats(cpu).underflows;
+      }
+    }
+    for (void* ptr : ptrs) {
+      if (ptr != nullptr) cache.Deallocate(ptr, kSizeClass);
+    }
+
+    if (underflows.has_value()) {
+      EXPECT_EQ(cache.GetPredictiveRefillStats().refills > 0, predictive);
+    }
+    cache.Deactivate();
+    return underflows;
+  };
+
+  const std::optional<size_t> fixed = burst_underflows(false);
+  const std::optional<size_t> predictive = burst_underflows(true);
+  if (!fixed.has_value() || !predictive.has_value()) {
+    return;
+  }
+  // The refills grow with the burst, so it underflows fewer times.
+  EXPECT_LT(*predictive, *fixed);
+}
+
+TEST(CpuCacheTest, ParseCapacityProfile) {
+  using cpu_cache_internal::CapacityProfileEntry;
+  using cpu_cache_internal::kCapacityProfileHeader;
+  using cpu_cache_internal::ParseCapacityProfile;
+
+  CapacityProfileEntry entries[4];
+  const std::string header = std::string(kCapacityProfileHeader) + "\n";
+  EXPECT_EQ(ParseCapacityProfile(header + "1 8 32 2048\n# comment\n\n"
+                                          "7 64 12 1024\n",
+                                 absl::MakeSpan(entries)),
+            2);
+  EXPECT_EQ(entries[0].size_class, 1);
+  EXPECT_EQ(entries[0].object_size, 8);
+  EXPECT_EQ(entries[0].capacity, 32);
+  EXPECT_EQ(entries[0].max_capacity, 2048);
+  EXPECT_EQ(entries[1].size_class, 7);
+  EXPECT_EQ(entries[1].max_capacity, 1024);
+
+  // Missing header, malformed lines and overflowing the output are rejected.
+  EXPECT_EQ(ParseCapacityProfile("1 8 32 2048\n", absl::MakeSpan(entries)),
+            0);
+  EXPECT_EQ(ParseCapacityProfile(header + "1 8 32\n", absl::MakeSpan(entries)),
+            0);
+  EXPECT_EQ(ParseCapacityProfile(header + "1 8 32 2048 5\n",
+                                 absl::MakeSpan(entries)),
+            0);
+  EXPECT_EQ(ParseCapacityProfile(header + "1 8 x 2048\n",
+                                 absl::MakeSpan(entries)),
+            0);
+  EXPECT_EQ(ParseCapacityProfile(header + "1 8 32 2048\n",
+                                 absl::MakeSpan(entries, 0)),
+            0);
+}
+
+TEST(CpuCacheTest, CgroupCacheLimit) {
+  using cpu_cache_internal::CgroupCacheLimit;
+  constexpr uint64_t kConfigured = 3 << 20;
+  constexpr int kNumCpus = 128;
+
+  // Without a memory limit, the configured limit is kept.
+  EXPECT_EQ(CgroupCacheLimit(kConfigured, kNumCpus, {}), kConfigured);
+  EXPECT_EQ(CgroupCacheLimit(kConfigured, kNumCpus, {.cpus = 2}), kConfigured);
+
+  // A 2 GiB container without a CPU quota budgets 64 MiB over all 128 cpus.
+  EXPECT_EQ(CgroupCacheLimit(kConfigured, kNumCpus,
+                             {.memory_bytes = uint64_t{2} << 30}),
+            512 << 10);
+
+  // A CPU quota bounds the number of warm caches.
+  EXPECT_EQ(CgroupCacheLimit(kConfigured, kNumCpus,
+                             {.cpus = 4, .memory_bytes = uint64_t{2} << 30}),
+            kConfigured);
+  EXPECT_EQ(CgroupCacheLimit(kConfigured, kNumCpus,
+                             {.cpus = 0.5, .memory_bytes = 32 << 20}),
+            1 << 20);
+
+  // Tiny containers keep a minimum cache, but never above the configured one.
+  EXPECT_EQ(CgroupCacheLimit(kConfigured, kNumCpus,
+                             {.memory_bytes = 64 << 20}),
+            256 << 10);
+  EXPECT_EQ(CgroupCacheLimit(128 << 10, kNumCpus, {.memory_bytes = 64 << 20}),
+            128 << 10);
+}
+
+TEST(CpuCacheTest, CapacityProfileWarmStart) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  const size_t kSizeClass = 3;
+  const int kCpu = 0;
+
+  std::string profile_text;
+  {
+    CpuCache cache;
+    cache.Activate();
+    for (int i = 0; i < 10; ++i) {
+      ColdCacheOperations(cache, kCpu, kSizeClass);
+    }
+    ASSERT_GT(cache.GetCapacityOfSizeClass(kCpu, kSizeClass), 0);
+
+    profile_text.resize(kNumClasses * 96);
+    Printer printer(profile_text.data(), profile_text.size());
+    cache.PrintCapacityProfile(printer);
+    profile_text.resize(printer.SpaceRequired());
+    cache.Deactivate();
+  }
+
+  std::vector<cpu_cache_internal::CapacityProfileEntry> entries(kNumClasses);
+  const size_t n = cpu_cache_internal::ParseCapacityProfile(
+      profile_text, absl::MakeSpan(entries));
+  ASSERT_GT(n, 0);
+  entries.resize(n);
+
+  size_t warm_capacity = 0;
+  for (const auto& entry : entries) {
+    if (entry.size_class == kSizeClass) {
+      warm_capacity = entry.capacity;
+    }
+  }
+  ASSERT_GT(warm_capacity, 0);
+
+  CpuCache cache;
+  cpu_cache_internal::CapacityProfile profile{entries, /*prefill=*/true};
+  cache.Activate(&profile);
+  EXPECT_EQ(cache.GetCapacityOfSizeClass(kCpu, kSizeClass), 0);
+  {
+    ScopedFakeCpuId fake_cpu_id(kCpu);
+    cache.Deallocate(cache.Allocate(kSizeClass), kSizeClass);
+  }
+  EXPECT_GE(cache.GetCapacityOfSizeClass(kCpu, kSizeClass), warm_capacity);
+
+  cache.Deactivate();
+}
+
 TEST(CpuCacheTest, SizeClassCapacityTest) {
   if (!subtle::percpu::IsFast()) {
     return;
@@ -2015,6 +2956,45 @@ TEST(TouchedCpus, SingleThreaded) {
   cache.Deactivate();
 }
 
+TEST(CpuCacheTest, SlabRecaches) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.Activate();
+
+  {
+    const std::vector<int> allowed = tcmalloc_internal::AllowedCpus();
+    if (allowed.empty()) {
+      cache.Deactivate();
+      return;
+    }
+    tcmalloc_internal::ScopedAffinityMask mask(allowed[0]);
+
+    // Each uncached slab, as left behind by a preemption or an aborted
+    // critical section, costs exactly one recache.
+    constexpr int kRounds = 10;
+    for (int i = 0; i < kRounds; ++i) {
+#if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
+      subtle::percpu::tcmalloc_slabs = 0;
+#endif
+      void* ptr = cache.Allocate(1);
+      cache.Deallocate(ptr, 1);
+    }
+
+    // Preemptions may add recaches of their own.
+    EXPECT_GE(cache.GetSlabRecaches(), kRounds);
+    uint64_t per_cpu = 0;
+    for (int cpu = 0, n = NumCPUs(); cpu < n; ++cpu) {
+      per_cpu += cache.GetSlabRecaches(cpu);
+    }
+    EXPECT_EQ(per_cpu, cache.GetSlabRecaches());
+  }
+
+  cache.Deactivate();
+}
+
 TEST(TouchedCpus, Multithreaded) {
   if (!subtle::percpu::IsFast()) {
     return;
@@ -2102,6 +3082,43 @@ TEST(CpuCacheTest, TargetOverflowRefillCount) {
   EXPECT_EQ(F(100, 8, 3), 51);
 }
 
+// Measures Print (state.range(1) == 0) and PrintInPbtxt (== 1) of a cache
+// sized for state.range(0) CPUs, all of them populated, regardless of how many
+// CPUs the benchmark runs on.
+void BM_PrintScaling(benchmark::State& state) {
+  if (!subtle::percpu::IsFast()) {
+    state.SkipWithError("rseq is unavailable");
+    return;
+  }
+  const int num_cpus = state.range(0);
+  const bool pbtxt = state.range(1);
+
+  ScopedFakeNumCPUs fake_num_cpus(num_cpus);
+  {
+    CpuCache cache;
+    cache.Activate();
+    for (int cpu = 0; cpu < num_cpus; ++cpu) {
+      AllocateThenDeallocate(cache, cpu, /*size_class=*/1, /*ops=*/8);
+      AllocateThenDeallocate(cache, cpu, /*size_class=*/2, /*ops=*/8);
+    }
+
+    std::string out(4 << 20, '\0');
+    for (auto _ : state) {
+      Printer p(out.data(), out.size());
+      if (pbtxt) {
+        PbtxtRegion r(p, kTop);
+        cache.PrintInPbtxt(r);
+      } else {
+        cache.Print(p);
+      }
+      benchmark::DoNotOptimize(out.data());
+    }
+
+    cache.Deactivate();
+  }
+}
+BENCHMARK(BM_PrintScaling)->ArgsProduct({{64, 128, 256, 512}, {0, 1}});
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
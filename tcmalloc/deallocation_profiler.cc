@@ -15,6 +15,7 @@
 #include "tcmalloc/deallocation_profiler.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>  // for std::lround
 #include <cstddef>
 #include <cstdint>  // for uintptr_t
@@ -33,6 +34,7 @@
 #include "absl/base/internal/spinlock.h"
 #include "absl/base/internal/sysinfo.h"
 #include "absl/base/macros.h"
+#include "absl/base/optimization.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/debugging/stacktrace.h"  // for GetStackTrace
 #include "absl/functional/function_ref.h"
@@ -175,10 +177,9 @@ int GetL3Id(int cpu_id) {
 }
 
 int GetNumaId(int cpu_id) {
-  return cpu_id >= 0
-             ? tcmalloc_internal::tc_globals.numa_topology().GetCpuPartition(
-                   cpu_id)
-             : -1;
+  return cpu_id >= 0 ? tcmalloc_internal::tc_globals.scanned_numa_topology()
+                           .GetCpuPartition(cpu_id)
+                     : -1;
 }
 
 constexpr std::pair<CpuThreadMatchingStatus, RpcMatchingStatus> kAllCases[] = {
@@ -364,10 +365,29 @@ class DeallocationProfiler {
   MyAllocator::LowLevelArenaReference arena_ref_;
 
   // All active profilers are stored in a list.
-  DeallocationProfiler* next_;
+  std::atomic<DeallocationProfiler*> next_ = nullptr;
   DeallocationProfilerList* list_ = nullptr;
   friend class DeallocationProfilerList;
 
+  // A sampled allocation or deallocation, as reported.  For a deallocation,
+  // record.stack_trace holds only the deallocation's stack and time; the rest
+  // is filled in from the allocation when the two are matched.
+  struct Event {
+    tcmalloc_internal::AllocHandle handle;
+    bool is_free;
+    DeallocationSampleRecord record;
+  };
+
+  // Events reported on one shard of CPUs and not yet matched.  Allocated from
+  // the arena when the shard first reports, and emptied into allocs_ and
+  // reports_ when full.
+  struct EventBuffer {
+    static constexpr size_t kCapacity = 32;
+
+    size_t size = 0;
+    Event events[kCapacity];
+  };
+
   using AllocsTable = absl::flat_hash_map<
       tcmalloc_internal::AllocHandle, DeallocationSampleRecord,
       absl::Hash<tcmalloc_internal::AllocHandle>,
@@ -448,12 +468,87 @@ class DeallocationProfiler {
     absl::Time stop_time_;
   };
 
+  // Guarded by the lock of the corresponding DeallocationProfilerList shard,
+  // until Remove() has returned.
+  EventBuffer* buffers_[DeallocationProfilerList::kNumShards] = {};
+
+  // Guards allocs_, pending_frees_ and reports_ while the profiler is active.
+  // Taken once per EventBuffer, after a shard lock.
+  SpinLock match_lock_{absl::base_internal::SCHEDULE_KERNEL_ONLY};
+
   // Keep track of allocations that are in flight
   AllocsTable allocs_;
 
+  // Deallocations matched before their allocations, which can happen when the
+  // two are reported on different shards.
+  AllocsTable pending_frees_;
+
   // Table to store lifetime information collected by this profiler
   std::unique_ptr<DeallocationStackTraceTable> reports_ = nullptr;
 
+  // Buffers an event reported on `shard`, matching up the shard's events if the
+  // buffer is full.
+  void Report(int shard, const Event& event) {
+    EventBuffer*& buffer = buffers_[shard];
+    if (ABSL_PREDICT_FALSE(buffer == nullptr)) {
+      buffer = new (MyAllocator::Allocate(sizeof(EventBuffer))) EventBuffer;
+    }
+    if (buffer->size == EventBuffer::kCapacity) {
+      Flush(*buffer);
+    }
+    buffer->events[buffer->size++] = event;
+  }
+
+  void Flush(EventBuffer& buffer) {
+    AllocationGuardSpinLockHolder h(match_lock_);
+    for (size_t i = 0; i < buffer.size; ++i) {
+      Match(buffer.events[i]);
+    }
+    buffer.size = 0;
+  }
+
+  void Match(const Event& event) {
+    if (!event.is_free) {
+      auto it = pending_frees_.find(event.handle);
+      if (it == pending_frees_.end()) {
+        allocs_[event.handle] = event.record;
+        return;
+      }
+      AddPair(event.record, it->second);
+      pending_frees_.erase(it);
+      return;
+    }
+
+    auto it = allocs_.find(event.handle);
+    if (it == allocs_.end()) {
+      pending_frees_[event.handle] = event.record;
+      return;
+    }
+    AddPair(it->second, event.record);
+    allocs_.erase(it);
+  }
+
+  void AddPair(const DeallocationSampleRecord& allocation,
+               const DeallocationSampleRecord& free) {
+    DeallocationSampleRecord deallocation = free;
+    deallocation.stack_trace = allocation.stack_trace;
+    deallocation.stack_trace.allocation_time = free.stack_trace.allocation_time;
+    deallocation.stack_trace.depth = free.stack_trace.depth;
+    std::copy(free.stack_trace.stack,
+              free.stack_trace.stack + free.stack_trace.depth,
+              deallocation.stack_trace.stack);
+    reports_->AddTrace(allocation, deallocation);
+  }
+
+  static void FillLocation(int cpu_id, DeallocationSampleRecord& record) {
+    // TODO(mmaas): Do we need to worry about b/65384231 anymore?
+    record.cpu_id = cpu_id;
+    record.vcpu_id = tcmalloc_internal::subtle::percpu::VirtualCpu::get();
+    record.l3_id = GetL3Id(cpu_id);
+    record.numa_id = GetNumaId(cpu_id);
+    record.thread_id = absl::base_internal::GetTID();
+  }
+
  public:
   explicit DeallocationProfiler(DeallocationProfilerList* list) : list_(list) {
     reports_ = std::make_unique<DeallocationStackTraceTable>();
@@ -469,8 +564,15 @@ class DeallocationProfiler {
   tcmalloc::Profile Stop() {
     if (reports_ != nullptr) {
       // We first remove the profiler from the list to avoid racing with
-      // potential allocations which may modify the allocs_ table.
+      // potential allocations which may add to the buffers.
       list_->Remove(this);
+      for (EventBuffer*& buffer : buffers_) {
+        if (buffer == nullptr) continue;
+        Flush(*buffer);
+        buffer->~EventBuffer();
+        MyAllocator::Free(buffer, sizeof(EventBuffer));
+        buffer = nullptr;
+      }
       reports_->StopAndRecord(allocs_);
       return tcmalloc_internal::ProfileAccessor::MakeProfile(
           std::move(reports_));
@@ -478,89 +580,93 @@ class DeallocationProfiler {
     return tcmalloc::Profile();
   }
 
-  void ReportMalloc(const tcmalloc_internal::StackTrace& stack_trace) {
-    // store sampled alloc in the hashmap
-    DeallocationSampleRecord& allocation =
-        allocs_[stack_trace.sampled_alloc_handle];
-
-    allocation.stack_trace = stack_trace;
-    // TODO(mmaas): Do we need to worry about b/65384231 anymore?
-    allocation.cpu_id = tcmalloc_internal::subtle::percpu::GetRealCpu();
-    allocation.vcpu_id = tcmalloc_internal::subtle::percpu::VirtualCpu::get();
-    allocation.l3_id = GetL3Id(allocation.cpu_id);
-    allocation.numa_id = GetNumaId(allocation.cpu_id);
-    allocation.thread_id = absl::base_internal::GetTID();
-  }
-
-  void ReportFree(tcmalloc_internal::AllocHandle handle) {
-    auto it = allocs_.find(handle);
-
-    // Handle the case that we observed the deallocation but not the allocation
-    if (it == allocs_.end()) {
-      return;
-    }
-
-    DeallocationSampleRecord sample = it->second;
-    allocs_.erase(it);
-
-    DeallocationSampleRecord deallocation;
-    deallocation.stack_trace = sample.stack_trace;
-    deallocation.stack_trace.allocation_time = absl::Now();
-    deallocation.cpu_id = tcmalloc_internal::subtle::percpu::GetRealCpu();
-    deallocation.vcpu_id = tcmalloc_internal::subtle::percpu::VirtualCpu::get();
-    deallocation.l3_id = GetL3Id(deallocation.cpu_id);
-    deallocation.numa_id = GetNumaId(deallocation.cpu_id);
-    deallocation.thread_id = absl::base_internal::GetTID();
-    deallocation.stack_trace.depth = absl::GetStackTrace(
-        deallocation.stack_trace.stack, tcmalloc_internal::kMaxStackDepth, 1);
-
-    reports_->AddTrace(sample, deallocation);
+  // Records a live allocation directly, for seeding a new profiler.
+  void SeedMalloc(const tcmalloc_internal::StackTrace& stack_trace) {
+    Event event = {stack_trace.sampled_alloc_handle, /*is_free=*/false};
+    event.record.stack_trace = stack_trace;
+    FillLocation(tcmalloc_internal::subtle::percpu::GetRealCpu(), event.record);
+    AllocationGuardSpinLockHolder h(match_lock_);
+    Match(event);
   }
 };
 
 void DeallocationProfilerList::Add(DeallocationProfiler* profiler) {
-  AllocationGuardSpinLockHolder h(profilers_lock_);
-  profiler->next_ = first_;
-  first_ = profiler;
+  {
+    AllocationGuardSpinLockHolder h(profilers_lock_);
+    profiler->next_.store(first_.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+    first_.store(profiler, std::memory_order_release);
+  }
 
-  // Whenever a new profiler is created, we seed it with live allocations.
+  // Whenever a new profiler is created, we seed it with live allocations.  An
+  // allocation reported concurrently may be recorded twice, to the same effect.
   tcmalloc_internal::tc_globals.sampled_allocation_recorder().Iterate(
       [profiler](
           const tcmalloc_internal::SampledAllocation& sampled_allocation) {
-        profiler->ReportMalloc(sampled_allocation.sampled_stack);
+        profiler->SeedMalloc(
+            tcmalloc_internal::tc_globals.stack_depot().Restore(
+                sampled_allocation.sampled_stack, sampled_allocation.stack_id));
       });
 }
 
 // This list is very short and we're nowhere near a hot path, just walk
 void DeallocationProfilerList::Remove(DeallocationProfiler* profiler) {
-  AllocationGuardSpinLockHolder h(profilers_lock_);
-  DeallocationProfiler** link = &first_;
-  DeallocationProfiler* cur = first_;
-  while (cur != profiler) {
-    TC_CHECK_NE(cur, nullptr);
-    link = &cur->next_;
-    cur = cur->next_;
+  {
+    AllocationGuardSpinLockHolder h(profilers_lock_);
+    std::atomic<DeallocationProfiler*>* link = &first_;
+    DeallocationProfiler* cur = first_.load(std::memory_order_relaxed);
+    while (cur != profiler) {
+      TC_CHECK_NE(cur, nullptr);
+      link = &cur->next_;
+      cur = cur->next_.load(std::memory_order_relaxed);
+    }
+    link->store(profiler->next_.load(std::memory_order_relaxed),
+                std::memory_order_release);
+  }
+
+  // Reporters may still be walking past profiler.  Each holds a shard lock
+  // while it does, so once we have held every shard lock, none is.
+  for (Shard& shard : shards_) {
+    AllocationGuardSpinLockHolder h(shard.lock);
   }
-  *link = profiler->next_;
 }
 
 void DeallocationProfilerList::ReportMalloc(
     const tcmalloc_internal::StackTrace& stack_trace) {
-  AllocationGuardSpinLockHolder h(profilers_lock_);
-  DeallocationProfiler* cur = first_;
-  while (cur != nullptr) {
-    cur->ReportMalloc(stack_trace);
-    cur = cur->next_;
+  if (first_.load(std::memory_order_relaxed) == nullptr) return;
+
+  DeallocationProfiler::Event event = {stack_trace.sampled_alloc_handle,
+                                       /*is_free=*/false};
+  event.record.stack_trace = stack_trace;
+  const int cpu = tcmalloc_internal::subtle::percpu::GetRealCpu();
+  DeallocationProfiler::FillLocation(cpu, event.record);
+
+  const int shard = ShardFor(cpu);
+  AllocationGuardSpinLockHolder h(shards_[shard].lock);
+  for (DeallocationProfiler* cur = first_.load(std::memory_order_acquire);
+       cur != nullptr; cur = cur->next_.load(std::memory_order_acquire)) {
+    cur->Report(shard, event);
   }
 }
 
 void DeallocationProfilerList::ReportFree(
     tcmalloc_internal::AllocHandle handle) {
-  AllocationGuardSpinLockHolder h(profilers_lock_);
-  DeallocationProfiler* cur = first_;
-  while (cur != nullptr) {
-    cur->ReportFree(handle);
-    cur = cur->next_;
+  if (first_.load(std::memory_order_relaxed) == nullptr) return;
+
+  DeallocationProfiler::Event event = {handle, /*is_free=*/true};
+  tcmalloc_internal::StackTrace& stack_trace = event.record.stack_trace;
+  stack_trace.allocation_time = absl::Now();
+  stack_trace.depth =
+      absl::GetStackTrace(stack_trace.stack, tcmalloc_internal::kMaxStackDepth,
+                          /*skip_count=*/0);
+  const int cpu = tcmalloc_internal::subtle::percpu::GetRealCpu();
+  DeallocationProfiler::FillLocation(cpu, event.record);
+
+  const int shard = ShardFor(cpu);
+  AllocationGuardSpinLockHolder h(shards_[shard].lock);
+  for (DeallocationProfiler* cur = first_.load(std::memory_order_acquire);
+       cur != nullptr; cur = cur->next_.load(std::memory_order_acquire)) {
+    cur->Report(shard, event);
   }
 }
 
@@ -15,10 +15,12 @@
 #ifndef TCMALLOC_DEALLOCATION_PROFILER_H_
 #define TCMALLOC_DEALLOCATION_PROFILER_H_
 
+#include <atomic>
 #include <memory>
 
 #include "absl/base/const_init.h"
 #include "absl/base/internal/spinlock.h"
+#include "absl/base/optimization.h"
 #include "absl/time/time.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -30,20 +32,36 @@ namespace deallocationz {
 
 class DeallocationProfiler;
 
+// Sampled allocations and deallocations are reported to every active profiler.
+// Reports are buffered by each profiler per shard of CPUs, under that shard's
+// lock, and matched up in batches, so reporting does not serialize the
+// process on a single lock.
 class DeallocationProfilerList {
  public:
+  static constexpr int kNumShards = 64;
+
   constexpr DeallocationProfilerList() = default;
 
   void ReportMalloc(const tcmalloc_internal::StackTrace& stack_trace);
   void ReportFree(tcmalloc_internal::AllocHandle handle);
   void Add(
       DeallocationProfiler* absl_nonnull profiler TCMALLOC_CAPTURED_BY_THIS);
+  // Once this returns, no report is being delivered to profiler.
   void Remove(DeallocationProfiler* absl_nonnull profiler);
 
  private:
-  DeallocationProfiler* absl_nullable first_ = nullptr;
+  struct ABSL_CACHELINE_ALIGNED Shard {
+    absl::base_internal::SpinLock lock{
+        absl::base_internal::SCHEDULE_KERNEL_ONLY};
+  };
+
+  static int ShardFor(int cpu) { return cpu < 0 ? 0 : cpu % kNumShards; }
+
+  // Written under profilers_lock_, read by reporters under a shard lock.
+  std::atomic<DeallocationProfiler*> first_ = nullptr;
   absl::base_internal::SpinLock profilers_lock_{
       absl::base_internal::SCHEDULE_KERNEL_ONLY};
+  Shard shards_[kNumShards];
 };
 
 class DeallocationSample final
@@ -0,0 +1,65 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/defragmentation.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absl/numeric/bits.h"
+#include "absl/types/span.h"
+#include "tcmalloc/central_freelist.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/mesh_estimator.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+MallocExtension::DefragmentationStats Defragment(
+    Static& state, MallocExtension::Relocator relocator, size_t budget) {
+  MallocExtension::DefragmentationStats stats;
+  SpanSnapshot spans[kMaxLeastOccupiedSpans];
+  for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+    const size_t size = state.sizemap().class_to_size(size_class);
+    if (size == 0) continue;
+    const size_t n =
+        state.central_freelist(size_class).LeastOccupiedSpans(spans);
+    for (size_t i = 0; i < n; ++i) {
+      ++stats.spans;
+      char* start = static_cast<char*>(spans[i].start);
+      for (size_t word = 0; word < spans[i].occupancy.size(); ++word) {
+        for (uint64_t bits = spans[i].occupancy[word]; bits != 0;
+             bits &= bits - 1) {
+          if (stats.bytes_offered + size > budget) return stats;
+          const size_t index = word * 64 + absl::countr_zero(bits);
+          ++stats.objects_offered;
+          stats.bytes_offered += size;
+          if (relocator(start + index * size, size)) {
+            ++stats.objects_relocated;
+            stats.bytes_relocated += size;
+          }
+        }
+      }
+    }
+  }
+  return stats;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,40 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_DEFRAGMENTATION_H_
+#define TCMALLOC_DEFRAGMENTATION_H_
+
+#include <stddef.h>
+
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Implements MallocExtension::Defragment: offers relocator the allocated
+// objects of the least occupied spans of each size class, sparsest first, until
+// budget bytes were offered.  The spans are snapshotted under the central
+// freelist lock, and relocator is called after it is dropped, so an object may
+// have been freed, or even reallocated, by the time it is offered.
+MallocExtension::DefragmentationStats Defragment(
+    Static& state, MallocExtension::Relocator relocator, size_t budget);
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_DEFRAGMENTATION_H_
@@ -0,0 +1,199 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_DONATION_POLICY_H_
+#define TCMALLOC_DONATION_POLICY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "absl/numeric/bits.h"
+#include "absl/time/time.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/pages.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// What to do with the slack on the last hugepage of a large allocation.
+enum class DonationDecision : uint8_t {
+  // Donate the rest of the hugepage to the filler.
+  kDonate,
+  // Allocate from a HugeRegion instead, which has no slack of its own.
+  kRegion,
+  // Leave the rest of the hugepage empty, so that the whole range goes back
+  // to the HugeCache once the allocation is freed.
+  kLeaveEmpty,
+  kNumDecisions,
+};
+
+// Learns, per size bucket, whether donating the slack of large allocations to
+// the filler pays off.
+//
+// A donation goes wrong when the allocation is freed while the filler still
+// uses its last hugepage: the hugepage is then abandoned to the filler, and
+// kept alive by whatever small allocations landed there.  Each freed donating
+// allocation votes against donation for its bucket if it abandoned its
+// hugepage, and for it otherwise.  Counters saturate at +/-kMaxVotes, and
+// buckets with at least kMinVotes against stop donating.  They still donate
+// one allocation in kExploreInterval, so that their votes can recover.
+//
+// Buckets that stopped donating use a HugeRegion if their allocations are
+// long-lived and leave more than half a hugepage of slack, as a region packs
+// them without slack; otherwise the slack is left empty.
+//
+// Not thread-safe; the HugePageAwareAllocator guards it with pageheap_lock.
+class DonationPolicy {
+ public:
+  // Allocations are bucketed by size, kBucketsPerDoubling buckets per
+  // doubling from one hugepage up.  Larger allocations share the last bucket.
+  static constexpr size_t kBucketsPerDoubling = 4;
+  static constexpr size_t kNumBuckets = 32;
+  static constexpr int8_t kMaxVotes = 16;
+  static constexpr int8_t kMinVotes = 4;
+  static constexpr size_t kExploreInterval = 16;
+  static constexpr absl::Duration kLongLivedThreshold = absl::Seconds(1);
+
+  constexpr DonationPolicy() = default;
+  DonationPolicy(const DonationPolicy&) = delete;
+  DonationPolicy& operator=(const DonationPolicy&) = delete;
+
+  // REQUIRES: n > kPagesPerHugePage
+  static size_t Bucket(Length n) {
+    TC_ASSERT_GT(n, kPagesPerHugePage);
+    // In units of 1/kBucketsPerDoubling hugepage, so at least
+    // kBucketsPerDoubling.
+    const size_t units =
+        n.raw_num() / (kPagesPerHugePage.raw_num() / kBucketsPerDoubling);
+    const int log = absl::bit_width(units) - 1;
+    constexpr int kSubBits = absl::countr_zero(kBucketsPerDoubling);
+    const size_t sub = (units >> (log - kSubBits)) & (kBucketsPerDoubling - 1);
+    return std::min((log - kSubBits) * kBucketsPerDoubling + sub,
+                    kNumBuckets - 1);
+  }
+
+  // Returns the smallest allocation, in bytes, that falls into bucket.
+  static size_t BucketStart(size_t bucket) {
+    const size_t units = (kBucketsPerDoubling + bucket % kBucketsPerDoubling)
+                         << (bucket / kBucketsPerDoubling);
+    return units * (kHugePageSize / kBucketsPerDoubling);
+  }
+
+  // Decides what to do with the slack of an allocation of n pages.
+  //
+  // REQUIRES: n > kPagesPerHugePage and n is not a multiple of it.
+  DonationDecision Decide(Length n) {
+    BucketState& b = buckets_[Bucket(n)];
+    if (b.votes < kMinVotes || ++b.explored % kExploreInterval == 0) {
+      return DonationDecision::kDonate;
+    }
+    const Length slack = HLFromPages(n).in_pages() - n;
+    const size_t frees = b.abandoned + b.reclaimed;
+    const bool long_lived =
+        b.total_lifetime >= kLongLivedThreshold * static_cast<double>(frees);
+    return long_lived && slack > kPagesPerHugePage / 2
+               ? DonationDecision::kRegion
+               : DonationDecision::kLeaveEmpty;
+  }
+
+  // Records that an allocation of n pages was made as per decision, which
+  // may differ from what Decide() returned if it could not be followed.
+  void RecordAllocation(Length n, DonationDecision decision) {
+    ++buckets_[Bucket(n)].decisions[static_cast<size_t>(decision)];
+  }
+
+  // Records that a donating allocation of n pages was freed after lifetime,
+  // and whether it abandoned its last hugepage to the filler.
+  void RecordFree(Length n, bool abandoned, absl::Duration lifetime) {
+    BucketState& b = buckets_[Bucket(n)];
+    if (abandoned) {
+      ++b.abandoned;
+      if (b.votes < kMaxVotes) ++b.votes;
+    } else {
+      ++b.reclaimed;
+      if (b.votes > -kMaxVotes) --b.votes;
+    }
+    b.total_lifetime += lifetime;
+  }
+
+  void Print(Printer& out) const {
+    out.printf(
+        "HugePageAware: donation policy (per size: donated, to regions, left "
+        "empty; abandoned, reclaimed; mean lifetime; votes against)\n");
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      const BucketState& b = buckets_[i];
+      if (b.empty()) continue;
+      out.printf(
+          "HugePageAware: donation policy >= %7.2f MiB: %zu, %zu, %zu; %zu, "
+          "%zu; %.3fs; %d\n",
+          BucketStart(i) / 1048576.0, b.count(DonationDecision::kDonate),
+          b.count(DonationDecision::kRegion),
+          b.count(DonationDecision::kLeaveEmpty), b.abandoned, b.reclaimed,
+          b.mean_lifetime_seconds(), b.votes);
+    }
+  }
+
+  void PrintInPbtxt(PbtxtRegion& hpaa) const {
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      const BucketState& b = buckets_[i];
+      if (b.empty()) continue;
+      PbtxtRegion region = hpaa.CreateSubRegion("donation_policy");
+      region.PrintI64("min_bytes", BucketStart(i));
+      region.PrintI64("donated", b.count(DonationDecision::kDonate));
+      region.PrintI64("to_regions", b.count(DonationDecision::kRegion));
+      region.PrintI64("left_empty", b.count(DonationDecision::kLeaveEmpty));
+      region.PrintI64("abandoned", b.abandoned);
+      region.PrintI64("reclaimed", b.reclaimed);
+      region.PrintDouble("mean_lifetime_seconds", b.mean_lifetime_seconds());
+      region.PrintI64("votes", b.votes);
+    }
+  }
+
+ private:
+  struct BucketState {
+    int8_t votes = 0;
+    size_t explored = 0;
+    size_t decisions[static_cast<size_t>(DonationDecision::kNumDecisions)] =
+        {};
+    size_t abandoned = 0;
+    size_t reclaimed = 0;
+    absl::Duration total_lifetime;
+
+    size_t count(DonationDecision d) const {
+      return decisions[static_cast<size_t>(d)];
+    }
+    bool empty() const {
+      return count(DonationDecision::kDonate) == 0 &&
+             count(DonationDecision::kRegion) == 0 &&
+             count(DonationDecision::kLeaveEmpty) == 0;
+    }
+    double mean_lifetime_seconds() const {
+      const size_t frees = abandoned + reclaimed;
+      return frees == 0 ? 0 : absl::ToDoubleSeconds(total_lifetime) / frees;
+    }
+  };
+
+  BucketState buckets_[kNumBuckets];
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_DONATION_POLICY_H_
@@ -0,0 +1,110 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/donation_policy.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/pages.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+TEST(DonationPolicyTest, Buckets) {
+  const Length hp = kPagesPerHugePage;
+  EXPECT_EQ(DonationPolicy::Bucket(hp + Length(1)), 0);
+  EXPECT_EQ(DonationPolicy::Bucket(hp * 2 - Length(1)), 3);
+  EXPECT_EQ(DonationPolicy::Bucket(hp * 2 + Length(1)), 4);
+  EXPECT_EQ(DonationPolicy::Bucket(hp * 100000 + Length(1)),
+            DonationPolicy::kNumBuckets - 1);
+  EXPECT_EQ(DonationPolicy::BucketStart(0), kHugePageSize);
+  EXPECT_EQ(DonationPolicy::BucketStart(1), kHugePageSize * 5 / 4);
+  EXPECT_EQ(DonationPolicy::BucketStart(4), 2 * kHugePageSize);
+  for (size_t i = 0; i < DonationPolicy::kNumBuckets; ++i) {
+    EXPECT_EQ(DonationPolicy::Bucket(BytesToLengthFloor(
+                  DonationPolicy::BucketStart(i)) + Length(1)),
+              i);
+  }
+}
+
+TEST(DonationPolicyTest, StopsDonatingAfterAbandonment) {
+  auto policy = std::make_unique<DonationPolicy>();
+  // Leaves most of its last hugepage as slack.
+  const Length n = kPagesPerHugePage + Length(1);
+  for (int i = 0; i < DonationPolicy::kMinVotes; ++i) {
+    EXPECT_EQ(policy->Decide(n), DonationDecision::kDonate);
+    policy->RecordFree(n, /*abandoned=*/true, absl::Milliseconds(1));
+  }
+
+  // Short-lived allocations leave their slack empty, except for occasional
+  // donations to keep learning.
+  size_t donated = 0;
+  for (size_t i = 0; i < DonationPolicy::kExploreInterval; ++i) {
+    const DonationDecision d = policy->Decide(n);
+    if (d == DonationDecision::kDonate) {
+      ++donated;
+    } else {
+      EXPECT_EQ(d, DonationDecision::kLeaveEmpty);
+    }
+  }
+  EXPECT_EQ(donated, 1);
+
+  // Reclaimed donations win the bucket back.
+  for (int i = 0; i < 2 * DonationPolicy::kMinVotes; ++i) {
+    policy->RecordFree(n, /*abandoned=*/false, absl::Milliseconds(1));
+  }
+  EXPECT_EQ(policy->Decide(n), DonationDecision::kDonate);
+}
+
+TEST(DonationPolicyTest, LongLivedUseRegions) {
+  auto policy = std::make_unique<DonationPolicy>();
+  const Length sparse_tail = kPagesPerHugePage * 2 + Length(1);
+  const Length dense_tail = kPagesPerHugePage * 3 - Length(1);
+  for (int i = 0; i < DonationPolicy::kMinVotes; ++i) {
+    policy->RecordFree(sparse_tail, /*abandoned=*/true, absl::Seconds(10));
+    policy->RecordFree(dense_tail, /*abandoned=*/true, absl::Seconds(10));
+  }
+  EXPECT_EQ(policy->Decide(sparse_tail), DonationDecision::kRegion);
+  // Little slack is not worth a region.
+  EXPECT_EQ(policy->Decide(dense_tail), DonationDecision::kLeaveEmpty);
+}
+
+TEST(DonationPolicyTest, Print) {
+  auto policy = std::make_unique<DonationPolicy>();
+  const Length n = kPagesPerHugePage + Length(1);
+  policy->RecordAllocation(n, DonationDecision::kDonate);
+  policy->RecordFree(n, /*abandoned=*/true, absl::Seconds(2));
+  policy->RecordAllocation(n, DonationDecision::kLeaveEmpty);
+
+  std::string buf(4096, '\0');
+  Printer printer(&buf[0], buf.size());
+  policy->Print(printer);
+  buf.resize(strlen(buf.c_str()));
+  EXPECT_THAT(buf, testing::HasSubstr("1, 0, 1; 1, 0; 2.000s; 1\n"));
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -41,7 +41,9 @@ ABSL_ATTRIBUTE_NOINLINE void ReportMismatchedDelete(
     size_t requested_size, std::optional<size_t> allocated_size) {
   TC_LOG("*** GWP-ASan (https://google.github.io/tcmalloc/gwp-asan.html) has detected a memory error ***");
   TC_LOG("Error originates from memory allocated at:");
-  PrintStackTrace(alloc.sampled_stack.stack, alloc.sampled_stack.depth);
+  const absl::Span<void* const> allocation_stack =
+      state.stack_depot().Get(alloc.stack_id);
+  PrintStackTrace(allocation_stack.data(), allocation_stack.size());
 
   size_t maximum_size;
   if (allocated_size.value_or(requested_size) != requested_size) {
@@ -56,8 +58,7 @@ ABSL_ATTRIBUTE_NOINLINE void ReportMismatchedDelete(
   RecordCrash("GWP-ASan", "mismatched-size-delete");
   state.gwp_asan_state().RecordMismatch(
       ptr, size, size, requested_size, maximum_size,
-      absl::MakeSpan(alloc.sampled_stack.stack, alloc.sampled_stack.depth),
-      absl::MakeSpan(stack, depth));
+      allocation_stack, absl::MakeSpan(stack, depth));
 
   if (allocated_size.value_or(requested_size) != requested_size) {
     TC_BUG(
@@ -176,7 +177,7 @@ ABSL_ATTRIBUTE_NOINLINE void ReportCorruptedFree(
 [[noreturn]]
 ABSL_ATTRIBUTE_NOINLINE void ReportCorruptedFree(
     Static& state, std::align_val_t expected_alignment, const void* ptr,
-    absl::Span<void*> allocation_stack) {
+    absl::Span<void* const> allocation_stack) {
   static void* stack[kMaxStackDepth];
   const size_t depth = absl::GetStackTrace(stack, kMaxStackDepth, 1);
 
@@ -193,7 +194,7 @@ ABSL_ATTRIBUTE_NOINLINE void ReportCorruptedFree(
 
 [[noreturn]] ABSL_ATTRIBUTE_NOINLINE void ReportMismatchedFree(
     Static& state, const void* ptr, AllocationType alloc_type,
-    AllocationType dealloc_type, absl::Span<void*> allocation_stack) {
+    AllocationType dealloc_type, absl::Span<void* const> allocation_stack) {
   void* stack[kMaxStackDepth];
   const size_t depth = absl::GetStackTrace(stack, kMaxStackDepth, 1);
 
@@ -208,7 +209,7 @@ ABSL_ATTRIBUTE_NOINLINE void ReportCorruptedFree(
 [[noreturn]] ABSL_ATTRIBUTE_NOINLINE void ReportMismatchedFree(
     Static& state, const void* ptr, std::optional<std::align_val_t> alloc_align,
     std::optional<std::align_val_t> dealloc_align,
-    absl::Span<void*> allocation_stack) {
+    absl::Span<void* const> allocation_stack) {
   void* stack[kMaxStackDepth];
   const size_t depth = absl::GetStackTrace(stack, kMaxStackDepth, 1);
 
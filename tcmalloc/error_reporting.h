@@ -33,12 +33,12 @@ namespace tcmalloc::tcmalloc_internal {
 
 [[noreturn]] ABSL_ATTRIBUTE_NOINLINE void ReportMismatchedFree(
     Static& state, const void* ptr, AllocationType alloc_type,
-    AllocationType dealloc_type, absl::Span<void*> allocation_stack);
+    AllocationType dealloc_type, absl::Span<void* const> allocation_stack);
 
 [[noreturn]] ABSL_ATTRIBUTE_NOINLINE void ReportMismatchedFree(
     Static& state, const void* ptr, std::optional<std::align_val_t> alloc_align,
     std::optional<std::align_val_t> dealloc_align,
-    absl::Span<void*> allocation_stack);
+    absl::Span<void* const> allocation_stack);
 
 [[noreturn]]
 ABSL_ATTRIBUTE_NOINLINE void ReportMismatchedSizeClass(Static& state,
@@ -60,7 +60,7 @@ ABSL_ATTRIBUTE_NOINLINE void ReportCorruptedFree(
 [[noreturn]]
 ABSL_ATTRIBUTE_NOINLINE void ReportCorruptedFree(
     Static& state, std::align_val_t expected_alignment, const void* ptr,
-    absl::Span<void*> allocation_stack);
+    absl::Span<void* const> allocation_stack);
 
 }  // namespace tcmalloc::tcmalloc_internal
 GOOGLE_MALLOC_SECTION_END
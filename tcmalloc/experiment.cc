@@ -239,6 +239,25 @@ void WalkExperiments(
   }
 }
 
+uint64_t ActiveExperimentsId() {
+  // FNV-1a over the active names, each followed by the delimiter.  experiments
+  // is sorted by name, so the order does not depend on the binary.
+  constexpr uint64_t kOffsetBasis = 0xcbf29ce484222325;
+  constexpr uint64_t kPrime = 0x100000001b3;
+  uint64_t id = kOffsetBasis;
+  bool any = false;
+  WalkExperiments([&](absl::string_view name, bool active) {
+    if (!active) return;
+    any = true;
+    for (char c : name) {
+      id = (id ^ static_cast<unsigned char>(c)) * kPrime;
+    }
+    id = (id ^ static_cast<unsigned char>(tcmalloc_internal::kDelimiter)) *
+         kPrime;
+  });
+  return any ? id : 0;
+}
+
 extern "C" void MallocExtension_Internal_GetExperiments(
     tcmalloc::MallocExtension::PropertyMap* result) {
   WalkExperiments([&](absl::string_view name, bool active) {
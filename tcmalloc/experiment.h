@@ -16,6 +16,7 @@
 #define TCMALLOC_EXPERIMENT_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <optional>
 
@@ -65,6 +66,12 @@ std::optional<Experiment> FindExperimentByName(absl::string_view name);
 void WalkExperiments(
     absl::FunctionRef<void(absl::string_view name, bool active)> callback);
 
+// Returns a fingerprint of the set of active experiments, or 0 if none is
+// active.  It only depends on the experiment names, so it is stable across
+// binaries and releases, and can be used to group profiles and stats by
+// experiment arm.
+uint64_t ActiveExperimentsId();
+
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
 
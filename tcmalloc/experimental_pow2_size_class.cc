@@ -105,6 +105,36 @@ static constexpr SizeClassInfo List[] = {
   {131072,     131072,    2},  // 15         1   0.05%      0.03%  100.00%
   {262144,     262144,    2},  // 16         1   0.02%      0.03%  100.00%
 };
+#elif TCMALLOC_PAGE_SHIFT == 16
+static_assert(kMaxSize == 262144, "kMaxSize mismatch");
+static constexpr SizeClassAssumptions Assumptions{
+  .has_expanded_classes = true,
+  .span_size = 64,
+  .sampling_interval = 2097152,
+  .large_size = 1024,
+  .large_size_alignment = 128,
+};
+static constexpr SizeClassInfo List[] = {
+//                                             |      waste       |
+//  bytes  span_bytes batch    class      objs | fixed   sampling |    inc
+  {     0,          0,    0},  //  0         0   0.00%      0.00%    0.00%
+  {     8,      65536,   32},  //  1      8192   0.10%      3.15%    0.00%
+  {    16,      65536,   32},  //  2      4096   0.10%      3.15%  100.00%
+  {    32,      65536,   32},  //  3      2048   0.10%      3.15%  100.00%
+  {    64,      65536,   32},  //  4      1024   0.10%      3.15%  100.00%
+  {   128,      65536,   32},  //  5       512   0.10%      3.15%  100.00%
+  {   256,      65536,   32},  //  6       256   0.10%      3.15%  100.00%
+  {   512,      65536,   32},  //  7       128   0.10%      3.15%  100.00%
+  {  1024,      65536,   32},  //  8        64   0.10%      3.15%  100.00%
+  {  2048,      65536,   32},  //  9        32   0.10%      3.15%  100.00%
+  {  4096,      65536,   16},  // 10        16   0.10%      3.15%  100.00%
+  {  8192,      65536,    8},  // 11         8   0.10%      3.15%  100.00%
+  { 16384,      65536,    4},  // 12         4   0.10%      3.15%  100.00%
+  { 32768,      65536,    2},  // 13         2   0.10%      3.15%  100.00%
+  { 65536,      65536,    2},  // 14         1   0.10%      0.03%  100.00%
+  {131072,     131072,    2},  // 15         1   0.05%      0.03%  100.00%
+  {262144,     262144,    2},  // 16         1   0.02%      0.03%  100.00%
+};
 #elif TCMALLOC_PAGE_SHIFT == 18
 static_assert(kMaxSize == 262144, "kMaxSize mismatch");
 static constexpr SizeClassAssumptions Assumptions{
@@ -224,6 +254,36 @@ static constexpr SizeClassInfo List[] = {
   {131072,     131072,    2},  // 15         1   0.05%      0.03%  100.00%
   {262144,     262144,    2},  // 16         1   0.02%      0.03%  100.00%
 };
+#elif TCMALLOC_PAGE_SHIFT == 16
+static_assert(kMaxSize == 262144, "kMaxSize mismatch");
+static constexpr SizeClassAssumptions Assumptions{
+  .has_expanded_classes = true,
+  .span_size = 64,
+  .sampling_interval = 2097152,
+  .large_size = 1024,
+  .large_size_alignment = 128,
+};
+static constexpr SizeClassInfo List[] = {
+//                                             |      waste       |
+//  bytes  span_bytes batch    class      objs | fixed   sampling |    inc
+  {     0,          0,    0},  //  0         0   0.00%      0.00%    0.00%
+  {     8,      65536,   32},  //  1      8192   0.10%      3.15%    0.00%
+  {    16,      65536,   32},  //  2      4096   0.10%      3.15%  100.00%
+  {    32,      65536,   32},  //  3      2048   0.10%      3.15%  100.00%
+  {    64,      65536,   32},  //  4      1024   0.10%      3.15%  100.00%
+  {   128,      65536,   32},  //  5       512   0.10%      3.15%  100.00%
+  {   256,      65536,   32},  //  6       256   0.10%      3.15%  100.00%
+  {   512,      65536,   32},  //  7       128   0.10%      3.15%  100.00%
+  {  1024,      65536,   32},  //  8        64   0.10%      3.15%  100.00%
+  {  2048,      65536,   32},  //  9        32   0.10%      3.15%  100.00%
+  {  4096,      65536,   16},  // 10        16   0.10%      3.15%  100.00%
+  {  8192,      65536,    8},  // 11         8   0.10%      3.15%  100.00%
+  { 16384,      65536,    4},  // 12         4   0.10%      3.15%  100.00%
+  { 32768,      65536,    2},  // 13         2   0.10%      3.15%  100.00%
+  { 65536,      65536,    2},  // 14         1   0.10%      0.03%  100.00%
+  {131072,     131072,    2},  // 15         1   0.05%      0.03%  100.00%
+  {262144,     262144,    2},  // 16         1   0.02%      0.03%  100.00%
+};
 #elif TCMALLOC_PAGE_SHIFT == 18
 static_assert(kMaxSize == 262144, "kMaxSize mismatch");
 static constexpr SizeClassAssumptions Assumptions{
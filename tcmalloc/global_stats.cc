@@ -14,15 +14,21 @@
 
 #include "tcmalloc/global_stats.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <initializer_list>
 #include <optional>
+#include <string>
 #include <utility>
 
 #include "absl/base/nullability.h"
 #include "absl/base/optimization.h"
+#include "absl/strings/ascii.h"
 #include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
 #include "absl/strings/strip.h"
 #include "absl/time/time.h"
@@ -40,22 +46,29 @@
 #include "tcmalloc/internal/memory_stats.h"
 #include "tcmalloc/internal/memory_tag.h"
 #include "tcmalloc/internal/optimization.h"
+#include "tcmalloc/internal/page_size.h"
 #include "tcmalloc/internal/pageflags.h"
 #include "tcmalloc/internal/percpu.h"
 #include "tcmalloc/internal/system_allocator.h"
 #include "tcmalloc/malloc_hook_invoke.h"
 #include "tcmalloc/metadata_object_allocator.h"
+#include "tcmalloc/object_region.h"
 #include "tcmalloc/page_allocator.h"
 #include "tcmalloc/pagemap.h"
+#include "tcmalloc/persistent_region.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
+#include "tcmalloc/shared_region.h"
+#include "tcmalloc/slow_path_latency.h"
 #include "tcmalloc/span.h"
 #include "tcmalloc/span_stats.h"
 #include "tcmalloc/stack_trace_table.h"
 #include "tcmalloc/static_vars.h"
 #include "tcmalloc/stats.h"
+#include "tcmalloc/tenant_tracker.h"
 #include "tcmalloc/thread_cache.h"
 #include "tcmalloc/transfer_cache.h"
+#include "tcmalloc/vma_stats.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
@@ -75,11 +88,41 @@ static absl::string_view MadviseString() {
       return "MADVISE_FREE_ONLY";
     case MadvisePreference::kFreeAndDontNeed:
       return "MADVISE_FREE_AND_DONTNEED";
+    case MadvisePreference::kAdaptive:
+      return "MADVISE_ADAPTIVE";
   }
 
   ABSL_UNREACHABLE();
 }
 
+// The stats returned by GetHotStats, as of the last ExtractStats.
+struct PublishedHotStats {
+  std::atomic<uint64_t> in_use_by_app{0};
+  std::atomic<uint64_t> heap_size{0};
+  std::atomic<uint64_t> physical_memory_used{0};
+  std::atomic<uint64_t> page_heap_free{0};
+  std::atomic<uint64_t> page_heap_unmapped{0};
+  // PageAllocator::allocated_bytes() when the stats were extracted.
+  std::atomic<int64_t> page_allocated_bytes{0};
+};
+
+ABSL_CONST_INIT static PublishedHotStats published_hot_stats;
+
+static void PublishHotStats(const TCMallocStats& r,
+                            int64_t page_allocated_bytes) {
+  PublishedHotStats& p = published_hot_stats;
+  p.in_use_by_app.store(InUseByApp(r), std::memory_order_relaxed);
+  p.heap_size.store(HeapSizeBytes(r.pageheap), std::memory_order_relaxed);
+  p.physical_memory_used.store(PhysicalMemoryUsed(r),
+                               std::memory_order_relaxed);
+  p.page_heap_free.store(r.pageheap.free_bytes, std::memory_order_relaxed);
+  p.page_heap_unmapped.store(
+      r.pageheap.unmapped_bytes + r.arena.bytes_nonresident,
+      std::memory_order_relaxed);
+  p.page_allocated_bytes.store(page_allocated_bytes,
+                               std::memory_order_relaxed);
+}
+
 // Get stats into "r".  Also, if class_count != NULL, class_count[k]
 // will be set to the total number of objects of size class k in the
 // central cache, transfer cache, and per-thread and per-CPU caches.
@@ -122,15 +165,18 @@ void ExtractStats(TCMallocStats& r, uint64_t* absl_nullable class_count,
   // Add stats from per-thread heaps
   r.thread_bytes = 0;
 
-  r.span_stats = tc_globals.span_allocator().stats();
+  r.span_stats = tc_globals.span_allocator_stats();
   r.stack_stats = tc_globals.sampledallocation_allocator().stats();
   r.linked_sample_stats = tc_globals.linked_sample_allocator().stats();
   r.tc_stats = ThreadCache::GetStats(&r.thread_bytes, class_count);
 
+  int64_t page_allocated_bytes;
   {  // scope
     PageHeapSpinLockHolder l;
+    page_allocated_bytes = tc_globals.page_allocator().allocated_bytes();
     r.metadata_bytes = tc_globals.metadata_bytes();
     r.pagemap_bytes = tc_globals.pagemap().bytes();
+    r.pagemap_leaves = tc_globals.pagemap().leaves();
     r.pageheap = tc_globals.page_allocator().stats();
     r.peak_stats = tc_globals.page_allocator().peak_stats();
     if (small_spans != nullptr) {
@@ -142,7 +188,7 @@ void ExtractStats(TCMallocStats& r, uint64_t* absl_nullable class_count,
 
     // TODO(b/207622377):  Arena is thread-safe, but we take the pageheap_lock
     // to present a consistent view of memory usage.
-    r.arena = tc_globals.arena().stats();
+    r.arena = tc_globals.arena_stats();
 
     const PageReleaseStats release_stats =
         tc_globals.page_allocator().GetReleaseStats();
@@ -155,6 +201,7 @@ void ExtractStats(TCMallocStats& r, uint64_t* absl_nullable class_count,
     r.num_released_soft_limit_exceeded = release_stats.soft_limit_exceeded;
     r.num_released_hard_limit_exceeded = release_stats.hard_limit_exceeded;
 
+    r.large_span_bytes = tc_globals.large_span_cache().bytes();
     r.per_cpu_bytes = 0;
     r.sharded_transfer_bytes = 0;
     r.percpu_metadata_bytes_res = 0;
@@ -186,12 +233,106 @@ void ExtractStats(TCMallocStats& r, uint64_t* absl_nullable class_count,
   } else {
     r.pagemap_root_bytes_res = 0;
   }
+
+  PublishHotStats(r, page_allocated_bytes);
 }
 
 void ExtractTCMallocStats(TCMallocStats& r, bool report_residence) {
   ExtractStats(r, nullptr, nullptr, nullptr, nullptr, report_residence);
 }
 
+static MallocExtension::StatsSnapshot::PageHeapComponent ToPageHeapComponent(
+    const BackingStats& stats) {
+  return {stats.system_bytes, stats.free_bytes, stats.unmapped_bytes};
+}
+
+void GetHotStats(MallocExtension::HotStats& stats) {
+  const PublishedHotStats& p = published_hot_stats;
+  // Spans handed out whole since the stats were published are taken to be in
+  // use by the application, and those freed to have been.  Spans of size
+  // classes are not: their objects may still sit in the caches.
+  const int64_t in_use_by_app =
+      static_cast<int64_t>(p.in_use_by_app.load(std::memory_order_relaxed)) +
+      tc_globals.page_allocator().allocated_bytes() -
+      p.page_allocated_bytes.load(std::memory_order_relaxed);
+  stats.current_allocated_bytes = std::max<int64_t>(in_use_by_app, 0);
+  stats.heap_size = p.heap_size.load(std::memory_order_relaxed);
+  stats.physical_memory_used =
+      p.physical_memory_used.load(std::memory_order_relaxed);
+  stats.page_heap_free = p.page_heap_free.load(std::memory_order_relaxed);
+  stats.page_heap_unmapped =
+      p.page_heap_unmapped.load(std::memory_order_relaxed);
+  stats.per_cpu_caches_active = tc_globals.CpuCacheActive();
+}
+
+// Fills in the byte counts of the caches and the page heap, which is all that
+// the hot stats and the stats snapshot need, and publishes the hot stats.
+// Unlike ExtractStats, it does not count objects per size class or gather span
+// stats, and holds pageheap_lock only while copying the page heap's counters.
+static void ExtractCacheAndPageHeapStats(
+    TCMallocStats& r,
+    PageAllocator::HugePageAwareStats* absl_nullable components) {
+  r.central_bytes = 0;
+  r.transfer_bytes = 0;
+  for (int size_class = 0; size_class < kNumClasses; ++size_class) {
+    const size_t size = tc_globals.sizemap().class_to_size(size_class);
+    r.central_bytes +=
+        size * tc_globals.central_freelist(size_class).length() +
+        tc_globals.central_freelist(size_class).OverheadBytes();
+    r.transfer_bytes +=
+        size * tc_globals.transfer_cache().tc_length(size_class);
+  }
+  r.thread_bytes = 0;
+  ThreadCache::GetStats(&r.thread_bytes, nullptr);
+  r.large_span_bytes = tc_globals.large_span_cache().bytes();
+  r.per_cpu_bytes = 0;
+  r.sharded_transfer_bytes = 0;
+  if (UsePerCpuCache(tc_globals)) {
+    r.per_cpu_bytes = tc_globals.cpu_cache().TotalUsedBytes();
+    r.sharded_transfer_bytes = tc_globals.sharded_transfer_cache().TotalBytes();
+  }
+
+  int64_t page_allocated_bytes;
+  {  // scope
+    PageHeapSpinLockHolder l;
+    page_allocated_bytes = tc_globals.page_allocator().allocated_bytes();
+    r.metadata_bytes = tc_globals.metadata_bytes();
+    r.pageheap = tc_globals.page_allocator().stats();
+    r.arena = tc_globals.arena_stats();
+    r.num_released_total = tc_globals.page_allocator().GetReleaseStats().total;
+    if (components != nullptr) {
+      *components = tc_globals.page_allocator().huge_page_aware_stats();
+    }
+  }
+  PublishHotStats(r, page_allocated_bytes);
+}
+
+void ExtractHotStats(TCMallocStats& r) {
+  ExtractCacheAndPageHeapStats(r, nullptr);
+}
+
+void ExtractStatsSnapshot(MallocExtension::StatsSnapshot& snapshot) {
+  TCMallocStats r;
+  PageAllocator::HugePageAwareStats components;
+  ExtractCacheAndPageHeapStats(r, &components);
+
+  snapshot.in_use_by_app = InUseByApp(r);
+  snapshot.page_heap_free = r.pageheap.free_bytes;
+  snapshot.page_heap_unmapped = r.pageheap.unmapped_bytes;
+  snapshot.central_cache_free = r.central_bytes;
+  snapshot.per_cpu_cache_free = r.per_cpu_bytes;
+  snapshot.sharded_transfer_cache_free = r.sharded_transfer_bytes;
+  snapshot.transfer_cache_free = r.transfer_bytes;
+  snapshot.thread_cache_free = r.thread_bytes;
+  snapshot.metadata = r.metadata_bytes;
+  snapshot.physical_memory_used = PhysicalMemoryUsed(r);
+  snapshot.virtual_memory_used = VirtualMemoryUsed(r);
+  snapshot.huge_page_filler = ToPageHeapComponent(components.filler);
+  snapshot.huge_region_set = ToPageHeapComponent(components.regions);
+  snapshot.huge_cache = ToPageHeapComponent(components.cache);
+  snapshot.released_total = r.num_released_total.in_bytes();
+}
+
 // Because different fields of stats are computed from state protected
 // by different locks, they may be inconsistent.  Prevent underflow
 // when subtracting to avoid gigantic results.
@@ -204,7 +345,8 @@ uint64_t InUseByApp(const TCMallocStats& stats) {
   return StatSub(stats.pageheap.system_bytes,
                  stats.thread_bytes + stats.central_bytes +
                      stats.transfer_bytes + stats.per_cpu_bytes +
-                     stats.sharded_transfer_bytes + stats.pageheap.free_bytes +
+                     stats.sharded_transfer_bytes + stats.large_span_bytes +
+                     stats.pageheap.free_bytes +
                      stats.pageheap.unmapped_bytes);
 }
 
@@ -230,7 +372,8 @@ uint64_t RequiredBytes(const TCMallocStats& stats) {
 
 size_t ExternalBytes(const TCMallocStats& stats) {
   return stats.pageheap.free_bytes + stats.central_bytes + stats.per_cpu_bytes +
-         stats.sharded_transfer_bytes + stats.transfer_bytes +
+         stats.sharded_transfer_bytes + stats.large_span_bytes +
+         stats.transfer_bytes +
          stats.thread_bytes + stats.metadata_bytes +
          stats.arena.bytes_unavailable + stats.arena.bytes_unallocated;
 }
@@ -241,7 +384,7 @@ size_t HeapSizeBytes(const BackingStats& stats) {
 
 size_t LocalBytes(const TCMallocStats& stats) {
   return stats.thread_bytes + stats.per_cpu_bytes +
-         stats.sharded_transfer_bytes;
+         stats.sharded_transfer_bytes + stats.large_span_bytes;
 }
 
 size_t SlackBytes(const BackingStats& stats) {
@@ -280,6 +423,12 @@ static absl::string_view SizeClassConfigurationString(
       return "SIZE_CLASS_REUSE";
     case SizeClassConfiguration::kReuseRelaxedBelow64:
       return "SIZE_CLASS_REUSE_RELAXED_BELOW_64";
+    case SizeClassConfiguration::kCustom:
+      return "SIZE_CLASS_CUSTOM";
+    case SizeClassConfiguration::kRuntime:
+      return "SIZE_CLASS_RUNTIME";
+    case SizeClassConfiguration::kPow2Range:
+      return "SIZE_CLASS_POW2_RANGE";
   }
 
   ASSUME(false);
@@ -344,6 +493,7 @@ void DumpStats(Printer& out, int level) {
       "MALLOC: + %12u (%7.1f MiB) Bytes in central cache freelist\n"
       "MALLOC: + %12u (%7.1f MiB) Bytes in per-CPU cache freelist\n"
       "MALLOC: + %12u (%7.1f MiB) Bytes in Sharded cache freelist\n"
+      "MALLOC: + %12u (%7.1f MiB) Bytes in large span cache freelist\n"
       "MALLOC: + %12u (%7.1f MiB) Bytes in transfer cache freelist\n"
       "MALLOC: + %12u (%7.1f MiB) Bytes in thread cache freelists\n"
       "MALLOC: + %12u (%7.1f MiB) Bytes in malloc metadata\n"
@@ -366,6 +516,7 @@ void DumpStats(Printer& out, int level) {
       "MALLOC:   %12u (%7.1f MiB) Table buckets created\n"
       "MALLOC:   %12u (%7.1f MiB) Pagemap bytes used\n"
       "MALLOC:   %12u (%7.1f MiB) Pagemap root resident bytes\n"
+      "MALLOC:   %12u               Pagemap leaves\n"
       "MALLOC:   %12u (%7.1f MiB) per-CPU slab bytes used\n"
       "MALLOC:   %12u (%7.1f MiB) per-CPU slab resident bytes\n"
       "MALLOC:   %12u (%7.1f MiB) malloc metadata Arena non-resident bytes\n"
@@ -381,6 +532,7 @@ void DumpStats(Printer& out, int level) {
       stats.central_bytes, stats.central_bytes / MiB,
       stats.per_cpu_bytes, stats.per_cpu_bytes / MiB,
       stats.sharded_transfer_bytes, stats.sharded_transfer_bytes / MiB,
+      stats.large_span_bytes, stats.large_span_bytes / MiB,
       stats.transfer_bytes, stats.transfer_bytes / MiB,
       stats.thread_bytes, stats.thread_bytes / MiB,
       stats.metadata_bytes, stats.metadata_bytes / MiB,
@@ -397,13 +549,14 @@ void DumpStats(Printer& out, int level) {
       (stats.tc_stats.total * sizeof(ThreadCache)) / MiB,
       uint64_t(stats.stack_stats.in_use),
       uint64_t(stats.stack_stats.total),
-      (stats.stack_stats.total * sizeof(StackTrace)) / MiB,
+      (stats.stack_stats.total * sizeof(SampledAllocation)) / MiB,
       uint64_t(stats.linked_sample_stats.in_use),
       uint64_t(stats.linked_sample_stats.total),
       (stats.linked_sample_stats.total * sizeof(StackTraceTable::LinkedSample)) / MiB,
       uint64_t(stats.pagemap_bytes),
       stats.pagemap_bytes / MiB,
       stats.pagemap_root_bytes_res, stats.pagemap_root_bytes_res / MiB,
+      uint64_t(stats.pagemap_leaves),
       uint64_t(stats.percpu_metadata_bytes),
       stats.percpu_metadata_bytes / MiB,
       stats.percpu_metadata_bytes_res, stats.percpu_metadata_bytes_res / MiB,
@@ -419,6 +572,22 @@ void DumpStats(Printer& out, int level) {
       stats.arena.blocks
   );
   // clang-format on
+  out.printf("MALLOC:   %12u               Arena hugepages\n",
+             stats.arena.hugepages);
+  // A kernel page larger than ours makes release and residency inexact; see
+  // TCMALLOC_INTERNAL_64K_PAGES.
+  out.printf("MALLOC:   %12u               System page size\n",
+             uint64_t(GetPageSize()));
+  if (tc_globals.numa_topology().numa_aware()) {
+    for (size_t partition = 0; partition < kNumaPartitions; ++partition) {
+      const ArenaStats arena = tc_globals.arena_stats(partition);
+      out.printf(
+          "MALLOC:   %12u (%7.1f MiB) Arena bytes for NUMA partition %zu "
+          "(%zu bytes nonresident, %zu hugepages)\n",
+          arena.bytes_allocated, arena.bytes_allocated / MiB, partition,
+          arena.bytes_nonresident, arena.hugepages);
+    }
+  }
 
   out.printf("MALLOC EXPERIMENTS:");
   WalkExperiments([&](absl::string_view name, bool active) {
@@ -426,6 +595,7 @@ void DumpStats(Printer& out, int level) {
     out.printf(" %s=%s", name, value);
   });
   out.printf("\n");
+  out.printf("MALLOC EXPERIMENT ID: %016x\n", ActiveExperimentsId());
 
   PrintHooksState(out);
   out.printf(
@@ -435,6 +605,15 @@ void DumpStats(Printer& out, int level) {
       tc_globals.sampled_internal_fragmentation_.value(),
       tc_globals.peak_heap_tracker().CurrentPeakSize(),
       tc_globals.total_sampled_count_.value());
+  tc_globals.adaptive_sampling_interval().Print(out);
+  tc_globals.stack_depot().Print(out);
+  if (tc_globals.size_class_configuration() ==
+      SizeClassConfiguration::kPow2Range) {
+    out.printf(
+        "MALLOC POW2 SIZE CLASSES: %zu bytes (sampled cost of rounding up to "
+        "powers of two)\n",
+        tc_globals.sampled_pow2_rounding_.value());
+  }
 
   MemoryStats memstats;
   if (GetMemoryStats(&memstats)) {
@@ -451,7 +630,7 @@ void DumpStats(Printer& out, int level) {
   }
 
   out.printf("\nMachine-level hugepage fragmentation stats:\n");
-  const size_t num_nodes = tc_globals.numa_topology().num_nodes();
+  const size_t num_nodes = tc_globals.scanned_numa_topology().num_nodes();
   for (size_t node = 0; node < num_nodes; node++) {
     std::optional<double> hugepage_frag_ratio =
         GetHugepageFragmentationRatio(node);
@@ -489,7 +668,7 @@ void DumpStats(Printer& out, int level) {
           size_class, tc_globals.sizemap().class_to_size(size_class),
           class_count[size_class], class_bytes / MiB, cumulative / MiB,
           (span_stats[size_class].num_live_spans() *
-           tc_globals.sizemap().class_to_pages(size_class))
+           tc_globals.central_freelist(size_class).pages_per_span())
               .raw_num(),
           span_stats[size_class].num_spans_returned,
           span_stats[size_class].num_spans_requested,
@@ -535,6 +714,26 @@ void DumpStats(Printer& out, int level) {
       tc_globals.central_freelist(size_class).PrintLongLivedSpansMoved(out);
     }
 
+    out.printf("\n");
+    out.printf("------------------------------------------------\n");
+    out.printf("Central cache freelist: Span lifetime predictions\n");
+    out.printf("------------------------------------------------\n");
+    tc_globals.lifetime_predictor().Print(out);
+    for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+      tc_globals.central_freelist(size_class).PrintLifetimePredictions(out);
+    }
+
+    out.printf("------------------------------------------------\n");
+    out.printf("Access hints: Observed page staleness\n");
+    out.printf("------------------------------------------------\n");
+    tc_globals.access_hint_auditor().Print(out);
+
+    out.printf("------------------------------------------------\n");
+    out.printf("Sampled internal fragmentation by size class\n");
+    out.printf("Requests by wasted eighth of the class size, from 0 to 7\n");
+    out.printf("------------------------------------------------\n");
+    tc_globals.size_class_fragmentation().Print(out, tc_globals.sizemap());
+
     out.printf("------------------------------------------------\n");
     out.printf("Central cache freelist: Same-span returns\n");
     out.printf("------------------------------------------------\n");
@@ -542,25 +741,70 @@ void DumpStats(Printer& out, int level) {
       tc_globals.central_freelist(size_class).PrintSameSpanStats(out);
     }
 
+    out.printf("------------------------------------------------\n");
+    out.printf("Central cache freelist: Shards and lock contentions\n");
+    out.printf("Contended lock acquisitions, per shard\n");
+    out.printf("------------------------------------------------\n");
+    for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+      tc_globals.central_freelist(size_class).PrintShardStats(out);
+    }
+
+    out.printf("------------------------------------------------\n");
+    out.printf("Central cache freelist: Empty spans kept for reuse\n");
+    out.printf("------------------------------------------------\n");
+    for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+      tc_globals.central_freelist(size_class).PrintEmptySpanStats(out);
+    }
+
+    if (Parameters::span_mesh_estimation()) {
+      out.printf("------------------------------------------------\n");
+      out.printf("Central cache freelist: Meshable spans\n");
+      out.printf("------------------------------------------------\n");
+      for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+        tc_globals.central_freelist(size_class).PrintMeshStats(out);
+      }
+    }
+
+    if (Parameters::central_freelist_span_sharing()) {
+      out.printf("------------------------------------------------\n");
+      out.printf("Central cache freelist: Span sharing\n");
+      out.printf("------------------------------------------------\n");
+      for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+        tc_globals.central_freelist(size_class).PrintSpanSharingStats(out);
+      }
+    }
+
     tc_globals.transfer_cache().Print(tc_globals.per_size_class_counts(), out);
     tc_globals.sharded_transfer_cache().Print(
         tc_globals.per_size_class_counts(), out);
 
     if (UsePerCpuCache(tc_globals)) {
       tc_globals.cpu_cache().Print(out);
+    } else {
+      ThreadCache::Print(out);
     }
+    tc_globals.large_span_cache().Print(out);
 
     PageFlags pageflags;
     tc_globals.page_allocator().Print(out, MemoryTag::kNormal, pageflags);
-    if (tc_globals.active_partitions() > 1) {
-      tc_globals.page_allocator().Print(out, MemoryTag::kNormalP1, pageflags);
+    for (size_t p = 1; p < tc_globals.active_partitions(); ++p) {
+      tc_globals.page_allocator().Print(out, MultiNormalTag(p), pageflags);
     }
     tc_globals.page_allocator().Print(out, MemoryTag::kSampled, pageflags);
     if (Parameters::heap_partitioning_mode() == HeapPartitioningMode::kFull) {
       tc_globals.page_allocator().Print(out, MemoryTag::kSampledP1, pageflags);
     }
     tc_globals.page_allocator().Print(out, MemoryTag::kCold, pageflags);
+    tc_globals.page_allocator().Print(out, MemoryTag::kSizeClassed, pageflags);
     tc_globals.guardedpage_allocator().Print(out);
+    slow_path_latency.Print(out);
+    PrintObjectRegionStats(out);
+    PrintPersistentRegionStats(out);
+    PrintSharedRegionStats(out);
+    tc_globals.signal_safe_pool().Print(out);
+    PrintVmaStats(out);
+    tc_globals.allocation_rate_tracker().PrintAllocTokens(out);
+    tc_globals.tenant_tracker().Print(out);
 
     out.printf("------------------------------------------------\n");
     out.printf("Configured limits and related statistics\n");
@@ -582,6 +826,28 @@ void DumpStats(Printer& out, int level) {
     out.printf("Number of times memory shrank below hard limit: %lld\n",
                tc_globals.page_allocator().successful_shrinks_after_limit_hit(
                    PageAllocator::kHard));
+    for (auto [kind, name] : {std::pair(PageAllocator::kSoft, "soft"),
+                              std::pair(PageAllocator::kHard, "hard")}) {
+      const PageAllocator& page_allocator = tc_globals.page_allocator();
+      out.printf(
+          "Handling of %s limit hits: %lld free pages, %lld caches, "
+          "%lld breaking hugepages, %lld unsatisfied\n",
+          name, page_allocator.limit_tier_hits(kind, PageAllocator::kFreePages),
+          page_allocator.limit_tier_hits(kind, PageAllocator::kCaches),
+          page_allocator.limit_tier_hits(kind,
+                                         PageAllocator::kBreakingHugepages),
+          page_allocator.limit_tier_hits(kind, PageAllocator::kUnsatisfied));
+    }
+    const PageAllocator::UsageChecks usage_checks =
+        tc_globals.page_allocator().usage_checks();
+    out.printf("Usage limit checks: %lld full, %lld within reservation\n",
+               usage_checks.full, usage_checks.reserved);
+    tc_globals.memory_pressure_governor().Print(out);
+    tc_globals.memory_pressure_notifier().Print(out);
+    tc_globals.pinned_pool().Print(out);
+    tc_globals.background_pacer().Print(out);
+    tc_globals.release_workers().Print(out);
+    tc_globals.parameter_tuner().Print(out);
 
     out.printf("Total number of pages released: %llu (%7.1f MiB)\n",
                stats.num_released_total.in_pages().raw_num(),
@@ -620,6 +886,8 @@ void DumpStats(Printer& out, int level) {
                Parameters::per_cpu_caches() ? 1 : 0);
     out.printf("PARAMETER tcmalloc_max_per_cpu_cache_size %d\n",
                Parameters::max_per_cpu_cache_size());
+    out.printf("PARAMETER tcmalloc_max_per_cpu_cold_cache_size %d\n",
+               Parameters::max_per_cpu_cold_cache_size());
     out.printf("PARAMETER tcmalloc_max_total_thread_cache_bytes %lld\n",
                Parameters::max_total_thread_cache_bytes());
     out.printf("PARAMETER malloc_release_bytes_per_sec %llu\n",
@@ -636,6 +904,8 @@ void DumpStats(Printer& out, int level) {
                Parameters::release_pages_from_huge_region() ? 1 : 0);
     out.printf("PARAMETER tcmalloc_huge_region_adaptive_release %d\n",
                Parameters::huge_region_adaptive_release() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_huge_region_demand_based_release %d\n",
+               Parameters::huge_region_demand_based_release() ? 1 : 0);
     out.printf("PARAMETER tcmalloc_use_wider_slabs %d\n",
                tc_globals.cpu_cache().UseWiderSlabs() ? 1 : 0);
     out.printf("PARAMETER heap_partitioning %d\n",
@@ -649,6 +919,97 @@ void DumpStats(Printer& out, int level) {
     out.printf("PARAMETER madvise %s\n", MadviseString());
     out.printf("PARAMETER tcmalloc_resize_size_class_max_capacity %d\n",
                Parameters::resize_size_class_max_capacity() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_per_cpu_caches_l3_aware_stealing %d\n",
+               Parameters::per_cpu_caches_l3_aware_stealing() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_per_cpu_caches_ranked_shuffle %d\n",
+               Parameters::per_cpu_caches_ranked_shuffle() ? 1 : 0);
+    out.printf(
+        "PARAMETER tcmalloc_per_cpu_caches_dynamic_slab_working_set %d\n",
+        Parameters::per_cpu_caches_dynamic_slab_working_set() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_per_cpu_caches_predictive_refill %d\n",
+               Parameters::per_cpu_caches_predictive_refill() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_transfer_cache_flow_sizing %d\n",
+               Parameters::transfer_cache_flow_sizing() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_per_cpu_caches_capacity_controller %d\n",
+               Parameters::per_cpu_caches_capacity_controller() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_per_cpu_caches_cgroup_aware %d\n",
+               Parameters::per_cpu_caches_cgroup_aware() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_per_cpu_caches_incremental_drain %d\n",
+               Parameters::per_cpu_caches_incremental_drain() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_per_cpu_caches_indirect %d\n",
+               Parameters::per_cpu_caches_indirect() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_per_cpu_caches_reset_after_fork %d\n",
+               Parameters::per_cpu_caches_reset_after_fork() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_large_span_cache %d\n",
+               Parameters::large_span_cache() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_background_adaptive_pacing %d\n",
+               Parameters::background_adaptive_pacing() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_auto_tuner_cpu_weight %d\n",
+               Parameters::auto_tuner_cpu_weight());
+    out.printf("PARAMETER tcmalloc_thread_cache_adaptive_sizing %d\n",
+               Parameters::thread_cache_adaptive_sizing() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_numa_remote_borrow_batches %d\n",
+               Parameters::numa_remote_borrow_batches());
+    out.printf("PARAMETER tcmalloc_refill_prefetch_objects %d\n",
+               Parameters::refill_prefetch_objects());
+    out.printf("PARAMETER tcmalloc_hugepage_collapse_budget_us %d\n",
+               Parameters::hugepage_collapse_budget_us());
+    out.printf("PARAMETER tcmalloc_slow_path_latency_sample_period %d\n",
+               Parameters::slow_path_latency_sample_period());
+    out.printf("PARAMETER tcmalloc_profile_sampling_target_rate %d\n",
+               Parameters::profile_sampling_target_rate());
+    out.printf("PARAMETER tcmalloc_gigantic_page_threshold %lld\n",
+               Parameters::gigantic_page_threshold());
+    out.printf("PARAMETER tcmalloc_eager_populate_threshold %lld\n",
+               Parameters::eager_populate_threshold());
+    out.printf("PARAMETER tcmalloc_far_memory_numa_node %d\n",
+               Parameters::far_memory_numa_node());
+    out.printf("PARAMETER tcmalloc_cgroup_memory_limit_percent %d\n",
+               Parameters::cgroup_memory_limit_percent());
+    out.printf("PARAMETER tcmalloc_central_freelist_max_shards %d\n",
+               Parameters::central_freelist_max_shards());
+    out.printf("PARAMETER tcmalloc_size_class_regions %d\n",
+               Parameters::size_class_regions());
+    out.printf("PARAMETER tcmalloc_numa_return_remote_frees %d\n",
+               Parameters::numa_return_remote_frees() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_span_lifetime_prediction %d\n",
+               Parameters::span_lifetime_prediction() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_access_hint_reclassification %d\n",
+               Parameters::access_hint_reclassification() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_memory_pressure_release %d\n",
+               Parameters::memory_pressure_release() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_allocation_rate_history %d\n",
+               Parameters::allocation_rate_history() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_peak_heap_bucket_interval_ns %lld\n",
+               absl::ToInt64Nanoseconds(
+                   Parameters::peak_heap_bucket_interval()));
+    out.printf("PARAMETER tcmalloc_cold_page_out_idle_time_ns %lld\n",
+               absl::ToInt64Nanoseconds(Parameters::cold_page_out_idle_time()));
+    out.printf("PARAMETER tcmalloc_leak_candidate_min_age_ns %lld\n",
+               absl::ToInt64Nanoseconds(Parameters::leak_candidate_min_age()));
+    out.printf(
+        "PARAMETER tcmalloc_slow_allocation_threshold_ns %lld\n",
+        absl::ToInt64Nanoseconds(Parameters::slow_allocation_threshold()));
+    out.printf("PARAMETER tcmalloc_access_heatmap_interval_ns %lld\n",
+               absl::ToInt64Nanoseconds(Parameters::access_heatmap_interval()));
+    out.printf("PARAMETER tcmalloc_frame_pointer_unwinding %d\n",
+               Parameters::frame_pointer_unwinding() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_prefault_pagemap_leaves %d\n",
+               Parameters::prefault_pagemap_leaves() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_central_freelist_empty_spans %d\n",
+               Parameters::central_freelist_empty_spans() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_span_mesh_estimation %d\n",
+               Parameters::span_mesh_estimation() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_central_freelist_span_sharing %d\n",
+               Parameters::central_freelist_span_sharing() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_central_freelist_adaptive_span_length %d\n",
+               Parameters::central_freelist_adaptive_span_length() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_hugepage_aligned_large_allocations %d\n",
+               Parameters::hugepage_aligned_large_allocations() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_deterministic %d\n",
+               Parameters::deterministic() ? 1 : 0);
+    out.printf("PARAMETER tcmalloc_limit_shrinks_caches %d\n",
+               Parameters::limit_shrinks_caches() ? 1 : 0);
     out.printf(
         "PARAMETER tcmalloc_dense_trackers_sorted_on_spans_allocated 1\n");
     out.printf("PARAMETER min_hot_access_hint %d\n",
@@ -691,6 +1052,57 @@ void DumpStats(Printer& out, int level) {
   }
 }
 
+// Prints the active experiments with the counters each one is expected to
+// move, so that the arms of an experiment can be compared by
+// experiment_id.  Savings are the difference between arms; a single process
+// only sees its own.
+static void PrintExperimentsInPbtxt(PbtxtRegion& region,
+                                    const TCMallocStats& stats) {
+  const uint64_t experiment_id = ActiveExperimentsId();
+  region.PrintString(
+      "experiment_id",
+      absl::AlphaNum(absl::Hex(experiment_id, absl::kZeroPad16)).Piece());
+
+  CpuCache<Static>::CpuCacheMissStats misses;
+  if (tc_globals.CpuCacheActive()) {
+    misses = tc_globals.cpu_cache().GetTotalCacheMissStats();
+  }
+  const uint64_t physical_bytes = PhysicalMemoryUsed(stats);
+  const uint64_t overhead_bytes = physical_bytes - InUseByApp(stats);
+
+  for (const auto& config : experiments) {
+    if (!IsExperimentActive(config.id)) continue;
+
+    PbtxtRegion entry = region.CreateSubRegion("experiment");
+    entry.PrintString("name", config.name);
+    switch (config.id) {
+      case Experiment::TCMALLOC_PER_CPU_CACHE_SIZE_1MB:
+      case Experiment::TEST_ONLY_MM_VCPU:
+      case Experiment::TEST_ONLY_TCMALLOC_SHARDED_TRANSFER_CACHE:
+        entry.PrintI64("per_cpu_cache_underflows", misses.underflows);
+        entry.PrintI64("per_cpu_cache_overflows", misses.overflows);
+        entry.PrintI64("per_cpu_cache_bytes", stats.per_cpu_bytes);
+        entry.PrintI64("sharded_transfer_cache_bytes",
+                       stats.sharded_transfer_bytes);
+        break;
+      case Experiment::TCMALLOC_EAGER_BACKING_V2:
+      case Experiment::TCMALLOC_HUGE_REGION_ADAPTIVE_RELEASE:
+      case Experiment::TEST_ONLY_TCMALLOC_ALWAYS_DISCARDING:
+      case Experiment::TEST_ONLY_TCMALLOC_SUBRELEASE_UNBACKED_PAGES:
+        entry.PrintI64("page_heap_free_bytes", stats.pageheap.free_bytes);
+        entry.PrintI64("page_heap_unmapped_bytes",
+                       stats.pageheap.unmapped_bytes);
+        entry.PrintI64("released_total_bytes",
+                       stats.num_released_total.in_bytes());
+        break;
+      default:
+        break;
+    }
+    entry.PrintI64("physical_memory_used", physical_bytes);
+    entry.PrintI64("overhead_bytes", overhead_bytes);
+  }
+}
+
 void PrintMemoryStatsInPbtxt(PbtxtRegion& region) {
   MemoryStats memstats;
   if (GetMemoryStats(memstats)) {
@@ -732,6 +1144,7 @@ void DumpStatsInPbtxt(Printer& out, int level) {
   region.PrintI64("per_cpu_cache_freelist", stats.per_cpu_bytes);
   region.PrintI64("sharded_transfer_cache_freelist",
                   stats.sharded_transfer_bytes);
+  region.PrintI64("large_span_cache_freelist", stats.large_span_bytes);
   region.PrintI64("transfer_cache_freelist", stats.transfer_bytes);
   region.PrintI64("thread_cache_freelists", stats.thread_bytes);
   region.PrintI64("malloc_metadata", stats.metadata_bytes);
@@ -755,6 +1168,7 @@ void DumpStatsInPbtxt(Printer& out, int level) {
                   uint64_t(stats.linked_sample_stats.total));
   region.PrintI64("pagemap_size", uint64_t(stats.pagemap_bytes));
   region.PrintI64("pagemap_root_residence", stats.pagemap_root_bytes_res);
+  region.PrintI64("pagemap_leaves", uint64_t(stats.pagemap_leaves));
   region.PrintI64("percpu_slab_size", stats.percpu_metadata_bytes);
   region.PrintI64("percpu_slab_residence", stats.percpu_metadata_bytes_res);
   region.PrintI64("peak_backed", stats.peak_stats.backed_bytes);
@@ -764,6 +1178,18 @@ void DumpStatsInPbtxt(Printer& out, int level) {
   region.PrintI64("tcmalloc_huge_page_size", uint64_t(kHugePageSize));
   region.PrintI64("cpus_allowed", CountAllowedCpus());
   region.PrintI64("arena_blocks", stats.arena.blocks);
+  region.PrintI64("arena_hugepages", stats.arena.hugepages);
+  region.PrintI64("system_page_size", uint64_t(GetPageSize()));
+  if (tc_globals.numa_topology().numa_aware()) {
+    for (size_t partition = 0; partition < kNumaPartitions; ++partition) {
+      const ArenaStats arena = tc_globals.arena_stats(partition);
+      PbtxtRegion entry = region.CreateSubRegion("numa_metadata_arena");
+      entry.PrintI64("partition", partition);
+      entry.PrintI64("bytes_allocated", arena.bytes_allocated);
+      entry.PrintI64("bytes_nonresident", arena.bytes_nonresident);
+      entry.PrintI64("hugepages", arena.hugepages);
+    }
+  }
 
   // Print hooks stats.
   region.PrintI64("new_hooks_present", uint64_t(new_hooks_.size()));
@@ -780,6 +1206,8 @@ void DumpStatsInPbtxt(Printer& out, int level) {
     sampled_profiles.PrintI64(
         "current_fragmentation_bytes",
         tc_globals.sampled_internal_fragmentation_.value());
+    sampled_profiles.PrintI64("current_pow2_rounding_bytes",
+                              tc_globals.sampled_pow2_rounding_.value());
     sampled_profiles.PrintI64("peak_bytes",
                               tc_globals.peak_heap_tracker().CurrentPeakSize());
   }
@@ -787,7 +1215,7 @@ void DumpStatsInPbtxt(Printer& out, int level) {
   // Print total process stats (inclusive of non-malloc sources).
   PrintMemoryStatsInPbtxt(region);
 
-  const size_t num_nodes = tc_globals.numa_topology().num_nodes();
+  const size_t num_nodes = tc_globals.scanned_numa_topology().num_nodes();
   for (size_t node = 0; node < num_nodes; node++) {
     std::optional<double> hugepage_frag_ratio =
         GetHugepageFragmentationRatio(node);
@@ -801,6 +1229,14 @@ void DumpStatsInPbtxt(Printer& out, int level) {
 
   region.PrintI64("total_sampled_count",
                   tc_globals.total_sampled_count_.value());
+  {
+    PbtxtRegion adaptive = region.CreateSubRegion("adaptive_sampling");
+    tc_globals.adaptive_sampling_interval().PrintInPbtxt(adaptive);
+  }
+  {
+    PbtxtRegion depot = region.CreateSubRegion("stack_depot");
+    tc_globals.stack_depot().PrintInPbtxt(depot);
+  }
 
   if (level >= 2) {
     for (int size_class = 1; size_class < kNumClasses; ++size_class) {
@@ -824,7 +1260,27 @@ void DumpStatsInPbtxt(Printer& out, int level) {
       tc_globals.central_freelist(size_class).PrintNumSpansUsedInPbtxt(entry);
       tc_globals.central_freelist(size_class)
           .PrintLongLivedSpansMovedInPbtxt(entry);
+      tc_globals.central_freelist(size_class)
+          .PrintLifetimePredictionsInPbtxt(entry);
       tc_globals.central_freelist(size_class).PrintSameSpanStatsInPbtxt(entry);
+      tc_globals.central_freelist(size_class).PrintShardStatsInPbtxt(entry);
+      tc_globals.central_freelist(size_class).PrintEmptySpanStatsInPbtxt(entry);
+      tc_globals.central_freelist(size_class).PrintMeshStatsInPbtxt(entry);
+      tc_globals.central_freelist(size_class)
+          .PrintSpanSharingStatsInPbtxt(entry);
+      tc_globals.size_class_fragmentation().PrintInPbtxt(entry, size_class);
+    }
+    {
+      PbtxtRegion predictor = region.CreateSubRegion("lifetime_predictor");
+      tc_globals.lifetime_predictor().PrintInPbtxt(predictor);
+    }
+    {
+      PbtxtRegion auditor = region.CreateSubRegion("access_hint_auditor");
+      tc_globals.access_hint_auditor().PrintInPbtxt(auditor);
+    }
+    {
+      PbtxtRegion heatmap = region.CreateSubRegion("access_heatmap");
+      tc_globals.access_heatmap().PrintInPbtxt(heatmap, tc_globals.sizemap());
     }
 
     tc_globals.transfer_cache().PrintInPbtxt(tc_globals.per_size_class_counts(),
@@ -834,13 +1290,19 @@ void DumpStatsInPbtxt(Printer& out, int level) {
   }
   if (UsePerCpuCache(tc_globals)) {
     tc_globals.cpu_cache().PrintInPbtxt(region);
+  } else {
+    ThreadCache::PrintInPbtxt(region);
+  }
+  {
+    PbtxtRegion large_span_cache = region.CreateSubRegion("large_span_cache");
+    tc_globals.large_span_cache().PrintInPbtxt(large_span_cache);
   }
 
   PageFlags pageflags;
   tc_globals.page_allocator().PrintInPbtxt(region, MemoryTag::kNormal,
                                            pageflags);
-  if (tc_globals.active_partitions() > 1) {
-    tc_globals.page_allocator().PrintInPbtxt(region, MemoryTag::kNormalP1,
+  for (size_t p = 1; p < tc_globals.active_partitions(); ++p) {
+    tc_globals.page_allocator().PrintInPbtxt(region, MultiNormalTag(p),
                                              pageflags);
   }
   tc_globals.page_allocator().PrintInPbtxt(region, MemoryTag::kSampled,
@@ -850,6 +1312,8 @@ void DumpStatsInPbtxt(Printer& out, int level) {
                                              pageflags);
   }
   tc_globals.page_allocator().PrintInPbtxt(region, MemoryTag::kCold, pageflags);
+  tc_globals.page_allocator().PrintInPbtxt(region, MemoryTag::kSizeClassed,
+                                           pageflags);
   // We do not collect tracking information in pbtxt.
 
   size_t soft_limit_bytes =
@@ -871,6 +1335,59 @@ void DumpStatsInPbtxt(Printer& out, int level) {
       "successful_shrinks_after_hard_limit_hit",
       tc_globals.page_allocator().successful_shrinks_after_limit_hit(
           PageAllocator::kHard));
+  for (auto [kind, name] :
+       {std::pair(PageAllocator::kSoft, "soft_limit_tiers"),
+        std::pair(PageAllocator::kHard, "hard_limit_tiers")}) {
+    const PageAllocator& page_allocator = tc_globals.page_allocator();
+    PbtxtRegion tiers = region.CreateSubRegion(name);
+    tiers.PrintI64("free_pages", page_allocator.limit_tier_hits(
+                                     kind, PageAllocator::kFreePages));
+    tiers.PrintI64(
+        "caches", page_allocator.limit_tier_hits(kind, PageAllocator::kCaches));
+    tiers.PrintI64("breaking_hugepages",
+                   page_allocator.limit_tier_hits(
+                       kind, PageAllocator::kBreakingHugepages));
+    tiers.PrintI64("unsatisfied", page_allocator.limit_tier_hits(
+                                      kind, PageAllocator::kUnsatisfied));
+  }
+  {
+    const PageAllocator::UsageChecks usage_checks =
+        tc_globals.page_allocator().usage_checks();
+    region.PrintI64("full_usage_limit_checks", usage_checks.full);
+    region.PrintI64("reserved_usage_limit_checks", usage_checks.reserved);
+  }
+  {
+    PbtxtRegion governor = region.CreateSubRegion("memory_pressure_governor");
+    tc_globals.memory_pressure_governor().PrintInPbtxt(governor);
+  }
+  {
+    PbtxtRegion notifier = region.CreateSubRegion("memory_pressure_notifier");
+    tc_globals.memory_pressure_notifier().PrintInPbtxt(notifier);
+  }
+  {
+    PbtxtRegion pinned = region.CreateSubRegion("pinned_pool");
+    tc_globals.pinned_pool().PrintInPbtxt(pinned);
+  }
+  {
+    PbtxtRegion pacer = region.CreateSubRegion("background_pacer");
+    tc_globals.background_pacer().PrintInPbtxt(pacer);
+  }
+  {
+    PbtxtRegion workers = region.CreateSubRegion("release_workers");
+    tc_globals.release_workers().PrintInPbtxt(workers);
+  }
+  {
+    PbtxtRegion tuner = region.CreateSubRegion("parameter_tuner");
+    tc_globals.parameter_tuner().PrintInPbtxt(tuner);
+  }
+  {
+    PbtxtRegion allocation_rate = region.CreateSubRegion("allocation_rate");
+    tc_globals.allocation_rate_tracker().PrintInPbtxt(allocation_rate);
+  }
+  {
+    PbtxtRegion tenants = region.CreateSubRegion("tenants");
+    tc_globals.tenant_tracker().PrintInPbtxt(tenants);
+  }
 
   region.PrintI64("num_released_total_pages",
                   stats.num_released_total.in_pages().raw_num());
@@ -890,12 +1407,55 @@ void DumpStatsInPbtxt(Printer& out, int level) {
     tc_globals.guardedpage_allocator().PrintInPbtxt(gwp_asan);
   }
 
+  {
+    PbtxtRegion latency = region.CreateSubRegion("slow_path_latency");
+    slow_path_latency.PrintInPbtxt(latency);
+  }
+
+  {
+    PbtxtRegion regions = region.CreateSubRegion("object_regions");
+    PrintObjectRegionStatsInPbtxt(regions);
+  }
+
+  {
+    PbtxtRegion persistent = region.CreateSubRegion("persistent_regions");
+    PrintPersistentRegionStatsInPbtxt(persistent);
+  }
+
+  {
+    PbtxtRegion shared = region.CreateSubRegion("shared_regions");
+    PrintSharedRegionStatsInPbtxt(shared);
+  }
+
+  {
+    PbtxtRegion signal_safe = region.CreateSubRegion("signal_safe_pool");
+    tc_globals.signal_safe_pool().PrintInPbtxt(signal_safe);
+  }
+
+  {
+    PbtxtRegion vmas = region.CreateSubRegion("vmas");
+    PrintVmaStatsInPbtxt(vmas);
+  }
+
+  {
+    PbtxtRegion experiments = region.CreateSubRegion("experiments");
+    PrintExperimentsInPbtxt(experiments, stats);
+  }
+
   region.PrintI64("memory_release_failures",
                   tc_globals.system_allocator().release_errors());
+  region.PrintI64("scattered_address_reservations",
+                  tc_globals.system_allocator().scattered_reservations());
+  region.PrintBool("mlockall_mode",
+                   tc_globals.system_allocator().mlockall_mode());
+  region.PrintI64("mlocked_releases",
+                  tc_globals.system_allocator().mlocked_releases());
 
   region.PrintBool("tcmalloc_per_cpu_caches", Parameters::per_cpu_caches());
   region.PrintI64("tcmalloc_max_per_cpu_cache_size",
                   Parameters::max_per_cpu_cache_size());
+  region.PrintI64("tcmalloc_max_per_cpu_cold_cache_size",
+                  Parameters::max_per_cpu_cold_cache_size());
   region.PrintI64("tcmalloc_max_total_thread_cache_bytes",
                   Parameters::max_total_thread_cache_bytes());
   region.PrintI64("malloc_release_bytes_per_sec",
@@ -912,6 +1472,8 @@ void DumpStatsInPbtxt(Printer& out, int level) {
                    Parameters::release_pages_from_huge_region());
   region.PrintBool("tcmalloc_huge_region_adaptive_release",
                    Parameters::huge_region_adaptive_release());
+  region.PrintBool("tcmalloc_huge_region_demand_based_release",
+                   Parameters::huge_region_demand_based_release());
   region.PrintI64("profile_sampling_interval",
                   Parameters::profile_sampling_interval());
   region.PrintRaw("percpu_vcpu_type",
@@ -941,6 +1503,98 @@ void DumpStatsInPbtxt(Printer& out, int level) {
   region.PrintRaw("madvise", MadviseString());
   region.PrintBool("tcmalloc_resize_size_class_max_capacity",
                    Parameters::resize_size_class_max_capacity());
+  region.PrintBool("tcmalloc_per_cpu_caches_l3_aware_stealing",
+                   Parameters::per_cpu_caches_l3_aware_stealing());
+  region.PrintBool("tcmalloc_per_cpu_caches_ranked_shuffle",
+                   Parameters::per_cpu_caches_ranked_shuffle());
+  region.PrintBool("tcmalloc_per_cpu_caches_dynamic_slab_working_set",
+                   Parameters::per_cpu_caches_dynamic_slab_working_set());
+  region.PrintBool("tcmalloc_per_cpu_caches_predictive_refill",
+                   Parameters::per_cpu_caches_predictive_refill());
+  region.PrintBool("tcmalloc_transfer_cache_flow_sizing",
+                   Parameters::transfer_cache_flow_sizing());
+  region.PrintBool("tcmalloc_per_cpu_caches_capacity_controller",
+                   Parameters::per_cpu_caches_capacity_controller());
+  region.PrintBool("tcmalloc_per_cpu_caches_cgroup_aware",
+                   Parameters::per_cpu_caches_cgroup_aware());
+  region.PrintBool("tcmalloc_per_cpu_caches_incremental_drain",
+                   Parameters::per_cpu_caches_incremental_drain());
+  region.PrintBool("tcmalloc_per_cpu_caches_indirect",
+                   Parameters::per_cpu_caches_indirect());
+  region.PrintBool("tcmalloc_per_cpu_caches_reset_after_fork",
+                   Parameters::per_cpu_caches_reset_after_fork());
+  region.PrintBool("tcmalloc_large_span_cache",
+                   Parameters::large_span_cache());
+  region.PrintBool("tcmalloc_background_adaptive_pacing",
+                   Parameters::background_adaptive_pacing());
+  region.PrintI64("tcmalloc_auto_tuner_cpu_weight",
+                  Parameters::auto_tuner_cpu_weight());
+  region.PrintBool("tcmalloc_thread_cache_adaptive_sizing",
+                   Parameters::thread_cache_adaptive_sizing());
+  region.PrintI64("tcmalloc_numa_remote_borrow_batches",
+                  Parameters::numa_remote_borrow_batches());
+  region.PrintI64("tcmalloc_refill_prefetch_objects",
+                  Parameters::refill_prefetch_objects());
+  region.PrintI64("tcmalloc_hugepage_collapse_budget_us",
+                  Parameters::hugepage_collapse_budget_us());
+  region.PrintI64("tcmalloc_slow_path_latency_sample_period",
+                  Parameters::slow_path_latency_sample_period());
+  region.PrintI64("tcmalloc_profile_sampling_target_rate",
+                  Parameters::profile_sampling_target_rate());
+  region.PrintI64("tcmalloc_gigantic_page_threshold",
+                  Parameters::gigantic_page_threshold());
+  region.PrintI64("tcmalloc_eager_populate_threshold",
+                  Parameters::eager_populate_threshold());
+  region.PrintI64("tcmalloc_far_memory_numa_node",
+                  Parameters::far_memory_numa_node());
+  region.PrintI64("tcmalloc_cgroup_memory_limit_percent",
+                  Parameters::cgroup_memory_limit_percent());
+  region.PrintI64("tcmalloc_central_freelist_max_shards",
+                  Parameters::central_freelist_max_shards());
+  region.PrintI64("tcmalloc_size_class_regions",
+                  Parameters::size_class_regions());
+  region.PrintBool("tcmalloc_numa_return_remote_frees",
+                   Parameters::numa_return_remote_frees());
+  region.PrintBool("tcmalloc_span_lifetime_prediction",
+                   Parameters::span_lifetime_prediction());
+  region.PrintBool("tcmalloc_access_hint_reclassification",
+                   Parameters::access_hint_reclassification());
+  region.PrintBool("tcmalloc_memory_pressure_release",
+                   Parameters::memory_pressure_release());
+  region.PrintBool("tcmalloc_allocation_rate_history",
+                   Parameters::allocation_rate_history());
+  region.PrintI64(
+      "tcmalloc_peak_heap_bucket_interval_ns",
+      absl::ToInt64Nanoseconds(Parameters::peak_heap_bucket_interval()));
+  region.PrintI64(
+      "tcmalloc_cold_page_out_idle_time_ns",
+      absl::ToInt64Nanoseconds(Parameters::cold_page_out_idle_time()));
+  region.PrintI64(
+      "tcmalloc_leak_candidate_min_age_ns",
+      absl::ToInt64Nanoseconds(Parameters::leak_candidate_min_age()));
+  region.PrintI64(
+      "tcmalloc_slow_allocation_threshold_ns",
+      absl::ToInt64Nanoseconds(Parameters::slow_allocation_threshold()));
+  region.PrintI64(
+      "tcmalloc_access_heatmap_interval_ns",
+      absl::ToInt64Nanoseconds(Parameters::access_heatmap_interval()));
+  region.PrintBool("tcmalloc_frame_pointer_unwinding",
+                   Parameters::frame_pointer_unwinding());
+  region.PrintBool("tcmalloc_prefault_pagemap_leaves",
+                   Parameters::prefault_pagemap_leaves());
+  region.PrintBool("tcmalloc_central_freelist_empty_spans",
+                   Parameters::central_freelist_empty_spans());
+  region.PrintBool("tcmalloc_span_mesh_estimation",
+                   Parameters::span_mesh_estimation());
+  region.PrintBool("tcmalloc_central_freelist_span_sharing",
+                   Parameters::central_freelist_span_sharing());
+  region.PrintBool("tcmalloc_central_freelist_adaptive_span_length",
+                   Parameters::central_freelist_adaptive_span_length());
+  region.PrintBool("tcmalloc_hugepage_aligned_large_allocations",
+                   Parameters::hugepage_aligned_large_allocations());
+  region.PrintBool("tcmalloc_deterministic", Parameters::deterministic());
+  region.PrintBool("tcmalloc_limit_shrinks_caches",
+                   Parameters::limit_shrinks_caches());
   region.PrintBool("tcmalloc_span_lifetime_tracking",
                    Parameters::span_lifetime_tracking() ==
                        central_freelist_internal::LifetimeTracking::kEnabled);
@@ -954,6 +1608,235 @@ void DumpStatsInPbtxt(Printer& out, int level) {
                        EnableUnfilteredCollapse::kEnabled);
 }
 
+static MallocExtension::MemoryBreakdown MemoryBreakdownLeaf(
+    absl::string_view name, uint64_t bytes, uint64_t reclaimable_bytes = 0) {
+  MallocExtension::MemoryBreakdown node;
+  node.name = std::string(name);
+  node.bytes = bytes;
+  node.reclaimable_bytes = reclaimable_bytes;
+  return node;
+}
+
+// Adds `child` to `parent` and to its totals.
+static void AddMemoryBreakdownChild(MallocExtension::MemoryBreakdown& parent,
+                                    MallocExtension::MemoryBreakdown child) {
+  parent.bytes += child.bytes;
+  parent.reclaimable_bytes += child.reclaimable_bytes;
+  parent.children.push_back(std::move(child));
+}
+
+void GetMemoryBreakdown(MallocExtension::MemoryBreakdown& breakdown) {
+  // The cache tiers are read without pageheap_lock.
+  MallocExtension::StatsSnapshot snapshot;
+  ExtractStatsSnapshot(snapshot);
+  const size_t large_span_bytes = tc_globals.large_span_cache().bytes();
+
+  struct TagStats {
+    MemoryTag tag;
+    BackingStats stats;
+    PageAllocator::HugePageAwareStats components;
+  };
+  TagStats tags[kNormalPartitions + 5];
+  size_t num_tags = 0;
+  for (size_t partition = 0; partition < kNormalPartitions; ++partition) {
+    tags[num_tags++].tag = NormalPartitionTag(partition);
+  }
+  for (MemoryTag tag : {MemoryTag::kSizeClassed, MemoryTag::kSampled,
+                        MemoryTag::kSampledP1, MemoryTag::kCold}) {
+    tags[num_tags++].tag = tag;
+  }
+  {
+    PageHeapSpinLockHolder l;
+    for (size_t i = 0; i < num_tags; ++i) {
+      tags[i].stats = tc_globals.page_allocator().stats(tags[i].tag);
+      tags[i].components =
+          tc_globals.page_allocator().huge_page_aware_stats(tags[i].tag);
+    }
+  }
+
+  breakdown = MemoryBreakdownLeaf("tcmalloc", 0);
+  AddMemoryBreakdownChild(
+      breakdown, MemoryBreakdownLeaf("in_use_by_app", snapshot.in_use_by_app));
+
+  MallocExtension::MemoryBreakdown caches = MemoryBreakdownLeaf("caches", 0);
+  const std::pair<absl::string_view, uint64_t> tiers[] = {
+      {"per_cpu", snapshot.per_cpu_cache_free},
+      {"thread", snapshot.thread_cache_free},
+      {"sharded_transfer", snapshot.sharded_transfer_cache_free},
+      {"transfer", snapshot.transfer_cache_free},
+      {"central", snapshot.central_cache_free},
+      {"large_span", large_span_bytes},
+  };
+  for (const auto& [tier, bytes] : tiers) {
+    AddMemoryBreakdownChild(caches, MemoryBreakdownLeaf(tier, bytes));
+  }
+  AddMemoryBreakdownChild(breakdown, std::move(caches));
+
+  MallocExtension::MemoryBreakdown page_heap =
+      MemoryBreakdownLeaf("page_heap", 0);
+  for (size_t i = 0; i < num_tags; ++i) {
+    const TagStats& t = tags[i];
+    if (t.stats.system_bytes == 0) continue;
+    MallocExtension::MemoryBreakdown tag = MemoryBreakdownLeaf(
+        absl::AsciiStrToLower(MemoryTagToLabel(t.tag)), t.stats.free_bytes,
+        t.stats.free_bytes);
+    const std::pair<absl::string_view, const BackingStats*> components[] = {
+        {"filler", &t.components.filler},
+        {"region_set", &t.components.regions},
+        {"cache", &t.components.cache},
+    };
+    for (const auto& [name, stats] : components) {
+      tag.children.push_back(
+          MemoryBreakdownLeaf(name, stats->free_bytes, stats->free_bytes));
+    }
+    AddMemoryBreakdownChild(page_heap, std::move(tag));
+  }
+  AddMemoryBreakdownChild(breakdown, std::move(page_heap));
+
+  AddMemoryBreakdownChild(breakdown,
+                          MemoryBreakdownLeaf("metadata", snapshot.metadata));
+}
+
+// Prints the metadata of an OpenMetrics gauge family measured in bytes.  The
+// name must end in "_bytes".
+static void PrintOpenMetricsGauge(Printer& out, absl::string_view name,
+                                  absl::string_view help) {
+  out.printf("# TYPE %s gauge\n# UNIT %s bytes\n# HELP %s %s\n", name, name,
+             name, help);
+}
+
+// Prints the samples of a page heap in the disjoint states of
+// tcmalloc_page_heap_bytes and tcmalloc_hugepage_component_bytes.
+static void PrintOpenMetricsBacking(Printer& out, absl::string_view name,
+                                    absl::string_view labels,
+                                    const BackingStats& stats) {
+  out.printf("%s{%s,state=\"used\"} %u\n", name, labels,
+             StatSub(stats.system_bytes,
+                     stats.free_bytes + stats.unmapped_bytes));
+  out.printf("%s{%s,state=\"free\"} %u\n", name, labels, stats.free_bytes);
+  out.printf("%s{%s,state=\"unmapped\"} %u\n", name, labels,
+             stats.unmapped_bytes);
+}
+
+void DumpStatsInOpenMetrics(Printer& out) {
+  MallocExtension::StatsSnapshot snapshot;
+  ExtractStatsSnapshot(snapshot);
+
+  struct TagStats {
+    MemoryTag tag;
+    absl::string_view label;
+    int partition;
+    BackingStats stats;
+  };
+  TagStats tags[] = {
+      {MemoryTag::kNormal, "normal", 0, {}},
+      {MemoryTag::kNormalP1, "normal", 1, {}},
+      {MemoryTag::kSizeClassed, "size_classed", 0, {}},
+      {MemoryTag::kSampled, "sampled", 0, {}},
+      {MemoryTag::kSampledP1, "sampled", 1, {}},
+      {MemoryTag::kCold, "cold", 0, {}},
+  };
+  {
+    PageHeapSpinLockHolder l;
+    for (TagStats& t : tags) {
+      t.stats = tc_globals.page_allocator().stats(t.tag);
+    }
+  }
+
+  PrintOpenMetricsGauge(out, "tcmalloc_in_use_by_app_bytes",
+                        "Bytes in use by the application.");
+  out.printf("tcmalloc_in_use_by_app_bytes %u\n", snapshot.in_use_by_app);
+
+  PrintOpenMetricsGauge(out, "tcmalloc_free_bytes",
+                        "Bytes free in each cache tier.");
+  const std::pair<absl::string_view, uint64_t> tiers[] = {
+      {"page_heap", snapshot.page_heap_free},
+      {"central", snapshot.central_cache_free},
+      {"per_cpu", snapshot.per_cpu_cache_free},
+      {"sharded_transfer", snapshot.sharded_transfer_cache_free},
+      {"transfer", snapshot.transfer_cache_free},
+      {"thread", snapshot.thread_cache_free},
+  };
+  for (const auto& [tier, bytes] : tiers) {
+    out.printf("tcmalloc_free_bytes{tier=\"%s\"} %u\n", tier, bytes);
+  }
+
+  PrintOpenMetricsGauge(out, "tcmalloc_unmapped_bytes",
+                        "Bytes of the page heap released to the OS.");
+  out.printf("tcmalloc_unmapped_bytes %u\n", snapshot.page_heap_unmapped);
+  PrintOpenMetricsGauge(out, "tcmalloc_metadata_bytes",
+                        "Bytes in malloc metadata.");
+  out.printf("tcmalloc_metadata_bytes %u\n", snapshot.metadata);
+  PrintOpenMetricsGauge(out, "tcmalloc_physical_memory_used_bytes",
+                        "Bytes of physical memory and swap used.");
+  out.printf("tcmalloc_physical_memory_used_bytes %u\n",
+             snapshot.physical_memory_used);
+  PrintOpenMetricsGauge(out, "tcmalloc_virtual_memory_used_bytes",
+                        "Bytes of address space used.");
+  out.printf("tcmalloc_virtual_memory_used_bytes %u\n",
+             snapshot.virtual_memory_used);
+
+  out.printf(
+      "# TYPE tcmalloc_released_bytes counter\n"
+      "# UNIT tcmalloc_released_bytes bytes\n"
+      "# HELP tcmalloc_released_bytes Bytes released to the OS.\n"
+      "tcmalloc_released_bytes_total %u\n",
+      snapshot.released_total);
+
+  PrintOpenMetricsGauge(out, "tcmalloc_page_heap_bytes",
+                        "Bytes of the page heap by memory tag.");
+  for (const TagStats& t : tags) {
+    if (t.stats.system_bytes == 0) continue;
+    char labels[64];
+    absl::SNPrintF(labels, sizeof(labels),
+                   "memory_tag=\"%s\",numa_partition=\"%d\"", t.label,
+                   t.partition);
+    PrintOpenMetricsBacking(out, "tcmalloc_page_heap_bytes", labels, t.stats);
+  }
+
+  PrintOpenMetricsGauge(out, "tcmalloc_hugepage_component_bytes",
+                        "Bytes of the page heap by hugepage-aware component.");
+  const std::pair<absl::string_view,
+                  const MallocExtension::StatsSnapshot::PageHeapComponent*>
+      components[] = {
+          {"component=\"filler\"", &snapshot.huge_page_filler},
+          {"component=\"region_set\"", &snapshot.huge_region_set},
+          {"component=\"cache\"", &snapshot.huge_cache},
+      };
+  for (const auto& [labels, component] : components) {
+    BackingStats stats;
+    stats.system_bytes = component->system;
+    stats.free_bytes = component->free;
+    stats.unmapped_bytes = component->unmapped;
+    PrintOpenMetricsBacking(out, "tcmalloc_hugepage_component_bytes", labels,
+                            stats);
+  }
+
+  PrintOpenMetricsGauge(out, "tcmalloc_size_class_free_bytes",
+                        "Bytes free in each cache tier by size class.");
+  for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+    const size_t size = tc_globals.sizemap().class_to_size(size_class);
+    if (size == 0) continue;
+    const std::pair<absl::string_view, size_t> objects[] = {
+        {"central", tc_globals.central_freelist(size_class).length()},
+        {"per_cpu", UsePerCpuCache(tc_globals)
+                        ? tc_globals.cpu_cache().TotalObjectsOfClass(size_class)
+                        : 0},
+        {"sharded_transfer",
+         tc_globals.sharded_transfer_cache().TotalObjectsOfClass(size_class)},
+        {"transfer", tc_globals.transfer_cache().tc_length(size_class)},
+    };
+    for (const auto& [tier, count] : objects) {
+      out.printf(
+          "tcmalloc_size_class_free_bytes{size_class=\"%d\","
+          "object_size=\"%u\",tier=\"%s\"} %u\n",
+          size_class, size, tier, size * count);
+    }
+  }
+
+  out.printf("# EOF\n");
+}
+
 bool GetNumericProperty(const char* name_data, size_t name_size,
                         size_t* value) {
   TC_ASSERT(name_data != nullptr || name_size == 0);
@@ -1035,6 +1918,11 @@ bool GetNumericProperty(const char* name_data, size_t name_size,
     return true;
   }
 
+  if (name == "tcmalloc.large_span_cache_free") {
+    *value = tc_globals.large_span_cache().bytes();
+    return true;
+  }
+
   if (name == "tcmalloc.slack_bytes") {
     // Kept for backwards compatibility.  Now defined externally as:
     //    pageheap_free_bytes + pageheap_unmapped_bytes.
@@ -1056,7 +1944,7 @@ bool GetNumericProperty(const char* name_data, size_t name_size,
     PageHeapSpinLockHolder l;
     // Arena non-resident bytes aren't on the page heap, but they are unmapped.
     *value = tc_globals.page_allocator().stats().unmapped_bytes +
-             tc_globals.arena().stats().bytes_nonresident;
+             tc_globals.arena_stats().bytes_nonresident;
     return true;
   }
 
@@ -1065,6 +1953,11 @@ bool GetNumericProperty(const char* name_data, size_t name_size,
     return true;
   }
 
+  if (name == "tcmalloc.sampled_pow2_rounding") {
+    *value = tc_globals.sampled_pow2_rounding_.value();
+    return true;
+  }
+
   if (name == "tcmalloc.max_total_thread_cache_bytes") {
     *value = ThreadCache::overall_thread_cache_size();
     return true;
@@ -1174,6 +2067,11 @@ bool GetNumericProperty(const char* name_data, size_t name_size,
     return true;
   }
 
+  if (name == "tcmalloc.experiment_id") {
+    *value = ActiveExperimentsId();
+    return true;
+  }
+
   const absl::string_view kExperimentPrefix = "tcmalloc.experiment.";
   if (absl::StartsWith(name, kExperimentPrefix)) {
     std::optional<Experiment> exp =
@@ -23,6 +23,7 @@
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/memory_stats.h"
+#include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/metadata_object_allocator.h"
 #include "tcmalloc/page_allocator.h"
 #include "tcmalloc/pages.h"
@@ -40,6 +41,7 @@ struct TCMallocStats {
   uint64_t metadata_bytes;             // Bytes alloced for metadata
   uint64_t sharded_transfer_bytes;     // Bytes in per-CCX cache
   uint64_t per_cpu_bytes;              // Bytes in per-CPU cache
+  uint64_t large_span_bytes;           // Bytes in large span cache
   uint64_t pagemap_root_bytes_res;     // Resident bytes of pagemap root node
   uint64_t percpu_metadata_bytes_res;  // Resident bytes of the per-CPU metadata
   AllocatorStats tc_stats;             // ThreadCache objects
@@ -47,6 +49,7 @@ struct TCMallocStats {
   AllocatorStats stack_stats;          // StackTrace objects
   AllocatorStats linked_sample_stats;  // StackTraceTable::LinkedSample objects
   size_t pagemap_bytes;                // included in metadata bytes
+  size_t pagemap_leaves;               // Leaves allocated by the pagemap
   size_t percpu_metadata_bytes;        // included in metadata bytes
   BackingStats pageheap;               // Stats from page heap
   PageAllocator::PeakStats peak_stats;
@@ -65,6 +68,23 @@ struct TCMallocStats {
 
 void ExtractTCMallocStats(TCMallocStats& r, bool report_residence);
 
+// Fills in only the byte counts of the caches, the page heap and the arena,
+// the metadata bytes and the released pages, and publishes them for
+// GetHotStats.  Much cheaper than ExtractTCMallocStats.
+void ExtractHotStats(TCMallocStats& r);
+
+// Like ExtractTCMallocStats without residence, but holds pageheap_lock only
+// while copying the page heap's counters, and also reports the components of
+// the page heap.
+void ExtractStatsSnapshot(MallocExtension::StatsSnapshot& snapshot);
+
+// Returns the stats published by the last ExtractTCMallocStats,
+// ExtractHotStats or ExtractStatsSnapshot, without locking.
+void GetHotStats(MallocExtension::HotStats& stats);
+
+// Fills in the tree of MallocExtension::GetMemoryBreakdown.
+void GetMemoryBreakdown(MallocExtension::MemoryBreakdown& breakdown);
+
 uint64_t InUseByApp(const TCMallocStats& stats);
 uint64_t VirtualMemoryUsed(const TCMallocStats& stats);
 uint64_t UnmappedBytes(const TCMallocStats& stats);
@@ -79,6 +99,9 @@ size_t SlackBytes(const BackingStats& stats);
 void DumpStats(Printer& out, int level);
 void DumpStatsInPbtxt(Printer& out, int level);
 
+// WRITE stats to "out" in the OpenMetrics text format, without allocating.
+void DumpStatsInOpenMetrics(Printer& out);
+
 // TODO(b/484431489): remove the functions PrintMemoryStatsInPbtxt from the
 // header file.  These functions had been exposed for testing purposes only.
 void PrintMemoryStatsInPbtxt(PbtxtRegion& region);
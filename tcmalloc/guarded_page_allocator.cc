@@ -14,6 +14,7 @@
 
 #include "tcmalloc/guarded_page_allocator.h"
 
+#include <errno.h>
 #include <sys/mman.h>
 
 #include <algorithm>
@@ -38,10 +39,12 @@
 #include "tcmalloc/error_reporting.h"
 #include "tcmalloc/guarded_allocations.h"
 #include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/cache_topology.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/memory_tag.h"
 #include "tcmalloc/internal/page_size.h"
+#include "tcmalloc/internal/percpu.h"
 #include "tcmalloc/internal/system_allocator.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/pagemap.h"
@@ -54,7 +57,7 @@ namespace tcmalloc {
 namespace tcmalloc_internal {
 
 void GuardedPageAllocator::Init(size_t max_allocated_pages,
-                                size_t total_pages) {
+                                size_t total_pages, bool allow_guard_regions) {
   TC_CHECK_GT(max_allocated_pages, 0);
   TC_CHECK_LE(max_allocated_pages, total_pages);
   TC_CHECK_LE(total_pages, kGpaMaxPages);
@@ -67,9 +70,23 @@ void GuardedPageAllocator::Init(size_t max_allocated_pages,
   page_size_ = std::max(kPageSize, static_cast<size_t>(GetPageSize()));
   TC_ASSERT_EQ(page_size_ % kPageSize, 0);
 
-  rand_.Reset(static_cast<uint64_t>(absl::base_internal::CycleClock::Now()) +
-              reinterpret_cast<uintptr_t>(this));
-  MapPages();
+  if (Parameters::deterministic()) {
+    rand_.Reset(1);
+  } else {
+    rand_.Reset(static_cast<uint64_t>(absl::base_internal::CycleClock::Now()) +
+                reinterpret_cast<uintptr_t>(this));
+  }
+  MapPages(allow_guard_regions);
+}
+
+bool GuardedPageAllocator::GuardRegionsSupported() {
+  const size_t page_size = GetPageSize();
+  void* page = mmap(nullptr, page_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (page == MAP_FAILED) return false;
+  const bool supported = madvise(page, page_size, MADV_GUARD_INSTALL) == 0;
+  munmap(page, page_size);
+  return supported;
 }
 
 void GuardedPageAllocator::Destroy() {
@@ -80,6 +97,7 @@ void GuardedPageAllocator::Destroy() {
     TC_ASSERT_NE(err, -1);
     (void)err;
     initialized_ = false;
+    ready_.store(false, std::memory_order_release);
   }
 }
 
@@ -181,12 +199,12 @@ GuardedAllocWithStatus GuardedPageAllocator::Allocate(
 
   // For size == 0, the page remains protected.
   if (size > 0) {
-    if (mprotect(result, page_size_, PROT_READ | PROT_WRITE) == -1) {
-      TC_ASSERT(false, "mprotect(.., PROT_READ|PROT_WRITE) failed");
-      AllocationGuardSpinLockHolder h(guarded_page_lock_);
-      failed_allocations_.LossyAdd(1);
-      successful_allocations_.LossyAdd(-1);
-      FreeSlot(free_slot);
+    if (!SetPageAccess(reinterpret_cast<uintptr_t>(result),
+                       /*accessible=*/true)) {
+      TC_ASSERT(false, "Failed to unprotect guarded page");
+      failed_allocations_.Add(1);
+      successful_allocations_.Add(-1);
+      ReleaseSlot(free_slot);
       return {nullptr, Profile::Sample::GuardedStatus::MProtectFailed};
     }
     // Place some allocations at end of page for better overflow detection.
@@ -223,7 +241,7 @@ GuardedAllocWithStatus GuardedPageAllocator::Allocate(
 // To trigger SEGV handler.
 static ABSL_ATTRIBUTE_NOINLINE ABSL_ATTRIBUTE_NORETURN void ForceTouchPage(
     void* ptr) {
-  // Spin, in case this thread is waiting for concurrent mprotect() to finish.
+  // Spin, in case this thread is waiting for concurrent protection to finish.
   for (;;) {
     *reinterpret_cast<volatile char*>(ptr) = 'X';
   }
@@ -251,18 +269,18 @@ void GuardedPageAllocator::Deallocate(void* absl_nonnull ptr) {
   // Remove allocation (based on allocation stack trace) from filter.
   stacktrace_filter_.Add({d.alloc_trace.stack, d.alloc_trace.depth}, -1);
 
-  // For zero-byte allocations WriteOverflowOccurred() and mprotect are skipped.
+  // For zero-byte allocations WriteOverflowOccurred() and SetPageAccess() are
+  // skipped.
   if (d.requested_size > 0) {
-    // Needs to be done before mprotect() because it accesses the object page to
-    // check canary bytes.
+    // Needs to be done before SetPageAccess() because it accesses the object
+    // page to check canary bytes.
     if (WriteOverflowOccurred(slot)) {
       d.write_overflow_detected = true;
     }
 
-    // Calling mprotect() should also be done outside the guarded_page_lock_
+    // Protecting the page should also be done outside the guarded_page_lock_
     // critical section, since mprotect() can have relatively large latency.
-    TC_CHECK_EQ(
-        0, mprotect(reinterpret_cast<void*>(page_addr), page_size_, PROT_NONE));
+    TC_CHECK(SetPageAccess(page_addr, /*accessible=*/false));
 
     if (d.write_overflow_detected) {
       ForceTouchPage(ptr);
@@ -280,8 +298,7 @@ void GuardedPageAllocator::Deallocate(void* absl_nonnull ptr) {
                         {d.alloc_trace.stack, d.alloc_trace.depth});
   }
 
-  AllocationGuardSpinLockHolder h(guarded_page_lock_);
-  FreeSlot(slot);
+  ReleaseSlot(slot);
 }
 
 size_t GuardedPageAllocator::GetRequestedSize(
@@ -338,6 +355,7 @@ void GuardedPageAllocator::Print(Printer& out) {
       "Allocated High-Watermark: %zu / %zu\n"
       "Object Pages Touched: %zu / %zu\n"
       "Currently Quarantined: %zu\n"
+      "Page Protection: %s\n"
       "PARAMETER tcmalloc_guarded_sample_parameter %d\n",
       // Successful Allocations
       successful_allocations_.value(),
@@ -358,6 +376,8 @@ void GuardedPageAllocator::Print(Printer& out) {
       pages_touched_.value(), total_pages_,
       // Currently Quarantined
       total_pages_ - allocated_pages(),
+      // Page Protection
+      guard_regions_ ? "guard regions" : "mprotect",
       // PARAMETER
       GetChainedInterval());
 }
@@ -378,12 +398,13 @@ void GuardedPageAllocator::PrintInPbtxt(PbtxtRegion& gwp_asan) {
   gwp_asan.PrintI64("max_allocated_pages", max_allocated_pages_);
   gwp_asan.PrintI64("pages_touched", pages_touched_.value());
   gwp_asan.PrintI64("total_pages", total_pages_);
+  gwp_asan.PrintBool("guard_regions", guard_regions_);
   gwp_asan.PrintI64("tcmalloc_guarded_sample_parameter", GetChainedInterval());
 }
 
 // Maps 2 * total_pages_ + 1 pages so that there are total_pages_ unique pages
 // we can return from Allocate with guard pages before and after them.
-void GuardedPageAllocator::MapPages() {
+void GuardedPageAllocator::MapPages(bool allow_guard_regions) {
   AllocationGuardSpinLockHolder h(guarded_page_lock_);
   TC_ASSERT(!first_page_addr_);
   TC_ASSERT_EQ(page_size_ % GetPageSize(), 0);
@@ -402,11 +423,18 @@ void GuardedPageAllocator::MapPages() {
     return;
   }
 
-  // Allocate memory for slot metadata.
-  data_ = reinterpret_cast<SlotMetadata*>(
-      tc_globals.arena().Alloc(sizeof(*data_) * total_pages_));
-  for (size_t i = 0; i < total_pages_; ++i) {
-    new (&data_[i]) SlotMetadata;
+  // The mapping is reserved PROT_NONE.  To use guard regions instead, guard
+  // every page and then open the mapping once, so that slots are opened and
+  // closed without changing its protection, which would split it into one VMA
+  // per slot.  Guards are installed first since they are refused for mlock()ed
+  // mappings, which mprotect() would populate.
+  void* pages = reinterpret_cast<void*>(base_addr);
+  if (allow_guard_regions && madvise(pages, len, MADV_GUARD_INSTALL) == 0) {
+    if (mprotect(pages, len, PROT_READ | PROT_WRITE) == 0) {
+      guard_regions_ = true;
+    } else {
+      madvise(pages, len, MADV_GUARD_REMOVE);
+    }
   }
 
   pages_base_addr_ = base_addr;
@@ -418,34 +446,124 @@ void GuardedPageAllocator::MapPages() {
   initialized_ = true;
 }
 
-// Selects a random slot in O(1) time.
+bool GuardedPageAllocator::SetPageAccess(uintptr_t page_addr, bool accessible) {
+  void* page = reinterpret_cast<void*>(page_addr);
+  if (!guard_regions_) {
+    return mprotect(page, page_size_,
+                    accessible ? PROT_READ | PROT_WRITE : PROT_NONE) == 0;
+  }
+  // Installing a guard region discards the page's contents, which a freed
+  // page no longer needs.
+  const int advice = accessible ? MADV_GUARD_REMOVE : MADV_GUARD_INSTALL;
+  int ret;
+  do {
+    ret = madvise(page, page_size_, advice);
+  } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+  return ret == 0;
+}
+
+void GuardedPageAllocator::AllocateSlotMetadata() {
+  data_ = reinterpret_cast<SlotMetadata*>(
+      tc_globals.arena().Alloc(sizeof(*data_) * total_pages_));
+  for (size_t i = 0; i < total_pages_; ++i) {
+    new (&data_[i]) SlotMetadata;
+  }
+}
+
+void GuardedPageAllocator::AllowAllocations() {
+  if (data_ == nullptr) {
+    AllocateSlotMetadata();
+  }
+  AllocationGuardSpinLockHolder h(guarded_page_lock_);
+  allow_allocations_ = true;
+  ready_.store(initialized_, std::memory_order_release);
+}
+
 ssize_t GuardedPageAllocator::ReserveFreeSlot() {
+  if (!ready_.load(std::memory_order_acquire)) return -1;
+
+  // Claim one of the max_allocated_pages_ first.  Slots outnumber those, so
+  // with a claim in hand a free slot exists in used_pages_ or in some pool.
+  size_t nalloced = allocated_pages_.load(std::memory_order_relaxed);
+  do {
+    if (nalloced >= max_allocated_pages_) {
+      skipped_allocations_noslots_.Add(1);
+      return -1;
+    }
+  } while (!allocated_pages_.compare_exchange_weak(
+      nalloced, nalloced + 1, std::memory_order_relaxed));
+  ++nalloced;
+  size_t high = high_allocated_pages_.load(std::memory_order_relaxed);
+  while (nalloced > high && !high_allocated_pages_.compare_exchange_weak(
+                                high, nalloced, std::memory_order_relaxed)) {
+  }
+  successful_allocations_.Add(1);
+
+  {
+    SlotPool& pool = CurrentPool();
+    AllocationGuardSpinLockHolder h(pool.lock);
+    if (pool.num_free == 0) RefillPool(pool);
+    if (pool.num_free > 0) return pool.free[--pool.num_free];
+  }
+
+  // Another pool holds the free slot we claimed.  It may be moving between
+  // used_pages_ and a pool while we look, so keep looking.
+  for (;;) {
+    const ssize_t slot = StealSlot();
+    if (slot >= 0) return slot;
+  }
+}
+
+void GuardedPageAllocator::ReleaseSlot(size_t slot) {
+  TC_ASSERT_LT(slot, total_pages_);
+  {
+    SlotPool& pool = CurrentPool();
+    AllocationGuardSpinLockHolder h(pool.lock);
+    if (pool.num_freed == kPoolBatch) {
+      AllocationGuardSpinLockHolder g(guarded_page_lock_);
+      for (size_t i = 0; i < pool.num_freed; ++i) FreeSlot(pool.freed[i]);
+      pool.num_freed = 0;
+    }
+    pool.freed[pool.num_freed++] = slot;
+  }
+  // Only now that the slot can be found again may its page be claimed.
+  allocated_pages_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+GuardedPageAllocator::SlotPool& GuardedPageAllocator::CurrentPool() {
+  const CacheTopology& topology = CacheTopology::Instance();
+  const int cpu = subtle::percpu::GetRealCpuUnsafe();
+  if (cpu < 0 || topology.l3_count() <= 1) return pools_[0];
+  return pools_[topology.GetL3FromCpuId(cpu) % kMaxPools];
+}
+
+void GuardedPageAllocator::RefillPool(SlotPool& pool) {
   AllocationGuardSpinLockHolder h(guarded_page_lock_);
-  if (!initialized_ || !allow_allocations_) return -1;
-  if (GetNumAvailablePages() == 0) {
-    skipped_allocations_noslots_.Add(1);
-    return -1;
+  for (size_t i = 0; i < pool.num_freed; ++i) FreeSlot(pool.freed[i]);
+  pool.num_freed = 0;
+  while (pool.num_free < kPoolBatch) {
+    const ssize_t slot = GetFreeSlot();
+    if (slot < 0) break;
+    used_pages_.SetBit(slot);
+    ++used_slots_;
+    pool.free[pool.num_free++] = slot;
   }
-  successful_allocations_.LossyAdd(1);
-
-  const size_t slot = GetFreeSlot();
-  TC_ASSERT(!used_pages_.GetBit(slot));
-  used_pages_.SetBit(slot);
-
-  // Both writes to allocated_pages_ happen under the guarded_page_lock_, so
-  // we do not have to use an atomic fetch_add(), which is more expensive due to
-  // typically imposing a full memory barrier when lowered on e.g. x86. Recent
-  // compiler optimizations will also turn the store(load(relaxed) + N, relaxed)
-  // into a simple add instruction.
-  const size_t nalloced = allocated_pages_.load(std::memory_order_relaxed) + 1;
-  allocated_pages_.store(nalloced, std::memory_order_relaxed);
-  if (nalloced > high_allocated_pages_.load(std::memory_order_relaxed)) {
-    high_allocated_pages_.store(nalloced, std::memory_order_relaxed);
+}
+
+ssize_t GuardedPageAllocator::StealSlot() {
+  for (SlotPool& pool : pools_) {
+    AllocationGuardSpinLockHolder h(pool.lock);
+    if (pool.num_free > 0) return pool.free[--pool.num_free];
+    if (pool.num_freed > 0) {
+      RefillPool(pool);
+      if (pool.num_free > 0) return pool.free[--pool.num_free];
+    }
   }
-  return slot;
+  return -1;
 }
 
-size_t GuardedPageAllocator::GetFreeSlot() {
+ssize_t GuardedPageAllocator::GetFreeSlot() {
+  if (used_slots_ == total_pages_) return -1;
   const size_t idx = rand_.Next() % total_pages_;
   // Find the closest adjacent free slot to the random index.
   ssize_t slot = used_pages_.FindClearBackwards(idx);
@@ -459,9 +577,7 @@ void GuardedPageAllocator::FreeSlot(size_t slot) {
   TC_ASSERT_LT(slot, total_pages_);
   TC_ASSERT(used_pages_.GetBit(slot));
   used_pages_.ClearBit(slot);
-  // Cheaper decrement - see above.
-  allocated_pages_.store(allocated_pages_.load(std::memory_order_relaxed) - 1,
-                         std::memory_order_relaxed);
+  --used_slots_;
 }
 
 uintptr_t GuardedPageAllocator::GetPageAddr(uintptr_t addr) const {
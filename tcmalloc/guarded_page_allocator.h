@@ -24,6 +24,7 @@
 #include "absl/base/const_init.h"
 #include "absl/base/internal/spinlock.h"
 #include "absl/base/nullability.h"
+#include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/guarded_allocations.h"
@@ -46,6 +47,11 @@ namespace tcmalloc_internal {
 // and any future accesses to it will also cause segfaults until the page is
 // reallocated.
 //
+// Pages are made inaccessible with MADV_GUARD_INSTALL guard regions where the
+// kernel supports them (Linux 6.13+), and with mprotect() otherwise.  Guard
+// regions live in the page tables, so unlike mprotect() they do not split the
+// mapping into one VMA per page, and a larger pool is affordable.
+//
 // Is safe to use with static storage duration and is thread safe with the
 // exception of calls to Init() and Destroy() (see corresponding function
 // comments).
@@ -73,7 +79,11 @@ namespace tcmalloc_internal {
 class GuardedPageAllocator {
  public:
   // Maximum number of pages this class can allocate.
-  static constexpr size_t kGpaMaxPages = 512;
+  static constexpr size_t kGpaMaxPages = 1024;
+  // Free slots are handed out from per-L3 cache pools of up to kPoolBatch
+  // slots.  L3 caches beyond kMaxPools share pools.
+  static constexpr size_t kMaxPools = 32;
+  static constexpr size_t kPoolBatch = 8;
 
   constexpr GuardedPageAllocator()
       : guarded_page_lock_(absl::base_internal::SCHEDULE_KERNEL_ONLY),
@@ -87,6 +97,8 @@ class GuardedPageAllocator {
         total_pages_(0),
         page_size_(0),
         rand_(0),
+        guard_regions_(false),
+        ready_(false),
         initialized_(false),
         allow_allocations_(false) {}
 
@@ -99,13 +111,21 @@ class GuardedPageAllocator {
   // time from a pool of total_pages pages, where:
   //   1 <= max_allocated_pages <= total_pages <= kGpaMaxPages
   //
+  // Guard regions are used if allow_guard_regions is true and the kernel
+  // supports them, and mprotect() otherwise.
+  //
   // This method should be called non-concurrently and only once to complete
   // initialization.  Dynamic initialization is deliberately done here and not
   // in the constructor, thereby allowing the constructor to be constexpr and
   // avoiding static initialization order issues.
-  void Init(size_t max_allocated_pages, size_t total_pages)
+  void Init(size_t max_allocated_pages, size_t total_pages,
+            bool allow_guard_regions = true)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Returns true if the kernel supports MADV_GUARD_INSTALL, by installing a
+  // guard region in a scratch mapping.
+  static bool GuardRegionsSupported();
+
   // Unmaps memory allocated by this class.
   //
   // This method should be called non-concurrently and only once to complete
@@ -186,10 +206,8 @@ class GuardedPageAllocator {
   }
 
   // Allows Allocate() to start returning allocations.
-  void AllowAllocations() ABSL_LOCKS_EXCLUDED(guarded_page_lock_) {
-    AllocationGuardSpinLockHolder h(guarded_page_lock_);
-    allow_allocations_ = true;
-  }
+  void AllowAllocations() ABSL_LOCKS_EXCLUDED(guarded_page_lock_)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
   // Returns the number of pages available for allocation, based on how many are
   // currently in use.  (Should only be used in testing.)
@@ -201,11 +219,29 @@ class GuardedPageAllocator {
   void Reset();
 
   size_t page_size() const { return page_size_; }
+  // Returns true if pages are protected with guard regions rather than
+  // mprotect().
+  bool uses_guard_regions() const { return guard_regions_; }
   size_t successful_allocations() const {
     return successful_allocations_.value();
   }
 
  private:
+  // Slots reserved in used_pages_ on behalf of the CPUs sharing an L3 cache,
+  // so that Allocate() and Deallocate() take guarded_page_lock_ once per
+  // kPoolBatch calls rather than on every call.
+  struct ABSL_CACHELINE_ALIGNED SlotPool {
+    absl::base_internal::SpinLock lock{
+        absl::base_internal::SCHEDULE_KERNEL_ONLY};
+    // Free slots, picked at random from used_pages_.
+    uint16_t free[kPoolBatch] ABSL_GUARDED_BY(lock) = {};
+    size_t num_free ABSL_GUARDED_BY(lock) = 0;
+    // Deallocated slots, returned to used_pages_ in a batch so that they are
+    // not reused before a random pick lands on them.
+    uint16_t freed[kPoolBatch] ABSL_GUARDED_BY(lock) = {};
+    size_t num_freed ABSL_GUARDED_BY(lock) = 0;
+  };
+
   // Structure for storing data about a slot.
   struct SlotMetadata {
     GuardedAllocationsStackTrace alloc_trace;
@@ -220,17 +256,43 @@ class GuardedPageAllocator {
   // Max number of magic bytes we use to detect write-overflows at deallocation.
   static constexpr size_t kMagicSize = 32;
 
-  // Maps pages into memory.
-  void MapPages() ABSL_LOCKS_EXCLUDED(guarded_page_lock_)
+  // Maps pages into memory.  With allow_guard_regions, tries to protect them
+  // with guard regions first.
+  void MapPages(bool allow_guard_regions)
+      ABSL_LOCKS_EXCLUDED(guarded_page_lock_)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Makes the page at page_addr accessible or inaccessible.  Returns false on
+  // failure.
+  bool SetPageAccess(uintptr_t page_addr, bool accessible);
+
+  // Allocates data_.  Deferred until allocations are allowed, since most
+  // processes never allow them.
+  void AllocateSlotMetadata() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   // Reserves and returns a slot randomly selected from the free slots in
-  // used_pages_.  Returns -1 if no slots available, or if AllowAllocations()
-  // hasn't been called yet.
+  // used_pages_, by way of the current L3 cache's pool.  Returns -1 if no slots
+  // available, or if AllowAllocations() hasn't been called yet.
   ssize_t ReserveFreeSlot() ABSL_LOCKS_EXCLUDED(guarded_page_lock_);
 
-  // Returns a random free slot in used_pages_.
-  size_t GetFreeSlot() ABSL_EXCLUSIVE_LOCKS_REQUIRED(guarded_page_lock_);
+  // Returns a slot obtained from ReserveFreeSlot().
+  void ReleaseSlot(size_t slot) ABSL_LOCKS_EXCLUDED(guarded_page_lock_);
+
+  // Returns the pool of the current CPU's L3 cache.
+  SlotPool& CurrentPool();
+
+  // Returns pool's deallocated slots to used_pages_ and refills its free slots
+  // from there.
+  void RefillPool(SlotPool& pool) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pool.lock)
+      ABSL_LOCKS_EXCLUDED(guarded_page_lock_);
+
+  // Takes a slot from any pool, for when the current pool cannot be refilled
+  // because every free slot is held by other pools.  Returns -1 if none was
+  // found.
+  ssize_t StealSlot() ABSL_LOCKS_EXCLUDED(guarded_page_lock_);
+
+  // Returns a random free slot in used_pages_, or -1 if there is none.
+  ssize_t GetFreeSlot() ABSL_EXCLUSIVE_LOCKS_REQUIRED(guarded_page_lock_);
 
   // Marks the specified slot as unreserved.
   void FreeSlot(size_t slot) ABSL_EXCLUSIVE_LOCKS_REQUIRED(guarded_page_lock_);
@@ -286,11 +348,16 @@ class GuardedPageAllocator {
   absl::base_internal::SpinLock guarded_page_lock_;
 
   // Maps each bool to one page.
-  // true: reserved. false: freed.
+  // true: reserved (allocated or held by a pool). false: freed.
   Bitmap<kGpaMaxPages> used_pages_ ABSL_GUARDED_BY(guarded_page_lock_);
+  // Number of bits set in used_pages_.
+  size_t used_slots_ ABSL_GUARDED_BY(guarded_page_lock_) = 0;
 
-  // Number of currently allocated pages. Atomic so it may be accessed outside
-  // the guarded_page_lock_ to calculate heuristics based on pool utilization.
+  SlotPool pools_[kMaxPools];
+
+  // Number of currently allocated pages, not counting those held by pools.
+  // Allocations claim a page here before looking for a slot, which bounds
+  // allocations by max_allocated_pages_ without taking a lock.
   std::atomic<size_t> allocated_pages_;
   // The high-water mark for allocated_pages_.
   std::atomic<size_t> high_allocated_pages_;
@@ -310,7 +377,7 @@ class GuardedPageAllocator {
 
   // A dynamically-allocated array of stack trace data captured when each page
   // is allocated/deallocated.  Printed by the SEGV handler when a memory error
-  // is detected.
+  // is detected.  Null until AllowAllocations().
   SlotMetadata* data_;
 
   uintptr_t pages_base_addr_;   // Points to start of mapped region.
@@ -320,6 +387,11 @@ class GuardedPageAllocator {
   size_t total_pages_;          // Size of the page pool to allocate from.
   size_t page_size_;            // Size of pages we allocate.
   Random rand_;
+  // True if pages are protected with guard regions.  Fixed by Init().
+  bool guard_regions_;
+
+  // initialized_ && allow_allocations_, readable without guarded_page_lock_.
+  std::atomic<bool> ready_;
 
   // True if this object has been fully initialized.
   bool initialized_ ABSL_GUARDED_BY(guarded_page_lock_);
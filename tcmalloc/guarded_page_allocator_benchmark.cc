@@ -15,6 +15,7 @@
 #include <algorithm>
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <new>
@@ -26,6 +27,7 @@
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/page_size.h"
+#include "tcmalloc/internal/proc_maps.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/static_vars.h"
@@ -52,18 +54,24 @@ inline auto& GetStackTrace(size_t first_frame) {
   return *s;
 }
 
+GuardedPageAllocator* NewGuardedPageAllocator(bool allow_guard_regions) {
+  auto gpa = new GuardedPageAllocator;
+  PageHeapSpinLockHolder l;
+  gpa->Init(kMaxGpaPages, kMaxGpaPages, allow_guard_regions);
+  gpa->AllowAllocations();
+  // Benchmark should always sample.
+  MallocExtension::SetProfileSamplingInterval(1);
+  MallocExtension::SetGuardedSamplingInterval(1);
+  return gpa;
+}
+
+// Returns an allocator using guard regions if allow_guard_regions is true and
+// they are supported, and mprotect() otherwise.
 std::unique_ptr<GuardedPageAllocator, void (*)(GuardedPageAllocator*)>
-GetGuardedPageAllocator() {
-  static GuardedPageAllocator* gpa = [] {
-    auto gpa = new GuardedPageAllocator;
-    PageHeapSpinLockHolder l;
-    gpa->Init(kMaxGpaPages, kMaxGpaPages);
-    gpa->AllowAllocations();
-    // Benchmark should always sample.
-    MallocExtension::SetProfileSamplingInterval(1);
-    MallocExtension::SetGuardedSamplingInterval(1);
-    return gpa;
-  }();
+GetGuardedPageAllocator(bool allow_guard_regions = true) {
+  static GuardedPageAllocator* guarded = NewGuardedPageAllocator(true);
+  static GuardedPageAllocator* mprotected = NewGuardedPageAllocator(false);
+  GuardedPageAllocator* gpa = allow_guard_regions ? guarded : mprotected;
   return {gpa, +[](GuardedPageAllocator* gpa) {
             // We can't reset GuardedPageAllocator before the benchmark in
             // multi-threaded mode as it might race with pre-initialization and
@@ -91,6 +99,76 @@ void BM_AllocDealloc(benchmark::State& state) {
 BENCHMARK(BM_AllocDealloc)->Range(1, GetGpaPageSize());
 BENCHMARK(BM_AllocDealloc)->Arg(1)->ThreadRange(1, kMaxGpaPages);
 
+// Like BM_AllocDealloc, but each thread keeps its last few allocations live, as
+// a sampled allocation usually is for a while.  Frees then go to the current
+// L3 cache's pool ahead of the allocation that needs a new slot.
+void BM_AllocDeallocLive(benchmark::State& state) {
+  constexpr size_t kLive = 4;
+  auto gpa = GetGuardedPageAllocator();
+  void* live[kLive] = {};
+  size_t i = 0;
+  for (auto _ : state) {
+    if (live[i] != nullptr) gpa->Deallocate(live[i]);
+    live[i] = gpa->Allocate(1, std::align_val_t{0}, GetStackTrace(0)).alloc;
+    i = (i + 1) % kLive;
+  }
+  for (void* ptr : live) {
+    if (ptr != nullptr) gpa->Deallocate(ptr);
+  }
+}
+
+BENCHMARK(BM_AllocDeallocLive)->ThreadRange(1, kMaxGpaPages / 8);
+
+// Returns the number of mappings of this process.
+int64_t CountVmas() {
+  ProcMapsIterator::Buffer buffer;
+  ProcMapsIterator it(&buffer);
+  TC_CHECK(it.Valid());
+  uint64_t start, end, offset;
+  int64_t inode;
+  char *flags, *filename;
+  int64_t count = 0;
+  while (
+      it.NextExt(&start, &end, &flags, &offset, &inode, &filename, nullptr)) {
+    ++count;
+  }
+  return count;
+}
+
+// Compares guard regions (state.range(0) == 1) against mprotect() (0), with
+// state.range(1) allocations live at a time.  The "vmas" counter reports the
+// mappings the live allocations add: each costs two VMAs with mprotect(), since
+// it splits the mapping on either side of the page, and none with guard
+// regions.
+void BM_AllocDeallocProtection(benchmark::State& state) {
+  const bool guard_regions = state.range(0);
+  const size_t live = state.range(1);
+  auto gpa = GetGuardedPageAllocator(guard_regions);
+  if (guard_regions && !gpa->uses_guard_regions()) {
+    state.SkipWithError("MADV_GUARD_INSTALL is unsupported");
+    return;
+  }
+
+  std::vector<void*> ptrs(live);
+  const int64_t vmas_before = CountVmas();
+  int64_t vmas = 0;
+  for (auto _ : state) {
+    for (void*& ptr : ptrs) {
+      ptr = gpa->Allocate(1, std::align_val_t{0}, GetStackTrace(0)).alloc;
+      TC_CHECK_NE(ptr, nullptr);
+      static_cast<char*>(ptr)[0] = 'X';
+    }
+    state.PauseTiming();
+    vmas = CountVmas() - vmas_before;
+    state.ResumeTiming();
+    for (void* ptr : ptrs) gpa->Deallocate(ptr);
+  }
+  state.counters["vmas"] = vmas;
+  state.SetItemsProcessed(state.iterations() * live);
+}
+
+BENCHMARK(BM_AllocDeallocProtection)->ArgsProduct({{0, 1}, {1, 8, 64}});
+
 auto& GetReserved() {
   static auto* ret =
       new std::vector<std::unique_ptr<void, std::function<void(void*)>>>;
@@ -232,6 +232,41 @@ TEST_F(GuardedPageAllocatorTest, Print) {
   EXPECT_THAT(buf, testing::ContainsRegex("GWP-ASan Status"));
 }
 
+TEST_F(GuardedPageAllocatorTest, GuardRegions) {
+  EXPECT_EQ(gpa_.uses_guard_regions(),
+            GuardedPageAllocator::GuardRegionsSupported());
+
+  // Reused slots are protected again, whichever way pages are protected.
+  for (size_t i = 0; i < 2 * kMaxGpaPages; ++i) {
+    char* buf = static_cast<char*>(
+        gpa_.Allocate(PageSize(), std::align_val_t{0}, GetStackTrace()).alloc);
+    ASSERT_NE(buf, nullptr);
+    memset(buf, 'A', PageSize());
+    gpa_.Deallocate(buf);
+    if (i % kMaxGpaPages == 0) EXPECT_DEATH(buf[0] = 'B', "");
+  }
+}
+
+TEST(GuardedPageAllocatorMprotectTest, SingleAllocDealloc) {
+  auto gpa = std::make_unique<GuardedPageAllocator>();
+  {
+    PageHeapSpinLockHolder l;
+    gpa->Init(kMaxGpaPages, kMaxGpaPages, /*allow_guard_regions=*/false);
+    gpa->AllowAllocations();
+  }
+  EXPECT_FALSE(gpa->uses_guard_regions());
+
+  char* buf = static_cast<char*>(
+      gpa->Allocate(PageSize(), std::align_val_t{0}, GetStackTrace()).alloc);
+  ASSERT_NE(buf, nullptr);
+  memset(buf, 'A', PageSize());
+  EXPECT_DEATH(buf[-1] = 'A', "");
+  EXPECT_DEATH(buf[PageSize()] = 'A', "");
+  gpa->Deallocate(buf);
+  EXPECT_DEATH(buf[0] = 'B', "");
+  gpa->Destroy();
+}
+
 TEST_F(GuardedPageAllocatorTest, ZeroByteAllocationAndDeallocation) {
   auto alloc_with_status =
       gpa_.Allocate(0, std::align_val_t{0}, GetStackTrace());
@@ -358,6 +393,39 @@ TEST_F(GuardedPageAllocatorTest, ThreadedHighContention) {
   }
 }
 
+// Test that slots held in the pools of other L3 caches, free or freed, are
+// still found once the current CPU's pool runs dry.
+TEST_F(GuardedPageAllocatorTest, AllPagesReachableFromEveryCpu) {
+  const int num_cpus = NumCPUs();
+  std::vector<void*> ptrs;
+  for (size_t i = 0; i < kMaxGpaPages; ++i) {
+    ScopedFakeCpuId fake_cpu(i % num_cpus);
+    auto alloc_with_status =
+        gpa_.Allocate(1, std::align_val_t{0}, GetStackTrace());
+    ASSERT_EQ(alloc_with_status.status,
+              Profile::Sample::GuardedStatus::Guarded);
+    ptrs.push_back(alloc_with_status.alloc);
+  }
+  for (size_t i = 0; i < ptrs.size(); ++i) {
+    ScopedFakeCpuId fake_cpu((i + 1) % num_cpus);
+    gpa_.Deallocate(ptrs[i]);
+  }
+  ptrs.clear();
+
+  ScopedFakeCpuId fake_cpu(0);
+  absl::flat_hash_set<void*> seen;
+  for (size_t i = 0; i < kMaxGpaPages; ++i) {
+    auto alloc_with_status =
+        gpa_.Allocate(1, std::align_val_t{0}, GetStackTrace());
+    ASSERT_EQ(alloc_with_status.status,
+              Profile::Sample::GuardedStatus::Guarded);
+    EXPECT_TRUE(seen.insert(alloc_with_status.alloc).second);
+  }
+  EXPECT_EQ(gpa_.Allocate(1, std::align_val_t{0}, GetStackTrace()).status,
+            Profile::Sample::GuardedStatus::NoAvailableSlots);
+  for (void* ptr : seen) gpa_.Deallocate(ptr);
+}
+
 class SampledAllocationWithFilterTest
     : public GuardedPageAllocatorTest,
       public testing::WithParamInterface<std::function<bool(void*)>> {
@@ -16,38 +16,76 @@
 #define TCMALLOC_HINTED_TRACKER_LISTS_H_
 
 #include <cstddef>
+#include <cstdint>
 
 #include "absl/base/nullability.h"
+#include "absl/base/optimization.h"
+#include "absl/numeric/bits.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/linked_list.h"
 #include "tcmalloc/internal/logging.h"
-#include "tcmalloc/internal/range_tracker.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
 
-// This class wraps an array of N TrackerLists and a Bitmap storing which
-// elements are non-empty.
+// This class wraps an array of N TrackerLists and a two-level bitmap storing
+// which elements are non-empty.  The second level records which words of the
+// first one are non-zero, so that finding the first non-empty list at or after
+// a given index takes at most two count-trailing-zeros operations, whatever N
+// is.  This lets callers use many fine-grained lists at no extra cost.
 template <class TrackerType, size_t N>
 class HintedTrackerLists {
+  static constexpr size_t kWordBits = 64;
+  static constexpr size_t kWords = (N + kWordBits - 1) / kWordBits;
+  static_assert(kWords <= kWordBits, "second level must fit in a single word");
+
  public:
   using TrackerList = TList<TrackerType>;
 
-  constexpr HintedTrackerLists() : size_{} {}
+  constexpr HintedTrackerLists() : size_{}, words_{}, summary_{} {}
 
   // Removes a TrackerType from the first non-empty freelist with index at
   // least n and returns it. Returns nullptr if there is none.
   TrackerType* absl_nullable GetLeast(const size_t n) {
     TC_ASSERT_LT(n, N);
-    size_t i = nonempty_.FindSet(n);
+    size_t i = FindSet(n);
+    if (i == N) {
+      return nullptr;
+    }
+    TC_ASSERT(!lists_[i].empty());
+    TrackerType* pt = lists_[i].first();
+    if (lists_[i].remove(pt)) {
+      ClearBit(i);
+    }
+    --size_;
+    return pt;
+  }
+
+  // Like GetLeast, but among the first max_scan entries of the first non-empty
+  // freelist with index at least n, removes and returns the first one for which
+  // pred returns true.  Falls back to the head of that freelist otherwise, so
+  // the choice of freelist is never affected by pred.
+  template <typename Predicate>
+  TrackerType* absl_nullable GetLeastPreferring(const size_t n,
+                                                const Predicate& pred,
+                                                size_t max_scan) {
+    TC_ASSERT_LT(n, N);
+    size_t i = FindSet(n);
     if (i == N) {
       return nullptr;
     }
     TC_ASSERT(!lists_[i].empty());
     TrackerType* pt = lists_[i].first();
+    for (TrackerType* candidate : lists_[i]) {
+      if (max_scan-- == 0) break;
+      if (pred(*candidate)) {
+        pt = candidate;
+        break;
+      }
+    }
     if (lists_[i].remove(pt)) {
-      nonempty_.ClearBit(i);
+      ClearBit(i);
     }
     --size_;
     return pt;
@@ -60,7 +98,7 @@ class HintedTrackerLists {
   // found.
   TrackerType* absl_nullable PeekLeast(const size_t n) {
     TC_ASSERT_LT(n, N);
-    size_t i = nonempty_.FindSet(n);
+    size_t i = FindSet(n);
     if (i == N) {
       return nullptr;
     }
@@ -76,7 +114,7 @@ class HintedTrackerLists {
     TC_ASSERT_NE(pt, nullptr);
     lists_[i].prepend(pt);
     ++size_;
-    nonempty_.SetBit(i);
+    SetBit(i);
   }
 
   // Removes pointer <pt> from the nonempty_[i] list.
@@ -85,8 +123,8 @@ class HintedTrackerLists {
     TC_ASSERT_LT(i, N);
     TC_ASSERT_NE(pt, nullptr);
     if (lists_[i].remove(pt)) {
-      TC_ASSERT(nonempty_.GetBit(i));
-      nonempty_.ClearBit(i);
+      TC_ASSERT(GetBit(i));
+      ClearBit(i);
     }
     --size_;
   }
@@ -107,7 +145,7 @@ class HintedTrackerLists {
   // This quirk is inherited from TrackerList.
   template <typename Functor>
   void Iter(const Functor& func, size_t start) const {
-    size_t i = nonempty_.FindSet(start);
+    size_t i = FindSet(start);
     while (i < N) {
       auto& list = lists_[i];
       TC_ASSERT(!list.empty());
@@ -115,14 +153,56 @@ class HintedTrackerLists {
         func(*pt);
       }
       i++;
-      if (i < N) i = nonempty_.FindSet(i);
+      if (i < N) i = FindSet(i);
     }
   }
 
  private:
+  // Returns index of the first non-empty list >= n, or N if none.
+  size_t FindSet(size_t n) const {
+    TC_ASSERT_LT(n, N);
+    size_t word = n / kWordBits;
+    const uint64_t here = words_[word] & (~uint64_t{0} << (n % kWordBits));
+    if (ABSL_PREDICT_TRUE(here != 0)) {
+      return word * kWordBits + absl::countr_zero(here);
+    }
+    if constexpr (kWords == 1) {
+      return N;
+    } else {
+      const uint64_t later =
+          word + 1 < kWordBits ? summary_ & (~uint64_t{0} << (word + 1)) : 0;
+      if (later == 0) {
+        return N;
+      }
+      word = absl::countr_zero(later);
+      TC_ASSERT_NE(words_[word], 0);
+      return word * kWordBits + absl::countr_zero(words_[word]);
+    }
+  }
+
+  bool GetBit(size_t i) const {
+    return (words_[i / kWordBits] >> (i % kWordBits)) & 1;
+  }
+
+  void SetBit(size_t i) {
+    words_[i / kWordBits] |= uint64_t{1} << (i % kWordBits);
+    summary_ |= uint64_t{1} << (i / kWordBits);
+  }
+
+  void ClearBit(size_t i) {
+    const size_t word = i / kWordBits;
+    words_[word] &= ~(uint64_t{1} << (i % kWordBits));
+    if (words_[word] == 0) {
+      summary_ &= ~(uint64_t{1} << word);
+    }
+  }
+
   TrackerList lists_[N];
   size_t size_;
-  Bitmap<N> nonempty_;
+  // Bit i of words_ is set iff lists_[i] is non-empty; bit w of summary_ is
+  // set iff words_[w] is non-zero.
+  uint64_t words_[kWords];
+  uint64_t summary_;
 };
 
 }  // namespace tcmalloc_internal
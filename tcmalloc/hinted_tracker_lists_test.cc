@@ -0,0 +1,148 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/hinted_tracker_lists.h"
+
+#include <stddef.h>
+
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/random/random.h"
+#include "tcmalloc/internal/linked_list.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+struct Tracker : public TList<Tracker>::Elem {
+  size_t index = 0;
+};
+
+template <typename Lists>
+class HintedTrackerListsTest : public testing::Test {};
+
+template <size_t N>
+struct ListsOf {
+  static constexpr size_t kN = N;
+  using Type = HintedTrackerLists<Tracker, N>;
+};
+
+// Sizes around the word boundaries of both levels of the index.
+using Sizes = testing::Types<ListsOf<16>, ListsOf<64>, ListsOf<65>,
+                             ListsOf<200>, ListsOf<2048>, ListsOf<4096>>;
+TYPED_TEST_SUITE(HintedTrackerListsTest, Sizes);
+
+TYPED_TEST(HintedTrackerListsTest, PeekAndGetLeast) {
+  constexpr size_t kN = TypeParam::kN;
+  auto lists = std::make_unique<typename TypeParam::Type>();
+  for (size_t n = 0; n < kN; ++n) {
+    EXPECT_EQ(lists->PeekLeast(n), nullptr);
+  }
+
+  Tracker first, last;
+  first.index = 1;
+  last.index = kN - 1;
+  lists->Add(&last, last.index);
+  lists->Add(&first, first.index);
+  EXPECT_EQ(lists->size(), 2);
+
+  EXPECT_EQ(lists->PeekLeast(0), &first);
+  EXPECT_EQ(lists->PeekLeast(1), &first);
+  EXPECT_EQ(lists->PeekLeast(2), &last);
+  EXPECT_EQ(lists->PeekLeast(kN - 1), &last);
+
+  EXPECT_EQ(lists->GetLeast(0), &first);
+  EXPECT_EQ(lists->PeekLeast(0), &last);
+  lists->Remove(&last, last.index);
+  EXPECT_EQ(lists->PeekLeast(0), nullptr);
+  EXPECT_EQ(lists->size(), 0);
+}
+
+TYPED_TEST(HintedTrackerListsTest, GetLeastPreferring) {
+  constexpr size_t kN = TypeParam::kN;
+  auto lists = std::make_unique<typename TypeParam::Type>();
+  auto is = [](const Tracker* t) {
+    return [t](const Tracker& candidate) { return &candidate == t; };
+  };
+
+  Tracker a, b, c, later;
+  a.index = b.index = c.index = 1;
+  later.index = kN - 1;
+  lists->Add(&later, later.index);
+  lists->Add(&c, c.index);
+  lists->Add(&b, b.index);
+  lists->Add(&a, a.index);
+  EXPECT_EQ(lists->PeekLeast(0), &a);
+
+  // Trackers past max_scan, or in later lists, are never preferred.
+  EXPECT_EQ(lists->GetLeastPreferring(0, is(&c), 2), &a);
+  EXPECT_EQ(lists->GetLeastPreferring(0, is(&later), 8), &b);
+  EXPECT_EQ(lists->size(), 2);
+
+  lists->Add(&a, a.index);
+  EXPECT_EQ(lists->GetLeastPreferring(0, is(&c), 2), &c);
+  EXPECT_EQ(lists->GetLeastPreferring(0, is(&c), 2), &a);
+  EXPECT_EQ(lists->GetLeastPreferring(0, is(&later), 1), &later);
+  EXPECT_EQ(lists->GetLeastPreferring(0, is(&later), 1), nullptr);
+  EXPECT_EQ(lists->size(), 0);
+}
+
+TYPED_TEST(HintedTrackerListsTest, MatchesReference) {
+  constexpr size_t kN = TypeParam::kN;
+  constexpr size_t kTrackers = 256;
+  auto lists = std::make_unique<typename TypeParam::Type>();
+  std::vector<Tracker> trackers(kTrackers);
+  std::vector<bool> added(kTrackers, false);
+  std::multiset<size_t> reference;
+
+  absl::BitGen rng;
+  for (int iter = 0; iter < 10000; ++iter) {
+    const size_t t = absl::Uniform<size_t>(rng, 0, kTrackers);
+    if (added[t]) {
+      lists->Remove(&trackers[t], trackers[t].index);
+      reference.erase(reference.find(trackers[t].index));
+    } else {
+      trackers[t].index = absl::Uniform<size_t>(rng, 0, kN);
+      lists->Add(&trackers[t], trackers[t].index);
+      reference.insert(trackers[t].index);
+    }
+    added[t] = !added[t];
+
+    const size_t n = absl::Uniform<size_t>(rng, 0, kN);
+    Tracker* found = lists->PeekLeast(n);
+    auto it = reference.lower_bound(n);
+    if (it == reference.end()) {
+      EXPECT_EQ(found, nullptr);
+    } else {
+      ASSERT_NE(found, nullptr);
+      EXPECT_EQ(found->index, *it);
+    }
+    ASSERT_EQ(lists->size(), reference.size());
+  }
+
+  size_t visited = 0;
+  lists->Iter([&](const Tracker&) { ++visited; }, 0);
+  EXPECT_EQ(visited, reference.size());
+
+  for (size_t t = 0; t < kTrackers; ++t) {
+    if (added[t]) lists->Remove(&trackers[t], trackers[t].index);
+  }
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -19,6 +19,7 @@
 #include <cstdint>
 
 #include "absl/base/internal/cycleclock.h"
+#include "absl/numeric/bits.h"
 #include "tcmalloc/huge_pages.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/exponential_biased.h"
@@ -112,6 +113,41 @@ void HugeAddressMap::Check() {
   TC_CHECK_EQ(nodes, nranges());
   TC_CHECK_EQ(size, total_mapped());
   TC_CHECK_EQ(total_nodes_, used_nodes_ + freelist_size_);
+
+  size_t indexed = 0;
+  for (size_t i = 0; i < kMaxIndexedLength; ++i) {
+    TC_CHECK_EQ(uint64_t{by_length_[i] != nullptr}, (nonempty_ >> i) & 1);
+    const Node* prev = nullptr;
+    for (const Node* n = by_length_[i]; n != nullptr; n = n->size_next_) {
+      TC_CHECK_EQ(n->range_.len(), NHugePages(i + 1));
+      TC_CHECK_EQ(n->size_prev_, prev);
+      prev = n;
+      ++indexed;
+    }
+  }
+  size_t expected = 0;
+  for (const Node* n = first(); n != nullptr; n = n->next()) {
+    if (n->range_.len() <= NHugePages(kMaxIndexedLength)) ++expected;
+  }
+  TC_CHECK_EQ(indexed, expected);
+
+  // Every node is in the heap, and no older than its parent there.
+  size_t in_heap = 0;
+  if (heap_root_ != nullptr) {
+    TC_CHECK_EQ(heap_root_->heap_prev_, nullptr);
+    TC_CHECK_EQ(heap_root_->heap_next_, nullptr);
+    in_heap = 1;
+  }
+  for (const Node* n = first(); n != nullptr; n = n->next()) {
+    const Node* prev = n;
+    for (const Node* c = n->heap_child_; c != nullptr; c = c->heap_next_) {
+      TC_CHECK(!Older(c, n));
+      TC_CHECK_EQ(c->heap_prev_, prev);
+      prev = c;
+      ++in_heap;
+    }
+  }
+  TC_CHECK_EQ(in_heap, nranges());
 }
 
 size_t HugeAddressMap::nranges() const { return used_nodes_; }
@@ -153,7 +189,142 @@ HugeAddressMap::Node* HugeAddressMap::Predecessor(HugePage p) {
   return best;
 }
 
-void HugeAddressMap::Merge(Node* b, HugeRange r, Node* a) {
+HugeAddressMap::Node* HugeAddressMap::BestFit(HugeLength n) {
+  TC_ASSERT_GT(n, NHugePages(0));
+  if (n <= NHugePages(kMaxIndexedLength)) {
+    const uint64_t fits = nonempty_ & (~uint64_t{0} << (n.raw_num() - 1));
+    if (fits != 0) return by_length_[absl::countr_zero(fits)];
+  }
+
+  // Only longer ranges than we index can fit.
+  Node* curr = root();
+  // invariant: curr != nullptr && curr->longest >= n
+  Node* best = nullptr;
+  while (curr && curr->longest() >= n) {
+    if (curr->range().len() >= n) {
+      if (!best || best->range().len() > curr->range().len()) {
+        best = curr;
+      }
+    }
+
+    // Either subtree could contain a better fit and we don't want to
+    // search the whole tree. Pick a reasonable child to look at.
+    auto left = curr->left();
+    auto right = curr->right();
+    if (!left || left->longest() < n) {
+      curr = right;
+      continue;
+    }
+
+    if (!right || right->longest() < n) {
+      curr = left;
+      continue;
+    }
+
+    // Here, we have a nontrivial choice.
+    if (left->range().len() == right->range().len()) {
+      if (left->longest() <= right->longest()) {
+        curr = left;
+      } else {
+        curr = right;
+      }
+    } else if (left->range().len() < right->range().len()) {
+      // Here, the longest range in both children is the same...look
+      // in the subtree with the smaller root, as that's slightly
+      // more likely to be our best.
+      curr = left;
+    } else {
+      curr = right;
+    }
+  }
+  return best;
+}
+
+void HugeAddressMap::Index(Node* n) {
+  n->heap_child_ = n->heap_next_ = n->heap_prev_ = nullptr;
+  heap_root_ = Meld(heap_root_, n);
+
+  const size_t len = n->range_.len().raw_num();
+  if (len > kMaxIndexedLength) return;
+  const size_t i = len - 1;
+  n->size_prev_ = nullptr;
+  n->size_next_ = by_length_[i];
+  if (n->size_next_ != nullptr) n->size_next_->size_prev_ = n;
+  by_length_[i] = n;
+  nonempty_ |= uint64_t{1} << i;
+}
+
+void HugeAddressMap::Unindex(Node* n) {
+  if (n == heap_root_) {
+    heap_root_ = MeldSiblings(n->heap_child_);
+  } else {
+    // Cut n and its children out of the heap, and put the children back.
+    if (n->heap_prev_->heap_child_ == n) {
+      n->heap_prev_->heap_child_ = n->heap_next_;
+    } else {
+      n->heap_prev_->heap_next_ = n->heap_next_;
+    }
+    if (n->heap_next_ != nullptr) n->heap_next_->heap_prev_ = n->heap_prev_;
+    heap_root_ = Meld(heap_root_, MeldSiblings(n->heap_child_));
+  }
+
+  const size_t len = n->range_.len().raw_num();
+  if (len > kMaxIndexedLength) return;
+  const size_t i = len - 1;
+  if (n->size_prev_ != nullptr) {
+    n->size_prev_->size_next_ = n->size_next_;
+  } else {
+    by_length_[i] = n->size_next_;
+  }
+  if (n->size_next_ != nullptr) n->size_next_->size_prev_ = n->size_prev_;
+  if (by_length_[i] == nullptr) nonempty_ &= ~(uint64_t{1} << i);
+}
+
+bool HugeAddressMap::Older(const Node* a, const Node* b) {
+  if (a->when_ != b->when_) return a->when_ < b->when_;
+  if (a->range_.len() != b->range_.len()) {
+    return a->range_.len() < b->range_.len();
+  }
+  return a->range_.start() < b->range_.start();
+}
+
+HugeAddressMap::Node* HugeAddressMap::Meld(Node* a, Node* b) {
+  if (a == nullptr) return b;
+  if (b == nullptr) return a;
+  if (Older(b, a)) std::swap(a, b);
+  // b becomes the first child of a.
+  b->heap_prev_ = a;
+  b->heap_next_ = a->heap_child_;
+  if (b->heap_next_ != nullptr) b->heap_next_->heap_prev_ = b;
+  a->heap_child_ = b;
+  return a;
+}
+
+HugeAddressMap::Node* HugeAddressMap::MeldSiblings(Node* first) {
+  // The usual two passes: meld pairs from the left, stacking the results on
+  // heap_next_, then meld the stack from the right.
+  Node* pairs = nullptr;
+  while (first != nullptr) {
+    Node* a = first;
+    Node* b = a->heap_next_;
+    first = b != nullptr ? b->heap_next_ : nullptr;
+    a->heap_next_ = a->heap_prev_ = nullptr;
+    if (b != nullptr) b->heap_next_ = b->heap_prev_ = nullptr;
+    Node* melded = Meld(a, b);
+    melded->heap_next_ = pairs;
+    pairs = melded;
+  }
+  Node* root = nullptr;
+  while (pairs != nullptr) {
+    Node* next = pairs->heap_next_;
+    pairs->heap_next_ = nullptr;
+    root = Meld(root, pairs);
+    pairs = next;
+  }
+  return root;
+}
+
+void HugeAddressMap::Merge(Node* b, HugeRange r, Node* a, int64_t when) {
   auto merge_when = [](HugeRange x, int64_t x_when, HugeRange y,
                        int64_t y_when) {
     // avoid overflow with floating-point
@@ -164,16 +335,19 @@ void HugeAddressMap::Merge(Node* b, HugeRange r, Node* a) {
     return static_cast<int64_t>((x_weight + y_weight) / (x_len + y_len));
   };
 
-  int64_t when = absl::base_internal::CycleClock::Now();
   // Two way merges are easy.
   if (a == nullptr) {
+    Unindex(b);
     b->when_ = merge_when(b->range_, b->when(), r, when);
     b->range_ = Join(b->range_, r);
+    Index(b);
     FixLongest(b);
     return;
   } else if (b == nullptr) {
+    Unindex(a);
     a->when_ = merge_when(r, when, a->range_, a->when());
     a->range_ = Join(r, a->range_);
+    Index(a);
     FixLongest(a);
     return;
   }
@@ -188,12 +362,18 @@ void HugeAddressMap::Merge(Node* b, HugeRange r, Node* a) {
   // we actually don't change lengths at all; undo that.
   total_size_ += a->range_.len();
   Remove(a);
+  Unindex(b);
   b->range_ = full;
   b->when_ = full_when;
+  Index(b);
   FixLongest(b);
 }
 
 void HugeAddressMap::Insert(HugeRange r) {
+  Insert(r, absl::base_internal::CycleClock::Now());
+}
+
+void HugeAddressMap::Insert(HugeRange r, int64_t when) {
   total_size_ += r.len();
   // First, try to merge if necessary. Note there are three possibilities:
   // we might need to merge before with r, r with after, or all three together.
@@ -203,19 +383,20 @@ void HugeAddressMap::Insert(HugeRange r) {
   TC_CHECK(!after || !after->range_.intersects(r));
   if (before && before->range_.precedes(r)) {
     if (after && r.precedes(after->range_)) {
-      Merge(before, r, after);
+      Merge(before, r, after, when);
     } else {
-      Merge(before, r, nullptr);
+      Merge(before, r, nullptr, when);
     }
     return;
   } else if (after && r.precedes(after->range_)) {
-    Merge(nullptr, r, after);
+    Merge(nullptr, r, after, when);
     return;
   }
   TC_CHECK(!before || !before->range_.precedes(r));
   TC_CHECK(!after || !r.precedes(after->range_));
   // No merging possible; just add a new node.
-  Node* n = Get(r);
+  Node* n = Get(r, when);
+  Index(n);
   Node* curr = root();
   Node* parent = nullptr;
   Node** link = &root_;
@@ -283,6 +464,7 @@ void HugeAddressMap::FixLongest(HugeAddressMap::Node* n) {
 
 void HugeAddressMap::Remove(HugeAddressMap::Node* n) {
   total_size_ -= n->range_.len();
+  Unindex(n);
   // We need to merge the left and right children of n into one
   // treap, then glue it into place wherever n was.
   Node** link;
@@ -352,7 +534,7 @@ void HugeAddressMap::Put(Node* n) {
   freelist_ = n;
 }
 
-HugeAddressMap::Node* HugeAddressMap::Get(HugeRange r) {
+HugeAddressMap::Node* HugeAddressMap::Get(HugeRange r, int64_t when) {
   TC_CHECK_EQ(freelist_ == nullptr, freelist_size_ == 0);
   used_nodes_++;
   seed_ = ExponentialBiased::NextRandom(seed_);
@@ -360,17 +542,17 @@ HugeAddressMap::Node* HugeAddressMap::Get(HugeRange r) {
   if (freelist_size_ == 0) {
     total_nodes_++;
     Node* ret = reinterpret_cast<Node*>(meta_(sizeof(Node)));
-    return new (ret) Node(r, prio);
+    return new (ret) Node(r, prio, when);
   }
 
   freelist_size_--;
   Node* ret = freelist_;
   freelist_ = ret->left_;
-  return new (ret) Node(r, prio);
+  return new (ret) Node(r, prio, when);
 }
 
-HugeAddressMap::Node::Node(HugeRange r, int prio)
-    : range_(r), prio_(prio), when_(absl::base_internal::CycleClock::Now()) {}
+HugeAddressMap::Node::Node(HugeRange r, int prio, int64_t when)
+    : range_(r), prio_(prio), when_(when) {}
 
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -32,6 +32,14 @@ namespace tcmalloc_internal {
 // augmented with the largest range in each subtree (this allows fairly simple
 // allocation algorithms from the contained ranges.
 //
+// Ranges of up to kMaxIndexedLength hugepages are also kept on lists by
+// length, so that BestFit finds the shortest of them that fits without
+// walking the tree, which costs a cache miss per level once the map holds
+// many fragmented ranges.
+//
+// All ranges are also kept in a pairing heap ordered by when they were added,
+// so that Oldest() does not walk the tree either.
+//
 // This class scales well and is *reasonably* performant, but it is not intended
 // for use on extremely hot paths.
 class HugeAddressMap {
@@ -54,14 +62,16 @@ class HugeAddressMap {
     const Node* next() const;
     Node* next();
     // when were this node's content added (in
-    // absl::base_internal::CycleClock::Now units)?
+    // absl::base_internal::CycleClock::Now units, unless given to Insert)?
+    // Merged ranges take the average, weighted by length, so a range holding
+    // an old hugepage may well look younger than a range holding none.
     int64_t when() const;
 
     // What is the length of the longest range in the subtree rooted here?
     HugeLength longest() const;
 
    private:
-    Node(HugeRange r, int prio);
+    Node(HugeRange r, int prio, int64_t when);
     friend class HugeAddressMap;
     HugeRange range_;
     int prio_;  // chosen randomly
@@ -69,6 +79,14 @@ class HugeAddressMap {
     Node* parent_;
     HugeLength longest_;
     int64_t when_;
+    // The other nodes of the same length, if indexed.
+    Node* size_prev_;
+    Node* size_next_;
+    // Pairing heap links: the first child, the next sibling, and the previous
+    // sibling or, for a first child, the parent.
+    Node* heap_child_;
+    Node* heap_next_;
+    Node* heap_prev_;
     // Expensive, recursive consistency check.
     // Accumulates node count and range sizes into passed arguments.
     void Check(size_t* num_nodes, HugeLength* size) const;
@@ -89,6 +107,18 @@ class HugeAddressMap {
   // after p (if any).
   Node* Predecessor(HugePage p);
 
+  // Returns a node whose range holds at least n hugepages, or nullptr if
+  // there is none.  If a range of at most kMaxIndexedLength hugepages fits,
+  // this is the shortest such range.  Beyond, we favor smaller gaps and lower nodes and lower addresses, in that
+  // order, which is vaguely close to best-fit.
+  Node* BestFit(HugeLength n);
+
+  // Returns the node that was added the longest ago, the shortest such on
+  // ties, or nullptr if the map is empty.  As merged ranges average when()
+  // over their hugepages, this is only approximately the range holding the
+  // oldest hugepage.
+  Node* Oldest();
+
   // Expensive consistency check.
   void Check();
 
@@ -100,6 +130,8 @@ class HugeAddressMap {
 
   // Add <r> to the map, merging with adjacent ranges as needed.
   void Insert(HugeRange r);
+  // As above, recording that <r> was added at <when>.
+  void Insert(HugeRange r, int64_t when);
 
   // Delete n from the map.
   void Remove(Node* n);
@@ -115,13 +147,32 @@ class HugeAddressMap {
   size_t freelist_size_{0};
   // How we get more
   MetadataAllocator& meta_;
-  Node* Get(HugeRange r);
+  Node* Get(HugeRange r, int64_t when);
   void Put(Node* n);
 
   size_t total_nodes_{0};
 
-  void Merge(Node* b, HugeRange r, Node* a);
+  void Merge(Node* b, HugeRange r, Node* a, int64_t when);
   void FixLongest(Node* n);
+
+  // by_length_[i] lists the nodes of i + 1 hugepages; bit i of nonempty_ is
+  // set iff it is not empty.
+  static constexpr size_t kMaxIndexedLength = 64;
+  Node* by_length_[kMaxIndexedLength] = {};
+  uint64_t nonempty_{0};
+  // Add n to or remove it from by_length_ and the heap.  Callers must unindex
+  // a node before changing its range or when, and index it again after.
+  void Index(Node* n);
+  void Unindex(Node* n);
+
+  // Root of the pairing heap of all nodes, on when() then length.
+  Node* heap_root_{nullptr};
+  // Whether a should come out of the heap before b.
+  static bool Older(const Node* a, const Node* b);
+  // Returns the root of the heap joining the heaps rooted at a and b.
+  static Node* Meld(Node* a, Node* b);
+  // Returns the root of the heap joining first and its next siblings.
+  static Node* MeldSiblings(Node* first);
   // Note that we always use the same seed, currently; this isn't very random.
   // In practice we're not worried about adversarial input and this works well
   // enough.
@@ -139,6 +190,7 @@ inline int64_t HugeAddressMap::Node::when() const { return when_; }
 inline HugeLength HugeAddressMap::Node::longest() const { return longest_; }
 
 inline HugeAddressMap::Node* HugeAddressMap::root() { return root_; }
+inline HugeAddressMap::Node* HugeAddressMap::Oldest() { return heap_root_; }
 inline const HugeAddressMap::Node* HugeAddressMap::root() const {
   return root_;
 }
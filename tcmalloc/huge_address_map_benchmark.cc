@@ -0,0 +1,94 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Benchmarks best-fit searches of a HugeAddressMap holding many fragmented
+// ranges, as HugeAllocator and HugeCache do.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/huge_address_map.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/mock_metadata_allocator.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// Fills map with `ranges` ranges of up to 128 hugepages, skewed towards short
+// ones, each separated from the next by a one hugepage gap.
+void Fragment(HugeAddressMap& map, size_t ranges, absl::BitGen& rng) {
+  size_t start = 0;
+  for (size_t i = 0; i < ranges; ++i) {
+    const size_t len =
+        absl::Bernoulli(rng, 0.9) ? absl::Uniform<size_t>(rng, 1, 8)
+                                  : absl::Uniform<size_t>(rng, 8, 129);
+    map.Insert(HugeRange::Make(HugePage{start}, NHugePages(len)));
+    start += len + 1;
+  }
+}
+
+// Arg: number of ranges in the map.
+void BM_BestFit(benchmark::State& state) {
+  FakeMetadataAllocator metadata;
+  HugeAddressMap map(metadata);
+  absl::BitGen rng;
+  Fragment(map, state.range(0), rng);
+
+  constexpr size_t kSearches = 1 << 12;
+  std::vector<HugeLength> lengths(kSearches);
+  for (HugeLength& n : lengths) {
+    n = NHugePages(absl::Uniform<size_t>(rng, 1, 16));
+  }
+
+  size_t i = 0;
+  for (auto s : state) {
+    benchmark::DoNotOptimize(map.BestFit(lengths[i]));
+    i = (i + 1) % kSearches;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_BestFit)->Range(64, 1 << 16);
+
+// Arg: number of ranges in the map.
+//
+// Takes the best fit for a hugepage from the map and returns it, which keeps
+// the map's shape while exercising removal and insertion with merging.
+void BM_BestFitRemoveInsert(benchmark::State& state) {
+  FakeMetadataAllocator metadata;
+  HugeAddressMap map(metadata);
+  absl::BitGen rng;
+  Fragment(map, state.range(0), rng);
+
+  for (auto s : state) {
+    HugeAddressMap::Node* node = map.BestFit(NHugePages(1));
+    TC_CHECK_NE(node, nullptr);
+    const HugeRange r = node->range();
+    map.Remove(node);
+    map.Insert(r);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_BestFitRemoveInsert)->Range(64, 1 << 16);
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -17,10 +17,13 @@
 #include <stddef.h>
 #include <stdlib.h>
 
+#include <cstdint>
 #include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
 #include "tcmalloc/internal/mock_metadata_allocator.h"
 
 namespace tcmalloc {
@@ -68,6 +71,96 @@ TEST_F(HugeAddressMapTest, Merging) {
   EXPECT_THAT(Contents(), testing::ElementsAre(all));
 }
 
+TEST_F(HugeAddressMapTest, BestFit) {
+  // Ranges of 3, 1, 100 and 2 hugepages, separated by gaps.
+  const HugeRange r1 = HugeRange::Make(hp(0), hl(3));
+  const HugeRange r2 = HugeRange::Make(hp(10), hl(1));
+  const HugeRange r3 = HugeRange::Make(hp(20), hl(100));
+  const HugeRange r4 = HugeRange::Make(hp(200), hl(2));
+  for (auto r : {r1, r2, r3, r4}) {
+    map_.Insert(r);
+    map_.Check();
+  }
+
+  EXPECT_EQ(map_.BestFit(hl(1))->range(), r2);
+  EXPECT_EQ(map_.BestFit(hl(2))->range(), r4);
+  EXPECT_EQ(map_.BestFit(hl(3))->range(), r1);
+  EXPECT_EQ(map_.BestFit(hl(4))->range(), r3);
+  EXPECT_EQ(map_.BestFit(hl(100))->range(), r3);
+  EXPECT_EQ(map_.BestFit(hl(101)), nullptr);
+
+  // Merging r1 and r2 makes a range of 11 hugepages.
+  map_.Insert(HugeRange::Make(hp(3), hl(7)));
+  map_.Check();
+  EXPECT_EQ(map_.BestFit(hl(1))->range(), r4);
+  EXPECT_EQ(map_.BestFit(hl(3))->range(), HugeRange::Make(hp(0), hl(11)));
+
+  map_.Remove(map_.BestFit(hl(1)));
+  map_.Check();
+  EXPECT_EQ(map_.BestFit(hl(1))->range(), HugeRange::Make(hp(0), hl(11)));
+  EXPECT_EQ(map_.BestFit(hl(12))->range(), r3);
+}
+
+TEST_F(HugeAddressMapTest, Oldest) {
+  EXPECT_EQ(map_.Oldest(), nullptr);
+  const HugeRange r1 = HugeRange::Make(hp(0), hl(2));
+  const HugeRange r2 = HugeRange::Make(hp(10), hl(1));
+  const HugeRange r3 = HugeRange::Make(hp(20), hl(1));
+  const HugeRange r4 = HugeRange::Make(hp(30), hl(4));
+  map_.Insert(r1, 30);
+  map_.Insert(r2, 10);
+  map_.Insert(r3, 20);
+  map_.Insert(r4, 10);
+  map_.Check();
+  // Ties go to the shorter range.
+  EXPECT_EQ(map_.Oldest()->range(), r2);
+  map_.Remove(map_.Oldest());
+  map_.Check();
+  EXPECT_EQ(map_.Oldest()->range(), r4);
+
+  // Merging averages over the hugepages: r4 and the four new ones make 8
+  // hugepages added at 20 on average, which ties with r3.
+  map_.Insert(HugeRange::Make(hp(34), hl(4)), 30);
+  map_.Check();
+  EXPECT_EQ(map_.Oldest()->when(), 20);
+  EXPECT_EQ(map_.Oldest()->range(), r3);
+  map_.Remove(map_.Oldest());
+  map_.Check();
+  EXPECT_EQ(map_.Oldest()->range(), HugeRange::Make(hp(30), hl(8)));
+  map_.Remove(map_.Oldest());
+  map_.Check();
+  EXPECT_EQ(map_.Oldest()->range(), r1);
+  map_.Remove(map_.Oldest());
+  map_.Check();
+  EXPECT_EQ(map_.Oldest(), nullptr);
+}
+
+TEST_F(HugeAddressMapTest, OldestMatchesScan) {
+  absl::BitGen rng;
+  for (int i = 0; i < 1000; ++i) {
+    const HugePage p = hp(absl::Uniform<size_t>(rng, 0, 200));
+    const bool taken = map_.Predecessor(p) != nullptr &&
+                       map_.Predecessor(p)->range().contains(p);
+    if (!taken) {
+      map_.Insert(HugeRange::Make(p, hl(1)),
+                  absl::Uniform<int64_t>(rng, 0, 100));
+    } else if (absl::Bernoulli(rng, 0.5)) {
+      map_.Remove(map_.Oldest());
+    }
+    map_.Check();
+
+    const HugeAddressMap::Node* expected = nullptr;
+    for (auto* n = map_.first(); n != nullptr; n = n->next()) {
+      if (expected == nullptr || n->when() < expected->when() ||
+          (n->when() == expected->when() &&
+           n->range().len() < expected->range().len())) {
+        expected = n;
+      }
+    }
+    ASSERT_EQ(map_.Oldest(), expected);
+  }
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
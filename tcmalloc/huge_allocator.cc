@@ -32,59 +32,15 @@ void HugeAllocator::Print(Printer& out) {
   out.printf("HugeAllocator: %zu requested - %zu in use = %zu hugepages free\n",
              from_system_.raw_num(), in_use_.raw_num(),
              (from_system_ - in_use_).raw_num());
+  out.printf("HugeAllocator: %zu free hugepages not known to be zero\n",
+             dirty().raw_num());
 }
 
 void HugeAllocator::PrintInPbtxt(PbtxtRegion& hpaa) const {
   free_.PrintInPbtxt(hpaa);
   hpaa.PrintI64("num_total_requested_huge_pages", from_system_.raw_num());
   hpaa.PrintI64("num_in_use_huge_pages", in_use_.raw_num());
-}
-
-HugeAddressMap::Node* HugeAllocator::Find(HugeLength n) {
-  HugeAddressMap::Node* curr = free_.root();
-  // invariant: curr != nullptr && curr->longest >= n
-  // we favor smaller gaps and lower nodes and lower addresses, in that
-  // order. The net effect is that we are neither a best-fit nor a
-  // lowest-address allocator but vaguely close to both.
-  HugeAddressMap::Node* best = nullptr;
-  while (curr && curr->longest() >= n) {
-    if (curr->range().len() >= n) {
-      if (!best || best->range().len() > curr->range().len()) {
-        best = curr;
-      }
-    }
-
-    // Either subtree could contain a better fit and we don't want to
-    // search the whole tree. Pick a reasonable child to look at.
-    auto left = curr->left();
-    auto right = curr->right();
-    if (!left || left->longest() < n) {
-      curr = right;
-      continue;
-    }
-
-    if (!right || right->longest() < n) {
-      curr = left;
-      continue;
-    }
-
-    // Here, we have a nontrivial choice.
-    if (left->range().len() == right->range().len()) {
-      if (left->longest() <= right->longest()) {
-        curr = left;
-      } else {
-        curr = right;
-      }
-    } else if (left->range().len() < right->range().len()) {
-      // Here, the longest range in both children is the same...look
-      // in the subtree with the smaller root, as that's slightly
-      // more likely to be our best.
-      curr = left;
-    } else {
-      curr = right;
-    }
-  }
-  return best;
+  hpaa.PrintI64("num_dirty_free_huge_pages", dirty().raw_num());
 }
 
 void HugeAllocator::CheckFreelist() {
@@ -116,16 +72,16 @@ HugeRange HugeAllocator::AllocateRange(HugeLength n) {
   return HugeRange::Make(HugePageContaining(ptr), n);
 }
 
-HugeRange HugeAllocator::Get(HugeLength n) {
+HugeRange HugeAllocator::Get(HugeLength n, bool* known_zero) {
   TC_CHECK_GT(n, NHugePages(0));
-  auto* node = Find(n);
+  auto* node = free_.BestFit(n);
   if (!node) {
     // Get more memory, then "delete" it
     HugeRange r = AllocateRange(n);
     if (!r.valid()) return r;
     in_use_ += r.len();
     Release(r);
-    node = Find(n);
+    node = free_.BestFit(n);
     TC_CHECK_NE(node, nullptr);
   }
   in_use_ += n;
@@ -145,16 +101,44 @@ HugeRange HugeAllocator::Get(HugeLength n) {
     DebugCheckFreelist();
   }
 
+  const bool dirty = TakeDirty(r);
+  if (known_zero != nullptr) {
+    *known_zero = !dirty;
+  }
   return r;
 }
 
-void HugeAllocator::Release(HugeRange r) {
+void HugeAllocator::Release(HugeRange r, bool known_zero) {
   in_use_ -= r.len();
 
   free_.Insert(r);
+  if (!known_zero) {
+    dirty_.Insert(r);
+  }
   DebugCheckFreelist();
 }
 
+bool HugeAllocator::TakeDirty(HugeRange r) {
+  bool dirty = false;
+  const HugePage last = r.start() + r.len() - NHugePages(1);
+  // Dirty ranges are disjoint, so walk back from the last one starting in r.
+  while (HugeAddressMap::Node* node = dirty_.Predecessor(last)) {
+    const HugeRange d = node->range();
+    if (!d.intersects(r)) break;
+    dirty = true;
+    dirty_.Remove(node);
+    if (d.start() < r.start()) {
+      dirty_.Insert(HugeRange::Make(d.start(), r.start() - d.start()));
+    }
+    const HugePage end = r.start() + r.len();
+    const HugePage d_end = d.start() + d.len();
+    if (end < d_end) {
+      dirty_.Insert(HugeRange::Make(end, d_end - end));
+    }
+  }
+  return dirty;
+}
+
 void HugeAllocator::AddSpanStats(SmallSpanStats* small,
                                  LargeSpanStats* large) const {
   for (const HugeAddressMap::Node* node = free_.first(); node != nullptr;
@@ -20,6 +20,7 @@
 #include <stddef.h>
 
 #include "absl/base/attributes.h"
+#include "absl/base/nullability.h"
 #include "tcmalloc/huge_address_map.h"
 #include "tcmalloc/huge_pages.h"
 #include "tcmalloc/internal/config.h"
@@ -50,27 +51,36 @@ class VirtualAllocator {
 // This tracks available ranges of hugepages and fulfills requests for
 // usable memory, allocating more from the system as needed.  All
 // hugepages are treated as (and assumed to be) unbacked.
+//
+// Unbacked hugepages are also assumed to be zero, as fresh or released memory
+// is, unless they were handed back as possibly holding data (e.g. hugepages
+// that were only partially released.)
 class HugeAllocator {
  public:
   constexpr HugeAllocator(
       VirtualAllocator& allocate ABSL_ATTRIBUTE_LIFETIME_BOUND,
       MetadataAllocator& meta_allocate ABSL_ATTRIBUTE_LIFETIME_BOUND)
-      : free_(meta_allocate), allocate_(allocate) {}
+      : free_(meta_allocate), dirty_(meta_allocate), allocate_(allocate) {}
 
   // Obtain a range of n unbacked hugepages, distinct from all other
-  // calls to Get (other than those that have been Released.)
-  HugeRange Get(HugeLength n);
+  // calls to Get (other than those that have been Released.)  If known_zero
+  // is not null, *known_zero is set to true iff the whole range is known to
+  // be zero.
+  HugeRange Get(HugeLength n, bool* absl_nullable known_zero = nullptr);
 
-  // Returns a range of hugepages for reuse by subsequent Gets().
+  // Returns a range of hugepages for reuse by subsequent Gets().  known_zero
+  // is false if <r> may still hold data.
   // REQUIRES: <r> is the return value (or a subrange thereof) of a previous
   // call to Get(); neither <r> nor any overlapping range has been released
   // since that Get().
-  void Release(HugeRange r);
+  void Release(HugeRange r, bool known_zero = true);
 
   // Total memory requested from the system, whether in use or not,
   HugeLength system() const { return from_system_; }
   // Unused memory in the allocator.
   HugeLength size() const { return from_system_ - in_use_; }
+  // Unused memory in the allocator that is not known to be zero.
+  HugeLength dirty() const { return dirty_.total_mapped(); }
 
   void AddSpanStats(SmallSpanStats* small, LargeSpanStats* large) const;
 
@@ -99,7 +109,11 @@ class HugeAllocator {
   // don't matter, and most of the simple ideas can't hit all of the above
   // requirements.
   HugeAddressMap free_;
-  HugeAddressMap::Node* Find(HugeLength n);
+  // The subset of free_ that is not known to be zero.
+  HugeAddressMap dirty_;
+
+  // Removes r from dirty_, returning true iff they overlapped.
+  bool TakeDirty(HugeRange r);
 
   void CheckFreelist();
   void DebugCheckFreelist() {
@@ -15,12 +15,14 @@
 #include "tcmalloc/huge_cache.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <tuple>
 
 #include "absl/base/optimization.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "tcmalloc/huge_address_map.h"
 #include "tcmalloc/huge_pages.h"
 #include "tcmalloc/internal/config.h"
@@ -105,14 +107,93 @@ bool MinMaxTracker<kSlots>::Extrema::operator==(const Extrema& other) const {
 template class MinMaxTracker<>;
 template class MinMaxTracker<600>;
 
+bool DemandForecaster::Report(HugeLength demand) {
+  if (!timeseries_.Report(demand)) return false;
+
+  // We just moved on from the epoch the current forecast was made for.
+  if (has_forecast_) {
+    const HugeLength realized = timeseries_.GetMostRecentRecord().data.max;
+    ++forecasts_;
+    realized_demand_ += realized.raw_num();
+    if (realized > forecast_) {
+      ++under_forecasts_;
+      forecast_error_ += (realized - forecast_).raw_num();
+    } else if (realized < forecast_) {
+      ++over_forecasts_;
+      forecast_error_ += (forecast_ - realized).raw_num();
+    }
+  }
+  forecast_ = Forecast();
+  has_forecast_ = true;
+  return true;
+}
+
+HugeLength DemandForecaster::Forecast() const {
+  const double half_life_epochs = kHalfLife / kEpochLength;
+  const int64_t recent_epochs = kRecentWindow / kEpochLength;
+  const int64_t lag_epochs = kSeasonalLag / kEpochLength;
+
+  HugeLength seasonal = NHugePages(0), recent = NHugePages(0);
+  // Each record was taken `start` epochs ago, and stayed the most recent one
+  // until `end` epochs ago, so it covers the epochs in (end, start].
+  int64_t start = 0, end = -1;
+  timeseries_.IterBackwards([&](size_t offset, size_t epoch_delta,
+                                const Peak& p) {
+    if (start <= recent_epochs) {
+      const double decay = std::exp2(-start / half_life_epochs);
+      recent = std::max(recent, NHugePages(static_cast<size_t>(
+                                    p.max.raw_num() * decay)));
+    }
+    if (start >= lag_epochs - 1 && end < lag_epochs) {
+      seasonal = std::max(seasonal, p.max);
+    }
+    end = start;
+    start += epoch_delta;
+  });
+  return std::max(seasonal, recent);
+}
+
+void DemandForecaster::Print(Printer& out) const {
+  const double mean_error =
+      forecasts_ > 0 ? static_cast<double>(forecast_error_) / forecasts_ : 0;
+  const double mean_realized =
+      forecasts_ > 0 ? static_cast<double>(realized_demand_) / forecasts_ : 0;
+  out.printf(
+      "HugeCache: demand forecast %zu MiB; %zu forecasts, %zu under / %zu "
+      "over realized demand, mean error %.1f MiB of %.1f MiB realized\n",
+      forecast_.in_mib(), forecasts_, under_forecasts_, over_forecasts_,
+      mean_error * kHugePageSize / 1024 / 1024,
+      mean_realized * kHugePageSize / 1024 / 1024);
+}
+
+void DemandForecaster::PrintInPbtxt(PbtxtRegion& hpaa) const {
+  auto forecast = hpaa.CreateSubRegion("huge_cache_demand_forecast");
+  forecast.PrintI64("forecast_bytes", forecast_.in_bytes());
+  forecast.PrintI64("forecasts", forecasts_);
+  forecast.PrintI64("under_forecasts", under_forecasts_);
+  forecast.PrintI64("over_forecasts", over_forecasts_);
+  forecast.PrintI64("forecast_error_bytes",
+                    NHugePages(forecast_error_).in_bytes());
+  forecast.PrintI64("realized_demand_bytes",
+                    NHugePages(realized_demand_).in_bytes());
+}
+
 // The logic for actually allocating from the cache or backing, and keeping
 // the hit rates specified.
-HugeRange HugeCache::DoGet(HugeLength n, bool* from_released) {
-  auto* node = Find(n);
+HugeRange HugeCache::DoGet(HugeLength n, bool* from_released,
+                           bool* known_zero, int numa_node) {
+  // Fall back to the pools of other nodes before backing more memory.
+  const size_t local = PoolIndex(numa_node);
+  size_t pool = local;
+  auto* node = cache_[local].BestFit(n);
+  for (size_t i = 1; node == nullptr && i < kNumaPools; ++i) {
+    pool = (local + i) % kNumaPools;
+    node = cache_[pool].BestFit(n);
+  }
   if (!node) {
     misses_++;
     weighted_misses_ += n.raw_num();
-    HugeRange res = allocator_->Get(n);
+    HugeRange res = allocator_->Get(n, known_zero);
     if (res.valid()) {
       *from_released = true;
     }
@@ -121,19 +202,42 @@ HugeRange HugeCache::DoGet(HugeLength n, bool* from_released) {
   }
   hits_++;
   weighted_hits_ += n.raw_num();
+  pool_hits_[pool]++;
+  if (pool != local && numa_node != kAnyNumaNode) {
+    cross_node_hits_++;
+  }
   *from_released = false;
+  if (known_zero != nullptr) {
+    *known_zero = false;
+  }
   size_ -= n;
   UpdateSize(size());
   HugeRange result, leftover;
   // Put back whatever we have left (or nothing, if it's exact.)
   std::tie(result, leftover) = Split(node->range(), n);
-  cache_.Remove(node);
+  const int64_t when = node->when();
+  cache_[pool].Remove(node);
   if (leftover.valid()) {
-    cache_.Insert(leftover);
+    cache_[pool].Insert(leftover, when);
   }
   return result;
 }
 
+HugeAddressMap::Node* HugeCache::OldestNode(size_t* pool) {
+  HugeAddressMap::Node* oldest = nullptr;
+  for (size_t i = 0; i < kNumaPools; ++i) {
+    HugeAddressMap::Node* node = cache_[i].Oldest();
+    if (node == nullptr) continue;
+    if (oldest == nullptr || node->when() < oldest->when() ||
+        (node->when() == oldest->when() &&
+         node->range().len() < oldest->range().len())) {
+      oldest = node;
+      *pool = i;
+    }
+  }
+  return oldest;
+}
+
 void HugeCache::MaybeGrowCacheLimit(HugeLength missed) {
   // Our goal is to make the cache size = the largest "brief dip."
   //
@@ -174,7 +278,7 @@ void HugeCache::MaybeGrowCacheLimit(HugeLength missed) {
 
   const HugeLength lim = dip + slack;
 
-  if (lim > limit()) {
+  if (lim > limit_) {
     last_limit_change_ = clock_.now();
     limit_ = lim;
   }
@@ -184,6 +288,7 @@ void HugeCache::IncUsage(HugeLength n) {
   usage_ += n;
   usage_tracker_.Report(usage_);
   detailed_tracker_.Report(usage_);
+  if (forecast_demand_) forecaster_.Report(usage_);
   off_peak_tracker_.Report(NHugePages(0));
 }
 
@@ -191,6 +296,7 @@ void HugeCache::DecUsage(HugeLength n) {
   usage_ -= n;
   usage_tracker_.Report(usage_);
   detailed_tracker_.Report(usage_);
+  if (forecast_demand_) forecaster_.Report(usage_);
   const HugeLength max = usage_tracker_.MaxOverTime(cache_time_);
   TC_ASSERT_GE(max, usage_);
   const HugeLength off_peak = max - usage_;
@@ -199,8 +305,9 @@ void HugeCache::DecUsage(HugeLength n) {
 
 void HugeCache::UpdateSize(HugeLength size) { size_tracker_.Report(size); }
 
-HugeRange HugeCache::Get(HugeLength n, bool* from_released) {
-  HugeRange r = DoGet(n, from_released);
+HugeRange HugeCache::Get(HugeLength n, bool* from_released, bool* known_zero,
+                         int numa_node) {
+  HugeRange r = DoGet(n, from_released, known_zero, numa_node);
   // failure to get a range should "never" "never" happen (VSS limits
   // or wildly incorrect allocation sizes only...) Don't deal with
   // this case for cache size accounting.
@@ -211,16 +318,27 @@ HugeRange HugeCache::Get(HugeLength n, bool* from_released) {
   return r;
 }
 
-void HugeCache::Release(HugeRange r) {
+HugeRange HugeCache::GetUnbacked(HugeLength n, bool* known_zero) {
+  HugeRange r = allocator_->Get(n, known_zero);
+  IncUsage(r.len());
+  return r;
+}
+
+void HugeCache::Release(HugeRange r, int numa_node) {
   DecUsage(r.len());
 
-  cache_.Insert(r);
+  cache_[PoolIndex(numa_node)].Insert(r, clock_.now());
   size_ += r.len();
   if (size_ <= limit()) {
     fills_++;
   } else {
     overflows_++;
   }
+  if (keep_backed_ ||
+      (defer_release_ && size_ <= limit() * kMaxDeferredFactor)) {
+    UpdateSize(size());
+    return;
+  }
   // Shrink the limit, if we're going to do it, before we shrink to
   // the max size.  (This could reduce the number of regions we break
   // in half to avoid overshrinking.)
@@ -231,10 +349,10 @@ void HugeCache::Release(HugeRange r) {
   UpdateSize(size());
 }
 
-void HugeCache::ReleaseUnbacked(HugeRange r) {
+void HugeCache::ReleaseUnbacked(HugeRange r, bool known_zero) {
   DecUsage(r.len());
   // No point in trying to cache it, just hand it back.
-  allocator_->Release(r);
+  allocator_->Release(r, known_zero);
 }
 
 HugeLength HugeCache::MaybeShrinkCacheLimit() {
@@ -246,9 +364,10 @@ HugeLength HugeCache::MaybeShrinkCacheLimit() {
   // too much/too often unless we have large gaps in usage.
   if (min < limit() / 5) return NHugePages(0);
 
-  // Take away half of the unused portion.
+  // Take away half of the unused portion.  The forecast headroom, if any, is
+  // kept on top of this by limit().
   HugeLength drop = std::max(min / 2, NHugePages(1));
-  limit_ = std::max(limit() <= drop ? NHugePages(0) : limit() - drop,
+  limit_ = std::max(limit_ <= drop ? NHugePages(0) : limit_ - drop,
                     MinCacheLimit());
   return ShrinkCache(limit());
 }
@@ -256,43 +375,71 @@ HugeLength HugeCache::MaybeShrinkCacheLimit() {
 HugeLength HugeCache::ShrinkCache(HugeLength target) {
   HugeLength removed = NHugePages(0);
   while (size_ > target) {
-    // Remove smallest-ish nodes, to avoid fragmentation where possible.
-    auto* node = Find(NHugePages(1));
-    TC_CHECK_NE(node, nullptr);
-    HugeRange r = node->range();
-    cache_.Remove(node);
-    // Suppose we're 10 MiB over target but the smallest available node
-    // is 100 MiB.  Don't go overboard--split up the range.
-    // In particular - this prevents disastrous results if we've decided
-    // the cache should be 99 MiB but the actual hot usage is 100 MiB
-    // (and it is unfragmented).
-    const HugeLength delta = size() - target;
-    if (r.len() > delta) {
-      HugeRange to_remove, leftover;
-      std::tie(to_remove, leftover) = Split(r, delta);
-      TC_ASSERT(leftover.valid());
-      cache_.Insert(leftover);
-      r = to_remove;
+    // Collect a batch of ranges to release together.
+    HugeRange batch[kMaxReleaseBatch];
+    Range pages[kMaxReleaseBatch];
+    size_t batch_pool[kMaxReleaseBatch];
+    int64_t batch_when[kMaxReleaseBatch];
+    size_t batch_size = 0;
+    while (size_ > target && batch_size < kMaxReleaseBatch) {
+      // Remove the least recently cached nodes, which are the least likely to
+      // be reused soon.
+      size_t pool;
+      auto* node = OldestNode(&pool);
+      TC_CHECK_NE(node, nullptr);
+      HugeRange r = node->range();
+      const int64_t when = node->when();
+      cache_[pool].Remove(node);
+      // Suppose we're 10 MiB over target but the smallest available node
+      // is 100 MiB.  Don't go overboard--split up the range.
+      // In particular - this prevents disastrous results if we've decided
+      // the cache should be 99 MiB but the actual hot usage is 100 MiB
+      // (and it is unfragmented).
+      const HugeLength delta = size() - target;
+      if (r.len() > delta) {
+        HugeRange to_remove, leftover;
+        std::tie(to_remove, leftover) = Split(r, delta);
+        TC_ASSERT(leftover.valid());
+        cache_[pool].Insert(leftover, when);
+        r = to_remove;
+      }
+
+      size_ -= r.len();
+      batch[batch_size] = r;
+      pages[batch_size] = Range(r.start().first_page(), r.len().in_pages());
+      batch_pool[batch_size] = pool;
+      batch_when[batch_size] = when;
+      ++batch_size;
     }
 
-    size_ -= r.len();
     // Note, actual unback implementation is temporarily dropping and
     // re-acquiring the page heap lock here.
-    if (ABSL_PREDICT_FALSE(!unback_(r).success)) {
-      // We failed to release r.  Retain it in the cache instead of returning it
-      // to the HugeAllocator.
-      size_ += r.len();
-      cache_.Insert(r);
+    const size_t released =
+        unback_.ApplyAll(absl::MakeConstSpan(pages, batch_size));
+    for (size_t i = 0; i < released; ++i) {
+      allocator_->Release(batch[i]);
+      removed += batch[i].len();
+      pool_released_[batch_pool[i]] += batch[i].len();
+    }
+    if (ABSL_PREDICT_FALSE(released < batch_size)) {
+      // We failed to release batch[released].  Retain it and the rest of the
+      // batch in the cache instead of returning them to the HugeAllocator.
+      for (size_t i = released; i < batch_size; ++i) {
+        size_ += batch[i].len();
+        cache_[batch_pool[i]].Insert(batch[i], batch_when[i]);
+      }
       break;
     }
-    allocator_->Release(r);
-    removed += r.len();
   }
 
   return removed;
 }
 
 HugeLength HugeCache::ReleaseCachedPages(HugeLength n) {
+  const HugeLength deferred = ReleaseDeferred();
+  n = n > deferred ? n - deferred : NHugePages(0);
+  // Periodic release keeps the forecast current even if usage is idle.
+  if (forecast_demand_) forecaster_.Report(usage_);
   // This is a good time to check: is our cache going persistently unused?
   HugeLength released = MaybeShrinkCacheLimit();
 
@@ -303,67 +450,32 @@ HugeLength HugeCache::ReleaseCachedPages(HugeLength n) {
   }
   UpdateSize(size());
   total_periodic_unbacked_ += released;
+  return deferred + released;
+}
+
+HugeLength HugeCache::ReleaseDeferred() {
+  if (keep_backed_ || !defer_release_ || size_ <= limit()) {
+    return NHugePages(0);
+  }
+  const HugeLength released = ShrinkCache(limit());
+  UpdateSize(size());
+  total_deferred_unbacked_ += released;
   return released;
 }
 
 void HugeCache::AddSpanStats(SmallSpanStats* small,
                              LargeSpanStats* large) const {
   static_assert(kPagesPerHugePage >= kMaxPages);
-  for (const HugeAddressMap::Node* node = cache_.first(); node != nullptr;
-       node = node->next()) {
-    HugeLength n = node->range().len();
-    if (large != nullptr) {
-      large->spans++;
-      large->normal_pages += n.in_pages();
-    }
-  }
-}
-
-HugeAddressMap::Node* HugeCache::Find(HugeLength n) {
-  HugeAddressMap::Node* curr = cache_.root();
-  // invariant: curr != nullptr && curr->longest >= n
-  // we favor smaller gaps and lower nodes and lower addresses, in that
-  // order. The net effect is that we are neither a best-fit nor a
-  // lowest-address allocator but vaguely close to both.
-  HugeAddressMap::Node* best = nullptr;
-  while (curr && curr->longest() >= n) {
-    if (curr->range().len() >= n) {
-      if (!best || best->range().len() > curr->range().len()) {
-        best = curr;
-      }
-    }
-
-    // Either subtree could contain a better fit and we don't want to
-    // search the whole tree. Pick a reasonable child to look at.
-    auto left = curr->left();
-    auto right = curr->right();
-    if (!left || left->longest() < n) {
-      curr = right;
-      continue;
-    }
-
-    if (!right || right->longest() < n) {
-      curr = left;
-      continue;
-    }
-
-    // Here, we have a nontrivial choice.
-    if (left->range().len() == right->range().len()) {
-      if (left->longest() <= right->longest()) {
-        curr = left;
-      } else {
-        curr = right;
+  for (const HugeAddressMap& pool : cache_) {
+    for (const HugeAddressMap::Node* node = pool.first(); node != nullptr;
+         node = node->next()) {
+      HugeLength n = node->range().len();
+      if (large != nullptr) {
+        large->spans++;
+        large->normal_pages += n.in_pages();
       }
-    } else if (left->range().len() < right->range().len()) {
-      // Here, the longest range in both children is the same...look
-      // in the subtree with the smaller root, as that's slightly
-      // more likely to be our best.
-      curr = left;
-    } else {
-      curr = right;
     }
   }
-  return best;
 }
 
 void HugeCache::Print(Printer& out) {
@@ -389,6 +501,23 @@ void HugeCache::Print(Printer& out) {
   out.printf("HugeCache: %zu MiB fast unbacked, %zu MiB periodic\n",
              total_fast_unbacked_.in_bytes() / 1024 / 1024,
              total_periodic_unbacked_.in_bytes() / 1024 / 1024);
+  if (defer_release_) {
+    out.printf("HugeCache: %zu MiB unbacked after deferral\n",
+               total_deferred_unbacked_.in_mib());
+  }
+  out.printf("HugeCache: %zu hits from another node's pool\n",
+             cross_node_hits_);
+  for (size_t i = 0; i < kNumaPools; ++i) {
+    const HugeLength cached = cache_[i].total_mapped();
+    if (cached == NHugePages(0) && pool_hits_[i] == 0 &&
+        pool_released_[i] == NHugePages(0)) {
+      continue;
+    }
+    out.printf(
+        "HugeCache: node pool %zu: %zu hugepages cached, %zu hits, "
+        "%zu MiB released\n",
+        i, cached.raw_num(), pool_hits_[i], pool_released_[i].in_mib());
+  }
   UpdateSize(size());
 
   usage_tracker_.Report(usage_);
@@ -412,6 +541,8 @@ void HugeCache::Print(Printer& out) {
       "HugeCache: recent cache range: %zu min - %zu curr - %zu max MiB\n",
       cache_min.in_mib(), size_.in_mib(), cache_max.in_mib());
 
+  if (forecast_demand_) forecaster_.Print(out);
+
   detailed_tracker_.Print(out);
 }
 
@@ -441,6 +572,20 @@ void HugeCache::PrintInPbtxt(PbtxtRegion& hpaa) {
   hpaa.PrintI64("fast_unbacked_bytes", total_fast_unbacked_.in_bytes());
   // bytes unbacked by periodic releaser thread
   hpaa.PrintI64("periodic_unbacked_bytes", total_periodic_unbacked_.in_bytes());
+  hpaa.PrintI64("deferred_unbacked_bytes", total_deferred_unbacked_.in_bytes());
+  hpaa.PrintI64("huge_cache_cross_node_hits", cross_node_hits_);
+  for (size_t i = 0; i < kNumaPools; ++i) {
+    const HugeLength cached = cache_[i].total_mapped();
+    if (cached == NHugePages(0) && pool_hits_[i] == 0 &&
+        pool_released_[i] == NHugePages(0)) {
+      continue;
+    }
+    auto pool = hpaa.CreateSubRegion("huge_cache_node_pool");
+    pool.PrintI64("pool", i);
+    pool.PrintI64("cached_bytes", cached.in_bytes());
+    pool.PrintI64("hits", pool_hits_[i]);
+    pool.PrintI64("released_bytes", pool_released_[i].in_bytes());
+  }
   UpdateSize(size());
 
   usage_tracker_.Report(usage_);
@@ -472,6 +617,7 @@ void HugeCache::PrintInPbtxt(PbtxtRegion& hpaa) {
     usage_stats.PrintI64("current_bytes", size_.in_bytes());
     usage_stats.PrintI64("max_bytes", cache_max.in_bytes());
   }
+  if (forecast_demand_) forecaster_.PrintInPbtxt(hpaa);
   detailed_tracker_.PrintInPbtxt(hpaa);
 }
 
@@ -28,6 +28,7 @@
 #include "absl/base/nullability.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "tcmalloc/huge_address_map.h"
 #include "tcmalloc/huge_allocator.h"
 #include "tcmalloc/huge_pages.h"
@@ -51,6 +52,15 @@ class MemoryModifyFunction {
   [[nodiscard]] MemoryModifyStatus operator()(HugeRange r) {
     return (*this)(Range{r.start().first_page(), r.len().in_pages()});
   }
+
+  // Applies the function to each of <ranges>, in order, stopping at the first
+  // one it fails on.  Returns the number of ranges it succeeded on.
+  // Implementations may override this to modify all the ranges at once.
+  [[nodiscard]] virtual size_t ApplyAll(absl::Span<const Range> ranges) {
+    size_t n = 0;
+    while (n < ranges.size() && (*this)(ranges[n]).success) ++n;
+    return n;
+  }
 };
 
 class MemoryTagFunction {
@@ -60,6 +70,28 @@ class MemoryTagFunction {
   virtual void operator()(Range r, std::optional<absl::string_view> name) = 0;
 };
 
+class MemoryTierFunction {
+ public:
+  virtual ~MemoryTierFunction() = default;
+
+  // Moves the memory in r to the far memory tier if far is true, and back to
+  // the default placement for its tag otherwise.
+  [[nodiscard]] virtual MemoryModifyStatus operator()(Range r, bool far) = 0;
+  [[nodiscard]] MemoryModifyStatus operator()(HugeRange r, bool far) {
+    return (*this)(Range{r.start().first_page(), r.len().in_pages()}, far);
+  }
+};
+
+class PageOutFunction {
+ public:
+  virtual ~PageOutFunction() = default;
+
+  // Has the kernel reclaim the memory in r, to swap or zswap, right away if
+  // reclaim is true, and before other memory otherwise.
+  [[nodiscard]] virtual MemoryModifyStatus operator()(Range r,
+                                                      bool reclaim) = 0;
+};
+
 // Track the extreme values of a HugeLength value over the past
 // kWindow (time ranges approximate.)
 template <size_t kSlots = 16>
@@ -109,16 +141,83 @@ class MinMaxTracker {
 extern template class MinMaxTracker<>;
 extern template class MinMaxTracker<600>;
 
+// Forecasts the peak hugepage demand of the current kEpochLength from the
+// demand seen over the last day, so that HugeCache can keep memory backed
+// ahead of a predictable ramp rather than unbacking and refaulting it.
+//
+// The forecast is the larger of:
+// - the peak demand over the same and the following epoch kSeasonalLag ago,
+//   which follows diurnal load;
+// - the recent peak demand, decayed by half every kHalfLife, so that a dip
+//   in load holds on to memory for a while even without a daily pattern.
+//
+// The forecast is scored against the demand that materialized every epoch.
+class DemandForecaster {
+ public:
+  static constexpr absl::Duration kEpochLength = absl::Minutes(15);
+  static constexpr absl::Duration kSeasonalLag = absl::Hours(24);
+  static constexpr absl::Duration kHalfLife = absl::Hours(1);
+  static constexpr absl::Duration kRecentWindow = absl::Hours(4);
+  // Enough to hold a day and a bit, even if every epoch has a record.
+  static constexpr size_t kSlots = 100;
+
+  explicit constexpr DemandForecaster(Clock clock)
+      : timeseries_(clock, kEpochLength) {}
+
+  // Records the current demand.  Returns true if this started a new epoch,
+  // and hence updated the forecast.
+  bool Report(HugeLength demand);
+
+  // The forecast peak demand for the current epoch.
+  HugeLength forecast() const { return forecast_; }
+
+  void Print(Printer& out) const;
+  void PrintInPbtxt(PbtxtRegion& hpaa) const;
+
+ private:
+  struct Peak {
+    HugeLength max;
+
+    static Peak Nil() { return Peak{NHugePages(0)}; }
+    void Report(HugeLength n) { max = std::max(max, n); }
+    bool empty() const { return max == NHugePages(0); }
+  };
+
+  HugeLength Forecast() const;
+
+  TimeSeriesTracker<Peak, HugeLength, kSlots> timeseries_;
+
+  HugeLength forecast_{NHugePages(0)};
+  bool has_forecast_{false};
+
+  // How past forecasts compared with the demand that materialized.
+  size_t forecasts_{0};
+  size_t under_forecasts_{0};
+  size_t over_forecasts_{0};
+  uint64_t forecast_error_{0};
+  uint64_t realized_demand_{0};
+};
+
+// Cached hugepages are kept in one pool per NUMA node, so that Get() hands out
+// hugepages backed on the caller's node while there are any, and released
+// longest-cached first.
 class HugeCache {
  public:
+  // Passed as numa_node when the caller does not know or care which node
+  // backs the hugepages, as with HugePageFiller<>::kAnyNumaNode.
+  static constexpr int kAnyNumaNode = -1;
+  // Nodes past kNumaPools share pools.
+  static constexpr size_t kNumaPools = 4;
+
   // For use in production
   HugeCache(HugeAllocator& allocator ABSL_ATTRIBUTE_LIFETIME_BOUND,
             MetadataAllocator& meta_allocate ABSL_ATTRIBUTE_LIFETIME_BOUND,
             MemoryModifyFunction& unback ABSL_ATTRIBUTE_LIFETIME_BOUND,
-            absl::Duration cache_time)
+            absl::Duration cache_time, bool forecast_demand = false)
       : HugeCache(allocator, meta_allocate, unback, cache_time,
                   Clock{.now = absl::base_internal::CycleClock::Now,
-                        .freq = absl::base_internal::CycleClock::Frequency}) {}
+                        .freq = absl::base_internal::CycleClock::Frequency},
+                  forecast_demand) {}
 
   // For testing with mock clock.
   //
@@ -147,12 +246,22 @@ class HugeCache {
   // capture the empirical dynamics we've seen.  See "Beyond Malloc
   // Efficiency..." (https://research.google/pubs/pub50370/) for more
   // information.
+  //
+  // If forecast_demand is set, the limit is additionally kept at or above the
+  // demand DemandForecaster expects beyond current usage.
+  //
+  // If defer_release is set, Release() leaves hugepages over the limit cached
+  // for ReleaseDeferred() to release, so that freeing threads do not wait on
+  // the kernel.  A deferred hugepage reused in the meantime is simply not
+  // released.
   HugeCache(HugeAllocator& allocator ABSL_ATTRIBUTE_LIFETIME_BOUND,
             MetadataAllocator& meta_allocate ABSL_ATTRIBUTE_LIFETIME_BOUND,
             MemoryModifyFunction& unback ABSL_ATTRIBUTE_LIFETIME_BOUND,
-            absl::Duration cache_time, Clock clock)
+            absl::Duration cache_time, Clock clock,
+            bool forecast_demand = false, bool defer_release = false)
       : allocator_(&allocator),
-        cache_(meta_allocate),
+        cache_{HugeAddressMap(meta_allocate), HugeAddressMap(meta_allocate),
+               HugeAddressMap(meta_allocate), HugeAddressMap(meta_allocate)},
         clock_(clock),
         cache_time_ticks_(clock_.freq() * absl::ToDoubleSeconds(cache_time)),
         nanoseconds_per_tick_(absl::ToInt64Nanoseconds(absl::Seconds(1)) /
@@ -162,34 +271,76 @@ class HugeCache {
         usage_tracker_(clock, cache_time * 2),
         off_peak_tracker_(clock, cache_time * 2),
         size_tracker_(clock, cache_time * 2),
+        forecaster_(clock),
+        forecast_demand_(forecast_demand),
+        defer_release_(defer_release),
         unback_(unback),
         cache_time_(cache_time) {}
   // Allocate a usable set of <n> contiguous hugepages.  Try to give out
   // memory that's currently backed from the kernel if we have it available.
   // *from_released is set to false if the return range is already backed;
-  // otherwise, it is set to true (and the caller should back it.)
-  HugeRange Get(HugeLength n, bool* absl_nonnull from_released);
+  // otherwise, it is set to true (and the caller should back it.)  If
+  // known_zero is not null, *known_zero is set to true iff the range is known
+  // to be zero, which only unbacked ranges can be.
+  //
+  // Cached hugepages on <numa_node> are preferred over those on other nodes.
+  HugeRange Get(HugeLength n, bool* absl_nonnull from_released,
+                bool* absl_nullable known_zero = nullptr,
+                int numa_node = kAnyNumaNode);
+
+  // As Get, but the range always comes, unbacked, from the HugeAllocator.  For
+  // address space about to be given pages that are already backed elsewhere.
+  HugeRange GetUnbacked(HugeLength n, bool* absl_nullable known_zero = nullptr);
 
-  // Deallocate <r> (assumed to be backed by the kernel.)
-  void Release(HugeRange r);
+  // Deallocate <r> (assumed to be backed by the kernel, on <numa_node> if
+  // known.)
+  void Release(HugeRange r, int numa_node = kAnyNumaNode);
 
-  // As Release, but the range is assumed to _not_ be backed.
-  void ReleaseUnbacked(HugeRange r);
+  // As Release, but the range is assumed to _not_ be backed.  known_zero is
+  // true if no part of <r> still holds data, e.g. if it was released in full.
+  void ReleaseUnbacked(HugeRange r, bool known_zero = false);
 
   // Release to the system up to <n> hugepages of cache contents; returns
   // the number of hugepages released. It also triggers cache shrinking if
-  // the cache becomes too big.
+  // the cache becomes too big.  Hugepages whose release was deferred are
+  // released first, and count towards <n>.  Like every release, this starts
+  // with the hugepages that have been cached the longest.
   HugeLength ReleaseCachedPages(HugeLength n);
 
+  // Releases the hugepages over the limit that Release() left cached, and
+  // returns their number.
+  HugeLength ReleaseDeferred();
+
+  // While set, Release() and ReleaseDeferred() keep every hugepage cached,
+  // whatever the limit, and only ReleaseCachedPages() gives memory back.
+  // Used when memory is mlock()ed, where releasing it is costly and of little
+  // use unless a memory limit requires it.
+  void set_keep_backed(bool v) { keep_backed_ = v; }
+  bool keep_backed() const { return keep_backed_; }
+
   // Backed memory available.
   HugeLength size() const { return size_; }
   // Current limit for how much backed memory we'll cache.
-  HugeLength limit() const { return limit_; }
+  HugeLength limit() const { return std::max(limit_, ForecastHeadroom()); }
   // Sum total of unreleased requests.
   HugeLength usage() const { return usage_; }
 
   void AddSpanStats(SmallSpanStats* small, LargeSpanStats* large) const;
 
+  // Calls func(HugePage) for each hugepage in the cache, all of them backed.
+  template <typename F>
+  void ForEachHugePage(const F& func) const {
+    for (const HugeAddressMap& pool : cache_) {
+      for (const HugeAddressMap::Node* node = pool.first(); node != nullptr;
+           node = node->next()) {
+        const HugeRange r = node->range();
+        for (size_t i = 0; i < r.len().raw_num(); ++i) {
+          func(r.start() + NHugePages(i));
+        }
+      }
+    }
+  }
+
   BackingStats stats() const {
     BackingStats s;
     s.system_bytes = (usage() + size()).in_bytes();
@@ -214,12 +365,24 @@ class HugeCache {
   // Ensure the cache contains at most <target> hugepages,
   // returning the number removed.
   HugeLength ShrinkCache(HugeLength target);
+  // ShrinkCache hands ranges to unback_ in batches of up to this many.
+  static constexpr size_t kMaxReleaseBatch = 16;
 
-  HugeRange DoGet(HugeLength n, bool* from_released);
+  HugeRange DoGet(HugeLength n, bool* from_released, bool* known_zero,
+                  int numa_node);
 
-  HugeAddressMap::Node* Find(HugeLength n);
+  static size_t PoolIndex(int numa_node) {
+    return numa_node < 0 ? 0 : numa_node % kNumaPools;
+  }
 
-  HugeAddressMap cache_;
+  // Returns the node cached the longest, and sets *pool to its pool.  Ties go
+  // to the shortest range, to avoid fragmentation where possible.  As merged
+  // ranges average their times (see HugeAddressMap::Node::when), "oldest" is
+  // approximate.
+  HugeAddressMap::Node* OldestNode(size_t* pool);
+
+  HugeAddressMap cache_[kNumaPools];
+  static_assert(kNumaPools == 4, "Update the initialization of cache_");
   HugeLength size_{NHugePages(0)};
 
   HugeLength limit_{NHugePages(10)};
@@ -230,6 +393,10 @@ class HugeCache {
   size_t overflows_{0};
   uint64_t weighted_hits_{0};
   uint64_t weighted_misses_{0};
+  // Hits served from the pool of another node than the caller asked for.
+  size_t cross_node_hits_{0};
+  size_t pool_hits_[kNumaPools] = {};
+  HugeLength pool_released_[kNumaPools] = {};
 
   // Sum(size of Gets) - Sum(size of Releases), i.e. amount of backed
   // hugepages our user currently wants to have.
@@ -251,14 +418,31 @@ class HugeCache {
 
   void UpdateSize(HugeLength size);
 
+  // How much demand beyond current usage we expect, if forecasting.
+  HugeLength ForecastHeadroom() const {
+    if (!forecast_demand_) return NHugePages(0);
+    const HugeLength forecast = forecaster_.forecast();
+    return forecast > usage_ ? forecast - usage_ : NHugePages(0);
+  }
+
   MinMaxTracker<600> detailed_tracker_;
 
   MinMaxTracker<> usage_tracker_;
   MinMaxTracker<> off_peak_tracker_;
   MinMaxTracker<> size_tracker_;
 
+  DemandForecaster forecaster_;
+  const bool forecast_demand_;
+
+  // Release() defers releasing the cache down to its limit until it grows past
+  // this many times the limit.
+  static constexpr size_t kMaxDeferredFactor = 2;
+  const bool defer_release_;
+  bool keep_backed_ = false;
+
   HugeLength total_fast_unbacked_{NHugePages(0)};
   HugeLength total_periodic_unbacked_{NHugePages(0)};
+  HugeLength total_deferred_unbacked_{NHugePages(0)};
 
   MemoryModifyFunction& unback_;
   absl::Duration cache_time_;
@@ -20,6 +20,7 @@
 
 #include <algorithm>
 #include <cstring>
+#include <limits>
 #include <random>
 #include <string>
 #include <tuple>
@@ -31,6 +32,7 @@
 #include "absl/random/random.h"
 #include "absl/strings/str_cat.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "tcmalloc/huge_pages.h"
 #include "tcmalloc/internal/clock.h"
 #include "tcmalloc/internal/config.h"
@@ -90,6 +92,10 @@ class HugeCacheTest : public testing::TestWithParam<absl::Duration> {
     clock_ += absl::ToDoubleSeconds(d) * GetFakeClockFrequency();
   }
 
+  static Clock GetClock() {
+    return Clock{.now = FakeClock, .freq = GetFakeClockFrequency};
+  }
+
   absl::Duration GetCacheTime() { return GetParam(); }
   void Release(HugeRange r) { cache_.Release(r); }
 
@@ -496,6 +502,203 @@ TEST_P(HugeCacheTest, Usage) {
   EXPECT_EQ(NHugePages(0), cache_.usage());
 }
 
+TEST_P(HugeCacheTest, ReleasesInBatches) {
+  class BatchUnback final : public MemoryModifyFunction {
+   public:
+    MemoryModifyStatus operator()(Range) override {
+      return {.success = true, .error_number = 0};
+    }
+
+    size_t ApplyAll(absl::Span<const Range> ranges) override {
+      ++batches;
+      return std::min(ranges.size(), succeed);
+    }
+
+    size_t batches = 0;
+    size_t succeed = std::numeric_limits<size_t>::max();
+  };
+  BatchUnback unback;
+  HugeCache cache{alloc_, metadata_allocator_, unback, GetCacheTime(),
+                  GetClock()};
+
+  // Leave three disjoint ranges in the cache.
+  bool from;
+  HugeRange r[6];
+  for (HugeRange& range : r) {
+    range = cache.Get(NHugePages(1), &from);
+  }
+  cache.Release(r[0]);
+  cache.Release(r[2]);
+  cache.Release(r[4]);
+  ASSERT_EQ(cache.size(), NHugePages(3));
+
+  // They are released with a single call, and the ones that fail are kept.
+  unback.succeed = 1;
+  EXPECT_EQ(cache.ReleaseCachedPages(NHugePages(3)), NHugePages(1));
+  EXPECT_EQ(unback.batches, 1);
+  EXPECT_EQ(cache.size(), NHugePages(2));
+
+  unback.succeed = std::numeric_limits<size_t>::max();
+  EXPECT_EQ(cache.ReleaseCachedPages(NHugePages(2)), NHugePages(2));
+  EXPECT_EQ(unback.batches, 2);
+  EXPECT_EQ(cache.size(), NHugePages(0));
+
+  cache.ReleaseUnbacked(r[1]);
+  cache.ReleaseUnbacked(r[3]);
+  cache.ReleaseUnbacked(r[5]);
+}
+
+TEST_P(HugeCacheTest, DeferredRelease) {
+  class CountingUnback final : public MemoryModifyFunction {
+   public:
+    MemoryModifyStatus operator()(Range r) override {
+      unbacked += r.n;
+      return {.success = true, .error_number = 0};
+    }
+
+    Length unbacked;
+  };
+  CountingUnback unback;
+  HugeCache cache{alloc_,
+                  metadata_allocator_,
+                  unback,
+                  GetCacheTime(),
+                  GetClock(),
+                  /*forecast_demand=*/false,
+                  /*defer_release=*/true};
+
+  // Going over the limit leaves the excess cached...
+  bool from;
+  const HugeLength limit = cache.limit();
+  HugeRange r = cache.Get(limit + NHugePages(5), &from);
+  ASSERT_EQ(cache.limit(), limit);
+  cache.Release(r);
+  EXPECT_EQ(cache.size(), limit + NHugePages(5));
+  EXPECT_EQ(unback.unbacked, Length(0));
+
+  // ...where it can be reused without faulting it back in...
+  r = cache.Get(NHugePages(2), &from);
+  EXPECT_FALSE(from);
+  cache.Release(r);
+
+  // ...until the deferred release.
+  EXPECT_EQ(cache.ReleaseDeferred(), NHugePages(5));
+  EXPECT_EQ(cache.size(), limit);
+  EXPECT_EQ(unback.unbacked, NHugePages(5).in_pages());
+  EXPECT_EQ(cache.ReleaseDeferred(), NHugePages(0));
+
+  // Far over the limit, the freeing thread releases the excess itself.
+  r = cache.Get(3 * limit, &from);
+  cache.Release(r);
+  EXPECT_LE(cache.size(), cache.limit());
+}
+
+TEST_P(HugeCacheTest, NumaPools) {
+  bool from;
+  const HugeLength one = NHugePages(1);
+  const HugeRange all = cache_.Get(NHugePages(3), &from);
+  HugeRange r[3];
+  for (int i = 0; i < 3; ++i) {
+    r[i] = HugeRange(all.start() + NHugePages(i), one);
+  }
+  cache_.Release(r[0], /*numa_node=*/1);
+  cache_.Release(r[1], /*numa_node=*/2);
+  cache_.Release(r[2], /*numa_node=*/2);
+  ASSERT_EQ(cache_.size(), NHugePages(3));
+
+  // A node's own hugepages are preferred, even over a better fit elsewhere...
+  HugeRange got = cache_.Get(one, &from, nullptr, /*numa_node=*/1);
+  EXPECT_FALSE(from);
+  EXPECT_EQ(got, r[0]);
+  cache_.Release(got, /*numa_node=*/1);
+  got = cache_.Get(NHugePages(2), &from, nullptr, /*numa_node=*/2);
+  EXPECT_FALSE(from);
+  EXPECT_EQ(got, HugeRange(r[1].start(), NHugePages(2)));
+  cache_.Release(got, /*numa_node=*/2);
+
+  // ...but another node's are reused rather than backing new ones.
+  got = cache_.Get(one, &from, nullptr, /*numa_node=*/3);
+  EXPECT_FALSE(from);
+  cache_.Release(got, /*numa_node=*/3);
+
+  std::string buffer(1024 * 1024, '\0');
+  Printer printer(&*buffer.begin(), buffer.size());
+  cache_.Print(printer);
+  buffer.resize(strlen(buffer.c_str()));
+  EXPECT_THAT(buffer,
+              testing::HasSubstr("HugeCache: 1 hits from another node's pool"));
+  EXPECT_THAT(buffer, testing::HasSubstr("HugeCache: node pool 1: "));
+  EXPECT_THAT(buffer, testing::HasSubstr("HugeCache: node pool 2: "));
+}
+
+TEST_P(HugeCacheTest, ReleasesOldestFirst) {
+  bool from;
+  const HugeLength one = NHugePages(1);
+  const HugeRange all = cache_.Get(NHugePages(5), &from);
+  HugeRange r[5];
+  for (int i = 0; i < 5; ++i) {
+    r[i] = HugeRange(all.start() + NHugePages(i), one);
+  }
+  // Disjoint ranges, cached at different times.
+  Release(r[4]);
+  Advance(absl::Seconds(1));
+  Release(r[0]);
+  Advance(absl::Seconds(1));
+  Release(r[2]);
+  ASSERT_EQ(cache_.size(), NHugePages(3));
+
+  testing::InSequence seq;
+  EXPECT_CALL(mock_unback_,
+              Unback(r[4].start().first_page(), kPagesPerHugePage))
+      .WillOnce(Return(MemoryModifyStatus{.success = true, .error_number = 0}));
+  EXPECT_CALL(mock_unback_,
+              Unback(r[0].start().first_page(), kPagesPerHugePage))
+      .WillOnce(Return(MemoryModifyStatus{.success = true, .error_number = 0}));
+  EXPECT_EQ(cache_.ReleaseCachedPages(NHugePages(2)), NHugePages(2));
+  EXPECT_EQ(cache_.size(), one);
+
+  HugeRange got = cache_.Get(one, &from);
+  EXPECT_FALSE(from);
+  EXPECT_EQ(got, r[2]);
+  Release(got);
+  cache_.ReleaseUnbacked(r[1]);
+  cache_.ReleaseUnbacked(r[3]);
+}
+
+TEST_P(HugeCacheTest, DemandForecast) {
+  ON_CALL(mock_unback_, Unback(testing::_, testing::_))
+      .WillByDefault(
+          Return(MemoryModifyStatus{.success = true, .error_number = 0}));
+
+  // Usage drops for a while, after being high for a whole epoch.
+  auto dip = [&](HugeCache& cache) {
+    bool from;
+    HugeRange r1 = cache.Get(NHugePages(100), &from);
+    Advance(DemandForecaster::kEpochLength);
+    HugeRange r2 = cache.Get(NHugePages(1), &from);
+    cache.Release(r1);
+    const HugeLength cached = cache.size();
+    cache.Release(r2);
+    return cached;
+  };
+
+  // The default policy has not seen a dip that it could have cached...
+  EXPECT_LE(dip(cache_), NHugePages(10));
+
+  // ...but the recent peak is forecast to return.
+  HugeCache forecasting{alloc_,         metadata_allocator_, mock_unback_,
+                        GetCacheTime(), GetClock(),
+                        /*forecast_demand=*/true};
+  EXPECT_EQ(dip(forecasting), NHugePages(100));
+  EXPECT_GE(forecasting.limit(), NHugePages(100));
+
+  std::string buffer(1024 * 1024, '\0');
+  Printer printer(&*buffer.begin(), buffer.size());
+  forecasting.Print(printer);
+  buffer.resize(strlen(buffer.c_str()));
+  EXPECT_THAT(buffer, testing::HasSubstr("HugeCache: demand forecast "));
+}
+
 class MinMaxTrackerTest : public testing::Test {
  protected:
   void Advance(absl::Duration d) {
@@ -563,6 +766,63 @@ TEST_F(MinMaxTrackerTest, Works) {
   EXPECT_EQ(NHugePages(1), tracker.MinOverTime(kDuration));
 }
 
+class DemandForecasterTest : public testing::Test {
+ protected:
+  void Advance(absl::Duration d) {
+    clock_ += absl::ToDoubleSeconds(d) * GetFakeClockFrequency();
+  }
+
+  static int64_t FakeClock() { return clock_; }
+
+  static double GetFakeClockFrequency() {
+    return absl::ToDoubleNanoseconds(absl::Seconds(2));
+  }
+
+ private:
+  static int64_t clock_;
+};
+
+int64_t DemandForecasterTest::clock_{0};
+
+TEST_F(DemandForecasterTest, RecentPeakAndSameTimeOfDay) {
+  DemandForecaster forecaster{
+      Clock{.now = FakeClock, .freq = GetFakeClockFrequency}};
+  const int64_t recent_epochs =
+      DemandForecaster::kRecentWindow / DemandForecaster::kEpochLength;
+  const int64_t lag_epochs =
+      DemandForecaster::kSeasonalLag / DemandForecaster::kEpochLength;
+
+  forecaster.Report(NHugePages(100));
+  EXPECT_EQ(forecaster.forecast(), NHugePages(0));
+
+  HugeLength last = NHugePages(100);
+  for (int64_t epoch = 1; epoch <= lag_epochs + 1; ++epoch) {
+    Advance(DemandForecaster::kEpochLength);
+    EXPECT_TRUE(forecaster.Report(NHugePages(0)));
+    SCOPED_TRACE(epoch);
+    if (epoch <= recent_epochs) {
+      // The peak decays, but is not forgotten, while it is recent.
+      EXPECT_GT(forecaster.forecast(), NHugePages(0));
+      EXPECT_LT(forecaster.forecast(), last);
+      last = forecaster.forecast();
+    } else if (epoch == lag_epochs - 1 || epoch == lag_epochs) {
+      // A day later, the peak is expected to come back.
+      EXPECT_EQ(forecaster.forecast(), NHugePages(100));
+    } else {
+      EXPECT_EQ(forecaster.forecast(), NHugePages(0));
+    }
+  }
+
+  // Every forecast after the first one has been scored.
+  std::string buffer(1024, '\0');
+  Printer printer(&*buffer.begin(), buffer.size());
+  forecaster.Print(printer);
+  buffer.resize(strlen(buffer.c_str()));
+  EXPECT_THAT(buffer,
+              testing::HasSubstr(absl::StrCat(lag_epochs, " forecasts, 0 "
+                                              "under / ")));
+}
+
 INSTANTIATE_TEST_SUITE_P(All, HugeCacheTest,
                          testing::Values(absl::Seconds(1), absl::Seconds(30)));
 
@@ -14,23 +14,35 @@
 
 #include "tcmalloc/huge_page_aware_allocator.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstddef>
+#include <cstdint>
 #include <optional>
 
 #include "absl/base/attributes.h"
 #include "absl/base/nullability.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "tcmalloc/arena.h"
 #include "tcmalloc/error_reporting.h"
+#include "tcmalloc/huge_page_filler.h"
 #include "tcmalloc/huge_pages.h"
 #include "tcmalloc/huge_region.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/environment.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/internal/mincore.h"
 #include "tcmalloc/internal/system_allocator.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/memory_pressure.h"
 #include "tcmalloc/pagemap.h"
 #include "tcmalloc/pages.h"
+#include "tcmalloc/parameters.h"
+#include "tcmalloc/slow_allocation_profiler.h"
 #include "tcmalloc/span.h"
 #include "tcmalloc/static_vars.h"
 
@@ -95,6 +107,54 @@ bool use_huge_region_more_often() {
   return true;
 }
 
+bool use_huge_cache_demand_forecast() {
+  const char* e = thread_safe_getenv("TCMALLOC_HUGE_CACHE_DEMAND_FORECAST");
+  if (e) {
+    switch (e[0]) {
+      case '0':
+        return false;
+      case '1':
+        return true;
+      default:
+        TC_BUG("bad env var '%s'", e);
+    }
+  }
+
+  return false;
+}
+
+bool use_huge_cache_deferred_release() {
+  const char* e = thread_safe_getenv("TCMALLOC_HUGE_CACHE_DEFERRED_RELEASE");
+  if (e) {
+    switch (e[0]) {
+      case '0':
+        return false;
+      case '1':
+        return true;
+      default:
+        TC_BUG("bad env var '%s'", e);
+    }
+  }
+
+  return false;
+}
+
+bool use_adaptive_hugepage_donation() {
+  const char* e = thread_safe_getenv("TCMALLOC_ADAPTIVE_HUGEPAGE_DONATION");
+  if (e) {
+    switch (e[0]) {
+      case '0':
+        return false;
+      case '1':
+        return true;
+      default:
+        TC_BUG("bad env var '%s'", e);
+    }
+  }
+
+  return false;
+}
+
 HugeRegionUsageOption huge_region_option() {
   // By default, we use slack to determine when to use HugeRegion. When slack is
   // greater than 64MB (to ignore small binaries), and greater than the number
@@ -110,7 +170,32 @@ HugeRegionUsageOption huge_region_option() {
              : HugeRegionUsageOption::kDefault;
 }
 
-Arena& StaticForwarder::arena() { return tc_globals.arena(); }
+Arena& StaticForwarder::arena(MemoryTag tag) { return tc_globals.arena(tag); }
+
+absl::Duration StaticForwarder::filler_skip_subrelease_short_interval() {
+  return tc_globals.memory_pressure_governor().ScaleSkipSubreleaseInterval(
+      Parameters::filler_skip_subrelease_short_interval());
+}
+
+absl::Duration StaticForwarder::filler_skip_subrelease_long_interval() {
+  return tc_globals.memory_pressure_governor().ScaleSkipSubreleaseInterval(
+      Parameters::filler_skip_subrelease_long_interval());
+}
+
+bool StaticForwarder::high_memory_pressure() {
+  return tc_globals.memory_pressure_governor().level() ==
+         MemoryPressureLevel::kHigh;
+}
+
+int StaticForwarder::CurrentNumaNode() {
+  const auto& numa = tc_globals.numa_topology();
+  // With at most one node per partition, the tags already keep hugepages of
+  // different nodes apart.
+  if (!numa.numa_aware() || numa.num_nodes() <= numa.active_partitions()) {
+    return HugePageFiller<PageTracker>::kAnyNumaNode;
+  }
+  return numa.GetCurrentNode();
+}
 
 void* StaticForwarder::GetHugepage(HugePage p) {
   return tc_globals.pagemap().GetHugepage(p.first_page());
@@ -142,18 +227,95 @@ Span* StaticForwarder::NewSpan(Range r) {
 void StaticForwarder::DeleteSpan(Span* span) { Span::Delete(span); }
 
 AddressRange StaticForwarder::AllocatePages(size_t bytes, size_t align,
-                                            MemoryTag tag) {
-  return tc_globals.system_allocator().Allocate(bytes, align, tag);
+                                            MemoryTag tag,
+                                            size_t size_class_region) {
+  ScopedSlowAllocationCause cause(SlowAllocationCause::kSystemAllocation);
+  return tc_globals.system_allocator().Allocate(bytes, align, tag,
+                                                size_class_region);
+}
+
+AddressRange StaticForwarder::AllocateGiganticPages(size_t bytes,
+                                                    MemoryTag tag) {
+  ScopedSlowAllocationCause cause(SlowAllocationCause::kSystemAllocation);
+  return tc_globals.system_allocator().AllocateGigantic(bytes, tag);
 }
 
 void StaticForwarder::Back(Range r) {
+  ScopedSlowAllocationCause cause(SlowAllocationCause::kPageBacking);
   tc_globals.system_allocator().Back(r.start_addr(), r.in_bytes());
 }
 
+void StaticForwarder::Populate(Range r) {
+  ScopedSlowAllocationCause cause(SlowAllocationCause::kPageBacking);
+  tc_globals.system_allocator().Populate(r.start_addr(), r.in_bytes());
+}
+
+MemoryModifyStatus StaticForwarder::SetMemoryTier(Range r, bool far) {
+  std::optional<int> far_node;
+  if (far) {
+    // Tiering may have been disabled since the hugepage was selected.
+    const int32_t node = Parameters::far_memory_numa_node();
+    if (node < 0) return {.success = false, .error_number = EINVAL};
+    far_node = node;
+  }
+  return tc_globals.system_allocator().SetMemoryTier(r.start_addr(),
+                                                     r.in_bytes(), far_node);
+}
+
+MemoryModifyStatus StaticForwarder::PageOut(Range r, bool reclaim) {
+  return tc_globals.system_allocator().PageOut(r.start_addr(), r.in_bytes(),
+                                               reclaim);
+}
+
+MemoryModifyStatus StaticForwarder::MovePages(Range r, PageId to) {
+  return tc_globals.system_allocator().Move(r.start_addr(), to.start_addr(),
+                                            r.in_bytes());
+}
+
+bool StaticForwarder::adaptive_madvise() {
+  return tc_globals.system_allocator().madvise_preference() ==
+         MadvisePreference::kAdaptive;
+}
+
+bool StaticForwarder::unbacked_memory_is_zero() {
+  return tc_globals.system_allocator().unbacked_memory_is_zero();
+}
+
+bool StaticForwarder::mlockall_mode() {
+  return tc_globals.system_allocator().mlockall_mode();
+}
+
 MemoryModifyStatus StaticForwarder::ReleasePages(Range r) {
   return tc_globals.system_allocator().Release(r.start_addr(), r.in_bytes());
 }
 
+MemoryModifyStatus StaticForwarder::ReleasePagesReusedSoon(Range r) {
+  return tc_globals.system_allocator().Release(r.start_addr(), r.in_bytes(),
+                                               ReleaseHint::kReusedSoon);
+}
+
+size_t StaticForwarder::ReleasePagesBatch(absl::Span<const Range> ranges) {
+  constexpr size_t kMaxBatch = 64;
+  AddressRange batch[kMaxBatch];
+  size_t released = 0;
+  while (released < ranges.size()) {
+    const size_t n = std::min(ranges.size() - released, kMaxBatch);
+    for (size_t i = 0; i < n; ++i) {
+      const Range& r = ranges[released + i];
+      batch[i] = {.ptr = r.start_addr(), .bytes = r.in_bytes()};
+    }
+    const size_t done = tc_globals.system_allocator().ReleaseBatch(
+        absl::MakeConstSpan(batch, n));
+    released += done;
+    if (done < n) break;
+  }
+  return released;
+}
+
+size_t StaticForwarder::ResidentBytes(Range r) {
+  return MInCore::residence(r.start_addr(), r.in_bytes());
+}
+
 void StaticForwarder::ReportDoubleFree(void* ptr) {
   ::tcmalloc::tcmalloc_internal::ReportDoubleFree(tc_globals, ptr);
 }
@@ -168,6 +330,14 @@ void StaticForwarder::SetAnonVmaName(Range r,
                                                name);
 }
 
+namespace span_trace_internal {
+ABSL_CONST_INIT std::atomic<SpanTraceHook> hook{nullptr};
+}  // namespace span_trace_internal
+
+void SetSpanTraceHook(SpanTraceHook hook) {
+  span_trace_internal::hook.store(hook, std::memory_order_release);
+}
+
 }  // namespace huge_page_allocator_internal
 
 }  // namespace tcmalloc_internal
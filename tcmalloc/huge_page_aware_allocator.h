@@ -17,6 +17,8 @@
 
 #include <stddef.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <optional>
 
@@ -26,15 +28,19 @@
 #include "absl/base/thread_annotations.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "tcmalloc/arena.h"
 #include "tcmalloc/central_freelist.h"
 #include "tcmalloc/common.h"
+#include "tcmalloc/donation_policy.h"
 #include "tcmalloc/huge_allocator.h"
 #include "tcmalloc/huge_cache.h"
 #include "tcmalloc/huge_page_filler.h"
+#include "tcmalloc/huge_page_subrelease.h"
 #include "tcmalloc/huge_pages.h"
 #include "tcmalloc/huge_region.h"
 #include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/clock.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/metadata_allocator.h"
@@ -57,16 +63,16 @@ bool decide_subrelease();
 
 HugeRegionUsageOption huge_region_option();
 bool use_huge_region_more_often();
+bool use_huge_cache_demand_forecast();
+bool use_huge_cache_deferred_release();
+bool use_adaptive_hugepage_donation();
 
 class StaticForwarder {
  public:
-  // Runtime parameters.  This can change between calls.
-  static absl::Duration filler_skip_subrelease_short_interval() {
-    return Parameters::filler_skip_subrelease_short_interval();
-  }
-  static absl::Duration filler_skip_subrelease_long_interval() {
-    return Parameters::filler_skip_subrelease_long_interval();
-  }
+  // Runtime parameters.  This can change between calls.  The skip-subrelease
+  // intervals are scaled by the memory pressure governor.
+  static absl::Duration filler_skip_subrelease_short_interval();
+  static absl::Duration filler_skip_subrelease_long_interval();
 
   static bool release_partial_alloc_pages() {
     return Parameters::release_partial_alloc_pages();
@@ -78,6 +84,35 @@ class StaticForwarder {
 
   static bool hpaa_subrelease() { return Parameters::hpaa_subrelease(); }
 
+  static absl::Duration hugepage_collapse_budget() {
+    return absl::Microseconds(Parameters::hugepage_collapse_budget_us());
+  }
+
+  static int64_t gigantic_page_threshold() {
+    return Parameters::gigantic_page_threshold();
+  }
+
+  static int64_t eager_populate_threshold() {
+    return Parameters::eager_populate_threshold();
+  }
+
+  static int32_t far_memory_numa_node() {
+    return Parameters::far_memory_numa_node();
+  }
+
+  static absl::Duration cold_page_out_idle_time() {
+    return Parameters::cold_page_out_idle_time();
+  }
+
+  // Whether the memory pressure governor found the pressure high.
+  static bool high_memory_pressure();
+
+  static bool adaptive_madvise();
+  // Whether unbacked memory, fresh or released, is known to read as zero.
+  static bool unbacked_memory_is_zero();
+  // Whether the process runs under mlockall(), so that our memory is locked.
+  static bool mlockall_mode();
+
   static EnableUnfilteredCollapse enable_unfiltered_collapse() {
     return Parameters::enable_unfiltered_collapse();
   }
@@ -86,12 +121,25 @@ class StaticForwarder {
     return Parameters::huge_region_adaptive_release();
   }
 
+  static bool hugepage_aligned_large_allocations() {
+    return Parameters::hugepage_aligned_large_allocations();
+  }
+
+  static bool huge_region_demand_based_release() {
+    return Parameters::huge_region_demand_based_release();
+  }
+
   static bool release_max_cold_pages() {
     return Parameters::release_max_cold_pages();
   }
 
-  // Arena state.
-  static Arena& arena();
+  // Arena state.  Returns the arena for metadata about memory with `tag`.
+  static Arena& arena(MemoryTag tag);
+
+  // NUMA state.  Returns the NUMA node of the current cpu when the NUMA
+  // partitions, and so the tags, each cover several nodes, and
+  // HugePageFiller<PageTracker>::kAnyNumaNode otherwise.
+  static int CurrentNumaNode();
 
   // PageAllocator state.
 
@@ -128,7 +176,10 @@ class StaticForwarder {
 
   // SystemAlloc state.
   [[nodiscard]] static AddressRange AllocatePages(size_t bytes, size_t align,
-                                                  MemoryTag tag);
+                                                  MemoryTag tag,
+                                                  size_t size_class_region);
+  [[nodiscard]] static AddressRange AllocateGiganticPages(size_t bytes,
+                                                          MemoryTag tag);
   static bool BackAllocations() {
     return Parameters::back_small_allocations();
   };
@@ -136,16 +187,79 @@ class StaticForwarder {
     return Parameters::back_size_threshold_bytes();
   };
   static void Back(Range r);
+  static void Populate(Range r);
   [[nodiscard]] static MemoryModifyStatus ReleasePages(Range r);
+  // Like ReleasePages, but hints that r is likely to be reused soon, so that
+  // it may be freed lazily with MADV_FREE.
+  [[nodiscard]] static MemoryModifyStatus ReleasePagesReusedSoon(Range r);
+  // Releases each of <ranges>, in order, stopping at the first failure.
+  // Returns the number of ranges released.
+  [[nodiscard]] static size_t ReleasePagesBatch(absl::Span<const Range> ranges);
+  // Returns the number of bytes of r backed by memory.
+  static size_t ResidentBytes(Range r);
   [[nodiscard]] static MemoryModifyStatus CollapsePages(Range r);
+  [[nodiscard]] static MemoryModifyStatus SetMemoryTier(Range r, bool far);
+  [[nodiscard]] static MemoryModifyStatus PageOut(Range r, bool reclaim);
+  // Moves the pages backing r to the range of the same length starting at to,
+  // leaving r unbacked.
+  [[nodiscard]] static MemoryModifyStatus MovePages(Range r, PageId to);
   static void SetAnonVmaName(Range r, std::optional<absl::string_view> name);
 };
 
 struct HugePageAwareAllocatorOptions {
   MemoryTag tag;
   HugeRegionUsageOption use_huge_region_more_often = huge_region_option();
+  // Whether HugeCache sizes itself ahead of forecast demand.
+  bool huge_cache_demand_forecast = use_huge_cache_demand_forecast();
+  // Whether HugeCache leaves releases over its limit to ReleaseDeferred().
+  bool huge_cache_deferred_release = use_huge_cache_deferred_release();
+  // Whether the slack of large allocations is donated to the filler as
+  // learned by DonationPolicy, rather than always.
+  bool adaptive_hugepage_donation = use_adaptive_hugepage_donation();
+  // For MemoryTag::kSizeClassed, the size class whose region backs this heap.
+  size_t size_class_region = 0;
+  // Drives the release intervals of the filler, the regions and the cache.
+  // Offline simulations replace it with simulated time.
+  Clock clock = {.now = absl::base_internal::CycleClock::Now,
+                 .freq = absl::base_internal::CycleClock::Frequency};
 };
 
+// A span allocated, freed, grown or shrunk by a HugePageAwareAllocator, as
+// reported to the span trace hook.  Spans are identified by their first page.
+struct SpanTraceEvent {
+  enum Op : uint8_t { kNew, kDelete, kExtend, kMove, kShrink };
+
+  // In ticks of HugePageAwareAllocatorOptions::clock.
+  int64_t time;
+  uint64_t first_page;
+  // For kMove, the first page the span moved to.
+  uint64_t moved_to;
+  // For kExtend and kMove, the length the span grew to; for kShrink, the
+  // length it shrank to.
+  uint64_t pages;
+  // For kNew, the requested alignment in pages.
+  uint64_t align;
+  uint32_t objects_per_span;
+  Op op;
+  MemoryTag tag;
+  uint8_t density;
+  uint8_t lifetime;
+};
+
+static_assert(sizeof(SpanTraceEvent) == 48);
+
+// Called for every span allocated, freed, grown or shrunk by any
+// HugePageAwareAllocator, so that the spans of a process can be replayed
+// offline against the filler, the regions and the cache with different
+// parameters.  The hook may be called with pageheap_lock held and must not
+// allocate.  Only one hook may be set at a time; nullptr removes it.
+using SpanTraceHook = void (*)(const SpanTraceEvent& event);
+void SetSpanTraceHook(SpanTraceHook hook);
+
+namespace span_trace_internal {
+ABSL_CONST_INIT extern std::atomic<SpanTraceHook> hook;
+}  // namespace span_trace_internal
+
 // An implementation of the PageAllocator interface that is hugepage-efficient.
 // Attempts to pack allocations into full hugepages wherever possible,
 // and aggressively returns empty ones to the system.
@@ -178,6 +292,16 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
                                  SpanAllocInfo span_alloc_info)
       ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
 
+  static constexpr size_t kMaxNewBatch = 16;
+
+  // As New, but allocates up to spans.size() runs of "n" pages, at most
+  // kMaxNewBatch, under a single acquisition of pageheap_lock.  The filler
+  // packs consecutive small runs, so they usually share a hugepage.  Stores
+  // the spans at the front of "spans" and returns how many were allocated,
+  // which is fewer than requested only if out of memory.
+  size_t NewBatch(Length n, SpanAllocInfo span_alloc_info,
+                  absl::Span<Span*> spans) ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
   // Delete the span "[p, p+n-1]".
   // REQUIRES: span was returned by earlier call to New() and
   //           has not yet been deleted.
@@ -189,6 +313,22 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
   void Delete(AllocationState s, SpanAllocInfo span_alloc_info)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override;
 
+  // Grows s in place if it was allocated from the filler or a region and the
+  // pages following it there are free.
+  bool TryExtend(AllocationState s, Length n)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
+
+  // Moves span to fresh address space with mremap if it came straight from
+  // the HugeCache.
+  bool TryMove(Span* absl_nonnull span, Length n)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
+
+  // Returns the tail of span to the filler or region it came from, or for
+  // spans straight from the HugeCache, its whole hugepages to the cache and
+  // any slack to the filler.
+  bool TryShrink(Span* absl_nonnull span, Length n)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
+
   BackingStats stats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override;
 
@@ -214,9 +354,49 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
   PageReleaseStats GetReleaseStats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override;
 
+  RefaultStats GetRefaultStats() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override {
+    return {.sampled = sampled_released_pages_, .refaulted = refaulted_pages_};
+  }
+
   void TreatHugepageTrackers(EnableCollapse enable_collapse)
       ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
 
+  // Faults in the hugepages queued by MaybeQueuePopulate, one madvise call per
+  // contiguous run, without holding pageheap_lock across the calls.
+  void PopulatePendingHugepages() ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
+
+  void ReleaseDeferred() ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
+
+  // Checks, with pageflags, whether a sample of the hugepages that the filler,
+  // the regions and the cache intend to keep intact are still backed by
+  // hugepages, which the kernel may have split since.
+  void VerifyHugepageCoverage(PageFlagsBase& pageflags)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
+
+  enum CoverageComponent {
+    kCoverageFiller,
+    kCoverageRegion,
+    kCoverageCache,
+    kNumCoverageComponents,
+  };
+
+  // The result of the last VerifyHugepageCoverage() for a component.
+  struct HugepageCoverage {
+    // Hugepages the component intended to be intact.
+    size_t intended = 0;
+    // Of these, the hugepages that were checked, and those found backed by a
+    // hugepage or that pageflags could not tell about.
+    size_t sampled = 0;
+    size_t backed = 0;
+    size_t unknown = 0;
+  };
+
+  HugepageCoverage hugepage_coverage(CoverageComponent component) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    return coverage_[component];
+  }
+
   // Prints stats about the page heap to *out.
   void Print(Printer& out, PageFlagsBase& pageflags)
       ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
@@ -266,6 +446,11 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
     return regions_;
   };
 
+  const HugePageFiller<PageTracker>& filler() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    return filler_;
+  }
+
   // IsValidSizeClass verifies size class parameters from the HPAA perspective.
   static bool IsValidSizeClass(size_t size, Length pages);
 
@@ -287,7 +472,23 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
 #ifndef NDEBUG
       pageheap_lock.AssertHeld();
 #endif  // NDEBUG
-      return hpaa_.forwarder_.ReleasePages(r);
+      ++hpaa_.release_generation_;
+      MemoryModifyStatus ret = hpaa_.forwarder_.ReleasePages(r);
+      if (ret.success) hpaa_.MaybeSampleRelease(r);
+      return ret;
+    }
+
+    [[nodiscard]] size_t ApplyAll(absl::Span<const Range> ranges) override
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+#ifndef NDEBUG
+      pageheap_lock.AssertHeld();
+#endif  // NDEBUG
+      ++hpaa_.release_generation_;
+      const size_t released = hpaa_.forwarder_.ReleasePagesBatch(ranges);
+      for (size_t i = 0; i < released; ++i) {
+        hpaa_.MaybeSampleRelease(ranges[i]);
+      }
+      return released;
     }
 
    public:
@@ -297,8 +498,9 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
   class UnbackWithoutLock final : public MemoryModifyFunction {
    public:
     explicit UnbackWithoutLock(
-        HugePageAwareAllocator& hpaa ABSL_ATTRIBUTE_LIFETIME_BOUND)
-        : hpaa_(hpaa) {}
+        HugePageAwareAllocator& hpaa ABSL_ATTRIBUTE_LIFETIME_BOUND,
+        ReleaseHint hint = ReleaseHint::kNotReused)
+        : hpaa_(hpaa), hint_(hint) {}
     ~UnbackWithoutLock() override = default;
 
     static void operator delete(void*) { __builtin_trap(); }
@@ -308,14 +510,45 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
 #ifndef NDEBUG
       pageheap_lock.AssertHeld();
 #endif  // NDEBUG
+      ++hpaa_.release_generation_;
+      const bool reused_soon = hint_ == ReleaseHint::kReusedSoon &&
+                               hpaa_.lazy_release_allowed_ &&
+                               hpaa_.forwarder_.adaptive_madvise();
       pageheap_lock.unlock();
-      MemoryModifyStatus ret = hpaa_.forwarder_.ReleasePages(r);
+      MemoryModifyStatus ret =
+          reused_soon ? hpaa_.forwarder_.ReleasePagesReusedSoon(r)
+                      : hpaa_.forwarder_.ReleasePages(r);
       pageheap_lock.lock();
+      if (ret.lazily_freed) hpaa_.RecordLazilyFreed(r);
+      if (ret.success) hpaa_.MaybeSampleRelease(r);
       return ret;
     }
 
+    [[nodiscard]] size_t ApplyAll(absl::Span<const Range> ranges) override
+        ABSL_NO_THREAD_SAFETY_ANALYSIS {
+#ifndef NDEBUG
+      pageheap_lock.AssertHeld();
+#endif  // NDEBUG
+      if (hint_ == ReleaseHint::kReusedSoon && hpaa_.lazy_release_allowed_ &&
+          hpaa_.forwarder_.adaptive_madvise()) {
+        // Lazily freed ranges are recorded one by one.
+        return MemoryModifyFunction::ApplyAll(ranges);
+      }
+      ++hpaa_.release_generation_;
+      pageheap_lock.unlock();
+      const size_t released = hpaa_.forwarder_.ReleasePagesBatch(ranges);
+      pageheap_lock.lock();
+      for (size_t i = 0; i < released; ++i) {
+        hpaa_.MaybeSampleRelease(ranges[i]);
+      }
+      return released;
+    }
+
    public:
     HugePageAwareAllocator& hpaa_;
+
+   private:
+    const ReleaseHint hint_;
   };
 
   class Collapse final : public MemoryModifyFunction {
@@ -336,6 +569,40 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
     HugePageAwareAllocator& hpaa_;
   };
 
+  class SetMemoryTier final : public MemoryTierFunction {
+   public:
+    explicit SetMemoryTier(
+        HugePageAwareAllocator& hpaa ABSL_ATTRIBUTE_LIFETIME_BOUND)
+        : hpaa_(hpaa) {}
+    ~SetMemoryTier() override = default;
+
+    static void operator delete(void*) { __builtin_trap(); }
+
+    [[nodiscard]] MemoryModifyStatus operator()(Range r, bool far) override {
+      return hpaa_.forwarder_.SetMemoryTier(r, far);
+    }
+
+   private:
+    HugePageAwareAllocator& hpaa_;
+  };
+
+  class PageOut final : public PageOutFunction {
+   public:
+    explicit PageOut(HugePageAwareAllocator& hpaa ABSL_ATTRIBUTE_LIFETIME_BOUND)
+        : hpaa_(hpaa) {}
+    ~PageOut() override = default;
+
+    static void operator delete(void*) { __builtin_trap(); }
+
+    [[nodiscard]] MemoryModifyStatus operator()(Range r,
+                                                bool reclaim) override {
+      return hpaa_.forwarder_.PageOut(r, reclaim);
+    }
+
+   private:
+    HugePageAwareAllocator& hpaa_;
+  };
+
   class SetAnonVmaName final : public MemoryTagFunction {
    public:
     explicit SetAnonVmaName(
@@ -354,10 +621,16 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
   };
 
   ABSL_ATTRIBUTE_NO_UNIQUE_ADDRESS Forwarder forwarder_;
+  const Clock clock_;
 
   Unback unback_ ABSL_GUARDED_BY(pageheap_lock);
   UnbackWithoutLock unback_without_lock_ ABSL_GUARDED_BY(pageheap_lock);
+  // Used by cache_: hugepages it returns to the OS are the first to be
+  // reused on a cache miss.
+  UnbackWithoutLock unback_cached_without_lock_ ABSL_GUARDED_BY(pageheap_lock);
   Collapse collapse_;
+  SetMemoryTier set_memory_tier_;
+  PageOut page_out_;
   SetAnonVmaName set_anon_vma_name_;
 
   typedef HugePageFiller<PageTracker> FillerType;
@@ -391,7 +664,7 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
     static void operator delete(void*) { __builtin_trap(); }
 
     [[nodiscard]] void* operator()(size_t bytes) override {
-      return hpaa_.forwarder_.arena().Alloc(bytes);
+      return hpaa_.forwarder_.arena(hpaa_.tag_).Alloc(bytes);
     }
 
    public:
@@ -407,6 +680,11 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
 
   FillerType::Tracker* GetTracker(HugePage p);
 
+  // Reports a span to the span trace hook, if one is set.
+  void TraceSpan(SpanTraceEvent::Op op, Range r, SpanAllocInfo span_alloc_info,
+                 Length pages = Length(0), Length align = Length(1),
+                 PageId moved_to = PageId(0));
+
   void SetTracker(HugePage p, FillerType::Tracker* pt);
 
   AddressRange AllocAndReport(size_t bytes, size_t align)
@@ -416,6 +694,7 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
   ArenaMetadataAllocator metadata_allocator_ ABSL_GUARDED_BY(pageheap_lock);
   HugeAllocator alloc_ ABSL_GUARDED_BY(pageheap_lock);
   HugeCache cache_ ABSL_GUARDED_BY(pageheap_lock);
+  const size_t size_class_region_;
 
   // donated_huge_pages_ measures the number of huge pages contributed to the
   // filler from left overs of large huge page allocations.  When the large
@@ -428,18 +707,119 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
   // reassembled.
   Length abandoned_pages_ ABSL_GUARDED_BY(pageheap_lock);
 
+  // If adaptive_donation_, decides which large allocations donate their slack
+  // to the filler.
+  const bool adaptive_donation_;
+  DonationPolicy donation_policy_ ABSL_GUARDED_BY(pageheap_lock);
+
+  // Large allocations placed on whole hugepages only because of
+  // hugepage_aligned_large_allocations(), and the pages that rounding them up
+  // to hugepages cost on top of what a region would have used.
+  size_t hugepage_aligned_allocs_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  Length hugepage_aligned_slack_ ABSL_GUARDED_BY(pageheap_lock);
+
+  // Bytes obtained from the system backed by 1 GiB pages, and the number of
+  // allocations above gigantic_page_threshold() that fell back to regular
+  // memory, e.g. because the hugetlbfs pool ran dry.
+  size_t gigantic_bytes_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  size_t gigantic_fallbacks_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+
+  // Hugepages waiting to be faulted in by PopulatePendingHugepages().  Each
+  // entry remembers release_generation_ when it was queued: a release since
+  // then may have returned the hugepage to the OS, so it is dropped rather
+  // than faulted back in.
+  struct PendingPopulate {
+    HugeRange r;
+    uint64_t release_generation;
+  };
+  static constexpr size_t kMaxPendingPopulate = 64;
+  PendingPopulate pending_populate_[kMaxPendingPopulate] ABSL_GUARDED_BY(
+      pageheap_lock);
+  size_t num_pending_populate_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  // Incremented by unback_ and unback_without_lock_ before every release.
+  uint64_t release_generation_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  HugeLength populated_huge_pages_ ABSL_GUARDED_BY(pageheap_lock);
+  HugeLength populate_dropped_huge_pages_ ABSL_GUARDED_BY(pageheap_lock);
+
+  // At most kCoverageSamples hugepages of each component are checked by
+  // VerifyHugepageCoverage(), evenly strided over the component.
+  static constexpr size_t kCoverageSamples = 64;
+  static constexpr const char*
+      kCoverageComponentNames[kNumCoverageComponents] = {"filler", "region",
+                                                         "cache"};
+  // Calls func(CoverageComponent, HugePage) for each hugepage intended to be
+  // intact: the filler's that were never subreleased, and the backed ones of
+  // the regions and the cache.
+  template <typename F>
+  void ForEachIntactHugePage(const F& func)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+  HugepageCoverage coverage_[kNumCoverageComponents] ABSL_GUARDED_BY(
+      pageheap_lock);
+  size_t coverage_checks_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+
+  // Whether cache_ may release hugepages lazily with MADV_FREE.  Cleared while
+  // releasing memory on request or to stay below a memory limit, where the
+  // memory should stop counting towards RSS right away.
+  bool lazy_release_allowed_ ABSL_GUARDED_BY(pageheap_lock) = true;
+  // The most recent ranges released with MADV_FREE, overwritten round-robin.
+  // When one is reused, the pages the kernel kept resident are counted as
+  // reused, the others as reclaimed.
+  static constexpr size_t kMaxLazilyFreed = 64;
+  Range lazily_freed_[kMaxLazilyFreed] ABSL_GUARDED_BY(pageheap_lock);
+  size_t next_lazily_freed_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  Length lazily_freed_pages_ ABSL_GUARDED_BY(pageheap_lock);
+  Length lazily_freed_reused_pages_ ABSL_GUARDED_BY(pageheap_lock);
+  Length lazily_freed_reclaimed_pages_ ABSL_GUARDED_BY(pageheap_lock);
+
+  // The reason for the ReleaseAtLeastNPages() call in progress, if any.
+  std::optional<PageReleaseReason> release_reason_
+      ABSL_GUARDED_BY(pageheap_lock);
+  // The most recent ranges released for a reason, overwritten round-robin.
+  // Pages allocated again from the filler or cache_ within kRefaultInterval
+  // of their release are counted as refaulted, by the reason they were
+  // released for.
+  struct SampledRelease {
+    Range r;
+    PageReleaseReason reason;
+    int64_t time;
+  };
+  static constexpr size_t kMaxSampledReleases = 64;
+  SampledRelease sampled_releases_[kMaxSampledReleases] ABSL_GUARDED_BY(
+      pageheap_lock);
+  size_t next_sampled_release_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  PageReleaseStats sampled_released_pages_ ABSL_GUARDED_BY(pageheap_lock);
+  PageReleaseStats refaulted_pages_ ABSL_GUARDED_BY(pageheap_lock);
+
+  // Filler hugepages currently on the far memory tier, and the moves between
+  // the tiers so far.
+  HugeLength far_tier_huge_pages_ ABSL_GUARDED_BY(pageheap_lock);
+  HugePageTieringStats tiering_stats_ ABSL_GUARDED_BY(pageheap_lock);
+  // The stale filler hugepages of MemoryTag::kCold handed to the kernel to
+  // reclaim so far.
+  HugePagePageOutStats page_out_stats_ ABSL_GUARDED_BY(pageheap_lock);
+
+  HugeLength NearTierHugePages() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    // Hugepages freed while being moved leave the filler before they are
+    // taken off the far tier.
+    const HugeLength total = filler_.size();
+    return total > far_tier_huge_pages_ ? total - far_tier_huge_pages_
+                                        : NHugePages(0);
+  }
+
   void GetSpanStats(SmallSpanStats* small, LargeSpanStats* large)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
   PageId RefillFiller(Length n, SpanAllocInfo span_alloc_info,
-                      bool* from_released)
+                      bool* from_released, bool* known_zero)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
   // Allocate the first <n> from p, and contribute the rest to the filler.  If
   // "donated" is true, the contribution will be marked as coming from the
-  // tail of a multi-hugepage alloc.  Returns the allocated section.
+  // tail of a multi-hugepage alloc.  If "known_zero" is true, p is fresh from
+  // the kernel.  Returns the allocated section.
   PageId AllocAndContribute(HugePage p, Length n, SpanAllocInfo span_alloc_info,
-                            bool donated)
+                            bool donated, bool known_zero = false)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
   // Helpers for New().
 
@@ -451,6 +831,12 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
 
   FinalizeType LockAndAlloc(Length n, SpanAllocInfo span_alloc_info,
                             bool* from_released);
+  FinalizeType Alloc(Length n, SpanAllocInfo span_alloc_info,
+                     bool* from_released)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+  // Backs and traces the allocation f of LockAndAlloc() or Alloc().
+  Span* absl_nullable FinishNew(FinalizeType f, bool from_released, Length n,
+                                SpanAllocInfo span_alloc_info);
 
   FinalizeType AllocSmall(Length n, SpanAllocInfo span_alloc_info,
                           bool* from_released)
@@ -462,8 +848,14 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
                              bool* from_released)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
-  FinalizeType AllocRawHugepages(Length n, SpanAllocInfo span_alloc_info,
-                                 bool* from_released)
+  FinalizeType AllocRawHugepages(
+      Length n, SpanAllocInfo span_alloc_info, bool* from_released,
+      DonationDecision decision = DonationDecision::kDonate)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Returns what to do with the slack on the last hugepage of an allocation
+  // of n pages straight from the HugeCache.
+  DonationDecision DecideDonation(Length n)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
   bool AddRegion() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
@@ -476,13 +868,34 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
   // Finish an allocation request - give it a span and mark it in the pagemap.
-  FinalizeType Finalize(Range r);
+  // known_zero is true if all of r is known to be zero.
+  FinalizeType Finalize(Range r, bool known_zero = false);
 
   Span* Spanify(FinalizeType f);
   Range Unspanify(FinalizeType f);
 
   bool ShouldBack(const Range& r) const;
 
+  // Queues the hugepages in r to be faulted in on the background thread if
+  // they came from released memory for an allocation of at least
+  // eager_populate_threshold() bytes.  The queue is bounded; hugepages that do
+  // not fit are left to be faulted in on first touch.
+  void MaybeQueuePopulate(HugeRange r, Length n, bool from_released)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  void RecordLazilyFreed(Range r) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+  // Accounts for the lazily freed memory in r, if it came from released
+  // memory.
+  void MaybeRecordLazyReuse(HugeRange r, bool from_released)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Samples r if it is being released by ReleaseAtLeastNPages().
+  void MaybeSampleRelease(Range r) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+  // Accounts for the sampled releases that r, newly allocated, overlaps if it
+  // came from released memory.
+  void MaybeRecordRefault(Range r, bool from_released)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   // Whether this HPAA should use subrelease. This delegates to the appropriate
   // parameter depending whether this is for the cold heap or another heap.
   bool hpaa_subrelease() const;
@@ -492,20 +905,30 @@ template <class Forwarder>
 inline HugePageAwareAllocator<Forwarder>::HugePageAwareAllocator(
     const HugePageAwareAllocatorOptions& options)
     : PageAllocatorInterface("HugePageAware", options.tag),
+      clock_(options.clock),
       unback_(*this),
       unback_without_lock_(*this),
+      unback_cached_without_lock_(*this, ReleaseHint::kReusedSoon),
       collapse_(*this),
+      set_memory_tier_(*this),
+      page_out_(*this),
       set_anon_vma_name_(*this),
-      filler_(tag_, unback_, unback_without_lock_, collapse_,
+      filler_(clock_, tag_, unback_, unback_without_lock_, collapse_,
               set_anon_vma_name_, forwarder_.subrelease_unbacked_hugepages()),
-      regions_(options.use_huge_region_more_often),
-      tracker_allocator_(forwarder_.arena()),
-      region_allocator_(forwarder_.arena()),
+      regions_(options.use_huge_region_more_often, clock_),
+      tracker_allocator_(forwarder_.arena(options.tag)),
+      region_allocator_(forwarder_.arena(options.tag)),
       vm_allocator_(*this),
       metadata_allocator_(*this),
       alloc_(vm_allocator_, metadata_allocator_),
-      cache_(HugeCache{alloc_, metadata_allocator_, unback_without_lock_,
-                       absl::Seconds(1)}) {}
+      cache_(HugeCache{alloc_, metadata_allocator_,
+                       unback_cached_without_lock_, absl::Seconds(1),
+                       clock_, options.huge_cache_demand_forecast,
+                       options.huge_cache_deferred_release}),
+      size_class_region_(options.size_class_region),
+      adaptive_donation_(options.adaptive_hugepage_donation) {
+  TC_ASSERT(tag_ == MemoryTag::kSizeClassed || size_class_region_ == 0);
+}
 
 template <class Forwarder>
 inline HugePageAwareAllocator<Forwarder>::FillerType::Tracker*
@@ -516,6 +939,31 @@ HugePageAwareAllocator<Forwarder>::GetTracker(HugePage p) {
   return pt;
 }
 
+template <class Forwarder>
+inline void HugePageAwareAllocator<Forwarder>::TraceSpan(
+    SpanTraceEvent::Op op, Range r, SpanAllocInfo span_alloc_info, Length pages,
+    Length align, PageId moved_to) {
+  const SpanTraceHook hook =
+      span_trace_internal::hook.load(std::memory_order_relaxed);
+  if (ABSL_PREDICT_TRUE(hook == nullptr)) return;
+  hook(SpanTraceEvent{
+      .time = clock_.now(),
+      .first_page = r.p.index(),
+      .moved_to = moved_to.index(),
+      .pages = (op == SpanTraceEvent::kExtend || op == SpanTraceEvent::kMove ||
+                        op == SpanTraceEvent::kShrink
+                    ? pages
+                    : r.n)
+                   .raw_num(),
+      .align = align.raw_num(),
+      .objects_per_span = static_cast<uint32_t>(span_alloc_info.objects_per_span),
+      .op = op,
+      .tag = tag_,
+      .density = static_cast<uint8_t>(span_alloc_info.density),
+      .lifetime = static_cast<uint8_t>(span_alloc_info.lifetime),
+  });
+}
+
 template <class Forwarder>
 inline void HugePageAwareAllocator<Forwarder>::SetTracker(
     HugePage p, HugePageAwareAllocator<Forwarder>::FillerType::Tracker* pt) {
@@ -524,10 +972,20 @@ inline void HugePageAwareAllocator<Forwarder>::SetTracker(
 
 template <class Forwarder>
 inline PageId HugePageAwareAllocator<Forwarder>::AllocAndContribute(
-    HugePage p, Length n, SpanAllocInfo span_alloc_info, bool donated) {
+    HugePage p, Length n, SpanAllocInfo span_alloc_info, bool donated,
+    bool known_zero) {
   TC_CHECK_NE(p.start_addr(), nullptr);
   FillerType::Tracker* pt = tracker_allocator_.New(
-      p, donated, absl::base_internal::CycleClock::Now());
+      p, donated, clock_.now());
+  if (known_zero) {
+    pt->SetKnownZero();
+  }
+  // The hugepage is about to be touched from this cpu, which is where the
+  // kernel places it within the nodes the tag is bound to.
+  const int numa_node = forwarder_.CurrentNumaNode();
+  if (numa_node != FillerType::kAnyNumaNode) {
+    pt->set_numa_node(numa_node);
+  }
   TC_ASSERT_GE(pt->longest_free_range(), n);
   TC_ASSERT_EQ(pt->was_donated(), donated);
   // if the page was donated, we track its size so that we can potentially
@@ -545,9 +1003,15 @@ inline PageId HugePageAwareAllocator<Forwarder>::AllocAndContribute(
 
 template <class Forwarder>
 inline PageId HugePageAwareAllocator<Forwarder>::RefillFiller(
-    Length n, SpanAllocInfo span_alloc_info, bool* from_released) {
-  HugeRange r = cache_.Get(NHugePages(1), from_released);
+    Length n, SpanAllocInfo span_alloc_info, bool* from_released,
+    bool* known_zero) {
+  HugeRange r = cache_.Get(NHugePages(1), from_released, known_zero,
+                           forwarder_.CurrentNumaNode());
   if (!r.valid()) return PageId{0};
+  MaybeRecordLazyReuse(r, *from_released);
+  MaybeRecordRefault(Range(r.start().first_page(), r.len().in_pages()),
+                     *from_released);
+  MaybeQueuePopulate(r, n, *from_released);
   // This is duplicate to Finalize, but if we need to break up
   // hugepages to get to our usage limit it would be very bad to break
   // up what's left of r after we allocate from there--while r is
@@ -557,24 +1021,29 @@ inline PageId HugePageAwareAllocator<Forwarder>::RefillFiller(
   // isn't very large), and the next allocation will just repeat this
   // process.
   forwarder_.ShrinkToUsageLimit(n);
-  return AllocAndContribute(r.start(), n, span_alloc_info, /*donated=*/false);
+  return AllocAndContribute(r.start(), n, span_alloc_info, /*donated=*/false,
+                            *known_zero);
 }
 
 template <class Forwarder>
 inline typename HugePageAwareAllocator<Forwarder>::FinalizeType
-HugePageAwareAllocator<Forwarder>::Finalize(Range r)
+HugePageAwareAllocator<Forwarder>::Finalize(Range r, bool known_zero)
     ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
   TC_ASSERT_NE(r.p, PageId{0});
   info_.RecordAlloc(r);
   forwarder_.ShrinkToUsageLimit(r.n);
+  // Our bookkeeping assumes that unbacked memory reads as zero, which the
+  // kernel stops guaranteeing once memory is released lazily.
+  known_zero = known_zero && forwarder_.unbacked_memory_is_zero();
 #ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
   // TODO(b/175334169): Lift Span creation out of LockAndAlloc.
   Span* ret = forwarder_.NewSpan(r);
   forwarder_.SetSpan(r.p, ret);
   TC_ASSERT(!ret->sampled());
+  ret->set_known_zero(known_zero);
   return ret;
 #else
-  return {r, false};
+  return {r, false, known_zero};
 #endif
 }
 
@@ -585,17 +1054,19 @@ inline typename HugePageAwareAllocator<Forwarder>::FinalizeType
 HugePageAwareAllocator<Forwarder>::AllocSmall(Length n,
                                               SpanAllocInfo span_alloc_info,
                                               bool* from_released) {
-  auto [pt, page, released] = filler_.TryGet(n, span_alloc_info);
+  auto [pt, page, released, known_zero] =
+      filler_.TryGet(n, span_alloc_info, forwarder_.CurrentNumaNode());
   *from_released = released;
   if (ABSL_PREDICT_TRUE(pt != nullptr)) {
-    return Finalize(Range(page, n));
+    MaybeRecordRefault(Range(page, n), released);
+    return Finalize(Range(page, n), known_zero);
   }
 
-  page = RefillFiller(n, span_alloc_info, from_released);
+  page = RefillFiller(n, span_alloc_info, from_released, &known_zero);
   if (ABSL_PREDICT_FALSE(page == PageId{0})) {
     return {};
   }
-  return Finalize(Range(page, n));
+  return Finalize(Range(page, n), known_zero);
 }
 
 template <class Forwarder>
@@ -609,20 +1080,49 @@ HugePageAwareAllocator<Forwarder>::AllocLarge(Length n,
     return AllocRawHugepages(n, span_alloc_info, from_released);
   }
 
+  // Allocations of a hugepage or more may be asked to start on a hugepage
+  // boundary and cover whole hugepages, which neither the filler nor a region
+  // guarantees.
+  if (n >= kPagesPerHugePage &&
+      forwarder_.hugepage_aligned_large_allocations()) {
+    DonationDecision decision = DecideDonation(n);
+    if (decision == DonationDecision::kRegion) {
+      decision = DonationDecision::kLeaveEmpty;
+    }
+    ++hugepage_aligned_allocs_;
+    hugepage_aligned_slack_ += hl.in_pages() - n;
+    return AllocRawHugepages(n, span_alloc_info, from_released, decision);
+  }
+
   PageId page;
   // If we fit in a single hugepage, try the Filler.p.
   if (n < kPagesPerHugePage) {
-    auto [pt, page, released] = filler_.TryGet(n, span_alloc_info);
+    auto [pt, page, released, known_zero] =
+        filler_.TryGet(n, span_alloc_info, forwarder_.CurrentNumaNode());
     *from_released = released;
     if (ABSL_PREDICT_TRUE(pt != nullptr)) {
-      return Finalize(Range(page, n));
+      MaybeRecordRefault(Range(page, n), released);
+      return Finalize(Range(page, n), known_zero);
     }
   }
 
   // If we're using regions in this binary (see below comment), is
   // there currently available space there?
-  if (regions_.MaybeGet(n, &page, from_released)) {
-    return Finalize(Range(page, n));
+  bool known_zero;
+  if (regions_.MaybeGet(n, &page, from_released, &known_zero)) {
+    return Finalize(Range(page, n), known_zero);
+  }
+
+  // Allocations whose slack we learned not to donate may go to a region
+  // regardless of the heuristics below.
+  DonationDecision decision = DecideDonation(n);
+  if (decision == DonationDecision::kRegion) {
+    if (AddRegion()) {
+      TC_CHECK(regions_.MaybeGet(n, &page, from_released, &known_zero));
+      donation_policy_.RecordAllocation(n, DonationDecision::kRegion);
+      return Finalize(Range(page, n), known_zero);
+    }
+    decision = DonationDecision::kLeaveEmpty;
   }
 
   // We have two choices here: allocate a new region or go to
@@ -640,7 +1140,7 @@ HugePageAwareAllocator<Forwarder>::AllocLarge(Length n,
       regions_.UseHugeRegionMoreOften() ? abandoned_pages_ + slack : slack;
   // Don't bother at all until the binary is reasonably sized.
   if (donated < HLFromBytes(64 * 1024 * 1024).in_pages()) {
-    return AllocRawHugepages(n, span_alloc_info, from_released);
+    return AllocRawHugepages(n, span_alloc_info, from_released, decision);
   }
 
   // In the vast majority of binaries, we have many small allocations which
@@ -651,17 +1151,17 @@ HugePageAwareAllocator<Forwarder>::AllocLarge(Length n,
   // we skip the check.
   const Length small = info_.small();
   if (slack < small && !regions_.UseHugeRegionMoreOften()) {
-    return AllocRawHugepages(n, span_alloc_info, from_released);
+    return AllocRawHugepages(n, span_alloc_info, from_released, decision);
   }
 
   // We couldn't allocate a new region. They're oversized, so maybe we'd get
   // lucky with a smaller request?
   if (!AddRegion()) {
-    return AllocRawHugepages(n, span_alloc_info, from_released);
+    return AllocRawHugepages(n, span_alloc_info, from_released, decision);
   }
 
-  TC_CHECK(regions_.MaybeGet(n, &page, from_released));
-  return Finalize(Range(page, n));
+  TC_CHECK(regions_.MaybeGet(n, &page, from_released, &known_zero));
+  return Finalize(Range(page, n), known_zero);
 }
 
 template <class Forwarder>
@@ -669,17 +1169,39 @@ inline typename HugePageAwareAllocator<Forwarder>::FinalizeType
 HugePageAwareAllocator<Forwarder>::AllocEnormous(Length n,
                                                  SpanAllocInfo span_alloc_info,
                                                  bool* from_released) {
-  return AllocRawHugepages(n, span_alloc_info, from_released);
+  DonationDecision decision = DecideDonation(n);
+  // Enormous allocations do not fit in a region.
+  if (decision == DonationDecision::kRegion) {
+    decision = DonationDecision::kLeaveEmpty;
+  }
+  return AllocRawHugepages(n, span_alloc_info, from_released, decision);
+}
+
+template <class Forwarder>
+inline DonationDecision HugePageAwareAllocator<Forwarder>::DecideDonation(
+    Length n) {
+  if (!adaptive_donation_ || n <= kPagesPerHugePage ||
+      HLFromPages(n).in_pages() == n) {
+    return DonationDecision::kDonate;
+  }
+  return donation_policy_.Decide(n);
 }
 
 template <class Forwarder>
 inline typename HugePageAwareAllocator<Forwarder>::FinalizeType
 HugePageAwareAllocator<Forwarder>::AllocRawHugepages(
-    Length n, SpanAllocInfo span_alloc_info, bool* from_released) {
+    Length n, SpanAllocInfo span_alloc_info, bool* from_released,
+    DonationDecision decision) {
   HugeLength hl = HLFromPages(n);
 
-  HugeRange r = cache_.Get(hl, from_released);
+  bool known_zero;
+  HugeRange r =
+      cache_.Get(hl, from_released, &known_zero, forwarder_.CurrentNumaNode());
   if (!r.valid()) return {};
+  MaybeRecordLazyReuse(r, *from_released);
+  MaybeRecordRefault(Range(r.start().first_page(), r.len().in_pages()),
+                     *from_released);
+  MaybeQueuePopulate(r, n, *from_released);
 
   // We now have a huge page range that covers our request.  There
   // might be some slack in it if n isn't a multiple of
@@ -692,15 +1214,26 @@ HugePageAwareAllocator<Forwarder>::AllocRawHugepages(
   HugePage last = first + r.len() - NHugePages(1);
   if (slack == Length(0)) {
     SetTracker(last, nullptr);
-    return Finalize(Range(r.start().first_page(), total));
+    return Finalize(Range(r.start().first_page(), total), known_zero);
+  }
+  if (adaptive_donation_ && n > kPagesPerHugePage) {
+    donation_policy_.RecordAllocation(n, decision);
+  }
+  if (decision != DonationDecision::kDonate) {
+    // The slack stays empty, to go back to the HugeCache along with the
+    // allocation.
+    TC_ASSERT(decision == DonationDecision::kLeaveEmpty);
+    SetTracker(last, nullptr);
+    return Finalize(Range(r.start().first_page(), n), known_zero);
   }
 
   ++donated_huge_pages_;
 
   Length here = kPagesPerHugePage - slack;
   TC_ASSERT_GT(here, Length(0));
-  AllocAndContribute(last, here, span_alloc_info, /*donated=*/true);
-  auto span = Finalize(Range(r.start().first_page(), n));
+  AllocAndContribute(last, here, span_alloc_info, /*donated=*/true,
+                     known_zero);
+  auto span = Finalize(Range(r.start().first_page(), n), known_zero);
 #ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
   span->set_donated(/*value=*/true);
   return span;
@@ -717,6 +1250,37 @@ inline Span* HugePageAwareAllocator<Forwarder>::New(
   TC_CHECK_GT(n, Length(0));
   bool from_released;
   FinalizeType f = LockAndAlloc(n, span_alloc_info, &from_released);
+  return FinishNew(f, from_released, n, span_alloc_info);
+}
+
+// public
+template <class Forwarder>
+inline size_t HugePageAwareAllocator<Forwarder>::NewBatch(
+    Length n, SpanAllocInfo span_alloc_info, absl::Span<Span*> spans) {
+  TC_CHECK_GT(n, Length(0));
+  TC_ASSERT_LE(spans.size(), kMaxNewBatch);
+  const size_t count = std::min(spans.size(), kMaxNewBatch);
+  FinalizeType f[kMaxNewBatch];
+  bool from_released[kMaxNewBatch];
+  size_t allocated = 0;
+  {
+    PageHeapSpinLockHolder l;
+    for (; allocated < count; ++allocated) {
+      f[allocated] = Alloc(n, span_alloc_info, &from_released[allocated]);
+      if (!f[allocated]) break;
+    }
+  }
+  // Backing and tracing may be slow, so happen after the lock is dropped.
+  for (size_t i = 0; i < allocated; ++i) {
+    spans[i] = FinishNew(f[i], from_released[i], n, span_alloc_info);
+  }
+  return allocated;
+}
+
+template <class Forwarder>
+inline Span* HugePageAwareAllocator<Forwarder>::FinishNew(
+    FinalizeType f, bool from_released, Length n,
+    SpanAllocInfo span_alloc_info) {
   if (f) {
     Range r = Unspanify(f);
     // Prefetch for writing, as we anticipate using the memory soon.
@@ -727,6 +1291,9 @@ inline Span* HugePageAwareAllocator<Forwarder>::New(
   }
   Span* s = Spanify(f);
   TC_ASSERT(!s || GetMemoryTag(s->start_address()) == tag_);
+  if (s != nullptr) {
+    TraceSpan(SpanTraceEvent::kNew, Range(s->first_page(), n), span_alloc_info);
+  }
   return s;
 }
 
@@ -736,6 +1303,14 @@ HugePageAwareAllocator<Forwarder>::LockAndAlloc(Length n,
                                                 SpanAllocInfo span_alloc_info,
                                                 bool* from_released) {
   PageHeapSpinLockHolder l;
+  return Alloc(n, span_alloc_info, from_released);
+}
+
+template <class Forwarder>
+inline typename HugePageAwareAllocator<Forwarder>::FinalizeType
+HugePageAwareAllocator<Forwarder>::Alloc(Length n,
+                                         SpanAllocInfo span_alloc_info,
+                                         bool* from_released) {
   // Our policy depends on size.  For small things, we will pack them
   // into single hugepages.
   if (n <= kSmallAllocPages) {
@@ -780,6 +1355,10 @@ inline Span* HugePageAwareAllocator<Forwarder>::NewAligned(
 
   Span* s = Spanify(f);
   TC_ASSERT(!s || GetMemoryTag(s->start_address()) == tag_);
+  if (s != nullptr) {
+    TraceSpan(SpanTraceEvent::kNew, Range(s->first_page(), n), span_alloc_info,
+              Length(0), align);
+  }
   return s;
 }
 
@@ -796,6 +1375,7 @@ inline Span* HugePageAwareAllocator<Forwarder>::Spanify(FinalizeType f) {
   forwarder_.SetSpan(f.r.p, s);
   TC_ASSERT(!s->sampled());
   s->set_donated(f.donated);
+  s->set_known_zero(f.known_zero);
   return s;
 #endif
 }
@@ -815,10 +1395,194 @@ inline bool HugePageAwareAllocator<Forwarder>::ShouldBack(
     const Range& r) const {
   // TODO(b/134694141): Experiment with the size threshold used for deciding
   // whether to back or not.
+  // Under mlockall(), released memory was unlocked, and is locked again before
+  // reuse so that the application does not fault on it.
+  if (forwarder_.mlockall_mode()) return true;
   return forwarder_.BackAllocations() &&
          r.in_bytes() <= forwarder_.BackSizeThresholdBytes();
 }
 
+template <class Forwarder>
+inline void HugePageAwareAllocator<Forwarder>::MaybeQueuePopulate(
+    HugeRange r, Length n, bool from_released) {
+  const int64_t threshold = forwarder_.eager_populate_threshold();
+  if (!from_released || threshold <= 0 ||
+      n.in_bytes() < static_cast<size_t>(threshold)) {
+    return;
+  }
+
+  // Hugepages handed out back to back are usually contiguous; extend the last
+  // entry so that they are populated in a single call.
+  if (num_pending_populate_ > 0) {
+    PendingPopulate& last = pending_populate_[num_pending_populate_ - 1];
+    if (last.release_generation == release_generation_ &&
+        last.r.start() + last.r.len() == r.start()) {
+      last.r = HugeRange(last.r.start(), last.r.len() + r.len());
+      return;
+    }
+  }
+  if (num_pending_populate_ == kMaxPendingPopulate) {
+    populate_dropped_huge_pages_ += r.len();
+    return;
+  }
+  pending_populate_[num_pending_populate_++] = {r, release_generation_};
+}
+
+template <class Forwarder>
+inline void HugePageAwareAllocator<Forwarder>::RecordLazilyFreed(Range r) {
+  lazily_freed_[next_lazily_freed_] = r;
+  next_lazily_freed_ = (next_lazily_freed_ + 1) % kMaxLazilyFreed;
+  lazily_freed_pages_ += r.n;
+}
+
+template <class Forwarder>
+inline void HugePageAwareAllocator<Forwarder>::MaybeRecordLazyReuse(
+    HugeRange r, bool from_released) {
+  if (!from_released || lazily_freed_pages_ == Length(0)) return;
+
+  const PageId start = r.start().first_page();
+  const PageId end = start + r.len().in_pages();
+  for (Range& freed : lazily_freed_) {
+    if (freed.n == Length(0)) continue;
+    const PageId overlap_start = std::max(freed.p, start);
+    const PageId overlap_end = std::min(freed.p + freed.n, end);
+    if (overlap_start >= overlap_end) continue;
+
+    // The rest of the range is forgotten: it may be merged with other
+    // released memory, so it can no longer be told apart when it is reused.
+    const Range overlap(overlap_start, overlap_end - overlap_start);
+    const Length resident =
+        BytesToLengthFloor(forwarder_.ResidentBytes(overlap));
+    lazily_freed_reused_pages_ += resident;
+    lazily_freed_reclaimed_pages_ += overlap.n - resident;
+    freed = Range();
+  }
+}
+
+template <class Forwarder>
+inline void HugePageAwareAllocator<Forwarder>::MaybeSampleRelease(Range r) {
+  if (!release_reason_.has_value()) return;
+  sampled_releases_[next_sampled_release_] = {r, *release_reason_,
+                                              clock_.now()};
+  next_sampled_release_ = (next_sampled_release_ + 1) % kMaxSampledReleases;
+  sampled_released_pages_.Add(*release_reason_, r.n);
+}
+
+template <class Forwarder>
+inline void HugePageAwareAllocator<Forwarder>::MaybeRecordRefault(
+    Range r, bool from_released) {
+  if (!from_released || sampled_released_pages_.total == Length(0)) return;
+
+  const int64_t now = clock_.now();
+  const double window = absl::ToDoubleSeconds(kRefaultInterval) * clock_.freq();
+  for (SampledRelease& sample : sampled_releases_) {
+    if (sample.r.n == Length(0)) continue;
+    if (now - sample.time > window) {
+      sample.r = Range();
+      continue;
+    }
+    const PageId overlap_start = std::max(sample.r.p, r.p);
+    const PageId overlap_end = std::min(sample.r.p + sample.r.n, r.p + r.n);
+    if (overlap_start >= overlap_end) continue;
+
+    // As with lazily freed ranges, the rest of the sample is forgotten.
+    refaulted_pages_.Add(sample.reason, overlap_end - overlap_start);
+    sample.r = Range();
+  }
+}
+
+template <class Forwarder>
+inline void HugePageAwareAllocator<Forwarder>::ReleaseDeferred() {
+  const bool mlocked = forwarder_.mlockall_mode();
+  PageHeapSpinLockHolder l;
+  cache_.set_keep_backed(mlocked);
+  cache_.ReleaseDeferred();
+}
+
+template <class Forwarder>
+template <typename F>
+inline void HugePageAwareAllocator<Forwarder>::ForEachIntactHugePage(
+    const F& func) {
+  filler_.ForEachHugePage([&](const FillerType::Tracker& pt) {
+    if (!pt.released()) func(kCoverageFiller, pt.location());
+  });
+  regions_.ForEachBackedHugePage(
+      [&](HugePage p) { func(kCoverageRegion, p); });
+  cache_.ForEachHugePage([&](HugePage p) { func(kCoverageCache, p); });
+}
+
+template <class Forwarder>
+inline void HugePageAwareAllocator<Forwarder>::VerifyHugepageCoverage(
+    PageFlagsBase& pageflags) {
+  HugePage samples[kNumCoverageComponents][kCoverageSamples];
+  HugepageCoverage coverage[kNumCoverageComponents];
+  {
+    PageHeapSpinLockHolder l;
+    ForEachIntactHugePage(
+        [&](CoverageComponent c, HugePage) { ++coverage[c].intended; });
+    size_t seen[kNumCoverageComponents] = {};
+    ForEachIntactHugePage([&](CoverageComponent c, HugePage p) {
+      const size_t stride =
+          (coverage[c].intended + kCoverageSamples - 1) / kCoverageSamples;
+      if (seen[c]++ % stride == 0 && coverage[c].sampled < kCoverageSamples) {
+        samples[c][coverage[c].sampled++] = p;
+      }
+    });
+  }
+
+  // Reading pageflags takes system calls, so it is done without the lock.  A
+  // hugepage released meanwhile is reported as split.
+  for (int c = 0; c < kNumCoverageComponents; ++c) {
+    for (size_t i = 0; i < coverage[c].sampled; ++i) {
+      const std::optional<bool> backed =
+          pageflags.IsHugepageBacked(samples[c][i].start_addr());
+      if (!backed.has_value()) {
+        ++coverage[c].unknown;
+      } else if (*backed) {
+        ++coverage[c].backed;
+      }
+    }
+  }
+
+  PageHeapSpinLockHolder l;
+  std::copy(coverage, coverage + kNumCoverageComponents, coverage_);
+  ++coverage_checks_;
+}
+
+template <class Forwarder>
+inline void HugePageAwareAllocator<Forwarder>::PopulatePendingHugepages() {
+  PendingPopulate pending[kMaxPendingPopulate];
+  size_t num_pending;
+  {
+    PageHeapSpinLockHolder l;
+    num_pending = num_pending_populate_;
+    std::copy(pending_populate_, pending_populate_ + num_pending, pending);
+    num_pending_populate_ = 0;
+  }
+
+  HugeLength populated, dropped;
+  for (size_t i = 0; i < num_pending; ++i) {
+    const HugeRange r = pending[i].r;
+    {
+      PageHeapSpinLockHolder l;
+      if (pending[i].release_generation != release_generation_) {
+        dropped += r.len();
+        continue;
+      }
+    }
+    // A release racing with this call may unback the hugepage first, in which
+    // case it stays backed until it is reused or released again.
+    forwarder_.Populate(Range(r.start().first_page(), r.len().in_pages()));
+    populated += r.len();
+  }
+
+  if (num_pending > 0) {
+    PageHeapSpinLockHolder l;
+    populated_huge_pages_ += populated;
+    populate_dropped_huge_pages_ += dropped;
+  }
+}
+
 template <class Forwarder>
 inline void HugePageAwareAllocator<Forwarder>::DeleteFromHugepage(
     FillerType::Tracker* pt, Range r, bool might_abandon,
@@ -836,15 +1600,176 @@ inline void HugePageAwareAllocator<Forwarder>::DeleteFromHugepage(
   ReleaseHugepage(pt);
 }
 
+template <class Forwarder>
+inline bool HugePageAwareAllocator<Forwarder>::TryExtend(AllocationState s,
+                                                         Length n) {
+  TC_ASSERT_GT(n, s.r.n);
+  // Donated allocations share their last hugepage with the slack given to the
+  // filler, which tracks them on its own.
+  if (s.donated) return false;
+
+  const Range extension(s.r.p + s.r.n, n - s.r.n);
+  bool from_released = false;
+  {
+    PageHeapSpinLockHolder l;
+    FillerType::Tracker* pt = GetTracker(HugePageContaining(s.r.p));
+    const bool extended =
+        pt != nullptr
+            ? filler_.TryExtend(pt, s.r, extension.n, &from_released)
+            : regions_.MaybeExtend(s.r, extension.n, &from_released);
+    // Allocations straight from the HugeCache are not extended: their slack,
+    // if any, belongs to the filler.
+    if (!extended) return false;
+
+    info_.RecordFree(s.r);
+    info_.RecordAlloc(Range(s.r.p, n));
+    forwarder_.ShrinkToUsageLimit(extension.n);
+    TraceSpan(SpanTraceEvent::kExtend, s.r,
+              {.objects_per_span = 1,
+               .density = AccessDensityPrediction::kSparse},
+              n);
+  }
+
+  // Prefetch for writing, as we anticipate using the memory soon.
+  PrefetchW(extension.p.start_addr());
+  if (from_released && ShouldBack(extension)) {
+    forwarder_.Back(extension);
+  }
+  return true;
+}
+
+template <class Forwarder>
+inline bool HugePageAwareAllocator<Forwarder>::TryMove(Span* span, Length n) {
+  const Range old(span->first_page(), span->num_pages());
+  TC_ASSERT_GT(n, old.n);
+  TC_ASSERT(!span->sampled());
+  // Only whole hugepages straight from the HugeCache can be remapped without
+  // disturbing other allocations.
+  const HugeLength old_hl = HLFromPages(old.n);
+  if (span->donated() || old_hl.in_pages() != old.n) return false;
+
+  const HugeLength hl = HLFromPages(n);
+  HugeRange r;
+  bool known_zero;
+  {
+    PageHeapSpinLockHolder l;
+    if (GetTracker(HugePageContaining(old.p)) != nullptr ||
+        regions_.contains(old.p)) {
+      return false;
+    }
+    r = cache_.GetUnbacked(hl, &known_zero);
+    if (!r.valid()) return false;
+  }
+
+  const PageId p = r.start().first_page();
+  if (!forwarder_.MovePages(old, p).success) {
+    PageHeapSpinLockHolder l;
+    cache_.ReleaseUnbacked(r, known_zero);
+    return false;
+  }
+
+  const Range extension(p + old.n, n - old.n);
+  {
+    PageHeapSpinLockHolder l;
+    // As in AllocRawHugepages, any slack past n on the last hugepage is
+    // donated to the filler.
+    const Length slack = hl.in_pages() - n;
+    HugePage last = r.start() + r.len() - NHugePages(1);
+    SetTracker(r.start(), nullptr);
+    bool donated = false;
+    if (slack == Length(0)) {
+      SetTracker(last, nullptr);
+    } else {
+      ++donated_huge_pages_;
+      AllocAndContribute(
+          last, kPagesPerHugePage - slack,
+          {.objects_per_span = 1, .density = AccessDensityPrediction::kSparse},
+          /*donated=*/true, known_zero);
+      donated = true;
+    }
+
+    info_.RecordFree(old);
+    info_.RecordAlloc(Range(p, n));
+    forwarder_.ShrinkToUsageLimit(extension.n);
+
+    span->set_first_page(p);
+    span->set_num_pages(n);
+    span->set_donated(donated);
+    forwarder_.SetSpan(p, span);
+    forwarder_.ClearSpan(old.p);
+
+    // The old pages were left unbacked, and empty, by the move.
+    cache_.ReleaseUnbacked(HugeRange(HugePageContaining(old.p), old_hl),
+                           /*known_zero=*/true);
+    TraceSpan(SpanTraceEvent::kMove, old,
+              {.objects_per_span = 1,
+               .density = AccessDensityPrediction::kSparse},
+              n, Length(1), p);
+  }
+
+  if (ShouldBack(extension)) {
+    forwarder_.Back(extension);
+  }
+  return true;
+}
+
 template <class Forwarder>
 inline bool HugePageAwareAllocator<Forwarder>::AddRegion() {
-  HugeRange r = alloc_.Get(HugeRegion::size());
+  bool known_zero;
+  HugeRange r = alloc_.Get(HugeRegion::size(), &known_zero);
   if (!r.valid()) return false;
-  HugeRegion* region = region_allocator_.New(r, unback_, set_anon_vma_name_);
+  HugeRegion* region =
+      region_allocator_.New(r, unback_, set_anon_vma_name_, known_zero);
   regions_.Contribute(region);
   return true;
 }
 
+template <class Forwarder>
+inline bool HugePageAwareAllocator<Forwarder>::TryShrink(Span* span, Length n) {
+  const Range old(span->first_page(), span->num_pages());
+  TC_ASSERT_GT(n, Length(0));
+  TC_ASSERT_LT(n, old.n);
+  TC_ASSERT(!span->sampled());
+  // As in TryExtend, the last hugepage of a donated allocation is shared with
+  // the filler.
+  if (span->donated()) return false;
+
+  const HugePage hp = HugePageContaining(old.p);
+  PageHeapSpinLockHolder l;
+  FillerType::Tracker* pt = GetTracker(hp);
+  if (pt != nullptr) {
+    filler_.Shrink(pt, old, n);
+  } else if (!regions_.MaybeShrink(old, n)) {
+    // Straight from the HugeCache: the hugepages n no longer needs go back to
+    // it, and as in AllocRawHugepages, any slack past n on the last one kept
+    // is donated to the filler.
+    const HugeLength hl = HLFromPages(old.n);
+    const HugeLength kept = HLFromPages(n);
+    TC_ASSERT_EQ(GetTracker(hp + hl - NHugePages(1)), nullptr);
+    if (kept < hl) {
+      cache_.Release({hp + kept, hl - kept}, forwarder_.CurrentNumaNode());
+    }
+    const Length slack = kept.in_pages() - n;
+    if (slack > Length(0)) {
+      ++donated_huge_pages_;
+      AllocAndContribute(
+          hp + kept - NHugePages(1), kPagesPerHugePage - slack,
+          {.objects_per_span = 1, .density = AccessDensityPrediction::kSparse},
+          /*donated=*/true, /*known_zero=*/false);
+      span->set_donated(true);
+    }
+  }
+
+  info_.RecordFree(old);
+  info_.RecordAlloc(Range(old.p, n));
+  span->set_num_pages(n);
+  TraceSpan(SpanTraceEvent::kShrink, old,
+            {.objects_per_span = 1,
+             .density = AccessDensityPrediction::kSparse},
+            n);
+  return true;
+}
+
 #ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
 template <class Forwarder>
 inline void HugePageAwareAllocator<Forwarder>::Delete(
@@ -867,6 +1792,7 @@ inline void HugePageAwareAllocator<Forwarder>::Delete(
   const HugePage hp = HugePageContaining(p);
   const Length n = s.r.n;
   info_.RecordFree(Range(p, n));
+  TraceSpan(SpanTraceEvent::kDelete, s.r, span_alloc_info);
 
   // Clear the descriptor of the page so a second pass through the same page
   // could trigger the check in InvokeHooksAndFreePages.
@@ -896,7 +1822,8 @@ inline void HugePageAwareAllocator<Forwarder>::Delete(
   HugeLength hl = HLFromPages(n);
   HugePage last = hp + hl - NHugePages(1);
   Length slack = hl.in_pages() - n;
-  if (slack == Length(0)) {
+  // Slack left empty (see DonationPolicy) has no tracker either.
+  if (slack == Length(0) || !s.donated) {
     TC_ASSERT_EQ(GetTracker(last), nullptr);
   } else {
     pt = GetTracker(last);
@@ -909,9 +1836,18 @@ inline void HugePageAwareAllocator<Forwarder>::Delete(
     // onto the last hugepage.
     PageId virt = last.first_page();
     Length virt_len = kPagesPerHugePage - slack;
+    const double donated_at = pt->alloctime();
     // We may have used the slack, which would prevent us from returning
     // the entire range now.  If filler returned a Tracker, we are fully empty.
-    if (filler_.Put(pt, Range(virt, virt_len), span_alloc_info) == nullptr) {
+    const bool abandoned =
+        filler_.Put(pt, Range(virt, virt_len), span_alloc_info) == nullptr;
+    if (adaptive_donation_ && n > kPagesPerHugePage) {
+      donation_policy_.RecordFree(
+          n, abandoned,
+          absl::Seconds(std::max<double>(clock_.now() - donated_at, 0) /
+                        clock_.freq()));
+    }
+    if (abandoned) {
       // Last page isn't empty -- pretend the range was shorter.
       --hl;
 
@@ -938,7 +1874,9 @@ inline void HugePageAwareAllocator<Forwarder>::Delete(
       }
     }
   }
-  cache_.Release({hp, hl});
+  // We do not track where large allocations were faulted in, so the node of
+  // the freeing cpu stands in for it.
+  cache_.Release({hp, hl}, forwarder_.CurrentNumaNode());
 }
 
 template <class Forwarder>
@@ -961,10 +1899,32 @@ inline void HugePageAwareAllocator<Forwarder>::ReleaseHugepage(
   HugeRange r = {pt->location(), NHugePages(1)};
   SetTracker(pt->location(), nullptr);
 
+  if (pt->GetTierState().far) {
+    // Return free far memory to the OS and restore the placement policy of
+    // the tag, so that the hugepage is faulted back in on the near tier when
+    // it is reused.
+    --far_tier_huge_pages_;
+    const bool unbacked = unback_(r).success;
+    if (!set_memory_tier_(r, /*far=*/false).success) {
+      ++tiering_stats_.failed;
+    }
+    if (unbacked) {
+      cache_.ReleaseUnbacked(r, /*known_zero=*/true);
+      tracker_allocator_.Delete(pt);
+      return;
+    }
+  }
+
   if (pt->released()) {
-    cache_.ReleaseUnbacked(r);
+    // The hugepage may only be partially released, with the rest of it still
+    // holding data.
+    cache_.ReleaseUnbacked(r, pt->known_zero_pages() == kPagesPerHugePage);
   } else {
-    cache_.Release(r);
+    const int numa_node =
+        forwarder_.CurrentNumaNode() == FillerType::kAnyNumaNode
+            ? FillerType::kAnyNumaNode
+            : static_cast<int>(pt->numa_node());
+    cache_.Release(r, numa_node);
   }
 
   tracker_allocator_.Delete(pt);
@@ -1019,25 +1979,47 @@ inline void HugePageAwareAllocator<Forwarder>::GetSpanStats(
 template <class Forwarder>
 inline Length HugePageAwareAllocator<Forwarder>::ReleaseAtLeastNPages(
     Length num_pages, PageReleaseReason reason) {
+  // Under mlockall(), the memory we keep stays locked, and releasing it takes
+  // an munlock() on top of the madvise().  We then keep it all in the cache,
+  // subrelease nothing, and release only when asked to or to meet a limit.
+  const bool mlocked = forwarder_.mlockall_mode();
+  cache_.set_keep_backed(mlocked);
+  if (mlocked && reason == PageReleaseReason::kProcessBackgroundActions) {
+    info_.RecordRelease(num_pages, Length(0), reason);
+    return Length(0);
+  }
+
+  // Only periodic releases are made in anticipation of the cache not being
+  // needed; explicit and limit-driven ones expect RSS to go down.
+  lazy_release_allowed_ =
+      reason == PageReleaseReason::kProcessBackgroundActions;
+  release_reason_ = reason;
   Length released =
       cache_.ReleaseCachedPages(HLFromPages(num_pages)).in_pages();
+  lazy_release_allowed_ = true;
 
-  // Release all backed-but-free hugepages from HugeRegion.
-  // TODO(b/199203282): We release all the free hugepages from HugeRegions when
-  // the experiment is enabled. We can also explore releasing only a desired
-  // number of pages.
+  // Release backed-but-free hugepages from HugeRegion.  With demand-based
+  // release, we keep as many backed as the recent demand requires, using the
+  // same skip-subrelease intervals as the filler.
   if (regions_.UseHugeRegionMoreOften()) {
     Length from_huge_region =
         num_pages > released ? num_pages - released : Length(0);
+    SkipSubreleaseIntervals intervals;
+    if (forwarder_.huge_region_demand_based_release()) {
+      intervals.short_interval =
+          forwarder_.filler_skip_subrelease_short_interval();
+      intervals.long_interval =
+          forwarder_.filler_skip_subrelease_long_interval();
+    }
     released += regions_.ReleasePages(from_huge_region,
                                       forwarder_.huge_region_adaptive_release(),
-                                      /*hit_limit=*/false);
+                                      /*hit_limit=*/false, intervals);
   }
 
   // This is our long term plan but in current state will lead to insufficient
   // THP coverage. It is however very useful to have the ability to turn this on
   // for testing.
-  if (hpaa_subrelease()) {
+  if (hpaa_subrelease() && !mlocked) {
     const bool release_max_cold =
         tag_ == MemoryTag::kCold && forwarder_.release_max_cold_pages();
     if (released < num_pages || release_max_cold) {
@@ -1054,6 +2036,7 @@ inline Length HugePageAwareAllocator<Forwarder>::ReleaseAtLeastNPages(
     }
   }
 
+  release_reason_.reset();
   info_.RecordRelease(num_pages, released, reason);
   return released;
 }
@@ -1063,8 +2046,34 @@ inline void HugePageAwareAllocator<Forwarder>::TreatHugepageTrackers(
     EnableCollapse enable_collapse) {
   const EnableUnfilteredCollapse enable_unfiltered_collapse =
       forwarder_.enable_unfiltered_collapse();
+  const absl::Duration collapse_budget = forwarder_.hugepage_collapse_budget();
+  const int32_t far_node = forwarder_.far_memory_numa_node();
+  const absl::Duration page_out_idle_time =
+      forwarder_.cold_page_out_idle_time();
+  const bool high_memory_pressure = forwarder_.high_memory_pressure();
   PageHeapSpinLockHolder l;
-  filler_.TreatHugepageTrackers(enable_collapse, enable_unfiltered_collapse);
+  filler_.TreatHugepageTrackers(enable_collapse, enable_unfiltered_collapse,
+                                /*pageflags=*/nullptr, /*residency=*/nullptr,
+                                collapse_budget);
+  if (far_node >= 0 || far_tier_huge_pages_ > NHugePages(0)) {
+    TieringMode mode = TieringMode::kDemoteStale;
+    if (far_node < 0) {
+      mode = TieringMode::kPromoteAll;
+    } else if (tag_ == MemoryTag::kCold) {
+      mode = TieringMode::kDemoteAll;
+    }
+    const HugePageTieringStats stats =
+        filler_.TierHugepageTrackers(set_memory_tier_, mode);
+    far_tier_huge_pages_ += NHugePages(stats.demoted);
+    far_tier_huge_pages_ -= NHugePages(stats.promoted);
+    tiering_stats_ += stats;
+  }
+  // Locked pages cannot be paged out.
+  if (tag_ == MemoryTag::kCold && page_out_idle_time > absl::ZeroDuration() &&
+      !forwarder_.mlockall_mode()) {
+    page_out_stats_ += filler_.PageOutHugepageTrackers(
+        page_out_, page_out_idle_time, high_memory_pressure);
+  }
   FillerType::Tracker* pt;
   while ((pt = filler_.FetchFullyFreedTracker()) != nullptr) {
     ReleaseHugepage(pt);
@@ -1138,6 +2147,79 @@ inline void HugePageAwareAllocator<Forwarder>::Print(Printer& out,
       "HugePageAware: filler donations %zu (%zu pages from abandoned "
       "donations)\n",
       donated_huge_pages_.raw_num(), abandoned_pages_.raw_num());
+  if (adaptive_donation_) {
+    donation_policy_.Print(out);
+  }
+  out.printf(
+      "HugePageAware: %zu hugepage aligned large allocations (%zu slack "
+      "pages)\n",
+      hugepage_aligned_allocs_, hugepage_aligned_slack_.raw_num());
+  if (gigantic_bytes_ > 0 || gigantic_fallbacks_ > 0) {
+    out.printf(
+        "HugePageAware: %.1f MiB in 1 GiB pages, %zu fallbacks to 2 MiB "
+        "pages\n",
+        BytesToMiB(gigantic_bytes_), gigantic_fallbacks_);
+  }
+  if (forwarder_.eager_populate_threshold() > 0 ||
+      populated_huge_pages_.raw_num() > 0) {
+    out.printf(
+        "HugePageAware: %zu hugepages eagerly populated, %zu dropped, %zu "
+        "pending\n",
+        populated_huge_pages_.raw_num(),
+        populate_dropped_huge_pages_.raw_num(), num_pending_populate_);
+  }
+  if (forwarder_.adaptive_madvise() || lazily_freed_pages_ > Length(0)) {
+    out.printf(
+        "HugePageAware: %zu pages released with MADV_FREE, %zu reused before "
+        "the kernel reclaimed them, %zu reclaimed\n",
+        lazily_freed_pages_.raw_num(), lazily_freed_reused_pages_.raw_num(),
+        lazily_freed_reclaimed_pages_.raw_num());
+  }
+  if (sampled_released_pages_.total > Length(0)) {
+    out.printf(
+        "HugePageAware: sampled released pages allocated again within %llds: "
+        "%zu of %zu released to system, %zu of %zu in background, %zu of %zu "
+        "over soft limit, %zu of %zu over hard limit\n",
+        absl::ToInt64Seconds(kRefaultInterval),
+        refaulted_pages_.release_memory_to_system.raw_num(),
+        sampled_released_pages_.release_memory_to_system.raw_num(),
+        refaulted_pages_.process_background_actions.raw_num(),
+        sampled_released_pages_.process_background_actions.raw_num(),
+        refaulted_pages_.soft_limit_exceeded.raw_num(),
+        sampled_released_pages_.soft_limit_exceeded.raw_num(),
+        refaulted_pages_.hard_limit_exceeded.raw_num(),
+        sampled_released_pages_.hard_limit_exceeded.raw_num());
+  }
+  const int32_t far_node = forwarder_.far_memory_numa_node();
+  if (far_node >= 0 || far_tier_huge_pages_ > NHugePages(0)) {
+    out.printf(
+        "HugePageAware: filler hugepages on the near tier %zu, on the far tier "
+        "(node %d) %zu; %zu demoted, %zu promoted, %zu failed moves\n",
+        NearTierHugePages().raw_num(), far_node,
+        far_tier_huge_pages_.raw_num(), tiering_stats_.demoted,
+        tiering_stats_.promoted, tiering_stats_.failed);
+  }
+  if (forwarder_.cold_page_out_idle_time() > absl::ZeroDuration() ||
+      page_out_stats_.advised_cold + page_out_stats_.paged_out > 0) {
+    out.printf(
+        "HugePageAware: stale hugepages advised with MADV_COLD %zu, with "
+        "MADV_PAGEOUT %zu (%.1f MiB paged out); %.1f MiB refaulted, %zu "
+        "failed\n",
+        page_out_stats_.advised_cold, page_out_stats_.paged_out,
+        BytesToMiB(page_out_stats_.paged_out_bytes),
+        BytesToMiB(page_out_stats_.refaulted_bytes), page_out_stats_.failed);
+  }
+  if (coverage_checks_ > 0) {
+    for (int c = 0; c < kNumCoverageComponents; ++c) {
+      const HugepageCoverage& cov = coverage_[c];
+      out.printf(
+          "HugePageAware: %-6s hugepage coverage: %zu intended intact, "
+          "%zu of %zu sampled backed by hugepages (%.1f%%), %zu unknown\n",
+          kCoverageComponentNames[c], cov.intended, cov.backed, cov.sampled,
+          safe_div(100.0 * cov.backed, cov.sampled - cov.unknown),
+          cov.unknown);
+    }
+  }
 
   // Component debug output
   // Filler is by far the most important; print (some) of it
@@ -1205,13 +2287,103 @@ inline void HugePageAwareAllocator<Forwarder>::PrintInPbtxt(
 
     hpaa.PrintI64("filler_donated_huge_pages", donated_huge_pages_.raw_num());
     hpaa.PrintI64("filler_abandoned_pages", abandoned_pages_.raw_num());
+    hpaa.PrintI64("hugepage_aligned_large_allocs", hugepage_aligned_allocs_);
+    hpaa.PrintI64("hugepage_aligned_slack_pages",
+                  hugepage_aligned_slack_.raw_num());
+    if (adaptive_donation_) {
+      donation_policy_.PrintInPbtxt(hpaa);
+    }
+    hpaa.PrintI64("gigantic_page_bytes", gigantic_bytes_);
+    hpaa.PrintI64("gigantic_page_fallbacks", gigantic_fallbacks_);
+    hpaa.PrintI64("eager_populated_huge_pages",
+                  populated_huge_pages_.raw_num());
+    hpaa.PrintI64("eager_populate_dropped_huge_pages",
+                  populate_dropped_huge_pages_.raw_num());
+    hpaa.PrintI64("lazily_freed_pages", lazily_freed_pages_.raw_num());
+    hpaa.PrintI64("lazily_freed_reused_pages",
+                  lazily_freed_reused_pages_.raw_num());
+    hpaa.PrintI64("lazily_freed_reclaimed_pages",
+                  lazily_freed_reclaimed_pages_.raw_num());
+    {
+      auto refaults = hpaa.CreateSubRegion("release_refaults");
+      refaults.PrintI64("interval_seconds",
+                        absl::ToInt64Seconds(kRefaultInterval));
+      refaults.PrintI64(
+          "sampled_release_memory_to_system",
+          sampled_released_pages_.release_memory_to_system.raw_num());
+      refaults.PrintI64("refaulted_release_memory_to_system",
+                        refaulted_pages_.release_memory_to_system.raw_num());
+      refaults.PrintI64(
+          "sampled_process_background_actions",
+          sampled_released_pages_.process_background_actions.raw_num());
+      refaults.PrintI64("refaulted_process_background_actions",
+                        refaulted_pages_.process_background_actions.raw_num());
+      refaults.PrintI64("sampled_soft_limit_exceeded",
+                        sampled_released_pages_.soft_limit_exceeded.raw_num());
+      refaults.PrintI64("refaulted_soft_limit_exceeded",
+                        refaulted_pages_.soft_limit_exceeded.raw_num());
+      refaults.PrintI64("sampled_hard_limit_exceeded",
+                        sampled_released_pages_.hard_limit_exceeded.raw_num());
+      refaults.PrintI64("refaulted_hard_limit_exceeded",
+                        refaulted_pages_.hard_limit_exceeded.raw_num());
+    }
+    {
+      auto tiers = hpaa.CreateSubRegion("memory_tiers");
+      tiers.PrintI64("far_numa_node", forwarder_.far_memory_numa_node());
+      tiers.PrintI64("near_tier_huge_pages", NearTierHugePages().raw_num());
+      tiers.PrintI64("far_tier_huge_pages", far_tier_huge_pages_.raw_num());
+      tiers.PrintI64("demoted_huge_pages", tiering_stats_.demoted);
+      tiers.PrintI64("promoted_huge_pages", tiering_stats_.promoted);
+      tiers.PrintI64("failed_tier_moves", tiering_stats_.failed);
+    }
+    {
+      auto page_out = hpaa.CreateSubRegion("page_out");
+      page_out.PrintI64(
+          "idle_time_ns",
+          absl::ToInt64Nanoseconds(forwarder_.cold_page_out_idle_time()));
+      page_out.PrintI64("advised_cold_huge_pages",
+                        page_out_stats_.advised_cold);
+      page_out.PrintI64("paged_out_huge_pages", page_out_stats_.paged_out);
+      page_out.PrintI64("paged_out_bytes", page_out_stats_.paged_out_bytes);
+      page_out.PrintI64("refaulted_bytes", page_out_stats_.refaulted_bytes);
+      page_out.PrintI64("failed", page_out_stats_.failed);
+    }
+    {
+      auto coverage = hpaa.CreateSubRegion("hugepage_coverage");
+      coverage.PrintI64("checks", coverage_checks_);
+      for (int c = 0; c < kNumCoverageComponents; ++c) {
+        auto component = coverage.CreateSubRegion("component");
+        component.PrintRaw("name", kCoverageComponentNames[c]);
+        component.PrintI64("intended_huge_pages", coverage_[c].intended);
+        component.PrintI64("sampled_huge_pages", coverage_[c].sampled);
+        component.PrintI64("backed_huge_pages", coverage_[c].backed);
+        component.PrintI64("unknown_huge_pages", coverage_[c].unknown);
+      }
+    }
   }
 }
 
 template <class Forwarder>
 inline AddressRange HugePageAwareAllocator<Forwarder>::AllocAndReport(
     size_t bytes, size_t align) {
-  auto ret = forwarder_.AllocatePages(bytes, align, tag_);
+  AddressRange ret = {nullptr, 0};
+  // Only normal memory is worth gigantic pages: sampled and cold memory favor
+  // fine-grained access telemetry.
+  const int64_t gigantic_threshold = forwarder_.gigantic_page_threshold();
+  if (gigantic_threshold > 0 &&
+      bytes >= static_cast<size_t>(gigantic_threshold) &&
+      align <= kGiganticPageSize &&
+      tag_ != MemoryTag::kSizeClassed && IsNormalPartitionTag(tag_)) {
+    ret = forwarder_.AllocateGiganticPages(bytes, tag_);
+    if (ret.ptr != nullptr) {
+      gigantic_bytes_ += ret.bytes;
+    } else {
+      ++gigantic_fallbacks_;
+    }
+  }
+  if (ret.ptr == nullptr) {
+    ret = forwarder_.AllocatePages(bytes, align, tag_, size_class_region_);
+  }
   if (ret.ptr == nullptr) return ret;
   TC_ASSERT_EQ(GetMemoryTag(ret.ptr), tag_);
   const PageId page = PageIdContaining(ret.ptr);
@@ -1231,7 +2403,10 @@ HugePageAwareAllocator<Forwarder>::ReleaseAtLeastNPagesBreakingHugepages(
 
   Length released;
 
+  release_reason_ = reason;
+  lazy_release_allowed_ = false;
   released += cache_.ReleaseCachedPages(HLFromPages(n)).in_pages();
+  lazy_release_allowed_ = true;
 
   // We try to release as many free hugepages from HugeRegion as possible.
   Length from_huge_region = n > released ? n - released : Length(0);
@@ -1240,6 +2415,7 @@ HugePageAwareAllocator<Forwarder>::ReleaseAtLeastNPagesBreakingHugepages(
                                     /*hit_limit=*/true);
 
   if (released >= n) {
+    release_reason_.reset();
     info_.RecordRelease(n, released, reason);
     return released;
   }
@@ -1248,6 +2424,7 @@ HugePageAwareAllocator<Forwarder>::ReleaseAtLeastNPagesBreakingHugepages(
                                    /*release_partial_alloc_pages=*/false,
                                    /*hit_limit=*/true);
 
+  release_reason_.reset();
   info_.RecordRelease(n, released, reason);
   return released;
 }
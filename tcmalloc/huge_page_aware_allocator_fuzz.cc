@@ -31,6 +31,7 @@
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_join.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/huge_page_aware_allocator.h"
 #include "tcmalloc/huge_page_filler.h"
@@ -93,6 +94,12 @@ class FakeStaticForwarderWithUnback : public FakeStaticForwarder {
     return FakeStaticForwarder::ReleasePages(r);
   }
 
+  size_t ReleasePagesBatch(absl::Span<const Range> ranges) {
+    size_t n = 0;
+    while (n < ranges.size() && ReleasePages(ranges[n]).success) ++n;
+    return n;
+  }
+
   void Back(Range r) {
     ASSERT_TRUE(BackAllocations());
     TC_CHECK_LE(r.in_bytes(), BackSizeThresholdBytes());
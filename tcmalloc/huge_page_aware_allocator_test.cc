@@ -32,6 +32,7 @@
 #include <string>
 #include <thread>  // NOLINT(build/c++11)
 #include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -46,12 +47,14 @@
 #include "absl/random/bit_gen_ref.h"
 #include "absl/random/distributions.h"
 #include "absl/random/random.h"
+#include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/barrier.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/huge_pages.h"
 #include "tcmalloc/huge_region.h"
@@ -105,6 +108,12 @@ class HugePageAwareAllocatorTest
       return ret;
     }
 
+    [[nodiscard]] size_t ReleasePagesBatch(absl::Span<const Range> ranges) {
+      size_t n = 0;
+      while (n < ranges.size() && ReleasePages(ranges[n]).success) ++n;
+      return n;
+    }
+
     void Back(Range r) {
       ASSERT_TRUE(BackAllocations());
       TC_CHECK_LE(r.in_bytes(), BackSizeThresholdBytes());
@@ -845,6 +854,381 @@ TEST_P(HugePageAwareAllocatorTest, DonatedHugePages) {
   EXPECT_THAT(PrintInPbtxt(), HasSubstr("filler_abandoned_pages: 0"));
 }
 
+TEST_P(HugePageAwareAllocatorTest, HugepageAlignedLargeAllocations) {
+  static constexpr Length kSlack = Length(3);
+  static constexpr Length kLargeSize = 2 * kPagesPerHugePage - kSlack;
+  const SpanAllocInfo kSpanInfo = {1, AccessDensityPrediction::kSparse};
+  allocator_->forwarder().set_hugepage_aligned_large_allocations(true);
+
+  std::vector<Span*> spans;
+  for (int i = 0; i < 3; ++i) {
+    Span* s = New(kLargeSize, kSpanInfo);
+    EXPECT_EQ(HugePageContaining(s->first_page()).start_addr(),
+              s->start_address());
+    spans.push_back(s);
+  }
+  // Smaller allocations are left to the filler.
+  Span* small = New(kPagesPerHugePage - Length(1), kSpanInfo);
+
+  EXPECT_THAT(Print(),
+              HasSubstr(absl::StrCat("3 hugepage aligned large allocations (",
+                                     (3 * kSlack).raw_num(), " slack pages)")));
+  EXPECT_THAT(PrintInPbtxt(), HasSubstr("hugepage_aligned_large_allocs: 3"));
+  EXPECT_THAT(PrintInPbtxt(),
+              HasSubstr(absl::StrCat("hugepage_aligned_slack_pages: ",
+                                     (3 * kSlack).raw_num())));
+
+  Delete(small, kSpanInfo.objects_per_span);
+  for (Span* s : spans) {
+    Delete(s, kSpanInfo.objects_per_span);
+  }
+  allocator_->forwarder().set_hugepage_aligned_large_allocations(false);
+}
+
+TEST_P(HugePageAwareAllocatorTest, TryMove) {
+  static constexpr Length kSize = 2 * kPagesPerHugePage;
+  const SpanAllocInfo kSpanInfo = {1, AccessDensityPrediction::kSparse};
+
+  // Only allocations straight from the HugeCache are moved.
+  Span* small = New(Length(1), kSpanInfo);
+  EXPECT_FALSE(allocator_->TryMove(small, Length(2)));
+
+  Span* large = New(kSize, kSpanInfo);
+  const PageId p = large->first_page();
+  allocator_->forwarder().set_move_succeeds(false);
+  EXPECT_FALSE(allocator_->TryMove(large, 2 * kSize));
+  EXPECT_EQ(large->first_page(), p);
+  EXPECT_EQ(large->num_pages(), kSize);
+  EXPECT_EQ(allocator_->forwarder().moved_bytes(), 0);
+  CheckStats();
+
+  // Leave slack on the last hugepage, which is donated to the filler.
+  allocator_->forwarder().set_move_succeeds(true);
+  const Length n = 2 * kSize - Length(1);
+  ASSERT_TRUE(allocator_->TryMove(large, n));
+  allocator_->forwarder().RecordDeallocation(
+      reinterpret_cast<uintptr_t>(p.start_addr()));
+  allocator_->forwarder().RecordAllocation(
+      reinterpret_cast<uintptr_t>(large->start_address()));
+  total_ += n - kSize;
+  EXPECT_NE(large->first_page(), p);
+  EXPECT_EQ(large->num_pages(), n);
+  EXPECT_TRUE(large->donated());
+  EXPECT_EQ(allocator_->forwarder().moved_bytes(), kSize.in_bytes());
+  CheckStats();
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(allocator_->DonatedHugePages(), NHugePages(1));
+    EXPECT_EQ(allocator_->info().slack(), Length(1));
+  }
+
+  // Its last hugepage is now shared with the filler.
+  EXPECT_FALSE(allocator_->TryMove(large, 2 * n));
+
+  Delete(large, kSpanInfo.objects_per_span);
+  Delete(small, kSpanInfo.objects_per_span);
+}
+
+TEST_P(HugePageAwareAllocatorTest, TryShrink) {
+  const SpanAllocInfo kSpanInfo = {1, AccessDensityPrediction::kSparse};
+
+  // A span packed onto a hugepage by the filler gives its tail back to it.
+  Span* small = New(Length(4), kSpanInfo);
+  ASSERT_TRUE(allocator_->TryShrink(small, Length(1)));
+  total_ -= Length(3);
+  EXPECT_EQ(small->num_pages(), Length(1));
+  CheckStats();
+
+  // A span of whole hugepages keeps the ones it still needs, and donates the
+  // slack on the last of them to the filler if it came from the HugeCache.
+  Span* large = New(3 * kPagesPerHugePage, kSpanInfo);
+  const PageId p = large->first_page();
+  const Length n = kPagesPerHugePage + Length(1);
+  ASSERT_TRUE(allocator_->TryShrink(large, n));
+  total_ -= 3 * kPagesPerHugePage - n;
+  EXPECT_EQ(large->first_page(), p);
+  EXPECT_EQ(large->num_pages(), n);
+  CheckStats();
+
+  // Once donated, its last hugepage is shared with the filler.
+  const bool donated = large->donated();
+  EXPECT_EQ(allocator_->TryShrink(large, Length(1)), !donated);
+  if (!donated) total_ -= n - Length(1);
+  CheckStats();
+
+  Delete(large, kSpanInfo.objects_per_span);
+  Delete(small, kSpanInfo.objects_per_span);
+}
+
+TEST_P(HugePageAwareAllocatorTest, NewBatch) {
+  const SpanAllocInfo kSpanInfo = {1, AccessDensityPrediction::kSparse};
+  constexpr size_t kSpans = 4;
+  Span* spans[kSpans];
+  ASSERT_EQ(allocator_->NewBatch(Length(2), kSpanInfo, absl::MakeSpan(spans)),
+            kSpans);
+  for (Span* span : spans) {
+    allocator_->forwarder().RecordAllocation(
+        reinterpret_cast<uintptr_t>(span->start_address()));
+    absl::base_internal::SpinLockHolder h(lock_);
+    EXPECT_EQ(span->num_pages(), Length(2));
+    TC_CHECK(ids_.insert({span, next_id_++}).second);
+    total_ += Length(2);
+  }
+  CheckStats();
+
+  // The filler packs the spans onto one hugepage.
+  for (Span* span : spans) {
+    EXPECT_EQ(HugePageContaining(span->start_address()),
+              HugePageContaining(spans[0]->start_address()));
+  }
+
+  for (Span* span : spans) {
+    Delete(span, kSpanInfo.objects_per_span);
+  }
+}
+
+TEST_P(HugePageAwareAllocatorTest, KnownZero) {
+  static constexpr Length kSize = 2 * kPagesPerHugePage;
+  const SpanAllocInfo kSpanInfo = {1, AccessDensityPrediction::kSparse};
+
+  // Hugepages that have never been backed are known to be zero.
+  Span* large = New(kSize, kSpanInfo);
+  EXPECT_TRUE(large->known_zero());
+  Delete(large, kSpanInfo.objects_per_span);
+
+  // So are hugepages that have been returned to the system since.
+  ReleasePages(Length(std::numeric_limits<size_t>::max()),
+               /*reason=*/PageReleaseReason::kReleaseMemoryToSystem);
+  large = New(kSize, kSpanInfo);
+  EXPECT_TRUE(large->known_zero());
+  Delete(large, kSpanInfo.objects_per_span);
+
+  // Unless the system allocator can no longer vouch for released memory.
+  ReleasePages(Length(std::numeric_limits<size_t>::max()),
+               /*reason=*/PageReleaseReason::kReleaseMemoryToSystem);
+  allocator_->forwarder().set_unbacked_memory_is_zero(false);
+  large = New(kSize, kSpanInfo);
+  EXPECT_FALSE(large->known_zero());
+  Delete(large, kSpanInfo.objects_per_span);
+  allocator_->forwarder().set_unbacked_memory_is_zero(true);
+}
+
+TEST_P(HugePageAwareAllocatorTest, MlockallMode) {
+  static constexpr Length kSize = 2 * kPagesPerHugePage;
+  const SpanAllocInfo kSpanInfo = {1, AccessDensityPrediction::kSparse};
+  allocator_->forwarder().set_mlockall_mode(true);
+
+  // Freed hugepages stay in the cache, and periodic releases leave them be.
+  Span* large = New(kSize, kSpanInfo);
+  Delete(large, kSpanInfo.objects_per_span);
+  EXPECT_EQ(ReleasePages(kSize, PageReleaseReason::kProcessBackgroundActions),
+            Length(0));
+
+  // Meeting a limit still releases them.
+  EXPECT_GE(ReleasePages(kSize, PageReleaseReason::kSoftLimitExceeded), kSize);
+  allocator_->forwarder().set_mlockall_mode(false);
+}
+
+TEST_P(HugePageAwareAllocatorTest, GiganticPages) {
+  static constexpr Length kGiganticSize = BytesToLengthFloor(kGiganticPageSize);
+  const SpanAllocInfo kSpanInfo = {1, AccessDensityPrediction::kSparse};
+  allocator_->forwarder().set_gigantic_page_threshold(kGiganticPageSize);
+  allocator_->forwarder().set_gigantic_pages_available(1);
+
+  // Smaller allocations never use gigantic pages.
+  Span* small = New(kPagesPerHugePage, kSpanInfo);
+  EXPECT_THAT(PrintInPbtxt(), HasSubstr("gigantic_page_bytes: 0"));
+
+  Span* first = New(kGiganticSize, kSpanInfo);
+  EXPECT_THAT(Print(), HasSubstr("1024.0 MiB in 1 GiB pages"));
+  EXPECT_THAT(PrintInPbtxt(),
+              HasSubstr(absl::StrCat("gigantic_page_bytes: ",
+                                     kGiganticPageSize)));
+  EXPECT_THAT(PrintInPbtxt(), HasSubstr("gigantic_page_fallbacks: 0"));
+
+  // Once the pool is exhausted, we fall back to regular hugepages.
+  Span* second = New(kGiganticSize, kSpanInfo);
+  EXPECT_THAT(PrintInPbtxt(),
+              HasSubstr(absl::StrCat("gigantic_page_bytes: ",
+                                     kGiganticPageSize)));
+  EXPECT_THAT(PrintInPbtxt(),
+              testing::Not(HasSubstr("gigantic_page_fallbacks: 0")));
+
+  Delete(second, kSpanInfo.objects_per_span);
+  Delete(first, kSpanInfo.objects_per_span);
+  Delete(small, kSpanInfo.objects_per_span);
+}
+
+TEST_P(HugePageAwareAllocatorTest, EagerPopulate) {
+  static constexpr Length kLargeSize = 2 * kPagesPerHugePage;
+  const SpanAllocInfo kSpanInfo = {1, AccessDensityPrediction::kSparse};
+  auto& forwarder = allocator_->forwarder();
+  forwarder.set_eager_populate_threshold(kHugePageSize);
+
+  // Allocations below the threshold leave their hugepages to be faulted in on
+  // first touch.
+  Span* small = New(Length(1), kSpanInfo);
+  Span* large = New(kLargeSize, kSpanInfo);
+  EXPECT_EQ(forwarder.populated_bytes(), 0);
+  allocator_->PopulatePendingHugepages();
+  EXPECT_EQ(forwarder.populated_bytes(), kLargeSize.in_bytes());
+  EXPECT_THAT(PrintInPbtxt(), HasSubstr("eager_populated_huge_pages: 2"));
+
+  allocator_->PopulatePendingHugepages();
+  EXPECT_EQ(forwarder.populated_bytes(), kLargeSize.in_bytes());
+
+  // Hugepages queued before a release are dropped, as they may have been
+  // returned to the OS in the meantime.
+  Span* large2 = New(kLargeSize, kSpanInfo);
+  Delete(large, kSpanInfo.objects_per_span);
+  EXPECT_GT(ReleasePages(kLargeSize,
+                         /*reason=*/PageReleaseReason::kReleaseMemoryToSystem),
+            Length(0));
+  allocator_->PopulatePendingHugepages();
+  EXPECT_EQ(forwarder.populated_bytes(), kLargeSize.in_bytes());
+  EXPECT_THAT(PrintInPbtxt(),
+              HasSubstr("eager_populate_dropped_huge_pages: 2"));
+  EXPECT_THAT(Print(), HasSubstr("2 hugepages eagerly populated, 2 dropped"));
+
+  Delete(large2, kSpanInfo.objects_per_span);
+  Delete(small, kSpanInfo.objects_per_span);
+}
+
+TEST_P(HugePageAwareAllocatorTest, VerifyHugepageCoverage) {
+  // Reports every hugepage as backed by a hugepage, except the split ones.
+  class FakePageFlags : public PageFlagsBase {
+   public:
+    std::optional<PageStats> Get(const void* addr, size_t size) override {
+      return PageStats{};
+    }
+    PageFlagsBitmaps GetSinglePageBitmaps(const void* addr) override {
+      PageFlagsBitmaps ret;
+      ret.status = absl::StatusCode::kUnimplemented;
+      return ret;
+    }
+    std::optional<bool> IsHugepageBacked(const void* addr) override {
+      return std::find(split.begin(), split.end(), addr) == split.end();
+    }
+
+    std::vector<const void*> split;
+  };
+  using Allocator = std::remove_reference_t<decltype(*allocator_)>;
+  const SpanAllocInfo kSpanInfo = {1, AccessDensityPrediction::kSparse};
+
+  Span* small = New(Length(1), kSpanInfo);
+  FakePageFlags pageflags;
+  pageflags.split.push_back(
+      HugePageContaining(small->first_page()).start_addr());
+  allocator_->VerifyHugepageCoverage(pageflags);
+
+  Allocator::HugepageCoverage filler;
+  Allocator::HugepageCoverage cache;
+  {
+    PageHeapSpinLockHolder l;
+    filler = allocator_->hugepage_coverage(Allocator::kCoverageFiller);
+    cache = allocator_->hugepage_coverage(Allocator::kCoverageCache);
+  }
+  EXPECT_EQ(filler.intended, 1);
+  EXPECT_EQ(filler.sampled, 1);
+  EXPECT_EQ(filler.backed, 0);
+  EXPECT_EQ(filler.unknown, 0);
+  EXPECT_EQ(cache.sampled, std::min<size_t>(cache.intended, 64));
+  EXPECT_EQ(cache.backed, cache.sampled);
+  EXPECT_THAT(Print(), HasSubstr("filler hugepage coverage: 1 intended intact, "
+                                 "0 of 1 sampled backed"));
+  EXPECT_THAT(PrintInPbtxt(), HasSubstr("intended_huge_pages: 1"));
+
+  Delete(small, kSpanInfo.objects_per_span);
+}
+
+TEST_P(HugePageAwareAllocatorTest, AdaptiveMadvise) {
+  static constexpr Length kLargeSize = 2 * kPagesPerHugePage;
+  const SpanAllocInfo kSpanInfo = {1, AccessDensityPrediction::kSparse};
+  auto& forwarder = allocator_->forwarder();
+  forwarder.set_adaptive_madvise(true);
+
+  // Keep the released hugepages apart from the rest of the free memory, so
+  // that the next allocation reuses them.
+  Span* before = New(kLargeSize, kSpanInfo);
+  Span* middle = New(kLargeSize, kSpanInfo);
+  Span* after = New(kLargeSize, kSpanInfo);
+  Delete(middle, kSpanInfo.objects_per_span);
+
+  // Periodic releases from the cache are lazy.
+  ASSERT_EQ(
+      ReleasePages(kLargeSize, PageReleaseReason::kProcessBackgroundActions),
+      kLargeSize);
+  middle = New(kLargeSize, kSpanInfo);
+  EXPECT_THAT(PrintInPbtxt(), HasSubstr(absl::StrCat("lazily_freed_pages: ",
+                                                     kLargeSize.raw_num())));
+  EXPECT_THAT(PrintInPbtxt(),
+              HasSubstr(absl::StrCat("lazily_freed_reused_pages: ",
+                                     kLargeSize.raw_num())));
+
+  // Pages the kernel reclaimed in the meantime are reported as such.
+  forwarder.set_lazily_freed_resident(false);
+  Delete(middle, kSpanInfo.objects_per_span);
+  ASSERT_EQ(
+      ReleasePages(kLargeSize, PageReleaseReason::kProcessBackgroundActions),
+      kLargeSize);
+  middle = New(kLargeSize, kSpanInfo);
+  EXPECT_THAT(PrintInPbtxt(),
+              HasSubstr(absl::StrCat("lazily_freed_reclaimed_pages: ",
+                                     kLargeSize.raw_num())));
+
+  // Explicit releases are not.
+  Delete(middle, kSpanInfo.objects_per_span);
+  ASSERT_EQ(ReleasePages(kLargeSize,
+                         /*reason=*/PageReleaseReason::kReleaseMemoryToSystem),
+            kLargeSize);
+  EXPECT_THAT(PrintInPbtxt(),
+              HasSubstr(absl::StrCat("lazily_freed_pages: ",
+                                     (2 * kLargeSize).raw_num())));
+  EXPECT_THAT(Print(), HasSubstr("released with MADV_FREE"));
+
+  Delete(after, kSpanInfo.objects_per_span);
+  Delete(before, kSpanInfo.objects_per_span);
+}
+
+TEST_P(HugePageAwareAllocatorTest, CountsRefaultsByReleaseReason) {
+  static constexpr Length kLargeSize = 2 * kPagesPerHugePage;
+  const SpanAllocInfo kSpanInfo = {1, AccessDensityPrediction::kSparse};
+
+  // Keep the released hugepages apart from the rest of the free memory, so
+  // that the next allocation reuses them.
+  Span* before = New(kLargeSize, kSpanInfo);
+  Span* middle = New(kLargeSize, kSpanInfo);
+  Span* after = New(kLargeSize, kSpanInfo);
+  Delete(middle, kSpanInfo.objects_per_span);
+
+  ASSERT_EQ(ReleasePages(kLargeSize, PageReleaseReason::kSoftLimitExceeded),
+            kLargeSize);
+  EXPECT_THAT(PrintInPbtxt(),
+              HasSubstr(absl::StrCat("sampled_soft_limit_exceeded: ",
+                                     kLargeSize.raw_num())));
+  EXPECT_THAT(PrintInPbtxt(), HasSubstr("refaulted_soft_limit_exceeded: 0"));
+
+  // Allocating the released hugepages again right away is a refault.
+  middle = New(kLargeSize, kSpanInfo);
+  EXPECT_THAT(PrintInPbtxt(),
+              HasSubstr(absl::StrCat("refaulted_soft_limit_exceeded: ",
+                                     kLargeSize.raw_num())));
+  EXPECT_THAT(PrintInPbtxt(),
+              HasSubstr("refaulted_release_memory_to_system: 0"));
+  EXPECT_THAT(Print(), HasSubstr("sampled released pages allocated again"));
+
+  // Each sample is counted once.
+  Delete(middle, kSpanInfo.objects_per_span);
+  middle = New(kLargeSize, kSpanInfo);
+  EXPECT_THAT(PrintInPbtxt(),
+              HasSubstr(absl::StrCat("refaulted_soft_limit_exceeded: ",
+                                     kLargeSize.raw_num())));
+
+  Delete(middle, kSpanInfo.objects_per_span);
+  Delete(after, kSpanInfo.objects_per_span);
+  Delete(before, kSpanInfo.objects_per_span);
+}
+
 TEST_P(HugePageAwareAllocatorTest, SmallDonations) {
   // This test works with small donations (kHugePageSize/2,kHugePageSize]-bytes
   // in size to check statistics.
@@ -1409,9 +1793,11 @@ class StatTest : public testing::Test {
     }
 
     // Provide hooked versions of AllocatePages
-    AddressRange AllocatePages(size_t bytes, size_t align, MemoryTag tag) {
+    AddressRange AllocatePages(size_t bytes, size_t align, MemoryTag tag,
+                               size_t size_class_region) {
       auto& underlying = *static_cast<StaticForwarder*>(this);
-      auto range = underlying.AllocatePages(bytes, align, tag);
+      auto range =
+          underlying.AllocatePages(bytes, align, tag, size_class_region);
 
       // we only support so many allocations here for simplicity
       TC_CHECK_LT(n_, kNumAllocs);
@@ -2134,6 +2520,94 @@ TEST(HugePageAwareAllocatorTest, ReleaseMaxColdPages) {
   }
 }
 
+// Measures Print (state.range(1) == 1) and PrintInPbtxt (== 2) of an
+// allocator holding state.range(0) GiB in a fragmented filler, while another
+// thread allocates and frees single pages.  Reports the tail latency of those
+// allocations, which wait on pageheap_lock while stats are collected; with
+// state.range(1) == 0, nothing collects stats and the tail is the baseline.
+void BM_PrintScaling(benchmark::State& state) {
+  const uint64_t heap_bytes = static_cast<uint64_t>(state.range(0)) << 30;
+  const int mode = state.range(1);
+  constexpr SpanAllocInfo kSpanInfo = {
+      .objects_per_span = 1, .density = AccessDensityPrediction::kSparse};
+
+  std::optional<FakeHugePageAwareAllocator> allocator;
+  allocator.emplace(HugePageAwareAllocatorOptions{.tag = MemoryTag::kNormal});
+  SpanDeleter deleter(&*allocator);
+
+  // Fill the heap with spans of up to half a hugepage, then free half of them
+  // at random, leaving most hugepages partially used.
+  absl::BitGen rng;
+  std::vector<Span*> spans;
+  for (uint64_t allocated = 0; allocated < heap_bytes;) {
+    const Length n(
+        absl::LogUniform<size_t>(rng, 1, kPagesPerHugePage.raw_num() / 2));
+    Span* s = allocator->New(n, kSpanInfo);
+    TC_CHECK_NE(s, nullptr);
+    spans.push_back(s);
+    allocated += n.in_bytes();
+  }
+  std::shuffle(spans.begin(), spans.end(), rng);
+  for (size_t i = spans.size() / 2; i < spans.size(); ++i) {
+    deleter(spans[i]);
+  }
+  spans.resize(spans.size() / 2);
+
+  std::atomic<bool> stop(false);
+  std::vector<int64_t> latencies_ns;
+  latencies_ns.reserve(1 << 22);
+  std::thread allocating([&]() {
+    while (!stop.load(std::memory_order_relaxed) &&
+           latencies_ns.size() < latencies_ns.capacity()) {
+      const absl::Time start = absl::Now();
+      Span* s = allocator->New(Length(1), kSpanInfo);
+      deleter(s);
+      latencies_ns.push_back(absl::ToInt64Nanoseconds(absl::Now() - start));
+    }
+  });
+
+  std::string buffer(1 << 20, '\0');
+  PageFlags pageflags;
+  for (auto _ : state) {
+    Printer printer(buffer.data(), buffer.size());
+    switch (mode) {
+      case 0:
+        absl::SleepFor(absl::Milliseconds(1));
+        break;
+      case 1:
+        allocator->Print(printer, pageflags);
+        break;
+      case 2: {
+        PbtxtRegion region(printer, kTop);
+        allocator->PrintInPbtxt(region, pageflags);
+        break;
+      }
+    }
+    benchmark::DoNotOptimize(buffer.data());
+  }
+
+  stop.store(true, std::memory_order_relaxed);
+  allocating.join();
+  for (Span* s : spans) {
+    deleter(s);
+  }
+
+  if (!latencies_ns.empty()) {
+    std::sort(latencies_ns.begin(), latencies_ns.end());
+    const auto percentile = [&](double p) {
+      return latencies_ns[static_cast<size_t>(p * (latencies_ns.size() - 1))];
+    };
+    state.counters["alloc_p50_ns"] = percentile(0.5);
+    state.counters["alloc_p99_ns"] = percentile(0.99);
+    state.counters["alloc_p999_ns"] = percentile(0.999);
+    state.counters["alloc_max_ns"] = latencies_ns.back();
+  }
+}
+BENCHMARK(BM_PrintScaling)
+    ->ArgsProduct({{1, 10, 100}, {0, 1, 2}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
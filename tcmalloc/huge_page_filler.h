@@ -52,9 +52,11 @@
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/internal/page_size.h"
 #include "tcmalloc/internal/pageflags.h"
+#include "tcmalloc/internal/probes.h"
 #include "tcmalloc/internal/range_tracker.h"
 #include "tcmalloc/internal/residency.h"
 #include "tcmalloc/internal/system_allocator.h"
+#include "tcmalloc/lifetime_predictor.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/span.h"
 #include "tcmalloc/stats.h"
@@ -70,6 +72,8 @@ constexpr absl::Duration kMinCollapseLatencyThreshold = absl::Milliseconds(15);
 enum class HugePageTreatmentType : uint8_t {
   kSampled = 1 << 0,
   kCollapse = 1 << 1,
+  kTiering = 1 << 2,
+  kPageOut = 1 << 3,
 };
 
 // Reduction operations for Scale(). In the case of contracting bitmaps,
@@ -117,6 +121,7 @@ class PageTracker : public TList<PageTracker>::Elem {
   PageTracker(HugePage p, bool was_donated, uint64_t now)
       : location_(p),
         released_count_(0),
+        known_zero_count_(0),
         abandoned_count_(0),
         donated_(false),
         was_donated_(was_donated),
@@ -165,6 +170,8 @@ class PageTracker : public TList<PageTracker>::Elem {
   struct PageAllocation {
     PageId page;
     Length previously_unbacked;
+    // Whether every page in the range is known to be zero.
+    bool known_zero = false;
   };
 
   struct TrackerFeatures {
@@ -181,7 +188,8 @@ class PageTracker : public TList<PageTracker>::Elem {
   // REQUIRES: there's a free range of at least n pages
   //
   // Returns a PageId i and a count of previously unbacked pages in the range
-  // [i, i+n) in previously_unbacked.
+  // [i, i+n) in previously_unbacked, and whether all of them are known to be
+  // zero in known_zero.
   PageAllocation Get(Length n, SpanAllocInfo span_alloc_info)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
@@ -189,9 +197,31 @@ class PageTracker : public TList<PageTracker>::Elem {
   void Put(Range r, SpanAllocInfo span_alloc_info)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Returns true if the n pages following r are free and on this hugepage.
+  bool CanExtend(Range r, Length n) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // REQUIRES: CanExtend(r, n), and r was the result of a previous call to Get
+  //
+  // Grows r by the n pages following it.  Returns the first of these pages and
+  // a count of previously unbacked ones among them in previously_unbacked.
+  PageAllocation Extend(Range r, Length n)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // REQUIRES: r was the result of a previous call to Get, and n < r.n.
+  //
+  // Frees the pages of r past its first n, which stay backed.
+  void Shrink(Range r, Length n) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   // Returns true if any unused pages have been returned-to-system.
   bool released() const { return released_count_ > 0; }
 
+  // Marks every free page as known to be zero, for a hugepage that is fresh
+  // from the kernel.  Pages released by ReleaseFree are known to be zero too,
+  // until they are handed out again.
+  void SetKnownZero() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+  Length known_zero_pages() const { return Length(known_zero_count_); }
+
   // Was this tracker donated from the tail of a multi-hugepage allocation?
   // Only up-to-date when the tracker is on a TrackerList in the Filler;
   // otherwise the value is meaningless.
@@ -224,6 +254,19 @@ class PageTracker : public TList<PageTracker>::Elem {
     abandoned_count_ = count.raw_num();
   }
 
+  // The NUMA node the hugepage was first touched from, recorded by the
+  // allocator that contributed it.  The filler prefers trackers on the
+  // caller's node when it has several equally good candidates.
+  size_t numa_node() const { return numa_node_; }
+  void set_numa_node(size_t node) { numa_node_ = node; }
+
+  // Whether the hugepage was contributed for a span predicted to be
+  // short-lived.  The filler keeps such hugepages apart from the others, so
+  // that they are left with short-lived allocations only and become free as a
+  // whole.
+  bool short_lived() const { return short_lived_; }
+  void SetShortLived() { short_lived_ = true; }
+
   // These statistics help us measure the fragmentation of a hugepage and
   // the desirability of allocating from this hugepage.
   Length longest_free_range() const { return Length(free_.longest_free()); }
@@ -235,6 +278,8 @@ class PageTracker : public TList<PageTracker>::Elem {
   double last_page_allocation_time() const {
     return last_page_allocation_time_;
   }
+  // When free pages of this hugepage were last subreleased, or 0 if never.
+  double last_release_time() const { return last_release_time_; }
   bool fully_freed() const { return longest_free_range() == kPagesPerHugePage; }
   Length free_pages() const;
   bool empty() const;
@@ -251,6 +296,16 @@ class PageTracker : public TList<PageTracker>::Elem {
   // Return all unused pages to the system, mark future frees to do same.
   // Returns the count of pages unbacked.
   Length ReleaseFree(MemoryModifyFunction& unback)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    Length not_resident;
+    return ReleaseFree(unback, PageBitmap(), &not_resident);
+  }
+  // As above, but pages set in `unbacked` are known not to be resident: free
+  // ranges made only of them are marked released without calling unback.
+  // Returns the count of resident pages unbacked; the known unbacked pages
+  // marked released are added to *not_resident.
+  Length ReleaseFree(MemoryModifyFunction& unback, const PageBitmap& unbacked,
+                     Length* not_resident)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
   Length MarkSubreleased(PageBitmap unbacked)
@@ -325,6 +380,8 @@ class PageTracker : public TList<PageTracker>::Elem {
     last_page_allocation_time_ = value;
   }
 
+  void SetLastReleaseTime(double value) { last_release_time_ = value; }
+
   void RecordFeatures() {
     features_.is_hugepage_backed =
         hugepage_residency_state_.maybe_hugepage_backed;
@@ -354,6 +411,34 @@ class PageTracker : public TList<PageTracker>::Elem {
   TagState GetTagState() const { return tagged_state_; }
   void SetTagState(const TagState& state) { tagged_state_ = state; }
 
+  struct TierState {
+    // Whether the hugepage was moved to the far memory tier.
+    bool far = false;
+    // Records whether the tier was ever checked.
+    bool entry_valid = false;
+    // Records the time (in ticks) when the tier was last checked.
+    double record_time = 0;
+  };
+  TierState GetTierState() const { return tier_state_; }
+  void SetTierState(const TierState& state) { tier_state_ = state; }
+
+  struct PageOutState {
+    enum Advice : uint8_t { kNone, kCold, kPageOut };
+    // Records whether the hugepage was ever checked, and when, in ticks.
+    bool entry_valid = false;
+    double record_time = 0;
+    // Whether the hugepage was entirely stale when last checked, and since
+    // when, in ticks.
+    bool stale = false;
+    double stale_since = 0;
+    // The strongest advice given since the hugepage became stale, and how
+    // many of its bytes were resident when last checked after it.
+    Advice advice = kNone;
+    uint32_t resident_bytes = 0;
+  };
+  PageOutState GetPageOutState() const { return page_out_state_; }
+  void SetPageOutState(const PageOutState& state) { page_out_state_ = state; }
+
   void SetAnonVmaName(MemoryTagFunction& set_anon_vma_name,
                       std::optional<absl::string_view> name);
 
@@ -377,6 +462,8 @@ class PageTracker : public TList<PageTracker>::Elem {
   //
   // TODO(b/151663108):  Logically, this is guarded by pageheap_lock.
   uint16_t released_count_;
+  // Cached value of known_zero_.CountBits(0, kPagesPerHugePages)
+  uint16_t known_zero_count_;
   uint16_t abandoned_count_;
   bool donated_;
   bool was_donated_;
@@ -390,6 +477,7 @@ class PageTracker : public TList<PageTracker>::Elem {
   bool unbroken_;
   double alloctime_;
   double last_page_allocation_time_ = 0;
+  double last_release_time_ = 0;
 
   RangeTracker<kPagesPerHugePage.raw_num()> free_;
 
@@ -399,6 +487,9 @@ class PageTracker : public TList<PageTracker>::Elem {
 
   TagState tagged_state_;
 
+  TierState tier_state_;
+  PageOutState page_out_state_;
+
   // Bitmap of pages based on them being released to the OS.
   // * Not yet released pages are unset (considered "free")
   // * Released pages are set.
@@ -412,6 +503,17 @@ class PageTracker : public TList<PageTracker>::Elem {
   // TODO(b/151663108):  Logically, this is guarded by pageheap_lock.
   Bitmap<kPagesPerHugePage.raw_num()> released_by_page_;
 
+  // Bitmap of free pages known to be zero: those never handed out since the
+  // hugepage came fresh from the kernel, and those released by ReleaseFree.
+  // Pages only found to be unbacked by MarkSubreleased are left out, as they
+  // might have been backed again in the meantime.
+  Bitmap<kPagesPerHugePage.raw_num()> known_zero_;
+
+  // Clears the known-zero state of [index, index + n), returning true iff all
+  // of it was known to be zero.
+  bool TakeKnownZero(size_t index, size_t n)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   static_assert(kPagesPerHugePage.raw_num() <
                     std::numeric_limits<uint16_t>::max(),
                 "nallocs must be able to support kPagesPerHugePage!");
@@ -427,13 +529,12 @@ class PageTracker : public TList<PageTracker>::Elem {
   // is checked to ensure that the tracker is not freed right away.
   uint8_t dont_free_tracker_mask_ = 0;
 
-  [[nodiscard]] bool ReleasePages(Range r, MemoryModifyFunction& unback) {
-    bool success = unback(r).success;
-    if (ABSL_PREDICT_TRUE(success)) {
-      unbroken_ = false;
-    }
-    return success;
-  }
+  uint8_t numa_node_ = 0;
+
+  bool short_lived_ = false;
+
+  // ReleaseFree hands free ranges to unback in batches of up to this many.
+  static constexpr size_t kMaxReleaseBatch = 32;
 };
 
 // Records number of hugepages in different types of allocs.
@@ -478,6 +579,12 @@ struct HugePageTreatmentStats {
   double collapse_time_total_cycles = 0;
   double collapse_time_max_cycles = 0;
   size_t collapse_intervals_skipped = 0;
+  // Collapses of hugepages that were subreleased and have since been refilled,
+  // which are also counted above.
+  size_t recollapse_eligible = 0;
+  size_t recollapse_attempted = 0;
+  size_t recollapse_succeeded = 0;
+  double recollapse_time_total_cycles = 0;
   static absl::string_view ErrorTypeToString(CollapseErrorType type) {
     switch (type) {
       case CollapseErrorType::kENoMem:
@@ -527,12 +634,61 @@ struct HugePageTreatmentStats {
       collapse_errors[i] += rhs.collapse_errors[i];
     }
     collapse_time_total_cycles += rhs.collapse_time_total_cycles;
+    recollapse_eligible += rhs.recollapse_eligible;
+    recollapse_attempted += rhs.recollapse_attempted;
+    recollapse_succeeded += rhs.recollapse_succeeded;
+    recollapse_time_total_cycles += rhs.recollapse_time_total_cycles;
     // TODO(b/425749361): Add treated_pages_subreleased to the stats when we
     // start collecting cumulative stats.
     return *this;
   };
 };
 
+// How HugePageFiller::TierHugepageTrackers places hugepages on the near and
+// far memory tiers.
+enum class TieringMode {
+  // Move stale hugepages without dense spans to the far tier, and move
+  // hugepages on the far tier back once they are accessed again.
+  kDemoteStale,
+  // Move every hugepage to the far tier, e.g. for MemoryTag::kCold.
+  kDemoteAll,
+  // Move every hugepage on the far tier back, e.g. once tiering is disabled.
+  kPromoteAll,
+};
+
+struct HugePageTieringStats {
+  size_t demoted = 0;
+  size_t promoted = 0;
+  size_t failed = 0;
+
+  HugePageTieringStats& operator+=(const HugePageTieringStats& rhs) {
+    demoted += rhs.demoted;
+    promoted += rhs.promoted;
+    failed += rhs.failed;
+    return *this;
+  }
+};
+
+struct HugePagePageOutStats {
+  // Hugepages advised with MADV_COLD and with MADV_PAGEOUT.
+  size_t advised_cold = 0;
+  size_t paged_out = 0;
+  // Resident bytes that MADV_PAGEOUT reclaimed, and bytes of advised
+  // hugepages that became resident again.
+  size_t paged_out_bytes = 0;
+  size_t refaulted_bytes = 0;
+  size_t failed = 0;
+
+  HugePagePageOutStats& operator+=(const HugePagePageOutStats& rhs) {
+    advised_cold += rhs.advised_cold;
+    paged_out += rhs.paged_out;
+    paged_out_bytes += rhs.paged_out_bytes;
+    refaulted_bytes += rhs.refaulted_bytes;
+    failed += rhs.failed;
+    return *this;
+  }
+};
+
 namespace huge_page_filler_internal {
 // Computes some histograms of fullness. Because nearly empty/full huge pages
 // are much more interesting, we calculate 4 buckets at each of the beginning
@@ -1180,6 +1336,8 @@ class HugePageFiller {
     TrackerType* absl_nullable pt;
     PageId page;
     bool from_released;
+    // Whether the allocated pages are all known to be zero.
+    bool known_zero;
   };
 
   // Our API is simple, but note that it does not include an unconditional
@@ -1190,10 +1348,45 @@ class HugePageFiller {
   // n is the number of TCMalloc pages to be allocated.  num_objects is the
   // number of individual objects that would be allocated on these n pages.
   //
+  // If numa_node is not kAnyNumaNode, trackers whose numa_node() matches it
+  // are preferred over other trackers that are equally good candidates.  This
+  // lets a single filler hold hugepages from several NUMA nodes.
+  //
   // On failure, returns nullptr/PageId{0}.
-  TryGetResult TryGet(Length n, SpanAllocInfo span_alloc_info)
+  TryGetResult TryGet(Length n, SpanAllocInfo span_alloc_info,
+                      int numa_node = kAnyNumaNode)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  static constexpr int kAnyNumaNode = -1;
+  // Number of trackers of a list TryGet looks at for one on the requested
+  // NUMA node.
+  static constexpr size_t kNumaCandidates = 8;
+
+  // Number of allocations TryGet served from a tracker on the requested NUMA
+  // node, and from a tracker on another node.
+  struct NumaStats {
+    size_t local = 0;
+    size_t remote = 0;
+  };
+  NumaStats numa_stats() const { return numa_stats_; }
+
+  // Number of hugepages set aside for spans predicted to be short-lived.
+  HugeLength short_lived_hugepages() const {
+    return short_lived_alloc_[AccessDensityPrediction::kSparse].size() +
+           short_lived_alloc_[AccessDensityPrediction::kDense].size();
+  }
+
+  // Free pages stranded on the hugepages set aside for short-lived spans.  If
+  // the lifetimes are right, these hugepages empty out quickly and this stays
+  // small relative to their size.
+  Length short_lived_free_pages() const {
+    Length free;
+    for (const auto& list : short_lived_alloc_) {
+      list.Iter([&](const TrackerType& pt) { free += pt.free_pages(); }, 0);
+    }
+    return free;
+  }
+
   // Marks r as usable by new allocations into *pt; returns pt if that hugepage
   // is now empty (nullptr otherwise.)
   //
@@ -1203,6 +1396,22 @@ class HugePageFiller {
                                  SpanAllocInfo span_alloc_info)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Grows r, allocated from *pt, by the n pages following it if they are free,
+  // setting *from_released = true iff any of them were released.  Returns
+  // false, leaving r unchanged, otherwise.
+  //
+  // REQUIRES: {pt, r} was the result of a previous TryGet.
+  bool TryExtend(TrackerType* absl_nonnull pt, Range r, Length n,
+                 bool* absl_nonnull from_released)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Frees the pages of r, allocated from *pt, past its first n.  pt keeps r's
+  // first n pages, so it is never returned empty.
+  //
+  // REQUIRES: {pt, r} was the result of a previous TryGet, and n < r.n.
+  void Shrink(TrackerType* absl_nonnull pt, Range r, Length n)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   // Contributes a tracker to the filler. If "donated," then the tracker is
   // marked as having come from the tail of a multi-hugepage allocation, which
   // causes it to be treated slightly differently.
@@ -1323,6 +1532,11 @@ class HugePageFiller {
   void UpdateMaxBackoffDelay(absl::Duration latency)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Adds <budget> worth of collapse cycles per second elapsed since the last
+  // call, keeping at most one second worth of unused budget.
+  void RefillCollapseBudget(absl::Duration budget)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   // Iterates through all hugepage trackers and applies different treatments.
   // Treatments applied include:
   // 1. Attempt to collapse eligible memory into hugepages if
@@ -1338,9 +1552,32 @@ class HugePageFiller {
   // revisited only after five minutes.
   // 3. Attempt to release free/unreleased pages from trackers with a swapped
   // page.
+  //
+  // Collapses happen without holding pageheap_lock.  If <collapse_budget> is
+  // nonzero, the time spent collapsing is limited to <collapse_budget> per
+  // second on average; otherwise collapse backs off when its latency is high.
   void TreatHugepageTrackers(
       EnableCollapse enable_collapse,
       EnableUnfilteredCollapse enable_unfiltered_collapse,
+      PageFlagsBase* pageflags = nullptr, Residency* residency = nullptr,
+      absl::Duration collapse_budget = absl::ZeroDuration())
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Moves hugepages between the near and far memory tiers according to <mode>,
+  // see HugePageTieringTreatment.  Memory is moved without holding
+  // pageheap_lock.  Trackers fully freed in the meantime are left for
+  // FetchFullyFreedTracker.
+  HugePageTieringStats TierHugepageTrackers(MemoryTierFunction& set_memory_tier,
+                                            TieringMode mode,
+                                            PageFlagsBase* pageflags = nullptr)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Advises the kernel to reclaim hugepages that pageflags found entirely
+  // stale for at least min_idle: with MADV_PAGEOUT if reclaim is true, and
+  // with MADV_COLD otherwise.  Hugepages that become resident again are
+  // counted as refaulted, and advised again once they are stale again.
+  HugePagePageOutStats PageOutHugepageTrackers(
+      PageOutFunction& page_out, absl::Duration min_idle, bool reclaim,
       PageFlagsBase* pageflags = nullptr, Residency* residency = nullptr)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
@@ -1404,6 +1641,11 @@ class HugePageFiller {
       [AccessDensityPrediction::kPredictionCounts];
   PageTrackerLists<kNumLists>
       regular_alloc_released_[AccessDensityPrediction::kPredictionCounts];
+  // Like regular_alloc_, for hugepages contributed for short-lived spans (see
+  // PageTracker::short_lived()).  Once subreleased, they are kept with the
+  // other released hugepages.
+  PageTrackerLists<kNumLists>
+      short_lived_alloc_[AccessDensityPrediction::kPredictionCounts];
 
   // Records a list of fully freed trackers. We might end up with trackers that
   // are fully freed, but not deleted, when: the trackers are being userspace-
@@ -1414,6 +1656,14 @@ class HugePageFiller {
 
   HugePageTreatmentStats treatment_stats_ ABSL_GUARDED_BY(pageheap_lock);
 
+  // Hugepages collapsed again after being subreleased and refilled, per
+  // second spent collapsing them.
+  double RecollapseRate() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    if (treatment_stats_.recollapse_time_total_cycles <= 0) return 0;
+    return treatment_stats_.recollapse_succeeded * clock_.freq() /
+           treatment_stats_.recollapse_time_total_cycles;
+  }
+
   // n_used_released_ contains the number of pages in huge pages that are not
   // free (i.e., allocated).  Only the hugepages in regular_alloc_released_ are
   // considered.
@@ -1424,6 +1674,14 @@ class HugePageFiller {
   // from the hugepages in the set regular_alloc_partial_released.
   Length n_used_partial_released_[AccessDensityPrediction::kPredictionCounts];
 
+  NumaStats numa_stats_;
+
+  // Removes the best tracker of lists with index at least n, as GetLeast does,
+  // preferring trackers on numa_node among equally good ones.
+  template <size_t N>
+  TrackerType* absl_nullable GetLeastOnNode(PageTrackerLists<N>& lists,
+                                            size_t n, int numa_node);
+
   // RemoveFromFillerList pt from the appropriate PageTrackerList.
   void RemoveFromFillerList(TrackerType* absl_nonnull pt);
   // Put pt in the appropriate PageTrackerList.
@@ -1464,12 +1722,12 @@ class HugePageFiller {
 
     if (a->used_pages() < b->used_pages()) return true;
     if (a->used_pages() > b->used_pages()) return false;
-    // If 'a' has dense spans, then we do not prefer to release from 'a'
-    // compared to 'b'.
-    if (a->HasDenseSpans()) return false;
-    // We know 'a' does not have dense spans.  If 'b' has dense spans, then we
-    // prefer to release from 'a'.  Otherwise, we do not prefer either.
-    return b->HasDenseSpans();
+    // We prefer to release from hugepages without dense spans, whose pages are
+    // less likely to be touched again soon.
+    if (a->HasDenseSpans() != b->HasDenseSpans()) return a->HasDenseSpans();
+    // Otherwise we prefer the hugepage that has gone longest without an
+    // allocation, as its free pages are the least likely to be reused.
+    return a->last_page_allocation_time() > b->last_page_allocation_time();
   }
 
   // SelectCandidates identifies the candidates.size() best candidates in the
@@ -1489,6 +1747,15 @@ class HugePageFiller {
                            Length target)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // The free pages of pt that the last residency scan found unbacked, if the
+  // scan is recent enough to trust.  Pages allocated since were cleared.
+  static constexpr absl::Duration kResidencyTrustInterval = absl::Minutes(5);
+  PageBitmap RecentlyUnbacked(const PageTracker& pt, double now) const;
+
+  // Counts subreleased pages allocated again within kRefaultInterval.
+  void RecordRefault(const TrackerType& pt, Length previously_unbacked,
+                     double now) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   HugeLength size_;
 
   Length pages_allocated_[AccessDensityPrediction::kPredictionCounts];
@@ -1517,6 +1784,11 @@ class HugePageFiller {
   MemoryTagFunction& set_anon_vma_name_;
   int max_backoff_delay_ ABSL_GUARDED_BY(pageheap_lock) = 1;
   int current_backoff_delay_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  // Cycles of collapse left in the budget passed to TreatHugepageTrackers, see
+  // RefillCollapseBudget.
+  double collapse_budget_cycles_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  double collapse_budget_refill_time_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  bool collapse_budget_started_ ABSL_GUARDED_BY(pageheap_lock) = false;
   uintptr_t rng_ = 0;
   SubreleaseUnbackedMode subrelease_unbacked_mode_;
 };
@@ -1542,8 +1814,27 @@ inline typename PageTracker::PageAllocation PageTracker::Get(
   }
 
   TC_ASSERT_EQ(released_by_page_.CountBits(), released_count_);
+  // The allocated pages will be faulted in, whatever residency last found.
+  if (hugepage_residency_state_.entry_valid) {
+    hugepage_residency_state_.unbacked.ClearRange(index, n.raw_num());
+  }
   return PageAllocation{location_.first_page() + Length(index),
-                        Length(unbacked)};
+                        Length(unbacked), TakeKnownZero(index, n.raw_num())};
+}
+
+inline void PageTracker::SetKnownZero() {
+  known_zero_ = ~free_.bits();
+  known_zero_count_ = known_zero_.CountBits();
+}
+
+inline bool PageTracker::TakeKnownZero(size_t index, size_t n) {
+  // As with released_count_, skip the bitmap while no page is known to be zero.
+  if (ABSL_PREDICT_TRUE(known_zero_count_ == 0)) return false;
+  const size_t zero = known_zero_.CountBits(index, n);
+  known_zero_.ClearRange(index, n);
+  TC_ASSERT_GE(known_zero_count_, zero);
+  known_zero_count_ -= zero;
+  return zero == n;
 }
 
 inline void PageTracker::SetAnonVmaName(MemoryTagFunction& set_anon_vma_name,
@@ -1595,10 +1886,71 @@ inline void PageTracker::Put(Range r, SpanAllocInfo span_alloc_info) {
   num_objects_ -= span_alloc_info.objects_per_span;
 }
 
-inline Length PageTracker::ReleaseFree(MemoryModifyFunction& unback) {
+inline bool PageTracker::CanExtend(Range r, Length n) const {
+  TC_ASSERT_GE(r.p, location_.first_page());
+  const Length index = r.p + r.n - location_.first_page();
+  return free_.IsFree(index.raw_num(), n.raw_num());
+}
+
+inline void PageTracker::Shrink(Range r, Length n) {
+  TC_ASSERT_LT(n, r.n);
+  const size_t index = (r.p + n - location_.first_page()).raw_num();
+  free_.Shrink(index, (r.n - n).raw_num());
+}
+
+inline typename PageTracker::PageAllocation PageTracker::Extend(Range r,
+                                                                Length n) {
+  TC_ASSERT(CanExtend(r, n));
+  const size_t index = (r.p + r.n - location_.first_page()).raw_num();
+  free_.Extend(index, n.raw_num());
+
+  // As in Get, the extension may reuse released pages.
+  size_t unbacked = 0;
+  if (ABSL_PREDICT_FALSE(released_count_ > 0)) {
+    unbacked = released_by_page_.CountBits(index, n.raw_num());
+    released_by_page_.ClearRange(index, n.raw_num());
+    TC_ASSERT_GE(released_count_, unbacked);
+    released_count_ -= unbacked;
+  }
+
+  TC_ASSERT_EQ(released_by_page_.CountBits(), released_count_);
+  if (hugepage_residency_state_.entry_valid) {
+    hugepage_residency_state_.unbacked.ClearRange(index, n.raw_num());
+  }
+  return PageAllocation{r.p + r.n, Length(unbacked),
+                        TakeKnownZero(index, n.raw_num())};
+}
+
+inline Length PageTracker::ReleaseFree(MemoryModifyFunction& unback,
+                                       const PageBitmap& unbacked,
+                                       Length* not_resident) {
   size_t count = 0;
+  // Of count, the pages that were known to be unbacked already.
+  size_t count_unbacked = 0;
   size_t index = 0;
   size_t n;
+  Range batch[kMaxReleaseBatch];
+  size_t batch_size = 0;
+  auto release_batch = [&]() {
+    absl::Span<const Range> pending(batch, batch_size);
+    while (!pending.empty()) {
+      const size_t released = unback.ApplyAll(pending);
+      for (size_t i = 0; i < released; ++i) {
+        // Mark pages as released.  Amortize the update to release_count_.
+        const Length offset = pending[i].p - location_.first_page();
+        released_by_page_.SetRange(offset.raw_num(), pending[i].n.raw_num());
+        known_zero_.SetRange(offset.raw_num(), pending[i].n.raw_num());
+        count += pending[i].n.raw_num();
+        count_unbacked +=
+            unbacked.CountBits(offset.raw_num(), pending[i].n.raw_num());
+      }
+      if (released > 0) unbroken_ = false;
+      // Skip the range that failed and carry on with the others.
+      pending.remove_prefix(std::min(released + 1, pending.size()));
+    }
+    batch_size = 0;
+  };
+
   // For purposes of tracking, pages which are not yet released are "free" in
   // the released_by_page_ bitmap.  We subrelease these pages in an iterative
   // process:
@@ -1606,7 +1958,9 @@ inline Length PageTracker::ReleaseFree(MemoryModifyFunction& unback) {
   // 1.  Identify the next range of still backed pages.
   // 2.  Iterate on the free_ tracker within this range.  For any free range
   //     found, mark these as unbacked.
-  // 3.  Release the subrange to the OS.
+  // 3.  Release the subranges to the OS, kMaxReleaseBatch at a time, so that
+  //     fragmented hugepages need fewer calls to unback.  Subranges that were
+  //     never faulted in, or were unbacked behind our back, are only marked.
   while (released_by_page_.NextFreeRange(index, &index, &n)) {
     size_t free_index;
     size_t free_n;
@@ -1623,11 +1977,16 @@ inline Length PageTracker::ReleaseFree(MemoryModifyFunction& unback) {
       TC_ASSERT_EQ(released_by_page_.CountBits(free_index, length), 0);
       PageId p = location_.first_page() + Length(free_index);
 
-      if (ABSL_PREDICT_TRUE(ReleasePages(Range(p, Length(length)), unback))) {
-        // Mark pages as released.  Amortize the update to release_count_.
+      if (unbacked.CountBits(free_index, length) == length) {
         released_by_page_.SetRange(free_index, length);
         count += length;
+        count_unbacked += length;
+        unbroken_ = false;
+        index = end;
+        continue;
       }
+      if (batch_size == kMaxReleaseBatch) release_batch();
+      batch[batch_size++] = Range(p, Length(length));
 
       index = end;
     } else {
@@ -1636,14 +1995,17 @@ inline Length PageTracker::ReleaseFree(MemoryModifyFunction& unback) {
       index += n;
     }
   }
+  release_batch();
 
   released_count_ += count;
+  known_zero_count_ = known_zero_.CountBits();
   if (count > 0) {
     hugepage_residency_state_.maybe_hugepage_backed = false;
   }
   TC_ASSERT_LE(Length(released_count_), kPagesPerHugePage);
   TC_ASSERT_EQ(released_by_page_.CountBits(), released_count_);
-  return Length(count);
+  *not_resident += Length(count_unbacked);
+  return Length(count - count_unbacked);
 }
 
 inline Length PageTracker::MarkSubreleased(PageBitmap unbacked) {
@@ -1774,9 +2136,33 @@ inline HugePageFiller<TrackerType>::HugePageFiller(
   }
 }
 
+template <class TrackerType>
+template <size_t N>
+inline TrackerType* HugePageFiller<TrackerType>::GetLeastOnNode(
+    PageTrackerLists<N>& lists, size_t n, int numa_node) {
+  if (ABSL_PREDICT_TRUE(numa_node == kAnyNumaNode)) {
+    return lists.GetLeast(n);
+  }
+  TrackerType* pt = lists.GetLeastPreferring(
+      n,
+      [numa_node](const TrackerType& candidate) {
+        return candidate.numa_node() == static_cast<size_t>(numa_node);
+      },
+      kNumaCandidates);
+  if (pt != nullptr) {
+    if (pt->numa_node() == static_cast<size_t>(numa_node)) {
+      ++numa_stats_.local;
+    } else {
+      ++numa_stats_.remote;
+    }
+  }
+  return pt;
+}
+
 template <class TrackerType>
 inline typename HugePageFiller<TrackerType>::TryGetResult
-HugePageFiller<TrackerType>::TryGet(Length n, SpanAllocInfo span_alloc_info) {
+HugePageFiller<TrackerType>::TryGet(Length n, SpanAllocInfo span_alloc_info,
+                                    int numa_node) {
   TC_ASSERT_GT(n, Length(0));
   TC_ASSERT(span_alloc_info.density == AccessDensityPrediction::kSparse ||
             n == Length(1));
@@ -1845,26 +2231,43 @@ HugePageFiller<TrackerType>::TryGet(Length n, SpanAllocInfo span_alloc_info) {
   // So all we have to do is find the first nonempty freelist in the regular
   // PageTrackerList that *could* support our allocation, and it will be our
   // best choice. If there is none we repeat with the donated PageTrackerList.
+  //
+  // The trackers of a freelist are equally good choices, so when a NUMA node
+  // is requested we pick one on that node among the first few of the freelist,
+  // without giving up on the above.
+  //
+  // Spans predicted to be short-lived are first placed on the hugepages set
+  // aside for them, which other spans only use once all the other hugepages,
+  // including released ones, are exhausted.
   ASSUME(n < kPagesPerHugePage);
   TrackerType* pt;
 
   bool was_released = false;
   const AccessDensityPrediction type = span_alloc_info.density;
+  const bool short_lived =
+      span_alloc_info.lifetime == LifetimePrediction::kShortLived;
   do {
     const size_t listindex =
         ListFor(n, 0, type, kPagesPerHugePage.raw_num() - 1);
-    pt = regular_alloc_[type].GetLeast(listindex);
+    if (short_lived) {
+      pt = GetLeastOnNode(short_lived_alloc_[type], listindex, numa_node);
+      if (pt) {
+        break;
+      }
+    }
+    pt = GetLeastOnNode(regular_alloc_[type], listindex, numa_node);
     if (pt) {
       TC_ASSERT(!pt->donated());
       break;
     }
     if (ABSL_PREDICT_TRUE(type == AccessDensityPrediction::kSparse)) {
-      pt = donated_alloc_.GetLeast(n.raw_num());
+      pt = GetLeastOnNode(donated_alloc_, n.raw_num(), numa_node);
       if (pt) {
         break;
       }
     }
-    pt = regular_alloc_partial_released_[type].GetLeast(listindex);
+    pt = GetLeastOnNode(regular_alloc_partial_released_[type], listindex,
+                        numa_node);
     if (pt) {
       TC_ASSERT(!pt->donated());
       was_released = true;
@@ -1872,7 +2275,7 @@ HugePageFiller<TrackerType>::TryGet(Length n, SpanAllocInfo span_alloc_info) {
       n_used_partial_released_[type] -= pt->used_pages();
       break;
     }
-    pt = regular_alloc_released_[type].GetLeast(listindex);
+    pt = GetLeastOnNode(regular_alloc_released_[type], listindex, numa_node);
     if (pt) {
       TC_ASSERT(!pt->donated());
       was_released = true;
@@ -1880,8 +2283,14 @@ HugePageFiller<TrackerType>::TryGet(Length n, SpanAllocInfo span_alloc_info) {
       n_used_released_[type] -= pt->used_pages();
       break;
     }
+    if (!short_lived) {
+      pt = GetLeastOnNode(short_lived_alloc_[type], listindex, numa_node);
+      if (pt) {
+        break;
+      }
+    }
 
-    return {nullptr, PageId{0}, false};
+    return {nullptr, PageId{0}, false, false};
   } while (false);
   ASSUME(pt != nullptr);
   TC_ASSERT_GE(pt->longest_free_range(), n);
@@ -1908,11 +2317,12 @@ HugePageFiller<TrackerType>::TryGet(Length n, SpanAllocInfo span_alloc_info) {
   TC_ASSERT(was_released || page_allocation.previously_unbacked == Length(0));
   TC_ASSERT_GE(unmapped_, page_allocation.previously_unbacked);
   unmapped_ -= page_allocation.previously_unbacked;
+  RecordRefault(*pt, page_allocation.previously_unbacked, now);
   // We're being used for an allocation, so we are no longer considered
   // donated by this point.
   TC_ASSERT(!pt->donated());
   UpdateFillerStatsTracker();
-  return {pt, page_allocation.page, was_released};
+  return {pt, page_allocation.page, was_released, page_allocation.known_zero};
 }
 
 template <class TrackerType>
@@ -2030,6 +2440,55 @@ inline TrackerType* HugePageFiller<TrackerType>::Put(
   return nullptr;
 }
 
+template <class TrackerType>
+inline bool HugePageFiller<TrackerType>::TryExtend(TrackerType* pt, Range r,
+                                                   Length n,
+                                                   bool* from_released) {
+  TC_ASSERT_GT(n, Length(0));
+  if (!pt->CanExtend(r, n)) {
+    return false;
+  }
+
+  const AccessDensityPrediction type = pt->HasDenseSpans()
+                                           ? AccessDensityPrediction::kDense
+                                           : AccessDensityPrediction::kSparse;
+  const bool was_released = pt->released();
+  RemoveFromFillerList(pt);
+  const double now = clock_.now();
+  pt->SetLastAllocationTime(now);
+  const auto page_allocation = pt->Extend(r, n);
+  AddToFillerList(pt);
+  pages_allocated_[type] += n;
+
+  // As in TryGet, record if the hugepage is no longer released.
+  if (was_released && !pt->released() && !pt->was_released()) {
+    pt->set_was_released(/*status=*/true);
+    ++n_was_released_[type];
+  }
+  TC_ASSERT_GE(unmapped_, page_allocation.previously_unbacked);
+  unmapped_ -= page_allocation.previously_unbacked;
+  RecordRefault(*pt, page_allocation.previously_unbacked, now);
+  *from_released = page_allocation.previously_unbacked > Length(0);
+  UpdateFillerStatsTracker();
+  return true;
+}
+
+template <class TrackerType>
+inline void HugePageFiller<TrackerType>::Shrink(TrackerType* pt, Range r,
+                                                Length n) {
+  TC_ASSERT_GT(n, Length(0));
+  TC_ASSERT_LT(n, r.n);
+  const AccessDensityPrediction type = pt->HasDenseSpans()
+                                           ? AccessDensityPrediction::kDense
+                                           : AccessDensityPrediction::kSparse;
+  RemoveFromFillerList(pt);
+  pt->Shrink(r, n);
+  AddToFillerList(pt);
+  TC_ASSERT_GE(pages_allocated_[type], r.n - n);
+  pages_allocated_[type] -= r.n - n;
+  UpdateFillerStatsTracker();
+}
+
 // TODO: b/425749361 - Add unit tests for subclasses.
 class HugePageTreatment {
  public:
@@ -2183,6 +2642,9 @@ inline void HugePageFiller<TrackerType>::Contribute(
     if (type == AccessDensityPrediction::kDense) {
       pt->SetHasDenseSpans();
     }
+    if (span_alloc_info.lifetime == LifetimePrediction::kShortLived) {
+      pt->SetShortLived();
+    }
     AddToFillerList(pt);
   }
 
@@ -2245,6 +2707,7 @@ inline Length HugePageFiller<TrackerType>::ReleaseCandidates(
 
   Length total_released;
   HugeLength total_broken = NHugePages(0);
+  const double now = clock_.now();
 #ifndef NDEBUG
   Length last;
 #endif
@@ -2269,10 +2732,16 @@ inline Length HugePageFiller<TrackerType>::ReleaseCandidates(
       ++total_broken;
     }
     RemoveFromFillerList(best);
-    Length ret = best->ReleaseFree(unback_);
-    unmapped_ += ret;
+    Length not_resident;
+    Length ret =
+        best->ReleaseFree(unback_, RecentlyUnbacked(*best, now), &not_resident);
+    unmapped_ += ret + not_resident;
+    subrelease_stats_.total_pages_found_unbacked += not_resident;
     TC_ASSERT_GE(unmapped_, best->released_pages());
     total_released += ret;
+    if (ret > Length(0)) {
+      best->SetLastReleaseTime(now);
+    }
     AddToFillerList(best);
     // If the candidate we just released from previously had was_released set,
     // clear it. was_released is tracked only for pages that aren't in
@@ -2289,6 +2758,7 @@ inline Length HugePageFiller<TrackerType>::ReleaseCandidates(
 
   subrelease_stats_.num_pages_subreleased += total_released;
   subrelease_stats_.num_hugepages_broken += total_broken;
+  TCMALLOC_PROBE(subrelease, total_released.raw_num(), total_broken.raw_num());
 
   // Keep separate stats if the on going release is triggered by reaching
   // tcmalloc limit
@@ -2299,6 +2769,34 @@ inline Length HugePageFiller<TrackerType>::ReleaseCandidates(
   return total_released;
 }
 
+template <class TrackerType>
+inline PageBitmap HugePageFiller<TrackerType>::RecentlyUnbacked(
+    const PageTracker& pt, double now) const {
+  const PageTracker::HugePageResidencyState state =
+      pt.GetHugePageResidencyState();
+  if (!state.entry_valid || state.maybe_hugepage_backed ||
+      state.being_collapsed) {
+    return PageBitmap();
+  }
+  // khugepaged may have collapsed the hugepage since, backing all of it.
+  const double elapsed = std::max<double>(now - state.record_time, 0);
+  if (elapsed > absl::ToDoubleSeconds(kResidencyTrustInterval) *
+                    clock_.freq()) {
+    return PageBitmap();
+  }
+  return state.unbacked;
+}
+
+template <class TrackerType>
+inline void HugePageFiller<TrackerType>::RecordRefault(
+    const TrackerType& pt, Length previously_unbacked, double now) {
+  if (ABSL_PREDICT_TRUE(previously_unbacked == Length(0))) return;
+  const double elapsed = std::max<double>(now - pt.last_release_time(), 0);
+  if (elapsed <= absl::ToDoubleSeconds(kRefaultInterval) * clock_.freq()) {
+    subrelease_stats_.total_pages_refaulted += previously_unbacked;
+  }
+}
+
 template <class TrackerType>
 inline Length HugePageFiller<TrackerType>::FreePagesInPartialAllocs() const {
   return regular_alloc_partial_released_[AccessDensityPrediction::kSparse]
@@ -2483,6 +2981,16 @@ inline Length HugePageFiller<TrackerType>::ReleasePages(
     // great candidate for partial release.
     n_candidates = SelectCandidates(absl::MakeSpan(candidates), n_candidates,
                                     donated_alloc_, 0);
+    // Hugepages holding short-lived spans are likely to become free as a
+    // whole soon, so we only break them up as a last resort.
+    if (n_candidates == 0) {
+      for (const AccessDensityPrediction type :
+           {AccessDensityPrediction::kSparse, AccessDensityPrediction::kDense}) {
+        n_candidates =
+            SelectCandidates(absl::MakeSpan(candidates), n_candidates,
+                             short_lived_alloc_[type], kChunks);
+      }
+    }
 
     Length released =
         ReleaseCandidates(absl::MakeSpan(candidates.data(), n_candidates),
@@ -2506,6 +3014,7 @@ inline void HugePageFiller<TrackerType>::AddSpanStats(
   for (const AccessDensityPrediction type :
        {AccessDensityPrediction::kDense, AccessDensityPrediction::kSparse}) {
     regular_alloc_[type].Iter(loop, kChunks);
+    short_lived_alloc_[type].Iter(loop, kChunks);
     regular_alloc_partial_released_[type].Iter(loop, 0);
     regular_alloc_released_[type].Iter(loop, 0);
   }
@@ -2529,13 +3038,17 @@ inline HugePageFillerStats HugePageFiller<TrackerType>::GetStats() const {
         ListFor(/*longest=*/Length(0), chunk, AccessDensityPrediction::kSparse,
                 /*nallocs=*/0);
     stats.n_full[AccessDensityPrediction::kSparse] += NHugePages(
-        regular_alloc_[AccessDensityPrediction::kSparse][sparselist].length());
+        regular_alloc_[AccessDensityPrediction::kSparse][sparselist].length() +
+        short_lived_alloc_[AccessDensityPrediction::kSparse][sparselist]
+            .length());
 
     size_t denselist = ListFor(
         /*longest=*/Length(0), chunk, AccessDensityPrediction::kDense,
         kPagesPerHugePage.raw_num());
     stats.n_full[AccessDensityPrediction::kDense] += NHugePages(
-        regular_alloc_[AccessDensityPrediction::kDense][denselist].length());
+        regular_alloc_[AccessDensityPrediction::kDense][denselist].length() +
+        short_lived_alloc_[AccessDensityPrediction::kDense][denselist]
+            .length());
   }
   stats.n_full[AccessDensityPrediction::kPredictionCounts] =
       stats.n_full[AccessDensityPrediction::kSparse] +
@@ -2550,8 +3063,9 @@ inline HugePageFillerStats HugePageFiller<TrackerType>::GetStats() const {
         regular_alloc_partial_released_[count].size();
     stats.n_released[count] =
         stats.n_fully_released[count] + stats.n_partial_released[count];
-    stats.n_total[count] +=
-        stats.n_released[count] + regular_alloc_[count].size();
+    stats.n_total[count] += stats.n_released[count] +
+                            regular_alloc_[count].size() +
+                            short_lived_alloc_[count].size();
     stats.n_partial[count] =
         stats.n_total[count] - stats.n_released[count] - stats.n_full[count];
   }
@@ -2584,7 +3098,8 @@ class HugePageUnbackedTrackerTreatment final : public HugePageTreatment {
       MemoryModifyFunction& collapse, HugePageFiller<TrackerType>& page_filler,
       EnableCollapse enable_collapse,
       SubreleaseUnbackedMode subrelease_unbacked_mode,
-      EnableUnfilteredCollapse enable_unfiltered_collapse)
+      EnableUnfilteredCollapse enable_unfiltered_collapse,
+      std::optional<double> collapse_budget_cycles = std::nullopt)
       : clock_(clock),
         pageflags_(pageflags),
         residency_(residency),
@@ -2592,7 +3107,8 @@ class HugePageUnbackedTrackerTreatment final : public HugePageTreatment {
         page_filler_(page_filler),
         enable_collapse_(enable_collapse),
         subrelease_unbacked_mode_(subrelease_unbacked_mode),
-        enable_unfiltered_collapse_(enable_unfiltered_collapse) {}
+        enable_unfiltered_collapse_(enable_unfiltered_collapse),
+        collapse_budget_cycles_(collapse_budget_cycles) {}
   ~HugePageUnbackedTrackerTreatment() override = default;
 
   static void operator delete(void*) { __builtin_trap(); }
@@ -2605,12 +3121,17 @@ class HugePageUnbackedTrackerTreatment final : public HugePageTreatment {
   //      were previously successfully collapsed.
   //   b. The trackers that were never scanned before.
   //   c. The trackers that were last scanned more than kRecordInterval ago.
+  //   Trackers that were subreleased and have since been refilled, so that
+  //   they are dense but broken into small pages, are instead collected as
+  //   recollapse candidates once they were last scanned kRecollapseInterval
+  //   ago.
   // 2. Release the pageheap lock and obtain the residency and pageflags
   //    information for the collected trackers. Attempt to apply treatments to
   //    the pages that aren't hugepage backed. In case of userspace collapse,
   //    it attempts to collapse pages that are composed of the number of
   //    unbacked and swapped pages less than kMaxUnbackedPagesForCollapse and
-  //    kMaxSwappedPagesForCollapse respectively.
+  //    kMaxSwappedPagesForCollapse respectively.  Recollapse candidates are
+  //    collapsed first, the most densely accessed (fewest stale pages) first.
   // 3. Acquire the pageheap lock and restore the recorded state using Restore
   //    (e.g. update the residency information in the trackers).
   static bool CompareForHugePageTreatment(PageTracker* a, PageTracker* b) {
@@ -2658,16 +3179,31 @@ class HugePageUnbackedTrackerTreatment final : public HugePageTreatment {
     PageTracker::HugePageResidencyState state = pt.GetHugePageResidencyState();
     if (state.maybe_hugepage_backed) return;
 
-    if (!state.entry_valid) {
-      PushCandidate(pt);
+    const double elapsed =
+        state.entry_valid
+            ? std::max<double>(clock_.now() - state.record_time, 0)
+            : std::numeric_limits<double>::infinity();
+    if (enable_collapse_ == EnableCollapse::kEnabled &&
+        num_recollapse_candidates_ < kTotalRecollapseTrackersToScan &&
+        IsRecollapseCandidate(pt) &&
+        elapsed > absl::ToDoubleSeconds(kRecollapseInterval) * clock_.freq()) {
+      recollapse_candidates_[num_recollapse_candidates_].tracker = &pt;
+      ++num_recollapse_candidates_;
+      pt.SetDontFreeTracker(HugePageTreatmentType::kCollapse);
       return;
     }
-    double elapsed = std::max<double>(clock_.now() - state.record_time, 0);
     if (elapsed > absl::ToDoubleSeconds(kRecordInterval) * clock_.freq()) {
       PushCandidate(pt);
     }
   }
 
+  // Returns true if pt was subreleased but has been refilled since, so that
+  // it is densely used while backed by small pages.
+  static bool IsRecollapseCandidate(const PageTracker& pt) {
+    return !pt.unbroken() && pt.released_pages() == Length(0) &&
+           pt.used_pages() >= kMinUsedPagesForRecollapse;
+  }
+
   int num_valid_trackers() const override { return num_valid_trackers_; }
 
   bool tracker_list_full() const {
@@ -2692,13 +3228,12 @@ class HugePageUnbackedTrackerTreatment final : public HugePageTreatment {
     if (enable_collapse_ == EnableCollapse::kEnabled) {
       treatment_stats_.collapse_eligible += num_valid_trackers_;
     }
+    Recollapse(*pf, *res);
     // Outside of the pageheap lock, obtain the residency and pageflags
     // information for the collected addresses. Try to collapse the pages that
     // aren't hugepage backed, and for which, the number of unbacked and swapped
     // pages are less than kMaxUnbackedPagesForCollapse and
     // kMaxSwappedPagesForCollapse respectively.
-    const double max_collapse_cycles =
-        absl::ToDoubleSeconds(kMaxCollapseLatencyThreshold) * clock_.freq();
     const size_t pages_per_huge_page = kHugePageSize / GetPageSize();
     for (int i = 0; i < num_valid_trackers_; ++i) {
       PageTracker::HugePageResidencyState state;
@@ -2726,8 +3261,7 @@ class HugePageUnbackedTrackerTreatment final : public HugePageTreatment {
         state.stale = Scale<kPagesPerHugePage.raw_num()>(
             single_page_bitmaps.stale, pages_per_huge_page, ReductionOp::kAny);
 
-        const bool backoff =
-            treatment_stats_.collapse_time_max_cycles > max_collapse_cycles;
+        const bool backoff = ShouldBackoff();
         if (enable_collapse_ == EnableCollapse::kEnabled && !backoff) {
           bool should_collapse =
               enable_unfiltered_collapse_ ==
@@ -2750,43 +3284,16 @@ class HugePageUnbackedTrackerTreatment final : public HugePageTreatment {
   }
 
   void Restore() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override {
+    for (int i = 0; i < num_recollapse_candidates_; ++i) {
+      RestoreTracker(recollapse_candidates_[i].tracker,
+                     recollapse_candidates_[i].tracker_state,
+                     /*recollapse=*/true);
+    }
     TC_ASSERT_LE(num_valid_trackers_, kTotalTrackersToScan);
     for (int i = 0; i < num_valid_trackers_; ++i) {
-      PageTracker* tracker = residency_states_[i].tracker;
-      TC_ASSERT_NE(tracker, nullptr);
-      tracker->ClearDontFreeTracker(HugePageTreatmentType::kCollapse);
-      if (tracker->fully_freed()) {
-        continue;
-      }
-      tracker->SetHugePageResidencyState(residency_states_[i].tracker_state);
-      if (residency_states_[i].tracker_state.maybe_hugepage_backed) {
-        if (subrelease_unbacked_mode_ == SubreleaseUnbackedMode::kEnabled) {
-          page_filler_.OnCollapseSuccess(tracker);
-        }
-        continue;
-      }
-
-      // It's possible that all the pages on the hugepage were freed when we had
-      // released the pageheap lock. Check that the longest free range is less
-      // than kPagesPerHugePage to make sure it's valid to release from that
-      // tracker.
-      if (!residency_states_[i].tracker_state.swapped.IsZero()) {
-        // TODO: b/425749361 - Clear swapped bit for pages that were freed.
-        Length released_length = page_filler_.HandleReleaseFree(tracker);
-        if (released_length > Length(0)) {
-          treatment_stats_.treated_pages_subreleased +=
-              released_length.raw_num();
-        }
-      }
-
-      if (subrelease_unbacked_mode_ == SubreleaseUnbackedMode::kEnabled) {
-        Length released_length = page_filler_.HandleUnbackedHugePage(
-            tracker, residency_states_[i].tracker_state.unbacked);
-        if (released_length > Length(0)) {
-          treatment_stats_.treated_pages_unbacked_subreleased +=
-              released_length.raw_num();
-        }
-      }
+      RestoreTracker(residency_states_[i].tracker,
+                     residency_states_[i].tracker_state,
+                     /*recollapse=*/false);
     }
   }
 
@@ -2806,6 +3313,123 @@ class HugePageUnbackedTrackerTreatment final : public HugePageTreatment {
   }
 
  private:
+  void RestoreTracker(PageTracker* tracker,
+                      PageTracker::HugePageResidencyState& state,
+                      bool recollapse)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    TC_ASSERT_NE(tracker, nullptr);
+    tracker->ClearDontFreeTracker(HugePageTreatmentType::kCollapse);
+    if (tracker->fully_freed()) {
+      return;
+    }
+    // A recollapse candidate may have been subreleased again while we did not
+    // hold the lock.
+    if (recollapse && tracker->released_pages() > Length(0)) {
+      state.maybe_hugepage_backed = false;
+    }
+    tracker->SetHugePageResidencyState(state);
+    if (state.maybe_hugepage_backed) {
+      if (recollapse ||
+          subrelease_unbacked_mode_ == SubreleaseUnbackedMode::kEnabled) {
+        page_filler_.OnCollapseSuccess(tracker);
+      }
+      return;
+    }
+
+    // It's possible that all the pages on the hugepage were freed when we had
+    // released the pageheap lock. Check that the longest free range is less
+    // than kPagesPerHugePage to make sure it's valid to release from that
+    // tracker.
+    if (!state.swapped.IsZero()) {
+      // TODO: b/425749361 - Clear swapped bit for pages that were freed.
+      Length released_length = page_filler_.HandleReleaseFree(tracker);
+      if (released_length > Length(0)) {
+        treatment_stats_.treated_pages_subreleased += released_length.raw_num();
+      }
+    }
+
+    if (subrelease_unbacked_mode_ == SubreleaseUnbackedMode::kEnabled) {
+      Length released_length =
+          page_filler_.HandleUnbackedHugePage(tracker, state.unbacked);
+      if (released_length > Length(0)) {
+        treatment_stats_.treated_pages_unbacked_subreleased +=
+            released_length.raw_num();
+      }
+    }
+  }
+
+  // With a budget, stop collapsing once it is spent.  Otherwise, stop after
+  // any collapse takes too long.
+  bool ShouldBackoff() const {
+    if (collapse_budget_cycles_.has_value()) {
+      return treatment_stats_.collapse_time_total_cycles >=
+             *collapse_budget_cycles_;
+    }
+    return treatment_stats_.collapse_time_max_cycles >
+           absl::ToDoubleSeconds(kMaxCollapseLatencyThreshold) * clock_.freq();
+  }
+
+  // Collapses the recollapse candidates that are not hugepage backed, the most
+  // densely accessed first, and records their residency.
+  void Recollapse(PageFlagsBase& pf, Residency& res) {
+    if (num_recollapse_candidates_ == 0) return;
+    treatment_stats_.collapse_eligible += num_recollapse_candidates_;
+    treatment_stats_.recollapse_eligible += num_recollapse_candidates_;
+
+    const size_t pages_per_huge_page = kHugePageSize / GetPageSize();
+    for (int i = 0; i < num_recollapse_candidates_; ++i) {
+      RecollapseCandidate& candidate = recollapse_candidates_[i];
+      PageTracker::HugePageResidencyState& state = candidate.tracker_state;
+      const void* addr = candidate.tracker->location().start_addr();
+      state.entry_valid = true;
+      state.record_time = clock_.now();
+      // Assume element is hugepage if we can't read the value.
+      state.maybe_hugepage_backed = pf.IsHugepageBacked(addr).value_or(true);
+      if (state.maybe_hugepage_backed) {
+        candidate.stale_pages = std::numeric_limits<size_t>::max();
+        continue;
+      }
+      auto single_page_bitmaps = pf.GetSinglePageBitmaps(addr);
+      candidate.stale_pages = single_page_bitmaps.stale.CountBits();
+      state.stale = Scale<kPagesPerHugePage.raw_num()>(
+          single_page_bitmaps.stale, pages_per_huge_page, ReductionOp::kAny);
+    }
+    std::sort(recollapse_candidates_.begin(),
+              recollapse_candidates_.begin() + num_recollapse_candidates_,
+              [](const RecollapseCandidate& a, const RecollapseCandidate& b) {
+                return a.stale_pages < b.stale_pages;
+              });
+
+    for (int i = 0; i < num_recollapse_candidates_; ++i) {
+      RecollapseCandidate& candidate = recollapse_candidates_[i];
+      PageTracker::HugePageResidencyState& state = candidate.tracker_state;
+      if (state.maybe_hugepage_backed) continue;
+      if (ShouldBackoff()) {
+        state.collapse_skipped = true;
+        state.collapse_skipped_due_to_backoff = true;
+        continue;
+      }
+      auto bitmaps = res.GetUnbackedAndSwappedBitmaps(
+          candidate.tracker->location().start_addr());
+      state.unbacked = Scale<kPagesPerHugePage.raw_num()>(
+          bitmaps.unbacked, pages_per_huge_page, ReductionOp::kAll);
+      state.swapped = Scale<kPagesPerHugePage.raw_num()>(
+          bitmaps.swapped, pages_per_huge_page, ReductionOp::kAny);
+      if (enable_unfiltered_collapse_ != EnableUnfilteredCollapse::kEnabled &&
+          (bitmaps.swapped.CountBits() >= kMaxSwappedPagesForCollapse ||
+           bitmaps.unbacked.CountBits() >= kMaxUnbackedPagesForCollapse)) {
+        state.collapse_skipped = true;
+        continue;
+      }
+      const double before = treatment_stats_.collapse_time_total_cycles;
+      state.maybe_hugepage_backed = TryUserspaceCollapse(candidate.tracker);
+      ++treatment_stats_.recollapse_attempted;
+      if (state.maybe_hugepage_backed) ++treatment_stats_.recollapse_succeeded;
+      treatment_stats_.recollapse_time_total_cycles +=
+          treatment_stats_.collapse_time_total_cycles - before;
+    }
+  }
+
   bool TryUserspaceCollapse(PageTracker* tracker) {
     double before = clock_.now();
     MemoryModifyStatus ret = tracker->Collapse(collapse_);
@@ -2828,6 +3452,10 @@ class HugePageUnbackedTrackerTreatment final : public HugePageTreatment {
   static constexpr absl::Duration kRecordInterval = absl::Minutes(5);
   static constexpr size_t kMaxSwappedPagesForCollapse = 128;
   static constexpr size_t kMaxUnbackedPagesForCollapse = 64;
+  static constexpr size_t kTotalRecollapseTrackersToScan = 16;
+  static constexpr absl::Duration kRecollapseInterval = absl::Seconds(30);
+  static constexpr Length kMinUsedPagesForRecollapse =
+      Length(kPagesPerHugePage.raw_num() * 7 / 8);
 
   Clock clock_;
   PageFlagsBase* pageflags_;
@@ -2843,12 +3471,308 @@ class HugePageUnbackedTrackerTreatment final : public HugePageTreatment {
     PageTracker::HugePageResidencyState tracker_state;
   };
   std::array<ResidencyState, kTotalTrackersToScan> residency_states_;
+
+  struct RecollapseCandidate {
+    PageTracker* tracker;
+    // Pages pageflags found stale; the fewer, the more densely accessed.
+    size_t stale_pages;
+    PageTracker::HugePageResidencyState tracker_state;
+  };
+  std::array<RecollapseCandidate, kTotalRecollapseTrackersToScan>
+      recollapse_candidates_;
+  int num_recollapse_candidates_ = 0;
   HugePageTreatmentStats treatment_stats_;
   HugePageFiller<TrackerType>& page_filler_;
   EnableCollapse enable_collapse_;
   SubreleaseUnbackedMode subrelease_unbacked_mode_;
 
   EnableUnfilteredCollapse enable_unfiltered_collapse_;
+  // Cycles this treatment may spend collapsing, if limited by a budget.
+  std::optional<double> collapse_budget_cycles_;
+};
+
+class HugePageTieringTreatment final : public HugePageTreatment {
+ public:
+  explicit HugePageTieringTreatment(Clock clock, PageFlagsBase* pageflags,
+                                    MemoryTierFunction& set_memory_tier,
+                                    TieringMode mode)
+      : clock_(clock),
+        pageflags_(pageflags),
+        set_memory_tier_(set_memory_tier),
+        mode_(mode) {}
+  ~HugePageTieringTreatment() override = default;
+
+  static void operator delete(void*) { __builtin_trap(); }
+
+  // Moving hugepages between the memory tiers involves three steps:
+  // 1. Collect up to kTotalTrackersToScan trackers using
+  //    SelectEligibleTrackers. Eligible trackers are the ones never checked,
+  //    or last checked more than kRecordInterval ago, that mode_ may move: with
+  //    TieringMode::kDemoteStale, hugepages on the near tier must not hold
+  //    dense spans, as those are accessed too often to be worth moving.
+  // 2. Release the pageheap lock, read the stale bits of the collected
+  //    hugepages and move the ones whose temperature no longer matches their
+  //    tier. Hugepages are demoted once they are entirely stale, and promoted
+  //    once less than half of them is.
+  // 3. Acquire the pageheap lock and record the new tier of the moved trackers
+  //    using Restore.
+  void SelectEligibleTrackers(PageTracker& pt) override {
+    if (num_valid_trackers_ >= kTotalTrackersToScan) return;
+
+    const PageTracker::TierState state = pt.GetTierState();
+    switch (mode_) {
+      case TieringMode::kDemoteStale:
+        if (!state.far && pt.HasDenseSpans()) return;
+        break;
+      case TieringMode::kDemoteAll:
+        if (state.far) return;
+        break;
+      case TieringMode::kPromoteAll:
+        if (!state.far) return;
+        break;
+    }
+    const double now = clock_.now();
+    const double elapsed = std::max<double>(now - state.record_time, 0);
+    if (state.entry_valid &&
+        elapsed <= absl::ToDoubleSeconds(kRecordInterval) * clock_.freq()) {
+      return;
+    }
+
+    selected_trackers_[num_valid_trackers_] = {&pt, state.far, false};
+    ++num_valid_trackers_;
+    pt.SetTierState(
+        {.far = state.far, .entry_valid = true, .record_time = now});
+    pt.SetDontFreeTracker(HugePageTreatmentType::kTiering);
+  }
+
+  int num_valid_trackers() const override { return num_valid_trackers_; }
+
+  void Treat() ABSL_LOCKS_EXCLUDED(pageheap_lock) override {
+    TC_ASSERT_LE(num_valid_trackers_, kTotalTrackersToScan);
+    PageFlagsBase* pf = pageflags_;
+    std::optional<PageFlags> pageflags_obj;
+    if (pf == nullptr && mode_ == TieringMode::kDemoteStale) {
+      pf = &pageflags_obj.emplace();
+    }
+
+    for (int i = 0; i < num_valid_trackers_; ++i) {
+      SelectedTracker& selected = selected_trackers_[i];
+      const HugePage location = selected.tracker->location();
+      if (mode_ == TieringMode::kDemoteStale) {
+        // Leave the hugepage alone if we can't read its stale bits.
+        std::optional<PageStats> stats =
+            pf->Get(location.start_addr(), kHugePageSize);
+        if (!stats.has_value()) continue;
+        const bool move = selected.far
+                              ? stats->bytes_stale < kHugePageSize / 2
+                              : stats->bytes_stale >= kHugePageSize;
+        if (!move) continue;
+      }
+
+      if (!set_memory_tier_(HugeRange(location, NHugePages(1)), !selected.far)
+               .success) {
+        ++stats_.failed;
+        continue;
+      }
+      selected.moved = true;
+      if (selected.far) {
+        ++stats_.promoted;
+      } else {
+        ++stats_.demoted;
+      }
+    }
+  }
+
+  void Restore() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override {
+    TC_ASSERT_LE(num_valid_trackers_, kTotalTrackersToScan);
+    for (int i = 0; i < num_valid_trackers_; ++i) {
+      const SelectedTracker& selected = selected_trackers_[i];
+      PageTracker* tracker = selected.tracker;
+      TC_ASSERT_NE(tracker, nullptr);
+      tracker->ClearDontFreeTracker(HugePageTreatmentType::kTiering);
+      // The tier is recorded even if all the pages of the hugepage were freed
+      // in the meantime, as it describes where its memory now lives.
+      if (selected.moved) {
+        PageTracker::TierState state = tracker->GetTierState();
+        state.far = !selected.far;
+        tracker->SetTierState(state);
+      }
+    }
+  }
+
+  HugePageTieringStats GetStats() const { return stats_; }
+
+ private:
+  static constexpr size_t kTotalTrackersToScan = 64;
+  static constexpr absl::Duration kRecordInterval = absl::Minutes(1);
+
+  Clock clock_;
+  PageFlagsBase* pageflags_;
+  MemoryTierFunction& set_memory_tier_;
+  TieringMode mode_;
+
+  struct SelectedTracker {
+    PageTracker* tracker;
+    // Whether the hugepage was on the far tier when it was selected.
+    bool far;
+    // Whether Treat moved it to the other tier.
+    bool moved;
+  };
+  std::array<SelectedTracker, kTotalTrackersToScan> selected_trackers_;
+  int num_valid_trackers_ = 0;
+  HugePageTieringStats stats_;
+};
+
+class HugePagePageOutTreatment final : public HugePageTreatment {
+ public:
+  explicit HugePagePageOutTreatment(Clock clock, PageFlagsBase* pageflags,
+                                    Residency* residency,
+                                    PageOutFunction& page_out,
+                                    absl::Duration min_idle, bool reclaim)
+      : clock_(clock),
+        pageflags_(pageflags),
+        residency_(residency),
+        page_out_(page_out),
+        min_idle_(min_idle),
+        reclaim_(reclaim) {}
+  ~HugePagePageOutTreatment() override = default;
+
+  static void operator delete(void*) { __builtin_trap(); }
+
+  // Paging out stale hugepages involves three steps:
+  // 1. Collect up to kTotalTrackersToScan trackers using
+  //    SelectEligibleTrackers. Eligible trackers are the ones never checked,
+  //    or last checked more than kRecordInterval ago.
+  // 2. Release the pageheap lock. Hugepages already advised whose resident
+  //    bytes grew were accessed again: the growth is counted as refaulted, and
+  //    they start over. The others are advised once their stale bits were all
+  //    set for at least min_idle_, or again with MADV_PAGEOUT if they were
+  //    only advised with MADV_COLD and reclaim_ is now set.
+  // 3. Acquire the pageheap lock and record the new state of the trackers
+  //    using Restore.
+  void SelectEligibleTrackers(PageTracker& pt) override {
+    if (num_valid_trackers_ >= kTotalTrackersToScan) return;
+
+    const PageTracker::PageOutState state = pt.GetPageOutState();
+    const double now = clock_.now();
+    const double elapsed = std::max<double>(now - state.record_time, 0);
+    if (state.entry_valid &&
+        elapsed <= absl::ToDoubleSeconds(kRecordInterval) * clock_.freq()) {
+      return;
+    }
+
+    selected_trackers_[num_valid_trackers_] = {&pt, state};
+    ++num_valid_trackers_;
+    pt.SetDontFreeTracker(HugePageTreatmentType::kPageOut);
+  }
+
+  int num_valid_trackers() const override { return num_valid_trackers_; }
+
+  void Treat() ABSL_LOCKS_EXCLUDED(pageheap_lock) override {
+    TC_ASSERT_LE(num_valid_trackers_, kTotalTrackersToScan);
+    PageFlagsBase* pf = pageflags_;
+    std::optional<PageFlags> pageflags_obj;
+    if (pf == nullptr) {
+      pf = &pageflags_obj.emplace();
+    }
+    Residency* res = residency_;
+    std::optional<ResidencyPageMap> residency_obj;
+    if (res == nullptr) {
+      res = &residency_obj.emplace();
+    }
+    auto resident_bytes = [&](HugePage p) -> size_t {
+      std::optional<Residency::Info> info =
+          res->Get(p.start_addr(), kHugePageSize);
+      return info.has_value() ? info->bytes_resident : 0;
+    };
+
+    const double now = clock_.now();
+    const double min_idle = absl::ToDoubleSeconds(min_idle_) * clock_.freq();
+    const PageTracker::PageOutState::Advice advice =
+        reclaim_ ? PageTracker::PageOutState::kPageOut
+                 : PageTracker::PageOutState::kCold;
+    for (int i = 0; i < num_valid_trackers_; ++i) {
+      PageTracker::PageOutState& state = selected_trackers_[i].state;
+      const HugePage location = selected_trackers_[i].tracker->location();
+      state.entry_valid = true;
+      state.record_time = now;
+
+      // Paged out memory has no stale bits to read, so advised hugepages are
+      // only known to be accessed again once they become resident.
+      if (state.advice != PageTracker::PageOutState::kNone) {
+        const size_t resident = resident_bytes(location);
+        if (resident > state.resident_bytes) {
+          stats_.refaulted_bytes += resident - state.resident_bytes;
+          state = {.entry_valid = true, .record_time = now};
+          continue;
+        }
+        state.resident_bytes = resident;
+        if (state.advice >= advice) continue;
+      }
+
+      // Leave the hugepage alone if we can't read its stale bits.
+      std::optional<PageStats> stats =
+          pf->Get(location.start_addr(), kHugePageSize);
+      if (!stats.has_value()) continue;
+      if (stats->bytes_stale < kHugePageSize) {
+        state.stale = false;
+        continue;
+      }
+      if (!state.stale) {
+        state.stale = true;
+        state.stale_since = now;
+      }
+      if (now - state.stale_since < min_idle) continue;
+
+      const size_t resident_before = resident_bytes(location);
+      if (!page_out_(Range(location.first_page(), kPagesPerHugePage), reclaim_)
+               .success) {
+        ++stats_.failed;
+        continue;
+      }
+      state.advice = advice;
+      state.resident_bytes = resident_bytes(location);
+      if (reclaim_) {
+        ++stats_.paged_out;
+        stats_.paged_out_bytes +=
+            resident_before - std::min(resident_before, state.resident_bytes);
+      } else {
+        ++stats_.advised_cold;
+      }
+    }
+  }
+
+  void Restore() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override {
+    TC_ASSERT_LE(num_valid_trackers_, kTotalTrackersToScan);
+    for (int i = 0; i < num_valid_trackers_; ++i) {
+      PageTracker* tracker = selected_trackers_[i].tracker;
+      TC_ASSERT_NE(tracker, nullptr);
+      tracker->ClearDontFreeTracker(HugePageTreatmentType::kPageOut);
+      tracker->SetPageOutState(selected_trackers_[i].state);
+    }
+  }
+
+  HugePagePageOutStats GetStats() const { return stats_; }
+
+ private:
+  static constexpr size_t kTotalTrackersToScan = 64;
+  static constexpr absl::Duration kRecordInterval = absl::Seconds(30);
+
+  Clock clock_;
+  PageFlagsBase* pageflags_;
+  Residency* residency_;
+  PageOutFunction& page_out_;
+  absl::Duration min_idle_;
+  bool reclaim_;
+
+  struct SelectedTracker {
+    PageTracker* tracker;
+    // The state of the tracker, updated by Treat.
+    PageTracker::PageOutState state;
+  };
+  std::array<SelectedTracker, kTotalTrackersToScan> selected_trackers_;
+  int num_valid_trackers_ = 0;
+  HugePagePageOutStats stats_;
 };
 
 // Returns true if backoff delay has reached the maximum threshold.
@@ -2877,13 +3801,42 @@ void HugePageFiller<TrackerType>::UpdateMaxBackoffDelay(
   }
 }
 
+template <class TrackerType>
+void HugePageFiller<TrackerType>::RefillCollapseBudget(absl::Duration budget) {
+  const double now = clock_.now();
+  const double max_cycles = absl::ToDoubleSeconds(budget) * clock_.freq();
+  if (!collapse_budget_started_) {
+    collapse_budget_started_ = true;
+    collapse_budget_cycles_ = max_cycles;
+  } else {
+    const double elapsed =
+        std::max<double>(now - collapse_budget_refill_time_, 0) / clock_.freq();
+    collapse_budget_cycles_ =
+        std::min(collapse_budget_cycles_ + elapsed * max_cycles, max_cycles);
+  }
+  collapse_budget_refill_time_ = now;
+}
+
 template <class TrackerType>
 inline void HugePageFiller<TrackerType>::TreatHugepageTrackers(
     EnableCollapse enable_collapse,
     EnableUnfilteredCollapse enable_unfiltered_collapse,
-    PageFlagsBase* pageflags, Residency* residency) {
-  if (enable_collapse == EnableCollapse::kEnabled &&
-      ShouldBackoffFromCollapse()) {
+    PageFlagsBase* pageflags, Residency* residency,
+    absl::Duration collapse_budget) {
+  const bool use_budget = collapse_budget > absl::ZeroDuration();
+  std::optional<double> collapse_budget_cycles;
+  if (enable_collapse == EnableCollapse::kEnabled && use_budget) {
+    RefillCollapseBudget(collapse_budget);
+    // A collapse may overrun the budget, which is paid back before collapsing
+    // again.
+    if (collapse_budget_cycles_ <= 0) {
+      enable_collapse = EnableCollapse::kDisabled;
+      ++treatment_stats_.collapse_intervals_skipped;
+    } else {
+      collapse_budget_cycles = collapse_budget_cycles_;
+    }
+  } else if (enable_collapse == EnableCollapse::kEnabled &&
+             ShouldBackoffFromCollapse()) {
     enable_collapse = EnableCollapse::kDisabled;
     ++treatment_stats_.collapse_intervals_skipped;
   }
@@ -2894,7 +3847,8 @@ inline void HugePageFiller<TrackerType>::TreatHugepageTrackers(
                                                     set_anon_vma_name_);
   HugePageUnbackedTrackerTreatment<TrackerType> unbacked_tracker_treatment(
       clock_, pageflags, residency, collapse_, *this, enable_collapse,
-      subrelease_unbacked_mode_, enable_unfiltered_collapse);
+      subrelease_unbacked_mode_, enable_unfiltered_collapse,
+      collapse_budget_cycles);
 
   // Collect up to kTotalTrackersToScan trackers from our lists.
   regular_alloc_partial_released_[AccessDensityPrediction::kSparse].Iter(
@@ -2924,6 +3878,13 @@ inline void HugePageFiller<TrackerType>::TreatHugepageTrackers(
       },
       /*start=*/0);
 
+  short_lived_alloc_[AccessDensityPrediction::kDense].Iter(
+      [&](TrackerType& pt) GOOGLE_MALLOC_SECTION {
+        sampled_tracker_treatment.SelectEligibleTrackers(pt);
+        unbacked_tracker_treatment.SelectEligibleTrackers(pt);
+      },
+      /*start=*/0);
+
   regular_alloc_[AccessDensityPrediction::kSparse].Iter(
       [&](TrackerType& pt) GOOGLE_MALLOC_SECTION {
         sampled_tracker_treatment.SelectEligibleTrackers(pt);
@@ -2931,6 +3892,13 @@ inline void HugePageFiller<TrackerType>::TreatHugepageTrackers(
       },
       /*start=*/0);
 
+  short_lived_alloc_[AccessDensityPrediction::kSparse].Iter(
+      [&](TrackerType& pt) GOOGLE_MALLOC_SECTION {
+        sampled_tracker_treatment.SelectEligibleTrackers(pt);
+        unbacked_tracker_treatment.SelectEligibleTrackers(pt);
+      },
+      /*start=*/0);
+
   regular_alloc_released_[AccessDensityPrediction::kSparse].Iter(
       [&](TrackerType& pt) GOOGLE_MALLOC_SECTION {
         sampled_tracker_treatment.SelectEligibleTrackers(pt);
@@ -2957,7 +3925,9 @@ inline void HugePageFiller<TrackerType>::TreatHugepageTrackers(
 
   // Lock the pageheap lock and update residency information in the tracker.
   pageheap_lock.lock();
-  if (stats.collapse_attempted > 0) {
+  if (use_budget) {
+    collapse_budget_cycles_ -= stats.collapse_time_total_cycles;
+  } else if (stats.collapse_attempted > 0) {
     absl::Duration max_collapse_latency = absl::Milliseconds(
         stats.collapse_time_max_cycles * 1000 / clock_.freq());
     UpdateMaxBackoffDelay(max_collapse_latency);
@@ -2974,13 +3944,68 @@ inline void HugePageFiller<TrackerType>::TreatHugepageTrackers(
   }
 }
 
+template <class TrackerType>
+inline HugePageTieringStats HugePageFiller<TrackerType>::TierHugepageTrackers(
+    MemoryTierFunction& set_memory_tier, TieringMode mode,
+    PageFlagsBase* pageflags) {
+  HugePageTieringTreatment treatment(clock_, pageflags, set_memory_tier, mode);
+  auto select = [&](TrackerType& pt) GOOGLE_MALLOC_SECTION {
+    treatment.SelectEligibleTrackers(pt);
+  };
+  donated_alloc_.Iter(select, /*start=*/0);
+  for (const AccessDensityPrediction type :
+       {AccessDensityPrediction::kSparse, AccessDensityPrediction::kDense}) {
+    regular_alloc_[type].Iter(select, /*start=*/0);
+    short_lived_alloc_[type].Iter(select, /*start=*/0);
+    regular_alloc_partial_released_[type].Iter(select, /*start=*/0);
+    regular_alloc_released_[type].Iter(select, /*start=*/0);
+  }
+  if (treatment.num_valid_trackers() == 0) return {};
+
+  pageheap_lock.unlock();
+  treatment.Treat();
+  pageheap_lock.lock();
+  treatment.Restore();
+  return treatment.GetStats();
+}
+
+template <class TrackerType>
+inline HugePagePageOutStats
+HugePageFiller<TrackerType>::PageOutHugepageTrackers(
+    PageOutFunction& page_out, absl::Duration min_idle, bool reclaim,
+    PageFlagsBase* pageflags, Residency* residency) {
+  HugePagePageOutTreatment treatment(clock_, pageflags, residency, page_out,
+                                     min_idle, reclaim);
+  auto select = [&](TrackerType& pt) GOOGLE_MALLOC_SECTION {
+    treatment.SelectEligibleTrackers(pt);
+  };
+  donated_alloc_.Iter(select, /*start=*/0);
+  for (const AccessDensityPrediction type :
+       {AccessDensityPrediction::kSparse, AccessDensityPrediction::kDense}) {
+    regular_alloc_[type].Iter(select, /*start=*/0);
+    short_lived_alloc_[type].Iter(select, /*start=*/0);
+    regular_alloc_partial_released_[type].Iter(select, /*start=*/0);
+    regular_alloc_released_[type].Iter(select, /*start=*/0);
+  }
+  if (treatment.num_valid_trackers() == 0) return {};
+
+  pageheap_lock.unlock();
+  treatment.Treat();
+  pageheap_lock.lock();
+  treatment.Restore();
+  return treatment.GetStats();
+}
+
 template <class TrackerType>
 inline Length HugePageFiller<TrackerType>::HandleReleaseFree(
     PageTracker* tracker) {
   RemoveFromFillerList(tracker);
-  Length released_length = tracker->ReleaseFree(unback_);
+  Length not_resident;
+  Length released_length = tracker->ReleaseFree(
+      unback_, RecentlyUnbacked(*tracker, clock_.now()), &not_resident);
   subrelease_stats_.total_pages_subreleased += released_length;
-  unmapped_ += released_length;
+  subrelease_stats_.total_pages_found_unbacked += not_resident;
+  unmapped_ += released_length + not_resident;
   unmapping_unaccounted_ += released_length;
   AddToFillerList(tracker);
   return released_length;
@@ -3074,6 +4099,18 @@ inline void HugePageFiller<TrackerType>::Print(Printer& out, bool everything,
                    .in_pages()));
   out.printf("HugePageFiller: %.4f of used pages hugepageable\n",
              hugepage_frac());
+  if (numa_stats_.local + numa_stats_.remote > 0) {
+    out.printf(
+        "HugePageFiller: %zu allocations from hugepages on the local NUMA "
+        "node, %zu from remote ones\n",
+        numa_stats_.local, numa_stats_.remote);
+  }
+  if (short_lived_hugepages() > NHugePages(0)) {
+    out.printf(
+        "HugePageFiller: %zu hugepages set aside for short-lived spans, "
+        "%zu pages free on them\n",
+        short_lived_hugepages().raw_num(), short_lived_free_pages().raw_num());
+  }
 
   // Subrelease
   out.printf(
@@ -3083,6 +4120,19 @@ inline void HugePageFiller<TrackerType>::Print(Printer& out, bool everything,
       subrelease_stats_.total_hugepages_broken.raw_num(),
       subrelease_stats_.total_pages_subreleased_due_to_limit.raw_num(),
       subrelease_stats_.total_hugepages_broken_due_to_limit.raw_num());
+  if (subrelease_stats_.total_pages_refaulted > Length(0)) {
+    out.printf(
+        "HugePageFiller: Since startup, %zu subreleased pages were allocated "
+        "again within %llds\n",
+        subrelease_stats_.total_pages_refaulted.raw_num(),
+        absl::ToInt64Seconds(kRefaultInterval));
+  }
+  if (subrelease_stats_.total_pages_found_unbacked > Length(0)) {
+    out.printf(
+        "HugePageFiller: Since startup, %zu free pages were found unbacked "
+        "and marked released without unbacking them\n",
+        subrelease_stats_.total_pages_found_unbacked.raw_num());
+  }
 
   if (!everything) return;
 
@@ -3119,6 +4169,16 @@ inline void HugePageFiller<TrackerType>::Print(Printer& out, bool everything,
       "subreleased %zu pages.\n",
       treatment_stats_.treated_pages_subreleased);
 
+  if (treatment_stats_.recollapse_eligible > 0) {
+    out.printf(
+        "HugePageFiller: Out of %zu refilled subreleased hugepages, %zu were "
+        "attempted, and %zu were collapsed again, %.1f hugepages per collapse "
+        "second.\n",
+        treatment_stats_.recollapse_eligible,
+        treatment_stats_.recollapse_attempted,
+        treatment_stats_.recollapse_succeeded, RecollapseRate());
+  }
+
   out.printf("\n");
   out.printf("HugePageFiller: fullness histograms\n");
 
@@ -3135,6 +4195,11 @@ inline void HugePageFiller<TrackerType>::Print(Printer& out, bool everything,
           usage.Record(pt, pageflags, now, frequency, records, num_selected);
         },
         0);
+    short_lived_alloc_[AccessDensityPrediction::kSparse].Iter(
+        [&](const TrackerType& pt) {
+          usage.Record(pt, pageflags, now, frequency, records, num_selected);
+        },
+        0);
     usage.Print(records, UsageInfo::kSparseRegular, out);
     num_selected = 0;
   }
@@ -3147,6 +4212,11 @@ inline void HugePageFiller<TrackerType>::Print(Printer& out, bool everything,
           usage.Record(pt, pageflags, now, frequency, records, num_selected);
         },
         0);
+    short_lived_alloc_[AccessDensityPrediction::kDense].Iter(
+        [&](const TrackerType& pt) {
+          usage.Record(pt, pageflags, now, frequency, records, num_selected);
+        },
+        0);
     usage.Print(records, UsageInfo::kDenseRegular, out);
   }
 
@@ -3292,6 +4362,16 @@ inline void HugePageFiller<TrackerType>::PrintInPbtxt(
               pages_allocated_[AccessDensityPrediction::kDense].in_bytes())));
   hpaa.PrintI64("filler_previously_released_huge_pages",
                 previously_released_huge_pages().raw_num());
+  if (numa_stats_.local + numa_stats_.remote > 0) {
+    hpaa.PrintI64("filler_numa_local_allocations", numa_stats_.local);
+    hpaa.PrintI64("filler_numa_remote_allocations", numa_stats_.remote);
+  }
+  if (short_lived_hugepages() > NHugePages(0)) {
+    hpaa.PrintI64("filler_short_lived_hugepages",
+                  short_lived_hugepages().raw_num());
+    hpaa.PrintI64("filler_short_lived_free_pages",
+                  short_lived_free_pages().raw_num());
+  }
   hpaa.PrintI64("filler_num_pages_subreleased",
                 subrelease_stats_.total_pages_subreleased.raw_num());
   hpaa.PrintI64("filler_num_hugepages_broken",
@@ -3302,6 +4382,10 @@ inline void HugePageFiller<TrackerType>::PrintInPbtxt(
   hpaa.PrintI64(
       "filler_num_hugepages_broken_due_to_limit",
       subrelease_stats_.total_hugepages_broken_due_to_limit.raw_num());
+  hpaa.PrintI64("filler_num_pages_refaulted",
+                subrelease_stats_.total_pages_refaulted.raw_num());
+  hpaa.PrintI64("filler_num_pages_found_unbacked",
+                subrelease_stats_.total_pages_found_unbacked.raw_num());
   // Compute some histograms of fullness.
   using huge_page_filler_internal::UsageInfo;
   UsageInfo usage;
@@ -3315,6 +4399,11 @@ inline void HugePageFiller<TrackerType>::PrintInPbtxt(
           usage.Record(pt, pageflags, now, frequency, records, num_selected);
         },
         0);
+    short_lived_alloc_[AccessDensityPrediction::kSparse].Iter(
+        [&](const TrackerType& pt) {
+          usage.Record(pt, pageflags, now, frequency, records, num_selected);
+        },
+        0);
     usage.Print(records, UsageInfo::kSparseRegular, hpaa);
   }
 
@@ -3326,6 +4415,11 @@ inline void HugePageFiller<TrackerType>::PrintInPbtxt(
           usage.Record(pt, pageflags, now, frequency, records, num_selected);
         },
         0);
+    short_lived_alloc_[AccessDensityPrediction::kDense].Iter(
+        [&](const TrackerType& pt) {
+          usage.Record(pt, pageflags, now, frequency, records, num_selected);
+        },
+        0);
     usage.Print(records, UsageInfo::kDenseRegular, hpaa);
   }
 
@@ -3422,6 +4516,18 @@ inline void HugePageFiller<TrackerType>::PrintInPbtxt(
     huge_page_treatment_region.PrintI64(
         "treated_pages_unbacked_subreleased",
         treatment_stats_.treated_pages_unbacked_subreleased);
+
+    huge_page_treatment_region.PrintI64("recollapse_eligible",
+                                        treatment_stats_.recollapse_eligible);
+    huge_page_treatment_region.PrintI64("recollapse_attempted",
+                                        treatment_stats_.recollapse_attempted);
+    huge_page_treatment_region.PrintI64("recollapse_succeeded",
+                                        treatment_stats_.recollapse_succeeded);
+    huge_page_treatment_region.PrintI64(
+        "recollapse_total_time_ms",
+        treatment_stats_.recollapse_time_total_cycles * 1000 / clock_.freq());
+    huge_page_treatment_region.PrintDouble("recollapse_hugepages_per_second",
+                                           RecollapseRate());
   }
   PrintLifetimeHistoInPbtxt(hpaa,
                             lifetime_histo_[AccessDensityPrediction::kDense],
@@ -3523,7 +4629,11 @@ inline void HugePageFiller<TrackerType>::RemoveFromFillerList(TrackerType* pt) {
   if (!pt->released() &&
       (pt->unbroken() ||
        subrelease_unbacked_mode_ == SubreleaseUnbackedMode::kDisabled)) {
-    regular_alloc_[type].Remove(pt, i);
+    if (pt->short_lived()) {
+      short_lived_alloc_[type].Remove(pt, i);
+    } else {
+      regular_alloc_[type].Remove(pt, i);
+    }
   } else if (pt->free_pages() <= pt->released_pages()) {
     regular_alloc_released_[type].Remove(pt, i);
     TC_ASSERT_GE(n_used_released_[type], pt->used_pages());
@@ -3573,7 +4683,11 @@ inline void HugePageFiller<TrackerType>::AddToFillerList(TrackerType* pt) {
   if (!pt->released() &&
       (pt->unbroken() ||
        subrelease_unbacked_mode_ == SubreleaseUnbackedMode::kDisabled)) {
-    regular_alloc_[type].Add(pt, i);
+    if (pt->short_lived()) {
+      short_lived_alloc_[type].Add(pt, i);
+    } else {
+      regular_alloc_[type].Add(pt, i);
+    }
   } else if (pt->free_pages() <= pt->released_pages()) {
     regular_alloc_released_[type].Add(pt, i);
     n_used_released_[type] += pt->used_pages();
@@ -3621,6 +4735,8 @@ void HugePageFiller<TrackerType>::ForEachHugePage(const F& func) {
   donated_alloc_.Iter(func, 0);
   regular_alloc_[AccessDensityPrediction::kSparse].Iter(func, 0);
   regular_alloc_[AccessDensityPrediction::kDense].Iter(func, 0);
+  short_lived_alloc_[AccessDensityPrediction::kSparse].Iter(func, 0);
+  short_lived_alloc_[AccessDensityPrediction::kDense].Iter(func, 0);
   regular_alloc_partial_released_[AccessDensityPrediction::kSparse].Iter(func,
                                                                          0);
   regular_alloc_partial_released_[AccessDensityPrediction::kDense].Iter(func,
@@ -0,0 +1,356 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replays a span trace recorded by SpanTraceRecorder against a
+// HugePageAwareAllocator backed by a fake address space, in simulated time,
+// to see how the filler, the regions and the cache would have fared under
+// other parameters.
+//
+// Usage: huge_page_filler_simulator --trace=trace
+//            [--skip_subrelease_short_interval=60s]
+//            [--skip_subrelease_long_interval=300s]
+//            [--release_rate=...] [--tag=4] ...
+//
+// Once per simulated second the simulator releases memory at
+// --release_rate, as the background thread would, and samples the page heap.
+// It reports hugepage coverage (the fraction of allocated pages on hugepages
+// that were never subreleased), fragmentation (backed but unallocated
+// memory), and how often and how much memory was released.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_page_aware_allocator.h"
+#include "tcmalloc/internal/clock.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/mock_huge_page_static_forwarder.h"
+#include "tcmalloc/page_allocator_interface.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+#include "tcmalloc/span_trace.h"
+#include "tcmalloc/stats.h"
+
+ABSL_FLAG(std::string, trace, "", "Span trace to replay.");
+ABSL_FLAG(int, tag,
+          static_cast<int>(tcmalloc::tcmalloc_internal::MemoryTag::kNormal),
+          "Memory tag whose spans to replay. Spans of other tags are skipped.");
+ABSL_FLAG(absl::Duration, skip_subrelease_short_interval, absl::Seconds(60),
+          "Short interval of demand-based subrelease skipping.");
+ABSL_FLAG(absl::Duration, skip_subrelease_long_interval, absl::Seconds(300),
+          "Long interval of demand-based subrelease skipping.");
+ABSL_FLAG(int64_t, release_rate, 0,
+          "Bytes to release per simulated second, as the background thread "
+          "would. 0 releases nothing.");
+ABSL_FLAG(bool, release_partial_alloc_pages, false,
+          "Whether to release free pages from partially allocated hugepages.");
+ABSL_FLAG(bool, hpaa_subrelease, true,
+          "Whether the filler may break up hugepages to release memory.");
+ABSL_FLAG(bool, use_huge_region_more_often, false,
+          "Whether to place allocations in huge regions more often.");
+ABSL_FLAG(bool, huge_cache_demand_forecast, false,
+          "Whether the huge cache sizes itself ahead of forecast demand.");
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+using huge_page_allocator_internal::FakeStaticForwarder;
+using huge_page_allocator_internal::HugePageAwareAllocator;
+using huge_page_allocator_internal::HugePageAwareAllocatorOptions;
+using huge_page_allocator_internal::SpanTraceEvent;
+
+// Simulated time, in the ticks of the trace.
+int64_t sim_now = 0;
+double sim_frequency = 1;
+
+int64_t SimNow() { return sim_now; }
+double SimFrequency() { return sim_frequency; }
+
+// Counts the calls made to release memory.
+class SimulatorForwarder : public FakeStaticForwarder {
+ public:
+  [[nodiscard]] MemoryModifyStatus ReleasePages(Range r) {
+    ++release_calls_;
+    released_pages_ += r.n;
+    return FakeStaticForwarder::ReleasePages(r);
+  }
+
+  [[nodiscard]] size_t ReleasePagesBatch(absl::Span<const Range> ranges) {
+    size_t n = 0;
+    while (n < ranges.size() && ReleasePages(ranges[n]).success) ++n;
+    return n;
+  }
+
+  [[nodiscard]] MemoryModifyStatus ReleasePagesReusedSoon(Range r) {
+    MemoryModifyStatus ret = ReleasePages(r);
+    ret.lazily_freed = ret.success;
+    return ret;
+  }
+
+  size_t release_calls() const { return release_calls_; }
+  Length released_pages() const { return released_pages_; }
+
+ private:
+  size_t release_calls_ = 0;
+  Length released_pages_;
+};
+
+using Allocator = HugePageAwareAllocator<SimulatorForwarder>;
+
+struct LiveSpan {
+  Span* span;
+  SpanAllocInfo info;
+};
+
+// Running averages and peaks of the samples taken each simulated second.
+struct Summary {
+  size_t samples = 0;
+  double coverage_sum = 0;
+  double fragmentation_sum = 0;
+  size_t peak_backed_bytes = 0;
+  size_t peak_free_bytes = 0;
+
+  void Add(Allocator& allocator) {
+    PageHeapSpinLockHolder l;
+    const BackingStats stats = allocator.stats();
+    const Length used = allocator.filler().used_pages();
+    const Length subreleased =
+        allocator.filler().used_pages_in_any_subreleased();
+    const size_t backed = stats.system_bytes - stats.unmapped_bytes;
+    ++samples;
+    coverage_sum +=
+        used == Length(0) ? 1.0 : 1.0 - subreleased.raw_num() /
+                                            static_cast<double>(used.raw_num());
+    fragmentation_sum +=
+        backed == 0 ? 0.0 : stats.free_bytes / static_cast<double>(backed);
+    peak_backed_bytes = std::max(peak_backed_bytes, backed);
+    peak_free_bytes = std::max(peak_free_bytes, stats.free_bytes);
+  }
+};
+
+void Delete(Allocator& allocator, const LiveSpan& live) {
+#ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
+  PageHeapSpinLockHolder l;
+  allocator.Delete(live.span, live.info);
+#else
+  PageAllocatorInterface::AllocationState a{
+      Range(live.span->first_page(), live.span->num_pages()),
+      live.span->donated(),
+  };
+  allocator.forwarder().DeleteSpan(live.span);
+  PageHeapSpinLockHolder l;
+  allocator.Delete(a, live.info);
+#endif  // TCMALLOC_INTERNAL_LEGACY_LOCKING
+}
+
+// Grows a span as the page allocator would on realloc: in place or by moving
+// it if the allocator can, otherwise by allocating a new span and freeing the
+// old one.
+void Grow(Allocator& allocator, LiveSpan& live, Length n, bool move) {
+  if (!move) {
+    const PageAllocatorInterface::AllocationState a{
+        Range(live.span->first_page(), live.span->num_pages()),
+        live.span->donated(),
+    };
+    if (allocator.TryExtend(a, n)) {
+      live.span->set_num_pages(n);
+      return;
+    }
+  } else if (allocator.TryMove(live.span, n)) {
+    return;
+  }
+  Span* grown = allocator.New(n, live.info);
+  TC_CHECK_NE(grown, nullptr);
+  Delete(allocator, live);
+  live.span = grown;
+}
+
+// Shrinks a span as the page allocator would on realloc: in place if the
+// allocator can, otherwise by allocating a new span and freeing the old one.
+void Shrink(Allocator& allocator, LiveSpan& live, Length n) {
+  if (allocator.TryShrink(live.span, n)) return;
+  Span* shrunk = allocator.New(n, live.info);
+  TC_CHECK_NE(shrunk, nullptr);
+  Delete(allocator, live);
+  live.span = shrunk;
+}
+
+int Simulate(const SpanTrace& trace) {
+  sim_frequency = trace.clock_frequency;
+  if (!trace.events.empty()) sim_now = trace.events.front().time;
+
+  HugePageAwareAllocatorOptions options;
+  options.tag = static_cast<MemoryTag>(absl::GetFlag(FLAGS_tag));
+  options.use_huge_region_more_often =
+      absl::GetFlag(FLAGS_use_huge_region_more_often)
+          ? HugeRegionUsageOption::kUseForAllLargeAllocs
+          : HugeRegionUsageOption::kDefault;
+  options.huge_cache_demand_forecast =
+      absl::GetFlag(FLAGS_huge_cache_demand_forecast);
+  options.clock = Clock{.now = SimNow, .freq = SimFrequency};
+  Allocator allocator(options);
+  SimulatorForwarder& forwarder = allocator.forwarder();
+  forwarder.set_filler_skip_subrelease_short_interval(
+      absl::GetFlag(FLAGS_skip_subrelease_short_interval));
+  forwarder.set_filler_skip_subrelease_long_interval(
+      absl::GetFlag(FLAGS_skip_subrelease_long_interval));
+  forwarder.set_release_partial_alloc_pages(
+      absl::GetFlag(FLAGS_release_partial_alloc_pages));
+  forwarder.set_hpaa_subrelease(absl::GetFlag(FLAGS_hpaa_subrelease));
+  const Length release_per_second =
+      BytesToLengthCeil(std::max<int64_t>(absl::GetFlag(FLAGS_release_rate), 0));
+
+  absl::flat_hash_map<uint64_t, LiveSpan> live;
+  Summary summary;
+  size_t replayed = 0, skipped = 0;
+  const int64_t tick = std::max<int64_t>(sim_frequency, 1);
+  int64_t next_second = sim_now + tick;
+
+  for (const SpanTraceEvent& e : trace.events) {
+    // Catch up with the background work due before this event.
+    while (e.time >= next_second) {
+      sim_now = next_second;
+      if (release_per_second > Length(0)) {
+        PageHeapSpinLockHolder l;
+        allocator.ReleaseAtLeastNPages(
+            release_per_second, PageReleaseReason::kProcessBackgroundActions);
+      }
+      summary.Add(allocator);
+      next_second += tick;
+    }
+    sim_now = std::max(sim_now, e.time);
+
+    if (e.tag != options.tag) {
+      ++skipped;
+      continue;
+    }
+    const SpanAllocInfo info = {
+        .objects_per_span = std::max<size_t>(e.objects_per_span, 1),
+        .density = static_cast<AccessDensityPrediction>(e.density),
+        .lifetime = static_cast<LifetimePrediction>(e.lifetime),
+    };
+    switch (e.op) {
+      case SpanTraceEvent::kNew: {
+        Span* s = e.align > 1 ? allocator.NewAligned(Length(e.pages),
+                                                     Length(e.align), info)
+                              : allocator.New(Length(e.pages), info);
+        TC_CHECK_NE(s, nullptr);
+        live[e.first_page] = {s, info};
+        break;
+      }
+      case SpanTraceEvent::kDelete: {
+        auto it = live.find(e.first_page);
+        // Allocated before recording started.
+        if (it == live.end()) {
+          ++skipped;
+          continue;
+        }
+        Delete(allocator, {it->second.span, info});
+        live.erase(it);
+        break;
+      }
+      case SpanTraceEvent::kExtend:
+      case SpanTraceEvent::kMove: {
+        auto it = live.find(e.first_page);
+        if (it == live.end()) {
+          ++skipped;
+          continue;
+        }
+        LiveSpan span = it->second;
+        Grow(allocator, span, Length(e.pages), e.op == SpanTraceEvent::kMove);
+        if (e.op == SpanTraceEvent::kMove) {
+          live.erase(it);
+          live[e.moved_to] = span;
+        } else {
+          it->second = span;
+        }
+        break;
+      }
+      case SpanTraceEvent::kShrink: {
+        auto it = live.find(e.first_page);
+        if (it == live.end()) {
+          ++skipped;
+          continue;
+        }
+        Shrink(allocator, it->second, Length(e.pages));
+        break;
+      }
+    }
+    ++replayed;
+  }
+  summary.Add(allocator);
+
+  BackingStats stats;
+  PageReleaseStats release_stats;
+  {
+    PageHeapSpinLockHolder l;
+    stats = allocator.stats();
+    release_stats = allocator.GetReleaseStats();
+  }
+  const double duration =
+      trace.events.empty()
+          ? 0
+          : (trace.events.back().time - trace.events.front().time) /
+                sim_frequency;
+  printf("replayed %zu span events over %.1f simulated seconds (%zu skipped)\n",
+         replayed, duration, skipped);
+  printf("hugepage coverage: %.2f%% average\n",
+         100.0 * summary.coverage_sum / summary.samples);
+  printf("fragmentation: %.2f%% average; %zu bytes free at peak\n",
+         100.0 * summary.fragmentation_sum / summary.samples,
+         summary.peak_free_bytes);
+  printf("backed memory: %zu bytes at peak, %zu bytes at end\n",
+         summary.peak_backed_bytes, stats.system_bytes - stats.unmapped_bytes);
+  printf("releases: %zu calls, %zu bytes\n", forwarder.release_calls(),
+         forwarder.released_pages().in_bytes());
+  printf("released by reason: background %zu bytes, soft limit %zu bytes, "
+         "hard limit %zu bytes, on request %zu bytes\n",
+         release_stats.process_background_actions.in_bytes(),
+         release_stats.soft_limit_exceeded.in_bytes(),
+         release_stats.hard_limit_exceeded.in_bytes(),
+         release_stats.release_memory_to_system.in_bytes());
+  return 0;
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  const std::string path = absl::GetFlag(FLAGS_trace);
+  if (path.empty()) {
+    fprintf(stderr, "usage: %s --trace=trace [flags]\n", argv[0]);
+    return 1;
+  }
+  absl::StatusOr<tcmalloc::tcmalloc_internal::SpanTrace> trace =
+      tcmalloc::tcmalloc_internal::SpanTrace::ReadFromFile(path);
+  if (!trace.ok()) {
+    fprintf(stderr, "%s\n", trace.status().ToString().c_str());
+    return 1;
+  }
+  return tcmalloc::tcmalloc_internal::Simulate(*trace);
+}
@@ -22,6 +22,7 @@
 #include <atomic>
 #include <cerrno>
 #include <cstdint>
+#include <limits>
 #include <optional>
 #include <random>
 #include <string>
@@ -48,6 +49,7 @@
 #include "absl/synchronization/blocking_counter.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/huge_cache.h"
 #include "tcmalloc/huge_page_subrelease.h"
@@ -60,6 +62,7 @@
 #include "tcmalloc/internal/range_tracker.h"
 #include "tcmalloc/internal/residency.h"
 #include "tcmalloc/internal/system_allocator.h"
+#include "tcmalloc/lifetime_predictor.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/span.h"
 #include "tcmalloc/stats.h"
@@ -554,6 +557,100 @@ TEST_F(PageTrackerTest, ReleasingRetainFailure) {
   EXPECT_EQ(tracker_.free_pages(), a1.n + a2.n + a3.n + a4.n);
 }
 
+TEST_F(PageTrackerTest, ReleasingBatches) {
+  // Releases all but the range at index <fail> of each batch.
+  class BatchUnback final : public MemoryModifyFunction {
+   public:
+    MemoryModifyStatus operator()(Range) override {
+      return {.success = true, .error_number = 0};
+    }
+
+    size_t ApplyAll(absl::Span<const Range> ranges) override {
+      batch_sizes.push_back(ranges.size());
+      return std::min(ranges.size(), fail);
+    }
+
+    std::vector<size_t> batch_sizes;
+    size_t fail = std::numeric_limits<size_t>::max();
+  };
+
+  static const Length kAllocSize = kPagesPerHugePage / 8;
+  SpanAllocInfo info = {1, AccessDensityPrediction::kSparse};
+  PAlloc a[8] = {Get(kAllocSize, info), Get(kAllocSize, info),
+                 Get(kAllocSize, info), Get(kAllocSize, info),
+                 Get(kAllocSize, info), Get(kAllocSize, info),
+                 Get(kAllocSize, info), Get(kAllocSize, info)};
+  // [free] [alloced] [free] [alloced] [free] [alloced] ...
+  Put(a[0]);
+  Put(a[2]);
+  Put(a[4]);
+
+  // The free ranges are handed out together.  The failed one is skipped,
+  // the rest go in another batch.
+  BatchUnback unback;
+  unback.fail = 1;
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(tracker_.ReleaseFree(unback), 2 * kAllocSize);
+  }
+  EXPECT_THAT(unback.batch_sizes, testing::ElementsAre(3, 1));
+  EXPECT_EQ(tracker_.released_pages(), 2 * kAllocSize);
+
+  unback.batch_sizes.clear();
+  unback.fail = std::numeric_limits<size_t>::max();
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(tracker_.ReleaseFree(unback), kAllocSize);
+  }
+  EXPECT_THAT(unback.batch_sizes, testing::ElementsAre(1));
+  EXPECT_EQ(tracker_.released_pages(), 3 * kAllocSize);
+
+  for (int i : {1, 3, 5, 6, 7}) {
+    Put(a[i]);
+  }
+}
+
+TEST_F(PageTrackerTest, ReleaseSkipsUnbackedRanges) {
+  class CountingUnback final : public MemoryModifyFunction {
+   public:
+    MemoryModifyStatus operator()(Range r) override {
+      released.push_back(r.p);
+      return {.success = true, .error_number = 0};
+    }
+
+    std::vector<PageId> released;
+  };
+
+  static const Length kAllocSize = kPagesPerHugePage / 4;
+  SpanAllocInfo info = {1, AccessDensityPrediction::kSparse};
+  PAlloc a[4] = {Get(kAllocSize, info), Get(kAllocSize, info),
+                 Get(kAllocSize, info), Get(kAllocSize, info)};
+  // [free] [alloced] [free] [alloced]
+  Put(a[0]);
+  Put(a[2]);
+
+  // a[0] was never faulted in, a[2] is half resident.
+  PageBitmap unbacked;
+  unbacked.SetRange(0, kAllocSize.raw_num());
+  unbacked.SetRange((2 * kAllocSize).raw_num(), (kAllocSize / 2).raw_num());
+
+  CountingUnback unback;
+  Length not_resident;
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(tracker_.ReleaseFree(unback, unbacked, &not_resident),
+              kAllocSize / 2);
+  }
+  EXPECT_EQ(not_resident, kAllocSize + kAllocSize / 2);
+  // Only the range that may be resident is unbacked, but both are released.
+  EXPECT_THAT(unback.released, testing::ElementsAre(a[2].p));
+  EXPECT_EQ(tracker_.released_pages(), 2 * kAllocSize);
+
+  for (int i : {1, 3}) {
+    Put(a[i]);
+  }
+}
+
 TEST_F(PageTrackerTest, Defrag) {
   absl::BitGen rng;
   const Length N = absl::GetFlag(FLAGS_page_tracker_defrag_lim);
@@ -789,6 +886,34 @@ TEST_F(PageTrackerTest, b151915873) {
                                   &small.normal_length[kMaxPages.raw_num()]));
 }
 
+TEST_F(PageTrackerTest, BestFit) {
+  // Small spans go in the smallest hole that fits them, leaving long holes for
+  // the multi-page spans that need them.
+  std::vector<PAlloc> allocs;
+  allocs.reserve(kPagesPerHugePage.raw_num());
+  SpanAllocInfo info = {1, AccessDensityPrediction::kSparse};
+  for (int i = 0; i < kPagesPerHugePage.raw_num(); i++) {
+    allocs.push_back(Get(Length(1), info));
+  }
+  std::sort(allocs.begin(), allocs.end(),
+            [](const PAlloc& a, const PAlloc& b) { return a.p < b.p; });
+
+  const Length long_hole = kPagesPerHugePage / 4;
+  Put(allocs[1]);
+  for (Length i = Length(0); i < long_hole; ++i) {
+    Put(allocs[3 + i.raw_num()]);
+  }
+  ASSERT_EQ(tracker_.longest_free_range(), long_hole);
+
+  PAlloc a = Get(Length(1), info);
+  EXPECT_EQ(a.p, allocs[1].p);
+  EXPECT_EQ(tracker_.longest_free_range(), long_hole);
+
+  PAlloc b = Get(long_hole, {1, AccessDensityPrediction::kDense});
+  EXPECT_EQ(b.p, allocs[3].p);
+  EXPECT_EQ(tracker_.longest_free_range(), Length(0));
+}
+
 class FakeClock {
  public:
   FakeClock() = default;
@@ -1113,14 +1238,15 @@ class FillerTest : public testing::Test {
   void TreatHugepageTrackers(
       EnableCollapse enable_collapse,
       EnableUnfilteredCollapse enable_unfiltered_collapse,
-      PageFlagsBase* pageflags, Residency* residency) {
+      PageFlagsBase* pageflags, Residency* residency,
+      absl::Duration collapse_budget = absl::ZeroDuration()) {
     // Note that scoped pageheap lock isn't used here. This is because the
     // pageheap lock is manually unlocked before the collapse operation, and the
     // scoped lock doesn't recognize the manual unlock. In tests, collapse
     // allocates, so we use manual lock and unlock here.
     pageheap_lock.lock();
     filler_.TreatHugepageTrackers(enable_collapse, enable_unfiltered_collapse,
-                                  pageflags, residency);
+                                  pageflags, residency, collapse_budget);
     pageheap_lock.unlock();
   }
 
@@ -1174,7 +1300,8 @@ class FillerTest : public testing::Test {
     ret.span_alloc_info = span_alloc_info;
     if (!donated) {  // Donated means always create a new hugepage
       PageHeapSpinLockHolder l;
-      auto [pt, page, from_released] = filler_.TryGet(n, span_alloc_info);
+      auto [pt, page, from_released, known_zero] =
+          filler_.TryGet(n, span_alloc_info);
       ret.pt = pt;
       ret.p = page;
       ret.from_released = from_released;
@@ -1248,6 +1375,349 @@ TEST_F(FillerTest, Density) {
   }
 }
 
+TEST_F(FillerTest, TryExtend) {
+  const SpanAllocInfo info = {.objects_per_span = 1,
+                              .density = AccessDensityPrediction::kSparse};
+  const Length n = kPagesPerHugePage / 4;
+  PAlloc a = AllocateWithSpanAllocInfo(n, info);
+  PAlloc b = AllocateWithSpanAllocInfo(n, info);
+  PAlloc c = AllocateWithSpanAllocInfo(n, info);
+  ASSERT_EQ(a.pt, b.pt);
+  ASSERT_EQ(a.pt, c.pt);
+  ASSERT_EQ(b.p, a.p + n);
+  ASSERT_EQ(c.p, b.p + n);
+  Delete(b);
+
+  // a can grow into b's pages, but not past them into c.
+  bool from_released;
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_FALSE(filler_.TryExtend(a.pt, Range(a.p, a.n), n + Length(1),
+                                   &from_released));
+    ASSERT_TRUE(filler_.TryExtend(a.pt, Range(a.p, a.n), n, &from_released));
+  }
+  EXPECT_FALSE(from_released);
+  a.n += n;
+  total_allocated_ += n;
+  Mark(a);
+  CheckStats();
+  EXPECT_EQ(a.pt->nallocs(), 2);
+  EXPECT_EQ(filler_.pages_allocated(), 3 * n);
+
+  Delete(a);
+  Delete(c);
+}
+
+TEST_F(FillerTest, Shrink) {
+  const SpanAllocInfo info = {.objects_per_span = 1,
+                              .density = AccessDensityPrediction::kSparse};
+  const Length n = kPagesPerHugePage / 4;
+  PAlloc a = AllocateWithSpanAllocInfo(2 * n, info);
+  PAlloc b = AllocateWithSpanAllocInfo(n, info);
+  ASSERT_EQ(a.pt, b.pt);
+  ASSERT_EQ(b.p, a.p + 2 * n);
+
+  // a gives back the pages past its first n, which c can then reuse.
+  {
+    PageHeapSpinLockHolder l;
+    filler_.Shrink(a.pt, Range(a.p, a.n), n);
+  }
+  a.n = n;
+  total_allocated_ -= n;
+  CheckStats();
+  EXPECT_EQ(a.pt->nallocs(), 2);
+  EXPECT_EQ(filler_.pages_allocated(), 2 * n);
+
+  PAlloc c = AllocateWithSpanAllocInfo(n, info);
+  EXPECT_EQ(c.pt, a.pt);
+  EXPECT_EQ(c.p, a.p + n);
+
+  Delete(a);
+  Delete(b);
+  Delete(c);
+}
+
+TEST_F(FillerTest, PrefersTrackersOnNumaNode) {
+  const SpanAllocInfo info = {.objects_per_span = 1,
+                              .density = AccessDensityPrediction::kSparse};
+  constexpr size_t kNodes = 4;
+  const Length kAllocLen = Length(1);
+
+  // Contribute one equally used hugepage per node, so that they all are
+  // equally good candidates.
+  std::vector<PAlloc> allocs;
+  for (size_t node = 0; node < kNodes; ++node) {
+    PAlloc a;
+    a.pt = new PageTracker(GetBacking(), /*was_donated=*/false, clock_);
+    a.pt->set_numa_node(node);
+    a.n = kAllocLen;
+    a.mark = ++next_mark_;
+    a.span_alloc_info = info;
+    a.from_released = false;
+    {
+      PageHeapSpinLockHolder l;
+      a.p = a.pt->Get(a.n, info).page;
+    }
+    filler_.Contribute(a.pt, /*donated=*/false, info);
+    ++hp_contained_;
+    total_allocated_ += a.n;
+    Mark(a);
+    allocs.push_back(a);
+  }
+  CheckStats();
+
+  auto try_get = [&](int numa_node) {
+    PAlloc a;
+    {
+      PageHeapSpinLockHolder l;
+      auto [pt, page, from_released, known_zero] =
+          filler_.TryGet(kAllocLen, info, numa_node);
+      a.pt = pt;
+      a.p = page;
+      a.from_released = from_released;
+    }
+    EXPECT_NE(a.pt, nullptr);
+    a.n = kAllocLen;
+    a.mark = ++next_mark_;
+    a.span_alloc_info = info;
+    total_allocated_ += a.n;
+    Mark(a);
+    return a;
+  };
+
+  allocs.push_back(try_get(/*numa_node=*/2));
+  EXPECT_EQ(allocs.back().pt->numa_node(), 2);
+  EXPECT_EQ(filler_.numa_stats().local, 1);
+  EXPECT_EQ(filler_.numa_stats().remote, 0);
+
+  // Without a tracker on the requested node, any equally good one is used.
+  allocs.push_back(try_get(/*numa_node=*/kNodes));
+  EXPECT_EQ(filler_.numa_stats().local, 1);
+  EXPECT_EQ(filler_.numa_stats().remote, 1);
+  CheckStats();
+
+  FakePageFlags pageflags;
+  std::string buffer = PrintToString(1024 * 1024, [&](Printer& printer) {
+    PageHeapSpinLockHolder l;
+    filler_.Print(printer, /*everything=*/false, pageflags);
+  });
+  EXPECT_THAT(buffer, testing::HasSubstr("HugePageFiller: 1 allocations from "
+                                         "hugepages on the local NUMA node, 1 "
+                                         "from remote ones"));
+
+  for (const PAlloc& a : allocs) {
+    Delete(a);
+  }
+}
+
+TEST_F(FillerTest, TiersStaleHugepages) {
+  class StalePageFlags final : public FakePageFlags {
+   public:
+    std::optional<PageStats> Get(const void* addr, size_t size) override {
+      auto it = stale_.find(addr);
+      return PageStats{.bytes_stale = it == stale_.end() ? 0 : it->second};
+    }
+    void SetStale(const PAlloc& a, size_t bytes) {
+      stale_[a.pt->location().start_addr()] = bytes;
+    }
+
+   private:
+    absl::flat_hash_map<const void*, size_t> stale_;
+  };
+  class MockSetMemoryTier final : public MemoryTierFunction {
+   public:
+    [[nodiscard]] MemoryModifyStatus operator()(Range r, bool far) override {
+      EXPECT_EQ(r.n, kPagesPerHugePage);
+      return {.success = success_, .error_number = 0};
+    }
+    void SetSuccess(bool success) { success_ = success; }
+
+   private:
+    bool success_ = true;
+  };
+
+  StalePageFlags pageflags;
+  MockSetMemoryTier set_memory_tier;
+  auto tier = [&](TieringMode mode) {
+    pageheap_lock.lock();
+    HugePageTieringStats stats =
+        filler_.TierHugepageTrackers(set_memory_tier, mode, &pageflags);
+    pageheap_lock.unlock();
+    return stats;
+  };
+
+  const Length n = kPagesPerHugePage / 2;
+  PAlloc sparse =
+      AllocateWithSpanAllocInfo(n, {1, AccessDensityPrediction::kSparse});
+  PAlloc dense = AllocateWithSpanAllocInfo(
+      n, {n.raw_num(), AccessDensityPrediction::kDense});
+  ASSERT_NE(sparse.pt, dense.pt);
+  pageflags.SetStale(sparse, kHugePageSize);
+  pageflags.SetStale(dense, kHugePageSize);
+
+  // Only stale hugepages without dense spans are demoted.
+  HugePageTieringStats stats = tier(TieringMode::kDemoteStale);
+  EXPECT_EQ(stats.demoted, 1);
+  EXPECT_TRUE(sparse.pt->GetTierState().far);
+  EXPECT_FALSE(dense.pt->GetTierState().far);
+
+  // Hugepages are checked again only after a while, and promoted once they
+  // are accessed again.
+  pageflags.SetStale(sparse, 0);
+  EXPECT_EQ(tier(TieringMode::kDemoteStale).promoted, 0);
+  FakeClock::Advance(absl::Minutes(2));
+  stats = tier(TieringMode::kDemoteStale);
+  EXPECT_EQ(stats.promoted, 1);
+  EXPECT_EQ(stats.demoted, 0);
+  EXPECT_FALSE(sparse.pt->GetTierState().far);
+
+  // Failed moves leave the hugepages on their tier.
+  FakeClock::Advance(absl::Minutes(2));
+  set_memory_tier.SetSuccess(false);
+  EXPECT_EQ(tier(TieringMode::kDemoteAll).failed, 2);
+  EXPECT_FALSE(dense.pt->GetTierState().far);
+
+  FakeClock::Advance(absl::Minutes(2));
+  set_memory_tier.SetSuccess(true);
+  EXPECT_EQ(tier(TieringMode::kDemoteAll).demoted, 2);
+  EXPECT_TRUE(sparse.pt->GetTierState().far);
+  EXPECT_TRUE(dense.pt->GetTierState().far);
+
+  FakeClock::Advance(absl::Minutes(2));
+  EXPECT_EQ(tier(TieringMode::kPromoteAll).promoted, 2);
+  EXPECT_FALSE(sparse.pt->GetTierState().far);
+  EXPECT_FALSE(dense.pt->GetTierState().far);
+
+  Delete(sparse);
+  Delete(dense);
+}
+
+TEST_F(FillerTest, PagesOutStaleHugepages) {
+  class StalePageFlags final : public FakePageFlags {
+   public:
+    std::optional<PageStats> Get(const void* addr, size_t size) override {
+      return PageStats{.bytes_stale = stale_ ? kHugePageSize : 0};
+    }
+    void SetStale(bool stale) { stale_ = stale; }
+
+   private:
+    bool stale_ = false;
+  };
+  class ResidentBytes final : public FakeResidency {
+   public:
+    std::optional<Info> Get(const void* addr, size_t size) override {
+      return Info{.bytes_resident = resident_};
+    }
+    void SetResident(size_t bytes) { resident_ = bytes; }
+
+   private:
+    size_t resident_ = kHugePageSize;
+  };
+  class MockPageOut final : public PageOutFunction {
+   public:
+    explicit MockPageOut(ResidentBytes& residency) : residency_(residency) {}
+    [[nodiscard]] MemoryModifyStatus operator()(Range r,
+                                                bool reclaim) override {
+      EXPECT_EQ(r.n, kPagesPerHugePage);
+      if (reclaim) residency_.SetResident(0);
+      return {.success = true, .error_number = 0};
+    }
+
+   private:
+    ResidentBytes& residency_;
+  };
+
+  StalePageFlags pageflags;
+  ResidentBytes residency;
+  MockPageOut page_out(residency);
+  auto page_out_stale = [&](bool reclaim) {
+    FakeClock::Advance(absl::Minutes(1));
+    pageheap_lock.lock();
+    HugePagePageOutStats stats = filler_.PageOutHugepageTrackers(
+        page_out, absl::Minutes(2), reclaim, &pageflags, &residency);
+    pageheap_lock.unlock();
+    return stats;
+  };
+
+  PAlloc a = AllocateWithSpanAllocInfo(Length(1),
+                                       {1, AccessDensityPrediction::kSparse});
+
+  // Hugepages are advised only once they were stale for long enough.
+  EXPECT_EQ(page_out_stale(false).advised_cold, 0);
+  pageflags.SetStale(true);
+  EXPECT_EQ(page_out_stale(false).advised_cold, 0);
+  EXPECT_EQ(page_out_stale(false).advised_cold, 0);
+  EXPECT_EQ(page_out_stale(false).advised_cold, 1);
+  EXPECT_EQ(page_out_stale(false).advised_cold, 0);
+
+  // Under pressure, hugepages advised with MADV_COLD are paged out.
+  HugePagePageOutStats stats = page_out_stale(true);
+  EXPECT_EQ(stats.paged_out, 1);
+  EXPECT_EQ(stats.paged_out_bytes, kHugePageSize);
+  EXPECT_EQ(page_out_stale(true).paged_out, 0);
+
+  // Pages faulted back in are counted as refaulted.
+  residency.SetResident(kHugePageSize / 4);
+  stats = page_out_stale(true);
+  EXPECT_EQ(stats.refaulted_bytes, kHugePageSize / 4);
+  EXPECT_EQ(stats.paged_out, 0);
+  EXPECT_EQ(a.pt->GetPageOutState().advice,
+            PageTracker::PageOutState::kNone);
+
+  Delete(a);
+}
+
+TEST_F(FillerTest, KeepsShortLivedSpansApart) {
+  const SpanAllocInfo long_lived = {
+      .objects_per_span = 1, .density = AccessDensityPrediction::kSparse};
+  const SpanAllocInfo short_lived = {
+      .objects_per_span = 1,
+      .density = AccessDensityPrediction::kSparse,
+      .lifetime = LifetimePrediction::kShortLived};
+
+  PAlloc p1 =
+      AllocateWithSpanAllocInfo(kPagesPerHugePage - Length(1), long_lived);
+  // Without hugepages set aside for them, short-lived spans may fill the gaps
+  // of the other hugepages.
+  PAlloc s1 = AllocateWithSpanAllocInfo(Length(1), short_lived);
+  EXPECT_EQ(s1.pt, p1.pt);
+  EXPECT_EQ(filler_.short_lived_hugepages(), NHugePages(0));
+
+  PAlloc s2 = AllocateWithSpanAllocInfo(Length(1), short_lived);
+  EXPECT_NE(s2.pt, p1.pt);
+  EXPECT_TRUE(s2.pt->short_lived());
+  EXPECT_EQ(filler_.short_lived_hugepages(), NHugePages(1));
+
+  // Short-lived spans go to their hugepages first, even when another hugepage
+  // is a better fit.
+  Delete(s1);
+  PAlloc s3 = AllocateWithSpanAllocInfo(Length(1), short_lived);
+  EXPECT_EQ(s3.pt, s2.pt);
+
+  // Other spans only use them once no other hugepage fits.
+  PAlloc p2 = AllocateWithSpanAllocInfo(Length(1), long_lived);
+  EXPECT_EQ(p2.pt, p1.pt);
+  PAlloc p3 = AllocateWithSpanAllocInfo(Length(2), long_lived);
+  EXPECT_EQ(p3.pt, s2.pt);
+  EXPECT_EQ(filler_.short_lived_free_pages(), kPagesPerHugePage - Length(4));
+
+  FakePageFlags pageflags;
+  std::string buffer = PrintToString(1024 * 1024, [&](Printer& printer) {
+    PageHeapSpinLockHolder l;
+    filler_.Print(printer, /*everything=*/false, pageflags);
+  });
+  EXPECT_THAT(buffer, testing::HasSubstr(absl::StrCat(
+                         "HugePageFiller: 1 hugepages set aside for "
+                         "short-lived spans, ",
+                         (kPagesPerHugePage - Length(4)).raw_num(),
+                         " pages free on them")));
+
+  for (const PAlloc& a : {p1, p2, p3, s2, s3}) {
+    Delete(a);
+  }
+  EXPECT_EQ(filler_.size(), NHugePages(0));
+}
+
 TEST_F(FillerTest, ReleaseFreePagesWhenAnyPageIsSwappedRespectsClock) {
   const Length kAlloc = kPagesPerHugePage;
   std::vector<PAlloc> p1 = AllocateVector(kAlloc - Length(1));
@@ -2124,6 +2594,73 @@ TEST_F(FillerTest, BackoffFromCollapse) {
   }
 }
 
+// Tests that, with a budget, collapse stops once the budget is spent and
+// resumes once it is replenished, regardless of the latency of each collapse.
+TEST_F(FillerTest, CollapseBudget) {
+  const Length kAlloc = kPagesPerHugePage - Length(1);
+  const absl::Duration kBudget = absl::Milliseconds(1);
+  collapse_.SetLatency(absl::Microseconds(600));
+
+  SpanAllocInfo info;
+  info.objects_per_span = 1;
+  info.density = AccessDensityPrediction::kSparse;
+  // Hugepages with increasingly long free ranges, so that they are collapsed
+  // in order.
+  std::vector<std::vector<PAlloc>> allocs;
+  for (Length n : {kAlloc, kAlloc - Length(1), kAlloc - Length(3)}) {
+    allocs.push_back(AllocateVectorWithSpanAllocInfo(n, info));
+  }
+  ASSERT_EQ(filler_.size(), NHugePages(3));
+
+  FakePageFlags pageflags;
+  FakeResidency residency;
+  for (const auto& hugepage : allocs) {
+    for (const auto& pa : hugepage) {
+      pageflags.MarkHugePageBacked(pa.p.start_addr(),
+                                   /*is_hugepage_backed=*/false);
+      residency.SetUnbackedAndSwappedBitmaps(pa.p.start_addr(),
+                                             Bitmap<kMaxResidencyBits>(),
+                                             Bitmap<kMaxResidencyBits>());
+    }
+  }
+  auto collapsed = [&](size_t i) {
+    return collapse_.TimesCollapsed(allocs[i].front().p.start_addr());
+  };
+
+  // The second collapse overruns the budget, so the third hugepage is skipped.
+  TreatHugepageTrackers(EnableCollapse::kEnabled,
+                        EnableUnfilteredCollapse::kDisabled, &pageflags,
+                        &residency, kBudget);
+  EXPECT_EQ(collapsed(0), 1);
+  EXPECT_EQ(collapsed(1), 1);
+  EXPECT_EQ(collapsed(2), 0);
+  HugePageTreatmentStats treatment_stats = GetHugePageTreatmentStats();
+  EXPECT_EQ(treatment_stats.collapse_attempted, 2);
+  EXPECT_EQ(treatment_stats.collapse_intervals_skipped, 0);
+
+  // The overrun is paid back before collapsing again.
+  TreatHugepageTrackers(EnableCollapse::kEnabled,
+                        EnableUnfilteredCollapse::kDisabled, &pageflags,
+                        &residency, kBudget);
+  treatment_stats = GetHugePageTreatmentStats();
+  EXPECT_EQ(treatment_stats.collapse_attempted, 2);
+  EXPECT_EQ(treatment_stats.collapse_intervals_skipped, 1);
+
+  // Wait for the skipped hugepage to be eligible for treatment again.
+  FakeClock::Advance(absl::Minutes(10));
+  TreatHugepageTrackers(EnableCollapse::kEnabled,
+                        EnableUnfilteredCollapse::kDisabled, &pageflags,
+                        &residency, kBudget);
+  EXPECT_EQ(collapsed(2), 1);
+  treatment_stats = GetHugePageTreatmentStats();
+  EXPECT_EQ(treatment_stats.collapse_attempted, 3);
+  EXPECT_EQ(treatment_stats.collapse_succeeded, 3);
+
+  for (const auto& hugepage : allocs) {
+    DeleteVector(hugepage);
+  }
+}
+
 // Don't collapse pages that are released.
 TEST_F(FillerTest, DontCollapseReleasedPages) {
   const Length kAlloc = kPagesPerHugePage / 2;
@@ -2170,6 +2707,51 @@ TEST_F(FillerTest, DontCollapseReleasedPages) {
   DeleteVector(p1);
 }
 
+// Verifies that a hugepage that was subreleased and then refilled is collapsed
+// again, and its tracker is no longer considered broken.
+TEST_F(FillerTest, RecollapseRefilledHugepages) {
+  const Length kAlloc = kPagesPerHugePage / 2;
+  std::vector<PAlloc> p1 = AllocateVector(kAlloc);
+  std::vector<PAlloc> p2 =
+      AllocateVectorWithSpanAllocInfo(kAlloc, p1.front().span_alloc_info);
+  ASSERT_TRUE(!p1.empty());
+  ASSERT_TRUE(!p2.empty());
+
+  DeleteVector(p2);
+  EXPECT_EQ(ReleasePartialPages(kAlloc), kAlloc);
+  p2 = AllocateVectorWithSpanAllocInfo(kAlloc, p1.front().span_alloc_info);
+  ASSERT_EQ(filler_.size(), NHugePages(1));
+  PageTracker* pt = p1.front().pt;
+  ASSERT_EQ(pt->released_pages(), Length(0));
+  ASSERT_FALSE(pt->unbroken());
+
+  FakePageFlags pageflags;
+  FakeResidency residency;
+  for (const auto& pa : p1) {
+    pageflags.MarkHugePageBacked(pa.p.start_addr(),
+                                 /*is_hugepage_backed=*/false);
+    Bitmap<kMaxResidencyBits> unbacked, swapped;
+    residency.SetUnbackedAndSwappedBitmaps(pa.p.start_addr(), unbacked,
+                                           swapped);
+  }
+
+  TreatHugepageTrackers(EnableCollapse::kEnabled,
+                        EnableUnfilteredCollapse::kDisabled, &pageflags,
+                        &residency);
+  for (const auto& pa : p1) {
+    EXPECT_EQ(collapse_.TimesCollapsed(pa.p.start_addr()), 1);
+  }
+  HugePageTreatmentStats treatment_stats = GetHugePageTreatmentStats();
+  EXPECT_EQ(treatment_stats.recollapse_eligible, 1);
+  EXPECT_EQ(treatment_stats.recollapse_attempted, 1);
+  EXPECT_EQ(treatment_stats.recollapse_succeeded, 1);
+  EXPECT_EQ(treatment_stats.collapse_succeeded, 1);
+  EXPECT_TRUE(pt->unbroken());
+
+  DeleteVector(p2);
+  DeleteVector(p1);
+}
+
 TEST_F(FillerTest, CollapseFailure) {
   const Length kAlloc = kPagesPerHugePage / 2;
   std::vector<PAlloc> p1 = AllocateVector(kAlloc - Length(1));
@@ -4672,6 +5254,28 @@ std::vector<FillerTest::PAlloc> FillerTest::GenerateInterestingAllocs() {
   return result;
 }
 
+// Pages allocated again shortly after they were subreleased count as refaulted.
+TEST_F(FillerTest, CountsRefaultedPages) {
+  const SpanAllocInfo info = {1, AccessDensityPrediction::kSparse};
+  const Length half = kPagesPerHugePage / 2;
+  const Length quarter = kPagesPerHugePage / 4;
+  PAlloc a = AllocateWithSpanAllocInfo(half, info);
+  PAlloc b = AllocateWithSpanAllocInfo(half, info);
+  Delete(b);
+  EXPECT_EQ(ReleasePages(half), half);
+
+  PAlloc c = AllocateWithSpanAllocInfo(quarter, info);
+  EXPECT_EQ(filler_.subrelease_stats().total_pages_refaulted, quarter);
+
+  FakeClock::Advance(absl::Minutes(1));
+  PAlloc d = AllocateWithSpanAllocInfo(quarter, info);
+  EXPECT_EQ(filler_.subrelease_stats().total_pages_refaulted, quarter);
+
+  Delete(a);
+  Delete(c);
+  Delete(d);
+}
+
 // Testing subrelase stats: ensure that the cumulative number of released
 // pages and broken hugepages is no less than those of the last 10 mins
 TEST_F(FillerTest, CheckSubreleaseStats) {
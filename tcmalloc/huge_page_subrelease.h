@@ -216,6 +216,10 @@ struct SkipSubreleaseIntervals {
   }
 };
 
+// Released pages allocated again within kRefaultInterval count as refaulted:
+// releasing them saved little memory for the faults they cost.
+inline constexpr absl::Duration kRefaultInterval = absl::Seconds(10);
+
 struct SubreleaseStats {
   Length total_pages_subreleased;                // cumulative since startup
   Length total_partial_alloc_pages_subreleased;  // cumulative since startup
@@ -228,6 +232,12 @@ struct SubreleaseStats {
   // Keep these limit-related stats cumulative since startup only
   Length total_pages_subreleased_due_to_limit;
   HugeLength total_hugepages_broken_due_to_limit{NHugePages(0)};
+  // Subreleased pages allocated again shortly after their release, cumulative
+  // since startup.
+  Length total_pages_refaulted;
+  // Free pages marked released that residency had found already unbacked,
+  // cumulative since startup.  They are not counted as subreleased.
+  Length total_pages_found_unbacked;
 
   void reset() {
     total_pages_subreleased += num_pages_subreleased;
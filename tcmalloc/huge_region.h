@@ -25,8 +25,11 @@
 #include "absl/base/nullability.h"
 #include "absl/base/optimization.h"
 #include "absl/strings/str_format.h"
+#include "absl/time/time.h"
 #include "tcmalloc/huge_cache.h"
+#include "tcmalloc/huge_page_subrelease.h"
 #include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/clock.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/linked_list.h"
 #include "tcmalloc/internal/logging.h"
@@ -71,23 +74,38 @@ class HugeRegion : public TList<HugeRegion>::Elem {
   static constexpr size_t kNumHugePages = kRegionSize.raw_num();
   static constexpr HugeLength size() { return kRegionSize; }
 
-  // REQUIRES: r.len() == size(); r unbacked.
+  // REQUIRES: r.len() == size(); r unbacked.  known_zero is true if r is
+  // also known to be zero.
   HugeRegion(
       HugeRange r, MemoryModifyFunction& unback ABSL_ATTRIBUTE_LIFETIME_BOUND,
-      MemoryTagFunction& set_anon_vma_name ABSL_ATTRIBUTE_LIFETIME_BOUND);
+      MemoryTagFunction& set_anon_vma_name ABSL_ATTRIBUTE_LIFETIME_BOUND,
+      bool known_zero = false);
   HugeRegion() = delete;
 
   // If available, return a range of n free pages, setting *from_released =
-  // true iff the returned range is currently unbacked.
+  // true iff the returned range is currently unbacked.  If known_zero is not
+  // null, *known_zero is set to true iff the range is known to be zero.
   // Returns false if no range available.
   bool MaybeGet(Length n, PageId* absl_nonnull p,
-                bool* absl_nonnull from_released);
+                bool* absl_nonnull from_released,
+                bool* absl_nullable known_zero = nullptr);
 
   // Return r for new allocations.
   // If release=true, release any hugepages made empty as a result.
   // REQUIRES: Range{p, n} was the result of a previous MaybeGet.
   void Put(Range r, bool release);
 
+  // If the n pages following r are free, grow r by them, setting
+  // *from_released = true iff any of them are currently unbacked.
+  // Returns false if they are not available.
+  // REQUIRES: r was the result of a previous MaybeGet.
+  bool MaybeExtend(Range r, Length n, bool* absl_nonnull from_released);
+
+  // Return the pages of r past its first n for new allocations.
+  // If release=true, release any hugepages made empty as a result.
+  // REQUIRES: r was the result of a previous MaybeGet, and n < r.n.
+  void Shrink(Range r, Length n, bool release);
+
   // Release <desired> number of pages from free-and-backed hugepages from the
   // region. If adaptive_release is true, we scan the hugepages in reverse order
   // to select candidates for release. This order is opposite to the allocation
@@ -118,6 +136,14 @@ class HugeRegion : public TList<HugeRegion>::Elem {
 
   BackingStats stats() const;
 
+  // Calls func(HugePage) for each backed hugepage of the region.
+  template <typename F>
+  void ForEachBackedHugePage(const F& func) const {
+    for (size_t i = 0; i < kNumHugePages; ++i) {
+      if (backed_[i]) func(location_.start() + NHugePages(i));
+    }
+  }
+
   // We don't define this as operator< because it's a rather specialized order.
   bool BetterToAllocThan(const HugeRegion* rhs) const {
     return longest_free() < rhs->longest_free();
@@ -132,8 +158,9 @@ class HugeRegion : public TList<HugeRegion>::Elem {
 
   // Adjust counts of allocs-per-hugepage for r being added/removed.
 
-  // *from_released is set to true iff r is currently unbacked
-  void Inc(Range r, bool* from_released);
+  // *from_released is set to true iff r is currently unbacked, and
+  // *known_zero, if not null, iff all of r is known to be zero.
+  void Inc(Range r, bool* from_released, bool* known_zero = nullptr);
   // If release is true, unback any hugepage that becomes empty.
   void Dec(Range r, bool release);
 
@@ -143,6 +170,9 @@ class HugeRegion : public TList<HugeRegion>::Elem {
   Length pages_used_[kNumHugePages];
   // Is this hugepage backed?
   bool backed_[kNumHugePages];
+  // Is this hugepage unbacked, and known to be zero? Fresh hugepages are, if
+  // the region was, and so are released ones.
+  bool known_zero_[kNumHugePages];
   HugeLength nbacked_;
   HugeLength total_unbacked_{NHugePages(0)};
   HugeLength free_backed_count_;
@@ -156,20 +186,43 @@ template <typename Region>
 class HugeRegionSet {
  public:
   explicit HugeRegionSet(HugeRegionUsageOption use_huge_region_more_often)
+      : HugeRegionSet(
+            use_huge_region_more_often,
+            Clock{.now = absl::base_internal::CycleClock::Now,
+                  .freq = absl::base_internal::CycleClock::Frequency}) {}
+
+  // For testing with mock clock.
+  HugeRegionSet(HugeRegionUsageOption use_huge_region_more_often, Clock clock)
       : n_(0),
         use_huge_region_more_often_(use_huge_region_more_often),
         free_backed_count_(NHugePages(0)),
-        lowater_free_backed_(NHugePages(0)) {}
+        lowater_free_backed_(NHugePages(0)),
+        regionstats_tracker_(clock, absl::Minutes(60), absl::Minutes(5),
+                             absl::Minutes(10)) {}
 
   // If available, return a range of n free pages, setting *from_released =
-  // true iff the returned range is currently unbacked.
+  // true iff the returned range is currently unbacked, and *known_zero, if not
+  // null, iff it is known to be zero.
   // Returns false if no range available.
   bool MaybeGet(Length n, PageId* absl_nonnull page,
-                bool* absl_nonnull from_released);
+                bool* absl_nonnull from_released,
+                bool* absl_nullable known_zero = nullptr);
 
   // Return an allocation to a region (if one matches!)
   bool MaybePut(Range r);
 
+  // Grow an allocation from a region (if one matches!) by the n pages
+  // following it, setting *from_released = true iff any of them are currently
+  // unbacked.  Returns false if they are not available.
+  bool MaybeExtend(Range r, Length n, bool* absl_nonnull from_released);
+
+  // Shrink an allocation from a region (if one matches!) to its first n pages,
+  // returning the rest to the region.
+  bool MaybeShrink(Range r, Length n);
+
+  // Returns true iff p belongs to one of the regions in the set.
+  bool contains(PageId p);
+
   // Add region to the set.
   void Contribute(Region* region);
 
@@ -179,7 +232,11 @@ class HugeRegionSet {
   //   low water mark of free backed pages (capped by desired).
   // - If hit_limit is false and use_adaptive is false, we release a fraction
   //   of the free backed pages.
-  Length ReleasePages(Length desired, bool use_adaptive, bool hit_limit);
+  // If hit_limit is false and intervals enables skip-subrelease, the amount
+  // is further capped to keep the backed pages at or above the recent demand,
+  // as HugePageFiller does.
+  Length ReleasePages(Length desired, bool use_adaptive, bool hit_limit,
+                      SkipSubreleaseIntervals intervals = {});
 
   void Print(Printer& out) const;
   void PrintInPbtxt(PbtxtRegion& hpaa) const;
@@ -187,6 +244,14 @@ class HugeRegionSet {
   BackingStats stats() const;
   HugeLength free_backed() const;
   size_t ActiveRegions() const;
+
+  // Calls func(HugePage) for each backed hugepage of the regions.
+  template <typename F>
+  void ForEachBackedHugePage(const F& func) const {
+    for (const Region* region : list_) {
+      region->ForEachBackedHugePage(func);
+    }
+  }
   bool UseHugeRegionMoreOften() const {
     return use_huge_region_more_often_ ==
            HugeRegionUsageOption::kUseForAllLargeAllocs;
@@ -195,6 +260,13 @@ class HugeRegionSet {
  private:
   static constexpr double kFractionToReleaseFromRegion = 0.1;
 
+  // Caps desired so that releasing it does not take the backed pages below
+  // the demand requirement computed for intervals.
+  Length GetDesiredReleasePages(Length desired,
+                                SkipSubreleaseIntervals intervals);
+
+  void UpdateRegionStatsTracker();
+
   void Fix(Region* absl_nonnull r) {
     // We've changed r's fragmentation--move it through the list to the
     // correct home (if needed).
@@ -253,21 +325,31 @@ class HugeRegionSet {
   TList<Region> list_;
   HugeLength free_backed_count_;
   HugeLength lowater_free_backed_;
+
+  // Demand and realized fragmentation of the regions, for demand-based
+  // release.  Pages released since the last report are in
+  // num_pages_subreleased_.
+  using StatsTrackerType = SubreleaseStatsTracker<600>;
+  StatsTrackerType regionstats_tracker_;
+  Length num_pages_subreleased_;
 };
 
 // REQUIRES: r.len() == size(); r unbacked.
 inline HugeRegion::HugeRegion(HugeRange r, MemoryModifyFunction& unback,
-                              MemoryTagFunction& set_anon_vma_name)
+                              MemoryTagFunction& set_anon_vma_name,
+                              bool known_zero)
     : tracker_{},
       location_(r),
       pages_used_{},
       backed_{},
+      known_zero_{},
       nbacked_(NHugePages(0)),
       unback_(unback) {
   for (int i = 0; i < kNumHugePages; ++i) {
     // These are already 0 but for clarity...
     pages_used_[i] = Length(0);
     backed_[i] = false;
+    known_zero_[i] = known_zero;
   }
   free_backed_count_ = NHugePages(0);
 
@@ -278,7 +360,8 @@ inline HugeRegion::HugeRegion(HugeRange r, MemoryModifyFunction& unback,
   set_anon_vma_name(Range(r), name);
 }
 
-inline bool HugeRegion::MaybeGet(Length n, PageId* p, bool* from_released) {
+inline bool HugeRegion::MaybeGet(Length n, PageId* p, bool* from_released,
+                                 bool* known_zero) {
   if (n > longest_free()) return false;
   TC_ASSERT_GT(n, Length(0));
   auto index = Length(tracker_.FindAndMark(n.raw_num()));
@@ -287,7 +370,7 @@ inline bool HugeRegion::MaybeGet(Length n, PageId* p, bool* from_released) {
   *p = page;
 
   // the last hugepage we touch
-  Inc(Range{page, n}, from_released);
+  Inc(Range{page, n}, from_released, known_zero);
   return true;
 }
 
@@ -299,6 +382,25 @@ inline void HugeRegion::Put(Range r, bool release) {
   Dec(r, release);
 }
 
+inline bool HugeRegion::MaybeExtend(Range r, Length n, bool* from_released) {
+  TC_ASSERT_GT(n, Length(0));
+  const Length index = r.p + r.n - location_.start().first_page();
+  if (!tracker_.IsFree(index.raw_num(), n.raw_num())) return false;
+  tracker_.Extend(index.raw_num(), n.raw_num());
+
+  Inc(Range{r.p + r.n, n}, from_released);
+  return true;
+}
+
+inline void HugeRegion::Shrink(Range r, Length n, bool release) {
+  TC_ASSERT_LT(n, r.n);
+  const Range tail(r.p + n, r.n - n);
+  const Length index = tail.p - location_.start().first_page();
+  tracker_.Shrink(index.raw_num(), tail.n.raw_num());
+
+  Dec(tail, release);
+}
+
 // Release hugepages that are unused but backed.
 // TODO(b/199203282): We release <desired> pages, rounded up to a hugepage, from
 // free but backed hugepages from the region. We can explore a more
@@ -429,8 +531,9 @@ inline BackingStats HugeRegion::stats() const {
   return s;
 }
 
-inline void HugeRegion::Inc(Range r, bool* from_released) {
+inline void HugeRegion::Inc(Range r, bool* from_released, bool* known_zero) {
   bool should_back = false;
+  bool zero = true;
   while (r.n > Length(0)) {
     const HugePage hp = HugePageContaining(r.p);
     const size_t i = (hp - location_.start()) / NHugePages(1);
@@ -440,11 +543,17 @@ inline void HugeRegion::Inc(Range r, bool* from_released) {
       if (backed_[i]) {
         TC_ASSERT_GT(free_backed_count_, NHugePages(0));
         --free_backed_count_;
+        zero = false;
       } else {
         backed_[i] = true;
         should_back = true;
         ++nbacked_;
+        zero = zero && known_zero_[i];
+        known_zero_[i] = false;
       }
+    } else {
+      // Pages we hand out may be zero, but we do not track them one by one.
+      zero = false;
     }
     pages_used_[i] += here;
     TC_ASSERT_LE(pages_used_[i], kPagesPerHugePage);
@@ -452,6 +561,9 @@ inline void HugeRegion::Inc(Range r, bool* from_released) {
     r.n -= here;
   }
   *from_released = should_back;
+  if (known_zero != nullptr) {
+    *known_zero = zero;
+  }
 }
 
 inline void HugeRegion::Dec(Range r, bool release) {
@@ -519,6 +631,7 @@ inline HugeLength HugeRegion::UnbackHugepages(
       for (size_t k = i; k < j; k++) {
         TC_ASSERT(should_unback[k]);
         backed_[k] = false;
+        known_zero_[k] = true;
       }
 
       released += hl;
@@ -547,10 +660,11 @@ inline HugeLength HugeRegion::UnbackHugepages(
 // Returns false if no range available.
 template <typename Region>
 inline bool HugeRegionSet<Region>::MaybeGet(Length n, PageId* page,
-                                            bool* from_released) {
+                                            bool* from_released,
+                                            bool* known_zero) {
   for (Region* region : list_) {
     HugeLength before = region->free_backed();
-    if (region->MaybeGet(n, page, from_released)) {
+    if (region->MaybeGet(n, page, from_released, known_zero)) {
       HugeLength after = region->free_backed();
       TC_ASSERT_LE(after, before);
       HugeLength diff = before - after;
@@ -558,6 +672,7 @@ inline bool HugeRegionSet<Region>::MaybeGet(Length n, PageId* page,
       free_backed_count_ -= diff;
       lowater_free_backed_ = std::min(lowater_free_backed_, free_backed_count_);
       Fix(region);
+      UpdateRegionStatsTracker();
       return true;
     }
   }
@@ -579,6 +694,7 @@ inline bool HugeRegionSet<Region>::MaybePut(Range r) {
       TC_ASSERT_GE(after, before);
       free_backed_count_ += (after - before);
       Fix(region);
+      UpdateRegionStatsTracker();
       return true;
     }
   }
@@ -586,18 +702,124 @@ inline bool HugeRegionSet<Region>::MaybePut(Range r) {
   return false;
 }
 
+template <typename Region>
+inline bool HugeRegionSet<Region>::MaybeExtend(Range r, Length n,
+                                               bool* from_released) {
+  for (Region* region : list_) {
+    if (region->contains(r.p)) {
+      HugeLength before = region->free_backed();
+      if (!region->MaybeExtend(r, n, from_released)) return false;
+      HugeLength after = region->free_backed();
+      TC_ASSERT_LE(after, before);
+      HugeLength diff = before - after;
+      TC_ASSERT_GE(free_backed_count_, diff);
+      free_backed_count_ -= diff;
+      lowater_free_backed_ = std::min(lowater_free_backed_, free_backed_count_);
+      Fix(region);
+      UpdateRegionStatsTracker();
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename Region>
+inline bool HugeRegionSet<Region>::MaybeShrink(Range r, Length n) {
+  // As in MaybePut.
+  const bool release = !UseHugeRegionMoreOften();
+  for (Region* region : list_) {
+    if (region->contains(r.p)) {
+      HugeLength before = region->free_backed();
+      region->Shrink(r, n, release);
+      HugeLength after = region->free_backed();
+      TC_ASSERT_GE(after, before);
+      free_backed_count_ += (after - before);
+      Fix(region);
+      UpdateRegionStatsTracker();
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename Region>
+inline bool HugeRegionSet<Region>::contains(PageId p) {
+  for (Region* region : list_) {
+    if (region->contains(p)) return true;
+  }
+  return false;
+}
+
 // Add region to the set.
 template <typename Region>
 inline void HugeRegionSet<Region>::Contribute(Region* region) {
   n_++;
   free_backed_count_ += region->free_backed();
   AddToList(region);
+  UpdateRegionStatsTracker();
+}
+
+template <typename Region>
+inline Length HugeRegionSet<Region>::GetDesiredReleasePages(
+    Length desired, SkipSubreleaseIntervals intervals) {
+  // As in HugePageFiller::GetDesiredSubreleasePages, don't release pages if it
+  // would push the backed pages under either the latest peak or the sum of
+  // short-term demand fluctuation peak and long-term demand trend.
+  UpdateRegionStatsTracker();
+  Length required_pages;
+  if (intervals.IsPeakIntervalSet()) {
+    required_pages =
+        regionstats_tracker_.GetRecentPeak(intervals.peak_interval);
+  } else {
+    required_pages = regionstats_tracker_.GetRecentDemand(
+        intervals.short_interval, intervals.long_interval);
+  }
+  if (required_pages == Length(0)) {
+    return desired;
+  }
+
+  Length current_pages;
+  for (Region* region : list_) {
+    current_pages += region->used_pages() + region->free_pages();
+  }
+  // We only release whole hugepages, so round down to stay above the demand.
+  const Length releasable_pages =
+      required_pages >= current_pages
+          ? Length(0)
+          : NHugePages((current_pages - required_pages) / kPagesPerHugePage)
+                .in_pages();
+  if (releasable_pages >= desired) {
+    return desired;
+  }
+
+  // Report the free hugepages that we keep backed because of the demand, which
+  // are never more than the ones we could have released.
+  const Length free_backed = free_backed_count_.in_pages();
+  const Length skipped_pages =
+      std::min(free_backed - std::min(free_backed, releasable_pages),
+               desired - releasable_pages);
+  regionstats_tracker_.ReportSkippedSubreleasePages(
+      skipped_pages, std::min(current_pages, required_pages));
+  return releasable_pages;
+}
+
+template <typename Region>
+inline void HugeRegionSet<Region>::UpdateRegionStatsTracker() {
+  StatsTrackerType::SubreleaseStats stats;
+  for (Region* region : list_) {
+    stats.num_pages += region->used_pages();
+    stats.free_pages += region->free_pages();
+    stats.unmapped_pages += region->unmapped_pages();
+  }
+  stats.num_pages_subreleased = num_pages_subreleased_;
+  regionstats_tracker_.Report(stats);
+  num_pages_subreleased_ = Length(0);
 }
 
 template <typename Region>
-inline Length HugeRegionSet<Region>::ReleasePages(Length desired,
-                                                  bool use_adaptive,
-                                                  bool hit_limit) {
+inline Length HugeRegionSet<Region>::ReleasePages(
+    Length desired, bool use_adaptive, bool hit_limit,
+    SkipSubreleaseIntervals intervals) {
   Length to_release;
   if (hit_limit) {
     to_release = desired;
@@ -608,6 +830,9 @@ inline Length HugeRegionSet<Region>::ReleasePages(Length desired,
         Length(static_cast<size_t>(free_backed_count_.in_pages().raw_num() *
                                    kFractionToReleaseFromRegion));
   }
+  if (!hit_limit && intervals.SkipSubreleaseEnabled()) {
+    to_release = GetDesiredReleasePages(to_release, intervals);
+  }
 
   Length released;
   auto release_from_region = [&](Region& region) {
@@ -635,6 +860,8 @@ inline Length HugeRegionSet<Region>::ReleasePages(Length desired,
   free_backed_count_ -= released_hl;
   lowater_free_backed_ = free_backed_count_;
 
+  num_pages_subreleased_ += released;
+  UpdateRegionStatsTracker();
   return released;
 }
 
@@ -666,6 +893,8 @@ inline void HugeRegionSet<Region>::Print(Printer& out) const {
              in_pages > Length(0) ? static_cast<double>(total_free.raw_num()) /
                                         static_cast<double>(in_pages.raw_num())
                                   : 0.0);
+  out.printf("\n");
+  regionstats_tracker_.Print(out, "HugeRegionSet");
 }
 
 template <typename Region>
@@ -676,6 +905,10 @@ inline void HugeRegionSet<Region>::PrintInPbtxt(PbtxtRegion& hpaa) const {
     auto detail = hpaa.CreateSubRegion("huge_region_details");
     region->PrintInPbtxt(detail);
   }
+  regionstats_tracker_.PrintSubreleaseStatsInPbtxt(
+      hpaa, "huge_region_skipped_subrelease");
+  regionstats_tracker_.PrintTimeseriesStatsInPbtxt(
+      hpaa, "huge_region_stats_timeseries");
 }
 
 template <typename Region>
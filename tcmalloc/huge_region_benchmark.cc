@@ -0,0 +1,281 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Benchmarks HugeRegionSet, which serves allocations of about 1 to 32 MiB that
+// would waste too much of a hugepage in the HugeCache: throughput, the
+// fragmentation and release cost churn leaves behind, and how long each
+// operation holds pageheap_lock.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "absl/base/internal/cycleclock.h"
+#include "absl/random/random.h"
+#include "absl/strings/string_view.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_cache.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/huge_region.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/internal/system_allocator.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/stats.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+void* MakeTaggedAddress(MemoryTag tag) {
+  return reinterpret_cast<void*>(uintptr_t{static_cast<uint8_t>(tag)}
+                                 << kTagShift);
+}
+
+class NilMemoryTagFunction final : public MemoryTagFunction {
+ public:
+  void operator()(Range r, std::optional<absl::string_view> name) override {}
+};
+
+// Succeeds without touching memory: the regions live at made-up addresses.
+class NilUnback final : public MemoryModifyFunction {
+ public:
+  [[nodiscard]] MemoryModifyStatus operator()(Range r) override {
+    return {.success = true, .error_number = 0};
+  }
+};
+
+// A HugeRegionSet of `regions` regions, and the allocations made from it.
+// With HugeRegionUsageOption::kUseForAllLargeAllocs, frees leave hugepages
+// backed for ReleasePages, rather than releasing them right away.
+class RegionSet {
+ public:
+  explicit RegionSet(
+      size_t regions,
+      HugeRegionUsageOption option = HugeRegionUsageOption::kDefault)
+      : set_(option) {
+    const HugePage base =
+        HugePageContaining(MakeTaggedAddress(MemoryTag::kNormal));
+    for (size_t i = 0; i < regions; ++i) {
+      regions_.push_back(std::make_unique<HugeRegion>(
+          HugeRange::Make(base + NHugePages(i * HugeRegion::kNumHugePages),
+                          HugeRegion::size()),
+          unback_, set_anon_vma_name_));
+      set_.Contribute(regions_.back().get());
+    }
+  }
+
+  // Allocates between 1 MiB and `max_mib` MiB.  Returns false if no region
+  // has room.
+  bool Allocate(size_t max_mib, absl::BitGen& rng) {
+    const Length n = BytesToLengthCeil(
+        absl::Uniform<size_t>(rng, size_t{1} << 20, (max_mib << 20) + 1));
+    PageId p;
+    bool from_released;
+    if (!set_.MaybeGet(n, &p, &from_released)) return false;
+    live_.push_back(Range(p, n));
+    used_ += n;
+    return true;
+  }
+
+  // Frees a random allocation.
+  void Free(absl::BitGen& rng) {
+    TC_CHECK(!live_.empty());
+    const size_t i = absl::Uniform<size_t>(rng, 0, live_.size());
+    std::swap(live_[i], live_.back());
+    TC_CHECK(set_.MaybePut(live_.back()));
+    used_ -= live_.back().n;
+    live_.pop_back();
+  }
+
+  // Allocates until `fraction` of the regions is used.
+  void Fill(double fraction, size_t max_mib, absl::BitGen& rng) {
+    const Length target = Length(static_cast<size_t>(
+        fraction * regions_.size() * HugeRegion::size().in_pages().raw_num()));
+    while (used_ < target && Allocate(max_mib, rng)) {
+    }
+  }
+
+  HugeRegionSet<HugeRegion>& set() { return set_; }
+  size_t live() const { return live_.size(); }
+
+ private:
+  NilUnback unback_;
+  NilMemoryTagFunction set_anon_vma_name_;
+  std::vector<std::unique_ptr<HugeRegion>> regions_;
+  HugeRegionSet<HugeRegion> set_;
+  std::vector<Range> live_;
+  Length used_;
+};
+
+// Arg: maximum allocation size, in MiB.
+//
+// Frees a random allocation and makes a new one, at about 75% occupancy.
+void BM_AllocFree(benchmark::State& state) {
+  const size_t max_mib = state.range(0);
+  absl::BitGen rng;
+  RegionSet regions(4);
+  regions.Fill(0.75, max_mib, rng);
+
+  for (auto s : state) {
+    regions.Free(rng);
+    while (!regions.Allocate(max_mib, rng)) {
+      regions.Free(rng);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_AllocFree)->RangeMultiplier(2)->Range(1, 32);
+
+// Arg: maximum allocation size, in MiB.
+//
+// Churns a full set and reports how fragmented it is left: the share of free
+// pages on backed hugepages, and how many allocations of the largest size
+// still fit.
+void BM_FragmentationAfterChurn(benchmark::State& state) {
+  const size_t max_mib = state.range(0);
+  constexpr int kChurn = 1 << 12;
+  absl::BitGen rng;
+  std::optional<RegionSet> regions;
+
+  for (auto s : state) {
+    state.PauseTiming();
+    regions.reset();
+    regions.emplace(4);
+    regions->Fill(0.9, max_mib, rng);
+    state.ResumeTiming();
+
+    for (int i = 0; i < kChurn; ++i) {
+      regions->Free(rng);
+      while (!regions->Allocate(max_mib, rng)) {
+        regions->Free(rng);
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kChurn);
+
+  // Free a third of the allocations, and see how much of that is usable.
+  for (size_t i = regions->live() / 3; i > 0; --i) {
+    regions->Free(rng);
+  }
+  const BackingStats stats = regions->set().stats();
+  const Length largest = BytesToLengthCeil(max_mib << 20);
+  size_t fit = 0;
+  PageId p;
+  bool from_released;
+  while (regions->set().MaybeGet(largest, &p, &from_released)) {
+    ++fit;
+  }
+  state.counters["free_backed_fraction"] =
+      static_cast<double>(stats.free_bytes) /
+      std::max<size_t>(stats.system_bytes - stats.unmapped_bytes, 1);
+  state.counters["largest_allocations_fitting"] = fit;
+}
+
+BENCHMARK(BM_FragmentationAfterChurn)->Arg(2)->Arg(8)->Arg(32);
+
+// Arg: whether release is adaptive.
+//
+// Frees half of a full set, which keeps the hugepages this empties backed,
+// then times releasing them.
+void BM_Release(benchmark::State& state) {
+  const bool adaptive = state.range(0);
+  constexpr size_t kMaxMiB = 16;
+  absl::BitGen rng;
+  std::optional<RegionSet> regions;
+  size_t released = 0;
+
+  for (auto s : state) {
+    state.PauseTiming();
+    regions.reset();
+    regions.emplace(4, HugeRegionUsageOption::kUseForAllLargeAllocs);
+    regions->Fill(0.9, kMaxMiB, rng);
+    for (size_t i = regions->live() / 2; i > 0; --i) {
+      regions->Free(rng);
+    }
+    state.ResumeTiming();
+
+    HugeRegionSet<HugeRegion>& set = regions->set();
+    released += set.ReleasePages(set.free_backed().in_pages(), adaptive,
+                                 /*hit_limit=*/!adaptive)
+                    .raw_num();
+  }
+  state.counters["released_pages"] = benchmark::Counter(
+      released, benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK(BM_Release)->Arg(0)->Arg(1);
+
+// Arg: number of regions.
+//
+// Like BM_AllocFree with 1-32 MiB allocations, over a growing number of
+// regions, which each operation reorders by their longest free range.
+void BM_ManyRegions(benchmark::State& state) {
+  constexpr size_t kMaxMiB = 32;
+  absl::BitGen rng;
+  RegionSet regions(state.range(0));
+  regions.Fill(0.75, kMaxMiB, rng);
+
+  for (auto s : state) {
+    regions.Free(rng);
+    while (!regions.Allocate(kMaxMiB, rng)) {
+      regions.Free(rng);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_ManyRegions)->RangeMultiplier(4)->Range(1, 64);
+
+// Arg: maximum allocation size, in MiB.
+//
+// Takes pageheap_lock around each allocation and free, as
+// HugePageAwareAllocator does, and reports the longest hold next to the
+// average time per operation.
+void BM_LockHoldMixedSizes(benchmark::State& state) {
+  const size_t max_mib = state.range(0);
+  absl::BitGen rng;
+  RegionSet regions(4);
+  regions.Fill(0.75, max_mib, rng);
+  int64_t max_hold = 0;
+
+  for (auto s : state) {
+    const bool allocate =
+        regions.live() == 0 || absl::Bernoulli(rng, 0.5);
+    const int64_t start = absl::base_internal::CycleClock::Now();
+    {
+      PageHeapSpinLockHolder l;
+      if (!allocate || !regions.Allocate(max_mib, rng)) {
+        regions.Free(rng);
+      }
+    }
+    max_hold = std::max(max_hold,
+                        absl::base_internal::CycleClock::Now() - start);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["max_hold_ns"] =
+      max_hold * 1e9 / absl::base_internal::CycleClock::Frequency();
+}
+
+BENCHMARK(BM_LockHoldMixedSizes)->Arg(4)->Arg(32);
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -24,6 +24,7 @@
 #include <functional>
 #include <memory>
 #include <optional>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -39,6 +40,7 @@
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/huge_cache.h"
+#include "tcmalloc/huge_page_subrelease.h"
 #include "tcmalloc/huge_pages.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/memory_tag.h"
@@ -216,6 +218,57 @@ TEST_F(HugeRegionTest, ReqsBacking) {
   }
 }
 
+TEST_F(HugeRegionTest, Extend) {
+  const Length n = kPagesPerHugePage;
+  bool from_released;
+  Alloc a = Allocate(n / 2, &from_released);
+  EXPECT_TRUE(from_released);
+  Alloc b = Allocate(n / 2, &from_released);
+  EXPECT_FALSE(from_released);
+  Alloc c = Allocate(n, &from_released);
+  EXPECT_TRUE(from_released);
+  Delete(b);
+
+  // a can grow into b's pages, which are still backed, but not past c.
+  EXPECT_FALSE(region_.MaybeExtend(Range(a.p, a.n), n / 2 + Length(1),
+                                   &from_released));
+  ASSERT_TRUE(region_.MaybeExtend(Range(a.p, a.n), n / 2, &from_released));
+  EXPECT_FALSE(from_released);
+  a.n += n / 2;
+  Mark(a);
+  EXPECT_EQ(region_.used_pages(), 2 * n);
+
+  // c grows onto a new hugepage.
+  ASSERT_TRUE(region_.MaybeExtend(Range(c.p, c.n), Length(1), &from_released));
+  EXPECT_TRUE(from_released);
+  c.n += Length(1);
+  Mark(c);
+  EXPECT_EQ(region_.used_pages(), 2 * n + Length(1));
+  EXPECT_EQ(region_.backed(), NHugePages(3));
+
+  Delete(a);
+  Delete(c);
+  EXPECT_EQ(region_.used_pages(), Length(0));
+}
+
+TEST_F(HugeRegionTest, Shrink) {
+  const Length n = kPagesPerHugePage;
+  bool from_released;
+  Alloc a = Allocate(2 * n, &from_released);
+  Alloc b = Allocate(n / 2, &from_released);
+  EXPECT_EQ(region_.backed(), NHugePages(3));
+
+  // a gives back its second hugepage, which is released as it is now empty.
+  region_.Shrink(Range(a.p, a.n), n, /*release=*/true);
+  a.n = n;
+  EXPECT_EQ(region_.used_pages(), n + n / 2);
+  EXPECT_EQ(region_.backed(), NHugePages(2));
+
+  Delete(a);
+  Delete(b);
+  EXPECT_EQ(region_.used_pages(), Length(0));
+}
+
 TEST_F(HugeRegionTest, ReleaseFrac) {
   const Length n = kPagesPerHugePage;
   bool from_released;
@@ -1034,6 +1087,57 @@ TEST_P(HugeRegionSetTest, ReleaseAdaptiveOrder) {
   ASSERT_TRUE(set_.MaybePut(Range(r1_allocs[0].p, r1_allocs[0].n)));
 }
 
+TEST_P(HugeRegionSetTest, ReleaseDemandBased) {
+  if (!UseHugeRegionMoreOften()) {
+    return;
+  }
+
+  PageId p;
+  constexpr Length kSize = kPagesPerHugePage;
+  bool from_released;
+  auto r1 = GetRegion();
+  set_.Contribute(r1.get());
+
+  std::vector<Alloc> allocs;
+  while (set_.MaybeGet(kSize, &p, &from_released)) {
+    allocs.push_back({p, kSize});
+  }
+  for (auto a : allocs) {
+    ASSERT_TRUE(set_.MaybePut(Range(a.p, a.n)));
+  }
+  ASSERT_EQ(r1->free_backed(), r1->size());
+
+  // The whole region was in use moments ago, so demand-based release keeps
+  // it backed.
+  const SkipSubreleaseIntervals intervals = {
+      .short_interval = absl::Seconds(60), .long_interval = absl::Seconds(300)};
+  Length released = set_.ReleasePages(Length::max(), /*use_adaptive=*/false,
+                                      /*hit_limit=*/false, intervals);
+  EXPECT_EQ(released, Length(0));
+  EXPECT_EQ(r1->free_backed(), r1->size());
+
+  std::string buffer(1024 * 1024, '\0');
+  {
+    Printer printer(&*buffer.begin(), buffer.size());
+    set_.Print(printer);
+  }
+  buffer.resize(strlen(buffer.c_str()));
+  EXPECT_THAT(buffer, testing::HasSubstr("HugeRegionSet: Since the start of "
+                                         "the execution, 1 subreleases"));
+
+  // Without skip-subrelease intervals, we release a fraction of the free
+  // pages as before.
+  released = set_.ReleasePages(Length::max(), /*use_adaptive=*/false,
+                               /*hit_limit=*/false);
+  EXPECT_GT(released, Length(0));
+  EXPECT_LT(r1->free_backed(), r1->size());
+
+  // Hitting the limit ignores the demand.
+  set_.ReleasePages(Length::max(), /*use_adaptive=*/false,
+                    /*hit_limit=*/true, intervals);
+  EXPECT_EQ(r1->free_backed(), NHugePages(0));
+}
+
 TEST_P(HugeRegionSetTest, Set) {
   absl::BitGen rng;
   PageId p;
@@ -0,0 +1,107 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// An inlinable copy of the fast paths of `::operator new(size)` and
+// `::operator delete(ptr, size)`, for binaries that link //tcmalloc
+// statically.  Callers get the size class lookup, the sampler check and the
+// per-CPU cache pop/push inlined, without the call, and only call into
+// tcmalloc.cc for the slow paths.
+//
+// The fast paths read TCMalloc's internal state directly, so this header must
+// be built in the same configuration as the TCMalloc it is linked with: it
+// only supports //tcmalloc (not its variants), and it must not be used from a
+// shared library that may be loaded into a process with another allocator.
+// It is most useful with LTO/ThinLTO, which can also inline it across
+// translation units.
+
+#ifndef TCMALLOC_INLINE_FAST_PATH_H_
+#define TCMALLOC_INLINE_FAST_PATH_H_
+
+#include <stddef.h>
+
+#include <new>
+
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
+#include "tcmalloc/allocation_sampling.h"
+#include "tcmalloc/cpu_cache.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/malloc_hook_invoke.h"
+#include "tcmalloc/static_vars.h"
+#include "tcmalloc/tcmalloc.h"
+#include "tcmalloc/tcmalloc_policy.h"
+
+namespace tcmalloc {
+
+// Equivalent to `::operator new(size)`.
+[[nodiscard]] ABSL_ATTRIBUTE_ALWAYS_INLINE inline void* InlineNew(size_t size) {
+  using tcmalloc_internal::CppPolicy;
+  using tcmalloc_internal::tc_globals;
+
+  const auto [is_small, size_class] =
+      tc_globals.sizemap().GetSizeClass(CppPolicy(), size);
+  // Allocations due for periodic hooks are left to `::operator new`, which
+  // finds the countdown still expired.
+  if (ABSL_PREDICT_FALSE(!is_small) ||
+      tcmalloc_internal::PeriodicNewHookDue()) {
+    return ::operator new(size);
+  }
+  // See fast_alloc in tcmalloc.cc.  Both the sampler and the per-CPU cache
+  // fail closed (size class 0, uninitialized caches), so that initialization,
+  // sampling and hooks are all left to the slow path.
+#if TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+  void* ret = tc_globals.cpu_cache().AllocateFastCounted(size_class, size);
+#else
+  if (ABSL_PREDICT_FALSE(
+          !tcmalloc_internal::GetThreadSampler().TryRecordAllocationFast(
+              size))) {
+    return TCMallocInternalInlineNewSlow(size, size_class);
+  }
+  void* ret = tc_globals.cpu_cache().AllocateFast(size_class);
+#endif  // TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+  if (ABSL_PREDICT_FALSE(ret == nullptr)) {
+    return TCMallocInternalInlineNewSlow(size, size_class);
+  }
+  return ret;
+}
+
+// Equivalent to `::operator delete(ptr, size)`.
+ABSL_ATTRIBUTE_ALWAYS_INLINE inline void InlineSizedDelete(void* ptr,
+                                                           size_t size) {
+  using tcmalloc_internal::CppPolicy;
+  using tcmalloc_internal::MemoryTag;
+  using tcmalloc_internal::tc_globals;
+
+  // Only partition 0 normal memory is handled inline.  Everything else,
+  // nullptr included, is tagged otherwise.
+  if (ABSL_PREDICT_TRUE(tcmalloc_internal::GetMemoryTag(ptr) ==
+                        MemoryTag::kNormalP0) &&
+      !tcmalloc_internal::PeriodicDeleteHookDue()) {
+    const auto [is_small, size_class] = tc_globals.sizemap().GetSizeClass(
+        CppPolicy().AccessAsHot().InPartition<0>(), size);
+    if (ABSL_PREDICT_TRUE(is_small)) {
+      if (ABSL_PREDICT_FALSE(
+              !tc_globals.cpu_cache().DeallocateFast(ptr, size_class))) {
+        TCMallocInternalInlineSizedDeleteSlow(ptr, size, size_class);
+      }
+      return;
+    }
+  }
+  ::operator delete(ptr, size);
+}
+
+}  // namespace tcmalloc
+
+#endif  // TCMALLOC_INLINE_FAST_PATH_H_
@@ -168,6 +168,24 @@ inline constexpr bool kSanitizerAddressSpace = true;
 inline constexpr bool kSanitizerAddressSpace = false;
 #endif
 
+// The number of security partitions normal memory is split into when heap
+// partitioning is active.  Partitions beyond the second each need a wider
+// memory tag (see memory_tag.h), so the count is fixed at build time by
+// TCMALLOC_INTERNAL_SECURITY_PARTITIONS.  Security and NUMA partitions share
+// the same tag bits and cannot be combined.
+#if defined(TCMALLOC_INTERNAL_SECURITY_PARTITIONS)
+#if defined(TCMALLOC_INTERNAL_NUMA_AWARE)
+#error "TCMALLOC_INTERNAL_SECURITY_PARTITIONS is incompatible with NUMA."
+#endif
+inline constexpr size_t kMaxSecurityPartitions =
+    TCMALLOC_INTERNAL_SECURITY_PARTITIONS;
+#else
+inline constexpr size_t kMaxSecurityPartitions = 2;
+#endif
+static_assert(kMaxSecurityPartitions == 2 || kMaxSecurityPartitions == 4 ||
+                  kMaxSecurityPartitions == 8,
+              "There can be 2, 4 or 8 security partitions.");
+
 #if defined(__x86_64__)
 // x86 has 2 MiB huge pages
 static constexpr size_t kHugePageShift = 21;
@@ -185,6 +203,9 @@ static constexpr size_t kHugePageShift = 21;
 static constexpr size_t kHugePageSize = static_cast<size_t>(1)
                                         << kHugePageShift;
 
+// Size of the hugetlbfs pages optionally used to back huge allocations.
+static constexpr size_t kGiganticPageSize = static_cast<size_t>(1) << 30;
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
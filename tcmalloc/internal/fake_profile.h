@@ -15,6 +15,8 @@
 #ifndef TCMALLOC_INTERNAL_FAKE_PROFILE_H_
 #define TCMALLOC_INTERNAL_FAKE_PROFILE_H_
 
+#include <stdint.h>
+
 #include <optional>
 #include <utility>
 #include <vector>
@@ -52,11 +54,15 @@ class FakeProfile final : public ProfileBase {
   std::optional<absl::Time> StartTime() const override { return start_time_; }
   void SetStartTime(std::optional<absl::Time> t) { start_time_ = t; }
 
+  uint64_t ExperimentId() const override { return experiment_id_; }
+  void SetExperimentId(uint64_t id) { experiment_id_ = id; }
+
  private:
   std::vector<Profile::Sample> samples_;
   ProfileType type_;
   absl::Duration duration_;
   std::optional<absl::Time> start_time_;
+  uint64_t experiment_id_ = 0;
 };
 
 }  // namespace tcmalloc_internal
@@ -0,0 +1,81 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/internal/frame_pointer_unwinder.h"
+
+#include <cstdint>
+
+#include "absl/base/attributes.h"
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+#if defined(__x86_64__) || defined(__aarch64__)
+
+namespace {
+
+// On both x86-64 and AArch64, a frame pointer points at a frame record holding
+// the caller's frame pointer followed by the return address.
+struct FrameRecord {
+  const FrameRecord* next;
+  void* return_address;
+};
+
+// Frames larger than this end the walk, as a frame pointer this far up the
+// stack is more likely to be garbage than a genuine frame.
+constexpr uintptr_t kMaxFrameBytes = 1 << 20;
+
+}  // namespace
+
+ABSL_ATTRIBUTE_NOINLINE ABSL_ATTRIBUTE_NO_SANITIZE_ADDRESS
+    ABSL_ATTRIBUTE_NO_SANITIZE_MEMORY int
+    GetStackTraceWithFramePointers(void** result, int max_depth,
+                                   int skip_count) {
+  const FrameRecord* frame =
+      static_cast<const FrameRecord*>(__builtin_frame_address(0));
+  // As with absl::GetStackTrace, the frame of our caller is not reported.
+  ++skip_count;
+  int depth = 0;
+  while (frame != nullptr && depth < max_depth) {
+    void* const return_address = frame->return_address;
+    if (return_address == nullptr) break;
+    if (skip_count > 0) {
+      --skip_count;
+    } else {
+      result[depth++] = return_address;
+    }
+
+    const FrameRecord* const next = frame->next;
+    const uintptr_t from = reinterpret_cast<uintptr_t>(frame);
+    const uintptr_t to = reinterpret_cast<uintptr_t>(next);
+    if (to <= from || to - from > kMaxFrameBytes ||
+        to % alignof(FrameRecord) != 0) {
+      break;
+    }
+    frame = next;
+  }
+  return depth;
+}
+
+#else
+
+int GetStackTraceWithFramePointers(void**, int, int) { return 0; }
+
+#endif  // defined(__x86_64__) || defined(__aarch64__)
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,44 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_INTERNAL_FRAME_POINTER_UNWINDER_H_
+#define TCMALLOC_INTERNAL_FRAME_POINTER_UNWINDER_H_
+
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Stores up to `max_depth` return addresses of the calling thread's stack in
+// `result`, skipping the innermost `skip_count` frames, and returns how many
+// were stored.  The addresses are the same as those absl::GetStackTrace
+// reports when called from the same place.
+//
+// The stack is found by following the chain of saved frame pointers, which
+// costs a couple of loads per frame but stops at the first function built
+// without frame pointers.  Frames are checked to grow towards the top of the
+// stack by less than a bound, so that a register used for other purposes is
+// unlikely to be followed, but this is not bulletproof: only use this in
+// binaries built with -fno-omit-frame-pointer.
+//
+// Returns 0 on architectures where the frame layout is not known.
+int GetStackTraceWithFramePointers(void** result, int max_depth,
+                                   int skip_count);
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_INTERNAL_FRAME_POINTER_UNWINDER_H_
@@ -0,0 +1,97 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/internal/frame_pointer_unwinder.h"
+
+#include "gtest/gtest.h"
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
+#include "absl/debugging/stacktrace.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+constexpr int kMaxDepth = 16;
+
+struct Traces {
+  void* frame_pointers[kMaxDepth];
+  int frame_pointers_depth;
+  void* absl[kMaxDepth];
+  int absl_depth;
+};
+
+// This test is built with frame pointers, so the walk reaches at least up to
+// the test body through these functions.
+ABSL_ATTRIBUTE_NOINLINE void Leaf(Traces& traces, int skip_count) {
+  traces.frame_pointers_depth =
+      GetStackTraceWithFramePointers(traces.frame_pointers, kMaxDepth,
+                                     skip_count);
+  traces.absl_depth = absl::GetStackTrace(traces.absl, kMaxDepth, skip_count);
+  ABSL_BLOCK_TAIL_CALL_OPTIMIZATION();
+}
+
+ABSL_ATTRIBUTE_NOINLINE void Middle(Traces& traces, int skip_count) {
+  Leaf(traces, skip_count);
+  ABSL_BLOCK_TAIL_CALL_OPTIMIZATION();
+}
+
+ABSL_ATTRIBUTE_NOINLINE void Outer(Traces& traces, int skip_count) {
+  Middle(traces, skip_count);
+  ABSL_BLOCK_TAIL_CALL_OPTIMIZATION();
+}
+
+bool Supported() {
+#if defined(__x86_64__) || defined(__aarch64__)
+  return true;
+#else
+  return false;
+#endif
+}
+
+TEST(FramePointerUnwinder, MatchesAbseil) {
+  if (!Supported()) {
+    GTEST_SKIP() << "Unsupported architecture";
+  }
+
+  Traces traces;
+  Outer(traces, 0);
+  ASSERT_GE(traces.frame_pointers_depth, 3);
+  ASSERT_GE(traces.absl_depth, 3);
+  // Both traces start with the return address into Middle, then Outer.
+  EXPECT_EQ(traces.frame_pointers[0], traces.absl[0]);
+  EXPECT_EQ(traces.frame_pointers[1], traces.absl[1]);
+}
+
+TEST(FramePointerUnwinder, SkipCount) {
+  if (!Supported()) {
+    GTEST_SKIP() << "Unsupported architecture";
+  }
+
+  Traces traces;
+  Outer(traces, 1);
+  ASSERT_GE(traces.frame_pointers_depth, 1);
+  ASSERT_GE(traces.absl_depth, 1);
+  EXPECT_EQ(traces.frame_pointers[0], traces.absl[0]);
+}
+
+TEST(FramePointerUnwinder, MaxDepth) {
+  void* stack[2];
+  EXPECT_LE(GetStackTraceWithFramePointers(stack, 2, 0), 2);
+  EXPECT_EQ(GetStackTraceWithFramePointers(stack, 0, 0), 0);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
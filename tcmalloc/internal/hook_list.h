@@ -22,8 +22,11 @@
 #ifndef TCMALLOC_INTERNAL_HOOK_LIST_H_
 #define TCMALLOC_INTERNAL_HOOK_LIST_H_
 
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <utility>
 
 #include "absl/base/attributes.h"
@@ -176,6 +179,119 @@ void HookList<T>::InvokeSlow(Args&&... args) const {
   }
 }
 
+// Counts the calls a thread makes towards a PeriodicHookList.
+struct PeriodicHookCountdown {
+  // Calls remaining until the next one the hooks may see.
+  int32_t remaining;
+  // Number of times remaining ran out since the thread started.
+  uint32_t rounds;
+};
+
+// PeriodicHookList: like HookList, for hooks that are only invoked for about
+// one in `period` calls on each thread.  Callers decrement a per-thread
+// PeriodicHookCountdown on their fast paths, and only call Invoke once it runs
+// out.  It then runs out every min_period() calls, and each hook is invoked
+// every period / min_period() rounds.
+template <typename T>
+class PeriodicHookList final : HookListBase {
+ public:
+  // While the list is empty, countdowns are reset to this, so that threads
+  // notice added hooks within as many calls.
+  static constexpr int32_t kEmptyRecheckPeriod = 4096;
+
+  constexpr PeriodicHookList() = default;
+
+  // Adds value, to be invoked for about one in period calls.  Returns false if
+  // value is invalid, period is 0, or there is no space left.
+  [[nodiscard]] bool Add(T value, uint32_t period)
+      ABSL_LOCKS_EXCLUDED(hooklist_spinlock_);
+
+  // Removes the first entry matching value.  Returns false if none does.
+  [[nodiscard]] bool Remove(T value) ABSL_LOCKS_EXCLUDED(hooklist_spinlock_);
+
+  // Resets countdown and invokes the hooks whose turn it is.
+  template <typename... Args>
+  void Invoke(PeriodicHookCountdown& countdown, Args&&... args) const
+      ABSL_ATTRIBUTE_COLD ABSL_ATTRIBUTE_NOINLINE;
+
+ private:
+  void UpdateMinPeriod() ABSL_EXCLUSIVE_LOCKS_REQUIRED(hooklist_spinlock_);
+
+  std::atomic<T> hooks_[kHookListMaxValues] = {};
+  std::atomic<uint32_t> periods_[kHookListMaxValues] = {};
+  // The smallest period of any hook, or 0 if there are none.
+  std::atomic<uint32_t> min_period_ = 0;
+};
+
+template <typename T>
+bool PeriodicHookList<T>::Add(T value, uint32_t period) {
+  if (value == T() || period == 0) {
+    return false;
+  }
+  absl::base_internal::SpinLockHolder l(hooklist_spinlock_);
+  for (int i = 0; i < kHookListMaxValues; ++i) {
+    if (hooks_[i].load(std::memory_order_relaxed) != T()) continue;
+    // Readers load the hook before its period.
+    periods_[i].store(period, std::memory_order_relaxed);
+    hooks_[i].store(value, std::memory_order_release);
+    UpdateMinPeriod();
+    return true;
+  }
+  return false;
+}
+
+template <typename T>
+bool PeriodicHookList<T>::Remove(T value) {
+  if (value == T()) {
+    return false;
+  }
+  absl::base_internal::SpinLockHolder l(hooklist_spinlock_);
+  for (int i = 0; i < kHookListMaxValues; ++i) {
+    if (hooks_[i].load(std::memory_order_relaxed) != value) continue;
+    hooks_[i].store(T(), std::memory_order_release);
+    UpdateMinPeriod();
+    return true;
+  }
+  return false;
+}
+
+template <typename T>
+void PeriodicHookList<T>::UpdateMinPeriod() {
+  uint32_t min_period = 0;
+  for (int i = 0; i < kHookListMaxValues; ++i) {
+    if (hooks_[i].load(std::memory_order_relaxed) == T()) continue;
+    const uint32_t period = periods_[i].load(std::memory_order_relaxed);
+    if (min_period == 0 || period < min_period) min_period = period;
+  }
+  min_period_.store(min_period, std::memory_order_relaxed);
+}
+
+template <typename T>
+template <typename... Args>
+void PeriodicHookList<T>::Invoke(PeriodicHookCountdown& countdown,
+                                 Args&&... args) const {
+  const uint32_t min_period = min_period_.load(std::memory_order_relaxed);
+  if (min_period == 0) {
+    countdown.remaining = kEmptyRecheckPeriod;
+    return;
+  }
+  // Reset the countdown first, as the hooks may allocate.
+  countdown.remaining = static_cast<int32_t>(std::min<uint32_t>(
+      min_period, std::numeric_limits<int32_t>::max()));
+  const uint32_t round = ++countdown.rounds;
+  for (int i = 0; i < kHookListMaxValues; ++i) {
+    const T hook = hooks_[i].load(std::memory_order_acquire);
+    if (hook == T()) continue;
+    const uint32_t every =
+        std::max<uint32_t>(periods_[i].load(std::memory_order_relaxed) /
+                               min_period,
+                           1);
+    if (round % every == 0) {
+      (*hook)(args...);
+    }
+  }
+}
+
 }  // namespace tcmalloc::tcmalloc_internal
 GOOGLE_MALLOC_SECTION_END
 
@@ -57,9 +57,8 @@ static constexpr int kMaxStackDepth = 64;
 // An opaque handle type used to identify allocations.
 using AllocHandle = MallocHook::AllocHandle;
 
-// size/depth are made the same size as a pointer so that some generic
-// code below can conveniently cast them back and forth to void*.
-struct StackTrace {
+// Everything recorded about a sampled allocation but its stack.
+struct StackTraceInfo {
   // An opaque handle used by allocator to uniquely identify the sampled
   // memory block.
   AllocHandle sampled_alloc_handle;
@@ -71,16 +70,28 @@ struct StackTrace {
 
   uint8_t access_hint;
   bool cold_allocated;
+  // The caller that passed the access hint, or nullptr if there was no hint.
+  const void* access_site = nullptr;
+
+  // Size class of the sampled object, or 0 if it was allocated from the page
+  // heap directly.
+  uint16_t size_class = 0;
 
   // weight is the expected number of *bytes* that were requested
   // between the previous sample and this one
   size_t weight;
 
+  // The mean number of bytes between samples when this one was taken.
+  int64_t sampling_interval = 0;
+
   // Timestamp of allocation.
   absl::Time allocation_time;
 
   TokenId token_id;
 
+  // The tenant of the allocating thread, see MallocExtension::SetCurrentTenant.
+  uint32_t tenant = 0;
+
   Profile::Sample::GuardedStatus guarded_status;
 
   // How the memory was allocated (new/malloc/etc.)
@@ -90,7 +101,11 @@ struct StackTrace {
   // sampled allocation. This may be nullptr for cases where it is not useful
   // for residency analysis such as for peakheapz.
   void* span_start_address = nullptr;
+};
 
+// size/depth are made the same size as a pointer so that some generic
+// code below can conveniently cast them back and forth to void*.
+struct StackTrace : StackTraceInfo {
   uintptr_t depth;  // Number of PC values stored in array below
   // Place stack as last member because it might not all be accessed.
   void* stack[kMaxStackDepth];
@@ -27,6 +27,20 @@ absl::string_view MemoryTagToLabel(MemoryTag tag) {
       return "NORMAL";
     case MemoryTag::kNormalP1:
       return "NORMAL_P1";
+    case MemoryTag::kNormalP2:
+      return "NORMAL_P2";
+    case MemoryTag::kNormalP3:
+      return "NORMAL_P3";
+    case MemoryTag::kNormalP4:
+      return "NORMAL_P4";
+    case MemoryTag::kNormalP5:
+      return "NORMAL_P5";
+    case MemoryTag::kNormalP6:
+      return "NORMAL_P6";
+    case MemoryTag::kNormalP7:
+      return "NORMAL_P7";
+    case MemoryTag::kSizeClassed:
+      return "SIZE_CLASSED";
     case MemoryTag::kSampled:
       return "SAMPLED";
     case MemoryTag::kSampledP1:
@@ -18,6 +18,7 @@
 #include <algorithm>
 #include <cstdint>
 
+#include "absl/numeric/bits.h"
 #include "absl/strings/string_view.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -35,21 +36,90 @@ enum class MemoryTag : uint8_t {
   kNormalP1 = kSanitizerAddressSpace ? 0xff : 0x6,
   // Normal memory
   kNormal = kNormalP0,
+  // Normal memory, partition 0, in per-size-class regions.  See
+  // SizeClassFromRegion.
+  kSizeClassed = kSanitizerAddressSpace ? 0xfe : 0x5,
   // Cold
   kCold = 0x2,
   // Metadata
   kMetadata = 0x3,
+  // Normal memory, security partitions 2 to 7.  Only used when more than two
+  // security partitions are compiled in.  See NormalPartitionTag.
+  kNormalP2 = kSanitizerAddressSpace ? 0xf0 : 0xc,
+  kNormalP3 = kSanitizerAddressSpace ? 0xf1 : 0xe,
+  kNormalP4 = kSanitizerAddressSpace ? 0xf2 : 0x14,
+  kNormalP5 = kSanitizerAddressSpace ? 0xf3 : 0x16,
+  kNormalP6 = kSanitizerAddressSpace ? 0xf4 : 0x1c,
+  kNormalP7 = kSanitizerAddressSpace ? 0xf5 : 0x1e,
 };
 
+// Each doubling of the security partitions beyond two adds a tag bit above
+// the three that the other tags use.
+inline constexpr uintptr_t kTagBits =
+    kSanitizerAddressSpace ? 2
+                           : 2 + absl::bit_width(kMaxSecurityPartitions - 1);
 inline constexpr uintptr_t kTagShift = std::min(kAddressBits - 4, 42);
-inline constexpr uintptr_t kTagMask =
-    uintptr_t{kSanitizerAddressSpace ? 0x3 : 0x7} << kTagShift;
+inline constexpr uintptr_t kTagMask = ((uintptr_t{1} << kTagBits) - 1)
+                                      << kTagShift;
+// The tag must stay clear of the top address bit, which belongs to the kernel.
+static_assert(kSanitizerAddressSpace ||
+              kTagShift + kTagBits <= static_cast<uintptr_t>(kAddressBits) - 1);
+
+// Normal memory of partition p is tagged with bit 2 set, the low bit of p in
+// bit 1, and the remaining bits of p from bit 3 up.  This keeps kNormalP0 and
+// kNormalP1 as they were, keeps bit 2 as the "normal" bit that IsNormalMemory
+// tests, and lets NormalTagPartition decode the partition without branches.
+inline constexpr MemoryTag NormalPartitionTag(size_t partition) {
+  return static_cast<MemoryTag>(static_cast<uintptr_t>(MemoryTag::kNormalP0) |
+                                ((partition & 1) << 1) |
+                                ((partition >> 1) << 3));
+}
+
+// Returns the partition of a normal tag.  kSizeClassed decodes as partition 0.
+inline constexpr size_t NormalTagPartition(MemoryTag tag) {
+  const size_t t = static_cast<size_t>(tag);
+  return ((t >> 1) & 1) | ((t >> 2) & ~size_t{1});
+}
+
+inline constexpr bool IsNormalPartitionTag(MemoryTag tag) {
+  return (static_cast<size_t>(tag) & static_cast<size_t>(MemoryTag::kNormal)) !=
+         0;
+}
+
+static_assert(kSanitizerAddressSpace ||
+              (NormalPartitionTag(0) == MemoryTag::kNormalP0 &&
+               NormalPartitionTag(1) == MemoryTag::kNormalP1 &&
+               NormalPartitionTag(2) == MemoryTag::kNormalP2 &&
+               NormalPartitionTag(7) == MemoryTag::kNormalP7 &&
+               NormalTagPartition(MemoryTag::kNormalP5) == 5));
 
 inline MemoryTag GetMemoryTag(const void* ptr) {
   return static_cast<MemoryTag>((reinterpret_cast<uintptr_t>(ptr) & kTagMask) >>
                                 kTagShift);
 }
 
+// kSizeClassed memory is further split into kMaxSizeClassRegions regions by
+// the address bits just below the tag.  Spans in region i only ever hold
+// objects of size class i, so that deallocation can recover the size class
+// from the address alone.  Region 0 is never used, as size class 0 denotes
+// pages without a size class.
+inline constexpr uintptr_t kSizeClassRegionBits = 4;
+inline constexpr size_t kMaxSizeClassRegions =
+    kSanitizerAddressSpace ? 1 : size_t{1} << kSizeClassRegionBits;
+inline constexpr uintptr_t kSizeClassRegionShift =
+    kTagShift - kSizeClassRegionBits;
+inline constexpr uintptr_t kSizeClassRegionMask =
+    (uintptr_t{1} << kTagShift) - (uintptr_t{1} << kSizeClassRegionShift);
+inline constexpr uintptr_t kSizeClassedTagMask =
+    static_cast<uintptr_t>(MemoryTag::kSizeClassed) << kTagShift;
+
+// Returns the size class region of ptr.  Only meaningful for kSizeClassed
+// memory.
+inline size_t SizeClassFromRegion(const void* ptr) {
+  return (reinterpret_cast<uintptr_t>(ptr) & kSizeClassRegionMask) >>
+         kSizeClassRegionShift;
+}
+
 inline bool IsNormalMemory(const void* ptr) {
   // This is slightly faster than checking kNormalP0/P1 separetly.
   static_assert((static_cast<uint8_t>(MemoryTag::kNormalP0) &
@@ -59,7 +129,10 @@ inline bool IsNormalMemory(const void* ptr) {
   bool res = (static_cast<uintptr_t>(GetMemoryTag(ptr)) &
               static_cast<uintptr_t>(MemoryTag::kNormal)) != 0;
   TC_ASSERT(res == (GetMemoryTag(ptr) == MemoryTag::kNormalP0 ||
-                    GetMemoryTag(ptr) == MemoryTag::kNormalP1),
+                    GetMemoryTag(ptr) == MemoryTag::kNormalP1 ||
+                    GetMemoryTag(ptr) == MemoryTag::kSizeClassed ||
+                    (kMaxSecurityPartitions > 2 &&
+                     NormalTagPartition(GetMemoryTag(ptr)) > 1)),
             "ptr=%p res=%d tag=%d", ptr, res,
             static_cast<int>(GetMemoryTag(ptr)));
   return res;
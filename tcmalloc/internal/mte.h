@@ -0,0 +1,138 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_INTERNAL_MTE_H_
+#define TCMALLOC_INTERNAL_MTE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tcmalloc/internal/config.h"
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <sys/prctl.h>
+#endif
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Support for Arm's Memory Tagging Extension.  Memory mapped with PROT_MTE
+// carries a 4-bit tag per kMteGranule bytes, and loads and stores through a
+// pointer whose tag (in bits 56-59, ignored by address translation) differs
+// from the memory's fault.  Tag 0 is never handed out, so that untagged
+// pointers keep working for memory whose tags were reset to 0.
+#if defined(__aarch64__) && defined(__linux__)
+inline constexpr bool kMteSupported = true;
+#else
+inline constexpr bool kMteSupported = false;
+#endif
+
+inline constexpr size_t kMteGranule = 16;
+inline constexpr uintptr_t kMteTagShift = 56;
+inline constexpr uintptr_t kMteTagMask =
+    kMteSupported ? uintptr_t{0xf} << kMteTagShift : 0;
+// Not defined by older <sys/mman.h>.
+inline constexpr int kProtMte = kMteSupported ? 0x20 : 0;
+
+// Returns p without its MTE tag.
+inline void* MteUntag(void* p) {
+  return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(p) &
+                                 ~kMteTagMask);
+}
+inline const void* MteUntag(const void* p) {
+  return reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(p) &
+                                       ~kMteTagMask);
+}
+
+inline bool MteTagged(const void* p) {
+  return (reinterpret_cast<uintptr_t>(p) & kMteTagMask) != 0;
+}
+
+// Enables synchronous tag checks for the calling thread, and the threads it
+// creates afterwards.  Returns false if the CPU or kernel lacks MTE.
+inline bool MteEnableTagChecks() {
+#if defined(__aarch64__) && defined(__linux__)
+  // Not defined by older kernel headers.
+  constexpr unsigned long kHwcap2Mte = 1 << 18;
+  constexpr unsigned long kPrSetTaggedAddrCtrl = 55;
+  constexpr unsigned long kPrTaggedAddrEnable = 1 << 0;
+  constexpr unsigned long kPrMteTcfSync = 1 << 1;
+  constexpr unsigned long kPrMteTagShift = 3;
+  if ((getauxval(AT_HWCAP2) & kHwcap2Mte) == 0) return false;
+  // Let IRG generate any tag but 0.
+  const unsigned long ctrl = kPrTaggedAddrEnable | kPrMteTcfSync |
+                             (0xfffeUL << kPrMteTagShift);
+  return prctl(kPrSetTaggedAddrCtrl, ctrl, 0, 0, 0) == 0;
+#else
+  return false;
+#endif
+}
+
+// Returns p with a random tag other than 0 and p's own.
+inline void* MteRandomTag(void* p) {
+#if defined(__aarch64__) && defined(__linux__)
+  const uint64_t exclude =
+      1 | (uint64_t{1} << ((reinterpret_cast<uintptr_t>(p) & kMteTagMask) >>
+                           kMteTagShift));
+  void* tagged;
+  __asm__ __volatile__(
+      ".arch_extension memtag\n"
+      "irg %0, %1, %2"
+      : "=r"(tagged)
+      : "r"(p), "r"(exclude));
+  return tagged;
+#else
+  return p;
+#endif
+}
+
+// Sets the tags of [p, p + size) to p's tag, two granules per instruction.
+// The caller must own the memory; its contents are left alone.
+//
+// REQUIRES: p and size are multiples of kMteGranule
+inline void MteSetTags(void* p, size_t size) {
+#if defined(__aarch64__) && defined(__linux__)
+  // STGM, which tags a whole cache line at once, is only available at EL1.
+  char* q = static_cast<char*>(p);
+  char* const end = q + size;
+  for (; end - q >= 2 * static_cast<ptrdiff_t>(kMteGranule);
+       q += 2 * kMteGranule) {
+    __asm__ __volatile__(
+        ".arch_extension memtag\n"
+        "st2g %0, [%0]"
+        :
+        : "r"(q)
+        : "memory");
+  }
+  if (q != end) {
+    __asm__ __volatile__(
+        ".arch_extension memtag\n"
+        "stg %0, [%0]"
+        :
+        : "r"(q)
+        : "memory");
+  }
+#else
+  (void)p;
+  (void)size;
+#endif
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_INTERNAL_MTE_H_
@@ -51,31 +51,13 @@ int OpenSysfsCpulist(size_t node) {
   return signal_safe_open(path, O_RDONLY | O_CLOEXEC);
 }
 
-bool InitNumaTopology(size_t cpu_to_scaled_partition[kMaxCpus],
-                      uint64_t* const partition_to_nodes,
-                      NumaBindMode* const bind_mode,
-                      const size_t num_partitions, const size_t scale_by,
-                      absl::FunctionRef<int(size_t)> open_node_cpulist,
-                      size_t* num_nodes) {
-  // Node 0 will always map to partition 0; record it here in case the system
-  // doesn't support NUMA or the user opts out of our awareness of it - in
-  // either case we'll record nothing in the loop below.
-
-  const char* e =
-      tcmalloc::tcmalloc_internal::thread_safe_getenv("TCMALLOC_NUMA_AWARE");
-
-  partition_to_nodes[NodeToPartition(0, num_partitions)] |= 1 << 0;
-  *num_nodes = 1;
-
-  // We rely on rseq to quickly obtain a CPU ID & lookup the appropriate
-  // partition in NumaTopology::GetCurrentPartition(). If rseq is unavailable,
-  // disable NUMA awareness.
-  if (!subtle::percpu::IsFast()) return false;
-
+bool WantNumaAwareness(NumaBindMode* const bind_mode) {
   // Honor default_want_numa_aware() to allow compile time configuration of
   // whether to enable NUMA awareness by default, and allow the user to
   // override that either way by setting TCMALLOC_NUMA_AWARE in the
   // environment.
+  const char* e =
+      tcmalloc::tcmalloc_internal::thread_safe_getenv("TCMALLOC_NUMA_AWARE");
   bool enabled = true;
   if (e == nullptr) {
     // Enable NUMA awareness iff default_want_numa_aware().
@@ -97,6 +79,28 @@ bool InitNumaTopology(size_t cpu_to_scaled_partition[kMaxCpus],
   } else {
     TC_BUG("bad TCMALLOC_NUMA_AWARE env var '%s'", e);
   }
+  return enabled;
+}
+
+bool InitNumaTopology(size_t cpu_to_scaled_partition[kMaxCpus],
+                      uint8_t cpu_to_node[kMaxCpus],
+                      uint64_t* const partition_to_nodes,
+                      NumaBindMode* const bind_mode,
+                      const size_t num_partitions, const size_t scale_by,
+                      absl::FunctionRef<int(size_t)> open_node_cpulist,
+                      size_t* num_nodes) {
+  // Node 0 will always map to partition 0; record it here in case the system
+  // doesn't support NUMA or the user opts out of our awareness of it - in
+  // either case we'll record nothing in the loop below.
+  partition_to_nodes[NodeToPartition(0, num_partitions)] |= 1 << 0;
+  *num_nodes = 1;
+
+  // We rely on rseq to quickly obtain a CPU ID & lookup the appropriate
+  // partition in NumaTopology::GetCurrentPartition(). If rseq is unavailable,
+  // disable NUMA awareness.
+  if (!subtle::percpu::IsFast()) return false;
+
+  const bool enabled = WantNumaAwareness(bind_mode);
 
   // The cpu_to_scaled_partition array has a fixed size so that we can
   // statically allocate it & avoid the need to check whether it has been
@@ -128,9 +132,9 @@ bool InitNumaTopology(size_t cpu_to_scaled_partition[kMaxCpus],
     const size_t partition = NodeToPartition(node, num_partitions);
     partition_to_nodes[partition] |= 1 << node;
 
-    // cpu_to_scaled_partition_ entries are default initialized to zero, so
-    // skip redundantly parsing CPU lists for nodes that map to partition 0.
-    if (partition == 0) {
+    // cpu_to_scaled_partition_ and cpu_to_node_ entries are default
+    // initialized to zero, so skip redundantly parsing the CPU list of node 0.
+    if (node == 0) {
       signal_safe_close(fd);
       continue;
     }
@@ -145,16 +149,17 @@ bool InitNumaTopology(size_t cpu_to_scaled_partition[kMaxCpus],
     // providing.
     TC_CHECK(node_cpus.has_value());
 
-    // Assign local CPUs to the appropriate partition.
+    // Assign local CPUs to the appropriate node and partition.
     for (size_t cpu = 0; cpu < kMaxCpus; cpu++) {
       if (node_cpus->IsSet(cpu)) {
         cpu_to_scaled_partition[cpu + kNumaCpuFudge] = partition * scale_by;
+        cpu_to_node[cpu + kNumaCpuFudge] = node;
       }
     }
 
     // If we observed any CPUs for this node then we've now got CPUs assigned
     // to a non-zero partition; report that we're NUMA aware.
-    if (node_cpus->Count() != 0) {
+    if (partition != 0 && node_cpus->Count() != 0) {
       numa_aware = true;
     }
 
@@ -87,8 +87,16 @@ class NumaTopology {
 
   // Initialize topology information. This must be called only once, before any
   // of the functions below.
+  //
+  // When NUMA awareness is disabled, Init() skips reading the topology from
+  // sysfs, which most short-lived processes would never look at, and the
+  // functions below report a single node until ScanDeferred() is called.
   void Init();
 
+  // Reads the topology that Init() skipped, if it did.  This must be called at
+  // most once, and not concurrently with any of the functions below.
+  void ScanDeferred();
+
   // Like Init(), but allows a test to specify a different `open_node_cpulist`
   // function in order to provide NUMA topology information that doesn't
   // reflect the system we're running upon.
@@ -144,6 +152,19 @@ class NumaTopology {
   // specified NUMA `partition`.
   uint64_t GetPartitionNodes(int partition) const;
 
+  // Return the NUMA node to which `cpu` belongs.  As with GetCpuPartition(),
+  // this is available even when NUMA awareness is disabled, and node 0 is
+  // returned for subtle::percpu::kCpuIdUninitialized or kCpuIdUnsupported.
+  size_t GetCpuNode(int cpu) const;
+
+  // Return the NUMA node of the CPU we're currently executing upon, or 0 if
+  // NUMA awareness is disabled.
+  size_t GetCurrentNode() const;
+
+  // Return the NUMA partition to which `node` belongs, or 0 if NUMA awareness
+  // is disabled.
+  size_t GetNodePartition(size_t node) const;
+
  private:
   // Maps from NUMA partition to a bitmap of NUMA nodes within the partition.
   uint64_t partition_to_nodes_[kNumInternalPartitions] = {0};
@@ -153,6 +174,8 @@ class NumaTopology {
   NumaBindMode bind_mode_ = NumaBindMode::kAdvisory;
   // The number of NUMA nodes detected in the system.
   size_t num_nodes_ = 1;
+  // Whether Init() left the sysfs scan to ScanDeferred().
+  bool scan_deferred_ = false;
 
   // We maintain two sets of CPU-to-partition information.  One is
   // unconditionally available in cpu_to_scaled_partition_.
@@ -166,6 +189,9 @@ class NumaTopology {
 
   static constexpr size_t kCpuMapSize = kMaxCpus + kNumaCpuFudge;
   std::array<size_t, kCpuMapSize> cpu_to_scaled_partition_ = {};
+  // Maps from CPU number (plus kNumaCpuFudge) to NUMA node.  Unlike partitions,
+  // nodes are only used off the fast path, so this is not gated.
+  std::array<uint8_t, kCpuMapSize> cpu_to_node_ = {};
   // Maps from CPU number (plus kNumaCpuFudge) to NUMA partition.
   // If NUMA awareness is not enabled, allocate array of 0 size to not waste
   // space, we shouldn't access it. Place it as the last member, so that ASan
@@ -180,6 +206,11 @@ class NumaTopology {
 // returns the file descriptor.
 int OpenSysfsCpulist(size_t node);
 
+// Returns whether NUMA awareness is wanted, per default_want_numa_aware() and
+// the TCMALLOC_NUMA_AWARE environment variable, and updates *bind_mode to any
+// binding behavior the latter asks for.
+bool WantNumaAwareness(NumaBindMode* bind_mode);
+
 // Initialize the data members of a NumaTopology<> instance.
 //
 // This function must only be called once per NumaTopology<> instance, and
@@ -191,6 +222,7 @@ int OpenSysfsCpulist(size_t node);
 // Returns true if we're actually NUMA aware; i.e. if we have CPUs mapped to
 // multiple partitions.
 bool InitNumaTopology(size_t cpu_to_scaled_partition[kMaxCpus],
+                      uint8_t cpu_to_node[kMaxCpus],
                       uint64_t* partition_to_nodes, NumaBindMode* bind_mode,
                       size_t num_partitions, size_t scale_by,
                       absl::FunctionRef<int(size_t)> open_node_cpulist,
@@ -208,9 +240,17 @@ inline void NumaTopology<NumPartitions, ScaleBy>::Init() {
                         sizeof(*gated_cpu_to_scaled_partition_.data()) >=
                     sizeof(NumaTopology),
                 "cpu_to_scaled_partition_ is not the last field");
+  if (subtle::percpu::IsFast() && !WantNumaAwareness(&bind_mode_)) {
+    // InitNumaTopology() would return false; the scan only fills in the
+    // ungated maps, so leave it until someone needs them.
+    partition_to_nodes_[0] |= 1 << 0;
+    scan_deferred_ = true;
+    return;
+  }
   numa_aware_ = InitNumaTopology(
-      cpu_to_scaled_partition_.data(), partition_to_nodes_, &bind_mode_,
-      kNumInternalPartitions, ScaleBy, OpenSysfsCpulist, &num_nodes_);
+      cpu_to_scaled_partition_.data(), cpu_to_node_.data(), partition_to_nodes_,
+      &bind_mode_, kNumInternalPartitions, ScaleBy, OpenSysfsCpulist,
+      &num_nodes_);
   if constexpr (NumPartitions > 1) {
     if (numa_aware_) {
       gated_cpu_to_scaled_partition_ = cpu_to_scaled_partition_;
@@ -222,8 +262,9 @@ template <size_t NumPartitions, size_t ScaleBy>
 inline void NumaTopology<NumPartitions, ScaleBy>::InitForTest(
     absl::FunctionRef<int(size_t)> open_node_cpulist) {
   numa_aware_ = InitNumaTopology(
-      cpu_to_scaled_partition_.data(), partition_to_nodes_, &bind_mode_,
-      kNumInternalPartitions, ScaleBy, open_node_cpulist, &num_nodes_);
+      cpu_to_scaled_partition_.data(), cpu_to_node_.data(), partition_to_nodes_,
+      &bind_mode_, kNumInternalPartitions, ScaleBy, open_node_cpulist,
+      &num_nodes_);
   if constexpr (NumPartitions > 1) {
     if (numa_aware_) {
       gated_cpu_to_scaled_partition_ = cpu_to_scaled_partition_;
@@ -231,6 +272,17 @@ inline void NumaTopology<NumPartitions, ScaleBy>::InitForTest(
   }
 }
 
+template <size_t NumPartitions, size_t ScaleBy>
+inline void NumaTopology<NumPartitions, ScaleBy>::ScanDeferred() {
+  if (!scan_deferred_) return;
+  scan_deferred_ = false;
+  NumaBindMode unused_bind_mode;
+  (void)InitNumaTopology(cpu_to_scaled_partition_.data(), cpu_to_node_.data(),
+                         partition_to_nodes_, &unused_bind_mode,
+                         kNumInternalPartitions, ScaleBy, OpenSysfsCpulist,
+                         &num_nodes_);
+}
+
 template <size_t NumPartitions, size_t ScaleBy>
 inline size_t NumaTopology<NumPartitions, ScaleBy>::GetCurrentPartition()
     const {
@@ -265,6 +317,25 @@ inline uint64_t NumaTopology<NumPartitions, ScaleBy>::GetPartitionNodes(
   return partition_to_nodes_[partition];
 }
 
+template <size_t NumPartitions, size_t ScaleBy>
+inline size_t NumaTopology<NumPartitions, ScaleBy>::GetCpuNode(
+    const int cpu) const {
+  return cpu_to_node_[cpu + kNumaCpuFudge];
+}
+
+template <size_t NumPartitions, size_t ScaleBy>
+inline size_t NumaTopology<NumPartitions, ScaleBy>::GetCurrentNode() const {
+  if (!numa_aware()) return 0;
+  return GetCpuNode(subtle::percpu::GetRealCpuUnsafe());
+}
+
+template <size_t NumPartitions, size_t ScaleBy>
+inline size_t NumaTopology<NumPartitions, ScaleBy>::GetNodePartition(
+    const size_t node) const {
+  if (!numa_aware()) return 0;
+  return NodeToPartition(node, kNumInternalPartitions);
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
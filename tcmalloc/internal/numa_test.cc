@@ -19,12 +19,14 @@
 #include <sched.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <syscall.h>
 #include <unistd.h>
 
 #include <algorithm>
 #include <new>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -197,6 +199,27 @@ TEST_F(NumaTopologyTest, EmptyNode) {
   }
 }
 
+// Ensure that nodes sharing a partition can still be told apart.
+TEST_F(NumaTopologyTest, MoreNodesThanPartitions) {
+  std::vector<SyntheticCpuList> nodes;
+  nodes.emplace_back("0-3");
+  nodes.emplace_back("4-7");
+  nodes.emplace_back("8-11");
+  nodes.emplace_back("12-15");
+
+  const auto nt = CreateNumaTopology<2>(nodes);
+
+  EXPECT_EQ(nt.numa_aware(), true);
+  EXPECT_EQ(nt.active_partitions(), 2);
+  EXPECT_EQ(nt.num_nodes(), 4);
+
+  for (int cpu = 0; cpu < 16; cpu++) {
+    EXPECT_EQ(nt.GetCpuNode(cpu), cpu / 4);
+    EXPECT_EQ(nt.GetCpuPartition(cpu), cpu / 4 % 2);
+  }
+  EXPECT_EQ(nt.GetCpuNode(subtle::percpu::kCpuIdUninitialized), 0);
+}
+
 // Test that cpulists too long to fit into the 16 byte buffer used by
 // InitNumaTopology() parse successfully.
 TEST_F(NumaTopologyTest, LongCpuLists) {
@@ -249,6 +272,42 @@ TEST_F(NumaTopologyTest, Host) {
   }
 }
 
+// Ensure that with NUMA awareness disabled, Init() leaves the host's topology
+// to ScanDeferred(), which reads the same topology an eager scan does.
+TEST_F(NumaTopologyTest, HostDeferred) {
+  const char* const old_env = getenv("TCMALLOC_NUMA_AWARE");
+  const std::optional<std::string> saved_env =
+      old_env != nullptr ? std::optional<std::string>(old_env) : std::nullopt;
+  ASSERT_EQ(setenv("TCMALLOC_NUMA_AWARE", "0", /*overwrite=*/1), 0);
+
+  NumaTopology<4> deferred;
+  deferred.Init();
+  NumaTopology<4> eager;
+  eager.InitForTest(OpenSysfsCpulist);
+
+  if (saved_env.has_value()) {
+    ASSERT_EQ(setenv("TCMALLOC_NUMA_AWARE", saved_env->c_str(), 1), 0);
+  } else {
+    ASSERT_EQ(unsetenv("TCMALLOC_NUMA_AWARE"), 0);
+  }
+
+  EXPECT_FALSE(deferred.numa_aware());
+  EXPECT_EQ(deferred.num_nodes(), 1);
+
+  deferred.ScanDeferred();
+  EXPECT_FALSE(deferred.numa_aware());
+  EXPECT_EQ(deferred.num_nodes(), eager.num_nodes());
+  for (int cpu = 0, n = NumCPUs(); cpu < n; ++cpu) {
+    EXPECT_EQ(deferred.GetCpuPartition(cpu), eager.GetCpuPartition(cpu)) << cpu;
+    EXPECT_EQ(deferred.GetCpuNode(cpu), eager.GetCpuNode(cpu)) << cpu;
+  }
+  for (int partition = 0; partition < 4; ++partition) {
+    EXPECT_EQ(deferred.GetPartitionNodes(partition),
+              eager.GetPartitionNodes(partition))
+        << partition;
+  }
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -0,0 +1,118 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/internal/page_idle.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <optional>
+
+#include "absl/status/status.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/util.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+constexpr uint64_t kPagePresent = uint64_t{1} << 63;
+constexpr uint64_t kPfnMask = (uint64_t{1} << 55) - 1;
+
+// The bitmap is made of 64-bit words, which must be read and written whole.
+off_t BitmapOffset(uint64_t pfn) { return pfn / 64 * sizeof(uint64_t); }
+uint64_t BitmapBit(uint64_t pfn) { return uint64_t{1} << (pfn % 64); }
+
+}  // namespace
+
+PageIdle::PageIdle()
+    : pagemap_fd_(signal_safe_open("/proc/self/pagemap", O_RDONLY)),
+      bitmap_fd_(
+          signal_safe_open("/sys/kernel/mm/page_idle/bitmap", O_RDWR)) {}
+
+PageIdle::~PageIdle() {
+  if (pagemap_fd_ >= 0) signal_safe_close(pagemap_fd_);
+  if (bitmap_fd_ >= 0) signal_safe_close(bitmap_fd_);
+}
+
+template <typename F>
+absl::StatusCode PageIdle::ForEachResidentPage(const void* addr,
+                                               const size_t size, F f) {
+  if (pagemap_fd_ < 0 || bitmap_fd_ < 0) return absl::StatusCode::kUnavailable;
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(addr);
+  const uintptr_t end = begin + size;
+  uintptr_t page = begin & ~(kHardwarePageSize - 1);
+  while (page < end) {
+    const size_t num_pages = std::min<size_t>(
+        kEntriesInBuf,
+        (end - page + kHardwarePageSize - 1) / kHardwarePageSize);
+    const size_t to_read = num_pages * kPagemapEntrySize;
+    if (signal_safe_pread(pagemap_fd_, reinterpret_cast<char*>(buf_), to_read,
+                          page / kHardwarePageSize * kPagemapEntrySize) !=
+        to_read) {
+      return absl::StatusCode::kUnavailable;
+    }
+    for (size_t i = 0; i < num_pages; ++i, page += kHardwarePageSize) {
+      if ((buf_[i] & kPagePresent) == 0) continue;
+      const uint64_t pfn = buf_[i] & kPfnMask;
+      // Frame numbers read as zero without CAP_SYS_ADMIN.
+      if (pfn == 0) return absl::StatusCode::kUnavailable;
+      const size_t bytes = std::min(page + kHardwarePageSize, end) -
+                           std::max(page, begin);
+      if (absl::StatusCode status = f(pfn, bytes);
+          status != absl::StatusCode::kOk) {
+        return status;
+      }
+    }
+  }
+  return absl::StatusCode::kOk;
+}
+
+absl::StatusCode PageIdle::MarkIdle(const void* addr, size_t size) {
+  return ForEachResidentPage(addr, size, [&](uint64_t pfn, size_t) {
+    const uint64_t word = BitmapBit(pfn);
+    if (TCMALLOC_RETRY_ON_TEMP_FAILURE(pwrite(bitmap_fd_, &word, sizeof(word),
+                                              BitmapOffset(pfn))) !=
+        sizeof(word)) {
+      return absl::StatusCode::kUnavailable;
+    }
+    return absl::StatusCode::kOk;
+  });
+}
+
+std::optional<size_t> PageIdle::GetIdleBytes(const void* addr, size_t size) {
+  size_t idle_bytes = 0;
+  const absl::StatusCode status =
+      ForEachResidentPage(addr, size, [&](uint64_t pfn, size_t bytes) {
+        uint64_t word;
+        if (signal_safe_pread(bitmap_fd_, reinterpret_cast<char*>(&word),
+                              sizeof(word),
+                              BitmapOffset(pfn)) != sizeof(word)) {
+          return absl::StatusCode::kUnavailable;
+        }
+        if (word & BitmapBit(pfn)) idle_bytes += bytes;
+        return absl::StatusCode::kOk;
+      });
+  if (status != absl::StatusCode::kOk) return std::nullopt;
+  return idle_bytes;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
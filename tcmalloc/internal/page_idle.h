@@ -0,0 +1,91 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Idle page tracking, see
+// https://docs.kernel.org/admin-guide/mm/idle_page_tracking.html.  Resolving
+// virtual addresses to page frames requires CAP_SYS_ADMIN; without it, every
+// query fails with kUnavailable.
+
+#ifndef TCMALLOC_INTERNAL_PAGE_IDLE_H_
+#define TCMALLOC_INTERNAL_PAGE_IDLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <optional>
+
+#include "absl/status/status.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/page_size.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Base page idle class that may be mocked for testing.
+class PageIdleBase {
+ public:
+  PageIdleBase() = default;
+  virtual ~PageIdleBase() = default;
+  PageIdleBase(const PageIdleBase&) = delete;
+  PageIdleBase& operator=(const PageIdleBase&) = delete;
+
+  // Sets the idle bit of the resident pages of [addr, addr + size).  The
+  // kernel clears it again when the page is accessed.
+  virtual absl::StatusCode MarkIdle(const void* addr, size_t size) = 0;
+  // Returns how many bytes of [addr, addr + size) are on resident pages whose
+  // idle bit is still set, that is, which were not accessed since MarkIdle.
+  virtual std::optional<size_t> GetIdleBytes(const void* addr, size_t size) = 0;
+};
+
+// PageIdle resolves pages to their frames with /proc/self/pagemap, and reads
+// and sets their idle bits in /sys/kernel/mm/page_idle/bitmap.
+//
+// The kernel tracks the idle bit of transparent hugepages on their head page
+// only, so tail pages never read as idle: memory on hugepages is reported as
+// accessed.
+class PageIdle final : public PageIdleBase {
+ public:
+  // This class keeps open file handles to procfs and sysfs.  Destroy the
+  // object to reclaim them.
+  PageIdle();
+  ~PageIdle() override;
+
+  static void operator delete(void*) { __builtin_trap(); }
+
+  absl::StatusCode MarkIdle(const void* addr, size_t size) override;
+  std::optional<size_t> GetIdleBytes(const void* addr, size_t size) override;
+
+ private:
+  // Calls `f(pfn, bytes)` for each resident page overlapping [addr, addr +
+  // size), with the bytes of the range on that page.
+  template <typename F>
+  absl::StatusCode ForEachResidentPage(const void* addr, size_t size, F f);
+
+  static constexpr int kBufferLength = 4096;
+  static constexpr int kPagemapEntrySize = 8;
+  static constexpr int kEntriesInBuf = kBufferLength / kPagemapEntrySize;
+
+  const size_t kHardwarePageSize = GetPageSize();
+
+  uint64_t buf_[kEntriesInBuf];
+  const int pagemap_fd_;
+  const int bitmap_fd_;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_INTERNAL_PAGE_IDLE_H_
@@ -0,0 +1,79 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/internal/page_idle.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <optional>
+
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "tcmalloc/internal/page_size.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+TEST(PageIdleTest, MarkAndAccess) {
+  const size_t page_size = GetPageSize();
+  constexpr int kPages = 4;
+  const size_t size = kPages * page_size;
+  void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(p, MAP_FAILED);
+  // Idle bits of transparent hugepages are tracked on their head page only.
+  madvise(p, size, MADV_NOHUGEPAGE);
+  memset(p, 1, size);
+
+  PageIdle page_idle;
+  if (page_idle.MarkIdle(p, size) != absl::StatusCode::kOk) {
+    EXPECT_EQ(page_idle.GetIdleBytes(p, size), std::nullopt);
+    munmap(p, size);
+    GTEST_SKIP() << "Idle page tracking is not available";
+  }
+  EXPECT_EQ(page_idle.GetIdleBytes(p, size), size);
+  // Partial pages are counted by the bytes of the range on them.
+  EXPECT_EQ(
+      page_idle.GetIdleBytes(static_cast<char*>(p) + page_size / 2, page_size),
+      page_size);
+
+  // Accessing a page clears its idle bit.
+  static_cast<volatile char*>(p)[page_size] = 2;
+  EXPECT_EQ(page_idle.GetIdleBytes(p, size), size - page_size);
+
+  munmap(p, size);
+}
+
+TEST(PageIdleTest, NonResident) {
+  const size_t size = 4 * GetPageSize();
+  void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(p, MAP_FAILED);
+
+  PageIdle page_idle;
+  // Pages that were never touched are not resident and so never idle.
+  std::optional<size_t> idle = page_idle.GetIdleBytes(p, size);
+  if (idle.has_value()) {
+    EXPECT_EQ(*idle, 0);
+  }
+
+  munmap(p, size);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
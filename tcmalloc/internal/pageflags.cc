@@ -113,11 +113,13 @@ size_t PageFlags::GetOffset(const uintptr_t vaddr) {
   return vaddr / kHardwarePageSize * kPagemapEntrySize;
 }
 
-absl::StatusCode PageFlags::Seek(const uintptr_t vaddr) {
-  size_t offset = GetOffset(vaddr);
-  // Note: lseek can't be interrupted.
-  off_t status = ::lseek(fd_, offset, SEEK_SET);
-  if (status != offset) {
+absl::StatusCode PageFlags::Read(const uintptr_t vaddr, const size_t num_pages,
+                                 uint64_t* const buf) {
+  static_assert(sizeof(*buf) == kPagemapEntrySize);
+  const size_t to_read = num_pages * kPagemapEntrySize;
+  auto status = signal_safe_pread(fd_, reinterpret_cast<char*>(buf), to_read,
+                                  GetOffset(vaddr));
+  if (status != to_read) {
     return absl::StatusCode::kUnavailable;
   }
   return absl::StatusCode::kOk;
@@ -125,12 +127,8 @@ absl::StatusCode PageFlags::Seek(const uintptr_t vaddr) {
 
 absl::StatusCode PageFlags::MaybeReadOne(uintptr_t vaddr, uint64_t& flags,
                                          bool& is_huge) {
-  if (auto res = Seek(vaddr); res != absl::StatusCode::kOk) return res;
-  static_assert(sizeof(flags) == kPagemapEntrySize);
-  auto status = signal_safe_read(fd_, reinterpret_cast<char*>(&flags),
-                                 kPagemapEntrySize, nullptr);
-  if (status != kPagemapEntrySize) {
-    return absl::StatusCode::kUnavailable;
+  if (auto res = Read(vaddr, 1, &flags); res != absl::StatusCode::kOk) {
+    return res;
   }
 
   if (ABSL_PREDICT_FALSE((PageHead(flags) || PageTail(flags)) &&
@@ -140,14 +138,10 @@ absl::StatusCode PageFlags::MaybeReadOne(uintptr_t vaddr, uint64_t& flags,
   }
 
   if (PageTail(flags)) {
-    if (auto res = Seek(vaddr & kHugePageMask); res != absl::StatusCode::kOk) {
+    if (auto res = Read(vaddr & kHugePageMask, 1, &flags);
+        res != absl::StatusCode::kOk) {
       return res;
     }
-    auto status = signal_safe_read(fd_, reinterpret_cast<char*>(&flags),
-                                   kPagemapEntrySize, nullptr);
-    if (status != kPagemapEntrySize) {
-      return absl::StatusCode::kUnavailable;
-    }
     if (ABSL_PREDICT_FALSE(PageTail(flags))) {
       TC_LOG("Somehow still at tail page even after seeking?");
       return absl::StatusCode::kFailedPrecondition;
@@ -165,18 +159,15 @@ absl::StatusCode PageFlags::MaybeReadOne(uintptr_t vaddr, uint64_t& flags,
   return absl::StatusCode::kOk;
 }
 
-absl::StatusCode PageFlags::ReadMany(int64_t num_pages, PageStats& output) {
+absl::StatusCode PageFlags::ReadMany(uintptr_t vaddr, int64_t num_pages,
+                                     PageStats& output) {
   while (num_pages > 0) {
     const size_t batch_size = std::min<int64_t>(kEntriesInBuf, num_pages);
-    const size_t to_read = kPagemapEntrySize * batch_size;
-
-    // We read continuously. For the first read, this starts at wherever the
-    // first ReadOne ended. See above note for the reinterpret_cast.
-    auto status =
-        signal_safe_read(fd_, reinterpret_cast<char*>(buf_), to_read, nullptr);
-    if (status != to_read) {
-      return absl::StatusCode::kUnavailable;
+    if (auto res = Read(vaddr, batch_size, buf_);
+        res != absl::StatusCode::kOk) {
+      return res;
     }
+    vaddr += batch_size * kHardwarePageSize;
     for (int i = 0; i < batch_size; ++i) {
       uint64_t flags = buf_[i];
       if (PageHead(flags)) {
@@ -208,13 +199,8 @@ std::optional<bool> PageFlags::IsHugepageBacked(const void* const addr) {
   // Round address down to get the start of the first page that has any bytes
   // corresponding to the span [addr, addr+size).
   uintptr_t basePage = uaddr & ~(kHardwarePageSize - 1);
-  // Seek into fd.
-  if (auto res = Seek(basePage); res != absl::StatusCode::kOk) return false;
   // Read entry
-  static_assert(sizeof(flags) == kPagemapEntrySize);
-  auto status = signal_safe_read(fd_, reinterpret_cast<char*>(&flags),
-                                 kPagemapEntrySize, nullptr);
-  if (status != kPagemapEntrySize) {
+  if (auto res = Read(basePage, 1, &flags); res != absl::StatusCode::kOk) {
     return std::nullopt;
   }
   // pass entry to check if its hugepage backed.
@@ -270,6 +256,7 @@ std::optional<PageStats> PageFlags::Get(const void* const addr,
     return std::nullopt;
   }
   size_t firstPageSize = kHardwarePageSize - (uaddr - basePage);
+  uintptr_t nextPage = basePage + kHardwarePageSize;
   if (is_huge) {
     // The object starts in the middle of a native page, but the entire page
     // might be stale. So the situation looks like, simplifying to four native
@@ -306,20 +293,17 @@ std::optional<PageStats> PageFlags::Get(const void* const addr,
         firstPageSize + (pages_represented - 1) * kHardwarePageSize);
 
     // We've read one uint64_t about a single page, but it represents 512 small
-    // pages. So the next page that is of interest is one hugepage away -- seek
-    // to make sure the next read doesn't double-count the native pages in
-    // between the two head pages.
-    if (auto res = Seek((basePage & kHugePageMask) + kHugePageSize);
-        res != absl::StatusCode::kOk) {
-      return std::nullopt;
-    }
+    // pages. So the next page that is of interest is one hugepage away -- skip
+    // ahead to make sure the next read doesn't double-count the native pages
+    // in between the two head pages.
+    nextPage = (basePage & kHugePageMask) + kHugePageSize;
   } else {
     remainingPages--;
     MaybeAddToStats(ret, result_flags, firstPageSize);
   }
 
   // Handle all pages but the last page.
-  if (auto res = ReadMany(remainingPages - 1, ret);
+  if (auto res = ReadMany(nextPage, remainingPages - 1, ret);
       res != absl::StatusCode::kOk) {
     return std::nullopt;
   }
@@ -354,20 +338,10 @@ PageFlagsBase::PageFlagsBitmaps PageFlags::GetSinglePageBitmaps(
     return ret;
   }
 
-  auto res = Seek(currPage);
-  if (res != absl::StatusCode::kOk) {
-    ret.status = res;
-    return ret;
-  }
-
   const size_t kHardwarePagesInHugePage = kHugePageSize / GetPageSize();
-  const size_t kPagemapEntrySize = 8;
-  const size_t kSizeOfHugepageInPagemap =
-      kPagemapEntrySize * kHardwarePagesInHugePage;
 
-  auto status = signal_safe_read(fd_, reinterpret_cast<char*>(buf_),
-                                 kSizeOfHugepageInPagemap, nullptr);
-  if (status != kSizeOfHugepageInPagemap) {
+  if (Read(currPage, kHardwarePagesInHugePage, buf_) !=
+      absl::StatusCode::kOk) {
     TC_LOG("Could not read from pageflags file");
     ret.status = absl::StatusCode::kUnavailable;
     return ret;
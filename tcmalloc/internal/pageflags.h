@@ -113,18 +113,19 @@ class PageFlags final : public PageFlagsBase {
   // Returns the offset in the pageflags file for the given virtual address.
   size_t GetOffset(uintptr_t vaddr);
 
-  // This helper seeks the internal file to the correct location for the given
-  // virtual address.
-  [[nodiscard]] absl::StatusCode Seek(uintptr_t vaddr);
+  // Reads the entries of `num_pages` pages starting at `vaddr` into `buf`,
+  // with a single pread.  Returns kUnavailable if they cannot all be read.
+  [[nodiscard]] absl::StatusCode Read(uintptr_t vaddr, size_t num_pages,
+                                      uint64_t* buf);
 
   // Tries to read staleness information about the page that contains vaddr.
   // Possibly seeks backwards in an effort to find head hugepages.
   absl::StatusCode MaybeReadOne(uintptr_t vaddr, uint64_t& flags,
                                 bool& is_huge);
   // This helper reads staleness information for `num_pages` worth of _full_
-  // pages and puts the results into `output`. It continues the read from the
-  // last Seek() or last Read operation.
-  absl::StatusCode ReadMany(int64_t num_pages, PageStats& output);
+  // pages starting at `vaddr` and puts the results into `output`.
+  absl::StatusCode ReadMany(uintptr_t vaddr, int64_t num_pages,
+                            PageStats& output);
 
   static constexpr const char* kKstaledScanSeconds =
       "/sys/kernel/mm/kstaled/scan_seconds";
@@ -71,6 +71,7 @@ ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetResizeSizeClassMaxCapacityEnabled(
     bool v);
 ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPrioritizeSpansEnabled(bool v);
 ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetMaxPerCpuCacheSize(int32_t v);
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetMaxPerCpuColdCacheSize(int32_t v);
 ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetMaxTotalThreadCacheBytes(
     int64_t v);
 ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPeakSamplingHeapGrowthFraction(
@@ -95,6 +96,126 @@ ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetMinHotAccessHint(uint8_t v);
 ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesDynamicSlabEnabled();
 ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPerCpuCachesDynamicSlabEnabled(
     bool v);
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPerCpuCachesDynamicSlabGrowThreshold(double v);
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPerCpuCachesDynamicSlabShrinkThreshold(double v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesL3AwareStealing();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPerCpuCachesL3AwareStealing(
+    bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesRankedShuffle();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPerCpuCachesRankedShuffle(
+    bool v);
+ABSL_ATTRIBUTE_WEAK bool
+TCMalloc_Internal_GetPerCpuCachesDynamicSlabWorkingSet();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPerCpuCachesDynamicSlabWorkingSet(
+    bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesPredictiveRefill();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPerCpuCachesPredictiveRefill(
+    bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetTransferCacheFlowSizing();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetTransferCacheFlowSizing(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesCapacityController();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPerCpuCachesCapacityController(
+    bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesCgroupAware();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPerCpuCachesCgroupAware(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetThreadCacheAdaptiveSizing();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetThreadCacheAdaptiveSizing(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesIncrementalDrain();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPerCpuCachesIncrementalDrain(
+    bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesIndirect();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPerCpuCachesIndirect(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesResetAfterFork();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPerCpuCachesResetAfterFork(
+    bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetLargeSpanCache();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetLargeSpanCache(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetBackgroundAdaptivePacing();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetBackgroundAdaptivePacing(bool v);
+ABSL_ATTRIBUTE_WEAK int32_t TCMalloc_Internal_GetAutoTunerCpuWeight();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetAutoTunerCpuWeight(int32_t v);
+ABSL_ATTRIBUTE_WEAK int32_t TCMalloc_Internal_GetNumaRemoteBorrowBatches();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetNumaRemoteBorrowBatches(
+    int32_t v);
+ABSL_ATTRIBUTE_WEAK int32_t TCMalloc_Internal_GetRefillPrefetchObjects();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetRefillPrefetchObjects(int32_t v);
+ABSL_ATTRIBUTE_WEAK int32_t TCMalloc_Internal_GetHugePageCollapseBudgetUs();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetHugePageCollapseBudgetUs(
+    int32_t v);
+ABSL_ATTRIBUTE_WEAK int32_t TCMalloc_Internal_GetSlowPathLatencySamplePeriod();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetSlowPathLatencySamplePeriod(
+    int32_t v);
+ABSL_ATTRIBUTE_WEAK int32_t TCMalloc_Internal_GetProfileSamplingTargetRate();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetProfileSamplingTargetRate(
+    int32_t v);
+ABSL_ATTRIBUTE_WEAK int64_t TCMalloc_Internal_GetGiganticPageThreshold();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetGiganticPageThreshold(int64_t v);
+ABSL_ATTRIBUTE_WEAK int64_t TCMalloc_Internal_GetEagerPopulateThreshold();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetEagerPopulateThreshold(int64_t v);
+ABSL_ATTRIBUTE_WEAK int32_t TCMalloc_Internal_GetFarMemoryNumaNode();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetFarMemoryNumaNode(int32_t v);
+ABSL_ATTRIBUTE_WEAK int32_t TCMalloc_Internal_GetCgroupMemoryLimitPercent();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetCgroupMemoryLimitPercent(
+    int32_t v);
+ABSL_ATTRIBUTE_WEAK int32_t TCMalloc_Internal_GetCentralFreeListMaxShards();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetCentralFreeListMaxShards(
+    int32_t v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetNumaReturnRemoteFrees();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetNumaReturnRemoteFrees(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetSpanLifetimePrediction();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetSpanLifetimePrediction(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetAccessHintReclassification();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetAccessHintReclassification(
+    bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetMemoryPressureRelease();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetMemoryPressureRelease(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetAllocationRateHistory();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetAllocationRateHistory(bool v);
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_GetPeakHeapBucketInterval(
+    absl::Duration* v);
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPeakHeapBucketInterval(
+    absl::Duration v);
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_GetColdPageOutIdleTime(
+    absl::Duration* v);
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetColdPageOutIdleTime(
+    absl::Duration v);
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_GetLeakCandidateMinAge(
+    absl::Duration* v);
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetLeakCandidateMinAge(
+    absl::Duration v);
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_GetSlowAllocationThreshold(
+    absl::Duration* v);
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetSlowAllocationThreshold(
+    absl::Duration v);
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_GetAccessHeatmapInterval(
+    absl::Duration* v);
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetAccessHeatmapInterval(
+    absl::Duration v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetFramePointerUnwinding();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetFramePointerUnwinding(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPrefaultPagemapLeaves();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPrefaultPagemapLeaves(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetCentralFreelistEmptySpans();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetCentralFreelistEmptySpans(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetSpanMeshEstimation();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetSpanMeshEstimation(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetCentralFreelistSpanSharing();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetCentralFreelistSpanSharing(
+    bool v);
+ABSL_ATTRIBUTE_WEAK bool
+TCMalloc_Internal_GetCentralFreelistAdaptiveSpanLength();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetCentralFreelistAdaptiveSpanLength(bool v);
+ABSL_ATTRIBUTE_WEAK bool
+TCMalloc_Internal_GetHugepageAlignedLargeAllocations();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetHugepageAlignedLargeAllocations(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetDeterministic();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetDeterministic(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetLimitShrinksCaches();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetLimitShrinksCaches(bool v);
 
 ABSL_ATTRIBUTE_WEAK tcmalloc::tcmalloc_internal::MadvisePreference
 TCMalloc_Internal_GetMadvise();
@@ -113,6 +234,9 @@ ABSL_ATTRIBUTE_WEAK bool
 TCMalloc_Internal_GetHugeRegionAdaptiveReleaseEnabled();
 ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetHugeRegionAdaptiveReleaseEnabled(
     bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetHugeRegionDemandBasedRelease();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetHugeRegionDemandBasedRelease(
+    bool v);
 ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetReleaseMaxColdPages();
 ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetReleaseMaxColdPages(bool v);
 
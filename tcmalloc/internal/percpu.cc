@@ -26,6 +26,7 @@
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
+#include <cstring>
 #include <limits>
 #include <optional>
 
@@ -36,6 +37,7 @@
 #include "tcmalloc/experiment_config.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/cpu_utils.h"
+#include "tcmalloc/internal/environment.h"
 #include "tcmalloc/internal/linux_syscall_support.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/optimization.h"
@@ -74,18 +76,20 @@ static bool InitThreadPerCpu() {
     return true;
   }
 
-  // Mask signals and double check thread registration afterwards.  If we
-  // encounter a signal between ThreadRegistered() above and rseq() and that
-  // signal initializes per-CPU, rseq() here will fail with EBUSY.
-  ScopedSigmask mask;
-
-  if (IsFastNoInit()) {
+#if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ && defined(__NR_rseq)
+  // If we encounter a signal between IsFastNoInit() above and rseq() and that
+  // signal initializes per-CPU, rseq() here fails with EBUSY, as the thread is
+  // already registered with the same area.  That leaves the thread registered
+  // just as well, so rather than masking signals around the syscall, which
+  // costs every new thread two more syscalls, we accept that failure.
+  const int saved_errno = errno;
+  if (0 == syscall(__NR_rseq, &__rseq_abi, sizeof(__rseq_abi), 0,
+                   TCMALLOC_PERCPU_RSEQ_SIGNATURE)) {
     return true;
   }
-
-#if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ && defined(__NR_rseq)
-  return 0 == syscall(__NR_rseq, &__rseq_abi, sizeof(__rseq_abi), 0,
-                      TCMALLOC_PERCPU_RSEQ_SIGNATURE);
+  const bool busy = errno == EBUSY;
+  errno = saved_errno;
+  return busy && IsFastNoInit();
 #endif  // __NR_rseq
   return false;
 }
@@ -124,6 +128,20 @@ int VirtualCpu::Synchronize() {
 #endif  // TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
 }
 
+#if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
+// Reports whether per-CPU state should be keyed by the kernel's mm_cid
+// (concurrency ID) instead of the physical CPU. mm_cid is dense and bounded by
+// the number of threads concurrently running in the process, so processes
+// limited by a CPU quota touch far fewer per-CPU caches.
+static bool WantRseqVirtualCpus() {
+  if (IsExperimentActive(Experiment::TEST_ONLY_MM_VCPU)) {
+    return true;
+  }
+  const char* e = thread_safe_getenv("TCMALLOC_RSEQ_VIRTUAL_CPUS");
+  return e != nullptr && std::strcmp(e, "1") == 0;
+}
+#endif  // TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
+
 static void InitPerCpu() {
   const auto maybe_numcpus = NumCPUsMaybe();
   if (!maybe_numcpus.has_value()) {
@@ -167,7 +185,7 @@ static void InitPerCpu() {
                      kMEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_RSEQ, 0, 0),
         std::memory_order_relaxed);
 
-    if (IsExperimentActive(Experiment::TEST_ONLY_MM_VCPU)) {
+    if (WantRseqVirtualCpus()) {
       auto auxv = getauxval(AT_RSEQ_FEATURE_SIZE);
       // mm_cid support was introduced in Linux 6.3
       // (https://github.com/torvalds/linux/commit/f7b01bb0b57f994a44ea6368536b59062b796381).
@@ -48,6 +48,17 @@
 #define TCMALLOC_INTERNAL_PERCPU_USE_RSEQ_ASM_GOTO_OUTPUT 1
 #endif
 
+// Building with -DTCMALLOC_INTERNAL_PERCPU_SAMPLER keeps the sampling
+// countdown of allocations served by the per-CPU cache in the slabs of each
+// cpu, rather than in the thread's Sampler, see TcmallocSlab::PopCounted.
+// This is experimental and only supported on x86-64 with rseq.
+#if defined(TCMALLOC_INTERNAL_PERCPU_SAMPLER) && \
+    TCMALLOC_INTERNAL_PERCPU_USE_RSEQ && defined(__x86_64__)
+#define TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED 1
+#else
+#define TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED 0
+#endif
+
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
@@ -158,10 +169,12 @@ class TcmallocSlab {
       PerSizeClassMaxCapacity* new_max_capacity, int classes_to_resize);
 
   // Grows or shrinks the size of the slabs to use the <new_shift> value. First
-  // we initialize <new_slabs>, then lock all headers on the old slabs,
-  // atomically update to use the new slabs, and teardown the old slabs. Returns
-  // a pointer to old slabs to be madvised away along with the size of the old
-  // slabs and the number of bytes that were reused.
+  // we initialize <new_slabs> while all CPUs keep running, then stop all CPUs
+  // just long enough to atomically update to use the new slabs, and teardown
+  // the old slabs after restarting them. The time during which CPUs are
+  // stopped does not depend on the number of CPUs. Returns a pointer to old
+  // slabs to be madvised away along with the size of the old slabs and the
+  // number of bytes that were reused.
   //
   // <alloc> is memory allocation callback (e.g. malloc).
   // <capacity> callback returns max capacity for size class <cl>.
@@ -174,6 +187,14 @@ class TcmallocSlab {
       absl::FunctionRef<size_t(size_t)> capacity,
       absl::FunctionRef<bool(size_t)> populated, DrainHandler drain_handler);
 
+  // Forgets the contents of all CPUs' slabs in a child process after fork(),
+  // including remote operations that were running in the parent's other
+  // threads.  Returns the slabs, which the caller must zero (e.g. madvise
+  // them away) before any CPU is initialized again.
+  //
+  // REQUIRES: the calling thread is the only one in the process.
+  [[nodiscard]] ResizeSlabsInfo ResetAfterFork();
+
   // For tests. Returns the freed slabs pointer.
   void* Destroy(absl::FunctionRef<void(void*, size_t, std::align_val_t)> free);
 
@@ -203,6 +224,38 @@ class TcmallocSlab {
   // invokes <underflow_handler> and returns its result.
   [[nodiscard]] void* Pop(size_t size_class);
 
+#if TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+  // The header of size class 0, which has no objects, holds the sampling
+  // countdown of the cpu: 1 + the number of bytes that may be allocated before
+  // the next sample, or 0 while the countdown is not armed, as in new slabs.
+  //
+  // Like Pop, and charges <bytes> to the countdown of the current cpu in the
+  // same critical section.  Returns nullptr without charging anything if the
+  // slab is empty or the countdown would expire, in which case the caller
+  // charges the allocation with ChargeSampler.  A preemption between the two
+  // stores of the critical section charges the allocation twice, which makes
+  // the next sample come marginally earlier.
+  // REQUIRES: 0 < bytes < 2^31.
+  [[nodiscard]] void* PopCounted(size_t size_class, uint32_t bytes);
+
+  enum class SamplerCharge {
+    // The slab of the current cpu is not cached: nothing was charged.
+    kUncached,
+    // The countdown did not expire and was charged.
+    kCharged,
+    // The countdown expired and <rearm> was negative: nothing was charged.
+    kExpired,
+    // The countdown expired, or was not armed, and was set to <rearm>.
+    kRearmed,
+  };
+
+  // Charges <bytes> to the countdown of the current cpu, and sets it to
+  // <rearm> if that would expire it, unless <rearm> is negative.  Returns the
+  // countdown found in <old>.
+  // REQUIRES: 0 < bytes < 2^31.
+  SamplerCharge ChargeSampler(uint32_t bytes, int32_t rearm, int32_t& old);
+#endif  // TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+
   // Add up to <len> items to the current cpu slab from the array located at
   // <batch>. Returns the number of items that were added (possibly 0). All
   // items not added will be returned at the start of <batch>. Items are not
@@ -290,6 +343,12 @@ class TcmallocSlab {
     return ToUint8(GetSlabsAndShift(std::memory_order_relaxed).second);
   }
 
+  // Gets the current slabs.  Intended for use by the thread that calls
+  // ResizeSlabs(), or while holding off calls to it.
+  void* GetSlabs() const {
+    return GetSlabsAndShift(std::memory_order_relaxed).first;
+  }
+
   constexpr static size_t GetCpuStateSize() { return sizeof(CpuState); }
 
  private:
@@ -371,7 +430,8 @@ class TcmallocSlab {
                      const std::array<uint16_t, NumClasses>& old_begins,
                      DrainHandler drain_handler);
 
-  // Implementation of InitCpu() allowing for reuse in ResizeSlabs().
+  // Implementation of InitCpu() allowing for reuse in ResizeSlabs(). <cpu>
+  // must be stopped, unless <slabs> are not yet visible to other threads.
   void InitCpuImpl(void* slabs, Shift shift, int cpu,
                    absl::FunctionRef<size_t(size_t)> capacity);
 
@@ -778,26 +838,30 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE bool TcmallocSlab<NumClasses>::Push(
 #endif
 }
 
-// PrefetchNextObject provides a common code path across architectures for
-// generating a prefetch of the next object.
+// Pop prefetches the object that the next Pop of the same size class will
+// return.  The prefetch is issued from within the restartable sequence, right
+// after the object's address is loaded, so that it starts before the header
+// update commits and needs no branch of its own: an aborted sequence merely
+// issues it again.
 //
-// It is in a distinct, always-lined method to make its cost more transparent
-// when profiling with debug information.
-inline ABSL_ATTRIBUTE_ALWAYS_INLINE void PrefetchNextObject(
-    void* prefetch_target) {
-  // A note about prefetcht0 in Pop:  While this prefetch may appear costly,
-  // trace analysis shows the target is frequently used (b/70294962). Stalling
-  // on a TLB miss at the prefetch site (which has no deps) and prefetching the
-  // line async is better than stalling at the use (which may have deps) to fill
-  // the TLB and the cache miss.
-  //
-  // See "Beyond malloc efficiency to fleet efficiency"
-  // (https://research.google/pubs/pub50370/), section 6.4 for additional
-  // details.
-  //
-  // TODO(b/214608320): Evaluate prefetch for write.
-  __builtin_prefetch(prefetch_target, 0, 3);
-}
+// While this prefetch may appear costly, trace analysis shows the target is
+// frequently used (b/70294962). Stalling on a TLB miss at the prefetch site
+// (which has no deps) and prefetching the line async is better than stalling
+// at the use (which may have deps) to fill the TLB and the cache miss.
+//
+// See "Beyond malloc efficiency to fleet efficiency"
+// (https://research.google/pubs/pub50370/), section 6.4 for additional
+// details.
+//
+// Building with -DTCMALLOC_INTERNAL_PREFETCH_NEXT_OBJECT_FOR_WRITE requests
+// the line for writing instead, as new objects are usually written to first.
+#ifdef TCMALLOC_INTERNAL_PREFETCH_NEXT_OBJECT_FOR_WRITE
+#define TCMALLOC_PREFETCH_NEXT_OBJECT_X86_64 "prefetchw"
+#define TCMALLOC_PREFETCH_NEXT_OBJECT_AARCH64 "pstl1keep"
+#else
+#define TCMALLOC_PREFETCH_NEXT_OBJECT_X86_64 "prefetcht0"
+#define TCMALLOC_PREFETCH_NEXT_OBJECT_AARCH64 "pldl1keep"
+#endif
 
 #if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ && defined(__x86_64__)
 template <size_t NumClasses>
@@ -839,6 +903,7 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* TcmallocSlab<NumClasses>::Pop(
   // If so, the above code needs to explicitly set a ccc return value.
 #endif
       "movq -16(%[scratch], %[current], 8), %[next]\n"
+      TCMALLOC_PREFETCH_NEXT_OBJECT_X86_64 " (%[next])\n"
       "lea -1(%[current]), %[current]\n"
       "movw %w[current], (%[scratch], %[size_class], 4)\n"
       // Commit
@@ -872,13 +937,114 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* TcmallocSlab<NumClasses>::Pop(
   // The next pop will be from current-1, but because we prefetch the previous
   // element we've already just read that, so prefetch current-2.
   PrefetchSlabMemory(scratch + (current - 2) * sizeof(void*));
-  PrefetchNextObject(next);
   return AssumeNotNull(result);
 underflow_path:
   return nullptr;
 }
 #endif  // defined(__x86_64__)
 
+#if TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+template <size_t NumClasses>
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* TcmallocSlab<NumClasses>::PopCounted(
+    size_t size_class, uint32_t bytes) {
+  // Size class 0 only shows up before initialization, when no slab is cached.
+  TC_ASSERT_GT(bytes, 0);
+  void* next;
+  void* result;
+  uintptr_t scratch, current;
+  int32_t countdown;
+  bool underflow;
+
+  asm(TCMALLOC_RSEQ_PROLOGUE(TcmallocSlab_Internal_PopCounted)
+      // scratch = tcmalloc_slabs;
+      "movq %[rseq_slabs_addr], %[scratch]\n"
+      // if (scratch & TCMALLOC_CACHED_SLABS_MASK) goto underflow;
+      // scratch &= ~TCMALLOC_CACHED_SLABS_MASK;
+      "btrq $%c[cached_slabs_bit], %[scratch]\n"
+      "cmc\n"
+      "jc 5f\n"
+      // countdown = scratch->header[0] - bytes;
+      // if (countdown <= 0) goto underflow;
+      "movl (%[scratch]), %[countdown]\n"
+      "subl %[bytes], %[countdown]\n"
+      "jg 6f\n"
+      "stc\n"
+      "jmp 5f\n"
+      "6:\n"
+      // current = scratch->header[size_class].current;
+      "movzwq (%[scratch], %[size_class], 4), %[current]\n"
+      "movq -8(%[scratch], %[current], 8), %[result]\n"
+      "btq $%c[begin_mark_bit], %[result]\n"
+      "jc 5f\n"
+      // Important! code below this must not affect any flags (i.e.: ccc)
+      "movq -16(%[scratch], %[current], 8), %[next]\n"
+      TCMALLOC_PREFETCH_NEXT_OBJECT_X86_64 " (%[next])\n"
+      "movl %[countdown], (%[scratch])\n"
+      "lea -1(%[current]), %[current]\n"
+      "movw %w[current], (%[scratch], %[size_class], 4)\n"
+      // Commit
+      "5:\n"
+      : [result] "=&r"(result), [underflow] "=@ccc"(underflow),
+        [scratch] "=&r"(scratch), [current] "=&r"(current), [next] "=&r"(next),
+        [countdown] "=&r"(countdown)
+      : TCMALLOC_RSEQ_INPUTS,
+        [begin_mark_bit] "n"(absl::countr_zero(kBeginMark)),
+        [size_class] "r"(size_class), [bytes] "r"(bytes)
+      : "cc", "memory");
+  if (ABSL_PREDICT_FALSE(underflow)) {
+    return nullptr;
+  }
+  TC_ASSERT(next);
+  TC_ASSERT(result);
+  TSANAcquire(result);
+
+  PrefetchSlabMemory(scratch + (current - 2) * sizeof(void*));
+  return AssumeNotNull(result);
+}
+
+template <size_t NumClasses>
+inline auto TcmallocSlab<NumClasses>::ChargeSampler(uint32_t bytes,
+                                                    int32_t rearm,
+                                                    int32_t& old)
+    -> SamplerCharge {
+  TC_ASSERT_GT(bytes, 0);
+  uintptr_t scratch;
+  int32_t countdown;
+  int32_t charge;
+
+  asm(TCMALLOC_RSEQ_PROLOGUE(TcmallocSlab_Internal_ChargeSampler)
+      "movl $%c[uncached], %[charge]\n"
+      "movl $0, %[old]\n"
+      "movq %[rseq_slabs_addr], %[scratch]\n"
+      "btrq $%c[cached_slabs_bit], %[scratch]\n"
+      "jnc 5f\n"
+      // countdown = old - bytes, unless that expires the countdown.
+      "movl (%[scratch]), %[old]\n"
+      "movl %[old], %[countdown]\n"
+      "movl $%c[charged], %[charge]\n"
+      "subl %[bytes], %[countdown]\n"
+      "jg 6f\n"
+      "movl $%c[expired], %[charge]\n"
+      "testl %[rearm], %[rearm]\n"
+      "js 5f\n"
+      "movl $%c[rearmed], %[charge]\n"
+      "movl %[rearm], %[countdown]\n"
+      "6:\n"
+      "movl %[countdown], (%[scratch])\n"
+      // Commit
+      "5:\n"
+      : [charge] "=&r"(charge), [old] "=&r"(old), [scratch] "=&r"(scratch),
+        [countdown] "=&r"(countdown)
+      : TCMALLOC_RSEQ_INPUTS, [bytes] "r"(bytes), [rearm] "r"(rearm),
+        [uncached] "n"(static_cast<int>(SamplerCharge::kUncached)),
+        [charged] "n"(static_cast<int>(SamplerCharge::kCharged)),
+        [expired] "n"(static_cast<int>(SamplerCharge::kExpired)),
+        [rearmed] "n"(static_cast<int>(SamplerCharge::kRearmed))
+      : "cc", "memory");
+  return static_cast<SamplerCharge>(charge);
+}
+#endif  // TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+
 #if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ && defined(__aarch64__)
 template <size_t NumClasses>
 inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* TcmallocSlab<NumClasses>::Pop(
@@ -927,6 +1093,7 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* TcmallocSlab<NumClasses>::Pop(
   // Important! code below this must not affect any flags (i.e.: cceq)
   // If so, the above code needs to explicitly set a cceq return value.
 #endif
+      "prfm " TCMALLOC_PREFETCH_NEXT_OBJECT_AARCH64 ", [%[prefetch]]\n"
       "strh %w[previous], [%[region_start], %[size_class_lsl2]]\n"
       // Commit
       "5:\n"
@@ -961,7 +1128,6 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* TcmallocSlab<NumClasses>::Pop(
 #endif
   TSANAcquire(result);
   PrefetchSlabMemory(scratch);
-  PrefetchNextObject(prefetch);
   return AssumeNotNull(result);
 underflow_path:
   return nullptr;
@@ -1127,7 +1293,6 @@ template <size_t NumClasses>
 void TcmallocSlab<NumClasses>::InitCpuImpl(
     void* slabs, Shift shift, int cpu,
     absl::FunctionRef<size_t(size_t)> capacity) {
-  TC_CHECK(state_[cpu].stopped.load(std::memory_order_relaxed));
   TC_CHECK_LE((1 << ToUint8(shift)), (1 << 16) * sizeof(void*));
 
   // Initialize prefetch target and compute the offsets for the
@@ -1336,8 +1501,10 @@ auto TcmallocSlab<NumClasses>::ResizeSlabs(
     absl::FunctionRef<size_t(size_t)> capacity,
     absl::FunctionRef<bool(size_t)> populated, DrainHandler drain_handler)
     -> ResizeSlabsInfo {
-  // Phase 1: Collect begins, stop all CPUs and initialize any CPUs in the new
-  // slab that have already been populated in the old slab.
+  // Phase 1: Collect begins and initialize any CPUs in the new slab that have
+  // already been populated in the old slab. Nothing but this thread can see
+  // <new_slabs> yet, so the CPUs do not need to be stopped for this, which
+  // keeps work proportional to the number of CPUs out of the stopped phase.
   const auto [old_slabs, old_shift] =
       GetSlabsAndShift(std::memory_order_relaxed);
   std::array<uint16_t, NumClasses> old_begins;
@@ -1349,12 +1516,17 @@ auto TcmallocSlab<NumClasses>::ResizeSlabs(
   TC_ASSERT_NE(new_shift, old_shift);
   const int n_cpus = num_cpus();
   for (size_t cpu = 0; cpu < n_cpus; ++cpu) {
-    TC_CHECK(!state_[cpu].stopped.load(std::memory_order_relaxed));
-    state_[cpu].stopped.store(true, std::memory_order_relaxed);
     if (populated(cpu)) {
       InitCpuImpl(new_slabs, new_shift, cpu, capacity);
     }
   }
+
+  // Phase 2: Stop all CPUs. A single fence is much cheaper than fencing each
+  // CPU individually.
+  for (auto& state : state_) {
+    TC_CHECK(!state.stopped.load(std::memory_order_relaxed));
+    state.stopped.store(true, std::memory_order_relaxed);
+  }
   FenceAllCpus();
 
 #ifdef TCMALLOC_INTERNAL_LATENCY_INJECTION
@@ -1362,15 +1534,15 @@ auto TcmallocSlab<NumClasses>::ResizeSlabs(
   ScopedDelay delay(ScopedDelay::resize_slabs_delay);
 #endif
 
-  // Phase 2: Atomically update slabs and shift.
+  // Phase 3: Atomically update slabs and shift.
   InitSlabs(new_slabs, new_shift, capacity);
 
-  // Phase 3: Re-start all CPUs.
+  // Phase 4: Re-start all CPUs.
   for (auto& state : state_) {
     state.stopped.store(false, std::memory_order_release);
   }
 
-  // Phase 4: Return pointers from the old slab to the TransferCache.
+  // Phase 5: Return pointers from the old slab to the TransferCache.
   for (size_t cpu = 0; cpu < n_cpus; ++cpu) {
     if (!populated(cpu)) continue;
     DrainOldSlabs(old_slabs, old_shift, cpu, old_begins, drain_handler);
@@ -1379,6 +1551,19 @@ auto TcmallocSlab<NumClasses>::ResizeSlabs(
   return {old_slabs, GetSlabsAllocSize(old_shift, n_cpus)};
 }
 
+template <size_t NumClasses>
+ResizeSlabsInfo TcmallocSlab<NumClasses>::ResetAfterFork() {
+  for (auto& state : state_) {
+    // Only write where needed, to leave the parent's pages shared.
+    if (state.stopped.load(std::memory_order_relaxed)) {
+      state.stopped.store(false, std::memory_order_relaxed);
+    }
+  }
+  UncacheCpuSlab();
+  const auto [slabs, shift] = GetSlabsAndShift(std::memory_order_relaxed);
+  return {slabs, GetSlabsAllocSize(shift, num_cpus())};
+}
+
 template <size_t NumClasses>
 void* TcmallocSlab<NumClasses>::Destroy(
     absl::FunctionRef<void(void*, size_t, std::align_val_t)> free) {
@@ -62,6 +62,7 @@
 #include "absl/types/span.h"
 #include "tcmalloc/internal/affinity.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/delay_injection.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/page_size.h"
 #include "tcmalloc/internal/sysinfo.h"
@@ -435,6 +436,50 @@ void* allocator(size_t bytes, std::align_val_t alignment) {
   return ptr;
 }
 
+#if TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+TEST_F(TcmallocSlabTest, SamplerCountdown) {
+  if (MallocExtension::PerCpuCachesActive()) {
+    GTEST_SKIP() << "per-CPU TCMalloc is incompatible with unregistering rseq";
+  }
+  if (!IsFast()) {
+    GTEST_SKIP() << "Need fast percpu. Skipping.";
+  }
+
+  using SamplerCharge = TcmallocSlab<kStressSlabs>::SamplerCharge;
+  constexpr size_t kSizeClass = 1;
+  void* objects[kCapacity];
+  const int cpu = AllowedCpus()[0];
+  ScopedFakeCpuId fake_cpu_id(cpu);
+  slab_.InitCpu(cpu, [](size_t size_class) { return kCapacity; });
+  int32_t old;
+  // Nothing is charged while the slab is not cached.
+  ASSERT_EQ(slab_.ChargeSampler(1, 100, old), SamplerCharge::kUncached);
+  slab_.CacheCpuSlab();
+  const auto max_capacity = [](uint8_t shift) { return kCapacity; };
+  ASSERT_EQ(slab_.Grow(cpu, kSizeClass, 2, max_capacity), 2);
+  ASSERT_TRUE(slab_.Push(kSizeClass, &objects[0]));
+  ASSERT_TRUE(slab_.Push(kSizeClass, &objects[1]));
+
+  // A new slab has no countdown armed.
+  EXPECT_EQ(slab_.PopCounted(kSizeClass, 1), nullptr);
+  ASSERT_EQ(slab_.ChargeSampler(10, -1, old), SamplerCharge::kExpired);
+  ASSERT_EQ(slab_.ChargeSampler(10, 100, old), SamplerCharge::kRearmed);
+  EXPECT_EQ(old, 0);
+
+  // Pops charge the countdown until it expires, leaving the object cached.
+  EXPECT_EQ(slab_.PopCounted(kSizeClass, 60), &objects[1]);
+  EXPECT_EQ(slab_.PopCounted(kSizeClass, 60), nullptr);
+  EXPECT_EQ(slab_.Length(cpu, kSizeClass), 1);
+  ASSERT_EQ(slab_.ChargeSampler(30, 100, old), SamplerCharge::kCharged);
+  ASSERT_EQ(slab_.ChargeSampler(30, 100, old), SamplerCharge::kRearmed);
+  EXPECT_EQ(old, 10);
+  EXPECT_EQ(slab_.PopCounted(kSizeClass, 60), &objects[0]);
+
+  slab_.UncacheCpuSlab();
+  EXPECT_EQ(slab_.PopCounted(kSizeClass, 1), nullptr);
+}
+#endif  // TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+
 TEST_F(TcmallocSlabTest, ResizeMaxCapacities) {
   if (MallocExtension::PerCpuCachesActive()) {
     // This test unregisters rseq temporarily, as to decrease flakiness.
@@ -1294,6 +1339,159 @@ void BM_PushPopBatch(benchmark::State& state) {
 }
 BENCHMARK(BM_PushPopBatch);
 
+// Measures Push/Pop throughput on one CPU shared with state.range(0) other
+// threads, all of which yield every few operations, so that critical sections
+// are preempted and restarted far more often than usual.  Reports the slab
+// recaches per operation, which bound the rseq aborts from above.
+void BM_PushPopContextSwitch(benchmark::State& state) {
+  TC_CHECK(IsFast());
+  const int num_competitors = state.range(0);
+  const int target_cpu = AllowedCpus()[0];
+
+  constexpr size_t kSizeClass = 1;
+  // Every thread holds at most one item, so Push never finds the slab full.
+  constexpr size_t kCapacity = 64;
+  TC_CHECK_LT(num_competitors, kCapacity);
+  constexpr int kOpsPerYield = 16;
+  const auto get_capacity = [](size_t size_class) -> size_t {
+    return kCapacity;
+  };
+  TcmallocSlab slab;
+  InitSlab(slab, allocator, get_capacity, kShift);
+  // The threads may share a virtual CPU ID other than target_cpu.
+  for (int cpu = 0, n = NumCPUs(); cpu < n; ++cpu) {
+    slab.InitCpu(cpu, get_capacity);
+    TC_CHECK_EQ(slab.GrowOtherCache(cpu, kSizeClass, kCapacity,
+                                    [](uint8_t shift) { return kCapacity; }),
+                kCapacity);
+  }
+
+  // Pushes and pops one item, recaching the slab as often as needed.  Returns
+  // the number of recaches.
+  const auto push_pop = [&](void* item) {
+    int recaches = 0;
+    while (!slab.Push(kSizeClass, item)) {
+      recaches += slab.CacheCpuSlab().second;
+    }
+    while (slab.Pop(kSizeClass) == nullptr) {
+      recaches += slab.CacheCpuSlab().second;
+    }
+    return recaches;
+  };
+
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> competitors;
+  for (int i = 0; i < num_competitors; ++i) {
+    competitors.emplace_back([&]() {
+      ScopedAffinityMask mask(target_cpu);
+      void* item = &item;
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (int op = 0; op < kOpsPerYield; ++op) {
+          push_pop(item);
+        }
+        sched_yield();
+      }
+    });
+  }
+
+  int64_t recaches = 0;
+  {
+    ScopedAffinityMask mask(target_cpu);
+    void* item = &item;
+    for (auto _ : state) {
+      for (int op = 0; op < kOpsPerYield; ++op) {
+        recaches += push_pop(item);
+      }
+      sched_yield();
+    }
+    if (mask.Tampered()) {
+      state.SkipWithError("affinity mask changed during the benchmark");
+    }
+  }
+
+  stop.store(true, std::memory_order_relaxed);
+  for (std::thread& t : competitors) {
+    t.join();
+  }
+  slab.Destroy(sized_aligned_delete);
+
+  const int64_t ops = state.iterations() * kOpsPerYield * 2;
+  state.SetItemsProcessed(ops);
+  state.counters["recaches_per_op"] = static_cast<double>(recaches) / ops;
+}
+BENCHMARK(BM_PushPopContextSwitch)->Arg(0)->Arg(1)->Arg(4)->Arg(16);
+
+// Measures how long a thread using the slab of one CPU stalls while another
+// thread resizes the slabs, with state.range(0) populated CPUs and
+// state.range(1) cycles injected at resize_slabs_delay (only effective with
+// TCMALLOC_INTERNAL_LATENCY_INJECTION). Populated CPUs are initialized before
+// any CPU is stopped, so the stall should not grow with the number of CPUs.
+void BM_ResizeSlabsStall(benchmark::State& state) {
+  TC_CHECK(IsFast());
+  const int num_populated = std::min<int>(state.range(0), NumCPUs());
+  ScopedDelay::resize_slabs_delay.store(state.range(1),
+                                        std::memory_order_relaxed);
+
+  constexpr int kCpu = 0;
+  constexpr size_t kSizeClass = 1;
+  constexpr size_t kCapacity = 4;
+  const auto get_capacity = [](size_t size_class) -> size_t {
+    return kCapacity;
+  };
+  TcmallocSlab slab;
+  size_t shift = kResizeInitialShift;
+  InitSlab(slab, allocator, get_capacity, shift);
+  for (int cpu = 0; cpu < num_populated; ++cpu) {
+    slab.InitCpu(cpu, get_capacity);
+  }
+
+  std::atomic<bool> stop(false);
+  std::atomic<int64_t> max_stall_ns(0);
+  std::thread user([&]() {
+    TC_CHECK(IsFast());
+    ScopedFakeCpuId fake_cpu_id(kCpu);
+    void* item = &item;
+    while (!stop.load(std::memory_order_relaxed)) {
+      const absl::Time start = absl::Now();
+      while (!slab.Push(kSizeClass, item)) {
+        // The slab was stopped or resized. Recache it and regain capacity.
+        auto [cpu, _] = slab.CacheCpuSlab();
+        if (cpu == kCpu) {
+          slab.Grow(cpu, kSizeClass, 1,
+                    [](uint8_t shift) { return kCapacity; });
+        }
+      }
+      const int64_t stall_ns = absl::ToInt64Nanoseconds(absl::Now() - start);
+      if (stall_ns > max_stall_ns.load(std::memory_order_relaxed)) {
+        max_stall_ns.store(stall_ns, std::memory_order_relaxed);
+      }
+      (void)slab.Pop(kSizeClass);
+    }
+  });
+
+  for (auto _ : state) {
+    shift = shift == kResizeInitialShift ? kResizeInitialShift + 1
+                                         : kResizeInitialShift;
+    void* slabs = AllocSlabs(allocator, shift);
+    const auto [old_slabs, old_slabs_size] = slab.ResizeSlabs(
+        ToShiftType(shift), slabs, get_capacity,
+        [&](size_t cpu) { return static_cast<int>(cpu) < num_populated; },
+        [](int cpu, size_t size_class, void** batch, size_t size,
+           size_t cap) {});
+    sized_aligned_delete(old_slabs, old_slabs_size,
+                         std::align_val_t{EXEC_PAGESIZE});
+  }
+
+  stop.store(true, std::memory_order_relaxed);
+  user.join();
+  ScopedDelay::resize_slabs_delay.store(0, std::memory_order_relaxed);
+  slab.Destroy(sized_aligned_delete);
+  state.counters["max_stall_ns"] = max_stall_ns.load();
+}
+BENCHMARK(BM_ResizeSlabsStall)
+    ->ArgsProduct({{1, 16, 64, 256}, {0, 1000000}})
+    ->UseRealTime();
+
 }  // namespace
 }  // namespace percpu
 }  // namespace subtle
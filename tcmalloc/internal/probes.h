@@ -0,0 +1,56 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_INTERNAL_PROBES_H_
+#define TCMALLOC_INTERNAL_PROBES_H_
+
+// Static tracepoints (USDT) on allocator slow paths, for tracing with eBPF
+// (bpftrace, bcc) or SystemTap without rebuilding.  For example:
+//
+//   bpftrace -e 'usdt:/path/to/binary:tcmalloc:cpu_cache_refill {
+//     @[arg1] = sum(arg2); }'
+//
+// A probe compiles to a single nop at its site plus a note in the
+// .note.stapsdt section; its arguments are only read when a tracer attaches.
+//
+// Probes are emitted when <sys/sdt.h> (systemtap-sdt-dev) is available at
+// build time, unless TCMALLOC_INTERNAL_DISABLE_PROBES is defined.  Otherwise
+// TCMALLOC_PROBE expands to nothing and its arguments are not evaluated.
+//
+// Probes, all under the "tcmalloc" provider, and their arguments:
+//
+//   cpu_cache_refill(cpu, size_class, objects)
+//   cpu_cache_overflow(cpu, size_class, objects)
+//   transfer_cache_insert_miss(size_class, objects)
+//   transfer_cache_remove_miss(size_class, objects)
+//   central_freelist_span_allocate(size_class, pages)
+//   central_freelist_span_free(size_class, spans)
+//   system_alloc(bytes, actual_bytes, tag)
+//   subrelease(pages, hugepages_broken)
+//   collapse(start, bytes, success)
+
+#if !defined(TCMALLOC_INTERNAL_DISABLE_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TCMALLOC_INTERNAL_HAVE_PROBES 1
+#endif  // __has_include(<sys/sdt.h>)
+#endif
+
+#ifdef TCMALLOC_INTERNAL_HAVE_PROBES
+#define TCMALLOC_PROBE(name, ...) STAP_PROBEV(tcmalloc, name, __VA_ARGS__)
+#else
+#define TCMALLOC_PROBE(name, ...) ((void)0)
+#endif
+
+#endif  // TCMALLOC_INTERNAL_PROBES_H_
@@ -19,7 +19,6 @@
 #include <unistd.h>
 
 #include <cstdint>
-#include <cstdio>
 #include <cstring>
 
 #include "absl/strings/str_format.h"
@@ -30,6 +29,52 @@
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
+namespace {
+
+// Parses the hexadecimal number at *p and advances *p past it.  Returns false
+// if *p does not start with a hexadecimal digit.
+bool ParseHex(const char** p, uint64_t* value) {
+  const char* s = *p;
+  uint64_t v = 0;
+  for (;; ++s) {
+    const char c = *s;
+    if (c >= '0' && c <= '9') {
+      v = (v << 4) | (c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      v = (v << 4) | (c - 'a' + 10);
+    } else if (c >= 'A' && c <= 'F') {
+      v = (v << 4) | (c - 'A' + 10);
+    } else {
+      break;
+    }
+  }
+  if (s == *p) return false;
+  *p = s;
+  *value = v;
+  return true;
+}
+
+// As ParseHex(), for a decimal number.
+bool ParseDecimal(const char** p, uint64_t* value) {
+  const char* s = *p;
+  uint64_t v = 0;
+  for (; *s >= '0' && *s <= '9'; ++s) {
+    v = v * 10 + (*s - '0');
+  }
+  if (s == *p) return false;
+  *p = s;
+  *value = v;
+  return true;
+}
+
+// Advances *p past at least one space.  Returns false if there is none.
+bool SkipSpaces(const char** p) {
+  if (**p != ' ') return false;
+  while (**p == ' ') ++*p;
+  return true;
+}
+
+}  // namespace
 
 ProcMapsIterator::ProcMapsIterator(Buffer* buffer) {
   ibuf_ = buffer->buf;
@@ -106,37 +151,39 @@ bool ProcMapsIterator::NextExt(uint64_t* start, uint64_t* end, char** flags,
     }
     *nextline_ = 0;                               // turn newline into nul
     nextline_ += ((nextline_ < etext_) ? 1 : 0);  // skip nul if not end of text
-    // stext_ now points at a nul-terminated line
-    unsigned long long tmpstart, tmpend, tmpoffset;           // NOLINT
-    long long tmpinode, local_inode;                          // NOLINT
-    unsigned long long local_start, local_end, local_offset;  // NOLINT
-    int major, minor;
-    unsigned filename_offset = 0;
-    // for now, assume all linuxes have the same format
-    int para_num =
-        sscanf(stext_, "%llx-%llx %4s %llx %x:%x %lld %n",
-               start ? &local_start : &tmpstart, end ? &local_end : &tmpend,
-               flags_, offset ? &local_offset : &tmpoffset, &major, &minor,
-               inode ? &local_inode : &tmpinode, &filename_offset);
-
-    if (para_num != 7) continue;
+    // stext_ now points at a nul-terminated line of the form
+    //   start-end flags offset major:minor inode [filename]
+    // which is parsed by hand: sscanf is locale aware and several times
+    // slower, which matters for processes with many mappings.
+    const char* p = stext_;
+    uint64_t local_start, local_end, local_offset, major, minor, local_inode;
+    if (!ParseHex(&p, &local_start) || *p++ != '-' ||
+        !ParseHex(&p, &local_end) || !SkipSpaces(&p)) {
+      continue;
+    }
+    size_t flags_length = 0;
+    while (flags_length < 4 && *p != '\0' && *p != ' ') {
+      flags_[flags_length++] = *p++;
+    }
+    flags_[flags_length] = '\0';
+    if (flags_length == 0 || !SkipSpaces(&p) ||
+        !ParseHex(&p, &local_offset) || !SkipSpaces(&p) ||
+        !ParseHex(&p, &major) || *p++ != ':' || !ParseHex(&p, &minor) ||
+        !SkipSpaces(&p) || !ParseDecimal(&p, &local_inode)) {
+      continue;
+    }
+    // Depending on the Linux kernel being used, there may or may not be a space
+    // after the inode if there is no filename.
+    while (*p == ' ') ++p;
 
     if (start) *start = local_start;
     if (end) *end = local_end;
     if (offset) *offset = local_offset;
     if (inode) *inode = local_inode;
-    // Depending on the Linux kernel being used, there may or may not be a space
-    // after the inode if there is no filename.  sscanf will in such situations
-    // nondeterministically either fill in filename_offset or not (the results
-    // differ on multiple calls in the same run even with identical arguments).
-    // We don't want to wander off somewhere beyond the end of the string.
-    size_t stext_length = strlen(stext_);
-    if (filename_offset == 0 || filename_offset > stext_length)
-      filename_offset = stext_length;
 
     // We found an entry
     if (flags) *flags = flags_;
-    if (filename) *filename = stext_ + filename_offset;
+    if (filename) *filename = const_cast<char*>(p);
     if (dev) *dev = makedev(major, minor);
 
     return true;
@@ -0,0 +1,91 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "benchmark/benchmark.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/page_size.h"
+#include "tcmalloc/internal/proc_maps.h"
+#include "tcmalloc/internal/residency.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// Benchmark walking /proc/self/maps, with state.range(0) extra mappings.
+void BM_ProcMaps(benchmark::State& state) {
+  const int mappings = state.range(0);
+  const size_t page_size = GetPageSize();
+  // Alternate protections so that the kernel cannot merge the mappings.
+  void* region = mmap(nullptr, 2 * mappings * page_size, PROT_READ,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  TC_CHECK_NE(region, MAP_FAILED);
+  for (int i = 0; i < mappings; ++i) {
+    TC_CHECK_EQ(mprotect(static_cast<char*>(region) + 2 * i * page_size,
+                         page_size, PROT_NONE),
+                0);
+  }
+
+  auto buffer = std::make_unique<ProcMapsIterator::Buffer>();
+  for (auto s : state) {
+    ProcMapsIterator it(buffer.get());
+    TC_CHECK(it.Valid());
+    uint64_t start, end, offset;
+    int64_t inode;
+    char *flags, *filename;
+    int64_t count = 0;
+    while (it.NextExt(&start, &end, &flags, &offset, &inode, &filename,
+                      nullptr)) {
+      ++count;
+    }
+    benchmark::DoNotOptimize(count);
+  }
+
+  munmap(region, 2 * mappings * page_size);
+}
+BENCHMARK(BM_ProcMaps)->Range(1, 16 * 1024);
+
+// Benchmark ResidencyPageMap::Get over a region of state.range(0) bytes, half
+// of which is touched.
+void BM_ResidencyGet(benchmark::State& state) {
+  const size_t size = state.range(0);
+  const size_t page_size = GetPageSize();
+  char* region = static_cast<char*>(mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  TC_CHECK_NE(region, MAP_FAILED);
+  for (size_t i = 0; i < size; i += 2 * page_size) {
+    region[i] = 1;
+  }
+
+  ResidencyPageMap residency;
+  for (auto s : state) {
+    benchmark::DoNotOptimize(residency.Get(region, size));
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+
+  munmap(region, size);
+}
+BENCHMARK(BM_ResidencyGet)->Range(4096, 1 << 30);
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
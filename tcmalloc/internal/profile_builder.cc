@@ -38,18 +38,26 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
 
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "google/protobuf/message_lite.h"
+#include "google/protobuf/wire_format_lite.h"
 #include "tcmalloc/internal/profile.pb.h"
 #include "absl/base/attributes.h"
 #include "absl/base/macros.h"
 #include "absl/status/status.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/residency.h"
 
@@ -109,7 +117,9 @@ struct SampleMergedData {
   std::optional<size_t> swapped_size;
   std::optional<size_t> stale_size;
   std::optional<size_t> locked_size;
+  std::optional<size_t> hugepage_size;
   std::optional<uint64_t> stale_scan_period;
+  int64_t growth_rate = 0;
 };
 
 // The equality and hash methods of Profile::Sample only use a subset of its
@@ -120,7 +130,8 @@ struct SampleEqWithSubFields {
       return std::tie(s.depth, s.requested_size, s.requested_alignment,
                       s.requested_size_returning, s.allocated_size,
                       s.access_hint, s.access_allocated, s.token_id,
-                      s.guarded_status, s.type);
+                      s.tenant, s.sampling_interval, s.guarded_status,
+                      s.type);
     };
     return fields(a) == fields(b) &&
            std::equal(a.stack, a.stack + a.depth, b.stack, b.stack + b.depth);
@@ -133,7 +144,8 @@ struct SampleHashWithSubFields {
                         s.requested_size, s.requested_alignment,
                         s.requested_size_returning, s.allocated_size,
                         s.access_hint, s.access_allocated, s.token_id,
-                        s.guarded_status, s.type);
+                        s.tenant, s.sampling_interval, s.guarded_status,
+                        s.type);
   }
 };
 
@@ -150,17 +162,51 @@ SampleMergedMap MergeProfileSamplesAndMaybeGetResidencyInfo(
     SampleMergedData& data = map[entry];
     data.count += entry.count;
     data.sum += entry.sum;
-    if (residency) {
-      auto residency_info =
-          residency->Get(entry.span_start_address, entry.allocated_size);
+    data.growth_rate += entry.growth_rate;
+  });
+  if (residency == nullptr && pageflags == nullptr) {
+    return map;
+  }
+
+  // Residency and page flags are read from procfs, so the objects are visited
+  // in address order: the residency of each hugepage is then read once,
+  // however many objects it holds, and the reads are sequential.
+  struct Object {
+    const void* addr;
+    size_t size;
+    int64_t count;
+    SampleMergedData* data;
+  };
+  std::vector<Object> objects;
+  objects.reserve(map.size());
+  profile.Iterate([&](const tcmalloc::Profile::Sample& entry) {
+    objects.push_back({entry.span_start_address, entry.allocated_size,
+                       entry.count, &map.find(entry)->second});
+  });
+  std::sort(objects.begin(), objects.end(),
+            [](const Object& a, const Object& b) {
+              return std::less<const void*>()(a.addr, b.addr);
+            });
+
+  std::optional<HugePageCachingResidency> cached_residency;
+  if (residency) {
+    cached_residency.emplace(*residency);
+  }
+  uintptr_t last_hugepage = 1;
+  std::optional<bool> last_hugepage_backed;
+
+  for (const Object& object : objects) {
+    SampleMergedData& data = *object.data;
+    if (cached_residency.has_value()) {
+      auto residency_info = cached_residency->Get(object.addr, object.size);
       // As long as `residency_info` provides data in some samples, the merged
       // data will have their sums.
       // NOTE: The data here is comparable to `tcmalloc::Profile::Sample::sum`,
       // not to `tcmalloc::Profile::Sample::requested_size` (it's pre-multiplied
       // by count and represents all of the resident memory).
       if (residency_info.has_value()) {
-        size_t resident_size = entry.count * residency_info->bytes_resident;
-        size_t swapped_size = entry.count * residency_info->bytes_swapped;
+        size_t resident_size = object.count * residency_info->bytes_resident;
+        size_t swapped_size = object.count * residency_info->bytes_swapped;
         if (!data.resident_size.has_value()) {
           data.resident_size = resident_size;
           data.swapped_size = swapped_size;
@@ -172,18 +218,17 @@ SampleMergedMap MergeProfileSamplesAndMaybeGetResidencyInfo(
     }
 
     if (pageflags) {
-      auto page_stats =
-          pageflags->Get(entry.span_start_address, entry.allocated_size);
+      auto page_stats = pageflags->Get(object.addr, object.size);
       if (page_stats.has_value()) {
         if (!data.stale_size.has_value()) {
           data.stale_size.emplace();
         }
-        data.stale_size.value() += entry.count * page_stats->bytes_stale;
+        data.stale_size.value() += object.count * page_stats->bytes_stale;
 
         if (!data.locked_size.has_value()) {
           data.locked_size.emplace();
         }
-        data.locked_size.value() += entry.count * page_stats->bytes_locked;
+        data.locked_size.value() += object.count * page_stats->bytes_locked;
 
         if (!data.stale_scan_period.has_value()) {
           data.stale_scan_period = page_stats->stale_scan_seconds;
@@ -193,8 +238,32 @@ SampleMergedMap MergeProfileSamplesAndMaybeGetResidencyInfo(
           data.stale_scan_period = 0;
         }
       }
+
+      // The bytes of the object on hugepages that the kernel backs with a
+      // hugepage, looked up once per hugepage.
+      if (object.addr == nullptr) continue;
+      uintptr_t begin = reinterpret_cast<uintptr_t>(object.addr);
+      const uintptr_t end = begin + object.size;
+      while (begin < end) {
+        const uintptr_t hugepage = begin & ~(kHugePageSize - 1);
+        if (hugepage != last_hugepage) {
+          last_hugepage_backed =
+              pageflags->IsHugepageBacked(reinterpret_cast<void*>(hugepage));
+          last_hugepage = hugepage;
+        }
+        const uintptr_t next = std::min(end, hugepage + kHugePageSize);
+        if (last_hugepage_backed.has_value()) {
+          if (!data.hugepage_size.has_value()) {
+            data.hugepage_size.emplace();
+          }
+          if (*last_hugepage_backed) {
+            data.hugepage_size.value() += object.count * (next - begin);
+          }
+        }
+        begin = next;
+      }
     }
-  });
+  }
   return map;
 }
 
@@ -345,10 +414,47 @@ ABSL_CONST_INIT const absl::string_view kProfileDropFrames =
     "operator new|"
     "operator delete";
 
+// Field numbers of the repeated fields of profile.proto that are streamed.
+constexpr int kSampleField = 2;
+constexpr int kLocationField = 4;
+constexpr int kStringTableField = 6;
+
 ProfileBuilder::ProfileBuilder()
     : profile_(std::make_unique<perftools::profiles::Profile>()) {
   // string_table[0] must be ""
-  profile_->add_string_table("");
+  AppendString("");
+}
+
+ProfileBuilder::ProfileBuilder(
+    google::protobuf::io::CodedOutputStream* absl_nonnull output)
+    : profile_(std::make_unique<perftools::profiles::Profile>()),
+      output_(output) {
+  // string_table[0] must be ""
+  AppendString("");
+}
+
+void ProfileBuilder::AppendString(absl::string_view sv) {
+  ++num_strings_;
+  if (output_ == nullptr) {
+    profile_->add_string_table(std::string(sv));
+    return;
+  }
+
+  output_->WriteTag(google::protobuf::internal::WireFormatLite::MakeTag(
+      kStringTableField,
+      google::protobuf::internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+  output_->WriteVarint32(sv.size());
+  output_->WriteRaw(sv.data(), sv.size());
+}
+
+void ProfileBuilder::WriteMessage(
+    int field, const google::protobuf::MessageLite& message) {
+  TC_ASSERT_NE(output_, nullptr);
+  output_->WriteTag(google::protobuf::internal::WireFormatLite::MakeTag(
+      field,
+      google::protobuf::internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+  output_->WriteVarint32(message.ByteSizeLong());
+  message.SerializeWithCachedSizes(output_);
 }
 
 int ProfileBuilder::InternString(absl::string_view sv) {
@@ -356,13 +462,13 @@ int ProfileBuilder::InternString(absl::string_view sv) {
     return 0;
   }
 
-  const int index = profile_->string_table_size();
+  const int index = num_strings_;
   const auto inserted = strings_.emplace(sv, index);
   if (!inserted.second) {
     // Failed to insert -- use existing id.
     return inserted.first->second;
   }
-  profile_->add_string_table(inserted.first->first);
+  AppendString(inserted.first->first);
   return index;
 }
 
@@ -370,39 +476,61 @@ int ProfileBuilder::InternLocation(const void* ptr) {
   uintptr_t address = absl::bit_cast<uintptr_t>(ptr);
 
   // Avoid assigning location ID 0 by incrementing by 1.
-  const int index = profile_->location_size() + 1;
+  const int index = num_locations_ + 1;
   const auto inserted = locations_.emplace(address, index);
   if (!inserted.second) {
     // Failed to insert -- use existing id.
     return inserted.first->second;
   }
-  perftools::profiles::Location& location = *profile_->add_location();
+  ++num_locations_;
+  perftools::profiles::Location* location;
+  if (output_ == nullptr) {
+    location = profile_->add_location();
+  } else {
+    location = &location_;
+    location->Clear();
+  }
   TC_ASSERT_EQ(inserted.first->second, index);
-  location.set_id(index);
-  location.set_address(address);
+  location->set_id(index);
+  location->set_address(address);
+
+  if (!mappings_.empty()) {
+    // Find the mapping ID.
+    auto it = mappings_.upper_bound(address);
+    if (it != mappings_.begin()) {
+      --it;
+    }
 
-  if (mappings_.empty()) {
-    return index;
-  }
+    // If *it contains address, add mapping to location.
+    const int mapping_index = it->second;
+    const perftools::profiles::Mapping& mapping =
+        profile_->mapping(mapping_index);
+    const int mapping_id = mapping.id();
+    TC_ASSERT(it->first == mapping.memory_start());
 
-  // Find the mapping ID.
-  auto it = mappings_.upper_bound(address);
-  if (it != mappings_.begin()) {
-    --it;
+    if (it->first <= address && address < mapping.memory_limit()) {
+      location->set_mapping_id(mapping_id);
+    }
   }
 
-  // If *it contains address, add mapping to location.
-  const int mapping_index = it->second;
-  const perftools::profiles::Mapping& mapping =
-      profile_->mapping(mapping_index);
-  const int mapping_id = mapping.id();
-  TC_ASSERT(it->first == mapping.memory_start());
+  if (output_ != nullptr) {
+    WriteMessage(kLocationField, *location);
+  }
+  return index;
+}
 
-  if (it->first <= address && address < mapping.memory_limit()) {
-    location.set_mapping_id(mapping_id);
+perftools::profiles::Sample& ProfileBuilder::NewSample() {
+  if (output_ == nullptr) {
+    return *profile_->add_sample();
   }
+  sample_.Clear();
+  return sample_;
+}
 
-  return index;
+void ProfileBuilder::CommitSample() {
+  if (output_ != nullptr) {
+    WriteMessage(kSampleField, sample_);
+  }
 }
 
 void ProfileBuilder::InternCallstack(absl::Span<const void* const> stack,
@@ -418,16 +546,44 @@ void ProfileBuilder::InternCallstack(absl::Span<const void* const> stack,
   TC_ASSERT_EQ(sample.location_id().size(), stack.size());
 }
 
-void ProfileBuilder::AddCurrentMappings() {
 #if defined(__linux__)
+namespace {
+
+// A loadable segment of an object of the current process.
+struct CurrentMapping {
+  uintptr_t memory_start;
+  uintptr_t memory_limit;
+  uintptr_t file_offset;
+  std::string filename;
+  std::string build_id;
+};
+
+// Returns how many objects were loaded and unloaded so far, or std::nullopt if
+// the C library does not count them.
+std::optional<std::pair<uint64_t, uint64_t>> LoadGeneration() {
+  std::optional<std::pair<uint64_t, uint64_t>> generation;
+  auto dl_iterate_callback = +[](dl_phdr_info* info, size_t size, void* data) {
+    if (size >= offsetof(dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+      *static_cast<std::optional<std::pair<uint64_t, uint64_t>>*>(data) =
+          std::make_pair(info->dlpi_adds, info->dlpi_subs);
+    }
+    // Every entry carries the same counts.
+    return 1;
+  };
+  dl_iterate_phdr(dl_iterate_callback, &generation);
+  return generation;
+}
+
+std::vector<CurrentMapping> ReadCurrentMappings() {
+  std::vector<CurrentMapping> mappings;
   auto dl_iterate_callback = +[](dl_phdr_info* info, size_t size, void* data) {
     // Skip dummy entry introduced since glibc 2.18.
     if (info->dlpi_phdr == nullptr && info->dlpi_phnum == 0) {
       return 0;
     }
 
-    ProfileBuilder& builder = *static_cast<ProfileBuilder*>(data);
-    const bool is_main_executable = builder.profile_->mapping_size() == 0;
+    auto& mappings = *static_cast<std::vector<CurrentMapping>*>(data);
+    const bool is_main_executable = mappings.empty();
 
     // Storage for path to executable as dlpi_name isn't populated for the
     // main executable.  +1 to allow for the null terminator that readlink
@@ -475,15 +631,58 @@ void ProfileBuilder::AddCurrentMappings() {
       const size_t memory_limit = memory_start + pt_load->p_memsz;
       const size_t file_offset = pt_load->p_offset;
 
-      // Add to profile.
-      builder.AddMapping(memory_start, memory_limit, file_offset,
-                         resolved_filename, build_id);
+      mappings.push_back({memory_start, memory_limit, file_offset,
+                          std::string(resolved_filename), build_id});
     }
     // Keep going.
     return 0;
   };
 
-  dl_iterate_phdr(dl_iterate_callback, this);
+  dl_iterate_phdr(dl_iterate_callback, &mappings);
+  return mappings;
+}
+
+// Resolving the paths and build IDs of the loaded objects takes time in
+// binaries with hundreds of them, so their mappings are kept until an object
+// is loaded or unloaded.
+class CurrentMappingsCache {
+ public:
+  std::shared_ptr<const std::vector<CurrentMapping>> Get() {
+    const std::optional<std::pair<uint64_t, uint64_t>> generation =
+        LoadGeneration();
+    absl::MutexLock l(&mu_);
+    if (mappings_ == nullptr || !generation.has_value() ||
+        generation != generation_) {
+      mappings_ = std::make_shared<const std::vector<CurrentMapping>>(
+          ReadCurrentMappings());
+      generation_ = generation;
+    }
+    return mappings_;
+  }
+
+ private:
+  absl::Mutex mu_;
+  std::optional<std::pair<uint64_t, uint64_t>> generation_
+      ABSL_GUARDED_BY(mu_);
+  std::shared_ptr<const std::vector<CurrentMapping>> mappings_
+      ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace
+#endif  // defined(__linux__)
+
+void ProfileBuilder::AddCurrentMappings(bool build_id_only) {
+#if defined(__linux__)
+  static CurrentMappingsCache& cache = *new CurrentMappingsCache;
+  const std::shared_ptr<const std::vector<CurrentMapping>> mappings =
+      cache.Get();
+  for (const CurrentMapping& m : *mappings) {
+    // Objects with a build ID are symbolized by it, without their path.
+    const absl::string_view filename =
+        build_id_only && !m.build_id.empty() ? "" : m.filename;
+    AddMapping(m.memory_start, m.memory_limit, m.file_offset, filename,
+               m.build_id);
+  }
 #endif  // defined(__linux__)
 }
 
@@ -504,6 +703,19 @@ int ProfileBuilder::AddMapping(uintptr_t memory_start, uintptr_t memory_limit,
   return mapping_id;
 }
 
+// Stamps the experiment arm the profile was collected under as a comment, so
+// that fleet analysis can group profiles by it.
+static void AddExperimentId(const tcmalloc::Profile& profile,
+                            ProfileBuilder& builder) {
+  const uint64_t experiment_id = profile.ExperimentId();
+  if (experiment_id == 0) {
+    return;
+  }
+  builder.profile().add_comment(builder.InternString(
+      absl::StrCat("tcmalloc_experiment_id=",
+                   absl::Hex(experiment_id, absl::kZeroPad16))));
+}
+
 static void AddCommonSampleTags(const tcmalloc::Profile::Sample& entry,
                                 perftools::profiles::Sample& sample,
                                 ProfileBuilder& builder) {
@@ -516,6 +728,8 @@ static void AddCommonSampleTags(const tcmalloc::Profile::Sample& entry,
   const int cold_id = builder.InternString("cold");
   const int hot_id = builder.InternString("hot");
   const int token_id = builder.InternString("token_id");
+  const int tenant_id = builder.InternString("tenant");
+  const int sampling_interval_id = builder.InternString("sampling_interval");
   const int allocation_type_id = builder.InternString("allocation type");
   const int new_id = builder.InternString("new");
   const int malloc_id = builder.InternString("malloc");
@@ -567,6 +781,8 @@ static void AddCommonSampleTags(const tcmalloc::Profile::Sample& entry,
   add_access_label(access_allocated_id, entry.access_allocated);
 
   add_label(token_id, token_id, static_cast<uint8_t>(entry.token_id));
+  add_positive_label(tenant_id, tenant_id, entry.tenant);
+  add_positive_label(sampling_interval_id, bytes_id, entry.sampling_interval);
 
   perftools::profiles::Label& type_label = *sample.add_label();
   type_label.set_key(allocation_type_id);
@@ -633,6 +849,111 @@ static void AddCommonSampleTags(const tcmalloc::Profile::Sample& entry,
   }
 }
 
+static absl::Status MakeLockContentionProfileProto(
+    const tcmalloc::Profile& profile, ProfileBuilder* builder) {
+  TC_CHECK_NE(builder, nullptr);
+  perftools::profiles::Profile& converted = builder->profile();
+
+  const int count_id = builder->InternString("count");
+  const int contentions_id = builder->InternString("contentions");
+  const int delay_id = builder->InternString("delay");
+  const int nanoseconds_id = builder->InternString("nanoseconds");
+
+  perftools::profiles::ValueType* period_type = converted.mutable_period_type();
+  period_type->set_type(contentions_id);
+  period_type->set_unit(count_id);
+
+  perftools::profiles::ValueType* sample_type = converted.add_sample_type();
+  sample_type->set_type(contentions_id);
+  sample_type->set_unit(count_id);
+  sample_type = converted.add_sample_type();
+  sample_type->set_type(delay_id);
+  sample_type->set_unit(nanoseconds_id);
+
+  converted.set_default_sample_type(delay_id);
+  converted.set_duration_nanos(absl::ToInt64Nanoseconds(profile.Duration()));
+  if (auto start = profile.StartTime(); start.has_value()) {
+    converted.set_time_nanos(absl::ToUnixNanos(*start));
+  }
+  AddExperimentId(profile, *builder);
+  converted.set_drop_frames(builder->InternString(kProfileDropFrames));
+
+  profile.Iterate([&](const tcmalloc::Profile::Sample& entry) {
+    perftools::profiles::Sample& sample = builder->NewSample();
+
+    TC_CHECK_LE(entry.depth, ABSL_ARRAYSIZE(entry.stack));
+    builder->InternCallstack(absl::MakeSpan(entry.stack, entry.depth), sample);
+
+    sample.add_value(entry.count);
+    sample.add_value(entry.sum);
+    builder->CommitSample();
+  });
+  return absl::OkStatus();
+}
+
+static absl::Status MakeSlowAllocationProfileProto(
+    const tcmalloc::Profile& profile, ProfileBuilder* builder) {
+  TC_CHECK_NE(builder, nullptr);
+  perftools::profiles::Profile& converted = builder->profile();
+
+  const int count_id = builder->InternString("count");
+  const int allocations_id = builder->InternString("allocations");
+  const int delay_id = builder->InternString("delay");
+  const int nanoseconds_id = builder->InternString("nanoseconds");
+  const int request_id = builder->InternString("request");
+  const int bytes_id = builder->InternString("bytes");
+  const int cause_id = builder->InternString("cause");
+  const int cause_ids[] = {
+      builder->InternString("other"),
+      builder->InternString("lock_wait"),
+      builder->InternString("system_allocation"),
+      builder->InternString("page_backing"),
+      builder->InternString("slab_resize"),
+  };
+
+  perftools::profiles::ValueType* period_type = converted.mutable_period_type();
+  period_type->set_type(allocations_id);
+  period_type->set_unit(count_id);
+
+  perftools::profiles::ValueType* sample_type = converted.add_sample_type();
+  sample_type->set_type(allocations_id);
+  sample_type->set_unit(count_id);
+  sample_type = converted.add_sample_type();
+  sample_type->set_type(delay_id);
+  sample_type->set_unit(nanoseconds_id);
+
+  converted.set_default_sample_type(delay_id);
+  converted.set_duration_nanos(absl::ToInt64Nanoseconds(profile.Duration()));
+  if (auto start = profile.StartTime(); start.has_value()) {
+    converted.set_time_nanos(absl::ToUnixNanos(*start));
+  }
+  converted.set_drop_frames(builder->InternString(kProfileDropFrames));
+
+  profile.Iterate([&](const tcmalloc::Profile::Sample& entry) {
+    perftools::profiles::Sample& sample = builder->NewSample();
+
+    TC_CHECK_LE(entry.depth, ABSL_ARRAYSIZE(entry.stack));
+    builder->InternCallstack(absl::MakeSpan(entry.stack, entry.depth), sample);
+
+    sample.add_value(entry.count);
+    sample.add_value(entry.sum);
+
+    perftools::profiles::Label& request_label = *sample.add_label();
+    request_label.set_key(request_id);
+    request_label.set_num(entry.requested_size);
+    request_label.set_num_unit(bytes_id);
+
+    const size_t cause = static_cast<size_t>(entry.slow_allocation_cause);
+    if (cause < ABSL_ARRAYSIZE(cause_ids)) {
+      perftools::profiles::Label& cause_label = *sample.add_label();
+      cause_label.set_key(cause_id);
+      cause_label.set_str(cause_ids[cause]);
+    }
+    builder->CommitSample();
+  });
+  return absl::OkStatus();
+}
+
 static absl::Status MakeLifetimeProfileProto(const tcmalloc::Profile& profile,
                                              ProfileBuilder* builder) {
   TC_CHECK_NE(builder, nullptr);
@@ -659,6 +980,7 @@ static absl::Status MakeLifetimeProfileProto(const tcmalloc::Profile& profile,
   if (auto start = profile.StartTime(); start.has_value()) {
     converted.set_time_nanos(absl::ToUnixNanos(*start));
   }
+  AddExperimentId(profile, *builder);
 
   converted.set_drop_frames(builder->InternString(kProfileDropFrames));
 
@@ -680,7 +1002,7 @@ static absl::Status MakeLifetimeProfileProto(const tcmalloc::Profile& profile,
   const int none_id = builder->InternString("none");
 
   profile.Iterate([&](const tcmalloc::Profile::Sample& entry) {
-    perftools::profiles::Sample& sample = *converted.add_sample();
+    perftools::profiles::Sample& sample = builder->NewSample();
 
     TC_CHECK_LE(entry.depth, ABSL_ARRAYSIZE(entry.stack));
     builder->InternCallstack(absl::MakeSpan(entry.stack, entry.depth), sample);
@@ -768,17 +1090,28 @@ static absl::Status MakeLifetimeProfileProto(const tcmalloc::Profile& profile,
       sample.add_value(0);
       sample.add_value(0);
     }
+    builder->CommitSample();
   });
   return absl::OkStatus();
 }
 
 std::unique_ptr<perftools::profiles::Profile> ProfileBuilder::Finalize() && {
+  TC_ASSERT_EQ(output_, nullptr);
   return std::move(profile_);
 }
 
-absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
-    const ::tcmalloc::Profile& profile, PageFlagsBase* pageflags,
-    Residency* residency) {
+absl::Status ProfileBuilder::Finish() && {
+  TC_ASSERT_NE(output_, nullptr);
+  // Everything streamed so far is a repeated field, so appending the remaining
+  // fields of the profile yields the same message as building it whole.
+  profile_->SerializeToCodedStream(output_);
+  if (output_->HadError()) {
+    return absl::InternalError("Failed to write profile");
+  }
+  return absl::OkStatus();
+}
+
+static absl::Status CheckProfileAvailable(const ::tcmalloc::Profile& profile) {
   if (profile.Type() == ProfileType::kDoNotUse) {
 #if defined(ABSL_HAVE_ADDRESS_SANITIZER) || \
     defined(ABSL_HAVE_LEAK_SANITIZER) ||    \
@@ -792,28 +1125,24 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
         "custom allocator may be linked)");
 #endif
   }
+  return absl::OkStatus();
+}
 
-  ProfileBuilder builder;
-  builder.AddCurrentMappings();
-
-  if (profile.Type() == ProfileType::kLifetimes) {
-    absl::Status error = MakeLifetimeProfileProto(profile, &builder);
-    if (!error.ok()) {
-      return error;
-    }
-    return std::move(builder).Finalize();
-  }
-
+// Sets the profile-wide fields and the sample types of a memory profile of
+// `profile`'s type.  The residency sample types are added if
+// `exporting_residency`.
+static absl::Status BuildMemoryProfileHeader(const ::tcmalloc::Profile& profile,
+                                             bool exporting_residency,
+                                             ProfileBuilder& builder) {
   const int bytes_id = builder.InternString("bytes");
   const int count_id = builder.InternString("count");
   const int objects_id = builder.InternString("objects");
-  const int stale_scan_period_id = builder.InternString("stale_scan_period");
-  const int seconds_id = builder.InternString("seconds");
   const int space_id = builder.InternString("space");
   const int resident_space_id = builder.InternString("resident_space");
   const int swapped_space_id = builder.InternString("swapped_space");
   const int stale_space_id = builder.InternString("stale_space");
   const int locked_space_id = builder.InternString("locked_space");
+  const int hugepage_space_id = builder.InternString("hugepage_space");
 
   perftools::profiles::Profile& converted = builder.profile();
 
@@ -827,6 +1156,7 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
   if (auto start = profile.StartTime(); start.has_value()) {
     converted.set_time_nanos(absl::ToUnixNanos(*start));
   }
+  AddExperimentId(profile, builder);
 
   {
     perftools::profiles::ValueType& sample_type = *converted.add_sample_type();
@@ -840,8 +1170,6 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
     sample_type.set_unit(bytes_id);
   }
 
-  const bool exporting_residency =
-      (profile.Type() == tcmalloc::ProfileType::kHeap);
   if (exporting_residency) {
     perftools::profiles::ValueType* sample_type = converted.add_sample_type();
     sample_type->set_type(resident_space_id);
@@ -858,6 +1186,10 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
     sample_type = converted.add_sample_type();
     sample_type->set_type(locked_space_id);
     sample_type->set_unit(bytes_id);
+
+    sample_type = converted.add_sample_type();
+    sample_type->set_type(hugepage_space_id);
+    sample_type->set_unit(bytes_id);
   }
 
   int default_sample_type_id;
@@ -865,6 +1197,8 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
     case tcmalloc::ProfileType::kFragmentation:
     case tcmalloc::ProfileType::kHeap:
     case tcmalloc::ProfileType::kPeakHeap:
+    case tcmalloc::ProfileType::kRealizedFragmentation:
+    case tcmalloc::ProfileType::kLeakCandidates:
       default_sample_type_id = space_id;
       break;
     case tcmalloc::ProfileType::kAllocations:
@@ -875,12 +1209,23 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
   }
 
   converted.set_default_sample_type(default_sample_type_id);
+  return absl::OkStatus();
+}
+
+// Adds the merged `samples` of a memory profile to `builder`.  If `snapshot`
+// is set, each sample is labelled with it.
+static void AddMergedSamples(const SampleMergedMap& samples,
+                             bool exporting_residency,
+                             std::optional<int64_t> snapshot,
+                             ProfileBuilder& builder) {
+  const int stale_scan_period_id = builder.InternString("stale_scan_period");
+  const int seconds_id = builder.InternString("seconds");
+  const int growth_rate_id = builder.InternString("growth_rate");
+  const int bytes_per_second_id = builder.InternString("bytes_per_second");
+  const int snapshot_id = builder.InternString("snapshot");
 
-  SampleMergedMap samples = MergeProfileSamplesAndMaybeGetResidencyInfo(
-      profile, pageflags, residency);
   for (const auto& [entry, data] : samples) {
-    perftools::profiles::Profile& profile = builder.profile();
-    perftools::profiles::Sample& sample = *profile.add_sample();
+    perftools::profiles::Sample& sample = builder.NewSample();
 
     TC_CHECK_LE(entry.depth, ABSL_ARRAYSIZE(entry.stack));
     builder.InternCallstack(absl::MakeSpan(entry.stack, entry.depth), sample);
@@ -892,6 +1237,7 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
       sample.add_value(data.swapped_size.value_or(0));
       sample.add_value(data.stale_size.value_or(0));
       sample.add_value(data.locked_size.value_or(0));
+      sample.add_value(data.hugepage_size.value_or(0));
     }
 
     // add fields that are common to all memory profiles
@@ -911,8 +1257,142 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
 
     add_positive_label(stale_scan_period_id, seconds_id,
                        data.stale_scan_period.value_or(0));
+    if (data.growth_rate != 0) {
+      perftools::profiles::Label& label = *sample.add_label();
+      label.set_key(growth_rate_id);
+      label.set_num(data.growth_rate);
+      label.set_num_unit(bytes_per_second_id);
+    }
+    if (snapshot.has_value()) {
+      perftools::profiles::Label& label = *sample.add_label();
+      label.set_key(snapshot_id);
+      label.set_num(*snapshot);
+    }
+    builder.CommitSample();
+  }
+}
+
+// Converts `profile` into `builder`.
+static absl::Status BuildProfileProto(const ::tcmalloc::Profile& profile,
+                                      PageFlagsBase* pageflags,
+                                      Residency* residency,
+                                      bool build_id_only_mappings,
+                                      ProfileBuilder& builder) {
+  if (absl::Status status = CheckProfileAvailable(profile); !status.ok()) {
+    return status;
   }
 
+  builder.AddCurrentMappings(build_id_only_mappings);
+
+  if (profile.Type() == ProfileType::kLifetimes) {
+    return MakeLifetimeProfileProto(profile, &builder);
+  }
+
+  if (profile.Type() == ProfileType::kLockContention) {
+    return MakeLockContentionProfileProto(profile, &builder);
+  }
+
+  if (profile.Type() == ProfileType::kSlowAllocations) {
+    return MakeSlowAllocationProfileProto(profile, &builder);
+  }
+
+  const bool exporting_residency =
+      (profile.Type() == tcmalloc::ProfileType::kHeap);
+  if (absl::Status status =
+          BuildMemoryProfileHeader(profile, exporting_residency, builder);
+      !status.ok()) {
+    return status;
+  }
+
+  AddMergedSamples(MergeProfileSamplesAndMaybeGetResidencyInfo(
+                       profile, pageflags, residency),
+                   exporting_residency, std::nullopt, builder);
+  return absl::OkStatus();
+}
+
+// Converts a series of memory profiles of the same type into `builder`.  If
+// `per_snapshot`, the samples of each profile are kept apart and labelled with
+// its index; otherwise they are summed by stack across all of them.
+static absl::Status BuildMultiProfileProto(
+    absl::Span<const ::tcmalloc::Profile* const> profiles, bool per_snapshot,
+    ProfileBuilder& builder) {
+  if (profiles.empty()) {
+    return absl::InvalidArgumentError("No profiles to merge");
+  }
+  const ::tcmalloc::Profile& first = *profiles.front();
+  for (const ::tcmalloc::Profile* profile : profiles) {
+    if (absl::Status status = CheckProfileAvailable(*profile); !status.ok()) {
+      return status;
+    }
+    if (profile->Type() != first.Type()) {
+      return absl::InvalidArgumentError(
+          "Only profiles of the same type can be merged");
+    }
+  }
+  if (first.Type() == ProfileType::kLifetimes ||
+      first.Type() == ProfileType::kLockContention ||
+      first.Type() == ProfileType::kSlowAllocations) {
+    return absl::InvalidArgumentError(
+        "Only memory profiles can be merged");
+  }
+
+  builder.AddCurrentMappings();
+  // The snapshots were taken at different times, so their residency is gone.
+  if (absl::Status status = BuildMemoryProfileHeader(
+          first, /*exporting_residency=*/false, builder);
+      !status.ok()) {
+    return status;
+  }
+
+  // The profile covers the span from the first snapshot to the end of the
+  // last one.
+  perftools::profiles::Profile& converted = builder.profile();
+  const ::tcmalloc::Profile& last = *profiles.back();
+  if (first.StartTime().has_value() && last.StartTime().has_value()) {
+    converted.set_duration_nanos(absl::ToInt64Nanoseconds(
+        *last.StartTime() + last.Duration() - *first.StartTime()));
+  }
+
+  if (per_snapshot) {
+    for (size_t i = 0; i < profiles.size(); ++i) {
+      if (auto start = profiles[i]->StartTime(); start.has_value()) {
+        converted.add_comment(builder.InternString(
+            absl::StrCat("tcmalloc_snapshot_", i,
+                         "_time_nanos=", absl::ToUnixNanos(*start))));
+      }
+      AddMergedSamples(MergeProfileSamplesAndMaybeGetResidencyInfo(
+                           *profiles[i], nullptr, nullptr),
+                       /*exporting_residency=*/false, i, builder);
+    }
+    return absl::OkStatus();
+  }
+
+  // Only one entry per distinct stack is held, however many samples the
+  // profiles have.
+  SampleMergedMap merged;
+  for (const ::tcmalloc::Profile* profile : profiles) {
+    profile->Iterate([&](const tcmalloc::Profile::Sample& entry) {
+      SampleMergedData& data = merged[entry];
+      data.count += entry.count;
+      data.sum += entry.sum;
+      data.growth_rate += entry.growth_rate;
+    });
+  }
+  AddMergedSamples(merged, /*exporting_residency=*/false, std::nullopt,
+                   builder);
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
+    const ::tcmalloc::Profile& profile, PageFlagsBase* pageflags,
+    Residency* residency) {
+  ProfileBuilder builder;
+  absl::Status status =
+      BuildProfileProto(profile, pageflags, residency,
+                        /*build_id_only_mappings=*/false, builder);
+  if (!status.ok()) {
+    return status;
+  }
   return std::move(builder).Finalize();
 }
 
@@ -943,5 +1423,133 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
   return MakeProfileProto(profile, p, r);
 }
 
+absl::Status WriteProfileProto(
+    const ::tcmalloc::Profile& profile,
+    google::protobuf::io::ZeroCopyOutputStream* absl_nonnull output,
+    bool build_id_only_mappings) {
+  // Used to populate residency info in heap profile.
+  std::optional<PageFlags> pageflags;
+  std::optional<ResidencyPageMap> residency;
+
+  PageFlags* p = nullptr;
+  Residency* r = nullptr;
+
+  if (profile.Type() == ProfileType::kHeap) {
+    p = &pageflags.emplace();
+    r = &residency.emplace();
+  }
+
+  google::protobuf::io::CodedOutputStream stream(output);
+  ProfileBuilder builder(&stream);
+  absl::Status status =
+      BuildProfileProto(profile, p, r, build_id_only_mappings, builder);
+  if (!status.ok()) {
+    return status;
+  }
+  return std::move(builder).Finish();
+}
+
+absl::Status WriteProfileSnapshotsProto(
+    absl::Span<const ::tcmalloc::Profile* const> profiles,
+    google::protobuf::io::ZeroCopyOutputStream* absl_nonnull output) {
+  google::protobuf::io::CodedOutputStream stream(output);
+  ProfileBuilder builder(&stream);
+  absl::Status status =
+      BuildMultiProfileProto(profiles, /*per_snapshot=*/true, builder);
+  if (!status.ok()) {
+    return status;
+  }
+  return std::move(builder).Finish();
+}
+
+absl::Status WriteMergedProfileProto(
+    absl::Span<const ::tcmalloc::Profile* const> profiles,
+    google::protobuf::io::ZeroCopyOutputStream* absl_nonnull output) {
+  google::protobuf::io::CodedOutputStream stream(output);
+  ProfileBuilder builder(&stream);
+  absl::Status status =
+      BuildMultiProfileProto(profiles, /*per_snapshot=*/false, builder);
+  if (!status.ok()) {
+    return status;
+  }
+  return std::move(builder).Finish();
+}
+
+absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>>
+MakeHeapDeltaProfileProto(const ::tcmalloc::Profile& added,
+                          absl::Span<const MallocHook::AllocHandle> removed) {
+  if (added.Type() != ProfileType::kHeap) {
+    return absl::InvalidArgumentError(
+        "Heap profile deltas must be built from a heap profile");
+  }
+
+  ProfileBuilder builder;
+  builder.AddCurrentMappings();
+
+  const int bytes_id = builder.InternString("bytes");
+  const int count_id = builder.InternString("count");
+  const int objects_id = builder.InternString("objects");
+  const int space_id = builder.InternString("space");
+  const int alloc_handle_id = builder.InternString("alloc_handle");
+  const int removed_alloc_handle_id =
+      builder.InternString("removed_alloc_handle");
+
+  perftools::profiles::Profile& converted = builder.profile();
+
+  perftools::profiles::ValueType& period_type =
+      *converted.mutable_period_type();
+  period_type.set_type(space_id);
+  period_type.set_unit(bytes_id);
+  converted.set_drop_frames(builder.InternString(kProfileDropFrames));
+  if (auto start = added.StartTime(); start.has_value()) {
+    converted.set_time_nanos(absl::ToUnixNanos(*start));
+  }
+  AddExperimentId(added, builder);
+
+  {
+    perftools::profiles::ValueType& sample_type = *converted.add_sample_type();
+    sample_type.set_type(objects_id);
+    sample_type.set_unit(count_id);
+  }
+
+  {
+    perftools::profiles::ValueType& sample_type = *converted.add_sample_type();
+    sample_type.set_type(space_id);
+    sample_type.set_unit(bytes_id);
+  }
+
+  converted.set_default_sample_type(space_id);
+
+  added.Iterate([&](const tcmalloc::Profile::Sample& entry) {
+    perftools::profiles::Sample& sample = builder.NewSample();
+
+    TC_CHECK_LE(entry.depth, ABSL_ARRAYSIZE(entry.stack));
+    builder.InternCallstack(absl::MakeSpan(entry.stack, entry.depth), sample);
+
+    sample.add_value(entry.count);
+    sample.add_value(entry.sum);
+
+    AddCommonSampleTags(entry, sample, builder);
+
+    perftools::profiles::Label& label = *sample.add_label();
+    label.set_key(alloc_handle_id);
+    label.set_num(static_cast<int64_t>(entry.alloc_handle));
+    builder.CommitSample();
+  });
+
+  for (MallocHook::AllocHandle handle : removed) {
+    perftools::profiles::Sample& sample = builder.NewSample();
+    sample.add_value(0);
+    sample.add_value(0);
+
+    perftools::profiles::Label& label = *sample.add_label();
+    label.set_key(removed_alloc_handle_id);
+    label.set_num(static_cast<int64_t>(handle));
+    builder.CommitSample();
+  }
+
+  return std::move(builder).Finalize();
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
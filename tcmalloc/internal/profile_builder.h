@@ -24,7 +24,11 @@
 #include <memory>
 #include <string>
 
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "google/protobuf/message_lite.h"
 #include "tcmalloc/internal/profile.pb.h"
+#include "absl/base/nullability.h"
 #include "absl/container/btree_map.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
@@ -42,14 +46,30 @@ std::string GetBuildId(const dl_phdr_info* info);
 
 // ProfileBuilder manages building up a profile.proto instance and populating
 // common parts using the string/pointer table conventions expected by pprof.
+//
+// A builder constructed with an output stream instead writes the serialized
+// profile.proto as it goes: strings, locations and samples are written out as
+// soon as they are added, so that memory use is bounded by the number of
+// distinct strings and locations rather than by the number of samples.
 class ProfileBuilder {
  public:
   ProfileBuilder();
+  explicit ProfileBuilder(
+      google::protobuf::io::CodedOutputStream* absl_nonnull output);
 
+  // When streaming, this only holds the mappings and the scalar fields, which
+  // are written out by Finish().
   perftools::profiles::Profile& profile() { return *profile_; }
 
-  // Adds the current process mappings to the profile.
-  void AddCurrentMappings();
+  // Returns an empty sample to populate.  It becomes part of the profile once
+  // CommitSample() is called, and must not be used after that.
+  perftools::profiles::Sample& NewSample();
+  void CommitSample();
+
+  // Adds the current process mappings to the profile.  They are cached until
+  // an object is loaded or unloaded.  If `build_id_only`, the paths of the
+  // objects that have a build ID are left out, for offline symbolization.
+  void AddCurrentMappings(bool build_id_only = false);
 
   // Adds a single mapping to the profile and to lookup cache and returns the
   // resulting ID.
@@ -72,8 +92,21 @@ class ProfileBuilder {
 
   std::unique_ptr<perftools::profiles::Profile> Finalize() &&;
 
+  // Writes out the rest of a streamed profile.
+  absl::Status Finish() &&;
+
  private:
+  void AppendString(absl::string_view sv);
+  void WriteMessage(int field, const google::protobuf::MessageLite& message);
+
   std::unique_ptr<perftools::profiles::Profile> profile_;
+  // Set when streaming.
+  google::protobuf::io::CodedOutputStream* output_ = nullptr;
+  // Reused for each location and sample when streaming.
+  perftools::profiles::Location location_;
+  perftools::profiles::Sample sample_;
+  int num_strings_ = 0;
+  int num_locations_ = 0;
   // mappings_ stores the start address of each mapping in profile_->mapping()
   // to its index.
   absl::btree_map<uintptr_t, int> mappings_;
@@ -86,6 +119,31 @@ extern const absl::string_view kProfileDropFrames;
 absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
     const ::tcmalloc::Profile& profile);
 
+// Writes a series of memory profiles of the same type, such as periodic heap
+// profiles of one process, as a single serialized profile.proto.  Strings,
+// locations and mappings are stored once for all of them.  The samples of each
+// profile are merged by stack as in MakeProfileProto, and labelled "snapshot"
+// with the index of their profile.  Residency is not reported.
+absl::Status WriteProfileSnapshotsProto(
+    absl::Span<const ::tcmalloc::Profile* const> profiles,
+    google::protobuf::io::ZeroCopyOutputStream* absl_nonnull output);
+
+// Like WriteProfileSnapshotsProto, but sums the samples with the same stack
+// across all of the profiles.  The profiles are visited once each, and only
+// one entry per distinct sample is held in memory.
+absl::Status WriteMergedProfileProto(
+    absl::Span<const ::tcmalloc::Profile* const> profiles,
+    google::protobuf::io::ZeroCopyOutputStream* absl_nonnull output);
+
+// Converts a heap profile delta into a profile.proto.  Added samples are kept
+// separate, rather than merged by stack, and carry an "alloc_handle" label so
+// that a consumer can match them against later removals.  Each removed handle
+// is recorded as a sample with no stack and zero values, labelled
+// "removed_alloc_handle".
+absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>>
+MakeHeapDeltaProfileProto(const ::tcmalloc::Profile& added,
+                          absl::Span<const MallocHook::AllocHandle> removed);
+
 class PageFlagsBase;
 class PageFlags;
 class Residency;
@@ -95,6 +153,14 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
     const ::tcmalloc::Profile& profile, PageFlagsBase* pageflags,
     Residency* residency);
 
+// Like MakeProfileProto, but writes the serialized profile.proto to `output` as
+// it is built, rather than materializing it in memory first.  If
+// `build_id_only_mappings`, mappings with a build ID have no filename.
+absl::Status WriteProfileProto(
+    const ::tcmalloc::Profile& profile,
+    google::protobuf::io::ZeroCopyOutputStream* absl_nonnull output,
+    bool build_id_only_mappings = false);
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 
@@ -33,6 +33,7 @@
 #include <variant>
 #include <vector>
 
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "tcmalloc/internal/profile.pb.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -61,6 +62,8 @@ namespace {
 
 using ::testing::AnyOf;
 using ::testing::Each;
+using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
 using ::testing::IsSupersetOf;
 using ::testing::Key;
 using ::testing::Not;
@@ -146,6 +149,39 @@ TEST(ProfileBuilderTest, Mappings) {
   EXPECT_THAT(mapping_ids, Not(testing::Contains(0)));
 }
 
+TEST(ProfileBuilderTest, MappingsAreCached) {
+  auto build = [](bool build_id_only) {
+    ProfileBuilder builder;
+    builder.AddCurrentMappings(build_id_only);
+    return std::move(builder).Finalize();
+  };
+  auto first = build(false);
+  auto second = build(false);
+  ASSERT_EQ(first->mapping_size(), second->mapping_size());
+  for (int i = 0; i < first->mapping_size(); ++i) {
+    EXPECT_EQ(first->mapping(i).memory_start(),
+              second->mapping(i).memory_start());
+    EXPECT_EQ(first->string_table(first->mapping(i).filename()),
+              second->string_table(second->mapping(i).filename()));
+  }
+
+  // Without filenames, the objects with a build ID are known by it alone.
+  auto build_id_only = build(true);
+  ASSERT_EQ(build_id_only->mapping_size(), first->mapping_size());
+  for (int i = 0; i < first->mapping_size(); ++i) {
+    const auto& mapping = build_id_only->mapping(i);
+    const absl::string_view build_id =
+        build_id_only->string_table(mapping.build_id());
+    const absl::string_view filename =
+        build_id_only->string_table(mapping.filename());
+    if (build_id.empty()) {
+      EXPECT_EQ(filename, first->string_table(first->mapping(i).filename()));
+    } else {
+      EXPECT_EQ(filename, "");
+    }
+  }
+}
+
 TEST(ProfileBuilderTest, LocationTableNoMappings) {
   const uintptr_t kAddress = uintptr_t{0x150};
 
@@ -574,7 +610,7 @@ TEST(ProfileConverterTest, HeapProfile) {
   // Require that the default_sample_type appeared in sample_type.
   EXPECT_THAT(sample_types, testing::Contains(converted.default_sample_type()));
 
-  constexpr int kNumSamples = 6;
+  constexpr int kNumSamples = 7;
   // This is slightly redundant with the next line, but we need to loop over
   // each of the samples later.
   EXPECT_THAT(extracted_sample_type, SizeIs(kNumSamples));
@@ -583,7 +619,8 @@ TEST(ProfileConverterTest, HeapProfile) {
       UnorderedElementsAre(
           Pair("objects", "count"), Pair("space", "bytes"),
           Pair("resident_space", "bytes"), Pair("stale_space", "bytes"),
-          Pair("locked_space", "bytes"), Pair("swapped_space", "bytes")));
+          Pair("locked_space", "bytes"), Pair("swapped_space", "bytes"),
+          Pair("hugepage_space", "bytes")));
 
   SampleLabels extracted_labels;
   {
@@ -674,6 +711,7 @@ TEST(ProfileConverterTest, HeapProfile) {
               UnorderedElementsAre(IsSupersetOf({
                                        Pair("resident_space", 64),
                                        Pair("swapped_space", 0),
+                                       Pair("hugepage_space", 64),
                                        Pair("space", 3702),
                                        Pair("objects", 6),
                                    }),
@@ -1055,6 +1093,141 @@ TEST(ProfileBuilderTest, SameTags) {
   EXPECT_THAT(allocation_tags, testing::ContainerEq(lifetime_tags));
 }
 
+TEST(ProfileBuilderTest, HeapDeltaProfile) {
+  auto fake_profile = std::make_unique<FakeProfile>();
+  fake_profile->SetType(ProfileType::kHeap);
+  fake_profile->SetDuration(absl::ZeroDuration());
+  fake_profile->SetStartTime(absl::Now());
+
+  // Two samples with the same stack, which a full heap profile would merge.
+  std::vector<Profile::Sample> samples;
+  Profile::Sample sample{
+      .sum = 1024,
+      .count = 1,
+      .requested_size = 1000,
+      .allocated_size = 1024,
+      .alloc_handle = MallocHook::AllocHandle{7},
+  };
+  sample.depth = 2;
+  sample.stack[0] = absl::bit_cast<void*>(uintptr_t{0x12345});
+  sample.stack[1] = absl::bit_cast<void*>(uintptr_t{0x23451});
+  samples.push_back(sample);
+  sample.alloc_handle = MallocHook::AllocHandle{8};
+  samples.push_back(sample);
+  fake_profile->SetSamples(std::move(samples));
+
+  Profile added = ProfileAccessor::MakeProfile(std::move(fake_profile));
+  const MallocHook::AllocHandle removed[] = {MallocHook::AllocHandle{3}};
+  auto converted_or = MakeHeapDeltaProfileProto(added, removed);
+  ASSERT_TRUE(converted_or.ok()) << converted_or.status();
+  const perftools::profiles::Profile& converted = **converted_or;
+
+  auto label = [&](const perftools::profiles::Sample& s,
+                   absl::string_view key) -> std::optional<int64_t> {
+    for (const auto& l : s.label()) {
+      if (converted.string_table(l.key()) == key) return l.num();
+    }
+    return std::nullopt;
+  };
+
+  ASSERT_EQ(converted.sample_size(), 3);
+  EXPECT_EQ(label(converted.sample(0), "alloc_handle"), 7);
+  EXPECT_EQ(label(converted.sample(1), "alloc_handle"), 8);
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(converted.sample(i).location_id_size(), 2);
+    EXPECT_THAT(converted.sample(i).value(), ElementsAre(1, 1024));
+  }
+
+  const perftools::profiles::Sample& removal = converted.sample(2);
+  EXPECT_EQ(removal.location_id_size(), 0);
+  EXPECT_THAT(removal.value(), ElementsAre(0, 0));
+  EXPECT_EQ(label(removal, "removed_alloc_handle"), 3);
+  EXPECT_EQ(label(removal, "alloc_handle"), std::nullopt);
+}
+
+TEST(ProfileBuilderTest, ExperimentId) {
+  auto fake_profile = std::make_unique<FakeProfile>();
+  fake_profile->SetType(ProfileType::kHeap);
+  fake_profile->SetExperimentId(0x123456789abcdef);
+  Profile profile = ProfileAccessor::MakeProfile(std::move(fake_profile));
+
+  auto converted_or = MakeProfileProto(profile);
+  ASSERT_TRUE(converted_or.ok()) << converted_or.status();
+  const perftools::profiles::Profile& converted = **converted_or;
+
+  ASSERT_EQ(converted.comment_size(), 1);
+  EXPECT_EQ(converted.string_table(converted.comment(0)),
+            "tcmalloc_experiment_id=0123456789abcdef");
+
+  // Without active experiments, there is no comment.
+  auto empty_profile = std::make_unique<FakeProfile>();
+  empty_profile->SetType(ProfileType::kHeap);
+  auto empty_or = MakeProfileProto(
+      ProfileAccessor::MakeProfile(std::move(empty_profile)));
+  ASSERT_TRUE(empty_or.ok()) << empty_or.status();
+  EXPECT_EQ((*empty_or)->comment_size(), 0);
+}
+
+TEST(ProfileBuilderTest, StreamedProfileMatches) {
+  auto fake_profile = std::make_unique<FakeProfile>();
+  fake_profile->SetType(ProfileType::kAllocations);
+  fake_profile->SetDuration(absl::Seconds(1));
+  fake_profile->SetStartTime(absl::Now());
+
+  std::vector<Profile::Sample> samples;
+  for (int i = 0; i < 3; ++i) {
+    Profile::Sample sample{
+        .sum = 1024 * (i + 1),
+        .count = 1,
+        .requested_size = 1000,
+        .allocated_size = 1024,
+    };
+    sample.depth = 2;
+    sample.stack[0] = absl::bit_cast<void*>(uintptr_t{0x12345});
+    sample.stack[1] = absl::bit_cast<void*>(uintptr_t{0x23451 + i});
+    samples.push_back(sample);
+  }
+  fake_profile->SetSamples(std::move(samples));
+  Profile profile = ProfileAccessor::MakeProfile(std::move(fake_profile));
+
+  auto expected_or = MakeProfileProto(profile);
+  ASSERT_TRUE(expected_or.ok()) << expected_or.status();
+  const perftools::profiles::Profile& expected = **expected_or;
+
+  std::string serialized;
+  {
+    google::protobuf::io::StringOutputStream stream(&serialized);
+    absl::Status status = WriteProfileProto(profile, &stream);
+    ASSERT_TRUE(status.ok()) << status;
+  }
+  perftools::profiles::Profile streamed;
+  ASSERT_TRUE(streamed.ParseFromString(serialized));
+
+  EXPECT_THAT(streamed.string_table(),
+              ElementsAreArray(expected.string_table()));
+  ASSERT_EQ(streamed.location_size(), expected.location_size());
+  for (int i = 0; i < expected.location_size(); ++i) {
+    EXPECT_EQ(streamed.location(i).id(), expected.location(i).id());
+    EXPECT_EQ(streamed.location(i).address(), expected.location(i).address());
+    EXPECT_EQ(streamed.location(i).mapping_id(),
+              expected.location(i).mapping_id());
+  }
+  ASSERT_EQ(streamed.sample_size(), expected.sample_size());
+  for (int i = 0; i < expected.sample_size(); ++i) {
+    EXPECT_THAT(streamed.sample(i).location_id(),
+                ElementsAreArray(expected.sample(i).location_id()));
+    EXPECT_THAT(streamed.sample(i).value(),
+                ElementsAreArray(expected.sample(i).value()));
+    EXPECT_EQ(streamed.sample(i).label_size(),
+              expected.sample(i).label_size());
+  }
+  EXPECT_EQ(streamed.mapping_size(), expected.mapping_size());
+  EXPECT_EQ(streamed.sample_type_size(), expected.sample_type_size());
+  EXPECT_EQ(streamed.period_type().type(), expected.period_type().type());
+  EXPECT_EQ(streamed.duration_nanos(), expected.duration_nanos());
+  EXPECT_EQ(streamed.drop_frames(), expected.drop_frames());
+}
+
 TEST(BuildId, CorruptImage_b180635896) {
   std::string image_path;
   const char* srcdir = thread_safe_getenv("TEST_SRCDIR");
@@ -82,6 +82,9 @@ class Bitmap {
   // put it in *index, *length and return true; else return false.
   bool NextFreeRange(size_t start, size_t* index, size_t* length) const;
 
+  // Returns the length of the longest run of clear bits.
+  size_t LongestFreeRange() const;
+
   // Returns index of the first {true, false} bit >= index, or N if none.
   size_t FindSet(size_t index) const;
   size_t FindClear(size_t index) const;
@@ -141,12 +144,26 @@ class RangeTracker {
   // (i.e. n <= longest_free()).
   //
   // Finds and marks n free bits, returning index of the first bit.  Chooses by
-  // best fit.
+  // best fit: the shortest free range of at least n bits, the lowest-addressed
+  // of those if several are equally short.
   size_t FindAndMark(size_t n);
 
   // REQUIRES: the range [index, index + n) is fully unmarked.
   void Mark(size_t index, size_t n);
 
+  // Returns true if the range [index, index + n) is fully unmarked.
+  bool IsFree(size_t index, size_t n) const;
+
+  // REQUIRES: the range [index, index + n) is fully unmarked, and index is the
+  // end of a marked range.
+  // Marks it as part of that range, without counting a new allocation.
+  void Extend(size_t index, size_t n);
+
+  // REQUIRES: the range [index, index + n) is fully marked, and is the tail of
+  // a range returned by FindAndMark, not all of it.
+  // Unmarks it, without counting a freed allocation.
+  void Shrink(size_t index, size_t n);
+
   // REQUIRES: the range [index, index + n) is fully marked, and
   // was the returned value from a call to FindAndMark.
   // Unmarks it.
@@ -226,14 +243,24 @@ inline size_t RangeTracker<N>::FindAndMark(size_t n) {
   size_t longest_len = 0;
   size_t second_len = 0;
 
-  // the best (shortest) range we could use
-  // TODO(b/134691947): shortest? lowest-addressed?
+  // The best (shortest) range we could use; ties go to the lowest-addressed.
+  // Keeping the longest ranges intact leaves room for later multi-page
+  // allocations.
   size_t best_index = N;
   size_t best_len = 2 * N;
   // Iterate over free ranges:
   size_t index = 0, len;
 
   while (bits_.NextFreeRange(index, &index, &len)) {
+    if (len == n && len < longest_free_) {
+      // An exact fit is the best fit, and as a longer range exists elsewhere,
+      // taking it leaves longest_free_ as it is.  Skip the rest of the scan.
+      bits_.SetRange(index, n);
+      nused_ += n;
+      nallocs_++;
+      return index;
+    }
+
     if (len > longest_len) {
       second_len = longest_len;
       longest_len = len;
@@ -267,25 +294,33 @@ inline size_t RangeTracker<N>::FindAndMark(size_t n) {
 // Marks it.
 template <size_t N>
 inline void RangeTracker<N>::Mark(size_t index, size_t n) {
+  Extend(index, n);
+  nallocs_++;
+}
+
+template <size_t N>
+inline bool RangeTracker<N>::IsFree(size_t index, size_t n) const {
+  TC_ASSERT_GT(n, 0);
+  return index + n <= N && bits_.FindSet(index) >= index + n;
+}
+
+template <size_t N>
+inline void RangeTracker<N>::Extend(size_t index, size_t n) {
   TC_ASSERT_GE(bits_.FindSet(index), index + n);
   bits_.SetRange(index, n);
   nused_ += n;
-  nallocs_++;
-
-  size_t longest_len = 0;
-  size_t scan_index = 0, scan_len;
 
   // We just marked a range as used. This might change the longest free range
   // recorded in longest_free_. Recompute.
-  while (bits_.NextFreeRange(scan_index, &scan_index, &scan_len)) {
-    if (scan_len > longest_len) {
-      longest_len = scan_len;
-    }
-
-    scan_index += scan_len;
-  }
+  longest_free_ = bits_.LongestFreeRange();
+}
 
-  longest_free_ = longest_len;
+template <size_t N>
+inline void RangeTracker<N>::Shrink(size_t index, size_t n) {
+  TC_ASSERT_GT(index, 0);
+  TC_ASSERT(bits_.GetBit(index - 1));
+  Unmark(index, n);
+  nallocs_++;
 }
 
 // REQUIRES: the range [index, index + n) is fully marked.
@@ -483,6 +518,46 @@ inline bool Bitmap<N>::NextFreeRange(size_t start, size_t* index,
   return true;
 }
 
+// Works a word at a time rather than a range at a time: runs crossing words are
+// carried between them, and runs within a word are only measured when the word
+// has enough clear bits to hold one longer than the longest so far.
+template <size_t N>
+inline size_t Bitmap<N>::LongestFreeRange() const {
+  const size_t all_ones = ~static_cast<size_t>(0);
+  size_t longest = 0;
+  // Clear bits at the top of the preceding words.
+  size_t run = 0;
+  for (size_t i = 0; i < kWords; ++i) {
+    size_t clear = ~bits_[i];
+    size_t top_shift = 0;
+    if constexpr (kDeadBits > 0) {
+      if (i == kWords - 1) {
+        clear &= all_ones >> kDeadBits;
+        top_shift = kDeadBits;
+      }
+    }
+    if (clear == all_ones) {
+      run += kWordSize;
+      continue;
+    }
+
+    run += absl::countr_one(clear);
+    longest = std::max(longest, run);
+    if (absl::popcount(clear) > longest) {
+      // Each step shortens every run of ones by one.
+      size_t x = clear;
+      size_t inner = 0;
+      while (x != 0) {
+        x &= x >> 1;
+        ++inner;
+      }
+      longest = std::max(longest, inner);
+    }
+    run = absl::countl_one(clear << top_shift);
+  }
+  return std::max(longest, run);
+}
+
 template <size_t N>
 inline size_t Bitmap<N>::FindSet(size_t index) const {
   return FindValue<true>(index);
@@ -111,6 +111,66 @@ BENCHMARK_TEMPLATE(BM_MarkUnmarkChunks, 64);
 BENCHMARK_TEMPLATE(BM_MarkUnmarkChunks, 256);
 BENCHMARK_TEMPLATE(BM_MarkUnmarkChunks, 256 * 32);
 
+// Fragments the tracker into free runs of 1 to 32 bits, as a long-lived
+// hugepage ends up after many allocations have come and gone.
+template <size_t N>
+static void Fragment(RangeTracker<N>& range) {
+  range.FindAndMark(N);
+  absl::BitGen rng;
+  size_t index = 0;
+  while (index < N) {
+    size_t len = absl::Uniform<int32_t>(rng, 0, 32) + 1;
+    len = std::min(len, N - index);
+    size_t drop = absl::Uniform<int32_t>(rng, 0, len);
+    if (drop > 0) {
+      range.Unmark(index, drop);
+    }
+    index += len;
+  }
+}
+
+// Small allocations from a fragmented tracker, which is where the filler
+// spends its time under pageheap_lock.
+template <size_t N>
+static void BM_FindAndMarkFragmented(benchmark::State& state) {
+  RangeTracker<N> range;
+  Fragment(range);
+  const size_t n = state.range(0);
+  if (n > range.longest_free()) {
+    state.SkipWithError("no free range is long enough");
+    return;
+  }
+  for (auto s : state) {
+    size_t index = range.FindAndMark(n);
+    benchmark::DoNotOptimize(index);
+    range.Unmark(index, n);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_FindAndMarkFragmented, 256)->Arg(1)->Arg(4)->Arg(16);
+BENCHMARK_TEMPLATE(BM_FindAndMarkFragmented, 256 * 32)
+    ->Arg(1)
+    ->Arg(4)
+    ->Arg(16);
+
+template <size_t N>
+static void BM_LongestFreeRange(benchmark::State& state) {
+  RangeTracker<N> range;
+  Fragment(range);
+  const Bitmap<N> bits = range.bits();
+  for (auto s : state) {
+    benchmark::DoNotOptimize(bits.LongestFreeRange());
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_LongestFreeRange, 64);
+BENCHMARK_TEMPLATE(BM_LongestFreeRange, 256);
+BENCHMARK_TEMPLATE(BM_LongestFreeRange, 256 * 32);
+
 template <size_t N>
 static void BM_FillOnes(benchmark::State& state) {
   RangeTracker<N> range;
@@ -17,6 +17,7 @@
 #include <stddef.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <utility>
 #include <vector>
@@ -24,6 +25,7 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/container/fixed_array.h"
+#include "absl/random/distributions.h"
 #include "absl/random/random.h"
 
 namespace tcmalloc {
@@ -364,6 +366,82 @@ TEST_F(RangeTrackerTest, Mark) {
   EXPECT_EQ(range_.longest_free(), kBits);
 }
 
+TEST_F(RangeTrackerTest, Extend) {
+  ASSERT_EQ(range_.FindAndMark(100), 0);
+  range_.Mark(300, 100);
+  EXPECT_TRUE(range_.IsFree(100, 200));
+  EXPECT_FALSE(range_.IsFree(100, 201));
+  EXPECT_FALSE(range_.IsFree(400, kBits - 399));
+
+  range_.Extend(100, 150);
+  EXPECT_EQ(range_.used(), 350);
+  EXPECT_EQ(range_.allocs(), 2);
+  EXPECT_EQ(range_.longest_free(), kBits - 400);
+  EXPECT_THAT(FreeRanges(), ElementsAre(Pair(250, 50), Pair(400, kBits - 400)));
+
+  // The extended range is freed as a single allocation.
+  range_.Unmark(0, 250);
+  EXPECT_EQ(range_.used(), 100);
+  EXPECT_EQ(range_.allocs(), 1);
+  EXPECT_EQ(range_.longest_free(), kBits - 400);
+}
+
+TEST_F(RangeTrackerTest, Shrink) {
+  ASSERT_EQ(range_.FindAndMark(300), 0);
+  range_.Mark(300, 100);
+
+  range_.Shrink(100, 200);
+  EXPECT_EQ(range_.used(), 200);
+  EXPECT_EQ(range_.allocs(), 2);
+  EXPECT_EQ(range_.longest_free(), kBits - 400);
+  EXPECT_THAT(FreeRanges(),
+              ElementsAre(Pair(100, 200), Pair(400, kBits - 400)));
+
+  // The shrunk range is freed as a single allocation.
+  range_.Unmark(0, 100);
+  EXPECT_EQ(range_.used(), 100);
+  EXPECT_EQ(range_.allocs(), 1);
+}
+
+TEST_F(RangeTrackerTest, ExactFit) {
+  range_.FindAndMark(kBits);
+  range_.Unmark(10, 20);
+  range_.Unmark(100, 8);
+  range_.Unmark(200, 8);
+  range_.Unmark(500, 300);
+  ASSERT_EQ(range_.longest_free(), 300);
+
+  // The first exact fit is taken, and the longest range is unaffected.
+  EXPECT_EQ(range_.FindAndMark(8), 100);
+  EXPECT_EQ(range_.longest_free(), 300);
+  EXPECT_THAT(FreeRanges(),
+              ElementsAre(Pair(10, 20), Pair(200, 8), Pair(500, 300)));
+
+  // An exact fit for the longest range shrinks it.
+  EXPECT_EQ(range_.FindAndMark(300), 500);
+  EXPECT_EQ(range_.longest_free(), 20);
+}
+
+TEST_F(RangeTrackerTest, LongestFreeRange) {
+  absl::BitGen rng;
+  for (int i = 0; i < 1000; ++i) {
+    range_.Clear();
+    const double density = absl::Uniform(rng, 0.0, 1.0);
+    for (size_t bit = 0; bit < kBits; ++bit) {
+      if (absl::Bernoulli(rng, density)) {
+        range_.Mark(bit, 1);
+      }
+    }
+
+    size_t expected = 0;
+    for (auto [index, len] : FreeRanges()) {
+      expected = std::max(expected, len);
+    }
+    EXPECT_EQ(range_.bits().LongestFreeRange(), expected);
+    EXPECT_EQ(range_.longest_free(), expected);
+  }
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
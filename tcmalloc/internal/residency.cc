@@ -86,49 +86,16 @@ ResidencyPageMap::~ResidencyPageMap() {
   }
 }
 
-absl::StatusCode ResidencyPageMap::Seek(const uintptr_t vaddr) {
-  size_t offset = vaddr / kHardwarePageSize * kPagemapEntrySize;
-  // Note: lseek can't be interrupted.
-  off_t status = ::lseek(fd_, offset, SEEK_SET);
-  if (status != offset) {
-    return absl::StatusCode::kUnavailable;
-  }
-  return absl::StatusCode::kOk;
-}
-
-std::optional<uint64_t> ResidencyPageMap::ReadOne() {
-  static_assert(sizeof(buf_) >= kPagemapEntrySize);
+ssize_t ResidencyPageMap::Read(const uintptr_t vaddr,
+                               const size_t num_pages) {
+  TC_ASSERT_LE(num_pages, kEntriesInBuf);
   // /proc/pid/pagemap is a sequence of 64-bit values in machine endianness, one
   // per page. The style guide really does not want me to do this "unsafe
   // conversion", but the conversion is done in reverse by the kernel and we
   // never persist it anywhere, so we actually do want this.
-  auto status = signal_safe_read(fd_, reinterpret_cast<char*>(buf_),
-                                 kPagemapEntrySize, nullptr);
-  if (status != kPagemapEntrySize) {
-    return std::nullopt;
-  }
-  return buf_[0];
-}
-
-absl::StatusCode ResidencyPageMap::ReadMany(int64_t num_pages,
-                                            Residency::Info& info) {
-  while (num_pages > 0) {
-    const size_t batch_size = std::min<int64_t>(kEntriesInBuf, num_pages);
-    const size_t to_read = kPagemapEntrySize * batch_size;
-
-    // We read continuously. For the first read, this starts at wherever the
-    // first ReadOne ended. See above note for the reinterpret_cast.
-    auto status =
-        signal_safe_read(fd_, reinterpret_cast<char*>(buf_), to_read, nullptr);
-    if (status != to_read) {
-      return absl::StatusCode::kUnavailable;
-    }
-    for (int i = 0; i < batch_size; ++i) {
-      Update(buf_[i], kHardwarePageSize, info);
-    }
-    num_pages -= batch_size;
-  }
-  return absl::StatusCode::kOk;
+  return signal_safe_pread(fd_, reinterpret_cast<char*>(buf_),
+                           num_pages * kPagemapEntrySize,
+                           vaddr / kHardwarePageSize * kPagemapEntrySize);
 }
 
 std::optional<Residency::Info> ResidencyPageMap::Get(const void* const addr,
@@ -139,51 +106,30 @@ std::optional<Residency::Info> ResidencyPageMap::Get(const void* const addr,
 
   Residency::Info info;
   if (size == 0) return info;
-
-  uintptr_t uaddr = reinterpret_cast<uintptr_t>(addr);
+  const uintptr_t uaddr = reinterpret_cast<uintptr_t>(addr);
+  const uintptr_t end = uaddr + size;
   // Round address down to get the start of the page containing the data.
-  uintptr_t basePage = uaddr & ~(kHardwarePageSize - 1);
+  uintptr_t page = uaddr & ~(kHardwarePageSize - 1);
   // Round end address up to get the end of the page containing the data.
-  // The data is in [basePage, endPage).
-  uintptr_t endPage =
-      (uaddr + size + kHardwarePageSize - 1) & ~(kHardwarePageSize - 1);
-
-  int64_t remainingPages = (endPage - basePage) / kHardwarePageSize;
-
-  if (auto res = Seek(basePage); res != absl::StatusCode::kOk) {
-    return std::nullopt;
-  }
-
-  if (remainingPages == 1) {
-    auto res = ReadOne();
-    if (!res.has_value()) return std::nullopt;
-    Update(res.value(), size, info);
-    return info;
-  }
-
-  // Since the input address might not be page-aligned (it can possibly point to
-  // an arbitrary object), we read the information about the first page
-  // separately with ReadOne, then read the complete pages with ReadMany, and
-  // then read the last page with ReadOne again if needed.
-  auto res = ReadOne();
-  if (!res.has_value()) return std::nullopt;
-
-  // Handle the first page.
-  size_t firstPageSize = kHardwarePageSize - (uaddr - basePage);
-  Update(res.value(), firstPageSize, info);
-  remainingPages--;
-
-  // Handle all pages but the last page.
-  if (auto res = ReadMany(remainingPages - 1, info);
-      res != absl::StatusCode::kOk) {
-    return std::nullopt;
+  // The data is in [page, endPage).
+  const uintptr_t endPage =
+      (end + kHardwarePageSize - 1) & ~(kHardwarePageSize - 1);
+
+  // Each pread covers a buffer's worth of pages.  The first and last pages
+  // only count the bytes of the data on them, since the input address might
+  // not be page-aligned (it can possibly point to an arbitrary object).
+  while (page < endPage) {
+    const size_t num_pages =
+        std::min<size_t>(kEntriesInBuf, (endPage - page) / kHardwarePageSize);
+    if (Read(page, num_pages) != num_pages * kPagemapEntrySize) {
+      return std::nullopt;
+    }
+    for (size_t i = 0; i < num_pages; ++i, page += kHardwarePageSize) {
+      const uintptr_t begin = std::max(page, uaddr);
+      const uintptr_t last = std::min(page + kHardwarePageSize, end);
+      Update(buf_[i], last - begin, info);
+    }
   }
-
-  // Check final page
-  size_t lastPageSize = kHardwarePageSize - (endPage - uaddr - size);
-  res = ReadOne();
-  if (!res.has_value()) return std::nullopt;
-  Update(res.value(), lastPageSize, info);
   return info;
 }
 
@@ -197,13 +143,7 @@ Residency::SinglePageBitmaps ResidencyPageMap::GetUnbackedAndSwappedBitmaps(
     return SinglePageBitmaps{page_unbacked, page_swapped,
                              absl::StatusCode::kFailedPrecondition};
   }
-  auto res = Seek(currPage);
-  if (res != absl::StatusCode::kOk) {
-    return SinglePageBitmaps{page_unbacked, page_swapped,
-                             absl::StatusCode::kUnavailable};
-  }
-  auto status = signal_safe_read(fd_, reinterpret_cast<char*>(buf_),
-                                 kSizeOfHugepageInPagemap, nullptr);
+  auto status = Read(currPage, kHardwarePagesInHugePage);
   if (status != kSizeOfHugepageInPagemap) {
     TC_LOG(
         "Could not read from pagemap file due to unexpected number of bytes "
@@ -227,6 +167,45 @@ Residency::SinglePageBitmaps ResidencyPageMap::GetUnbackedAndSwappedBitmaps(
   return SinglePageBitmaps{page_unbacked, page_swapped, absl::StatusCode::kOk};
 }
 
+const Residency::SinglePageBitmaps& HugePageCachingResidency::Bitmaps(
+    uintptr_t hugepage) {
+  if (hugepage != cached_hugepage_) {
+    cached_ =
+        base_.GetUnbackedAndSwappedBitmaps(reinterpret_cast<void*>(hugepage));
+    cached_hugepage_ = hugepage;
+    ++hugepages_read_;
+  }
+  return cached_;
+}
+
+std::optional<Residency::Info> HugePageCachingResidency::Get(
+    const void* const addr, const size_t size) {
+  Residency::Info info;
+  const size_t page_size = kHugePageSize / GetHardwarePagesInHugePage();
+  uintptr_t begin = reinterpret_cast<uintptr_t>(addr);
+  const uintptr_t end = begin + size;
+  while (begin < end) {
+    const uintptr_t hugepage = begin & ~(kHugePageSize - 1);
+    const SinglePageBitmaps& bitmaps = Bitmaps(hugepage);
+    if (bitmaps.status != absl::StatusCode::kOk) {
+      return std::nullopt;
+    }
+    const uintptr_t hugepage_end = std::min(end, hugepage + kHugePageSize);
+    while (begin < hugepage_end) {
+      const size_t index = (begin - hugepage) / page_size;
+      const uintptr_t page_end =
+          std::min(hugepage_end, hugepage + (index + 1) * page_size);
+      if (bitmaps.swapped.GetBit(index)) {
+        info.bytes_swapped += page_end - begin;
+      } else if (!bitmaps.unbacked.GetBit(index)) {
+        info.bytes_resident += page_end - begin;
+      }
+      begin = page_end;
+    }
+  }
+  return info;
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
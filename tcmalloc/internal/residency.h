@@ -98,17 +98,9 @@ class ResidencyPageMap : public Residency {
   SinglePageBitmaps GetUnbackedAndSwappedBitmaps(const void* addr) override;
 
  private:
-  // This helper seeks the internal file to the correct location for the given
-  // virtual address.
-  absl::StatusCode Seek(uintptr_t vaddr);
-  // This helper reads information for a single page. This is useful for the
-  // boundaries. It continues the read from the last Seek() or last Read
-  // operation.
-  std::optional<uint64_t> ReadOne();
-  // This helper reads information for `num_pages` worth of _full_ pages and
-  // puts the results into `info`. It continues the read from the last Seek() or
-  // last Read operation.
-  absl::StatusCode ReadMany(int64_t num_pages, Info& info);
+  // Reads the entries of `num_pages` pages starting at `vaddr` into buf_, with
+  // a single pread.  Returns the number of bytes read, or -1 on error.
+  ssize_t Read(uintptr_t vaddr, size_t num_pages);
 
   // For testing.
   friend class ResidencySpouse;
@@ -130,6 +122,39 @@ class ResidencyPageMap : public Residency {
       kPagemapEntrySize * kHardwarePagesInHugePage;
 };
 
+// Answers queries from the bitmaps of whole hugepages, read through `base` and
+// kept for the last hugepage read.  A batch of queries sorted by address thus
+// reads each hugepage of /proc/self/pagemap once, however many objects it
+// holds.  As the bitmaps are not refreshed, use one instance per batch.
+//
+// This is NOT thread-safe.
+class HugePageCachingResidency final : public Residency {
+ public:
+  explicit HugePageCachingResidency(Residency& base) : base_(base) {}
+
+  std::optional<Info> Get(const void* addr, size_t size) override;
+
+  size_t GetHardwarePagesInHugePage() const override {
+    return base_.GetHardwarePagesInHugePage();
+  }
+
+  SinglePageBitmaps GetUnbackedAndSwappedBitmaps(const void* addr) override {
+    return Bitmaps(reinterpret_cast<uintptr_t>(addr));
+  }
+
+  // The number of hugepages read from `base`.
+  size_t hugepages_read() const { return hugepages_read_; }
+
+ private:
+  const SinglePageBitmaps& Bitmaps(uintptr_t hugepage);
+
+  Residency& base_;
+  // Not hugepage aligned, so that nothing is cached initially.
+  uintptr_t cached_hugepage_ = 1;
+  SinglePageBitmaps cached_;
+  size_t hugepages_read_ = 0;
+};
+
 inline std::ostream& operator<<(std::ostream& stream,
                                 const Residency::Info& rhs) {
   return stream << "{.resident = " << rhs.bytes_resident
@@ -372,6 +372,67 @@ TEST(PageMapIntegrationTest, WorksOnActualData) {
   EXPECT_TRUE(res.swapped.IsZero());
 }
 
+TEST(HugePageCachingResidencyTest, MatchesPageMap) {
+  const size_t kHardwarePageSize = GetPageSize();
+  // Map 3 hugepages worth, so that 2 aligned ones fit.
+  void* p = mmap(nullptr, 3 * kHugePageSize, PROT_READ | PROT_WRITE,
+                 MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  ASSERT_NE(p, MAP_FAILED) << errno;
+  char* base = reinterpret_cast<char*>(
+      (reinterpret_cast<uintptr_t>(p) + kHugePageSize - 1) &
+      ~(kHugePageSize - 1));
+  // Touch every third page.
+  for (size_t offset = 0; offset < 2 * kHugePageSize;
+       offset += 3 * kHardwarePageSize) {
+    base[offset] = 1;
+  }
+  ::benchmark::DoNotOptimize(base);
+
+  ResidencyPageMap r;
+  HugePageCachingResidency cached(r);
+  // Objects in address order, straddling pages and the hugepage boundary.
+  const std::vector<std::pair<size_t, size_t>> objects = {
+      {0, 16},
+      {7, kHardwarePageSize},
+      {kHardwarePageSize + 5, 5 * kHardwarePageSize},
+      {kHugePageSize - kHardwarePageSize - 3, 2 * kHardwarePageSize + 6},
+      {kHugePageSize + 100, 0},
+      {kHugePageSize + 100, kHugePageSize - 200},
+  };
+  for (const auto& [offset, size] : objects) {
+    SCOPED_TRACE(absl::StrCat(offset, " ", size));
+    std::optional<Residency::Info> expected = r.Get(base + offset, size);
+    ASSERT_TRUE(expected.has_value());
+    EXPECT_THAT(cached.Get(base + offset, size),
+                Optional(FieldsAre(expected->bytes_resident,
+                                   expected->bytes_swapped)));
+  }
+  EXPECT_EQ(cached.hugepages_read(), 2);
+
+  ASSERT_EQ(munmap(p, 3 * kHugePageSize), 0);
+}
+
+class UnavailableResidency final : public Residency {
+ public:
+  std::optional<Info> Get(const void* addr, size_t size) override {
+    return std::nullopt;
+  }
+  size_t GetHardwarePagesInHugePage() const override {
+    return kHugePageSize / GetPageSize();
+  }
+  SinglePageBitmaps GetUnbackedAndSwappedBitmaps(const void* addr) override {
+    return {{}, {}, absl::StatusCode::kUnavailable};
+  }
+};
+
+TEST(HugePageCachingResidencyTest, CannotRead) {
+  UnavailableResidency r;
+  HugePageCachingResidency cached(r);
+  int x;
+  EXPECT_FALSE(cached.Get(&x, sizeof(x)).has_value());
+  EXPECT_THAT(cached.Get(&x, 0), Optional(FieldsAre(0, 0)));
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
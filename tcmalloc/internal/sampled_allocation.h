@@ -15,7 +15,7 @@
 #ifndef TCMALLOC_INTERNAL_SAMPLED_ALLOCATION_H_
 #define TCMALLOC_INTERNAL_SAMPLED_ALLOCATION_H_
 
-#include <utility>
+#include <stdint.h>
 
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/sampled_allocation_recorder.h"
@@ -26,17 +26,15 @@ namespace tcmalloc_internal {
 
 // Stores information about the sampled allocation.
 struct SampledAllocation : public tcmalloc_internal::Sample<SampledAllocation> {
-  // We use this constructor to initialize `graveyard_`, which is used to
-  // maintain the freelist of SampledAllocations. When we revive objects from
-  // the freelist, we use `PrepareForSampling()` to update the state of the
-  // object.
+  // When we revive objects from the freelist, we use `PrepareForSampling()`
+  // to update the state of the object.
   constexpr SampledAllocation() = default;
 
   // When no object is available on the freelist, we allocate for a new
   // SampledAllocation object and invoke this constructor with
   // `PrepareForSampling()`.
-  explicit SampledAllocation(StackTrace&& stack_trace) {
-    PrepareForSampling(std::move(stack_trace));
+  SampledAllocation(const StackTraceInfo& info, uint32_t id) {
+    PrepareForSampling(info, id);
   }
 
   SampledAllocation(const SampledAllocation&) = delete;
@@ -47,13 +45,17 @@ struct SampledAllocation : public tcmalloc_internal::Sample<SampledAllocation> {
 
   // Prepares the state of the object. It is invoked when either a new sampled
   // allocation is constructed or when an object is revived from the freelist.
-  void PrepareForSampling(StackTrace&& stack_trace)
+  // Takes over a reference on the stack `id`.
+  void PrepareForSampling(const StackTraceInfo& info, uint32_t id)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock) {
-    sampled_stack = std::move(stack_trace);
+    sampled_stack = info;
+    stack_id = id;
   }
 
-  // The stack trace of the sampled allocation.
-  StackTrace sampled_stack = {};
+  // The stack trace of the sampled allocation, but for its frames.
+  StackTraceInfo sampled_stack = {};
+  // The frames, interned in the StackDepot.
+  uint32_t stack_id = 0;
 };
 
 }  // namespace tcmalloc_internal
@@ -22,15 +22,21 @@
 #ifndef TCMALLOC_INTERNAL_SAMPLED_ALLOCATION_RECORDER_H_
 #define TCMALLOC_INTERNAL_SAMPLED_ALLOCATION_RECORDER_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <atomic>
+#include <utility>
 
 #include "absl/base/attributes.h"
 #include "absl/base/const_init.h"
 #include "absl/base/internal/spinlock.h"
+#include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
 #include "absl/functional/function_ref.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/percpu.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
@@ -44,17 +50,26 @@ struct Sample {
   // prevents races with sampling and resurrecting an object.
   absl::base_internal::SpinLock lock{absl::base_internal::SCHEDULE_KERNEL_ONLY};
   T* next = nullptr;
-  T* dead ABSL_GUARDED_BY(lock) = nullptr;
+  // Set while the sample is unregistered.
+  std::atomic<bool> dead{false};
+  // The recorder's epoch when the sample was unregistered, and the next sample
+  // in its graveyard.  Guarded by the lock of the graveyard holding the sample.
+  uint64_t dead_epoch = 0;
+  T* next_dead = nullptr;
 };
 
 // Holds samples and their associated stack traces.
 //
-// Thread safe.
+// Thread safe.  Iterate() takes no locks, so it never blocks Register() and
+// Unregister(), nor they it.
 template <typename T, typename AllocatorT>
 class SampleRecorder {
  public:
   using Allocator = AllocatorT;
 
+  // The number of graveyards for unregistered samples, picked by CPU.
+  static constexpr size_t kGraveyards = 32;
+
   constexpr explicit SampleRecorder(
       Allocator& allocator ABSL_ATTRIBUTE_LIFETIME_BOUND);
   ~SampleRecorder();
@@ -88,42 +103,49 @@ class SampleRecorder {
   // passed to `Unregister()` which assumes the sample is live.
   void UnregisterAll();
 
-  // Iterates over all the registered samples.
+  // Iterates over all the registered samples.  A sample unregistered while
+  // `f` may still see it is not reused until the iteration ends.
   void Iterate(const absl::FunctionRef<void(const T& sample)>& f);
 
  private:
+  // Unregistered samples, oldest first.
+  struct alignas(ABSL_CACHELINE_SIZE) Graveyard {
+    absl::base_internal::SpinLock lock{
+        absl::base_internal::SCHEDULE_KERNEL_ONLY};
+    T* head ABSL_GUARDED_BY(lock) = nullptr;
+    T* tail ABSL_GUARDED_BY(lock) = nullptr;
+    // Read without the lock to skip empty graveyards.
+    std::atomic<size_t> size{0};
+  };
+
+  static size_t CurrentGraveyard();
+
   void PushNew(T* sample);
   void PushDead(T* sample);
+  // Adds a sample marked dead to the current CPU's graveyard.
+  void Bury(T* sample);
   template <typename... Targs>
   T* PopDead(Targs&&... args);
 
-  // Intrusive lock free linked lists for tracking samples.
-  //
-  // `all_` records all samples (they are never removed from this list) and is
-  // terminated with a `nullptr`.
-  //
-  // `graveyard_.dead` is a circular linked list.  When it is empty,
-  // `graveyard_.dead == &graveyard`.  The list is circular so that
-  // every item on it (even the last) has a non-null dead pointer.  This allows
-  // `Iterate` to determine if a given sample is live or dead using only
-  // information on the sample itself.
-  //
-  // For example, nodes [A, B, C, D, E] with [A, C, E] alive and [B, D] dead
-  // looks like this (G is the Graveyard):
-  //
-  //           +---+    +---+    +---+    +---+    +---+
-  //    all -->| A |--->| B |--->| C |--->| D |--->| E |
-  //           |   |    |   |    |   |    |   |    |   |
-  //   +---+   |   | +->|   |-+  |   | +->|   |-+  |   |
-  //   | G |   +---+ |  +---+ |  +---+ |  +---+ |  +---+
-  //   |   |         |        |        |        |
-  //   |   | --------+        +--------+        |
-  //   +---+                                    |
-  //     ^                                      |
-  //     +--------------------------------------+
+  // Epoch-based protection of iterations against the reuse of samples.
   //
+  // Each iteration counts itself in `readers_[epoch % 2]` for the epoch it
+  // started in.  The epoch only advances from e to e + 1 once the iterations
+  // that started in e - 1 have finished, so a sample that died in epoch e can
+  // be reused once the epoch reaches e + 2.  Iterations that started later
+  // found it dead.
+  size_t StartIteration();
+  void TryAdvanceEpoch();
+  bool Reusable(const T& sample) const;
+
+  // Intrusive lock free linked list of all samples.  Samples are never
+  // removed from it, and it is terminated with a `nullptr`.  Dead samples are
+  // also linked into one of `graveyards_`, from which Register() revives them.
   std::atomic<T*> all_;
-  T graveyard_;
+  Graveyard graveyards_[kGraveyards];
+
+  std::atomic<uint64_t> epoch_;
+  std::atomic<int64_t> readers_[2];
 
   std::atomic<DisposeCallback> dispose_;
   Allocator* const allocator_;
@@ -137,9 +159,11 @@ SampleRecorder<T, Allocator>::SetDisposeCallback(DisposeCallback f) {
 
 template <typename T, typename Allocator>
 constexpr SampleRecorder<T, Allocator>::SampleRecorder(Allocator& allocator)
-    : all_(nullptr), dispose_(nullptr), allocator_(&allocator) {
-  graveyard_.dead = &graveyard_;
-}
+    : all_(nullptr),
+      epoch_(0),
+      readers_{0, 0},
+      dispose_(nullptr),
+      allocator_(&allocator) {}
 
 template <typename T, typename Allocator>
 SampleRecorder<T, Allocator>::~SampleRecorder() {
@@ -151,6 +175,12 @@ SampleRecorder<T, Allocator>::~SampleRecorder() {
   }
 }
 
+template <typename T, typename Allocator>
+size_t SampleRecorder<T, Allocator>::CurrentGraveyard() {
+  const int cpu = subtle::percpu::GetRealCpuUnsafe();
+  return cpu < 0 ? 0 : static_cast<size_t>(cpu) % kGraveyards;
+}
+
 template <typename T, typename Allocator>
 void SampleRecorder<T, Allocator>::PushNew(T* sample) {
   sample->next = all_.load(std::memory_order_relaxed);
@@ -166,30 +196,91 @@ void SampleRecorder<T, Allocator>::PushDead(T* sample) {
     dispose(*sample);
   }
 
-  AllocationGuardSpinLockHolder graveyard_lock(graveyard_.lock);
-  AllocationGuardSpinLockHolder sample_lock(sample->lock);
-  sample->dead = graveyard_.dead;
-  graveyard_.dead = sample;
+  sample->dead.store(true, std::memory_order_seq_cst);
+  Bury(sample);
+}
+
+template <typename T, typename Allocator>
+void SampleRecorder<T, Allocator>::Bury(T* sample) {
+  // Pairs with StartIteration(): an iteration that reads a later epoch than
+  // this sees the sample dead.
+  const uint64_t epoch = epoch_.load(std::memory_order_seq_cst);
+
+  Graveyard& graveyard = graveyards_[CurrentGraveyard()];
+  AllocationGuardSpinLockHolder graveyard_lock(graveyard.lock);
+  sample->dead_epoch = epoch;
+  sample->next_dead = nullptr;
+  if (graveyard.tail == nullptr) {
+    graveyard.head = sample;
+  } else {
+    graveyard.tail->next_dead = sample;
+  }
+  graveyard.tail = sample;
+  graveyard.size.fetch_add(1, std::memory_order_relaxed);
 }
 
 template <typename T, typename Allocator>
 template <typename... Targs>
 T* SampleRecorder<T, Allocator>::PopDead(Targs&&... args) {
-  AllocationGuardSpinLockHolder graveyard_lock(graveyard_.lock);
-
-  // The list is circular, so eventually it collapses down to
-  //   graveyard_.dead == &graveyard_
-  // when it is empty.
-  T* sample = graveyard_.dead;
-  if (sample == &graveyard_) return nullptr;
+  // Prefer the current CPU's graveyard, but revive samples from the others
+  // too, so that samples unregistered on other CPUs than they were registered
+  // on do not pile up.
+  const size_t start = CurrentGraveyard();
+  bool advanced = false;
+  T* sample = nullptr;
+  for (size_t i = 0; i < kGraveyards && sample == nullptr; ++i) {
+    Graveyard& graveyard = graveyards_[(start + i) % kGraveyards];
+    if (graveyard.size.load(std::memory_order_relaxed) == 0) continue;
+
+    AllocationGuardSpinLockHolder graveyard_lock(graveyard.lock);
+    T* head = graveyard.head;
+    if (head == nullptr) continue;
+    if (!Reusable(*head) && !advanced) {
+      TryAdvanceEpoch();
+      TryAdvanceEpoch();
+      advanced = true;
+    }
+    // The head died first, so if it is still protected, so are the others.
+    if (!Reusable(*head)) continue;
+
+    graveyard.head = head->next_dead;
+    if (graveyard.head == nullptr) graveyard.tail = nullptr;
+    graveyard.size.fetch_sub(1, std::memory_order_relaxed);
+    head->next_dead = nullptr;
+    sample = head;
+  }
+  if (sample == nullptr) return nullptr;
 
   AllocationGuardSpinLockHolder sample_lock(sample->lock);
-  graveyard_.dead = sample->dead;
-  sample->dead = nullptr;
   sample->PrepareForSampling(std::forward<Targs>(args)...);
+  sample->dead.store(false, std::memory_order_release);
   return sample;
 }
 
+template <typename T, typename Allocator>
+size_t SampleRecorder<T, Allocator>::StartIteration() {
+  while (true) {
+    const uint64_t epoch = epoch_.load(std::memory_order_seq_cst);
+    const size_t slot = epoch % 2;
+    readers_[slot].fetch_add(1, std::memory_order_seq_cst);
+    // If the epoch advanced meanwhile, it may not have waited for us.
+    if (epoch_.load(std::memory_order_seq_cst) == epoch) return slot;
+    readers_[slot].fetch_sub(1, std::memory_order_release);
+  }
+}
+
+template <typename T, typename Allocator>
+void SampleRecorder<T, Allocator>::TryAdvanceEpoch() {
+  uint64_t epoch = epoch_.load(std::memory_order_seq_cst);
+  if (readers_[(epoch + 1) % 2].load(std::memory_order_seq_cst) != 0) return;
+  epoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+}
+
+template <typename T, typename Allocator>
+bool SampleRecorder<T, Allocator>::Reusable(const T& sample) const {
+  return epoch_.load(std::memory_order_acquire) >= sample.dead_epoch + 2;
+}
+
 template <typename T, typename Allocator>
 template <typename... Targs>
 T* SampleRecorder<T, Allocator>::Register(Targs&&... args) {
@@ -210,33 +301,32 @@ void SampleRecorder<T, Allocator>::Unregister(T* sample) {
 
 template <typename T, typename Allocator>
 void SampleRecorder<T, Allocator>::UnregisterAll() {
-  AllocationGuardSpinLockHolder graveyard_lock(graveyard_.lock);
   T* sample = all_.load(std::memory_order_acquire);
   auto* dispose = dispose_.load(std::memory_order_relaxed);
-  while (sample != nullptr) {
+  for (; sample != nullptr; sample = sample->next) {
     {
+      // Concurrent calls must not bury the same sample twice.
       AllocationGuardSpinLockHolder sample_lock(sample->lock);
-      if (sample->dead == nullptr) {
-        if (dispose) dispose(*sample);
-        sample->dead = graveyard_.dead;
-        graveyard_.dead = sample;
-      }
+      if (sample->dead.load(std::memory_order_relaxed)) continue;
+      if (dispose) dispose(*sample);
+      sample->dead.store(true, std::memory_order_seq_cst);
     }
-    sample = sample->next;
+    Bury(sample);
   }
 }
 
 template <typename T, typename Allocator>
 void SampleRecorder<T, Allocator>::Iterate(
     const absl::FunctionRef<void(const T& sample)>& f) {
+  const size_t slot = StartIteration();
   T* s = all_.load(std::memory_order_acquire);
   while (s != nullptr) {
-    AllocationGuardSpinLockHolder l(s->lock);
-    if (s->dead == nullptr) {
+    if (!s->dead.load(std::memory_order_seq_cst)) {
       f(*s);
     }
     s = s->next;
   }
+  readers_[slot].fetch_sub(1, std::memory_order_release);
 }
 
 }  // namespace tcmalloc_internal
@@ -153,6 +153,54 @@ TEST_F(SampleRecorderTest, Unregistration) {
   EXPECT_EQ(alloc_count1, alloc_count2);
 }
 
+TEST_F(SampleRecorderTest, ReuseWaitsForIteration) {
+  Info* info1 = Register(1);
+  Info* info2 = Register(2);
+  const uint64_t alloc_count = allocator_.alloc_count();
+
+  // Registering and unregistering while iterating neither blocks nor reuses a
+  // sample that the iteration may still be looking at.
+  std::vector<Info*> registered;
+  sample_recorder_.Iterate([&](const Info& info) {
+    if (&info != info1) return;
+    sample_recorder_.Unregister(info1);
+    registered.push_back(Register(3));
+    EXPECT_EQ(info.size.load(), 1);
+  });
+  ASSERT_EQ(registered.size(), 1);
+  EXPECT_NE(registered[0], info1);
+  EXPECT_EQ(allocator_.alloc_count(), alloc_count + 1);
+  EXPECT_THAT(GetSizes(), UnorderedElementsAre(2, 3));
+
+  // Once the iteration ended, the sample is reused.
+  EXPECT_EQ(Register(4), info1);
+  EXPECT_EQ(allocator_.alloc_count(), alloc_count + 1);
+  EXPECT_THAT(GetSizes(), UnorderedElementsAre(2, 3, 4));
+
+  sample_recorder_.Unregister(info1);
+  sample_recorder_.Unregister(info2);
+  sample_recorder_.Unregister(registered[0]);
+}
+
+TEST_F(SampleRecorderTest, ReviveFromOtherGraveyards) {
+  // Samples are buried on the current CPU, but revived from any CPU's
+  // graveyard, so that they do not pile up when threads migrate.
+  std::vector<Info*> infos;
+  for (size_t i = 0; i < 2 * SampleRecorder<Info, TestAllocator>::kGraveyards;
+       ++i) {
+    infos.push_back(Register(i));
+  }
+  const uint64_t alloc_count = allocator_.alloc_count();
+  for (Info* info : infos) {
+    sample_recorder_.Unregister(info);
+  }
+  for (size_t i = 0; i < infos.size(); ++i) {
+    Register(i);
+  }
+  EXPECT_EQ(allocator_.alloc_count(), alloc_count);
+  sample_recorder_.UnregisterAll();
+}
+
 TEST_F(SampleRecorderTest, MultiThreaded) {
   absl::Notification stop;
   ThreadManager threads;
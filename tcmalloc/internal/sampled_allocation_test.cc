@@ -39,11 +39,11 @@ StackTrace PrepareStackTrace() {
 
 TEST(SampledAllocationTest, PrepareForSampling) {
   // PrepareForSampling() invoked in the constructor.
-  SampledAllocation sampled_allocation(PrepareStackTrace());
+  SampledAllocation sampled_allocation(PrepareStackTrace(), /*id=*/7);
   absl::base_internal::SpinLockHolder sample_lock(sampled_allocation.lock);
 
   // Now verify some fields.
-  EXPECT_GT(sampled_allocation.sampled_stack.depth, 0);
+  EXPECT_EQ(sampled_allocation.stack_id, 7);
   EXPECT_EQ(sampled_allocation.sampled_stack.requested_size, 8);
   EXPECT_EQ(sampled_allocation.sampled_stack.requested_alignment,
             std::align_val_t{4});
@@ -52,7 +52,7 @@ TEST(SampledAllocationTest, PrepareForSampling) {
   EXPECT_EQ(sampled_allocation.sampled_stack.weight, 4);
 
   // Set them to different values.
-  sampled_allocation.sampled_stack.depth = 0;
+  sampled_allocation.stack_id = 0;
   sampled_allocation.sampled_stack.requested_size = 0;
   sampled_allocation.sampled_stack.requested_alignment = std::nullopt;
   sampled_allocation.sampled_stack.allocated_size = 0;
@@ -60,8 +60,8 @@ TEST(SampledAllocationTest, PrepareForSampling) {
   sampled_allocation.sampled_stack.weight = 0;
 
   // Call PrepareForSampling() again and check the fields.
-  sampled_allocation.PrepareForSampling(PrepareStackTrace());
-  EXPECT_GT(sampled_allocation.sampled_stack.depth, 0);
+  sampled_allocation.PrepareForSampling(PrepareStackTrace(), /*id=*/7);
+  EXPECT_EQ(sampled_allocation.stack_id, 7);
   EXPECT_EQ(sampled_allocation.sampled_stack.requested_size, 8);
   EXPECT_EQ(sampled_allocation.sampled_stack.requested_alignment,
             std::align_val_t{4});
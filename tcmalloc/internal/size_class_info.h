@@ -29,6 +29,7 @@ namespace tcmalloc_internal {
 
 // Precomputed size class parameters.
 struct SizeClassInfo {
+  constexpr SizeClassInfo() : SizeClassInfo(0, 0, 0) {}
   constexpr SizeClassInfo(uint32_t size, size_t bytes, uint8_t num_to_move)
       : size(size), bytes(bytes), num_to_move(num_to_move) {}
 
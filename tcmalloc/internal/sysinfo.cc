@@ -20,13 +20,16 @@
 #include <algorithm>
 #include <array>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <optional>
 
 #include "absl/base/optimization.h"
 #include "absl/functional/function_ref.h"
+#include "absl/strings/ascii.h"
 #include "absl/strings/numbers.h"
 #include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/cpu_utils.h"
 #include "tcmalloc/internal/util.h"
@@ -38,8 +41,240 @@ namespace tcmalloc_internal {
 #if __linux__
 namespace {
 bool IsInBounds(int cpu) { return 0 <= cpu && cpu < kMaxCpus; }
+
+// Reads up to <size> bytes of the file at <path> into <buf>.  Returns
+// std::nullopt if the file cannot be read.
+std::optional<absl::string_view> ReadSmallFile(const char* path, char* buf,
+                                               size_t size) {
+  int fd = signal_safe_open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  size_t bytes_read = 0;
+  const ssize_t rc = signal_safe_read(fd, buf, size, &bytes_read);
+  signal_safe_close(fd);
+  if (rc < 0) {
+    return std::nullopt;
+  }
+  return absl::string_view(buf, bytes_read);
+}
+
+template <typename T>
+void TakeMin(std::optional<T>& current, std::optional<T> limit) {
+  if (limit.has_value() && (!current.has_value() || *limit < *current)) {
+    current = limit;
+  }
+}
+
+constexpr absl::string_view kCgroupRoot = "/sys/fs/cgroup";
+constexpr size_t kCgroupPathSize = 4096 + 32;
+
+// Writes the directory of the cgroup v2 the process runs in to <path>, without
+// a trailing slash, and returns its length.  Leaves at least 32 bytes of
+// <path> for the name of a file in the directory.  Returns std::nullopt if
+// cgroup v2 is not in use.
+std::optional<size_t> CgroupDirectory(char (&path)[kCgroupPathSize]) {
+  // The cgroup v2 entry of /proc/self/cgroup is "0::<path>".
+  char buf[4096];
+  std::optional<absl::string_view> cgroups =
+      ReadSmallFile("/proc/self/cgroup", buf, sizeof(buf));
+  if (!cgroups.has_value()) {
+    return std::nullopt;
+  }
+  absl::string_view cgroup;
+  for (absl::string_view rest = *cgroups; !rest.empty();) {
+    const size_t newline = std::min(rest.find('\n'), rest.size());
+    absl::string_view line = rest.substr(0, newline);
+    rest.remove_prefix(std::min(newline + 1, rest.size()));
+    if (absl::ConsumePrefix(&line, "0::")) {
+      cgroup = line;
+      break;
+    }
+  }
+
+  if (cgroup.empty() || cgroup[0] != '/' ||
+      kCgroupRoot.size() + cgroup.size() + 32 > sizeof(path)) {
+    return std::nullopt;
+  }
+  memcpy(path, kCgroupRoot.data(), kCgroupRoot.size());
+  memcpy(path + kCgroupRoot.size(), cgroup.data(), cgroup.size());
+  size_t dir_len = kCgroupRoot.size() + cgroup.size();
+  while (dir_len > kCgroupRoot.size() && path[dir_len - 1] == '/') --dir_len;
+  return dir_len;
+}
 }  // namespace
 
+std::optional<double> ParseCgroupCpuMax(absl::string_view contents) {
+  contents = absl::StripAsciiWhitespace(contents);
+  const size_t space = contents.find(' ');
+  if (space == absl::string_view::npos) {
+    return std::nullopt;
+  }
+  int64_t quota, period;
+  if (!absl::SimpleAtoi(contents.substr(0, space), &quota) ||
+      !absl::SimpleAtoi(contents.substr(space + 1), &period) || quota <= 0 ||
+      period <= 0) {
+    // This includes a quota of "max".
+    return std::nullopt;
+  }
+  return static_cast<double>(quota) / period;
+}
+
+std::optional<uint64_t> ParseCgroupMemoryMax(absl::string_view contents) {
+  uint64_t limit;
+  if (!absl::SimpleAtoi(absl::StripAsciiWhitespace(contents), &limit)) {
+    // This includes "max".
+    return std::nullopt;
+  }
+  return limit;
+}
+
+CgroupLimits ReadCgroupLimits() {
+  CgroupLimits limits;
+
+  char path[kCgroupPathSize];
+  std::optional<size_t> cgroup_dir = CgroupDirectory(path);
+  if (!cgroup_dir.has_value()) {
+    return limits;
+  }
+  constexpr absl::string_view kRoot = kCgroupRoot;
+  size_t dir_len = *cgroup_dir;
+
+  // Limits of ancestors apply to the process too, so walk up to the root.
+  while (true) {
+    while (dir_len > kRoot.size() && path[dir_len - 1] == '/') --dir_len;
+
+    char contents[64];
+    memcpy(path + dir_len, "/cpu.max", sizeof("/cpu.max"));
+    if (auto cpu_max = ReadSmallFile(path, contents, sizeof(contents))) {
+      TakeMin(limits.cpus, ParseCgroupCpuMax(*cpu_max));
+    }
+    memcpy(path + dir_len, "/memory.max", sizeof("/memory.max"));
+    if (auto memory_max = ReadSmallFile(path, contents, sizeof(contents))) {
+      TakeMin(limits.memory_bytes, ParseCgroupMemoryMax(*memory_max));
+    }
+    memcpy(path + dir_len, "/memory.high", sizeof("/memory.high"));
+    if (auto memory_high = ReadSmallFile(path, contents, sizeof(contents))) {
+      TakeMin(limits.memory_high_bytes, ParseCgroupMemoryMax(*memory_high));
+    }
+
+    if (dir_len <= kRoot.size()) break;
+    while (dir_len > kRoot.size() && path[dir_len - 1] != '/') --dir_len;
+  }
+
+  return limits;
+}
+
+std::optional<double> ParsePressureSomeAvg10(absl::string_view contents) {
+  // The first line is "some avg10=<pct> avg60=<pct> avg300=<pct> total=<us>".
+  if (!absl::ConsumePrefix(&contents, "some avg10=")) {
+    return std::nullopt;
+  }
+  double avg10;
+  if (!absl::SimpleAtod(contents.substr(0, contents.find(' ')), &avg10) ||
+      avg10 < 0) {
+    return std::nullopt;
+  }
+  return avg10;
+}
+
+std::optional<uint64_t> ParseMemoryEvents(absl::string_view contents) {
+  // Lines are "<event> <count>".  Only count the events that mean the cgroup
+  // ran into its limits.
+  uint64_t events = 0;
+  bool found = false;
+  for (absl::string_view rest = contents; !rest.empty();) {
+    const size_t newline = std::min(rest.find('\n'), rest.size());
+    absl::string_view line = rest.substr(0, newline);
+    rest.remove_prefix(std::min(newline + 1, rest.size()));
+    const size_t space = line.find(' ');
+    if (space == absl::string_view::npos) {
+      return std::nullopt;
+    }
+    const absl::string_view name = line.substr(0, space);
+    if (name != "high" && name != "max" && name != "oom") {
+      continue;
+    }
+    uint64_t count;
+    if (!absl::SimpleAtoi(line.substr(space + 1), &count)) {
+      return std::nullopt;
+    }
+    events += count;
+    found = true;
+  }
+  if (!found) {
+    return std::nullopt;
+  }
+  return events;
+}
+
+std::optional<int64_t> ReadMaxMapCount() {
+  char contents[32];
+  std::optional<absl::string_view> max_map_count =
+      ReadSmallFile("/proc/sys/vm/max_map_count", contents, sizeof(contents));
+  if (!max_map_count.has_value()) {
+    return std::nullopt;
+  }
+  int64_t count;
+  if (!absl::SimpleAtoi(absl::StripAsciiWhitespace(*max_map_count), &count) ||
+      count <= 0) {
+    return std::nullopt;
+  }
+  return count;
+}
+
+MemoryPressure ReadMemoryPressure() {
+  MemoryPressure pressure;
+  char contents[256];
+
+  char path[kCgroupPathSize];
+  if (std::optional<size_t> dir_len = CgroupDirectory(path)) {
+    memcpy(path + *dir_len, "/memory.pressure", sizeof("/memory.pressure"));
+    if (auto psi = ReadSmallFile(path, contents, sizeof(contents))) {
+      pressure.some_avg10 = ParsePressureSomeAvg10(*psi);
+    }
+    memcpy(path + *dir_len, "/memory.events", sizeof("/memory.events"));
+    if (auto events = ReadSmallFile(path, contents, sizeof(contents))) {
+      pressure.limit_events = ParseMemoryEvents(*events);
+    }
+  }
+
+  // Fall back to the pressure of the whole machine, e.g. without cgroup v2 or
+  // if the process runs in the root cgroup.
+  if (!pressure.some_avg10.has_value()) {
+    if (auto psi = ReadSmallFile("/proc/pressure/memory", contents,
+                                 sizeof(contents))) {
+      pressure.some_avg10 = ParsePressureSomeAvg10(*psi);
+    }
+  }
+  return pressure;
+}
+
+ThpMode ParseThpMode(absl::string_view contents) {
+  const size_t open = contents.find('[');
+  const size_t close = contents.find(']');
+  if (open == absl::string_view::npos || close == absl::string_view::npos ||
+      close < open) {
+    return ThpMode::kUnknown;
+  }
+  const absl::string_view mode = contents.substr(open + 1, close - open - 1);
+  if (mode == "always") return ThpMode::kAlways;
+  if (mode == "madvise") return ThpMode::kMadvise;
+  if (mode == "never") return ThpMode::kNever;
+  return ThpMode::kUnknown;
+}
+
+ThpMode ReadThpMode() {
+  char contents[64];
+  std::optional<absl::string_view> enabled =
+      ReadSmallFile("/sys/kernel/mm/transparent_hugepage/enabled", contents,
+                    sizeof(contents));
+  if (!enabled.has_value()) {
+    return ThpMode::kUnknown;
+  }
+  return ParseThpMode(*enabled);
+}
+
 std::optional<CpuSet> ParseCpulist(
     absl::FunctionRef<ssize_t(char*, size_t)> read) {
   CpuSet set;
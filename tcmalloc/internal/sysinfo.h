@@ -18,12 +18,16 @@
 #include <sched.h>
 #include <sys/types.h>
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <optional>
 
 #include "absl/base/attributes.h"
 #include "absl/base/call_once.h"
+#include "absl/base/optimization.h"
 #include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/cpu_utils.h"
 #include "tcmalloc/internal/logging.h"
@@ -32,7 +36,111 @@ GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
 
+// Resource limits of the cgroup the process runs in.  Unset fields mean that
+// no limit applies, or that it could not be determined.
+struct CgroupLimits {
+  // CPU bandwidth quota, in CPUs.
+  std::optional<double> cpus;
+  // Memory limit, in bytes.
+  std::optional<uint64_t> memory_bytes;
+  // Memory usage above which the cgroup is throttled and reclaimed, in bytes.
+  std::optional<uint64_t> memory_high_bytes;
+
+  bool operator==(const CgroupLimits& other) const {
+    return cpus == other.cpus && memory_bytes == other.memory_bytes &&
+           memory_high_bytes == other.memory_high_bytes;
+  }
+  bool operator!=(const CgroupLimits& other) const { return !(*this == other); }
+};
+
+// Memory pressure of the cgroup the process runs in, or of the machine.  Unset
+// fields could not be determined.
+struct MemoryPressure {
+  // Share of the last 10 seconds during which some task stalled on memory, in
+  // percent.
+  std::optional<double> some_avg10;
+  // Number of times the cgroup hit memory.high or memory.max, or ran out of
+  // memory, since it was created.
+  std::optional<uint64_t> limit_events;
+};
+
+// The transparent hugepage mode of the machine.
+enum class ThpMode : uint8_t {
+  kUnknown,
+  // Anonymous memory is backed by hugepages where possible.
+  kAlways,
+  // Only memory advised with MADV_HUGEPAGE is backed by hugepages.
+  kMadvise,
+  kNever,
+};
+
+inline const char* ThpModeName(ThpMode mode) {
+  switch (mode) {
+    case ThpMode::kAlways:
+      return "always";
+    case ThpMode::kMadvise:
+      return "madvise";
+    case ThpMode::kNever:
+      return "never";
+    case ThpMode::kUnknown:
+      break;
+  }
+  return "unknown";
+}
+
 #if __linux__
+// Parse the contents of a cgroup v2 cpu.max file - that is, "<quota> <period>"
+// where <quota> may be "max".
+//
+// Returns the quota in CPUs, or std::nullopt if unlimited or on error.
+std::optional<double> ParseCgroupCpuMax(absl::string_view contents);
+
+// Parse the contents of a cgroup v2 memory.max or memory.high file - that is, a
+// number of bytes or "max".
+//
+// Returns the limit in bytes, or std::nullopt if unlimited or on error.
+std::optional<uint64_t> ParseCgroupMemoryMax(absl::string_view contents);
+
+// Returns the tightest cpu.max, memory.max and memory.high limits that apply to
+// the process, found by walking the cgroup v2 hierarchy from the cgroup of the
+// process up to the root.  Fields are unset if cgroup v2 is not mounted at
+// /sys/fs/cgroup.
+//
+// This does not allocate, and the result is not cached internally.
+CgroupLimits ReadCgroupLimits();
+
+// Returns vm.max_map_count, the limit on the number of VMAs of a process, or
+// std::nullopt if it cannot be read.
+std::optional<int64_t> ReadMaxMapCount();
+
+// Parse the contents of a PSI file, such as /proc/pressure/memory or a cgroup
+// v2 memory.pressure file.
+//
+// Returns the avg10 value of the "some" line, or std::nullopt on error.
+std::optional<double> ParsePressureSomeAvg10(absl::string_view contents);
+
+// Parse the contents of a cgroup v2 memory.events file.
+//
+// Returns the sum of the high, max and oom counts, or std::nullopt on error.
+std::optional<uint64_t> ParseMemoryEvents(absl::string_view contents);
+
+// Returns the memory pressure of the cgroup v2 of the process, falling back to
+// /proc/pressure/memory for the PSI averages.
+//
+// This does not allocate, and the result is not cached internally.
+MemoryPressure ReadMemoryPressure();
+
+// Parse the contents of /sys/kernel/mm/transparent_hugepage/enabled - that is,
+// the modes separated by spaces, with the selected one in brackets.
+//
+// Returns ThpMode::kUnknown on error.
+ThpMode ParseThpMode(absl::string_view contents);
+
+// Returns the transparent hugepage mode of the machine.
+//
+// This does not allocate, and the result is not cached internally.
+ThpMode ReadThpMode();
+
 // Parse a CPU list in the format used by
 // /sys/devices/system/node/nodeX/cpulist files - that is, individual CPU
 // numbers or ranges in the format <start>-<end> inclusive all joined by comma
@@ -55,9 +163,18 @@ namespace sysinfo_internal {
 // The result of this function is not cached internally.
 std::optional<int> NumPossibleCPUsNoCache();
 
+// For tests: when positive, NumCPUs() reports this many CPUs instead of the
+// machine's.  It must not change while anything sized by NumCPUs() is live.
+ABSL_CONST_INIT inline std::atomic<int> num_cpus_for_testing{0};
+
 }  // namespace sysinfo_internal
 
 inline std::optional<int> NumCPUsMaybe() {
+  if (const int n = sysinfo_internal::num_cpus_for_testing.load(
+          std::memory_order_relaxed);
+      ABSL_PREDICT_FALSE(n > 0)) {
+    return n;
+  }
   ABSL_CONST_INIT static absl::once_flag flag;
   ABSL_CONST_INIT static std::optional<int> result;
   absl::base_internal::LowLevelCallOnce(
@@ -69,8 +186,24 @@ inline std::optional<int> NumCPUsMaybe() {
 
 inline std::optional<int> NumCPUsMaybe() { return std::nullopt; }
 
+inline CgroupLimits ReadCgroupLimits() { return {}; }
+
+inline MemoryPressure ReadMemoryPressure() { return {}; }
+
+inline ThpMode ReadThpMode() { return ThpMode::kUnknown; }
+
 #endif  // __linux__
 
+// Returns the transparent hugepage mode of the machine, as read by the first
+// call.
+inline ThpMode GetThpMode() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static ThpMode result = ThpMode::kUnknown;
+  absl::base_internal::LowLevelCallOnce(&flag,
+                                        [&]() { result = ReadThpMode(); });
+  return result;
+}
+
 inline int NumCPUs() {
   std::optional<int> maybe_cpus = NumCPUsMaybe();
   TC_CHECK(maybe_cpus.has_value());
@@ -18,6 +18,7 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <optional>
 #include <string>
@@ -114,6 +115,96 @@ TEST(NumCPUs, Cached) {
   EXPECT_EQ(NumCPUs(), absl::base_internal::NumCPUs());
 }
 
+TEST(CgroupTest, ParseCpuMax) {
+  EXPECT_EQ(ParseCgroupCpuMax("max 100000\n"), std::nullopt);
+  EXPECT_EQ(ParseCgroupCpuMax("200000 100000\n"), 2.0);
+  EXPECT_EQ(ParseCgroupCpuMax("50000 100000"), 0.5);
+  EXPECT_EQ(ParseCgroupCpuMax(""), std::nullopt);
+  EXPECT_EQ(ParseCgroupCpuMax("100000"), std::nullopt);
+  EXPECT_EQ(ParseCgroupCpuMax("100000 0"), std::nullopt);
+  EXPECT_EQ(ParseCgroupCpuMax("-1 100000"), std::nullopt);
+}
+
+TEST(CgroupTest, ParseMemoryMax) {
+  EXPECT_EQ(ParseCgroupMemoryMax("max\n"), std::nullopt);
+  EXPECT_EQ(ParseCgroupMemoryMax("2147483648\n"), uint64_t{2} << 30);
+  EXPECT_EQ(ParseCgroupMemoryMax(""), std::nullopt);
+  EXPECT_EQ(ParseCgroupMemoryMax("12x"), std::nullopt);
+}
+
+TEST(CgroupTest, ReadLimits) {
+  const CgroupLimits limits = []() {
+    AllocationGuard guard;
+    return ReadCgroupLimits();
+  }();
+
+  // The limits depend on the environment, but must be sane if present.
+  if (limits.cpus.has_value()) {
+    EXPECT_GT(*limits.cpus, 0);
+  }
+  if (limits.memory_bytes.has_value()) {
+    EXPECT_GT(*limits.memory_bytes, 0);
+  }
+  if (limits.memory_high_bytes.has_value()) {
+    EXPECT_GT(*limits.memory_high_bytes, 0);
+  }
+  EXPECT_EQ(limits, ReadCgroupLimits());
+}
+
+TEST(CgroupTest, ParsePressure) {
+  EXPECT_EQ(ParsePressureSomeAvg10("some avg10=1.25 avg60=0.50 avg300=0.10 "
+                                   "total=12345\n"
+                                   "full avg10=0.00 avg60=0.00 avg300=0.00 "
+                                   "total=0\n"),
+            1.25);
+  EXPECT_EQ(ParsePressureSomeAvg10("some avg10=0.00 avg60=0.00"), 0.0);
+  EXPECT_EQ(ParsePressureSomeAvg10("full avg10=1.00"), std::nullopt);
+  EXPECT_EQ(ParsePressureSomeAvg10("some avg10=x avg60=0.00"), std::nullopt);
+  EXPECT_EQ(ParsePressureSomeAvg10(""), std::nullopt);
+}
+
+TEST(CgroupTest, ParseMemoryEvents) {
+  EXPECT_EQ(ParseMemoryEvents("low 7\nhigh 3\nmax 2\noom 1\noom_kill 1\n"
+                              "oom_group_kill 0\n"),
+            6);
+  EXPECT_EQ(ParseMemoryEvents("high 0\nmax 0\noom 0\n"), 0);
+  EXPECT_EQ(ParseMemoryEvents("low 7\n"), std::nullopt);
+  EXPECT_EQ(ParseMemoryEvents("high x\n"), std::nullopt);
+  EXPECT_EQ(ParseMemoryEvents(""), std::nullopt);
+}
+
+TEST(CgroupTest, ReadMemoryPressure) {
+  const MemoryPressure pressure = []() {
+    AllocationGuard guard;
+    return ReadMemoryPressure();
+  }();
+
+  // Pressure depends on the environment, but must be sane if present.
+  if (pressure.some_avg10.has_value()) {
+    EXPECT_GE(*pressure.some_avg10, 0);
+    EXPECT_LE(*pressure.some_avg10, 100);
+  }
+}
+
+TEST(ThpModeTest, Parse) {
+  EXPECT_EQ(ParseThpMode("[always] madvise never\n"), ThpMode::kAlways);
+  EXPECT_EQ(ParseThpMode("always [madvise] never\n"), ThpMode::kMadvise);
+  EXPECT_EQ(ParseThpMode("always madvise [never]\n"), ThpMode::kNever);
+  EXPECT_EQ(ParseThpMode("always madvise never\n"), ThpMode::kUnknown);
+  EXPECT_EQ(ParseThpMode("always [inherit] never\n"), ThpMode::kUnknown);
+  EXPECT_EQ(ParseThpMode("] always ["), ThpMode::kUnknown);
+  EXPECT_EQ(ParseThpMode(""), ThpMode::kUnknown);
+}
+
+TEST(ThpModeTest, Cached) {
+  const ThpMode mode = []() {
+    AllocationGuard guard;
+    return ReadThpMode();
+  }();
+  EXPECT_EQ(GetThpMode(), mode);
+  EXPECT_STRNE(ThpModeName(mode), "");
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
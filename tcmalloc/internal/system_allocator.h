@@ -33,20 +33,25 @@
 #include <sys/mman.h>
 #include <sys/prctl.h>
 #include <sys/syscall.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "absl/base/attributes.h"
 #include "absl/base/call_once.h"
+#include "absl/types/span.h"
 #include "tcmalloc/experiment.h"
 #include "tcmalloc/experiment_config.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/environment.h"
 #include "tcmalloc/internal/exponential_biased.h"
 #include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/internal/mte.h"
 #include "tcmalloc/internal/numa.h"
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/internal/page_size.h"
+#include "tcmalloc/internal/probes.h"
 #include "tcmalloc/internal/strerror.h"
+#include "tcmalloc/internal/sysinfo.h"
 #include "tcmalloc/internal/util.h"
 #include "tcmalloc/malloc_extension.h"
 
@@ -58,14 +63,44 @@
 #define MADV_COLLAPSE 25 /* Synchronous hugepage collapse */
 #endif
 
+#ifndef MADV_COLD
+#define MADV_COLD 20
+#endif
+
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+
 #ifndef MADV_POPULATE_READ
 #define MADV_POPULATE_READ 22
 #endif
 
+#ifndef MREMAP_DONTUNMAP
+#define MREMAP_DONTUNMAP 4
+#endif
+
 #ifndef MADV_POPULATE_WRITE
 #define MADV_POPULATE_WRITE 23
 #endif
 
+#ifndef MADV_GUARD_INSTALL
+#define MADV_GUARD_INSTALL 102
+#endif
+
+#ifndef MADV_GUARD_REMOVE
+#define MADV_GUARD_REMOVE 103
+#endif
+
+#ifndef __NR_process_madvise
+#define __NR_process_madvise 440
+#endif
+
+// Refers to the calling process in pidfd-taking syscalls (Linux 6.14+).  Unlike
+// a pidfd for getpid(), it keeps referring to the caller across fork().
+#ifndef PIDFD_SELF_THREAD_GROUP
+#define PIDFD_SELF_THREAD_GROUP -20000
+#endif
+
 // The <sys/prctl.h> on some systems may not define these macros yet even though
 // the kernel may have support for the new PR_SET_VMA syscall, so we explicitly
 // define them here.
@@ -77,6 +112,14 @@
 #define PR_SET_VMA_ANON_NAME 0
 #endif
 
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
@@ -89,6 +132,16 @@ struct AddressRange {
 struct MemoryModifyStatus {
   bool success;
   int error_number;
+  // Whether released memory was freed lazily with MADV_FREE, i.e. the kernel
+  // only reclaims it under memory pressure.
+  bool lazily_freed = false;
+};
+
+// How soon memory handed to SystemAllocator::Release is expected to be reused.
+// Only consulted with MadvisePreference::kAdaptive.
+enum class ReleaseHint : uint8_t {
+  kNotReused,
+  kReusedSoon,
 };
 
 template <typename Topology, size_t NormalPartitions>
@@ -112,9 +165,33 @@ class SystemAllocator {
   // aligned.
   //
   // The returned pointer is guaranteed to satisfy GetMemoryTag(ptr) == "tag".
+  // For MemoryTag::kSizeClassed, it also satisfies
+  // SizeClassFromRegion(ptr) == "size_class_region".
   // Returns nullptr when out of memory.
   [[nodiscard]] AddressRange Allocate(size_t bytes, size_t alignment,
-                                      MemoryTag tag);
+                                      MemoryTag tag,
+                                      size_t size_class_region = 0);
+
+  // Binds "size" bytes at "base", returned by Allocate() for
+  // MemoryTag::kMetadata and not yet touched, to the NUMA nodes of
+  // "partition".  Other tags are bound when they are mapped.
+  void BindMetadata(void* base, size_t size, size_t partition) const {
+    AllocationGuardSpinLockHolder lock_holder(spinlock_);
+    BindMemory(base, size, partition);
+  }
+
+  // Allocates "bytes", rounded up to kGiganticPageSize, of zeroed memory backed
+  // by 1 GiB hugetlbfs pages.  Returns {nullptr, 0} if the hugetlbfs pool has
+  // too few free pages, or if a custom AddressRegionFactory is installed.
+  //
+  // Gigantic pages are never released: Release() fails on any range that
+  // overlaps them, so that they are neither broken up nor lost to the pool.
+  [[nodiscard]] AddressRange AllocateGigantic(size_t bytes, MemoryTag tag);
+
+  // Returns the number of bytes backed by gigantic pages.
+  size_t gigantic_bytes() const {
+    return gigantic_bytes_.load(std::memory_order_relaxed);
+  }
 
   // Returns the number of times we failed to give pages back to the OS after a
   // call to Release.
@@ -122,6 +199,31 @@ class SystemAllocator {
     return release_errors_.load(std::memory_order_relaxed);
   }
 
+  // Returns true if the process runs under mlockall(MCL_FUTURE), which locks
+  // the memory we map as it is mapped, unless TCMALLOC_MLOCKALL_UNLOCK_FUTURE
+  // asked us to unlock it.  Release() then munlock()s pages up front rather
+  // than after a failed madvise(), and Back() locks them again.
+  bool mlockall_mode() const {
+    return mlockall_.load(std::memory_order_relaxed);
+  }
+
+  // Checks whether mlockall(MCL_FUTURE) is in effect, as the application may
+  // call it at any time, updates mlockall_mode() and returns it.  This maps a
+  // page to see whether the kernel faults it in right away.
+  bool DetectMlockall() ABSL_LOCKS_EXCLUDED(spinlock_);
+
+  // Returns the number of times a tag's next reservation could not extend its
+  // previous ones, and was placed at a random address instead.
+  size_t scattered_reservations() const {
+    return scattered_reservations_.load(std::memory_order_relaxed);
+  }
+
+  // Returns the number of calls to Release() that munlock()ed their range
+  // because of mlockall_mode().
+  size_t mlocked_releases() const {
+    return mlocked_releases_.load(std::memory_order_relaxed);
+  }
+
   void set_madvise_preference(MadvisePreference v) {
     madvise_.store(v, std::memory_order_relaxed);
   }
@@ -130,6 +232,31 @@ class SystemAllocator {
     return madvise_.load(std::memory_order_relaxed);
   }
 
+  // With MadvisePreference::kAdaptive, memory is released with MADV_DONTNEED
+  // rather than MADV_FREE while under memory pressure, so that it stops
+  // counting towards the process' RSS right away.
+  void set_memory_pressure(bool v) {
+    memory_pressure_.store(v, std::memory_order_relaxed);
+  }
+
+  bool memory_pressure() const {
+    return memory_pressure_.load(std::memory_order_relaxed);
+  }
+
+  // Maps sampled memory committed from now on with PROT_MTE, so that it can
+  // carry Arm MTE tags.  Only affects the default AddressRegionFactory.
+  void EnableMteForSampledMemory() {
+    AllocationGuardSpinLockHolder lock_holder(spinlock_);
+    mmap_factory_.set_mte_sampled(true);
+  }
+
+  // Returns true if memory handed out by Allocate(), and memory given back to
+  // the OS by Release(), reads as zero until it is next written.  This stops
+  // holding once any memory was released with MADV_FREE alone, which the
+  // kernel may leave as is, and while a custom AddressRegionFactory is
+  // installed.
+  bool unbacked_memory_is_zero() const;
+
   // This call is a hint to the operating system that the pages
   // contained in the specified range of memory will not be used for a
   // while, and can be released for use by other processes or the OS.
@@ -140,14 +267,51 @@ class SystemAllocator {
   // performance.  (Only pages fully covered by the memory region will
   // be released, partial pages will not.)
   //
+  // With MadvisePreference::kAdaptive, memory expected to be reused soon is
+  // released with MADV_FREE unless we are under memory pressure, and with
+  // MADV_DONTNEED otherwise.
+  //
   // Returns true on success.
-  [[nodiscard]] MemoryModifyStatus Release(void* start, size_t length);
+  [[nodiscard]] MemoryModifyStatus Release(
+      void* start, size_t length, ReleaseHint hint = ReleaseHint::kNotReused);
+
+  // Releases each of <ranges>, in order, as Release would, stopping at the
+  // first one that fails.  Returns the number of ranges released.
+  //
+  // Where the kernel supports it (Linux 6.14+), the ranges are submitted in
+  // batches with a single process_madvise(2) call each, rather than one
+  // madvise(2) per range.
+  [[nodiscard]] size_t ReleaseBatch(absl::Span<const AddressRange> ranges);
 
   // Attempt to MADV_COLLAPSE the specified range of memory, starting at the
   // <start> address, ranging <length>.
   // Returns true on success.
   [[nodiscard]] MemoryModifyStatus Collapse(void* start, size_t length);
 
+  // Advises the kernel to reclaim the specified range of memory, starting at
+  // the <start> address, ranging <length>, to swap or zswap: right away with
+  // MADV_PAGEOUT if <reclaim> is true, and before other memory with MADV_COLD
+  // otherwise.  Its contents are kept.  Both need Linux 5.4+.
+  [[nodiscard]] MemoryModifyStatus PageOut(void* start, size_t length,
+                                           bool reclaim);
+
+  // Binds the specified range of memory, starting at the <start> address,
+  // ranging <length>, to NUMA node <far_node> and migrates the pages already
+  // backing it there.  If <far_node> is std::nullopt, restores the placement
+  // its memory tag gets at allocation time instead, migrating the pages back.
+  [[nodiscard]] MemoryModifyStatus SetMemoryTier(void* start, size_t length,
+                                                 std::optional<int> far_node);
+
+  // Moves the pages backing [<from>, <from> + <length>) to the same offsets
+  // of [<to>, <to> + <length>) by remapping them, without copying their
+  // contents.  <from> stays mapped, but is left unbacked.  Fails if either
+  // range overlaps gigantic pages, if a custom AddressRegionFactory is
+  // installed, or if the kernel lacks MREMAP_DONTUNMAP (Linux 5.7+).
+  //
+  // REQUIRES: both ranges were returned by Allocate() for the same tag and are
+  //           aligned to kHugePageSize boundaries.
+  [[nodiscard]] MemoryModifyStatus Move(void* from, void* to, size_t length);
+
   // Sets the anonymous VMA <name> for the specified range of memory, starting
   // at the <start> address, ranging <length>.
   // If <name> is empty, it uses a default name based on the memory tag for the
@@ -157,13 +321,24 @@ class SystemAllocator {
 
   // This call is the inverse of Release: the pages in this range are in use and
   // should be faulted in.  (In principle this is a best-effort hint, but in
-  // practice we will unconditionally fault the range.)
+  // practice we will unconditionally fault the range.)  In mlockall_mode(),
+  // the range is locked again, which also faults it in.
   //
   // REQUIRES: [start, start + length) is a range aligned to 4KiB boundaries.
   void Back(void* start, size_t length) {
+    if (mlockall_mode() && mlock(start, length) == 0) return;
     madvise(start, length, MADV_POPULATE_READ | MADV_POPULATE_WRITE);
   }
 
+  // Faults in [start, start + length) with write access in a single call, so
+  // that the first touch of the range does not take a page fault.  Kernels
+  // without MADV_POPULATE_WRITE leave the range to be faulted in lazily.
+  //
+  // REQUIRES: [start, start + length) is a range aligned to 4KiB boundaries.
+  void Populate(void* start, size_t length) {
+    madvise(start, length, MADV_POPULATE_WRITE);
+  }
+
   // Returns the current address region factory.
   [[nodiscard]] AddressRegionFactory* GetRegionFactory() const;
 
@@ -197,12 +372,42 @@ class SystemAllocator {
       ABSL_GUARDED_BY(spinlock_) = {0};
   std::array<uintptr_t, kNumPartitions> next_normal_addr_
       ABSL_GUARDED_BY(spinlock_) = {0};
+  std::array<uintptr_t, kMaxSizeClassRegions> next_size_classed_addr_
+      ABSL_GUARDED_BY(spinlock_) = {0};
   uintptr_t next_cold_addr_ ABSL_GUARDED_BY(spinlock_) = 0;
   uintptr_t next_metadata_addr_ ABSL_GUARDED_BY(spinlock_) = 0;
 
   std::atomic<int> release_errors_{0};
+
+  // Reservations colliding with other mappings try this many addresses past
+  // them before being placed at random.
+  static constexpr int kCompactProbes = 8;
+  std::atomic<size_t> scattered_reservations_{0};
+
+  // Ranges mapped by AllocateGigantic.  Entries are only ever appended, so
+  // Release can check them without taking spinlock_.
+  static constexpr int kMaxGiganticRanges = 64;
+  std::array<std::atomic<uintptr_t>, kMaxGiganticRanges> gigantic_start_{};
+  std::array<std::atomic<uintptr_t>, kMaxGiganticRanges> gigantic_end_{};
+  std::atomic<int> num_gigantic_ranges_{0};
+  std::atomic<size_t> gigantic_bytes_{0};
+
+  bool OverlapsGigantic(uintptr_t start, uintptr_t end) const;
   std::atomic<MadvisePreference> madvise_{MadvisePreference::kDontNeed};
+  std::atomic<bool> memory_pressure_{false};
+  // Set once process_madvise(2) failed in a way that suggests the kernel does
+  // not support it for our advice.
+  std::atomic<bool> process_madvise_unsupported_{false};
+  // Set, and never cleared, before memory is first released in a way that may
+  // leave its contents in place.
+  std::atomic<bool> released_without_zeroing_{false};
   bool unlock_vmas_ = false;
+  std::atomic<bool> mlockall_{false};
+  std::atomic<size_t> mlocked_releases_{0};
+
+  // Returns true if a freshly mapped page is resident before being touched,
+  // as under mlockall(MCL_FUTURE).
+  static bool ProbeMlockall();
 
   void DiscardMappedRegions() ABSL_EXCLUSIVE_LOCKS_REQUIRED(spinlock_);
 
@@ -210,30 +415,53 @@ class SystemAllocator {
   // for the next allocation, if not allocate a new region.
   // Then returns a pointer to the new memory.
   std::pair<void*, size_t> AllocateFromRegion(size_t size, size_t alignment,
-                                              MemoryTag tag)
+                                              MemoryTag tag,
+                                              size_t size_class_region)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(spinlock_);
 
   std::array<AddressRegion*, kNumPartitions> normal_region_
       ABSL_GUARDED_BY(spinlock_){{nullptr}};
   std::array<AddressRegion*, kSecurityPartitions> sampled_region_
       ABSL_GUARDED_BY(spinlock_){{nullptr}};
+  std::array<AddressRegion*, kMaxSizeClassRegions> size_classed_region_
+      ABSL_GUARDED_BY(spinlock_){{nullptr}};
   AddressRegion* cold_region_ ABSL_GUARDED_BY(spinlock_){nullptr};
   AddressRegion* metadata_region_ ABSL_GUARDED_BY(spinlock_){nullptr};
 
+  class MmapRegionFactory;
+
+  // Hands out memory from the end of a PROT_NONE reservation.  The reservation
+  // is made accessible in batches of at least kCommitBatch bytes, so that a
+  // ramping heap takes one mprotect() per batch rather than per allocation,
+  // and the committed part of the region stays a single VMA.
   class MmapRegion final : public AddressRegion {
    public:
+    static constexpr size_t kCommitBatch = 16 * kHugePageSize;
+
     MmapRegion(uintptr_t start, size_t size,
-               AddressRegionFactory::UsageHint hint)
-        : start_(start), free_size_(size), hint_(hint) {}
+               AddressRegionFactory::UsageHint hint,
+               MmapRegionFactory* factory)
+        : start_(start),
+          free_size_(size),
+          committed_start_(start + size),
+          hint_(hint),
+          factory_(factory) {}
     std::pair<void*, size_t> Alloc(size_t size, size_t alignment) override;
     ~MmapRegion() override = default;
 
     static void operator delete(void*) { __builtin_trap(); }
 
    private:
+    // Makes [addr, committed_start_) accessible, along with up to
+    // kCommitBatch bytes below addr.
+    bool Commit(uintptr_t addr);
+
     const uintptr_t start_;
     size_t free_size_;
+    // [committed_start_, start_ + free_size_) is accessible but unallocated.
+    uintptr_t committed_start_;
     const AddressRegionFactory::UsageHint hint_;
+    MmapRegionFactory* const factory_;
   };
 
   class MmapRegionFactory final : public AddressRegionFactory {
@@ -247,8 +475,28 @@ class SystemAllocator {
     size_t GetStats(absl::Span<char> buffer) override;
     size_t GetStatsInPbtxt(absl::Span<char> buffer) override;
 
+    void RecordCommit(size_t bytes) {
+      bytes_committed_.fetch_add(bytes, std::memory_order_relaxed);
+      commits_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void RecordHugepageAdvice(size_t bytes) {
+      bytes_hugepage_advised_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    // Both are called with the SystemAllocator's spinlock_ held.
+    void set_mte_sampled(bool v) { mte_sampled_ = v; }
+    bool mte_sampled() const { return mte_sampled_; }
+
    private:
     std::atomic<size_t> bytes_reserved_{0};
+    std::atomic<size_t> bytes_committed_{0};
+    // Number of mmap() reservations and of mprotect() commits.
+    std::atomic<size_t> reservations_{0};
+    std::atomic<size_t> commits_{0};
+    // Committed bytes advised with MADV_HUGEPAGE, see ThpMode::kMadvise.
+    std::atomic<size_t> bytes_hugepage_advised_{0};
+    bool mte_sampled_ = false;
   };
 
   MmapRegionFactory mmap_factory_ ABSL_GUARDED_BY(spinlock_);
@@ -258,12 +506,21 @@ class SystemAllocator {
   AddressRegionFactory::UsageHint TagToHint(MemoryTag tag) const;
   void BindMemory(void* base, size_t size, size_t partition) const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(spinlock_);
-  uintptr_t RandomMmapHint(size_t size, size_t alignment, MemoryTag tag)
+  uintptr_t RandomMmapHint(size_t size, size_t alignment, MemoryTag tag,
+                           size_t size_class_region)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(spinlock_);
   [[nodiscard]] void* MmapAlignedLocked(size_t size, size_t alignment,
-                                        MemoryTag tag)
+                                        MemoryTag tag,
+                                        size_t size_class_region = 0)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(spinlock_);
-  [[nodiscard]] bool ReleasePages(void* start, size_t length) const;
+  // Releases [start, start + length).  If <lazy> is true on entry, the pages
+  // are released with MADV_FREE instead of following madvise_preference(); it
+  // is cleared if they ended up released some other way.
+  [[nodiscard]] bool ReleasePages(void* start, size_t length,
+                                  bool& lazy) const;
+  // Releases a prefix of <ranges> with process_madvise(2) and returns its
+  // length, or 0 if the ranges must be released one at a time.
+  size_t ProcessMadviseRelease(absl::Span<const AddressRange> ranges);
 };
 
 namespace system_allocator_internal {
@@ -300,7 +557,10 @@ int MapFixedNoReplaceFlagAvailable();
 
 template <typename Topology, size_t NormalPartitions>
 AddressRange SystemAllocator<Topology, NormalPartitions>::Allocate(
-    size_t bytes, size_t alignment, const MemoryTag tag) {
+    size_t bytes, size_t alignment, const MemoryTag tag,
+    size_t size_class_region) {
+  TC_ASSERT(tag == MemoryTag::kSizeClassed || size_class_region == 0);
+  TC_ASSERT_LT(size_class_region, kMaxSizeClassRegions);
   // If default alignment is set request the minimum alignment provided by
   // the system.
   alignment = std::max(alignment, GetPageSize());
@@ -310,13 +570,17 @@ AddressRange SystemAllocator<Topology, NormalPartitions>::Allocate(
 
   AllocationGuardSpinLockHolder lock_holder(spinlock_);
 
-  auto [result, actual_bytes] = AllocateFromRegion(bytes, alignment, tag);
+  auto [result, actual_bytes] =
+      AllocateFromRegion(bytes, alignment, tag, size_class_region);
 
   if (result != nullptr) {
     system_allocator_internal::CheckAddressBits<kAddressBits>(
         reinterpret_cast<uintptr_t>(result) + actual_bytes - 1);
     TC_ASSERT_EQ(GetMemoryTag(result), tag);
+    TC_ASSERT(tag != MemoryTag::kSizeClassed ||
+              SizeClassFromRegion(result) == size_class_region);
   }
+  TCMALLOC_PROBE(system_alloc, bytes, actual_bytes, static_cast<int>(tag));
   return {result, actual_bytes};
 }
 
@@ -327,6 +591,70 @@ SystemAllocator<Topology, NormalPartitions>::GetRegionFactory() const {
   return region_factory_;
 }
 
+template <typename Topology, size_t NormalPartitions>
+bool SystemAllocator<Topology, NormalPartitions>::unbacked_memory_is_zero()
+    const {
+  return !released_without_zeroing_.load(std::memory_order_relaxed) &&
+         GetRegionFactory() == &mmap_factory_;
+}
+
+template <typename Topology, size_t NormalPartitions>
+AddressRange SystemAllocator<Topology, NormalPartitions>::AllocateGigantic(
+    size_t bytes, const MemoryTag tag) {
+#ifdef MAP_HUGETLB
+  using system_allocator_internal::RoundUp;
+
+  const size_t size = RoundUp(bytes, kGiganticPageSize);
+  if (size < bytes || size > kTagMask) return {nullptr, 0};
+
+  AllocationGuardSpinLockHolder lock_holder(spinlock_);
+  // A custom factory expects to see all the memory we map.
+  if (region_factory_ != &mmap_factory_) return {nullptr, 0};
+  const int n = num_gigantic_ranges_.load(std::memory_order_relaxed);
+  if (n == kMaxGiganticRanges) return {nullptr, 0};
+
+  void* ptr = MmapAlignedLocked(size, kGiganticPageSize, tag);
+  if (ptr == nullptr) return {nullptr, 0};
+  // Replace the reservation with hugetlbfs memory.  Private hugetlbfs
+  // mappings reserve their pages from the pool up front, so this fails
+  // instead of faulting later if the pool is exhausted.
+  ErrnoRestorer errno_restorer;
+  void* result = mmap(ptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB |
+                          MAP_HUGE_1GB,
+                      -1, 0);
+  if (result != ptr) {
+    munmap(ptr, size);
+    return {nullptr, 0};
+  }
+
+  const uintptr_t start = reinterpret_cast<uintptr_t>(ptr);
+  gigantic_start_[n].store(start, std::memory_order_relaxed);
+  gigantic_end_[n].store(start + size, std::memory_order_relaxed);
+  num_gigantic_ranges_.store(n + 1, std::memory_order_release);
+  gigantic_bytes_.fetch_add(size, std::memory_order_relaxed);
+  system_allocator_internal::CheckAddressBits<kAddressBits>(start + size - 1);
+  return {ptr, size};
+#else
+  (void)bytes;
+  (void)tag;
+  return {nullptr, 0};
+#endif  // MAP_HUGETLB
+}
+
+template <typename Topology, size_t NormalPartitions>
+bool SystemAllocator<Topology, NormalPartitions>::OverlapsGigantic(
+    uintptr_t start, uintptr_t end) const {
+  const int n = num_gigantic_ranges_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; ++i) {
+    if (start < gigantic_end_[i].load(std::memory_order_relaxed) &&
+        gigantic_start_[i].load(std::memory_order_relaxed) < end) {
+      return true;
+    }
+  }
+  return false;
+}
+
 template <typename Topology, size_t NormalPartitions>
 void SystemAllocator<Topology, NormalPartitions>::SetRegionFactory(
     AddressRegionFactory* factory) {
@@ -365,11 +693,34 @@ SystemAllocator<Topology, NormalPartitions>::MmapRegion::Alloc(
   size_t actual_size = end - result;
 
   TC_ASSERT_EQ(result % GetPageSize(), 0);
-  void* result_ptr = reinterpret_cast<void*>(result);
-  if (mprotect(result_ptr, actual_size, PROT_READ | PROT_WRITE) != 0) {
-    TC_LOG("mprotect(%p, %v) failed (%v)", result_ptr, actual_size,
+  if (result < committed_start_ && !Commit(result)) return {nullptr, 0};
+  free_size_ -= actual_size;
+  return {reinterpret_cast<void*>(result), actual_size};
+}
+
+template <typename Topology, size_t NormalPartitions>
+bool SystemAllocator<Topology, NormalPartitions>::MmapRegion::Commit(
+    uintptr_t addr) {
+  TC_ASSERT_LT(addr, committed_start_);
+  TC_ASSERT_EQ(addr % kHugePageSize, 0);
+  // Commit at least a batch, but never past the start of the region.
+  uintptr_t commit_start = addr;
+  if (committed_start_ - addr < kCommitBatch) {
+    commit_start = committed_start_ - std::min(kCommitBatch,
+                                               committed_start_ - start_);
+  }
+  const size_t commit_size = committed_start_ - commit_start;
+
+  void* commit_ptr = reinterpret_cast<void*>(commit_start);
+  int prot = PROT_READ | PROT_WRITE;
+  if (hint_ == AddressRegionFactory::UsageHint::kInfrequentAllocation &&
+      factory_->mte_sampled()) {
+    prot |= kProtMte;
+  }
+  if (mprotect(commit_ptr, commit_size, prot) != 0) {
+    TC_LOG("mprotect(%p, %v) failed (%v)", commit_ptr, commit_size,
            StrError(errno));
-    return {nullptr, 0};
+    return false;
   }
   // For cold regions (kInfrequentAccess) and sampled regions
   // (kInfrequentAllocation), we want as granular of access telemetry as
@@ -378,10 +729,20 @@ SystemAllocator<Topology, NormalPartitions>::MmapRegion::Alloc(
       hint_ == AddressRegionFactory::UsageHint::kInfrequentAllocation) {
     // This is only advisory, so ignore the error.
     ErrnoRestorer errno_restorer;
-    (void)madvise(result_ptr, actual_size, MADV_NOHUGEPAGE);
+    (void)madvise(commit_ptr, commit_size, MADV_NOHUGEPAGE);
+  } else if (hint_ != AddressRegionFactory::UsageHint::kMetadata &&
+             GetThpMode() == ThpMode::kMadvise) {
+    // Without MADV_HUGEPAGE, the kernel backs the memory the hugepage-aware
+    // allocator keeps intact with native pages.  Committing whole batches
+    // keeps the advised memory a single VMA.
+    ErrnoRestorer errno_restorer;
+    if (madvise(commit_ptr, commit_size, MADV_HUGEPAGE) == 0) {
+      factory_->RecordHugepageAdvice(commit_size);
+    }
   }
-  free_size_ -= actual_size;
-  return {result_ptr, actual_size};
+  committed_start_ = commit_start;
+  factory_->RecordCommit(commit_size);
+  return true;
 }
 
 template <typename Topology, size_t NormalPartitions>
@@ -391,8 +752,9 @@ SystemAllocator<Topology, NormalPartitions>::MmapRegionFactory::Create(
   void* region_space = MallocInternal(sizeof(MmapRegion));
   if (!region_space) return nullptr;
   bytes_reserved_.fetch_add(size, std::memory_order_relaxed);
+  reservations_.fetch_add(1, std::memory_order_relaxed);
   return new (region_space)
-      MmapRegion(reinterpret_cast<uintptr_t>(start), size, hint);
+      MmapRegion(reinterpret_cast<uintptr_t>(start), size, hint, this);
 }
 
 template <typename Topology, size_t NormalPartitions>
@@ -403,6 +765,19 @@ size_t SystemAllocator<Topology, NormalPartitions>::MmapRegionFactory::GetStats(
   constexpr double MiB = 1048576.0;
   printer.printf("MmapSysAllocator: %zu bytes (%.1f MiB) reserved\n", allocated,
                  allocated / MiB);
+  const size_t committed = bytes_committed_.load(std::memory_order_relaxed);
+  printer.printf(
+      "MmapSysAllocator: %zu bytes (%.1f MiB) committed, in %zu reservations "
+      "and %zu commits\n",
+      committed, committed / MiB,
+      reservations_.load(std::memory_order_relaxed),
+      commits_.load(std::memory_order_relaxed));
+  const size_t advised =
+      bytes_hugepage_advised_.load(std::memory_order_relaxed);
+  printer.printf(
+      "MmapSysAllocator: THP mode %s, %zu bytes (%.1f MiB) advised with "
+      "MADV_HUGEPAGE\n",
+      ThpModeName(GetThpMode()), advised, advised / MiB);
 
   return printer.SpaceRequired();
 }
@@ -414,6 +789,16 @@ SystemAllocator<Topology, NormalPartitions>::MmapRegionFactory::GetStatsInPbtxt(
   Printer printer(buffer.data(), buffer.size());
   size_t allocated = bytes_reserved_.load(std::memory_order_relaxed);
   printer.printf(" mmap_sys_allocator: %lld\n", allocated);
+  printer.printf(" mmap_sys_allocator_committed: %lld\n",
+                 bytes_committed_.load(std::memory_order_relaxed));
+  printer.printf(" mmap_sys_allocator_reservations: %lld\n",
+                 reservations_.load(std::memory_order_relaxed));
+  printer.printf(" mmap_sys_allocator_commits: %lld\n",
+                 commits_.load(std::memory_order_relaxed));
+  printer.printf(" mmap_sys_allocator_thp_mode: %s\n",
+                 ThpModeName(GetThpMode()));
+  printer.printf(" mmap_sys_allocator_hugepage_advised: %lld\n",
+                 bytes_hugepage_advised_.load(std::memory_order_relaxed));
 
   return printer.SpaceRequired();
 }
@@ -421,10 +806,13 @@ SystemAllocator<Topology, NormalPartitions>::MmapRegionFactory::GetStatsInPbtxt(
 template <typename Topology, size_t NormalPartitions>
 std::pair<void*, size_t>
 SystemAllocator<Topology, NormalPartitions>::AllocateFromRegion(
-    size_t request_size, size_t alignment, const MemoryTag tag) {
+    size_t request_size, size_t alignment, const MemoryTag tag,
+    size_t size_class_region) {
   using system_allocator_internal::RoundUp;
 
-  constexpr uintptr_t kTagFree = uintptr_t{1} << kTagShift;
+  const uintptr_t kTagFree =
+      uintptr_t{1} << (tag == MemoryTag::kSizeClassed ? kSizeClassRegionShift
+                                                      : kTagShift);
 
   // We do not support size or alignment larger than kTagFree.
   // TODO(b/141325493): Handle these large allocations.
@@ -439,7 +827,7 @@ SystemAllocator<Topology, NormalPartitions>::AllocateFromRegion(
     size_t size = RoundUp(request_size, kHugePageSize);
     if (size < request_size) return {nullptr, 0};
     alignment = std::max(alignment, kHugePageSize);
-    void* ptr = MmapAlignedLocked(size, alignment, tag);
+    void* ptr = MmapAlignedLocked(size, alignment, tag, size_class_region);
     if (!ptr) return {nullptr, 0};
 
     const auto region_type = TagToHint(tag);
@@ -465,6 +853,16 @@ SystemAllocator<Topology, NormalPartitions>::AllocateFromRegion(
             return &normal_region_[0];
           case MemoryTag::kNormalP1:
             return &normal_region_[1];
+          case MemoryTag::kNormalP2:
+          case MemoryTag::kNormalP3:
+          case MemoryTag::kNormalP4:
+          case MemoryTag::kNormalP5:
+          case MemoryTag::kNormalP6:
+          case MemoryTag::kNormalP7:
+            TC_ASSERT_LT(NormalTagPartition(tag), kNumPartitions);
+            return &normal_region_[NormalTagPartition(tag)];
+          case MemoryTag::kSizeClassed:
+            return &size_classed_region_[size_class_region];
           case MemoryTag::kSampled:
             return &sampled_region_[0];
           case MemoryTag::kSampledP1:
@@ -487,7 +885,8 @@ SystemAllocator<Topology, NormalPartitions>::AllocateFromRegion(
 
   // Allocation failed so we need to reserve more memory.
   // Reserve new region and try allocation again.
-  void* ptr = MmapAlignedLocked(min_mmap_size_, min_mmap_size_, tag);
+  void* ptr =
+      MmapAlignedLocked(min_mmap_size_, min_mmap_size_, tag, size_class_region);
   if (!ptr) return {nullptr, 0};
 
   const auto region_type = TagToHint(tag);
@@ -508,8 +907,10 @@ void* SystemAllocator<Topology, NormalPartitions>::MmapAligned(
 
 template <typename Topology, size_t NormalPartitions>
 void* SystemAllocator<Topology, NormalPartitions>::MmapAlignedLocked(
-    size_t size, size_t alignment, const MemoryTag tag) {
+    size_t size, size_t alignment, const MemoryTag tag,
+    size_t size_class_region) {
   using system_allocator_internal::MapFixedNoReplaceFlagAvailable;
+  using system_allocator_internal::RoundUp;
 
   TC_ASSERT_LE(size, kTagMask);
   TC_ASSERT_LE(alignment, kTagMask);
@@ -528,6 +929,19 @@ void* SystemAllocator<Topology, NormalPartitions>::MmapAlignedLocked(
           case MemoryTag::kNormalP1:
             numa_partition = topology_.numa_aware() ? 1 : 0;
             return &next_normal_addr_[1];
+          case MemoryTag::kNormalP2:
+          case MemoryTag::kNormalP3:
+          case MemoryTag::kNormalP4:
+          case MemoryTag::kNormalP5:
+          case MemoryTag::kNormalP6:
+          case MemoryTag::kNormalP7:
+            // Security partitions beyond the second are never NUMA aware.
+            numa_partition = 0;
+            TC_ASSERT_LT(NormalTagPartition(tag), kNumPartitions);
+            return &next_normal_addr_[NormalTagPartition(tag)];
+          case MemoryTag::kSizeClassed:
+            numa_partition = 0;
+            return &next_size_classed_addr_[size_class_region];
           case MemoryTag::kCold:
             return &next_cold_addr_;
           case MemoryTag::kMetadata:
@@ -538,11 +952,24 @@ void* SystemAllocator<Topology, NormalPartitions>::MmapAlignedLocked(
         __builtin_unreachable();
       }();
 
+  auto in_region = [&](uintptr_t addr) {
+    const void* ptr = reinterpret_cast<const void*>(addr);
+    return GetMemoryTag(ptr) == tag &&
+           (tag != MemoryTag::kSizeClassed ||
+            SizeClassFromRegion(ptr) == size_class_region);
+  };
   bool first = !next_addr;
-  if (!next_addr || next_addr & (alignment - 1) ||
-      GetMemoryTag(reinterpret_cast<void*>(next_addr)) != tag ||
-      GetMemoryTag(reinterpret_cast<void*>(next_addr + size - 1)) != tag) {
-    next_addr = RandomMmapHint(size, alignment, tag);
+  // Each tag's reservations are kept in a compact window, so that the pagemap
+  // needs few leaves to cover them: a misaligned next_addr is rounded up
+  // rather than replaced by a random address.
+  if (next_addr) {
+    next_addr = RoundUp(next_addr, alignment);
+  }
+  if (!next_addr || !in_region(next_addr) || !in_region(next_addr + size - 1)) {
+    if (!first) {
+      scattered_reservations_.fetch_add(1, std::memory_order_relaxed);
+    }
+    next_addr = RandomMmapHint(size, alignment, tag, size_class_region);
   }
   const int map_fixed_noreplace_flag = MapFixedNoReplaceFlagAvailable();
   void* hint;
@@ -552,7 +979,7 @@ void* SystemAllocator<Topology, NormalPartitions>::MmapAlignedLocked(
   ErrnoRestorer errno_restorer;
   for (int i = 0; i < 1000; ++i) {
     hint = reinterpret_cast<void*>(next_addr);
-    TC_ASSERT_EQ(GetMemoryTag(hint), tag);
+    TC_ASSERT(in_region(next_addr));
     int flags = MAP_PRIVATE | MAP_ANONYMOUS | map_fixed_noreplace_flag;
 
     void* result = mmap(hint, size, PROT_NONE, flags, -1, 0);
@@ -592,7 +1019,17 @@ void* SystemAllocator<Topology, NormalPartitions>::MmapAlignedLocked(
         TC_ASSERT_EQ(err, 0);
       }
     }
-    next_addr = RandomMmapHint(size, alignment, tag);
+    // Something else is mapped within the range we asked for.  We do not know
+    // where that mapping ends, so try the next aligned range of the same size
+    // a few times before giving up on the window.
+    const uintptr_t probe = RoundUp(next_addr + size, alignment);
+    if (i < kCompactProbes && probe > next_addr && in_region(probe) &&
+        in_region(probe + size - 1)) {
+      next_addr = probe;
+      continue;
+    }
+    scattered_reservations_.fetch_add(1, std::memory_order_relaxed);
+    next_addr = RandomMmapHint(size, alignment, tag, size_class_region);
   }
 
   TC_LOG(
@@ -612,8 +1049,21 @@ void* SystemAllocator<Topology, NormalPartitions>::MmapAlignedLocked(
 
 template <typename Topology, size_t NormalPartitions>
 MemoryModifyStatus SystemAllocator<Topology, NormalPartitions>::Release(
-    void* start, size_t length) {
+    void* start, size_t length, ReleaseHint hint) {
   bool result = false;
+  bool lazy = hint == ReleaseHint::kReusedSoon &&
+              madvise_preference() == MadvisePreference::kAdaptive &&
+              !memory_pressure();
+
+  {
+    const uintptr_t s = reinterpret_cast<uintptr_t>(start);
+    if (OverlapsGigantic(s, s + length)) {
+      return {false, EINVAL};
+    }
+  }
+  if (lazy || madvise_preference() == MadvisePreference::kFreeOnly) {
+    released_without_zeroing_.store(true, std::memory_order_relaxed);
+  }
 
 #if defined(MADV_DONTNEED) || defined(MADV_REMOVE)
   ErrnoRestorer errno_restorer;
@@ -637,14 +1087,20 @@ MemoryModifyStatus SystemAllocator<Topology, NormalPartitions>::Release(
     void* new_ptr = reinterpret_cast<void*>(new_start);
     size_t new_length = new_end - new_start;
 
-    if (!ReleasePages(new_ptr, new_length)) {
+    // Under mlockall(), madvise() fails on the locked pages, so we unlock
+    // them up front rather than after a failed attempt.
+    const bool locked = mlockall_mode();
+    if (locked) {
+      mlocked_releases_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (locked || !ReleasePages(new_ptr, new_length, lazy)) {
       // Try unlocking.
       int ret;
       do {
         ret = munlock(reinterpret_cast<char*>(new_start), new_end - new_start);
       } while (ret == -1 && errno == EAGAIN);
 
-      if (ret != 0 || !ReleasePages(new_ptr, new_length)) {
+      if (ret != 0 || !ReleasePages(new_ptr, new_length, lazy)) {
         // If we fail to munlock *or* fail our second attempt at madvise,
         // increment our failure count.
         release_errors_.fetch_add(1, std::memory_order_relaxed);
@@ -657,7 +1113,133 @@ MemoryModifyStatus SystemAllocator<Topology, NormalPartitions>::Release(
   }
 #endif
 
-  return {result, errno};
+  return {.success = result,
+          .error_number = errno,
+          .lazily_freed = result && lazy};
+}
+
+template <typename Topology, size_t NormalPartitions>
+size_t SystemAllocator<Topology, NormalPartitions>::ReleaseBatch(
+    absl::Span<const AddressRange> ranges) {
+  // Locked pages fail the batched calls, which would also mistake the failure
+  // for a lack of kernel support, so they are left to Release() to unlock.
+  size_t released = mlockall_mode() ? 0 : ProcessMadviseRelease(ranges);
+  // Release whatever the batched calls did not cover one range at a time.  This
+  // also takes care of retrying failed ranges after munlock().
+  for (; released < ranges.size(); ++released) {
+    if (!Release(ranges[released].ptr, ranges[released].bytes).success) break;
+  }
+  return released;
+}
+
+template <typename Topology, size_t NormalPartitions>
+bool SystemAllocator<Topology, NormalPartitions>::ProbeMlockall() {
+#ifdef __linux__
+  ErrnoRestorer errno_restorer;
+  const size_t page_size = GetPageSize();
+  void* probe = mmap(nullptr, page_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (probe == MAP_FAILED) return false;
+  unsigned char resident = 0;
+  const bool locked =
+      mincore(probe, page_size, &resident) == 0 && (resident & 1) != 0;
+  munmap(probe, page_size);
+  return locked;
+#else
+  return false;
+#endif
+}
+
+template <typename Topology, size_t NormalPartitions>
+bool SystemAllocator<Topology, NormalPartitions>::DetectMlockall() {
+  bool unlock_vmas;
+  {
+    AllocationGuardSpinLockHolder lock_holder(spinlock_);
+    unlock_vmas = unlock_vmas_;
+  }
+  const bool locked = !unlock_vmas && ProbeMlockall();
+  mlockall_.store(locked, std::memory_order_relaxed);
+  return locked;
+}
+
+template <typename Topology, size_t NormalPartitions>
+size_t SystemAllocator<Topology, NormalPartitions>::ProcessMadviseRelease(
+    absl::Span<const AddressRange> ranges) {
+#ifdef __linux__
+  if (ranges.size() < 2 ||
+      process_madvise_unsupported_.load(std::memory_order_relaxed)) {
+    return 0;
+  }
+
+  int advice;
+  switch (madvise_preference()) {
+    case MadvisePreference::kDontNeed:
+    case MadvisePreference::kAdaptive:
+      advice = MADV_DONTNEED;
+      break;
+    case MadvisePreference::kFreeOnly:
+      advice = MADV_FREE;
+      released_without_zeroing_.store(true, std::memory_order_relaxed);
+      break;
+    case MadvisePreference::kFreeAndDontNeed:
+    case MadvisePreference::kNever:
+      return 0;
+  }
+
+  // Memory from a custom AddressRegionFactory may be shared, in which case
+  // Release issues MADV_REMOVE first.
+  if (GetRegionFactory() != &mmap_factory_) return 0;
+
+  ErrnoRestorer errno_restorer;
+  const uintptr_t mask = GetPageSize() - 1;
+  constexpr size_t kMaxIovecs = 64;
+  size_t released = 0;
+  while (released < ranges.size()) {
+    const size_t n = std::min(ranges.size() - released, kMaxIovecs);
+    struct iovec iov[kMaxIovecs];
+    size_t total = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const AddressRange& r = ranges[released + i];
+      const uintptr_t s = reinterpret_cast<uintptr_t>(r.ptr);
+      // Leave the ranges Release treats specially to it.
+      if ((s & mask) != 0 || (r.bytes & mask) != 0 || r.bytes == 0 ||
+          OverlapsGigantic(s, s + r.bytes)) {
+        return released;
+      }
+      iov[i] = {.iov_base = r.ptr, .iov_len = r.bytes};
+      total += r.bytes;
+    }
+
+    ssize_t ret;
+    do {
+      ret = syscall(__NR_process_madvise, PIDFD_SELF_THREAD_GROUP, iov, n,
+                    advice, 0);
+    } while (ret == -1 && errno == EAGAIN);
+    if (ret == -1) {
+      // Older kernels either lack process_madvise, or PIDFD_SELF, or only
+      // support a few advice values with it.
+      if (errno == ENOSYS || errno == EBADF || errno == EINVAL ||
+          errno == EPERM) {
+        process_madvise_unsupported_.store(true, std::memory_order_relaxed);
+      }
+      return released;
+    }
+
+    // A partial result means we hit an error on the first range that was not
+    // fully advised.
+    size_t advised = ret;
+    size_t i = 0;
+    while (i < n && advised >= iov[i].iov_len) {
+      advised -= iov[i].iov_len;
+      ++i;
+    }
+    released += i;
+    if (static_cast<size_t>(ret) != total) return released;
+  }
+  return released;
+#else
+  return 0;
+#endif
 }
 
 template <typename Topology, size_t NormalPartitions>
@@ -671,6 +1253,84 @@ MemoryModifyStatus SystemAllocator<Topology, NormalPartitions>::Collapse(
     ret = madvise(start, length, MADV_COLLAPSE);
     ++attempts;
   } while (ret == -1 && errno == EAGAIN && attempts < kMaxAttempts);
+  TCMALLOC_PROBE(collapse, start, length, ret == 0);
+  return {ret == 0, errno};
+}
+
+template <typename Topology, size_t NormalPartitions>
+MemoryModifyStatus SystemAllocator<Topology, NormalPartitions>::PageOut(
+    void* start, size_t length, bool reclaim) {
+  ErrnoRestorer errno_restorer;
+  const int ret = madvise(start, length, reclaim ? MADV_PAGEOUT : MADV_COLD);
+  return {ret == 0, errno};
+}
+
+template <typename Topology, size_t NormalPartitions>
+MemoryModifyStatus SystemAllocator<Topology, NormalPartitions>::Move(
+    void* from, void* to, size_t length) {
+  TC_ASSERT_EQ(reinterpret_cast<uintptr_t>(from) % kHugePageSize, 0);
+  TC_ASSERT_EQ(reinterpret_cast<uintptr_t>(to) % kHugePageSize, 0);
+  TC_ASSERT_EQ(GetMemoryTag(from), GetMemoryTag(to));
+  {
+    const uintptr_t f = reinterpret_cast<uintptr_t>(from);
+    const uintptr_t t = reinterpret_cast<uintptr_t>(to);
+    if (OverlapsGigantic(f, f + length) || OverlapsGigantic(t, t + length)) {
+      return {false, EINVAL};
+    }
+  }
+  {
+    // A custom factory need not hand out private anonymous memory, which is
+    // all that older kernels can remap with MREMAP_DONTUNMAP.
+    AllocationGuardSpinLockHolder lock_holder(spinlock_);
+    if (region_factory_ != &mmap_factory_) return {false, EINVAL};
+  }
+
+  // MREMAP_DONTUNMAP leaves <from> in place, so that no other mapping can claim
+  // the address range before we hand it back to the HugeAllocator.  <to> is
+  // replaced atomically.
+  ErrnoRestorer errno_restorer;
+  void* result =
+      mremap(from, length, length,
+             MREMAP_MAYMOVE | MREMAP_FIXED | MREMAP_DONTUNMAP, to);
+  return {result == to, errno};
+}
+
+template <typename Topology, size_t NormalPartitions>
+MemoryModifyStatus SystemAllocator<Topology, NormalPartitions>::SetMemoryTier(
+    void* start, size_t length, std::optional<int> far_node) {
+  int mode;
+  uint64_t nodemask = 0;
+  std::optional<size_t> partition;
+  switch (GetMemoryTag(start)) {
+    case MemoryTag::kNormalP0:
+    case MemoryTag::kSizeClassed:
+      partition = 0;
+      break;
+    case MemoryTag::kNormalP1:
+      partition = topology_.numa_aware() ? 1 : 0;
+      break;
+    default:
+      break;
+  }
+  if (far_node.has_value()) {
+    TC_ASSERT_GE(*far_node, 0);
+    TC_ASSERT_LT(*far_node, 64);
+    mode = MPOL_BIND;
+    nodemask = uint64_t{1} << *far_node;
+  } else if (partition.has_value() && topology_.numa_aware() &&
+             topology_.bind_mode() != NumaBindMode::kNone) {
+    // Mirror BindMemory.
+    mode = MPOL_BIND | MPOL_F_STATIC_NODES;
+    nodemask = topology_.GetPartitionNodes(*partition);
+  } else {
+    // An empty nodemask requests local allocation, which is what memory that
+    // was never bound gets.
+    mode = MPOL_PREFERRED;
+  }
+
+  ErrnoRestorer errno_restorer;
+  const int ret = syscall(__NR_mbind, start, length, mode, &nodemask,
+                          sizeof(nodemask) * 8, MPOL_MF_MOVE);
   return {ret == 0, errno};
 }
 
@@ -736,6 +1396,7 @@ SystemAllocator<Topology, NormalPartitions>::TagToHint(MemoryTag tag) const {
   using UsageHint = AddressRegionFactory::UsageHint;
   switch (tag) {
     case MemoryTag::kNormal:
+    case MemoryTag::kSizeClassed:
       if (topology_.numa_aware()) {
         return UsageHint::kNormalNumaAwareS0;
       }
@@ -745,6 +1406,13 @@ SystemAllocator<Topology, NormalPartitions>::TagToHint(MemoryTag tag) const {
         return UsageHint::kNormalNumaAwareS1;
       }
       return UsageHint::kNormal;
+    case MemoryTag::kNormalP2:
+    case MemoryTag::kNormalP3:
+    case MemoryTag::kNormalP4:
+    case MemoryTag::kNormalP5:
+    case MemoryTag::kNormalP6:
+    case MemoryTag::kNormalP7:
+      return UsageHint::kNormal;
     case MemoryTag::kSampled:
     case MemoryTag::kSampledP1:
       return UsageHint::kInfrequentAllocation;
@@ -760,7 +1428,8 @@ SystemAllocator<Topology, NormalPartitions>::TagToHint(MemoryTag tag) const {
 
 template <typename Topology, size_t NormalPartitions>
 uintptr_t SystemAllocator<Topology, NormalPartitions>::RandomMmapHint(
-    size_t size, size_t alignment, const MemoryTag tag) {
+    size_t size, size_t alignment, const MemoryTag tag,
+    size_t size_class_region) {
   // Rely on kernel's mmap randomization to seed our RNG.
   absl::base_internal::LowLevelCallOnce(
       &rnd_flag_, [&]() GOOGLE_MALLOC_SECTION {
@@ -769,6 +1438,8 @@ uintptr_t SystemAllocator<Topology, NormalPartitions>::RandomMmapHint(
         // TCMalloc-managed memory to be mlocked.
         const char* e = thread_safe_getenv("TCMALLOC_MLOCKALL_UNLOCK_FUTURE");
         unlock_vmas_ = absl::NullSafeStringView(e) == "1";
+        mlockall_.store(!unlock_vmas_ && ProbeMlockall(),
+                        std::memory_order_relaxed);
 
         const size_t page_size = GetPageSize();
         void* seed = mmap(nullptr, page_size, PROT_NONE,
@@ -780,6 +1451,14 @@ uintptr_t SystemAllocator<Topology, NormalPartitions>::RandomMmapHint(
         munmap(seed, page_size);
         spinlock_.AssertHeld();
         rnd_ = reinterpret_cast<uintptr_t>(seed);
+
+        // `TCMALLOC_DETERMINISTIC` asks for reproducible runs, so that hints
+        // do not depend on where the kernel placed the seed mapping.
+        const absl::string_view deterministic = absl::NullSafeStringView(
+            thread_safe_getenv("TCMALLOC_DETERMINISTIC"));
+        if (deterministic == "1" || deterministic == "true") {
+          rnd_ = uintptr_t{0x5eed} << 32;
+        }
       });
 
 #if !defined(ABSL_HAVE_MEMORY_SANITIZER) && !defined(ABSL_HAVE_THREAD_SANITIZER)
@@ -803,9 +1482,19 @@ uintptr_t SystemAllocator<Topology, NormalPartitions>::RandomMmapHint(
   // tag.
   alignment = absl::bit_ceil(std::max(alignment, size));
 
+  // kSizeClassed memory additionally fixes the size class region bits.
+  const uintptr_t fixed_mask =
+      tag == MemoryTag::kSizeClassed ? kTagMask | kSizeClassRegionMask
+                                     : kTagMask;
+  const uintptr_t fixed_bits =
+      (static_cast<uintptr_t>(tag) << kTagShift) |
+      (tag == MemoryTag::kSizeClassed
+           ? static_cast<uintptr_t>(size_class_region) << kSizeClassRegionShift
+           : 0);
+
   rnd_ = ExponentialBiased::NextRandom(rnd_);
-  uintptr_t addr = rnd_ & kAddrMask & ~(alignment - 1) & ~kTagMask;
-  addr |= static_cast<uintptr_t>(tag) << kTagShift;
+  uintptr_t addr = rnd_ & kAddrMask & ~(alignment - 1) & ~fixed_mask;
+  addr |= fixed_bits;
 
 #if defined(ABSL_HAVE_THREAD_SANITIZER)
 #if defined(__x86_64__)
@@ -839,8 +1528,8 @@ uintptr_t SystemAllocator<Topology, NormalPartitions>::RandomMmapHint(
 
   for (int i = 0; i < 10 && !reserved_for_app(addr); ++i) {
     rnd_ = ExponentialBiased::NextRandom(rnd_);
-    addr = rnd_ & kHiAppMask & ~(alignment - 1) & ~kTagMask;
-    addr |= static_cast<uintptr_t>(tag) << kTagShift;
+    addr = rnd_ & kHiAppMask & ~(alignment - 1) & ~fixed_mask;
+    addr |= fixed_bits;
   }
 #endif
 
@@ -850,7 +1539,7 @@ uintptr_t SystemAllocator<Topology, NormalPartitions>::RandomMmapHint(
 
 template <typename Topology, size_t NormalPartitions>
 inline bool SystemAllocator<Topology, NormalPartitions>::ReleasePages(
-    void* start, size_t length) const {
+    void* start, size_t length, bool& lazy) const {
   // TODO(b/424551232): madvise rounds up length to the multiple of page size.
   // If TCMalloc's page size is lower than the system's page size, madvise may
   // corrupt the in-use memory. Check that the requested size and start address
@@ -875,11 +1564,23 @@ inline bool SystemAllocator<Topology, NormalPartitions>::ReleasePages(
   } while (ret == -1 && errno == EAGAIN);
 
   if (ret == 0) {
+    lazy = false;
     return true;
   }
 #endif
 
 #ifdef MADV_FREE
+  if (lazy) {
+    do {
+      ret = madvise(start, length, MADV_FREE);
+    } while (ret == -1 && errno == EAGAIN);
+    if (ret == 0) {
+      return true;
+    }
+    // Kernels without MADV_FREE fall back to MADV_DONTNEED below.
+    lazy = false;
+  }
+
   const bool do_madvfree = [&]() {
     switch (madvise_preference()) {
       case MadvisePreference::kFreeAndDontNeed:
@@ -887,6 +1588,7 @@ inline bool SystemAllocator<Topology, NormalPartitions>::ReleasePages(
         return true;
       case MadvisePreference::kDontNeed:
       case MadvisePreference::kNever:
+      case MadvisePreference::kAdaptive:
         return false;
     }
 
@@ -898,12 +1600,15 @@ inline bool SystemAllocator<Topology, NormalPartitions>::ReleasePages(
       ret = madvise(start, length, MADV_FREE);
     } while (ret == -1 && errno == EAGAIN);
   }
+#else
+  lazy = false;
 #endif
 #ifdef MADV_DONTNEED
   const bool do_madvdontneed = [&]() {
     switch (madvise_preference()) {
       case MadvisePreference::kDontNeed:
       case MadvisePreference::kFreeAndDontNeed:
+      case MadvisePreference::kAdaptive:
         return true;
       case MadvisePreference::kFreeOnly:
       case MadvisePreference::kNever:
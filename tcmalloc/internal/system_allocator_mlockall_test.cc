@@ -109,6 +109,42 @@ TEST_P(SystemAllocatorMlockallTest, Mlockall) {
   ASSERT_EQ(unsetenv("TCMALLOC_MLOCKALL_UNLOCK_FUTURE"), 0);
 }
 
+TEST_P(SystemAllocatorMlockallTest, MlockallMode) {
+#if ABSL_HAVE_ADDRESS_SANITIZER || ABSL_HAVE_MEMORY_SANITIZER || \
+    ABSL_HAVE_THREAD_SANITIZER
+  GTEST_SKIP() << "Skipped under sanitizers.";
+#endif
+
+  if (GetParam().mlockall_unlock_future) {
+    ASSERT_EQ(setenv("TCMALLOC_MLOCKALL_UNLOCK_FUTURE",
+                     GetParam().mlockall_unlock_future, 1),
+              0);
+  } else {
+    ASSERT_EQ(unsetenv("TCMALLOC_MLOCKALL_UNLOCK_FUTURE"), 0);
+  }
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    GTEST_SKIP() << "Failed to mlockall, errno=" << errno;
+  }
+
+  NumaTopology<2> topology;
+  SystemAllocator<NumaTopology<2>, 1> allocator(topology, 4 << 20);
+
+  AddressRange result = allocator.Allocate(1024, 1, MemoryTag::kNormal);
+  ASSERT_NE(result.ptr, nullptr);
+  EXPECT_EQ(allocator.mlockall_mode(), GetParam().expect_locked);
+
+  // Locked pages are unlocked up front, and released all the same.
+  ASSERT_TRUE(allocator.Release(result.ptr, result.bytes).success);
+  EXPECT_EQ(allocator.mlocked_releases(), GetParam().expect_locked ? 1 : 0);
+  EXPECT_EQ(allocator.release_errors(), 0);
+
+  ASSERT_EQ(munlockall(), 0);
+  EXPECT_FALSE(allocator.DetectMlockall());
+  EXPECT_FALSE(allocator.mlockall_mode());
+  ASSERT_EQ(unsetenv("TCMALLOC_MLOCKALL_UNLOCK_FUTURE"), 0);
+}
+
 INSTANTIATE_TEST_SUITE_P(SystemAllocatorMlockallTest,
                          SystemAllocatorMlockallTest,
                          ::testing::Values(MlockallParams{"0", true},
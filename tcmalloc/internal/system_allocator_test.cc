@@ -17,13 +17,16 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/prctl.h>
 
+#include <algorithm>
 #include <limits>
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "benchmark/benchmark.h"
 #include "gmock/gmock.h"
@@ -31,6 +34,7 @@
 #include "absl/base/attributes.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -118,6 +122,62 @@ TEST_F(MmapAlignedTest, LargeSizeSmallAlignment) {
   MmapAndCheck(uintptr_t{1} << kTagShift, 1 << 12);
 }
 
+TEST_F(MmapAlignedTest, Gigantic) {
+  EXPECT_EQ(allocator_.gigantic_bytes(), 0);
+  AddressRange r = allocator_.AllocateGigantic(1, MemoryTag::kNormal);
+  if (r.ptr == nullptr) {
+    GTEST_SKIP() << "No free 1 GiB hugetlbfs pages";
+  }
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(r.ptr) % kGiganticPageSize, 0);
+  EXPECT_EQ(r.bytes, kGiganticPageSize);
+  EXPECT_EQ(GetMemoryTag(r.ptr), MemoryTag::kNormal);
+  EXPECT_EQ(allocator_.gigantic_bytes(), kGiganticPageSize);
+
+  // The memory is usable, and is never handed back to the system.
+  static_cast<volatile char*>(r.ptr)[0] = 1;
+  EXPECT_FALSE(allocator_.Release(r.ptr, kHugePageSize).success);
+  EXPECT_FALSE(allocator_.Release(r.ptr, r.bytes).success);
+  EXPECT_EQ(allocator_.release_errors(), 0);
+  EXPECT_EQ(static_cast<volatile char*>(r.ptr)[0], 1);
+  EXPECT_EQ(munmap(r.ptr, r.bytes), 0);
+}
+
+TEST_F(MmapAlignedTest, SizeClassRegions) {
+  if (kMaxSizeClassRegions == 1) {
+    GTEST_SKIP() << "No size class regions in this address space";
+  }
+  for (size_t region : {size_t{1}, kMaxSizeClassRegions - 1}) {
+    SCOPED_TRACE(region);
+    AddressRange r = allocator_.Allocate(kHugePageSize, kHugePageSize,
+                                         MemoryTag::kSizeClassed, region);
+    ASSERT_NE(r.ptr, nullptr);
+    EXPECT_EQ(GetMemoryTag(r.ptr), MemoryTag::kSizeClassed);
+    EXPECT_TRUE(IsNormalMemory(r.ptr));
+    EXPECT_EQ(SizeClassFromRegion(r.ptr), region);
+    EXPECT_EQ(
+        SizeClassFromRegion(static_cast<char*>(r.ptr) + r.bytes - 1), region);
+  }
+}
+
+TEST_F(MmapAlignedTest, CommitsInBatches) {
+  // Consecutive allocations come from one reservation, and after the first,
+  // from memory that is already accessible.
+  std::vector<AddressRange> ranges;
+  for (int i = 0; i < 4; ++i) {
+    AddressRange r =
+        allocator_.Allocate(kHugePageSize, kHugePageSize, MemoryTag::kCold);
+    ASSERT_NE(r.ptr, nullptr);
+    memset(r.ptr, 1, r.bytes);
+    ranges.push_back(r);
+  }
+
+  char buffer[1024];
+  const size_t length =
+      allocator_.GetRegionFactory()->GetStats(absl::MakeSpan(buffer));
+  EXPECT_THAT(absl::string_view(buffer, std::min(length, sizeof(buffer))),
+              HasSubstr("in 1 reservations and 1 commits"));
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
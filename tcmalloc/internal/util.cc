@@ -123,6 +123,22 @@ ssize_t signal_safe_read(int fd, char* buf, size_t count, size_t* bytes_read) {
   return rc;
 }
 
+ssize_t signal_safe_pread(int fd, char* buf, size_t count, off_t offset) {
+  size_t total_bytes = 0;
+  while (total_bytes < count) {
+    const ssize_t rc = pread(fd, buf + total_bytes, count - total_bytes,
+                             offset + total_bytes);
+    if (rc > 0) {
+      total_bytes += rc;
+    } else if (rc == 0) {
+      break;  // EOF
+    } else if (errno != EINTR) {
+      return -1;
+    }
+  }
+  return total_bytes;
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
@@ -82,6 +82,12 @@ ssize_t signal_safe_write(int fd, const char* buf, size_t count,
 // read before any error.
 ssize_t signal_safe_read(int fd, char* buf, size_t count, size_t* bytes_read);
 
+// signal_safe_pread() - a wrapper for pread(2) which ignores signals
+// Reads `count` bytes at `offset` without moving the file offset, retrying
+// interrupted and short reads until they are all read or EOF is reached.
+//   returns number of bytes read, -1 on failure, error in errno
+ssize_t signal_safe_pread(int fd, char* buf, size_t count, off_t offset);
+
 // signal_safe_poll() - a wrapper for poll(2) which ignores signals
 // Semantics equivalent to poll(2):
 //   Returns number of structures with non-zero revent fields.
@@ -26,6 +26,7 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/time/time.h"
@@ -68,6 +69,14 @@ ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetRegionFactory(
 
 ABSL_ATTRIBUTE_WEAK const tcmalloc::tcmalloc_internal::ProfileBase*
 MallocExtension_Internal_SnapshotCurrent(tcmalloc::ProfileType type);
+ABSL_ATTRIBUTE_WEAK const tcmalloc::tcmalloc_internal::ProfileBase*
+MallocExtension_Internal_SnapshotHeapDelta(
+    std::vector<tcmalloc::MallocHook::AllocHandle>* live,
+    std::vector<tcmalloc::MallocHook::AllocHandle>* removed);
+
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SnapshotPeakHeaps(
+    absl::Time start, absl::Time end,
+    std::vector<const tcmalloc::tcmalloc_internal::ProfileBase*>* ret);
 
 ABSL_ATTRIBUTE_WEAK tcmalloc::tcmalloc_internal::AllocationProfilingTokenBase*
 MallocExtension_Internal_StartAllocationProfiling();
@@ -83,6 +92,8 @@ ABSL_ATTRIBUTE_WEAK bool MallocExtension_Internal_GetNumericProperty(
     const char* name_data, size_t name_size, size_t* value);
 ABSL_ATTRIBUTE_WEAK bool MallocExtension_Internal_GetPerCpuCachesActive();
 ABSL_ATTRIBUTE_WEAK int32_t MallocExtension_Internal_GetMaxPerCpuCacheSize();
+ABSL_ATTRIBUTE_WEAK int32_t
+MallocExtension_Internal_GetMaxPerCpuColdCacheSize();
 ABSL_ATTRIBUTE_WEAK bool
 MallocExtension_Internal_GetBackgroundProcessActionsEnabled();
 ABSL_ATTRIBUTE_WEAK void
@@ -97,9 +108,26 @@ ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetProperties(
     tcmalloc::MallocExtension::PropertyMap* ret);
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetExperiments(
     tcmalloc::MallocExtension::PropertyMap* ret);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetAllocationRateHistory(
+    std::vector<tcmalloc::MallocExtension::AllocationRateEpoch>* ret);
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetStats(std::string* ret);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetStatsSnapshot(
+    tcmalloc::MallocExtension::StatsSnapshot* ret);
+ABSL_ATTRIBUTE_WEAK size_t
+MallocExtension_Internal_GetStatsInOpenMetrics(char* buffer, size_t length);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetHotStats(
+    tcmalloc::MallocExtension::HotStats* ret);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetMemoryBreakdown(
+    tcmalloc::MallocExtension::MemoryBreakdown* ret);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_Defragment(
+    tcmalloc::MallocExtension::Relocator relocator, size_t budget,
+    tcmalloc::MallocExtension::DefragmentationStats* ret);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetPerCpuCapacityProfile(
+    std::string* ret);
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetMaxPerCpuCacheSize(
     int32_t value);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetMaxPerCpuColdCacheSize(
+    int32_t value);
 ABSL_ATTRIBUTE_WEAK void
 MallocExtension_Internal_SetBackgroundProcessActionsEnabled(bool value);
 ABSL_ATTRIBUTE_WEAK void
@@ -116,6 +144,16 @@ ABSL_ATTRIBUTE_WEAK size_t
 MallocExtension_Internal_ReleaseMemoryToSystem(size_t bytes);
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetMemoryLimit(
     size_t limit, tcmalloc::MallocExtension::LimitKind limit_kind);
+ABSL_ATTRIBUTE_WEAK bool MallocExtension_Internal_AddMemoryPressureCallback(
+    tcmalloc::MallocExtension::MemoryPressureCallback callback, void* arg,
+    double moderate_fraction, double critical_fraction);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_RemoveMemoryPressureCallback(
+    tcmalloc::MallocExtension::MemoryPressureCallback callback, void* arg);
+ABSL_ATTRIBUTE_WEAK void* MallocExtension_Internal_AllocatePinned(size_t size);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_FreePinned(void* ptr,
+                                                             size_t size);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetPinnedMemoryCallback(
+    tcmalloc::MallocExtension::PinnedMemoryCallback callback, void* arg);
 
 ABSL_ATTRIBUTE_WEAK size_t
 MallocExtension_Internal_GetAllocatedSize(const void* ptr);
@@ -123,6 +161,27 @@ ABSL_ATTRIBUTE_WEAK size_t
 MallocExtension_Internal_GetEstimatedAllocatedSize(size_t size);
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_MarkThreadBusy();
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_MarkThreadIdle();
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_MarkCpuParking(
+    absl::Duration expected);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetProtectedCpus(
+    const int* cpus, size_t num_cpus);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetProtectedCpus(
+    std::vector<int>* cpus);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetThreadAllocationBudget(
+    size_t bytes, tcmalloc::MallocExtension::AllocationBudgetCallback callback,
+    void* arg);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_ClearThreadAllocationBudget();
+ABSL_ATTRIBUTE_WEAK bool MallocExtension_Internal_GetThreadAllocatedBytes(
+    size_t* bytes);
+ABSL_ATTRIBUTE_WEAK uint32_t MallocExtension_Internal_SetCurrentTenant(
+    uint32_t tenant);
+ABSL_ATTRIBUTE_WEAK uint32_t MallocExtension_Internal_GetCurrentTenant();
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetTenantLimit(
+    uint32_t tenant, size_t bytes);
+ABSL_ATTRIBUTE_WEAK bool MallocExtension_Internal_IsTenantOverLimit(
+    uint32_t tenant);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetTenantStats(
+    std::vector<tcmalloc::MallocExtension::TenantStats>* stats);
 
 ABSL_ATTRIBUTE_WEAK int64_t
 MallocExtension_Internal_GetProfileSamplingInterval();
@@ -130,6 +189,10 @@ ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetProfileSamplingInterval(
     int64_t);
 
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_ProcessBackgroundActions();
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_RunBackgroundStep(
+    absl::Duration budget, absl::Time* next_wake);
+ABSL_ATTRIBUTE_WEAK void
+MallocExtension_Internal_ProcessBackgroundReleaseWorker();
 
 ABSL_ATTRIBUTE_WEAK tcmalloc::MallocExtension::BytesPerSecond
 MallocExtension_Internal_GetBackgroundReleaseRate();
@@ -145,6 +208,51 @@ ABSL_ATTRIBUTE_WEAK int64_t
 MallocExtension_Internal_GetMaxTotalThreadCacheBytes();
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetMaxTotalThreadCacheBytes(
     int64_t value);
+
+ABSL_ATTRIBUTE_WEAK size_t MallocExtension_Internal_AllocateBatch(size_t size,
+                                                                  void** out,
+                                                                  size_t n);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_DeallocateBatch(void** ptrs,
+                                                                  size_t n,
+                                                                  size_t size);
+ABSL_ATTRIBUTE_WEAK size_t MallocExtension_Internal_GoodSize(
+    size_t min_size, size_t growth_hint);
+
+// `*region` is null until the first allocation creates the region.
+ABSL_ATTRIBUTE_WEAK void* MallocExtension_Internal_RegionAllocate(
+    void** region, size_t size, size_t alignment);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_RegionReset(void* region);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_RegionDestroy(void* region);
+
+// Returns a tcmalloc::PersistentRegion::AttachResult.
+ABSL_ATTRIBUTE_WEAK int MallocExtension_Internal_PersistentRegionAttach(
+    const char* path, void* address, size_t size, void** region);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_PersistentRegionDetach(
+    void* region);
+ABSL_ATTRIBUTE_WEAK void* MallocExtension_Internal_PersistentRegionAllocate(
+    void* region, size_t size, size_t alignment);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_PersistentRegionDeallocate(
+    void* region, void* ptr, size_t size, size_t alignment);
+ABSL_ATTRIBUTE_WEAK void* MallocExtension_Internal_PersistentRegionRoot(
+    void* region);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_PersistentRegionSetRoot(
+    void* region, void* root);
+
+// Returns nullptr on failure.
+ABSL_ATTRIBUTE_WEAK void* MallocExtension_Internal_SharedRegionAttach(
+    int fd, void* address, size_t size);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SharedRegionDetach(
+    void* region);
+ABSL_ATTRIBUTE_WEAK void* MallocExtension_Internal_SharedRegionAllocate(
+    void* region, size_t size, size_t alignment);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SharedRegionDeallocate(
+    void* region, void* ptr, size_t size, size_t alignment);
+
+ABSL_ATTRIBUTE_WEAK bool MallocExtension_Internal_ReserveSignalSafeMemory(
+    size_t bytes);
+ABSL_ATTRIBUTE_WEAK void* MallocExtension_Internal_SignalSafeAllocate(
+    size_t size);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SignalSafeFree(void* ptr);
 }
 
 #endif
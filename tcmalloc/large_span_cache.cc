@@ -0,0 +1,127 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/large_span_cache.h"
+
+#include <stddef.h>
+
+#include "absl/base/optimization.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/cache_topology.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/internal/percpu.h"
+#include "tcmalloc/page_allocator.h"
+#include "tcmalloc/page_allocator_interface.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+size_t CurrentLargeSpanCacheShard() {
+  const int cpu = subtle::percpu::GetRealCpu();
+  if (ABSL_PREDICT_FALSE(cpu < 0)) {
+    return 0;
+  }
+  const CacheTopology& topology = CacheTopology::Instance();
+  const unsigned l3_count = topology.l3_count();
+  if (l3_count > 1) {
+    return topology.GetL3FromCpuId(cpu);
+  }
+  // With a single L3 cache, a single shard would merely trade pageheap_lock
+  // for another global lock.  Give groups of neighbouring cpus a shard each
+  // instead, which still lets threads that migrate within a group hit.
+  constexpr int kCpusPerShard = 4;
+  return static_cast<size_t>(cpu / kCpusPerShard);
+}
+
+void ReturnLargeSpans(Span* const* spans, size_t n) {
+  if (n == 0) return;
+  // Only kNormal spans are cached.
+#ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
+  PageHeapSpinLockHolder l;
+  for (size_t i = 0; i < n; ++i) {
+    tc_globals.page_allocator().Delete(
+        spans[i], MemoryTag::kNormal,
+        {.objects_per_span = 1, .density = AccessDensityPrediction::kSparse});
+  }
+#else
+  PageAllocatorInterface::AllocationState
+      states[LargeSpanCache::kEntriesPerShard];
+  TC_ASSERT_LE(n, LargeSpanCache::kEntriesPerShard);
+  for (size_t i = 0; i < n; ++i) {
+    states[i] = {Range(spans[i]->first_page(), spans[i]->num_pages()),
+                 spans[i]->donated()};
+    Span::Delete(spans[i]);
+  }
+  PageHeapSpinLockHolder l;
+  for (size_t i = 0; i < n; ++i) {
+    tc_globals.page_allocator().Delete(
+        states[i], MemoryTag::kNormal,
+        {.objects_per_span = 1, .density = AccessDensityPrediction::kSparse});
+  }
+#endif  // TCMALLOC_INTERNAL_LEGACY_LOCKING
+}
+
+void DrainLargeSpanCache() {
+  LargeSpanCache& cache = tc_globals.large_span_cache();
+  Span* drained[LargeSpanCache::kEntriesPerShard];
+  for (size_t shard = 0; shard < LargeSpanCache::kNumShards; ++shard) {
+    ReturnLargeSpans(drained, cache.Drain(shard, drained));
+  }
+}
+
+void FlushLargeSpanCache() {
+  LargeSpanCache& cache = tc_globals.large_span_cache();
+  if (cache.bytes() == 0) return;
+  Span* drained[LargeSpanCache::kEntriesPerShard];
+  for (size_t shard = 0; shard < LargeSpanCache::kNumShards; ++shard) {
+    ReturnLargeSpans(drained, cache.Flush(shard, drained));
+  }
+}
+
+Length FlushLargeSpanCacheLocked() {
+  LargeSpanCache& cache = tc_globals.large_span_cache();
+  if (cache.bytes() == 0) return Length(0);
+  Length flushed;
+  Span* drained[LargeSpanCache::kEntriesPerShard];
+  for (size_t shard = 0; shard < LargeSpanCache::kNumShards; ++shard) {
+    const size_t n = cache.Flush(shard, drained);
+    for (size_t i = 0; i < n; ++i) {
+      flushed += drained[i]->num_pages();
+#ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
+      tc_globals.page_allocator().Delete(
+          drained[i], MemoryTag::kNormal,
+          {.objects_per_span = 1, .density = AccessDensityPrediction::kSparse});
+#else
+      const PageAllocatorInterface::AllocationState state{
+          Range(drained[i]->first_page(), drained[i]->num_pages()),
+          drained[i]->donated()};
+      Span::Delete(drained[i]);
+      tc_globals.page_allocator().Delete(
+          state, MemoryTag::kNormal,
+          {.objects_per_span = 1, .density = AccessDensityPrediction::kSparse});
+#endif  // TCMALLOC_INTERNAL_LEGACY_LOCKING
+    }
+  }
+  return flushed;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,229 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_LARGE_SPAN_CACHE_H_
+#define TCMALLOC_LARGE_SPAN_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "absl/base/attributes.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Caches the spans of recently freed page-level allocations of up to a
+// hugepage, so that allocations of the same number of pages can reuse them
+// without taking pageheap_lock.
+//
+// The cache is sharded, usually by L3 cache, and each shard holds up to
+// kEntriesPerShard spans and kMaxBytesPerShard bytes.  Spans stay allocated
+// from the page heap's point of view and keep their pagemap entries; a hit
+// requires the exact number of pages.  When a shard is full, its oldest spans
+// are evicted.  Shards that went unused between two calls to Drain are
+// emptied, so that idle caches give their memory back to the page heap.
+//
+// Evicted and drained spans are returned to the caller, which must return
+// them to the page heap.
+class LargeSpanCache {
+ public:
+  static constexpr size_t kNumShards = 64;
+  static constexpr size_t kEntriesPerShard = 8;
+  static constexpr size_t kMaxBytesPerShard = size_t{4} << 20;
+  static constexpr Length kMaxPages = kPagesPerHugePage;
+
+  constexpr LargeSpanCache() = default;
+  LargeSpanCache(const LargeSpanCache&) = delete;
+  LargeSpanCache& operator=(const LargeSpanCache&) = delete;
+
+  static bool Cacheable(Length n) { return n <= kMaxPages; }
+
+  // Returns a cached span of exactly n pages from shard, or nullptr.
+  Span* Get(size_t shard, Length n) {
+    Shard& s = shards_[shard % kNumShards];
+    Span* span = nullptr;
+    {
+      AllocationGuardSpinLockHolder l(s.lock);
+      s.used = true;
+      // Newest first, as it is the most likely to be in the cache.
+      for (size_t i = s.count; i-- > 0;) {
+        if (s.spans[i]->num_pages() == n) {
+          span = s.spans[i];
+          Remove(s, i);
+          break;
+        }
+      }
+    }
+    if (span == nullptr) {
+      misses_.LossyAdd(1);
+      return nullptr;
+    }
+    hits_.LossyAdd(1);
+    return span;
+  }
+
+  // Caches span in shard.  Returns the number of spans evicted to make room,
+  // which are stored in evicted, or -1 if span is already cached, in any
+  // shard, i.e. if it was freed twice.
+  //
+  // REQUIRES: Cacheable(span->num_pages())
+  int Put(size_t shard, Span* span, Span* evicted[kEntriesPerShard]) {
+    TC_ASSERT(Cacheable(span->num_pages()));
+    Shard& s = shards_[shard % kNumShards];
+    const size_t bytes = span->bytes_in_span();
+    int num_evicted = 0;
+    {
+      AllocationGuardSpinLockHolder l(s.lock);
+      if (ABSL_PREDICT_FALSE(span->in_large_span_cache())) return -1;
+      s.used = true;
+      while (s.count == kEntriesPerShard ||
+             (s.count > 0 && s.bytes + bytes > kMaxBytesPerShard)) {
+        evicted[num_evicted++] = s.spans[0];
+        Remove(s, 0);
+      }
+      span->set_in_large_span_cache(true);
+      s.spans[s.count++] = span;
+      s.bytes += bytes;
+      bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    evictions_.LossyAdd(num_evicted);
+    return num_evicted;
+  }
+
+  // Empties shard if it went unused since the previous call, storing its
+  // spans in drained.  Returns the number of spans drained.
+  size_t Drain(size_t shard, Span* drained[kEntriesPerShard]) {
+    Shard& s = shards_[shard % kNumShards];
+    size_t n = 0;
+    {
+      AllocationGuardSpinLockHolder l(s.lock);
+      if (s.used) {
+        s.used = false;
+        return 0;
+      }
+      n = Empty(s, drained);
+    }
+    drains_.LossyAdd(n);
+    return n;
+  }
+
+  // As Drain, but empties shard even if it was used.
+  size_t Flush(size_t shard, Span* drained[kEntriesPerShard]) {
+    Shard& s = shards_[shard % kNumShards];
+    size_t n;
+    {
+      AllocationGuardSpinLockHolder l(s.lock);
+      n = Empty(s, drained);
+    }
+    drains_.LossyAdd(n);
+    return n;
+  }
+
+  // Bytes in cached spans.
+  size_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+  void Print(Printer& out) const {
+    out.printf(
+        "Large span cache: %zu bytes cached; %lld hits, %lld misses, %lld "
+        "evictions, %lld drained\n",
+        bytes(), hits_.value(), misses_.value(), evictions_.value(),
+        drains_.value());
+  }
+
+  void PrintInPbtxt(PbtxtRegion& region) const {
+    region.PrintI64("bytes", bytes());
+    region.PrintI64("hits", hits_.value());
+    region.PrintI64("misses", misses_.value());
+    region.PrintI64("evictions", evictions_.value());
+    region.PrintI64("drained", drains_.value());
+  }
+
+ private:
+  struct ABSL_CACHELINE_ALIGNED Shard {
+    absl::base_internal::SpinLock lock{
+        absl::base_internal::SCHEDULE_KERNEL_ONLY};
+    // Cached spans, oldest first.
+    size_t count ABSL_GUARDED_BY(lock) = 0;
+    size_t bytes ABSL_GUARDED_BY(lock) = 0;
+    bool used ABSL_GUARDED_BY(lock) = false;
+    Span* spans[kEntriesPerShard] ABSL_GUARDED_BY(lock) = {};
+  };
+
+  void Remove(Shard& s, size_t i) ABSL_EXCLUSIVE_LOCKS_REQUIRED(s.lock) {
+    const size_t bytes = s.spans[i]->bytes_in_span();
+    s.spans[i]->set_in_large_span_cache(false);
+    for (; i + 1 < s.count; ++i) {
+      s.spans[i] = s.spans[i + 1];
+    }
+    --s.count;
+    s.bytes -= bytes;
+    bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  size_t Empty(Shard& s, Span* drained[kEntriesPerShard])
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(s.lock) {
+    size_t n = 0;
+    while (s.count > 0) {
+      drained[n++] = s.spans[0];
+      Remove(s, 0);
+    }
+    return n;
+  }
+
+  Shard shards_[kNumShards];
+  std::atomic<size_t> bytes_{0};
+  StatsCounter hits_;
+  StatsCounter misses_;
+  StatsCounter evictions_;
+  StatsCounter drains_;
+};
+
+// Returns the shard of tc_globals.large_span_cache() for the current CPU.
+size_t CurrentLargeSpanCacheShard();
+
+// Returns n spans taken out of tc_globals.large_span_cache() to the page heap,
+// under a single acquisition of pageheap_lock.
+void ReturnLargeSpans(Span* const* spans, size_t n);
+
+// Drains the shards of tc_globals.large_span_cache() that went unused since
+// the previous call.  Called by the background thread.
+void DrainLargeSpanCache();
+
+// Returns every span in tc_globals.large_span_cache() to the page heap, e.g.
+// when memory is released to the system or the cache is turned off.
+void FlushLargeSpanCache() ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+// As FlushLargeSpanCache, for the page heap's usage limits.  Returns the
+// number of pages returned.
+Length FlushLargeSpanCacheLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_LARGE_SPAN_CACHE_H_
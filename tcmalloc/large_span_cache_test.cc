@@ -0,0 +1,136 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/large_span_cache.h"
+
+#include <stddef.h>
+
+#include <deque>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+class LargeSpanCacheTest : public testing::Test {
+ protected:
+  Span* NewSpan(Length n) {
+    Span& span = spans_.emplace_back(Range(next_, n));
+    next_ += n;
+    return &span;
+  }
+
+  LargeSpanCache cache_;
+  Span* evicted_[LargeSpanCache::kEntriesPerShard];
+
+ private:
+  std::deque<Span> spans_;
+  PageId next_{1};
+};
+
+TEST_F(LargeSpanCacheTest, ExactSizeHits) {
+  const Length n = BytesToLengthCeil(512 << 10);
+  EXPECT_EQ(cache_.Get(0, n), nullptr);
+
+  Span* span = NewSpan(n);
+  EXPECT_EQ(cache_.Put(0, span, evicted_), 0);
+  EXPECT_EQ(cache_.bytes(), n.in_bytes());
+  // Other sizes and shards miss.
+  EXPECT_EQ(cache_.Get(0, n + Length(1)), nullptr);
+  EXPECT_EQ(cache_.Get(1, n), nullptr);
+  EXPECT_EQ(cache_.Get(0, n), span);
+  EXPECT_EQ(cache_.Get(0, n), nullptr);
+  EXPECT_EQ(cache_.bytes(), 0);
+}
+
+TEST_F(LargeSpanCacheTest, NewestFirst) {
+  const Length n = BytesToLengthCeil(512 << 10);
+  Span* a = NewSpan(n);
+  Span* b = NewSpan(n);
+  ASSERT_EQ(cache_.Put(0, a, evicted_), 0);
+  ASSERT_EQ(cache_.Put(0, b, evicted_), 0);
+  EXPECT_EQ(cache_.Get(0, n), b);
+  EXPECT_EQ(cache_.Get(0, n), a);
+}
+
+TEST_F(LargeSpanCacheTest, EvictsOldestWhenFull) {
+  const Length n = Length(1);
+  Span* spans[LargeSpanCache::kEntriesPerShard + 1];
+  for (Span*& span : spans) {
+    span = NewSpan(n);
+  }
+  for (size_t i = 0; i < LargeSpanCache::kEntriesPerShard; ++i) {
+    ASSERT_EQ(cache_.Put(0, spans[i], evicted_), 0);
+  }
+  ASSERT_EQ(cache_.Put(0, spans[LargeSpanCache::kEntriesPerShard], evicted_),
+            1);
+  EXPECT_EQ(evicted_[0], spans[0]);
+  EXPECT_EQ(cache_.bytes(), LargeSpanCache::kEntriesPerShard * n.in_bytes());
+}
+
+TEST_F(LargeSpanCacheTest, EvictsToStayUnderByteLimit) {
+  const Length big = LargeSpanCache::kMaxPages;
+  const size_t fit = LargeSpanCache::kMaxBytesPerShard / big.in_bytes();
+  ASSERT_GE(fit, 1);
+  ASSERT_LT(fit, LargeSpanCache::kEntriesPerShard);
+  for (size_t i = 0; i < fit; ++i) {
+    ASSERT_EQ(cache_.Put(0, NewSpan(big), evicted_), 0);
+  }
+  EXPECT_EQ(cache_.Put(0, NewSpan(big), evicted_), 1);
+  EXPECT_LE(cache_.bytes(), LargeSpanCache::kMaxBytesPerShard);
+}
+
+TEST_F(LargeSpanCacheTest, DetectsDoubleFree) {
+  Span* span = NewSpan(Length(4));
+  ASSERT_EQ(cache_.Put(0, span, evicted_), 0);
+  EXPECT_EQ(cache_.Put(0, span, evicted_), -1);
+  EXPECT_EQ(cache_.bytes(), Length(4).in_bytes());
+}
+
+TEST_F(LargeSpanCacheTest, DetectsDoubleFreeAcrossShards) {
+  Span* span = NewSpan(Length(4));
+  ASSERT_EQ(cache_.Put(0, span, evicted_), 0);
+  EXPECT_EQ(cache_.Put(1, span, evicted_), -1);
+  EXPECT_EQ(cache_.bytes(), Length(4).in_bytes());
+  // Once taken back out, the span may be cached again.
+  ASSERT_EQ(cache_.Get(0, Length(4)), span);
+  EXPECT_EQ(cache_.Put(1, span, evicted_), 0);
+}
+
+TEST_F(LargeSpanCacheTest, DrainsIdleShards) {
+  Span* span = NewSpan(Length(4));
+  ASSERT_EQ(cache_.Put(0, span, evicted_), 0);
+  // The shard was used since the last drain.
+  EXPECT_EQ(cache_.Drain(0, evicted_), 0);
+  EXPECT_EQ(cache_.Drain(0, evicted_), 1);
+  EXPECT_EQ(evicted_[0], span);
+  EXPECT_EQ(cache_.bytes(), 0);
+  EXPECT_EQ(cache_.Get(0, Length(4)), nullptr);
+}
+
+TEST_F(LargeSpanCacheTest, FlushEmptiesUsedShards) {
+  Span* span = NewSpan(Length(4));
+  ASSERT_EQ(cache_.Put(0, span, evicted_), 0);
+  EXPECT_EQ(cache_.Flush(0, evicted_), 1);
+  EXPECT_EQ(evicted_[0], span);
+  EXPECT_EQ(cache_.bytes(), 0);
+  EXPECT_EQ(cache_.Flush(0, evicted_), 0);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
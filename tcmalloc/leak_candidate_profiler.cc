@@ -0,0 +1,125 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/leak_candidate_profiler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+#include "absl/base/attributes.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/sampled_allocation.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/stack_depot.h"
+#include "tcmalloc/stack_trace_table.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+ABSL_CONST_INIT LeakCandidateProfiler leak_candidate_profiler;
+
+LeakCandidateProfiler::Candidate* LeakCandidateProfiler::FindOrInsert(
+    StackDepot::Id id) {
+  for (size_t i = Slot(id);; i = (i + 1) % kSlots) {
+    Candidate& c = candidates_[i];
+    if (c.used) {
+      if (c.stack_id == id) return &c;
+      continue;
+    }
+    if (num_candidates_ == kMaxStacks) return nullptr;
+    ++num_candidates_;
+    c.used = true;
+    c.stack_id = id;
+    c.count = 0;
+    c.sum = 0;
+    return &c;
+  }
+}
+
+int64_t LeakCandidateProfiler::PreviousSum(StackDepot::Id id) const {
+  for (size_t i = Slot(id); previous_[i].used; i = (i + 1) % kSlots) {
+    if (previous_[i].stack_id == id) return previous_[i].sum;
+  }
+  return 0;
+}
+
+std::unique_ptr<ProfileBase> LeakCandidateProfiler::DumpSample(
+    Static& state, absl::Duration min_age, absl::Time now) {
+  auto profile =
+      std::make_unique<StackTraceTable>(ProfileType::kLeakCandidates);
+  profile->SetStartTime(now);
+  const absl::Time cutoff = now - min_age;
+
+  AllocationGuardSpinLockHolder h(lock_);
+  for (Candidate& c : candidates_) {
+    c.used = false;
+  }
+  num_candidates_ = 0;
+
+  // Young objects, usually most of them, are skipped without being copied.
+  state.sampled_allocation_recorder().Iterate(
+      [&](const SampledAllocation& sampled_allocation) {
+        const StackTraceInfo& info = sampled_allocation.sampled_stack;
+        if (info.allocation_time > cutoff) return;
+        Candidate* c = FindOrInsert(sampled_allocation.stack_id);
+        if (c == nullptr) return;
+        if (c->count == 0 ||
+            info.allocation_time < c->oldest.allocation_time) {
+          c->oldest = info;
+        }
+        const int64_t count = StackTraceTable::SampleCount(1.0, info);
+        c->count += count;
+        c->sum += count * info.allocated_size;
+      });
+
+  const double seconds = previous_time_ == absl::InfinitePast()
+                             ? 0
+                             : absl::ToDoubleSeconds(now - previous_time_);
+  for (const Candidate& c : candidates_) {
+    if (!c.used) continue;
+    Profile::Sample sample;
+    StackTraceTable::FillSample(
+        1.0, state.stack_depot().Restore(c.oldest, c.stack_id), sample);
+    sample.count = c.count;
+    sample.sum = c.sum;
+    if (seconds > 0) {
+      sample.growth_rate = (c.sum - PreviousSum(c.stack_id)) / seconds;
+    }
+    profile->AddSample(sample);
+  }
+
+  // The totals of this profile are the baseline of the next one.
+  for (Previous& p : previous_) {
+    p.used = false;
+  }
+  for (const Candidate& c : candidates_) {
+    if (!c.used) continue;
+    size_t i = Slot(c.stack_id);
+    while (previous_[i].used) i = (i + 1) % kSlots;
+    previous_[i] = {true, c.stack_id, c.sum};
+  }
+  previous_time_ = now;
+  return profile;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
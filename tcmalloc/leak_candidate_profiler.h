@@ -0,0 +1,103 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_LEAK_CANDIDATE_PROFILER_H_
+#define TCMALLOC_LEAK_CANDIDATE_PROFILER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+#include "absl/base/attributes.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/stack_depot.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Builds ProfileType::kLeakCandidates profiles: the sampled objects older than
+// a minimum age, grouped by their stack in the stack depot.
+//
+// Objects are aggregated while iterating over the sampled allocation recorder,
+// into fixed tables, so that no sample is copied out unless it is old.  The
+// per-stack totals of the previous profile are kept to estimate how fast each
+// stack's old objects grow.  At most kMaxStacks stacks are reported; objects
+// of further stacks are dropped.
+class LeakCandidateProfiler {
+ public:
+  static constexpr size_t kMaxStacks = 256;
+
+  constexpr LeakCandidateProfiler()
+      : lock_(absl::base_internal::SCHEDULE_KERNEL_ONLY) {}
+
+  // Returns the sampled objects of `state` allocated at least `min_age` before
+  // `now`.
+  std::unique_ptr<ProfileBase> DumpSample(Static& state, absl::Duration min_age,
+                                          absl::Time now)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  // Open addressing tables, at most half full.
+  static constexpr size_t kSlots = 2 * kMaxStacks;
+
+  struct Candidate {
+    bool used;
+    StackDepot::Id stack_id;
+    int64_t count;
+    int64_t sum;
+    // The oldest object of the stack, which the sample reports.
+    StackTraceInfo oldest;
+  };
+
+  struct Previous {
+    bool used;
+    StackDepot::Id stack_id;
+    int64_t sum;
+  };
+
+  static size_t Slot(StackDepot::Id id) {
+    return static_cast<size_t>((id * uint64_t{0x9e3779b97f4a7c15}) >> 40) %
+           kSlots;
+  }
+
+  // Returns the slot for `id`, or nullptr if kMaxStacks stacks are already
+  // present.
+  Candidate* FindOrInsert(StackDepot::Id id)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  // Returns the sum of `id` in the previous profile, or 0 if it had none.
+  int64_t PreviousSum(StackDepot::Id id) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  absl::base_internal::SpinLock lock_;
+  size_t num_candidates_ ABSL_GUARDED_BY(lock_) = 0;
+  Candidate candidates_[kSlots] ABSL_GUARDED_BY(lock_) = {};
+  Previous previous_[kSlots] ABSL_GUARDED_BY(lock_) = {};
+  absl::Time previous_time_ ABSL_GUARDED_BY(lock_) = absl::InfinitePast();
+};
+
+ABSL_CONST_INIT extern LeakCandidateProfiler leak_candidate_profiler;
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_LEAK_CANDIDATE_PROFILER_H_
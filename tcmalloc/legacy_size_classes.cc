@@ -235,6 +235,97 @@ static constexpr SizeClassInfo List[] = {
   {229376,     229376,    2},  // 76         1   0.03%      0.03%   16.67%
   {262144,     262144,    2},  // 77         1   0.02%      0.03%   14.29%
 };
+#elif TCMALLOC_PAGE_SHIFT == 16
+static_assert(kMaxSize == 262144, "kMaxSize mismatch");
+static constexpr SizeClassAssumptions Assumptions{
+  .has_expanded_classes = true,
+  .span_size = 64,
+  .sampling_interval = 2097152,
+  .large_size = 1024,
+  .large_size_alignment = 128,
+};
+static constexpr SizeClassInfo List[] = {
+//                                             |      waste       |
+//  bytes  span_bytes batch    class      objs | fixed   sampling |    inc
+  {     0,          0,    0},  //  0         0   0.00%      0.00%    0.00%
+  {     8,      65536,   32},  //  1      8192   0.10%      3.15%    0.00%
+  {    16,      65536,   32},  //  2      4096   0.10%      3.15%  100.00%
+  {    24,      65536,   32},  //  3      2730   0.12%      3.15%   50.00%
+  {    32,      65536,   32},  //  4      2048   0.10%      3.15%   33.33%
+  {    40,      65536,   32},  //  5      1638   0.12%      3.15%   25.00%
+  {    48,      65536,   32},  //  6      1365   0.12%      3.15%   20.00%
+  {    56,      65536,   32},  //  7      1170   0.12%      3.15%   16.67%
+  {    64,      65536,   32},  //  8      1024   0.10%      3.15%   14.29%
+  {    72,      65536,   32},  //  9       910   0.12%      3.15%   12.50%
+  {    80,      65536,   32},  // 10       819   0.12%      3.15%   11.11%
+  {    88,      65536,   32},  // 11       744   0.20%      3.15%   10.00%
+  {    96,      65536,   32},  // 12       682   0.20%      3.15%    9.09%
+  {   104,      65536,   32},  // 13       630   0.12%      3.15%    8.33%
+  {   112,      65536,   32},  // 14       585   0.12%      3.15%    7.69%
+  {   120,      65536,   32},  // 15       546   0.12%      3.15%    7.14%
+  {   128,      65536,   32},  // 16       512   0.10%      3.15%    6.67%
+  {   144,      65536,   32},  // 17       455   0.12%      3.15%   12.50%
+  {   160,      65536,   32},  // 18       409   0.24%      3.15%   11.11%
+  {   176,      65536,   32},  // 19       372   0.20%      3.15%   10.00%
+  {   192,      65536,   32},  // 20       341   0.20%      3.15%    9.09%
+  {   208,      65536,   32},  // 21       315   0.12%      3.15%    8.33%
+  {   224,      65536,   32},  // 22       292   0.29%      3.15%    7.69%
+  {   240,      65536,   32},  // 23       273   0.12%      3.15%    7.14%
+  {   256,      65536,   32},  // 24       256   0.10%      3.15%    6.67%
+  {   264,      65536,   32},  // 25       248   0.20%      3.15%    3.12%
+  {   288,      65536,   32},  // 26       227   0.34%      3.15%    9.09%
+  {   320,      65536,   32},  // 27       204   0.49%      3.15%   11.11%
+  {   368,      65536,   32},  // 28       178   0.15%      3.15%   15.00%
+  {   400,      65536,   32},  // 29       163   0.61%      3.15%    8.70%
+  {   448,      65536,   32},  // 30       146   0.29%      3.15%   12.00%
+  {   512,      65536,   32},  // 31       128   0.10%      3.15%   14.29%
+  {   576,      65536,   32},  // 32       113   0.79%      3.15%   12.50%
+  {   640,      65536,   32},  // 33       102   0.49%      3.15%   11.11%
+  {   704,      65536,   32},  // 34        93   0.20%      3.15%   10.00%
+  {   768,      65536,   32},  // 35        85   0.49%      3.15%    9.09%
+  {   832,      65536,   32},  // 36        78   1.08%      3.15%    8.33%
+  {   896,      65536,   32},  // 37        73   0.29%      3.15%    7.69%
+  {  1024,      65536,   32},  // 38        64   0.10%      3.15%   14.29%
+  {  1152,      65536,   32},  // 39        56   1.69%      3.15%   12.50%
+  {  1280,      65536,   32},  // 40        51   0.49%      3.15%   11.11%
+  {  1408,      65536,   32},  // 41        46   1.28%      3.15%   10.00%
+  {  1536,      65536,   32},  // 42        42   1.69%      3.15%    9.09%
+  {  1664,      65536,   32},  // 43        39   1.08%      3.15%    8.33%
+  {  1920,      65536,   32},  // 44        34   0.49%      3.15%   15.38%
+  {  2048,      65536,   32},  // 45        32   0.10%      3.15%    6.67%
+  {  2176,      65536,   30},  // 46        30   0.49%      3.15%    6.25%
+  {  2304,      65536,   28},  // 47        28   1.69%      3.15%    5.88%
+  {  2688,      65536,   24},  // 48        24   1.69%      3.15%   16.67%
+  {  2944,      65536,   22},  // 49        22   1.28%      3.15%    9.52%
+  {  3200,      65536,   20},  // 50        20   2.50%      3.15%    8.70%
+  {  3584,      65536,   18},  // 51        18   1.69%      3.15%   12.00%
+  {  4096,      65536,   16},  // 52        16   0.10%      3.15%   14.29%
+  {  4608,      65536,   14},  // 53        14   1.69%      3.15%   12.50%
+  {  5376,      65536,   12},  // 54        12   1.69%      3.15%   16.67%
+  {  6528,      65536,   10},  // 55        10   0.49%      3.15%   21.43%
+  {  8192,      65536,    8},  // 56         8   0.10%      3.15%   25.49%
+  {  9344,      65536,    7},  // 57         7   0.29%      3.15%   14.06%
+  { 10880,      65536,    6},  // 58         6   0.49%      3.15%   16.44%
+  { 13952,     131072,    4},  // 59         9   4.43%      3.15%   28.24%
+  { 16384,      65536,    4},  // 60         4   0.10%      3.15%   17.43%
+  { 19072,     196608,    3},  // 61        10   3.12%      3.15%   16.41%
+  { 21760,      65536,    3},  // 62         3   0.49%      3.15%   14.09%
+  { 26112,     131072,    2},  // 63         5   0.44%      3.15%   20.00%
+  { 32768,      65536,    2},  // 64         2   0.10%      3.15%   25.49%
+  { 38144,     196608,    2},  // 65         5   3.12%      3.15%   16.41%
+  { 40960,     131072,    2},  // 66         3   6.72%      3.15%    7.38%
+  { 49152,     196608,    2},  // 67         4   0.03%      3.15%   20.00%
+  { 57344,     458752,    2},  // 68         8   0.01%      3.15%   16.67%
+  { 65536,      65536,    2},  // 69         1   0.10%      0.03%   14.29%
+  { 81920,     262144,    2},  // 70         3   6.69%      6.28%   25.00%
+  { 98304,     196608,    2},  // 71         2   0.03%      6.28%   20.00%
+  {114688,     458752,    2},  // 72         4   0.01%      6.28%   16.67%
+  {131072,     131072,    2},  // 73         1   0.05%      0.03%   14.29%
+  {163840,     327680,    2},  // 74         2   0.02%      9.40%   25.00%
+  {196608,     196608,    2},  // 75         1   0.03%      0.03%   20.00%
+  {229376,     458752,    2},  // 76         2   0.01%     12.53%   16.67%
+  {262144,     262144,    2},  // 77         1   0.02%      0.03%   14.29%
+};
 #elif TCMALLOC_PAGE_SHIFT == 18
 static_assert(kMaxSize == 262144, "kMaxSize mismatch");
 static constexpr SizeClassAssumptions Assumptions{
@@ -590,6 +681,97 @@ static constexpr SizeClassInfo List[] = {
   {229376,     229376,    2},  // 76         1   0.03%      0.03%   16.67%
   {262144,     262144,    2},  // 77         1   0.02%      0.03%   14.29%
 };
+#elif TCMALLOC_PAGE_SHIFT == 16
+static_assert(kMaxSize == 262144, "kMaxSize mismatch");
+static constexpr SizeClassAssumptions Assumptions{
+  .has_expanded_classes = true,
+  .span_size = 64,
+  .sampling_interval = 2097152,
+  .large_size = 1024,
+  .large_size_alignment = 128,
+};
+static constexpr SizeClassInfo List[] = {
+//                                             |      waste       |
+//  bytes  span_bytes batch    class      objs | fixed   sampling |    inc
+  {     0,          0,    0},  //  0         0   0.00%      0.00%    0.00%
+  {     8,      65536,   32},  //  1      8192   0.10%      3.15%    0.00%
+  {    16,      65536,   32},  //  2      4096   0.10%      3.15%  100.00%
+  {    32,      65536,   32},  //  3      2048   0.10%      3.15%  100.00%
+  {    48,      65536,   32},  //  4      1365   0.12%      3.15%   50.00%
+  {    64,      65536,   32},  //  5      1024   0.10%      3.15%   33.33%
+  {    80,      65536,   32},  //  6       819   0.12%      3.15%   25.00%
+  {    96,      65536,   32},  //  7       682   0.20%      3.15%   20.00%
+  {   112,      65536,   32},  //  8       585   0.12%      3.15%   16.67%
+  {   128,      65536,   32},  //  9       512   0.10%      3.15%   14.29%
+  {   144,      65536,   32},  // 10       455   0.12%      3.15%   12.50%
+  {   160,      65536,   32},  // 11       409   0.24%      3.15%   11.11%
+  {   176,      65536,   32},  // 12       372   0.20%      3.15%   10.00%
+  {   192,      65536,   32},  // 13       341   0.20%      3.15%    9.09%
+  {   208,      65536,   32},  // 14       315   0.12%      3.15%    8.33%
+  {   224,      65536,   32},  // 15       292   0.29%      3.15%    7.69%
+  {   240,      65536,   32},  // 16       273   0.12%      3.15%    7.14%
+  {   256,      65536,   32},  // 17       256   0.10%      3.15%    6.67%
+  {   272,      65536,   32},  // 18       240   0.49%      3.15%    6.25%
+  {   288,      65536,   32},  // 19       227   0.34%      3.15%    5.88%
+  {   320,      65536,   32},  // 20       204   0.49%      3.15%   11.11%
+  {   336,      65536,   32},  // 21       195   0.12%      3.15%    5.00%
+  {   368,      65536,   32},  // 22       178   0.15%      3.15%    9.52%
+  {   400,      65536,   32},  // 23       163   0.61%      3.15%    8.70%
+  {   448,      65536,   32},  // 24       146   0.29%      3.15%   12.00%
+  {   480,      65536,   32},  // 25       136   0.49%      3.15%    7.14%
+  {   512,      65536,   32},  // 26       128   0.10%      3.15%    6.67%
+  {   576,      65536,   32},  // 27       113   0.79%      3.15%   12.50%
+  {   640,      65536,   32},  // 28       102   0.49%      3.15%   11.11%
+  {   704,      65536,   32},  // 29        93   0.20%      3.15%   10.00%
+  {   768,      65536,   32},  // 30        85   0.49%      3.15%    9.09%
+  {   832,      65536,   32},  // 31        78   1.08%      3.15%    8.33%
+  {   896,      65536,   32},  // 32        73   0.29%      3.15%    7.69%
+  {  1024,      65536,   32},  // 33        64   0.10%      3.15%   14.29%
+  {  1152,      65536,   32},  // 34        56   1.69%      3.15%   12.50%
+  {  1280,      65536,   32},  // 35        51   0.49%      3.15%   11.11%
+  {  1408,      65536,   32},  // 36        46   1.28%      3.15%   10.00%
+  {  1536,      65536,   32},  // 37        42   1.69%      3.15%    9.09%
+  {  1664,      65536,   32},  // 38        39   1.08%      3.15%    8.33%
+  {  1792,      65536,   32},  // 39        36   1.69%      3.15%    7.69%
+  {  1920,      65536,   32},  // 40        34   0.49%      3.15%    7.14%
+  {  2048,      65536,   32},  // 41        32   0.10%      3.15%    6.67%
+  {  2176,      65536,   30},  // 42        30   0.49%      3.15%    6.25%
+  {  2304,      65536,   28},  // 43        28   1.69%      3.15%    5.88%
+  {  2432,      65536,   26},  // 44        26   3.74%      3.15%    5.56%
+  {  2688,      65536,   24},  // 45        24   1.69%      3.15%   10.53%
+  {  2944,      65536,   22},  // 46        22   1.28%      3.15%    9.52%
+  {  3200,      65536,   20},  // 47        20   2.50%      3.15%    8.70%
+  {  3584,      65536,   18},  // 48        18   1.69%      3.15%   12.00%
+  {  4096,      65536,   16},  // 49        16   0.10%      3.15%   14.29%
+  {  4608,      65536,   14},  // 50        14   1.69%      3.15%   12.50%
+  {  5376,      65536,   12},  // 51        12   1.69%      3.15%   16.67%
+  {  6528,      65536,   10},  // 52        10   0.49%      3.15%   21.43%
+  {  7168,      65536,    9},  // 53         9   1.69%      3.15%    9.80%
+  {  8192,      65536,    8},  // 54         8   0.10%      3.15%   14.29%
+  {  9344,      65536,    7},  // 55         7   0.29%      3.15%   14.06%
+  { 10880,      65536,    6},  // 56         6   0.49%      3.15%   16.44%
+  { 13056,      65536,    5},  // 57         5   0.49%      3.15%   20.00%
+  { 14336,     131072,    4},  // 58         9   1.64%      3.15%    9.80%
+  { 16384,      65536,    4},  // 59         4   0.10%      3.15%   14.29%
+  { 19072,     196608,    3},  // 60        10   3.12%      3.15%   16.41%
+  { 21760,      65536,    3},  // 61         3   0.49%      3.15%   14.09%
+  { 24576,     131072,    2},  // 62         5   6.72%      3.15%   12.94%
+  { 28672,     262144,    2},  // 63         9   1.61%      3.15%   16.67%
+  { 32768,      65536,    2},  // 64         2   0.10%      3.15%   14.29%
+  { 38144,     196608,    2},  // 65         5   3.12%      3.15%   16.41%
+  { 40960,     131072,    2},  // 66         3   6.72%      3.15%    7.38%
+  { 49152,     196608,    2},  // 67         4   0.03%      3.15%   20.00%
+  { 57344,     458752,    2},  // 68         8   0.01%      3.15%   16.67%
+  { 65536,      65536,    2},  // 69         1   0.10%      0.03%   14.29%
+  { 81920,     262144,    2},  // 70         3   6.69%      6.28%   25.00%
+  { 98304,     196608,    2},  // 71         2   0.03%      6.28%   20.00%
+  {114688,     458752,    2},  // 72         4   0.01%      6.28%   16.67%
+  {131072,     131072,    2},  // 73         1   0.05%      0.03%   14.29%
+  {163840,     327680,    2},  // 74         2   0.02%      9.40%   25.00%
+  {196608,     196608,    2},  // 75         1   0.03%      0.03%   20.00%
+  {229376,     458752,    2},  // 76         2   0.01%     12.53%   16.67%
+  {262144,     262144,    2},  // 77         1   0.02%      0.03%   14.29%
+};
 #elif TCMALLOC_PAGE_SHIFT == 18
 static_assert(kMaxSize == 262144, "kMaxSize mismatch");
 static constexpr SizeClassAssumptions Assumptions{
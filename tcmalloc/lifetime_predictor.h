@@ -0,0 +1,134 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_LIFETIME_PREDICTOR_H_
+#define TCMALLOC_LIFETIME_PREDICTOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+enum class LifetimePrediction : uint8_t {
+  kUnknown,
+  kShortLived,
+  kLongLived,
+};
+
+// Predicts whether objects allocated from a call site are long-lived, based on
+// the observed lifetimes of sampled allocations from the same call site.
+//
+// Call sites are identified by a hash of their stack trace, folded into a
+// fixed-size table of saturating counters.  Each sampled object freed after
+// kLongLivedThreshold moves its counter up, each one freed sooner moves it
+// down.  Collisions only make predictions less confident; they never affect
+// correctness, since the prediction is just a placement hint.
+class LifetimePredictor {
+ public:
+  static constexpr size_t kTableSize = 4096;
+  static constexpr absl::Duration kLongLivedThreshold = absl::Seconds(1);
+  // Counters saturate at +/-kMaxVotes and predictions require at least
+  // kMinVotes in one direction.
+  static constexpr int8_t kMaxVotes = 16;
+  static constexpr int8_t kMinVotes = 4;
+
+  constexpr LifetimePredictor() = default;
+  LifetimePredictor(const LifetimePredictor&) = delete;
+  LifetimePredictor& operator=(const LifetimePredictor&) = delete;
+
+  static size_t HashStack(absl::Span<void* const> stack) {
+    uint64_t hash = 0x9e3779b97f4a7c15;
+    for (void* frame : stack) {
+      hash ^= reinterpret_cast<uintptr_t>(frame);
+      hash *= 0xff51afd7ed558ccd;
+      hash ^= hash >> 32;
+    }
+    return hash;
+  }
+
+  // Records that an object allocated from the call site with the given hash
+  // lived for the given duration.
+  void Record(size_t hash, absl::Duration lifetime) {
+    const bool long_lived = lifetime >= kLongLivedThreshold;
+    std::atomic<int8_t>& votes = votes_[hash % kTableSize];
+    // Updates may be lost in the face of concurrent calls, which only delays
+    // the counter reaching its steady state.
+    const int8_t v = votes.load(std::memory_order_relaxed);
+    if (long_lived) {
+      if (v < kMaxVotes) votes.store(v + 1, std::memory_order_relaxed);
+      recorded_long_lived_.Add(1);
+    } else {
+      if (v > -kMaxVotes) votes.store(v - 1, std::memory_order_relaxed);
+      recorded_short_lived_.Add(1);
+    }
+  }
+
+  LifetimePrediction Predict(size_t hash) {
+    const int8_t v = votes_[hash % kTableSize].load(std::memory_order_relaxed);
+    if (v >= kMinVotes) {
+      predicted_long_lived_.Add(1);
+      return LifetimePrediction::kLongLived;
+    }
+    if (v <= -kMinVotes) {
+      predicted_short_lived_.Add(1);
+      return LifetimePrediction::kShortLived;
+    }
+    predicted_unknown_.Add(1);
+    return LifetimePrediction::kUnknown;
+  }
+
+  void Print(Printer& out) const {
+    out.printf(
+        "Sampled lifetimes recorded: %zu short-lived, %zu long-lived\n",
+        recorded_short_lived_.value(), recorded_long_lived_.value());
+    out.printf(
+        "Lifetime predictions: %zu short-lived, %zu long-lived, %zu "
+        "unknown\n",
+        predicted_short_lived_.value(), predicted_long_lived_.value(),
+        predicted_unknown_.value());
+  }
+
+  void PrintInPbtxt(PbtxtRegion& region) const {
+    region.PrintI64("recorded_short_lived", recorded_short_lived_.value());
+    region.PrintI64("recorded_long_lived", recorded_long_lived_.value());
+    region.PrintI64("predicted_short_lived", predicted_short_lived_.value());
+    region.PrintI64("predicted_long_lived", predicted_long_lived_.value());
+    region.PrintI64("predicted_unknown", predicted_unknown_.value());
+  }
+
+ private:
+  std::atomic<int8_t> votes_[kTableSize] = {};
+
+  StatsCounter recorded_short_lived_;
+  StatsCounter recorded_long_lived_;
+  StatsCounter predicted_short_lived_;
+  StatsCounter predicted_long_lived_;
+  StatsCounter predicted_unknown_;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_LIFETIME_PREDICTOR_H_
@@ -0,0 +1,96 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/lifetime_predictor.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "tcmalloc/internal/logging.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+TEST(LifetimePredictorTest, HashStack) {
+  void* a[] = {reinterpret_cast<void*>(0x1000), reinterpret_cast<void*>(0x2000)};
+  void* b[] = {reinterpret_cast<void*>(0x2000), reinterpret_cast<void*>(0x1000)};
+  EXPECT_EQ(LifetimePredictor::HashStack(a), LifetimePredictor::HashStack(a));
+  EXPECT_NE(LifetimePredictor::HashStack(a), LifetimePredictor::HashStack(b));
+  EXPECT_NE(LifetimePredictor::HashStack(absl::MakeSpan(a, 1)),
+            LifetimePredictor::HashStack(a));
+}
+
+TEST(LifetimePredictorTest, PredictsAfterEnoughVotes) {
+  auto predictor = std::make_unique<LifetimePredictor>();
+  constexpr size_t kLong = 1, kShort = 2;
+  EXPECT_EQ(predictor->Predict(kLong), LifetimePrediction::kUnknown);
+  EXPECT_EQ(predictor->Predict(kShort), LifetimePrediction::kUnknown);
+
+  for (int i = 0; i < LifetimePredictor::kMinVotes; ++i) {
+    EXPECT_EQ(predictor->Predict(kLong), LifetimePrediction::kUnknown);
+    predictor->Record(kLong, LifetimePredictor::kLongLivedThreshold);
+    EXPECT_EQ(predictor->Predict(kShort), LifetimePrediction::kUnknown);
+    predictor->Record(kShort, absl::Milliseconds(1));
+  }
+  EXPECT_EQ(predictor->Predict(kLong), LifetimePrediction::kLongLived);
+  EXPECT_EQ(predictor->Predict(kShort), LifetimePrediction::kShortLived);
+}
+
+TEST(LifetimePredictorTest, Saturates) {
+  auto predictor = std::make_unique<LifetimePredictor>();
+  constexpr size_t kSite = 3;
+  for (int i = 0; i < 10 * LifetimePredictor::kMaxVotes; ++i) {
+    predictor->Record(kSite, absl::Seconds(10));
+  }
+  EXPECT_EQ(predictor->Predict(kSite), LifetimePrediction::kLongLived);
+
+  // Counters saturate, so a site whose behavior changes is re-learned after a
+  // bounded number of samples.
+  const int flip =
+      LifetimePredictor::kMaxVotes + LifetimePredictor::kMinVotes;
+  for (int i = 0; i < flip; ++i) {
+    predictor->Record(kSite, absl::ZeroDuration());
+  }
+  EXPECT_EQ(predictor->Predict(kSite), LifetimePrediction::kShortLived);
+}
+
+TEST(LifetimePredictorTest, Stats) {
+  auto predictor = std::make_unique<LifetimePredictor>();
+  predictor->Record(4, absl::Seconds(5));
+  predictor->Record(4, absl::Milliseconds(5));
+  predictor->Record(4, absl::Milliseconds(5));
+  (void)predictor->Predict(4);
+
+  std::string buffer(1024, '\0');
+  Printer printer(&buffer[0], buffer.size());
+  predictor->Print(printer);
+  buffer.resize(strlen(buffer.c_str()));
+  EXPECT_THAT(buffer, testing::HasSubstr("Sampled lifetimes recorded: 2 "
+                                         "short-lived, 1 long-lived"));
+  EXPECT_THAT(buffer, testing::HasSubstr("Lifetime predictions: 0 "
+                                         "short-lived, 0 long-lived, 1 "
+                                         "unknown"));
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
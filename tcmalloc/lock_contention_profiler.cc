@@ -0,0 +1,116 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/lock_contention_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "absl/base/internal/cycleclock.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/debugging/stacktrace.h"
+#include "absl/functional/function_ref.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+ABSL_CONST_INIT LockContentionProfiler lock_contention_profiler;
+
+namespace {
+
+class LockContentionProfile final : public ProfileBase {
+ public:
+  LockContentionProfile() : start_(absl::Now()) {}
+
+  void Iterate(
+      absl::FunctionRef<void(const Profile::Sample&)> f) const override {
+    for (const Profile::Sample& sample : samples_) {
+      f(sample);
+    }
+  }
+
+  ProfileType Type() const override { return ProfileType::kLockContention; }
+
+  std::optional<absl::Time> StartTime() const override { return start_; }
+
+  absl::Duration Duration() const override { return absl::ZeroDuration(); }
+
+  std::vector<Profile::Sample>& samples() { return samples_; }
+
+ private:
+  absl::Time start_;
+  std::vector<Profile::Sample> samples_;
+};
+
+}  // namespace
+
+void LockContentionProfiler::Record(int64_t cycles) {
+  if (contentions_.fetch_add(1, std::memory_order_relaxed) % kSamplePeriod !=
+      0) {
+    return;
+  }
+
+  void* stack[kMaxStackDepth];
+  const int depth = absl::GetStackTrace(stack, kMaxStackDepth, 1);
+
+  AllocationGuardSpinLockHolder h(lock_);
+  Sample& sample = samples_[next_ % kMaxSamples];
+  ++next_;
+  sample.cycles = cycles;
+  sample.depth = depth;
+  memcpy(sample.stack, stack, sizeof(stack[0]) * depth);
+}
+
+std::unique_ptr<ProfileBase> LockContentionProfiler::DumpSample() const {
+  auto profile = std::make_unique<LockContentionProfile>();
+  // Reserve up front: the samples are copied out under lock_, where we must
+  // not allocate.
+  profile->samples().reserve(kMaxSamples);
+  const double nanoseconds_per_cycle =
+      1e9 / absl::base_internal::CycleClock::Frequency();
+
+  AllocationGuardSpinLockHolder h(lock_);
+  const size_t n = std::min(next_, kMaxSamples);
+  for (size_t i = 0; i < n; ++i) {
+    const Sample& recorded = samples_[i];
+    Profile::Sample& sample = profile->samples().emplace_back();
+    sample.count = kSamplePeriod;
+    sample.sum = static_cast<int64_t>(recorded.cycles * nanoseconds_per_cycle) *
+                 kSamplePeriod;
+    sample.depth = recorded.depth;
+    static_assert(kMaxStackDepth <= Profile::Sample::kMaxStackDepth,
+                  "Profile stack size smaller than internal stack sizes");
+    memcpy(sample.stack, recorded.stack,
+           sizeof(sample.stack[0]) * sample.depth);
+  }
+  return profile;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
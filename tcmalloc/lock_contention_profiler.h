@@ -0,0 +1,120 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_LOCK_CONTENTION_PROFILER_H_
+#define TCMALLOC_LOCK_CONTENTION_PROFILER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "absl/base/attributes.h"
+#include "absl/base/const_init.h"
+#include "absl/base/internal/cycleclock.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/slow_allocation_profiler.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Keeps the stacks of a sample of contended acquisitions of the page heap,
+// central freelist and transfer cache locks, for
+// ProfileType::kLockContention.
+//
+// Only acquisitions that find their lock held reach Record(), and only one in
+// kSamplePeriod of those captures a stack.  The most recent kMaxSamples
+// samples are retained.
+class LockContentionProfiler {
+ public:
+  static constexpr int kSamplePeriod = 64;
+  static constexpr size_t kMaxSamples = 128;
+
+  constexpr LockContentionProfiler()
+      : lock_(absl::base_internal::SCHEDULE_KERNEL_ONLY) {}
+
+  // Records that the caller waited `cycles` to acquire a contended lock.  Must
+  // not be called with the lock held, so that sampling does not lengthen the
+  // critical section.
+  void Record(int64_t cycles) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns the retained samples.
+  std::unique_ptr<ProfileBase> DumpSample() const ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  struct Sample {
+    int64_t cycles;
+    int depth;
+    void* stack[kMaxStackDepth];
+  };
+
+  std::atomic<uint64_t> contentions_{0};
+
+  mutable absl::base_internal::SpinLock lock_;
+  // Ring buffer of samples; next_ counts all samples ever recorded.
+  size_t next_ ABSL_GUARDED_BY(lock_) = 0;
+  Sample samples_[kMaxSamples] ABSL_GUARDED_BY(lock_) = {};
+};
+
+ABSL_CONST_INIT extern LockContentionProfiler lock_contention_profiler;
+
+// Measures how long the current thread waits to acquire `lock` and reports it
+// to lock_contention_profiler.  Construct it immediately before acquiring the
+// lock, call Acquired() once it is held, and destroy it after the lock is
+// released.  An uncontended acquisition costs a single load of the lock word.
+class LockContentionTimer {
+ public:
+  explicit LockContentionTimer(const absl::base_internal::SpinLock& lock)
+      : contended_(lock.IsHeld()) {
+    if (ABSL_PREDICT_FALSE(contended_)) {
+      start_ = absl::base_internal::CycleClock::Now();
+    }
+  }
+
+  LockContentionTimer(const LockContentionTimer&) = delete;
+  LockContentionTimer& operator=(const LockContentionTimer&) = delete;
+
+  ~LockContentionTimer() {
+    if (ABSL_PREDICT_FALSE(contended_)) {
+      lock_contention_profiler.Record(start_);
+    }
+  }
+
+  void Acquired() {
+    if (ABSL_PREDICT_FALSE(contended_)) {
+      // Reuse start_ to hold the wait until it is recorded.
+      start_ = absl::base_internal::CycleClock::Now() - start_;
+      AttributeToSlowAllocation(SlowAllocationCause::kLockWait, start_);
+    }
+  }
+
+  // Whether the lock was held by another thread when the timer was created.
+  bool contended() const { return contended_; }
+
+ private:
+  bool contended_;
+  int64_t start_ = 0;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_LOCK_CONTENTION_PROFILER_H_
@@ -17,7 +17,9 @@
 #include <assert.h>
 #include <string.h>
 
+#include <algorithm>
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <limits>
@@ -31,6 +33,8 @@
 #include "absl/base/attributes.h"
 #include "absl/base/call_once.h"
 #include "absl/base/internal/low_level_alloc.h"
+#include "absl/base/nullability.h"
+#include "absl/base/optimization.h"
 #include "absl/functional/function_ref.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
@@ -174,6 +178,14 @@ absl::Duration Profile::Duration() const {
   return impl_->Duration();
 }
 
+uint64_t Profile::ExperimentId() const {
+  if (!impl_) {
+    return 0;
+  }
+
+  return impl_->ExperimentId();
+}
+
 AddressRegion::~AddressRegion() = default;
 
 size_t AddressRegionFactory::GetStats(absl::Span<char> buffer) {
@@ -230,6 +242,57 @@ std::string MallocExtension::GetStats() {
   return "";
 }
 
+MallocExtension::StatsSnapshot MallocExtension::GetStatsSnapshot() {
+  StatsSnapshot ret = {};
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetStatsSnapshot != nullptr) {
+    MallocExtension_Internal_GetStatsSnapshot(&ret);
+  }
+#endif
+  return ret;
+}
+
+size_t MallocExtension::GetStatsInOpenMetrics(absl::Span<char> buffer) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetStatsInOpenMetrics != nullptr) {
+    return MallocExtension_Internal_GetStatsInOpenMetrics(buffer.data(),
+                                                          buffer.size());
+  }
+#endif
+  return 0;
+}
+
+MallocExtension::HotStats MallocExtension::GetHotStats() {
+  HotStats ret = {};
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetHotStats != nullptr) {
+    MallocExtension_Internal_GetHotStats(&ret);
+  }
+#endif
+  return ret;
+}
+
+MallocExtension::MemoryBreakdown MallocExtension::GetMemoryBreakdown() {
+  MemoryBreakdown ret;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetMemoryBreakdown != nullptr) {
+    MallocExtension_Internal_GetMemoryBreakdown(&ret);
+  }
+#endif
+  return ret;
+}
+
+MallocExtension::DefragmentationStats MallocExtension::Defragment(
+    Relocator relocator, size_t budget) {
+  DefragmentationStats ret;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_Defragment != nullptr) {
+    MallocExtension_Internal_Defragment(relocator, budget, &ret);
+  }
+#endif
+  return ret;
+}
+
 void MallocExtension::ReleaseMemoryToSystem(size_t num_bytes) {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (&MallocExtension_Internal_ReleaseMemoryToSystem != nullptr) {
@@ -275,6 +338,41 @@ Profile MallocExtension::SnapshotCurrent(tcmalloc::ProfileType type) {
 #endif
 }
 
+std::vector<Profile> MallocExtension::SnapshotPeakHeaps(absl::Time start,
+                                                       absl::Time end) {
+  std::vector<Profile> profiles;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SnapshotPeakHeaps == nullptr) {
+    return profiles;
+  }
+
+  std::vector<const tcmalloc_internal::ProfileBase*> peaks;
+  MallocExtension_Internal_SnapshotPeakHeaps(start, end, &peaks);
+  profiles.reserve(peaks.size());
+  for (const tcmalloc_internal::ProfileBase* peak : peaks) {
+    profiles.push_back(tcmalloc_internal::ProfileAccessor::MakeProfile(
+        std::unique_ptr<const tcmalloc_internal::ProfileBase>(peak)));
+  }
+#endif
+  return profiles;
+}
+
+MallocExtension::HeapProfileDelta MallocExtension::SnapshotHeapDelta(
+    HeapProfileCursor& cursor) {
+  HeapProfileDelta delta;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SnapshotHeapDelta == nullptr) {
+    return delta;
+  }
+
+  delta.added = tcmalloc_internal::ProfileAccessor::MakeProfile(
+      std::unique_ptr<const tcmalloc_internal::ProfileBase>(
+          MallocExtension_Internal_SnapshotHeapDelta(&cursor.live_,
+                                                     &delta.removed)));
+#endif
+  return delta;
+}
+
 MallocExtension::AllocationProfilingToken
 MallocExtension::StartAllocationProfiling() {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
@@ -328,6 +426,106 @@ void MallocExtension::MarkThreadBusy() {
 #endif
 }
 
+void MallocExtension::MarkCpuParking(absl::Duration expected) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_MarkCpuParking != nullptr) {
+    MallocExtension_Internal_MarkCpuParking(expected);
+  }
+#endif
+}
+
+void MallocExtension::SetProtectedCpus(absl::Span<const int> cpus) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SetProtectedCpus != nullptr) {
+    MallocExtension_Internal_SetProtectedCpus(cpus.data(), cpus.size());
+  }
+#endif
+}
+
+std::vector<int> MallocExtension::GetProtectedCpus() {
+  std::vector<int> cpus;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetProtectedCpus != nullptr) {
+    MallocExtension_Internal_GetProtectedCpus(&cpus);
+  }
+#endif
+  return cpus;
+}
+
+void MallocExtension::SetThreadAllocationBudget(
+    size_t bytes, AllocationBudgetCallback callback, void* arg) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SetThreadAllocationBudget != nullptr) {
+    MallocExtension_Internal_SetThreadAllocationBudget(bytes, callback, arg);
+  }
+#endif
+}
+
+void MallocExtension::ClearThreadAllocationBudget() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_ClearThreadAllocationBudget != nullptr) {
+    MallocExtension_Internal_ClearThreadAllocationBudget();
+  }
+#endif
+}
+
+std::optional<size_t> MallocExtension::GetThreadAllocatedBytes() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetThreadAllocatedBytes != nullptr) {
+    size_t bytes;
+    if (MallocExtension_Internal_GetThreadAllocatedBytes(&bytes)) {
+      return bytes;
+    }
+  }
+#endif
+  return std::nullopt;
+}
+
+MallocExtension::TenantId MallocExtension::SetCurrentTenant(TenantId tenant) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SetCurrentTenant != nullptr) {
+    return MallocExtension_Internal_SetCurrentTenant(tenant);
+  }
+#endif
+  return kNoTenant;
+}
+
+MallocExtension::TenantId MallocExtension::GetCurrentTenant() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetCurrentTenant != nullptr) {
+    return MallocExtension_Internal_GetCurrentTenant();
+  }
+#endif
+  return kNoTenant;
+}
+
+void MallocExtension::SetTenantLimit(TenantId tenant, size_t bytes) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SetTenantLimit != nullptr) {
+    MallocExtension_Internal_SetTenantLimit(tenant, bytes);
+  }
+#endif
+}
+
+bool MallocExtension::IsTenantOverLimit(TenantId tenant) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_IsTenantOverLimit != nullptr) {
+    return MallocExtension_Internal_IsTenantOverLimit(tenant);
+  }
+#endif
+  return false;
+}
+
+std::vector<MallocExtension::TenantStats> MallocExtension::GetTenantStats() {
+  std::vector<TenantStats> stats;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetTenantStats != nullptr) {
+    MallocExtension_Internal_GetTenantStats(&stats);
+  }
+#endif
+  return stats;
+}
+
 size_t MallocExtension::GetMemoryLimit(LimitKind limit_kind) {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (&MallocExtension_Internal_GetMemoryLimit != nullptr) {
@@ -348,6 +546,54 @@ void MallocExtension::SetMemoryLimit(const size_t limit, LimitKind limit_kind) {
 #endif
 }
 
+bool MallocExtension::AddMemoryPressureCallback(MemoryPressureCallback callback,
+                                                void* arg,
+                                                double moderate_fraction,
+                                                double critical_fraction) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_AddMemoryPressureCallback != nullptr) {
+    return MallocExtension_Internal_AddMemoryPressureCallback(
+        callback, arg, moderate_fraction, critical_fraction);
+  }
+#endif
+  return false;
+}
+
+void MallocExtension::RemoveMemoryPressureCallback(
+    MemoryPressureCallback callback, void* arg) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_RemoveMemoryPressureCallback != nullptr) {
+    MallocExtension_Internal_RemoveMemoryPressureCallback(callback, arg);
+  }
+#endif
+}
+
+void* MallocExtension::AllocatePinned(size_t size) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_AllocatePinned != nullptr) {
+    return MallocExtension_Internal_AllocatePinned(size);
+  }
+#endif
+  return nullptr;
+}
+
+void MallocExtension::FreePinned(void* ptr, size_t size) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_FreePinned != nullptr) {
+    MallocExtension_Internal_FreePinned(ptr, size);
+  }
+#endif
+}
+
+void MallocExtension::SetPinnedMemoryCallback(PinnedMemoryCallback callback,
+                                              void* arg) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SetPinnedMemoryCallback != nullptr) {
+    MallocExtension_Internal_SetPinnedMemoryCallback(callback, arg);
+  }
+#endif
+}
+
 int64_t MallocExtension::GetProfileSamplingInterval() {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (&MallocExtension_Internal_GetProfileSamplingInterval != nullptr) {
@@ -422,6 +668,28 @@ int32_t MallocExtension::GetMaxPerCpuCacheSize() {
 #endif
 }
 
+int32_t MallocExtension::GetMaxPerCpuColdCacheSize() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (MallocExtension_Internal_GetMaxPerCpuColdCacheSize == nullptr) {
+    return -1;
+  }
+
+  return MallocExtension_Internal_GetMaxPerCpuColdCacheSize();
+#else
+  return -1;
+#endif
+}
+
+std::string MallocExtension::GetPerCpuCapacityProfile() {
+  std::string ret;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetPerCpuCapacityProfile != nullptr) {
+    MallocExtension_Internal_GetPerCpuCapacityProfile(&ret);
+  }
+#endif
+  return ret;
+}
+
 void MallocExtension::SetMaxPerCpuCacheSize(int32_t value) {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (MallocExtension_Internal_SetMaxPerCpuCacheSize == nullptr) {
@@ -434,6 +702,18 @@ void MallocExtension::SetMaxPerCpuCacheSize(int32_t value) {
 #endif
 }
 
+void MallocExtension::SetMaxPerCpuColdCacheSize(int32_t value) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (MallocExtension_Internal_SetMaxPerCpuColdCacheSize == nullptr) {
+    return;
+  }
+
+  MallocExtension_Internal_SetMaxPerCpuColdCacheSize(value);
+#else
+  (void)value;
+#endif
+}
+
 int64_t MallocExtension::GetMaxTotalThreadCacheBytes() {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (MallocExtension_Internal_GetMaxTotalThreadCacheBytes == nullptr) {
@@ -672,6 +952,17 @@ MallocExtension::PropertyMap MallocExtension::GetProperties() {
   return ret;
 }
 
+std::vector<MallocExtension::AllocationRateEpoch>
+MallocExtension::GetAllocationRateHistory() {
+  std::vector<AllocationRateEpoch> ret;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetAllocationRateHistory != nullptr) {
+    MallocExtension_Internal_GetAllocationRateHistory(&ret);
+  }
+#endif
+  return ret;
+}
+
 size_t MallocExtension::ReleaseCpuMemory(int cpu) {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (MallocExtension_Internal_ReleaseCpuMemory != nullptr) {
@@ -689,6 +980,25 @@ void MallocExtension::ProcessBackgroundActions() {
 #endif
 }
 
+absl::Time MallocExtension::RunBackgroundStep(absl::Duration budget) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_RunBackgroundStep != nullptr) {
+    absl::Time next_wake;
+    MallocExtension_Internal_RunBackgroundStep(budget, &next_wake);
+    return next_wake;
+  }
+#endif
+  return absl::InfiniteFuture();
+}
+
+void MallocExtension::ProcessBackgroundReleaseWorker() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_ProcessBackgroundReleaseWorker != nullptr) {
+    MallocExtension_Internal_ProcessBackgroundReleaseWorker();
+  }
+#endif
+}
+
 bool MallocExtension::NeedsProcessBackgroundActions() {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   return &MallocExtension_Internal_ProcessBackgroundActions != nullptr;
@@ -714,6 +1024,310 @@ void MallocExtension::SetBackgroundReleaseRate(BytesPerSecond rate) {
 #endif
 }
 
+size_t AllocateBatch(size_t size, void** out, size_t n) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_AllocateBatch != nullptr) {
+    return MallocExtension_Internal_AllocateBatch(size, out, n);
+  }
+#endif
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = ::operator new(size, std::nothrow);
+    if (out[i] == nullptr) {
+      return i;
+    }
+  }
+  return n;
+}
+
+void DeallocateBatch(void** ptrs, size_t n, size_t size) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_DeallocateBatch != nullptr) {
+    MallocExtension_Internal_DeallocateBatch(ptrs, n, size);
+    return;
+  }
+#endif
+  for (size_t i = 0; i < n; ++i) {
+    ::operator delete(ptrs[i], size);
+  }
+}
+
+size_t GoodSize(size_t min_size, size_t growth_hint) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GoodSize != nullptr) {
+    return MallocExtension_Internal_GoodSize(min_size, growth_hint);
+  }
+#endif
+  return nallocx(std::max(min_size, growth_hint), 0);
+}
+
+namespace {
+
+// Without TCMalloc, a region is a list of separately allocated objects.
+struct FallbackRegionObject {
+  FallbackRegionObject* next;
+  void* ptr;
+  size_t size;
+  size_t alignment;
+};
+
+void FreeFallbackRegion(void* region) {
+  auto* object = static_cast<FallbackRegionObject*>(region);
+  while (object != nullptr) {
+    FallbackRegionObject* next = object->next;
+    ::operator delete(object->ptr, object->size,
+                      static_cast<std::align_val_t>(object->alignment));
+    delete object;
+    object = next;
+  }
+}
+
+}  // namespace
+
+namespace {
+
+// The scratch region of a thread.  ScratchBuffers bump top_, and pop it back
+// when destroyed in reverse order.
+class ScratchStack {
+ public:
+  static constexpr size_t kSize = size_t{64} << 10;
+
+  constexpr ScratchStack() = default;
+  ~ScratchStack() {
+    // Buffers outliving the thread's other thread_locals keep the region.
+    if (base_ != nullptr && live_ == 0) ::operator delete(base_, kSize);
+    base_ = nullptr;
+  }
+
+  // Returns nullptr if `size` bytes do not fit.
+  void* absl_nullable Push(size_t size) {
+    if (size > kSize) return nullptr;
+    size = (size + alignof(std::max_align_t) - 1) &
+           ~(alignof(std::max_align_t) - 1);
+    if (ABSL_PREDICT_FALSE(base_ == nullptr)) {
+      base_ = static_cast<char*>(::operator new(kSize, std::nothrow));
+      if (base_ == nullptr) return nullptr;
+    }
+    if (size > kSize - top_) return nullptr;
+    void* ptr = base_ + top_;
+    top_ += size;
+    ++live_;
+    return ptr;
+  }
+
+  void Pop(void* absl_nonnull ptr, size_t size) {
+    size = (size + alignof(std::max_align_t) - 1) &
+           ~(alignof(std::max_align_t) - 1);
+    assert(live_ > 0);
+    assert(static_cast<char*>(ptr) >= base_ &&
+           static_cast<char*>(ptr) < base_ + kSize);
+    if (--live_ == 0) {
+      top_ = 0;
+    } else if (static_cast<char*>(ptr) + size == base_ + top_) {
+      top_ = static_cast<char*>(ptr) - base_;
+    }
+  }
+
+ private:
+  char* absl_nullable base_ = nullptr;
+  size_t top_ = 0;
+  size_t live_ = 0;
+};
+
+#ifndef TCMALLOC_UNDER_SANITIZERS
+ABSL_CONST_INIT thread_local ScratchStack scratch_stack;
+#endif
+
+}  // namespace
+
+ScratchBuffer::ScratchBuffer(size_t size) : size_(size), scratch_(false) {
+#ifndef TCMALLOC_UNDER_SANITIZERS
+  void* ptr = scratch_stack.Push(size);
+  if (ABSL_PREDICT_TRUE(ptr != nullptr)) {
+    data_ = ptr;
+    scratch_ = true;
+    return;
+  }
+#endif
+  // Sanitizers only catch overflows of buffers that are allocated separately.
+  data_ = ::operator new(size);
+}
+
+ScratchBuffer::~ScratchBuffer() {
+#ifndef TCMALLOC_UNDER_SANITIZERS
+  if (ABSL_PREDICT_TRUE(scratch_)) {
+    scratch_stack.Pop(data_, size_);
+    return;
+  }
+#endif
+  ::operator delete(data_, size_);
+}
+
+Region::~Region() {
+  if (impl_ == nullptr) return;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_RegionDestroy != nullptr) {
+    MallocExtension_Internal_RegionDestroy(impl_);
+    return;
+  }
+#endif
+  FreeFallbackRegion(impl_);
+}
+
+void* Region::Allocate(size_t size, size_t alignment) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_RegionAllocate != nullptr) {
+    return MallocExtension_Internal_RegionAllocate(&impl_, size, alignment);
+  }
+#endif
+  auto* object = new (std::nothrow) FallbackRegionObject;
+  if (object == nullptr) return nullptr;
+  object->ptr = ::operator new(size, static_cast<std::align_val_t>(alignment),
+                               std::nothrow);
+  if (object->ptr == nullptr) {
+    delete object;
+    return nullptr;
+  }
+  object->next = static_cast<FallbackRegionObject*>(impl_);
+  object->size = size;
+  object->alignment = alignment;
+  impl_ = object;
+  return object->ptr;
+}
+
+void Region::Reset() {
+  if (impl_ == nullptr) return;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_RegionReset != nullptr) {
+    MallocExtension_Internal_RegionReset(impl_);
+    return;
+  }
+#endif
+  FreeFallbackRegion(impl_);
+  impl_ = nullptr;
+}
+
+PersistentRegion::AttachResult PersistentRegion::Attach(const char* path,
+                                                        void* address,
+                                                        size_t size) {
+  assert(impl_ == nullptr);
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_PersistentRegionAttach != nullptr) {
+    return static_cast<AttachResult>(
+        MallocExtension_Internal_PersistentRegionAttach(path, address, size,
+                                                        &impl_));
+  }
+#endif
+  return AttachResult::kFailed;
+}
+
+// The remaining methods are only reachable once Attach() has succeeded, which
+// implies that TCMalloc is linked in.
+
+void PersistentRegion::Detach() {
+  if (impl_ == nullptr) return;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  MallocExtension_Internal_PersistentRegionDetach(impl_);
+#endif
+  impl_ = nullptr;
+}
+
+void* PersistentRegion::Allocate(size_t size, size_t alignment) {
+  assert(impl_ != nullptr);
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  return MallocExtension_Internal_PersistentRegionAllocate(impl_, size,
+                                                           alignment);
+#else
+  return nullptr;
+#endif
+}
+
+void PersistentRegion::Deallocate(void* ptr, size_t size, size_t alignment) {
+  assert(impl_ != nullptr);
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  MallocExtension_Internal_PersistentRegionDeallocate(impl_, ptr, size,
+                                                      alignment);
+#endif
+}
+
+void* PersistentRegion::root() const {
+  assert(impl_ != nullptr);
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  return MallocExtension_Internal_PersistentRegionRoot(impl_);
+#else
+  return nullptr;
+#endif
+}
+
+void PersistentRegion::set_root(void* root) {
+  assert(impl_ != nullptr);
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  MallocExtension_Internal_PersistentRegionSetRoot(impl_, root);
+#endif
+}
+
+bool SharedRegion::Attach(int fd, void* address, size_t size) {
+  assert(impl_ == nullptr);
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SharedRegionAttach != nullptr) {
+    impl_ = MallocExtension_Internal_SharedRegionAttach(fd, address, size);
+    return impl_ != nullptr;
+  }
+#endif
+  return false;
+}
+
+// As for PersistentRegion, the remaining methods are only reachable once
+// Attach() has succeeded.
+
+void SharedRegion::Detach() {
+  if (impl_ == nullptr) return;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  MallocExtension_Internal_SharedRegionDetach(impl_);
+#endif
+  impl_ = nullptr;
+}
+
+void* SharedRegion::Allocate(size_t size, size_t alignment) {
+  assert(impl_ != nullptr);
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  return MallocExtension_Internal_SharedRegionAllocate(impl_, size, alignment);
+#else
+  return nullptr;
+#endif
+}
+
+void SharedRegion::Deallocate(void* ptr, size_t size, size_t alignment) {
+  assert(impl_ != nullptr);
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  MallocExtension_Internal_SharedRegionDeallocate(impl_, ptr, size, alignment);
+#endif
+}
+
+bool ReserveSignalSafeMemory(size_t bytes) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_ReserveSignalSafeMemory != nullptr) {
+    return MallocExtension_Internal_ReserveSignalSafeMemory(bytes);
+  }
+#endif
+  return false;
+}
+
+void* SignalSafeAllocate(size_t size) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SignalSafeAllocate != nullptr) {
+    return MallocExtension_Internal_SignalSafeAllocate(size);
+  }
+#endif
+  return nullptr;
+}
+
+void SignalSafeFree(void* ptr) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  // Only reachable with memory from SignalSafeAllocate(), so the stub exists.
+  MallocExtension_Internal_SignalSafeFree(ptr);
+#endif
+}
+
 }  // namespace tcmalloc
 
 // Default implementation just returns size. The expectation is that
@@ -768,6 +1382,16 @@ tcmalloc_size_returning_operator_new_hot_cold_nothrow(size_t size,
   return {p, p ? size : 0};
 }
 
+ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE void* tcmalloc_new_with_class_index(
+    size_t size, size_t) noexcept(false) {
+  return ::operator new(size);
+}
+
+ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE tcmalloc::sized_ptr_t
+__size_returning_new_lifetime(size_t size, tcmalloc::lifetime_t) {
+  return {::operator new(size), size};
+}
+
 #if defined(_LIBCPP_VERSION) && defined(__cpp_aligned_new)
 
 ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE tcmalloc::sized_ptr_t
@@ -817,6 +1441,26 @@ ABSL_ATTRIBUTE_WEAK void* operator new[](size_t size, const std::nothrow_t&,
   return ::operator new[](size, std::nothrow);
 }
 
+ABSL_ATTRIBUTE_WEAK void* operator new(size_t size,
+                                       tcmalloc::lifetime_t) noexcept(false) {
+  return ::operator new(size);
+}
+
+ABSL_ATTRIBUTE_WEAK void* operator new(size_t size, const std::nothrow_t&,
+                                       tcmalloc::lifetime_t) noexcept {
+  return ::operator new(size, std::nothrow);
+}
+
+ABSL_ATTRIBUTE_WEAK void* operator new[](size_t size,
+                                         tcmalloc::lifetime_t) noexcept(false) {
+  return ::operator new[](size);
+}
+
+ABSL_ATTRIBUTE_WEAK void* operator new[](size_t size, const std::nothrow_t&,
+                                         tcmalloc::lifetime_t) noexcept {
+  return ::operator new[](size, std::nothrow);
+}
+
 #ifdef __cpp_aligned_new
 ABSL_ATTRIBUTE_WEAK void* operator new(size_t size, std::align_val_t alignment,
                                        tcmalloc::hot_cold_t) noexcept(false) {
@@ -33,6 +33,7 @@
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/base/macros.h"
@@ -58,14 +59,45 @@
 // 255 - The allocation is accessed very frequently.
 enum class __hot_cold_t : uint8_t;
 
-// TODO(ckennelly): Lifetimes
-
 namespace tcmalloc {
 
 // Alias to the newer type in the global namespace, so that existing code works
 // as is.
 using hot_cold_t = __hot_cold_t;
 
+// Tag for the operator new overloads below that return memory whose pages are
+// already faulted in, so that first touching them during latency-critical work
+// does not take a page fault per page.  This is only a hint: the page heap
+// prefers memory that is already backed and otherwise populates large
+// allocations up front, which costs the same faults, just earlier.  Small
+// allocations are returned as is.
+struct prefault_t {
+  explicit prefault_t() = default;
+};
+inline constexpr prefault_t prefault{};
+
+// Identifies the NUMA node that the numa_node_t overloads of operator new below
+// should allocate from, regardless of which node the calling CPU belongs to.
+// This is useful for buffers consumed by a device attached to a particular
+// node.  The request is routed to the NUMA partition containing the node, so it
+// only takes effect when NUMA awareness is enabled; otherwise memory comes from
+// the single, shared partition.  Such allocations are freed as usual.
+enum class numa_node_t : uint8_t {};
+
+// Indicates how long an allocation is expected to live, for the lifetime_t
+// overloads of operator new below.  TCMalloc otherwise predicts lifetimes from
+// sampled allocations; an explicit hint lets callers that know better, e.g.
+// for request-scoped buffers or cache-resident entries, say so up front.
+// Short-lived page-sized allocations are placed on hugepages set aside for
+// them, so that they do not pin hugepages holding long-lived memory once they
+// are freed.  For smaller objects the hint votes for the lifetime of the
+// object's size class whenever the allocation is sampled.  Such allocations are
+// freed as usual.
+enum class lifetime_t : uint8_t {
+  kShortLived = 1,
+  kLongLived = 2,
+};
+
 #if ABSL_HAVE_ATTRIBUTE(malloc_span)
 #define TCMALLOC_ATTRIBUTE_MALLOC_SPAN __attribute__((malloc_span))
 #else
@@ -165,6 +197,33 @@ enum class ProfileType {
   // Lifetimes of sampled objects that are live during the profiling session.
   kLifetimes,
 
+  // Sample of contended acquisitions of TCMalloc's internal locks (the page
+  // heap, central freelist and transfer cache locks).  For these samples, sum
+  // is the estimated time spent waiting in nanoseconds and count is the
+  // estimated number of contended acquisitions.
+  kLockContention,
+
+  // Sample of live objects, each charged the memory that is unused but held
+  // on its behalf: for objects from size classes, a share of the free objects
+  // of their spans and of the free pages of the page heap; for larger objects,
+  // the rounding up of their spans and a share of the free but backed pages of
+  // the hugepages they sit on.  For these samples, sum is the estimated unused
+  // bytes and count is the estimated number of objects.
+  kRealizedFragmentation,
+
+  // Sampled objects that have been live for longer than
+  // TCMALLOC_LEAK_CANDIDATE_MIN_AGE_SECONDS, with one sample per allocation
+  // stack.  For these samples, sum and count cover the old objects of the
+  // stack, allocation_time is that of the oldest, and growth_rate is how fast
+  // sum changed since the previous kLeakCandidates profile.
+  kLeakCandidates,
+
+  // The most recent allocations whose slow path took longer than
+  // TCMALLOC_SLOW_ALLOCATION_THRESHOLD_US.  For these samples, sum is the time
+  // the allocation took in nanoseconds, count is 1, and slow_allocation_cause
+  // is what most of that time went to.
+  kSlowAllocations,
+
   // Only present to prevent switch statements without a default clause so that
   // we can extend this enumeration without breaking code.
   kDoNotUse,
@@ -226,6 +285,42 @@ class Profile final {
     // The token id which is used to determine the partition.
     TokenId token_id;
 
+    // The tenant of the allocating thread, see
+    // MallocExtension::SetCurrentTenant.
+    uint32_t tenant = 0;
+
+    // The mean number of bytes between samples when this sample was taken, or
+    // 0 if unknown.  The interval varies over time when
+    // TCMALLOC_PROFILE_SAMPLING_TARGET_RATE is set; sum and count already
+    // account for it.
+    int64_t sampling_interval = 0;
+
+    // For ProfileType::kLeakCandidates, the change of sum since the previous
+    // profile of that type, in bytes per second.  0 for the first profile and
+    // for other types.
+    int64_t growth_rate = 0;
+
+    // What an allocation of a ProfileType::kSlowAllocations profile spent most
+    // of its time on.
+    enum class SlowAllocationCause : uint8_t {
+      // None of the below, such as refilling caches from spans.
+      kOther,
+      // Waiting for one of TCMalloc's internal locks.
+      kLockWait,
+      // Mapping new memory from the operating system.
+      kSystemAllocation,
+      // Backing released memory again, including faulting it in.
+      kPageBacking,
+      // Falling back to the central caches while the per-CPU slabs were
+      // being resized.
+      kSlabResize,
+
+      // Only present to prevent switch statements without a default clause so
+      // that we can extend this enumeration without breaking code.
+      kDoNotUse,
+    };
+    SlowAllocationCause slow_allocation_cause = SlowAllocationCause::kOther;
+
     // Whether this sample captures allocations where the deallocation event
     // was not observed. Thus the measurements are censored in the statistical
     // sense, see https://en.wikipedia.org/wiki/Censoring_(statistics)#Types.
@@ -312,6 +407,11 @@ class Profile final {
   // (heap, peakheap, etc.), this returns absl::ZeroDuration().
   absl::Duration Duration() const;
 
+  // Fingerprint of the experiments active in the process that collected the
+  // profile, or 0 if none was active.  Profiles with the same ID were
+  // collected under the same experiment arm.
+  uint64_t ExperimentId() const;
+
  private:
   explicit Profile(std::unique_ptr<const tcmalloc_internal::ProfileBase>);
 
@@ -401,6 +501,103 @@ class MallocExtension final {
   // statistics.
   [[nodiscard]] static std::string GetStats();
 
+  // A fixed-layout copy of the main counters behind GetStats(), in bytes.
+  struct StatsSnapshot {
+    // Where memory is held, as in the summary at the top of GetStats().
+    uint64_t in_use_by_app;
+    uint64_t page_heap_free;
+    uint64_t page_heap_unmapped;
+    uint64_t central_cache_free;
+    uint64_t per_cpu_cache_free;
+    uint64_t sharded_transfer_cache_free;
+    uint64_t transfer_cache_free;
+    uint64_t thread_cache_free;
+    uint64_t metadata;
+    uint64_t physical_memory_used;
+    uint64_t virtual_memory_used;
+
+    // Memory held by each part of the hugepage-aware page heap, summed over
+    // its memory tags and partitions.
+    struct PageHeapComponent {
+      uint64_t system;    // Address space backing the component
+      uint64_t free;      // Backed but not allocated
+      uint64_t unmapped;  // Released to the OS
+    };
+    PageHeapComponent huge_page_filler;
+    PageHeapComponent huge_region_set;
+    PageHeapComponent huge_cache;
+
+    // Total memory released to the OS since startup.
+    uint64_t released_total;
+  };
+
+  // Returns a snapshot of the counters behind GetStats().  Unlike GetStats(),
+  // this does no formatting and only holds TCMalloc's page heap lock while
+  // copying the page heap's counters, so it is cheap enough to call from a
+  // monitoring agent that scrapes often.  Returns all zeros if the
+  // implementation does not support it.
+  [[nodiscard]] static StatsSnapshot GetStatsSnapshot();
+
+  // Writes the counters of GetStatsSnapshot(), the page heap broken down by
+  // memory tag and NUMA partition, and the free bytes of each cache tier
+  // broken down by size class, to `buffer` in the OpenMetrics text format.
+  // Metric names and labels are stable.
+  //
+  // Does not allocate, so it can be called from a metrics thread at high
+  // frequency.  Returns the length of the full output; if that is not less
+  // than buffer.size(), the output was truncated and the call should be
+  // retried with a larger buffer.  Returns 0 if the implementation does not
+  // support it.
+  static size_t GetStatsInOpenMetrics(absl::Span<char> buffer);
+
+  // The most used numeric properties, for callers that check them on every
+  // request.
+  struct HotStats {
+    // "generic.current_allocated_bytes"
+    size_t current_allocated_bytes;
+    // "generic.heap_size"
+    size_t heap_size;
+    // "generic.physical_memory_used"
+    size_t physical_memory_used;
+    // "tcmalloc.pageheap_free_bytes"
+    size_t page_heap_free;
+    // "tcmalloc.pageheap_unmapped_bytes"
+    size_t page_heap_unmapped;
+    // "tcmalloc.per_cpu_caches_active"
+    bool per_cpu_caches_active;
+  };
+
+  // Returns the most used numeric properties without taking any locks, in
+  // tens of nanoseconds.  The properties are copied whenever TCMalloc gathers
+  // its stats, which its background thread does every ten
+  // GetBackgroundProcessSleepInterval()s, and current_allocated_bytes is
+  // further adjusted by the large allocations made and freed since.  Use
+  // GetNumericProperty() for exact values.  Returns all zeros if the
+  // implementation does not support it.
+  [[nodiscard]] static HotStats GetHotStats();
+
+  // Where TCMalloc's memory is held, as a tree.  Each node's bytes are the sum
+  // of its children's, if it has any.
+  //
+  // The root, "tcmalloc", approximates physical_memory_used.  Its children are
+  // "in_use_by_app", "caches" with one child per cache tier, "page_heap" for
+  // the free pages that are still backed, with one child per memory tag and
+  // partition (named like "normal_p1"), each in turn split into its "filler",
+  // "region_set" and "cache" components, and "metadata".
+  struct MemoryBreakdown {
+    std::string name;
+    uint64_t bytes = 0;
+    // The part of `bytes` that ReleaseMemoryToSystem() can return to the OS.
+    uint64_t reclaimable_bytes = 0;
+    std::vector<MemoryBreakdown> children;
+  };
+
+  // Returns the tree described above.  The cache tiers are read without
+  // locks, and TCMalloc's page heap lock is only held while copying the page
+  // heap's counters, so the nodes may be slightly inconsistent with each
+  // other.  Returns an empty tree if the implementation does not support it.
+  [[nodiscard]] static MemoryBreakdown GetMemoryBreakdown();
+
   // -------------------------------------------------------------------
   // Control operations for getting malloc implementation specific parameters.
   // Some currently useful properties:
@@ -464,6 +661,93 @@ class MallocExtension final {
   // not called, performance may suffer.
   static void MarkThreadBusy();
 
+  // Hints that the calling thread, a worker running a user-space scheduler
+  // such as a fiber scheduler, is about to park, e.g. in epoll, for about
+  // `expected`.  The CPU it last allocated on may then have its per-CPU cache
+  // drained, lazily where possible, rather than keep its objects until the
+  // cache is found idle.  Parks shorter than the background thread's sleep
+  // interval are ignored.  Unlike MarkThreadIdle(), this is cheap enough to
+  // call on every park, and needs no matching call when the worker wakes up.
+  static void MarkCpuParking(absl::Duration expected);
+
+  // Protects the per-CPU caches of `cpus`, e.g. cores reserved for
+  // latency-critical threads, and stops protecting any other CPU.  The
+  // capacity of a protected CPU's cache is never moved to other CPUs below
+  // the per-CPU cache limit, its cache is not drained when idle or on
+  // MarkCpuParking(), and it is grown before other CPUs when capacity is
+  // shuffled between CPUs.  Invalid CPU ids are ignored.  The initial set may
+  // also be given as a cpulist, e.g. "2-5,8", in TCMALLOC_PROTECTED_CPUS.
+  static void SetProtectedCpus(absl::Span<const int> cpus);
+
+  // Returns the protected CPUs, in increasing order.
+  static std::vector<int> GetProtectedCpus();
+
+  // Called with the `arg` given to SetThreadAllocationBudget() and the bytes
+  // counted against the budget so far.
+  using AllocationBudgetCallback = void (*)(void* arg, size_t allocated_bytes);
+
+  // Starts counting the bytes the calling thread allocates, e.g. while serving
+  // a request, against a budget of `bytes`, replacing any previous budget of
+  // the thread.  Once the count exceeds the budget, `callback` is invoked once
+  // on the thread, from within the allocation that crossed it.  It may
+  // allocate, but should be cheap, e.g. flag the request to be shed.
+  //
+  // The count is kept without touching the allocation fast path, so it is
+  // only brought up to date every few hundred KiB.  The callback may run that
+  // much later than the budget was crossed, but never earlier.  To budget
+  // bytes per unit of time, set the budget again at the start of each period.
+  //
+  // Does nothing for malloc implementations that do not support budgets.
+  static void SetThreadAllocationBudget(size_t bytes,
+                                        AllocationBudgetCallback callback,
+                                        void* arg);
+
+  // Stops counting the calling thread's allocations.
+  static void ClearThreadAllocationBudget();
+
+  // Returns the bytes the calling thread allocated since its budget was set,
+  // or nullopt if it has none.
+  [[nodiscard]] static std::optional<size_t> GetThreadAllocatedBytes();
+
+  // Tenants attribute the memory of a multi-tenant server, e.g. one tenant per
+  // customer.  Threads allocate for a tenant while inside a ScopedTenant.
+  using TenantId = uint32_t;
+  static constexpr TenantId kNoTenant = 0;
+
+  struct TenantStats {
+    TenantId tenant;
+    // Estimated from sampled allocations, like heap profiles.
+    size_t live_bytes;
+    size_t allocated_bytes;
+    // The limit set by SetTenantLimit(), or 0 if none.
+    size_t limit;
+    // How many times live_bytes went over the limit.
+    size_t limit_exceeded;
+  };
+
+  // Makes the calling thread allocate for `tenant`, and returns the tenant it
+  // allocated for before.  ScopedTenant is usually more convenient.
+  //
+  // Only sampled allocations look at the tenant, so this does not slow down
+  // allocations.  Memory freed by another tenant is still credited to the
+  // tenant that allocated it.  Heap profiles report the tenant of each sample.
+  static TenantId SetCurrentTenant(TenantId tenant);
+
+  // Returns the tenant the calling thread allocates for.
+  [[nodiscard]] static TenantId GetCurrentTenant();
+
+  // Sets a limit of `bytes` live bytes for `tenant`, or removes it if 0.
+  // Nothing is enforced by the allocator: admission control would check
+  // IsTenantOverLimit() before taking on work for a tenant.
+  static void SetTenantLimit(TenantId tenant, size_t bytes);
+
+  // Returns whether the estimated live bytes of `tenant` exceed its limit.
+  [[nodiscard]] static bool IsTenantOverLimit(TenantId tenant);
+
+  // Returns the statistics of every tenant that allocated or has a limit.
+  // At most a few hundred tenants are tracked.
+  [[nodiscard]] static std::vector<TenantStats> GetTenantStats();
+
   // Attempts to free any resources associated with cpu <cpu> (in the sense of
   // only being usable from that CPU.)  Returns the number of bytes previously
   // assigned to "cpu" that were freed.  Safe to call from any processor, not
@@ -505,6 +789,36 @@ class MallocExtension final {
   //   back in.
   static void ReleaseMemoryToSystem(size_t num_bytes);
 
+  // What a Defragment() call did.
+  struct DefragmentationStats {
+    // Sparse spans whose objects were offered to the relocator.
+    size_t spans = 0;
+    // Objects offered to the relocator, and their bytes.
+    size_t objects_offered = 0;
+    size_t bytes_offered = 0;
+    // Objects the relocator moved, and their bytes.
+    size_t objects_relocated = 0;
+    size_t bytes_relocated = 0;
+  };
+
+  // Called by Defragment() with the address and size of an object that
+  // TCMalloc would like moved.  If ptr is a live allocation of the
+  // application that it can move, the relocator allocates a new copy,
+  // redirects its references to it, frees ptr and returns true.  Otherwise it
+  // returns false without touching ptr: the object may be free, held by one of
+  // TCMalloc's caches, or owned by another part of the program.  size is the
+  // size of ptr's size class when it was chosen.
+  using Relocator = absl::FunctionRef<bool(void* ptr, size_t size)>;
+
+  // Asks the application to move objects out of the least occupied spans of
+  // each size class, so that the spans empty and their memory can be
+  // released.  Offers at most budget bytes of objects to relocator, which is
+  // called without any of TCMalloc's locks held.  Objects that sit in
+  // TCMalloc's caches keep their spans in use until the caches drain, e.g.
+  // after ReleaseCpuMemory(), and the memory of emptied spans is returned to
+  // the OS by ReleaseMemoryToSystem() or the background thread.
+  static DefragmentationStats Defragment(Relocator relocator, size_t budget);
+
   enum class LimitKind { kSoft, kHard };
 
   // Make a best effort attempt to prevent more than limit bytes of memory
@@ -517,6 +831,70 @@ class MallocExtension final {
   static size_t GetMemoryLimit(LimitKind limit_kind);
   static void SetMemoryLimit(size_t limit, LimitKind limit_kind);
 
+  enum class MemoryPressureSeverity { kNone, kModerate, kCritical };
+
+  // What a memory pressure callback is told.
+  struct MemoryPressureEvent {
+    MemoryPressureSeverity severity = MemoryPressureSeverity::kNone;
+    // Memory backing the heap, including TCMalloc's metadata.
+    size_t heap_bytes = 0;
+    // The soft memory limit, or std::numeric_limits<size_t>::max() if unset.
+    size_t soft_limit = 0;
+    // Share of the last 10 seconds during which some task of the cgroup
+    // stalled on memory, in percent, if known.
+    std::optional<double> some_avg10;
+  };
+
+  // Called with the `arg` given to AddMemoryPressureCallback().
+  using MemoryPressureCallback = void (*)(void* arg,
+                                          const MemoryPressureEvent& event);
+
+  // Registers `callback` to be told when memory gets tight, so that the
+  // application can drop its own caches before TCMalloc has to release, and
+  // later re-fault, the memory it caches.  Severity is kModerate once the heap
+  // reaches `moderate_fraction` of the soft limit, or some task stalled on
+  // memory for 10% of the last 10 seconds, and kCritical once it reaches
+  // `critical_fraction` of the soft limit, or tasks stalled 40% of the time.
+  //
+  // The callback runs on the thread running ProcessBackgroundActions(), when
+  // the severity rises, and again every 10 seconds while it stays above
+  // kNone.  It may allocate and free, but should not block for long, as
+  // background actions wait for it.  Returns false if too many callbacks are
+  // registered, or if the malloc implementation does not support them.
+  static bool AddMemoryPressureCallback(MemoryPressureCallback callback,
+                                        void* arg,
+                                        double moderate_fraction = 0.8,
+                                        double critical_fraction = 0.95);
+
+  // Unregisters a callback registered with the same `callback` and `arg`.  It
+  // may still be running on the background thread when this returns.
+  static void RemoveMemoryPressureCallback(MemoryPressureCallback callback,
+                                           void* arg);
+
+  // Allocates `size` bytes of pinned memory, for I/O buffers registered with
+  // io_uring (IORING_REGISTER_BUFFERS) or RDMA NICs.  Pinned memory is
+  // mlock()ed in whole hugepages, which are never released to the system.  The
+  // result is aligned to TCMalloc's page size, and must be freed with
+  // FreePinned(), not free().  Returns nullptr if `size` is 0 or above 1 GiB,
+  // if the memory could not be locked (see RLIMIT_MEMLOCK), or if the malloc
+  // implementation does not support pinned memory.
+  static void* AllocatePinned(size_t size);
+
+  // Frees `ptr`, returned by AllocatePinned(size).  Its hugepages stay pinned
+  // for later buffers.
+  static void FreePinned(void* ptr, size_t size);
+
+  // Called with the `arg` given to SetPinnedMemoryCallback() for a range of
+  // hugepages added to the pinned memory.
+  using PinnedMemoryCallback = void (*)(void* arg, void* start, size_t length);
+
+  // Sets the callback told of the hugepages pinned so far, and then of the
+  // hugepages added to the pinned memory before any buffer in them is handed
+  // out, so that the application can register them for zero-copy I/O.  The
+  // callback runs with pinned allocations blocked, so it may allocate but must
+  // not call AllocatePinned() or FreePinned().  A null `callback` unsets it.
+  static void SetPinnedMemoryCallback(PinnedMemoryCallback callback, void* arg);
+
   // Gets the sampling interval.  Returns a value < 0 if unknown.
   static int64_t GetProfileSamplingInterval();
   // Sets the sampling interval for heap profiles.  TCMalloc samples
@@ -546,6 +924,25 @@ class MallocExtension final {
   // Sets the maximum cache size per CPU cache.  This is a per-core limit.
   static void SetMaxPerCpuCacheSize(int32_t value);
 
+  // Gets the current maximum cache size per CPU cache for cold-hinted
+  // allocations, or 0 if they share the limit above.
+  static int32_t GetMaxPerCpuColdCacheSize();
+  // Sets the maximum cache size per CPU cache for cold-hinted allocations.  If
+  // nonzero before per-CPU caches are activated (for example via
+  // TCMALLOC_MAX_PER_CPU_COLD_CACHE_SIZE), cold-hinted allocations get their
+  // own per-core budget that does not compete with the limit above.
+  static void SetMaxPerCpuColdCacheSize(int32_t value);
+
+  // Returns a small text profile of the steady-state per-CPU cache capacity of
+  // each size class, or the empty string if per-CPU caches are not active.
+  //
+  // If a later process is started with TCMALLOC_PER_CPU_CAPACITY_PROFILE set
+  // to the path of a file holding this profile, its per-CPU caches start at
+  // these capacities rather than growing from zero.  Setting
+  // TCMALLOC_PER_CPU_CAPACITY_PROFILE_PREFILL=1 additionally fills each cache
+  // with a batch of objects when it is first used.
+  [[nodiscard]] static std::string GetPerCpuCapacityProfile();
+
   // Gets the current maximum thread cache.
   static int64_t GetMaxTotalThreadCacheBytes();
   // Sets the maximum thread cache size.  This is a whole-process limit.
@@ -637,8 +1034,85 @@ class MallocExtension final {
   using PropertyMap = std::map<std::string, Property, std::less<>>;
   [[nodiscard]] static PropertyMap GetProperties();
 
+  // Allocation traffic during one epoch of GetAllocationRateHistory.  Counts
+  // are estimated from sampled allocations, as for heap profiles, so they are
+  // only meaningful in aggregate.
+  struct AllocationRateEpoch {
+    absl::Time start;
+    absl::Duration duration;
+
+    struct SizeClass {
+      // Size of the objects of the size class, or 0 for allocations larger
+      // than the largest size class, whose sizes vary.
+      size_t size;
+      // Heap partition (e.g. NUMA node) of the size class.
+      int partition;
+      // Whether this is a size class for cold (hinted) allocations.
+      bool cold;
+
+      uint64_t allocated_objects;
+      uint64_t allocated_bytes;
+      uint64_t freed_objects;
+      uint64_t freed_bytes;
+    };
+    // Only the size classes allocated from or freed to during the epoch.
+    std::vector<SizeClass> size_classes;
+
+    struct AllocToken {
+      TokenId token_id;
+      uint64_t allocated_bytes;
+      uint64_t freed_bytes;
+    };
+    // Only the alloc tokens allocated from or freed to during the epoch.
+    std::vector<AllocToken> alloc_tokens;
+  };
+
+  // Returns the allocation traffic per size class and per alloc token over
+  // the last hour, in 10-second epochs, oldest first.  Returns an empty history unless
+  // TCMALLOC_ALLOCATION_RATE_HISTORY=1, as keeping it takes up to 1 MiB.
+  [[nodiscard]] static std::vector<AllocationRateEpoch>
+  GetAllocationRateHistory();
+
   [[nodiscard]] static Profile SnapshotCurrent(tcmalloc::ProfileType type);
 
+  // Returns ProfileType::kPeakHeap profiles of the largest peaks of the heap
+  // reached in [start, end), largest first, each starting at the time of its
+  // peak.  Up to 4 peaks are kept for each of the last 24 time buckets, so
+  // this returns nothing unless the buckets are enabled with
+  // TCMALLOC_PEAK_HEAP_BUCKET_SECONDS (e.g. 3600 for hourly peaks).
+  [[nodiscard]] static std::vector<Profile> SnapshotPeakHeaps(absl::Time start,
+                                                              absl::Time end);
+
+  // HeapProfileCursor remembers which heap samples previous calls to
+  // SnapshotHeapDelta have reported, so that each call only reports what
+  // changed since.  A default-constructed cursor has seen nothing.  Not
+  // thread-safe.
+  class HeapProfileCursor {
+   public:
+    HeapProfileCursor() = default;
+
+   private:
+    // alloc_handle of each sample reported and not yet removed, sorted.
+    std::vector<MallocHook::AllocHandle> live_;
+    friend class MallocExtension;
+  };
+
+  struct HeapProfileDelta {
+    // The heap samples recorded since the cursor was last advanced, as a
+    // ProfileType::kHeap profile.
+    Profile added;
+    // The alloc_handle of each previously reported sample that has since been
+    // freed.
+    std::vector<MallocHook::AllocHandle> removed;
+  };
+
+  // Like SnapshotCurrent(ProfileType::kHeap), but only returns the samples
+  // added and removed since the last call with `cursor`, and advances it.
+  // This walks every sample, but only copies out the ones that are new, which
+  // keeps repeated collection much cheaper than a full snapshot.
+  [[nodiscard]] static HeapProfileDelta SnapshotHeapDelta(
+      HeapProfileCursor& cursor);
+
   // AllocationProfilingToken tracks an active profiling session started with
   // StartAllocationProfiling.  Profiling continues until Stop() is called.
   class AllocationProfilingToken {
@@ -684,6 +1158,27 @@ class MallocExtension final {
   // When linked against TCMalloc, this method does not return.
   static void ProcessBackgroundActions();
 
+  // Runs one slice of the actions of ProcessBackgroundActions, for
+  // applications that schedule their own housekeeping, e.g. on an executor,
+  // rather than dedicating a thread to it.  Optional actions, such as
+  // rebalancing the per-CPU caches, are skipped once budget is spent; memory
+  // is always released.  Does not block: returns at once if another thread is
+  // running background actions.
+  //
+  // Returns when the next slice should run, or absl::InfiniteFuture() when
+  // not linked against TCMalloc.  Do not mix with ProcessBackgroundActions.
+  static absl::Time RunBackgroundStep(absl::Duration budget);
+
+  // Runs a worker that releases memory on behalf of ProcessBackgroundActions,
+  // for heaps too large for a single thread to release from at the background
+  // release rate.  Each worker releases from one memory tag or NUMA partition
+  // at a time, so running more than one per NUMA node plus two gains little.
+  // The background release rate still bounds the total.
+  //
+  // When linked against TCMalloc, this method returns once background actions
+  // are disabled.
+  static void ProcessBackgroundReleaseWorker();
+
   // Return true if ProcessBackgroundActions should be called on this platform.
   // Not all platforms need/support background actions. As of 2021 this
   // includes Apple and Emscripten.
@@ -702,6 +1197,253 @@ class MallocExtension final {
   static void SetBackgroundReleaseRate(BytesPerSecond rate);
 };
 
+// Allocates up to `n` objects of `size` bytes each, storing them in `out`.
+// Each object behaves as if returned by `::operator new(size, std::nothrow)`
+// and may be freed individually or via DeallocateBatch.  Returns the number
+// of objects allocated, which is less than `n` only if memory is exhausted.
+//
+// When linked against TCMalloc, small requests are served from the current
+// CPU's cache in a single pass, which is considerably cheaper than `n`
+// separate calls.
+[[nodiscard]] size_t AllocateBatch(size_t size, void* absl_nonnull* out,
+                                   size_t n);
+
+// Frees the `n` objects in `ptrs`, each of which must have been allocated with
+// the given `size` (e.g. by AllocateBatch).  Null entries are ignored.  The
+// contents of `ptrs` are unspecified after this call.
+void DeallocateBatch(void* absl_nullable* ptrs, size_t n, size_t size);
+
+// Returns a capacity in bytes for a container that needs at least `min_size`
+// bytes and would like to grow to about `growth_hint` bytes, e.g. twice its
+// current capacity.  Of the sizes that `::operator new` actually hands out,
+// so that no memory is wasted to rounding, this is the one closest to
+// max(min_size, growth_hint) that is at least `min_size`.
+//
+// For example, a vector of 4000 bytes wanting to double picks 8192 bytes
+// rather than landing just past a size class boundary.
+[[nodiscard]] size_t GoodSize(size_t min_size, size_t growth_hint = 0);
+
+// Makes the calling thread allocate for `tenant` while in scope, see
+// MallocExtension::SetCurrentTenant.  Scopes may nest.
+//
+//   void HandleRequest(const Request& request) {
+//     tcmalloc::ScopedTenant tenant(request.customer_id());
+//     ...
+//   }
+class ScopedTenant {
+ public:
+  explicit ScopedTenant(MallocExtension::TenantId tenant)
+      : previous_(MallocExtension::SetCurrentTenant(tenant)) {}
+  ~ScopedTenant() { MallocExtension::SetCurrentTenant(previous_); }
+
+  ScopedTenant(const ScopedTenant&) = delete;
+  ScopedTenant& operator=(const ScopedTenant&) = delete;
+
+ private:
+  MallocExtension::TenantId previous_;
+};
+
+// A temporary buffer of `size` bytes, aligned to alignof(std::max_align_t),
+// for the scope of the ScratchBuffer.
+//
+// The buffers of a thread are carved from a small region of that thread with a
+// pointer bump, and handed back by destroying them in reverse order, so that
+// short-lived temporaries stay out of the size class caches.  Buffers larger
+// than what is left of the region are allocated with `::operator new`.
+// Destroying buffers out of order is allowed, but their space is only reused
+// once every buffer of the thread is gone.
+//
+// A ScratchBuffer must be destroyed by the thread that created it.
+//
+//   void Hash(absl::Span<const Row> rows) {
+//     tcmalloc::ScratchBuffer keys(rows.size() * sizeof(Key));
+//     ...
+//   }
+class ScratchBuffer {
+ public:
+  explicit ScratchBuffer(size_t size);
+  ~ScratchBuffer();
+
+  ScratchBuffer(const ScratchBuffer&) = delete;
+  ScratchBuffer& operator=(const ScratchBuffer&) = delete;
+
+  void* absl_nonnull data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  void* absl_nonnull data_;
+  size_t size_;
+  // Whether data_ comes from the thread's region.
+  bool scratch_;
+};
+
+// A Region hands out objects that are all freed together, when the region is
+// reset or destroyed, rather than one by one.  Objects must not be passed to
+// free/delete.  No destructors are run.
+//
+// When linked against TCMalloc, objects are carved from spans dedicated to the
+// region with a pointer bump, and resetting or destroying the region returns
+// those spans in bulk.  Sampled, large and overaligned objects are allocated
+// as usual (and so show up in heap profiles) and freed with the region.
+// MallocExtension::GetStats() reports the memory held by live regions.
+//
+// A Region is not thread-safe.
+class Region {
+ public:
+  Region() = default;
+  ~Region();
+
+  Region(const Region&) = delete;
+  Region& operator=(const Region&) = delete;
+
+  // Returns `size` bytes aligned to `alignment`, which must be a power of two,
+  // or nullptr if memory is exhausted.
+  [[nodiscard]] void* absl_nullable Allocate(
+      size_t size, size_t alignment = alignof(std::max_align_t));
+
+  // Frees every object allocated from the region.  The region remains usable.
+  void Reset();
+
+ private:
+  void* absl_nullable impl_ = nullptr;
+};
+
+// Experimental.  A PersistentRegion allocates objects from a file mapped at a
+// fixed address, so that they survive the process: a later process attaching
+// the same file at the same address finds them in place, with any pointers
+// between them still valid.  A cache kept in a PersistentRegion can thus be
+// re-adopted after a restart instead of being rebuilt.  The file would
+// typically live on a memory-backed filesystem (tmpfs or hugetlbfs).
+//
+// Objects must be freed with Deallocate(), never free/delete, and are not part
+// of the heap: they do not show up in heap profiles and GetOwnership()
+// reports them as not owned.  Objects are only persisted if the region is
+// detached (explicitly or by its destructor); a region left attached by a
+// crashed process is reinitialized on the next Attach().  Only one process can
+// attach a file at a time.
+//
+// Requires TCMalloc; otherwise Attach() fails.  PersistentRegion is
+// thread-safe.
+class PersistentRegion {
+ public:
+  enum class AttachResult {
+    // The file could not be opened, is attached elsewhere, or could not be
+    // mapped at the requested address.
+    kFailed,
+    // The region is new, or held nothing that could be re-adopted.
+    kCreated,
+    // The region holds the objects of a previous attach.
+    kReattached,
+  };
+
+  PersistentRegion() = default;
+  ~PersistentRegion() { Detach(); }
+
+  PersistentRegion(const PersistentRegion&) = delete;
+  PersistentRegion& operator=(const PersistentRegion&) = delete;
+
+  // Maps `size` bytes of the file at `path` at `address`, creating the file if
+  // it does not exist.  `address` and `size` must be multiples of 4 KiB, and
+  // the range must be unused.  Must not already be attached.
+  AttachResult Attach(const char* absl_nonnull path, void* absl_nonnull address,
+                      size_t size);
+
+  // Writes the region back to its file and unmaps it.  No-op if not attached.
+  void Detach();
+
+  bool attached() const { return impl_ != nullptr; }
+
+  // Returns `size` bytes aligned to `alignment`, which must be a power of two
+  // no larger than 4 KiB, or nullptr if the region is full.
+  [[nodiscard]] void* absl_nullable Allocate(
+      size_t size, size_t alignment = alignof(std::max_align_t));
+
+  // Frees an object from Allocate(), which must be passed the same size and
+  // alignment.
+  void Deallocate(void* absl_nonnull ptr, size_t size,
+                  size_t alignment = alignof(std::max_align_t));
+
+  // The object from which the application finds the others after
+  // reattaching, e.g. the cache's index.  nullptr until set.
+  void* absl_nullable root() const;
+  void set_root(void* absl_nullable root);
+
+ private:
+  void* absl_nullable impl_ = nullptr;
+};
+
+// Experimental.  A SharedRegion allocates objects from a file, typically a
+// memfd, that cooperating processes map at the same address at the same time.
+// A producer can thus build a message in place and pass a plain pointer to a
+// consumer in another process, which reads it without copying and frees it
+// once done.
+//
+// Every process attaches the file with the same address and size, e.g. the
+// memfd is created and attached before forking, or passed over a Unix socket.
+// Objects must be freed with Deallocate(), by any attached process, never with
+// free/delete, and are not part of the heap.  A process crashing in the middle
+// of Allocate() or Deallocate() may leave the region unusable for the others.
+//
+// Requires TCMalloc; otherwise Attach() fails.  SharedRegion is thread-safe.
+class SharedRegion {
+ public:
+  SharedRegion() = default;
+  ~SharedRegion() { Detach(); }
+
+  SharedRegion(const SharedRegion&) = delete;
+  SharedRegion& operator=(const SharedRegion&) = delete;
+
+  // Maps `size` bytes of the file `fd` at `address`, growing the file if
+  // needed.  `address` and `size` must be multiples of 4 KiB, and the range
+  // must be unused.  Returns false if the file cannot be mapped there, was
+  // attached elsewhere or with another size, or was left half formatted by a
+  // process that crashed while attaching it.  `fd` may be closed afterwards.
+  // Must not already be attached.
+  [[nodiscard]] bool Attach(int fd, void* absl_nonnull address, size_t size);
+
+  // Unmaps the region from this process.  No-op if not attached.
+  void Detach();
+
+  bool attached() const { return impl_ != nullptr; }
+
+  // Returns `size` bytes aligned to `alignment`, which must be a power of two
+  // no larger than 4 KiB, or nullptr if the region is full.
+  [[nodiscard]] void* absl_nullable Allocate(
+      size_t size, size_t alignment = alignof(std::max_align_t));
+
+  // Frees an object from Allocate() in any attached process, which must be
+  // passed the same size and alignment.
+  void Deallocate(void* absl_nonnull ptr, size_t size,
+                  size_t alignment = alignof(std::max_align_t));
+
+ private:
+  void* absl_nullable impl_ = nullptr;
+};
+
+// Experimental.  Memory for signal handlers, e.g. crash handlers that need to
+// build a report.  malloc is not async-signal-safe: a handler that interrupts
+// a thread holding an allocator lock deadlocks on it.  SignalSafeAllocate()
+// and SignalSafeFree() instead serve a pool reserved ahead of time, using
+// atomic operations only.
+//
+// ReserveSignalSafeMemory() asks for `bytes` of the pool to be kept
+// available, and is not itself async-signal-safe: call it at startup, e.g.
+// when installing the handler.  The first call reserves the pool's address
+// space.  The background thread (see ProcessBackgroundActions) tops the pool
+// up as it is used.  Returns false if the memory could not be reserved.
+//
+// Requires TCMalloc; otherwise ReserveSignalSafeMemory() fails.
+bool ReserveSignalSafeMemory(size_t bytes);
+
+// Returns `size` bytes aligned to 16 bytes, or nullptr if no memory was
+// reserved, the pool is exhausted, or `size` is larger than 64 KiB - 16.
+// Async-signal-safe.
+[[nodiscard]] void* absl_nullable SignalSafeAllocate(size_t size);
+
+// Frees memory from SignalSafeAllocate(); never pass it to free().
+// Async-signal-safe.
+void SignalSafeFree(void* absl_nonnull ptr);
+
 }  // namespace tcmalloc
 
 // The nallocx function allocates no memory, but it performs the same size
@@ -808,6 +1550,10 @@ inline __sized_ptr_t tcmalloc_size_returning_operator_new_hot_cold(
 __sized_ptr_t tcmalloc_size_returning_operator_new_hot_cold_nothrow(
     size_t size,
     tcmalloc::hot_cold_t hot_cold) noexcept TCMALLOC_ATTRIBUTE_MALLOC_SPAN;
+[[nodiscard]] __sized_ptr_t __size_returning_new_numa_node(
+    size_t size, tcmalloc::numa_node_t node) TCMALLOC_ATTRIBUTE_MALLOC_SPAN;
+[[nodiscard]] __sized_ptr_t __size_returning_new_lifetime(
+    size_t size, tcmalloc::lifetime_t lifetime) TCMALLOC_ATTRIBUTE_MALLOC_SPAN;
 
 #if defined(__cpp_aligned_new)
 
@@ -849,6 +1595,45 @@ void* absl_nonnull operator new[](
 void* absl_nullable operator new[](size_t size, const std::nothrow_t&,
                                    tcmalloc::hot_cold_t hot_cold) noexcept;
 
+[[nodiscard]]
+void* absl_nonnull operator new(size_t size,
+                                tcmalloc::prefault_t) noexcept(false);
+[[nodiscard]]
+void* absl_nullable operator new(size_t size, const std::nothrow_t&,
+                                 tcmalloc::prefault_t) noexcept;
+[[nodiscard]]
+void* absl_nonnull operator new[](size_t size,
+                                  tcmalloc::prefault_t) noexcept(false);
+[[nodiscard]]
+void* absl_nullable operator new[](size_t size, const std::nothrow_t&,
+                                   tcmalloc::prefault_t) noexcept;
+
+[[nodiscard]]
+void* absl_nonnull operator new(size_t size,
+                                tcmalloc::numa_node_t node) noexcept(false);
+[[nodiscard]]
+void* absl_nullable operator new(size_t size, const std::nothrow_t&,
+                                 tcmalloc::numa_node_t node) noexcept;
+[[nodiscard]]
+void* absl_nonnull operator new[](size_t size,
+                                  tcmalloc::numa_node_t node) noexcept(false);
+[[nodiscard]]
+void* absl_nullable operator new[](size_t size, const std::nothrow_t&,
+                                   tcmalloc::numa_node_t node) noexcept;
+
+[[nodiscard]]
+void* absl_nonnull operator new(size_t size,
+                                tcmalloc::lifetime_t lifetime) noexcept(false);
+[[nodiscard]]
+void* absl_nullable operator new(size_t size, const std::nothrow_t&,
+                                 tcmalloc::lifetime_t lifetime) noexcept;
+[[nodiscard]]
+void* absl_nonnull operator new[](
+    size_t size, tcmalloc::lifetime_t lifetime) noexcept(false);
+[[nodiscard]]
+void* absl_nullable operator new[](size_t size, const std::nothrow_t&,
+                                   tcmalloc::lifetime_t lifetime) noexcept;
+
 #ifdef __cpp_aligned_new
 [[nodiscard]]
 void* absl_nonnull operator new(size_t size, std::align_val_t alignment,
@@ -867,6 +1652,46 @@ void* absl_nullable operator new[](size_t size, std::align_val_t alignment,
                                    tcmalloc::hot_cold_t hot_cold) noexcept;
 #endif  // __cpp_aligned_new
 
+// Allocates `size` bytes like `::operator new(size)`, given the index of the
+// size class table entry for `size`, as computed by
+// `tcmalloc::new_internal::ClassIndex(size)`.  Use `tcmalloc::New<kSize>()`
+// instead, which computes the index at compile time.
+//
+// The default weak implementation allocates the memory using
+// `::operator new(size)`.
+extern "C" [[nodiscard]] void* absl_nonnull tcmalloc_new_with_class_index(
+    size_t size, size_t class_index) noexcept(false);
+
+namespace tcmalloc {
+namespace new_internal {
+
+// Sizes up to kMaxConstantSize are covered by every size class configuration,
+// and map to the size class table entry ClassIndex(size).  This mirrors
+// tcmalloc_internal::SizeMap.
+inline constexpr size_t kMaxConstantSize = 1024;
+
+constexpr size_t ClassIndex(size_t size) { return (size + 7) >> 3; }
+
+}  // namespace new_internal
+
+// Allocates kSize bytes like `::operator new(kSize)`.  For small constant
+// sizes, such as the nodes of a container, the size class is looked up without
+// computing its table index at run time.
+//
+// The returned pointer must be freed with `::operator delete`, preferably
+// sized.
+template <size_t kSize>
+[[nodiscard]] ABSL_ATTRIBUTE_ALWAYS_INLINE inline void* absl_nonnull New() {
+  if constexpr (kSize <= new_internal::kMaxConstantSize) {
+    constexpr size_t kClassIndex = new_internal::ClassIndex(kSize);
+    return tcmalloc_new_with_class_index(kSize, kClassIndex);
+  } else {
+    return ::operator new(kSize);
+  }
+}
+
+}  // namespace tcmalloc
+
 #ifndef MALLOCX_LG_ALIGN
 #define MALLOCX_LG_ALIGN(la) (la)
 #endif
@@ -915,6 +1740,9 @@ class ProfileBase {
   // The duration the profile was collected for.  For instantaneous profiles
   // (heap, peakheap, etc.), this returns absl::ZeroDuration().
   virtual absl::Duration Duration() const = 0;
+
+  // See Profile::ExperimentId().
+  virtual uint64_t ExperimentId() const { return 0; }
 };
 
 enum class MadvisePreference {
@@ -922,6 +1750,9 @@ enum class MadvisePreference {
   kDontNeed = 0x1,
   kFreeAndDontNeed = 0x3,
   kFreeOnly = 0x2,
+  // Chooses per release: MADV_FREE for memory likely to be reused soon, and
+  // MADV_DONTNEED otherwise or when close to a memory limit.
+  kAdaptive = 0x4,
 };
 
 inline bool AbslParseFlag(absl::string_view text,
@@ -939,6 +1770,9 @@ inline bool AbslParseFlag(absl::string_view text,
   } else if (text == "FREE_ONLY") {
     *preference = MadvisePreference::kFreeOnly;
     return true;
+  } else if (text == "ADAPTIVE") {
+    *preference = MadvisePreference::kAdaptive;
+    return true;
   } else {
     return false;
   }
@@ -954,6 +1788,8 @@ inline std::string AbslUnparseFlag(MadvisePreference preference) {
       return "FREE_AND_DONTNEED";
     case MadvisePreference::kFreeOnly:
       return "FREE_ONLY";
+    case MadvisePreference::kAdaptive:
+      return "ADAPTIVE";
   }
 
   ABSL_UNREACHABLE();
@@ -14,6 +14,8 @@
 
 #include "tcmalloc/malloc_hook.h"
 
+#include <cstdint>
+
 #include "absl/base/attributes.h"
 #include "absl/base/call_once.h"
 #include "tcmalloc/internal/config.h"
@@ -53,6 +55,22 @@ ABSL_CONST_INIT HookList<MallocHook::DeleteHook> delete_hooks_;
 ABSL_CONST_INIT HookList<MallocHook::SampledNewHook> sampled_new_hooks_;
 ABSL_CONST_INIT HookList<MallocHook::SampledDeleteHook> sampled_delete_hooks_;
 
+ABSL_CONST_INIT PeriodicHookList<MallocHook::NewHook> periodic_new_hooks_;
+ABSL_CONST_INIT PeriodicHookList<MallocHook::DeleteHook>
+    periodic_delete_hooks_;
+ABSL_CONST_INIT thread_local PeriodicHookCountdown periodic_new_hook_countdown
+    ABSL_ATTRIBUTE_INITIAL_EXEC = {};
+ABSL_CONST_INIT thread_local PeriodicHookCountdown
+    periodic_delete_hook_countdown ABSL_ATTRIBUTE_INITIAL_EXEC = {};
+
+void InvokePeriodicNewHook(const MallocHook::NewInfo& info) {
+  periodic_new_hooks_.Invoke(periodic_new_hook_countdown, info);
+}
+
+void InvokePeriodicDeleteHook(const MallocHook::DeleteInfo& info) {
+  periodic_delete_hooks_.Invoke(periodic_delete_hook_countdown, info);
+}
+
 void RemoveInitialHooksAndCallInitializers() {
   ABSL_RAW_CHECK(MallocHook::RemoveNewHook(&InitialNewHook), "");
   // HeapLeakChecker need to get control on the first memory allocation. One can
@@ -111,6 +129,22 @@ bool MallocHook::RemoveSampledDeleteHook(SampledDeleteHook hook) {
   return tcmalloc_internal::sampled_delete_hooks_.Remove(hook);
 }
 
+bool MallocHook::AddPeriodicNewHook(NewHook hook, uint32_t period) {
+  return tcmalloc_internal::periodic_new_hooks_.Add(hook, period);
+}
+
+bool MallocHook::RemovePeriodicNewHook(NewHook hook) {
+  return tcmalloc_internal::periodic_new_hooks_.Remove(hook);
+}
+
+bool MallocHook::AddPeriodicDeleteHook(DeleteHook hook, uint32_t period) {
+  return tcmalloc_internal::periodic_delete_hooks_.Add(hook, period);
+}
+
+bool MallocHook::RemovePeriodicDeleteHook(DeleteHook hook) {
+  return tcmalloc_internal::periodic_delete_hooks_.Remove(hook);
+}
+
 
 
 }  // namespace tcmalloc
@@ -15,6 +15,8 @@
 #ifndef TCMALLOC_MALLOC_HOOK_H_
 #define TCMALLOC_MALLOC_HOOK_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <optional>
 #include <ostream>
 
@@ -43,6 +45,10 @@ class MallocHook final {
     size_t allocated_size = 0;
     // Allow a hook to modify the memory.
     HookMemoryMutable is_mutable;
+    // Requested alignment, if known.  Defaults to 1.
+    size_t alignment = 1;
+    // Requested tcmalloc::hot_cold_t access hint, if known.  Defaults to hot.
+    uint8_t hot_cold = 255;
   };
 
   // The NewHook is invoked whenever an object is being allocated.
@@ -75,6 +81,21 @@ class MallocHook final {
   [[nodiscard]] static bool RemoveDeleteHook(DeleteHook hook);
   static void InvokeDeleteHook(const DeleteInfo& info);
 
+  // Periodic hooks are only invoked for about one in `period` allocations
+  // (or deallocations) on each thread.  Unlike with AddNewHook and
+  // AddDeleteHook, which send every operation down the allocator's slow path,
+  // the operations a periodic hook does not see stay on the fast path, so
+  // they suit statistics such as allocation rates.
+  //
+  // The deallocations a periodic DeleteHook sees are unrelated to the
+  // allocations a periodic NewHook sees.  Use SampledNewHook and
+  // SampledDeleteHook to follow objects over their lifetime.
+  [[nodiscard]] static bool AddPeriodicNewHook(NewHook hook, uint32_t period);
+  [[nodiscard]] static bool RemovePeriodicNewHook(NewHook hook);
+  [[nodiscard]] static bool AddPeriodicDeleteHook(DeleteHook hook,
+                                                  uint32_t period);
+  [[nodiscard]] static bool RemovePeriodicDeleteHook(DeleteHook hook);
+
   // The SampledNewHook is invoked for some subset of object allocations
   // according to the sampling policy of an allocator such as tcmalloc.
   // SampledAlloc has the following fields:
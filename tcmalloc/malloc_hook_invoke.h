@@ -15,6 +15,8 @@
 #ifndef TCMALLOC_MALLOC_HOOK_INVOKE_H_
 #define TCMALLOC_MALLOC_HOOK_INVOKE_H_
 
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/hook_list.h"
 #include "tcmalloc/malloc_hook.h"
@@ -29,6 +31,28 @@ extern HookList<MallocHook::DeleteHook> delete_hooks_;
 extern HookList<MallocHook::SampledNewHook> sampled_new_hooks_;
 extern HookList<MallocHook::SampledDeleteHook> sampled_delete_hooks_;
 
+extern PeriodicHookList<MallocHook::NewHook> periodic_new_hooks_;
+extern PeriodicHookList<MallocHook::DeleteHook> periodic_delete_hooks_;
+ABSL_CONST_INIT extern thread_local PeriodicHookCountdown
+    periodic_new_hook_countdown ABSL_ATTRIBUTE_INITIAL_EXEC;
+ABSL_CONST_INIT extern thread_local PeriodicHookCountdown
+    periodic_delete_hook_countdown ABSL_ATTRIBUTE_INITIAL_EXEC;
+
+// Count an allocation (deallocation) towards the periodic hooks, and return
+// true if it is to be passed to InvokePeriodicNewHook
+// (InvokePeriodicDeleteHook).  This is a thread-local decrement, cheap enough
+// for the fast paths.
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE bool PeriodicNewHookDue() {
+  return ABSL_PREDICT_FALSE(--periodic_new_hook_countdown.remaining <= 0);
+}
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE bool PeriodicDeleteHookDue() {
+  return ABSL_PREDICT_FALSE(--periodic_delete_hook_countdown.remaining <= 0);
+}
+
+// Resets the countdown, and invokes the periodic hooks whose turn it is.
+void InvokePeriodicNewHook(const MallocHook::NewInfo& info);
+void InvokePeriodicDeleteHook(const MallocHook::DeleteInfo& info);
+
 }  // namespace tcmalloc_internal
 
 inline void MallocHook::InvokeNewHook(const NewInfo& info) {
@@ -0,0 +1,75 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/mapped_region.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+
+#include "absl/strings/ascii.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+void* MapRegionAt(int fd, void* address, size_t size) {
+  // Other processes may grow the file concurrently, to the same size.
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (static_cast<size_t>(st.st_size) < size && ftruncate(fd, size) != 0)) {
+    return nullptr;
+  }
+
+  // MAP_FIXED_NOREPLACE fails rather than clobbering an existing mapping.
+  // Kernels predating it treat it as a hint, so check where we landed.
+  void* result = mmap(address, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+  if (result == MAP_FAILED) {
+    return nullptr;
+  }
+  if (result != address) {
+    munmap(result, size);
+    return nullptr;
+  }
+  return result;
+}
+
+void MappedRegionCounters::Print(Printer& out, const char* kind) const {
+  static constexpr double MiB = 1048576.0;
+  const int64_t mapped = mapped_bytes();
+  out.printf("------------------------------------------------\n");
+  out.printf("%c%s regions: %d attached\n", absl::ascii_toupper(kind[0]),
+             kind + 1, attached_regions());
+  out.printf("------------------------------------------------\n");
+  out.printf("MALLOC: %12d (%7.1f MiB) Bytes mapped by %s regions\n", mapped,
+             mapped / MiB, kind);
+}
+
+void MappedRegionCounters::PrintInPbtxt(PbtxtRegion& region) const {
+  region.PrintI64("attached_regions", attached_regions());
+  region.PrintI64("mapped_bytes", mapped_bytes());
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
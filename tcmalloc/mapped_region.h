@@ -0,0 +1,204 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Building blocks shared by PersistentRegionHeader and SharedRegionHeader,
+// which both allocate objects from a file mapped at a fixed address and keep
+// all of their state in the mapping itself.
+
+#ifndef TCMALLOC_MAPPED_REGION_H_
+#define TCMALLOC_MAPPED_REGION_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/numeric/bits.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Maps `size` bytes of the file `fd` shared at exactly `address`, growing the
+// file to `size` if it is shorter.  Returns nullptr if the file cannot be
+// grown or something else is mapped there.
+void* MapRegionAt(int fd, void* address, size_t size);
+
+// Power-of-two free lists, linked by offset from the start of the mapping, and
+// the end of its used part.  Offsets rather than pointers keep the state
+// meaningful to every process that maps the file at the same address, and 0
+// means none, as the mapping starts with its header.
+//
+// Lock guards the lists.  It must have Lock() and Unlock(), and is constructed
+// by the owner, as a lock living in a file may need resetting on attach.
+template <typename Lock>
+class OffsetFreeLists {
+ public:
+  static constexpr size_t kMaxAlignment = 4096;
+
+  // As AllocationGuardSpinLockHolder, for Lock.
+  class ABSL_SCOPED_LOCKABLE LockHolder {
+   public:
+    explicit LockHolder(Lock& lock) ABSL_EXCLUSIVE_LOCK_FUNCTION(lock)
+        : lock_(lock) {
+      lock_.Lock();
+    }
+    ~LockHolder() ABSL_UNLOCK_FUNCTION() { lock_.Unlock(); }
+
+   private:
+    AllocationGuard guard_;
+    Lock& lock_;
+  };
+
+  OffsetFreeLists() = default;
+  OffsetFreeLists(const OffsetFreeLists&) = delete;
+  OffsetFreeLists& operator=(const OffsetFreeLists&) = delete;
+
+  // Empties the lists of a mapping of `size` bytes at `base`, whose first
+  // `reserved` bytes are not allocated.
+  void Init(uintptr_t base, size_t size, size_t reserved)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns `size` bytes aligned to `alignment`, or nullptr if the mapping is
+  // full.
+  //
+  // REQUIRES: alignment is a power of two no larger than kMaxAlignment
+  void* Allocate(size_t size, size_t alignment) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns an object to the lists.  size and alignment must be those it was
+  // allocated with.
+  void Deallocate(void* ptr, size_t size, size_t alignment)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // The bytes an object of `size` and `alignment` takes up.
+  static size_t ObjectSize(size_t size, size_t alignment) {
+    return ListSize(ListIndex(size, alignment));
+  }
+
+  uintptr_t base() const { return base_; }
+  size_t size() const { return size_; }
+  uint64_t in_use_bytes() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    return in_use_bytes_;
+  }
+  Lock& lock() const ABSL_LOCK_RETURNED(lock_) { return lock_; }
+
+  uintptr_t ToAddress(uint64_t offset) const { return base_ + offset; }
+  uint64_t ToOffset(const void* ptr) const {
+    return reinterpret_cast<uintptr_t>(ptr) - base_;
+  }
+
+ private:
+  // Free list i holds objects of 2^(i + kMinShift) bytes.
+  static constexpr int kMinShift = 4;
+  static constexpr int kNumLists = 64 - kMinShift;
+
+  static int ListIndex(size_t size, size_t alignment) {
+    size = std::max({size, alignment, size_t{1} << kMinShift});
+    return absl::bit_width(size - 1) - kMinShift;
+  }
+  static size_t ListSize(int index) { return size_t{1} << (index + kMinShift); }
+
+  uintptr_t base_;
+  uint64_t size_;
+  mutable Lock lock_;
+  // Start of the never allocated part of the mapping.
+  uint64_t cursor_ ABSL_GUARDED_BY(lock_);
+  uint64_t in_use_bytes_ ABSL_GUARDED_BY(lock_);
+  uint64_t free_lists_[kNumLists] ABSL_GUARDED_BY(lock_);
+};
+
+template <typename Lock>
+void OffsetFreeLists<Lock>::Init(uintptr_t base, size_t size,
+                                 size_t reserved) {
+  base_ = base;
+  size_ = size;
+  LockHolder l(lock_);
+  cursor_ = (reserved + kMaxAlignment - 1) & ~(kMaxAlignment - 1);
+  in_use_bytes_ = 0;
+  std::fill(std::begin(free_lists_), std::end(free_lists_), 0);
+}
+
+template <typename Lock>
+void* OffsetFreeLists<Lock>::Allocate(size_t size, size_t alignment) {
+  TC_ASSERT(absl::has_single_bit(alignment));
+  if (alignment > kMaxAlignment || size > size_) return nullptr;
+  const int index = ListIndex(size, alignment);
+  const size_t list_size = ListSize(index);
+
+  LockHolder l(lock_);
+  uint64_t offset = free_lists_[index];
+  if (offset != 0) {
+    free_lists_[index] = *reinterpret_cast<uint64_t*>(ToAddress(offset));
+  } else {
+    // Objects are carved at their own size's alignment, up to kMaxAlignment,
+    // so that any object on a free list suits any request mapping to it.
+    const size_t carve_alignment = std::min(list_size, kMaxAlignment);
+    offset = (cursor_ + carve_alignment - 1) & ~(carve_alignment - 1);
+    if (offset > size_ || list_size > size_ - offset) return nullptr;
+    cursor_ = offset + list_size;
+  }
+  in_use_bytes_ += list_size;
+  return reinterpret_cast<void*>(ToAddress(offset));
+}
+
+template <typename Lock>
+void OffsetFreeLists<Lock>::Deallocate(void* ptr, size_t size,
+                                       size_t alignment) {
+  const uint64_t offset = ToOffset(ptr);
+  TC_CHECK_LT(offset, size_);
+  const int index = ListIndex(size, alignment);
+  const size_t list_size = ListSize(index);
+
+  LockHolder l(lock_);
+  *static_cast<uint64_t*>(ptr) = free_lists_[index];
+  free_lists_[index] = offset;
+  in_use_bytes_ -= list_size;
+}
+
+// Counts the regions of one kind that this process has attached.
+class MappedRegionCounters {
+ public:
+  constexpr MappedRegionCounters() = default;
+
+  void Attached(size_t size) {
+    attached_regions_.Add(1);
+    mapped_bytes_.Add(size);
+  }
+  void Detached(size_t size) {
+    attached_regions_.Add(-1);
+    mapped_bytes_.Add(-static_cast<int64_t>(size));
+  }
+
+  int64_t attached_regions() const { return attached_regions_.value(); }
+  int64_t mapped_bytes() const { return mapped_bytes_.value(); }
+
+  // Prints the counters of the regions of `kind`, e.g. "persistent".
+  void Print(Printer& out, const char* kind) const;
+  void PrintInPbtxt(PbtxtRegion& region) const;
+
+ private:
+  StatsCounter attached_regions_;
+  StatsCounter mapped_bytes_;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_MAPPED_REGION_H_
@@ -0,0 +1,317 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_MEMORY_PRESSURE_H_
+#define TCMALLOC_MEMORY_PRESSURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <optional>
+
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/sysinfo.h"
+#include "tcmalloc/malloc_extension.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+enum class MemoryPressureLevel : uint8_t {
+  kNormal,
+  kIdle,
+  kHigh,
+};
+
+// Turns memory pressure samples into how eagerly memory is returned to the
+// system.
+//
+// Under high pressure, i.e. when tasks of the cgroup (or of the machine)
+// stalled on memory for at least kHighPressureAvg10 percent of the last 10
+// seconds, or when the cgroup hit its memory limits since the previous
+// sample, memory is released kScale times faster and the skip-subrelease
+// intervals are kScale times shorter.  When nothing stalled on memory, the
+// background release stops and the intervals are kScale times longer, which
+// keeps hugepages intact.
+class MemoryPressureGovernor {
+ public:
+  static constexpr double kHighPressureAvg10 = 10;
+  static constexpr double kIdleAvg10 = 0.1;
+  static constexpr int kScale = 4;
+  // Release rate used under high pressure when the configured rate is lower,
+  // so that pressure is acted upon even if background release is disabled.
+  static constexpr size_t kHighPressureMinReleaseRate = size_t{8} << 20;
+
+  constexpr MemoryPressureGovernor() = default;
+  MemoryPressureGovernor(const MemoryPressureGovernor&) = delete;
+  MemoryPressureGovernor& operator=(const MemoryPressureGovernor&) = delete;
+
+  // Classifies a new sample.  Samples without PSI averages or limit events
+  // leave the level at kNormal.
+  void Update(const MemoryPressure& sample) {
+    bool hit_limits = false;
+    if (sample.limit_events.has_value()) {
+      hit_limits = last_limit_events_.has_value() &&
+                   *sample.limit_events > *last_limit_events_;
+      last_limit_events_ = sample.limit_events;
+    }
+
+    MemoryPressureLevel level = MemoryPressureLevel::kNormal;
+    if (hit_limits || (sample.some_avg10.has_value() &&
+                       *sample.some_avg10 >= kHighPressureAvg10)) {
+      level = MemoryPressureLevel::kHigh;
+      high_samples_.Add(1);
+    } else if (sample.some_avg10.has_value() &&
+               *sample.some_avg10 < kIdleAvg10) {
+      level = MemoryPressureLevel::kIdle;
+      idle_samples_.Add(1);
+    } else {
+      normal_samples_.Add(1);
+    }
+    level_.store(level, std::memory_order_relaxed);
+  }
+
+  // Forgets the previous samples, e.g. while the governor is disabled.
+  void Reset() {
+    last_limit_events_ = std::nullopt;
+    level_.store(MemoryPressureLevel::kNormal, std::memory_order_relaxed);
+  }
+
+  MemoryPressureLevel level() const {
+    return level_.load(std::memory_order_relaxed);
+  }
+
+  size_t ScaleReleaseRate(size_t bytes_per_second) const {
+    switch (level()) {
+      case MemoryPressureLevel::kIdle:
+        return 0;
+      case MemoryPressureLevel::kHigh:
+        return std::max(
+            kHighPressureMinReleaseRate,
+            bytes_per_second > std::numeric_limits<size_t>::max() / kScale
+                ? std::numeric_limits<size_t>::max()
+                : bytes_per_second * kScale);
+      case MemoryPressureLevel::kNormal:
+        break;
+    }
+    return bytes_per_second;
+  }
+
+  absl::Duration ScaleSkipSubreleaseInterval(absl::Duration interval) const {
+    switch (level()) {
+      case MemoryPressureLevel::kIdle:
+        return interval * kScale;
+      case MemoryPressureLevel::kHigh:
+        return interval / kScale;
+      case MemoryPressureLevel::kNormal:
+        break;
+    }
+    return interval;
+  }
+
+  void Print(Printer& out) const {
+    out.printf(
+        "Memory pressure samples: %zu idle, %zu normal, %zu high; current "
+        "level: %s\n",
+        idle_samples_.value(), normal_samples_.value(), high_samples_.value(),
+        LevelName(level()));
+  }
+
+  void PrintInPbtxt(PbtxtRegion& region) const {
+    region.PrintI64("idle_samples", idle_samples_.value());
+    region.PrintI64("normal_samples", normal_samples_.value());
+    region.PrintI64("high_samples", high_samples_.value());
+    region.PrintRaw("level", LevelName(level()));
+  }
+
+ private:
+  static const char* LevelName(MemoryPressureLevel level) {
+    switch (level) {
+      case MemoryPressureLevel::kIdle:
+        return "IDLE";
+      case MemoryPressureLevel::kHigh:
+        return "HIGH";
+      case MemoryPressureLevel::kNormal:
+        break;
+    }
+    return "NORMAL";
+  }
+
+  std::atomic<MemoryPressureLevel> level_{MemoryPressureLevel::kNormal};
+  // Only accessed by the thread calling Update and Reset.
+  std::optional<uint64_t> last_limit_events_;
+
+  StatsCounter idle_samples_;
+  StatsCounter normal_samples_;
+  StatsCounter high_samples_;
+};
+
+// Tells the callbacks registered with
+// MallocExtension::AddMemoryPressureCallback when the heap nears the soft limit
+// or tasks stall on memory.
+//
+// Each callback has its own thresholds, and is told when its severity rises,
+// and every kRenotifyInterval while the severity stays above kNone.  The
+// callbacks are invoked without the lock held, so that they may register or
+// unregister callbacks.
+class MemoryPressureNotifier {
+ public:
+  using Severity = MallocExtension::MemoryPressureSeverity;
+  using Callback = MallocExtension::MemoryPressureCallback;
+  using Event = MallocExtension::MemoryPressureEvent;
+
+  static constexpr size_t kMaxCallbacks = 16;
+  static constexpr double kModerateAvg10 = 10;
+  static constexpr double kCriticalAvg10 = 40;
+  static constexpr absl::Duration kRenotifyInterval = absl::Seconds(10);
+
+  constexpr MemoryPressureNotifier()
+      : lock_(absl::base_internal::SCHEDULE_KERNEL_ONLY) {}
+  MemoryPressureNotifier(const MemoryPressureNotifier&) = delete;
+  MemoryPressureNotifier& operator=(const MemoryPressureNotifier&) = delete;
+
+  // Returns false if the thresholds are not 0 < moderate <= critical, or if
+  // kMaxCallbacks callbacks are registered already.
+  bool Add(Callback callback, void* arg, double moderate_fraction,
+           double critical_fraction) ABSL_LOCKS_EXCLUDED(lock_) {
+    if (callback == nullptr || !(moderate_fraction > 0) ||
+        !(moderate_fraction <= critical_fraction)) {
+      return false;
+    }
+    AllocationGuardSpinLockHolder h(lock_);
+    if (num_entries_ == kMaxCallbacks) return false;
+    entries_[num_entries_++] = {callback,          arg,
+                                moderate_fraction, critical_fraction,
+                                Severity::kNone,   absl::InfinitePast()};
+    has_callbacks_.store(true, std::memory_order_relaxed);
+    return true;
+  }
+
+  void Remove(Callback callback, void* arg) ABSL_LOCKS_EXCLUDED(lock_) {
+    AllocationGuardSpinLockHolder h(lock_);
+    for (size_t i = 0; i < num_entries_; ++i) {
+      if (entries_[i].callback == callback && entries_[i].arg == arg) {
+        entries_[i] = entries_[--num_entries_];
+        break;
+      }
+    }
+    has_callbacks_.store(num_entries_ > 0, std::memory_order_relaxed);
+  }
+
+  // Whether any callback is registered, so that the caller may skip
+  // gathering the inputs of Notify.
+  bool has_callbacks() const {
+    return has_callbacks_.load(std::memory_order_relaxed);
+  }
+
+  // Returns the severity of `event` for the given thresholds.  A soft limit
+  // of std::numeric_limits<size_t>::max() means there is none.
+  static Severity Classify(const Event& event, double moderate_fraction,
+                           double critical_fraction) {
+    double usage = 0;
+    if (event.soft_limit != std::numeric_limits<size_t>::max() &&
+        event.soft_limit > 0) {
+      usage = static_cast<double>(event.heap_bytes) / event.soft_limit;
+    }
+    const double avg10 = event.some_avg10.value_or(0);
+    if (usage >= critical_fraction || avg10 >= kCriticalAvg10) {
+      return Severity::kCritical;
+    }
+    if (usage >= moderate_fraction || avg10 >= kModerateAvg10) {
+      return Severity::kModerate;
+    }
+    return Severity::kNone;
+  }
+
+  // Invokes the callbacks that are due to be told about `event`, whose
+  // severity is filled in for each of them.
+  void Notify(Event event, absl::Time now) ABSL_LOCKS_EXCLUDED(lock_) {
+    struct Pending {
+      Callback callback;
+      void* arg;
+      Severity severity;
+    };
+    Pending pending[kMaxCallbacks];
+    size_t num_pending = 0;
+    {
+      AllocationGuardSpinLockHolder h(lock_);
+      for (size_t i = 0; i < num_entries_; ++i) {
+        Entry& e = entries_[i];
+        const Severity severity =
+            Classify(event, e.moderate_fraction, e.critical_fraction);
+        const bool due = severity > e.severity ||
+                         (severity != Severity::kNone &&
+                          now - e.last_notified >= kRenotifyInterval);
+        e.severity = severity;
+        if (!due) continue;
+        e.last_notified = now;
+        pending[num_pending++] = {e.callback, e.arg, severity};
+      }
+    }
+    for (size_t i = 0; i < num_pending; ++i) {
+      event.severity = pending[i].severity;
+      pending[i].callback(pending[i].arg, event);
+      if (pending[i].severity == Severity::kCritical) {
+        critical_notifications_.Add(1);
+      } else {
+        moderate_notifications_.Add(1);
+      }
+    }
+  }
+
+  void Print(Printer& out) const {
+    out.printf(
+        "Memory pressure callbacks: %zu moderate, %zu critical notifications\n",
+        moderate_notifications_.value(), critical_notifications_.value());
+  }
+
+  void PrintInPbtxt(PbtxtRegion& region) const {
+    region.PrintI64("moderate_notifications", moderate_notifications_.value());
+    region.PrintI64("critical_notifications", critical_notifications_.value());
+  }
+
+ private:
+  struct Entry {
+    Callback callback;
+    void* arg;
+    double moderate_fraction;
+    double critical_fraction;
+    // The severity seen by the last Notify call.
+    Severity severity;
+    absl::Time last_notified;
+  };
+
+  absl::base_internal::SpinLock lock_;
+  size_t num_entries_ ABSL_GUARDED_BY(lock_) = 0;
+  Entry entries_[kMaxCallbacks] ABSL_GUARDED_BY(lock_) = {};
+  std::atomic<bool> has_callbacks_{false};
+
+  StatsCounter moderate_notifications_;
+  StatsCounter critical_notifications_;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_MEMORY_PRESSURE_H_
@@ -0,0 +1,219 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/memory_pressure.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/sysinfo.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+MemoryPressure Sample(std::optional<double> avg10,
+                      std::optional<uint64_t> events) {
+  MemoryPressure sample;
+  sample.some_avg10 = avg10;
+  sample.limit_events = events;
+  return sample;
+}
+
+TEST(MemoryPressureGovernorTest, Levels) {
+  MemoryPressureGovernor governor;
+  EXPECT_EQ(governor.level(), MemoryPressureLevel::kNormal);
+
+  governor.Update(Sample(0, std::nullopt));
+  EXPECT_EQ(governor.level(), MemoryPressureLevel::kIdle);
+  governor.Update(Sample(1, std::nullopt));
+  EXPECT_EQ(governor.level(), MemoryPressureLevel::kNormal);
+  governor.Update(
+      Sample(MemoryPressureGovernor::kHighPressureAvg10, std::nullopt));
+  EXPECT_EQ(governor.level(), MemoryPressureLevel::kHigh);
+  governor.Update(Sample(std::nullopt, std::nullopt));
+  EXPECT_EQ(governor.level(), MemoryPressureLevel::kNormal);
+}
+
+TEST(MemoryPressureGovernorTest, LimitEvents) {
+  MemoryPressureGovernor governor;
+  // The first sample only establishes the baseline.
+  governor.Update(Sample(0, 5));
+  EXPECT_EQ(governor.level(), MemoryPressureLevel::kIdle);
+  governor.Update(Sample(0, 6));
+  EXPECT_EQ(governor.level(), MemoryPressureLevel::kHigh);
+  governor.Update(Sample(0, 6));
+  EXPECT_EQ(governor.level(), MemoryPressureLevel::kIdle);
+
+  governor.Reset();
+  EXPECT_EQ(governor.level(), MemoryPressureLevel::kNormal);
+  governor.Update(Sample(0, 100));
+  EXPECT_EQ(governor.level(), MemoryPressureLevel::kIdle);
+}
+
+TEST(MemoryPressureGovernorTest, Scaling) {
+  MemoryPressureGovernor governor;
+  constexpr size_t kRate = size_t{16} << 20;
+  const absl::Duration kInterval = absl::Seconds(60);
+  EXPECT_EQ(governor.ScaleReleaseRate(kRate), kRate);
+  EXPECT_EQ(governor.ScaleSkipSubreleaseInterval(kInterval), kInterval);
+
+  governor.Update(Sample(0, std::nullopt));
+  EXPECT_EQ(governor.ScaleReleaseRate(kRate), 0);
+  EXPECT_EQ(governor.ScaleSkipSubreleaseInterval(kInterval),
+            kInterval * MemoryPressureGovernor::kScale);
+
+  governor.Update(Sample(50, std::nullopt));
+  EXPECT_EQ(governor.ScaleReleaseRate(kRate),
+            kRate * MemoryPressureGovernor::kScale);
+  EXPECT_EQ(governor.ScaleReleaseRate(0),
+            MemoryPressureGovernor::kHighPressureMinReleaseRate);
+  EXPECT_EQ(governor.ScaleSkipSubreleaseInterval(kInterval),
+            kInterval / MemoryPressureGovernor::kScale);
+  EXPECT_EQ(governor.ScaleSkipSubreleaseInterval(absl::ZeroDuration()),
+            absl::ZeroDuration());
+}
+
+TEST(MemoryPressureGovernorTest, Stats) {
+  MemoryPressureGovernor governor;
+  governor.Update(Sample(0, std::nullopt));
+  governor.Update(Sample(0, std::nullopt));
+  governor.Update(Sample(50, std::nullopt));
+
+  std::string buffer(1024, '\0');
+  Printer printer(&buffer[0], buffer.size());
+  governor.Print(printer);
+  buffer.resize(strlen(buffer.c_str()));
+  EXPECT_THAT(buffer,
+              testing::HasSubstr("Memory pressure samples: 2 idle, 0 normal, "
+                                 "1 high; current level: HIGH"));
+}
+
+using Severity = MemoryPressureNotifier::Severity;
+
+MemoryPressureNotifier::Event Usage(size_t heap_bytes, size_t soft_limit,
+                                    std::optional<double> avg10) {
+  MemoryPressureNotifier::Event event;
+  event.heap_bytes = heap_bytes;
+  event.soft_limit = soft_limit;
+  event.some_avg10 = avg10;
+  return event;
+}
+
+TEST(MemoryPressureNotifierClassifyTest, Severity) {
+  constexpr size_t kNoLimit = std::numeric_limits<size_t>::max();
+  EXPECT_EQ(MemoryPressureNotifier::Classify(Usage(79, 100, 0), 0.8, 0.95),
+            Severity::kNone);
+  EXPECT_EQ(MemoryPressureNotifier::Classify(Usage(80, 100, 0), 0.8, 0.95),
+            Severity::kModerate);
+  EXPECT_EQ(MemoryPressureNotifier::Classify(Usage(95, 100, 0), 0.8, 0.95),
+            Severity::kCritical);
+  EXPECT_EQ(MemoryPressureNotifier::Classify(Usage(100, 100, 0), 0.5, 0.5),
+            Severity::kCritical);
+
+  // Without a limit, only stalls count.
+  EXPECT_EQ(MemoryPressureNotifier::Classify(
+                Usage(size_t{1} << 40, kNoLimit, std::nullopt), 0.8, 0.95),
+            Severity::kNone);
+  EXPECT_EQ(MemoryPressureNotifier::Classify(
+                Usage(0, kNoLimit, MemoryPressureNotifier::kModerateAvg10),
+                0.8, 0.95),
+            Severity::kModerate);
+  EXPECT_EQ(MemoryPressureNotifier::Classify(
+                Usage(0, kNoLimit, MemoryPressureNotifier::kCriticalAvg10),
+                0.8, 0.95),
+            Severity::kCritical);
+}
+
+class MemoryPressureNotifierTest : public testing::Test {
+ protected:
+  static void Record(void* arg, const MemoryPressureNotifier::Event& event) {
+    static_cast<std::vector<Severity>*>(arg)->push_back(event.severity);
+  }
+
+  MemoryPressureNotifier notifier_;
+  std::vector<Severity> seen_;
+  absl::Time now_ = absl::UnixEpoch();
+};
+
+TEST_F(MemoryPressureNotifierTest, Registration) {
+  EXPECT_FALSE(notifier_.has_callbacks());
+  EXPECT_FALSE(notifier_.Add(nullptr, &seen_, 0.8, 0.95));
+  EXPECT_FALSE(notifier_.Add(Record, &seen_, 0, 0.95));
+  EXPECT_FALSE(notifier_.Add(Record, &seen_, 0.95, 0.8));
+
+  std::vector<Severity> others[MemoryPressureNotifier::kMaxCallbacks];
+  for (auto& other : others) {
+    EXPECT_TRUE(notifier_.Add(Record, &other, 0.8, 0.95));
+  }
+  EXPECT_TRUE(notifier_.has_callbacks());
+  EXPECT_FALSE(notifier_.Add(Record, &seen_, 0.8, 0.95));
+  for (auto& other : others) {
+    notifier_.Remove(Record, &other);
+  }
+  EXPECT_FALSE(notifier_.has_callbacks());
+}
+
+TEST_F(MemoryPressureNotifierTest, NotifiesWhenSeverityRises) {
+  ASSERT_TRUE(notifier_.Add(Record, &seen_, 0.8, 0.95));
+
+  notifier_.Notify(Usage(50, 100, std::nullopt), now_);
+  EXPECT_TRUE(seen_.empty());
+  notifier_.Notify(Usage(85, 100, std::nullopt), now_);
+  EXPECT_EQ(seen_, std::vector<Severity>({Severity::kModerate}));
+  // Still moderate: not told again until kRenotifyInterval passed.
+  notifier_.Notify(Usage(90, 100, std::nullopt), now_ + absl::Seconds(1));
+  EXPECT_EQ(seen_.size(), 1);
+  notifier_.Notify(Usage(96, 100, std::nullopt), now_ + absl::Seconds(2));
+  EXPECT_EQ(seen_, std::vector<Severity>(
+                       {Severity::kModerate, Severity::kCritical}));
+  notifier_.Notify(Usage(96, 100, std::nullopt),
+                   now_ + absl::Seconds(2) +
+                       MemoryPressureNotifier::kRenotifyInterval);
+  EXPECT_EQ(seen_.size(), 3);
+  EXPECT_EQ(seen_.back(), Severity::kCritical);
+
+  // Falling back is not reported, but rising again is.
+  seen_.clear();
+  notifier_.Notify(Usage(50, 100, std::nullopt), now_ + absl::Seconds(30));
+  EXPECT_TRUE(seen_.empty());
+  notifier_.Notify(Usage(85, 100, std::nullopt), now_ + absl::Seconds(31));
+  EXPECT_EQ(seen_, std::vector<Severity>({Severity::kModerate}));
+
+  notifier_.Remove(Record, &seen_);
+  notifier_.Notify(Usage(99, 100, std::nullopt), now_ + absl::Seconds(32));
+  EXPECT_EQ(seen_.size(), 1);
+
+  std::string buffer(1024, '\0');
+  Printer printer(&buffer[0], buffer.size());
+  notifier_.Print(printer);
+  buffer.resize(strlen(buffer.c_str()));
+  EXPECT_THAT(buffer, testing::HasSubstr("Memory pressure callbacks: 2 "
+                                         "moderate, 2 critical notifications"));
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -0,0 +1,90 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_MESH_ESTIMATOR_H_
+#define TCMALLOC_MESH_ESTIMATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <array>
+
+#include "absl/types/span.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Meshing, as done by the Mesh allocator, merges two spans of a size class
+// whose allocated objects sit at different offsets: the objects of one are
+// copied into the page of the other, and both virtual ranges are remapped to
+// that page, so that pointers to either stay valid while a page is freed.
+//
+// Remapping needs memory that can be mapped twice, such as a memfd, whereas
+// TCMalloc's pages are private anonymous memory.  So spans are not meshed;
+// the central freelists only estimate how many could be, from the allocated
+// objects of a sample of their sparse spans, to tell how much memory meshing
+// would reclaim.
+
+// Largest number of objects per span for which meshing is estimated.
+inline constexpr size_t kMaxMeshObjects = 512;
+// Number of spans of a size class sampled per estimate.
+inline constexpr size_t kMaxMeshCandidates = 64;
+// Number of spans each span is tried against, the "t" of Mesh's SplitMesher.
+inline constexpr size_t kMeshProbes = 8;
+
+// Bit i is set if the i-th object of the span is allocated.
+using SpanOccupancy = std::array<uint64_t, kMaxMeshObjects / 64>;
+
+// Returns whether two spans could be meshed, that is whether no object is
+// allocated in both.
+inline bool Meshable(const SpanOccupancy& a, const SpanOccupancy& b) {
+  for (size_t i = 0; i < a.size(); ++i) {
+    if ((a[i] & b[i]) != 0) return false;
+  }
+  return true;
+}
+
+// Returns the number of disjoint pairs of meshable spans found by SplitMesher:
+// each span of the first half of spans is tried against up to kMeshProbes
+// spans of the second half, and paired with the first meshable one not yet
+// paired.
+inline size_t CountMeshablePairs(absl::Span<const SpanOccupancy> spans) {
+  TC_ASSERT_LE(spans.size(), kMaxMeshCandidates);
+  const size_t half = spans.size() / 2;
+  const size_t others = spans.size() - half;
+  const size_t probes = std::min(kMeshProbes, others);
+  bool paired[kMaxMeshCandidates] = {};
+  size_t pairs = 0;
+  for (size_t i = 0; i < half; ++i) {
+    for (size_t k = 0; k < probes; ++k) {
+      const size_t j = half + (i + k) % others;
+      if (!paired[j] && Meshable(spans[i], spans[j])) {
+        paired[j] = true;
+        ++pairs;
+        break;
+      }
+    }
+  }
+  return pairs;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_MESH_ESTIMATOR_H_
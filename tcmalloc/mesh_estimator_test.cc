@@ -0,0 +1,80 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/mesh_estimator.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+SpanOccupancy Occupancy(std::vector<size_t> objects) {
+  SpanOccupancy occupancy = {};
+  for (size_t i : objects) {
+    occupancy[i / 64] |= uint64_t{1} << (i % 64);
+  }
+  return occupancy;
+}
+
+TEST(MeshEstimatorTest, Meshable) {
+  EXPECT_TRUE(Meshable(Occupancy({0, 2, 100}), Occupancy({1, 3, 511})));
+  EXPECT_FALSE(Meshable(Occupancy({0, 2, 100}), Occupancy({1, 100})));
+  EXPECT_TRUE(Meshable(Occupancy({}), Occupancy({})));
+}
+
+TEST(MeshEstimatorTest, PairsEachSpanOnce) {
+  // The spans of the first half mesh with those of the second.
+  std::vector<SpanOccupancy> spans = {
+      Occupancy({0}), Occupancy({0}), Occupancy({1}), Occupancy({1})};
+  EXPECT_EQ(CountMeshablePairs(spans), 2);
+
+  // A single span in the second half pairs with at most one span.
+  spans = {Occupancy({0}), Occupancy({0}), Occupancy({0}), Occupancy({1})};
+  EXPECT_EQ(CountMeshablePairs(spans), 1);
+
+  spans = {Occupancy({0}), Occupancy({0}), Occupancy({0}), Occupancy({0})};
+  EXPECT_EQ(CountMeshablePairs(spans), 0);
+}
+
+TEST(MeshEstimatorTest, FewSpans) {
+  EXPECT_EQ(CountMeshablePairs({}), 0);
+  std::vector<SpanOccupancy> spans = {Occupancy({0})};
+  EXPECT_EQ(CountMeshablePairs(spans), 0);
+}
+
+TEST(MeshEstimatorTest, ProbesAreBounded) {
+  // The only span of the second half meshable with the first span is beyond
+  // the kMeshProbes spans that it is tried against; the other spans of the
+  // first half mesh with nothing.
+  const size_t half = kMeshProbes + 1;
+  std::vector<SpanOccupancy> spans(2 * half, Occupancy({0}));
+  for (size_t i = 1; i < half; ++i) {
+    spans[i] = Occupancy({0, 1});
+  }
+  spans.back() = Occupancy({1});
+  EXPECT_EQ(CountMeshablePairs(spans), 0);
+  // The last span of the first half tries it first.
+  spans[half - 1] = Occupancy({2});
+  EXPECT_EQ(CountMeshablePairs(spans), 1);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
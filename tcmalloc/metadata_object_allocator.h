@@ -16,8 +16,11 @@
 #define TCMALLOC_METADATA_OBJECT_ALLOCATOR_H_
 
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
 
 #include <new>
+#include <utility>
 
 #include "absl/base/attributes.h"
 #include "absl/base/const_init.h"
@@ -29,6 +32,8 @@
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/page_size.h"
 
 #ifdef ABSL_HAVE_ADDRESS_SANITIZER
 #include <sanitizer/asan_interface.h>
@@ -133,6 +138,223 @@ class MetadataObjectAllocator {
   AllocatorStats stats_ ABSL_GUARDED_BY(metadata_lock_);
 };
 
+// Like MetadataObjectAllocator, but carves objects from aligned chunks and
+// returns the memory of chunks whose objects are all free to the OS.  New
+// objects come from the fullest chunks, so that after a spike of allocations
+// the survivors gather in few chunks and the others empty out.
+//
+// For metadata that is allocated in large numbers and freed in bulk, e.g.
+// spans.  Each chunk is kept on a list by occupancy, so allocation and
+// deallocation stay O(1).
+template <class T>
+class ReleasingMetadataObjectAllocator {
+ public:
+  static constexpr size_t kChunkSize = 64 << 10;
+
+  constexpr explicit ReleasingMetadataObjectAllocator(
+      Arena& arena ABSL_ATTRIBUTE_LIFETIME_BOUND)
+      : arena_(&arena) {}
+
+  template <typename... Args>
+  [[nodiscard]] ABSL_ATTRIBUTE_RETURNS_NONNULL T* New(Args&&... args) {
+    T* ret = LockAndAllocMemory();
+    return new (ret) T(std::forward<Args>(args)...);
+  }
+
+  void Delete(T* p) ABSL_ATTRIBUTE_NONNULL() {
+    p->~T();
+    LockAndDeleteMemory(p);
+  }
+
+  // `total` counts the objects carved from chunks that are not released.
+  AllocatorStats stats() const {
+    AllocationGuardSpinLockHolder l(metadata_lock_);
+
+    return stats_;
+  }
+
+  // Returns the number of bytes of chunks returned to the OS.
+  size_t released_bytes() const {
+    AllocationGuardSpinLockHolder l(metadata_lock_);
+
+    return released_chunks_ * kChunkSize;
+  }
+
+ private:
+  // Lives at the start of each chunk, followed by the objects.
+  struct Chunk {
+    Chunk* next;
+    Chunk* prev;
+    // Free objects below `carved`.
+    void* free_list;
+    uint32_t live;
+    // Number of objects carved from the chunk since it was last released.
+    uint32_t carved;
+    // The list the chunk is on: kBuckets for the empty and released chunks,
+    // -1 for none (the chunk is full).
+    int list;
+  };
+
+  static constexpr size_t kObjectsOffset =
+      (sizeof(Chunk) + alignof(T) - 1) & ~(alignof(T) - 1);
+  static constexpr uint32_t kCapacity =
+      (kChunkSize - kObjectsOffset) / sizeof(T);
+  static_assert(kCapacity >= 16, "object too large for chunks");
+  // Partially used chunks are kept on kBuckets lists by occupancy.
+  static constexpr int kBuckets = 8;
+  // Empty chunks kept resident rather than released, so that an allocation
+  // pattern oscillating around a chunk boundary does not release and refault
+  // it each time.
+  static constexpr size_t kMaxEmptyChunks = 1;
+
+  static Chunk* ChunkOf(void* p) {
+    return reinterpret_cast<Chunk*>(reinterpret_cast<uintptr_t>(p) &
+                                    ~(kChunkSize - 1));
+  }
+
+  static int Bucket(uint32_t live) {
+    return live == kCapacity ? -1 : live * kBuckets / kCapacity;
+  }
+
+  void Push(Chunk* c, int list) ABSL_EXCLUSIVE_LOCKS_REQUIRED(metadata_lock_) {
+    c->list = list;
+    if (list < 0) return;
+    if (list == kBuckets) ++num_empty_;
+    Chunk*& head = list == kBuckets ? empty_ : lists_[list];
+    c->prev = nullptr;
+    c->next = head;
+    if (head != nullptr) head->prev = c;
+    head = c;
+  }
+
+  void Remove(Chunk* c) ABSL_EXCLUSIVE_LOCKS_REQUIRED(metadata_lock_) {
+    if (c->list < 0) return;
+    if (c->list == kBuckets) --num_empty_;
+    Chunk*& head = c->list == kBuckets ? empty_ : lists_[c->list];
+    if (c->prev != nullptr) {
+      c->prev->next = c->next;
+    } else {
+      head = c->next;
+    }
+    if (c->next != nullptr) c->next->prev = c->prev;
+    c->list = -1;
+  }
+
+  // The bytes of a chunk that can be released: whole OS pages after the
+  // header.
+  static std::pair<uintptr_t, size_t> Body(Chunk* c) {
+    const size_t page = GetPageSize();
+    const uintptr_t start =
+        (reinterpret_cast<uintptr_t>(c) + sizeof(Chunk) + page - 1) &
+        ~(page - 1);
+    return {start, reinterpret_cast<uintptr_t>(c) + kChunkSize - start};
+  }
+
+  ABSL_ATTRIBUTE_RETURNS_NONNULL T* LockAndAllocMemory() {
+    AllocationGuardSpinLockHolder l(metadata_lock_);
+
+    Chunk* c = nullptr;
+    for (int b = kBuckets - 1; b >= 0 && c == nullptr; --b) {
+      c = lists_[b];
+    }
+    if (c == nullptr) {
+      c = empty_;
+    }
+    if (c != nullptr) {
+      Remove(c);
+    } else if (released_ != nullptr) {
+      // Reuse a released chunk; its body faults back in as it is carved.
+      c = released_;
+      released_ = c->next;
+      --released_chunks_;
+      const size_t body = Body(c).second;
+      arena_->UpdateAllocatedAndNonresident(body, -static_cast<int64_t>(body));
+    } else {
+      c = static_cast<Chunk*>(
+          arena_->Alloc(kChunkSize, static_cast<std::align_val_t>(kChunkSize)));
+      c->free_list = nullptr;
+      c->live = 0;
+      c->carved = 0;
+    }
+
+    T* result;
+    if (c->free_list != nullptr) {
+      result = static_cast<T*>(c->free_list);
+#ifdef ABSL_HAVE_ADDRESS_SANITIZER
+      ASAN_UNPOISON_MEMORY_REGION(result, sizeof(T));
+#endif
+      c->free_list = *reinterpret_cast<void**>(result);
+    } else {
+      TC_ASSERT_LT(c->carved, kCapacity);
+      result = reinterpret_cast<T*>(reinterpret_cast<char*>(c) +
+                                    kObjectsOffset + c->carved * sizeof(T));
+      ++c->carved;
+      ++stats_.total;
+    }
+    ++c->live;
+    ++stats_.in_use;
+    Push(c, Bucket(c->live));
+    ABSL_ANNOTATE_MEMORY_IS_UNINITIALIZED(result, sizeof(T));
+    return result;
+  }
+
+  void LockAndDeleteMemory(T* p) ABSL_ATTRIBUTE_NONNULL() {
+    AllocationGuardSpinLockHolder l(metadata_lock_);
+
+    Chunk* c = ChunkOf(p);
+    TC_ASSERT_GT(c->live, 0);
+    *reinterpret_cast<void**>(p) = c->free_list;
+#ifdef ABSL_HAVE_ADDRESS_SANITIZER
+    ASAN_POISON_MEMORY_REGION(p, sizeof(T));
+#endif
+    c->free_list = p;
+    --c->live;
+    --stats_.in_use;
+
+    const int bucket = c->live == 0 ? kBuckets : Bucket(c->live);
+    if (bucket == c->list) return;
+    Remove(c);
+    if (bucket != kBuckets || num_empty_ < kMaxEmptyChunks) {
+      Push(c, bucket);
+      return;
+    }
+
+    // Release the chunk.  Its objects are all free, so forget them.
+    stats_.total -= c->carved;
+    c->free_list = nullptr;
+    c->carved = 0;
+    auto [start, body] = Body(c);
+#ifdef ABSL_HAVE_ADDRESS_SANITIZER
+    ASAN_UNPOISON_MEMORY_REGION(reinterpret_cast<void*>(start), body);
+#endif
+    if (madvise(reinterpret_cast<void*>(start), body, MADV_DONTNEED) == 0) {
+      arena_->UpdateAllocatedAndNonresident(-static_cast<int64_t>(body), body);
+      c->next = released_;
+      released_ = c;
+      ++released_chunks_;
+    } else {
+      Push(c, kBuckets);
+    }
+  }
+
+  // Arena from which to allocate memory
+  Arena* arena_;
+
+  mutable absl::base_internal::SpinLock metadata_lock_{
+      absl::base_internal::SCHEDULE_KERNEL_ONLY};
+
+  // Partially used chunks, by occupancy.
+  Chunk* lists_[kBuckets] ABSL_GUARDED_BY(metadata_lock_) = {};
+  // Empty but resident chunks.
+  Chunk* empty_ ABSL_GUARDED_BY(metadata_lock_) = nullptr;
+  size_t num_empty_ ABSL_GUARDED_BY(metadata_lock_) = 0;
+  // Chunks returned to the OS, singly linked.
+  Chunk* released_ ABSL_GUARDED_BY(metadata_lock_) = nullptr;
+  size_t released_chunks_ ABSL_GUARDED_BY(metadata_lock_) = 0;
+
+  AllocatorStats stats_ ABSL_GUARDED_BY(metadata_lock_) = {0, 0};
+};
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,122 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/metadata_object_allocator.h"
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/arena.h"
+#include "tcmalloc/common.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+struct alignas(64) Object {
+  explicit Object(int v) : value(v) {}
+
+  int value;
+};
+
+using Allocator = ReleasingMetadataObjectAllocator<Object>;
+
+uintptr_t ChunkOf(const Object* p) {
+  return reinterpret_cast<uintptr_t>(p) & ~(Allocator::kChunkSize - 1);
+}
+
+class ReleasingMetadataObjectAllocatorTest : public testing::Test {
+ protected:
+  // Allocates objects until `chunks` chunks are full.
+  std::vector<Object*> FillChunks(int chunks) {
+    std::vector<Object*> objects;
+    int seen = 0;
+    while (true) {
+      Object* p = allocator_.New(static_cast<int>(objects.size()));
+      if (!objects.empty() && ChunkOf(p) != ChunkOf(objects.back()) &&
+          ++seen == chunks) {
+        allocator_.Delete(p);
+        return objects;
+      }
+      objects.push_back(p);
+    }
+  }
+
+  Arena arena_;
+  Allocator allocator_{arena_};
+};
+
+TEST_F(ReleasingMetadataObjectAllocatorTest, ObjectsAreUsable) {
+  std::vector<Object*> objects = FillChunks(3);
+  for (size_t i = 0; i < objects.size(); ++i) {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(objects[i]) % alignof(Object), 0);
+    EXPECT_EQ(objects[i]->value, static_cast<int>(i));
+  }
+  EXPECT_EQ(allocator_.stats().in_use, objects.size());
+  for (Object* p : objects) allocator_.Delete(p);
+  EXPECT_EQ(allocator_.stats().in_use, 0);
+}
+
+TEST_F(ReleasingMetadataObjectAllocatorTest, EmptyChunksAreReleased) {
+  std::vector<Object*> objects = FillChunks(4);
+  const size_t resident = arena_.stats().bytes_allocated;
+  for (Object* p : objects) allocator_.Delete(p);
+
+  // One empty chunk, left over by FillChunks, stays resident.
+  EXPECT_EQ(allocator_.released_bytes(), 4 * Allocator::kChunkSize);
+  EXPECT_GT(arena_.stats().bytes_nonresident, 0);
+  EXPECT_LT(arena_.stats().bytes_allocated, resident);
+  EXPECT_LT(allocator_.stats().total, objects.size());
+
+  // Released chunks are reused, and their memory reads as new.
+  objects = FillChunks(4);
+  EXPECT_EQ(allocator_.released_bytes(), 0);
+  EXPECT_EQ(arena_.stats().bytes_allocated, resident);
+  EXPECT_EQ(arena_.stats().bytes_nonresident, 0);
+  for (size_t i = 0; i < objects.size(); ++i) {
+    EXPECT_EQ(objects[i]->value, static_cast<int>(i));
+  }
+  for (Object* p : objects) allocator_.Delete(p);
+}
+
+TEST_F(ReleasingMetadataObjectAllocatorTest, PrefersFullestChunk) {
+  std::vector<Object*> objects = FillChunks(3);
+  const uintptr_t first = ChunkOf(objects.front());
+  const uintptr_t last = ChunkOf(objects.back());
+
+  // Leave the first chunk almost full and the last one almost empty.
+  std::vector<Object*> kept;
+  for (Object* p : objects) {
+    const uintptr_t chunk = ChunkOf(p);
+    const bool drop = (chunk == first && p == objects.front()) ||
+                      (chunk == last && p != objects.back());
+    if (drop) {
+      allocator_.Delete(p);
+    } else {
+      kept.push_back(p);
+    }
+  }
+
+  Object* p = allocator_.New(0);
+  EXPECT_EQ(ChunkOf(p), first);
+  allocator_.Delete(p);
+  for (Object* q : kept) allocator_.Delete(q);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -30,6 +30,7 @@
 #include "absl/numeric/bits.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "tcmalloc/arena.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/huge_page_filler.h"
@@ -91,6 +92,15 @@ class FakeStaticForwarder {
   void set_huge_region_adaptive_release(bool value) {
     huge_region_adaptive_release_ = value;
   }
+  bool hugepage_aligned_large_allocations() const {
+    return hugepage_aligned_large_allocations_;
+  }
+  void set_hugepage_aligned_large_allocations(bool value) {
+    hugepage_aligned_large_allocations_ = value;
+  }
+  int CurrentNumaNode() const { return numa_node_; }
+  void set_numa_node(int value) { numa_node_ = value; }
+
   bool release_max_cold_pages() const { return release_max_cold_pages_; }
   void set_release_max_cold_pages(bool value) {
     release_max_cold_pages_ = value;
@@ -103,6 +113,55 @@ class FakeStaticForwarder {
     back_size_threshold_bytes_ = value;
   }
 
+  absl::Duration hugepage_collapse_budget() const {
+    return hugepage_collapse_budget_;
+  }
+  void set_hugepage_collapse_budget(absl::Duration value) {
+    hugepage_collapse_budget_ = value;
+  }
+
+  int64_t gigantic_page_threshold() const { return gigantic_page_threshold_; }
+  void set_gigantic_page_threshold(int64_t value) {
+    gigantic_page_threshold_ = value;
+  }
+  void set_gigantic_pages_available(size_t n) { gigantic_pages_available_ = n; }
+
+  int64_t eager_populate_threshold() const { return eager_populate_threshold_; }
+  void set_eager_populate_threshold(int64_t value) {
+    eager_populate_threshold_ = value;
+  }
+  size_t populated_bytes() const { return populated_bytes_; }
+
+  int32_t far_memory_numa_node() const { return far_memory_numa_node_; }
+  void set_far_memory_numa_node(int32_t value) {
+    far_memory_numa_node_ = value;
+  }
+  size_t far_tier_moves() const { return far_tier_moves_; }
+
+  absl::Duration cold_page_out_idle_time() const {
+    return cold_page_out_idle_time_;
+  }
+  void set_cold_page_out_idle_time(absl::Duration value) {
+    cold_page_out_idle_time_ = value;
+  }
+  bool high_memory_pressure() const { return high_memory_pressure_; }
+  void set_high_memory_pressure(bool value) { high_memory_pressure_ = value; }
+  void set_move_succeeds(bool value) { move_succeeds_ = value; }
+  size_t moved_bytes() const { return moved_bytes_; }
+
+  bool adaptive_madvise() const { return adaptive_madvise_; }
+  void set_adaptive_madvise(bool value) { adaptive_madvise_ = value; }
+  bool unbacked_memory_is_zero() const { return unbacked_memory_is_zero_; }
+  void set_unbacked_memory_is_zero(bool value) {
+    unbacked_memory_is_zero_ = value;
+  }
+  bool mlockall_mode() const { return mlockall_mode_; }
+  void set_mlockall_mode(bool value) { mlockall_mode_ = value; }
+  // Whether lazily freed memory is still resident when it is reused.
+  void set_lazily_freed_resident(bool value) {
+    lazily_freed_resident_ = value;
+  }
+
   EnableUnfilteredCollapse enable_unfiltered_collapse() const {
     return enable_unfiltered_collapse_;
   }
@@ -112,7 +171,7 @@ class FakeStaticForwarder {
   }
 
   // Arena state.
-  Arena& arena() { return arena_; }
+  Arena& arena(MemoryTag) { return arena_; }
 
   // PageAllocator state.
 
@@ -167,8 +226,11 @@ class FakeStaticForwarder {
   }
 
   // SystemAlloc state.
+  // The fake address space has no size class regions, so size_class_region
+  // is ignored.
   [[nodiscard]] AddressRange AllocatePages(size_t bytes, size_t align,
-                                           MemoryTag tag) {
+                                           MemoryTag tag,
+                                           size_t size_class_region = 0) {
     TC_CHECK(absl::has_single_bit(align), "align=%v", align);
     uintptr_t allocation, aligned_allocation, new_allocation;
     do {
@@ -184,6 +246,16 @@ class FakeStaticForwarder {
     return AddressRange{ptr, bytes};
   }
 
+  [[nodiscard]] AddressRange AllocateGiganticPages(size_t bytes,
+                                                   MemoryTag tag) {
+    const size_t pages = (bytes + kGiganticPageSize - 1) / kGiganticPageSize;
+    if (pages > gigantic_pages_available_) {
+      return {nullptr, 0};
+    }
+    gigantic_pages_available_ -= pages;
+    return AllocatePages(pages * kGiganticPageSize, kGiganticPageSize, tag);
+  }
+
   void Back(Range r) {
     const uintptr_t start =
         reinterpret_cast<uintptr_t>(r.p.start_addr()) & ~kTagMask;
@@ -191,6 +263,11 @@ class FakeStaticForwarder {
     TC_CHECK_LE(end, fake_allocation_);
   }
 
+  void Populate(Range r) {
+    Back(r);
+    populated_bytes_ += r.n.in_bytes();
+  }
+
   [[nodiscard]] MemoryModifyStatus ReleasePages(Range r) {
     const uintptr_t start =
         reinterpret_cast<uintptr_t>(r.p.start_addr()) & ~kTagMask;
@@ -200,12 +277,39 @@ class FakeStaticForwarder {
     return {.success = release_succeeds_, .error_number = 0};
   }
 
+  [[nodiscard]] size_t ReleasePagesBatch(absl::Span<const Range> ranges) {
+    size_t n = 0;
+    while (n < ranges.size() && ReleasePages(ranges[n]).success) ++n;
+    return n;
+  }
+
+  [[nodiscard]] MemoryModifyStatus ReleasePagesReusedSoon(Range r) {
+    MemoryModifyStatus ret = ReleasePages(r);
+    ret.lazily_freed = ret.success;
+    return ret;
+  }
+
+  size_t ResidentBytes(Range r) const {
+    return lazily_freed_resident_ ? r.in_bytes() : 0;
+  }
+
   [[noreturn]] void ReportDoubleFree(void* ptr) {
     TC_BUG("Double free of %p", ptr);
   }
   [[nodiscard]] MemoryModifyStatus CollapsePages(Range r) {
     return {.success = collapse_succeeds_, .error_number = error_number_};
   }
+  [[nodiscard]] MemoryModifyStatus SetMemoryTier(Range r, bool far) {
+    if (far) ++far_tier_moves_;
+    return {.success = true, .error_number = 0};
+  }
+  [[nodiscard]] MemoryModifyStatus PageOut(Range r, bool reclaim) {
+    return {.success = true, .error_number = 0};
+  }
+  [[nodiscard]] MemoryModifyStatus MovePages(Range r, PageId to) {
+    if (move_succeeds_) moved_bytes_ += r.in_bytes();
+    return {.success = move_succeeds_, .error_number = 0};
+  }
   void SetAnonVmaName(
       Range, std::optional<absl::string_view> name) { /* unimplemented */ }
 
@@ -229,13 +333,30 @@ class FakeStaticForwarder {
       SubreleaseUnbackedMode::kEnabled;
   bool release_succeeds_ = true;
   bool collapse_succeeds_ = true;
+  bool move_succeeds_ = true;
   int error_number_ = 0;
   bool huge_region_demand_based_release_ = false;
   bool huge_region_adaptive_release_ = false;
+  bool hugepage_aligned_large_allocations_ = false;
   bool release_max_cold_pages_ = false;
+  int numa_node_ = HugePageFiller<PageTracker>::kAnyNumaNode;
 
   bool back_allocations_ = false;
   int32_t back_size_threshold_bytes_ = kPageSize;
+  absl::Duration hugepage_collapse_budget_ = absl::ZeroDuration();
+  int64_t gigantic_page_threshold_ = 0;
+  size_t gigantic_pages_available_ = 0;
+  int64_t eager_populate_threshold_ = 0;
+  size_t populated_bytes_ = 0;
+  int32_t far_memory_numa_node_ = -1;
+  size_t far_tier_moves_ = 0;
+  absl::Duration cold_page_out_idle_time_ = absl::ZeroDuration();
+  bool high_memory_pressure_ = false;
+  size_t moved_bytes_ = 0;
+  bool adaptive_madvise_ = false;
+  bool lazily_freed_resident_ = true;
+  bool unbacked_memory_is_zero_ = true;
+  bool mlockall_mode_ = false;
   EnableUnfilteredCollapse enable_unfiltered_collapse_ =
       EnableUnfilteredCollapse::kDisabled;
   Arena arena_;
@@ -15,11 +15,14 @@
 #ifndef TCMALLOC_MOCK_STATIC_FORWARDER_H_
 #define TCMALLOC_MOCK_STATIC_FORWARDER_H_
 
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <map>
 #include <new>
+#include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -29,6 +32,7 @@
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/hook_list.h"
+#include "tcmalloc/lifetime_predictor.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/span.h"
 
@@ -42,6 +46,12 @@ class FakeStaticForwarder {
  public:
   FakeStaticForwarder()
       : class_size_(0), pages_(), page_size_(kPageSize), clock_frequency_(0) {}
+  ~FakeStaticForwarder() {
+    absl::MutexLock l(mu_);
+    for (auto [ptr, alignment] : allocs_) {
+      ::operator delete(ptr, alignment);
+    }
+  }
   void Init(size_t class_size, Bytes span_bytes, size_t num_objects_to_move,
             size_t page_size, double clock_frequency) {
     class_size_ = class_size;
@@ -75,6 +85,8 @@ class FakeStaticForwarder {
 
   size_t class_to_size(int size_class) const { return class_size_; }
   Length class_to_pages(int size_class) const { return pages_; }
+  size_t class_to_colors(int size_class) const { return colors_; }
+  void set_class_to_colors(size_t colors) { colors_ = colors; }
   size_t num_objects_to_move(int size_class) const {
     return num_objects_to_move_;
   }
@@ -86,16 +98,27 @@ class FakeStaticForwarder {
     }
   }
 
+  // Objects of spans this forwarder did not allocate belong to another size
+  // class.
+  size_t PartitionObjectsOfClass(absl::Span<void*> batch, int size_class) {
+    auto foreign = std::stable_partition(
+        batch.begin(), batch.end(),
+        [this](void* object) { return MapObjectToSpan(object) != nullptr; });
+    return foreign - batch.begin();
+  }
+
   [[nodiscard]] Span* MapObjectToSpan(const void* object) {
     const PageId page = PageIdContaining(object);
 
     absl::MutexLock l(mu_);
-    auto it = map_.lower_bound(page);
-    if (it->first != page && it != map_.begin()) {
-      --it;
+    // The last span starting at or before page, if any.
+    auto it = map_.upper_bound(page);
+    if (it == map_.begin()) {
+      return nullptr;
     }
+    --it;
 
-    if (it->first <= page && page <= it->second.span->last_page()) {
+    if (page <= it->second.span->last_page()) {
       return it->second.span;
     }
 
@@ -103,7 +126,8 @@ class FakeStaticForwarder {
   }
 
   [[nodiscard]] Span* AllocateSpan(int, size_t objects_per_span,
-                                   Length pages_per_span) {
+                                   Length pages_per_span,
+                                   LifetimePrediction lifetime) {
     void* backing = ::operator new(pages_per_span.raw_num() * page_size_,
                                    std::align_val_t(page_size_));
     PageId page = PageIdContaining(backing);
@@ -115,12 +139,52 @@ class FakeStaticForwarder {
     info.span = span;
     SpanAllocInfo span_alloc_info = {
         .objects_per_span = objects_per_span,
-        .density = AccessDensityPrediction::kSparse};
+        .density = AccessDensityPrediction::kSparse,
+        .lifetime = lifetime};
     info.span_alloc_info = span_alloc_info;
     map_.emplace(page, info);
     return span;
   }
 
+  [[nodiscard]] size_t AllocateSpans(int size_class, size_t objects_per_span,
+                                     Length pages_per_span,
+                                     LifetimePrediction lifetime,
+                                     absl::Span<Span*> spans) {
+    for (Span*& span : spans) {
+      span = AllocateSpan(size_class, objects_per_span, pages_per_span,
+                          lifetime);
+    }
+    return spans.size();
+  }
+
+  void* Alloc(size_t size, std::align_val_t alignment) {
+    void* ptr = ::operator new(size, alignment);
+    absl::MutexLock l(mu_);
+    allocs_.push_back({ptr, alignment});
+    return ptr;
+  }
+
+  unsigned CurrentShard(unsigned num_shards) const {
+    return current_shard_.load(std::memory_order_relaxed) % num_shards;
+  }
+  void set_current_shard(unsigned shard) {
+    current_shard_.store(shard, std::memory_order_relaxed);
+  }
+
+  bool prefetch_span_freelists() const {
+    return prefetch_span_freelists_.load(std::memory_order_relaxed);
+  }
+  void set_prefetch_span_freelists(bool value) {
+    prefetch_span_freelists_.store(value, std::memory_order_relaxed);
+  }
+
+  bool cache_empty_spans() const {
+    return cache_empty_spans_.load(std::memory_order_relaxed);
+  }
+  void set_cache_empty_spans(bool value) {
+    cache_empty_spans_.store(value, std::memory_order_relaxed);
+  }
+
   void DeallocateSpans(size_t, absl::Span<Span*> free_spans) {
     {
       absl::MutexLock l(mu_);
@@ -145,8 +209,13 @@ class FakeStaticForwarder {
 
   absl::Mutex mu_;
   std::map<PageId, SpanInfo> map_ ABSL_GUARDED_BY(mu_);
+  std::vector<std::pair<void*, std::align_val_t>> allocs_ ABSL_GUARDED_BY(mu_);
+  std::atomic<unsigned> current_shard_ = 0;
+  std::atomic<bool> prefetch_span_freelists_ = false;
+  std::atomic<bool> cache_empty_spans_ = false;
   size_t class_size_;
   Length pages_;
+  size_t colors_ = 1;
   size_t num_objects_to_move_;
   size_t page_size_;
   std::atomic<uint64_t> clock_;
@@ -181,9 +250,18 @@ class RawMockStaticForwarder : public FakeStaticForwarder {
         });
     ON_CALL(*this, AllocateSpan)
         .WillByDefault([this](int size_class, size_t objects_per_span,
-                              Length pages_per_span) {
+                              Length pages_per_span,
+                              LifetimePrediction lifetime) {
           return FakeStaticForwarder::AllocateSpan(size_class, objects_per_span,
-                                                   pages_per_span);
+                                                   pages_per_span, lifetime);
+        });
+    ON_CALL(*this, AllocateSpans)
+        .WillByDefault([this](int size_class, size_t objects_per_span,
+                              Length pages_per_span,
+                              LifetimePrediction lifetime,
+                              absl::Span<Span*> spans) {
+          return FakeStaticForwarder::AllocateSpans(
+              size_class, objects_per_span, pages_per_span, lifetime, spans);
         });
     ON_CALL(*this, DeallocateSpans)
         .WillByDefault([this](size_t objects_per_span,
@@ -201,7 +279,11 @@ class RawMockStaticForwarder : public FakeStaticForwarder {
   MOCK_METHOD(void, MapObjectsToSpans,
               (absl::Span<void*> batch, Span** spans, int expected_size_class));
   MOCK_METHOD(Span*, AllocateSpan,
-              (int size_class, size_t objects_per_span, Length pages_per_span));
+              (int size_class, size_t objects_per_span, Length pages_per_span,
+               LifetimePrediction lifetime));
+  MOCK_METHOD(size_t, AllocateSpans,
+              (int size_class, size_t objects_per_span, Length pages_per_span,
+               LifetimePrediction lifetime, absl::Span<Span*> spans));
   MOCK_METHOD(void, DeallocateSpans,
               (size_t object_per_span, absl::Span<Span*> free_spans));
 };
@@ -118,10 +118,13 @@ class FakeShardedTransferCacheManager
   static void SetCacheForLargeClassesOnly(bool value) {
     enable_cache_for_large_classes_only_ = value;
   }
+  static bool UseAdaptiveCache() { return enable_adaptive_cache_; }
+  static void SetAdaptiveCache(bool value) { enable_adaptive_cache_ = value; }
 
  private:
   static bool enable_generic_cache_;
   static bool enable_cache_for_large_classes_only_;
+  static bool enable_adaptive_cache_;
 };
 
 // Wires up a largely functional TransferCache + TransferCacheManager +
@@ -416,13 +419,15 @@ class FakeShardedTransferCacheEnvironment {
                                       MinimalFakeCentralFreeList>;
 
   explicit FakeShardedTransferCacheEnvironment(int num_shards,
-                                               bool use_generic_cache)
+                                               bool use_generic_cache,
+                                               bool use_adaptive_cache = false)
       : sharded_manager_(&owner_, &cpu_layout_) {
     if (use_generic_cache) {
       owner_.SetGenericCache(true);
     } else {
       owner_.SetCacheForLargeClassesOnly(true);
     }
+    owner_.SetAdaptiveCache(use_adaptive_cache);
 
     cpu_layout_.Init(num_shards);
     sharded_manager_.Init();
@@ -19,6 +19,7 @@
 #include <algorithm>
 #include <limits>
 #include <new>
+#include <utility>
 #include <vector>
 
 #include "benchmark/benchmark.h"
@@ -481,5 +482,54 @@ TEST(HotColdNew, OperatorNewArrayAlignedNothrow) {
 }
 #endif  // __cpp_aligned_new
 
+TEST(PrefaultNew, InvalidSizeNothrow) {
+  constexpr size_t kBadSize = std::numeric_limits<size_t>::max();
+  EXPECT_EQ(::operator new(kBadSize, std::nothrow, prefault), nullptr);
+  EXPECT_EQ(::operator new[](kBadSize, std::nothrow, prefault), nullptr);
+}
+
+TEST(PrefaultNew, OperatorNew) {
+  // Cover both small objects, which are returned as is, and page-level
+  // allocations, which are populated before being returned.
+  for (size_t size : {size_t{0}, size_t{1}, size_t{1} << 10, size_t{1} << 18,
+                      (size_t{1} << 20) + 1, size_t{8} << 20}) {
+    void* ret = ::operator new(size, prefault);
+    ASSERT_NE(ret, nullptr);
+    benchmark::DoNotOptimize(memset(ret, 0xBF, size));
+    ::operator delete(ret);
+
+    ret = ::operator new[](size, std::nothrow, prefault);
+    ASSERT_NE(ret, nullptr);
+    benchmark::DoNotOptimize(memset(ret, 0xBF, size));
+    sized_array_delete(ret, size);
+  }
+}
+
+template <size_t kSize>
+void CheckConstantSizeNew() {
+  void* ret = New<kSize>();
+  ASSERT_NE(ret, nullptr);
+  benchmark::DoNotOptimize(memset(ret, 0xBF, kSize));
+  // The object must come from the size class ::operator new(kSize) uses.
+  EXPECT_EQ(MallocExtension::GetAllocatedSize(ret), nallocx(kSize, 0))
+      << kSize;
+  ::operator delete(ret, kSize);
+}
+
+template <size_t... kSizes>
+void CheckConstantSizeNew(std::index_sequence<kSizes...>) {
+  (CheckConstantSizeNew<kSizes>(), ...);
+}
+
+TEST(ConstantSizeNew, MatchesOperatorNew) {
+  CheckConstantSizeNew(std::make_index_sequence<130>());
+  CheckConstantSizeNew<255>();
+  CheckConstantSizeNew<1023>();
+  CheckConstantSizeNew<1024>();
+  // Larger sizes take the regular path.
+  CheckConstantSizeNew<1025>();
+  CheckConstantSizeNew<(size_t{1} << 20) + 1>();
+}
+
 }  // namespace
 }  // namespace tcmalloc
@@ -0,0 +1,214 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/object_region.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include "absl/base/attributes.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/page_allocator_interface.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// Region spans are handed out and returned whole, like large allocations.
+constexpr SpanAllocInfo kRegionSpanInfo = {
+    .objects_per_span = 1, .density = AccessDensityPrediction::kSparse};
+
+ABSL_CONST_INIT StatsCounter live_regions;
+ABSL_CONST_INIT StatsCounter region_span_bytes;
+ABSL_CONST_INIT StatsCounter region_object_bytes;
+ABSL_CONST_INIT StatsCounter region_separate_bytes;
+
+// Returns spans to the page allocator, taking pageheap_lock once for up to
+// kBatch of them.
+class SpanReleaser {
+ public:
+  explicit SpanReleaser(MemoryTag tag) : tag_(tag) {}
+  ~SpanReleaser() { Flush(); }
+
+  void Release(Span* span) {
+#ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
+    spans_[n_++] = span;
+#else
+    states_[n_++] = {Range(span->first_page(), span->num_pages()),
+                     span->donated()};
+    Span::Delete(span);
+#endif  // TCMALLOC_INTERNAL_LEGACY_LOCKING
+    if (n_ == kBatch) Flush();
+  }
+
+ private:
+  static constexpr size_t kBatch = 64;
+
+  void Flush() {
+    if (n_ == 0) return;
+    PageHeapSpinLockHolder l;
+    for (size_t i = 0; i < n_; ++i) {
+#ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
+      tc_globals.page_allocator().Delete(spans_[i], tag_, kRegionSpanInfo);
+#else
+      tc_globals.page_allocator().Delete(states_[i], tag_, kRegionSpanInfo);
+#endif  // TCMALLOC_INTERNAL_LEGACY_LOCKING
+    }
+    n_ = 0;
+  }
+
+  const MemoryTag tag_;
+  size_t n_ = 0;
+#ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
+  Span* spans_[kBatch];
+#else
+  PageAllocatorInterface::AllocationState states_[kBatch];
+#endif  // TCMALLOC_INTERNAL_LEGACY_LOCKING
+};
+
+}  // namespace
+
+ObjectRegion* ObjectRegion::Create(MemoryTag tag) {
+  Span* span = tc_globals.page_allocator().New(Length(1), kRegionSpanInfo, tag);
+  if (span == nullptr) return nullptr;
+  live_regions.Add(1);
+  return new (span->start_address()) ObjectRegion(span, tag);
+}
+
+ObjectRegion::ObjectRegion(Span* first, MemoryTag tag)
+    : first_(first),
+      tag_(tag),
+      next_span_pages_(Length(2)),
+      span_bytes_(first->bytes_in_span()) {
+  region_span_bytes.Add(span_bytes_);
+  ResetCursor(first, reinterpret_cast<uintptr_t>(this + 1));
+}
+
+void ObjectRegion::ResetCursor(const Span* span, uintptr_t start) {
+  cursor_ = start;
+  limit_ = reinterpret_cast<uintptr_t>(span->start_address()) +
+           span->bytes_in_span();
+}
+
+void* ObjectRegion::AllocateSlow(size_t size, size_t alignment) {
+  TC_ASSERT_LE(alignment, kPageSize);
+  // Whatever is left of the current span is abandoned.  Keeping spans at least
+  // twice the largest object bounds that waste.
+  const Length pages = std::max(next_span_pages_, BytesToLengthCeil(size));
+  Span* span = tc_globals.page_allocator().New(pages, kRegionSpanInfo, tag_);
+  if (span == nullptr) return nullptr;
+  spans_.prepend(span);
+  next_span_pages_ = std::min(next_span_pages_ * 2, kPagesPerHugePage);
+
+  span_bytes_ += span->bytes_in_span();
+  region_span_bytes.Add(span->bytes_in_span());
+  region_object_bytes.Add(object_bytes_ - published_object_bytes_);
+  published_object_bytes_ = object_bytes_;
+
+  ResetCursor(span, reinterpret_cast<uintptr_t>(span->start_address()));
+  return Allocate(size, alignment);
+}
+
+bool ObjectRegion::AddSeparate(void* ptr, size_t size, size_t alignment) {
+  void* record = Allocate(sizeof(Separate), alignof(Separate));
+  if (record == nullptr) return false;
+  separate_ = new (record) Separate{separate_, ptr, size, alignment};
+  separate_bytes_ += size;
+  region_separate_bytes.Add(size);
+  return true;
+}
+
+void ObjectRegion::ReleaseSpans() {
+  SpanReleaser releaser(tag_);
+  while (!spans_.empty()) {
+    Span* span = spans_.first();
+    spans_.remove(span);
+    releaser.Release(span);
+  }
+}
+
+void ObjectRegion::Reset() {
+  ReleaseSpans();
+  region_span_bytes.Add(-static_cast<int64_t>(span_bytes_ -
+                                              first_->bytes_in_span()));
+  region_object_bytes.Add(-static_cast<int64_t>(published_object_bytes_));
+  region_separate_bytes.Add(-static_cast<int64_t>(separate_bytes_));
+  span_bytes_ = first_->bytes_in_span();
+  object_bytes_ = 0;
+  published_object_bytes_ = 0;
+  separate_bytes_ = 0;
+  separate_ = nullptr;
+  next_span_pages_ = Length(2);
+  ResetCursor(first_, reinterpret_cast<uintptr_t>(this + 1));
+}
+
+void ObjectRegion::Destroy() {
+  ReleaseSpans();
+  live_regions.Add(-1);
+  region_span_bytes.Add(-static_cast<int64_t>(span_bytes_));
+  region_object_bytes.Add(-static_cast<int64_t>(published_object_bytes_));
+  region_separate_bytes.Add(-static_cast<int64_t>(separate_bytes_));
+
+  Span* first = first_;
+  const MemoryTag tag = tag_;
+  this->~ObjectRegion();
+  SpanReleaser releaser(tag);
+  releaser.Release(first);
+}
+
+ObjectRegionStats GetObjectRegionStats() {
+  return {
+      .live_regions = live_regions.value(),
+      .span_bytes = region_span_bytes.value(),
+      .object_bytes = region_object_bytes.value(),
+      .separate_bytes = region_separate_bytes.value(),
+  };
+}
+
+void PrintObjectRegionStats(Printer& out) {
+  static constexpr double MiB = 1048576.0;
+  const ObjectRegionStats stats = GetObjectRegionStats();
+  out.printf("------------------------------------------------\n");
+  out.printf("Regions: %d live\n", stats.live_regions);
+  out.printf("------------------------------------------------\n");
+  out.printf("MALLOC: %12d (%7.1f MiB) Bytes in region spans\n",
+             stats.span_bytes, stats.span_bytes / MiB);
+  out.printf("MALLOC: %12d (%7.1f MiB) Bytes of objects in region spans\n",
+             stats.object_bytes, stats.object_bytes / MiB);
+  out.printf("MALLOC: %12d (%7.1f MiB) Bytes of separate region objects\n",
+             stats.separate_bytes, stats.separate_bytes / MiB);
+}
+
+void PrintObjectRegionStatsInPbtxt(PbtxtRegion& region) {
+  const ObjectRegionStats stats = GetObjectRegionStats();
+  region.PrintI64("live_regions", stats.live_regions);
+  region.PrintI64("span_bytes", stats.span_bytes);
+  region.PrintI64("object_bytes", stats.object_bytes);
+  region.PrintI64("separate_bytes", stats.separate_bytes);
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,142 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_OBJECT_REGION_H_
+#define TCMALLOC_OBJECT_REGION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Backs tcmalloc::Region.  Objects are carved from spans of the page allocator
+// by bumping a pointer, and are freed all at once by returning the spans.  The
+// region itself lives at the start of its first span.
+//
+// Objects too large or too aligned for the spans are allocated separately by
+// the caller and recorded with AddSeparate(), so that they can be freed with
+// the region.
+//
+// Not thread-safe.
+class ObjectRegion {
+ public:
+  // Objects up to this size, and aligned to at most kPageSize, come from the
+  // region's spans.
+  static constexpr size_t kMaxSpanObjectSize = kMaxSize;
+
+  // Returns nullptr if out of memory.
+  static ObjectRegion* Create(MemoryTag tag);
+
+  ObjectRegion(const ObjectRegion&) = delete;
+  ObjectRegion& operator=(const ObjectRegion&) = delete;
+
+  // Returns `size` bytes aligned to `alignment`, or nullptr if out of memory.
+  //
+  // REQUIRES: size <= kMaxSpanObjectSize
+  // REQUIRES: alignment is a power of two no larger than kPageSize
+  void* Allocate(size_t size, size_t alignment) {
+    TC_ASSERT_LE(size, kMaxSpanObjectSize);
+    const uintptr_t p = (cursor_ + alignment - 1) & ~(alignment - 1);
+    if (ABSL_PREDICT_TRUE(p <= limit_ && size <= limit_ - p)) {
+      cursor_ = p + size;
+      object_bytes_ += size;
+      return reinterpret_cast<void*>(p);
+    }
+    return AllocateSlow(size, alignment);
+  }
+
+  // Remembers an object allocated outside the region's spans.  Returns false
+  // if out of memory.
+  bool AddSeparate(void* ptr, size_t size, size_t alignment);
+
+  // Calls f(ptr, size, alignment) for each object passed to AddSeparate()
+  // since the region was created or last reset.
+  template <typename F>
+  void ForEachSeparate(F f) const {
+    for (const Separate* s = separate_; s != nullptr; s = s->next) {
+      f(s->ptr, s->size, s->alignment);
+    }
+  }
+
+  // Releases everything allocated from the region, keeping its first span.
+  // The caller must have freed the separate objects first.
+  void Reset();
+
+  // Releases everything allocated from the region, including the region
+  // itself.  The caller must have freed the separate objects first.
+  void Destroy();
+
+ private:
+  struct Separate {
+    Separate* next;
+    void* ptr;
+    size_t size;
+    size_t alignment;
+  };
+
+  ObjectRegion(Span* first, MemoryTag tag);
+
+  void* AllocateSlow(size_t size, size_t alignment);
+  // Returns every span but the first to the page allocator.
+  void ReleaseSpans();
+  void ResetCursor(const Span* span, uintptr_t start);
+
+  Span* const first_;
+  const MemoryTag tag_;
+  // Spans after the first, newest first.
+  SpanList spans_;
+  uintptr_t cursor_;
+  uintptr_t limit_;
+  // The size of the next span we allocate; doubles up to a hugepage.
+  Length next_span_pages_;
+  Separate* separate_ = nullptr;
+  // Bytes of spans held, and of objects allocated from them and separately.
+  // The region stats are updated with these when a span is added, rather than
+  // on every allocation, and withdrawn on Reset() and Destroy().
+  size_t span_bytes_;
+  size_t object_bytes_ = 0;
+  size_t published_object_bytes_ = 0;
+  size_t separate_bytes_ = 0;
+};
+
+struct ObjectRegionStats {
+  int64_t live_regions;
+  // Bytes of the spans held by live regions.
+  int64_t span_bytes;
+  // Bytes requested from live regions and served from their spans.
+  int64_t object_bytes;
+  // Bytes requested from live regions and allocated separately.
+  int64_t separate_bytes;
+};
+
+ObjectRegionStats GetObjectRegionStats();
+void PrintObjectRegionStats(Printer& out);
+void PrintObjectRegionStatsInPbtxt(PbtxtRegion& region);
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_OBJECT_REGION_H_
@@ -14,8 +14,11 @@
 
 #include "tcmalloc/page_allocator.h"
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <limits>
+#include <optional>
 
 #include "absl/base/macros.h"
 #include "absl/base/optimization.h"
@@ -25,6 +28,8 @@
 #include "tcmalloc/internal/environment.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/internal/sysinfo.h"
+#include "tcmalloc/large_span_cache.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/static_vars.h"
@@ -44,11 +49,11 @@ PageAllocator::PageAllocator() {
 
   normal_impl_[0] = new (&choices_[part++].hpaa)
       HugePageAwareAllocator(HugePageAwareAllocatorOptions{MemoryTag::kNormal});
-  if (tc_globals.active_partitions() > 1) {
-    normal_impl_[1] =
+  for (size_t p = 1; p < tc_globals.active_partitions(); ++p) {
+    normal_impl_[p] =
         new (tc_globals.arena().Alloc(sizeof(HugePageAwareAllocator)))
             HugePageAwareAllocator(
-                HugePageAwareAllocatorOptions{MemoryTag::kNormalP1});
+                HugePageAwareAllocatorOptions{MultiNormalTag(p)});
   }
   sampled_impl_[0] = new (&choices_[part++].hpaa) HugePageAwareAllocator(
       HugePageAwareAllocatorOptions{MemoryTag::kSampled});
@@ -66,11 +71,25 @@ PageAllocator::PageAllocator() {
   } else {
     cold_impl_ = normal_impl_[0];
   }
+  size_class_regions_ = Parameters::size_class_regions();
+  for (size_t c = 1; c <= size_class_regions_; ++c) {
+    size_classed_impl_[c] =
+        new (tc_globals.arena().Alloc(sizeof(HugePageAwareAllocator)))
+            HugePageAwareAllocator(HugePageAwareAllocatorOptions{
+                .tag = MemoryTag::kSizeClassed, .size_class_region = c});
+  }
   alg_ = HPAA;
   TC_CHECK_LE(part, ABSL_ARRAYSIZE(choices_));
 }
 
 void PageAllocator::ShrinkToUsageLimit(Length n) {
+  if (n != Length(0) && n.in_bytes() <= usage_reservation_) {
+    usage_reservation_ -= n.in_bytes();
+    ++reserved_usage_checks_;
+    return;
+  }
+  ++usage_checks_;
+
   BackingStats s = stats();
   const size_t backed =
       s.system_bytes - s.unmapped_bytes + tc_globals.metadata_bytes();
@@ -92,6 +111,28 @@ void PageAllocator::ShrinkToUsageLimit(Length n) {
   // occur if we allocate space for many objects preemptively and only later
   // sample them (incrementing sampled_objects_size_).
 
+  // Memory released with MADV_FREE counts towards RSS until the kernel
+  // reclaims it, so MadvisePreference::kAdaptive stops using it once we get
+  // within 10% of the limit.
+  const bool pressure = limits_[kSoft] != std::numeric_limits<size_t>::max() &&
+                        backed >= limits_[kSoft] / 10 * 9;
+  if (ABSL_PREDICT_FALSE(pressure !=
+                         tc_globals.system_allocator().memory_pressure())) {
+    tc_globals.system_allocator().set_memory_pressure(pressure);
+  }
+
+  // Reserve the growth that can be skipped until the next check.  Only half
+  // the distance to the pressure threshold is reserved, so that the checks
+  // grow denser as the heap approaches it, and crossing it (or the limits
+  // above it) is still caught at the allocation that does.
+  usage_reservation_ = peak_backed_bytes_ - backed;
+  if (limits_[kSoft] != std::numeric_limits<size_t>::max()) {
+    const size_t threshold = limits_[kSoft] / 10 * 9;
+    usage_reservation_ =
+        pressure ? 0
+                 : std::min(usage_reservation_, (threshold - backed) / 2);
+  }
+
   if (limits_[kSoft] == std::numeric_limits<size_t>::max()) {
     // Limits are not set.
     return;
@@ -104,12 +145,21 @@ void PageAllocator::ShrinkToUsageLimit(Length n) {
   ++limit_hits_[kSoft];
   if (limits_[kHard] < backed) ++limit_hits_[kHard];
 
+  // The spans held by the large span cache are allocated as far as the page
+  // heap is concerned.  Return them, so that the releases below can take
+  // them.  Only the global page allocator hands out the spans it holds.
+  if (this == &tc_globals.page_allocator()) {
+    FlushLargeSpanCacheLocked();
+  }
+
   const size_t overage = backed - limits_[kSoft];
   const Length pages = BytesToLengthCeil(overage);
   if (ShrinkHardBy(pages, kSoft)) {
     ++successful_shrinks_after_limit_hit_[kSoft];
     return;
   }
+  // Hits while the caches are to be drained are folded into the pending one.
+  if (!cache_drain_requested_) ++limit_tier_hits_[kSoft][kUnsatisfied];
 
   // We're still not below limit.
   if (limits_[kHard] < std::numeric_limits<size_t>::max()) {
@@ -129,6 +179,7 @@ void PageAllocator::ShrinkToUsageLimit(Length n) {
                    limit_hits_[kHard]);
       return;
     }
+    ++limit_tier_hits_[kHard][kUnsatisfied];
     const size_t hard_limit = limits_[kHard];
     limits_[kHard] = std::numeric_limits<size_t>::max();
     TC_BUG(
@@ -140,6 +191,9 @@ void PageAllocator::ShrinkToUsageLimit(Length n) {
         hard_limit);
   }
 
+  // The background thread finishes the soft limit hit.
+  if (cache_drain_requested_) return;
+
   // Print logs once.
   static bool warned = false;
   if (warned) return;
@@ -148,15 +202,45 @@ void PageAllocator::ShrinkToUsageLimit(Length n) {
          limits_[kSoft]);
 }
 
-bool PageAllocator::ShrinkHardBy(Length pages, LimitKind limit_kind) {
+void PageAllocator::ShrinkAfterCacheDrain() {
+  PageHeapSpinLockHolder l;
+  if (!cache_drain_requested_) return;
+  cache_drain_requested_ = false;
+  if (limits_[kSoft] == std::numeric_limits<size_t>::max()) return;
+
+  BackingStats s = stats();
+  const size_t backed =
+      s.system_bytes - s.unmapped_bytes + tc_globals.metadata_bytes();
+  if (backed <= limits_[kSoft]) {
+    ++limit_tier_hits_[kSoft][kCaches];
+    ++successful_shrinks_after_limit_hit_[kSoft];
+    return;
+  }
+  if (ShrinkHardBy(BytesToLengthCeil(backed - limits_[kSoft]), kSoft,
+                   kCaches)) {
+    ++successful_shrinks_after_limit_hit_[kSoft];
+    return;
+  }
+  ++limit_tier_hits_[kSoft][kUnsatisfied];
+}
+
+bool PageAllocator::ShrinkHardBy(Length pages, LimitKind limit_kind,
+                                 LimitTier tier) {
   const PageReleaseReason release_reason =
       limit_kind == kHard ? PageReleaseReason::kHardLimitExceeded
                           : PageReleaseReason::kSoftLimitExceeded;
   Length ret = ReleaseAtLeastNPages(pages, release_reason);
+  if (pages <= ret) {
+    // We released target amount.
+    ++limit_tier_hits_[limit_kind][tier];
+    return true;
+  }
   if (alg_ == HPAA) {
-    if (pages <= ret) {
-      // We released target amount.
-      return true;
+    // Draining the caches may empty enough spans to spare the hugepages.
+    if (limit_kind == kSoft && tier == kFreePages &&
+        Parameters::limit_shrinks_caches()) {
+      cache_drain_requested_ = true;
+      return false;
     }
 
     // At this point, we have no choice but to break up hugepages.
@@ -178,6 +262,7 @@ bool PageAllocator::ShrinkHardBy(Length pages, LimitKind limit_kind) {
                  ->ReleaseAtLeastNPagesBreakingHugepages(pages - ret,
                                                          release_reason);
       if (ret >= pages) {
+        ++limit_tier_hits_[limit_kind][kBreakingHugepages];
         return true;
       }
     }
@@ -186,28 +271,105 @@ bool PageAllocator::ShrinkHardBy(Length pages, LimitKind limit_kind) {
                  ->ReleaseAtLeastNPagesBreakingHugepages(pages - ret,
                                                          release_reason);
       if (ret >= pages) {
+        ++limit_tier_hits_[limit_kind][kBreakingHugepages];
+        return true;
+      }
+    }
+    for (size_t c = 1; c <= size_class_regions_; ++c) {
+      ret += static_cast<HugePageAwareAllocator*>(size_classed_impl_[c])
+                 ->ReleaseAtLeastNPagesBreakingHugepages(pages - ret,
+                                                         release_reason);
+      if (ret >= pages) {
+        ++limit_tier_hits_[limit_kind][kBreakingHugepages];
         return true;
       }
     }
     for (int partition = 0;
-         partition < (sampled_partition_active_ ? kSecurityPartitions : 1);
+         partition < (sampled_partition_active_ ? kSampledPartitions : 1);
          partition++) {
       ret += static_cast<HugePageAwareAllocator*>(sampled_impl_[partition])
                  ->ReleaseAtLeastNPagesBreakingHugepages(pages - ret,
                                                          release_reason);
       if (ret >= pages) {
+        ++limit_tier_hits_[limit_kind][kBreakingHugepages];
         return true;
       }
     }
   }
-  // Return "true", if we got back under the limit.
-  return (pages <= ret);
+  // We did not get back under the limit.
+  return false;
+}
+
+void PageAllocator::PrintSizeClassed(Printer& out, PageFlagsBase& pageflags) {
+  for (size_t c = 1; c <= size_class_regions_; ++c) {
+    out.printf(
+        "\n>>>>>>> Begin %s page allocator for size class %zu <<<<<<<\n",
+        MemoryTagToLabel(MemoryTag::kSizeClassed), c);
+    size_classed_impl_[c]->Print(out, pageflags);
+    out.printf(">>>>>>> End %s page allocator for size class %zu <<<<<<<\n",
+               MemoryTagToLabel(MemoryTag::kSizeClassed), c);
+  }
+}
+
+void PageAllocator::PrintSizeClassedInPbtxt(PbtxtRegion& region,
+                                            PageFlagsBase& pageflags) {
+  for (size_t c = 1; c <= size_class_regions_; ++c) {
+    PbtxtRegion pa = region.CreateSubRegion("page_allocator");
+    pa.PrintRaw("tag", MemoryTagToLabel(MemoryTag::kSizeClassed));
+    pa.PrintI64("size_class", c);
+    size_classed_impl_[c]->PrintInPbtxt(pa, pageflags);
+  }
 }
 
 size_t PageAllocator::active_partitions() const {
   return tc_globals.active_partitions();
 }
 
+namespace page_allocator_internal {
+
+CgroupMemoryLimits CgroupPageHeapLimits(const CgroupLimits& limits,
+                                        int percent) {
+  auto scale = [percent](std::optional<uint64_t> bytes) {
+    if (!bytes.has_value() || percent <= 0) {
+      return std::numeric_limits<size_t>::max();
+    }
+    // Divide first: cgroup limits are far above 100 bytes, and this cannot
+    // overflow.
+    return static_cast<size_t>(
+        std::max<uint64_t>(*bytes / 100 * std::min(percent, 100), 1));
+  };
+
+  CgroupMemoryLimits result;
+  result.hard = scale(limits.memory_bytes);
+  result.soft = std::min(result.hard, scale(limits.memory_high_bytes));
+  return result;
+}
+
+}  // namespace page_allocator_internal
+
+void UpdateMemoryLimitFromCgroup() {
+  const int percent = Parameters::cgroup_memory_limit_percent();
+  if (percent <= 0) {
+    return;
+  }
+
+  ABSL_CONST_INIT static int last_percent = 0;
+  ABSL_CONST_INIT static CgroupLimits last_limits;
+
+  const CgroupLimits limits = ReadCgroupLimits();
+  if (percent == last_percent && limits == last_limits) {
+    return;
+  }
+  last_percent = percent;
+  last_limits = limits;
+
+  const page_allocator_internal::CgroupMemoryLimits derived =
+      page_allocator_internal::CgroupPageHeapLimits(limits, percent);
+  // The hard limit goes first, since it caps the soft limit.
+  Parameters::set_heap_size_hard_limit(derived.hard);
+  tc_globals.page_allocator().set_limit(derived.soft, PageAllocator::kSoft);
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
@@ -18,6 +18,7 @@
 #include <stddef.h>
 
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <limits>
 #include <utility>
@@ -27,6 +28,7 @@
 #include "absl/base/thread_annotations.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/huge_page_aware_allocator.h"
 #include "tcmalloc/internal/allocation_guard.h"
@@ -35,9 +37,11 @@
 #include "tcmalloc/internal/memory_tag.h"
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/internal/pageflags.h"
+#include "tcmalloc/internal/sysinfo.h"
 #include "tcmalloc/page_allocator_interface.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
+#include "tcmalloc/slow_path_latency.h"
 #include "tcmalloc/span.h"
 #include "tcmalloc/stats.h"
 
@@ -54,9 +58,11 @@ class PageAllocator {
   // been rounded up already.
   //
   // Any address in the returned Span is guaranteed to satisfy
-  // GetMemoryTag(addr) == "tag".
+  // GetMemoryTag(addr) == "tag".  For MemoryTag::kSizeClassed, it also
+  // satisfies SizeClassFromRegion(addr) == "size_class".
   Span* absl_nullable New(Length n, SpanAllocInfo span_alloc_info,
-                          MemoryTag tag) ABSL_LOCKS_EXCLUDED(pageheap_lock);
+                          MemoryTag tag, size_t size_class = 0)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
 
   // As New, but the returned span is aligned to a <align>-page boundary.
   // <align> must be a power of two.
@@ -64,6 +70,14 @@ class PageAllocator {
                                  SpanAllocInfo span_alloc_info, MemoryTag tag)
       ABSL_LOCKS_EXCLUDED(pageheap_lock);
 
+  // As New, but allocates up to spans.size() runs of "n" pages, at most
+  // Interface::kMaxNewBatch, under a single acquisition of pageheap_lock.
+  // Stores the spans at the front of "spans" and returns how many were
+  // allocated.
+  size_t NewBatch(Length n, SpanAllocInfo span_alloc_info, MemoryTag tag,
+                  size_t size_class, absl::Span<Span*> spans)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
   // Delete the span "[p, p+n-1]".
   // REQUIRES: span was returned by earlier call to New() with the same value of
   //           "tag" and has not yet been deleted.
@@ -77,8 +91,56 @@ class PageAllocator {
               SpanAllocInfo span_alloc_info)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Tries to grow the single-object allocation s to n pages in place.
+  // Returns false, leaving s unchanged, if the pages following it are not
+  // free.
+  // REQUIRES: s was returned by an earlier call to New() or NewAligned() with
+  //           the same value of "tag", tag != MemoryTag::kSizeClassed.
+  bool TryExtend(PageAllocatorInterface::AllocationState s, Length n,
+                 MemoryTag tag) ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Tries to move the single-object allocation span to n new pages without
+  // copying it.  Returns false, leaving span unchanged, if it cannot be moved.
+  // REQUIRES: span was returned by an earlier call to New() or NewAligned()
+  //           with the same value of "tag", tag != MemoryTag::kSizeClassed.
+  bool TryMove(Span* absl_nonnull span, Length n, MemoryTag tag)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Tries to shrink the single-object allocation span in place to n pages.
+  // Returns false, leaving span unchanged, if it cannot be shrunk.
+  // REQUIRES: span was returned by an earlier call to New() or NewAligned()
+  //           with the same value of "tag", tag != MemoryTag::kSizeClassed.
+  bool TryShrink(Span* absl_nonnull span, Length n, MemoryTag tag)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
   BackingStats stats() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Stats of the page heap serving `tag`, or empty stats if it has none.
+  BackingStats stats(MemoryTag tag) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Stats of the components of the hugepage-aware allocators, summed over all
+  // memory tags and partitions.
+  struct HugePageAwareStats {
+    BackingStats filler;
+    BackingStats regions;
+    BackingStats cache;
+  };
+
+  HugePageAwareStats huge_page_aware_stats() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // As above, for the page heap serving `tag` only.
+  HugePageAwareStats huge_page_aware_stats(MemoryTag tag) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Bytes of the spans currently handed out whole, across all memory tags,
+  // i.e. not those that central freelists carve into several objects of a size
+  // class.  Unlike stats(), this can be read without pageheap_lock.
+  int64_t allocated_bytes() const {
+    return allocated_bytes_.load(std::memory_order_relaxed);
+  }
+
   void GetSmallSpanStats(SmallSpanStats* result)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
@@ -94,11 +156,36 @@ class PageAllocator {
   Length ReleaseAtLeastNPages(Length num_pages, PageReleaseReason reason)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // As ReleaseAtLeastNPages, but takes pageheap_lock for one allocator instance
+  // (tag and partition) at a time, so that allocations from the others are not
+  // held up for the whole of a large release.
+  Length ReleaseAtLeastNPagesByInstance(Length num_pages,
+                                        PageReleaseReason reason)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // The number of allocator instances, which are indexed in the order that
+  // releases visit them.  Fixed once initialized.
+  size_t num_instances() const;
+
+  // Pages that instance `index` holds free and backed, i.e. could release.
+  Length FreeBackedPages(size_t index) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // As ReleaseAtLeastNPages, but only releases from instance `index`.
+  Length ReleaseAtLeastNPagesFromInstance(size_t index, Length num_pages,
+                                          PageReleaseReason reason)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
   // Returns the number of pages that have been released, combined across all
   // child PageAllocatorInterface implementations.
   PageReleaseStats GetReleaseStats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Returns the refaults of sampled released pages, combined across all
+  // child PageAllocatorInterface implementations.
+  RefaultStats GetRefaultStats() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   // Prints stats about the page heap to *out.
   void Print(Printer& out, MemoryTag tag, PageFlagsBase& pageflags)
       ABSL_LOCKS_EXCLUDED(pageheap_lock);
@@ -121,14 +208,64 @@ class PageAllocator {
   int64_t successful_shrinks_after_limit_hit(LimitKind limit_kind) const
       ABSL_LOCKS_EXCLUDED(pageheap_lock);
 
+  // How limit hits were handled, cheapest first.
+  enum LimitTier {
+    // Releasing free pages got below the limit.
+    kFreePages,
+    // Releasing the pages freed by draining the per-CPU and transfer caches
+    // got below the limit.
+    kCaches,
+    // Hugepages had to be broken up.
+    kBreakingHugepages,
+    // The heap stayed over the limit.
+    kUnsatisfied,
+    kNumLimitTiers
+  };
+  int64_t limit_tier_hits(LimitKind limit_kind, LimitTier tier) const
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // How often ShrinkToUsageLimit gathered the backing stats, and how often
+  // the growth fit in the headroom reserved by the previous check instead.
+  struct UsageChecks {
+    int64_t full;
+    int64_t reserved;
+  };
+  UsageChecks usage_checks() const ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+    PageHeapSpinLockHolder l;
+    return {usage_checks_, reserved_usage_checks_};
+  }
+
+  // Whether a soft limit hit waits for the caches to be drained, see
+  // Parameters::limit_shrinks_caches().
+  bool cache_drain_requested() const ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+    PageHeapSpinLockHolder l;
+    return cache_drain_requested_;
+  }
+
+  // Called once the caches were drained for a soft limit hit: releases the
+  // pages this freed and, if that is not enough, breaks up hugepages.
+  void ShrinkAfterCacheDrain() ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
   // If we have a usage limit set, ensure we're not violating it from our latest
-  // allocation.
+  // allocation.  Growth by a nonzero <n> that fits in the headroom reserved by
+  // the previous check is charged to it without gathering the backing stats.
   void ShrinkToUsageLimit(Length n)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
   void TreatHugepageTrackers(EnableCollapse enable_collapse)
       ABSL_LOCKS_EXCLUDED(pageheap_lock);
 
+  // Faults in the hugepages of normal memory queued for eager population.
+  // Sampled and cold memory are left to be faulted in lazily.
+  void PopulatePendingHugepages() ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Performs the releases deferred by each allocator instance.
+  void ReleaseDeferred() ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Checks the hugepage coverage of each allocator instance.
+  void VerifyHugepageCoverage(PageFlagsBase& pageflags)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
   const PageAllocInfo& info(MemoryTag tag) const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
@@ -147,15 +284,38 @@ class PageAllocator {
   }
 
  private:
-  bool ShrinkHardBy(Length page, LimitKind limit_kind)
+  // Releases at least `pages`, and returns whether that succeeded.  `tier` is
+  // credited if releasing free pages is enough.  Soft limit hits that would
+  // break hugepages at kFreePages are deferred to the background thread when
+  // Parameters::limit_shrinks_caches() is set.
+  bool ShrinkHardBy(Length pages, LimitKind limit_kind,
+                    LimitTier tier = kFreePages)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
   using Interface = HugePageAwareAllocator;
 
-  ABSL_ATTRIBUTE_RETURNS_NONNULL Interface* impl(MemoryTag tag) const;
+  ABSL_ATTRIBUTE_RETURNS_NONNULL Interface* impl(MemoryTag tag,
+                                                 size_t size_class = 0) const;
+
+  static void AddHugePageAwareStats(const Interface* absl_nonnull impl,
+                                    HugePageAwareStats& stats)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  void PrintSizeClassed(Printer& out, PageFlagsBase& pageflags)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+  void PrintSizeClassedInPbtxt(PbtxtRegion& region, PageFlagsBase& pageflags)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
 
   size_t active_partitions() const;
 
+  static constexpr size_t kMaxInstances =
+      1 + kNormalPartitions + kMaxSizeClassRegions + kSampledPartitions;
+  using Instances = std::array<Interface*, kMaxInstances>;
+
+  // Fills `instances` with the allocator instances in use, in the order that
+  // releases visit them, and returns their number.
+  size_t ReleaseOrder(Instances& instances) const;
+
   static constexpr size_t kNumHeaps = 3;  // 3 heaps: normal, sampled, cold.
 
   union Choices {
@@ -165,8 +325,11 @@ class PageAllocator {
     HugePageAwareAllocator hpaa;
   } choices_[kNumHeaps];
   std::array<Interface*, kNormalPartitions> normal_impl_;
-  std::array<Interface*, kSecurityPartitions> sampled_impl_;
+  std::array<Interface*, kSampledPartitions> sampled_impl_;
   Interface* cold_impl_;
+  // Indexed by size class; only [1, size_class_regions_] are populated.
+  std::array<Interface*, kMaxSizeClassRegions> size_classed_impl_{};
+  size_t size_class_regions_;
   Algorithm alg_;
   bool has_cold_impl_;
   bool sampled_partition_active_;
@@ -182,6 +345,17 @@ class PageAllocator {
   // Number of times we succeeded in shrinking the memory usage to be less than
   // or at the limit.
   int64_t successful_shrinks_after_limit_hit_[kNumLimits]{0};
+  // How each limit hit was handled.
+  int64_t limit_tier_hits_[kNumLimits][kNumLimitTiers]{};
+  // A soft limit hit waits for the background thread to drain the caches.
+  bool cache_drain_requested_ = false;
+
+  // Growth that can neither set a new peak_backed_bytes_ nor get within 10%
+  // of the soft limit, as of the last check of ShrinkToUsageLimit.  Frees are
+  // not credited back.
+  size_t usage_reservation_ = 0;
+  int64_t usage_checks_ = 0;
+  int64_t reserved_usage_checks_ = 0;
 
   // peak_backed_bytes_ tracks the maximum number of pages backed (with physical
   // memory) in the page heap and metadata.
@@ -193,20 +367,47 @@ class PageAllocator {
   // requires minimal work to compute.
   size_t peak_backed_bytes_{0};
   size_t peak_sampled_application_bytes_{0};
+
+  std::atomic<int64_t> allocated_bytes_{0};
+
+  void RecordAllocated(Length n, bool allocated) {
+    const int64_t bytes = n.in_bytes();
+    allocated_bytes_.fetch_add(allocated ? bytes : -bytes,
+                               std::memory_order_relaxed);
+  }
+
+  void RecordAllocated(Length n, bool allocated,
+                       SpanAllocInfo span_alloc_info) {
+    if (span_alloc_info.objects_per_span > 1) return;
+    RecordAllocated(n, allocated);
+  }
 };
 
-inline PageAllocator::Interface* PageAllocator::impl(MemoryTag tag) const {
+inline PageAllocator::Interface* PageAllocator::impl(MemoryTag tag,
+                                                     size_t size_class) const {
   switch (tag) {
     case MemoryTag::kNormalP0:
       return normal_impl_[0];
     case MemoryTag::kNormalP1:
       return normal_impl_[1];
+    case MemoryTag::kNormalP2:
+    case MemoryTag::kNormalP3:
+    case MemoryTag::kNormalP4:
+    case MemoryTag::kNormalP5:
+    case MemoryTag::kNormalP6:
+    case MemoryTag::kNormalP7:
+      TC_ASSERT_LT(NormalTagPartition(tag), active_partitions());
+      return normal_impl_[NormalTagPartition(tag)];
     case MemoryTag::kSampled:
       return sampled_impl_[0];
     case MemoryTag::kSampledP1:
       return sampled_impl_[1];
     case MemoryTag::kCold:
       return cold_impl_;
+    case MemoryTag::kSizeClassed:
+      TC_ASSERT_GT(size_class, 0);
+      TC_ASSERT_LE(size_class, size_class_regions_);
+      return size_classed_impl_[size_class];
     default:
       ASSUME(false);
       __builtin_unreachable();
@@ -214,27 +415,84 @@ inline PageAllocator::Interface* PageAllocator::impl(MemoryTag tag) const {
 }
 
 inline Span* PageAllocator::New(Length n, SpanAllocInfo span_alloc_info,
-                                MemoryTag tag) {
-  return impl(tag)->New(n, span_alloc_info);
+                                MemoryTag tag, size_t size_class) {
+  ScopedSlowPathTimer timer(SlowPath::kPageAllocatorNew);
+  Span* span = impl(tag, size_class)->New(n, span_alloc_info);
+  if (ABSL_PREDICT_TRUE(span != nullptr)) {
+    RecordAllocated(n, true, span_alloc_info);
+  }
+  return span;
+}
+
+inline size_t PageAllocator::NewBatch(Length n, SpanAllocInfo span_alloc_info,
+                                     MemoryTag tag, size_t size_class,
+                                     absl::Span<Span*> spans) {
+  ScopedSlowPathTimer timer(SlowPath::kPageAllocatorNew);
+  const size_t allocated =
+      impl(tag, size_class)->NewBatch(n, span_alloc_info, spans);
+  RecordAllocated(n * allocated, true, span_alloc_info);
+  return allocated;
 }
 
 inline Span* PageAllocator::NewAligned(Length n, Length align,
                                        SpanAllocInfo span_alloc_info,
                                        MemoryTag tag) {
-  return impl(tag)->NewAligned(n, align, span_alloc_info);
+  Span* span = impl(tag)->NewAligned(n, align, span_alloc_info);
+  if (ABSL_PREDICT_TRUE(span != nullptr)) {
+    RecordAllocated(n, true, span_alloc_info);
+  }
+  return span;
 }
 
 #ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
 inline void PageAllocator::Delete(Span* span, MemoryTag tag,
                                   SpanAllocInfo span_alloc_info) {
-  impl(tag)->Delete(span, span_alloc_info);
+  ScopedSlowPathTimer timer(SlowPath::kPageAllocatorDelete);
+  const size_t size_class = tag == MemoryTag::kSizeClassed
+                                ? SizeClassFromRegion(span->start_address())
+                                : 0;
+  RecordAllocated(span->num_pages(), false, span_alloc_info);
+  impl(tag, size_class)->Delete(span, span_alloc_info);
 }
 #endif  // TCMALLOC_INTERNAL_LEGACY_LOCKING
 
 inline void PageAllocator::Delete(PageAllocatorInterface::AllocationState s,
                                   MemoryTag tag,
                                   SpanAllocInfo span_alloc_info) {
-  impl(tag)->Delete(s, span_alloc_info);
+  ScopedSlowPathTimer timer(SlowPath::kPageAllocatorDelete);
+  const size_t size_class = tag == MemoryTag::kSizeClassed
+                                ? SizeClassFromRegion(s.r.p.start_addr())
+                                : 0;
+  RecordAllocated(s.r.n, false, span_alloc_info);
+  impl(tag, size_class)->Delete(s, span_alloc_info);
+}
+
+inline bool PageAllocator::TryExtend(PageAllocatorInterface::AllocationState s,
+                                     Length n, MemoryTag tag) {
+  TC_ASSERT_NE(tag, MemoryTag::kSizeClassed);
+  if (!impl(tag)->TryExtend(s, n)) return false;
+  RecordAllocated(n - s.r.n, true);
+  return true;
+}
+
+inline bool PageAllocator::TryMove(Span* span, Length n, MemoryTag tag) {
+  TC_ASSERT_NE(tag, MemoryTag::kSizeClassed);
+  const Length old_n = span->num_pages();
+  if (!impl(tag)->TryMove(span, n)) return false;
+  if (n >= old_n) {
+    RecordAllocated(n - old_n, true);
+  } else {
+    RecordAllocated(old_n - n, false);
+  }
+  return true;
+}
+
+inline bool PageAllocator::TryShrink(Span* span, Length n, MemoryTag tag) {
+  TC_ASSERT_NE(tag, MemoryTag::kSizeClassed);
+  const Length old_n = span->num_pages();
+  if (!impl(tag)->TryShrink(span, n)) return false;
+  RecordAllocated(old_n - n, false);
+  return true;
 }
 
 inline BackingStats PageAllocator::stats() const {
@@ -249,6 +507,100 @@ inline BackingStats PageAllocator::stats() const {
   if (has_cold_impl_) {
     ret += cold_impl_->stats();
   }
+  for (size_t c = 1; c <= size_class_regions_; ++c) {
+    ret += size_classed_impl_[c]->stats();
+  }
+  return ret;
+}
+
+inline BackingStats PageAllocator::stats(MemoryTag tag) const {
+  switch (tag) {
+    case MemoryTag::kNormalP1:
+    case MemoryTag::kNormalP2:
+    case MemoryTag::kNormalP3:
+    case MemoryTag::kNormalP4:
+    case MemoryTag::kNormalP5:
+    case MemoryTag::kNormalP6:
+    case MemoryTag::kNormalP7:
+      if (active_partitions() <= NormalTagPartition(tag)) return BackingStats();
+      break;
+    case MemoryTag::kSampledP1:
+      if (!sampled_partition_active_) return BackingStats();
+      break;
+    case MemoryTag::kCold:
+      if (!has_cold_impl_) return BackingStats();
+      break;
+    case MemoryTag::kSizeClassed: {
+      BackingStats ret;
+      for (size_t c = 1; c <= size_class_regions_; ++c) {
+        ret += size_classed_impl_[c]->stats();
+      }
+      return ret;
+    }
+    case MemoryTag::kMetadata:
+      return BackingStats();
+    default:
+      break;
+  }
+  return impl(tag)->stats();
+}
+
+inline void PageAllocator::AddHugePageAwareStats(
+    const Interface* absl_nonnull impl, HugePageAwareStats& stats) {
+  stats.filler += impl->FillerStats();
+  stats.regions += impl->RegionsStats();
+  stats.cache += impl->CacheStats();
+}
+
+inline PageAllocator::HugePageAwareStats PageAllocator::huge_page_aware_stats()
+    const {
+  HugePageAwareStats ret;
+  for (int partition = 0; partition < active_partitions(); partition++) {
+    AddHugePageAwareStats(normal_impl_[partition], ret);
+  }
+  AddHugePageAwareStats(sampled_impl_[0], ret);
+  if (sampled_partition_active_) {
+    AddHugePageAwareStats(sampled_impl_[1], ret);
+  }
+  if (has_cold_impl_) {
+    AddHugePageAwareStats(cold_impl_, ret);
+  }
+  for (size_t c = 1; c <= size_class_regions_; ++c) {
+    AddHugePageAwareStats(size_classed_impl_[c], ret);
+  }
+  return ret;
+}
+
+inline PageAllocator::HugePageAwareStats PageAllocator::huge_page_aware_stats(
+    MemoryTag tag) const {
+  HugePageAwareStats ret;
+  switch (tag) {
+    case MemoryTag::kNormalP1:
+    case MemoryTag::kNormalP2:
+    case MemoryTag::kNormalP3:
+    case MemoryTag::kNormalP4:
+    case MemoryTag::kNormalP5:
+    case MemoryTag::kNormalP6:
+    case MemoryTag::kNormalP7:
+      if (active_partitions() <= NormalTagPartition(tag)) return ret;
+      break;
+    case MemoryTag::kSampledP1:
+      if (!sampled_partition_active_) return ret;
+      break;
+    case MemoryTag::kCold:
+      if (!has_cold_impl_) return ret;
+      break;
+    case MemoryTag::kSizeClassed:
+      for (size_t c = 1; c <= size_class_regions_; ++c) {
+        AddHugePageAwareStats(size_classed_impl_[c], ret);
+      }
+      return ret;
+    case MemoryTag::kMetadata:
+      return ret;
+    default:
+      break;
+  }
+  AddHugePageAwareStats(impl(tag), ret);
   return ret;
 }
 
@@ -271,6 +623,11 @@ inline void PageAllocator::GetSmallSpanStats(SmallSpanStats* result) {
     cold_impl_->GetSmallSpanStats(&cold);
     *result += cold;
   }
+  for (size_t c = 1; c <= size_class_regions_; ++c) {
+    SmallSpanStats size_classed;
+    size_classed_impl_[c]->GetSmallSpanStats(&size_classed);
+    *result += size_classed;
+  }
 }
 
 inline void PageAllocator::GetLargeSpanStats(LargeSpanStats* result) {
@@ -292,6 +649,11 @@ inline void PageAllocator::GetLargeSpanStats(LargeSpanStats* result) {
     cold_impl_->GetLargeSpanStats(&cold);
     *result = *result + cold;
   }
+  for (size_t c = 1; c <= size_class_regions_; ++c) {
+    LargeSpanStats size_classed;
+    size_classed_impl_[c]->GetLargeSpanStats(&size_classed);
+    *result = *result + size_classed;
+  }
 }
 
 inline void PageAllocator::TreatHugepageTrackers(
@@ -302,31 +664,103 @@ inline void PageAllocator::TreatHugepageTrackers(
   for (int partition = 0; partition < active_partitions(); partition++) {
     normal_impl_[partition]->TreatHugepageTrackers(enable_collapse);
   }
+  for (size_t c = 1; c <= size_class_regions_; ++c) {
+    size_classed_impl_[c]->TreatHugepageTrackers(enable_collapse);
+  }
 }
 
-inline Length PageAllocator::ReleaseAtLeastNPages(Length num_pages,
-                                                  PageReleaseReason reason) {
-  Length released;
+inline void PageAllocator::PopulatePendingHugepages() {
+  for (int partition = 0; partition < active_partitions(); partition++) {
+    normal_impl_[partition]->PopulatePendingHugepages();
+  }
+  for (size_t c = 1; c <= size_class_regions_; ++c) {
+    size_classed_impl_[c]->PopulatePendingHugepages();
+  }
+}
+
+inline void PageAllocator::ReleaseDeferred() {
+  Instances instances;
+  const size_t n = ReleaseOrder(instances);
+  for (size_t i = 0; i < n; ++i) {
+    instances[i]->ReleaseDeferred();
+  }
+}
+
+inline void PageAllocator::VerifyHugepageCoverage(PageFlagsBase& pageflags) {
+  Instances instances;
+  const size_t n = ReleaseOrder(instances);
+  for (size_t i = 0; i < n; ++i) {
+    instances[i]->VerifyHugepageCoverage(pageflags);
+  }
+}
+
+inline size_t PageAllocator::ReleaseOrder(Instances& instances) const {
+  size_t n = 0;
   // TODO(ckennelly): Refine this policy.  Cold data should be the most
   // resilient to not being on huge pages.
   if (has_cold_impl_) {
-    released = cold_impl_->ReleaseAtLeastNPages(num_pages, reason);
+    instances[n++] = cold_impl_;
   }
   for (int partition = 0; partition < active_partitions(); partition++) {
-    released += normal_impl_[partition]->ReleaseAtLeastNPages(
-        num_pages > released ? num_pages - released : Length(0), reason);
+    instances[n++] = normal_impl_[partition];
   }
-
-  released += sampled_impl_[0]->ReleaseAtLeastNPages(
-      num_pages > released ? num_pages - released : Length(0), reason);
+  for (size_t c = 1; c <= size_class_regions_; ++c) {
+    instances[n++] = size_classed_impl_[c];
+  }
+  instances[n++] = sampled_impl_[0];
   if (sampled_partition_active_) {
-    released += sampled_impl_[1]->ReleaseAtLeastNPages(
+    instances[n++] = sampled_impl_[1];
+  }
+  return n;
+}
+
+inline Length PageAllocator::ReleaseAtLeastNPages(Length num_pages,
+                                                  PageReleaseReason reason) {
+  Instances instances;
+  const size_t n = ReleaseOrder(instances);
+  Length released;
+  for (size_t i = 0; i < n; ++i) {
+    released += instances[i]->ReleaseAtLeastNPages(
         num_pages > released ? num_pages - released : Length(0), reason);
   }
+  return released;
+}
 
+inline Length PageAllocator::ReleaseAtLeastNPagesByInstance(
+    Length num_pages, PageReleaseReason reason) {
+  // The set of instances is fixed once initialized.
+  Instances instances;
+  const size_t n = ReleaseOrder(instances);
+  Length released;
+  for (size_t i = 0; i < n; ++i) {
+    PageHeapSpinLockHolder l;
+    released += instances[i]->ReleaseAtLeastNPages(
+        num_pages > released ? num_pages - released : Length(0), reason);
+  }
   return released;
 }
 
+inline size_t PageAllocator::num_instances() const {
+  Instances instances;
+  return ReleaseOrder(instances);
+}
+
+inline Length PageAllocator::FreeBackedPages(size_t index) const {
+  Instances instances;
+  const size_t n = ReleaseOrder(instances);
+  TC_ASSERT_LT(index, n);
+  return BytesToLengthFloor(instances[index]->stats().free_bytes);
+}
+
+inline Length PageAllocator::ReleaseAtLeastNPagesFromInstance(
+    size_t index, Length num_pages, PageReleaseReason reason) {
+  Instances instances;
+  const size_t n = ReleaseOrder(instances);
+  TC_ASSERT_LT(index, n);
+  PageHeapSpinLockHolder l;
+  return instances[index]->ReleaseAtLeastNPages(num_pages, reason);
+}
+
 inline PageReleaseStats PageAllocator::GetReleaseStats() const {
   PageReleaseStats stats;
 
@@ -336,6 +770,9 @@ inline PageReleaseStats PageAllocator::GetReleaseStats() const {
   for (int partition = 0; partition < active_partitions(); partition++) {
     stats += normal_impl_[partition]->GetReleaseStats();
   }
+  for (size_t c = 1; c <= size_class_regions_; ++c) {
+    stats += size_classed_impl_[c]->GetReleaseStats();
+  }
 
   stats += sampled_impl_[0]->GetReleaseStats();
   if (sampled_partition_active_) {
@@ -345,11 +782,36 @@ inline PageReleaseStats PageAllocator::GetReleaseStats() const {
   return stats;
 }
 
+inline RefaultStats PageAllocator::GetRefaultStats() const {
+  RefaultStats stats;
+
+  if (has_cold_impl_) {
+    stats += cold_impl_->GetRefaultStats();
+  }
+  for (int partition = 0; partition < active_partitions(); partition++) {
+    stats += normal_impl_[partition]->GetRefaultStats();
+  }
+  for (size_t c = 1; c <= size_class_regions_; ++c) {
+    stats += size_classed_impl_[c]->GetRefaultStats();
+  }
+
+  stats += sampled_impl_[0]->GetRefaultStats();
+  if (sampled_partition_active_) {
+    stats += sampled_impl_[1]->GetRefaultStats();
+  }
+
+  return stats;
+}
+
 inline void PageAllocator::Print(Printer& out, MemoryTag tag,
                                  PageFlagsBase& pageflags) {
   if (tag == MemoryTag::kCold && !has_cold_impl_) {
     return;
   }
+  if (tag == MemoryTag::kSizeClassed) {
+    PrintSizeClassed(out, pageflags);
+    return;
+  }
 
   const absl::string_view label = MemoryTagToLabel(tag);
   if (tag != MemoryTag::kNormal) {
@@ -366,6 +828,10 @@ inline void PageAllocator::PrintInPbtxt(PbtxtRegion& region, MemoryTag tag,
   if (tag == MemoryTag::kCold && !has_cold_impl_) {
     return;
   }
+  if (tag == MemoryTag::kSizeClassed) {
+    PrintSizeClassedInPbtxt(region, pageflags);
+    return;
+  }
 
   PbtxtRegion pa = region.CreateSubRegion("page_allocator");
   pa.PrintRaw("tag", MemoryTagToLabel(tag));
@@ -379,6 +845,7 @@ inline void PageAllocator::set_limit(size_t limit, LimitKind limit_kind) {
     // Soft limit can not be higher than hard limit.
     limits_[kSoft] = limits_[kHard];
   }
+  usage_reservation_ = 0;
   // Attempt to shed memory to get below the new limit.
   ShrinkToUsageLimit(Length(0));
 }
@@ -396,10 +863,40 @@ inline int64_t PageAllocator::successful_shrinks_after_limit_hit(
   return successful_shrinks_after_limit_hit_[limit_kind];
 }
 
+inline int64_t PageAllocator::limit_tier_hits(LimitKind limit_kind,
+                                              LimitTier tier) const {
+  TC_ASSERT_LT(limit_kind, kNumLimits);
+  TC_ASSERT_LT(tier, kNumLimitTiers);
+  PageHeapSpinLockHolder l;
+  return limit_tier_hits_[limit_kind][tier];
+}
+
 inline const PageAllocInfo& PageAllocator::info(MemoryTag tag) const {
   return impl(tag)->info();
 }
 
+namespace page_allocator_internal {
+
+// Page heap limits, in bytes, that keep the process at <percent> percent of
+// its cgroup <limits>.  The soft limit follows memory.high, or memory.max if
+// memory.high is unset; the hard limit follows memory.max.  Limits the cgroup
+// does not set are std::numeric_limits<size_t>::max().
+struct CgroupMemoryLimits {
+  size_t soft = std::numeric_limits<size_t>::max();
+  size_t hard = std::numeric_limits<size_t>::max();
+};
+CgroupMemoryLimits CgroupPageHeapLimits(const CgroupLimits& limits,
+                                        int percent);
+
+}  // namespace page_allocator_internal
+
+// When Parameters::cgroup_memory_limit_percent() is set, re-reads the cgroup
+// limits of the process and, if they or the percentage changed since the last
+// call, applies the limits derived by CgroupPageHeapLimits() to the page heap.
+// Limits set through MallocExtension in the meantime stay in place until the
+// cgroup limits change.  Must not be called concurrently.
+void UpdateMemoryLimitFromCgroup();
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
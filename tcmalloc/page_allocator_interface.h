@@ -65,6 +65,8 @@ class PageAllocatorInterface {
   struct AllocationState {
     Range r;
     bool donated;
+    // Whether all of r was known to be zero when it was allocated.
+    bool known_zero = false;
 
     operator bool() const { return ABSL_PREDICT_TRUE(r.p != PageId{0}); }
   };
@@ -72,6 +74,32 @@ class PageAllocatorInterface {
   virtual void Delete(AllocationState s, SpanAllocInfo span_alloc_info)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) = 0;
 
+  // Tries to grow the allocation s to n pages in place, by claiming the free
+  // pages following it.  Returns false, leaving s unchanged, if they are not
+  // available.
+  // REQUIRES: s.r was returned by an earlier call to New() for a single
+  //           object, and n > s.r.n.
+  virtual bool TryExtend(AllocationState s, Length n)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) = 0;
+
+  // Tries to move the allocation described by span to a new run of n pages, by
+  // remapping the pages backing it rather than copying them.  On success, the
+  // old pages are freed and span and the pagemap describe the new ones.
+  // Returns false, leaving span unchanged, if the pages cannot be remapped.
+  // REQUIRES: span was returned by an earlier call to New() for a single,
+  //           unsampled object, and n > span->num_pages().
+  virtual bool TryMove(Span* absl_nonnull span, Length n)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) = 0;
+
+  // Tries to shrink the allocation described by span in place to n pages,
+  // freeing the pages past them.  On success, span and the pagemap describe
+  // the pages kept.  Returns false, leaving span unchanged, if they cannot be
+  // freed.
+  // REQUIRES: span was returned by an earlier call to New() for a single,
+  //           unsampled object, and 0 < n < span->num_pages().
+  virtual bool TryShrink(Span* absl_nonnull span, Length n)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) = 0;
+
   virtual BackingStats stats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) = 0;
 
@@ -96,9 +124,25 @@ class PageAllocatorInterface {
   virtual PageReleaseStats GetReleaseStats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) = 0;
 
+  // Returns the sampled released pages that were allocated again soon after.
+  virtual RefaultStats GetRefaultStats() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) = 0;
+
   virtual void TreatHugepageTrackers(EnableCollapse enable_collapse)
       ABSL_LOCKS_EXCLUDED(pageheap_lock) = 0;
 
+  // Faults in the hugepages queued for eager population since the last call.
+  virtual void PopulatePendingHugepages()
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) = 0;
+
+  // Performs the releases that freeing threads deferred.
+  virtual void ReleaseDeferred() ABSL_LOCKS_EXCLUDED(pageheap_lock) = 0;
+
+  // Samples the hugepages meant to be intact and records how many the kernel
+  // still backs with hugepages, for the stats.
+  virtual void VerifyHugepageCoverage(PageFlagsBase& pageflags)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) = 0;
+
   // Prints stats about the page heap to *out.
   virtual void Print(Printer& out, PageFlagsBase& pageflags)
       ABSL_LOCKS_EXCLUDED(pageheap_lock) = 0;
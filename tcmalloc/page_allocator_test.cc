@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <limits>
 #include <new>
 #include <optional>
 #include <string>
@@ -35,6 +36,7 @@
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/memory_tag.h"
 #include "tcmalloc/internal/pageflags.h"
+#include "tcmalloc/internal/sysinfo.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/page_allocator_interface.h"
 #include "tcmalloc/page_allocator_test_util.h"
@@ -169,6 +171,23 @@ TEST_F(PageAllocatorTest, PrintIt) {
   EXPECT_THAT(output, testing::ContainsRegex("stats on allocation sizes"));
 }
 
+TEST_F(PageAllocatorTest, ReleaseByInstance) {
+  constexpr SpanAllocInfo kSpanInfo = {/*objects_per_span=*/1,
+                                       AccessDensityPrediction::kSparse};
+  // Free hugepages in two instances: released, they cover the whole request.
+  Delete(New(kPagesPerHugePage, kSpanInfo, MemoryTag::kNormal), kSpanInfo,
+         MemoryTag::kNormal);
+  Delete(New(kPagesPerHugePage, kSpanInfo, MemoryTag::kSampled), kSpanInfo,
+         MemoryTag::kSampled);
+
+  const Length released = allocator_.ReleaseAtLeastNPagesByInstance(
+      2 * kPagesPerHugePage, PageReleaseReason::kReleaseMemoryToSystem);
+  EXPECT_GE(released, 2 * kPagesPerHugePage);
+
+  PageHeapSpinLockHolder l;
+  EXPECT_GE(allocator_.stats().unmapped_bytes, 2 * kHugePageSize);
+}
+
 TEST_F(PageAllocatorTest, ShrinkFailureTest) {
   // Turn off subrelease so that we take the ShrinkHardBy path.
   const bool old_subrelease = Parameters::hpaa_subrelease();
@@ -246,6 +265,124 @@ TEST_F(PageAllocatorTest, b270916852) {
   Parameters::set_hpaa_subrelease(old_subrelease);
 }
 
+TEST_F(PageAllocatorTest, SoftLimitWaitsForCacheDrain) {
+  // Turn off subrelease so that releasing free pages is not enough.
+  const bool old_subrelease = Parameters::hpaa_subrelease();
+  Parameters::set_hpaa_subrelease(false);
+  const bool old_limit_shrinks_caches = Parameters::limit_shrinks_caches();
+  Parameters::set_limit_shrinks_caches(true);
+
+  constexpr SpanAllocInfo kSpanInfo = {/*objects_per_span=*/1,
+                                       AccessDensityPrediction::kSparse};
+  Span* normal = New(kPagesPerHugePage / 2, kSpanInfo, MemoryTag::kNormal);
+
+  // Only releasing the free half of the hugepage gets below the limit.
+  const size_t metadata_bytes = []() {
+    PageHeapSpinLockHolder l;
+    return tc_globals.metadata_bytes();
+  }();
+  allocator_.set_limit(
+      metadata_bytes + (kPagesPerHugePage / 2).in_bytes() + kPageSize,
+      PageAllocator::kSoft);
+  {
+    PageHeapSpinLockHolder l;
+    allocator_.ShrinkToUsageLimit(Length(0));
+  }
+  EXPECT_LE(1, allocator_.limit_hits(PageAllocator::kSoft));
+  EXPECT_TRUE(allocator_.cache_drain_requested());
+  EXPECT_EQ(
+      0, allocator_.successful_shrinks_after_limit_hit(PageAllocator::kSoft));
+  EXPECT_EQ(0, allocator_.limit_tier_hits(PageAllocator::kSoft,
+                                          PageAllocator::kUnsatisfied));
+
+  // No cache holds the span, so the hugepage has to be broken up.
+  allocator_.ShrinkAfterCacheDrain();
+  EXPECT_FALSE(allocator_.cache_drain_requested());
+  EXPECT_EQ(
+      1, allocator_.successful_shrinks_after_limit_hit(PageAllocator::kSoft));
+  EXPECT_EQ(1, allocator_.limit_tier_hits(PageAllocator::kSoft,
+                                          PageAllocator::kBreakingHugepages));
+  EXPECT_EQ(0, allocator_.limit_tier_hits(PageAllocator::kSoft,
+                                          PageAllocator::kFreePages));
+
+  Delete(normal, kSpanInfo, MemoryTag::kNormal);
+  Parameters::set_limit_shrinks_caches(old_limit_shrinks_caches);
+  Parameters::set_hpaa_subrelease(old_subrelease);
+}
+
+TEST_F(PageAllocatorTest, UsageLimitReservation) {
+  constexpr SpanAllocInfo kSpanInfo = {/*objects_per_span=*/1,
+                                       AccessDensityPrediction::kSparse};
+  // Set a peak and release below it, so that regrowing up to it reserves
+  // headroom.
+  Span* span = New(4 * kPagesPerHugePage, kSpanInfo);
+  {
+    PageHeapSpinLockHolder l;
+    allocator_.ShrinkToUsageLimit(Length(0));
+  }
+  Delete(span, kSpanInfo);
+  allocator_.ReleaseAtLeastNPagesByInstance(
+      4 * kPagesPerHugePage, PageReleaseReason::kReleaseMemoryToSystem);
+  const size_t metadata_bytes = []() {
+    PageHeapSpinLockHolder l;
+    return tc_globals.metadata_bytes();
+  }();
+  allocator_.set_limit(metadata_bytes + (64 * kPagesPerHugePage).in_bytes(),
+                       PageAllocator::kSoft);
+  const PageAllocator::UsageChecks before = allocator_.usage_checks();
+  {
+    PageHeapSpinLockHolder l;
+    for (int i = 0; i < 8; ++i) {
+      allocator_.ShrinkToUsageLimit(kPagesPerHugePage / 8);
+    }
+  }
+  const PageAllocator::UsageChecks after = allocator_.usage_checks();
+  EXPECT_EQ(after.reserved, before.reserved + 8);
+  EXPECT_EQ(after.full, before.full);
+
+  // Explicit checks are never skipped, and growth past the reservation is
+  // caught.
+  {
+    PageHeapSpinLockHolder l;
+    allocator_.ShrinkToUsageLimit(Length(0));
+    allocator_.ShrinkToUsageLimit(128 * kPagesPerHugePage);
+  }
+  EXPECT_EQ(allocator_.usage_checks().full, after.full + 2);
+  EXPECT_EQ(allocator_.limit_hits(PageAllocator::kSoft), 0);
+
+  allocator_.set_limit(std::numeric_limits<size_t>::max(),
+                       PageAllocator::kSoft);
+}
+
+TEST(CgroupPageHeapLimitsTest, Derivation) {
+  using page_allocator_internal::CgroupPageHeapLimits;
+  constexpr size_t kUnlimited = std::numeric_limits<size_t>::max();
+  constexpr uint64_t kGiB = uint64_t{1} << 30;
+
+  CgroupLimits limits;
+  EXPECT_EQ(CgroupPageHeapLimits(limits, 90).soft, kUnlimited);
+  EXPECT_EQ(CgroupPageHeapLimits(limits, 90).hard, kUnlimited);
+
+  // Without memory.high, both limits follow memory.max.
+  limits.memory_bytes = 10 * kGiB;
+  EXPECT_EQ(CgroupPageHeapLimits(limits, 90).soft, 10 * kGiB / 100 * 90);
+  EXPECT_EQ(CgroupPageHeapLimits(limits, 90).hard, 10 * kGiB / 100 * 90);
+
+  limits.memory_high_bytes = 8 * kGiB;
+  EXPECT_EQ(CgroupPageHeapLimits(limits, 50).soft, 8 * kGiB / 100 * 50);
+  EXPECT_EQ(CgroupPageHeapLimits(limits, 50).hard, 10 * kGiB / 100 * 50);
+
+  // The soft limit never exceeds the hard limit.
+  limits.memory_high_bytes = 20 * kGiB;
+  EXPECT_EQ(CgroupPageHeapLimits(limits, 100).soft, 10 * kGiB);
+
+  // memory.high alone only sets the soft limit.
+  limits.memory_bytes.reset();
+  EXPECT_EQ(CgroupPageHeapLimits(limits, 100).soft, 20 * kGiB);
+  EXPECT_EQ(CgroupPageHeapLimits(limits, 100).hard, kUnlimited);
+  EXPECT_EQ(CgroupPageHeapLimits(limits, 0).soft, kUnlimited);
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -18,13 +18,19 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <new>
 
+#include "absl/base/attributes.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
 #include "tcmalloc/common.h"
+#include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/util.h"
 #include "tcmalloc/pages.h"
+#include "tcmalloc/parameters.h"
 #include "tcmalloc/span.h"
 #include "tcmalloc/static_vars.h"
 
@@ -73,6 +79,49 @@ void PageMap::MapRootWithSmallPages() {
 
 void* MetaDataAlloc(size_t bytes) { return tc_globals.arena().Alloc(bytes); }
 
+namespace {
+
+// Leaves are carved out of hugepage-sized chunks.  Packing only pays off when
+// a chunk holds at least two leaves, and on platforms with very large
+// hugepages we would rather not commit that much metadata up front.
+constexpr size_t kLeafChunkSize = kHugePageSize;
+constexpr bool kPackLeaves = kLeafChunkSize <= (size_t{2} << 20);
+
+ABSL_CONST_INIT absl::base_internal::SpinLock leaf_lock(
+    absl::base_internal::SCHEDULE_KERNEL_ONLY);
+ABSL_CONST_INIT char* leaf_free_area ABSL_GUARDED_BY(leaf_lock) = nullptr;
+ABSL_CONST_INIT size_t leaf_free_avail ABSL_GUARDED_BY(leaf_lock) = 0;
+
+}  // namespace
+
+void* PageMapLeafAlloc(size_t bytes) {
+  if (!kPackLeaves || bytes > kLeafChunkSize / 2) {
+    return MetaDataAlloc(bytes);
+  }
+
+  AllocationGuardSpinLockHolder l(leaf_lock);
+  bytes = (bytes + ABSL_CACHELINE_SIZE - 1) & ~(ABSL_CACHELINE_SIZE - 1);
+  if (leaf_free_avail < bytes) {
+    // The tail of the previous chunk, if any, is abandoned.  It is less than
+    // a leaf in size and is still accounted for as metadata.
+    leaf_free_area = static_cast<char*>(tc_globals.arena().Alloc(
+        kLeafChunkSize, std::align_val_t{kLeafChunkSize}));
+    leaf_free_avail = kLeafChunkSize;
+
+    ErrnoRestorer errno_restorer;
+    madvise(leaf_free_area, kLeafChunkSize, MADV_HUGEPAGE);
+    if (Parameters::prefault_pagemap_leaves()) {
+      // Fault the whole chunk in at once, so that the leaves placed in it
+      // later do not take page faults on the allocation path.
+      tc_globals.system_allocator().Populate(leaf_free_area, kLeafChunkSize);
+    }
+  }
+  void* result = leaf_free_area;
+  leaf_free_area += bytes;
+  leaf_free_avail -= bytes;
+  return result;
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
@@ -52,6 +52,10 @@ namespace tcmalloc_internal {
 // Two-level radix tree
 typedef void* (*PagemapAllocator)(size_t);
 void* MetaDataAlloc(size_t bytes);
+// Allocates PageMap leaves.  Leaves are packed into hugepage-aligned chunks of
+// metadata, so that the leaves covering the heap, which every unsized free
+// reads, take up as few dTLB entries as possible.
+void* PageMapLeafAlloc(size_t bytes);
 
 // Convenience wrapper around a uintptr that packs a Span pointer and its
 // size class into a single word.
@@ -76,7 +80,8 @@ class PackedSpanAndSizeclass {
   static constexpr uintptr_t kSpanMask = (uintptr_t{1} << kSizeclassShift) - 1;
 };
 
-template <int BITS, PagemapAllocator Allocator>
+template <int BITS, PagemapAllocator Allocator,
+          PagemapAllocator LeafAllocator = Allocator>
 class PageMap2 {
  private:
   // The leaf node (regardless of pointer size) always maps 2^15 entries;
@@ -114,11 +119,12 @@ class PageMap2 {
 
   Leaf* absl_nullable root_[kRootLength];  // Top-level node
   size_t bytes_used_;
+  size_t leaves_used_;
 
  public:
   typedef uintptr_t Number;
 
-  constexpr PageMap2() : root_{}, bytes_used_(0) {}
+  constexpr PageMap2() : root_{}, bytes_used_(0), leaves_used_(0) {}
 
   // No locks required.  See SYNCHRONIZATION explanation at top of tcmalloc.cc.
   Span* absl_nullable get(Number k) const ABSL_NO_THREAD_SAFETY_ANALYSIS {
@@ -262,9 +268,10 @@ class PageMap2 {
 
       // Make 2nd level node if necessary
       if (root_[i1] == nullptr) {
-        Leaf* leaf = reinterpret_cast<Leaf*>(Allocator(sizeof(Leaf)));
+        Leaf* leaf = reinterpret_cast<Leaf*>(LeafAllocator(sizeof(Leaf)));
         if (leaf == nullptr) return false;
         bytes_used_ += sizeof(Leaf);
+        ++leaves_used_;
         memset(leaf, 0, sizeof(*leaf));
         root_[i1] = leaf;
       }
@@ -280,13 +287,18 @@ class PageMap2 {
     return bytes_used_ + sizeof(*this);
   }
 
+  // The number of leaves, each covering 2^kLeafBits pages.  The fewer leaves
+  // the heap spans, the fewer cache lines lookups touch.
+  size_t leaves_used() const { return leaves_used_; }
+
   constexpr size_t RootSize() const { return sizeof(root_); }
   const void* RootAddress() { return root_; }
 };
 
 // Three-level radix tree
 // Currently only used for TCMALLOC_INTERNAL_SMALL_BUT_SLOW
-template <int BITS, PagemapAllocator Allocator>
+template <int BITS, PagemapAllocator Allocator,
+          PagemapAllocator LeafAllocator = Allocator>
 class PageMap3 {
  private:
   // For x86 we currently have 48 usable bits, for POWER we have 46. With
@@ -335,11 +347,12 @@ class PageMap3 {
 
   Node* absl_nullable root_[kRootLength];  // Top-level node
   size_t bytes_used_;
+  size_t leaves_used_;
 
  public:
   typedef uintptr_t Number;
 
-  constexpr PageMap3() : root_{}, bytes_used_(0) {}
+  constexpr PageMap3() : root_{}, bytes_used_(0), leaves_used_(0) {}
 
   // No locks required.  See SYNCHRONIZATION explanation at top of tcmalloc.cc.
   Span* absl_nullable get(Number k) const ABSL_NO_THREAD_SAFETY_ANALYSIS {
@@ -513,9 +526,10 @@ class PageMap3 {
 
       // Allocate Leaf if necessary
       if (root_[i1]->leafs[i2] == nullptr) {
-        Leaf* leaf = reinterpret_cast<Leaf*>(Allocator(sizeof(Leaf)));
+        Leaf* leaf = reinterpret_cast<Leaf*>(LeafAllocator(sizeof(Leaf)));
         if (leaf == nullptr) return false;
         bytes_used_ += sizeof(Leaf);
+        ++leaves_used_;
         memset(leaf, 0, sizeof(*leaf));
         root_[i1]->leafs[i2] = leaf;
       }
@@ -528,6 +542,10 @@ class PageMap3 {
 
   size_t bytes_used() const { return bytes_used_ + sizeof(*this); }
 
+  // The number of leaves, each covering 2^kLeafBits pages.  The fewer leaves
+  // the heap spans, the fewer cache lines lookups touch.
+  size_t leaves_used() const { return leaves_used_; }
+
   constexpr size_t RootSize() const { return sizeof(root_); }
   const void* RootAddress() { return root_; }
 };
@@ -600,6 +618,10 @@ class PageMap {
     return map_.bytes_used();
   }
 
+  size_t leaves() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    return map_.leaves_used();
+  }
+
   [[nodiscard]] void* GetHugepage(PageId p) {
     return map_.get_hugepage(p.index());
   }
@@ -649,9 +671,9 @@ class PageMap {
 
  private:
 #ifdef TCMALLOC_USE_PAGEMAP3
-  PageMap3<kAddressBits - kPageShift, MetaDataAlloc> map_;
+  PageMap3<kAddressBits - kPageShift, MetaDataAlloc, PageMapLeafAlloc> map_;
 #else
-  PageMap2<kAddressBits - kPageShift, MetaDataAlloc> map_;
+  PageMap2<kAddressBits - kPageShift, MetaDataAlloc, PageMapLeafAlloc> map_;
 #endif
 };
 
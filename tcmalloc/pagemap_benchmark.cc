@@ -0,0 +1,118 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks random pagemap size class lookups, as done by unsized free, with
+// the leaves on small pages or packed into hugepages.
+
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/pagemap.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+void* RootAlloc(size_t bytes) { return ::operator new(bytes); }
+
+// Backs each leaf by its own mapping, kept on small pages.
+void* SmallPageLeafAlloc(size_t bytes) {
+  void* result = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  TC_CHECK_NE(result, MAP_FAILED);
+  madvise(result, bytes, MADV_NOHUGEPAGE);
+  return result;
+}
+
+// Packs leaves into hugepage-aligned chunks, as PageMapLeafAlloc does.
+void* HugePageLeafAlloc(size_t bytes) {
+  static char* free_area = nullptr;
+  static size_t free_avail = 0;
+  TC_CHECK_LE(bytes, kHugePageSize);
+  if (free_avail < bytes) {
+    // Over-allocate so that we can align the chunk to a hugepage boundary.
+    void* ptr = mmap(nullptr, 2 * kHugePageSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    TC_CHECK_NE(ptr, MAP_FAILED);
+    const uintptr_t aligned =
+        (reinterpret_cast<uintptr_t>(ptr) + kHugePageSize - 1) &
+        ~(kHugePageSize - 1);
+    free_area = reinterpret_cast<char*>(aligned);
+    free_avail = kHugePageSize;
+    madvise(free_area, kHugePageSize, MADV_HUGEPAGE);
+  }
+  void* result = free_area;
+  free_area += bytes;
+  free_avail -= bytes;
+  return result;
+}
+
+template <PagemapAllocator LeafAllocator>
+#ifdef TCMALLOC_USE_PAGEMAP3
+using BenchmarkPageMap =
+    PageMap3<kAddressBits - kPageShift, RootAlloc, LeafAllocator>;
+#else
+using BenchmarkPageMap =
+    PageMap2<kAddressBits - kPageShift, RootAlloc, LeafAllocator>;
+#endif
+
+// Arg: GiB of address space covered by the pagemap.
+//
+// Maps are kept across runs, so that leaves are only allocated once per
+// allocator and repeated runs do not leak.
+template <PagemapAllocator LeafAllocator>
+void BM_RandomSizeClassLookup(benchmark::State& state) {
+  static auto* map = new BenchmarkPageMap<LeafAllocator>();
+  const size_t pages = (size_t{1} << 30) * state.range(0) >> kPageShift;
+  TC_CHECK(map->Ensure(0, pages));
+
+  constexpr size_t kLookups = 1 << 16;
+  absl::BitGen rng;
+  std::vector<uintptr_t> keys(kLookups);
+  for (uintptr_t& key : keys) {
+    key = absl::Uniform<uintptr_t>(rng, 0, pages);
+  }
+
+  size_t i = 0;
+  for (auto s : state) {
+    benchmark::DoNotOptimize(map->sizeclass(keys[i]));
+    i = (i + 1) % kLookups;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_RandomSizeClassLookup<SmallPageLeafAlloc>)
+    ->Arg(1)
+    ->Arg(4)
+    ->Arg(16)
+    ->Arg(64);
+BENCHMARK(BM_RandomSizeClassLookup<HugePageLeafAlloc>)
+    ->Arg(1)
+    ->Arg(4)
+    ->Arg(16)
+    ->Arg(64);
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -116,6 +116,21 @@ TEST_P(PageMapTest, Bulk) {
   }
 }
 
+TEST_P(PageMapTest, LeavesUsed) {
+  const intptr_t limit = GetParam();
+  EXPECT_EQ(map->leaves_used(), 0);
+
+  ASSERT_TRUE(map->Ensure(0, limit));
+  const size_t leaves = map->leaves_used();
+  EXPECT_GT(leaves, 0);
+  ASSERT_TRUE(map->Ensure(0, limit));
+  EXPECT_EQ(map->leaves_used(), leaves);
+
+  // A distant page needs a leaf of its own.
+  ASSERT_TRUE(map->Ensure((1 << 20) - 1, 1));
+  EXPECT_EQ(map->leaves_used(), leaves + 1);
+}
+
 TEST_P(PageMapTest, Overflow) {
   const intptr_t kLimit = 1 << 20;
   ASSERT_FALSE(map->Ensure(kLimit, kLimit + 1));
@@ -29,6 +29,7 @@
 #include "tcmalloc/internal/bytes.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/mte.h"
 #include "tcmalloc/internal/optimization.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
@@ -276,9 +277,10 @@ inline PageId PageIdContaining(const void* p) {
   return PageId(reinterpret_cast<uintptr_t>(p) >> kPageShift);
 }
 
+// Like PageIdContaining, for pointers that may carry an MTE tag.
 TCMALLOC_ATTRIBUTE_CONST
 inline PageId PageIdContainingTagged(const void* p) {
-  return PageIdContaining(p);
+  return PageIdContaining(MteUntag(p));
 }
 
 TCMALLOC_ATTRIBUTE_CONST
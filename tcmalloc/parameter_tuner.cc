@@ -0,0 +1,430 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/parameter_tuner.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <iterator>
+
+#include "absl/base/internal/spinlock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/global_stats.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/parameters.h"
+#include "tcmalloc/static_vars.h"
+#include "tcmalloc/stats.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+const char* ParameterTuner::ActionName(Action action) {
+  switch (action) {
+    case Action::kTrial:
+      return "trial";
+    case Action::kKeep:
+      return "keep";
+    case Action::kRevert:
+      return "revert";
+  }
+  return "unknown";
+}
+
+double ParameterTuner::Cost(const TunerCounters& counters,
+                            absl::Duration elapsed, double cpu_weight) const {
+  const double seconds = std::max(absl::ToDoubleSeconds(elapsed), 1e-3);
+  auto delta = [&](uint64_t TunerCounters::* field) {
+    return static_cast<double>(counters.*field - prev_counters_.*field);
+  };
+
+  const double released = delta(&TunerCounters::released_pages);
+  const double sampled = delta(&TunerCounters::sampled_released_pages);
+  const double refaulted =
+      sampled > 0 ? delta(&TunerCounters::refaulted_pages) * released / sampled
+                  : 0;
+  const double cpu_ns = delta(&TunerCounters::cache_misses) * kMissCostNs +
+                        released * kReleaseCostNs + refaulted * kRefaultCostNs;
+  const double cpus = cpu_ns / 1e9 / seconds;
+
+  // Caches take most of an epoch to settle after a change, so the memory at
+  // its end is what the setting costs.
+  const double overhead_gib = static_cast<double>(counters.overhead_bytes) /
+                              static_cast<double>(uint64_t{1} << 30);
+  return overhead_gib + cpu_weight * cpus;
+}
+
+void ParameterTuner::Advance(size_t num_params) {
+  current_ = (current_ + 1) % num_params;
+}
+
+void ParameterTuner::Record(absl::Time now, const char* name, double from,
+                            double to, Action action) {
+  TC_LOG("tcmalloc parameter tuner: %s %s %g -> %g", ActionName(action), name,
+         from, to);
+
+  AllocationGuardSpinLockHolder l(lock_);
+  switch (action) {
+    case Action::kTrial:
+      ++trials_;
+      break;
+    case Action::kKeep:
+      ++kept_;
+      break;
+    case Action::kRevert:
+      ++reverted_;
+      break;
+  }
+  changes_[next_change_ % kMaxChanges] = {
+      .time = now, .name = name, .from = from, .to = to, .action = action};
+  ++next_change_;
+}
+
+void ParameterTuner::StartTrial(absl::Time now,
+                                absl::Span<const TunableParameter> params) {
+  // Each parameter gets a chance in each direction before giving up until the
+  // next epoch.
+  for (size_t i = 0; i < 2 * params.size(); ++i) {
+    const TunableParameter& p = params[current_];
+    const double value = p.get();
+    if (value <= 0) {
+      Advance(params.size());
+      continue;
+    }
+    // A parameter that was disabled initially is bounded relative to its
+    // first enabled value instead.
+    if (initial_[current_] <= 0) {
+      initial_[current_] = value;
+    }
+
+    const double lo = std::max(p.min, initial_[current_] / kMaxDrift);
+    const double hi = std::min(p.max, initial_[current_] * kMaxDrift);
+    const double next = std::clamp(
+        direction_[current_] > 0 ? value * p.step : value / p.step, lo, hi);
+    if (next == value) {
+      // At a bound, so only the other direction is left.
+      direction_[current_] = -direction_[current_];
+      Advance(params.size());
+      continue;
+    }
+
+    p.set(next);
+    if (p.get() == value) {
+      // Held in place by another parameter.
+      direction_[current_] = -direction_[current_];
+      Advance(params.size());
+      continue;
+    }
+    trial_from_ = value;
+    trial_to_ = p.get();
+    phase_ = Phase::kTrial;
+    Record(now, p.name, trial_from_, trial_to_, Action::kTrial);
+    return;
+  }
+  phase_ = Phase::kBaseline;
+}
+
+void ParameterTuner::Update(absl::Time now, const TunerCounters& counters,
+                            double cpu_weight,
+                            absl::Span<const TunableParameter> params) {
+  TC_ASSERT_LE(params.size(), kMaxParameters);
+  if (params.empty()) return;
+
+  if (phase_ == Phase::kStopped) {
+    for (size_t i = 0; i < params.size(); ++i) {
+      initial_[i] = params[i].get();
+      direction_[i] = 1;
+    }
+    current_ = 0;
+    failed_trials_ = 0;
+    rest_epochs_ = 0;
+    prev_counters_ = counters;
+    prev_time_ = now;
+    phase_ = Phase::kBaseline;
+    return;
+  }
+
+  const double cost = Cost(counters, now - prev_time_, cpu_weight);
+  prev_counters_ = counters;
+  prev_time_ = now;
+  {
+    AllocationGuardSpinLockHolder l(lock_);
+    cost_ = cost;
+  }
+
+  if (phase_ == Phase::kTrial) {
+    const TunableParameter& p = params[current_];
+    if (p.get() != trial_to_) {
+      // Someone else set the parameter during the trial.  Their value
+      // stands, and becomes the reference for its bounds.
+      initial_[current_] = p.get();
+      Advance(params.size());
+    } else if (cost < baseline_cost_ * (1 - kMinImprovement)) {
+      Record(now, p.name, trial_from_, trial_to_, Action::kKeep);
+      failed_trials_ = 0;
+      // Keep going the same way, from the new baseline.
+      baseline_cost_ = cost;
+      StartTrial(now, params);
+      return;
+    } else {
+      p.set(trial_from_);
+      Record(now, p.name, trial_to_, trial_from_, Action::kRevert);
+      direction_[current_] = -direction_[current_];
+      Advance(params.size());
+      if (++failed_trials_ >= 2 * params.size()) {
+        failed_trials_ = 0;
+        rest_epochs_ = kRestEpochs;
+      }
+      // The epoch measured the trial, not the restored value.
+      phase_ = Phase::kBaseline;
+      return;
+    }
+  }
+
+  baseline_cost_ = cost;
+  if (rest_epochs_ > 0) {
+    --rest_epochs_;
+    return;
+  }
+  StartTrial(now, params);
+}
+
+void ParameterTuner::Stop(absl::Time now,
+                          absl::Span<const TunableParameter> params) {
+  if (phase_ == Phase::kTrial) {
+    const TunableParameter& p = params[current_];
+    if (p.get() == trial_to_) {
+      p.set(trial_from_);
+      Record(now, p.name, trial_to_, trial_from_, Action::kRevert);
+    }
+  }
+  phase_ = Phase::kStopped;
+}
+
+double ParameterTuner::cost() const {
+  AllocationGuardSpinLockHolder l(lock_);
+  return cost_;
+}
+
+void ParameterTuner::Print(Printer& out) const {
+  size_t trials, kept, reverted, next_change;
+  double cost;
+  Change changes[kMaxChanges];
+  {
+    AllocationGuardSpinLockHolder l(lock_);
+    trials = trials_;
+    kept = kept_;
+    reverted = reverted_;
+    next_change = next_change_;
+    cost = cost_;
+    std::copy(changes_, changes_ + kMaxChanges, changes);
+  }
+
+  out.printf(
+      "Parameter tuner: %zu trials, %zu kept, %zu reverted; last epoch cost "
+      "%.4f\n",
+      trials, kept, reverted, cost);
+  const size_t first =
+      next_change > kMaxChanges ? next_change - kMaxChanges : 0;
+  for (size_t i = first; i < next_change; ++i) {
+    const Change& c = changes[i % kMaxChanges];
+    out.printf("Parameter tuner: %d %s %s %g -> %g\n",
+               absl::ToUnixSeconds(c.time), ActionName(c.action), c.name,
+               c.from, c.to);
+  }
+}
+
+void ParameterTuner::PrintInPbtxt(PbtxtRegion& region) const {
+  size_t trials, kept, reverted, next_change;
+  double cost;
+  Change changes[kMaxChanges];
+  {
+    AllocationGuardSpinLockHolder l(lock_);
+    trials = trials_;
+    kept = kept_;
+    reverted = reverted_;
+    next_change = next_change_;
+    cost = cost_;
+    std::copy(changes_, changes_ + kMaxChanges, changes);
+  }
+
+  region.PrintI64("trials", trials);
+  region.PrintI64("kept", kept);
+  region.PrintI64("reverted", reverted);
+  region.PrintDouble("cost", cost);
+  const size_t first =
+      next_change > kMaxChanges ? next_change - kMaxChanges : 0;
+  for (size_t i = first; i < next_change; ++i) {
+    const Change& c = changes[i % kMaxChanges];
+    PbtxtRegion change = region.CreateSubRegion("changes");
+    change.PrintI64("time", absl::ToUnixSeconds(c.time));
+    change.PrintRaw("action", ActionName(c.action));
+    change.PrintRaw("parameter", c.name);
+    change.PrintDouble("from", c.from);
+    change.PrintDouble("to", c.to);
+  }
+}
+
+namespace {
+
+double MaxPerCpuCacheSize() {
+  return MallocExtension::PerCpuCachesActive()
+             ? Parameters::max_per_cpu_cache_size()
+             : 0;
+}
+
+double DynamicSlabGrowThreshold() {
+  return Parameters::per_cpu_caches_dynamic_slab_enabled()
+             ? Parameters::per_cpu_caches_dynamic_slab_grow_threshold()
+             : 0;
+}
+
+double DynamicSlabShrinkThreshold() {
+  return Parameters::per_cpu_caches_dynamic_slab_enabled()
+             ? Parameters::per_cpu_caches_dynamic_slab_shrink_threshold()
+             : 0;
+}
+
+// The skip-subrelease intervals are tuned in seconds, and the short one is
+// kept below the long one.
+constexpr TunableParameter kTunableParameters[] = {
+    {
+        .name = "max_per_cpu_cache_size",
+        .get = MaxPerCpuCacheSize,
+        .set =
+            [](double v) {
+              Parameters::set_max_per_cpu_cache_size(static_cast<int32_t>(v));
+            },
+        .min = 64 << 10,
+        .max = 64 << 20,
+        .step = 1.25,
+    },
+    {
+        .name = "background_release_rate",
+        .get =
+            []() -> double {
+          return static_cast<double>(Parameters::background_release_rate());
+        },
+        .set =
+            [](double v) {
+              Parameters::set_background_release_rate(
+                  static_cast<MallocExtension::BytesPerSecond>(
+                      static_cast<size_t>(v)));
+            },
+        .min = 1 << 20,
+        .max = 1 << 30,
+        .step = 1.5,
+    },
+    {
+        .name = "filler_skip_subrelease_short_interval",
+        .get =
+            []() {
+              return absl::ToDoubleSeconds(
+                  Parameters::filler_skip_subrelease_short_interval());
+            },
+        .set =
+            [](double v) {
+              Parameters::set_filler_skip_subrelease_short_interval(std::min(
+                  absl::Seconds(v),
+                  Parameters::filler_skip_subrelease_long_interval()));
+            },
+        .min = 1,
+        .max = 3600,
+        .step = 1.5,
+    },
+    {
+        .name = "filler_skip_subrelease_long_interval",
+        .get =
+            []() {
+              return absl::ToDoubleSeconds(
+                  Parameters::filler_skip_subrelease_long_interval());
+            },
+        .set =
+            [](double v) {
+              Parameters::set_filler_skip_subrelease_long_interval(std::max(
+                  absl::Seconds(v),
+                  Parameters::filler_skip_subrelease_short_interval()));
+            },
+        .min = 1,
+        .max = 3600,
+        .step = 1.5,
+    },
+    {
+        .name = "per_cpu_caches_dynamic_slab_grow_threshold",
+        .get = DynamicSlabGrowThreshold,
+        .set =
+            [](double v) {
+              Parameters::set_per_cpu_caches_dynamic_slab_grow_threshold(
+                  std::max(v, DynamicSlabShrinkThreshold()));
+            },
+        .min = 0.5,
+        .max = 0.99,
+        .step = 1.05,
+    },
+    {
+        .name = "per_cpu_caches_dynamic_slab_shrink_threshold",
+        .get = DynamicSlabShrinkThreshold,
+        .set =
+            [](double v) {
+              Parameters::set_per_cpu_caches_dynamic_slab_shrink_threshold(
+                  std::min(v, DynamicSlabGrowThreshold()));
+            },
+        .min = 0.1,
+        .max = 0.8,
+        .step = 1.1,
+    },
+};
+static_assert(std::size(kTunableParameters) <=
+              ParameterTuner::kMaxParameters);
+
+}  // namespace
+
+void UpdateParameterTuner(absl::Time now, const TCMallocStats& stats) {
+  ParameterTuner& tuner = tc_globals.parameter_tuner();
+  const int32_t cpu_weight = Parameters::auto_tuner_cpu_weight();
+  if (cpu_weight <= 0) {
+    tuner.Stop(now, kTunableParameters);
+    return;
+  }
+
+  TunerCounters counters;
+  const uint64_t physical = PhysicalMemoryUsed(stats);
+  const uint64_t in_use = InUseByApp(stats);
+  counters.overhead_bytes = physical > in_use ? physical - in_use : 0;
+  if (MallocExtension::PerCpuCachesActive()) {
+    const auto misses = tc_globals.cpu_cache().GetTotalCacheMissStats();
+    counters.cache_misses =
+        uint64_t{misses.underflows} + uint64_t{misses.overflows};
+  }
+  counters.released_pages = stats.num_released_total.raw_num();
+  {
+    PageHeapSpinLockHolder l;
+    const RefaultStats refaults = tc_globals.page_allocator().GetRefaultStats();
+    counters.sampled_released_pages = refaults.sampled.total.raw_num();
+    counters.refaulted_pages = refaults.refaulted.total.raw_num();
+  }
+
+  tuner.Update(now, counters, cpu_weight, kTunableParameters);
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
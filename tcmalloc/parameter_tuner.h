@@ -0,0 +1,181 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_PARAMETER_TUNER_H_
+#define TCMALLOC_PARAMETER_TUNER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+struct TCMallocStats;
+
+// A parameter that ParameterTuner may adjust.  get() returns 0 while the
+// parameter does not apply, e.g. while the feature it configures is disabled,
+// and the tuner then leaves it alone.
+struct TunableParameter {
+  const char* name;
+  double (*get)();
+  void (*set)(double);
+  // Bounds on top of those relative to the parameter's initial value.
+  double min;
+  double max;
+  // Each trial multiplies or divides the value by step.
+  double step;
+};
+
+// What ParameterTuner measures at the end of each epoch.  All but
+// overhead_bytes are totals since startup.
+struct TunerCounters {
+  // Physical memory held by the allocator beyond the application's live
+  // bytes.  The parameters do not change the live bytes, so this is the part
+  // of the RSS that they control.
+  uint64_t overhead_bytes = 0;
+  // Per-CPU cache underflows and overflows.
+  uint64_t cache_misses = 0;
+  uint64_t released_pages = 0;
+  // Refaults are counted for a sample of the released pages.
+  uint64_t sampled_released_pages = 0;
+  uint64_t refaulted_pages = 0;
+};
+
+// Adjusts allocator parameters to minimize
+//
+//   overhead GiB + cpu_weight * estimated allocator CPUs
+//
+// by coordinate descent: each epoch either measures the current settings or
+// a trial that moves one parameter by one step.  A trial that lowers the
+// objective by at least kMinImprovement is kept, and the parameter is moved
+// further the same way; otherwise it is reverted, and the next parameter is
+// tried, in the other direction next time around.  Parameters stay within a
+// factor of kMaxDrift of their initial values.  Once every parameter failed
+// to improve in either direction, the tuner rests for kRestEpochs before
+// probing again.  Every change is logged.
+//
+// The allocator CPU time is estimated from the per-CPU cache misses, the
+// released pages and the refaulted pages, which are what the parameters
+// trade against memory.
+class ParameterTuner {
+ public:
+  static constexpr size_t kMaxParameters = 8;
+  static constexpr size_t kMaxChanges = 16;
+  static constexpr double kMaxDrift = 4;
+  static constexpr double kMinImprovement = 0.02;
+  static constexpr size_t kRestEpochs = 30;
+  // Rough costs, in nanoseconds.  A miss goes to the transfer cache; a
+  // released page costs the madvise call, and a refaulted one also the page
+  // faults to back it again.
+  static constexpr double kMissCostNs = 100;
+  static constexpr double kReleaseCostNs = 500;
+  static constexpr double kRefaultCostNs = 5000;
+
+  constexpr ParameterTuner()
+      : lock_(absl::base_internal::SCHEDULE_KERNEL_ONLY) {}
+  ParameterTuner(const ParameterTuner&) = delete;
+  ParameterTuner& operator=(const ParameterTuner&) = delete;
+
+  // Measures the epoch since the previous call and moves on to the next
+  // trial.  The first call only starts measuring.
+  //
+  // REQUIRES: params holds at most kMaxParameters, and is the same on every
+  // call.  Calls are serialized.
+  void Update(absl::Time now, const TunerCounters& counters, double cpu_weight,
+              absl::Span<const TunableParameter> params)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Reverts the trial in progress, if any, and forgets the measurements.
+  void Stop(absl::Time now, absl::Span<const TunableParameter> params)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // The objective measured for the last epoch.
+  double cost() const;
+
+  void Print(Printer& out) const ABSL_LOCKS_EXCLUDED(lock_);
+  void PrintInPbtxt(PbtxtRegion& region) const ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  enum class Phase : uint8_t {
+    kStopped,
+    kBaseline,
+    kTrial,
+  };
+
+  enum class Action : uint8_t {
+    kTrial,
+    kKeep,
+    kRevert,
+  };
+
+  struct Change {
+    absl::Time time;
+    const char* name;
+    double from;
+    double to;
+    Action action;
+  };
+
+  static const char* ActionName(Action action);
+
+  double Cost(const TunerCounters& counters, absl::Duration elapsed,
+              double cpu_weight) const;
+  // Moves the current parameter, or the next one that can move, by one step.
+  void StartTrial(absl::Time now, absl::Span<const TunableParameter> params);
+  void Advance(size_t num_params);
+  void Record(absl::Time now, const char* name, double from, double to,
+              Action action) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Only accessed by the thread calling Update and Stop.
+  Phase phase_ = Phase::kStopped;
+  TunerCounters prev_counters_;
+  absl::Time prev_time_;
+  double baseline_cost_ = 0;
+  size_t current_ = 0;
+  double trial_from_ = 0;
+  double trial_to_ = 0;
+  // Trials reverted since the last one kept.
+  size_t failed_trials_ = 0;
+  size_t rest_epochs_ = 0;
+  double initial_[kMaxParameters] = {};
+  int8_t direction_[kMaxParameters] = {};
+
+  mutable absl::base_internal::SpinLock lock_;
+  double cost_ ABSL_GUARDED_BY(lock_) = 0;
+  size_t trials_ ABSL_GUARDED_BY(lock_) = 0;
+  size_t kept_ ABSL_GUARDED_BY(lock_) = 0;
+  size_t reverted_ ABSL_GUARDED_BY(lock_) = 0;
+  // Ring buffer of changes; next_change_ counts all changes ever recorded.
+  size_t next_change_ ABSL_GUARDED_BY(lock_) = 0;
+  Change changes_[kMaxChanges] ABSL_GUARDED_BY(lock_) = {};
+};
+
+// Runs tc_globals.parameter_tuner() on the allocator's telemetry while
+// Parameters::auto_tuner_cpu_weight() is positive, and stops it otherwise.
+// Called by the background thread once per epoch.
+void UpdateParameterTuner(absl::Time now, const TCMallocStats& stats);
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_PARAMETER_TUNER_H_
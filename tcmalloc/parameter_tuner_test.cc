@@ -0,0 +1,114 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/parameter_tuner.h"
+
+#include <stdint.h>
+
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+constexpr absl::Duration kEpoch = absl::Seconds(60);
+
+// A cache whose size trades memory against misses: each unit of size costs
+// 1 MiB, and misses are inversely proportional to the size.  With a CPU
+// weight of 1, the objective is lowest at a size of 250.
+double cache_size;
+
+double GetCacheSize() { return cache_size; }
+void SetCacheSize(double v) { cache_size = v; }
+
+constexpr TunableParameter kParams[] = {
+    {
+        .name = "cache_size",
+        .get = GetCacheSize,
+        .set = SetCacheSize,
+        .min = 1,
+        .max = 10000,
+        .step = 1.25,
+    },
+};
+
+class ParameterTunerTest : public testing::Test {
+ protected:
+  // Simulates an epoch at the current cache size, and updates the tuner.
+  void RunEpoch() {
+    now_ += kEpoch;
+    counters_.overhead_bytes = static_cast<uint64_t>(cache_size * (1 << 20));
+    counters_.cache_misses += static_cast<uint64_t>(3.66e10 / cache_size);
+    tuner_.Update(now_, counters_, /*cpu_weight=*/1, kParams);
+  }
+
+  ParameterTuner tuner_;
+  absl::Time now_ = absl::UnixEpoch();
+  TunerCounters counters_;
+};
+
+TEST_F(ParameterTunerTest, ConvergesTowardsOptimum) {
+  cache_size = 100;
+  for (int i = 0; i < 100; ++i) {
+    RunEpoch();
+  }
+  EXPECT_GE(cache_size, 150);
+  EXPECT_LE(cache_size, 400);
+  EXPECT_GT(tuner_.cost(), 0);
+}
+
+TEST_F(ParameterTunerTest, StaysWithinDrift) {
+  // The optimum is far above the initial value.
+  cache_size = 10;
+  for (int i = 0; i < 100; ++i) {
+    RunEpoch();
+    EXPECT_LE(cache_size, 10 * ParameterTuner::kMaxDrift);
+  }
+  // It keeps probing below the bound, one step at a time.
+  EXPECT_GE(cache_size, 10 * ParameterTuner::kMaxDrift / kParams[0].step);
+}
+
+TEST_F(ParameterTunerTest, IgnoresDisabledParameters) {
+  cache_size = 0;
+  for (int i = 0; i < 10; ++i) {
+    RunEpoch();
+    EXPECT_EQ(cache_size, 0);
+  }
+}
+
+TEST_F(ParameterTunerTest, StopRevertsTrial) {
+  cache_size = 100;
+  // The first epoch starts measuring, and the second starts a trial.
+  RunEpoch();
+  RunEpoch();
+  ASSERT_NE(cache_size, 100);
+  tuner_.Stop(now_, kParams);
+  EXPECT_EQ(cache_size, 100);
+}
+
+TEST_F(ParameterTunerTest, KeepsExternalChanges) {
+  cache_size = 100;
+  RunEpoch();
+  RunEpoch();
+  ASSERT_NE(cache_size, 100);
+  // Someone else sets the parameter during the trial.
+  cache_size = 50;
+  RunEpoch();
+  EXPECT_NE(cache_size, 100);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -13,6 +13,7 @@
 // limitations under the License.
 #include "tcmalloc/parameters.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
@@ -23,6 +24,7 @@
 #include "absl/base/call_once.h"
 #include "absl/base/const_init.h"
 #include "absl/base/internal/spinlock.h"
+#include "absl/strings/numbers.h"
 #include "absl/time/time.h"
 #include "tcmalloc/central_freelist.h"
 #include "tcmalloc/common.h"
@@ -36,8 +38,11 @@
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/environment.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/internal/mte.h"
 #include "tcmalloc/internal/parameter_accessors.h"
 #include "tcmalloc/internal_malloc_extension.h"
+#include "tcmalloc/large_span_cache.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/page_allocator.h"
 #include "tcmalloc/static_vars.h"
@@ -262,6 +267,627 @@ static std::atomic<bool>& huge_region_adaptive_release_enabled() {
   return v;
 }
 
+static std::atomic<bool>& per_cpu_caches_l3_aware_stealing_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_L3_AWARE_STEALING");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& per_cpu_caches_capacity_controller_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_PER_CPU_CAPACITY_CONTROLLER");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& per_cpu_caches_cgroup_aware_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_PER_CPU_CACHES_CGROUP_AWARE");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& thread_cache_adaptive_sizing_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_THREAD_CACHE_ADAPTIVE_SIZING");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& per_cpu_caches_incremental_drain_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e =
+        thread_safe_getenv("TCMALLOC_PER_CPU_CACHES_INCREMENTAL_DRAIN");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& per_cpu_caches_indirect_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_PER_CPU_CACHES_INDIRECT");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& per_cpu_caches_reset_after_fork_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e =
+        thread_safe_getenv("TCMALLOC_PER_CPU_CACHES_RESET_AFTER_FORK");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& large_span_cache_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_LARGE_SPAN_CACHE");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& background_adaptive_pacing_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_BACKGROUND_ADAPTIVE_PACING");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int32_t>& auto_tuner_cpu_weight_value() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int32_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_AUTO_TUNER_CPU_WEIGHT");
+    int32_t weight;
+    if (e != nullptr && absl::SimpleAtoi(e, &weight) && weight > 0) {
+      v.store(weight, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int32_t>& numa_remote_borrow_batches_value() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int32_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_NUMA_REMOTE_BORROW_BATCHES");
+    int32_t batches;
+    if (e != nullptr && absl::SimpleAtoi(e, &batches) && batches > 0) {
+      v.store(batches, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int32_t>& refill_prefetch_objects_value() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int32_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_REFILL_PREFETCH_OBJECTS");
+    int32_t objects;
+    if (e != nullptr && absl::SimpleAtoi(e, &objects) && objects > 0) {
+      v.store(objects, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int32_t>& hugepage_collapse_budget_us_value() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int32_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_HUGEPAGE_COLLAPSE_BUDGET_US");
+    int32_t budget;
+    if (e != nullptr && absl::SimpleAtoi(e, &budget) && budget > 0) {
+      v.store(budget, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int32_t>& slow_path_latency_sample_period_value() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int32_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e =
+        thread_safe_getenv("TCMALLOC_SLOW_PATH_LATENCY_SAMPLE_PERIOD");
+    int32_t period;
+    if (e != nullptr && absl::SimpleAtoi(e, &period) && period > 0) {
+      v.store(period, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int32_t>& profile_sampling_target_rate_value() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int32_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_PROFILE_SAMPLING_TARGET_RATE");
+    int32_t rate;
+    if (e != nullptr && absl::SimpleAtoi(e, &rate) && rate > 0) {
+      v.store(rate, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int64_t>& gigantic_page_threshold_value() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int64_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_GIGANTIC_PAGE_THRESHOLD");
+    int64_t bytes;
+    if (e != nullptr && absl::SimpleAtoi(e, &bytes) && bytes > 0) {
+      v.store(bytes, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int64_t>& eager_populate_threshold_value() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int64_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_EAGER_POPULATE_THRESHOLD");
+    int64_t bytes;
+    if (e != nullptr && absl::SimpleAtoi(e, &bytes) && bytes > 0) {
+      v.store(bytes, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+// The far memory tier is bound with a 64-bit nodemask.
+static constexpr int32_t kMaxFarMemoryNumaNodes = 64;
+
+static std::atomic<int32_t>& far_memory_numa_node_value() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int32_t> v{-1};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_FAR_MEMORY_NUMA_NODE");
+    int32_t node;
+    if (e != nullptr && absl::SimpleAtoi(e, &node) && node >= 0 &&
+        node < kMaxFarMemoryNumaNodes) {
+      v.store(node, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int32_t>& cgroup_memory_limit_percent_value() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int32_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_CGROUP_MEMORY_LIMIT_PERCENT");
+    int32_t percent;
+    if (e != nullptr && absl::SimpleAtoi(e, &percent) && percent > 0) {
+      v.store(std::min<int32_t>(percent, 100), std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int32_t>& central_freelist_max_shards_value() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int32_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_CENTRAL_FREELIST_MAX_SHARDS");
+    int32_t shards;
+    if (e != nullptr && absl::SimpleAtoi(e, &shards) && shards > 0) {
+      v.store(shards, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int32_t>& size_class_regions_value() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int32_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_SIZE_CLASS_REGIONS");
+    int32_t regions;
+    if (e != nullptr && absl::SimpleAtoi(e, &regions) && regions > 0) {
+      v.store(std::min(regions,
+                       static_cast<int32_t>(kMaxSizeClassRegions - 1)),
+              std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& mte_sampled_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_MTE_SAMPLED");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0) &&
+        MteEnableTagChecks()) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& numa_return_remote_frees_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_NUMA_RETURN_REMOTE_FREES");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& span_lifetime_prediction_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_SPAN_LIFETIME_PREDICTION");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& access_hint_reclassification_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_ACCESS_HINT_RECLASSIFICATION");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& huge_region_demand_based_release_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e =
+        thread_safe_getenv("TCMALLOC_HUGE_REGION_DEMAND_BASED_RELEASE");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& memory_pressure_release_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_MEMORY_PRESSURE_RELEASE");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& allocation_rate_history_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_ALLOCATION_RATE_HISTORY");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int64_t>& peak_heap_bucket_interval_ns() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int64_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_PEAK_HEAP_BUCKET_SECONDS");
+    int64_t seconds;
+    if (e != nullptr && absl::SimpleAtoi(e, &seconds) && seconds > 0) {
+      v.store(absl::ToInt64Nanoseconds(absl::Seconds(seconds)),
+              std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int64_t>& cold_page_out_idle_time_ns() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int64_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e =
+        thread_safe_getenv("TCMALLOC_COLD_PAGE_OUT_IDLE_TIME_SECONDS");
+    int64_t seconds;
+    if (e != nullptr && absl::SimpleAtoi(e, &seconds) && seconds > 0) {
+      v.store(absl::ToInt64Nanoseconds(absl::Seconds(seconds)),
+              std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int64_t>& leak_candidate_min_age_ns() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int64_t> v{
+      absl::ToInt64Nanoseconds(absl::Minutes(5))};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e =
+        thread_safe_getenv("TCMALLOC_LEAK_CANDIDATE_MIN_AGE_SECONDS");
+    int64_t seconds;
+    if (e != nullptr && absl::SimpleAtoi(e, &seconds) && seconds >= 0) {
+      v.store(absl::ToInt64Nanoseconds(absl::Seconds(seconds)),
+              std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int64_t>& slow_allocation_threshold_ns() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int64_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_SLOW_ALLOCATION_THRESHOLD_US");
+    int64_t micros;
+    if (e != nullptr && absl::SimpleAtoi(e, &micros) && micros >= 0) {
+      v.store(absl::ToInt64Nanoseconds(absl::Microseconds(micros)),
+              std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<int64_t>& access_heatmap_interval_ns() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<int64_t> v{0};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e =
+        thread_safe_getenv("TCMALLOC_ACCESS_HEATMAP_INTERVAL_SECONDS");
+    int64_t seconds;
+    if (e != nullptr && absl::SimpleAtoi(e, &seconds) && seconds > 0) {
+      v.store(absl::ToInt64Nanoseconds(absl::Seconds(seconds)),
+              std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& frame_pointer_unwinding_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_FRAME_POINTER_UNWINDING");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& prefault_pagemap_leaves_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_PREFAULT_PAGEMAP_LEAVES");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& central_freelist_empty_spans_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_CENTRAL_FREELIST_EMPTY_SPANS");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& span_mesh_estimation_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_SPAN_MESH_ESTIMATION");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& central_freelist_span_sharing_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e =
+        thread_safe_getenv("TCMALLOC_CENTRAL_FREELIST_SPAN_SHARING");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& central_freelist_adaptive_span_length_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e =
+        thread_safe_getenv("TCMALLOC_CENTRAL_FREELIST_ADAPTIVE_SPAN_LENGTH");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& hugepage_aligned_large_allocations_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e =
+        thread_safe_getenv("TCMALLOC_HUGEPAGE_ALIGNED_LARGE_ALLOCATIONS");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& deterministic_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_DETERMINISTIC");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& limit_shrinks_caches_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_LIMIT_SHRINKS_CACHES");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& per_cpu_caches_ranked_shuffle_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_RANKED_SHUFFLE");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& per_cpu_caches_dynamic_slab_working_set_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_DYNAMIC_SLAB_WORKING_SET");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& per_cpu_caches_predictive_refill_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_PREDICTIVE_REFILL");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
+static std::atomic<bool>& transfer_cache_flow_sizing_enabled() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_TRANSFER_CACHE_FLOW_SIZING");
+    if (e != nullptr &&
+        (std::strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0)) {
+      v.store(true, std::memory_order_relaxed);
+    }
+  });
+  return v;
+}
+
 static std::atomic<HeapPartitioningMode>& heap_partitioning_mode_ptr() {
   ABSL_CONST_INIT static absl::once_flag flag;
   ABSL_CONST_INIT static std::atomic<HeapPartitioningMode> v{
@@ -298,44 +924,246 @@ ABSL_CONST_INIT std::atomic<bool>
         DefaultOrDebugValue(true, false),
     };
 
-bool Parameters::background_process_actions_enabled() {
-  return background_process_actions_enabled_ptr().load(
-      std::memory_order_relaxed);
+bool Parameters::background_process_actions_enabled() {
+  return background_process_actions_enabled_ptr().load(
+      std::memory_order_relaxed);
+}
+
+absl::Duration Parameters::background_process_sleep_interval() {
+  return absl::Nanoseconds(
+      background_process_sleep_interval_ns().load(std::memory_order_relaxed));
+}
+
+absl::Duration Parameters::filler_skip_subrelease_short_interval() {
+  return absl::Nanoseconds(
+      skip_subrelease_short_interval_ns().load(std::memory_order_relaxed));
+}
+
+absl::Duration Parameters::filler_skip_subrelease_long_interval() {
+  return absl::Nanoseconds(
+      skip_subrelease_long_interval_ns().load(std::memory_order_relaxed));
+}
+
+EnableCollapse Parameters::usermode_hugepage_collapse() {
+  return usermode_hugepage_collapse_enabled_.load(std::memory_order_relaxed)
+             ? EnableCollapse::kEnabled
+             : EnableCollapse::kDisabled;
+}
+
+bool Parameters::back_small_allocations() {
+  return back_small_allocations_enabled().load(std::memory_order_relaxed);
+}
+
+bool Parameters::huge_region_adaptive_release() {
+  return huge_region_adaptive_release_enabled().load(std::memory_order_relaxed);
+}
+
+bool Parameters::per_cpu_caches_l3_aware_stealing() {
+  return per_cpu_caches_l3_aware_stealing_enabled().load(
+      std::memory_order_relaxed);
+}
+
+bool Parameters::per_cpu_caches_ranked_shuffle() {
+  return per_cpu_caches_ranked_shuffle_enabled().load(
+      std::memory_order_relaxed);
+}
+
+bool Parameters::per_cpu_caches_dynamic_slab_working_set() {
+  return per_cpu_caches_dynamic_slab_working_set_enabled().load(
+      std::memory_order_relaxed);
+}
+
+bool Parameters::per_cpu_caches_predictive_refill() {
+  return per_cpu_caches_predictive_refill_enabled().load(
+      std::memory_order_relaxed);
+}
+
+bool Parameters::transfer_cache_flow_sizing() {
+  return transfer_cache_flow_sizing_enabled().load(std::memory_order_relaxed);
+}
+
+bool Parameters::per_cpu_caches_capacity_controller() {
+  return per_cpu_caches_capacity_controller_enabled().load(
+      std::memory_order_relaxed);
+}
+
+bool Parameters::per_cpu_caches_cgroup_aware() {
+  return per_cpu_caches_cgroup_aware_enabled().load(std::memory_order_relaxed);
+}
+
+bool Parameters::per_cpu_caches_incremental_drain() {
+  return per_cpu_caches_incremental_drain_enabled().load(
+      std::memory_order_relaxed);
+}
+
+bool Parameters::per_cpu_caches_indirect() {
+  return per_cpu_caches_indirect_enabled().load(std::memory_order_relaxed);
+}
+
+bool Parameters::per_cpu_caches_reset_after_fork() {
+  return per_cpu_caches_reset_after_fork_enabled().load(
+      std::memory_order_relaxed);
+}
+
+bool Parameters::large_span_cache() {
+  return large_span_cache_enabled().load(std::memory_order_relaxed);
+}
+
+bool Parameters::background_adaptive_pacing() {
+  return background_adaptive_pacing_enabled().load(std::memory_order_relaxed);
+}
+
+int32_t Parameters::auto_tuner_cpu_weight() {
+  return auto_tuner_cpu_weight_value().load(std::memory_order_relaxed);
+}
+
+bool Parameters::thread_cache_adaptive_sizing() {
+  return thread_cache_adaptive_sizing_enabled().load(std::memory_order_relaxed);
+}
+
+int32_t Parameters::numa_remote_borrow_batches() {
+  return numa_remote_borrow_batches_value().load(std::memory_order_relaxed);
+}
+
+int32_t Parameters::refill_prefetch_objects() {
+  return refill_prefetch_objects_value().load(std::memory_order_relaxed);
+}
+
+int32_t Parameters::hugepage_collapse_budget_us() {
+  return hugepage_collapse_budget_us_value().load(std::memory_order_relaxed);
+}
+
+int32_t Parameters::slow_path_latency_sample_period() {
+  return slow_path_latency_sample_period_value().load(
+      std::memory_order_relaxed);
+}
+
+int32_t Parameters::profile_sampling_target_rate() {
+  return profile_sampling_target_rate_value().load(std::memory_order_relaxed);
+}
+
+int64_t Parameters::gigantic_page_threshold() {
+  return gigantic_page_threshold_value().load(std::memory_order_relaxed);
+}
+
+int64_t Parameters::eager_populate_threshold() {
+  return eager_populate_threshold_value().load(std::memory_order_relaxed);
+}
+
+int32_t Parameters::far_memory_numa_node() {
+  return far_memory_numa_node_value().load(std::memory_order_relaxed);
+}
+
+int32_t Parameters::cgroup_memory_limit_percent() {
+  return cgroup_memory_limit_percent_value().load(std::memory_order_relaxed);
+}
+
+int32_t Parameters::central_freelist_max_shards() {
+  return central_freelist_max_shards_value().load(std::memory_order_relaxed);
+}
+
+bool Parameters::numa_return_remote_frees() {
+  return numa_return_remote_frees_enabled().load(std::memory_order_relaxed);
+}
+
+bool Parameters::span_lifetime_prediction() {
+  return span_lifetime_prediction_enabled().load(std::memory_order_relaxed);
+}
+
+bool Parameters::access_hint_reclassification() {
+  return access_hint_reclassification_enabled().load(std::memory_order_relaxed);
+}
+
+bool Parameters::memory_pressure_release() {
+  return memory_pressure_release_enabled().load(std::memory_order_relaxed);
+}
+
+bool Parameters::allocation_rate_history() {
+  return allocation_rate_history_enabled().load(std::memory_order_relaxed);
+}
+
+absl::Duration Parameters::peak_heap_bucket_interval() {
+  return absl::Nanoseconds(
+      peak_heap_bucket_interval_ns().load(std::memory_order_relaxed));
+}
+
+absl::Duration Parameters::cold_page_out_idle_time() {
+  return absl::Nanoseconds(
+      cold_page_out_idle_time_ns().load(std::memory_order_relaxed));
 }
 
-absl::Duration Parameters::background_process_sleep_interval() {
+absl::Duration Parameters::leak_candidate_min_age() {
   return absl::Nanoseconds(
-      background_process_sleep_interval_ns().load(std::memory_order_relaxed));
+      leak_candidate_min_age_ns().load(std::memory_order_relaxed));
 }
 
-absl::Duration Parameters::filler_skip_subrelease_short_interval() {
+absl::Duration Parameters::slow_allocation_threshold() {
   return absl::Nanoseconds(
-      skip_subrelease_short_interval_ns().load(std::memory_order_relaxed));
+      slow_allocation_threshold_ns().load(std::memory_order_relaxed));
 }
 
-absl::Duration Parameters::filler_skip_subrelease_long_interval() {
+absl::Duration Parameters::access_heatmap_interval() {
   return absl::Nanoseconds(
-      skip_subrelease_long_interval_ns().load(std::memory_order_relaxed));
+      access_heatmap_interval_ns().load(std::memory_order_relaxed));
 }
 
-EnableCollapse Parameters::usermode_hugepage_collapse() {
-  return usermode_hugepage_collapse_enabled_.load(std::memory_order_relaxed)
-             ? EnableCollapse::kEnabled
-             : EnableCollapse::kDisabled;
+bool Parameters::frame_pointer_unwinding() {
+  return frame_pointer_unwinding_enabled().load(std::memory_order_relaxed);
 }
 
-bool Parameters::back_small_allocations() {
-  return back_small_allocations_enabled().load(std::memory_order_relaxed);
+bool Parameters::prefault_pagemap_leaves() {
+  return prefault_pagemap_leaves_enabled().load(std::memory_order_relaxed);
 }
 
-bool Parameters::huge_region_adaptive_release() {
-  return huge_region_adaptive_release_enabled().load(std::memory_order_relaxed);
+bool Parameters::central_freelist_empty_spans() {
+  return central_freelist_empty_spans_enabled().load(
+      std::memory_order_relaxed);
+}
+
+bool Parameters::span_mesh_estimation() {
+  return span_mesh_estimation_enabled().load(std::memory_order_relaxed);
+}
+
+bool Parameters::central_freelist_span_sharing() {
+  return central_freelist_span_sharing_enabled().load(
+      std::memory_order_relaxed);
+}
+
+bool Parameters::central_freelist_adaptive_span_length() {
+  return central_freelist_adaptive_span_length_enabled().load(
+      std::memory_order_relaxed);
+}
+
+bool Parameters::hugepage_aligned_large_allocations() {
+  return hugepage_aligned_large_allocations_enabled().load(
+      std::memory_order_relaxed);
+}
+
+bool Parameters::deterministic() {
+  return deterministic_enabled().load(std::memory_order_relaxed);
+}
+
+bool Parameters::limit_shrinks_caches() {
+  return limit_shrinks_caches_enabled().load(std::memory_order_relaxed);
+}
+
+bool Parameters::huge_region_demand_based_release() {
+  return huge_region_demand_based_release_enabled().load(
+      std::memory_order_relaxed);
 }
 
 HeapPartitioningMode Parameters::heap_partitioning_mode() {
   return heap_partitioning_mode_ptr().load(std::memory_order_relaxed);
 }
 
+int32_t Parameters::size_class_regions() {
+  return size_class_regions_value().load(std::memory_order_relaxed);
+}
+
+bool Parameters::mte_sampled() {
+  return mte_sampled_enabled().load(std::memory_order_relaxed);
+}
+
 bool ABSL_ATTRIBUTE_WEAK default_want_disable_span_lifetime_tracking();
 static central_freelist_internal::LifetimeTracking
 want_span_lifetime_tracking() {
@@ -372,6 +1200,10 @@ int32_t Parameters::max_per_cpu_cache_size() {
   return tc_globals.cpu_cache().CacheLimit();
 }
 
+int32_t Parameters::max_per_cpu_cold_cache_size() {
+  return tc_globals.cpu_cache().ColdCacheLimit();
+}
+
 int ABSL_ATTRIBUTE_WEAK default_want_disable_dynamic_slabs();
 
 // TODO(b/271475288): remove the default_want_disable_dynamic_slabs opt-out
@@ -560,6 +1392,10 @@ void TCMalloc_Internal_SetMaxPerCpuCacheSize(int32_t v) {
   tcmalloc::tcmalloc_internal::tc_globals.cpu_cache().SetCacheLimit(v);
 }
 
+void TCMalloc_Internal_SetMaxPerCpuColdCacheSize(int32_t v) {
+  tcmalloc::tcmalloc_internal::tc_globals.cpu_cache().SetColdCacheLimit(v);
+}
+
 void TCMalloc_Internal_SetMaxTotalThreadCacheBytes(int64_t v) {
   Parameters::max_total_thread_cache_bytes_.store(v, std::memory_order_relaxed);
   tcmalloc::tcmalloc_internal::ThreadCache::set_overall_thread_cache_size(v);
@@ -624,6 +1460,415 @@ void TCMalloc_Internal_SetPerCpuCachesDynamicSlabEnabled(bool v) {
   Parameters::per_cpu_caches_dynamic_slab_.store(v, std::memory_order_relaxed);
 }
 
+void TCMalloc_Internal_SetPerCpuCachesDynamicSlabGrowThreshold(double v) {
+  Parameters::per_cpu_caches_dynamic_slab_grow_threshold_.store(
+      v, std::memory_order_relaxed);
+}
+
+void TCMalloc_Internal_SetPerCpuCachesDynamicSlabShrinkThreshold(double v) {
+  Parameters::per_cpu_caches_dynamic_slab_shrink_threshold_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesL3AwareStealing() {
+  return Parameters::per_cpu_caches_l3_aware_stealing();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesL3AwareStealing(bool v) {
+  tcmalloc::tcmalloc_internal::per_cpu_caches_l3_aware_stealing_enabled()
+      .store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesRankedShuffle() {
+  return Parameters::per_cpu_caches_ranked_shuffle();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesRankedShuffle(bool v) {
+  tcmalloc::tcmalloc_internal::per_cpu_caches_ranked_shuffle_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesDynamicSlabWorkingSet() {
+  return Parameters::per_cpu_caches_dynamic_slab_working_set();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesDynamicSlabWorkingSet(bool v) {
+  tcmalloc::tcmalloc_internal::per_cpu_caches_dynamic_slab_working_set_enabled()
+      .store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesPredictiveRefill() {
+  return Parameters::per_cpu_caches_predictive_refill();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesPredictiveRefill(bool v) {
+  tcmalloc::tcmalloc_internal::per_cpu_caches_predictive_refill_enabled()
+      .store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetTransferCacheFlowSizing() {
+  return Parameters::transfer_cache_flow_sizing();
+}
+
+void TCMalloc_Internal_SetTransferCacheFlowSizing(bool v) {
+  tcmalloc::tcmalloc_internal::transfer_cache_flow_sizing_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesCapacityController() {
+  return Parameters::per_cpu_caches_capacity_controller();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesCapacityController(bool v) {
+  tcmalloc::tcmalloc_internal::per_cpu_caches_capacity_controller_enabled()
+      .store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesCgroupAware() {
+  return Parameters::per_cpu_caches_cgroup_aware();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesCgroupAware(bool v) {
+  tcmalloc::tcmalloc_internal::per_cpu_caches_cgroup_aware_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesIncrementalDrain() {
+  return Parameters::per_cpu_caches_incremental_drain();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesIncrementalDrain(bool v) {
+  tcmalloc::tcmalloc_internal::per_cpu_caches_incremental_drain_enabled()
+      .store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesIndirect() {
+  return Parameters::per_cpu_caches_indirect();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesIndirect(bool v) {
+  tcmalloc::tcmalloc_internal::per_cpu_caches_indirect_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesResetAfterFork() {
+  return Parameters::per_cpu_caches_reset_after_fork();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesResetAfterFork(bool v) {
+  tcmalloc::tcmalloc_internal::per_cpu_caches_reset_after_fork_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetLargeSpanCache() {
+  return Parameters::large_span_cache();
+}
+
+void TCMalloc_Internal_SetLargeSpanCache(bool v) {
+  tcmalloc::tcmalloc_internal::large_span_cache_enabled().store(
+      v, std::memory_order_relaxed);
+  if (!v) {
+    // Nothing is put in the cache anymore, so nothing would take the spans
+    // back out.
+    tcmalloc::tcmalloc_internal::FlushLargeSpanCache();
+  }
+}
+
+bool TCMalloc_Internal_GetBackgroundAdaptivePacing() {
+  return Parameters::background_adaptive_pacing();
+}
+
+void TCMalloc_Internal_SetBackgroundAdaptivePacing(bool v) {
+  tcmalloc::tcmalloc_internal::background_adaptive_pacing_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+int32_t TCMalloc_Internal_GetAutoTunerCpuWeight() {
+  return Parameters::auto_tuner_cpu_weight();
+}
+
+void TCMalloc_Internal_SetAutoTunerCpuWeight(int32_t v) {
+  tcmalloc::tcmalloc_internal::auto_tuner_cpu_weight_value().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetThreadCacheAdaptiveSizing() {
+  return Parameters::thread_cache_adaptive_sizing();
+}
+
+void TCMalloc_Internal_SetThreadCacheAdaptiveSizing(bool v) {
+  tcmalloc::tcmalloc_internal::thread_cache_adaptive_sizing_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+int32_t TCMalloc_Internal_GetNumaRemoteBorrowBatches() {
+  return Parameters::numa_remote_borrow_batches();
+}
+
+void TCMalloc_Internal_SetNumaRemoteBorrowBatches(int32_t v) {
+  tcmalloc::tcmalloc_internal::numa_remote_borrow_batches_value().store(
+      std::max<int32_t>(v, 0), std::memory_order_relaxed);
+}
+
+int32_t TCMalloc_Internal_GetRefillPrefetchObjects() {
+  return Parameters::refill_prefetch_objects();
+}
+
+void TCMalloc_Internal_SetRefillPrefetchObjects(int32_t v) {
+  tcmalloc::tcmalloc_internal::refill_prefetch_objects_value().store(
+      std::max<int32_t>(v, 0), std::memory_order_relaxed);
+}
+
+int32_t TCMalloc_Internal_GetHugePageCollapseBudgetUs() {
+  return Parameters::hugepage_collapse_budget_us();
+}
+
+void TCMalloc_Internal_SetHugePageCollapseBudgetUs(int32_t v) {
+  tcmalloc::tcmalloc_internal::hugepage_collapse_budget_us_value().store(
+      std::max<int32_t>(v, 0), std::memory_order_relaxed);
+}
+
+int32_t TCMalloc_Internal_GetSlowPathLatencySamplePeriod() {
+  return Parameters::slow_path_latency_sample_period();
+}
+
+void TCMalloc_Internal_SetSlowPathLatencySamplePeriod(int32_t v) {
+  tcmalloc::tcmalloc_internal::slow_path_latency_sample_period_value().store(
+      std::max<int32_t>(v, 0), std::memory_order_relaxed);
+}
+
+int32_t TCMalloc_Internal_GetProfileSamplingTargetRate() {
+  return Parameters::profile_sampling_target_rate();
+}
+
+void TCMalloc_Internal_SetProfileSamplingTargetRate(int32_t v) {
+  tcmalloc::tcmalloc_internal::profile_sampling_target_rate_value().store(
+      std::max<int32_t>(v, 0), std::memory_order_relaxed);
+}
+
+int64_t TCMalloc_Internal_GetGiganticPageThreshold() {
+  return Parameters::gigantic_page_threshold();
+}
+
+void TCMalloc_Internal_SetGiganticPageThreshold(int64_t v) {
+  tcmalloc::tcmalloc_internal::gigantic_page_threshold_value().store(
+      std::max<int64_t>(v, 0), std::memory_order_relaxed);
+}
+
+int64_t TCMalloc_Internal_GetEagerPopulateThreshold() {
+  return Parameters::eager_populate_threshold();
+}
+
+void TCMalloc_Internal_SetEagerPopulateThreshold(int64_t v) {
+  tcmalloc::tcmalloc_internal::eager_populate_threshold_value().store(
+      std::max<int64_t>(v, 0), std::memory_order_relaxed);
+}
+
+int32_t TCMalloc_Internal_GetFarMemoryNumaNode() {
+  return Parameters::far_memory_numa_node();
+}
+
+void TCMalloc_Internal_SetFarMemoryNumaNode(int32_t v) {
+  const bool valid =
+      v >= 0 && v < tcmalloc::tcmalloc_internal::kMaxFarMemoryNumaNodes;
+  tcmalloc::tcmalloc_internal::far_memory_numa_node_value().store(
+      valid ? v : -1, std::memory_order_relaxed);
+}
+
+int32_t TCMalloc_Internal_GetCgroupMemoryLimitPercent() {
+  return Parameters::cgroup_memory_limit_percent();
+}
+
+void TCMalloc_Internal_SetCgroupMemoryLimitPercent(int32_t v) {
+  tcmalloc::tcmalloc_internal::cgroup_memory_limit_percent_value().store(
+      std::clamp<int32_t>(v, 0, 100), std::memory_order_relaxed);
+}
+
+int32_t TCMalloc_Internal_GetCentralFreeListMaxShards() {
+  return Parameters::central_freelist_max_shards();
+}
+
+void TCMalloc_Internal_SetCentralFreeListMaxShards(int32_t v) {
+  tcmalloc::tcmalloc_internal::central_freelist_max_shards_value().store(
+      std::max<int32_t>(v, 0), std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetNumaReturnRemoteFrees() {
+  return Parameters::numa_return_remote_frees();
+}
+
+void TCMalloc_Internal_SetNumaReturnRemoteFrees(bool v) {
+  tcmalloc::tcmalloc_internal::numa_return_remote_frees_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetSpanLifetimePrediction() {
+  return Parameters::span_lifetime_prediction();
+}
+
+void TCMalloc_Internal_SetSpanLifetimePrediction(bool v) {
+  tcmalloc::tcmalloc_internal::span_lifetime_prediction_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetAccessHintReclassification() {
+  return Parameters::access_hint_reclassification();
+}
+
+void TCMalloc_Internal_SetAccessHintReclassification(bool v) {
+  tcmalloc::tcmalloc_internal::access_hint_reclassification_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetMemoryPressureRelease() {
+  return Parameters::memory_pressure_release();
+}
+
+void TCMalloc_Internal_SetMemoryPressureRelease(bool v) {
+  tcmalloc::tcmalloc_internal::memory_pressure_release_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetAllocationRateHistory() {
+  return Parameters::allocation_rate_history();
+}
+
+void TCMalloc_Internal_SetAllocationRateHistory(bool v) {
+  tcmalloc::tcmalloc_internal::allocation_rate_history_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+void TCMalloc_Internal_GetPeakHeapBucketInterval(absl::Duration* v) {
+  *v = Parameters::peak_heap_bucket_interval();
+}
+
+void TCMalloc_Internal_SetPeakHeapBucketInterval(absl::Duration v) {
+  tcmalloc::tcmalloc_internal::peak_heap_bucket_interval_ns().store(
+      absl::ToInt64Nanoseconds(std::max(v, absl::ZeroDuration())),
+      std::memory_order_relaxed);
+}
+
+void TCMalloc_Internal_GetColdPageOutIdleTime(absl::Duration* v) {
+  *v = Parameters::cold_page_out_idle_time();
+}
+
+void TCMalloc_Internal_SetColdPageOutIdleTime(absl::Duration v) {
+  tcmalloc::tcmalloc_internal::cold_page_out_idle_time_ns().store(
+      absl::ToInt64Nanoseconds(std::max(v, absl::ZeroDuration())),
+      std::memory_order_relaxed);
+}
+
+void TCMalloc_Internal_GetLeakCandidateMinAge(absl::Duration* v) {
+  *v = Parameters::leak_candidate_min_age();
+}
+
+void TCMalloc_Internal_SetLeakCandidateMinAge(absl::Duration v) {
+  tcmalloc::tcmalloc_internal::leak_candidate_min_age_ns().store(
+      absl::ToInt64Nanoseconds(std::max(v, absl::ZeroDuration())),
+      std::memory_order_relaxed);
+}
+
+void TCMalloc_Internal_GetSlowAllocationThreshold(absl::Duration* v) {
+  *v = Parameters::slow_allocation_threshold();
+}
+
+void TCMalloc_Internal_SetSlowAllocationThreshold(absl::Duration v) {
+  tcmalloc::tcmalloc_internal::slow_allocation_threshold_ns().store(
+      absl::ToInt64Nanoseconds(std::max(v, absl::ZeroDuration())),
+      std::memory_order_relaxed);
+}
+
+void TCMalloc_Internal_GetAccessHeatmapInterval(absl::Duration* v) {
+  *v = Parameters::access_heatmap_interval();
+}
+
+void TCMalloc_Internal_SetAccessHeatmapInterval(absl::Duration v) {
+  tcmalloc::tcmalloc_internal::access_heatmap_interval_ns().store(
+      absl::ToInt64Nanoseconds(std::max(v, absl::ZeroDuration())),
+      std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetFramePointerUnwinding() {
+  return Parameters::frame_pointer_unwinding();
+}
+
+void TCMalloc_Internal_SetFramePointerUnwinding(bool v) {
+  tcmalloc::tcmalloc_internal::frame_pointer_unwinding_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPrefaultPagemapLeaves() {
+  return Parameters::prefault_pagemap_leaves();
+}
+
+void TCMalloc_Internal_SetPrefaultPagemapLeaves(bool v) {
+  tcmalloc::tcmalloc_internal::prefault_pagemap_leaves_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetCentralFreelistEmptySpans() {
+  return Parameters::central_freelist_empty_spans();
+}
+
+void TCMalloc_Internal_SetCentralFreelistEmptySpans(bool v) {
+  tcmalloc::tcmalloc_internal::central_freelist_empty_spans_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetSpanMeshEstimation() {
+  return Parameters::span_mesh_estimation();
+}
+
+void TCMalloc_Internal_SetSpanMeshEstimation(bool v) {
+  tcmalloc::tcmalloc_internal::span_mesh_estimation_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetCentralFreelistSpanSharing() {
+  return Parameters::central_freelist_span_sharing();
+}
+
+void TCMalloc_Internal_SetCentralFreelistSpanSharing(bool v) {
+  tcmalloc::tcmalloc_internal::central_freelist_span_sharing_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetCentralFreelistAdaptiveSpanLength() {
+  return Parameters::central_freelist_adaptive_span_length();
+}
+
+void TCMalloc_Internal_SetCentralFreelistAdaptiveSpanLength(bool v) {
+  tcmalloc::tcmalloc_internal::central_freelist_adaptive_span_length_enabled()
+      .store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetHugepageAlignedLargeAllocations() {
+  return Parameters::hugepage_aligned_large_allocations();
+}
+
+void TCMalloc_Internal_SetHugepageAlignedLargeAllocations(bool v) {
+  tcmalloc::tcmalloc_internal::hugepage_aligned_large_allocations_enabled()
+      .store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetDeterministic() {
+  return Parameters::deterministic();
+}
+
+void TCMalloc_Internal_SetDeterministic(bool v) {
+  tcmalloc::tcmalloc_internal::deterministic_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetLimitShrinksCaches() {
+  return Parameters::limit_shrinks_caches();
+}
+
+void TCMalloc_Internal_SetLimitShrinksCaches(bool v) {
+  tcmalloc::tcmalloc_internal::limit_shrinks_caches_enabled().store(
+      v, std::memory_order_relaxed);
+}
+
 
 uint8_t TCMalloc_Internal_GetMinHotAccessHint() {
   return static_cast<uint8_t>(Parameters::min_hot_access_hint());
@@ -665,6 +1910,15 @@ void TCMalloc_Internal_SetHugeRegionAdaptiveReleaseEnabled(bool v) {
       v, std::memory_order_relaxed);
 }
 
+bool TCMalloc_Internal_GetHugeRegionDemandBasedRelease() {
+  return Parameters::huge_region_demand_based_release();
+}
+
+void TCMalloc_Internal_SetHugeRegionDemandBasedRelease(bool v) {
+  tcmalloc::tcmalloc_internal::huge_region_demand_based_release_enabled()
+      .store(v, std::memory_order_relaxed);
+}
+
 bool TCMalloc_Internal_GetReleaseMaxColdPages() {
   return Parameters::release_max_cold_pages();
 }
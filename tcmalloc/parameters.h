@@ -73,6 +73,12 @@ class Parameters {
     TCMalloc_Internal_SetMaxPerCpuCacheSize(value);
   }
 
+  static int32_t max_per_cpu_cold_cache_size();
+
+  static void set_max_per_cpu_cold_cache_size(int32_t value) {
+    TCMalloc_Internal_SetMaxPerCpuColdCacheSize(value);
+  }
+
   static int64_t max_total_thread_cache_bytes() {
     return max_total_thread_cache_bytes_.load(std::memory_order_relaxed);
   }
@@ -131,6 +137,14 @@ class Parameters {
 
   static bool huge_region_adaptive_release();
 
+  // Whether free hugepages in HugeRegions are only released once they are
+  // above the recent demand, using the filler's skip-subrelease intervals.
+  // Enabled by TCMALLOC_HUGE_REGION_DEMAND_BASED_RELEASE=1.
+  static bool huge_region_demand_based_release();
+  static void set_huge_region_demand_based_release(bool value) {
+    TCMalloc_Internal_SetHugeRegionDemandBasedRelease(value);
+  }
+
   static bool release_max_cold_pages() {
     return release_max_cold_pages_.load(std::memory_order_relaxed);
   }
@@ -186,14 +200,404 @@ class Parameters {
     return per_cpu_caches_dynamic_slab_grow_threshold_.load(
         std::memory_order_relaxed);
   }
+  static void set_per_cpu_caches_dynamic_slab_grow_threshold(double value) {
+    TCMalloc_Internal_SetPerCpuCachesDynamicSlabGrowThreshold(value);
+  }
 
   static double per_cpu_caches_dynamic_slab_shrink_threshold() {
     return per_cpu_caches_dynamic_slab_shrink_threshold_.load(
         std::memory_order_relaxed);
   }
+  static void set_per_cpu_caches_dynamic_slab_shrink_threshold(double value) {
+    TCMalloc_Internal_SetPerCpuCachesDynamicSlabShrinkThreshold(value);
+  }
+
+  // Whether per-CPU cache capacity is stolen from CPUs that share an L3 cache
+  // before crossing L3 domains.  Enabled by TCMALLOC_L3_AWARE_STEALING=1.
+  static bool per_cpu_caches_l3_aware_stealing();
+  static void set_per_cpu_caches_l3_aware_stealing(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesL3AwareStealing(value);
+  }
+
+  // Whether ShuffleCpuCaches moves capacity to every CPU with above-average
+  // misses, in proportion to its excess, over several background ticks.
+  // Enabled by TCMALLOC_RANKED_SHUFFLE=1.
+  static bool per_cpu_caches_ranked_shuffle();
+  static void set_per_cpu_caches_ranked_shuffle(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesRankedShuffle(value);
+  }
+
+  // Whether the dynamic slab is sized to fit the working set of the per-CPU
+  // caches instead of by the ratio of overflows to underflows.  Enabled by
+  // TCMALLOC_DYNAMIC_SLAB_WORKING_SET=1.
+  static bool per_cpu_caches_dynamic_slab_working_set();
+  static void set_per_cpu_caches_dynamic_slab_working_set(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesDynamicSlabWorkingSet(value);
+  }
+
+  // Whether per-CPU cache refills grow with the rate of underflows, so that
+  // an allocation burst is served by a few large transfer cache removals.
+  // Enabled by TCMALLOC_PREDICTIVE_REFILL=1.
+  static bool per_cpu_caches_predictive_refill();
+  static void set_per_cpu_caches_predictive_refill(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesPredictiveRefill(value);
+  }
+
+  // Whether transfer caches are resized by the objects flowing through them
+  // from freeing to allocating CPUs, towards a target hit rate, rather than by
+  // their misses alone.  Enabled by TCMALLOC_TRANSFER_CACHE_FLOW_SIZING=1.
+  static bool transfer_cache_flow_sizing();
+  static void set_transfer_cache_flow_sizing(bool value) {
+    TCMalloc_Internal_SetTransferCacheFlowSizing(value);
+  }
+
+  // Whether per-size-class maximum capacities are resized by a feedback
+  // controller that balances miss cost per byte across size classes.  Enabled
+  // by TCMALLOC_PER_CPU_CAPACITY_CONTROLLER=1.
+  static bool per_cpu_caches_capacity_controller();
+  static void set_per_cpu_caches_capacity_controller(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesCapacityController(value);
+  }
+
+  // Whether the per-cpu cache limit is derived from the cgroup v2 cpu.max and
+  // memory.max limits of the process.  Enabled by
+  // TCMALLOC_PER_CPU_CACHES_CGROUP_AWARE=1.
+  static bool per_cpu_caches_cgroup_aware();
+  static void set_per_cpu_caches_cgroup_aware(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesCgroupAware(value);
+  }
+
+  // Whether idle per-cpu caches are drained a few size classes per background
+  // tick rather than all at once.  Enabled by
+  // TCMALLOC_PER_CPU_CACHES_INCREMENTAL_DRAIN=1.
+  static bool per_cpu_caches_incremental_drain();
+  static void set_per_cpu_caches_incremental_drain(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesIncrementalDrain(value);
+  }
+
+  // Whether size classes that bypass the per-cpu slabs, because they are
+  // served by the sharded transfer cache, are still cached per CPU, a few
+  // objects at a time.  Enabled by TCMALLOC_PER_CPU_CACHES_INDIRECT=1.
+  static bool per_cpu_caches_indirect();
+  static void set_per_cpu_caches_indirect(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesIndirect(value);
+  }
+
+  // Whether a child process discards the per-cpu caches it inherits from
+  // fork(), rather than keep using (and copying) the parent's.  Enabled by
+  // TCMALLOC_PER_CPU_CACHES_RESET_AFTER_FORK=1.
+  static bool per_cpu_caches_reset_after_fork();
+  static void set_per_cpu_caches_reset_after_fork(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesResetAfterFork(value);
+  }
+
+  // Whether the spans of freed page-level allocations of up to a hugepage are
+  // cached per L3 cache, so that allocations of the same size can reuse them
+  // without taking pageheap_lock.  Enabled by TCMALLOC_LARGE_SPAN_CACHE=1.
+  static bool large_span_cache();
+  static void set_large_span_cache(bool value) {
+    TCMalloc_Internal_SetLargeSpanCache(value);
+  }
+
+  // Whether the background thread runs at idle priority, sleeps for longer
+  // while the allocator's state does not change, and defers its optional
+  // actions when it uses more than its CPU budget.  Enabled by
+  // TCMALLOC_BACKGROUND_ADAPTIVE_PACING=1.
+  static bool background_adaptive_pacing();
+  static void set_background_adaptive_pacing(bool value) {
+    TCMalloc_Internal_SetBackgroundAdaptivePacing(value);
+  }
+
+  // How many GiB of memory held by the allocator are worth one CPU of
+  // allocator time to the auto-tuner, which adjusts the cache sizes, release
+  // rate and skip-subrelease intervals in the background when this is
+  // positive.  Set by TCMALLOC_AUTO_TUNER_CPU_WEIGHT.
+  static int32_t auto_tuner_cpu_weight();
+  static void set_auto_tuner_cpu_weight(int32_t value) {
+    TCMalloc_Internal_SetAutoTunerCpuWeight(value);
+  }
+
+  // Whether the background thread moves thread cache budget towards the
+  // threads that miss the most, and away from idle ones, when per-cpu caches
+  // are not in use.  Enabled by TCMALLOC_THREAD_CACHE_ADAPTIVE_SIZING=1.
+  static bool thread_cache_adaptive_sizing();
+  static void set_thread_cache_adaptive_sizing(bool value) {
+    TCMalloc_Internal_SetThreadCacheAdaptiveSizing(value);
+  }
+
+  // When NUMA awareness is enabled, a partition whose transfer cache is empty
+  // may borrow from the other partition's transfer cache once the latter holds
+  // at least this many batches, instead of going to its own central freelist.
+  // 0 disables borrowing.  Set by TCMALLOC_NUMA_REMOTE_BORROW_BATCHES.
+  static int32_t numa_remote_borrow_batches();
+  static void set_numa_remote_borrow_batches(int32_t value) {
+    TCMalloc_Internal_SetNumaRemoteBorrowBatches(value);
+  }
+
+  // Number of objects of each batch pulled into a per-CPU cache on refill that
+  // are prefetched before being handed out, together with the freelist head of
+  // the spans they came from.  The depth is capped by the batch size of each
+  // size class.  0 disables prefetching.  Set by
+  // TCMALLOC_REFILL_PREFETCH_OBJECTS.
+  static int32_t refill_prefetch_objects();
+  static void set_refill_prefetch_objects(int32_t value) {
+    TCMalloc_Internal_SetRefillPrefetchObjects(value);
+  }
+
+  // Microseconds of MADV_COLLAPSE the background thread may spend per second
+  // collapsing hugepage trackers.  Unused budget carries over for up to one
+  // second.  0 falls back to backing off from collapse based on its latency.
+  // Set by TCMALLOC_HUGEPAGE_COLLAPSE_BUDGET_US.
+  static int32_t hugepage_collapse_budget_us();
+  static void set_hugepage_collapse_budget_us(int32_t value) {
+    TCMalloc_Internal_SetHugePageCollapseBudgetUs(value);
+  }
+
+  // One in this many calls to each allocator slow path, per thread, is timed
+  // for the slow path latency histograms.  0 disables them.  Set by
+  // TCMALLOC_SLOW_PATH_LATENCY_SAMPLE_PERIOD.
+  static int32_t slow_path_latency_sample_period();
+  static void set_slow_path_latency_sample_period(int32_t value) {
+    TCMalloc_Internal_SetSlowPathLatencySamplePeriod(value);
+  }
+
+  // Number of allocation samples per second the process aims for.  While
+  // positive, the background thread scales the sampling interval up or down
+  // from profile_sampling_interval() to keep close to it.  0 disables this.
+  // Set by TCMALLOC_PROFILE_SAMPLING_TARGET_RATE.
+  static int32_t profile_sampling_target_rate();
+  static void set_profile_sampling_target_rate(int32_t value) {
+    TCMalloc_Internal_SetProfileSamplingTargetRate(value);
+  }
+
+  // Huge allocations and HugeRegions of at least this many bytes are backed by
+  // 1 GiB hugetlbfs pages when the pool has free ones.  Such memory is never
+  // broken up or released.  0 disables gigantic pages.  Set by
+  // TCMALLOC_GIGANTIC_PAGE_THRESHOLD.
+  static int64_t gigantic_page_threshold();
+  static void set_gigantic_page_threshold(int64_t value) {
+    TCMalloc_Internal_SetGiganticPageThreshold(value);
+  }
+
+  // Allocations of at least this many bytes that take fresh hugepages from
+  // released memory queue those hugepages to be faulted in with
+  // MADV_POPULATE_WRITE by the background thread, rather than 4 KiB at a time
+  // on first touch.  0 disables eager population.  Set by
+  // TCMALLOC_EAGER_POPULATE_THRESHOLD.
+  static int64_t eager_populate_threshold();
+  static void set_eager_populate_threshold(int64_t value) {
+    TCMalloc_Internal_SetEagerPopulateThreshold(value);
+  }
+
+  // NUMA node of the far memory tier, e.g. CXL-attached memory.  The
+  // background thread moves stale filler hugepages and cold memory there, and
+  // moves hugepages back once they are accessed again.  -1 disables tiering.
+  // Set by TCMALLOC_FAR_MEMORY_NUMA_NODE.
+  static int32_t far_memory_numa_node();
+  static void set_far_memory_numa_node(int32_t value) {
+    TCMalloc_Internal_SetFarMemoryNumaNode(value);
+  }
+
+  // Percentage of the cgroup v2 memory limits at which the background thread
+  // keeps the page heap limits: the soft limit follows memory.high (or
+  // memory.max if unset) and the hard limit follows memory.max.  0 leaves the
+  // limits alone.  Set by TCMALLOC_CGROUP_MEMORY_LIMIT_PERCENT.
+  static int32_t cgroup_memory_limit_percent();
+  static void set_cgroup_memory_limit_percent(int32_t value) {
+    TCMalloc_Internal_SetCgroupMemoryLimitPercent(value);
+  }
+
+  // Maximum number of shards a contended central freelist may be split into,
+  // each owning its own spans and lock.  Size classes are sharded by the
+  // background thread once their central freelist lock shows contention.
+  // 0 or 1 disables sharding.  Set by TCMALLOC_CENTRAL_FREELIST_MAX_SHARDS.
+  static int32_t central_freelist_max_shards();
+  static void set_central_freelist_max_shards(int32_t value) {
+    TCMalloc_Internal_SetCentralFreeListMaxShards(value);
+  }
+
+  // Whether objects freed on a CPU of another NUMA node are buffered in the
+  // per-cpu cache for at most one batch before going back to their home
+  // transfer cache.  Enabled by TCMALLOC_NUMA_RETURN_REMOTE_FREES=1.
+  static bool numa_return_remote_frees();
+  static void set_numa_return_remote_frees(bool value) {
+    TCMalloc_Internal_SetNumaReturnRemoteFrees(value);
+  }
+
+  // Whether sampled allocations train a per-call-site lifetime predictor
+  // whose verdicts steer central freelist span placement.  Enabled by
+  // TCMALLOC_SPAN_LIFETIME_PREDICTION=1.
+  static bool span_lifetime_prediction();
+  static void set_span_lifetime_prediction(bool value) {
+    TCMalloc_Internal_SetSpanLifetimePrediction(value);
+  }
+
+  // Whether hot/cold hints from call sites whose memory is observed, through
+  // page staleness, to be accessed against their hint are overridden.
+  // Enabled by TCMALLOC_ACCESS_HINT_RECLASSIFICATION=1.
+  static bool access_hint_reclassification();
+  static void set_access_hint_reclassification(bool value) {
+    TCMalloc_Internal_SetAccessHintReclassification(value);
+  }
+
+  // Whether the background thread scales its release rate and the
+  // skip-subrelease intervals with the memory pressure reported by Linux PSI
+  // and cgroup memory.events.  Enabled by TCMALLOC_MEMORY_PRESSURE_RELEASE=1.
+  static bool memory_pressure_release();
+  static void set_memory_pressure_release(bool value) {
+    TCMalloc_Internal_SetMemoryPressureRelease(value);
+  }
+
+  // Whether the background thread keeps a ring of the estimated allocation
+  // and deallocation traffic per size class over the last hour, for
+  // MallocExtension::GetAllocationRateHistory.  Enabled by
+  // TCMALLOC_ALLOCATION_RATE_HISTORY=1.
+  static bool allocation_rate_history();
+  static void set_allocation_rate_history(bool value) {
+    TCMalloc_Internal_SetAllocationRateHistory(value);
+  }
+
+  // Length of the time buckets for which the peak heap tracker keeps the
+  // largest peaks, for MallocExtension::SnapshotPeakHeaps.  Zero (the default)
+  // disables bucketing.  Set by TCMALLOC_PEAK_HEAP_BUCKET_SECONDS.
+  static absl::Duration peak_heap_bucket_interval();
+  static void set_peak_heap_bucket_interval(absl::Duration value) {
+    TCMalloc_Internal_SetPeakHeapBucketInterval(value);
+  }
+
+  // How long the stale bits of a MemoryTag::kCold filler hugepage must stay
+  // set before it is handed to the kernel to reclaim, with MADV_PAGEOUT under
+  // high memory pressure and MADV_COLD otherwise.  Set by
+  // TCMALLOC_COLD_PAGE_OUT_IDLE_TIME_SECONDS; zero, the default, disables it.
+  static absl::Duration cold_page_out_idle_time();
+  static void set_cold_page_out_idle_time(absl::Duration value) {
+    TCMalloc_Internal_SetColdPageOutIdleTime(value);
+  }
+
+  // How long a sampled object must have been live to be reported by
+  // ProfileType::kLeakCandidates profiles.  Set by
+  // TCMALLOC_LEAK_CANDIDATE_MIN_AGE_SECONDS; defaults to 5 minutes.
+  static absl::Duration leak_candidate_min_age();
+  static void set_leak_candidate_min_age(absl::Duration value) {
+    TCMalloc_Internal_SetLeakCandidateMinAge(value);
+  }
+
+  // How long the slow path of an allocation must take for it to be reported
+  // by ProfileType::kSlowAllocations profiles.  Set by
+  // TCMALLOC_SLOW_ALLOCATION_THRESHOLD_US; 0, the default, disables them.
+  static absl::Duration slow_allocation_threshold();
+  static void set_slow_allocation_threshold(absl::Duration value) {
+    TCMalloc_Internal_SetSlowAllocationThreshold(value);
+  }
+
+  // How often the background thread samples which size classes' objects go
+  // unaccessed, see AccessHeatmap.  Zero, the default, disables it.  Set by
+  // TCMALLOC_ACCESS_HEATMAP_INTERVAL_SECONDS.
+  static absl::Duration access_heatmap_interval();
+  static void set_access_heatmap_interval(absl::Duration value) {
+    TCMalloc_Internal_SetAccessHeatmapInterval(value);
+  }
+
+  // Whether sampled allocations capture their stack by walking the frame
+  // pointer chain rather than with absl::GetStackTrace.  This is much cheaper,
+  // but only yields complete stacks in binaries built with
+  // -fno-omit-frame-pointer.  Enabled by TCMALLOC_FRAME_POINTER_UNWINDING=1.
+  static bool frame_pointer_unwinding();
+  static void set_frame_pointer_unwinding(bool value) {
+    TCMalloc_Internal_SetFramePointerUnwinding(value);
+  }
+
+  // Whether each hugepage of PageMap leaves is faulted in with
+  // MADV_POPULATE_WRITE as soon as it is allocated, rather than a page at a
+  // time as leaves are first used.  Enabled by
+  // TCMALLOC_PREFAULT_PAGEMAP_LEAVES=1.
+  static bool prefault_pagemap_leaves();
+  static void set_prefault_pagemap_leaves(bool value) {
+    TCMalloc_Internal_SetPrefaultPagemapLeaves(value);
+  }
+
+  // Whether central freelists keep a few spans that became empty, rather than
+  // returning them to the page heap at once, so that a size class whose
+  // objects are repeatedly all freed and reallocated does not take
+  // pageheap_lock each time.  The background thread returns the spans that
+  // stay unused.  Enabled by TCMALLOC_CENTRAL_FREELIST_EMPTY_SPANS=1.
+  static bool central_freelist_empty_spans();
+  static void set_central_freelist_empty_spans(bool value) {
+    TCMalloc_Internal_SetCentralFreelistEmptySpans(value);
+  }
+
+  // Whether the background thread periodically estimates, per size class,
+  // how many spans meshing could free, see mesh_estimator.h.  The estimate
+  // walks the freelists of sparse spans under the central freelist lock.
+  // Enabled by TCMALLOC_SPAN_MESH_ESTIMATION=1.
+  static bool span_mesh_estimation();
+  static void set_span_mesh_estimation(bool value) {
+    TCMalloc_Internal_SetSpanMeshEstimation(value);
+  }
+
+  // Whether the background thread lets rarely used size classes borrow
+  // objects from the spans of the next larger class, rather than holding a
+  // mostly empty span each, see CentralFreeList::UpdateSpanSharing.
+  // Enabled by TCMALLOC_CENTRAL_FREELIST_SPAN_SHARING=1.
+  static bool central_freelist_span_sharing();
+  static void set_central_freelist_span_sharing(bool value) {
+    TCMalloc_Internal_SetCentralFreelistSpanSharing(value);
+  }
+
+  // Whether the background thread adapts the length of the spans of each size
+  // class, up to SizeMap's, to its refill rate and span occupancy, see
+  // CentralFreeList::AdaptSpanLength.  Enabled by
+  // TCMALLOC_CENTRAL_FREELIST_ADAPTIVE_SPAN_LENGTH=1.
+  static bool central_freelist_adaptive_span_length();
+  static void set_central_freelist_adaptive_span_length(bool value) {
+    TCMalloc_Internal_SetCentralFreelistAdaptiveSpanLength(value);
+  }
+
+  // Whether allocations of at least a hugepage always get whole, hugepage
+  // aligned hugepages from the HugeAllocator, rather than a region, so that
+  // they can be entirely backed by THPs.  Enabled by
+  // TCMALLOC_HUGEPAGE_ALIGNED_LARGE_ALLOCATIONS=1.
+  static bool hugepage_aligned_large_allocations();
+  static void set_hugepage_aligned_large_allocations(bool value) {
+    TCMalloc_Internal_SetHugepageAlignedLargeAllocations(value);
+  }
+
+  // Whether runs are made reproducible for benchmarking: sampling points are
+  // spaced exactly one interval apart, random seeds are fixed, and the
+  // background actions follow a clock that advances by one sleep interval per
+  // step rather than the wall clock.  Enabled by TCMALLOC_DETERMINISTIC=1,
+  // which also fixes the seed of the address space layout.
+  static bool deterministic();
+  static void set_deterministic(bool value) {
+    TCMalloc_Internal_SetDeterministic(value);
+  }
+
+  // Whether the soft memory limit is enforced in tiers: when releasing free
+  // pages does not get below it, the background thread first drains the
+  // per-CPU and transfer caches, so that the spans their objects pin can
+  // empty, and only then breaks up hugepages.  Until then the heap may stay
+  // over the limit for a background interval.  The hard limit is always
+  // enforced right away.
+  static bool limit_shrinks_caches();
+  static void set_limit_shrinks_caches(bool value) {
+    TCMalloc_Internal_SetLimitShrinksCaches(value);
+  }
 
   static HeapPartitioningMode heap_partitioning_mode();
 
+  // Number of the smallest size classes whose spans are placed in their own
+  // address regions, so that free() can recover their size class from the
+  // pointer without a PageMap lookup.  Each of them gets its own page heap.
+  // Fixed at startup by TCMALLOC_SIZE_CLASS_REGIONS; at most
+  // kMaxSizeClassRegions - 1.
+  static int32_t size_class_regions();
+
+  // Whether sampled objects, other than guarded ones, are given a random Arm
+  // MTE tag, so that accesses past their end or after they are freed fault.
+  // Fixed at startup by TCMALLOC_MTE_SAMPLED=1, and only takes effect where
+  // the CPU and kernel support MTE.
+  static bool mte_sampled();
+
   static central_freelist_internal::LifetimeTracking span_lifetime_tracking();
 
  private:
@@ -205,6 +609,7 @@ class Parameters {
   friend void ::TCMalloc_Internal_SetReleasePagesFromHugeRegionEnabled(bool v);
   friend void ::TCMalloc_Internal_SetResizeSizeClassMaxCapacityEnabled(bool v);
   friend void ::TCMalloc_Internal_SetMaxPerCpuCacheSize(int32_t v);
+  friend void ::TCMalloc_Internal_SetMaxPerCpuColdCacheSize(int32_t v);
   friend void ::TCMalloc_Internal_SetMaxTotalThreadCacheBytes(int64_t v);
   friend void ::TCMalloc_Internal_SetPeakSamplingHeapGrowthFraction(double v);
   friend void ::TCMalloc_Internal_SetPerCpuCachesEnabled(bool v);
@@ -217,6 +622,10 @@ class Parameters {
   friend void ::TCMalloc_Internal_SetHugePageFillerSkipSubreleaseLongInterval(
       absl::Duration v);
   friend void ::TCMalloc_Internal_SetPerCpuCachesDynamicSlabEnabled(bool v);
+  friend void ::TCMalloc_Internal_SetPerCpuCachesDynamicSlabGrowThreshold(
+      double v);
+  friend void ::TCMalloc_Internal_SetPerCpuCachesDynamicSlabShrinkThreshold(
+      double v);
 
   friend void TCMalloc_Internal_SetLifetimeAllocatorOptions(
       absl::string_view s);
@@ -16,12 +16,16 @@
 
 #include <stdio.h>
 
+#include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include "absl/base/internal/spinlock.h"
 #include "absl/memory/memory.h"
 #include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -42,7 +46,18 @@ bool PeakHeapTracker::IsNewPeak() {
 }
 
 void PeakHeapTracker::MaybeSaveSample() {
-  if (Parameters::peak_sampling_heap_growth_fraction() <= 0 || !IsNewPeak()) {
+  const double growth_fraction = Parameters::peak_sampling_heap_growth_fraction();
+  if (growth_fraction <= 0) {
+    return;
+  }
+  const absl::Duration interval = Parameters::peak_heap_bucket_interval();
+  if (interval > absl::ZeroDuration()) {
+    AllocationGuardSpinLockHolder h(recorder_lock_);
+    MaybeSaveBucketedSample(interval, absl::Now(),
+                            tc_globals.sampled_objects_size_.value(),
+                            growth_fraction);
+  }
+  if (!IsNewPeak()) {
     return;
   }
 
@@ -58,12 +73,70 @@ void PeakHeapTracker::MaybeSaveSample() {
 
   // Guaranteed to have no live sample after this call since we are doing this
   // under `recorder_lock_`.
+  peak_heap_recorder_.Iterate([](const SampledAllocation& peak_heap_record) {
+    tc_globals.stack_depot().Unref(peak_heap_record.stack_id);
+  });
   peak_heap_recorder_.UnregisterAll();
   tc_globals.sampled_allocation_recorder().Iterate(
       [this](const SampledAllocation& sampled_allocation) {
         recorder_lock_.AssertHeld();
-        StackTrace st = sampled_allocation.sampled_stack;
-        peak_heap_recorder_.Register(std::move(st));
+        tc_globals.stack_depot().Ref(sampled_allocation.stack_id);
+        peak_heap_recorder_.Register(sampled_allocation.sampled_stack,
+                                     sampled_allocation.stack_id);
+      });
+}
+
+void PeakHeapTracker::MaybeSaveBucketedSample(absl::Duration interval,
+                                              absl::Time now, int64_t size,
+                                              double growth_fraction) {
+  const int64_t index = absl::ToUnixNanos(now) /
+                        absl::ToInt64Nanoseconds(interval);
+  const absl::Time start = absl::UnixEpoch() + index * interval;
+  Bucket& bucket = buckets_[index % kNumBuckets];
+  if (bucket.start != start) {
+    for (BucketedPeak& peak : bucket.peaks) {
+      StackTraceTable::Recycle(&peak.samples, &spare_samples_);
+      peak.size = 0;
+    }
+    bucket.start = start;
+    bucket.open = -1;
+  }
+
+  if (bucket.open >= 0) {
+    BucketedPeak& open = bucket.peaks[bucket.open];
+    if (size > open.size * growth_fraction) {
+      SaveBucketedPeak(open, now, size);
+    } else if (size * growth_fraction < open.size) {
+      bucket.open = -1;
+    }
+    return;
+  }
+
+  // Start a new peak if it can displace the smallest one kept.
+  int smallest = 0;
+  for (int i = 1; i < kPeaksPerBucket; ++i) {
+    if (bucket.peaks[i].size < bucket.peaks[smallest].size) smallest = i;
+  }
+  if (bucket.peaks[smallest].size != 0 && size <= bucket.peaks[smallest].size) {
+    return;
+  }
+  SaveBucketedPeak(bucket.peaks[smallest], now, size);
+  bucket.open = smallest;
+}
+
+void PeakHeapTracker::SaveBucketedPeak(BucketedPeak& peak, absl::Time now,
+                                       int64_t size) {
+  StackTraceTable::Recycle(&peak.samples, &spare_samples_);
+  peak.size = size;
+  peak.time = now;
+  tc_globals.sampled_allocation_recorder().Iterate(
+      [&](const SampledAllocation& sampled_allocation) {
+        recorder_lock_.AssertHeld();
+        StackTraceTable::AddTrace(
+            1.0,
+            tc_globals.stack_depot().Restore(sampled_allocation.sampled_stack,
+                                             sampled_allocation.stack_id),
+            &peak.samples, &spare_samples_);
       });
 }
 
@@ -74,11 +147,59 @@ std::unique_ptr<ProfileBase> PeakHeapTracker::DumpSample() {
   profile->SetStartTime(last_peak_);
   peak_heap_recorder_.Iterate(
       [&profile](const SampledAllocation& peak_heap_record) {
-        profile->AddTrace(1.0, peak_heap_record.sampled_stack);
+        profile->AddTrace(1.0, tc_globals.stack_depot().Restore(
+                                   peak_heap_record.sampled_stack,
+                                   peak_heap_record.stack_id));
       });
   return profile;
 }
 
+std::vector<std::unique_ptr<ProfileBase>> PeakHeapTracker::DumpBucketedSamples(
+    absl::Time start, absl::Time end) {
+  // Copy the peaks out under the lock, but build the profiles outside of it:
+  // they allocate, and a sampled allocation would need the lock.
+  struct Found {
+    int64_t size;
+    absl::Time time;
+    std::unique_ptr<StackTraceTable> profile;
+  };
+  std::vector<Found> found;
+  found.reserve(kNumBuckets * kPeaksPerBucket);
+  for (int i = 0; i < kNumBuckets * kPeaksPerBucket; ++i) {
+    found.push_back(
+        {0, absl::InfinitePast(),
+         std::make_unique<StackTraceTable>(ProfileType::kPeakHeap)});
+  }
+
+  size_t n = 0;
+  {
+    AllocationGuardSpinLockHolder h(recorder_lock_);
+    for (const Bucket& bucket : buckets_) {
+      for (const BucketedPeak& peak : bucket.peaks) {
+        if (peak.size == 0 || peak.time < start || peak.time >= end) continue;
+        Found& f = found[n++];
+        f.size = peak.size;
+        f.time = peak.time;
+        f.profile->SetStartTime(peak.time);
+        for (auto* s = peak.samples; s != nullptr; s = s->next) {
+          f.profile->AddSample(s->sample);
+        }
+      }
+    }
+  }
+  found.resize(n);
+  std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) {
+    return a.size != b.size ? a.size > b.size : a.time < b.time;
+  });
+
+  std::vector<std::unique_ptr<ProfileBase>> profiles;
+  profiles.reserve(found.size());
+  for (Found& f : found) {
+    profiles.push_back(std::move(f.profile));
+  }
+  return profiles;
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
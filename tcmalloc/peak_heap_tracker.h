@@ -19,10 +19,12 @@
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 #include "absl/base/const_init.h"
 #include "absl/base/internal/spinlock.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/time/time.h"
 #include "tcmalloc/arena.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/config.h"
@@ -30,6 +32,7 @@
 #include "tcmalloc/internal/sampled_allocation_recorder.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/metadata_object_allocator.h"
+#include "tcmalloc/stack_trace_table.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
@@ -52,6 +55,12 @@ class PeakHeapTracker {
   // Return the saved high-water-mark heap profile, if any.
   std::unique_ptr<ProfileBase> DumpSample() ABSL_LOCKS_EXCLUDED(recorder_lock_);
 
+  // Returns the peaks saved in time buckets (see
+  // Parameters::peak_heap_bucket_interval) that were reached in [start, end),
+  // largest first, as kPeakHeap profiles starting at the time of the peak.
+  std::vector<std::unique_ptr<ProfileBase>> DumpBucketedSamples(
+      absl::Time start, absl::Time end) ABSL_LOCKS_EXCLUDED(recorder_lock_);
+
   size_t CurrentPeakSize() const {
     return do_not_access_directly_peak_sampled_heap_size_.load(
         std::memory_order_relaxed);
@@ -82,6 +91,41 @@ class PeakHeapTracker {
   PeakHeapRecorder peak_heap_recorder_ ABSL_GUARDED_BY(recorder_lock_);
 
   bool IsNewPeak();
+
+  // Number of time buckets kept, and of peaks kept per bucket.
+  static constexpr int kNumBuckets = 24;
+  static constexpr int kPeaksPerBucket = 4;
+
+  struct BucketedPeak {
+    // Sampled heap size when the samples were saved, 0 if the peak is unused.
+    int64_t size = 0;
+    absl::Time time;
+    StackTraceTable::LinkedSample* samples = nullptr;
+  };
+
+  struct Bucket {
+    absl::Time start = absl::InfinitePast();
+    BucketedPeak peaks[kPeaksPerBucket];
+    // The peak the heap is still growing towards, or -1.  It is saved again
+    // whenever the heap grows by the growth fraction, and is closed once the
+    // heap shrinks by the same fraction, so that one climb yields one peak.
+    int open = -1;
+  };
+
+  // Saves the sampled heap into the bucket of `now` if it is one of the
+  // bucket's largest peaks.
+  void MaybeSaveBucketedSample(absl::Duration interval, absl::Time now,
+                               int64_t size, double growth_fraction)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(recorder_lock_);
+  void SaveBucketedPeak(BucketedPeak& peak, absl::Time now, int64_t size)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(recorder_lock_);
+
+  Bucket buckets_[kNumBuckets] ABSL_GUARDED_BY(recorder_lock_);
+  // Samples of dropped peaks, reused for the next peak saved.  A heap with a
+  // steady number of live samples thus stops allocating once every peak is in
+  // use.
+  StackTraceTable::LinkedSample* spare_samples_ ABSL_GUARDED_BY(
+      recorder_lock_) = nullptr;
 };
 
 }  // namespace tcmalloc_internal
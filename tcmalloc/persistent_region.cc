@@ -0,0 +1,176 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/persistent_region.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include "absl/base/attributes.h"
+#include "absl/base/internal/spinlock.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/util.h"
+#include "tcmalloc/mapped_region.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+ABSL_CONST_INIT MappedRegionCounters counters;
+// Bytes of the objects allocated from attached regions.
+ABSL_CONST_INIT StatsCounter in_use_bytes;
+
+}  // namespace
+
+PersistentRegionHeader::AttachResult PersistentRegionHeader::Attach(
+    const char* path, void* address, size_t size,
+    PersistentRegionHeader** header) {
+  const uintptr_t base = reinterpret_cast<uintptr_t>(address);
+  if (base % kMaxAlignment != 0 || size % kMaxAlignment != 0 ||
+      size < sizeof(PersistentRegionHeader)) {
+    return AttachResult::kFailed;
+  }
+
+  const int fd = signal_safe_open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) return AttachResult::kFailed;
+  // Another process may be attached to the same file.
+  if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+    signal_safe_close(fd);
+    return AttachResult::kFailed;
+  }
+  void* result = MapRegionAt(fd, address, size);
+  if (result == nullptr) {
+    signal_safe_close(fd);
+    return AttachResult::kFailed;
+  }
+
+  auto* h = static_cast<PersistentRegionHeader*>(result);
+  AttachResult attach_result;
+  if (h->Matches(base, size)) {
+    h->ResetLock();
+    attach_result = AttachResult::kReattached;
+  } else {
+    h->Format(base, size);
+    attach_result = AttachResult::kCreated;
+  }
+  h->fd_ = fd;
+  // Until Detach(), a crash leaves the region to be reinitialized.
+  h->clean_ = 0;
+  msync(h, sizeof(*h), MS_SYNC);
+
+  counters.Attached(size);
+  {
+    AllocationGuardSpinLockHolder l(h->allocator_.lock());
+    in_use_bytes.Add(h->allocator_.in_use_bytes());
+  }
+  *header = h;
+  return attach_result;
+}
+
+bool PersistentRegionHeader::Matches(uintptr_t base, size_t size) const {
+  return magic_ == kMagic && version_ == kVersion && clean_ == 1 &&
+         allocator_.base() == base && allocator_.size() == size;
+}
+
+void PersistentRegionHeader::ResetLock() {
+  new (&allocator_.lock())
+      absl::base_internal::SpinLock(absl::base_internal::SCHEDULE_KERNEL_ONLY);
+}
+
+void PersistentRegionHeader::Format(uintptr_t base, size_t size) {
+  magic_ = kMagic;
+  version_ = kVersion;
+  ResetLock();
+  allocator_.Init(base, size, sizeof(*this));
+  AllocationGuardSpinLockHolder l(allocator_.lock());
+  root_ = 0;
+}
+
+void* PersistentRegionHeader::Allocate(size_t size, size_t alignment) {
+  void* ptr = allocator_.Allocate(size, alignment);
+  if (ptr != nullptr) {
+    in_use_bytes.Add(Allocator::ObjectSize(size, alignment));
+  }
+  return ptr;
+}
+
+void PersistentRegionHeader::Deallocate(void* ptr, size_t size,
+                                        size_t alignment) {
+  allocator_.Deallocate(ptr, size, alignment);
+  in_use_bytes.Add(
+      -static_cast<int64_t>(Allocator::ObjectSize(size, alignment)));
+}
+
+void* PersistentRegionHeader::root() const {
+  AllocationGuardSpinLockHolder l(allocator_.lock());
+  return root_ == 0 ? nullptr
+                    : reinterpret_cast<void*>(allocator_.ToAddress(root_));
+}
+
+void PersistentRegionHeader::set_root(void* root) {
+  AllocationGuardSpinLockHolder l(allocator_.lock());
+  root_ = root == nullptr ? 0 : allocator_.ToOffset(root);
+}
+
+void PersistentRegionHeader::Detach() {
+  const size_t size = allocator_.size();
+  const int fd = fd_;
+  {
+    AllocationGuardSpinLockHolder l(allocator_.lock());
+    in_use_bytes.Add(-static_cast<int64_t>(allocator_.in_use_bytes()));
+  }
+  // Write back the objects before marking the header clean, so that a crash
+  // in between leaves the region to be reinitialized rather than torn.
+  msync(this, size, MS_SYNC);
+  clean_ = 1;
+  msync(this, sizeof(*this), MS_SYNC);
+  munmap(this, size);
+  // Closing the file drops the flock().
+  signal_safe_close(fd);
+  counters.Detached(size);
+}
+
+PersistentRegionStats GetPersistentRegionStats() {
+  return {
+      .attached_regions = counters.attached_regions(),
+      .mapped_bytes = counters.mapped_bytes(),
+      .in_use_bytes = in_use_bytes.value(),
+  };
+}
+
+void PrintPersistentRegionStats(Printer& out) {
+  static constexpr double MiB = 1048576.0;
+  counters.Print(out, "persistent");
+  const int64_t in_use = in_use_bytes.value();
+  out.printf("MALLOC: %12d (%7.1f MiB) Bytes in use in persistent regions\n",
+             in_use, in_use / MiB);
+}
+
+void PrintPersistentRegionStatsInPbtxt(PbtxtRegion& region) {
+  counters.PrintInPbtxt(region);
+  region.PrintI64("in_use_bytes", in_use_bytes.value());
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,123 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_PERSISTENT_REGION_H_
+#define TCMALLOC_PERSISTENT_REGION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/thread_annotations.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/mapped_region.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Backs tcmalloc::PersistentRegion.  A file is mapped shared at a fixed
+// address, and objects are allocated from it so that a later process mapping
+// the same file at the same address finds them where they were, pointers
+// between them included.
+//
+// The mapping starts with this header, followed by the objects.  All of the
+// allocator's state lives in the header, so there is nothing to rebuild on
+// attach.  Objects are kept in OffsetFreeLists.
+//
+// The file is locked with flock() while attached, so that only one process
+// maps it at a time.  A region that was not detached cleanly (the process
+// crashed) may be inconsistent and is reinitialized on the next attach.
+class PersistentRegionHeader {
+ public:
+  enum class AttachResult { kFailed, kCreated, kReattached };
+
+  // Maps `size` bytes of the file at `path` at `address`, creating or growing
+  // the file as needed, and returns the header in *header.
+  //
+  // REQUIRES: address and size are multiples of the page size.
+  static AttachResult Attach(const char* path, void* address, size_t size,
+                             PersistentRegionHeader** header);
+
+  PersistentRegionHeader(const PersistentRegionHeader&) = delete;
+  PersistentRegionHeader& operator=(const PersistentRegionHeader&) = delete;
+
+  using Allocator = OffsetFreeLists<absl::base_internal::SpinLock>;
+
+  static constexpr size_t kMaxAlignment = Allocator::kMaxAlignment;
+
+  // Returns `size` bytes aligned to `alignment`, or nullptr if the region is
+  // full.
+  //
+  // REQUIRES: alignment is a power of two no larger than kMaxAlignment
+  void* Allocate(size_t size, size_t alignment);
+
+  // Returns an object to the region.  size and alignment must be those it was
+  // allocated with.
+  void Deallocate(void* ptr, size_t size, size_t alignment);
+
+  // An object that the application can find again after reattaching, or
+  // nullptr.
+  void* root() const ABSL_LOCKS_EXCLUDED(allocator_.lock());
+  void set_root(void* root) ABSL_LOCKS_EXCLUDED(allocator_.lock());
+
+  // Flushes the region to its file and unmaps it.  The header must not be
+  // used afterwards.
+  void Detach() ABSL_LOCKS_EXCLUDED(allocator_.lock());
+
+ private:
+  static constexpr uint64_t kMagic = 0x7463'6d70'7265'6731;  // "tcmpreg1"
+  // Version 2 moved the allocator's state into OffsetFreeLists.
+  static constexpr uint32_t kVersion = 2;
+
+  PersistentRegionHeader() = default;
+
+  // Reinitializes a header whose mapping holds no valid region.
+  void Format(uintptr_t base, size_t size);
+  bool Matches(uintptr_t base, size_t size) const;
+  // The lock left in the file belongs to the last process that attached it.
+  void ResetLock();
+
+  // Persistent state.  Offsets are from the start of the mapping, and 0 means
+  // none.
+  uint64_t magic_;
+  uint32_t version_;
+  // Cleared while attached, set by Detach().
+  uint32_t clean_;
+  Allocator allocator_;
+  uint64_t root_ ABSL_GUARDED_BY(allocator_.lock());
+
+  // State of the attaching process, reset on every attach.
+  int fd_;
+};
+
+struct PersistentRegionStats {
+  int64_t attached_regions;
+  // Bytes mapped by attached regions.
+  int64_t mapped_bytes;
+  // Bytes of the objects allocated from attached regions, rounded up to their
+  // free list sizes.
+  int64_t in_use_bytes;
+};
+
+PersistentRegionStats GetPersistentRegionStats();
+void PrintPersistentRegionStats(Printer& out);
+void PrintPersistentRegionStatsInPbtxt(PbtxtRegion& region);
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_PERSISTENT_REGION_H_
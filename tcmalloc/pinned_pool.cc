@@ -0,0 +1,202 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "tcmalloc/pinned_pool.h"
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+#include <new>
+#include <optional>
+
+#include "absl/base/internal/spinlock.h"
+#include "absl/strings/string_view.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/huge_region.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/internal/system_allocator.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+void PinnedPool::SetAnonVmaName::operator()(
+    Range r, std::optional<absl::string_view>) {
+  tc_globals.system_allocator().SetAnonVmaName(r.start_addr(), r.in_bytes(),
+                                               "tcmalloc_pinned_pool");
+}
+
+void* PinnedPool::Allocate(size_t size) {
+  if (size == 0 || size > HugeRegion::size().in_bytes()) return nullptr;
+  const Length n = BytesToLengthCeil(size);
+
+  absl::base_internal::SpinLockHolder h(&lock_);
+  PageId p;
+  Region* region = Get(n, &p);
+  if (region == nullptr) {
+    ++failed_allocations_;
+    return nullptr;
+  }
+  if (!Pin(*region, Range(p, n))) {
+    region->region->Put(Range(p, n), /*release=*/false);
+    ++failed_allocations_;
+    return nullptr;
+  }
+  used_ += n;
+  ++allocations_;
+  return p.start_addr();
+}
+
+void PinnedPool::Deallocate(void* ptr, size_t size) {
+  const Range r(PageIdContaining(ptr), BytesToLengthCeil(size));
+  absl::base_internal::SpinLockHolder h(&lock_);
+  for (size_t i = 0; i < num_regions_; ++i) {
+    if (regions_[i].region->contains(r.p)) {
+      regions_[i].region->Put(r, /*release=*/false);
+      used_ -= r.n;
+      return;
+    }
+  }
+  TC_BUG("%p was not allocated from the pinned pool", ptr);
+}
+
+void PinnedPool::SetCallback(MallocExtension::PinnedMemoryCallback callback,
+                             void* arg) {
+  absl::base_internal::SpinLockHolder h(&lock_);
+  callback_ = callback;
+  callback_arg_ = arg;
+  // Tell the new callback of every run of pinned hugepages.
+  for (size_t i = 0; i < num_regions_; ++i) {
+    const Region& region = regions_[i];
+    size_t start = region.pinned.FindSet(0);
+    while (start < HugeRegion::kNumHugePages) {
+      const size_t end = region.pinned.FindClear(start);
+      Notify(region.start + NHugePages(start), NHugePages(end - start));
+      start = end < HugeRegion::kNumHugePages ? region.pinned.FindSet(end)
+                                              : end;
+    }
+  }
+}
+
+PinnedPool::Region* PinnedPool::Get(Length n, PageId* p) {
+  bool from_released;
+  for (size_t i = 0; i < num_regions_; ++i) {
+    if (regions_[i].region->MaybeGet(n, p, &from_released)) {
+      return &regions_[i];
+    }
+  }
+  if (!AddRegion()) return nullptr;
+  Region& region = regions_[num_regions_ - 1];
+  TC_CHECK(region.region->MaybeGet(n, p, &from_released));
+  return &region;
+}
+
+bool PinnedPool::AddRegion() {
+  if (num_regions_ == kMaxRegions) return false;
+  // Pinned memory is kept out of the heap's address ranges, as it is never
+  // freed with free().  The tag space has no spare non-normal tag, so it
+  // shares kMetadata with TCMalloc's own metadata.
+  auto [ptr, bytes] = tc_globals.system_allocator().Allocate(
+      HugeRegion::size().in_bytes(), kHugePageSize, MemoryTag::kMetadata);
+  if (ptr == nullptr) return false;
+  TC_ASSERT_GE(bytes, HugeRegion::size().in_bytes());
+
+  Region& region = regions_[num_regions_];
+  region.start = HugePageContaining(ptr);
+  void* storage = tc_globals.arena().Alloc(
+      sizeof(HugeRegion), static_cast<std::align_val_t>(alignof(HugeRegion)));
+  region.region =
+      new (storage) HugeRegion(HugeRange(region.start, HugeRegion::size()),
+                               unback_, set_anon_vma_name_,
+                               /*known_zero=*/true);
+  ++num_regions_;
+  return true;
+}
+
+bool PinnedPool::Pin(Region& region, Range r) {
+  const HugePage first = HugePageContaining(r.p);
+  const HugePage last = HugePageContaining(r.p + r.n - Length(1));
+  // The run of hugepages pinned by this call, not yet notified.
+  HugePage run = first;
+  HugeLength run_len = NHugePages(0);
+  bool ok = true;
+  for (HugePage hp = first; hp <= last; ++hp) {
+    const size_t i = (hp - region.start).raw_num();
+    if (region.pinned.GetBit(i)) {
+      if (run_len > NHugePages(0)) Notify(run, run_len);
+      run_len = NHugePages(0);
+      continue;
+    }
+    // Back it with a hugepage if possible, before mlock() faults it in.
+    madvise(hp.start_addr(), kHugePageSize, MADV_HUGEPAGE);
+    if (mlock(hp.start_addr(), kHugePageSize) != 0) {
+      ++pin_failures_;
+      ok = false;
+      break;
+    }
+    region.pinned.SetBit(i);
+    ++pinned_;
+    if (run_len == NHugePages(0)) run = hp;
+    ++run_len;
+  }
+  if (run_len > NHugePages(0)) Notify(run, run_len);
+  return ok;
+}
+
+void PinnedPool::Notify(HugePage first, HugeLength n) {
+  if (callback_ == nullptr) return;
+  callback_(callback_arg_, first.start_addr(), n.in_bytes());
+}
+
+PinnedPool::Stats PinnedPool::stats() const {
+  absl::base_internal::SpinLockHolder h(&lock_);
+  Stats s;
+  s.regions = num_regions_;
+  s.pinned_bytes = pinned_.in_bytes();
+  s.used_bytes = used_.in_bytes();
+  s.allocations = allocations_;
+  s.failed_allocations = failed_allocations_;
+  s.pin_failures = pin_failures_;
+  return s;
+}
+
+void PinnedPool::Print(Printer& out) const {
+  const Stats s = stats();
+  out.printf(
+      "MALLOC PINNED POOL: %zu regions, %zu bytes pinned, %zu bytes used, "
+      "%zu allocations, %zu failed, %zu mlock failures\n",
+      s.regions, s.pinned_bytes, s.used_bytes, s.allocations,
+      s.failed_allocations, s.pin_failures);
+}
+
+void PinnedPool::PrintInPbtxt(PbtxtRegion& region) const {
+  const Stats s = stats();
+  region.PrintI64("regions", s.regions);
+  region.PrintI64("pinned_bytes", s.pinned_bytes);
+  region.PrintI64("used_bytes", s.used_bytes);
+  region.PrintI64("allocations", s.allocations);
+  region.PrintI64("failed_allocations", s.failed_allocations);
+  region.PrintI64("pin_failures", s.pin_failures);
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
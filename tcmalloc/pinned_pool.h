@@ -0,0 +1,157 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef TCMALLOC_PINNED_POOL_H_
+#define TCMALLOC_PINNED_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <optional>
+
+#include "absl/base/attributes.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/string_view.h"
+#include "tcmalloc/huge_cache.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/huge_region.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/range_tracker.h"
+#include "tcmalloc/internal/system_allocator.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/pages.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// A pool of mlock()ed memory for I/O buffers registered with io_uring or RDMA
+// NICs, served by MallocExtension::AllocatePinned().
+//
+// The pool carves buffers out of HugeRegions, each reserving 1 GiB of address
+// space.  A hugepage is pinned, with MADV_HUGEPAGE and mlock(), the first time
+// a buffer covers it, and is never released, so that its registration stays
+// valid.  The callback set with SetCallback() is told of each run of hugepages
+// pinned, before any buffer in it is handed out.
+//
+// Buffers are whole TCMalloc pages.  The pool has its own lock, and none of
+// it is reachable from malloc() or free().
+class PinnedPool {
+ public:
+  // The pool stops growing at kMaxRegions regions.
+  static constexpr size_t kMaxRegions = 16;
+
+  constexpr PinnedPool()
+      : lock_(absl::base_internal::SCHEDULE_KERNEL_ONLY) {}
+  PinnedPool(const PinnedPool&) = delete;
+  PinnedPool& operator=(const PinnedPool&) = delete;
+
+  // Returns size bytes of pinned memory, aligned to kPageSize, or nullptr if
+  // size is 0 or larger than a HugeRegion, if the pool is full, or if mlock()
+  // failed.
+  void* Allocate(size_t size) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns a buffer from Allocate(size) to the pool.  Its hugepages stay
+  // pinned.
+  void Deallocate(void* ptr, size_t size) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Sets the callback, which is first told of the hugepages pinned so far.  A
+  // null callback unsets it.
+  void SetCallback(MallocExtension::PinnedMemoryCallback callback, void* arg)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  struct Stats {
+    size_t regions = 0;
+    size_t pinned_bytes = 0;
+    size_t used_bytes = 0;
+    size_t allocations = 0;
+    size_t failed_allocations = 0;
+    size_t pin_failures = 0;
+  };
+  Stats stats() const ABSL_LOCKS_EXCLUDED(lock_);
+
+  void Print(Printer& out) const ABSL_LOCKS_EXCLUDED(lock_);
+  void PrintInPbtxt(PbtxtRegion& region) const ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  // Pinned memory is never released, so the regions never unback it.
+  class NoUnback final : public MemoryModifyFunction {
+   public:
+    constexpr NoUnback() = default;
+    ~NoUnback() override = default;
+
+    static void operator delete(void*) { __builtin_trap(); }
+
+    [[nodiscard]] MemoryModifyStatus operator()(Range) override {
+      return {.success = false, .error_number = 0};
+    }
+  };
+
+  class SetAnonVmaName final : public MemoryTagFunction {
+   public:
+    constexpr SetAnonVmaName() = default;
+    ~SetAnonVmaName() override = default;
+
+    static void operator delete(void*) { __builtin_trap(); }
+
+    void operator()(Range r, std::optional<absl::string_view> name) override;
+  };
+
+  struct Region {
+    HugeRegion* region;
+    HugePage start;
+    // Hugepages that are mlock()ed.
+    Bitmap<HugeRegion::kNumHugePages> pinned;
+  };
+
+  // Takes n pages, starting at *p, from one of the regions, adding a region if
+  // none has room, and returns that region.  Returns nullptr if the pool is
+  // full.
+  Region* Get(Length n, PageId* p) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  bool AddRegion() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Pins the hugepages of region that r covers and that are not yet pinned,
+  // telling the callback of them.  Returns false if mlock() failed.
+  bool Pin(Region& region, Range r) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Tells the callback of hugepages [first, first + n), if set.
+  void Notify(HugePage first, HugeLength n)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Not an AllocationGuardSpinLockHolder's lock: the callback runs under it,
+  // and may allocate.
+  mutable absl::base_internal::SpinLock lock_;
+  NoUnback unback_;
+  SetAnonVmaName set_anon_vma_name_;
+  Region regions_[kMaxRegions] ABSL_GUARDED_BY(lock_) = {};
+  size_t num_regions_ ABSL_GUARDED_BY(lock_) = 0;
+  MallocExtension::PinnedMemoryCallback callback_ ABSL_GUARDED_BY(lock_) =
+      nullptr;
+  void* callback_arg_ ABSL_GUARDED_BY(lock_) = nullptr;
+
+  HugeLength pinned_ ABSL_GUARDED_BY(lock_) = NHugePages(0);
+  Length used_ ABSL_GUARDED_BY(lock_);
+  size_t allocations_ ABSL_GUARDED_BY(lock_) = 0;
+  size_t failed_allocations_ ABSL_GUARDED_BY(lock_) = 0;
+  size_t pin_failures_ ABSL_GUARDED_BY(lock_) = 0;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_PINNED_POOL_H_
@@ -0,0 +1,81 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/pmr.h"
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+#include "absl/base/config.h"
+#include "absl/base/optimization.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace pmr {
+namespace {
+
+// Objects no more aligned than ::operator new guarantees use the unaligned
+// entry points, which are cheaper, and are freed with the unaligned delete.
+bool IsOveraligned(size_t alignment) {
+  return alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+}
+
+}  // namespace
+
+sized_ptr_t PerCpuResource::AllocateSized(size_t bytes, size_t alignment) {
+  if (ABSL_PREDICT_TRUE(!IsOveraligned(alignment))) {
+    switch (binding_) {
+      case Binding::kNone:
+        return __size_returning_new(bytes);
+      case Binding::kHotCold:
+        return __size_returning_new_hot_cold(bytes,
+                                             static_cast<hot_cold_t>(value_));
+      case Binding::kNumaNode:
+        return __size_returning_new_numa_node(
+            bytes, static_cast<numa_node_t>(value_));
+    }
+  }
+  if (binding_ == Binding::kHotCold) {
+    return __size_returning_new_aligned_hot_cold(
+        bytes, static_cast<std::align_val_t>(alignment),
+        static_cast<hot_cold_t>(value_));
+  }
+  return __size_returning_new_aligned(bytes,
+                                      static_cast<std::align_val_t>(alignment));
+}
+
+void* PerCpuResource::do_allocate(size_t bytes, size_t alignment) {
+  return AllocateSized(bytes, alignment).p;
+}
+
+void PerCpuResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+  if (ABSL_PREDICT_TRUE(!IsOveraligned(alignment))) {
+    ::operator delete(p, bytes);
+  } else {
+    ::operator delete(p, bytes, static_cast<std::align_val_t>(alignment));
+  }
+}
+
+bool PerCpuResource::do_is_equal(
+    const std::pmr::memory_resource& other) const noexcept {
+#ifdef ABSL_INTERNAL_HAS_RTTI
+  return dynamic_cast<const PerCpuResource*>(&other) != nullptr;
+#else
+  return this == &other;
+#endif  // ABSL_INTERNAL_HAS_RTTI
+}
+
+}  // namespace pmr
+}  // namespace tcmalloc
@@ -0,0 +1,86 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// std::pmr::memory_resource implementations that allocate from TCMalloc's
+// sized fast paths.  Passing std::pmr::new_delete_resource() to a container
+// instead routes every allocation through a virtual call into the unsized
+// ::operator new, and frees it without its size.
+
+#ifndef TCMALLOC_PMR_H_
+#define TCMALLOC_PMR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace pmr {
+
+// Allocates objects as `::operator new` would, from the current CPU's cache,
+// and frees them with sized delete.  A resource may be bound to an access hint,
+// which places cold objects in their own memory tag, or to a NUMA node, which
+// routes objects to the node's partition.
+//
+// Objects may be freed through any PerCpuResource, so all of them compare
+// equal (when built with RTTI), and containers may move objects between them
+// without copying.
+//
+// PerCpuResource holds no state beyond its binding and is thread-safe.
+class PerCpuResource : public std::pmr::memory_resource {
+ public:
+  PerCpuResource() = default;
+  explicit PerCpuResource(hot_cold_t hot_cold)
+      : binding_(Binding::kHotCold), value_(static_cast<uint8_t>(hot_cold)) {}
+  // Objects aligned beyond __STDCPP_DEFAULT_NEW_ALIGNMENT__ are allocated
+  // without regard to `node`.
+  explicit PerCpuResource(numa_node_t node)
+      : binding_(Binding::kNumaNode), value_(static_cast<uint8_t>(node)) {}
+
+ protected:
+  // Allocates `bytes` aligned to `alignment`, returning the usable capacity.
+  sized_ptr_t AllocateSized(size_t bytes, size_t alignment);
+
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+  bool do_is_equal(
+      const std::pmr::memory_resource& other) const noexcept override;
+
+ private:
+  enum class Binding : uint8_t { kNone, kHotCold, kNumaNode };
+
+  Binding binding_ = Binding::kNone;
+  uint8_t value_ = 0;
+};
+
+// A PerCpuResource that also reports how much of each allocation is usable,
+// for containers that can grow into the slack of the size class.
+class SizedResource : public PerCpuResource {
+ public:
+  using PerCpuResource::PerCpuResource;
+
+  // Allocates at least `bytes` aligned to `alignment`.  The object may be
+  // passed to deallocate() with any size from `bytes` to the returned
+  // capacity.
+  [[nodiscard]] sized_ptr_t allocate_at_least(
+      size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+    return AllocateSized(bytes, alignment);
+  }
+};
+
+}  // namespace pmr
+}  // namespace tcmalloc
+
+#endif  // TCMALLOC_PMR_H_
@@ -0,0 +1,95 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/pmr.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/base/config.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace pmr {
+namespace {
+
+TEST(PerCpuResourceTest, Containers) {
+  PerCpuResource resource;
+  std::pmr::vector<int> v(&resource);
+  for (int i = 0; i < 10000; ++i) {
+    v.push_back(i);
+  }
+  std::pmr::map<int, std::pmr::string> m(&resource);
+  for (int i = 0; i < 1000; ++i) {
+    m.emplace(i, std::string(i % 100, 'x'));
+  }
+  EXPECT_EQ(v[9999], 9999);
+  EXPECT_EQ(m[999].size(), 99);
+}
+
+TEST(PerCpuResourceTest, Alignment) {
+  PerCpuResource unbound;
+  PerCpuResource cold(hot_cold_t{0});
+  PerCpuResource hot(hot_cold_t{255});
+  PerCpuResource numa(numa_node_t{0});
+  for (PerCpuResource* resource : {&unbound, &cold, &hot, &numa}) {
+    for (size_t alignment = 1; alignment <= 4096; alignment <<= 1) {
+      SCOPED_TRACE(alignment);
+      for (size_t size : {size_t{1}, size_t{100}, size_t{100000}}) {
+        void* ptr = resource->allocate(size, alignment);
+        ASSERT_NE(ptr, nullptr);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignment, 0);
+        memset(ptr, 0xab, size);
+        EXPECT_GE(MallocExtension::GetAllocatedSize(ptr).value_or(size), size);
+        resource->deallocate(ptr, size, alignment);
+      }
+    }
+  }
+}
+
+TEST(PerCpuResourceTest, Equality) {
+  PerCpuResource a;
+  PerCpuResource b(hot_cold_t{0});
+  SizedResource c;
+  EXPECT_TRUE(a.is_equal(a));
+#ifdef ABSL_INTERNAL_HAS_RTTI
+  EXPECT_TRUE(a.is_equal(b));
+  EXPECT_TRUE(b.is_equal(c));
+#endif  // ABSL_INTERNAL_HAS_RTTI
+  EXPECT_FALSE(a.is_equal(*std::pmr::new_delete_resource()));
+}
+
+TEST(SizedResourceTest, AllocateAtLeast) {
+  SizedResource resource;
+  for (size_t size = 1; size <= 1 << 20; size = size * 3 / 2 + 1) {
+    SCOPED_TRACE(size);
+    sized_ptr_t res = resource.allocate_at_least(size);
+    ASSERT_NE(res.p, nullptr);
+    EXPECT_GE(res.n, size);
+    // The whole capacity is usable, and the object may be freed with it.
+    memset(res.p, 0xab, res.n);
+    resource.deallocate(res.p, res.n);
+  }
+}
+
+}  // namespace
+}  // namespace pmr
+}  // namespace tcmalloc
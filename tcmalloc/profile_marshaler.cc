@@ -14,8 +14,12 @@
 
 #include "tcmalloc/profile_marshaler.h"
 
+#include <memory>
 #include <string>
 
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/types/span.h"
 #include "google/protobuf/io/gzip_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "tcmalloc/internal/profile_builder.h"
@@ -25,8 +29,12 @@ namespace tcmalloc {
 // Marshal converts a Profile instance into a gzip-encoded, serialized
 // representation suitable for viewing with PProf
 // (https://github.com/google/pprof).
-absl::StatusOr<std::string> Marshal(const tcmalloc::Profile& profile) {
-  auto converted_or = tcmalloc_internal::MakeProfileProto(profile);
+namespace {
+
+absl::StatusOr<std::string> Serialize(
+    const absl::StatusOr<
+        std::unique_ptr<tcmalloc_internal::perftools::profiles::Profile>>&
+        converted_or) {
   if (!converted_or.ok()) {
     return converted_or.status();
   }
@@ -43,4 +51,56 @@ absl::StatusOr<std::string> Marshal(const tcmalloc::Profile& profile) {
   return output;
 }
 
+// Streams the profile.proto written by `write` straight into a gzip stream,
+// rather than building the whole profile.proto in memory first.
+absl::StatusOr<std::string> WriteGzipped(
+    absl::FunctionRef<absl::Status(google::protobuf::io::ZeroCopyOutputStream*)>
+        write) {
+  std::string output;
+  google::protobuf::io::StringOutputStream stream(&output);
+  google::protobuf::io::GzipOutputStream gzip_stream(&stream);
+  absl::Status status = write(&gzip_stream);
+  if (!status.ok()) {
+    return status;
+  }
+  if (!gzip_stream.Close()) {
+    return absl::InternalError("Failed to serialize to gzip stream");
+  }
+  return output;
+}
+
+}  // namespace
+
+absl::StatusOr<std::string> Marshal(const tcmalloc::Profile& profile) {
+  return Marshal(profile, MarshalOptions());
+}
+
+absl::StatusOr<std::string> Marshal(const tcmalloc::Profile& profile,
+                                    const MarshalOptions& options) {
+  return WriteGzipped([&](google::protobuf::io::ZeroCopyOutputStream* output) {
+    return tcmalloc_internal::WriteProfileProto(
+        profile, output, options.build_id_only_mappings);
+  });
+}
+
+absl::StatusOr<std::string> MarshalSnapshots(
+    absl::Span<const tcmalloc::Profile* const> profiles) {
+  return WriteGzipped([&](google::protobuf::io::ZeroCopyOutputStream* output) {
+    return tcmalloc_internal::WriteProfileSnapshotsProto(profiles, output);
+  });
+}
+
+absl::StatusOr<std::string> MarshalMerged(
+    absl::Span<const tcmalloc::Profile* const> profiles) {
+  return WriteGzipped([&](google::protobuf::io::ZeroCopyOutputStream* output) {
+    return tcmalloc_internal::WriteMergedProfileProto(profiles, output);
+  });
+}
+
+absl::StatusOr<std::string> MarshalHeapDelta(
+    const tcmalloc::MallocExtension::HeapProfileDelta& delta) {
+  return Serialize(tcmalloc_internal::MakeHeapDeltaProfileProto(
+      delta.added, delta.removed));
+}
+
 }  // namespace tcmalloc
@@ -18,6 +18,7 @@
 #include <string>
 
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "tcmalloc/malloc_extension.h"
 
 namespace tcmalloc {
@@ -28,6 +29,37 @@ namespace tcmalloc {
 [[nodiscard]] absl::StatusOr<std::string> Marshal(
     const tcmalloc::Profile& profile);
 
+struct MarshalOptions {
+  // Leaves out the paths of the loaded objects that have a build ID, so that
+  // the profile is symbolized offline by build ID.
+  bool build_id_only_mappings = false;
+};
+
+[[nodiscard]] absl::StatusOr<std::string> Marshal(
+    const tcmalloc::Profile& profile, const MarshalOptions& options);
+
+// MarshalHeapDelta converts the result of MallocExtension::SnapshotHeapDelta
+// into the same gzip-encoded format.  Each added sample is labelled with its
+// "alloc_handle", and each removed one appears as an empty sample labelled with
+// its "removed_alloc_handle", so that a consumer holding the previous state can
+// apply the delta.
+[[nodiscard]] absl::StatusOr<std::string> MarshalHeapDelta(
+    const tcmalloc::MallocExtension::HeapProfileDelta& delta);
+
+// MarshalSnapshots converts a series of profiles of the same type, such as a
+// process's periodic heap profiles, into a single gzip-encoded pprof profile.
+// Stacks and mappings are stored once for all of the profiles rather than once
+// per profile.  Each sample is labelled with the index of its profile as
+// "snapshot".  Residency is not reported.
+[[nodiscard]] absl::StatusOr<std::string> MarshalSnapshots(
+    absl::Span<const tcmalloc::Profile* const> profiles);
+
+// MarshalMerged sums a series of profiles of the same type into a single
+// gzip-encoded pprof profile, one sample per distinct stack.  Each profile is
+// iterated once, without copying its samples.
+[[nodiscard]] absl::StatusOr<std::string> MarshalMerged(
+    absl::Span<const tcmalloc::Profile* const> profiles);
+
 }  // namespace tcmalloc
 
 #endif  // TCMALLOC_PROFILE_MARSHALER_H_
@@ -14,6 +14,8 @@
 
 #include "tcmalloc/profile_marshaler.h"
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <utility>
@@ -38,6 +40,40 @@ namespace tcmalloc {
 namespace tcmalloc_internal {
 namespace {
 
+perftools::profiles::Profile Decode(absl::string_view encoded) {
+  google::protobuf::io::ArrayInputStream stream(encoded.data(), encoded.size());
+  google::protobuf::io::GzipInputStream gzip_stream(&stream);
+  google::protobuf::io::CodedInputStream coded_stream(&gzip_stream);
+
+  perftools::profiles::Profile converted;
+  EXPECT_TRUE(converted.ParseFromCodedStream(&coded_stream));
+  return converted;
+}
+
+// Returns a heap profile starting at `start` with one sample of `count`
+// objects of `size` bytes, allocated from a stack made of `frames`.
+Profile MakeHeapProfile(absl::Time start, std::vector<uintptr_t> frames,
+                        int64_t count, size_t size) {
+  auto fake_profile = std::make_unique<FakeProfile>();
+  fake_profile->SetType(ProfileType::kHeap);
+  fake_profile->SetStartTime(start);
+  fake_profile->SetDuration(absl::ZeroDuration());
+
+  std::vector<Profile::Sample> samples;
+  auto& sample = samples.emplace_back();
+  sample.count = count;
+  sample.sum = count * size;
+  sample.requested_size = size;
+  sample.allocated_size = size;
+  sample.depth = frames.size();
+  for (size_t i = 0; i < frames.size(); ++i) {
+    sample.stack[i] = reinterpret_cast<void*>(frames[i]);
+  }
+  fake_profile->SetSamples(std::move(samples));
+  return tcmalloc_internal::ProfileAccessor::MakeProfile(
+      std::move(fake_profile));
+}
+
 TEST(ProfileMarshalTest, Smoke) {
   constexpr absl::Duration kDuration = absl::Milliseconds(1500);
 
@@ -82,6 +118,72 @@ TEST(ProfileMarshalTest, Smoke) {
   EXPECT_EQ(converted.string_table(converted.default_sample_type()), "objects");
 }
 
+TEST(ProfileMarshalTest, Snapshots) {
+  const absl::Time t0 = absl::FromUnixSeconds(1000);
+  const Profile first = MakeHeapProfile(t0, {0x1000, 0x2000}, 2, 64);
+  const Profile second =
+      MakeHeapProfile(t0 + absl::Minutes(1), {0x1000, 0x3000}, 3, 64);
+
+  absl::StatusOr<std::string> encoded_or = MarshalSnapshots({&first, &second});
+  ASSERT_TRUE(encoded_or.ok()) << encoded_or.status();
+  const perftools::profiles::Profile converted = Decode(*encoded_or);
+
+  EXPECT_EQ(converted.time_nanos(), absl::ToUnixNanos(t0));
+  EXPECT_EQ(converted.duration_nanos(),
+            absl::ToInt64Nanoseconds(absl::Minutes(1)));
+  // Residency is not reported.
+  EXPECT_EQ(converted.sample_type_size(), 2);
+  // The shared frame has a single location.
+  EXPECT_EQ(converted.location_size(), 3);
+
+  ASSERT_EQ(converted.sample_size(), 2);
+  for (int i = 0; i < 2; ++i) {
+    const perftools::profiles::Sample& sample = converted.sample(i);
+    int64_t snapshot = -1;
+    for (const auto& label : sample.label()) {
+      if (converted.string_table(label.key()) == "snapshot") {
+        snapshot = label.num();
+      }
+    }
+    EXPECT_EQ(snapshot, i);
+    EXPECT_EQ(sample.value(0), i == 0 ? 2 : 3);
+  }
+}
+
+TEST(ProfileMarshalTest, Merged) {
+  const absl::Time t0 = absl::FromUnixSeconds(1000);
+  const Profile first = MakeHeapProfile(t0, {0x1000, 0x2000}, 2, 64);
+  const Profile second =
+      MakeHeapProfile(t0 + absl::Minutes(1), {0x1000, 0x2000}, 3, 64);
+  const Profile third =
+      MakeHeapProfile(t0 + absl::Minutes(2), {0x1000, 0x3000}, 1, 64);
+
+  absl::StatusOr<std::string> encoded_or =
+      MarshalMerged({&first, &second, &third});
+  ASSERT_TRUE(encoded_or.ok()) << encoded_or.status();
+  const perftools::profiles::Profile converted = Decode(*encoded_or);
+
+  ASSERT_EQ(converted.sample_size(), 2);
+  int64_t total_objects = 0;
+  for (const auto& sample : converted.sample()) {
+    EXPECT_THAT(sample.value(0), testing::AnyOf(5, 1));
+    total_objects += sample.value(0);
+  }
+  EXPECT_EQ(total_objects, 6);
+}
+
+TEST(ProfileMarshalTest, MergeRejectsMixedTypes) {
+  const Profile heap = MakeHeapProfile(absl::UnixEpoch(), {0x1000}, 1, 64);
+  auto fake_profile = std::make_unique<FakeProfile>();
+  fake_profile->SetType(ProfileType::kAllocations);
+  const Profile allocations =
+      tcmalloc_internal::ProfileAccessor::MakeProfile(std::move(fake_profile));
+
+  EXPECT_FALSE(MarshalMerged({&heap, &allocations}).ok());
+  EXPECT_FALSE(MarshalSnapshots({&heap, &allocations}).ok());
+  EXPECT_FALSE(MarshalMerged({}).ok());
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
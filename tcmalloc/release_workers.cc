@@ -0,0 +1,136 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/release_workers.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/page_allocator.h"
+#include "tcmalloc/page_allocator_interface.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+void ReleaseWorkers::Run() {
+  // Start workers at different instances, so that they do not all contend
+  // for the first one.
+  const size_t first = workers_.fetch_add(1, std::memory_order_relaxed);
+  uint64_t seen;
+  {
+    absl::MutexLock l(mu_);
+    seen = generation_;
+  }
+
+  while (MallocExtension::GetBackgroundProcessActionsEnabled()) {
+    // Wake up at least once per interval, to notice if background actions
+    // were disabled.
+    const absl::Duration timeout =
+        MallocExtension::GetBackgroundProcessSleepInterval();
+    {
+      WaitArgs args = {this, seen};
+      absl::MutexLock l(mu_);
+      mu_.AwaitWithTimeout(absl::Condition(&NewWork, &args), timeout);
+      seen = generation_;
+    }
+    ReleasePending(first);
+  }
+
+  workers_.fetch_sub(1, std::memory_order_relaxed);
+  // Leave nothing behind for workers that may not exist anymore.
+  ReleasePending(first);
+}
+
+void ReleaseWorkers::ReleasePending(size_t first) {
+  const size_t n = tc_globals.page_allocator().num_instances();
+  for (size_t i = 0; i < n; ++i) {
+    const size_t index = (first + i) % n;
+    const size_t pages =
+        pending_[index].exchange(0, std::memory_order_relaxed);
+    if (pages == 0) continue;
+    const Length released =
+        tc_globals.page_allocator().ReleaseAtLeastNPagesFromInstance(
+            index, Length(pages),
+            PageReleaseReason::kProcessBackgroundActions);
+    released_pages_.Add(released.raw_num());
+  }
+}
+
+Length ReleaseWorkers::Distribute(Length num_pages) {
+  if (num_pages == Length(0)) return Length(0);
+  PageAllocator& page_allocator = tc_globals.page_allocator();
+  const size_t n = page_allocator.num_instances();
+  Length free[kMaxInstances];
+  Length total_free;
+  {
+    PageHeapSpinLockHolder l;
+    for (size_t i = 0; i < n; ++i) {
+      free[i] = page_allocator.FreeBackedPages(i);
+      total_free += free[i];
+    }
+  }
+  if (total_free == Length(0)) return Length(0);
+
+  Length distributed;
+  for (size_t i = 0; i < n; ++i) {
+    if (free[i] == Length(0)) continue;
+    // Round up, so that small instances still get to release something.
+    const size_t share = std::ceil(static_cast<double>(num_pages.raw_num()) *
+                                   free[i].raw_num() / total_free.raw_num());
+    // Do not hand out more than the instance holds, even if the workers fall
+    // behind.
+    const size_t pending = pending_[i].load(std::memory_order_relaxed);
+    const size_t room =
+        free[i].raw_num() - std::min(pending, free[i].raw_num());
+    const size_t add = std::min(share, room);
+    if (add == 0) continue;
+    pending_[i].fetch_add(add, std::memory_order_relaxed);
+    distributed += Length(add);
+  }
+  distributed_pages_.Add(distributed.raw_num());
+
+  absl::MutexLock l(mu_);
+  ++generation_;
+  return distributed;
+}
+
+void ReleaseWorkers::Print(Printer& out) const {
+  out.printf(
+      "Background release workers: %d running; %lld pages handed out, %lld "
+      "released\n",
+      workers_.load(std::memory_order_relaxed), distributed_pages_.value(),
+      released_pages_.value());
+}
+
+void ReleaseWorkers::PrintInPbtxt(PbtxtRegion& region) const {
+  region.PrintI64("workers", workers_.load(std::memory_order_relaxed));
+  region.PrintI64("distributed_pages", distributed_pages_.value());
+  region.PrintI64("released_pages", released_pages_.value());
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,97 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_RELEASE_WORKERS_H_
+#define TCMALLOC_RELEASE_WORKERS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "absl/base/const_init.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/page_allocator.h"
+#include "tcmalloc/pages.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Spreads the background release over threads that the application runs in
+// MallocExtension::ProcessBackgroundReleaseWorker.
+//
+// Each iteration, the background thread hands the pages it would release
+// to Distribute(), which splits them among the allocator instances (memory
+// tags and partitions) in proportion to the pages they could release.  Each
+// worker then takes the pending pages of one instance at a time and releases
+// them.  pageheap_lock is held for one instance at a time, and released
+// during madvise, so that the workers' releases overlap.  The background
+// release rate still bounds the total.
+class ReleaseWorkers {
+ public:
+  static constexpr size_t kMaxInstances = PageAllocator::kMaxInstances;
+
+  constexpr ReleaseWorkers() = default;
+  ReleaseWorkers(const ReleaseWorkers&) = delete;
+  ReleaseWorkers& operator=(const ReleaseWorkers&) = delete;
+
+  // Runs a worker on the calling thread until background actions are
+  // disabled.
+  void Run() ABSL_LOCKS_EXCLUDED(mu_, pageheap_lock);
+
+  // Whether any worker is running.
+  bool active() const { return workers_.load(std::memory_order_relaxed) > 0; }
+
+  // Hands num_pages to the workers, split among instances by the pages
+  // they could release.  Returns the number of pages handed out.
+  Length Distribute(Length num_pages) ABSL_LOCKS_EXCLUDED(mu_, pageheap_lock);
+
+  void Print(Printer& out) const;
+  void PrintInPbtxt(PbtxtRegion& region) const;
+
+ private:
+  struct WaitArgs {
+    const ReleaseWorkers* self;
+    uint64_t seen;
+  };
+
+  static bool NewWork(WaitArgs* args) ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    return args->self->generation_ != args->seen;
+  }
+
+  // Releases the pending pages of every instance, starting at `first`.
+  void ReleasePending(size_t first) ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  absl::Mutex mu_{absl::kConstInit};
+  // Incremented by Distribute() to wake the workers.
+  uint64_t generation_ ABSL_GUARDED_BY(mu_) = 0;
+
+  std::atomic<int> workers_{0};
+  // Pages handed out but not yet released, per instance.
+  std::atomic<size_t> pending_[kMaxInstances] = {};
+
+  StatsCounter distributed_pages_;
+  StatsCounter released_pages_;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_RELEASE_WORKERS_H_
@@ -43,7 +43,24 @@ namespace tcmalloc_internal {
 constexpr ssize_t kIntervalOffset = 1;
 
 ssize_t Sampler::GetSampleInterval() {
-  return Parameters::profile_sampling_interval();
+  return tc_globals.adaptive_sampling_interval().interval();
+}
+
+ABSL_CONST_INIT static thread_local ThreadAllocationBudget
+    thread_allocation_budget ABSL_ATTRIBUTE_INITIAL_EXEC;
+
+ThreadAllocationBudget& GetThreadAllocationBudget() {
+  return thread_allocation_budget;
+}
+
+void Sampler::ArmBudget() {
+  ThreadAllocationBudget& budget = GetThreadAllocationBudget();
+  // Restart the step from here, so that Settle() only counts what follows.
+  bytes_until_sample_ = budget.Clip(budget.Resume(bytes_until_sample_));
+}
+
+size_t Sampler::BudgetedBytes() const {
+  return GetThreadAllocationBudget().allocated(bytes_until_sample_);
 }
 
 // Run this before using your sampler
@@ -80,6 +97,11 @@ ssize_t Sampler::PickNextSamplingPoint() {
     // cost, is a request for *every* allocation to be sampled.
     return 0;
   }
+  if (ABSL_PREDICT_FALSE(Parameters::deterministic())) {
+    // Sample every interval bytes exactly, so that runs sample the same
+    // allocations and pay for the same samples.
+    return sample_interval_ - kIntervalOffset;
+  }
   return std::max<ssize_t>(
       0, GetGeometricVariable(sample_interval_) - kIntervalOffset);
 }
@@ -120,12 +142,29 @@ ssize_t Sampler::GetGeometricVariable(ssize_t mean) {
     return static_cast<ssize_t>(interval);
 }
 
+ssize_t Sampler::PickNextCpuSamplingPoint(ssize_t& interval) {
+  if (ABSL_PREDICT_FALSE(!initialized_)) {
+    initialized_ = true;
+    Init(absl::HashOf(
+        static_cast<uint64_t>(absl::base_internal::CycleClock::Now()),
+        reinterpret_cast<uintptr_t>(this)));
+  }
+  // Our own step keeps being weighed with the interval it was drawn with.
+  const ssize_t own_interval = sample_interval_;
+  const ssize_t step = PickNextSamplingPoint();
+  interval = sample_interval_;
+  sample_interval_ = own_interval;
+  return step;
+}
+
 size_t Sampler::RecordAllocationSlow(size_t k) {
+  ThreadAllocationBudget& budget = GetThreadAllocationBudget();
   if (ABSL_PREDICT_FALSE(!initialized_)) {
     initialized_ = true;
     Init(absl::HashOf(
         static_cast<uint64_t>(absl::base_internal::CycleClock::Now()),
         reinterpret_cast<uintptr_t>(this)));
+    bytes_until_sample_ = budget.Clip(bytes_until_sample_);
     // Avoid missampling 0.
     bytes_until_sample_ -= k + 1;
     if (ABSL_PREDICT_TRUE(bytes_until_sample_ >= 0)) {
@@ -133,6 +172,18 @@ size_t Sampler::RecordAllocationSlow(size_t k) {
     }
   }
 
+  if (ABSL_PREDICT_FALSE(budget.engaged())) {
+    // The step may have been clipped to count the budget in time.  Unless the
+    // real sampling point has been reached too, resume the rest of the step.
+    const ssize_t remaining = budget.Settle(bytes_until_sample_);
+    if (remaining >= 0) {
+      bytes_until_sample_ = budget.Clip(remaining);
+      budget.MaybeNotify();
+      return 0;
+    }
+    bytes_until_sample_ = remaining;
+  }
+
   // Compute sampling weight (i.e. the number of bytes represented by this
   // sample in expectation).
   //
@@ -150,10 +201,14 @@ size_t Sampler::RecordAllocationSlow(size_t k) {
     weight = std::numeric_limits<ssize_t>::max();
   }
   bytes_until_sample_ = PickNextSamplingPoint();
+  if (ABSL_PREDICT_FALSE(budget.active())) {
+    bytes_until_sample_ = budget.Clip(bytes_until_sample_);
+    budget.MaybeNotify();
+  }
   return GetSampleInterval() <= 0 ? 0 : weight;
 }
 
-double AllocatedBytes(const StackTrace& stack) {
+double AllocatedBytes(const StackTraceInfo& stack) {
   return static_cast<double>(stack.weight) * stack.allocated_size /
          (stack.requested_size + 1);
 }
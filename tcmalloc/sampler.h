@@ -77,6 +77,102 @@ namespace tcmalloc_internal {
 
 class SamplerTest;
 
+// Counts the bytes a thread allocates against a budget (see
+// MallocExtension::SetThreadAllocationBudget).  The count is only updated when
+// the thread's Sampler takes its slow path, so while a budget is set the
+// Sampler clips its steps to at most kStep bytes, which bounds how far the
+// count lags behind.  Clipped steps do not change which allocations are
+// sampled: the rest of the step is deferred and resumed afterwards.
+class ThreadAllocationBudget {
+ public:
+  using Callback = MallocExtension::AllocationBudgetCallback;
+
+  static constexpr ssize_t kStep = 256 << 10;
+
+  constexpr ThreadAllocationBudget() = default;
+
+  // Starts counting from zero against `limit`.  `callback` is invoked once the
+  // count exceeds it.
+  void Set(size_t limit, Callback callback, void* arg) {
+    limit_ = limit;
+    allocated_ = 0;
+    callback_ = callback;
+    arg_ = arg;
+    active_ = true;
+    exceeded_ = false;
+  }
+  void Clear() {
+    active_ = false;
+    callback_ = nullptr;
+  }
+
+  bool active() const { return active_; }
+  // Whether the Sampler must consult the budget on its slow path, which is
+  // also the case for a step clipped before the budget was cleared.
+  bool engaged() const { return active_ || deferred_ != 0; }
+  // Returns the count, including the bytes allocated since the Sampler's step
+  // was last armed, given its counter `bytes_until_sample`.
+  size_t allocated(ssize_t bytes_until_sample) const {
+    return allocated_ + (armed_ - bytes_until_sample);
+  }
+
+  // Counts the bytes allocated since the Sampler's step was last armed, given
+  // its counter `bytes_until_sample`, and returns the counter the step would
+  // have without clipping.
+  ssize_t Settle(ssize_t bytes_until_sample) {
+    if (active_) {
+      allocated_ += armed_ - bytes_until_sample;
+    }
+    return Resume(bytes_until_sample);
+  }
+
+  // Like Settle(), without counting anything.
+  ssize_t Resume(ssize_t bytes_until_sample) {
+    const ssize_t remaining = bytes_until_sample + deferred_;
+    deferred_ = 0;
+    return remaining;
+  }
+
+  // Returns the counter to arm the Sampler with for a step of `step` bytes,
+  // deferring the part past kStep.
+  ssize_t Clip(ssize_t step) {
+    if (active_ && step > kStep) {
+      deferred_ = step - kStep;
+      step = kStep;
+    } else {
+      deferred_ = 0;
+    }
+    armed_ = step;
+    return step;
+  }
+
+  // Invokes the callback if the count exceeded the budget since it was set.
+  // This is done once the Sampler is consistent, as the callback may allocate.
+  void MaybeNotify() {
+    if (ABSL_PREDICT_TRUE(!active_ || exceeded_ || allocated_ <= limit_)) {
+      return;
+    }
+    exceeded_ = true;
+    if (callback_ != nullptr) {
+      callback_(arg_, allocated_);
+    }
+  }
+
+ private:
+  size_t limit_ = 0;
+  size_t allocated_ = 0;
+  Callback callback_ = nullptr;
+  void* arg_ = nullptr;
+  // The value the Sampler's counter was armed with, and the part of its step
+  // deferred by clipping.
+  ssize_t armed_ = 0;
+  ssize_t deferred_ = 0;
+  bool active_ = false;
+  bool exceeded_ = false;
+};
+
+ThreadAllocationBudget& GetThreadAllocationBudget();
+
 class Sampler {
  public:
   // Record allocation of "k" bytes. If the allocation needs to be sampled,
@@ -108,9 +204,21 @@ class Sampler {
   // the next sample is still weighed properly).
   ssize_t PickNextSamplingPoint();
 
+  // Like PickNextSamplingPoint, for the per-CPU sampling countdowns of
+  // TCMALLOC_INTERNAL_PERCPU_SAMPLER builds.  Returns the sampling interval
+  // the step was drawn with in `interval`.
+  ssize_t PickNextCpuSamplingPoint(ssize_t& interval);
+
   // Returns the current sample interval.
   static ssize_t GetSampleInterval();
 
+  // Clips the current step to the calling thread's newly set budget.
+  void ArmBudget();
+
+  // Returns the bytes counted against the calling thread's budget, including
+  // those of the current step.
+  size_t BudgetedBytes() const;
+
   // The following are public for the purposes of testing
 
   // Used to ensure that the hot fields are collocated in the same cache line
@@ -187,7 +295,7 @@ inline bool Sampler::WillRecordAllocation(size_t k) {
 
 // Returns the approximate number of bytes that would have been allocated to
 // obtain this sample.
-double AllocatedBytes(const StackTrace& stack);
+double AllocatedBytes(const StackTraceInfo& stack);
 
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -27,6 +27,7 @@
 #include "absl/base/internal/sysinfo.h"
 #include "absl/debugging/stacktrace.h"
 #include "absl/strings/string_view.h"
+#include "tcmalloc/common.h"
 #include "tcmalloc/guarded_allocations.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -240,13 +241,19 @@ static void HandleSegvAndForward(int signo, siginfo_t* info, void* context) {
 extern "C" void MallocExtension_Internal_ActivateGuardedSampling() {
   static absl::once_flag flag;
   absl::base_internal::LowLevelCallOnce(&flag, []() {
+    // The handler reads the slot metadata that AllowAllocations() allocates, so
+    // allow allocations before installing it.
+    tc_globals.InitIfNecessary();
+    {
+      PageHeapSpinLockHolder l;
+      tc_globals.guardedpage_allocator().AllowAllocations();
+    }
     struct sigaction action = {};
     action.sa_sigaction = HandleSegvAndForward;
     sigemptyset(&action.sa_mask);
     action.sa_flags = SA_SIGINFO;
     sigaction(SIGSEGV, &action, &old_segv_sa);
     sigaction(SIGTRAP, &action, &old_trap_sa);
-    tc_globals.guardedpage_allocator().AllowAllocations();
   });
 }
 
@@ -0,0 +1,124 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/shared_region.h"
+
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/base/attributes.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/mapped_region.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+ABSL_CONST_INIT MappedRegionCounters counters;
+
+}  // namespace
+
+void SharedSpinLock::Lock() {
+  constexpr int kSpins = 100;
+  for (int i = 0;; ++i) {
+    if (word_.load(std::memory_order_relaxed) == 0 &&
+        word_.exchange(1, std::memory_order_acquire) == 0) {
+      return;
+    }
+    if (i >= kSpins) {
+      sched_yield();
+    }
+  }
+}
+
+SharedRegionHeader* SharedRegionHeader::Attach(int fd, void* address,
+                                               size_t size) {
+  const uintptr_t base = reinterpret_cast<uintptr_t>(address);
+  if (fd < 0 || base % kMaxAlignment != 0 || size % kMaxAlignment != 0 ||
+      size < sizeof(SharedRegionHeader)) {
+    return nullptr;
+  }
+  void* result = MapRegionAt(fd, address, size);
+  if (result == nullptr) {
+    return nullptr;
+  }
+
+  auto* h = static_cast<SharedRegionHeader*>(result);
+  uint32_t state = kEmpty;
+  if (h->state_.compare_exchange_strong(state, kFormatting,
+                                        std::memory_order_acquire)) {
+    h->Format(base, size);
+    h->state_.store(kReady, std::memory_order_release);
+    state = kReady;
+  } else {
+    // A process that crashed while formatting leaves kFormatting behind for
+    // good, so do not wait for it forever.
+    const absl::Time deadline = absl::Now() + kFormatTimeout;
+    while (state == kFormatting && absl::Now() < deadline) {
+      sched_yield();
+      state = h->state_.load(std::memory_order_acquire);
+    }
+  }
+  // Pointers in the region would be wrong at any other address.
+  if (state != kReady || !h->Matches(base, size)) {
+    munmap(result, size);
+    return nullptr;
+  }
+
+  counters.Attached(size);
+  return h;
+}
+
+bool SharedRegionHeader::Matches(uintptr_t base, size_t size) const {
+  return magic_ == kMagic && version_ == kVersion &&
+         allocator_.base() == base && allocator_.size() == size;
+}
+
+void SharedRegionHeader::Format(uintptr_t base, size_t size) {
+  magic_ = kMagic;
+  version_ = kVersion;
+  // The file is still empty, so the lock reads as unlocked.
+  allocator_.Init(base, size, sizeof(*this));
+}
+
+void SharedRegionHeader::Detach() {
+  const size_t size = allocator_.size();
+  munmap(this, size);
+  counters.Detached(size);
+}
+
+SharedRegionStats GetSharedRegionStats() {
+  return {
+      .attached_regions = counters.attached_regions(),
+      .mapped_bytes = counters.mapped_bytes(),
+  };
+}
+
+void PrintSharedRegionStats(Printer& out) { counters.Print(out, "shared"); }
+
+void PrintSharedRegionStatsInPbtxt(PbtxtRegion& region) {
+  counters.PrintInPbtxt(region);
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
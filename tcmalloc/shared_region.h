@@ -0,0 +1,123 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_SHARED_REGION_H_
+#define TCMALLOC_SHARED_REGION_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/mapped_region.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// A lock that works across processes mapping the memory it lives in.
+// absl::base_internal::SpinLock sleeps on private futexes, which an unlock in
+// another process does not wake, so this one yields instead.  Critical
+// sections must be short.
+class ABSL_LOCKABLE SharedSpinLock {
+ public:
+  void Lock() ABSL_EXCLUSIVE_LOCK_FUNCTION();
+  void Unlock() ABSL_UNLOCK_FUNCTION() {
+    word_.store(0, std::memory_order_release);
+  }
+
+ private:
+  std::atomic<uint32_t> word_;
+};
+
+// Backs tcmalloc::SharedRegion.  A file, typically a memfd, is mapped shared at
+// the same address by several processes, which allocate and free objects in
+// it concurrently.  Pointers into the region are thus valid in all of them.
+//
+// As for PersistentRegionHeader, the mapping starts with this header, which
+// holds all of the allocator's state in OffsetFreeLists.  The first process
+// to attach an empty file formats it; the others wait for it and check that
+// they attach it at the same address and size.
+class SharedRegionHeader {
+ public:
+  // Maps `size` bytes of the file `fd` at `address`, growing the file as
+  // needed, and returns the header, or nullptr on failure.  That includes
+  // another process not finishing formatting the file within kFormatTimeout,
+  // e.g. because it crashed meanwhile.
+  //
+  // REQUIRES: address and size are multiples of the page size.
+  static SharedRegionHeader* Attach(int fd, void* address, size_t size);
+
+  SharedRegionHeader(const SharedRegionHeader&) = delete;
+  SharedRegionHeader& operator=(const SharedRegionHeader&) = delete;
+
+  static constexpr size_t kMaxAlignment =
+      OffsetFreeLists<SharedSpinLock>::kMaxAlignment;
+  // Formatting only writes the header, so this is ample.
+  static constexpr absl::Duration kFormatTimeout = absl::Seconds(1);
+
+  // Returns `size` bytes aligned to `alignment`, or nullptr if the region is
+  // full.
+  //
+  // REQUIRES: alignment is a power of two no larger than kMaxAlignment
+  void* Allocate(size_t size, size_t alignment) {
+    return allocator_.Allocate(size, alignment);
+  }
+
+  // Returns an object, allocated by any attached process, to the region.  size
+  // and alignment must be those it was allocated with.
+  void Deallocate(void* ptr, size_t size, size_t alignment) {
+    allocator_.Deallocate(ptr, size, alignment);
+  }
+
+  // Unmaps the region from this process.  The header must not be used
+  // afterwards.  The objects stay in place for the other processes.
+  void Detach();
+
+ private:
+  static constexpr uint64_t kMagic = 0x7463'6d73'6872'6731;  // "tcmshrg1"
+  static constexpr uint32_t kVersion = 1;
+
+  enum State : uint32_t { kEmpty = 0, kFormatting = 1, kReady = 2 };
+
+  SharedRegionHeader() = default;
+
+  void Format(uintptr_t base, size_t size);
+  bool Matches(uintptr_t base, size_t size) const;
+
+  // A fresh file reads as zeros, i.e. kEmpty, and an unlocked allocator_.
+  std::atomic<uint32_t> state_;
+  uint32_t version_;
+  uint64_t magic_;
+  OffsetFreeLists<SharedSpinLock> allocator_;
+};
+
+struct SharedRegionStats {
+  // Regions attached by this process, and the bytes they map.
+  int64_t attached_regions;
+  int64_t mapped_bytes;
+};
+
+SharedRegionStats GetSharedRegionStats();
+void PrintSharedRegionStats(Printer& out);
+void PrintSharedRegionStatsInPbtxt(PbtxtRegion& region);
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_SHARED_REGION_H_
@@ -0,0 +1,81 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/signal_safe_pool.h"
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+#include "absl/base/attributes.h"
+#include "absl/base/const_init.h"
+#include "absl/base/internal/spinlock.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// The pool's address space is reserved once, by the first call to
+// ReserveSignalSafeMemory, with room for later calls to ask for more.
+constexpr size_t kMinReservation = size_t{64} << 20;
+constexpr size_t kMaxReservation = size_t{1} << 30;
+
+ABSL_CONST_INIT absl::base_internal::SpinLock reserve_lock(
+    absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY);
+
+}  // namespace
+
+bool ReserveSignalSafeMemory(size_t bytes) {
+  SignalSafePool& pool = tc_globals.signal_safe_pool();
+  {
+    AllocationGuardSpinLockHolder l(reserve_lock);
+    if (!pool.initialized()) {
+      if (bytes > kMaxReservation) return false;
+      // Reserve without committing swap; Refill() populates what is used.
+      const size_t reserved = std::max(
+          kMinReservation,
+          (bytes + SignalSafePool::kRefillAlignment - 1) &
+              ~(SignalSafePool::kRefillAlignment - 1));
+      void* base = mmap(nullptr, reserved, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (base == MAP_FAILED) return false;
+      pool.Init(base, reserved);
+    }
+    if (bytes > pool.reserved()) return false;
+    pool.set_target(bytes);
+  }
+  // Make the memory available now rather than at the background thread's
+  // next iteration, which may not be running.
+  RefillSignalSafePool();
+  return true;
+}
+
+void RefillSignalSafePool() {
+  SignalSafePool& pool = tc_globals.signal_safe_pool();
+  if (!pool.initialized()) return;
+  AllocationGuardSpinLockHolder l(reserve_lock);
+  pool.Refill([](void* start, size_t len) {
+    tc_globals.system_allocator().Populate(start, len);
+  });
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,261 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_SIGNAL_SAFE_POOL_H_
+#define TCMALLOC_SIGNAL_SAFE_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "absl/base/optimization.h"
+#include "absl/numeric/bits.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Backs tcmalloc::SignalSafeAllocate.  Hands out blocks from a reserved range
+// of address space using atomics only, so that it can be used from signal
+// handlers, including ones that interrupted the allocator itself.
+//
+// Blocks are powers of two from kMinBlock to kMaxBlock bytes, including a
+// kHeaderSize header that records the block's bucket.  Freed blocks go onto a
+// lock-free stack per bucket, whose head carries a generation count against
+// ABA.  Otherwise blocks are carved from the range with a pointer bump, up to
+// limit(), which Refill() raises, outside of signal handlers, to keep target
+// bytes available.
+class SignalSafePool {
+ public:
+  static constexpr size_t kHeaderSize = 16;
+  static constexpr size_t kMinBlockShift = 5;
+  static constexpr size_t kMinBlock = size_t{1} << kMinBlockShift;
+  static constexpr size_t kNumBuckets = 12;
+  static constexpr size_t kMaxBlock = kMinBlock << (kNumBuckets - 1);
+  // The largest size Allocate() serves.
+  static constexpr size_t kMaxSize = kMaxBlock - kHeaderSize;
+  // Refill() raises limit() in multiples of this.
+  static constexpr size_t kRefillAlignment = 4096;
+
+  constexpr SignalSafePool() = default;
+  SignalSafePool(const SignalSafePool&) = delete;
+  SignalSafePool& operator=(const SignalSafePool&) = delete;
+
+  // Hands [base, base + reserved) to the pool, none of which is usable until
+  // Refill().  Not signal-safe.
+  //
+  // REQUIRES: base and reserved are aligned to kRefillAlignment, and
+  // reserved < 64 GiB.
+  void Init(void* base, size_t reserved) {
+    TC_ASSERT_EQ(reinterpret_cast<uintptr_t>(base) % kRefillAlignment, 0);
+    TC_ASSERT_EQ(reserved % kRefillAlignment, 0);
+    TC_ASSERT_LT(reserved / kHeaderSize, uint64_t{1} << 32);
+    reserved_ = reserved;
+    base_.store(static_cast<char*>(base), std::memory_order_release);
+  }
+
+  bool initialized() const {
+    return base_.load(std::memory_order_acquire) != nullptr;
+  }
+
+  // Returns size bytes aligned to kHeaderSize, or nullptr if the pool is not
+  // initialized, is exhausted, or size is larger than kMaxSize.
+  // Async-signal-safe.
+  void* Allocate(size_t size) {
+    char* base = base_.load(std::memory_order_acquire);
+    if (ABSL_PREDICT_FALSE(base == nullptr || size > kMaxSize)) {
+      failures_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    const size_t bucket = Bucket(size);
+    Header* h = Pop(base, bucket);
+    if (h == nullptr) {
+      h = Carve(base, BlockSize(bucket));
+      if (ABSL_PREDICT_FALSE(h == nullptr)) {
+        failures_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      h->bucket = bucket;
+    }
+    in_use_.fetch_add(BlockSize(bucket), std::memory_order_relaxed);
+    return reinterpret_cast<char*>(h) + kHeaderSize;
+  }
+
+  // Returns ptr, from Allocate(), to the pool.  Async-signal-safe.
+  void Free(void* ptr) {
+    char* base = base_.load(std::memory_order_acquire);
+    Header* h =
+        reinterpret_cast<Header*>(static_cast<char*>(ptr) - kHeaderSize);
+    TC_ASSERT(Owns(ptr));
+    const size_t bucket = h->bucket;
+    TC_ASSERT_LT(bucket, kNumBuckets);
+    in_use_.fetch_sub(BlockSize(bucket), std::memory_order_relaxed);
+    Push(base, bucket, h);
+  }
+
+  bool Owns(const void* ptr) const {
+    const char* base = base_.load(std::memory_order_acquire);
+    const char* p = static_cast<const char*>(ptr);
+    return base != nullptr && p >= base && p < base + reserved_;
+  }
+
+  // Sets the number of bytes that Refill() keeps available for carving.
+  void set_target(size_t bytes) {
+    target_.store(std::min(bytes, reserved_), std::memory_order_relaxed);
+  }
+
+  // Raises limit() so that at least target bytes are left to carve, as far
+  // as the reservation allows.  populate(ptr, bytes) is called on the newly
+  // usable range, which is aligned to kRefillAlignment, before it is
+  // published.  Returns the number of bytes added.
+  // Not signal-safe, and must not run concurrently with itself.
+  template <typename Populate>
+  size_t Refill(Populate populate) {
+    char* base = base_.load(std::memory_order_acquire);
+    if (base == nullptr) return 0;
+    const size_t limit = limit_.load(std::memory_order_relaxed);
+    const size_t used = std::min(used_.load(std::memory_order_relaxed), limit);
+    const size_t target = target_.load(std::memory_order_relaxed);
+    if (limit - used >= target) return 0;
+    const size_t new_limit =
+        std::min((used + target + kRefillAlignment - 1) &
+                     ~(kRefillAlignment - 1),
+                 reserved_);
+    if (new_limit <= limit) return 0;
+    populate(base + limit, new_limit - limit);
+    limit_.store(new_limit, std::memory_order_release);
+    return new_limit - limit;
+  }
+
+  size_t reserved() const { return reserved_; }
+  size_t limit() const { return limit_.load(std::memory_order_acquire); }
+  // Bytes carved from the reservation so far.
+  size_t carved() const {
+    return std::min(used_.load(std::memory_order_relaxed), limit());
+  }
+  // Bytes of blocks currently allocated, headers included.
+  size_t in_use() const { return in_use_.load(std::memory_order_relaxed); }
+  size_t failures() const {
+    return failures_.load(std::memory_order_relaxed);
+  }
+
+  void Print(Printer& out) const {
+    out.printf(
+        "Signal-safe pool: %zu bytes usable, %zu carved, %zu in use; %zu "
+        "failed allocations\n",
+        limit(), carved(), in_use(), failures());
+  }
+
+  void PrintInPbtxt(PbtxtRegion& region) const {
+    region.PrintI64("usable_bytes", limit());
+    region.PrintI64("carved_bytes", carved());
+    region.PrintI64("in_use_bytes", in_use());
+    region.PrintI64("failed_allocations", failures());
+  }
+
+ private:
+  struct Header {
+    uint32_t bucket;
+    // While free: 1 + the offset of the next free block, in kHeaderSize
+    // units, or 0.  Atomic, as a racing Pop() may read it after the block was
+    // handed out again; the generation count then fails its CAS.
+    std::atomic<uint32_t> next;
+  };
+  static_assert(sizeof(Header) <= kHeaderSize);
+
+  static size_t Bucket(size_t size) {
+    const size_t block = std::max(size + kHeaderSize, kMinBlock);
+    return absl::bit_width(block - 1) - kMinBlockShift;
+  }
+
+  static size_t BlockSize(size_t bucket) { return kMinBlock << bucket; }
+
+  static uint32_t Index(const char* base, const Header* h) {
+    return static_cast<uint32_t>(
+        (reinterpret_cast<const char*>(h) - base) / kHeaderSize + 1);
+  }
+
+  static Header* AtIndex(char* base, uint32_t index) {
+    return reinterpret_cast<Header*>(base + size_t{index - 1} * kHeaderSize);
+  }
+
+  // Heads are (generation << 32) | index.
+  Header* Pop(char* base, size_t bucket) {
+    std::atomic<uint64_t>& head = heads_[bucket];
+    uint64_t old_head = head.load(std::memory_order_acquire);
+    while (true) {
+      const uint32_t index = static_cast<uint32_t>(old_head);
+      if (index == 0) return nullptr;
+      Header* h = AtIndex(base, index);
+      const uint64_t new_head = ((old_head >> 32) + 1) << 32 |
+                                h->next.load(std::memory_order_relaxed);
+      if (head.compare_exchange_weak(old_head, new_head,
+                                     std::memory_order_acquire,
+                                     std::memory_order_acquire)) {
+        return h;
+      }
+    }
+  }
+
+  void Push(char* base, size_t bucket, Header* h) {
+    std::atomic<uint64_t>& head = heads_[bucket];
+    uint64_t old_head = head.load(std::memory_order_relaxed);
+    uint64_t new_head;
+    do {
+      h->next.store(static_cast<uint32_t>(old_head),
+                    std::memory_order_relaxed);
+      new_head = ((old_head >> 32) + 1) << 32 | Index(base, h);
+    } while (!head.compare_exchange_weak(old_head, new_head,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed));
+  }
+
+  Header* Carve(char* base, size_t bytes) {
+    size_t used = used_.load(std::memory_order_relaxed);
+    do {
+      if (used + bytes > limit_.load(std::memory_order_acquire)) {
+        return nullptr;
+      }
+    } while (!used_.compare_exchange_weak(used, used + bytes,
+                                          std::memory_order_relaxed));
+    return reinterpret_cast<Header*>(base + used);
+  }
+
+  std::atomic<char*> base_{nullptr};
+  size_t reserved_ = 0;
+  std::atomic<size_t> limit_{0};
+  std::atomic<size_t> used_{0};
+  std::atomic<size_t> target_{0};
+  std::atomic<uint64_t> heads_[kNumBuckets] = {};
+  std::atomic<size_t> in_use_{0};
+  std::atomic<size_t> failures_{0};
+};
+
+// Reserves the address space of tc_globals.signal_safe_pool() on first use,
+// and has the background thread keep bytes of it available.  Not
+// signal-safe.  Returns false if the reservation failed.
+bool ReserveSignalSafeMemory(size_t bytes);
+
+// Refills tc_globals.signal_safe_pool().  Called by the background thread.
+void RefillSignalSafePool();
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_SIGNAL_SAFE_POOL_H_
@@ -0,0 +1,165 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/signal_safe_pool.h"
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+class SignalSafePoolTest : public testing::Test {
+ protected:
+  static constexpr size_t kReserved = 1 << 20;
+
+  SignalSafePoolTest() { pool_.Init(buffer_, kReserved); }
+
+  size_t Refill() {
+    return pool_.Refill([](void*, size_t) {});
+  }
+
+  SignalSafePool pool_;
+
+ private:
+  alignas(SignalSafePool::kRefillAlignment) char buffer_[kReserved];
+};
+
+TEST_F(SignalSafePoolTest, NothingUsableUntilRefilled) {
+  EXPECT_EQ(pool_.Allocate(8), nullptr);
+  EXPECT_EQ(pool_.failures(), 1);
+  pool_.set_target(64 << 10);
+  EXPECT_EQ(Refill(), 64 << 10);
+  EXPECT_NE(pool_.Allocate(8), nullptr);
+}
+
+TEST_F(SignalSafePoolTest, ReusesFreedBlocks) {
+  pool_.set_target(64 << 10);
+  Refill();
+  void* p = pool_.Allocate(100);
+  ASSERT_NE(p, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % SignalSafePool::kHeaderSize, 0);
+  EXPECT_TRUE(pool_.Owns(p));
+  memset(p, 0xab, 100);
+  EXPECT_EQ(pool_.in_use(), 128);
+  const size_t carved = pool_.carved();
+  pool_.Free(p);
+  EXPECT_EQ(pool_.in_use(), 0);
+  // Sizes in the same bucket reuse the block without carving.
+  EXPECT_EQ(pool_.Allocate(112), p);
+  EXPECT_EQ(pool_.carved(), carved);
+  EXPECT_NE(pool_.Allocate(100), p);
+}
+
+TEST_F(SignalSafePoolTest, RejectsOversizedRequests) {
+  pool_.set_target(kReserved);
+  Refill();
+  EXPECT_NE(pool_.Allocate(SignalSafePool::kMaxSize), nullptr);
+  EXPECT_EQ(pool_.Allocate(SignalSafePool::kMaxSize + 1), nullptr);
+}
+
+TEST_F(SignalSafePoolTest, RefillTopsUpToTarget) {
+  pool_.set_target(16 << 10);
+  Refill();
+  std::vector<void*> ptrs;
+  while (void* p = pool_.Allocate(1000)) {
+    ptrs.push_back(p);
+  }
+  EXPECT_EQ(ptrs.size(), 16);
+  EXPECT_EQ(pool_.carved(), pool_.limit());
+  // Blocks in use do not count towards the target.
+  EXPECT_EQ(Refill(), 16 << 10);
+  EXPECT_EQ(Refill(), 0);
+  EXPECT_NE(pool_.Allocate(1000), nullptr);
+}
+
+TEST_F(SignalSafePoolTest, RefillStopsAtReservation) {
+  pool_.set_target(2 * kReserved);
+  EXPECT_EQ(Refill(), kReserved);
+  EXPECT_EQ(pool_.limit(), kReserved);
+}
+
+TEST_F(SignalSafePoolTest, ConcurrentAllocateAndFree) {
+  pool_.set_target(kReserved);
+  Refill();
+  constexpr int kThreads = 4;
+  constexpr int kIterations = 10000;
+  std::atomic<bool> failed{false};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      void* ptrs[16];
+      for (int i = 0; i < kIterations; ++i) {
+        for (int j = 0; j < 16; ++j) {
+          ptrs[j] = pool_.Allocate(16 << (j % 8));
+          if (ptrs[j] == nullptr) {
+            failed = true;
+            return;
+          }
+          memset(ptrs[j], t, 16);
+        }
+        for (void* p : ptrs) {
+          if (*static_cast<unsigned char*>(p) != t) failed = true;
+          pool_.Free(p);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_FALSE(failed);
+  EXPECT_EQ(pool_.in_use(), 0);
+}
+
+std::atomic<void*> handler_allocation{nullptr};
+
+void AllocatingHandler(int) {
+  void* p = SignalSafeAllocate(256);
+  if (p != nullptr) memset(p, 0, 256);
+  handler_allocation.store(p);
+}
+
+TEST(SignalSafeAllocateTest, AllocatesInSignalHandler) {
+  ASSERT_TRUE(ReserveSignalSafeMemory(1 << 20));
+
+  struct sigaction sa = {};
+  struct sigaction old_sa;
+  sa.sa_handler = AllocatingHandler;
+  sigemptyset(&sa.sa_mask);
+  ASSERT_EQ(sigaction(SIGUSR1, &sa, &old_sa), 0);
+  raise(SIGUSR1);
+  ASSERT_EQ(sigaction(SIGUSR1, &old_sa, nullptr), 0);
+
+  void* p = handler_allocation.load();
+  ASSERT_NE(p, nullptr);
+  // The memory does not belong to the heap.
+  EXPECT_EQ(MallocExtension::GetOwnership(p),
+            MallocExtension::Ownership::kNotOwned);
+  SignalSafeFree(p);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
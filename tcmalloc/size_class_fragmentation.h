@@ -0,0 +1,159 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_SIZE_CLASS_FRAGMENTATION_H_
+#define TCMALLOC_SIZE_CLASS_FRAGMENTATION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/sizemap.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Tracks, per size class, the internal fragmentation of the live sampled
+// objects, that is the bytes lost to rounding their requested sizes up to the
+// size of the class, and a histogram of how far below the class size the
+// requested sizes of all sampled allocations fell.  Like the totals kept by
+// Static, the numbers are weighted by how many allocations each sample stands
+// for.
+//
+// The histogram is the input of the offline size class optimizer, gathered
+// continuously: a class whose requests crowd into the upper buckets would be
+// better served by an extra class below it.
+class SizeClassFragmentation {
+ public:
+  // Bucket i counts the requests that wasted [i, i + 1) / kBuckets of the
+  // class size.
+  static constexpr int kBuckets = 8;
+
+  constexpr SizeClassFragmentation() = default;
+  SizeClassFragmentation(const SizeClassFragmentation&) = delete;
+  SizeClassFragmentation& operator=(const SizeClassFragmentation&) = delete;
+
+  void RecordAllocation(size_t size_class, size_t requested_size,
+                        size_t allocated_size, double weight) {
+    if (size_class == 0) return;
+    TC_ASSERT_LT(size_class, kNumClasses);
+    TC_ASSERT_LE(requested_size, allocated_size);
+    Class& c = classes_[size_class];
+    c.live_bytes.fetch_add(Weigh(weight, allocated_size),
+                           std::memory_order_relaxed);
+    c.fragmentation_bytes.fetch_add(
+        Weigh(weight, allocated_size - requested_size),
+        std::memory_order_relaxed);
+    c.histogram[Bucket(requested_size, allocated_size)].fetch_add(
+        Weigh(weight, 1), std::memory_order_relaxed);
+  }
+
+  void RecordDeallocation(size_t size_class, size_t requested_size,
+                          size_t allocated_size, double weight) {
+    if (size_class == 0) return;
+    TC_ASSERT_LT(size_class, kNumClasses);
+    Class& c = classes_[size_class];
+    c.live_bytes.fetch_sub(Weigh(weight, allocated_size),
+                           std::memory_order_relaxed);
+    c.fragmentation_bytes.fetch_sub(
+        Weigh(weight, allocated_size - requested_size),
+        std::memory_order_relaxed);
+  }
+
+  struct Stats {
+    int64_t live_bytes = 0;
+    int64_t fragmentation_bytes = 0;
+    int64_t histogram[kBuckets] = {};
+  };
+
+  Stats GetStats(size_t size_class) const {
+    const Class& c = classes_[size_class];
+    Stats s;
+    s.live_bytes = c.live_bytes.load(std::memory_order_relaxed);
+    s.fragmentation_bytes =
+        c.fragmentation_bytes.load(std::memory_order_relaxed);
+    for (int i = 0; i < kBuckets; ++i) {
+      s.histogram[i] = c.histogram[i].load(std::memory_order_relaxed);
+    }
+    return s;
+  }
+
+  void Print(Printer& out, const SizeMap& sizemap) const {
+    for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
+      const Stats s = GetStats(size_class);
+      if (s.live_bytes == 0 &&
+          std::all_of(s.histogram, s.histogram + kBuckets,
+                      [](int64_t n) { return n == 0; })) {
+        continue;
+      }
+      out.printf(
+          "class %3zu [ %8zu bytes ] : %12lld live; %12lld wasted (%5.1f%%);",
+          size_class, sizemap.class_to_size(size_class),
+          static_cast<long long>(s.live_bytes),
+          static_cast<long long>(s.fragmentation_bytes),
+          s.live_bytes > 0 ? 100. * s.fragmentation_bytes / s.live_bytes : 0.);
+      for (int i = 0; i < kBuckets; ++i) {
+        out.printf(" %lld", static_cast<long long>(s.histogram[i]));
+      }
+      out.printf("\n");
+    }
+  }
+
+  void PrintInPbtxt(PbtxtRegion& region, size_t size_class) const {
+    const Stats s = GetStats(size_class);
+    region.PrintI64("sampled_live_bytes", s.live_bytes);
+    region.PrintI64("sampled_internal_fragmentation_bytes",
+                    s.fragmentation_bytes);
+    for (int i = 0; i < kBuckets; ++i) {
+      PbtxtRegion bucket = region.CreateSubRegion("requested_size_histogram");
+      bucket.PrintI64("wasted_eighths", i);
+      bucket.PrintI64("count", s.histogram[i]);
+    }
+  }
+
+ private:
+  struct Class {
+    std::atomic<int64_t> live_bytes{0};
+    std::atomic<int64_t> fragmentation_bytes{0};
+    // Cumulative over all sampled allocations.
+    std::atomic<int64_t> histogram[kBuckets] = {};
+  };
+
+  // Deallocations weigh their object exactly as its allocation did, so the
+  // live totals return to zero.
+  static int64_t Weigh(double weight, size_t n) {
+    return static_cast<int64_t>(weight * n);
+  }
+
+  static int Bucket(size_t requested_size, size_t allocated_size) {
+    if (allocated_size == 0) return 0;
+    return std::min<size_t>(
+        kBuckets - 1,
+        (allocated_size - requested_size) * kBuckets / allocated_size);
+  }
+
+  Class classes_[kNumClasses] = {};
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_SIZE_CLASS_FRAGMENTATION_H_
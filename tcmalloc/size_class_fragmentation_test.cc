@@ -0,0 +1,69 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/size_class_fragmentation.h"
+
+#include <memory>
+
+#include "gtest/gtest.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+TEST(SizeClassFragmentationTest, TracksLiveFragmentation) {
+  auto fragmentation = std::make_unique<SizeClassFragmentation>();
+
+  fragmentation->RecordAllocation(1, 48, 64, 2.0);
+  fragmentation->RecordAllocation(1, 64, 64, 1.0);
+  SizeClassFragmentation::Stats s = fragmentation->GetStats(1);
+  EXPECT_EQ(s.live_bytes, 3 * 64);
+  EXPECT_EQ(s.fragmentation_bytes, 2 * 16);
+
+  fragmentation->RecordDeallocation(1, 48, 64, 2.0);
+  s = fragmentation->GetStats(1);
+  EXPECT_EQ(s.live_bytes, 64);
+  EXPECT_EQ(s.fragmentation_bytes, 0);
+
+  // Other classes are untouched.
+  EXPECT_EQ(fragmentation->GetStats(2).live_bytes, 0);
+}
+
+TEST(SizeClassFragmentationTest, Histogram) {
+  auto fragmentation = std::make_unique<SizeClassFragmentation>();
+
+  // Wastes nothing, an eighth, half, and all but one byte of 64 bytes.
+  fragmentation->RecordAllocation(1, 64, 64, 1.0);
+  fragmentation->RecordAllocation(1, 56, 64, 1.0);
+  fragmentation->RecordAllocation(1, 32, 64, 3.0);
+  fragmentation->RecordAllocation(1, 1, 64, 1.0);
+  fragmentation->RecordDeallocation(1, 32, 64, 3.0);
+
+  // The histogram covers all allocations, not just the live ones.
+  const SizeClassFragmentation::Stats s = fragmentation->GetStats(1);
+  EXPECT_EQ(s.histogram[0], 1);
+  EXPECT_EQ(s.histogram[1], 1);
+  EXPECT_EQ(s.histogram[4], 3);
+  EXPECT_EQ(s.histogram[SizeClassFragmentation::kBuckets - 1], 1);
+}
+
+TEST(SizeClassFragmentationTest, IgnoresLargeAllocations) {
+  auto fragmentation = std::make_unique<SizeClassFragmentation>();
+  fragmentation->RecordAllocation(0, 1, 1 << 20, 1.0);
+  EXPECT_EQ(fragmentation->GetStats(0).live_bytes, 0);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
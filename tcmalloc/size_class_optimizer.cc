@@ -0,0 +1,381 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/size_class_optimizer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "tcmalloc/internal/profile.pb.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/gzip_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_page_aware_allocator.h"
+#include "tcmalloc/internal/size_class_info.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/sizemap.h"
+#include "tcmalloc/span.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// SizeMap::IsValidSizeClass rejects larger spans.
+constexpr size_t kMaxSpanPages = 32;
+
+// Batches move about this many bytes between the caches, within
+// [2, kMaxBatch] objects, as in the built-in size classes.
+constexpr size_t kBatchBytes = 64 << 10;
+constexpr size_t kMaxBatch = 32;
+
+constexpr double kInfinity = std::numeric_limits<double>::infinity();
+
+// Re-exports SizeMap's validation of a whole table.
+struct Validator : SizeMap {
+  using SizeMap::ValidSizeClasses;
+};
+
+// The alignment observed by the built-in size classes.
+size_t Alignment(size_t size) {
+  size_t ret = static_cast<size_t>(kAlignment);
+  if (size >= 1024) {
+    // SizeMap::ClassIndexMaybe requires 128-byte alignment for sizes >=1024.
+    ret = 128;
+  } else if (size >= 512) {
+    ret = 64;
+#if defined(__cpp_aligned_new) && __STDCPP_DEFAULT_NEW_ALIGNMENT__ > 8
+  } else if (size >= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+    ret = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+#endif
+  } else if (size >= 8) {
+    ret = 8;
+  }
+  return ret;
+}
+
+// Returns the end-of-span and span metadata overhead of a size class, as a
+// fraction of the bytes handed out from each span.
+double FixedWaste(size_t size, size_t pages) {
+  const size_t span_bytes = pages * kPageSize;
+  const size_t objects = span_bytes / size;
+  return static_cast<double>(span_bytes - objects * size + sizeof(Span)) /
+         (objects * size);
+}
+
+bool IsValidSpan(size_t size, size_t pages) {
+  return pages * kPageSize >= size &&
+         Span::IsValidSizeClass(size, Length(pages)) &&
+         HugePageAwareAllocator::IsValidSizeClass(size, Length(pages));
+}
+
+struct SpanChoice {
+  size_t pages;
+  double waste;
+};
+
+// Returns the span lengths worth considering for a size: those with less
+// fixed waste than every shorter span, in increasing length.
+std::vector<SpanChoice> SpanChoices(size_t size) {
+  std::vector<SpanChoice> choices;
+  for (size_t pages = 1; pages <= kMaxSpanPages; ++pages) {
+    if (!IsValidSpan(size, pages)) continue;
+    const double waste = FixedWaste(size, pages);
+    if (choices.empty() || waste < choices.back().waste) {
+      choices.push_back({pages, waste});
+    }
+  }
+  return choices;
+}
+
+struct SpanCost {
+  double cost = kInfinity;
+  size_t pages = 0;
+};
+
+// Picks the span length minimizing the fixed waste over object_bytes plus one
+// partially used span.
+SpanCost BestSpan(absl::Span<const SpanChoice> choices, double object_bytes) {
+  SpanCost best;
+  for (const SpanChoice& choice : choices) {
+    const double cost =
+        choice.waste * object_bytes + choice.pages * kPageSize;
+    if (cost < best.cost) {
+      best = {cost, choice.pages};
+    }
+  }
+  return best;
+}
+
+size_t BatchSize(size_t size) {
+  return std::clamp<size_t>(kBatchBytes / size, 2, kMaxBatch);
+}
+
+}  // namespace
+
+absl::Status AddProfileToHistogram(absl::string_view encoded_profile,
+                                   RequestedSizeHistogram& histogram) {
+  google::protobuf::io::ArrayInputStream stream(encoded_profile.data(),
+                                                encoded_profile.size());
+  google::protobuf::io::GzipInputStream gzip_stream(&stream);
+  google::protobuf::io::CodedInputStream coded_stream(&gzip_stream);
+
+  perftools::profiles::Profile profile;
+  if (!profile.ParseFromCodedStream(&coded_stream)) {
+    return absl::InvalidArgumentError("failed to parse profile");
+  }
+
+  auto string_at = [&](int64_t i) -> absl::string_view {
+    if (i < 0 || i >= profile.string_table_size()) return "";
+    return profile.string_table(i);
+  };
+
+  int objects_index = -1;
+  for (int i = 0; i < profile.sample_type_size(); ++i) {
+    if (string_at(profile.sample_type(i).type()) == "objects") {
+      objects_index = i;
+      break;
+    }
+  }
+  if (objects_index < 0) {
+    return absl::InvalidArgumentError("profile has no objects sample type");
+  }
+
+  for (const perftools::profiles::Sample& sample : profile.sample()) {
+    if (objects_index >= sample.value_size()) continue;
+    size_t requested = 0;
+    for (const perftools::profiles::Label& label : sample.label()) {
+      if (string_at(label.key()) == "request") {
+        requested = label.num();
+        break;
+      }
+    }
+    if (requested == 0 || requested > kMaxSize) continue;
+    histogram[requested] += sample.value(objects_index);
+  }
+  return absl::OkStatus();
+}
+
+double SizeClassOverhead(const RequestedSizeHistogram& histogram,
+                         absl::Span<const SizeClassInfo> classes) {
+  if (classes.size() < 2) return kInfinity;
+  const absl::Span<const SizeClassInfo> nonzero = classes.subspan(1);
+  std::vector<double> objects(nonzero.size(), 0.);
+
+  double overhead = 0;
+  for (const auto& [size, count] : histogram) {
+    auto it = std::partition_point(
+        nonzero.begin(), nonzero.end(),
+        [size = size](const SizeClassInfo& c) { return c.size < size; });
+    if (it == nonzero.end()) continue;
+    overhead += count * (it->size - size);
+    objects[it - nonzero.begin()] += count;
+  }
+  for (size_t c = 0; c < nonzero.size(); ++c) {
+    const size_t span_bytes = nonzero[c].bytes.raw_num();
+    overhead +=
+        FixedWaste(nonzero[c].size, span_bytes / kPageSize) * objects[c] *
+            nonzero[c].size +
+        span_bytes;
+  }
+  return overhead;
+}
+
+absl::StatusOr<std::vector<SizeClassInfo>> OptimizeSizeClasses(
+    const RequestedSizeHistogram& histogram,
+    const SizeClassOptimizerOptions& options) {
+  if (options.max_classes == 0 || options.max_classes >= kNumBaseClasses) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "max_classes must be in [1, ", kNumBaseClasses - 1, "]"));
+  }
+
+  // Candidate sizes, with a sentinel of 0 standing for "no previous class".
+  std::vector<size_t> sizes = {0};
+  for (size_t size = static_cast<size_t>(kAlignment); size <= kMaxSize;
+       size += Alignment(size)) {
+    sizes.push_back(size);
+  }
+  if (sizes.back() != kMaxSize) {
+    return absl::InternalError("kMaxSize is not a candidate size");
+  }
+  const size_t num_sizes = sizes.size();
+
+  // Prefix sums of the objects, and of their requested bytes, up to and
+  // including each candidate size.
+  std::vector<double> objects(num_sizes, 0.), bytes(num_sizes, 0.);
+  auto it = histogram.begin();
+  for (size_t i = 1; i < num_sizes; ++i) {
+    objects[i] = objects[i - 1];
+    bytes[i] = bytes[i - 1];
+    for (; it != histogram.end() && it->first <= sizes[i]; ++it) {
+      objects[i] += it->second;
+      bytes[i] += it->second * it->first;
+    }
+  }
+
+  std::vector<std::vector<SpanChoice>> span_choices(num_sizes);
+  for (size_t i = 1; i < num_sizes; ++i) {
+    span_choices[i] = SpanChoices(sizes[i]);
+  }
+
+  // A size class may follow prev if it is at most max_increment larger, or
+  // one alignment step larger.
+  auto may_follow = [&](size_t prev, size_t size) {
+    return size - prev <=
+           std::max<double>(prev * options.max_increment, Alignment(size));
+  };
+
+  // cost[k][j] is the least overhead of covering all sizes up to sizes[j]
+  // with k size classes, the largest of them being sizes[j].  This is a 1-D
+  // segmentation: the overhead of a class depends only on the sizes between
+  // it and the previous class.
+  const size_t max_classes = options.max_classes;
+  std::vector<std::vector<double>> cost(
+      max_classes + 1, std::vector<double>(num_sizes, kInfinity));
+  std::vector<std::vector<uint32_t>> prev(
+      max_classes + 1, std::vector<uint32_t>(num_sizes, 0));
+  cost[0][0] = 0;
+  for (size_t j = 1; j < num_sizes; ++j) {
+    if (span_choices[j].empty()) continue;
+    for (size_t i = j; i-- > 0;) {
+      if (!may_follow(sizes[i], sizes[j])) break;
+      const double n = objects[j] - objects[i];
+      const double fragmentation = n * sizes[j] - (bytes[j] - bytes[i]);
+      const double segment =
+          fragmentation + BestSpan(span_choices[j], n * sizes[j]).cost;
+      for (size_t k = 1; k <= max_classes; ++k) {
+        const double total = cost[k - 1][i] + segment;
+        if (total < cost[k][j]) {
+          cost[k][j] = total;
+          prev[k][j] = i;
+        }
+      }
+    }
+  }
+
+  size_t best_k = 0;
+  for (size_t k = 1; k <= max_classes; ++k) {
+    if (cost[k][num_sizes - 1] < cost[best_k][num_sizes - 1]) best_k = k;
+  }
+  if (best_k == 0) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("cannot cover sizes up to ", kMaxSize, " with ",
+                     max_classes, " size classes"));
+  }
+
+  std::vector<size_t> chosen;
+  for (size_t k = best_k, j = num_sizes - 1; k > 0; j = prev[k--][j]) {
+    chosen.push_back(j);
+  }
+  std::reverse(chosen.begin(), chosen.end());
+
+  std::vector<SizeClassInfo> classes = {{0, 0, 0}};
+  size_t last = 0;
+  for (size_t j : chosen) {
+    const double n = objects[j] - objects[last];
+    const size_t pages = BestSpan(span_choices[j], n * sizes[j]).pages;
+    classes.push_back({static_cast<uint32_t>(sizes[j]), pages * kPageSize,
+                       static_cast<uint8_t>(BatchSize(sizes[j]))});
+    last = j;
+  }
+
+  if (!Validator::ValidSizeClasses(classes)) {
+    return absl::InternalError("generated size classes are invalid");
+  }
+  return classes;
+}
+
+std::string FormatSizeClasses(absl::Span<const SizeClassInfo> classes) {
+  std::string out = absl::StrCat(
+      "// Generated by size_class_optimizer.  DO NOT EDIT.\n"
+      "//\n"
+      "// Linking this file into a binary makes TCMalloc use these size "
+      "classes\n"
+      "// instead of its default ones.  They only apply to builds with ",
+      kPageSize, R"(-byte pages.
+
+#include "absl/base/attributes.h"
+#include "tcmalloc/internal/size_class_info.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// clang-format off
+static constexpr SizeClassAssumptions kAssumptions{
+)");
+  absl::StrAppendFormat(&out, "  .has_expanded_classes = %s,\n",
+                        kHasExpandedClasses ? "true" : "false");
+  absl::StrAppendFormat(&out, "  .span_size = %zu,\n", sizeof(Span));
+  absl::StrAppendFormat(&out, "  .sampling_interval = %zu,\n",
+                        kDefaultProfileSamplingInterval);
+  absl::StrAppendFormat(&out, "  .large_size = %d,\n", SizeMap::kLargeSize);
+  absl::StrAppendFormat(&out, "  .large_size_alignment = %d,\n",
+                        SizeMap::kLargeSizeAlignment);
+  absl::StrAppend(&out, R"(};
+static constexpr SizeClassInfo kClasses[] = {
+//  bytes  span_bytes batch    class      objs    fixed      inc
+)");
+  for (size_t c = 0; c < classes.size(); ++c) {
+    const size_t size = classes[c].size;
+    const size_t span_bytes = classes[c].bytes.raw_num();
+    const size_t objects = size > 0 ? span_bytes / size : 0;
+    const double fixed =
+        size > 0 ? FixedWaste(size, span_bytes / kPageSize) * 100 : 0;
+    const double inc =
+        c > 1 ? (static_cast<double>(size) / classes[c - 1].size - 1) * 100
+              : 0;
+    absl::StrAppendFormat(&out,
+                          "  {%7zu, %10zu, %4u},  // %3zu %9zu  %6.2f%%  "
+                          "%6.2f%%\n",
+                          size, span_bytes, classes[c].num_to_move, c, objects,
+                          fixed, inc);
+  }
+  absl::StrAppend(&out, R"(};
+// clang-format on
+
+ABSL_ATTRIBUTE_UNUSED const SizeClasses* default_custom_size_classes() {
+  static constexpr SizeClasses kCustomSizeClasses{kClasses, kAssumptions};
+  return &kCustomSizeClasses;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+)");
+  return out;
+}
+
+std::string FormatRuntimeSizeClasses(absl::Span<const SizeClassInfo> classes) {
+  std::string out =
+      "# size:span_bytes:batch, generated by size_class_optimizer\n";
+  for (size_t c = 1; c < classes.size(); ++c) {
+    absl::StrAppend(&out, classes[c].size, ":", classes[c].bytes.raw_num(), ":",
+                    classes[c].num_to_move, "\n");
+  }
+  return out;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -0,0 +1,78 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Offline optimization of size class tables for a given workload.
+#ifndef TCMALLOC_SIZE_CLASS_OPTIMIZER_H_
+#define TCMALLOC_SIZE_CLASS_OPTIMIZER_H_
+
+#include <stddef.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/size_class_info.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Estimated number of objects by requested size.
+using RequestedSizeHistogram = std::map<size_t, double>;
+
+// Adds the objects of a gzip-encoded profile, as produced by Marshal(), to
+// histogram.  Requests larger than kMaxSize are ignored, since they are not
+// served from size classes.
+absl::Status AddProfileToHistogram(absl::string_view encoded_profile,
+                                   RequestedSizeHistogram& histogram);
+
+struct SizeClassOptimizerOptions {
+  // Maximum number of size classes, not counting size class 0.
+  size_t max_classes = kNumBaseClasses - 1;
+  // Maximum increment from one size class to the next, as a fraction of the
+  // smaller one.  Sizes that are missing from the profiles still get size
+  // classes at least this close.
+  double max_increment = 0.25;
+};
+
+// Returns the overhead, in bytes, of backing the objects in histogram with
+// the given size classes: the internal fragmentation of each object, the
+// end-of-span and span metadata overhead of each size class, and one span per
+// size class that is assumed to be partially used.
+double SizeClassOverhead(const RequestedSizeHistogram& histogram,
+                         absl::Span<const SizeClassInfo> classes);
+
+// Returns the size classes, including size class 0, minimizing
+// SizeClassOverhead() for histogram, subject to options.
+absl::StatusOr<std::vector<SizeClassInfo>> OptimizeSizeClasses(
+    const RequestedSizeHistogram& histogram,
+    const SizeClassOptimizerOptions& options);
+
+// Returns the source of a translation unit defining the given size classes.
+// Linking it into a binary makes TCMalloc use them instead of the default
+// ones, the same way want_legacy_size_classes does.
+std::string FormatSizeClasses(absl::Span<const SizeClassInfo> classes);
+
+// Returns the given size classes in the format read from
+// TCMALLOC_SIZE_CLASSES_FILE, which takes effect without rebuilding.
+std::string FormatRuntimeSizeClasses(absl::Span<const SizeClassInfo> classes);
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+
+#endif  // TCMALLOC_SIZE_CLASS_OPTIMIZER_H_
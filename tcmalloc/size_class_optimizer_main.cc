@@ -0,0 +1,118 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Generates size classes tuned for the heap profiles of one binary.
+//
+// Usage: size_class_optimizer [--max_classes=N] [--max_increment=F]
+//            [--runtime_format] [--output=size_classes.cc] profile...
+//
+// Each profile is a gzip-encoded heap profile, as returned by Marshal() for
+// MallocExtension::SnapshotCurrent(ProfileType::kHeap).  The generated file
+// must be built for the same page size as this tool.
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "tcmalloc/internal/size_class_info.h"
+#include "tcmalloc/size_class_optimizer.h"
+#include "tcmalloc/sizemap.h"
+
+ABSL_FLAG(size_t, max_classes,
+          tcmalloc::tcmalloc_internal::SizeClassOptimizerOptions().max_classes,
+          "Maximum number of size classes, not counting size class 0.");
+ABSL_FLAG(double, max_increment,
+          tcmalloc::tcmalloc_internal::SizeClassOptimizerOptions()
+              .max_increment,
+          "Maximum increment from one size class to the next, as a fraction "
+          "of the smaller one.");
+ABSL_FLAG(bool, runtime_format, false,
+          "Write the size classes in the format read from "
+          "TCMALLOC_SIZE_CLASSES_FILE, rather than as a .cc file.");
+ABSL_FLAG(std::string, output, "",
+          "File to write the generated size classes to. Defaults to stdout.");
+
+int main(int argc, char** argv) {
+  using tcmalloc::tcmalloc_internal::AddProfileToHistogram;
+  using tcmalloc::tcmalloc_internal::FormatRuntimeSizeClasses;
+  using tcmalloc::tcmalloc_internal::FormatSizeClasses;
+  using tcmalloc::tcmalloc_internal::OptimizeSizeClasses;
+  using tcmalloc::tcmalloc_internal::RequestedSizeHistogram;
+  using tcmalloc::tcmalloc_internal::SizeClassInfo;
+  using tcmalloc::tcmalloc_internal::SizeClassOptimizerOptions;
+  using tcmalloc::tcmalloc_internal::SizeClassOverhead;
+  using tcmalloc::tcmalloc_internal::SizeMap;
+
+  std::vector<char*> profiles = absl::ParseCommandLine(argc, argv);
+  if (profiles.size() < 2) {
+    fprintf(stderr, "usage: %s [flags] profile...\n", argv[0]);
+    return 1;
+  }
+
+  RequestedSizeHistogram histogram;
+  for (size_t i = 1; i < profiles.size(); ++i) {
+    std::ifstream in(profiles[i], std::ios::binary);
+    if (!in) {
+      fprintf(stderr, "cannot open %s\n", profiles[i]);
+      return 1;
+    }
+    const std::string encoded{std::istreambuf_iterator<char>(in),
+                              std::istreambuf_iterator<char>()};
+    if (absl::Status status = AddProfileToHistogram(encoded, histogram);
+        !status.ok()) {
+      fprintf(stderr, "%s: %s\n", profiles[i], status.ToString().c_str());
+      return 1;
+    }
+  }
+
+  SizeClassOptimizerOptions options;
+  options.max_classes = absl::GetFlag(FLAGS_max_classes);
+  options.max_increment = absl::GetFlag(FLAGS_max_increment);
+  absl::StatusOr<std::vector<SizeClassInfo>> classes =
+      OptimizeSizeClasses(histogram, options);
+  if (!classes.ok()) {
+    fprintf(stderr, "%s\n", classes.status().ToString().c_str());
+    return 1;
+  }
+
+  const double current =
+      SizeClassOverhead(histogram, SizeMap::CurrentClasses().classes);
+  const double optimized = SizeClassOverhead(histogram, *classes);
+  fprintf(stderr,
+          "%zu size classes; estimated overhead %.0f bytes, %.0f bytes with "
+          "the current size classes\n",
+          classes->size() - 1, optimized, current);
+
+  const std::string source = absl::GetFlag(FLAGS_runtime_format)
+                                 ? FormatRuntimeSizeClasses(*classes)
+                                 : FormatSizeClasses(*classes);
+  const std::string output = absl::GetFlag(FLAGS_output);
+  if (output.empty()) {
+    fwrite(source.data(), 1, source.size(), stdout);
+    return 0;
+  }
+  std::ofstream out(output);
+  out << source;
+  if (!out) {
+    fprintf(stderr, "cannot write %s\n", output.c_str());
+    return 1;
+  }
+  return 0;
+}
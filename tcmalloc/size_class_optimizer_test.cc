@@ -0,0 +1,144 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/size_class_optimizer.h"
+
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/fake_profile.h"
+#include "tcmalloc/internal/size_class_info.h"
+#include "tcmalloc/internal_malloc_extension.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/profile_marshaler.h"
+#include "tcmalloc/sizemap.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+using ::testing::HasSubstr;
+
+const SizeClassInfo* ClassFor(absl::Span<const SizeClassInfo> classes,
+                              size_t size) {
+  for (size_t c = 1; c < classes.size(); ++c) {
+    if (classes[c].size >= size) return &classes[c];
+  }
+  return nullptr;
+}
+
+TEST(SizeClassOptimizerTest, ReadsMarshaledProfiles) {
+  auto fake_profile = std::make_unique<FakeProfile>();
+  fake_profile->SetType(ProfileType::kAllocations);
+
+  std::vector<Profile::Sample> samples;
+  for (auto [requested_size, count] :
+       {std::pair<size_t, int64_t>{100, 7}, {5000, 3}, {kMaxSize + 1, 1}}) {
+    auto& sample = samples.emplace_back();
+    sample.requested_size = requested_size;
+    sample.allocated_size = requested_size;
+    sample.count = count;
+    sample.sum = count * requested_size;
+    sample.depth = 1;
+    sample.stack[0] = reinterpret_cast<void*>(requested_size);
+  }
+  fake_profile->SetSamples(std::move(samples));
+
+  absl::StatusOr<std::string> encoded = Marshal(
+      ProfileAccessor::MakeProfile(std::move(fake_profile)));
+  ASSERT_TRUE(encoded.ok());
+
+  RequestedSizeHistogram histogram;
+  ASSERT_TRUE(AddProfileToHistogram(*encoded, histogram).ok());
+  ASSERT_TRUE(AddProfileToHistogram(*encoded, histogram).ok());
+  EXPECT_THAT(histogram, testing::ElementsAre(testing::Pair(100, 14),
+                                              testing::Pair(5000, 6)));
+
+  EXPECT_FALSE(AddProfileToHistogram("not a profile", histogram).ok());
+}
+
+TEST(SizeClassOptimizerTest, FitsOddSizes) {
+  // A few heavily used sizes just past the built-in size classes.
+  RequestedSizeHistogram histogram = {
+      {40, 1e7}, {1100, 1e6}, {3000, 1e5}};
+
+  absl::StatusOr<std::vector<SizeClassInfo>> classes =
+      OptimizeSizeClasses(histogram, SizeClassOptimizerOptions());
+  ASSERT_TRUE(classes.ok()) << classes.status();
+  EXPECT_LT(classes->size(), kNumBaseClasses + 1);
+  EXPECT_EQ(classes->back().size, kMaxSize);
+
+  // Each odd size gets a size class of its own, rounded up to its alignment.
+  EXPECT_EQ(ClassFor(*classes, 40)->size, 40);
+  EXPECT_EQ(ClassFor(*classes, 1100)->size, 1152);
+  EXPECT_EQ(ClassFor(*classes, 3000)->size, 3072);
+
+  EXPECT_LE(SizeClassOverhead(histogram, *classes),
+            SizeClassOverhead(histogram, SizeMap::CurrentClasses().classes));
+}
+
+TEST(SizeClassOptimizerTest, BoundsIncrements) {
+  SizeClassOptimizerOptions options;
+  absl::StatusOr<std::vector<SizeClassInfo>> classes =
+      OptimizeSizeClasses({}, options);
+  ASSERT_TRUE(classes.ok()) << classes.status();
+  for (size_t c = 2; c < classes->size(); ++c) {
+    const size_t prev = (*classes)[c - 1].size;
+    const size_t size = (*classes)[c].size;
+    EXPECT_TRUE(size - prev <= prev * options.max_increment ||
+                size - prev <= 128)
+        << prev << " " << size;
+  }
+
+  options.max_classes = 4;
+  EXPECT_EQ(OptimizeSizeClasses({}, options).status().code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST(SizeClassOptimizerTest, Format) {
+  absl::StatusOr<std::vector<SizeClassInfo>> classes =
+      OptimizeSizeClasses({{1100, 1e6}}, SizeClassOptimizerOptions());
+  ASSERT_TRUE(classes.ok()) << classes.status();
+
+  const std::string source = FormatSizeClasses(*classes);
+  EXPECT_THAT(source,
+              HasSubstr("const SizeClasses* default_custom_size_classes()"));
+  EXPECT_THAT(source, HasSubstr("{      0,          0,    0}"));
+  EXPECT_THAT(source, HasSubstr("{   1152,"));
+
+  // The runtime format round-trips through SizeMap's parser.
+  std::vector<SizeClassInfo> parsed(kNumBaseClasses);
+  ASSERT_EQ(SizeMap::ParseSizeClasses(FormatRuntimeSizeClasses(*classes),
+                                      absl::MakeSpan(parsed)),
+            classes->size());
+  for (size_t c = 0; c < classes->size(); ++c) {
+    EXPECT_EQ(parsed[c].size, (*classes)[c].size);
+    EXPECT_EQ(parsed[c].bytes, (*classes)[c].bytes);
+    EXPECT_EQ(parsed[c].num_to_move, (*classes)[c].num_to_move);
+  }
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -167,6 +167,67 @@ static constexpr SizeClassInfo List[] = {
   {229376,     229376,    2},  // 46         1   0.03%      0.03%   40.00%
   {262144,     262144,    2},  // 47         1   0.02%      0.03%   14.29%
 };
+#elif TCMALLOC_PAGE_SHIFT == 16
+static_assert(kMaxSize == 262144, "kMaxSize mismatch");
+static constexpr SizeClassAssumptions Assumptions{
+  .has_expanded_classes = true,
+  .span_size = 64,
+  .sampling_interval = 2097152,
+  .large_size = 1024,
+  .large_size_alignment = 128,
+};
+static constexpr SizeClassInfo List[] = {
+//                                             |      waste       |
+//  bytes  span_bytes batch    class      objs | fixed   sampling |    inc
+  {     0,          0,    0},  //  0         0   0.00%      0.00%    0.00%
+  {     8,      65536,   32},  //  1      8192   0.10%      3.15%    0.00%
+  {    16,      65536,   32},  //  2      4096   0.10%      3.15%  100.00%
+  {    32,      65536,   32},  //  3      2048   0.10%      3.15%  100.00%
+  {    64,      65536,   32},  //  4      1024   0.10%      3.15%  100.00%
+  {    80,      65536,   32},  //  5       819   0.12%      3.15%   25.00%
+  {    96,      65536,   32},  //  6       682   0.20%      3.15%   20.00%
+  {   112,      65536,   32},  //  7       585   0.12%      3.15%   16.67%
+  {   128,      65536,   32},  //  8       512   0.10%      3.15%   14.29%
+  {   160,      65536,   32},  //  9       409   0.24%      3.15%   25.00%
+  {   176,      65536,   32},  // 10       372   0.20%      3.15%   10.00%
+  {   208,      65536,   32},  // 11       315   0.12%      3.15%   18.18%
+  {   256,      65536,   32},  // 12       256   0.10%      3.15%   23.08%
+  {   312,      65536,   32},  // 13       210   0.12%      3.15%   21.88%
+  {   400,      65536,   32},  // 14       163   0.61%      3.15%   28.21%
+  {   448,      65536,   32},  // 15       146   0.29%      3.15%   12.00%
+  {   512,      65536,   32},  // 16       128   0.10%      3.15%   14.29%
+  {   640,      65536,   32},  // 17       102   0.49%      3.15%   25.00%
+  {   768,      65536,   32},  // 18        85   0.49%      3.15%   20.00%
+  {   896,      65536,   32},  // 19        73   0.29%      3.15%   16.67%
+  {  1024,      65536,   32},  // 20        64   0.10%      3.15%   14.29%
+  {  1280,      65536,   32},  // 21        51   0.49%      3.15%   25.00%
+  {  1536,      65536,   32},  // 22        42   1.69%      3.15%   20.00%
+  {  2048,      65536,   32},  // 23        32   0.10%      3.15%   33.33%
+  {  2304,      65536,   28},  // 24        28   1.69%      3.15%   12.50%
+  {  2688,      65536,   24},  // 25        24   1.69%      3.15%   16.67%
+  {  3200,      65536,   20},  // 26        20   2.50%      3.15%   19.05%
+  {  4096,      65536,   16},  // 27        16   0.10%      3.15%   28.00%
+  {  4608,      65536,   14},  // 28        14   1.69%      3.15%   12.50%
+  {  5376,      65536,   12},  // 29        12   1.69%      3.15%   16.67%
+  {  6528,      65536,   10},  // 30        10   0.49%      3.15%   21.43%
+  {  8192,      65536,    8},  // 31         8   0.10%      3.15%   25.49%
+  { 10880,      65536,    6},  // 32         6   0.49%      3.15%   32.81%
+  { 13952,     131072,    4},  // 33         9   4.43%      3.15%   28.24%
+  { 16384,      65536,    4},  // 34         4   0.10%      3.15%   17.43%
+  { 21760,      65536,    3},  // 35         3   0.49%      3.15%   32.81%
+  { 26112,     131072,    2},  // 36         5   0.44%      3.15%   20.00%
+  { 32768,      65536,    2},  // 37         2   0.10%      3.15%   25.49%
+  { 40960,     131072,    2},  // 38         3   6.72%      3.15%   25.00%
+  { 54528,     327680,    2},  // 39         6   0.18%      3.15%   33.12%
+  { 65536,      65536,    2},  // 40         1   0.10%      0.03%   20.19%
+  { 81920,     262144,    2},  // 41         3   6.69%      6.28%   25.00%
+  { 98304,     196608,    2},  // 42         2   0.03%      6.28%   20.00%
+  {114688,     458752,    2},  // 43         4   0.01%      6.28%   16.67%
+  {131072,     131072,    2},  // 44         1   0.05%      0.03%   14.29%
+  {163840,     327680,    2},  // 45         2   0.02%      9.40%   25.00%
+  {229376,     458752,    2},  // 46         2   0.01%     12.53%   40.00%
+  {262144,     262144,    2},  // 47         1   0.02%      0.03%   14.29%
+};
 #elif TCMALLOC_PAGE_SHIFT == 18
 static_assert(kMaxSize == 262144, "kMaxSize mismatch");
 static constexpr SizeClassAssumptions Assumptions{
@@ -396,6 +457,67 @@ static constexpr SizeClassInfo List[] = {
   {229376,     229376,    2},  // 46         1   0.03%      0.03%   40.00%
   {262144,     262144,    2},  // 47         1   0.02%      0.03%   14.29%
 };
+#elif TCMALLOC_PAGE_SHIFT == 16
+static_assert(kMaxSize == 262144, "kMaxSize mismatch");
+static constexpr SizeClassAssumptions Assumptions{
+  .has_expanded_classes = true,
+  .span_size = 64,
+  .sampling_interval = 2097152,
+  .large_size = 1024,
+  .large_size_alignment = 128,
+};
+static constexpr SizeClassInfo List[] = {
+//                                             |      waste       |
+//  bytes  span_bytes batch    class      objs | fixed   sampling |    inc
+  {     0,          0,    0},  //  0         0   0.00%      0.00%    0.00%
+  {     8,      65536,   32},  //  1      8192   0.10%      3.15%    0.00%
+  {    16,      65536,   32},  //  2      4096   0.10%      3.15%  100.00%
+  {    32,      65536,   32},  //  3      2048   0.10%      3.15%  100.00%
+  {    64,      65536,   32},  //  4      1024   0.10%      3.15%  100.00%
+  {    80,      65536,   32},  //  5       819   0.12%      3.15%   25.00%
+  {    96,      65536,   32},  //  6       682   0.20%      3.15%   20.00%
+  {   112,      65536,   32},  //  7       585   0.12%      3.15%   16.67%
+  {   128,      65536,   32},  //  8       512   0.10%      3.15%   14.29%
+  {   160,      65536,   32},  //  9       409   0.24%      3.15%   25.00%
+  {   176,      65536,   32},  // 10       372   0.20%      3.15%   10.00%
+  {   208,      65536,   32},  // 11       315   0.12%      3.15%   18.18%
+  {   256,      65536,   32},  // 12       256   0.10%      3.15%   23.08%
+  {   320,      65536,   32},  // 13       204   0.49%      3.15%   25.00%
+  {   400,      65536,   32},  // 14       163   0.61%      3.15%   25.00%
+  {   448,      65536,   32},  // 15       146   0.29%      3.15%   12.00%
+  {   512,      65536,   32},  // 16       128   0.10%      3.15%   14.29%
+  {   640,      65536,   32},  // 17       102   0.49%      3.15%   25.00%
+  {   768,      65536,   32},  // 18        85   0.49%      3.15%   20.00%
+  {   896,      65536,   32},  // 19        73   0.29%      3.15%   16.67%
+  {  1024,      65536,   32},  // 20        64   0.10%      3.15%   14.29%
+  {  1280,      65536,   32},  // 21        51   0.49%      3.15%   25.00%
+  {  1536,      65536,   32},  // 22        42   1.69%      3.15%   20.00%
+  {  2048,      65536,   32},  // 23        32   0.10%      3.15%   33.33%
+  {  2304,      65536,   28},  // 24        28   1.69%      3.15%   12.50%
+  {  2688,      65536,   24},  // 25        24   1.69%      3.15%   16.67%
+  {  3200,      65536,   20},  // 26        20   2.50%      3.15%   19.05%
+  {  4096,      65536,   16},  // 27        16   0.10%      3.15%   28.00%
+  {  4608,      65536,   14},  // 28        14   1.69%      3.15%   12.50%
+  {  5376,      65536,   12},  // 29        12   1.69%      3.15%   16.67%
+  {  6528,      65536,   10},  // 30        10   0.49%      3.15%   21.43%
+  {  8192,      65536,    8},  // 31         8   0.10%      3.15%   25.49%
+  { 10880,      65536,    6},  // 32         6   0.49%      3.15%   32.81%
+  { 13952,     131072,    4},  // 33         9   4.43%      3.15%   28.24%
+  { 16384,      65536,    4},  // 34         4   0.10%      3.15%   17.43%
+  { 21760,      65536,    3},  // 35         3   0.49%      3.15%   32.81%
+  { 26112,     131072,    2},  // 36         5   0.44%      3.15%   20.00%
+  { 32768,      65536,    2},  // 37         2   0.10%      3.15%   25.49%
+  { 40960,     131072,    2},  // 38         3   6.72%      3.15%   25.00%
+  { 54528,     327680,    2},  // 39         6   0.18%      3.15%   33.12%
+  { 65536,      65536,    2},  // 40         1   0.10%      0.03%   20.19%
+  { 81920,     262144,    2},  // 41         3   6.69%      6.28%   25.00%
+  { 98304,     196608,    2},  // 42         2   0.03%      6.28%   20.00%
+  {114688,     458752,    2},  // 43         4   0.01%      6.28%   16.67%
+  {131072,     131072,    2},  // 44         1   0.05%      0.03%   14.29%
+  {163840,     327680,    2},  // 45         2   0.02%      9.40%   25.00%
+  {229376,     458752,    2},  // 46         2   0.01%     12.53%   40.00%
+  {262144,     262144,    2},  // 47         1   0.02%      0.03%   14.29%
+};
 #elif TCMALLOC_PAGE_SHIFT == 18
 static_assert(kMaxSize == 262144, "kMaxSize mismatch");
 static constexpr SizeClassAssumptions Assumptions{
@@ -184,6 +184,9 @@ TEST_F(RunTimeSizeClassesTest, WastedSpan) {
     case SizeClassConfiguration::kLegacy:
     case SizeClassConfiguration::kReuse:
     case SizeClassConfiguration::kReuseRelaxedBelow64:
+    case SizeClassConfiguration::kCustom:
+    case SizeClassConfiguration::kRuntime:
+    case SizeClassConfiguration::kPow2Range:
       // This test fails for other classes (was passing with a different span
       // size allocation algorithm used between cl/130150125 and cl/139955211).
       GTEST_SKIP();
@@ -14,23 +14,35 @@
 
 #include "tcmalloc/sizemap.h"
 
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/types.h>
+
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <limits>
 #include <new>
 #include <vector>
 
+#include "absl/base/call_once.h"
 #include "absl/base/macros.h"
 #include "absl/base/nullability.h"
+#include "absl/numeric/bits.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/huge_page_aware_allocator.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/environment.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/parameter_accessors.h"
 #include "tcmalloc/internal/sampled_allocation.h"
 #include "tcmalloc/internal/size_class_info.h"
+#include "tcmalloc/internal/util.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/span.h"
@@ -52,6 +64,12 @@ const SizeClasses& SizeMap::CurrentClasses() {
     case SizeClassConfiguration::kLegacy:
       // TODO(b/242710633): remove this opt out.
       return kLegacySizeClasses;
+    case SizeClassConfiguration::kCustom:
+      return *default_custom_size_classes();
+    case SizeClassConfiguration::kRuntime:
+      return *RuntimeClasses();
+    case SizeClassConfiguration::kPow2Range:
+      return *Pow2RangeClasses();
   }
   TC_BUG("unreachable");
 }
@@ -187,6 +205,54 @@ bool SizeMap::SetSizeClasses(absl::Span<const SizeClassInfo> size_classes) {
   return true;
 }
 
+void SizeMap::InitSpanColors(bool enabled) {
+  for (size_t c = 0; c < kNumClasses; ++c) {
+    const size_t size = class_to_size_[c];
+    const size_t span_bytes = Length(class_to_pages_[c]).in_bytes();
+    size_t colors = 1;
+    if (enabled && size != 0 && size != kMaxSize &&
+        Span::UseBitmapForSize(size) &&
+        (size % 4096 == 0 || absl::has_single_bit(size))) {
+      const size_t slack = span_bytes % size;
+      colors = std::min(slack / Span::kColorStride + 1, Span::kMaxColors);
+    }
+    class_to_colors_[c] = colors;
+    class_to_align_bits_[c] = size | (colors > 1 ? Span::kColorStride : 0);
+  }
+  InitAlignedClasses();
+}
+
+size_t SizeMap::span_sharing_lender(size_t size_class) const {
+  TC_ASSERT_LT(size_class, kNumClasses);
+  const size_t lender = size_class + 1;
+  // Partitions start over from the smallest size.
+  if (size_class == 0 || lender >= kNumClasses ||
+      class_to_size_[size_class] == 0 ||
+      class_to_size_[lender] <= class_to_size_[size_class]) {
+    return 0;
+  }
+  const uint32_t bits = class_to_align_bits_[size_class];
+  const uint32_t align = bits & -bits;
+  if ((class_to_align_bits_[lender] & (align - 1)) != 0) return 0;
+  return lender;
+}
+
+void SizeMap::InitAlignedClasses() {
+  for (size_t i = 0; i < kNumAlignedClassShifts; ++i) {
+    const size_t align = size_t{1} << (kMinAlignedClassShift + i);
+    // The last size class of each partition holds kMaxSize, a multiple of
+    // kPageSize that is never colored, so the search never crosses into the
+    // next partition.
+    size_t next = kNumClasses - 1;
+    for (size_t c = kNumClasses; c-- > 0;) {
+      if ((class_to_align_bits_[c] & (align - 1)) == 0) {
+        next = c;
+      }
+      aligned_class_[i][c] = next;
+    }
+  }
+}
+
 // Return true if all size classes meet the requirements for alignment
 // ordering and min and max values.
 bool SizeMap::ValidSizeClasses(absl::Span<const SizeClassInfo> size_classes) {
@@ -233,6 +299,190 @@ bool SizeMap::ValidSizeClasses(absl::Span<const SizeClassInfo> size_classes) {
   return true;
 }
 
+size_t SizeMap::ParseSizeClasses(absl::string_view spec,
+                                 absl::Span<SizeClassInfo> out) {
+  if (out.empty()) return 0;
+  out[0] = SizeClassInfo(0, 0, 0);
+  size_t n = 1;
+  while (!spec.empty()) {
+    const char c = spec.front();
+    if (c == ',' || c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+      spec.remove_prefix(1);
+      continue;
+    }
+    if (c == '#') {
+      spec.remove_prefix(std::min(spec.find('\n'), spec.size()));
+      continue;
+    }
+
+    const absl::string_view entry =
+        spec.substr(0, spec.find_first_of(", \t\n\r#"));
+    spec.remove_prefix(entry.size());
+    const size_t colon1 = entry.find(':');
+    const size_t colon2 = colon1 == absl::string_view::npos
+                              ? absl::string_view::npos
+                              : entry.find(':', colon1 + 1);
+    uint32_t size, bytes, num_to_move;
+    if (colon2 == absl::string_view::npos ||
+        !absl::SimpleAtoi(entry.substr(0, colon1), &size) ||
+        !absl::SimpleAtoi(entry.substr(colon1 + 1, colon2 - colon1 - 1),
+                          &bytes) ||
+        !absl::SimpleAtoi(entry.substr(colon2 + 1), &num_to_move) ||
+        num_to_move > std::numeric_limits<uint8_t>::max()) {
+      TC_LOG("malformed size class '%v'", entry);
+      return 0;
+    }
+    if (n == out.size()) {
+      TC_LOG("more than %v size classes", out.size() - 1);
+      return 0;
+    }
+    out[n++] = SizeClassInfo(size, bytes, static_cast<uint8_t>(num_to_move));
+  }
+  if (!ValidSizeClasses(out.first(n))) {
+    return 0;
+  }
+  return n;
+}
+
+const SizeClasses* absl_nullable SizeMap::RuntimeClasses() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static SizeClassInfo classes[kNumBaseClasses];
+  ABSL_CONST_INIT static SizeClasses runtime_classes = {};
+  ABSL_CONST_INIT static const SizeClasses* result = nullptr;
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    // This runs before TCMalloc is initialized, so it cannot allocate.
+    ABSL_CONST_INIT static char buf[16 << 10];
+    absl::string_view spec;
+    const char* path = thread_safe_getenv("TCMALLOC_SIZE_CLASSES_FILE");
+    if (const char* e = thread_safe_getenv("TCMALLOC_SIZE_CLASSES");
+        e != nullptr) {
+      spec = e;
+    } else if (path != nullptr) {
+      const int fd = signal_safe_open(path, O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        TC_LOG("Cannot open %s, using the default size classes", path);
+        return;
+      }
+      size_t bytes_read = 0;
+      const ssize_t rc = signal_safe_read(fd, buf, sizeof(buf), &bytes_read);
+      signal_safe_close(fd);
+      if (rc < 0 || bytes_read == sizeof(buf)) {
+        TC_LOG("Cannot read %s, using the default size classes", path);
+        return;
+      }
+      spec = absl::string_view(buf, bytes_read);
+    } else {
+      return;
+    }
+
+    const size_t n = ParseSizeClasses(spec, absl::MakeSpan(classes));
+    if (n == 0) {
+      TC_LOG("Invalid runtime size classes, using the default size classes");
+      return;
+    }
+    runtime_classes.classes = absl::MakeConstSpan(classes, n);
+    runtime_classes.assumptions = {
+        .has_expanded_classes = kHasExpandedClasses,
+        .span_size = sizeof(Span),
+        .sampling_interval = kDefaultProfileSamplingInterval,
+        .large_size = kLargeSize,
+        .large_size_alignment = kLargeSizeAlignment,
+    };
+    result = &runtime_classes;
+  });
+  return result;
+}
+
+size_t SizeMap::RoundSizeClassesToPow2(absl::Span<const SizeClassInfo> in,
+                                       size_t min_size, size_t max_size,
+                                       absl::Span<SizeClassInfo> out) {
+  if (in.empty() || out.empty()) return 0;
+  out[0] = in[0];
+  size_t n = 1;
+  bool prev_rounded = false;
+  for (size_t c = 1; c < in.size(); ++c) {
+    SizeClassInfo info = in[c];
+    const bool rounded = info.size >= min_size && info.size <= max_size &&
+                         absl::bit_ceil(info.size) <= kMaxSize;
+    if (rounded) {
+      info.size = absl::bit_ceil(info.size);
+      const Length pages = BytesToLengthCeil(info.size);
+      if (info.bytes < Bytes(pages.in_bytes())) {
+        info.bytes = Bytes(pages.in_bytes());
+      }
+    }
+    if (info.size < out[n - 1].size ||
+        (info.size == out[n - 1].size && !prev_rounded)) {
+      // Covered by a rounded up size class.
+      continue;
+    }
+    if (info.size == out[n - 1].size) {
+      // Of the size classes rounded up to the same size, keep the span and
+      // batch sizes of the largest, which were chosen for the closest size.
+      out[n - 1] = info;
+    } else {
+      if (n == out.size()) return 0;
+      out[n++] = info;
+    }
+    prev_rounded = rounded;
+  }
+  if (!ValidSizeClasses(out.first(n))) {
+    return 0;
+  }
+  return n;
+}
+
+const SizeClasses* absl_nullable SizeMap::Pow2RangeClasses() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static SizeClassInfo classes[kNumBaseClasses];
+  ABSL_CONST_INIT static SizeClasses pow2_classes = {};
+  ABSL_CONST_INIT static const SizeClasses* result = nullptr;
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_POW2_SIZE_CLASSES");
+    if (e == nullptr) return;
+    const absl::string_view range = e;
+    const size_t dash = range.find('-');
+    uint32_t min_size, max_size;
+    if (dash == absl::string_view::npos ||
+        !absl::SimpleAtoi(range.substr(0, dash), &min_size) ||
+        !absl::SimpleAtoi(range.substr(dash + 1), &max_size) ||
+        min_size > max_size) {
+      TC_LOG("Bad TCMALLOC_POW2_SIZE_CLASSES '%s', expected min-max", e);
+      return;
+    }
+
+    const SizeClasses& base = kReuseRelaxedBelow64SizeClasses;
+    const size_t n = RoundSizeClassesToPow2(base.classes, min_size, max_size,
+                                            absl::MakeSpan(classes));
+    if (n == 0) {
+      TC_LOG("Invalid power-of-two size classes, using the default ones");
+      return;
+    }
+    pow2_classes.classes = absl::MakeConstSpan(classes, n);
+    pow2_classes.assumptions = base.assumptions;
+    result = &pow2_classes;
+  });
+  return result;
+}
+
+size_t SizeMap::Pow2RoundingCost(size_t requested_size,
+                                 size_t allocated_size) {
+  if (allocated_size > kMaxSize || Pow2RangeClasses() == nullptr ||
+      Static::size_class_configuration() !=
+          SizeClassConfiguration::kPow2Range) {
+    return 0;
+  }
+  // The default size class for requested_size is the first one at least as
+  // large.
+  const absl::Span<const SizeClassInfo> base =
+      kReuseRelaxedBelow64SizeClasses.classes;
+  const SizeClassInfo* it = std::lower_bound(
+      base.begin(), base.end(), requested_size,
+      [](const SizeClassInfo& info, size_t size) { return info.size < size; });
+  if (it == base.end() || it->size >= allocated_size) return 0;
+  return allocated_size - it->size;
+}
+
 // Initialize the mapping arrays
 bool SizeMap::Init(absl::Span<const SizeClassInfo> size_classes) {
   // Do some sanity checking on add_amount[]/shift_amount[]/class_array[]
@@ -243,6 +493,9 @@ bool SizeMap::Init(absl::Span<const SizeClassInfo> size_classes) {
   if (!SetSizeClasses(size_classes)) {
     return false;
   }
+  const char* coloring = thread_safe_getenv("TCMALLOC_SPAN_COLORING");
+  InitSpanColors(coloring != nullptr && (std::strcmp(coloring, "1") == 0 ||
+                                         strcasecmp(coloring, "true") == 0));
 
   int next_size = 0;
   for (int c = 1; c < kNumClasses; c++) {
@@ -270,24 +523,27 @@ bool SizeMap::Init(absl::Span<const SizeClassInfo> size_classes) {
   if (kSecurityPartitions > 1 && heap_partitioning_active) {
     bool heap_partitioning_full =
         Parameters::heap_partitioning_mode() == HeapPartitioningMode::kFull;
-    next_size = 0;
-    for (int c = kNumBaseClasses + 1; c < kExpandedClassesStart; ++c) {
-      const int max_size_in_class = class_to_size_[c];
-
-      for (int s = next_size; s <= max_size_in_class;
-           s += static_cast<size_t>(kAlignment)) {
-        // Route Hot Malloc P1 to security partition P1.
-        class_array_[ClassIndex(s) +
-                     kClassArraySize * (kSecurityPartitions + 1)] = c;
-        // Route Hot New P1 to security partition P1.
-        class_array_[ClassIndex(s) + kClassArraySize] = c;
-        if (heap_partitioning_full) continue;
-        // In kLight mode, route Hot New P0 to P1.
-        class_array_[ClassIndex(s)] = c;
-      }
-      next_size = max_size_in_class + static_cast<size_t>(kAlignment);
-      if (next_size > kMaxSize) {
-        break;
+    for (size_t p = 1; p < kSecurityPartitions; ++p) {
+      next_size = 0;
+      for (int c = p * kNumBaseClasses + 1; c < (p + 1) * kNumBaseClasses;
+           ++c) {
+        const int max_size_in_class = class_to_size_[c];
+
+        for (int s = next_size; s <= max_size_in_class;
+             s += static_cast<size_t>(kAlignment)) {
+          // Route Hot Malloc Pp to security partition Pp.
+          class_array_[ClassIndex(s) +
+                       kClassArraySize * (kSecurityPartitions + p)] = c;
+          // Route Hot New Pp to security partition Pp.
+          class_array_[ClassIndex(s) + kClassArraySize * p] = c;
+          if (heap_partitioning_full || p != 1) continue;
+          // In kLight mode, route Hot New P0 to P1.
+          class_array_[ClassIndex(s)] = c;
+        }
+        next_size = max_size_in_class + static_cast<size_t>(kAlignment);
+        if (next_size > kMaxSize) {
+          break;
+        }
       }
     }
   }
@@ -323,18 +579,19 @@ bool SizeMap::Init(absl::Span<const SizeClassInfo> size_classes) {
         break;
       }
     }
-    if (kSecurityPartitions > 1) {
+    for (size_t p = 1; p < kSecurityPartitions; ++p) {
       if (Parameters::heap_partitioning_mode() == HeapPartitioningMode::kFull) {
-        // Point all lookups in Cold New's P1 register to Hot New's P1.
+        // Point all lookups in Cold New's Pp register to Hot New's Pp.
         std::copy(
-            &class_array_[kClassArraySize], &class_array_[kClassArraySize * 2],
-            &class_array_[kClassArraySize * (2 * kSecurityPartitions + 1)]);
+            &class_array_[kClassArraySize * p],
+            &class_array_[kClassArraySize * (p + 1)],
+            &class_array_[kClassArraySize * (2 * kSecurityPartitions + p)]);
       } else {
-        // Point all lookups in Cold New's P1 register to Cold New's P0.
+        // Point all lookups in Cold New's Pp register to Cold New's P0.
         std::copy(
             &class_array_[kClassArraySize * (2 * kSecurityPartitions)],
             &class_array_[kClassArraySize * (2 * kSecurityPartitions + 1)],
-            &class_array_[kClassArraySize * (2 * kSecurityPartitions + 1)]);
+            &class_array_[kClassArraySize * (2 * kSecurityPartitions + p)]);
       }
     }
   }
@@ -22,8 +22,10 @@
 #include <utility>
 
 #include "absl/base/attributes.h"
+#include "absl/base/nullability.h"
 #include "absl/base/optimization.h"
 #include "absl/numeric/bits.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/config.h"
@@ -50,8 +52,15 @@ enum class SizeClassConfiguration {
   kLegacy = 4,
   kReuse = 6,
   kReuseRelaxedBelow64 = 8,
+  kCustom = 10,
+  kRuntime = 12,
+  kPow2Range = 14,
 };
 
+// Returns size classes generated by size_class_optimizer for this binary, if
+// they are linked in.
+ABSL_ATTRIBUTE_WEAK const SizeClasses* default_custom_size_classes();
+
 // Size-class information + mapping
 class SizeMap {
  public:
@@ -105,6 +114,10 @@ class SizeMap {
   // * If the heap partitioning feature is active in kLight mode: Malloc P0 is
   //   exclusive to P0; Hot New P0 maps to Hot New P1; Cold P1 maps to Cold P0.
   //
+  // With more than two security partitions, each of Hot New, Hot Malloc and
+  // Cold New has one region per partition, and partition p >= 2 is treated
+  // like partition 1 above, except that kLight mode leaves Hot New P0 alone.
+  //
   // If NUMA support is compiled in, the partition 1 regions won't exist.
   // Similarly, for cold memory, if expanded classes are not compiled in.
   static constexpr size_t kHotRegisters = 2 * kSecurityPartitions;
@@ -133,8 +146,8 @@ class SizeMap {
   // If size is no more than kMaxSize, compute index of the
   // class_array[] entry for it, putting the class index in output
   // parameter idx and returning true. Otherwise return false.
-  ABSL_ATTRIBUTE_ALWAYS_INLINE static inline bool ClassIndexMaybe(size_t s,
-                                                                  size_t& idx) {
+  ABSL_ATTRIBUTE_ALWAYS_INLINE static constexpr bool ClassIndexMaybe(
+      size_t s, size_t& idx) {
     if (ABSL_PREDICT_TRUE(s <= kLargeSize)) {
       idx = (s + 7) >> 3;
       return true;
@@ -157,6 +170,30 @@ class SizeMap {
   // Mapping from size class to max size storable in that class
   uint32_t class_to_size_[kNumClasses] = {0};
 
+  // Alignments above kAlignment, up to kPageSize, that GetSizeClass() looks
+  // up in aligned_class_.
+  static constexpr size_t kMinAlignedClassShift =
+      absl::countr_zero(static_cast<size_t>(kAlignment)) + 1;
+  static constexpr size_t kNumAlignedClassShifts =
+      kPageShift + 1 - kMinAlignedClassShift;
+
+  // aligned_class_[i][c] is the first size class from c on whose objects are
+  // aligned to 1 << (kMinAlignedClassShift + i), i.e. whose
+  // class_to_align_bits_ are a multiple of it, so that aligned allocations
+  // find their class without a search.
+  CompactSizeClass aligned_class_[kNumAlignedClassShifts][kNumClasses] = {};
+
+  // Number of object start offsets that the spans of a size class rotate
+  // through, 1 if the class is not colored.  See InitSpanColors().
+  uint8_t class_to_colors_[kNumClasses] = {0};
+
+  // class_to_size_, with Span::kColorStride or'ed in for colored classes: the
+  // lowest set bit is the alignment that all objects of the class have.
+  uint32_t class_to_align_bits_[kNumClasses] = {0};
+
+  // Fills aligned_class_ from class_to_align_bits_.
+  void InitAlignedClasses();
+
  protected:
   // Set the give size classes to be used by TCMalloc.
   bool SetSizeClasses(absl::Span<const SizeClassInfo> size_classes);
@@ -171,6 +208,40 @@ class SizeMap {
   // Returns size classes to use in the current process.
   static const SizeClasses& CurrentClasses();
 
+  // Returns the size classes given by TCMALLOC_SIZE_CLASSES, or read from the
+  // file named by TCMALLOC_SIZE_CLASSES_FILE, at startup.  Returns nullptr if
+  // neither is set, or if the size classes fail validation, in which case the
+  // default ones are used.
+  static const SizeClasses* absl_nullable RuntimeClasses();
+
+  // Parses size classes written as "size:span_bytes:batch" entries separated
+  // by commas or whitespace, where '#' starts a comment running to the end of
+  // the line, into out after an implicit size class 0.  Returns the number of
+  // size classes including size class 0, or 0 if spec is malformed, does not
+  // fit in out or fails ValidSizeClasses().
+  static size_t ParseSizeClasses(absl::string_view spec,
+                                 absl::Span<SizeClassInfo> out);
+
+  // Returns the default size classes with those in the size range given by
+  // TCMALLOC_POW2_SIZE_CLASSES, written as "min-max", rounded up to powers of
+  // two.  Objects in these size classes are aligned to their size, up to
+  // kPageSize.  Returns nullptr if the variable is not set or is malformed.
+  static const SizeClasses* absl_nullable Pow2RangeClasses();
+
+  // Copies in to out, rounding the sizes of classes in [min_size, max_size]
+  // up to powers of two and dropping the classes this makes redundant.
+  // Returns the number of size classes written, or 0 if they do not fit in out
+  // or fail ValidSizeClasses().
+  static size_t RoundSizeClassesToPow2(absl::Span<const SizeClassInfo> in,
+                                       size_t min_size, size_t max_size,
+                                       absl::Span<SizeClassInfo> out);
+
+  // Returns the bytes that Pow2RangeClasses() adds to an allocation of
+  // requested_size, served as allocated_size, compared to the default size
+  // classes.  Returns 0 if they are not in use.
+  static size_t Pow2RoundingCost(size_t requested_size,
+                                 size_t allocated_size);
+
   // Checks assumptions used to generate the current size classes.
   // Prints any wrong assumptions to stderr.
   //
@@ -220,30 +291,7 @@ class SizeMap {
     if (ABSL_PREDICT_FALSE(!ClassIndexMaybe(size, idx))) {
       return {false};
     }
-    size_t size_class;
-    // Note, if security heap partitioning is enabled, only data (partition 0)
-    // is added to the cold heap. See the comment for kClassArraySizePartitions
-    // for more details.
-    if (kHasExpandedClasses && policy.is_cold()) {
-      TC_ASSERT(policy.allocation_type() == AllocationType::New);
-      TC_ASSERT_LT(idx + (policy.security_partition() + kColdRegisterStride) *
-                             kClassArraySize,
-                   kClassArraySizePartitions);
-      size_class = class_array_[idx + (policy.security_partition() +
-                                       kColdRegisterStride) *
-                                          kClassArraySize];
-    } else {
-      constexpr size_t kTypeOffset =
-          policy.allocation_type() != AllocationType::New ? kSecurityPartitions
-                                                          : 0;
-      TC_ASSERT_LT(
-          idx + (policy.security_partition() + kTypeOffset) * kClassArraySize,
-          kClassArraySizePartitions);
-      size_class =
-          class_array_[idx + (policy.security_partition() + kTypeOffset) *
-                                 kClassArraySize] +
-          policy.scaled_numa_partition();
-    }
+    size_t size_class = LookupSizeClass(policy, idx);
 
     // Don't search for suitably aligned class for operator new
     // (when alignment is statically known to be no greater than kAlignment).
@@ -260,13 +308,14 @@ class SizeMap {
     // size class, i.e., multiples of 32, 64, etc, matching our class sizes.
     // Since alignment is <= kPageSize, we must find a suitable class
     // (at least kMaxSize is aligned on kPageSize).
-    static_assert((kMaxSize % kPageSize) == 0, "the loop below won't work");
+    static_assert((kMaxSize % kPageSize) == 0, "aligned_class_ won't work");
     // Profiles say we usually get the right class based on the size,
-    // so avoid the loop overhead on the fast path.
-    if (ABSL_PREDICT_FALSE(class_to_size(size_class) & (align - 1))) {
-      do {
-        ++size_class;
-      } while (ABSL_PREDICT_FALSE(class_to_size(size_class) & (align - 1)));
+    // so avoid the table lookup on the fast path.  As all sizes are multiples
+    // of kAlignment, align is larger than kAlignment here.
+    if (ABSL_PREDICT_FALSE(class_to_align_bits_[size_class] & (align - 1))) {
+      const size_t shift = absl::countr_zero(align);
+      TC_ASSERT_GE(shift, kMinAlignedClassShift);
+      size_class = aligned_class_[shift - kMinAlignedClassShift][size_class];
     }
     return {true, size_class};
   }
@@ -280,6 +329,38 @@ class SizeMap {
     return GetSizeClass(policy, size).size_class;
   }
 
+  // Returns the size class at class_array_ index idx, as computed by
+  // ClassIndexMaybe() (or tcmalloc::new_internal::ClassIndex() at compile
+  // time), for the partitions selected by policy.  Unlike GetSizeClass(), this
+  // does not look for a suitably aligned class, so policy must use the default
+  // alignment.
+  template <typename Policy>
+  ABSL_ATTRIBUTE_ALWAYS_INLINE size_t LookupSizeClass(Policy policy,
+                                                      size_t idx) const {
+    // Note, if security heap partitioning is enabled, only data (partition 0)
+    // is added to the cold heap. See the comment for kClassArraySizePartitions
+    // for more details.
+    if (kHasExpandedClasses && policy.is_cold()) {
+      TC_ASSERT(policy.allocation_type() == AllocationType::New);
+      TC_ASSERT_LT(idx + (policy.security_partition() + kColdRegisterStride) *
+                             kClassArraySize,
+                   kClassArraySizePartitions);
+      return class_array_[idx + (policy.security_partition() +
+                                 kColdRegisterStride) *
+                                    kClassArraySize];
+    } else {
+      constexpr size_t kTypeOffset =
+          policy.allocation_type() != AllocationType::New ? kSecurityPartitions
+                                                          : 0;
+      TC_ASSERT_LT(
+          idx + (policy.security_partition() + kTypeOffset) * kClassArraySize,
+          kClassArraySizePartitions);
+      return class_array_[idx + (policy.security_partition() + kTypeOffset) *
+                                    kClassArraySize] +
+             policy.scaled_numa_partition();
+    }
+  }
+
   // Get the byte-size for a specified class. REQUIRES: size_class <=
   // kNumClasses.
   //
@@ -295,6 +376,30 @@ class SizeMap {
     return class_to_size_[size_class];
   }
 
+  // Number of start offsets, Span::kColorStride bytes apart, that successive
+  // spans of a size class place their first object at.  Page-multiple and
+  // power-of-two sized objects otherwise start at the same page offsets in
+  // every span and compete for the same cache sets.
+  size_t class_to_colors(size_t size_class) const {
+    TC_ASSERT_LT(size_class, kNumClasses);
+    return class_to_colors_[size_class];
+  }
+
+  // Returns the size class whose spans may serve size_class while it is
+  // rarely used, see CentralFreeList::UpdateSpanSharing: the next larger size
+  // class, if its objects are aligned at least as much as size_class's.
+  // Returns 0 if there is none, as for the largest class of each partition.
+  size_t span_sharing_lender(size_t size_class) const;
+
+  // Colors the size classes when `enabled`: classes whose objects are
+  // page-multiple or power-of-two sized, use a bitmap and leave at least
+  // Span::kColorStride bytes of slack at the end of the span get as many
+  // colors as the slack holds, up to Span::kMaxColors.  Objects of colored
+  // classes are only aligned to Span::kColorStride, so that aligned
+  // allocations above it skip them.  Called by Init(), which colors when
+  // TCMALLOC_SPAN_COLORING is set.
+  void InitSpanColors(bool enabled);
+
   // Mapping from size class to number of pages to allocate at a time
   ABSL_ATTRIBUTE_ALWAYS_INLINE inline Length class_to_pages(
       size_t size_class) const {
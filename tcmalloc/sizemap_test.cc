@@ -16,10 +16,14 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <string>
 #include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/numeric/bits.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/parameter_accessors.h"
 #include "tcmalloc/internal/size_class_info.h"
@@ -156,6 +160,73 @@ TEST(SizeMapTest, ClassToSizeRange) {
   }
 }
 
+TEST(SizeMapTest, AlignedSizeClasses) {
+  for (const SizeClasses* sc : kAllSizeClassesConfigs) {
+    SizeMap size_map;
+    ASSERT_TRUE(size_map.Init(sc->classes));
+
+    for (size_t align = 1; align <= kPageSize; align <<= 1) {
+      const auto policy = CppPolicy().AlignAs(align);
+      for (size_t size = 0; size <= kMaxSize; size += 8) {
+        const auto [is_small, size_class] =
+            size_map.GetSizeClass(policy, size);
+        ASSERT_TRUE(is_small) << size << " " << align;
+        // The smallest class that fits size and is aligned to align.
+        size_t expected = size_map.SizeClass(CppPolicy(), size);
+        while (size_map.class_to_size(expected) % align != 0) {
+          ++expected;
+        }
+        ASSERT_EQ(size_class, expected) << size << " " << align;
+      }
+    }
+  }
+}
+
+TEST(SizeMapTest, SpanColors) {
+  for (const SizeClasses* sc : kAllSizeClassesConfigs) {
+    SizeMap size_map;
+    ASSERT_TRUE(size_map.Init(sc->classes));
+    size_map.InitSpanColors(true);
+
+    for (size_t c = 0; c < kNumClasses; ++c) {
+      const size_t colors = size_map.class_to_colors(c);
+      ASSERT_GE(colors, 1);
+      ASSERT_LE(colors, Span::kMaxColors);
+      if (colors == 1) continue;
+      const size_t size = size_map.class_to_size(c);
+      EXPECT_TRUE(size % 4096 == 0 || absl::has_single_bit(size)) << size;
+      EXPECT_TRUE(Span::UseBitmapForSize(size)) << size;
+      const size_t span_bytes = size_map.class_to_pages(c).in_bytes();
+      const size_t objects = span_bytes / size;
+      // The last color still fits every object in the span.
+      EXPECT_LE((colors - 1) * Span::kColorStride + objects * size,
+                span_bytes)
+          << size;
+    }
+
+    // Aligned allocations never land in a colored class above the color
+    // stride.
+    for (size_t align = 1; align <= kPageSize; align <<= 1) {
+      const auto policy = CppPolicy().AlignAs(align);
+      for (size_t size = 0; size <= kMaxSize; size += 8) {
+        const auto [is_small, size_class] =
+            size_map.GetSizeClass(policy, size);
+        ASSERT_TRUE(is_small) << size << " " << align;
+        ASSERT_EQ(size_map.class_to_size(size_class) % align, 0);
+        if (align > Span::kColorStride) {
+          ASSERT_EQ(size_map.class_to_colors(size_class), 1)
+              << size << " " << align;
+        }
+      }
+    }
+
+    size_map.InitSpanColors(false);
+    for (size_t c = 0; c < kNumClasses; ++c) {
+      EXPECT_EQ(size_map.class_to_colors(c), 1);
+    }
+  }
+}
+
 TEST(SizeMapTest, HeapPartitioning) {
   if (kSecurityPartitions == 1) {
     GTEST_SKIP() << "Heap partitioning is not compiled in.";
@@ -289,4 +360,78 @@ TEST(SizeMapTest, SpecificClassRanges) {
   }
 }
 
+TEST(SizeMapTest, ParseSizeClasses) {
+  const absl::Span<const SizeClassInfo> classes =
+      kSizeClasses.classes.first(std::min<size_t>(kSizeClasses.classes.size(),
+                                                  kNumBaseClasses));
+  std::string spec = "# Default size classes\n";
+  for (size_t c = 1; c < classes.size(); ++c) {
+    absl::StrAppend(&spec, classes[c].size, ":", classes[c].bytes.raw_num(),
+                    ":", classes[c].num_to_move, c % 4 == 0 ? "\n" : ", ");
+  }
+
+  std::vector<SizeClassInfo> parsed(kNumBaseClasses);
+  ASSERT_EQ(SizeMap::ParseSizeClasses(spec, absl::MakeSpan(parsed)),
+            classes.size());
+  for (size_t c = 0; c < classes.size(); ++c) {
+    EXPECT_EQ(parsed[c].size, classes[c].size);
+    EXPECT_EQ(parsed[c].bytes, classes[c].bytes);
+    EXPECT_EQ(parsed[c].num_to_move, classes[c].num_to_move);
+  }
+
+  // Tables that do not fit, or that fail validation, are rejected.
+  EXPECT_EQ(SizeMap::ParseSizeClasses(
+                spec, absl::MakeSpan(parsed).first(classes.size() - 1)),
+            0);
+  EXPECT_EQ(SizeMap::ParseSizeClasses("16:8192:32, 8:8192:32",
+                                      absl::MakeSpan(parsed)),
+            0);
+  EXPECT_EQ(SizeMap::ParseSizeClasses(absl::StrCat("8:8192:32 ", kMaxSize),
+                                      absl::MakeSpan(parsed)),
+            0);
+  EXPECT_EQ(SizeMap::ParseSizeClasses(
+                absl::StrCat("8:", kPageSize, ":32 ", kMaxSize, ":",
+                             std::max(kPageSize, kMaxSize), ":2"),
+                absl::MakeSpan(parsed)),
+            3);
+}
+
+TEST(SizeMapTest, RoundSizeClassesToPow2) {
+  const absl::Span<const SizeClassInfo> base =
+      kReuseRelaxedBelow64SizeClasses.classes;
+  constexpr size_t kMin = 64, kMax = 4096;
+  std::vector<SizeClassInfo> rounded(kNumBaseClasses);
+  const size_t n = SizeMap::RoundSizeClassesToPow2(base, kMin, kMax,
+                                                   absl::MakeSpan(rounded));
+  ASSERT_GT(n, 0);
+  ASSERT_LT(n, base.size());
+  rounded.resize(n);
+
+  std::vector<size_t> in_range;
+  for (const SizeClassInfo& info : rounded) {
+    if (info.size >= kMin && info.size <= kMax) {
+      in_range.push_back(info.size);
+    }
+  }
+  EXPECT_THAT(in_range, testing::ElementsAre(64, 128, 256, 512, 1024, 2048,
+                                             4096));
+
+  // Size classes outside of the range are unchanged.
+  for (const SizeClassInfo& info : base) {
+    if (info.size < kMin || info.size > kMax) {
+      EXPECT_TRUE(std::any_of(rounded.begin(), rounded.end(),
+                              [&](const SizeClassInfo& r) {
+                                return r.size == info.size &&
+                                       r.bytes == info.bytes;
+                              }))
+          << info.size;
+    }
+  }
+
+  // The rounded size classes must fit in out.
+  EXPECT_EQ(SizeMap::RoundSizeClassesToPow2(base, 1, kMaxSize,
+                                            absl::MakeSpan(rounded).first(2)),
+            0);
+}
+
 }  // namespace tcmalloc::tcmalloc_internal
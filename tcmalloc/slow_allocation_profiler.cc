@@ -0,0 +1,152 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/slow_allocation_profiler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "absl/base/internal/cycleclock.h"
+#include "absl/base/optimization.h"
+#include "absl/debugging/stacktrace.h"
+#include "absl/functional/function_ref.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/parameters.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+ABSL_CONST_INIT SlowAllocationProfiler slow_allocation_profiler;
+ABSL_CONST_INIT thread_local SlowAllocationTiming slow_allocation_timing
+    ABSL_ATTRIBUTE_INITIAL_EXEC = {};
+
+namespace {
+
+class SlowAllocationProfile final : public ProfileBase {
+ public:
+  SlowAllocationProfile() : start_(absl::Now()) {}
+
+  void Iterate(
+      absl::FunctionRef<void(const Profile::Sample&)> f) const override {
+    for (const Profile::Sample& sample : samples_) {
+      f(sample);
+    }
+  }
+
+  ProfileType Type() const override { return ProfileType::kSlowAllocations; }
+
+  std::optional<absl::Time> StartTime() const override { return start_; }
+
+  absl::Duration Duration() const override { return absl::ZeroDuration(); }
+
+  std::vector<Profile::Sample>& samples() { return samples_; }
+
+ private:
+  absl::Time start_;
+  std::vector<Profile::Sample> samples_;
+};
+
+}  // namespace
+
+int64_t SlowAllocationThresholdCycles() {
+  const absl::Duration threshold = Parameters::slow_allocation_threshold();
+  if (ABSL_PREDICT_TRUE(threshold <= absl::ZeroDuration())) {
+    return 0;
+  }
+  return std::max<int64_t>(
+      1, static_cast<int64_t>(absl::ToDoubleSeconds(threshold) *
+                              absl::base_internal::CycleClock::Frequency()));
+}
+
+void ScopedSlowAllocationTimer::RecordSlow(int64_t cycles) {
+  // Whatever was not charged to a specific cause was spent refilling caches
+  // and the like.
+  int64_t attributed = 0;
+  for (int64_t c : slow_allocation_timing.cause_cycles) {
+    attributed += c;
+  }
+  slow_allocation_timing
+      .cause_cycles[static_cast<size_t>(SlowAllocationCause::kOther)] =
+      std::max<int64_t>(0, cycles - attributed);
+
+  size_t cause = 0;
+  for (size_t i = 1; i < kNumSlowAllocationCauses; ++i) {
+    if (slow_allocation_timing.cause_cycles[i] >
+        slow_allocation_timing.cause_cycles[cause]) {
+      cause = i;
+    }
+  }
+  slow_allocation_profiler.Record(size_, cycles,
+                                  static_cast<SlowAllocationCause>(cause));
+}
+
+void SlowAllocationProfiler::Record(size_t size, int64_t cycles,
+                                    SlowAllocationCause cause) {
+  void* stack[kMaxStackDepth];
+  const int depth = absl::GetStackTrace(stack, kMaxStackDepth, 2);
+  const absl::Time now = absl::Now();
+
+  AllocationGuardSpinLockHolder h(lock_);
+  Sample& sample = samples_[next_ % kMaxSamples];
+  ++next_;
+  sample.cycles = cycles;
+  sample.size = size;
+  sample.cause = cause;
+  sample.time = now;
+  sample.depth = depth;
+  memcpy(sample.stack, stack, sizeof(stack[0]) * depth);
+}
+
+std::unique_ptr<ProfileBase> SlowAllocationProfiler::DumpSample() const {
+  auto profile = std::make_unique<SlowAllocationProfile>();
+  // Reserve up front: the samples are copied out under lock_, where we must
+  // not allocate.
+  profile->samples().reserve(kMaxSamples);
+  const double nanoseconds_per_cycle =
+      1e9 / absl::base_internal::CycleClock::Frequency();
+
+  AllocationGuardSpinLockHolder h(lock_);
+  const size_t n = std::min(next_, kMaxSamples);
+  for (size_t i = 0; i < n; ++i) {
+    const Sample& recorded = samples_[i];
+    Profile::Sample& sample = profile->samples().emplace_back();
+    sample.count = 1;
+    sample.sum = static_cast<int64_t>(recorded.cycles * nanoseconds_per_cycle);
+    sample.requested_size = recorded.size;
+    sample.allocation_time = recorded.time;
+    sample.slow_allocation_cause = recorded.cause;
+    sample.depth = recorded.depth;
+    static_assert(kMaxStackDepth <= Profile::Sample::kMaxStackDepth,
+                  "Profile stack size smaller than internal stack sizes");
+    memcpy(sample.stack, recorded.stack,
+           sizeof(sample.stack[0]) * sample.depth);
+  }
+  return profile;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
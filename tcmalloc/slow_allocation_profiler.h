@@ -0,0 +1,168 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_SLOW_ALLOCATION_PROFILER_H_
+#define TCMALLOC_SLOW_ALLOCATION_PROFILER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "absl/base/attributes.h"
+#include "absl/base/internal/cycleclock.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+using SlowAllocationCause = Profile::Sample::SlowAllocationCause;
+inline constexpr size_t kNumSlowAllocationCauses =
+    static_cast<size_t>(SlowAllocationCause::kDoNotUse);
+
+// Keeps the stacks of the allocations whose slow path took longer than
+// Parameters::slow_allocation_threshold(), for
+// ProfileType::kSlowAllocations.  The most recent kMaxSamples are retained.
+class SlowAllocationProfiler {
+ public:
+  static constexpr size_t kMaxSamples = 128;
+
+  constexpr SlowAllocationProfiler()
+      : lock_(absl::base_internal::SCHEDULE_KERNEL_ONLY) {}
+
+  // Records an allocation of `size` bytes that took `cycles`, most of which
+  // went to `cause`.  Must not be called with any allocator lock held.
+  void Record(size_t size, int64_t cycles, SlowAllocationCause cause)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns the retained samples.
+  std::unique_ptr<ProfileBase> DumpSample() const ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  struct Sample {
+    int64_t cycles;
+    size_t size;
+    SlowAllocationCause cause;
+    absl::Time time;
+    int depth;
+    void* stack[kMaxStackDepth];
+  };
+
+  mutable absl::base_internal::SpinLock lock_;
+  // Ring buffer of samples; next_ counts all samples ever recorded.
+  size_t next_ ABSL_GUARDED_BY(lock_) = 0;
+  Sample samples_[kMaxSamples] ABSL_GUARDED_BY(lock_) = {};
+};
+
+ABSL_CONST_INIT extern SlowAllocationProfiler slow_allocation_profiler;
+
+// The slow allocation being timed on this thread, if any.
+struct SlowAllocationTiming {
+  // Whether a ScopedSlowAllocationTimer is active.
+  bool active;
+  int64_t cause_cycles[kNumSlowAllocationCauses];
+};
+
+ABSL_CONST_INIT extern thread_local SlowAllocationTiming slow_allocation_timing
+    ABSL_ATTRIBUTE_INITIAL_EXEC;
+
+// Returns Parameters::slow_allocation_threshold() in cycles, or 0 if slow
+// allocations are not being profiled.
+int64_t SlowAllocationThresholdCycles();
+
+// Charges `cycles` of the slow allocation being timed on this thread, if any,
+// to `cause`.
+inline void AttributeToSlowAllocation(SlowAllocationCause cause,
+                                      int64_t cycles) {
+  if (ABSL_PREDICT_FALSE(slow_allocation_timing.active)) {
+    slow_allocation_timing.cause_cycles[static_cast<size_t>(cause)] += cycles;
+  }
+}
+
+// Times the slow path of an allocation of `size` bytes, and records it to
+// slow_allocation_profiler if it exceeds the threshold.  While profiling is
+// disabled this costs a load of the parameter.  Nested timers are ignored.
+class ScopedSlowAllocationTimer {
+ public:
+  explicit ScopedSlowAllocationTimer(size_t size) : size_(size) {
+    if (ABSL_PREDICT_FALSE(slow_allocation_timing.active)) return;
+    threshold_ = SlowAllocationThresholdCycles();
+    if (ABSL_PREDICT_FALSE(threshold_ > 0)) {
+      slow_allocation_timing.active = true;
+      for (int64_t& cycles : slow_allocation_timing.cause_cycles) {
+        cycles = 0;
+      }
+      start_ = absl::base_internal::CycleClock::Now();
+    }
+  }
+
+  ScopedSlowAllocationTimer(const ScopedSlowAllocationTimer&) = delete;
+  ScopedSlowAllocationTimer& operator=(const ScopedSlowAllocationTimer&) =
+      delete;
+
+  ~ScopedSlowAllocationTimer() {
+    if (ABSL_PREDICT_TRUE(threshold_ == 0)) return;
+    slow_allocation_timing.active = false;
+    const int64_t cycles = absl::base_internal::CycleClock::Now() - start_;
+    if (cycles >= threshold_) {
+      RecordSlow(cycles);
+    }
+  }
+
+ private:
+  ABSL_ATTRIBUTE_NOINLINE void RecordSlow(int64_t cycles);
+
+  size_t size_;
+  int64_t threshold_ = 0;
+  int64_t start_ = 0;
+};
+
+// Charges the time spent in its scope to `cause`, if a slow allocation is
+// being timed on this thread.
+class ScopedSlowAllocationCause {
+ public:
+  explicit ScopedSlowAllocationCause(SlowAllocationCause cause)
+      : cause_(cause) {
+    if (ABSL_PREDICT_FALSE(slow_allocation_timing.active)) {
+      start_ = absl::base_internal::CycleClock::Now();
+    }
+  }
+
+  ScopedSlowAllocationCause(const ScopedSlowAllocationCause&) = delete;
+  ScopedSlowAllocationCause& operator=(const ScopedSlowAllocationCause&) =
+      delete;
+
+  ~ScopedSlowAllocationCause() {
+    if (ABSL_PREDICT_FALSE(start_ != 0)) {
+      AttributeToSlowAllocation(
+          cause_, absl::base_internal::CycleClock::Now() - start_);
+    }
+  }
+
+ private:
+  SlowAllocationCause cause_;
+  int64_t start_ = 0;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_SLOW_ALLOCATION_PROFILER_H_
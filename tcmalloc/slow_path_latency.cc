@@ -0,0 +1,148 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/slow_path_latency.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/base/attributes.h"
+#include "absl/base/internal/cycleclock.h"
+#include "absl/numeric/bits.h"
+#include "absl/strings/string_view.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/parameters.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+ABSL_CONST_INIT SlowPathLatency slow_path_latency;
+ABSL_CONST_INIT thread_local int32_t slow_path_latency_countdown
+    ABSL_ATTRIBUTE_INITIAL_EXEC = 0;
+
+namespace {
+
+// While sampling is disabled, the parameter is rechecked after this many calls
+// on each thread.
+constexpr int32_t kDisabledRecheckPeriod = 4096;
+
+constexpr absl::string_view kSlowPathNames[kNumSlowPaths] = {
+    "cpu_cache_allocate",
+    "central_freelist_remove",
+    "central_freelist_insert",
+    "page_allocator_new",
+    "page_allocator_delete",
+    "background_release",
+};
+
+// Returns the upper bound of the bucket holding the q-th quantile of
+// `buckets`, in microseconds.
+double QuantileMicros(const uint64_t* buckets, uint64_t total, double q) {
+  const uint64_t target = static_cast<uint64_t>(q * total);
+  uint64_t seen = 0;
+  size_t i = 0;
+  for (; i < SlowPathLatency::kBuckets - 1; ++i) {
+    seen += buckets[i];
+    if (seen > target) break;
+  }
+  return static_cast<double>(uint64_t{2} << i) * 1e6 /
+         absl::base_internal::CycleClock::Frequency();
+}
+
+}  // namespace
+
+bool ResetSlowPathLatencyCountdown() {
+  const int32_t period = Parameters::slow_path_latency_sample_period();
+  if (period <= 0) {
+    slow_path_latency_countdown = kDisabledRecheckPeriod;
+    return false;
+  }
+  slow_path_latency_countdown = period;
+  return true;
+}
+
+bool SlowPathLatencyEnabled() {
+  return Parameters::slow_path_latency_sample_period() > 0;
+}
+
+void SlowPathLatency::Record(SlowPath path, int64_t cycles) {
+  const size_t bucket =
+      cycles <= 0 ? 0
+                  : std::min<size_t>(
+                        absl::bit_width(static_cast<uint64_t>(cycles)) - 1,
+                        kBuckets - 1);
+  buckets_[static_cast<size_t>(path)][bucket].fetch_add(
+      1, std::memory_order_relaxed);
+}
+
+void SlowPathLatency::Print(Printer& out) const {
+  out.printf("------------------------------------------------\n");
+  out.printf("Slow path latency: sampled 1 in %d calls per thread\n",
+             Parameters::slow_path_latency_sample_period());
+  out.printf("Non-cumulative number of samples taking [2^N, 2^(N+1)) cycles\n");
+  out.printf("------------------------------------------------\n");
+  for (size_t path = 0; path < kNumSlowPaths; ++path) {
+    uint64_t buckets[kBuckets];
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      buckets[i] = buckets_[path][i].load(std::memory_order_relaxed);
+      total += buckets[i];
+    }
+    out.printf("%-24s: %10u samples; p50 <= %9.3f us; p99 <= %9.3f us\n",
+               kSlowPathNames[path], total,
+               total ? QuantileMicros(buckets, total, 0.5) : 0.,
+               total ? QuantileMicros(buckets, total, 0.99) : 0.);
+    if (total == 0) continue;
+    out.printf("%-24s:", "");
+    for (size_t i = 0; i < kBuckets; ++i) {
+      if (buckets[i] == 0) continue;
+      out.printf(" %2u: %u", i, buckets[i]);
+    }
+    out.printf("\n");
+  }
+}
+
+void SlowPathLatency::PrintInPbtxt(PbtxtRegion& region) const {
+  region.PrintI64("sample_period",
+                  Parameters::slow_path_latency_sample_period());
+  for (size_t path = 0; path < kNumSlowPaths; ++path) {
+    uint64_t buckets[kBuckets];
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      buckets[i] = buckets_[path][i].load(std::memory_order_relaxed);
+      total += buckets[i];
+    }
+
+    PbtxtRegion entry = region.CreateSubRegion("slow_path");
+    entry.PrintRaw("path", kSlowPathNames[path]);
+    entry.PrintI64("samples", total);
+    if (total == 0) continue;
+    entry.PrintDouble("p50_us", QuantileMicros(buckets, total, 0.5));
+    entry.PrintDouble("p99_us", QuantileMicros(buckets, total, 0.99));
+    for (size_t i = 0; i < kBuckets; ++i) {
+      if (buckets[i] == 0) continue;
+      PbtxtRegion histogram = entry.CreateSubRegion("cycles_histogram");
+      histogram.PrintI64("lower_bound", int64_t{1} << i);
+      histogram.PrintI64("value", buckets[i]);
+    }
+  }
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
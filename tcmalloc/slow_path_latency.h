@@ -0,0 +1,113 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_SLOW_PATH_LATENCY_H_
+#define TCMALLOC_SLOW_PATH_LATENCY_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/base/attributes.h"
+#include "absl/base/internal/cycleclock.h"
+#include "absl/base/optimization.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// The allocator slow paths whose latency is tracked.
+enum class SlowPath : uint8_t {
+  kCpuCacheAllocate,
+  kCentralFreeListRemove,
+  kCentralFreeListInsert,
+  kPageAllocatorNew,
+  kPageAllocatorDelete,
+  kBackgroundRelease,
+};
+inline constexpr size_t kNumSlowPaths = 6;
+
+// Histograms of the cycles spent in each SlowPath, bucketed by powers of two.
+// Only a sample of one in Parameters::slow_path_latency_sample_period() calls
+// per thread is timed, and none are when it is 0.
+class SlowPathLatency {
+ public:
+  // Bucket i counts samples of [2^i, 2^(i+1)) cycles; the last bucket also
+  // counts anything longer.
+  static constexpr size_t kBuckets = 40;
+
+  constexpr SlowPathLatency() = default;
+
+  void Record(SlowPath path, int64_t cycles);
+
+  void Print(Printer& out) const;
+  void PrintInPbtxt(PbtxtRegion& region) const;
+
+ private:
+  std::atomic<uint64_t> buckets_[kNumSlowPaths][kBuckets] = {};
+};
+
+ABSL_CONST_INIT extern SlowPathLatency slow_path_latency;
+
+// Calls remaining on this thread until the next sampled one.
+ABSL_CONST_INIT extern thread_local int32_t slow_path_latency_countdown
+    ABSL_ATTRIBUTE_INITIAL_EXEC;
+
+// Resets slow_path_latency_countdown, returning whether the current call is
+// sampled.
+bool ResetSlowPathLatencyCountdown();
+
+// Returns whether slow path latencies are being sampled at all.
+bool SlowPathLatencyEnabled();
+
+// Times its scope for slow_path_latency, if the call is sampled.  Unsampled
+// calls cost a thread-local decrement.
+//
+// Background release runs once per background interval, so it is timed every
+// time while sampling is enabled.
+class ScopedSlowPathTimer {
+ public:
+  explicit ScopedSlowPathTimer(SlowPath path) : path_(path) {
+    const bool sampled =
+        path == SlowPath::kBackgroundRelease
+            ? SlowPathLatencyEnabled()
+            : ABSL_PREDICT_FALSE(--slow_path_latency_countdown <= 0) &&
+                  ResetSlowPathLatencyCountdown();
+    if (ABSL_PREDICT_FALSE(sampled)) {
+      start_ = absl::base_internal::CycleClock::Now();
+    }
+  }
+
+  ScopedSlowPathTimer(const ScopedSlowPathTimer&) = delete;
+  ScopedSlowPathTimer& operator=(const ScopedSlowPathTimer&) = delete;
+
+  ~ScopedSlowPathTimer() {
+    if (ABSL_PREDICT_FALSE(start_ != 0)) {
+      slow_path_latency.Record(
+          path_, absl::base_internal::CycleClock::Now() - start_);
+    }
+  }
+
+ private:
+  SlowPath path_;
+  int64_t start_ = 0;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_SLOW_PATH_LATENCY_H_
@@ -16,6 +16,7 @@
 
 #include <stdint.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
 #include <cstring>
@@ -28,6 +29,7 @@
 #include "tcmalloc/internal/atomic_stats_counter.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/memory_tag.h"
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/internal/sampled_allocation.h"
 #include "tcmalloc/pages.h"
@@ -117,7 +119,7 @@ SampledAllocation* Span::UnsampleSlow() {
 
 #ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
 void* Span::BitmapIdxToPtr(ObjIdx idx, size_t size) const {
-  uintptr_t off = first_page().start_uintptr() + idx * size;
+  uintptr_t off = bitmap_start() + idx * size;
   return reinterpret_cast<ObjIdx*>(off);
 }
 #endif
@@ -143,16 +145,20 @@ void Span::BuildBitmap(size_t size, size_t count) __restrict__ {
 }
 
 int Span::BuildFreelist(size_t size, size_t count, absl::Span<void*> batch,
-                        uint64_t alloc_time) __restrict__ {
+                        uint64_t alloc_time, size_t color) __restrict__ {
   TC_ASSERT(!is_large_or_sampled());
   TC_ASSERT_GT(count, 0);
   freelist_ = kListEnd;
   small_span_state_.alloc_time = alloc_time >> kAllocTimeShift;
 
   if (UseBitmapForSize(size)) {
+    TC_ASSERT_LT(color, kMaxColors);
+    TC_ASSERT_LE(color * kColorStride + count * size, bytes_in_span());
+    color_ = color;
     BuildBitmap(size, count);
     return BitmapPopBatch(batch, size);
   }
+  TC_ASSERT_EQ(color, 0);
 
   // First, push as much as we can into the batch.
   const uintptr_t start = first_page().start_uintptr();
@@ -216,14 +222,60 @@ int Span::BuildFreelist(size_t size, size_t count, absl::Span<void*> batch,
   return result;
 }
 
-Span* Span::New(Range r) { return Static::span_allocator().New(r); }
+void Span::AllocatedObjects(size_t size, size_t objects_per_span,
+                            absl::Span<uint64_t> occupancy) const {
+  TC_ASSERT(!is_large_or_sampled());
+  TC_ASSERT_LE(objects_per_span, 64 * occupancy.size());
+  std::fill(occupancy.begin(), occupancy.end(), 0);
+  for (size_t i = 0; i < objects_per_span; ++i) {
+    occupancy[i / 64] |= uint64_t{1} << (i % 64);
+  }
+  auto clear = [&](size_t i) {
+    TC_ASSERT_LT(i, objects_per_span);
+    occupancy[i / 64] &= ~(uint64_t{1} << (i % 64));
+  };
+
+  if (UseBitmapForSize(size)) {
+    for (size_t i = 0; i < objects_per_span; ++i) {
+      if (small_span_state_.bitmap.GetBit(i)) clear(i);
+    }
+    return;
+  }
+
+  auto object = [&](ObjIdx idx) {
+    return (static_cast<size_t>(idx) << kAlignmentShift) / size;
+  };
+  for (size_t i = 0; i < cache_size_; ++i) {
+    clear(object(small_span_state_.cache[i]));
+  }
+  // Only the first object on the freelist may be partially filled, see
+  // "Freelist organization" above.
+  const uintptr_t start = first_page().start_uintptr();
+  const size_t max_embed = size / sizeof(ObjIdx) - 1;
+  size_t embed_count = embed_count_;
+  for (ObjIdx idx = freelist_; idx != kListEnd;) {
+    const ObjIdx* host = IdxToPtr(idx, size, start);
+    clear(object(idx));
+    for (size_t i = 1; i <= embed_count; ++i) {
+      clear(object(host[i]));
+    }
+    idx = host[0];
+    embed_count = max_embed;
+  }
+}
+
+Span* Span::New(Range r) {
+  return Static::span_allocator(GetMemoryTag(r.p.start_addr())).New(r);
+}
 
 void Span::Delete(Span* span) {
+  auto& allocator =
+      Static::span_allocator(GetMemoryTag(span->first_page().start_addr()));
 #ifndef NDEBUG
   // In debug mode, trash the contents of deleted Spans
   memset(static_cast<void*>(span), 0x3f, sizeof(*span));
 #endif
-  Static::span_allocator().Delete(span);
+  allocator.Delete(span);
 }
 
 [[noreturn]] void Span::ReportDoubleFree(const void* ptr) {
@@ -21,6 +21,7 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <cstddef>
@@ -40,6 +41,7 @@
 #include "tcmalloc/internal/prefetch.h"
 #include "tcmalloc/internal/range_tracker.h"
 #include "tcmalloc/internal/sampled_allocation.h"
+#include "tcmalloc/lifetime_predictor.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/sizemap.h"
 
@@ -63,6 +65,9 @@ enum AccessDensityPrediction {
 struct SpanAllocInfo {
   size_t objects_per_span;
   AccessDensityPrediction density;
+  // Whether the span is expected to be freed soon, used to keep short-lived
+  // spans from pinning hugepages that otherwise hold long-lived ones.
+  LifetimePrediction lifetime = LifetimePrediction::kUnknown;
 };
 
 // Information kept for a span (a contiguous run of pages).
@@ -92,6 +97,10 @@ class ABSL_CACHELINE_ALIGNED Span final : public SpanList::Elem {
         nonempty_index_(0),
         is_donated_(0),
         first_page_(0),
+        central_freelist_shard_(0),
+        known_zero_(0),
+        in_large_span_cache_(0),
+        color_(0),
         reserved_(0),
         is_large_span_(0),
         sampled_(0),
@@ -106,6 +115,10 @@ class ABSL_CACHELINE_ALIGNED Span final : public SpanList::Elem {
         nonempty_index_(0),
         is_donated_(0),
         first_page_(r.p.index()),
+        central_freelist_shard_(0),
+        known_zero_(0),
+        in_large_span_cache_(0),
+        color_(0),
         reserved_(0),
         is_large_span_(0),
         sampled_(0),
@@ -158,6 +171,16 @@ class ABSL_CACHELINE_ALIGNED Span final : public SpanList::Elem {
   bool donated() const { return is_donated_; }
   void set_donated(bool value) { is_donated_ = value; }
 
+  // Were the span's pages known to be zero when the page heap handed it out?
+  // calloc skips clearing such spans.
+  bool known_zero() const { return known_zero_; }
+  void set_known_zero(bool value) { known_zero_ = value; }
+
+  // Is the span held by the LargeSpanCache?  Guarded by the lock of the cache
+  // shard that holds it.
+  bool in_large_span_cache() const { return in_large_span_cache_; }
+  void set_in_large_span_cache(bool value) { in_large_span_cache_ = value; }
+
   // ---------------------------------------------------------------------------
   // Span memory range.
   // ---------------------------------------------------------------------------
@@ -224,13 +247,28 @@ class ABSL_CACHELINE_ALIGNED Span final : public SpanList::Elem {
   // Initialize freelist to contain all objects in the span.
   // Pops up to N objects from the freelist and returns them in the batch array.
   // Returns number of objects actually popped.
+  //
+  // Objects of bitmap'd spans start color * kColorStride bytes into the span.
+  // REQUIRES: color == 0 unless UseBitmapForSize(size), and the objects fit.
   [[nodiscard]] int BuildFreelist(size_t size, size_t count,
-                                  absl::Span<void*> batch,
-                                  uint64_t alloc_time) __restrict__;
+                                  absl::Span<void*> batch, uint64_t alloc_time,
+                                  size_t color = 0) __restrict__;
+
+  // Sets the bit of each allocated object in occupancy, bit i standing for the
+  // i-th object of the span, and clears the others.  Reads the freelist
+  // without changing it.
+  // REQUIRES: objects_per_span <= 64 * occupancy.size().
+  void AllocatedObjects(size_t size, size_t objects_per_span,
+                        absl::Span<uint64_t> occupancy) const;
 
   // Prefetch cacheline containing most important span information.
   void Prefetch();
 
+  // Prefetch the object holding the head of the embedded freelist, which the
+  // next FreelistPopBatch reads.  No-op for bitmap'd spans, whose freelist
+  // lives in the span itself.
+  void PrefetchFreelist(size_t size) const;
+
   // IsValidSizeClass verifies size class parameters from the Span perspective.
   static bool IsValidSizeClass(size_t size, Length pages);
 
@@ -259,17 +297,40 @@ class ABSL_CACHELINE_ALIGNED Span final : public SpanList::Elem {
   ObjIdx BitmapPtrToIdx(void* ptr, size_t size, uint32_t reciprocal) const;
   void* BitmapIdxToPtr(ObjIdx idx, size_t size) const;
 
-  static constexpr size_t kNonemptyIndexBits = 5;
+  static constexpr size_t kNonemptyIndexBits = 6;
 
   bool is_long_lived_span() const { return is_long_lived_span_; }
 
   void set_is_long_lived_span(bool value) { is_long_lived_span_ = value; }
 
+  // The central freelist shard that owns this span, see
+  // CentralFreeList::EnableShards.
+  static constexpr size_t kCentralFreeListShardBits = 2;
+
+  uint8_t central_freelist_shard() const { return central_freelist_shard_; }
+
+  // Objects of a bitmap'd span start color() * kColorStride bytes into the
+  // span, so that spans of a size class rotate their objects across cache sets
+  // within the slack at the end of the span.  See SizeMap::class_to_colors().
+  static constexpr size_t kColorBits = 4;
+  static constexpr size_t kMaxColors = size_t{1} << kColorBits;
+  static constexpr size_t kColorStride = 64;
+
+  size_t color() const { return color_; }
+
+  void set_central_freelist_shard(uint8_t shard) {
+    TC_ASSERT_LT(shard, 1 << kCentralFreeListShardBits);
+    central_freelist_shard_ = shard;
+  }
+
  private:
   // Returns if the span is large (i.e. consists of > kLargeSpanLength number of
   // pages) or is sampled.
   bool is_large_or_sampled() const { return is_large_span_ || sampled_; }
 
+  // Returns the address of the first object of a bitmap'd span.
+  uintptr_t bitmap_start() const;
+
   // See the comment on freelist organization in cc file.
   static constexpr ObjIdx kListEnd = -1;
 
@@ -290,7 +351,8 @@ class ABSL_CACHELINE_ALIGNED Span final : public SpanList::Elem {
   static_assert(kCacheSize <= (1 << kMaxCacheBits) - 1);
 
   static constexpr size_t kMaxPageIdBits = kAddressBits - kPageShift;
-  static constexpr size_t kReservedBits = 24;
+  static constexpr size_t kReservedBits =
+      24 - kCentralFreeListShardBits - 2 - kColorBits;
   // Use uint16_t or uint8_t for 16 bit and 8 bit fields instead of bitfields.
   // LLVM will generate widen load/store and bit masking operations to access
   // bitfields and this hurts performance. Although compiler flag
@@ -333,6 +395,10 @@ class ABSL_CACHELINE_ALIGNED Span final : public SpanList::Elem {
 
   uint64_t first_page_ : kMaxPageIdBits;  // Starting page number.
 
+  uint32_t central_freelist_shard_ : kCentralFreeListShardBits;
+  uint32_t known_zero_ : 1;
+  uint32_t in_large_span_cache_ : 1;
+  uint32_t color_ : kColorBits;
   uint32_t reserved_ : kReservedBits;
   // Determines if the span consists of > kLargeSpanLength number of pages.
   uint8_t is_large_span_ : 1;
@@ -397,6 +463,15 @@ class ABSL_CACHELINE_ALIGNED Span final : public SpanList::Elem {
   size_t ListPopBatch(void** __restrict batch, size_t N,
                       size_t size) __restrict__;
 
+  // Converts the n indices src[n - 1], ..., src[0] to pointers into dst, and
+  // dst[0], ..., dst[n - 1] to indices into src respectively.  Iterations are
+  // independent so that the loops compile to SIMD code and the conversions
+  // under the central freelist lock do not run one object at a time.
+  void DecodeReversed(const ObjIdx* __restrict src, size_t n, size_t size,
+                      uintptr_t start, void** __restrict dst) const;
+  void Encode(void* const* __restrict src, size_t n, size_t size,
+              ObjIdx* __restrict dst) const;
+
   bool ListPushBatch(absl::Span<void*> batch, size_t size) __restrict__;
   bool ListPushBatch(absl::Span<ObjIdx> batch, size_t size) __restrict__;
 
@@ -455,6 +530,36 @@ inline Span::ObjIdx Span::PtrToIdx(void* ptr, size_t size) const {
   return idx;
 }
 
+inline void Span::DecodeReversed(const ObjIdx* __restrict src, size_t n,
+                                 size_t size, uintptr_t start,
+                                 void** __restrict dst) const {
+  TC_ASSERT_EQ(small_span_state_.num_pages, 1u);
+  TC_ASSERT_EQ(start, first_page().start_uintptr());
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = reinterpret_cast<void*>(
+        start + (static_cast<uintptr_t>(src[n - 1 - i]) << kAlignmentShift));
+  }
+  for (size_t i = 0; i < n; ++i) {
+    TC_ASSERT_NE(src[n - 1 - i], kListEnd);
+    TC_ASSERT_EQ(PtrToIdx(dst[i], size), src[n - 1 - i]);
+  }
+}
+
+inline void Span::Encode(void* const* __restrict src, size_t n, size_t size,
+                         ObjIdx* __restrict dst) const {
+  // Classes that use freelist must also use 1 page per span, so the index is
+  // just the offset into the page; see PtrToIdx.
+  TC_ASSERT_EQ(small_span_state_.num_pages, 1u);
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = static_cast<ObjIdx>(
+        (reinterpret_cast<uintptr_t>(src[i]) & (kPageSize - 1)) >>
+        kAlignmentShift);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    TC_ASSERT_EQ(PtrToIdx(src[i], size), dst[i]);
+  }
+}
+
 template <typename T>
 inline bool Span::FreelistPushBatch(absl::Span<T> batch, size_t size,
                                     uint32_t reciprocal) __restrict__ {
@@ -477,11 +582,9 @@ inline bool Span::ListPushBatch(absl::Span<void*> batch,
                                 size_t size) __restrict__ {
   if (cache_size_ < kCacheSize) {
     auto cache_writes = std::min(kCacheSize - cache_size_, batch.size());
-    for (int i = 0; i < cache_writes; ++i) {
-      // Have empty space in the cache, push there.
-      const ObjIdx idx = PtrToIdx(batch[i], size);
-      small_span_state_.cache[cache_size_ + i] = idx;
-    }
+    // Have empty space in the cache, push there.
+    Encode(batch.data(), cache_writes, size,
+           small_span_state_.cache + cache_size_);
     cache_size_ += cache_writes;
     batch.remove_prefix(cache_writes);
   }
@@ -501,21 +604,25 @@ inline bool Span::ListPushBatch(absl::Span<void*> batch,
   }
 #endif
 
-  for (void* ptr : batch) {
-    const ObjIdx idx = PtrToIdx(ptr, size);
+  // -1 because the first slot is used by freelist link.
+  const size_t limit = size / sizeof(ObjIdx) - 1;
 
+  while (!batch.empty()) {
     if (ABSL_PREDICT_TRUE(freelist_ != kListEnd) &&
-        // -1 because the first slot is used by freelist link.
-        ABSL_PREDICT_TRUE(embed_count_ != size / sizeof(ObjIdx) - 1)) {
-      // Push onto the first object on freelist.
+        ABSL_PREDICT_TRUE(embed_count_ != limit)) {
+      // Push as many objects as fit onto the first object on freelist.
       ObjIdx* __restrict host = IdxToPtr(freelist_, size, start);
-      embed_count_++;
-      host[embed_count_] = idx;
+      const size_t n = std::min<size_t>(limit - embed_count_, batch.size());
+      Encode(batch.data(), n, size, host + embed_count_ + 1);
+      embed_count_ += n;
+      batch.remove_prefix(n);
     } else {
       // Push onto freelist.
+      void* ptr = batch[0];
       *reinterpret_cast<ObjIdx*>(ptr) = freelist_;
-      freelist_ = idx;
+      freelist_ = PtrToIdx(ptr, size);
       embed_count_ = 0;
+      batch.remove_prefix(1);
     }
   }
   return true;
@@ -525,11 +632,9 @@ inline bool Span::ListPushBatch(absl::Span<Span::ObjIdx> batch,
                                 size_t size) __restrict__ {
   if (cache_size_ < kCacheSize) {
     auto cache_writes = std::min(kCacheSize - cache_size_, batch.size());
-    for (int i = 0; i < cache_writes; ++i) {
-      // Have empty space in the cache, push there.
-      const ObjIdx idx = batch[i];
-      small_span_state_.cache[cache_size_ + i] = idx;
-    }
+    // Have empty space in the cache, push there.
+    std::copy_n(batch.data(), cache_writes,
+                small_span_state_.cache + cache_size_);
     cache_size_ += cache_writes;
     batch.remove_prefix(cache_writes);
   }
@@ -561,18 +666,22 @@ inline bool Span::ListPushBatch(absl::Span<Span::ObjIdx> batch,
   // -1 because the first slot is used by freelist link.
   const size_t limit = size / sizeof(ObjIdx) - 1;
 
-  for (const ObjIdx idx : batch) {
+  while (!batch.empty()) {
     if (ABSL_PREDICT_TRUE(embed_count != limit)) {
-      // Push onto the first object on freelist.
-      embed_count++;
-      host[embed_count] = idx;
+      // Push as many objects as fit onto the first object on freelist.
+      const size_t n = std::min<size_t>(limit - embed_count, batch.size());
+      std::copy_n(batch.data(), n, host + embed_count + 1);
+      embed_count += n;
+      batch.remove_prefix(n);
     } else {
       // Push onto freelist.
+      const ObjIdx idx = batch[0];
       ObjIdx* __restrict new_host = IdxToPtr(idx, size, start);
       *new_host = freelist;
       freelist = idx;
       embed_count = 0;
       host = new_host;
+      batch.remove_prefix(1);
     }
   }
   freelist_ = freelist;
@@ -589,15 +698,19 @@ inline Span::ObjIdx Span::OffsetToIdx(uintptr_t offset, uint32_t reciprocal) {
 
 #ifndef TCMALLOC_INTERNAL_LEGACY_LOCKING
 inline void* Span::BitmapIdxToPtr(ObjIdx idx, size_t size) const {
-  uintptr_t off = first_page().start_uintptr() + idx * size;
+  uintptr_t off = bitmap_start() + idx * size;
   return reinterpret_cast<void*>(off);
 }
 #endif
 
+inline uintptr_t Span::bitmap_start() const {
+  return first_page().start_uintptr() + color_ * kColorStride;
+}
+
 inline Span::ObjIdx Span::BitmapPtrToIdx(void* ptr, size_t size,
                                          uint32_t reciprocal) const {
   uintptr_t p = reinterpret_cast<uintptr_t>(ptr);
-  uintptr_t off = static_cast<uint32_t>(p - first_page().start_uintptr());
+  uintptr_t off = static_cast<uint32_t>(p - bitmap_start());
   ObjIdx idx = OffsetToIdx(off, reciprocal);
   TC_ASSERT_EQ(BitmapIdxToPtr(idx, size), ptr);
   return idx;
@@ -712,6 +825,11 @@ inline void Span::Prefetch() {
 #endif
 }
 
+inline void Span::PrefetchFreelist(size_t size) const {
+  if (UseBitmapForSize(size) || freelist_ == kListEnd) return;
+  PrefetchT0(IdxToPtr(freelist_, size, first_page().start_uintptr()));
+}
+
 inline bool Span::IsValidSizeClass(size_t size, Length pages) {
   if (pages > kLargeSpanLength) return false;
   if (Span::UseBitmapForSize(size)) {
@@ -783,10 +901,9 @@ inline size_t Span::ListPopBatch(void** __restrict batch, size_t N,
   ASSUME(csize <= kCacheSize);
   auto cache_reads = csize < N ? csize : N;
   const uintptr_t span_start = first_page().start_uintptr();
-  for (; result < cache_reads; result++) {
-    batch[result] =
-        IdxToPtr(small_span_state_.cache[csize - result - 1], size, span_start);
-  }
+  DecodeReversed(small_span_state_.cache + csize - cache_reads, cache_reads,
+                 size, span_start, batch);
+  result = cache_reads;
 
   // Store this->cache_size_ one time.
   cache_size_ = csize - result;
@@ -803,10 +920,9 @@ inline size_t Span::ListPopBatch(void** __restrict batch, size_t N,
     if (result + embed_count > N) {
       iter = N - result;
     }
-    for (size_t i = 0; i < iter; i++) {
-      // Pop from the first object on freelist.
-      batch[result + i] = IdxToPtr(host[embed_count - i], size, span_start);
-    }
+    // Pop from the first object on freelist, last embedded index first.
+    DecodeReversed(host + embed_count - iter + 1, iter, size, span_start,
+                   batch + result);
     embed_count -= iter;
     result += iter;
 
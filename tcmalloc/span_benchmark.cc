@@ -47,16 +47,18 @@ class RawSpan {
   RawSpan(const RawSpan&) = delete;
   RawSpan& operator=(const RawSpan&) = delete;
 
-  void Init(size_t size, Length npages) {
+  void Init(size_t size, Length npages, size_t color = 0) {
     TC_CHECK_GT(size, 0);
-    size_t objects_per_span = npages.in_bytes() / size;
+    size_t objects_per_span =
+        (npages.in_bytes() - color * Span::kColorStride) / size;
 
     void* mem;
     int res = posix_memalign(&mem, kPageSize, npages.in_bytes());
     TC_CHECK_EQ(res, 0);
     span_.emplace(Range(PageIdContaining(mem), npages));
-    TC_CHECK_EQ(
-        span_->BuildFreelist(size, objects_per_span, {}, kSpanAllocTime), 0);
+    TC_CHECK_EQ(span_->BuildFreelist(size, objects_per_span, {}, kSpanAllocTime,
+                                     color),
+                0);
   }
 
   ~RawSpan() {
@@ -290,6 +292,61 @@ void ForEachConfig(F&& f) {
   }
 }
 
+// Creates and destroys `num_spans` spans in random order, as the page heap
+// does while spans cycle through the central freelists.
+void BM_SpanNewDelete(benchmark::State& state) {
+  const size_t num_spans = state.range(0);
+  std::vector<Span*> spans(num_spans);
+  std::vector<size_t> order(num_spans);
+  std::iota(order.begin(), order.end(), size_t{0});
+  absl::BitGen rng;
+  std::shuffle(order.begin(), order.end(), rng);
+
+  // Spans are never dereferenced through these pages.
+  const PageId first = PageIdContaining(&spans);
+  while (state.KeepRunningBatch(num_spans)) {
+    for (size_t i = 0; i < num_spans; ++i) {
+      spans[i] = Span::New(Range(first + Length(i), Length(1)));
+    }
+    for (size_t i : order) {
+      Span::Delete(spans[i]);
+    }
+  }
+}
+
+BENCHMARK(BM_SpanNewDelete)->Range(64, 64 << 10);
+
+// Touches the first cache line of every object of `num_spans` spans of 4 KiB
+// objects, whose spans rotate through `colors` start offsets.  Uncolored, all
+// objects start at the same page offset and compete for a single cache set.
+void BM_SpanColoredTouch(benchmark::State& state) {
+  const size_t colors = state.range(0);
+  const size_t num_spans = state.range(1);
+  constexpr size_t kSize = 4096;
+  // Leave room for the last color.
+  const Length npages =
+      BytesToLengthCeil(kSize + Span::kMaxColors * Span::kColorStride);
+
+  std::vector<RawSpan> spans(num_spans);
+  std::vector<void*> objects;
+  for (size_t i = 0; i < num_spans; ++i) {
+    spans[i].Init(kSize, npages, i % colors);
+    void* batch[kMaxObjectsToMove];
+    size_t n = spans[i].span().FreelistPopBatch(absl::MakeSpan(batch), kSize);
+    objects.insert(objects.end(), batch, batch + n);
+  }
+
+  while (state.KeepRunningBatch(objects.size())) {
+    for (void* p : objects) {
+      ++*static_cast<volatile uint64_t*>(p);
+    }
+  }
+}
+
+BENCHMARK(BM_SpanColoredTouch)
+    ->ArgsProduct({{1, Span::kMaxColors}, {8, 64, 512}})
+    ->ArgNames({"colors", "spans"});
+
 class BenchmarkRegistrar {
  public:
   BenchmarkRegistrar() {
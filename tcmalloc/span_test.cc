@@ -317,8 +317,96 @@ TEST_P(SpanTest, FreelistRandomized) {
   }
 }
 
+TEST_P(SpanTest, AllocatedObjects) {
+  Span& span_ = raw_span_.span();
+
+  char* start = static_cast<char*>(span_.start_address());
+  std::vector<uint64_t> occupancy((objects_per_span_ + 63) / 64);
+  auto allocated = [&](size_t i) {
+    return (occupancy[i / 64] >> (i % 64)) & 1;
+  };
+
+  span_.AllocatedObjects(size_, objects_per_span_, absl::MakeSpan(occupancy));
+  for (size_t i = 0; i < objects_per_span_; ++i) {
+    EXPECT_FALSE(allocated(i)) << i;
+  }
+
+  // Allocate everything, then free objects at random, so that the freelist
+  // spans the cache and several freelist objects.
+  absl::BitGen rng;
+  std::vector<void*> objects;
+  void* batch[kMaxObjectsToMove];
+  for (;;) {
+    size_t n =
+        span_.FreelistPopBatch(absl::MakeSpan(batch, batch_size_), size_);
+    objects.insert(objects.end(), batch, batch + n);
+    if (n < batch_size_) break;
+  }
+  ASSERT_EQ(objects.size(), objects_per_span_);
+  std::vector<bool> live(objects_per_span_, true);
+  for (void* p : objects) {
+    if (absl::Bernoulli(rng, 0.5)) continue;
+    if (!span_.FreelistPushBatch(absl::MakeSpan(&p, 1), size_, reciprocal_)) {
+      break;
+    }
+    live[(static_cast<char*>(p) - start) / size_] = false;
+  }
+
+  span_.AllocatedObjects(size_, objects_per_span_, absl::MakeSpan(occupancy));
+  for (size_t i = 0; i < objects_per_span_; ++i) {
+    EXPECT_EQ(allocated(i), live[i]) << i;
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(All, SpanTest, testing::Range(size_t(1), kNumClasses));
 
+TEST(SpanColorTest, ObjectsStartAtColorOffset) {
+#if ABSL_HAVE_HWADDRESS_SANITIZER
+  GTEST_SKIP()
+      << "Skipping under HWASan, which uses the top bits of the pointer.";
+#endif
+
+  // Three objects leave a quarter of the page as slack.
+  const size_t size = kPageSize / 4;
+  const size_t objects_per_span = 3;
+  const size_t color = Span::kMaxColors - 1;
+  ASSERT_TRUE(Span::UseBitmapForSize(size));
+  ASSERT_LE(color * Span::kColorStride, kPageSize - objects_per_span * size);
+
+  void* mem;
+  ASSERT_EQ(posix_memalign(&mem, kPageSize, kPageSize), 0);
+  auto span = std::make_unique<Span>(Range(PageIdContaining(mem), Length(1)));
+  void* batch[objects_per_span];
+  ASSERT_EQ(span->BuildFreelist(size, objects_per_span,
+                                absl::MakeSpan(batch), kSpanAllocTime, color),
+            objects_per_span);
+  EXPECT_EQ(span->color(), color);
+
+  const uint32_t reciprocal = Span::CalcReciprocal(size);
+  char* start = static_cast<char*>(mem) + color * Span::kColorStride;
+  std::vector<bool> seen(objects_per_span);
+  for (void* p : batch) {
+    const uintptr_t off = static_cast<char*>(p) - start;
+    ASSERT_EQ(off % size, 0);
+    ASSERT_LT(off / size, objects_per_span);
+    EXPECT_FALSE(seen[off / size]);
+    seen[off / size] = true;
+    EXPECT_EQ(span->BitmapPtrToIdx(p, size, reciprocal), off / size);
+  }
+
+  std::vector<uint64_t> occupancy(1);
+  span->AllocatedObjects(size, objects_per_span, absl::MakeSpan(occupancy));
+  EXPECT_EQ(occupancy[0], (uint64_t{1} << objects_per_span) - 1);
+  ASSERT_TRUE(span->FreelistPushBatch(absl::MakeSpan(batch, 1), size,
+                                      reciprocal));
+  void* p;
+  ASSERT_EQ(span->FreelistPopBatch(absl::MakeSpan(&p, 1), size), 1);
+  EXPECT_EQ(p, batch[0]);
+
+  span.reset();
+  free(mem);
+}
+
 TEST(SpanAllocatorTest, Alignment) {
   Range r(PageId{1}, Length{2});
 
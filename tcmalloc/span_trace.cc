@@ -0,0 +1,148 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/span_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "absl/base/internal/cycleclock.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "tcmalloc/huge_page_aware_allocator.h"
+#include "tcmalloc/internal/logging.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+using huge_page_allocator_internal::SetSpanTraceHook;
+using huge_page_allocator_internal::SpanTraceEvent;
+
+constexpr char kMagic[8] = {'T', 'C', 'S', 'P', 'A', 'N', 'S', '1'};
+
+struct FileHeader {
+  char magic[8];
+  double clock_frequency;
+  uint64_t num_events;
+};
+
+}  // namespace
+
+std::atomic<SpanTraceRecorder*> SpanTraceRecorder::active_{nullptr};
+
+absl::Status SpanTrace::WriteToFile(absl::string_view path) const {
+  const std::string filename(path);
+  FILE* f = fopen(filename.c_str(), "wb");
+  if (f == nullptr) {
+    return absl::NotFoundError(absl::StrCat("cannot open ", path));
+  }
+  FileHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.clock_frequency = clock_frequency;
+  header.num_events = events.size();
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  if (ok && !events.empty()) {
+    ok = fwrite(events.data(), sizeof(events[0]), events.size(), f) ==
+         events.size();
+  }
+  ok = (fclose(f) == 0) && ok;
+  if (!ok) {
+    return absl::DataLossError(absl::StrCat("cannot write ", path));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<SpanTrace> SpanTrace::ReadFromFile(absl::string_view path) {
+  const std::string filename(path);
+  FILE* f = fopen(filename.c_str(), "rb");
+  if (f == nullptr) {
+    return absl::NotFoundError(absl::StrCat("cannot open ", path));
+  }
+  FileHeader header;
+  if (fread(&header, sizeof(header), 1, f) != 1 ||
+      memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      !(header.clock_frequency > 0)) {
+    fclose(f);
+    return absl::InvalidArgumentError(
+        absl::StrCat(path, " is not a span trace"));
+  }
+
+  SpanTrace trace;
+  trace.clock_frequency = header.clock_frequency;
+  trace.events.resize(header.num_events);
+  const bool ok = trace.events.empty() ||
+                  fread(trace.events.data(), sizeof(trace.events[0]),
+                        trace.events.size(), f) == trace.events.size();
+  fclose(f);
+  if (!ok) {
+    return absl::DataLossError(absl::StrCat(path, " is truncated"));
+  }
+  return trace;
+}
+
+SpanTraceRecorder::SpanTraceRecorder(size_t max_events)
+    : capacity_(max_events),
+      events_(std::make_unique<SpanTraceEvent[]>(max_events)) {
+  SpanTraceRecorder* expected = nullptr;
+  TC_CHECK(active_.compare_exchange_strong(expected, this,
+                                           std::memory_order_release));
+  SetSpanTraceHook(&SpanTraceRecorder::Hook);
+}
+
+SpanTraceRecorder::~SpanTraceRecorder() {
+  if (!finished_) {
+    Finish();
+  }
+}
+
+void SpanTraceRecorder::Hook(const SpanTraceEvent& event) {
+  SpanTraceRecorder* recorder = active_.load(std::memory_order_acquire);
+  if (recorder == nullptr) return;
+  const size_t i = recorder->next_.fetch_add(1, std::memory_order_relaxed);
+  if (i >= recorder->capacity_) return;
+  recorder->events_[i] = event;
+  recorder->written_.fetch_add(1, std::memory_order_release);
+}
+
+SpanTrace SpanTraceRecorder::Finish() {
+  TC_CHECK(!finished_);
+  finished_ = true;
+  SetSpanTraceHook(nullptr);
+  active_.store(nullptr, std::memory_order_release);
+
+  // Wait for hooks that were already running to fill in their slots.
+  const size_t n =
+      std::min(next_.load(std::memory_order_relaxed), capacity_);
+  while (written_.load(std::memory_order_acquire) < n) {
+    std::this_thread::yield();
+  }
+
+  SpanTrace trace;
+  trace.clock_frequency = absl::base_internal::CycleClock::Frequency();
+  trace.events.assign(events_.get(), events_.get() + n);
+  return trace;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -0,0 +1,82 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Records the spans allocated and freed by the HugePageAwareAllocators of a
+// process, for replay by huge_page_filler_simulator.
+
+#ifndef TCMALLOC_SPAN_TRACE_H_
+#define TCMALLOC_SPAN_TRACE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "tcmalloc/huge_page_aware_allocator.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+struct SpanTrace {
+  // Ticks per second of SpanTraceEvent::time.
+  double clock_frequency = 0;
+  // In the order they were reported in.
+  std::vector<huge_page_allocator_internal::SpanTraceEvent> events;
+
+  // Traces are written in the byte order of the host.
+  absl::Status WriteToFile(absl::string_view path) const;
+  static absl::StatusOr<SpanTrace> ReadFromFile(absl::string_view path);
+};
+
+// Records span events from construction until Finish() into a buffer
+// allocated up front, since the hook may run with pageheap_lock held.  Events
+// beyond max_events are dropped.
+//
+// Only one recorder may exist at a time.
+class SpanTraceRecorder {
+ public:
+  explicit SpanTraceRecorder(size_t max_events);
+  ~SpanTraceRecorder();
+
+  SpanTraceRecorder(const SpanTraceRecorder&) = delete;
+  SpanTraceRecorder& operator=(const SpanTraceRecorder&) = delete;
+
+  // Stops recording and returns the trace.
+  SpanTrace Finish();
+
+  size_t dropped_events() const {
+    const size_t reserved = next_.load(std::memory_order_relaxed);
+    return reserved > capacity_ ? reserved - capacity_ : 0;
+  }
+
+ private:
+  static void Hook(const huge_page_allocator_internal::SpanTraceEvent& event);
+
+  const size_t capacity_;
+  std::unique_ptr<huge_page_allocator_internal::SpanTraceEvent[]> events_;
+  // Slots handed out, and slots filled in.
+  std::atomic<size_t> next_{0};
+  std::atomic<size_t> written_{0};
+  bool finished_ = false;
+
+  static std::atomic<SpanTraceRecorder*> active_;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+
+#endif  // TCMALLOC_SPAN_TRACE_H_
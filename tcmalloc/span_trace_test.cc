@@ -0,0 +1,183 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/span_trace.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_page_aware_allocator.h"
+#include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/mock_huge_page_static_forwarder.h"
+#include "tcmalloc/page_allocator_interface.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+using huge_page_allocator_internal::FakeStaticForwarder;
+using huge_page_allocator_internal::HugePageAwareAllocator;
+using huge_page_allocator_internal::SpanTraceEvent;
+
+using FakeHugePageAwareAllocator = HugePageAwareAllocator<FakeStaticForwarder>;
+
+constexpr SpanAllocInfo kSparse = {.objects_per_span = 1,
+                                   .density = AccessDensityPrediction::kSparse};
+
+class SpanTraceTest : public testing::Test {
+ protected:
+  SpanTraceTest() {
+    allocator_ = new (allocator_storage_.data())
+        FakeHugePageAwareAllocator({.tag = MemoryTag::kNormal});
+  }
+
+  ~SpanTraceTest() override { allocator_->~FakeHugePageAwareAllocator(); }
+
+  void Delete(Span* s, SpanAllocInfo info) {
+#ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
+    PageHeapSpinLockHolder l;
+    allocator_->Delete(s, info);
+#else
+    PageAllocatorInterface::AllocationState a{
+        Range(s->first_page(), s->num_pages()),
+        s->donated(),
+    };
+    allocator_->forwarder().DeleteSpan(s);
+    PageHeapSpinLockHolder l;
+    allocator_->Delete(a, info);
+#endif  // TCMALLOC_INTERNAL_LEGACY_LOCKING
+  }
+
+  // Events of the fake allocator, rather than of the process heap.
+  static std::vector<SpanTraceEvent> EventsFor(const SpanTrace& trace,
+                                               uint64_t first_page) {
+    std::vector<SpanTraceEvent> events;
+    for (const SpanTraceEvent& e : trace.events) {
+      if (e.first_page == first_page) events.push_back(e);
+    }
+    return events;
+  }
+
+  alignas(FakeHugePageAwareAllocator)
+      std::array<unsigned char, sizeof(FakeHugePageAwareAllocator)>
+          allocator_storage_;
+  FakeHugePageAwareAllocator* allocator_;
+};
+
+TEST_F(SpanTraceTest, RecordsSpans) {
+  SpanTrace trace;
+  uint64_t small_page, aligned_page;
+  {
+    SpanTraceRecorder recorder(/*max_events=*/1 << 16);
+    const SpanAllocInfo dense = {.objects_per_span = 64,
+                                 .density = AccessDensityPrediction::kDense};
+    Span* small = allocator_->New(Length(1), dense);
+    Span* aligned = allocator_->NewAligned(Length(3), Length(4), kSparse);
+    ASSERT_NE(small, nullptr);
+    ASSERT_NE(aligned, nullptr);
+    small_page = small->first_page().index();
+    aligned_page = aligned->first_page().index();
+    Delete(small, dense);
+    Delete(aligned, kSparse);
+    trace = recorder.Finish();
+    EXPECT_EQ(recorder.dropped_events(), 0);
+  }
+  EXPECT_GT(trace.clock_frequency, 0);
+
+  const std::vector<SpanTraceEvent> small = EventsFor(trace, small_page);
+  ASSERT_EQ(small.size(), 2);
+  EXPECT_EQ(small[0].op, SpanTraceEvent::kNew);
+  EXPECT_EQ(small[0].pages, 1);
+  EXPECT_EQ(small[0].objects_per_span, 64);
+  EXPECT_EQ(small[0].density, AccessDensityPrediction::kDense);
+  EXPECT_EQ(small[0].tag, MemoryTag::kNormal);
+  EXPECT_EQ(small[1].op, SpanTraceEvent::kDelete);
+  EXPECT_EQ(small[1].pages, 1);
+  EXPECT_LE(small[0].time, small[1].time);
+
+  const std::vector<SpanTraceEvent> aligned = EventsFor(trace, aligned_page);
+  ASSERT_EQ(aligned.size(), 2);
+  EXPECT_EQ(aligned[0].op, SpanTraceEvent::kNew);
+  EXPECT_EQ(aligned[0].pages, 3);
+  EXPECT_EQ(aligned[0].align, 4);
+  EXPECT_EQ(aligned[1].op, SpanTraceEvent::kDelete);
+}
+
+TEST_F(SpanTraceTest, StopsRecording) {
+  Span* s;
+  {
+    SpanTraceRecorder recorder(/*max_events=*/1 << 16);
+    recorder.Finish();
+    s = allocator_->New(Length(1), kSparse);
+  }
+  // A second recorder may start once the first is gone.
+  const uint64_t page = s->first_page().index();
+  SpanTraceRecorder recorder(/*max_events=*/1 << 16);
+  Delete(s, kSparse);
+  const SpanTrace trace = recorder.Finish();
+  const std::vector<SpanTraceEvent> events = EventsFor(trace, page);
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].op, SpanTraceEvent::kDelete);
+}
+
+TEST_F(SpanTraceTest, RoundTrip) {
+  SpanTrace trace;
+  trace.clock_frequency = 1e9;
+  for (int i = 0; i < 10; ++i) {
+    trace.events.push_back({.time = i,
+                            .first_page = static_cast<uint64_t>(100 + i),
+                            .moved_to = 0,
+                            .pages = static_cast<uint64_t>(i + 1),
+                            .align = 1,
+                            .objects_per_span = 1,
+                            .op = i % 2 == 0 ? SpanTraceEvent::kNew
+                                             : SpanTraceEvent::kDelete,
+                            .tag = MemoryTag::kNormal,
+                            .density = 0,
+                            .lifetime = 0});
+  }
+  const std::string path = absl::StrCat(testing::TempDir(), "/span_trace");
+  ASSERT_TRUE(trace.WriteToFile(path).ok());
+
+  absl::StatusOr<SpanTrace> read = SpanTrace::ReadFromFile(path);
+  ASSERT_TRUE(read.ok()) << read.status();
+  EXPECT_EQ(read->clock_frequency, trace.clock_frequency);
+  ASSERT_EQ(read->events.size(), trace.events.size());
+  for (size_t i = 0; i < trace.events.size(); ++i) {
+    EXPECT_EQ(read->events[i].time, trace.events[i].time);
+    EXPECT_EQ(read->events[i].first_page, trace.events[i].first_page);
+    EXPECT_EQ(read->events[i].pages, trace.events[i].pages);
+    EXPECT_EQ(read->events[i].op, trace.events[i].op);
+  }
+
+  EXPECT_EQ(
+      SpanTrace::ReadFromFile(absl::StrCat(testing::TempDir(), "/missing"))
+          .status()
+          .code(),
+      absl::StatusCode::kNotFound);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
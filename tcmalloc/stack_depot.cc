@@ -0,0 +1,182 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/stack_depot.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
+
+#include "absl/hash/hash.h"
+#include "absl/types/span.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+StackDepot::Entry* StackDepot::entry(Id id) const {
+  TC_ASSERT_NE(id, kNoStack);
+  const size_t word = id - 1;
+  char* chunk =
+      chunks_[word / kWordsPerChunk].load(std::memory_order_acquire);
+  TC_ASSERT_NE(chunk, nullptr);
+  return reinterpret_cast<Entry*>(chunk +
+                                  (word % kWordsPerChunk) * sizeof(void*));
+}
+
+StackDepot::Id StackDepot::Find(Id head, size_t hash,
+                                absl::Span<void* const> stack) const {
+  for (Id id = head; id != kNoStack;) {
+    const Entry* e = entry(id);
+    if (e->hash == hash && e->depth == stack.size() &&
+        memcmp(e->frames(), stack.data(), stack.size() * sizeof(void*)) ==
+            0) {
+      return id;
+    }
+    id = e->next;
+  }
+  return kNoStack;
+}
+
+StackDepot::Id StackDepot::Allocate(size_t words) {
+  TC_ASSERT_LE(words, kWordsPerChunk);
+  if (chunk_used_ + words > kWordsPerChunk) {
+    if (num_chunks_ == kMaxChunks) return kNoStack;
+    char* chunk = static_cast<char*>(arena_->Alloc(
+        kChunkSize, static_cast<std::align_val_t>(alignof(Entry))));
+    chunks_[num_chunks_].store(chunk, std::memory_order_release);
+    ++num_chunks_;
+    chunk_used_ = 0;
+  }
+  const size_t word = (num_chunks_ - 1) * kWordsPerChunk + chunk_used_;
+  chunk_used_ += words;
+  return static_cast<Id>(word + 1);
+}
+
+StackDepot::Id StackDepot::Intern(absl::Span<void* const> stack) {
+  if (stack.empty()) return kNoStack;
+  stack = stack.subspan(0, kMaxStackDepth);
+  interns_.fetch_add(1, std::memory_order_relaxed);
+
+  const size_t hash = absl::HashOf(stack);
+  std::atomic<Id>& bucket = buckets_[hash % kBuckets];
+  Id id = Find(bucket.load(std::memory_order_acquire), hash, stack);
+  if (id == kNoStack) {
+    AllocationGuardSpinLockHolder l(lock_);
+    // Another thread may have inserted the stack meanwhile.
+    const Id head = bucket.load(std::memory_order_relaxed);
+    id = Find(head, hash, stack);
+    if (id == kNoStack) {
+      const size_t depth = stack.size();
+      const size_t words = sizeof(Entry) / sizeof(void*) + depth;
+      id = Allocate(words);
+      if (id == kNoStack) {
+        overflows_.fetch_add(1, std::memory_order_relaxed);
+        return kNoStack;
+      }
+      Entry* e = new (entry(id)) Entry;
+      e->hash = hash;
+      e->next = head;
+      e->depth = depth;
+      e->refs.store(0, std::memory_order_relaxed);
+      memcpy(const_cast<void**>(e->frames()), stack.data(),
+             depth * sizeof(void*));
+      bucket.store(id, std::memory_order_release);
+      stacks_.fetch_add(1, std::memory_order_relaxed);
+      bytes_.fetch_add(words * sizeof(void*), std::memory_order_relaxed);
+      Ref(id);
+      return id;
+    }
+  }
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  Ref(id);
+  return id;
+}
+
+void StackDepot::Ref(Id id) {
+  if (id == kNoStack) return;
+  if (entry(id)->refs.fetch_add(1, std::memory_order_relaxed) == 0) {
+    live_stacks_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void StackDepot::Unref(Id id) {
+  if (id == kNoStack) return;
+  const uint32_t refs =
+      entry(id)->refs.fetch_sub(1, std::memory_order_relaxed);
+  TC_ASSERT_GT(refs, 0);
+  if (refs == 1) {
+    live_stacks_.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+absl::Span<void* const> StackDepot::Get(Id id) const {
+  if (id == kNoStack) return {};
+  const Entry* e = entry(id);
+  return absl::MakeSpan(e->frames(), e->depth);
+}
+
+StackTrace StackDepot::Restore(const StackTraceInfo& info, Id id) const {
+  StackTrace t;
+  static_cast<StackTraceInfo&>(t) = info;
+  const absl::Span<void* const> frames = Get(id);
+  t.depth = frames.size();
+  memcpy(t.stack, frames.data(), frames.size() * sizeof(void*));
+  return t;
+}
+
+StackDepot::Stats StackDepot::stats() const {
+  Stats s;
+  s.stacks = stacks_.load(std::memory_order_relaxed);
+  s.live_stacks = live_stacks_.load(std::memory_order_relaxed);
+  s.bytes = bytes_.load(std::memory_order_relaxed);
+  {
+    AllocationGuardSpinLockHolder l(lock_);
+    s.reserved_bytes = num_chunks_ * kChunkSize;
+  }
+  s.interns = interns_.load(std::memory_order_relaxed);
+  s.hits = hits_.load(std::memory_order_relaxed);
+  s.overflows = overflows_.load(std::memory_order_relaxed);
+  return s;
+}
+
+void StackDepot::Print(Printer& out) const {
+  const Stats s = stats();
+  out.printf(
+      "MALLOC STACK DEPOT: %zu stacks (%zu live), %zu bytes (%zu reserved), "
+      "%u interned, %u found, %u overflowed\n",
+      s.stacks, s.live_stacks, s.bytes, s.reserved_bytes, s.interns, s.hits,
+      s.overflows);
+}
+
+void StackDepot::PrintInPbtxt(PbtxtRegion& region) const {
+  const Stats s = stats();
+  region.PrintI64("stacks", s.stacks);
+  region.PrintI64("live_stacks", s.live_stacks);
+  region.PrintI64("bytes", s.bytes);
+  region.PrintI64("reserved_bytes", s.reserved_bytes);
+  region.PrintI64("interns", s.interns);
+  region.PrintI64("hits", s.hits);
+  region.PrintI64("overflows", s.overflows);
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,142 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_STACK_DEPOT_H_
+#define TCMALLOC_STACK_DEPOT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "absl/base/attributes.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/types/span.h"
+#include "tcmalloc/arena.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Interns stack traces, so that each distinct stack is stored once and is
+// referred to by a 4-byte ID.  Sampled allocations from the same call site
+// share their frames this way.
+//
+// Stacks are stored in chunks of arena memory, and are never freed: programs
+// have a bounded number of allocation sites, and this keeps lookups lock-free.
+// Reference counts track how many users each stack has, for the statistics.
+// Inserting a new stack takes a lock.
+//
+// Thread-safe.
+class StackDepot {
+ public:
+  using Id = uint32_t;
+  // The ID of no stack, whose frames are empty.
+  static constexpr Id kNoStack = 0;
+
+  static constexpr size_t kBuckets = 1 << 13;
+  static constexpr size_t kChunkSize = 64 << 10;
+  // Caps the depot at 256 MiB.
+  static constexpr size_t kMaxChunks = 4096;
+
+  struct Stats {
+    // Distinct stacks, and those with references.
+    size_t stacks;
+    size_t live_stacks;
+    // Bytes of the stacks, and of the chunks holding them.
+    size_t bytes;
+    size_t reserved_bytes;
+    // Calls to Intern(), and those that found the stack already interned.
+    uint64_t interns;
+    uint64_t hits;
+    // Calls to Intern() that failed because the depot was full.
+    uint64_t overflows;
+  };
+
+  constexpr explicit StackDepot(Arena& arena ABSL_ATTRIBUTE_LIFETIME_BOUND)
+      : arena_(&arena) {}
+  StackDepot(const StackDepot&) = delete;
+  StackDepot& operator=(const StackDepot&) = delete;
+
+  // Returns the ID of `stack`, and takes a reference on it.  Returns kNoStack
+  // for an empty stack, or if the depot is full.
+  Id Intern(absl::Span<void* const> stack) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Takes and releases a reference on `id`.  No-ops for kNoStack.
+  void Ref(Id id);
+  void Unref(Id id);
+
+  // Returns the frames of `id`.  They stay valid for the lifetime of the
+  // depot.
+  absl::Span<void* const> Get(Id id) const;
+
+  // Returns `info` completed with the frames of `id`.
+  StackTrace Restore(const StackTraceInfo& info, Id id) const;
+
+  Stats stats() const;
+  void Print(Printer& out) const;
+  void PrintInPbtxt(PbtxtRegion& region) const;
+
+ private:
+  // Followed by `depth` frames.
+  struct Entry {
+    size_t hash;
+    // The next entry in the same bucket.  Immutable once published.
+    Id next;
+    uint32_t depth;
+    std::atomic<uint32_t> refs;
+
+    void* const* frames() const {
+      return reinterpret_cast<void* const*>(this + 1);
+    }
+  };
+  static_assert(sizeof(Entry) % sizeof(void*) == 0);
+
+  static constexpr size_t kWordsPerChunk = kChunkSize / sizeof(void*);
+  static_assert(kMaxChunks * kWordsPerChunk < uint64_t{1} << 32);
+
+  Entry* entry(Id id) const;
+  // Returns the ID of `stack` if it is in the list starting at `head`.
+  Id Find(Id head, size_t hash, absl::Span<void* const> stack) const;
+  // Returns the ID of `words` words of fresh storage, or kNoStack if the depot
+  // is full.
+  Id Allocate(size_t words) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  Arena* const arena_;
+
+  std::atomic<Id> buckets_[kBuckets] = {};
+  std::atomic<char*> chunks_[kMaxChunks] = {};
+
+  mutable absl::base_internal::SpinLock lock_{
+      absl::base_internal::SCHEDULE_KERNEL_ONLY};
+  size_t num_chunks_ ABSL_GUARDED_BY(lock_) = 0;
+  // Words used in the last chunk.
+  size_t chunk_used_ ABSL_GUARDED_BY(lock_) = kWordsPerChunk;
+
+  std::atomic<size_t> stacks_{0};
+  std::atomic<size_t> live_stacks_{0};
+  std::atomic<size_t> bytes_{0};
+  std::atomic<uint64_t> interns_{0};
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> overflows_{0};
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_STACK_DEPOT_H_
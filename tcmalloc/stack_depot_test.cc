@@ -0,0 +1,151 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/stack_depot.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/types/span.h"
+#include "tcmalloc/arena.h"
+#include "tcmalloc/internal/logging.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+using ::testing::ElementsAreArray;
+using ::testing::IsEmpty;
+
+class StackDepotTest : public testing::Test {
+ protected:
+  static std::vector<void*> Stack(uintptr_t seed, size_t depth) {
+    std::vector<void*> stack;
+    for (size_t i = 0; i < depth; ++i) {
+      stack.push_back(reinterpret_cast<void*>(seed * 1000 + i));
+    }
+    return stack;
+  }
+
+  Arena arena_;
+  // The depot is too large for the stack.
+  std::unique_ptr<StackDepot> depot_ = std::make_unique<StackDepot>(arena_);
+};
+
+TEST_F(StackDepotTest, InternsOnce) {
+  const std::vector<void*> a = Stack(1, 10);
+  const std::vector<void*> b = Stack(2, 10);
+
+  const StackDepot::Id id_a = depot_->Intern(a);
+  const StackDepot::Id id_b = depot_->Intern(b);
+  EXPECT_NE(id_a, StackDepot::kNoStack);
+  EXPECT_NE(id_b, StackDepot::kNoStack);
+  EXPECT_NE(id_a, id_b);
+  EXPECT_EQ(depot_->Intern(a), id_a);
+
+  EXPECT_THAT(depot_->Get(id_a), ElementsAreArray(a));
+  EXPECT_THAT(depot_->Get(id_b), ElementsAreArray(b));
+
+  StackDepot::Stats stats = depot_->stats();
+  EXPECT_EQ(stats.stacks, 2);
+  EXPECT_EQ(stats.live_stacks, 2);
+  EXPECT_EQ(stats.interns, 3);
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_GE(stats.bytes, 2 * 10 * sizeof(void*));
+
+  // Prefixes of a stack are distinct stacks.
+  EXPECT_NE(depot_->Intern(absl::MakeSpan(a).subspan(0, 5)), id_a);
+}
+
+TEST_F(StackDepotTest, EmptyStack) {
+  EXPECT_EQ(depot_->Intern({}), StackDepot::kNoStack);
+  EXPECT_THAT(depot_->Get(StackDepot::kNoStack), IsEmpty());
+  depot_->Ref(StackDepot::kNoStack);
+  depot_->Unref(StackDepot::kNoStack);
+  EXPECT_EQ(depot_->stats().stacks, 0);
+}
+
+TEST_F(StackDepotTest, RefCounts) {
+  const std::vector<void*> a = Stack(1, 4);
+  const StackDepot::Id id = depot_->Intern(a);
+  depot_->Ref(id);
+  depot_->Unref(id);
+  EXPECT_EQ(depot_->stats().live_stacks, 1);
+  depot_->Unref(id);
+  EXPECT_EQ(depot_->stats().live_stacks, 0);
+
+  // The stack is kept, and found again.
+  EXPECT_THAT(depot_->Get(id), ElementsAreArray(a));
+  EXPECT_EQ(depot_->Intern(a), id);
+  EXPECT_EQ(depot_->stats().live_stacks, 1);
+  EXPECT_EQ(depot_->stats().stacks, 1);
+}
+
+TEST_F(StackDepotTest, Restore) {
+  const std::vector<void*> a = Stack(1, kMaxStackDepth);
+  StackTraceInfo info = {};
+  info.requested_size = 17;
+  info.allocated_size = 32;
+
+  const StackTrace t = depot_->Restore(info, depot_->Intern(a));
+  EXPECT_EQ(t.requested_size, 17);
+  EXPECT_EQ(t.allocated_size, 32);
+  EXPECT_THAT(absl::MakeSpan(t.stack, t.depth), ElementsAreArray(a));
+}
+
+TEST_F(StackDepotTest, ManyStacks) {
+  // Spans several chunks.
+  constexpr int kStacks = 1000;
+  std::vector<StackDepot::Id> ids;
+  for (int i = 0; i < kStacks; ++i) {
+    ids.push_back(depot_->Intern(Stack(i, kMaxStackDepth)));
+  }
+  EXPECT_GT(depot_->stats().reserved_bytes, StackDepot::kChunkSize);
+  for (int i = 0; i < kStacks; ++i) {
+    EXPECT_THAT(depot_->Get(ids[i]),
+                ElementsAreArray(Stack(i, kMaxStackDepth)));
+  }
+}
+
+TEST_F(StackDepotTest, Concurrent) {
+  constexpr int kThreads = 8;
+  constexpr int kStacks = 100;
+  std::vector<std::vector<StackDepot::Id>> ids(kThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kStacks; ++i) {
+        ids[t].push_back(depot_->Intern(Stack(i, 8)));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Every thread got the same ID for the same stack.
+  for (int t = 1; t < kThreads; ++t) {
+    EXPECT_EQ(ids[t], ids[0]);
+  }
+  EXPECT_EQ(depot_->stats().stacks, kStacks);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -23,6 +23,7 @@
 
 #include "absl/functional/function_ref.h"
 #include "tcmalloc/common.h"
+#include "tcmalloc/experiment.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -36,7 +37,10 @@ namespace tcmalloc {
 namespace tcmalloc_internal {
 
 StackTraceTable::StackTraceTable(ProfileType type)
-    : type_(type), depth_total_(0), all_(nullptr) {}
+    : type_(type),
+      experiment_id_(ActiveExperimentsId()),
+      depth_total_(0),
+      all_(nullptr) {}
 
 StackTraceTable::~StackTraceTable() {
   LinkedSample* cur = all_;
@@ -48,6 +52,52 @@ StackTraceTable::~StackTraceTable() {
   all_ = nullptr;
 }
 
+int64_t StackTraceTable::SampleCount(double sample_weight,
+                                     const StackTraceInfo& t) {
+  const size_t allocated_size = t.allocated_size;
+  if (allocated_size == 0) {
+    // Zero-byte allocations without any bytes allocated are serviced by
+    // GuardedPageAllocator, and we know there was only one sample.
+    return 1;
+  }
+  uintptr_t bytes = sample_weight * AllocatedBytes(t) + 0.5;
+  // We want sum to be a multiple of allocated_size; pick the nearest
+  // multiple rather than always rounding up or down.
+  // The reported count of samples, with possible rounding up for unsample.
+  return (bytes + allocated_size / 2) / allocated_size;
+}
+
+void StackTraceTable::FillSample(double sample_weight, const StackTrace& t,
+                                 Profile::Sample& sample) {
+  // Report total bytes that are a multiple of the object size.
+  size_t allocated_size = t.allocated_size;
+  size_t requested_size = t.requested_size;
+
+  sample.count = SampleCount(sample_weight, t);
+  sample.sum = sample.count * allocated_size;
+  sample.requested_size = requested_size;
+  sample.requested_alignment = t.requested_alignment;
+  sample.requested_size_returning = t.requested_size_returning;
+  sample.allocated_size = allocated_size;
+  sample.alloc_handle = t.sampled_alloc_handle;
+  sample.access_hint = static_cast<hot_cold_t>(t.access_hint);
+  sample.token_id = t.token_id;
+  sample.tenant = t.tenant;
+  sample.sampling_interval = t.sampling_interval;
+  sample.access_allocated = t.cold_allocated ? Profile::Sample::Access::Cold
+                                             : Profile::Sample::Access::Hot;
+  sample.depth = t.depth;
+  sample.allocation_time = t.allocation_time;
+
+  sample.span_start_address = t.span_start_address;
+  sample.guarded_status = t.guarded_status;
+  sample.type = t.allocation_type;
+
+  static_assert(kMaxStackDepth <= Profile::Sample::kMaxStackDepth,
+                "Profile stack size smaller than internal stack sizes");
+  memcpy(sample.stack, t.stack, sizeof(sample.stack[0]) * sample.depth);
+}
+
 void StackTraceTable::AddTrace(double sample_weight, const StackTrace& t) {
   depth_total_ += t.depth;
   // Note this makes a copy of the information from the stack trace and users
@@ -62,46 +112,40 @@ void StackTraceTable::AddTrace(double sample_weight, const StackTrace& t) {
   // allocating, see more details in "HeapProfilingTest.AllocateWhileIterating"
   // under google3/tcmalloc/heap_profiling_test.cc.
   LinkedSample* s = tc_globals.linked_sample_allocator().New();
+  FillSample(sample_weight, t, s->sample);
+  s->next = all_;
+  all_ = s;
+}
 
-  // Report total bytes that are a multiple of the object size.
-  size_t allocated_size = t.allocated_size;
-  size_t requested_size = t.requested_size;
+void StackTraceTable::AddSample(const Profile::Sample& sample) {
+  depth_total_ += sample.depth;
+  LinkedSample* s = tc_globals.linked_sample_allocator().New();
+  s->sample = sample;
+  s->next = all_;
+  all_ = s;
+}
 
-  if (allocated_size != 0) {
-    uintptr_t bytes = sample_weight * AllocatedBytes(t) + 0.5;
-    // We want sum to be a multiple of allocated_size; pick the nearest
-    // multiple rather than always rounding up or down.
-    // The reported count of samples, with possible rounding up for unsample.
-    s->sample.count = (bytes + allocated_size / 2) / allocated_size;
+void StackTraceTable::AddTrace(double sample_weight, const StackTrace& t,
+                               LinkedSample** samples, LinkedSample** spare) {
+  LinkedSample* s = *spare;
+  if (s != nullptr) {
+    *spare = s->next;
   } else {
-    // Zero-byte allocations without any bytes allocated are serviced by
-    // GuardedPageAllocator, and we know there was only one sample.
-    s->sample.count = 1;
+    s = tc_globals.linked_sample_allocator().New();
   }
-  s->sample.sum = s->sample.count * allocated_size;
-  s->sample.requested_size = requested_size;
-  s->sample.requested_alignment = t.requested_alignment;
-  s->sample.requested_size_returning = t.requested_size_returning;
-  s->sample.allocated_size = allocated_size;
-  s->sample.alloc_handle = t.sampled_alloc_handle;
-  s->sample.access_hint = static_cast<hot_cold_t>(t.access_hint);
-  s->sample.token_id = t.token_id;
-  s->sample.access_allocated = t.cold_allocated ? Profile::Sample::Access::Cold
-                                                : Profile::Sample::Access::Hot;
-  s->sample.depth = t.depth;
-  s->sample.allocation_time = t.allocation_time;
-
-  s->sample.span_start_address = t.span_start_address;
-  s->sample.guarded_status = t.guarded_status;
-  s->sample.type = t.allocation_type;
-
-  static_assert(kMaxStackDepth <= Profile::Sample::kMaxStackDepth,
-                "Profile stack size smaller than internal stack sizes");
-  memcpy(s->sample.stack, t.stack,
-         sizeof(s->sample.stack[0]) * s->sample.depth);
+  FillSample(sample_weight, t, s->sample);
+  s->next = *samples;
+  *samples = s;
+}
 
-  s->next = all_;
-  all_ = s;
+void StackTraceTable::Recycle(LinkedSample** samples, LinkedSample** spare) {
+  LinkedSample* head = *samples;
+  if (head == nullptr) return;
+  LinkedSample* tail = head;
+  while (tail->next != nullptr) tail = tail->next;
+  tail->next = *spare;
+  *spare = head;
+  *samples = nullptr;
 }
 
 void StackTraceTable::Iterate(
@@ -17,6 +17,8 @@
 #ifndef TCMALLOC_STACK_TRACE_TABLE_H_
 #define TCMALLOC_STACK_TRACE_TABLE_H_
 
+#include <stdint.h>
+
 #include "absl/base/thread_annotations.h"
 #include "absl/time/time.h"
 #include "tcmalloc/common.h"
@@ -46,6 +48,8 @@ class StackTraceTable final : public ProfileBase {
   void SetDuration(absl::Duration duration) { duration_ = duration; }
   absl::Duration Duration() const override { return duration_; }
 
+  uint64_t ExperimentId() const override { return experiment_id_; }
+
   // Adds stack trace "t" of the sample to table with the given weight of the
   // sample. `sample_weight` is a floating point value used to calculate the
   // the expected number of objects allocated (might be fractional considering
@@ -53,12 +57,34 @@ class StackTraceTable final : public ProfileBase {
   void AddTrace(double sample_weight, const StackTrace& t)
       ABSL_LOCKS_EXCLUDED(pageheap_lock);
 
+  // Adds a copy of `sample`, e.g. one saved with AddTrace(..., spare) below.
+  void AddSample(const Profile::Sample& sample)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
   // Exposed for PageHeapAllocator
   struct LinkedSample {
     Profile::Sample sample;
     LinkedSample* next;
   };
 
+  // Returns the number of objects that stack trace "t" stands for, weighted
+  // by `sample_weight` like AddTrace() does.
+  static int64_t SampleCount(double sample_weight, const StackTraceInfo& t);
+
+  // Converts stack trace "t" to a sample with AddTrace()'s weighting.
+  static void FillSample(double sample_weight, const StackTrace& t,
+                         Profile::Sample& sample);
+
+  // Like AddTrace(), but prepends the sample to the list at *samples, taking
+  // its storage from *spare when that is not empty.  For callers that keep
+  // samples across many snapshots without a table per snapshot.
+  static void AddTrace(double sample_weight, const StackTrace& t,
+                       LinkedSample** samples, LinkedSample** spare)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Moves the list at *samples to *spare, leaving *samples empty.
+  static void Recycle(LinkedSample** samples, LinkedSample** spare);
+
   // For testing
   int depth_total() const { return depth_total_; }
 
@@ -66,6 +92,7 @@ class StackTraceTable final : public ProfileBase {
   ProfileType type_;
   absl::Duration duration_ = absl::ZeroDuration();
   absl::Time start_time_;
+  uint64_t experiment_id_;
   int depth_total_;
   LinkedSample* all_;
 };
@@ -20,10 +20,13 @@
 #include <cstring>
 
 #include "absl/base/attributes.h"
+#include "absl/base/call_once.h"
 #include "absl/base/const_init.h"
 #include "absl/base/internal/spinlock.h"
 #include "absl/base/optimization.h"
 #include "absl/types/span.h"
+#include "tcmalloc/adaptive_sampling.h"
+#include "tcmalloc/allocation_rate_tracker.h"
 #include "tcmalloc/allocation_sample.h"
 #include "tcmalloc/arena.h"
 #include "tcmalloc/common.h"
@@ -33,6 +36,7 @@
 #include "tcmalloc/experiment_config.h"
 #include "tcmalloc/guarded_page_allocator.h"
 #include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/bytes.h"
 #include "tcmalloc/internal/cache_topology.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/environment.h"
@@ -56,6 +60,7 @@
 #include "tcmalloc/sizemap.h"
 #include "tcmalloc/span.h"
 #include "tcmalloc/stack_trace_table.h"
+#include "tcmalloc/tenant_tracker.h"
 #include "tcmalloc/thread_cache.h"
 #include "tcmalloc/transfer_cache.h"
 
@@ -71,6 +76,7 @@ namespace tcmalloc_internal {
 ABSL_CONST_INIT absl::base_internal::SpinLock pageheap_lock(
     absl::base_internal::SCHEDULE_KERNEL_ONLY);
 ABSL_CONST_INIT Arena Static::arena_;
+ABSL_CONST_INIT Static::NumaMetadata Static::numa_metadata_[kNumaPartitions];
 ABSL_CONST_INIT SizeMap ABSL_CACHELINE_ALIGNED Static::sizemap_;
 TCMALLOC_ATTRIBUTE_NO_DESTROY ABSL_CONST_INIT TransferCacheManager
     Static::transfer_cache_;
@@ -80,7 +86,9 @@ ABSL_CONST_INIT CpuCache<Static> ABSL_CACHELINE_ALIGNED Static::cpu_cache_{
     tc_globals};
 ABSL_CONST_INIT MetadataObjectAllocator<SampledAllocation>
     Static::sampledallocation_allocator_{arena_};
-ABSL_CONST_INIT MetadataObjectAllocator<Span> Static::span_allocator_{arena_};
+ABSL_CONST_INIT StackDepot Static::stack_depot_{arena_};
+ABSL_CONST_INIT ReleasingMetadataObjectAllocator<Span> Static::span_allocator_{
+    arena_};
 ABSL_CONST_INIT MetadataObjectAllocator<ThreadCache>
     Static::threadcache_allocator_{arena_};
 TCMALLOC_ATTRIBUTE_NO_DESTROY ABSL_CONST_INIT
@@ -89,6 +97,7 @@ TCMALLOC_ATTRIBUTE_NO_DESTROY ABSL_CONST_INIT
 ABSL_CONST_INIT tcmalloc_internal::StatsCounter Static::sampled_objects_size_;
 ABSL_CONST_INIT tcmalloc_internal::StatsCounter
     Static::sampled_internal_fragmentation_;
+ABSL_CONST_INIT tcmalloc_internal::StatsCounter Static::sampled_pow2_rounding_;
 ABSL_CONST_INIT tcmalloc_internal::StatsCounter Static::total_sampled_count_;
 ABSL_CONST_INIT AllocationSampleList Static::allocation_samples;
 ABSL_CONST_INIT deallocationz::DeallocationProfilerList
@@ -108,6 +117,21 @@ ABSL_CONST_INIT NumaTopology<kNumaPartitions, kNumBaseClasses>
     Static::numa_topology_;
 ABSL_CONST_INIT GwpAsanState Static::gwp_asan_state_;
 ABSL_CONST_INIT Static::PerSizeClassCounts Static::per_size_class_counts_;
+ABSL_CONST_INIT LifetimePredictor Static::lifetime_predictor_;
+ABSL_CONST_INIT AccessHintAuditor Static::access_hint_auditor_;
+ABSL_CONST_INIT AccessHeatmap Static::access_heatmap_;
+ABSL_CONST_INIT SizeClassFragmentation Static::size_class_fragmentation_;
+ABSL_CONST_INIT MemoryPressureGovernor Static::memory_pressure_governor_;
+ABSL_CONST_INIT MemoryPressureNotifier Static::memory_pressure_notifier_;
+ABSL_CONST_INIT PinnedPool Static::pinned_pool_;
+ABSL_CONST_INIT BackgroundPacer Static::background_pacer_;
+ABSL_CONST_INIT ReleaseWorkers Static::release_workers_;
+ABSL_CONST_INIT ParameterTuner Static::parameter_tuner_;
+ABSL_CONST_INIT AllocationRateTracker Static::allocation_rate_tracker_;
+ABSL_CONST_INIT TenantTracker Static::tenant_tracker_;
+ABSL_CONST_INIT LargeSpanCache Static::large_span_cache_;
+ABSL_CONST_INIT SignalSafePool Static::signal_safe_pool_;
+ABSL_CONST_INIT AdaptiveSamplingInterval Static::adaptive_sampling_interval_;
 TCMALLOC_ATTRIBUTE_NO_DESTROY ABSL_CONST_INIT
     Static::NoDestructorStorage<SystemAllocator<
         NumaTopology<kNumaPartitions, kNumBaseClasses>, kNormalPartitions>>
@@ -133,29 +157,63 @@ size_t Static::metadata_bytes() {
   // collection of static variables.  Simplify this.
   // LINT.IfChange(static_vars_size)
   const size_t static_var_size =
-      sizeof(pageheap_lock) + sizeof(arena_) + sizeof(sizemap_) +
+      sizeof(pageheap_lock) + sizeof(arena_) + sizeof(numa_metadata_) +
+      sizeof(sizemap_) +
       sizeof(sharded_transfer_cache_) + sizeof(transfer_cache_) +
       sizeof(cpu_cache_) + sizeof(sampledallocation_allocator_) +
+      sizeof(stack_depot_) +
       sizeof(span_allocator_) + +sizeof(threadcache_allocator_) +
       sizeof(sampled_allocation_recorder_) + sizeof(linked_sample_allocator_) +
       sizeof(inited_) + sizeof(cpu_cache_active_) + sizeof(page_allocator_) +
       sizeof(pagemap_) + sizeof(sampled_objects_size_) +
-      sizeof(sampled_internal_fragmentation_) + sizeof(total_sampled_count_) +
+      sizeof(sampled_internal_fragmentation_) + sizeof(sampled_pow2_rounding_) +
+      sizeof(total_sampled_count_) +
       sizeof(allocation_samples) + sizeof(deallocation_samples) +
       sizeof(sampled_alloc_handle_generator) + sizeof(peak_heap_tracker_) +
       sizeof(guardedpage_allocator_) + sizeof(numa_topology_) +
       sizeof(CacheTopology::Instance()) + sizeof(gwp_asan_state_) +
-      sizeof(per_size_class_counts_) + sizeof(system_allocator_) +
+      sizeof(per_size_class_counts_) + sizeof(lifetime_predictor_) +
+      sizeof(access_hint_auditor_) + sizeof(access_heatmap_) +
+      sizeof(size_class_fragmentation_) +
+      sizeof(memory_pressure_governor_) + sizeof(memory_pressure_notifier_) +
+      sizeof(pinned_pool_) +
+      sizeof(allocation_rate_tracker_) + sizeof(tenant_tracker_) +
+      sizeof(large_span_cache_) +
+      sizeof(signal_safe_pool_) + sizeof(adaptive_sampling_interval_) +
+      sizeof(background_pacer_) + sizeof(release_workers_) +
+      sizeof(parameter_tuner_) + sizeof(system_allocator_) +
       sizeof(kInvalidSpan);
   // LINT.ThenChange(:static_vars)
 
   const size_t internal_dependencies_size = sizeof(PerCpuState::state());
 
-  const size_t allocated = arena().stats().bytes_allocated +
+  const size_t allocated = arena_stats().bytes_allocated +
                            AddressRegionFactory::InternalBytesAllocated();
   return allocated + static_var_size + internal_dependencies_size;
 }
 
+ArenaStats Static::arena_stats() {
+  ArenaStats stats = arena_.stats();
+  if (numa_topology_.numa_aware()) {
+    for (const NumaMetadata& m : numa_metadata_) {
+      stats += m.arena.stats();
+    }
+  }
+  return stats;
+}
+
+AllocatorStats Static::span_allocator_stats() {
+  AllocatorStats stats = span_allocator_.stats();
+  if (numa_topology_.numa_aware()) {
+    for (const NumaMetadata& m : numa_metadata_) {
+      const AllocatorStats partition = m.span_allocator.stats();
+      stats.in_use += partition.in_use;
+      stats.total += partition.total;
+    }
+  }
+  return stats;
+}
+
 size_t Static::pagemap_residence() {
   // Determine residence of the root node of the pagemap.
   size_t total = MInCore::residence(&pagemap_, sizeof(pagemap_));
@@ -169,6 +227,27 @@ SizeClassConfiguration Static::size_class_configuration() {
     return SizeClassConfiguration::kPow2Only;
   }
 
+  // Size classes loaded at runtime take precedence over linked-in ones, so
+  // that they can be tried out without rebuilding.
+  if (SizeMap::RuntimeClasses() != nullptr) {
+    return SizeClassConfiguration::kRuntime;
+  }
+
+  if (SizeMap::Pow2RangeClasses() != nullptr) {
+    return SizeClassConfiguration::kPow2Range;
+  }
+
+  // Size classes generated for another page size or kMaxSize are ignored.
+  if (default_custom_size_classes != nullptr) {
+    const SizeClasses* custom = default_custom_size_classes();
+    if (custom != nullptr && !custom->classes.empty() &&
+        custom->classes.size() <= kNumBaseClasses &&
+        custom->classes.back().size == kMaxSize &&
+        SizeClassesAreDivisibleByPageSize(custom->classes, Bytes(kPageSize))) {
+      return SizeClassConfiguration::kCustom;
+    }
+  }
+
   // TODO(b/242710633): remove this opt out.
   if (default_want_legacy_size_classes != nullptr &&
       default_want_legacy_size_classes() > 0 &&
@@ -206,6 +285,14 @@ SizeClassConfiguration Static::size_class_configuration() {
   return SizeClassConfiguration::kReuseRelaxedBelow64;
 }
 
+const NumaTopology<kNumaPartitions, kNumBaseClasses>&
+Static::scanned_numa_topology() {
+  static absl::once_flag flag;
+  absl::base_internal::LowLevelCallOnce(
+      &flag, [] { numa_topology_.ScanDeferred(); });
+  return numa_topology_;
+}
+
 ABSL_ATTRIBUTE_COLD ABSL_ATTRIBUTE_NOINLINE void Static::SlowInitIfNecessary() {
   PageHeapSpinLockHolder l;
 
@@ -223,6 +310,11 @@ ABSL_ATTRIBUTE_COLD ABSL_ATTRIBUTE_NOINLINE void Static::SlowInitIfNecessary() {
       cpu_cache_.SetCacheLimit(/*v=*/1024 * 1024);
     }
     numa_topology_.Init();
+    if (numa_topology_.numa_aware()) {
+      for (size_t p = 0; p < kNumaPartitions; ++p) {
+        numa_metadata_[p].arena.set_numa_partition(p);
+      }
+    }
     CacheTopology::Instance().Init();
 
     if (IsExperimentActive(Experiment::TCMALLOC_PGHO_EXPERIMENT)) {
@@ -235,10 +327,20 @@ ABSL_ATTRIBUTE_COLD ABSL_ATTRIBUTE_NOINLINE void Static::SlowInitIfNecessary() {
     // The constructor of the sharded transfer cache leaves it in a disabled
     // state.
     sharded_transfer_cache_.Init();
+    if (Parameters::mte_sampled()) {
+      system_allocator().EnableMteForSampledMemory();
+    }
     new (page_allocator_.memory) PageAllocator;
     pagemap_.MapRootWithSmallPages();
-    guardedpage_allocator_.Init(/*max_allocated_pages=*/64,
-                                /*total_pages=*/128);
+    // Guard regions do not cost a VMA per protected page, so they afford a
+    // larger pool.
+    if (GuardedPageAllocator::GuardRegionsSupported()) {
+      guardedpage_allocator_.Init(/*max_allocated_pages=*/256,
+                                  /*total_pages=*/1024);
+    } else {
+      guardedpage_allocator_.Init(/*max_allocated_pages=*/64,
+                                  /*total_pages=*/128);
+    }
 
     inited_.store(true, std::memory_order_release);
   }
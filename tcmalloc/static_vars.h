@@ -26,8 +26,13 @@
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
+#include "tcmalloc/access_heatmap.h"
+#include "tcmalloc/access_hint_auditor.h"
+#include "tcmalloc/adaptive_sampling.h"
+#include "tcmalloc/allocation_rate_tracker.h"
 #include "tcmalloc/allocation_sample.h"
 #include "tcmalloc/arena.h"
+#include "tcmalloc/background_pacer.h"
 #include "tcmalloc/central_freelist.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/cpu_cache.h"
@@ -42,16 +47,26 @@
 #include "tcmalloc/internal/sampled_allocation.h"
 #include "tcmalloc/internal/sampled_allocation_recorder.h"
 #include "tcmalloc/internal/system_allocator.h"
+#include "tcmalloc/lifetime_predictor.h"
+#include "tcmalloc/large_span_cache.h"
+#include "tcmalloc/memory_pressure.h"
 #include "tcmalloc/malloc_hook_invoke.h"
 #include "tcmalloc/metadata_object_allocator.h"
 #include "tcmalloc/page_allocator.h"
 #include "tcmalloc/pages.h"
+#include "tcmalloc/parameter_tuner.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/peak_heap_tracker.h"
+#include "tcmalloc/pinned_pool.h"
+#include "tcmalloc/release_workers.h"
+#include "tcmalloc/signal_safe_pool.h"
+#include "tcmalloc/size_class_fragmentation.h"
 #include "tcmalloc/sizemap.h"
 #include "tcmalloc/span.h"
+#include "tcmalloc/stack_depot.h"
 #include "tcmalloc/stack_trace_table.h"
 #include "tcmalloc/stats.h"
+#include "tcmalloc/tenant_tracker.h"
 #include "tcmalloc/transfer_cache.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
@@ -101,9 +116,57 @@ class Static final {
     return peak_heap_tracker_.value;
   }
 
+  static LifetimePredictor& lifetime_predictor() {
+    return lifetime_predictor_;
+  }
+
+  static AccessHintAuditor& access_hint_auditor() {
+    return access_hint_auditor_;
+  }
+
+  static AccessHeatmap& access_heatmap() { return access_heatmap_; }
+
+  static SizeClassFragmentation& size_class_fragmentation() {
+    return size_class_fragmentation_;
+  }
+
+  static MemoryPressureGovernor& memory_pressure_governor() {
+    return memory_pressure_governor_;
+  }
+
+  static MemoryPressureNotifier& memory_pressure_notifier() {
+    return memory_pressure_notifier_;
+  }
+
+  static PinnedPool& pinned_pool() { return pinned_pool_; }
+
+  static BackgroundPacer& background_pacer() { return background_pacer_; }
+
+  static ReleaseWorkers& release_workers() { return release_workers_; }
+
+  static ParameterTuner& parameter_tuner() { return parameter_tuner_; }
+
+  static AllocationRateTracker& allocation_rate_tracker() {
+    return allocation_rate_tracker_;
+  }
+
+  static TenantTracker& tenant_tracker() { return tenant_tracker_; }
+
+  static LargeSpanCache& large_span_cache() { return large_span_cache_; }
+
+  static SignalSafePool& signal_safe_pool() { return signal_safe_pool_; }
+
+  static AdaptiveSamplingInterval& adaptive_sampling_interval() {
+    return adaptive_sampling_interval_;
+  }
+
   static NumaTopology<kNumaPartitions, kNumBaseClasses>& numa_topology() {
     return numa_topology_;
   }
+  // Like numa_topology(), but for statistics and profiles, which need node
+  // information even when NUMA awareness is disabled.
+  static const NumaTopology<kNumaPartitions, kNumBaseClasses>&
+  scanned_numa_topology();
 
   static bool multiple_non_numa_partitions() {
     return Parameters::heap_partitioning_mode() != HeapPartitioningMode::kOff;
@@ -122,6 +185,24 @@ class Static final {
 
   static Arena& arena() { return arena_; }
 
+  // Returns the arena for metadata about memory with `tag`: with NUMA
+  // awareness, that of the tag's NUMA partition, so that the metadata is
+  // local to the memory it describes.
+  static Arena& arena(MemoryTag tag) {
+    const int partition = NumaPartitionOfTag(tag);
+    return partition < 0 ? arena_ : numa_metadata_[partition].arena;
+  }
+
+  // Returns the stats of the NUMA partition's arena, or of the shared arena
+  // without NUMA awareness.
+  static ArenaStats arena_stats(size_t partition) {
+    return numa_topology().numa_aware() ? numa_metadata_[partition].arena.stats()
+                                        : arena_.stats();
+  }
+
+  // Returns the combined stats of all metadata arenas.
+  static ArenaStats arena_stats();
+
   // Page-level allocator.
   static PageAllocator& page_allocator() {
     return *reinterpret_cast<PageAllocator*>(page_allocator_.memory);
@@ -138,10 +219,24 @@ class Static final {
     return sampledallocation_allocator_;
   }
 
-  static MetadataObjectAllocator<Span>& span_allocator() {
+  // Interned stacks of sampled allocations.
+  static StackDepot& stack_depot() { return stack_depot_; }
+
+  static ReleasingMetadataObjectAllocator<Span>& span_allocator() {
     return span_allocator_;
   }
 
+  // Returns the allocator for spans of memory with `tag`, from arena(tag).
+  static ReleasingMetadataObjectAllocator<Span>& span_allocator(
+      MemoryTag tag) {
+    const int partition = NumaPartitionOfTag(tag);
+    return partition < 0 ? span_allocator_
+                         : numa_metadata_[partition].span_allocator;
+  }
+
+  // Returns the combined stats of all span allocators.
+  static AllocatorStats span_allocator_stats();
+
   static MetadataObjectAllocator<ThreadCache>& threadcache_allocator() {
     return threadcache_allocator_;
   }
@@ -156,6 +251,9 @@ class Static final {
   // allocation sizes being rounded up to size class/page boundaries.
   ABSL_CONST_INIT static tcmalloc_internal::StatsCounter
       sampled_internal_fragmentation_;
+  // sampled_pow2_rounding_ estimates the part of that overhead added by
+  // power-of-two size classes (SizeMap::Pow2RangeClasses()).
+  ABSL_CONST_INIT static tcmalloc_internal::StatsCounter sampled_pow2_rounding_;
   // total_sampled_count_ tracks the total number of allocations that are
   // sampled.
   ABSL_CONST_INIT static tcmalloc_internal::StatsCounter total_sampled_count_;
@@ -220,7 +318,28 @@ class Static final {
   // static variables may try to allocate memory before these variables
   // can run their constructors.
 
+  // Returns the NUMA partition whose metadata arena serves memory with `tag`,
+  // or -1 for the shared arena.  Mirrors the binding of the tags' memory in
+  // SystemAllocator.
+  static int NumaPartitionOfTag(MemoryTag tag) {
+    if (ABSL_PREDICT_TRUE(!numa_topology_.numa_aware())) return -1;
+    switch (tag) {
+      case MemoryTag::kNormalP0:
+        return 0;
+      case MemoryTag::kNormalP1:
+        return kNumaPartitions - 1;
+      default:
+        return -1;
+    }
+  }
+
   ABSL_CONST_INIT static Arena arena_;
+
+  struct NumaMetadata {
+    Arena arena;
+    ReleasingMetadataObjectAllocator<Span> span_allocator{arena};
+  };
+  ABSL_CONST_INIT static NumaMetadata numa_metadata_[kNumaPartitions];
   static SizeMap sizemap_;
   TCMALLOC_ATTRIBUTE_NO_DESTROY ABSL_CONST_INIT static TransferCacheManager
       transfer_cache_;
@@ -229,7 +348,8 @@ class Static final {
   ABSL_CONST_INIT static GuardedPageAllocator guardedpage_allocator_;
   static MetadataObjectAllocator<SampledAllocation>
       sampledallocation_allocator_;
-  static MetadataObjectAllocator<Span> span_allocator_;
+  ABSL_CONST_INIT static StackDepot stack_depot_;
+  static ReleasingMetadataObjectAllocator<Span> span_allocator_;
   static MetadataObjectAllocator<ThreadCache> threadcache_allocator_;
   static MetadataObjectAllocator<StackTraceTable::LinkedSample>
       linked_sample_allocator_;
@@ -259,6 +379,21 @@ class Static final {
       numa_topology_;
   ABSL_CONST_INIT static GwpAsanState gwp_asan_state_;
   ABSL_CONST_INIT static PerSizeClassCounts per_size_class_counts_;
+  ABSL_CONST_INIT static LifetimePredictor lifetime_predictor_;
+  ABSL_CONST_INIT static AccessHintAuditor access_hint_auditor_;
+  ABSL_CONST_INIT static AccessHeatmap access_heatmap_;
+  ABSL_CONST_INIT static SizeClassFragmentation size_class_fragmentation_;
+  ABSL_CONST_INIT static MemoryPressureGovernor memory_pressure_governor_;
+  ABSL_CONST_INIT static MemoryPressureNotifier memory_pressure_notifier_;
+  ABSL_CONST_INIT static PinnedPool pinned_pool_;
+  ABSL_CONST_INIT static BackgroundPacer background_pacer_;
+  ABSL_CONST_INIT static ReleaseWorkers release_workers_;
+  ABSL_CONST_INIT static ParameterTuner parameter_tuner_;
+  ABSL_CONST_INIT static AllocationRateTracker allocation_rate_tracker_;
+  ABSL_CONST_INIT static TenantTracker tenant_tracker_;
+  ABSL_CONST_INIT static LargeSpanCache large_span_cache_;
+  ABSL_CONST_INIT static SignalSafePool signal_safe_pool_;
+  ABSL_CONST_INIT static AdaptiveSamplingInterval adaptive_sampling_interval_;
 
   // PageHeap uses a constructor for initialization.  Like the members above,
   // we can't depend on initialization order, so pageheap is new'd
@@ -304,11 +439,14 @@ inline void Static::InitIfNecessary() {
 // of wildly different sizes. This keeps track of the extra bytes bytes released
 // so that the app can periodically call Release() to release memory at a
 // constant rate.
+//
+// pageheap_lock is taken for one page allocator instance at a time, so a
+// release does not stall page-level allocation across all of them.  Callers
+// serialize calls to Release() themselves.
 class ConstantRatePageAllocatorReleaser {
  public:
-  size_t Release(size_t num_bytes, PageReleaseReason reason) {
-    const PageHeapSpinLockHolder l;
-
+  size_t Release(size_t num_bytes, PageReleaseReason reason)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) {
     if (num_bytes <= extra_bytes_released_) {
       // We released too much on a prior call, so don't release any
       // more this time.
@@ -331,9 +469,10 @@ class ConstantRatePageAllocatorReleaser {
       }
     }();
 
-    const size_t bytes_released = tc_globals.page_allocator()
-                                      .ReleaseAtLeastNPages(num_pages, reason)
-                                      .in_bytes();
+    const size_t bytes_released =
+        tc_globals.page_allocator()
+            .ReleaseAtLeastNPagesByInstance(num_pages, reason)
+            .in_bytes();
     if (bytes_released > num_bytes) {
       extra_bytes_released_ = bytes_released - num_bytes;
 
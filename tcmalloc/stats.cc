@@ -304,25 +304,7 @@ void PageAllocInfo::RecordFree(Range r) {
 
 void PageAllocInfo::RecordRelease(Length n, Length got,
                                   PageReleaseReason reason) {
-  released_.total += got;
-
-  switch (reason) {
-    case PageReleaseReason::kReleaseMemoryToSystem:
-      released_.release_memory_to_system += got;
-      break;
-
-    case PageReleaseReason::kProcessBackgroundActions:
-      released_.process_background_actions += got;
-      break;
-
-    case PageReleaseReason::kSoftLimitExceeded:
-      released_.soft_limit_exceeded += got;
-      break;
-
-    case PageReleaseReason::kHardLimitExceeded:
-      released_.hard_limit_exceeded += got;
-      break;
-  }
+  released_.Add(reason, got);
 }
 
 PageReleaseStats PageAllocInfo::GetRecordedReleases() const {
@@ -121,6 +121,28 @@ struct PageReleaseStats {
   Length soft_limit_exceeded;
   Length hard_limit_exceeded;
 
+  // Adds n to total and to the count for reason.
+  constexpr void Add(PageReleaseReason reason, Length n) {
+    total += n;
+    switch (reason) {
+      case PageReleaseReason::kReleaseMemoryToSystem:
+        release_memory_to_system += n;
+        break;
+
+      case PageReleaseReason::kProcessBackgroundActions:
+        process_background_actions += n;
+        break;
+
+      case PageReleaseReason::kSoftLimitExceeded:
+        soft_limit_exceeded += n;
+        break;
+
+      case PageReleaseReason::kHardLimitExceeded:
+        hard_limit_exceeded += n;
+        break;
+    }
+  }
+
   constexpr friend PageReleaseStats operator+(const PageReleaseStats& lhs,
                                               const PageReleaseStats& rhs) {
     return {
@@ -169,6 +191,20 @@ struct PageReleaseStats {
   }
 };
 
+// Pages that were allocated again soon after their release, out of a sample
+// of the released pages, by the reason they were released for.
+struct RefaultStats {
+  PageReleaseStats sampled;
+  PageReleaseStats refaulted;
+
+  constexpr RefaultStats& operator+=(const RefaultStats& other) {
+    sampled += other.sampled;
+    refaulted += other.refaulted;
+
+    return *this;
+  }
+};
+
 class PageAllocInfo {
  private:
   struct Counts;
@@ -91,6 +91,7 @@
 #include "tcmalloc/common.h"
 #include "tcmalloc/cpu_cache.h"
 #include "tcmalloc/deallocation_profiler.h"
+#include "tcmalloc/defragmentation.h"
 #include "tcmalloc/error_reporting.h"
 #include "tcmalloc/experiment.h"
 #include "tcmalloc/global_stats.h"
@@ -98,8 +99,10 @@
 #include "tcmalloc/guarded_page_allocator.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/cpu_utils.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/memory_tag.h"
+#include "tcmalloc/internal/mte.h"
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/internal/overflow.h"
 #include "tcmalloc/internal/page_size.h"
@@ -107,22 +110,31 @@
 #include "tcmalloc/internal/sampled_allocation.h"
 #include "tcmalloc/internal/system_allocator.h"
 #include "tcmalloc/internal_malloc_extension.h"
+#include "tcmalloc/large_span_cache.h"
+#include "tcmalloc/leak_candidate_profiler.h"
+#include "tcmalloc/lock_contention_profiler.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/malloc_hook.h"
 #include "tcmalloc/malloc_tracing_extension.h"
 #include "tcmalloc/metadata_object_allocator.h"
+#include "tcmalloc/object_region.h"
 #include "tcmalloc/page_allocator.h"
 #include "tcmalloc/page_allocator_interface.h"
 #include "tcmalloc/pagemap.h"
+#include "tcmalloc/persistent_region.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/sampler.h"
 #include "tcmalloc/segv_handler.h"
+#include "tcmalloc/shared_region.h"
+#include "tcmalloc/signal_safe_pool.h"
+#include "tcmalloc/slow_allocation_profiler.h"
 #include "tcmalloc/span.h"
 #include "tcmalloc/stack_trace_table.h"
 #include "tcmalloc/static_vars.h"
 #include "tcmalloc/stats.h"
 #include "tcmalloc/tcmalloc_policy.h"
+#include "tcmalloc/tenant_tracker.h"
 #include "tcmalloc/thread_cache.h"
 #include "tcmalloc/transfer_cache.h"
 
@@ -248,6 +260,40 @@ extern "C" void MallocExtension_Internal_GetStats(std::string* ret) {
   }
 }
 
+extern "C" void MallocExtension_Internal_GetStatsSnapshot(
+    MallocExtension::StatsSnapshot* ret) {
+  ExtractStatsSnapshot(*ret);
+}
+
+extern "C" size_t MallocExtension_Internal_GetStatsInOpenMetrics(
+    char* buffer, size_t length) {
+  // Printer needs room for the terminating NUL.
+  char empty[1];
+  if (length == 0) {
+    buffer = empty;
+    length = sizeof(empty);
+  }
+  Printer printer(buffer, length);
+  DumpStatsInOpenMetrics(printer);
+  return printer.SpaceRequired();
+}
+
+extern "C" void MallocExtension_Internal_GetHotStats(
+    MallocExtension::HotStats* ret) {
+  GetHotStats(*ret);
+}
+
+extern "C" void MallocExtension_Internal_GetMemoryBreakdown(
+    MallocExtension::MemoryBreakdown* ret) {
+  GetMemoryBreakdown(*ret);
+}
+
+extern "C" void MallocExtension_Internal_Defragment(
+    MallocExtension::Relocator relocator, size_t budget,
+    MallocExtension::DefragmentationStats* ret) {
+  *ret = Defragment(tc_globals, relocator, budget);
+}
+
 extern "C" size_t TCMalloc_Internal_GetStats(char* buffer,
                                              size_t buffer_length) {
   Printer printer(buffer, buffer_length);
@@ -261,6 +307,9 @@ extern "C" size_t TCMalloc_Internal_GetStats(char* buffer,
   auto& system_allocator = tc_globals.system_allocator();
   printer.printf("Memory Release Failures: %d\n",
                  system_allocator.release_errors());
+  printer.printf("Mlockall Mode: %s (%zu releases munlocked)\n",
+                 system_allocator.mlockall_mode() ? "on" : "off",
+                 system_allocator.mlocked_releases());
 
   size_t n = printer.SpaceRequired();
 
@@ -283,11 +332,40 @@ extern "C" const ProfileBase* MallocExtension_Internal_SnapshotCurrent(
       return nullptr;
     case ProfileType::kPeakHeap:
       return tc_globals.peak_heap_tracker().DumpSample().release();
+    case ProfileType::kLockContention:
+      return lock_contention_profiler.DumpSample().release();
+    case ProfileType::kRealizedFragmentation:
+      return DumpRealizedFragmentationProfile(tc_globals).release();
+    case ProfileType::kLeakCandidates:
+      return leak_candidate_profiler
+          .DumpSample(tc_globals, Parameters::leak_candidate_min_age(),
+                      absl::Now())
+          .release();
+    case ProfileType::kSlowAllocations:
+      return slow_allocation_profiler.DumpSample().release();
     default:
       return nullptr;
   }
 }
 
+extern "C" void MallocExtension_Internal_SnapshotPeakHeaps(
+    absl::Time start, absl::Time end, std::vector<const ProfileBase*>* ret) {
+  for (auto& profile :
+       tc_globals.peak_heap_tracker().DumpBucketedSamples(start, end)) {
+    ret->push_back(profile.release());
+  }
+}
+
+extern "C" const ProfileBase* MallocExtension_Internal_SnapshotHeapDelta(
+    std::vector<AllocHandle>* live, std::vector<AllocHandle>* removed) {
+  return DumpHeapProfileDelta(tc_globals, *live, *removed).release();
+}
+
+extern "C" void MallocExtension_Internal_GetAllocationRateHistory(
+    std::vector<MallocExtension::AllocationRateEpoch>* history) {
+  tc_globals.allocation_rate_tracker().GetHistory(*history);
+}
+
 extern "C" AllocationProfilingTokenBase*
 MallocExtension_Internal_StartAllocationProfiling() {
   return new AllocationSample(&tc_globals.allocation_samples, absl::Now());
@@ -335,10 +413,109 @@ extern "C" void MallocExtension_Internal_SetMemoryLimit(
       limit, static_cast<PageAllocator::LimitKind>(limit_kind));
 }
 
+extern "C" bool MallocExtension_Internal_AddMemoryPressureCallback(
+    tcmalloc::MallocExtension::MemoryPressureCallback callback, void* arg,
+    double moderate_fraction, double critical_fraction) {
+  return tc_globals.memory_pressure_notifier().Add(
+      callback, arg, moderate_fraction, critical_fraction);
+}
+
+extern "C" void MallocExtension_Internal_RemoveMemoryPressureCallback(
+    tcmalloc::MallocExtension::MemoryPressureCallback callback, void* arg) {
+  tc_globals.memory_pressure_notifier().Remove(callback, arg);
+}
+
+extern "C" void* MallocExtension_Internal_AllocatePinned(size_t size) {
+  tc_globals.InitIfNecessary();
+  return tc_globals.pinned_pool().Allocate(size);
+}
+
+extern "C" void MallocExtension_Internal_FreePinned(void* ptr, size_t size) {
+  if (ptr == nullptr) return;
+  tc_globals.pinned_pool().Deallocate(ptr, size);
+}
+
+extern "C" void MallocExtension_Internal_SetPinnedMemoryCallback(
+    tcmalloc::MallocExtension::PinnedMemoryCallback callback, void* arg) {
+  tc_globals.InitIfNecessary();
+  tc_globals.pinned_pool().SetCallback(callback, arg);
+}
+
 extern "C" void MallocExtension_Internal_MarkThreadIdle() {
   ThreadCache::BecomeIdle();
 }
 
+extern "C" void MallocExtension_Internal_MarkCpuParking(
+    absl::Duration expected) {
+  if (!tc_globals.CpuCacheActive()) return;
+  // The per-CPU cache this thread last used.
+  const int cpu = subtle::percpu::VirtualCpu::get();
+  if (cpu < 0) return;
+  tc_globals.cpu_cache().MarkCpuParking(cpu, expected);
+}
+
+extern "C" void MallocExtension_Internal_SetProtectedCpus(const int* cpus,
+                                                          size_t num_cpus) {
+  CpuSet set;
+  set.Zero();
+  for (size_t i = 0; i < num_cpus; ++i) {
+    if (cpus[i] >= 0 && cpus[i] < kMaxCpus) set.Set(cpus[i]);
+  }
+  // The protected set is kept even while per-CPU caches are not active.
+  tc_globals.cpu_cache().SetProtectedCpus(set);
+}
+
+extern "C" void MallocExtension_Internal_GetProtectedCpus(
+    std::vector<int>* cpus) {
+  const CpuSet set = tc_globals.cpu_cache().GetProtectedCpus();
+  for (int cpu = 0; cpu < kMaxCpus; ++cpu) {
+    if (set.IsSet(cpu)) cpus->push_back(cpu);
+  }
+}
+
+extern "C" void MallocExtension_Internal_SetThreadAllocationBudget(
+    size_t bytes, MallocExtension::AllocationBudgetCallback callback,
+    void* arg) {
+  GetThreadAllocationBudget().Set(bytes, callback, arg);
+  GetThreadSampler().ArmBudget();
+}
+
+extern "C" void MallocExtension_Internal_ClearThreadAllocationBudget() {
+  GetThreadAllocationBudget().Clear();
+}
+
+extern "C" bool MallocExtension_Internal_GetThreadAllocatedBytes(
+    size_t* bytes) {
+  if (!GetThreadAllocationBudget().active()) return false;
+  *bytes = GetThreadSampler().BudgetedBytes();
+  return true;
+}
+
+extern "C" uint32_t MallocExtension_Internal_SetCurrentTenant(
+    uint32_t tenant) {
+  const uint32_t previous = current_tenant;
+  current_tenant = tenant;
+  return previous;
+}
+
+extern "C" uint32_t MallocExtension_Internal_GetCurrentTenant() {
+  return current_tenant;
+}
+
+extern "C" void MallocExtension_Internal_SetTenantLimit(uint32_t tenant,
+                                                        size_t bytes) {
+  tc_globals.tenant_tracker().SetLimit(tenant, bytes);
+}
+
+extern "C" bool MallocExtension_Internal_IsTenantOverLimit(uint32_t tenant) {
+  return tc_globals.tenant_tracker().OverLimit(tenant);
+}
+
+extern "C" void MallocExtension_Internal_GetTenantStats(
+    std::vector<MallocExtension::TenantStats>* stats) {
+  tc_globals.tenant_tracker().GetStats(*stats);
+}
+
 extern "C" AddressRegionFactory* MallocExtension_Internal_GetRegionFactory() {
   PageHeapSpinLockHolder l;
   return tc_globals.system_allocator().GetRegionFactory();
@@ -363,6 +540,9 @@ extern "C" size_t MallocExtension_Internal_ReleaseMemoryToSystem(
 
   const AllocationGuardSpinLockHolder rh(release_lock);
 
+  // Cached spans are allocated as far as the page heap is concerned, so they
+  // could not be released otherwise.
+  FlushLargeSpanCache();
   return releaser.Release(num_bytes,
                           /*reason=*/PageReleaseReason::kReleaseMemoryToSystem);
 }
@@ -405,6 +585,33 @@ extern "C" size_t nallocx(size_t size, int flags) noexcept {
   }
 }
 
+extern "C" size_t MallocExtension_Internal_GoodSize(size_t min_size,
+                                                    size_t growth_hint) {
+  const size_t target = std::max(min_size, growth_hint);
+  tc_globals.InitIfNecessary();
+
+  // The allocated sizes just above and just below target.
+  size_t up, down;
+  const auto [is_small, size_class] =
+      tc_globals.sizemap().GetSizeClass(CppPolicy(), target);
+  if (ABSL_PREDICT_TRUE(is_small)) {
+    up = tc_globals.sizemap().class_to_size(size_class);
+    // The smallest size of a class is one more than the largest size of the
+    // class before it, if any.
+    const size_t min_class_size =
+        tc_globals.sizemap().class_to_size_range(size_class).first;
+    down = min_class_size == 0 ? 0 : min_class_size - 1;
+  } else {
+    up = BytesToLengthCeil(target).in_bytes();
+    down = BytesToLengthFloor(target).in_bytes();
+  }
+
+  if (down != 0 && down >= min_size && target - down < up - target) {
+    return down;
+  }
+  return up;
+}
+
 extern "C" MallocExtension::Ownership MallocExtension_Internal_GetOwnership(
     const void* ptr) {
   return GetOwnership(ptr);
@@ -451,6 +658,7 @@ extern "C" void MallocExtension_Internal_GetProperties(
   (*result)["tcmalloc.cpu_free"].value = stats.per_cpu_bytes;
   (*result)["tcmalloc.sharded_transfer_cache_free"].value =
       stats.sharded_transfer_bytes;
+  (*result)["tcmalloc.large_span_cache_free"].value = stats.large_span_bytes;
   (*result)["tcmalloc.per_cpu_caches_active"].value =
       tc_globals.CpuCacheActive();
   // Thread Cache Free List
@@ -470,6 +678,8 @@ extern "C" void MallocExtension_Internal_GetProperties(
       stats.pageheap.unmapped_bytes + stats.arena.bytes_nonresident;
   (*result)["tcmalloc.sampled_internal_fragmentation"].value =
       tc_globals.sampled_internal_fragmentation_.value();
+  (*result)["tcmalloc.sampled_pow2_rounding"].value =
+      tc_globals.sampled_pow2_rounding_.value();
 
   (*result)["tcmalloc.external_fragmentation_bytes"].value =
       ExternalBytes(stats);
@@ -508,6 +718,7 @@ extern "C" void MallocExtension_Internal_GetProperties(
       kSecurityPartitions > 1
           ? static_cast<int>(Parameters::heap_partitioning_mode())
           : 0;
+  (*result)["tcmalloc.experiment_id"].value = ActiveExperimentsId();
 }
 
 extern "C" size_t MallocExtension_Internal_ReleaseCpuMemory(int cpu) {
@@ -601,6 +812,17 @@ ABSL_ATTRIBUTE_NOINLINE static void FreeSmallSlow(void* ptr,
       ptr, size_class);
 }
 
+ABSL_ATTRIBUTE_NOINLINE static void FreeSmallPeriodicHooks(
+    void* ptr, std::optional<size_t> size, size_t size_class) {
+  InvokePeriodicDeleteHook({ptr, size,
+                            tc_globals.sizemap().class_to_size(size_class),
+                            HookMemoryMutable::kMutable});
+  if (ABSL_PREDICT_FALSE(
+          !tc_globals.cpu_cache().DeallocateFast(ptr, size_class))) {
+    FreeSmallSlow(ptr, size, size_class);
+  }
+}
+
 static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void FreeSmall(
     void* ptr, std::optional<size_t> size, size_t size_class) {
   if (!IsExpandedSizeClass(size_class)) {
@@ -609,6 +831,11 @@ static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void FreeSmall(
     TC_ASSERT_EQ(GetMemoryTag(ptr), MemoryTag::kCold, "ptr=%p", ptr);
   }
 
+  if (PeriodicDeleteHookDue()) {
+    SLOW_PATH_BARRIER();
+    return FreeSmallPeriodicHooks(ptr, size, size_class);
+  }
+
   // DeallocateFast may fail if:
   //  - the cpu cache is full
   //  - the cpu cache is not initialized
@@ -635,10 +862,21 @@ inline sized_ptr_t do_malloc_pages(size_t size, size_t weight, Policy policy) {
   } else if (tc_globals.active_partitions() > 1) {
     tag = MultiNormalTag(policy.partition());
   }
-  Span* span = tc_globals.page_allocator().NewAligned(
-      num_pages, BytesToLengthCeil(policy.align()),
-      {1, AccessDensityPrediction::kSparse}, tag);
-  if (span == nullptr) return {nullptr, 0};
+  Span* span = nullptr;
+  // The large span cache only holds unaligned, unsampled kNormal spans.
+  if (ABSL_PREDICT_FALSE(Parameters::large_span_cache()) && weight == 0 &&
+      tag == MemoryTag::kNormal &&
+      static_cast<size_t>(policy.align()) <= kPageSize &&
+      LargeSpanCache::Cacheable(num_pages)) {
+    span = tc_globals.large_span_cache().Get(CurrentLargeSpanCacheShard(),
+                                             num_pages);
+  }
+  if (span == nullptr) {
+    span = tc_globals.page_allocator().NewAligned(
+        num_pages, BytesToLengthCeil(policy.align()),
+        {1, AccessDensityPrediction::kSparse, policy.lifetime()}, tag);
+    if (span == nullptr) return {nullptr, 0};
+  }
 
   // Set capacity to the exact size for a page allocation.  This needs to be
   // revisited if we introduce gwp-asan sampling / guarded allocations to
@@ -694,11 +932,19 @@ ABSL_ATTRIBUTE_NOINLINE static void InvokeHooksAndFreePages(
     valid_ptr = gwp_asan.PointerIsCorrectlyAligned(ptr);
   } else if (ABSL_PREDICT_FALSE(ptr != span->start_address())) {
     valid_ptr = false;
+  } else if (Parameters::mte_sampled() && IsSampledMemory(ptr)) {
+    // Reset the tags set by MteTagSampledAllocation before anything reads the
+    // object through its untagged address.
+    MteSetTags(ptr, span->bytes_in_span());
   }
 
   if (ABSL_PREDICT_TRUE(valid_ptr)) {
     MallocHook::InvokeDeleteHook(
         {ptr, size, GetLargeSize(ptr, *span), HookMemoryMutable::kMutable});
+    if (PeriodicDeleteHookDue()) {
+      InvokePeriodicDeleteHook(
+          {ptr, size, GetLargeSize(ptr, *span), HookMemoryMutable::kMutable});
+    }
   }
 
   MaybeUnsampleAllocation(tc_globals, policy, ptr, size, *span);
@@ -727,6 +973,20 @@ ABSL_ATTRIBUTE_NOINLINE static void InvokeHooksAndFreePages(
       ReportCorruptedFree(tc_globals, static_cast<std::align_val_t>(kPageSize),
                           ptr);
     }
+    if (ABSL_PREDICT_FALSE(Parameters::large_span_cache()) &&
+        GetMemoryTag(ptr) == MemoryTag::kNormal &&
+        LargeSpanCache::Cacheable(span->num_pages())) {
+      // Its contents are the application's now.
+      span->set_known_zero(false);
+      Span* evicted[LargeSpanCache::kEntriesPerShard];
+      const int num_evicted = tc_globals.large_span_cache().Put(
+          CurrentLargeSpanCacheShard(), span, evicted);
+      if (ABSL_PREDICT_FALSE(num_evicted < 0)) {
+        ReportDoubleFree(tc_globals, ptr);
+      }
+      ReturnLargeSpans(evicted, num_evicted);
+      return;
+    }
 #ifdef TCMALLOC_INTERNAL_LEGACY_LOCKING
     PageHeapSpinLockHolder l;
     tc_globals.page_allocator().Delete(
@@ -758,14 +1018,17 @@ static constexpr uintptr_t kBadDeallocationHighMask =
     ~((uintptr_t{1} << kAddressBits) - 1u);
 static constexpr uintptr_t kBadAlignmentMask =
     static_cast<uintptr_t>(kAlignment) - 1u;
-// kNormalMask covers both kNormal and kNormalP1 because they share an
-// overlapping tag bit.  This is the same property IsNormalMemory relies on.
+// kNormalMask covers kNormal, kNormalP1 and kSizeClassed because they share
+// an overlapping tag bit.  This is the same property IsNormalMemory relies on.
 static constexpr uintptr_t kNormalMask =
     static_cast<uintptr_t>(MemoryTag::kNormal) << kTagShift;
 static constexpr uintptr_t kColdMask = static_cast<uintptr_t>(MemoryTag::kCold)
                                        << kTagShift;
 static_assert((static_cast<uintptr_t>(MemoryTag::kNormal) &
                static_cast<uintptr_t>(MemoryTag::kNormalP1)) != 0);
+static_assert(kSanitizerAddressSpace ||
+              (static_cast<uintptr_t>(MemoryTag::kNormal) &
+               static_cast<uintptr_t>(MemoryTag::kSizeClassed)) != 0);
 
 static constexpr uintptr_t kNormalOrBadDeallocationMask =
     kBadDeallocationHighMask | kNormalMask | kBadAlignmentMask;
@@ -776,6 +1039,9 @@ static constexpr uintptr_t kTagOrBadDeallocationMask =
 template <typename Policy>
 ABSL_ATTRIBUTE_NOINLINE static void do_unsized_free_irregular(void* ptr,
                                                               Policy policy) {
+  // Objects tagged by MteTagSampledAllocation land here, as their tag sets
+  // bits in kBadDeallocationHighMask.
+  ptr = MteUntag(ptr);
   const uintptr_t uptr = absl::bit_cast<uintptr_t>(ptr);
 
   if (ABSL_PREDICT_FALSE(uptr & kBadDeallocationHighMask)) {
@@ -825,6 +1091,17 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void do_free(void* ptr, Policy policy) {
   // therefore static initialization must have already occurred.
   TC_ASSERT(tc_globals.IsInited());
 
+  // Objects in size class regions carry their size class in their address,
+  // which saves the PageMap walk and its likely cache miss.
+  if (kMaxSizeClassRegions > 1 && (uptr & kTagMask) == kSizeClassedTagMask) {
+    const size_t size_class = SizeClassFromRegion(ptr);
+    TC_ASSERT_EQ(size_class,
+                 tc_globals.pagemap().sizeclass(PageIdContaining(ptr)),
+                 "ptr=%p", ptr);
+    FreeSmall(ptr, std::nullopt, size_class);
+    return;
+  }
+
   size_t size_class = tc_globals.pagemap().sizeclass(PageIdContaining(ptr));
   if (ABSL_PREDICT_TRUE(size_class != 0)) {
     FreeSmall(ptr, std::nullopt, size_class);
@@ -840,11 +1117,11 @@ ABSL_ATTRIBUTE_NOINLINE static void handle_sampled_or_illformed_ptrs(
   TC_ASSERT_NE(ptr, nullptr);
   // If we get here, the allocation is either sampled or the pointer is
   // illformed.
+  ptr = MteUntag(ptr);
   auto tag = GetMemoryTag(ptr);
   const uintptr_t uptr = absl::bit_cast<uintptr_t>(ptr);
   TC_ASSERT((uptr & (kBadAlignmentMask | kBadDeallocationHighMask)) != 0 ||
-            (tag != MemoryTag::kNormal && tag != MemoryTag::kNormalP1 &&
-             tag != MemoryTag::kCold));
+            (!IsNormalPartitionTag(tag) && tag != MemoryTag::kCold));
 
   if (ABSL_PREDICT_TRUE(IsSampledMemory(ptr))) {
     // we don't know true class size of the ptr
@@ -969,7 +1246,19 @@ inline
   // at allocation time is not recorded in the tag for cold objects and
   // 'PartitionFromPointerFast' will return wrong results for them (and
   // therefore there is assertion failure if used for kCold ptrs)
-  if (policy.is_cold() || PartitionFromPointerFast(ptr) == 0) {
+  if constexpr (kNormalPartitions > 2) {
+    // With more partitions the tag is decoded into a lookup region instead of
+    // branching once per partition: partition p's classes occupy their own
+    // range of the per-CPU cache, so the size class lookup is all we need.
+    const size_t partition =
+        policy.is_cold() ? 0 : PartitionFromPointerFast(ptr);
+    const auto [is_small, size_class] =
+        tc_globals.sizemap().GetSizeClass(policy.InPartition(partition), size);
+    if (ABSL_PREDICT_TRUE(is_small)) {
+      FreeSmall(ptr, size, size_class);
+      return;
+    }
+  } else if (policy.is_cold() || PartitionFromPointerFast(ptr) == 0) {
     const auto [is_small, size_class] = tc_globals.sizemap().GetSizeClass(
         policy.template InPartition<0>(), size);
     if (ABSL_PREDICT_TRUE(is_small)) {
@@ -1050,6 +1339,11 @@ bool CorrectSize(const void* ptr, const size_t provided_size, Policy policy) {
     }
 
     TC_ASSERT_EQ(size_class, 0);
+  } else if (is_small && provided_size_class + 1 == size_class &&
+             tc_globals.central_freelist(size_class).lent()) {
+    // The object was borrowed by the next smaller class, see
+    // CentralFreeList::UpdateSpanSharing.
+    return true;
   } else {
     ReportMismatchedDelete(tc_globals, ptr, provided_size, minimum_size,
                            maximum_size);
@@ -1183,6 +1477,20 @@ using tcmalloc::tcmalloc_internal::UsePerCpuCache;
 namespace tcmalloc {
 namespace tcmalloc_internal {
 
+// With Parameters::mte_sampled(), returns the sampled object [p, p + n) with a
+// random MTE tag, so that accesses past its span or after it is freed fault.
+// Guarded objects have guard pages instead.  Internal bookkeeping and hooks
+// only ever see untagged pointers; frees strip the tag again.
+static void* MteTagSampledAllocation(void* p, size_t n) {
+  if (ABSL_PREDICT_TRUE(!Parameters::mte_sampled()) || !IsSampledMemory(p) ||
+      tc_globals.guardedpage_allocator().PointerIsMine(p)) {
+    return p;
+  }
+  void* tagged = MteRandomTag(p);
+  MteSetTags(tagged, (n + kMteGranule - 1) & ~(kMteGranule - 1));
+  return tagged;
+}
+
 template <typename Policy>
 ABSL_ATTRIBUTE_NOINLINE static typename Policy::pointer_type
 alloc_small_sampled_hooks_or_perthread(size_t size, size_t size_class,
@@ -1213,11 +1521,55 @@ alloc_small_sampled_hooks_or_perthread(size_t size, size_t size_class,
     // The callee of the hook has no other way of knowing that writes to [size,
     // ptr.n) are valid.
     MallocHook::InvokeNewHook({ptr.p, Policy::size_returning() ? ptr.n : size,
-                               ptr.n, HookMemoryMutable::kMutable});
+                               ptr.n, HookMemoryMutable::kMutable,
+                               static_cast<size_t>(policy.align()),
+                               static_cast<uint8_t>(policy.access())});
+  }
+  if (ABSL_PREDICT_FALSE(weight != 0)) {
+    ptr.p = MteTagSampledAllocation(ptr.p, ptr.n);
   }
   return Policy::as_pointer(ptr.p, ptr.n);
 }
 
+#if TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+// Charges an allocation of <size> bytes whose AllocateFastCounted failed to
+// the sampling countdown of the current cpu, drawing new countdowns from the
+// thread's sampler.  Returns its sampling weight, or 0 if it is not sampled.
+// Threads without a cached slab are charged to their own sampler instead: both
+// are Poisson processes with the same rate, over disjoint bytes.
+static size_t RecordCpuSampledAllocation(size_t size) {
+  TC_ASSERT_LE(size, kMaxSize);
+  using SamplerCharge = CpuCache::SamplerCharge;
+  Sampler& sampler = GetThreadSampler();
+  int32_t rearm = -1;
+  ssize_t interval = 0;
+  while (true) {
+    int32_t old;
+    // Avoid missampling 0, as Sampler::TryRecordAllocationFast does.
+    switch (tc_globals.cpu_cache().ChargeSampler(size + 1, rearm, old)) {
+      case SamplerCharge::kUncached:
+        return sampler.RecordAllocation(size);
+      case SamplerCharge::kCharged:
+        return 0;
+      case SamplerCharge::kExpired:
+        // Draw the next countdown before expiring this one, so that a single
+        // allocation on this cpu takes the sample.
+        rearm = static_cast<int32_t>(
+            std::min<ssize_t>(sampler.PickNextCpuSamplingPoint(interval),
+                              std::numeric_limits<int32_t>::max() - 1) +
+            1);
+        continue;
+      case SamplerCharge::kRearmed:
+        // A countdown that was not armed yet does not sample.
+        if (old == 0 || interval <= 0) return 0;
+        // As in Sampler::RecordAllocationSlow, with old - 1 bytes left until
+        // the sample.
+        return interval + size - (old - 1);
+    }
+  }
+}
+#endif  // TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+
 // Slow path implementation.
 // This function is used by `fast_alloc` if the allocation requires page sized
 // allocations or some complex logic is required such as initialization,
@@ -1230,7 +1582,12 @@ ABSL_ATTRIBUTE_NOINLINE static
     typename Policy::pointer_type slow_alloc_small(size_t size,
                                                    uint32_t size_class,
                                                    Policy policy) {
+  ScopedSlowAllocationTimer slow_allocation_timer(size);
+#if TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+  size_t weight = RecordCpuSampledAllocation(size);
+#else
   size_t weight = GetThreadSampler().RecordedAllocationFast(size);
+#endif
   if (ABSL_PREDICT_FALSE(weight != 0) ||
       ABSL_PREDICT_FALSE(tcmalloc::tcmalloc_internal::Static::HaveHooks()) ||
       ABSL_PREDICT_FALSE(!UsePerCpuCache(tc_globals))) {
@@ -1248,6 +1605,7 @@ ABSL_ATTRIBUTE_NOINLINE static
 template <typename Policy>
 ABSL_ATTRIBUTE_NOINLINE static typename Policy::pointer_type slow_alloc_large(
     size_t size, Policy policy) {
+  ScopedSlowAllocationTimer slow_allocation_timer(size);
   size_t weight = GetThreadSampler().RecordAllocation(size);
   __sized_ptr_t res = do_malloc_pages(size, weight, policy);
   if (ABSL_PREDICT_FALSE(res.p == nullptr)) return policy.handle_oom(size);
@@ -1257,26 +1615,40 @@ ABSL_ATTRIBUTE_NOINLINE static typename Policy::pointer_type slow_alloc_large(
     // The callee of the hook has no other way of knowing that writes to [size,
     // ptr.n) are valid.
     MallocHook::InvokeNewHook({res.p, Policy::size_returning() ? res.n : size,
-                               res.n, HookMemoryMutable::kMutable});
+                               res.n, HookMemoryMutable::kMutable,
+                               static_cast<size_t>(policy.align()),
+                               static_cast<uint8_t>(policy.access())});
+  }
+  if (PeriodicNewHookDue()) {
+    InvokePeriodicNewHook({res.p, Policy::size_returning() ? res.n : size,
+                           res.n, HookMemoryMutable::kMutable,
+                           static_cast<size_t>(policy.align()),
+                           static_cast<uint8_t>(policy.access())});
+  }
+  if (ABSL_PREDICT_FALSE(weight != 0)) {
+    res.p = MteTagSampledAllocation(res.p, res.n);
   }
   return Policy::as_pointer(res.p, res.n);
 }
 
+static void* RawPointer(void* p) { return p; }
+static void* RawPointer(sized_ptr_t p) { return p.p; }
+
 template <typename Policy, typename Pointer = typename Policy::pointer_type>
-static inline Pointer ABSL_ATTRIBUTE_ALWAYS_INLINE fast_alloc(size_t size,
-                                                              Policy policy) {
-  // If size is larger than kMaxSize, it's not fast-path anymore. In
-  // such case, GetSizeClass will return false, and we'll delegate to the slow
-  // path. If malloc is not yet initialized, we may end up with size_class == 0
-  // (regardless of size), but in this case should also delegate to the slow
-  // path by the fast path check further down.
-  const auto [is_small, size_class] =
-      tc_globals.sizemap().GetSizeClass(policy, size);
-  if (ABSL_PREDICT_FALSE(!is_small)) {
+static inline Pointer ABSL_ATTRIBUTE_ALWAYS_INLINE
+fast_alloc_small_no_periodic_hooks(size_t size, size_t size_class,
+                                   Policy policy) {
+#if TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+  // The sampling countdown lives in the per-CPU slab, and is charged by the
+  // same restartable sequence that pops the object.  Initialization, sampling
+  // and hooks all fail the pop, see CpuCache::AllocateFastCounted.
+  void* ret = tc_globals.cpu_cache().AllocateFastCounted(size_class, size);
+  if (ABSL_PREDICT_FALSE(ret == nullptr)) {
     SLOW_PATH_BARRIER();
-    TCMALLOC_MUSTTAIL return slow_alloc_large(size, policy);
+    return slow_alloc_small(size, size_class, policy);
   }
-
+  return Policy::to_pointer(ret, size_class);
+#else
   // TryRecordAllocationFast() returns true if no extra logic is required, e.g.:
   // - this allocation does not need to be sampled
   // - no new/delete hooks need to be invoked
@@ -1301,6 +1673,207 @@ static inline Pointer ABSL_ATTRIBUTE_ALWAYS_INLINE fast_alloc(size_t size,
 
   TC_ASSERT_NE(ret, nullptr);
   return Policy::to_pointer(ret, size_class);
+#endif  // TCMALLOC_INTERNAL_PERCPU_SAMPLER_ENABLED
+}
+
+template <typename Policy>
+ABSL_ATTRIBUTE_NOINLINE static typename Policy::pointer_type
+alloc_small_periodic_hooks(size_t size, size_t size_class, Policy policy) {
+  auto ret = fast_alloc_small_no_periodic_hooks(size, size_class, policy);
+  const size_t capacity = tc_globals.sizemap().class_to_size(size_class);
+  InvokePeriodicNewHook({RawPointer(ret),
+                         Policy::size_returning() ? capacity : size, capacity,
+                         HookMemoryMutable::kMutable,
+                         static_cast<size_t>(policy.align()),
+                         static_cast<uint8_t>(policy.access())});
+  return ret;
+}
+
+// Allocates size bytes from size_class, which GetSizeClass (or a lookup
+// equivalent to it) chose for them.
+template <typename Policy, typename Pointer = typename Policy::pointer_type>
+static inline Pointer ABSL_ATTRIBUTE_ALWAYS_INLINE
+fast_alloc_small(size_t size, size_t size_class, Policy policy) {
+  // Periodic hooks see a fraction of allocations, without sending the others
+  // down the slow path as MallocHook::AddNewHook does.
+  if (PeriodicNewHookDue()) {
+    SLOW_PATH_BARRIER();
+    return alloc_small_periodic_hooks(size, size_class, policy);
+  }
+  return fast_alloc_small_no_periodic_hooks(size, size_class, policy);
+}
+
+template <typename Policy, typename Pointer = typename Policy::pointer_type>
+static inline Pointer ABSL_ATTRIBUTE_ALWAYS_INLINE fast_alloc(size_t size,
+                                                              Policy policy) {
+  // If size is larger than kMaxSize, it's not fast-path anymore. In
+  // such case, GetSizeClass will return false, and we'll delegate to the slow
+  // path. If malloc is not yet initialized, we may end up with size_class == 0
+  // (regardless of size), but in this case should also delegate to the slow
+  // path by the fast path check further down.
+  const auto [is_small, size_class] =
+      tc_globals.sizemap().GetSizeClass(policy, size);
+  if (ABSL_PREDICT_FALSE(!is_small)) {
+    SLOW_PATH_BARRIER();
+    TCMALLOC_MUSTTAIL return slow_alloc_large(size, policy);
+  }
+  return fast_alloc_small(size, size_class, policy);
+}
+
+// Like fast_alloc, for sizes known to be served by the size class at
+// class_array_ index class_index.
+template <typename Policy, typename Pointer = typename Policy::pointer_type>
+static inline Pointer ABSL_ATTRIBUTE_ALWAYS_INLINE
+fast_alloc_class_index(size_t size, size_t class_index, Policy policy) {
+  const size_t size_class =
+      tc_globals.sizemap().LookupSizeClass(policy, class_index);
+  // A zeroed class_array_ before initialization yields size class 0, which the
+  // checks in fast_alloc_small send to the slow path.
+  TC_ASSERT(size_class == 0 ||
+            size_class == tc_globals.sizemap().SizeClass(policy, size));
+  return fast_alloc_small(size, size_class, policy);
+}
+
+// Allocates up to <n> objects of <size> directly from the per-CPU cache.
+// Returns 0 without side effects if any object in the batch would need the
+// slow path (sampling, hooks, per-thread mode, large sizes), in which case
+// the caller falls back to fast_alloc for each object.
+static size_t alloc_small_batch(size_t size, void** batch, size_t n) {
+  const auto [is_small, size_class] =
+      tc_globals.sizemap().GetSizeClass(CppPolicy(), size);
+  if (ABSL_PREDICT_FALSE(!is_small) || ABSL_PREDICT_FALSE(size_class == 0) ||
+      ABSL_PREDICT_FALSE(Static::HaveHooks()) ||
+      ABSL_PREDICT_FALSE(!UsePerCpuCache(tc_globals))) {
+    return 0;
+  }
+
+  // If any object in the batch would be sampled, let the per-object path take
+  // care of it.
+  size_t bytes;
+  if (ABSL_PREDICT_FALSE(MultiplyOverflow(n, size + 1, &bytes))) {
+    return 0;
+  }
+  Sampler& sampler = GetThreadSampler();
+  if (ABSL_PREDICT_FALSE(sampler.WillRecordAllocation(bytes - 1))) {
+    return 0;
+  }
+
+  // Charge the sampler for the objects we got at once, as that many calls to
+  // TryRecordAllocationFast(size) would.  The caller allocates the rest one by
+  // one, which charges the sampler for them.
+  const size_t got = tc_globals.cpu_cache().AllocateBatch(size_class, batch, n);
+  if (got != 0) {
+    [[maybe_unused]] const bool recorded =
+        sampler.TryRecordAllocationFast(got * (size + 1) - 1);
+    TC_ASSERT(recorded);
+  }
+  return got;
+}
+
+// Frees <n> kNormal-tagged objects of <size_class> that were previously
+// grouped by free_batch.
+static void free_small_batch(void** batch, size_t n, size_t size_class) {
+  if (n == 0) return;
+  tc_globals.cpu_cache().DeallocateBatch(size_class, batch, n);
+}
+
+// Allocates an object of a tcmalloc::Region.  Objects that are sampled, too
+// large, or too aligned for the region's spans take the regular allocation
+// path, so that sampled ones are reported like any other allocation, and are
+// freed when the region is.
+static void* region_alloc(ObjectRegion* region, size_t size,
+                          size_t alignment) {
+  Sampler& sampler = GetThreadSampler();
+  if (ABSL_PREDICT_TRUE(size <= ObjectRegion::kMaxSpanObjectSize) &&
+      ABSL_PREDICT_TRUE(alignment <= kPageSize) &&
+      ABSL_PREDICT_TRUE(!sampler.WillRecordAllocation(size))) {
+    [[maybe_unused]] const bool recorded =
+        sampler.TryRecordAllocationFast(size);
+    TC_ASSERT(recorded);
+    return region->Allocate(size, alignment);
+  }
+
+  void* ptr = fast_alloc(size, CppPolicy().AlignAs(alignment).Nothrow());
+  if (ABSL_PREDICT_FALSE(ptr == nullptr)) return nullptr;
+  if (ABSL_PREDICT_FALSE(!region->AddSeparate(ptr, size, alignment))) {
+    do_free_with_size(ptr, size, CppPolicy().AlignAs(alignment));
+    return nullptr;
+  }
+  return ptr;
+}
+
+static void region_free_separate(const ObjectRegion* region) {
+  region->ForEachSeparate([](void* ptr, size_t size, size_t alignment) {
+    do_free_with_size(ptr, size, CppPolicy().AlignAs(alignment));
+  });
+}
+
+// Tries to grow the page-level allocation at ptr to new_size bytes without
+// copying it: in place, by claiming the free pages following it, or else by
+// remapping its pages elsewhere.  Returns the address of the grown allocation,
+// or nullptr, leaving it unchanged, if ptr is not such an allocation or neither
+// is possible.
+ABSL_ATTRIBUTE_NOINLINE void* TryGrowPages(void* ptr, size_t new_size) {
+  // The grown allocation is accounted for by the sampler as a new one, but it
+  // cannot be sampled in place.
+  Sampler& sampler = GetThreadSampler();
+  if (sampler.WillRecordAllocation(new_size) || !IsNormalMemory(ptr)) {
+    return nullptr;
+  }
+
+  const PageId p = PageIdContaining(ptr);
+  auto [span, size_class] = tc_globals.pagemap().GetDescriptorAndSizeClass(p);
+  if (size_class != 0 || span == nullptr || span->sampled() ||
+      ptr != span->start_address()) {
+    return nullptr;
+  }
+
+  const Length n = BytesToLengthCeil(new_size);
+  if (n <= span->num_pages()) return nullptr;
+  const MemoryTag tag = GetMemoryTag(ptr);
+  if (tc_globals.page_allocator().TryExtend(
+          {Range(span->first_page(), span->num_pages()), span->donated()}, n,
+          tag)) {
+    span->set_num_pages(n);
+  } else if (!tc_globals.page_allocator().TryMove(span, n, tag)) {
+    return nullptr;
+  }
+
+  const bool recorded = sampler.TryRecordAllocationFast(new_size);
+  TC_ASSERT(recorded);
+  (void)recorded;
+  return span->start_address();
+}
+
+// Tries to shrink the page-level allocation at ptr to new_size bytes in place,
+// returning the pages past them to the page heap rather than copying it to a
+// smaller allocation.  Returns false, leaving it unchanged, if ptr is not such
+// an allocation or its pages cannot be freed.
+ABSL_ATTRIBUTE_NOINLINE bool TryShrinkPages(void* ptr, size_t new_size) {
+  // As in TryGrowPages, the shrunk allocation is accounted for by the sampler
+  // as a new one.
+  Sampler& sampler = GetThreadSampler();
+  if (sampler.WillRecordAllocation(new_size) || !IsNormalMemory(ptr)) {
+    return false;
+  }
+
+  const PageId p = PageIdContaining(ptr);
+  auto [span, size_class] = tc_globals.pagemap().GetDescriptorAndSizeClass(p);
+  if (size_class != 0 || span == nullptr || span->sampled() ||
+      ptr != span->start_address()) {
+    return false;
+  }
+
+  const Length n = BytesToLengthCeil(new_size);
+  if (n >= span->num_pages() ||
+      !tc_globals.page_allocator().TryShrink(span, n, GetMemoryTag(ptr))) {
+    return false;
+  }
+
+  const bool recorded = sampler.TryRecordAllocationFast(new_size);
+  TC_ASSERT(recorded);
+  (void)recorded;
+  return true;
 }
 
 }  // namespace tcmalloc_internal
@@ -1367,7 +1940,7 @@ MallocTracingExtension_Internal_GetAllocatedAddressRanges() {
   constexpr float kAllocatedSpansSizeReserveFactor = 1.2;
   constexpr int kMaxAttempts = 10;
   for (int i = 0; i < kMaxAttempts; i++) {
-    int estimated_span_count = tc_globals.span_allocator().stats().total;
+    int estimated_span_count = tc_globals.span_allocator_stats().total;
 
     // We need to avoid allocation events during GetAllocatedSpans, as that may
     // cause a deadlock on pageheap_lock. To this end, we ensure that the result
@@ -1408,6 +1981,10 @@ using tcmalloc::tcmalloc_internal::GetPageSize;
 using tcmalloc::tcmalloc_internal::GetSizeAndSampled;
 using tcmalloc::tcmalloc_internal::kMaxSize;
 using tcmalloc::tcmalloc_internal::MultiplyOverflow;
+using tcmalloc::tcmalloc_internal::PageIdContaining;
+using tcmalloc::tcmalloc_internal::Span;
+using tcmalloc::tcmalloc_internal::TryGrowPages;
+using tcmalloc::tcmalloc_internal::TryShrinkPages;
 
 // depends on TCMALLOC_HAVE_STRUCT_MALLINFO, so needs to come after that.
 #ifndef TCMALLOC_INTERNAL_METHODS_ONLY
@@ -1463,15 +2040,33 @@ __sized_ptr_t __size_returning_new_aligned(size_t size,
 extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc)
 __sized_ptr_t __size_returning_new_hot_cold(size_t size,
                                             __hot_cold_t hot_cold) {
-  return fast_alloc(size, CppPolicy().AccessAs(hot_cold).SizeReturning());
+  return fast_alloc(size, CppPolicy()
+                              .AccessAs(hot_cold, __builtin_return_address(0))
+                              .SizeReturning());
 }
 
 extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc)
 __sized_ptr_t __size_returning_new_aligned_hot_cold(size_t size,
                                                     std::align_val_t alignment,
                                                     __hot_cold_t hot_cold) {
-  return fast_alloc(
-      size, CppPolicy().AlignAs(alignment).AccessAs(hot_cold).SizeReturning());
+  return fast_alloc(size, CppPolicy()
+                              .AlignAs(alignment)
+                              .AccessAs(hot_cold, __builtin_return_address(0))
+                              .SizeReturning());
+}
+
+extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc)
+__sized_ptr_t __size_returning_new_numa_node(size_t size,
+                                             tcmalloc::numa_node_t node) {
+  return fast_alloc(size, CppPolicy()
+                              .InNumaNode(static_cast<size_t>(node))
+                              .SizeReturning());
+}
+
+extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc)
+__sized_ptr_t __size_returning_new_lifetime(size_t size,
+                                            tcmalloc::lifetime_t lifetime) {
+  return fast_alloc(size, CppPolicy().LivesFor(lifetime).SizeReturning());
 }
 #endif  // !TCMALLOC_INTERNAL_METHODS_ONLY
 
@@ -1492,26 +2087,57 @@ extern "C" ABSL_CACHELINE_ALIGNED void* TCMallocInternalNewAlignedNothrow(
 
 extern "C" ABSL_CACHELINE_ALIGNED void* TCMallocInternalNewHotCold(
     size_t size, tcmalloc::hot_cold_t hot_cold) {
-  return fast_alloc(size, CppPolicy().AccessAs(hot_cold));
+  return fast_alloc(
+      size, CppPolicy().AccessAs(hot_cold, __builtin_return_address(0)));
 }
 
 extern "C" ABSL_CACHELINE_ALIGNED void* TCMallocInternalNewAlignedHotCold(
     size_t size, std::align_val_t alignment, tcmalloc::hot_cold_t hot_cold) {
-  return fast_alloc(size, CppPolicy().AlignAs(alignment).AccessAs(hot_cold));
+  return fast_alloc(size, CppPolicy().AlignAs(alignment).AccessAs(
+                              hot_cold, __builtin_return_address(0)));
 }
 
 extern "C" ABSL_CACHELINE_ALIGNED void* TCMallocInternalNewHotColdNothrow(
     size_t size, const std::nothrow_t&,
     tcmalloc::hot_cold_t hot_cold) noexcept {
-  return fast_alloc(size, CppPolicy().Nothrow().AccessAs(hot_cold));
+  return fast_alloc(size, CppPolicy().Nothrow().AccessAs(
+                              hot_cold, __builtin_return_address(0)));
 }
 
 extern "C" ABSL_CACHELINE_ALIGNED void*
 TCMallocInternalNewAlignedHotColdNothrow(
     size_t size, std::align_val_t alignment, const std::nothrow_t&,
     tcmalloc::hot_cold_t hot_cold) noexcept {
-  return fast_alloc(
-      size, CppPolicy().AlignAs(alignment).Nothrow().AccessAs(hot_cold));
+  return fast_alloc(size, CppPolicy()
+                              .AlignAs(alignment)
+                              .Nothrow()
+                              .AccessAs(hot_cold, __builtin_return_address(0)));
+}
+
+// Clears the <size> bytes calloc just allocated at <ptr>.  Large allocations
+// whose pages the page heap knows to be zero, such as fresh or released
+// hugepages, are left alone.
+static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void ZeroForCalloc(void* ptr,
+                                                             size_t size) {
+  if (ABSL_PREDICT_FALSE(size > kMaxSize)) {
+    const Span* span =
+        tc_globals.pagemap().GetExistingDescriptor(PageIdContainingTagged(ptr));
+    if (span->known_zero()) return;
+  }
+  memset(ptr, 0, size);
+}
+
+// Allocates <size> bytes according to <policy> for the prefault_t overloads of
+// operator new.  Page-level allocations are populated before being returned;
+// small objects come from spans that are almost always resident already.
+template <typename Policy>
+static inline void* prefaulted_alloc(size_t size, Policy policy) {
+  void* ptr = fast_alloc(size, policy);
+  if (ABSL_PREDICT_FALSE(size > kMaxSize) && ptr != nullptr) {
+    tc_globals.system_allocator().Populate(
+        MteUntag(ptr), BytesToLengthCeil(size).in_bytes());
+  }
+  return ptr;
 }
 
 extern "C" ABSL_CACHELINE_ALIGNED void* TCMallocInternalCalloc(
@@ -1522,7 +2148,7 @@ extern "C" ABSL_CACHELINE_ALIGNED void* TCMallocInternalCalloc(
   }
   void* result = fast_alloc(size, MallocPolicy());
   if (ABSL_PREDICT_TRUE(result != nullptr)) {
-    memset(result, 0, size);
+    ZeroForCalloc(result, size);
   }
   return result;
 }
@@ -1562,6 +2188,41 @@ static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* do_realloc(void* old_ptr,
     changes_correct_size = actual_new_size != old_size;
   }
 
+  // Page-level allocations can often grow into the free pages following them,
+  // or have their pages remapped elsewhere, which saves copying them.
+  if (new_size > kMaxSize && new_size > old_size && !was_sampled &&
+      !tc_globals.guardedpage_allocator().PointerIsMine(old_ptr)) {
+    if (void* new_ptr = TryGrowPages(old_ptr, new_size); new_ptr != nullptr) {
+      const size_t new_allocated_size = BytesToLengthCeil(new_size).in_bytes();
+      tcmalloc::MallocHook::InvokeDeleteHook(
+          {old_ptr, std::nullopt, old_size,
+           tcmalloc::HookMemoryMutable::kImmutable});
+      tcmalloc::MallocHook::InvokeNewHook(
+          {new_ptr, new_size, new_allocated_size,
+           tcmalloc::HookMemoryMutable::kImmutable});
+      TC_ASSERT(CorrectSize(new_ptr, new_size, MallocPolicy()));
+      return new_ptr;
+    }
+  }
+
+  // Likewise, page-level allocations shrinking to another page-level size
+  // return their tail pages to the page heap in place, which saves both the
+  // copy and holding on to the tail.
+  if (new_size > kMaxSize && changes_correct_size && new_size < old_size &&
+      !was_sampled &&
+      !tc_globals.guardedpage_allocator().PointerIsMine(old_ptr) &&
+      TryShrinkPages(old_ptr, new_size)) {
+    const size_t new_allocated_size = BytesToLengthCeil(new_size).in_bytes();
+    tcmalloc::MallocHook::InvokeDeleteHook(
+        {old_ptr, std::nullopt, old_size,
+         tcmalloc::HookMemoryMutable::kImmutable});
+    tcmalloc::MallocHook::InvokeNewHook(
+        {old_ptr, new_size, new_allocated_size,
+         tcmalloc::HookMemoryMutable::kImmutable});
+    TC_ASSERT(CorrectSize(old_ptr, new_size, MallocPolicy()));
+    return old_ptr;
+  }
+
   if (changes_correct_size || was_sampled || will_sample ||
       tc_globals.guardedpage_allocator().PointerIsMine(old_ptr)) {
     // Need to reallocate.
@@ -1626,6 +2287,11 @@ extern "C" ABSL_CACHELINE_ALIGNED void* TCMallocInternalReallocArray(
 }
 
 #ifndef TCMALLOC_INTERNAL_METHODS_ONLY
+extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc)
+void* tcmalloc_new_with_class_index(size_t size, size_t class_index) {
+  return fast_alloc_class_index(size, class_index, CppPolicy());
+}
+
 extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc)
 __sized_ptr_t tcmalloc_size_returning_operator_new_nothrow(
     size_t size) noexcept {
@@ -1642,8 +2308,10 @@ __sized_ptr_t tcmalloc_size_returning_operator_new_aligned_nothrow(
 extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc)
 __sized_ptr_t tcmalloc_size_returning_operator_new_hot_cold_nothrow(
     size_t size, __hot_cold_t hot_cold) noexcept {
-  return fast_alloc(size,
-                    CppPolicy().AccessAs(hot_cold).Nothrow().SizeReturning());
+  return fast_alloc(size, CppPolicy()
+                              .AccessAs(hot_cold, __builtin_return_address(0))
+                              .Nothrow()
+                              .SizeReturning());
 }
 
 extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc)
@@ -1651,7 +2319,7 @@ __sized_ptr_t tcmalloc_size_returning_operator_new_aligned_hot_cold_nothrow(
     size_t size, std::align_val_t alignment, __hot_cold_t hot_cold) noexcept {
   return fast_alloc(size, CppPolicy()
                               .AlignAs(alignment)
-                              .AccessAs(hot_cold)
+                              .AccessAs(hot_cold, __builtin_return_address(0))
                               .Nothrow()
                               .SizeReturning());
 }
@@ -1710,6 +2378,18 @@ extern "C" ABSL_CACHELINE_ALIGNED void TCMallocInternalDeleteSizedAligned(
   return do_free_with_size(p, t, CppPolicy().AlignAs(alignment));
 }
 
+extern "C" void* TCMallocInternalInlineNewSlow(size_t size,
+                                               size_t size_class) {
+  return tcmalloc::tcmalloc_internal::slow_alloc_small(size, size_class,
+                                                       CppPolicy());
+}
+
+extern "C" void TCMallocInternalInlineSizedDeleteSlow(
+    void* p, size_t size, size_t size_class) noexcept {
+  TC_ASSERT(CorrectSize(p, size, CppPolicy()));
+  tcmalloc::tcmalloc_internal::FreeSmallSlow(p, size, size_class);
+}
+
 extern "C" void TCMallocInternalDeleteArraySized(void* p, size_t size) noexcept
     TCMALLOC_ALIAS(TCMallocInternalDeleteSized);
 
@@ -1887,6 +2567,183 @@ TCMallocInternalAlignedAllocAtLeast(size_t alignment,
   return alloc_result_t{sized_ptr.p, sized_ptr.n};
 }
 
+extern "C" size_t MallocExtension_Internal_AllocateBatch(size_t size,
+                                                         void** out,
+                                                         size_t n) {
+  if (ABSL_PREDICT_FALSE(n == 0)) return 0;
+
+  size_t got = tcmalloc::tcmalloc_internal::alloc_small_batch(size, out, n);
+  for (; got < n; ++got) {
+    void* ptr = fast_alloc(size, CppPolicy().Nothrow());
+    if (ABSL_PREDICT_FALSE(ptr == nullptr)) break;
+    out[got] = ptr;
+  }
+  return got;
+}
+
+extern "C" void MallocExtension_Internal_DeallocateBatch(void** ptrs, size_t n,
+                                                         size_t size) {
+  using tcmalloc::tcmalloc_internal::kMaxObjectsToMove;
+  using tcmalloc::tcmalloc_internal::kNormalPartitions;
+  using tcmalloc::tcmalloc_internal::PartitionFromPointerFast;
+  using tcmalloc::tcmalloc_internal::Static;
+
+  const auto [is_small, size_class0] =
+      tc_globals.sizemap().GetSizeClass(CppPolicy().InPartition<0>(), size);
+  if (ABSL_PREDICT_FALSE(!is_small) ||
+      ABSL_PREDICT_FALSE(Static::HaveHooks()) ||
+      ABSL_PREDICT_FALSE(!UsePerCpuCache(tc_globals))) {
+    for (size_t i = 0; i < n; ++i) {
+      do_free_with_size(ptrs[i], size, CppPolicy());
+    }
+    return;
+  }
+  size_t size_classes[kNormalPartitions] = {size_class0};
+  for (size_t p = 1; p < kNormalPartitions; ++p) {
+    size_classes[p] =
+        tc_globals.sizemap()
+            .GetSizeClass(CppPolicy().InPartition(p), size)
+            .size_class;
+  }
+
+  // Group runs of objects from the same partition, so that each run is pushed
+  // onto the per-CPU slab in one go.  Anything other than a kNormal object
+  // (nullptr, cold, sampled) goes through the regular sized free path.
+  void* chunk[kMaxObjectsToMove];
+  size_t count = 0;
+  size_t partition = 0;
+  for (size_t i = 0; i < n; ++i) {
+    void* ptr = ptrs[i];
+    const uintptr_t uptr = absl::bit_cast<uintptr_t>(ptr);
+    if (ABSL_PREDICT_FALSE((uptr & tcmalloc::tcmalloc_internal::
+                                       kNormalOrBadDeallocationMask) !=
+                           tcmalloc::tcmalloc_internal::kNormalMask)) {
+      do_free_with_size(ptr, size, CppPolicy());
+      continue;
+    }
+    TC_ASSERT(CorrectSize(ptr, size, CppPolicy()));
+
+    const size_t p = PartitionFromPointerFast(ptr);
+    if (count == kMaxObjectsToMove || (count != 0 && p != partition)) {
+      tcmalloc::tcmalloc_internal::free_small_batch(chunk, count,
+                                                    size_classes[partition]);
+      count = 0;
+    }
+    partition = p;
+    chunk[count++] = ptr;
+  }
+  tcmalloc::tcmalloc_internal::free_small_batch(chunk, count,
+                                                size_classes[partition]);
+}
+
+extern "C" void* MallocExtension_Internal_RegionAllocate(void** region,
+                                                        size_t size,
+                                                        size_t alignment) {
+  using tcmalloc::tcmalloc_internal::MemoryTag;
+  using tcmalloc::tcmalloc_internal::ObjectRegion;
+
+  if (ABSL_PREDICT_FALSE(*region == nullptr)) {
+    tc_globals.InitIfNecessary();
+    *region = ObjectRegion::Create(MemoryTag::kNormal);
+    if (*region == nullptr) return nullptr;
+  }
+  return tcmalloc::tcmalloc_internal::region_alloc(
+      static_cast<ObjectRegion*>(*region), size, alignment);
+}
+
+extern "C" void MallocExtension_Internal_RegionReset(void* region) {
+  auto* r = static_cast<tcmalloc::tcmalloc_internal::ObjectRegion*>(region);
+  tcmalloc::tcmalloc_internal::region_free_separate(r);
+  r->Reset();
+}
+
+extern "C" void MallocExtension_Internal_RegionDestroy(void* region) {
+  auto* r = static_cast<tcmalloc::tcmalloc_internal::ObjectRegion*>(region);
+  tcmalloc::tcmalloc_internal::region_free_separate(r);
+  r->Destroy();
+}
+
+extern "C" int MallocExtension_Internal_PersistentRegionAttach(
+    const char* path, void* address, size_t size, void** region) {
+  using tcmalloc::tcmalloc_internal::PersistentRegionHeader;
+
+  PersistentRegionHeader* header = nullptr;
+  const PersistentRegionHeader::AttachResult result =
+      PersistentRegionHeader::Attach(path, address, size, &header);
+  if (result != PersistentRegionHeader::AttachResult::kFailed) {
+    *region = header;
+  }
+  return static_cast<int>(result);
+}
+
+extern "C" void MallocExtension_Internal_PersistentRegionDetach(void* region) {
+  static_cast<tcmalloc::tcmalloc_internal::PersistentRegionHeader*>(region)
+      ->Detach();
+}
+
+extern "C" void* MallocExtension_Internal_PersistentRegionAllocate(
+    void* region, size_t size, size_t alignment) {
+  return static_cast<tcmalloc::tcmalloc_internal::PersistentRegionHeader*>(
+             region)
+      ->Allocate(size, alignment);
+}
+
+extern "C" void MallocExtension_Internal_PersistentRegionDeallocate(
+    void* region, void* ptr, size_t size, size_t alignment) {
+  static_cast<tcmalloc::tcmalloc_internal::PersistentRegionHeader*>(region)
+      ->Deallocate(ptr, size, alignment);
+}
+
+extern "C" void* MallocExtension_Internal_PersistentRegionRoot(void* region) {
+  return static_cast<tcmalloc::tcmalloc_internal::PersistentRegionHeader*>(
+             region)
+      ->root();
+}
+
+extern "C" void MallocExtension_Internal_PersistentRegionSetRoot(void* region,
+                                                                void* root) {
+  static_cast<tcmalloc::tcmalloc_internal::PersistentRegionHeader*>(region)
+      ->set_root(root);
+}
+
+extern "C" void* MallocExtension_Internal_SharedRegionAttach(int fd,
+                                                            void* address,
+                                                            size_t size) {
+  return tcmalloc::tcmalloc_internal::SharedRegionHeader::Attach(fd, address,
+                                                                 size);
+}
+
+extern "C" void MallocExtension_Internal_SharedRegionDetach(void* region) {
+  static_cast<tcmalloc::tcmalloc_internal::SharedRegionHeader*>(region)
+      ->Detach();
+}
+
+extern "C" void* MallocExtension_Internal_SharedRegionAllocate(
+    void* region, size_t size, size_t alignment) {
+  return static_cast<tcmalloc::tcmalloc_internal::SharedRegionHeader*>(region)
+      ->Allocate(size, alignment);
+}
+
+extern "C" void MallocExtension_Internal_SharedRegionDeallocate(
+    void* region, void* ptr, size_t size, size_t alignment) {
+  static_cast<tcmalloc::tcmalloc_internal::SharedRegionHeader*>(region)
+      ->Deallocate(ptr, size, alignment);
+}
+
+extern "C" bool MallocExtension_Internal_ReserveSignalSafeMemory(
+    size_t bytes) {
+  return tcmalloc::tcmalloc_internal::ReserveSignalSafeMemory(bytes);
+}
+
+extern "C" void* MallocExtension_Internal_SignalSafeAllocate(size_t size) {
+  return tcmalloc::tcmalloc_internal::tc_globals.signal_safe_pool().Allocate(
+      size);
+}
+
+extern "C" void MallocExtension_Internal_SignalSafeFree(void* ptr) {
+  tcmalloc::tcmalloc_internal::tc_globals.signal_safe_pool().Free(ptr);
+}
+
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
@@ -1919,48 +2776,122 @@ static TCMallocGuard module_enter_exit_hook;
 #ifndef TCMALLOC_INTERNAL_METHODS_ONLY
 ABSL_CACHELINE_ALIGNED void* operator new(
     size_t size, __hot_cold_t hot_cold) noexcept(false) {
-  return fast_alloc(size, CppPolicy().AccessAs(hot_cold));
+  return fast_alloc(
+      size, CppPolicy().AccessAs(hot_cold, __builtin_return_address(0)));
 }
 
 ABSL_CACHELINE_ALIGNED void* operator new(size_t size, const std::nothrow_t&,
                                           __hot_cold_t hot_cold) noexcept {
-  return fast_alloc(size, CppPolicy().Nothrow().AccessAs(hot_cold));
+  return fast_alloc(size, CppPolicy().Nothrow().AccessAs(
+                              hot_cold, __builtin_return_address(0)));
 }
 
 ABSL_CACHELINE_ALIGNED void* operator new(
     size_t size, std::align_val_t align,
     __hot_cold_t hot_cold) noexcept(false) {
-  return fast_alloc(size, CppPolicy().AlignAs(align).AccessAs(hot_cold));
+  return fast_alloc(size, CppPolicy().AlignAs(align).AccessAs(
+                              hot_cold, __builtin_return_address(0)));
 }
 
 ABSL_CACHELINE_ALIGNED void* operator new(size_t size, std::align_val_t align,
                                           const std::nothrow_t&,
                                           __hot_cold_t hot_cold) noexcept {
-  return fast_alloc(size,
-                    CppPolicy().Nothrow().AlignAs(align).AccessAs(hot_cold));
+  return fast_alloc(size, CppPolicy()
+                              .Nothrow()
+                              .AlignAs(align)
+                              .AccessAs(hot_cold, __builtin_return_address(0)));
 }
 
 ABSL_CACHELINE_ALIGNED void* operator new[](
     size_t size, __hot_cold_t hot_cold) noexcept(false) {
-  return fast_alloc(size, CppPolicy().AccessAs(hot_cold));
+  return fast_alloc(
+      size, CppPolicy().AccessAs(hot_cold, __builtin_return_address(0)));
 }
 
 ABSL_CACHELINE_ALIGNED void* operator new[](size_t size, const std::nothrow_t&,
                                             __hot_cold_t hot_cold) noexcept {
-  return fast_alloc(size, CppPolicy().Nothrow().AccessAs(hot_cold));
+  return fast_alloc(size, CppPolicy().Nothrow().AccessAs(
+                              hot_cold, __builtin_return_address(0)));
 }
 
 ABSL_CACHELINE_ALIGNED void* operator new[](
     size_t size, std::align_val_t align,
     __hot_cold_t hot_cold) noexcept(false) {
-  return fast_alloc(size, CppPolicy().AlignAs(align).AccessAs(hot_cold));
+  return fast_alloc(size, CppPolicy().AlignAs(align).AccessAs(
+                              hot_cold, __builtin_return_address(0)));
 }
 
 ABSL_CACHELINE_ALIGNED void* operator new[](size_t size, std::align_val_t align,
                                             const std::nothrow_t&,
                                             __hot_cold_t hot_cold) noexcept {
-  return fast_alloc(size,
-                    CppPolicy().Nothrow().AlignAs(align).AccessAs(hot_cold));
+  return fast_alloc(size, CppPolicy()
+                              .Nothrow()
+                              .AlignAs(align)
+                              .AccessAs(hot_cold, __builtin_return_address(0)));
+}
+
+ABSL_CACHELINE_ALIGNED void* operator new(
+    size_t size, tcmalloc::prefault_t) noexcept(false) {
+  return prefaulted_alloc(size, CppPolicy());
+}
+
+ABSL_CACHELINE_ALIGNED void* operator new(size_t size, const std::nothrow_t&,
+                                          tcmalloc::prefault_t) noexcept {
+  return prefaulted_alloc(size, CppPolicy().Nothrow());
+}
+
+ABSL_CACHELINE_ALIGNED void* operator new[](
+    size_t size, tcmalloc::prefault_t) noexcept(false) {
+  return prefaulted_alloc(size, CppPolicy());
+}
+
+ABSL_CACHELINE_ALIGNED void* operator new[](size_t size, const std::nothrow_t&,
+                                            tcmalloc::prefault_t) noexcept {
+  return prefaulted_alloc(size, CppPolicy().Nothrow());
+}
+
+ABSL_CACHELINE_ALIGNED void* operator new(
+    size_t size, tcmalloc::numa_node_t node) noexcept(false) {
+  return fast_alloc(size, CppPolicy().InNumaNode(static_cast<size_t>(node)));
+}
+
+ABSL_CACHELINE_ALIGNED void* operator new(size_t size, const std::nothrow_t&,
+                                          tcmalloc::numa_node_t node) noexcept {
+  return fast_alloc(
+      size, CppPolicy().Nothrow().InNumaNode(static_cast<size_t>(node)));
+}
+
+ABSL_CACHELINE_ALIGNED void* operator new[](
+    size_t size, tcmalloc::numa_node_t node) noexcept(false) {
+  return fast_alloc(size, CppPolicy().InNumaNode(static_cast<size_t>(node)));
+}
+
+ABSL_CACHELINE_ALIGNED void* operator new[](
+    size_t size, const std::nothrow_t&, tcmalloc::numa_node_t node) noexcept {
+  return fast_alloc(
+      size, CppPolicy().Nothrow().InNumaNode(static_cast<size_t>(node)));
+}
+
+ABSL_CACHELINE_ALIGNED void* operator new(
+    size_t size, tcmalloc::lifetime_t lifetime) noexcept(false) {
+  return fast_alloc(size, CppPolicy().LivesFor(lifetime));
+}
+
+ABSL_CACHELINE_ALIGNED void* operator new(
+    size_t size, const std::nothrow_t&,
+    tcmalloc::lifetime_t lifetime) noexcept {
+  return fast_alloc(size, CppPolicy().Nothrow().LivesFor(lifetime));
+}
+
+ABSL_CACHELINE_ALIGNED void* operator new[](
+    size_t size, tcmalloc::lifetime_t lifetime) noexcept(false) {
+  return fast_alloc(size, CppPolicy().LivesFor(lifetime));
+}
+
+ABSL_CACHELINE_ALIGNED void* operator new[](
+    size_t size, const std::nothrow_t&,
+    tcmalloc::lifetime_t lifetime) noexcept {
+  return fast_alloc(size, CppPolicy().Nothrow().LivesFor(lifetime));
 }
 #endif  // !TCMALLOC_INTERNAL_METHODS_ONLY
 
@@ -2005,22 +2936,23 @@ ABSL_CACHELINE_ALIGNED void* operator new[](size_t size, std::align_val_t align,
 #define DEFINE_ALLOC_TOKEN_NEW_EXTENSION(id)                                                                        \
   void* __alloc_token_##id##__Znwm12__hot_cold_t(size_t size,                                                       \
                                                  __hot_cold_t hot_cold) {                                           \
-    return fast_alloc(                                                                                              \
-        size,                                                                                                       \
-        CppPolicy().WithSecurityToken<TokenId{id}>().AccessAs(hot_cold));                                           \
+    return fast_alloc(size, CppPolicy()                                                                             \
+                                .WithSecurityToken<TokenId{id}>()                                                   \
+                                .AccessAs(hot_cold, __builtin_return_address(0)));                                  \
   }                                                                                                                 \
   void* __alloc_token_##id##__ZnwmRKSt9nothrow_t12__hot_cold_t(                                                     \
       size_t size, const std::nothrow_t&, __hot_cold_t hot_cold) noexcept {                                         \
-    return fast_alloc(                                                                                              \
-        size, CppPolicy().WithSecurityToken<TokenId{id}>().Nothrow().AccessAs(                                      \
-                  hot_cold));                                                                                       \
+    return fast_alloc(size, CppPolicy()                                                                             \
+                                .WithSecurityToken<TokenId{id}>()                                                   \
+                                .Nothrow()                                                                          \
+                                .AccessAs(hot_cold, __builtin_return_address(0)));                                  \
   }                                                                                                                 \
   void* __alloc_token_##id##__ZnwmSt11align_val_t12__hot_cold_t(                                                    \
       size_t size, std::align_val_t align, __hot_cold_t hot_cold) {                                                 \
-    return fast_alloc(                                                                                              \
-        size,                                                                                                       \
-        CppPolicy().WithSecurityToken<TokenId{id}>().AlignAs(align).AccessAs(                                       \
-            hot_cold));                                                                                             \
+    return fast_alloc(size, CppPolicy()                                                                             \
+                                .WithSecurityToken<TokenId{id}>()                                                   \
+                                .AlignAs(align)                                                                     \
+                                .AccessAs(hot_cold, __builtin_return_address(0)));                                  \
   }                                                                                                                 \
   void* __alloc_token_##id##__ZnwmSt11align_val_tRKSt9nothrow_t12__hot_cold_t(                                      \
       size_t size, std::align_val_t align, const std::nothrow_t&,                                                   \
@@ -2029,7 +2961,7 @@ ABSL_CACHELINE_ALIGNED void* operator new[](size_t size, std::align_val_t align,
                                 .WithSecurityToken<TokenId{id}>()                                                   \
                                 .Nothrow()                                                                          \
                                 .AlignAs(align)                                                                     \
-                                .AccessAs(hot_cold));                                                               \
+                                .AccessAs(hot_cold, __builtin_return_address(0)));                                  \
   }                                                                                                                 \
   void* __alloc_token_##id##__Znam12__hot_cold_t(size_t, __hot_cold_t)                                              \
       TCMALLOC_ALIAS(__alloc_token_##id##__Znwm12__hot_cold_t);                                                     \
@@ -2057,7 +2989,7 @@ ABSL_CACHELINE_ALIGNED void* operator new[](size_t size, std::align_val_t align,
       size_t size, __hot_cold_t hot_cold) {                                                                         \
     return fast_alloc(size, CppPolicy()                                                                             \
                                 .WithSecurityToken<TokenId{id}>()                                                   \
-                                .AccessAs(hot_cold)                                                                 \
+                                .AccessAs(hot_cold, __builtin_return_address(0))                                    \
                                 .SizeReturning());                                                                  \
   }                                                                                                                 \
   __sized_ptr_t __alloc_token_##id##___size_returning_new_aligned_hot_cold(                                         \
@@ -2065,7 +2997,7 @@ ABSL_CACHELINE_ALIGNED void* operator new[](size_t size, std::align_val_t align,
     return fast_alloc(size, CppPolicy()                                                                             \
                                 .WithSecurityToken<TokenId{id}>()                                                   \
                                 .AlignAs(alignment)                                                                 \
-                                .AccessAs(hot_cold)                                                                 \
+                                .AccessAs(hot_cold, __builtin_return_address(0))                                    \
                                 .SizeReturning());                                                                  \
   }
 
@@ -2108,7 +3040,7 @@ ABSL_CACHELINE_ALIGNED void* operator new[](size_t size, std::align_val_t align,
     void* result =                                                             \
         fast_alloc(size, MallocPolicy().WithSecurityToken<TokenId{id}>());     \
     if (ABSL_PREDICT_TRUE(result != nullptr)) {                                \
-      memset(result, 0, size);                                                 \
+      ZeroForCalloc(result, size);                                             \
     }                                                                          \
     return result;                                                             \
   }                                                                            \
@@ -2165,12 +3097,25 @@ ABSL_CACHELINE_ALIGNED void* operator new[](size_t size, std::align_val_t align,
 #ifndef ALLOC_TOKEN_MAX
 #error "Define ALLOC_TOKEN_MAX to match -falloc-token-max=<max number of IDs>"
 #endif
-static_assert(ALLOC_TOKEN_MAX == 2);
+static_assert(ALLOC_TOKEN_MAX ==
+              tcmalloc::tcmalloc_internal::kMaxSecurityPartitions);
 #endif  // __SANITIZE_ALLOC_TOKEN__
 
 extern "C" {
 DEFINE_ALLOC_TOKEN_VARIANTS(0)
 DEFINE_ALLOC_TOKEN_VARIANTS(1)
+#if defined(TCMALLOC_INTERNAL_SECURITY_PARTITIONS) && \
+    TCMALLOC_INTERNAL_SECURITY_PARTITIONS > 2
+DEFINE_ALLOC_TOKEN_VARIANTS(2)
+DEFINE_ALLOC_TOKEN_VARIANTS(3)
+#endif
+#if defined(TCMALLOC_INTERNAL_SECURITY_PARTITIONS) && \
+    TCMALLOC_INTERNAL_SECURITY_PARTITIONS > 4
+DEFINE_ALLOC_TOKEN_VARIANTS(4)
+DEFINE_ALLOC_TOKEN_VARIANTS(5)
+DEFINE_ALLOC_TOKEN_VARIANTS(6)
+DEFINE_ALLOC_TOKEN_VARIANTS(7)
+#endif
 #ifdef ALLOC_TOKEN_FALLBACK
 // Define the functions for the fallback token ID if overridden with -mllvm
 // -alloc-token-fallback=N; should fall outside the range of normal token IDs.
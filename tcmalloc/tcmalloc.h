@@ -144,6 +144,15 @@ ABSL_ATTRIBUTE_UNUSED void TCMallocInternalDeleteSized(void* p,
 ABSL_ATTRIBUTE_UNUSED void TCMallocInternalDeleteSizedAligned(
     void* p, size_t t, std::align_val_t alignment) noexcept
     ABSL_ATTRIBUTE_SECTION(google_malloc);
+// Slow paths of tcmalloc::InlineNew and tcmalloc::InlineSizedDelete (see
+// inline_fast_path.h), for objects of size_class that the inlined per-CPU
+// cache pop or push could not handle.
+ABSL_ATTRIBUTE_UNUSED void* TCMallocInternalInlineNewSlow(size_t size,
+                                                          size_t size_class)
+    ABSL_ATTRIBUTE_SECTION(google_malloc);
+ABSL_ATTRIBUTE_UNUSED void TCMallocInternalInlineSizedDeleteSlow(
+    void* p, size_t size, size_t size_class) noexcept
+    ABSL_ATTRIBUTE_SECTION(google_malloc);
 ABSL_ATTRIBUTE_UNUSED void TCMallocInternalDeleteNothrow(
     void* p, const std::nothrow_t&) noexcept
     ABSL_ATTRIBUTE_SECTION(google_malloc);
@@ -269,11 +278,24 @@ TCMallocInternalSizeReturningNewAligned(size_t size, std::align_val_t alignment)
 #ifndef ALLOC_TOKEN_MAX
 #error "Define ALLOC_TOKEN_MAX to match -falloc-token-max=<max number of IDs>"
 #endif
-static_assert(ALLOC_TOKEN_MAX == 2);
+static_assert(ALLOC_TOKEN_MAX ==
+              tcmalloc::tcmalloc_internal::kMaxSecurityPartitions);
 #endif  // __SANITIZE_ALLOC_TOKEN__
 
 DECLARE_ALLOC_TOKEN_VARIANTS(0)
 DECLARE_ALLOC_TOKEN_VARIANTS(1)
+#if defined(TCMALLOC_INTERNAL_SECURITY_PARTITIONS) && \
+    TCMALLOC_INTERNAL_SECURITY_PARTITIONS > 2
+DECLARE_ALLOC_TOKEN_VARIANTS(2)
+DECLARE_ALLOC_TOKEN_VARIANTS(3)
+#endif
+#if defined(TCMALLOC_INTERNAL_SECURITY_PARTITIONS) && \
+    TCMALLOC_INTERNAL_SECURITY_PARTITIONS > 4
+DECLARE_ALLOC_TOKEN_VARIANTS(4)
+DECLARE_ALLOC_TOKEN_VARIANTS(5)
+DECLARE_ALLOC_TOKEN_VARIANTS(6)
+DECLARE_ALLOC_TOKEN_VARIANTS(7)
+#endif
 #ifdef ALLOC_TOKEN_FALLBACK
 // Define the functions for the fallback token ID if overridden with -mllvm
 // -alloc-token-fallback=N; should fall outside the range of normal token IDs.
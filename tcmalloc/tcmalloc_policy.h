@@ -83,6 +83,7 @@
 #include <errno.h>
 #include <stddef.h>
 
+#include <algorithm>
 #include <cstddef>
 #include <new>
 #include <type_traits>
@@ -93,6 +94,7 @@
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/numa.h"
+#include "tcmalloc/lifetime_predictor.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/sizemap.h"
@@ -166,13 +168,25 @@ class AllocationAccessAsPolicy {
   AllocationAccessAsPolicy() = delete;
   explicit constexpr AllocationAccessAsPolicy(hot_cold_t value)
       : value_(value) {}
+  // `site` identifies the caller that passed the hint, so that the hint can be
+  // checked against how the memory is actually accessed.
+  constexpr AllocationAccessAsPolicy(hot_cold_t value, const void* site)
+      : value_(value), site_(site) {}
 
   constexpr hot_cold_t access() const { return value_; }
+  constexpr const void* access_site() const { return site_; }
 
-  bool is_cold() const { return value_ < Parameters::min_hot_access_hint(); }
+  bool is_cold() const {
+    const bool hinted_cold = value_ < Parameters::min_hot_access_hint();
+    if (site_ == nullptr || !Parameters::access_hint_reclassification()) {
+      return hinted_cold;
+    }
+    return tc_globals.access_hint_auditor().IsCold(site_, hinted_cold);
+  }
 
  private:
   hot_cold_t value_;
+  const void* site_ = nullptr;
 };
 
 struct AllocationAccessHotPolicy {
@@ -180,18 +194,48 @@ struct AllocationAccessHotPolicy {
   // to be constant propagated.  This allows allocations without a hot/cold hint
   // to use the normal fast path.
   static constexpr hot_cold_t access() { return hot_cold_t{255}; }
+  static constexpr const void* access_site() { return nullptr; }
 
   static bool is_cold() { return false; }
 };
 
 struct AllocationAccessColdPolicy {
   static constexpr hot_cold_t access() { return hot_cold_t{0}; }
+  static constexpr const void* access_site() { return nullptr; }
 
   static bool is_cold() { return true; }
 };
 
 using DefaultAllocationAccessPolicy = AllocationAccessHotPolicy;
 
+// DefaultLifetimePolicy: no lifetime hint, the lifetime of the allocation is
+// predicted from its size class
+struct DefaultLifetimePolicy {
+  static constexpr LifetimePrediction lifetime() {
+    return LifetimePrediction::kUnknown;
+  }
+};
+
+// LifetimeAsPolicy: use user provided lifetime hint
+class LifetimeAsPolicy {
+ public:
+  LifetimeAsPolicy() = delete;
+  explicit constexpr LifetimeAsPolicy(lifetime_t value) : value_(value) {}
+
+  constexpr LifetimePrediction lifetime() const {
+    switch (value_) {
+      case lifetime_t::kShortLived:
+        return LifetimePrediction::kShortLived;
+      case lifetime_t::kLongLived:
+        return LifetimePrediction::kLongLived;
+    }
+    return LifetimePrediction::kUnknown;
+  }
+
+ private:
+  lifetime_t value_;
+};
+
 // InvokeHooksPolicy: invoke memory allocation hooks
 struct InvokeHooksPolicy {
   static constexpr bool invoke_hooks() { return true; }
@@ -279,7 +323,9 @@ class SecurityPartitionPolicy {
   explicit constexpr SecurityPartitionPolicy(size_t partition_id,
                                              TokenId token_id)
       : partition_id_(partition_id), token_id_(token_id) {}
-  constexpr size_t partition() const { return partition_id_ > 0 ? 1 : 0; }
+  constexpr size_t partition() const {
+    return std::min(partition_id_, kMaxSecurityPartitions - 1);
+  }
   constexpr TokenId token_id() const { return token_id_; }
 
  private:
@@ -291,7 +337,9 @@ class SecurityPartitionPolicy {
 // partition value, so we define a constant version that can be optimized.
 template <TokenId kTokenId, size_t kPartitionId = static_cast<size_t>(kTokenId)>
 struct ConstSecurityPartitionPolicy {
-  constexpr size_t partition() const { return kPartitionId > 0 ? 1 : 0; }
+  constexpr size_t partition() const {
+    return std::min(kPartitionId, kMaxSecurityPartitions - 1);
+  }
   constexpr TokenId token_id() const { return kTokenId; }
 };
 
@@ -304,7 +352,8 @@ template <typename OomPolicy = CppOomPolicy,
           typename HooksPolicy = InvokeHooksPolicy,
           typename SizeReturningPolicy = NonSizeReturningPolicy,
           typename NumaPolicy = LocalNumaPartitionPolicy,
-          typename PartitionPolicy = DefaultPartitionPolicy>
+          typename PartitionPolicy = DefaultPartitionPolicy,
+          typename LifetimePolicy = DefaultLifetimePolicy>
 class TCMallocPolicy {
  public:
   // Size returning / pointer type
@@ -317,6 +366,14 @@ class TCMallocPolicy {
   explicit constexpr TCMallocPolicy(AlignPolicy align, AccessPolicy access,
                                     NumaPolicy numa, PartitionPolicy partition)
       : align_(align), access_(access), numa_(numa), partition_(partition) {}
+  explicit constexpr TCMallocPolicy(AlignPolicy align, AccessPolicy access,
+                                    NumaPolicy numa, PartitionPolicy partition,
+                                    LifetimePolicy lifetime)
+      : align_(align),
+        access_(access),
+        numa_(numa),
+        partition_(partition),
+        lifetime_(lifetime) {}
 
   // OOM policy
   static pointer_type handle_oom(size_t size) {
@@ -350,7 +407,7 @@ class TCMallocPolicy {
     return numa_.scaled_partition();
   }
 
-  // Security partition (0 or 1)
+  // Security partition, in [0, kSecurityPartitions)
   constexpr size_t security_partition() const {
     if constexpr (kSecurityPartitions == 1) {
       return 0;
@@ -358,7 +415,7 @@ class TCMallocPolicy {
     return partition_.partition();
   }
 
-  // NUMA or Security partition (0 or 1)
+  // NUMA or Security partition, in [0, kNormalPartitions)
   constexpr size_t partition() const {
     if constexpr (kSecurityPartitions == 1) {
       return numa_partition();
@@ -370,9 +427,13 @@ class TCMallocPolicy {
   constexpr TokenId token_id() const { return partition_.token_id(); }
 
   constexpr hot_cold_t access() const { return access_.access(); }
+  constexpr const void* access_site() const { return access_.access_site(); }
 
   bool is_cold() const { return access_.is_cold(); }
 
+  // Lifetime policy
+  constexpr LifetimePrediction lifetime() const { return lifetime_.lifetime(); }
+
   // Hooks policy
   static constexpr bool invoke_hooks() { return HooksPolicy::invoke_hooks(); }
 
@@ -390,82 +451,119 @@ class TCMallocPolicy {
   // Returns this policy aligned as 'align'
   template <typename align_t>
   constexpr TCMallocPolicy<OomPolicy, AlignAsPolicy, AccessPolicy, HooksPolicy,
-                           SizeReturningPolicy, NumaPolicy, PartitionPolicy>
+                           SizeReturningPolicy, NumaPolicy, PartitionPolicy,
+                           LifetimePolicy>
   AlignAs(align_t align) const {
     return TCMallocPolicy<OomPolicy, AlignAsPolicy, AccessPolicy, HooksPolicy,
-                          SizeReturningPolicy, NumaPolicy, PartitionPolicy>(
-        AlignAsPolicy{align}, numa_, partition_);
+                          SizeReturningPolicy, NumaPolicy, PartitionPolicy,
+                          LifetimePolicy>(AlignAsPolicy{align}, access_, numa_,
+                                          partition_, lifetime_);
   }
 
   constexpr TCMallocPolicy<OomPolicy, AlignPolicy, AllocationAccessAsPolicy,
                            HooksPolicy, SizeReturningPolicy, NumaPolicy,
-                           PartitionPolicy>
-  AccessAs(hot_cold_t hot_cold) const {
+                           PartitionPolicy, LifetimePolicy>
+  AccessAs(hot_cold_t hot_cold, const void* site = nullptr) const {
     return TCMallocPolicy<OomPolicy, AlignPolicy, AllocationAccessAsPolicy,
                           HooksPolicy, SizeReturningPolicy, NumaPolicy,
-                          PartitionPolicy>(
-        align_, AllocationAccessAsPolicy{hot_cold}, numa_, partition_);
+                          PartitionPolicy, LifetimePolicy>(
+        align_, AllocationAccessAsPolicy{hot_cold, site}, numa_, partition_,
+        lifetime_);
   }
 
   // Returns this policy for frequent access
   constexpr TCMallocPolicy<OomPolicy, AlignPolicy, AllocationAccessHotPolicy,
                            HooksPolicy, SizeReturningPolicy, NumaPolicy,
-                           PartitionPolicy>
+                           PartitionPolicy, LifetimePolicy>
   AccessAsHot() const {
     return TCMallocPolicy<OomPolicy, AlignPolicy, AllocationAccessHotPolicy,
                           HooksPolicy, SizeReturningPolicy, NumaPolicy,
-                          PartitionPolicy>(align_, numa_, partition_);
+                          PartitionPolicy, LifetimePolicy>(
+        align_, AllocationAccessHotPolicy{}, numa_, partition_, lifetime_);
   }
 
   // Returns this policy for infrequent access
   constexpr TCMallocPolicy<OomPolicy, AlignPolicy, AllocationAccessColdPolicy,
                            HooksPolicy, SizeReturningPolicy, NumaPolicy,
-                           PartitionPolicy>
+                           PartitionPolicy, LifetimePolicy>
   AccessAsCold() const {
     return TCMallocPolicy<OomPolicy, AlignPolicy, AllocationAccessColdPolicy,
                           HooksPolicy, SizeReturningPolicy, NumaPolicy,
-                          PartitionPolicy>(align_, numa_, partition_);
+                          PartitionPolicy, LifetimePolicy>(
+        align_, AllocationAccessColdPolicy{}, numa_, partition_, lifetime_);
+  }
+
+  // Returns this policy with the caller's expected object lifetime.
+  constexpr TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
+                           SizeReturningPolicy, NumaPolicy, PartitionPolicy,
+                           LifetimeAsPolicy>
+  LivesFor(lifetime_t lifetime) const {
+    return TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
+                          SizeReturningPolicy, NumaPolicy, PartitionPolicy,
+                          LifetimeAsPolicy>(align_, access_, numa_, partition_,
+                                            LifetimeAsPolicy{lifetime});
   }
 
   // Returns this policy with a nullptr OOM policy.
   constexpr TCMallocPolicy<NullOomPolicy, AlignPolicy, AccessPolicy,
                            HooksPolicy, SizeReturningPolicy, NumaPolicy,
-                           PartitionPolicy>
+                           PartitionPolicy, LifetimePolicy>
   Nothrow() const {
     return TCMallocPolicy<NullOomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
-                          SizeReturningPolicy, NumaPolicy, PartitionPolicy>(
-        align_, access_, numa_, partition_);
+                          SizeReturningPolicy, NumaPolicy, PartitionPolicy,
+                          LifetimePolicy>(align_, access_, numa_, partition_,
+                                          lifetime_);
   }
 
   // Returns this policy with NewAllocHook invocations disabled.
   constexpr TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, NoHooksPolicy,
-                           SizeReturningPolicy, NumaPolicy, PartitionPolicy>
+                           SizeReturningPolicy, NumaPolicy, PartitionPolicy,
+                           LifetimePolicy>
   WithoutHooks() const {
     return TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, NoHooksPolicy,
-                          SizeReturningPolicy, NumaPolicy, PartitionPolicy>(
-        align_, access_, numa_, partition_);
+                          SizeReturningPolicy, NumaPolicy, PartitionPolicy,
+                          LifetimePolicy>(align_, access_, numa_, partition_,
+                                          lifetime_);
   }
 
   constexpr TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
-                           IsSizeReturningPolicy, NumaPolicy, PartitionPolicy>
+                           IsSizeReturningPolicy, NumaPolicy, PartitionPolicy,
+                           LifetimePolicy>
   SizeReturning() const {
     return TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
-                          IsSizeReturningPolicy, NumaPolicy, PartitionPolicy>(
-        align_, access_, numa_, partition_);
+                          IsSizeReturningPolicy, NumaPolicy, PartitionPolicy,
+                          LifetimePolicy>(align_, access_, numa_, partition_,
+                                          lifetime_);
   }
 
   // Returns this policy with a fixed NUMA/type partition.
   constexpr TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
                            SizeReturningPolicy, FixedNumaPartitionPolicy,
-                           SecurityPartitionPolicy>
+                           SecurityPartitionPolicy, LifetimePolicy>
   InPartition(size_t partition) const {
     const size_t numa_partition = partition % kNumaPartitions;
     return TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
                           SizeReturningPolicy, FixedNumaPartitionPolicy,
-                          SecurityPartitionPolicy>(
+                          SecurityPartitionPolicy, LifetimePolicy>(
         align_, access_, FixedNumaPartitionPolicy{numa_partition},
         SecurityPartitionPolicy{(partition - numa_partition) /
-                                kNumaPartitions});
+                                kNumaPartitions},
+        lifetime_);
+  }
+
+  // Returns this policy with the NUMA partition that `node` belongs to, rather
+  // than that of the executing CPU.
+  TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
+                 SizeReturningPolicy, FixedNumaPartitionPolicy, PartitionPolicy,
+                 LifetimePolicy>
+  InNumaNode(size_t node) const {
+    return TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
+                          SizeReturningPolicy, FixedNumaPartitionPolicy,
+                          PartitionPolicy, LifetimePolicy>(
+        align_, access_,
+        FixedNumaPartitionPolicy{
+            tc_globals.numa_topology().GetNodePartition(node)},
+        partition_, lifetime_);
   }
 
   // Returns this policy with a compile-time fixed NUMA/type partition.
@@ -478,37 +576,42 @@ class TCMallocPolicy {
         ConstSecurityPartitionPolicy<TokenId::kNoAllocToken, kSecPartition>;
     return TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
                           SizeReturningPolicy, FixedNumaPartitionPolicy,
-                          ConstSecurityPartitionPolicy>(
+                          ConstSecurityPartitionPolicy, LifetimePolicy>(
         align_, access_, FixedNumaPartitionPolicy{kNumaPartition},
-        ConstSecurityPartitionPolicy());
+        ConstSecurityPartitionPolicy(), lifetime_);
   }
 
   // Returns this policy with a fixed partition and token ID.
   // Note, this results in a slower allocation path for non-zero partitions.
   constexpr TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
                            SizeReturningPolicy, NumaPolicy,
-                           SecurityPartitionPolicy>
+                           SecurityPartitionPolicy, LifetimePolicy>
   InPartitionWithToken(size_t partition, TokenId token_id) const {
     const size_t numa_partition = partition % kNumaPartitions;
     return TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
                           SizeReturningPolicy, NumaPolicy,
-                          SecurityPartitionPolicy>(
-        align_, numa_,
+                          SecurityPartitionPolicy, LifetimePolicy>(
+        align_, access_, numa_,
         SecurityPartitionPolicy{(partition - numa_partition) / kNumaPartitions,
-                                token_id});
+                                token_id},
+        lifetime_);
   }
 
   // Returns this policy with a partition choice based on the token ID.
-  // Namely, tokens != kAllocToken0 will use partition 1.
+  // Namely, token N uses partition N, and tokens past the last partition share
+  // it.
   template <TokenId kTokenId>
   constexpr TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
                            SizeReturningPolicy, NumaPolicy,
-                           ConstSecurityPartitionPolicy<kTokenId>>
+                           ConstSecurityPartitionPolicy<kTokenId>,
+                           LifetimePolicy>
   WithSecurityToken() const {
     return TCMallocPolicy<OomPolicy, AlignPolicy, AccessPolicy, HooksPolicy,
                           SizeReturningPolicy, NumaPolicy,
-                          ConstSecurityPartitionPolicy<kTokenId>>(
-        align_, numa_, ConstSecurityPartitionPolicy<kTokenId>());
+                          ConstSecurityPartitionPolicy<kTokenId>,
+                          LifetimePolicy>(
+        align_, access_, numa_, ConstSecurityPartitionPolicy<kTokenId>(),
+        lifetime_);
   }
 
   // Returns this policy with a fixed NUMA/type partition matching that of the
@@ -522,6 +625,7 @@ class TCMallocPolicy {
   ABSL_ATTRIBUTE_NO_UNIQUE_ADDRESS AccessPolicy access_;
   ABSL_ATTRIBUTE_NO_UNIQUE_ADDRESS NumaPolicy numa_;
   ABSL_ATTRIBUTE_NO_UNIQUE_ADDRESS PartitionPolicy partition_;
+  ABSL_ATTRIBUTE_NO_UNIQUE_ADDRESS LifetimePolicy lifetime_;
 };
 
 using CppPolicy = TCMallocPolicy<CppOomPolicy, DefaultAlignPolicy>;
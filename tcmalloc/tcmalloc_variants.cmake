@@ -39,6 +39,14 @@ function(tcmalloc_cc_library_variants)
     LINKOPTS ${TCMALLOC_LINKOPTS}
     DEPS ${TCMALLOC_DEPS}
   )
+  tcmalloc_cc_library(NAME ${TCMALLOC_NAME}_64k_pages
+    ALIAS ${TCMALLOC_ALIAS}_64k_pages
+    SRCS ${TCMALLOC_SRCS}
+    HDRS ${TCMALLOC_HDRS}
+    COPTS ${TCMALLOC_COPTS} -DTCMALLOC_INTERNAL_64K_PAGES
+    LINKOPTS ${TCMALLOC_LINKOPTS}
+    DEPS ${TCMALLOC_DEPS}
+  )
   tcmalloc_cc_library(NAME ${TCMALLOC_NAME}_256k_pages
     ALIAS ${TCMALLOC_ALIAS}_256k_pages
     SRCS ${TCMALLOC_SRCS}
@@ -87,6 +95,14 @@ function(tcmalloc_cc_library_variants)
     LINKOPTS ${TCMALLOC_LINKOPTS}
     DEPS ${TCMALLOC_DEPS}
   )
+  tcmalloc_cc_library(NAME ${TCMALLOC_NAME}_security_partitions_8
+    ALIAS ${TCMALLOC_ALIAS}_security_partitions_8
+    SRCS ${TCMALLOC_SRCS}
+    HDRS ${TCMALLOC_HDRS}
+    COPTS ${TCMALLOC_COPTS} -DTCMALLOC_INTERNAL_8K_PAGES -DTCMALLOC_INTERNAL_SECURITY_PARTITIONS=8
+    LINKOPTS ${TCMALLOC_LINKOPTS}
+    DEPS ${TCMALLOC_DEPS}
+  )
 endfunction()
 
 function(tcmalloc_cc_test_variants)
@@ -274,7 +290,7 @@ function(tcmalloc_cc_test_variants)
     LINKOPTS ${TCMALLOC_LINKOPTS}
     DEPS ${TCMALLOC_DEPS} $<LINK_LIBRARY:WHOLE_ARCHIVE,tcmalloc::tcmalloc,tcmalloc::common_8k_pages>
   )
-  set_tests_properties(${TCMALLOC_NAME}_mm_vcpu_cpu_caches PROPERTIES ENVIRONMENT "BORG_EXPERIMENTS=TEST_ONLY_MM_VCPU;GLIBC_TUNABLES=glibc.pthread.rseq=0;TEST_TMPDIR=${CMAKE_CURRENT_BINARY_DIR};TEST_SRCDIR=${CMAKE_SOURCE_DIR}")
+  set_tests_properties(${TCMALLOC_NAME}_mm_vcpu_cpu_caches PROPERTIES ENVIRONMENT "TCMALLOC_RSEQ_VIRTUAL_CPUS=1;GLIBC_TUNABLES=glibc.pthread.rseq=0;TEST_TMPDIR=${CMAKE_CURRENT_BINARY_DIR};TEST_SRCDIR=${CMAKE_SOURCE_DIR}")
   tcmalloc_cc_test(NAME ${TCMALLOC_NAME}_legacy_locking
     SRCS ${TCMALLOC_SRCS}
     HDRS ${TCMALLOC_HDRS}
@@ -307,6 +323,14 @@ function(tcmalloc_cc_test_variants)
     DEPS ${TCMALLOC_DEPS} $<LINK_LIBRARY:WHOLE_ARCHIVE,tcmalloc::tcmalloc_latency_injection,tcmalloc::common_latency_injection>
   )
   set_tests_properties(${TCMALLOC_NAME}_latency_injection PROPERTIES ENVIRONMENT "TEST_TMPDIR=${CMAKE_CURRENT_BINARY_DIR};TEST_SRCDIR=${CMAKE_SOURCE_DIR}")
+  tcmalloc_cc_test(NAME ${TCMALLOC_NAME}_security_partitions_8
+    SRCS ${TCMALLOC_SRCS}
+    HDRS ${TCMALLOC_HDRS}
+    COPTS ${TCMALLOC_COPTS} -DTCMALLOC_INTERNAL_8K_PAGES -DTCMALLOC_INTERNAL_SECURITY_PARTITIONS=8
+    LINKOPTS ${TCMALLOC_LINKOPTS}
+    DEPS ${TCMALLOC_DEPS} $<LINK_LIBRARY:WHOLE_ARCHIVE,tcmalloc::tcmalloc_security_partitions_8,tcmalloc::common_security_partitions_8>
+  )
+  set_tests_properties(${TCMALLOC_NAME}_security_partitions_8 PROPERTIES ENVIRONMENT "TCMALLOC_HEAP_PARTITIONING=true;TEST_TMPDIR=${CMAKE_CURRENT_BINARY_DIR};TEST_SRCDIR=${CMAKE_SOURCE_DIR}")
 endfunction()
 
 function(tcmalloc_cc_binary_variants)
@@ -0,0 +1,177 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "tcmalloc/tenant_tracker.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+ABSL_CONST_INIT thread_local MallocExtension::TenantId current_tenant
+    ABSL_ATTRIBUTE_INITIAL_EXEC = MallocExtension::kNoTenant;
+
+namespace {
+
+size_t Hash(MallocExtension::TenantId tenant) {
+  return static_cast<size_t>((tenant * uint64_t{0x9e3779b97f4a7c15}) >> 40);
+}
+
+}  // namespace
+
+TenantTracker::Slot* TenantTracker::Find(MallocExtension::TenantId tenant,
+                                         bool insert) {
+  TC_ASSERT_NE(tenant, MallocExtension::kNoTenant);
+  const size_t start = Hash(tenant);
+  for (size_t i = 0; i < kMaxTenants; ++i) {
+    Slot& slot = slots_[(start + i) % kMaxTenants];
+    MallocExtension::TenantId t = slot.tenant.load(std::memory_order_acquire);
+    if (t == MallocExtension::kNoTenant) {
+      if (!insert) return nullptr;
+      // Another thread may claim the slot meanwhile, possibly for `tenant`.
+      if (!slot.tenant.compare_exchange_strong(t, tenant,
+                                               std::memory_order_acq_rel) &&
+          t != tenant) {
+        continue;
+      }
+      return &slot;
+    }
+    if (t == tenant) return &slot;
+  }
+  return nullptr;
+}
+
+const TenantTracker::Slot* TenantTracker::Find(
+    MallocExtension::TenantId tenant) const {
+  return const_cast<TenantTracker*>(this)->Find(tenant, /*insert=*/false);
+}
+
+void TenantTracker::RecordAllocation(MallocExtension::TenantId tenant,
+                                     int64_t bytes) {
+  if (tenant == MallocExtension::kNoTenant) return;
+  Slot* slot = Find(tenant, /*insert=*/true);
+  if (slot == nullptr) {
+    untracked_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    return;
+  }
+  slot->allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  const int64_t live =
+      slot->live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  const size_t limit = slot->limit.load(std::memory_order_relaxed);
+  if (limit != 0 && live > static_cast<int64_t>(limit) &&
+      live - bytes <= static_cast<int64_t>(limit)) {
+    slot->limit_exceeded.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void TenantTracker::RecordDeallocation(MallocExtension::TenantId tenant,
+                                       int64_t bytes) {
+  if (tenant == MallocExtension::kNoTenant) return;
+  Slot* slot = Find(tenant, /*insert=*/false);
+  if (slot == nullptr) {
+    untracked_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    return;
+  }
+  slot->live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void TenantTracker::SetLimit(MallocExtension::TenantId tenant, size_t bytes) {
+  if (tenant == MallocExtension::kNoTenant) return;
+  Slot* slot = Find(tenant, /*insert=*/true);
+  if (slot == nullptr) return;
+  slot->limit.store(bytes, std::memory_order_relaxed);
+}
+
+bool TenantTracker::OverLimit(MallocExtension::TenantId tenant) const {
+  if (tenant == MallocExtension::kNoTenant) return false;
+  const Slot* slot = Find(tenant);
+  if (slot == nullptr) return false;
+  const size_t limit = slot->limit.load(std::memory_order_relaxed);
+  return limit != 0 && slot->live_bytes.load(std::memory_order_relaxed) >
+                           static_cast<int64_t>(limit);
+}
+
+void TenantTracker::GetStats(
+    std::vector<MallocExtension::TenantStats>& stats) const {
+  for (const Slot& slot : slots_) {
+    const MallocExtension::TenantId tenant =
+        slot.tenant.load(std::memory_order_acquire);
+    if (tenant == MallocExtension::kNoTenant) continue;
+    MallocExtension::TenantStats s;
+    s.tenant = tenant;
+    s.live_bytes = std::max<int64_t>(
+        slot.live_bytes.load(std::memory_order_relaxed), 0);
+    s.allocated_bytes = slot.allocated_bytes.load(std::memory_order_relaxed);
+    s.limit = slot.limit.load(std::memory_order_relaxed);
+    s.limit_exceeded = slot.limit_exceeded.load(std::memory_order_relaxed);
+    stats.push_back(s);
+  }
+}
+
+void TenantTracker::Print(Printer& out) const {
+  static constexpr double MiB = 1048576.0;
+  out.printf("------------------------------------------------\n");
+  out.printf("Tenant usage, estimated from sampled allocations\n");
+  out.printf("------------------------------------------------\n");
+  for (const Slot& slot : slots_) {
+    const MallocExtension::TenantId tenant =
+        slot.tenant.load(std::memory_order_acquire);
+    if (tenant == MallocExtension::kNoTenant) continue;
+    const int64_t live_bytes = slot.live_bytes.load(std::memory_order_relaxed);
+    out.printf(
+        "tenant %10u: %12lld live bytes (%7.1f MiB); %14lld bytes allocated; "
+        "limit %zu, exceeded %lld times\n",
+        tenant, live_bytes, live_bytes / MiB,
+        slot.allocated_bytes.load(std::memory_order_relaxed),
+        slot.limit.load(std::memory_order_relaxed),
+        slot.limit_exceeded.load(std::memory_order_relaxed));
+  }
+  out.printf("untracked tenants: %12lld live bytes\n",
+             untracked_bytes_.load(std::memory_order_relaxed));
+}
+
+void TenantTracker::PrintInPbtxt(PbtxtRegion& region) const {
+  for (const Slot& slot : slots_) {
+    const MallocExtension::TenantId tenant =
+        slot.tenant.load(std::memory_order_acquire);
+    if (tenant == MallocExtension::kNoTenant) continue;
+    PbtxtRegion entry = region.CreateSubRegion("tenant");
+    entry.PrintI64("tenant", tenant);
+    entry.PrintI64("live_bytes",
+                   slot.live_bytes.load(std::memory_order_relaxed));
+    entry.PrintI64("allocated_bytes",
+                   slot.allocated_bytes.load(std::memory_order_relaxed));
+    entry.PrintI64("limit", slot.limit.load(std::memory_order_relaxed));
+    entry.PrintI64("limit_exceeded",
+                   slot.limit_exceeded.load(std::memory_order_relaxed));
+  }
+  region.PrintI64("untracked_tenant_bytes",
+                  untracked_bytes_.load(std::memory_order_relaxed));
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
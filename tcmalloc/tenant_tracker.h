@@ -0,0 +1,93 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef TCMALLOC_TENANT_TRACKER_H_
+#define TCMALLOC_TENANT_TRACKER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// The tenant that the calling thread allocates for, see
+// MallocExtension::SetCurrentTenant.  Only read when an allocation is sampled.
+ABSL_CONST_INIT extern thread_local MallocExtension::TenantId current_tenant
+    ABSL_ATTRIBUTE_INITIAL_EXEC;
+
+// Tracks the live bytes of each tenant.
+//
+// Like AllocationRateTracker, the bytes are estimated from sampled
+// allocations, each of which stands for weight / (requested_size + 1) objects
+// as in heap profiles, so that the allocation fast path does not change.
+// Tenants are never forgotten.  At most kMaxTenants are tracked; the bytes of
+// further tenants are only counted in total.
+class TenantTracker {
+ public:
+  static constexpr size_t kMaxTenants = 256;
+
+  constexpr TenantTracker() = default;
+  TenantTracker(const TenantTracker&) = delete;
+  TenantTracker& operator=(const TenantTracker&) = delete;
+
+  // Records a sampled allocation or deallocation of `tenant` that stands for
+  // `bytes` bytes.
+  void RecordAllocation(MallocExtension::TenantId tenant, int64_t bytes);
+  void RecordDeallocation(MallocExtension::TenantId tenant, int64_t bytes);
+
+  // Sets the limit of `tenant`, 0 for none.
+  void SetLimit(MallocExtension::TenantId tenant, size_t bytes);
+
+  // Returns whether the live bytes of `tenant` exceed its limit.
+  bool OverLimit(MallocExtension::TenantId tenant) const;
+
+  void GetStats(std::vector<MallocExtension::TenantStats>& stats) const;
+
+  void Print(Printer& out) const;
+  void PrintInPbtxt(PbtxtRegion& region) const;
+
+ private:
+  struct Slot {
+    std::atomic<MallocExtension::TenantId> tenant{
+        MallocExtension::kNoTenant};
+    std::atomic<int64_t> live_bytes{0};
+    std::atomic<int64_t> allocated_bytes{0};
+    std::atomic<size_t> limit{0};
+    std::atomic<int64_t> limit_exceeded{0};
+  };
+
+  // Returns the slot of `tenant`, claiming a free one if `insert`, or nullptr.
+  Slot* Find(MallocExtension::TenantId tenant, bool insert);
+  const Slot* Find(MallocExtension::TenantId tenant) const;
+
+  Slot slots_[kMaxTenants];
+  // Live bytes of the tenants that found no slot.
+  std::atomic<int64_t> untracked_bytes_{0};
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_TENANT_TRACKER_H_
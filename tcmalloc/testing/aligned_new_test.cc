@@ -65,6 +65,13 @@ struct alignas(64) Aligned64 {
 
 static_assert(alignof(Aligned64) == 64, "Unexpected alignment");
 
+// For 4 KiB alignment, as for DMA buffers, sizeof() is 4 KiB too.
+struct alignas(4096) Aligned4096 {
+  int32_t a[16];
+};
+
+static_assert(alignof(Aligned4096) == 4096, "Unexpected alignment");
+
 template <typename T>
 class AlignedNew : public ::testing::Test {
  protected:
@@ -196,7 +203,8 @@ TYPED_TEST_P(AlignedNew, ArraySizeCheckSampling) {
 REGISTER_TYPED_TEST_SUITE_P(AlignedNew, AlignedTest, SizeCheckSampling,
                             ArraySizeCheckSampling);
 
-typedef ::testing::Types<Aligned4, Aligned8, Aligned16, Aligned32, Aligned64>
+typedef ::testing::Types<Aligned4, Aligned8, Aligned16, Aligned32, Aligned64,
+                         Aligned4096>
     MyTypes;
 INSTANTIATE_TYPED_TEST_SUITE_P(My, AlignedNew, MyTypes);
 
@@ -0,0 +1,347 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/testing/allocation_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/numeric/bits.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/malloc_hook.h"
+
+namespace tcmalloc {
+namespace tcmalloc_testing {
+namespace {
+
+constexpr char kMagic[8] = {'T', 'C', 'M', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint32_t kVersion = 1;
+constexpr uint8_t kHot = 255;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_threads;
+  uint64_t num_objects;
+  uint64_t num_events;
+};
+
+// Identifies the recorder buffer of the current thread.  The generation
+// distinguishes buffers of an earlier recorder from those of the current one.
+struct ThreadSlot {
+  uint64_t generation;
+  int index;
+};
+
+ABSL_CONST_INIT thread_local ThreadSlot thread_slot = {0, -1};
+ABSL_CONST_INIT std::atomic<uint64_t> next_generation{1};
+
+}  // namespace
+
+std::atomic<AllocationTraceRecorder*> AllocationTraceRecorder::active_{
+    nullptr};
+
+absl::Status AllocationTrace::WriteToFile(absl::string_view path) const {
+  const std::string filename(path);
+  FILE* f = fopen(filename.c_str(), "wb");
+  if (f == nullptr) {
+    return absl::NotFoundError(absl::StrCat("cannot open ", path));
+  }
+  FileHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_threads = num_threads;
+  header.num_objects = num_objects;
+  header.num_events = events.size();
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  if (ok && !events.empty()) {
+    ok = fwrite(events.data(), sizeof(events[0]), events.size(), f) ==
+         events.size();
+  }
+  ok = (fclose(f) == 0) && ok;
+  if (!ok) {
+    return absl::DataLossError(absl::StrCat("cannot write ", path));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<AllocationTrace> AllocationTrace::ReadFromFile(
+    absl::string_view path) {
+  const std::string filename(path);
+  FILE* f = fopen(filename.c_str(), "rb");
+  if (f == nullptr) {
+    return absl::NotFoundError(absl::StrCat("cannot open ", path));
+  }
+  FileHeader header;
+  if (fread(&header, sizeof(header), 1, f) != 1 ||
+      memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    fclose(f);
+    return absl::InvalidArgumentError(
+        absl::StrCat(path, " is not an allocation trace"));
+  }
+  if (header.version != kVersion) {
+    fclose(f);
+    return absl::InvalidArgumentError(absl::StrCat(
+        path, " has unsupported version ", header.version));
+  }
+
+  AllocationTrace trace;
+  trace.num_threads = header.num_threads;
+  trace.num_objects = header.num_objects;
+  trace.events.resize(header.num_events);
+  const bool ok = trace.events.empty() ||
+                  fread(trace.events.data(), sizeof(trace.events[0]),
+                        trace.events.size(), f) == trace.events.size();
+  fclose(f);
+  if (!ok) {
+    return absl::DataLossError(absl::StrCat(path, " is truncated"));
+  }
+  for (const AllocationTraceEvent& e : trace.events) {
+    if (e.thread >= trace.num_threads || e.object >= trace.num_objects ||
+        e.log2_alignment >= 64) {
+      return absl::InvalidArgumentError(
+          absl::StrCat(path, " has an invalid event"));
+    }
+  }
+  return trace;
+}
+
+AllocationTraceRecorder::AllocationTraceRecorder(int max_threads,
+                                                 size_t events_per_thread)
+    : events_per_thread_(events_per_thread),
+      generation_(next_generation.fetch_add(1, std::memory_order_relaxed)),
+      threads_(max_threads) {
+  TC_CHECK_GT(max_threads, 0);
+  for (ThreadBuffer& buffer : threads_) {
+    buffer.events = std::make_unique<RawEvent[]>(events_per_thread_);
+  }
+  AllocationTraceRecorder* expected = nullptr;
+  TC_CHECK(active_.compare_exchange_strong(expected, this,
+                                           std::memory_order_release));
+  TC_CHECK(MallocHook::AddNewHook(&AllocationTraceRecorder::NewHook));
+  TC_CHECK(MallocHook::AddDeleteHook(&AllocationTraceRecorder::DeleteHook));
+}
+
+AllocationTraceRecorder::~AllocationTraceRecorder() {
+  if (recording_.load(std::memory_order_relaxed)) {
+    Finish();
+  }
+}
+
+void AllocationTraceRecorder::NewHook(const MallocHook::NewInfo& info) {
+  AllocationTraceRecorder* recorder = active_.load(std::memory_order_acquire);
+  if (recorder == nullptr || info.ptr == nullptr) return;
+  recorder->Record(AllocationTraceEvent::kAllocate, info.ptr,
+                   info.requested_size, info.alignment, info.hot_cold);
+}
+
+void AllocationTraceRecorder::DeleteHook(const MallocHook::DeleteInfo& info) {
+  AllocationTraceRecorder* recorder = active_.load(std::memory_order_acquire);
+  if (recorder == nullptr || info.ptr == nullptr) return;
+  recorder->Record(AllocationTraceEvent::kDeallocate, info.ptr, 0, 1, kHot);
+}
+
+void AllocationTraceRecorder::Record(AllocationTraceEvent::Op op,
+                                     const void* ptr, uint64_t size,
+                                     size_t alignment, uint8_t hot_cold) {
+  if (!recording_.load(std::memory_order_relaxed)) return;
+
+  ThreadSlot& slot = thread_slot;
+  if (slot.generation != generation_) {
+    slot.generation = generation_;
+    slot.index = num_threads_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (slot.index >= static_cast<int>(threads_.size())) {
+    dropped_events_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ThreadBuffer& buffer = threads_[slot.index];
+  const size_t n = buffer.size.load(std::memory_order_relaxed);
+  if (n >= events_per_thread_) {
+    dropped_events_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  RawEvent& event = buffer.events[n];
+  // Deallocations are ordered before the allocations that reuse their
+  // address, since the delete hook runs before the object is freed.
+  event.sequence = sequence_.fetch_add(1, std::memory_order_relaxed);
+  event.ptr = ptr;
+  event.size = size;
+  event.op = op;
+  event.log2_alignment =
+      alignment > 1 ? absl::bit_width(alignment - 1) : 0;
+  event.hot_cold = hot_cold;
+  buffer.size.store(n + 1, std::memory_order_release);
+}
+
+AllocationTrace AllocationTraceRecorder::Finish() {
+  TC_CHECK(recording_.exchange(false, std::memory_order_relaxed));
+  TC_CHECK(MallocHook::RemoveNewHook(&AllocationTraceRecorder::NewHook));
+  TC_CHECK(MallocHook::RemoveDeleteHook(&AllocationTraceRecorder::DeleteHook));
+  active_.store(nullptr, std::memory_order_release);
+
+  // Threads index their buffers in order of their first event.
+  const int num_threads =
+      std::min<int>(num_threads_.load(std::memory_order_relaxed),
+                    threads_.size());
+  std::vector<std::pair<uint64_t, std::pair<int, size_t>>> order;
+  for (int t = 0; t < num_threads; ++t) {
+    const size_t n = threads_[t].size.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; ++i) {
+      order.push_back({threads_[t].events[i].sequence, {t, i}});
+    }
+  }
+  std::sort(order.begin(), order.end());
+
+  AllocationTrace trace;
+  trace.num_threads = num_threads;
+  trace.events.reserve(order.size());
+  absl::flat_hash_map<const void*, uint64_t> live;
+  for (const auto& [sequence, index] : order) {
+    const RawEvent& raw = threads_[index.first].events[index.second];
+    AllocationTraceEvent event;
+    event.thread = index.first;
+    event.op = raw.op;
+    event.log2_alignment = raw.log2_alignment;
+    event.hot_cold = raw.hot_cold;
+    if (raw.op == AllocationTraceEvent::kAllocate) {
+      event.object = trace.num_objects++;
+      event.size = raw.size;
+      live[raw.ptr] = event.object;
+    } else {
+      auto it = live.find(raw.ptr);
+      // Allocated before recording started.
+      if (it == live.end()) continue;
+      event.object = it->second;
+      event.size = 0;
+      live.erase(it);
+    }
+    trace.events.push_back(event);
+  }
+  return trace;
+}
+
+AllocationTraceReplayer::AllocationTraceReplayer(const AllocationTrace& trace)
+    : trace_(trace),
+      thread_events_(trace.num_threads),
+      objects_(new std::atomic<void*>[trace.num_objects]),
+      log2_alignments_(new uint8_t[trace.num_objects]) {
+  for (uint64_t i = 0; i < trace_.num_objects; ++i) {
+    objects_[i].store(nullptr, std::memory_order_relaxed);
+    log2_alignments_[i] = 0;
+  }
+  for (uint64_t i = 0; i < trace_.events.size(); ++i) {
+    const AllocationTraceEvent& e = trace_.events[i];
+    TC_CHECK_LT(e.thread, trace_.num_threads);
+    TC_CHECK_LT(e.object, trace_.num_objects);
+    thread_events_[e.thread].push_back(i);
+    if (e.op == AllocationTraceEvent::kAllocate) {
+      log2_alignments_[e.object] = e.log2_alignment;
+    }
+  }
+}
+
+AllocationTraceReplayer::~AllocationTraceReplayer() {
+  for (uint64_t i = 0; i < trace_.num_objects; ++i) {
+    void* ptr = objects_[i].load(std::memory_order_relaxed);
+    if (ptr == nullptr || ptr == this) continue;
+    if (log2_alignments_[i] == 0) {
+      ::operator delete(ptr);
+    } else {
+      ::operator delete(ptr,
+                        static_cast<std::align_val_t>(size_t{1}
+                                                      << log2_alignments_[i]));
+    }
+  }
+}
+
+absl::Duration AllocationTraceReplayer::Run() {
+  absl::Notification start;
+  std::vector<std::thread> threads;
+  threads.reserve(trace_.num_threads);
+  for (uint32_t t = 0; t < trace_.num_threads; ++t) {
+    threads.emplace_back([&, t] {
+      start.WaitForNotification();
+      RunThread(t);
+    });
+  }
+  const absl::Time begin = absl::Now();
+  start.Notify();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return absl::Now() - begin;
+}
+
+void AllocationTraceReplayer::RunThread(uint32_t thread) {
+  for (uint64_t index : thread_events_[thread]) {
+    const AllocationTraceEvent& e = trace_.events[index];
+    std::atomic<void*>& slot = objects_[e.object];
+    if (e.op == AllocationTraceEvent::kAllocate) {
+      const std::align_val_t alignment =
+          static_cast<std::align_val_t>(size_t{1} << e.log2_alignment);
+      const hot_cold_t hot_cold = static_cast<hot_cold_t>(e.hot_cold);
+      void* ptr;
+      if (e.log2_alignment == 0) {
+        ptr = e.hot_cold == kHot ? ::operator new(e.size)
+                                 : __size_returning_new_hot_cold(e.size,
+                                                                 hot_cold)
+                                       .p;
+      } else {
+        ptr = __size_returning_new_aligned_hot_cold(e.size, alignment,
+                                                    hot_cold)
+                  .p;
+      }
+      slot.store(ptr, std::memory_order_release);
+      continue;
+    }
+
+    // Wait for the allocating thread to get there.
+    void* ptr;
+    while ((ptr = slot.load(std::memory_order_acquire)) == nullptr) {
+      std::this_thread::yield();
+    }
+    // Leave a non-null marker behind, so the destructor skips the object.
+    slot.store(this, std::memory_order_relaxed);
+    if (log2_alignments_[e.object] == 0) {
+      ::operator delete(ptr);
+    } else {
+      ::operator delete(ptr, static_cast<std::align_val_t>(
+                                 size_t{1} << log2_alignments_[e.object]));
+    }
+  }
+}
+
+}  // namespace tcmalloc_testing
+}  // namespace tcmalloc
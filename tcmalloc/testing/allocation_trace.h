@@ -0,0 +1,155 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Records the allocations and deallocations of a process through MallocHook,
+// so that they can be replayed against allocator variants by
+// tcmalloc_replay.
+
+#ifndef TCMALLOC_TESTING_ALLOCATION_TRACE_H_
+#define TCMALLOC_TESTING_ALLOCATION_TRACE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "tcmalloc/malloc_hook.h"
+
+namespace tcmalloc {
+namespace tcmalloc_testing {
+
+struct AllocationTraceEvent {
+  enum Op : uint8_t { kAllocate, kDeallocate };
+
+  // Index of the object, in order of allocation.  An object's lifetime spans
+  // the events between its allocation and its deallocation, if any.
+  uint64_t object;
+  // Requested size.  0 for deallocations.
+  uint64_t size;
+  // Index of the thread, in order of first event.
+  uint32_t thread;
+  Op op;
+  // log2 of the requested alignment.
+  uint8_t log2_alignment;
+  // Requested tcmalloc::hot_cold_t access hint.
+  uint8_t hot_cold;
+};
+
+static_assert(sizeof(AllocationTraceEvent) == 24);
+
+struct AllocationTrace {
+  uint32_t num_threads = 0;
+  uint64_t num_objects = 0;
+  // In the order they happened in.
+  std::vector<AllocationTraceEvent> events;
+
+  // Traces are written in the byte order of the host.
+  absl::Status WriteToFile(absl::string_view path) const;
+  static absl::StatusOr<AllocationTrace> ReadFromFile(absl::string_view path);
+};
+
+// Records the allocations and deallocations of all threads from construction
+// until Finish().  Events are appended to per-thread buffers that are
+// allocated up front, so recording does not allocate and only synchronizes
+// threads to order their events; events beyond a thread's buffer, or from
+// threads beyond max_threads, are dropped.
+//
+// Only one recorder may exist at a time.
+class AllocationTraceRecorder {
+ public:
+  explicit AllocationTraceRecorder(int max_threads = 256,
+                                   size_t events_per_thread = 1 << 20);
+  ~AllocationTraceRecorder();
+
+  AllocationTraceRecorder(const AllocationTraceRecorder&) = delete;
+  AllocationTraceRecorder& operator=(const AllocationTraceRecorder&) = delete;
+
+  // Stops recording and returns the trace.  Deallocations of objects
+  // allocated before recording started are left out.
+  AllocationTrace Finish();
+
+  // Number of events dropped so far for lack of buffer space.
+  size_t dropped_events() const {
+    return dropped_events_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct RawEvent {
+    uint64_t sequence;
+    const void* ptr;
+    uint64_t size;
+    AllocationTraceEvent::Op op;
+    uint8_t log2_alignment;
+    uint8_t hot_cold;
+  };
+
+  struct ThreadBuffer {
+    std::unique_ptr<RawEvent[]> events;
+    // Only written by the thread the buffer belongs to.
+    std::atomic<size_t> size{0};
+  };
+
+  void Record(AllocationTraceEvent::Op op, const void* ptr, uint64_t size,
+              size_t alignment, uint8_t hot_cold);
+
+  static void NewHook(const MallocHook::NewInfo& info);
+  static void DeleteHook(const MallocHook::DeleteInfo& info);
+
+  const size_t events_per_thread_;
+  const uint64_t generation_;
+  std::vector<ThreadBuffer> threads_;
+  std::atomic<int> num_threads_{0};
+  std::atomic<uint64_t> sequence_{0};
+  std::atomic<size_t> dropped_events_{0};
+  std::atomic<bool> recording_{true};
+
+  static std::atomic<AllocationTraceRecorder*> active_;
+};
+
+// Replays a trace with one thread per traced thread.  A thread that
+// deallocates an object allocated by another waits for the allocation, so
+// the replay respects the order of the trace wherever threads interact.
+class AllocationTraceReplayer {
+ public:
+  explicit AllocationTraceReplayer(const AllocationTrace& trace);
+  // Deallocates the objects that the trace left live.
+  ~AllocationTraceReplayer();
+
+  AllocationTraceReplayer(const AllocationTraceReplayer&) = delete;
+  AllocationTraceReplayer& operator=(const AllocationTraceReplayer&) = delete;
+
+  // Replays the trace and returns how long it took.  Objects that the trace
+  // left live remain allocated until the replayer is destroyed, so that the
+  // state of the heap at the end of the trace can be inspected.  May only be
+  // called once.
+  absl::Duration Run();
+
+ private:
+  void RunThread(uint32_t thread);
+
+  const AllocationTrace& trace_;
+  std::vector<std::vector<uint64_t>> thread_events_;
+  std::unique_ptr<std::atomic<void*>[]> objects_;
+  std::unique_ptr<uint8_t[]> log2_alignments_;
+};
+
+}  // namespace tcmalloc_testing
+}  // namespace tcmalloc
+
+#endif  // TCMALLOC_TESTING_ALLOCATION_TRACE_H_
@@ -0,0 +1,173 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/testing/allocation_trace.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace tcmalloc_testing {
+namespace {
+
+// Sizes that nothing else in the test allocates.
+constexpr size_t kPlainSize = 12345;
+constexpr size_t kAlignedSize = 23456;
+constexpr size_t kColdSize = 34567;
+
+const AllocationTraceEvent* FindAllocation(const AllocationTrace& trace,
+                                           size_t size) {
+  for (const AllocationTraceEvent& e : trace.events) {
+    if (e.op == AllocationTraceEvent::kAllocate && e.size == size) return &e;
+  }
+  return nullptr;
+}
+
+const AllocationTraceEvent* FindDeallocation(const AllocationTrace& trace,
+                                             uint64_t object) {
+  for (const AllocationTraceEvent& e : trace.events) {
+    if (e.op == AllocationTraceEvent::kDeallocate && e.object == object) {
+      return &e;
+    }
+  }
+  return nullptr;
+}
+
+AllocationTrace RecordTrace() {
+  AllocationTraceRecorder recorder(/*max_threads=*/64,
+                                   /*events_per_thread=*/4096);
+  void* plain = ::operator new(kPlainSize);
+  void* aligned = ::operator new(kAlignedSize, std::align_val_t{256});
+  void* cold =
+      __size_returning_new_hot_cold(kColdSize, hot_cold_t{0}).p;
+  // Freed by another thread than the one that allocated it.
+  std::thread t([&] { ::operator delete(plain); });
+  t.join();
+  ::operator delete(aligned, std::align_val_t{256});
+  // Left live at the end of the trace.
+  AllocationTrace trace = recorder.Finish();
+  ::operator delete(cold);
+  EXPECT_EQ(recorder.dropped_events(), 0);
+  return trace;
+}
+
+TEST(AllocationTraceTest, Records) {
+  const AllocationTrace trace = RecordTrace();
+  EXPECT_GE(trace.num_threads, 2);
+
+  const AllocationTraceEvent* plain = FindAllocation(trace, kPlainSize);
+  const AllocationTraceEvent* aligned = FindAllocation(trace, kAlignedSize);
+  const AllocationTraceEvent* cold = FindAllocation(trace, kColdSize);
+  ASSERT_NE(plain, nullptr);
+  ASSERT_NE(aligned, nullptr);
+  ASSERT_NE(cold, nullptr);
+  EXPECT_EQ(plain->log2_alignment, 0);
+  EXPECT_EQ(plain->hot_cold, 255);
+  EXPECT_EQ(aligned->log2_alignment, 8);
+  EXPECT_EQ(cold->hot_cold, 0);
+
+  const AllocationTraceEvent* plain_free = FindDeallocation(trace, plain->object);
+  ASSERT_NE(plain_free, nullptr);
+  EXPECT_NE(plain_free->thread, plain->thread);
+  EXPECT_GT(plain_free, plain);
+  const AllocationTraceEvent* aligned_free =
+      FindDeallocation(trace, aligned->object);
+  ASSERT_NE(aligned_free, nullptr);
+  EXPECT_EQ(aligned_free->thread, aligned->thread);
+  EXPECT_EQ(FindDeallocation(trace, cold->object), nullptr);
+
+  for (const AllocationTraceEvent& e : trace.events) {
+    EXPECT_LT(e.thread, trace.num_threads);
+    EXPECT_LT(e.object, trace.num_objects);
+  }
+}
+
+TEST(AllocationTraceTest, RoundTrip) {
+  const AllocationTrace trace = RecordTrace();
+  const std::string path =
+      absl::StrCat(testing::TempDir(), "/allocation_trace");
+  ASSERT_TRUE(trace.WriteToFile(path).ok());
+
+  absl::StatusOr<AllocationTrace> read = AllocationTrace::ReadFromFile(path);
+  ASSERT_TRUE(read.ok()) << read.status();
+  EXPECT_EQ(read->num_threads, trace.num_threads);
+  EXPECT_EQ(read->num_objects, trace.num_objects);
+  ASSERT_EQ(read->events.size(), trace.events.size());
+  for (size_t i = 0; i < trace.events.size(); ++i) {
+    EXPECT_EQ(read->events[i].object, trace.events[i].object);
+    EXPECT_EQ(read->events[i].size, trace.events[i].size);
+    EXPECT_EQ(read->events[i].thread, trace.events[i].thread);
+    EXPECT_EQ(read->events[i].op, trace.events[i].op);
+    EXPECT_EQ(read->events[i].log2_alignment, trace.events[i].log2_alignment);
+    EXPECT_EQ(read->events[i].hot_cold, trace.events[i].hot_cold);
+  }
+
+  EXPECT_EQ(AllocationTrace::ReadFromFile(
+                absl::StrCat(testing::TempDir(), "/missing"))
+                .status()
+                .code(),
+            absl::StatusCode::kNotFound);
+}
+
+TEST(AllocationTraceTest, Replay) {
+  // Many objects across threads, half of them freed by the next thread.
+  constexpr int kThreads = 4;
+  constexpr int kObjects = 1000;
+  AllocationTrace trace;
+  trace.num_threads = kThreads;
+  for (int i = 0; i < kObjects; ++i) {
+    const uint32_t thread = i % kThreads;
+    AllocationTraceEvent alloc = {};
+    alloc.object = trace.num_objects++;
+    alloc.size = 8 + i;
+    alloc.thread = thread;
+    alloc.op = AllocationTraceEvent::kAllocate;
+    alloc.log2_alignment = i % 3 == 0 ? 6 : 0;
+    alloc.hot_cold = i % 5 == 0 ? 0 : 255;
+    trace.events.push_back(alloc);
+    if (i % 2 == 0) {
+      AllocationTraceEvent free = alloc;
+      free.size = 0;
+      free.thread = (thread + 1) % kThreads;
+      free.op = AllocationTraceEvent::kDeallocate;
+      trace.events.push_back(free);
+    }
+  }
+
+  const size_t before =
+      *MallocExtension::GetNumericProperty("generic.current_allocated_bytes");
+  {
+    AllocationTraceReplayer replayer(trace);
+    replayer.Run();
+    const size_t during = *MallocExtension::GetNumericProperty(
+        "generic.current_allocated_bytes");
+    // The odd objects are still live.
+    EXPECT_GE(during + (1 << 20), before + kObjects / 2 * (8 + kObjects / 2));
+  }
+}
+
+}  // namespace
+}  // namespace tcmalloc_testing
+}  // namespace tcmalloc
@@ -13,9 +13,14 @@
 // limitations under the License.
 
 #include <stddef.h>
+#include <string.h>
 #include <sys/types.h>
 
+#include <new>
+#include <optional>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "absl/time/clock.h"
@@ -64,6 +69,92 @@ TEST(BackgroundTest, Stress) {
   background.join();
 }
 
+TEST(BackgroundTest, ReleaseWorkers) {
+  constexpr absl::Duration kSleepTime = absl::Milliseconds(10);
+  ScopedBackgroundProcessSleepInterval sleep_time(kSleepTime);
+  ScopedBackgroundReleaseRate release_rate(
+      MallocExtension::BytesPerSecond{size_t{1} << 30});
+
+  std::optional<size_t> unmapped_before =
+      MallocExtension::GetNumericProperty("tcmalloc.pageheap_unmapped_bytes");
+  ASSERT_TRUE(unmapped_before.has_value());
+
+  // Leave free pages for the workers to release.
+  constexpr size_t kBytes = size_t{64} << 20;
+  constexpr size_t kChunk = size_t{1} << 20;
+  std::vector<void*> ptrs;
+  for (size_t i = 0; i < kBytes / kChunk; ++i) {
+    void* ptr = ::operator new(kChunk);
+    memset(ptr, 1, kChunk);
+    ptrs.push_back(ptr);
+  }
+  for (void* ptr : ptrs) {
+    ::operator delete(ptr);
+  }
+
+  std::thread background(MallocExtension::ProcessBackgroundActions);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < 2; ++i) {
+    workers.emplace_back(MallocExtension::ProcessBackgroundReleaseWorker);
+  }
+
+  // The background thread releases by itself until the workers start.
+  const absl::Time deadline = absl::Now() + absl::Seconds(10);
+  bool workers_running = false;
+  size_t unmapped = *unmapped_before;
+  while ((!workers_running || unmapped < *unmapped_before + kBytes / 2) &&
+         absl::Now() < deadline) {
+    absl::SleepFor(kSleepTime);
+    workers_running =
+        MallocExtension::GetStats().find(
+            "Background release workers: 2 running") != std::string::npos;
+    unmapped = *MallocExtension::GetNumericProperty(
+        "tcmalloc.pageheap_unmapped_bytes");
+  }
+  EXPECT_TRUE(workers_running);
+  EXPECT_GE(unmapped, *unmapped_before + kBytes / 2);
+
+  {
+    ScopedBackgroundProcessActionsEnabled background_process_enabled(
+        /*value=*/false);
+    background.join();
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+}
+
+TEST(BackgroundTest, RunBackgroundStep) {
+  constexpr absl::Duration kSleepTime = absl::Milliseconds(10);
+  ScopedBackgroundProcessSleepInterval sleep_time(kSleepTime);
+  ScopedBackgroundReleaseRate release_rate(
+      MallocExtension::BytesPerSecond{size_t{1} << 30});
+
+  // Leave free pages for the steps to release.
+  constexpr size_t kBytes = size_t{16} << 20;
+  void* ptr = ::operator new(kBytes);
+  memset(ptr, 1, kBytes);
+  ::operator delete(ptr);
+
+  for (int i = 0; i < 20; ++i) {
+    const absl::Time start = absl::Now();
+    // Give optional actions no budget; the step must still return promptly
+    // with a wake time in the future.
+    const absl::Time next_wake =
+        MallocExtension::RunBackgroundStep(absl::ZeroDuration());
+    EXPECT_GT(next_wake, start);
+    EXPECT_LE(next_wake, absl::Now() + kSleepTime);
+    absl::SleepFor(next_wake - absl::Now());
+  }
+
+  for (int i = 0; i < 5; ++i) {
+    const absl::Time next_wake =
+        MallocExtension::RunBackgroundStep(absl::InfiniteDuration());
+    EXPECT_GT(next_wake, absl::Now() - kSleepTime);
+    absl::SleepFor(next_wake - absl::Now());
+  }
+}
+
 }  // namespace
 }  // namespace tcmalloc
 
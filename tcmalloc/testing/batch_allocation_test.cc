@@ -0,0 +1,81 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Test AllocateBatch() / DeallocateBatch() functionality
+
+#include <stddef.h>
+#include <string.h>
+
+#include <new>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/container/flat_hash_set.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+class BatchAllocationTest : public testing::TestWithParam<size_t> {};
+
+TEST_P(BatchAllocationTest, AllocateAndFree) {
+  const size_t size = GetParam();
+  for (size_t n : {1, 2, 31, 32, 33, 100, 1000}) {
+    SCOPED_TRACE(n);
+    std::vector<void*> ptrs(n);
+    ASSERT_EQ(AllocateBatch(size, ptrs.data(), n), n);
+
+    absl::flat_hash_set<void*> seen;
+    for (void* ptr : ptrs) {
+      ASSERT_NE(ptr, nullptr);
+      EXPECT_TRUE(seen.insert(ptr).second);
+      EXPECT_GE(MallocExtension::GetAllocatedSize(ptr).value_or(size), size);
+      memset(ptr, 0xab, size);
+    }
+
+    DeallocateBatch(ptrs.data(), n, size);
+  }
+}
+
+TEST_P(BatchAllocationTest, MixedWithSingleObjects) {
+  const size_t size = GetParam();
+  constexpr size_t kBatch = 64;
+  void* ptrs[kBatch];
+
+  // Objects from AllocateBatch may be freed individually, and objects from
+  // operator new may be freed in a batch.
+  ASSERT_EQ(AllocateBatch(size, ptrs, kBatch), kBatch);
+  for (void* ptr : ptrs) {
+    ::operator delete(ptr, size);
+  }
+
+  for (void*& ptr : ptrs) {
+    ptr = ::operator new(size);
+  }
+  // Null entries are ignored.
+  ptrs[kBatch / 2] = nullptr;
+  DeallocateBatch(ptrs, kBatch, size);
+}
+
+INSTANTIATE_TEST_SUITE_P(Sizes, BatchAllocationTest,
+                         testing::Values(0, 8, 17, 64, 1024, 4096, 100000,
+                                         1 << 20));
+
+TEST(BatchAllocationTest, Empty) {
+  EXPECT_EQ(AllocateBatch(16, nullptr, 0), 0);
+  DeallocateBatch(nullptr, 0, 16);
+}
+
+}  // namespace
+}  // namespace tcmalloc
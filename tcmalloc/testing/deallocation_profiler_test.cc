@@ -32,6 +32,7 @@
 #include "absl/strings/match.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "tcmalloc/internal/sysinfo.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/testing/testutil.h"
 
@@ -660,6 +661,68 @@ TEST(LifetimeProfiler, RecordLiveAllocations) {
   EXPECT_GE(sample_lifetime, kDuration);
 }
 
+// Deallocations are buffered per shard of CPUs.  Test that they are matched
+// with allocations buffered on another shard, whichever is matched first.
+TEST(LifetimeProfiler, MatchAcrossCpus) {
+  if (CheckerIsActive()) {
+    return;
+  }
+  if (tcmalloc::tcmalloc_internal::NumCPUs() < 2) {
+    GTEST_SKIP() << "needs two CPUs";
+  }
+
+  // Avoid unsample-related behavior
+  tcmalloc::ScopedProfileSamplingInterval test_sample_interval(1);
+  constexpr int64_t kMallocSize = 64 * 1024;
+  // More than fit in a shard's buffer, so that some deallocations are matched
+  // while their allocations are still buffered.
+  constexpr int kNumAllocations = 100;
+
+  auto token = tcmalloc::MallocExtension::StartLifetimeProfiling();
+  std::vector<void*> ptrs;
+  {
+    tcmalloc::ScopedFakeCpuId fake_cpu(0);
+    for (int i = 0; i < kNumAllocations; ++i) {
+      ptrs.push_back(SingleAlloc(2, kMallocSize));
+    }
+  }
+  {
+    tcmalloc::ScopedFakeCpuId fake_cpu(1);
+    for (void* ptr : ptrs) {
+      SingleDealloc(2, ptr);
+    }
+  }
+  const tcmalloc::Profile profile = std::move(token).Stop();
+
+  int64_t alloc_count = 0;
+  int64_t dealloc_count = 0;
+  profile.Iterate([&](const tcmalloc::Profile::Sample& sample) {
+    bool found_test_alloc = false;
+    for (int i = 0; i < sample.depth; i++) {
+      const int kMaxFunctionNameLength = 1024;
+      char str[kMaxFunctionNameLength];
+      absl::Symbolize(sample.stack[i], str, kMaxFunctionNameLength);
+      if (absl::StrContains(str, "SingleAlloc") ||
+          absl::StrContains(str, "SingleDealloc")) {
+        found_test_alloc = true;
+      }
+    }
+    if (!found_test_alloc) {
+      return;
+    }
+
+    EXPECT_FALSE(sample.is_censored);
+    if (sample.count > 0) {
+      alloc_count += sample.count;
+    } else {
+      dealloc_count -= sample.count;
+    }
+  });
+
+  EXPECT_EQ(alloc_count, kNumAllocations);
+  EXPECT_EQ(dealloc_count, kNumAllocations);
+}
+
 TEST(LifetimeProfiler, RecordCensoredAllocations) {
   if (CheckerIsActive()) {
     return;
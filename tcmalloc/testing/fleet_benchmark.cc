@@ -0,0 +1,331 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Macro benchmark of a server-like workload, to judge changes to the caches
+// and the page heap on throughput and memory together.
+//
+// Each benchmark thread serves "requests".  A request allocates a burst of
+// objects drawn from a size distribution that is heavy on small objects with a
+// long tail, and frees most of them when it ends.  A few objects outlive the
+// request in a per-thread cache with random eviction, and a few are handed to
+// another thread to free.  Every so often a thread serves a request from a
+// short-lived thread instead, to churn thread-local state.  Background actions
+// run throughout, as they would in a long-running server.
+//
+// Besides items_per_second (allocations plus deallocations), reports the peak
+// physical memory used during the run, the fraction of resident anonymous
+// memory backed by hugepages at the end, and where TCMalloc held memory at
+// the end, as in the summary of MallocExtension::GetStats().
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <new>
+#include <optional>
+#include <random>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "absl/random/random.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/internal/affinity.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+struct SizeBucket {
+  size_t min;
+  size_t max;
+  double weight;
+};
+
+// Roughly the shape of allocation counts by size seen across a fleet: most
+// allocations are small, but the bytes are dominated by the tail.
+constexpr SizeBucket kSizeBuckets[] = {
+    {1, 16, 30},           {17, 64, 30},       {65, 256, 20},
+    {257, 1024, 10},       {1025, 4096, 6},    {4097, 32768, 3},
+    {32769, 262144, 0.9},  {262145, 2 << 20, 0.1},
+};
+
+constexpr int kObjectsPerRequest = 32;
+// An object outlives its request with probability 1/kLongLivedOneIn, and is
+// freed by another thread with probability 1/kCrossThreadOneIn.
+constexpr int kLongLivedOneIn = 64;
+constexpr int kCrossThreadOneIn = 16;
+// Long-lived objects held by each thread.
+constexpr size_t kLongLivedCapacity = 4096;
+// Every kChurnRequests requests, a thread serves one from a fresh thread.
+constexpr int64_t kChurnRequests = 256;
+
+struct Object {
+  void* ptr;
+  size_t size;
+};
+
+class SizeDistribution {
+ public:
+  SizeDistribution() {
+    std::vector<double> weights;
+    for (const SizeBucket& bucket : kSizeBuckets) {
+      weights.push_back(bucket.weight);
+    }
+    bucket_ = std::discrete_distribution<int>(weights.begin(), weights.end());
+  }
+
+  size_t operator()(absl::BitGen& rng) {
+    const SizeBucket& bucket = kSizeBuckets[bucket_(rng)];
+    return absl::Uniform<size_t>(absl::IntervalClosed, rng, bucket.min,
+                                 bucket.max);
+  }
+
+ private:
+  std::discrete_distribution<int> bucket_;
+};
+
+// Objects in flight from one thread to another.
+class Mailbox {
+ public:
+  void Post(Object object) {
+    absl::MutexLock l(&mu_);
+    objects_.push_back(object);
+  }
+
+  // Frees up to `max` objects posted by any thread.  Returns the number freed.
+  int Drain(int max) {
+    std::vector<Object> taken;
+    {
+      absl::MutexLock l(&mu_);
+      const size_t n = std::min<size_t>(max, objects_.size());
+      taken.assign(objects_.end() - n, objects_.end());
+      objects_.resize(objects_.size() - n);
+    }
+    for (const Object& object : taken) {
+      ::operator delete(object.ptr, object.size);
+    }
+    return taken.size();
+  }
+
+ private:
+  absl::Mutex mu_;
+  std::vector<Object> objects_ ABSL_GUARDED_BY(mu_);
+};
+
+// Samples physical memory use until destroyed, and remembers the peak.
+class PeakMemorySampler {
+ public:
+  PeakMemorySampler()
+      : thread_([this] {
+          while (!done_.load(std::memory_order_acquire)) {
+            Sample();
+            absl::SleepFor(absl::Milliseconds(10));
+          }
+        }) {}
+
+  ~PeakMemorySampler() {
+    done_.store(true, std::memory_order_release);
+    thread_.join();
+  }
+
+  size_t peak() {
+    Sample();
+    return peak_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void Sample() {
+    const size_t physical =
+        MallocExtension::GetNumericProperty("generic.physical_memory_used")
+            .value_or(0);
+    size_t peak = peak_.load(std::memory_order_relaxed);
+    while (physical > peak &&
+           !peak_.compare_exchange_weak(peak, physical,
+                                        std::memory_order_relaxed)) {
+    }
+  }
+
+  std::atomic<bool> done_{false};
+  std::atomic<size_t> peak_{0};
+  std::thread thread_;
+};
+
+// Fraction of resident anonymous memory backed by transparent hugepages, or
+// std::nullopt if the kernel does not report it.
+std::optional<double> HugepageCoverage() {
+  FILE* f = fopen("/proc/self/smaps_rollup", "r");
+  if (f == nullptr) return std::nullopt;
+  char line[256];
+  long long anonymous = -1, anon_huge = -1;  // NOLINT(runtime/int)
+  while (fgets(line, sizeof(line), f) != nullptr) {
+    sscanf(line, "Anonymous: %lld kB", &anonymous);
+    sscanf(line, "AnonHugePages: %lld kB", &anon_huge);
+  }
+  fclose(f);
+  if (anonymous <= 0 || anon_huge < 0) return std::nullopt;
+  return static_cast<double>(anon_huge) / anonymous;
+}
+
+void StartBackgroundActions() {
+  static const bool started = [] {
+    if (!MallocExtension::NeedsProcessBackgroundActions()) return false;
+    // Run background actions more often than the default, so that even short
+    // runs see several rounds of releasing and cache resizing.
+    MallocExtension::SetBackgroundProcessSleepInterval(
+        absl::Milliseconds(100));
+    std::thread(MallocExtension::ProcessBackgroundActions).detach();
+    return true;
+  }();
+  (void)started;
+}
+
+class Worker {
+ public:
+  explicit Worker(Mailbox& mailbox) : mailbox_(mailbox) {
+    long_lived_.reserve(kLongLivedCapacity);
+  }
+
+  ~Worker() {
+    for (const Object& object : long_lived_) {
+      ::operator delete(object.ptr, object.size);
+    }
+  }
+
+  // Serves one request, and returns the number of allocations and
+  // deallocations it made.
+  int64_t Request() {
+    int64_t ops = 0;
+    Object request[kObjectsPerRequest];
+    int live = 0;
+    for (int i = 0; i < kObjectsPerRequest; ++i) {
+      const size_t size = sizes_(rng_);
+      Object object = {::operator new(size), size};
+      // Touch the object as the application would.
+      static_cast<volatile char*>(object.ptr)[0] = 1;
+      ++ops;
+      if (absl::Uniform(rng_, 0, kLongLivedOneIn) == 0) {
+        ops += KeepLongLived(object);
+      } else if (absl::Uniform(rng_, 0, kCrossThreadOneIn) == 0) {
+        mailbox_.Post(object);
+      } else {
+        request[live++] = object;
+      }
+    }
+    for (int i = 0; i < live; ++i) {
+      ::operator delete(request[i].ptr, request[i].size);
+    }
+    ops += live;
+    // Free about as many objects as this thread posted on average.
+    ops += mailbox_.Drain(kObjectsPerRequest / kCrossThreadOneIn + 1);
+    return ops;
+  }
+
+ private:
+  int64_t KeepLongLived(Object object) {
+    if (long_lived_.size() < kLongLivedCapacity) {
+      long_lived_.push_back(object);
+      return 0;
+    }
+    Object& evicted = long_lived_[absl::Uniform<size_t>(
+        rng_, 0, long_lived_.size())];
+    ::operator delete(evicted.ptr, evicted.size);
+    evicted = object;
+    return 1;
+  }
+
+  Mailbox& mailbox_;
+  absl::BitGen rng_;
+  SizeDistribution sizes_;
+  std::vector<Object> long_lived_;
+};
+
+Mailbox* mailbox;
+PeakMemorySampler* sampler;
+
+void BM_fleet(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    StartBackgroundActions();
+    mailbox = new Mailbox;
+    sampler = new PeakMemorySampler;
+  }
+
+  int64_t ops = 0;
+  {
+    // Set up once the benchmark has synchronized its threads, so that
+    // thread 0 has created the mailbox.
+    std::optional<Worker> worker;
+    int64_t requests = 0;
+    for (auto s : state) {
+      if (!worker.has_value()) worker.emplace(*mailbox);
+      if (++requests % kChurnRequests == 0) {
+        std::thread churn([&] {
+          Worker transient(*mailbox);
+          ops += transient.Request();
+        });
+        churn.join();
+      } else {
+        ops += worker->Request();
+      }
+    }
+  }
+  state.SetItemsProcessed(ops);
+
+  if (state.thread_index() == 0) {
+    // All threads have left the loop, but others may still be freeing their
+    // long-lived objects.  What is left in the mailbox is only ours to free.
+    while (mailbox->Drain(1 << 20) > 0) {
+    }
+    delete mailbox;
+    mailbox = nullptr;
+
+    state.counters["peak_physical_bytes"] = sampler->peak();
+    delete sampler;
+    sampler = nullptr;
+    if (std::optional<double> coverage = HugepageCoverage()) {
+      state.counters["hugepage_coverage"] = *coverage;
+    }
+
+    const MallocExtension::StatsSnapshot stats =
+        MallocExtension::GetStatsSnapshot();
+    state.counters["in_use_bytes"] = stats.in_use_by_app;
+    state.counters["page_heap_free_bytes"] = stats.page_heap_free;
+    state.counters["page_heap_unmapped_bytes"] = stats.page_heap_unmapped;
+    state.counters["central_cache_free_bytes"] = stats.central_cache_free;
+    state.counters["per_cpu_cache_free_bytes"] = stats.per_cpu_cache_free;
+    state.counters["transfer_cache_free_bytes"] =
+        stats.transfer_cache_free + stats.sharded_transfer_cache_free;
+    state.counters["thread_cache_free_bytes"] = stats.thread_cache_free;
+    state.counters["metadata_bytes"] = stats.metadata;
+    state.counters["physical_bytes"] = stats.physical_memory_used;
+  }
+}
+BENCHMARK(BM_fleet)
+    ->Apply([](benchmark::internal::Benchmark* b) {
+      const int cpus = tcmalloc_internal::AllowedCpus().size();
+      for (int threads = 1; threads < cpus; threads *= 2) {
+        b->Threads(threads);
+      }
+      b->Threads(std::max(cpus, 1));
+    })
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace tcmalloc
@@ -0,0 +1,175 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures what a child of a prefork server pays for the allocator state it
+// inherits.  The parent warms up its caches by allocating and freeing objects
+// of many sizes, then forks once per iteration.  The child times its first
+// "request", kMallocs mallocs and frees of the same sizes, and reports it
+// together with the growth of its Private_Dirty memory, i.e. of the pages it
+// copied from or did not share with the parent, through a pipe.  The
+// iteration time is the child's whole lifetime.
+//
+// The argument selects whether the child resets its per-CPU caches after fork
+// (see Parameters::per_cpu_caches_reset_after_fork).
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/parameter_accessors.h"
+
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+constexpr int kMallocs = 1000;
+// Objects held by the parent, so that its caches and spans are spread over
+// many pages, as a server's would be.
+constexpr int kParentObjects = 100000;
+
+struct ChildReport {
+  int64_t first_request_ns;
+  int64_t private_dirty_growth_kib;
+};
+
+int64_t MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Returns the Private_Dirty memory of this process in KiB, or -1.  Reads
+// without allocating, as the read is part of what the child measures.
+int64_t PrivateDirtyKib() {
+  const int fd = open("/proc/self/smaps_rollup", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return -1;
+  char buf[4096];
+  ssize_t len = 0;
+  ssize_t n;
+  while (len < static_cast<ssize_t>(sizeof(buf)) - 1 &&
+         (n = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0) {
+    len += n;
+  }
+  close(fd);
+  buf[len] = '\0';
+  const char* line = strstr(buf, "Private_Dirty:");
+  if (line == nullptr) return -1;
+  return strtoll(line + strlen("Private_Dirty:"), nullptr, 10);
+}
+
+void* AllocateForRequest(int i) {
+  // Cycle through small sizes from 8 bytes to 4 KiB.
+  return malloc(size_t{8} << (i % 10));
+}
+
+[[noreturn]] void RunChild(int fd) {
+  void* ptrs[kMallocs];
+  ChildReport report;
+  const int64_t dirty_before = PrivateDirtyKib();
+  const int64_t start = MonotonicNanos();
+  for (int i = 0; i < kMallocs; ++i) {
+    ptrs[i] = AllocateForRequest(i);
+    benchmark::DoNotOptimize(ptrs[i]);
+    memset(ptrs[i], 0, 8);
+  }
+  for (void* ptr : ptrs) {
+    free(ptr);
+  }
+  report.first_request_ns = MonotonicNanos() - start;
+  report.private_dirty_growth_kib = PrivateDirtyKib() - dirty_before;
+
+  const bool ok = write(fd, &report, sizeof(report)) == sizeof(report);
+  _exit(ok ? 0 : 1);
+}
+
+void BM_fork_first_request(benchmark::State& state) {
+  if (&TCMalloc_Internal_SetPerCpuCachesResetAfterFork == nullptr) {
+    state.SkipWithError("per-CPU cache reset after fork is not supported");
+    return;
+  }
+  const bool old_reset = TCMalloc_Internal_GetPerCpuCachesResetAfterFork();
+  TCMalloc_Internal_SetPerCpuCachesResetAfterFork(state.range(0) != 0);
+
+  // Keep every other object, so that the freed ones fill the caches and the
+  // kept ones pin their spans.
+  std::vector<void*> held;
+  held.reserve(kParentObjects);
+  for (int i = 0; i < 2 * kParentObjects; ++i) {
+    void* ptr = AllocateForRequest(i);
+    benchmark::DoNotOptimize(ptr);
+    if (i % 2 == 0) {
+      held.push_back(ptr);
+    } else {
+      free(ptr);
+    }
+  }
+
+  int64_t first_request_ns = 0;
+  int64_t private_dirty_growth_kib = 0;
+  for (auto _ : state) {
+    int fds[2];
+    TC_CHECK_EQ(pipe2(fds, O_CLOEXEC), 0);
+
+    const absl::Time start = absl::Now();
+    const pid_t pid = fork();
+    TC_CHECK_GE(pid, 0);
+    if (pid == 0) {
+      close(fds[0]);
+      RunChild(fds[1]);
+    }
+    close(fds[1]);
+    ChildReport report;
+    const ssize_t n = read(fds[0], &report, sizeof(report));
+    int status;
+    TC_CHECK_EQ(waitpid(pid, &status, 0), pid);
+    state.SetIterationTime(absl::ToDoubleSeconds(absl::Now() - start));
+    close(fds[0]);
+
+    if (n != sizeof(report) || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      state.SkipWithError("child did not report its first request");
+      break;
+    }
+    first_request_ns += report.first_request_ns;
+    private_dirty_growth_kib += report.private_dirty_growth_kib;
+  }
+
+  for (void* ptr : held) {
+    free(ptr);
+  }
+  TCMalloc_Internal_SetPerCpuCachesResetAfterFork(old_reset);
+
+  const double iterations = state.iterations();
+  state.counters["first_request_ns"] = first_request_ns / iterations;
+  state.counters["private_dirty_growth_kib"] =
+      private_dirty_growth_kib / iterations;
+}
+BENCHMARK(BM_fork_first_request)
+    ->ArgName("reset")
+    ->Arg(0)
+    ->Arg(1)
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace tcmalloc::tcmalloc_internal
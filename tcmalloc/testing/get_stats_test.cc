@@ -96,7 +96,13 @@ TEST_F(GetStatsTest, Pbtxt) {
   EXPECT_THAT(buf, HasSubstr(R"(gwp_asan {)"));
 
   EXPECT_THAT(buf, ContainsRegex(R"(mmap_sys_allocator: [0-9]*)"));
+  EXPECT_THAT(buf,
+              ContainsRegex(R"(mmap_sys_allocator_thp_mode: [a-z]+)"));
+  EXPECT_THAT(buf,
+              ContainsRegex(R"(mmap_sys_allocator_hugepage_advised: [0-9]+)"));
   EXPECT_THAT(buf, HasSubstr("memory_release_failures: 0"));
+  // Every process has VMAs for at least its stack and its binary.
+  EXPECT_THAT(buf, ContainsRegex(R"(vmas {\s*total: [1-9][0-9]*)"));
 
   if (MallocExtension::PerCpuCachesActive()) {
     EXPECT_THAT(buf, ContainsRegex(R"(per_cpu_cache_freelist: [1-9][0-9]*)"));
@@ -158,6 +164,16 @@ TEST_F(GetStatsTest, Pbtxt) {
     EXPECT_THAT(buf, HasSubstr("min_hot_access_hint: 1"));
   }
 
+  EXPECT_THAT(buf, ContainsRegex(R"(experiment_id: "[0-9a-f]{16}")"));
+  WalkExperiments([&](absl::string_view name, bool active) {
+    if (active) {
+      EXPECT_THAT(buf, HasSubstr(absl::StrCat("name: \"", name, "\"")));
+    }
+  });
+  EXPECT_EQ(
+      MallocExtension::GetNumericProperty("tcmalloc.experiment_id"),
+      ActiveExperimentsId());
+
   EXPECT_THAT(buf, HasSubstr("tcmalloc_enable_unfiltered_collapse: false"));
   if (MallocExtension::PerCpuCachesActive()) {
     EXPECT_THAT(buf, ContainsRegex("cpu_caches_touched: [0-9]+"));
@@ -359,6 +375,28 @@ TEST_F(GetStatsTest, Parameters) {
       old_skip_subrelease_long);
 }
 
+TEST_F(GetStatsTest, SlowPathLatency) {
+  const int32_t old_period = Parameters::slow_path_latency_sample_period();
+  Parameters::set_slow_path_latency_sample_period(1);
+
+  // Allocations this large always go to the page allocator.
+  for (int i = 0; i < 100; ++i) {
+    ::operator delete(::operator new(1 << 20));
+  }
+
+  const std::string buf = MallocExtension::GetStats();
+  const std::string pbtxt = GetStatsInPbTxt();
+  Parameters::set_slow_path_latency_sample_period(old_period);
+
+  EXPECT_THAT(buf, HasSubstr("Slow path latency: sampled 1 in 1 calls"));
+  EXPECT_THAT(buf,
+              ContainsRegex(R"(page_allocator_new +: +[1-9][0-9]* samples)"));
+  EXPECT_THAT(pbtxt, HasSubstr("tcmalloc_slow_path_latency_sample_period: 1"));
+  EXPECT_THAT(pbtxt, ContainsRegex(R"(slow_path_latency \{ sample_period: 1)"));
+  EXPECT_THAT(pbtxt,
+              ContainsRegex(R"(path: page_allocator_new samples: [1-9])"));
+}
+
 TEST_F(GetStatsTest, StackDepth) {
   GTEST_SKIP() << "Skipping";
 
@@ -75,6 +75,8 @@ TEST_P(HeapProfilingTest, GetHeapProfileWhileAllocAndDealloc) {
            ProfileType::kHeap,
            ProfileType::kFragmentation,
            ProfileType::kPeakHeap,
+           ProfileType::kRealizedFragmentation,
+           ProfileType::kLeakCandidates,
        }) {
     manager.Start(2, [&, t](int) {
       MallocExtension::SnapshotCurrent(t).Iterate(
@@ -173,6 +175,60 @@ TEST(HeapProfilingTest, AllocateDifferentSizes) {
   }
 }
 
+TEST(HeapProfilingTest, HeapDelta) {
+  if (tcmalloc_internal::kSanitizerPresent) {
+    GTEST_SKIP() << "Skipping under sanitizers";
+  }
+
+  ScopedProfileSamplingInterval s(1);
+  constexpr size_t kNumAllocations = 100;
+  constexpr size_t kRequestedSize = (1 << 18) + 3;
+
+  // A fresh cursor starts from an empty profile.
+  MallocExtension::HeapProfileCursor cursor;
+  MallocExtension::HeapProfileDelta delta =
+      MallocExtension::SnapshotHeapDelta(cursor);
+  EXPECT_TRUE(delta.removed.empty());
+
+  void* allocations[kNumAllocations];
+  for (size_t i = 0; i < kNumAllocations; i++) {
+    allocations[i] = ::operator new(kRequestedSize);
+  }
+
+  // Only the new samples are reported.
+  absl::flat_hash_set<MallocHook::AllocHandle> added;
+  delta = MallocExtension::SnapshotHeapDelta(cursor);
+  delta.added.Iterate([&](const Profile::Sample& sample) {
+    if (sample.requested_size == kRequestedSize) {
+      added.insert(sample.alloc_handle);
+    }
+  });
+  EXPECT_EQ(added.size(), kNumAllocations);
+  for (MallocHook::AllocHandle handle : delta.removed) {
+    EXPECT_FALSE(added.contains(handle));
+  }
+
+  for (size_t i = 0; i < kNumAllocations; i++) {
+    ::operator delete(allocations[i]);
+  }
+
+  // Their removal is reported once, and they are not reported as added again.
+  delta = MallocExtension::SnapshotHeapDelta(cursor);
+  delta.added.Iterate([&](const Profile::Sample& sample) {
+    EXPECT_NE(sample.requested_size, kRequestedSize);
+  });
+  size_t removed = 0;
+  for (MallocHook::AllocHandle handle : delta.removed) {
+    removed += added.contains(handle);
+  }
+  EXPECT_EQ(removed, kNumAllocations);
+
+  delta = MallocExtension::SnapshotHeapDelta(cursor);
+  for (MallocHook::AllocHandle handle : delta.removed) {
+    EXPECT_FALSE(added.contains(handle));
+  }
+}
+
 TEST(HeapProfilingTest, CheckResidency) {
   ScopedProfileSamplingInterval s(1);
   const int num_allocations = 1000;
@@ -254,14 +310,14 @@ TEST(HeapProfilingTest, CheckResidency) {
 // `MallocExtension::SnapshotCurrent()` uses `StackTraceTable` to make a copy of
 // the sampled allocations from `tc_globals.sampled_allocation_recorder()` and
 // then iterate from the `StackTraceTable`. Ideally, we would want to avoid the
-// extra copy and iterate over sampled allocations directly. However, this would
-// result in deadlocks for the test case below. If we `Iterate()` directly on
-// `tc_globals.sampled_allocation_recorder()`, we hold the per-sample lock. As
-// we add data to a hashtable that stores allocations (always sampled here), the
-// hashtable can decide to `resize()`, deallocates the same sampled allocation
-// it is iterating at, wants to get the per-sample lock and ends up with a
-// deadlock. At the current state, making copies over sampled allocations and
-// iterate over those copies would not deadlock and the test case below passes.
+// extra copy and iterate over sampled allocations directly. However, this used
+// to result in deadlocks for the test case below, when `Iterate()` held the
+// per-sample lock: as we add data to a hashtable that stores allocations
+// (always sampled here), the hashtable can decide to `resize()`, deallocates
+// the same sampled allocation it is iterating at, wants to get the per-sample
+// lock and ends up with a deadlock. `Iterate()` no longer takes locks, and
+// making copies over sampled allocations and iterating over those copies would
+// not deadlock either.
 TEST(HeapProfilingTest, AllocateWhileIterating) {
   ScopedProfileSamplingInterval s(1);
   absl::flat_hash_set<void*> set;
@@ -370,13 +426,17 @@ TEST_P(HeapAllocHandleTest, VerifyAllocHandles) {
   manager.Start(kThreads, [&](int thread_id) { harness.Run(thread_id); });
 
   // Set up some threads iterating over the sampled allocations and check if
-  // their alloc handles are present in `alloc_handles_`.
+  // their alloc handles are present in `alloc_handles_`.  Iterating does not
+  // block deallocations, so the sample may be unregistered, and its handle
+  // removed, while we look at it.
   manager.Start(2, [&](int) {
     tcmalloc_internal::tc_globals.sampled_allocation_recorder().Iterate(
         [&](const tcmalloc_internal::SampledAllocation& sampled_allocation) {
+          const AllocHandle handle =
+              sampled_allocation.sampled_stack.sampled_alloc_handle;
           absl::base_internal::SpinLockHolder h(lock_);
-          ABSL_CHECK(alloc_handles_->contains(
-              sampled_allocation.sampled_stack.sampled_alloc_handle));
+          ABSL_CHECK(alloc_handles_->contains(handle) ||
+                     sampled_allocation.dead.load());
         });
   });
 
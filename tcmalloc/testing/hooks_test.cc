@@ -598,5 +598,56 @@ TEST(TCMallocTest, MarkThreadBusy) {
   log_hooks = false;
 }
 
+TEST(TCMallocTest, PeriodicHooks) {
+  if (kSanitizerPresent) {
+    GTEST_SKIP() << "Sanitizer present.";
+  }
+
+  // Hooks run on the thread that allocates, so this only counts ours.
+  static thread_local int every_100_news = 0;
+  static thread_local int every_1000_news = 0;
+  static thread_local int every_100_deletes = 0;
+  const auto every_100_new = [](const MallocHook::NewInfo& info) {
+    TC_CHECK_NE(info.ptr, nullptr);
+    TC_CHECK_GE(info.allocated_size, info.requested_size);
+    ++every_100_news;
+  };
+  const auto every_1000_new = [](const MallocHook::NewInfo&) {
+    ++every_1000_news;
+  };
+  const auto every_100_delete = [](const MallocHook::DeleteInfo& info) {
+    TC_CHECK_NE(info.ptr, nullptr);
+    ++every_100_deletes;
+  };
+  EXPECT_FALSE(MallocHook::AddPeriodicNewHook(every_100_new, 0));
+  ASSERT_TRUE(MallocHook::AddPeriodicNewHook(every_100_new, 100));
+  ASSERT_TRUE(MallocHook::AddPeriodicNewHook(every_1000_new, 1000));
+  ASSERT_TRUE(MallocHook::AddPeriodicDeleteHook(every_100_delete, 100));
+
+  // Threads notice new hooks within PeriodicHookList::kEmptyRecheckPeriod
+  // operations.
+  constexpr int kOperations = 100000;
+  for (int i = 0; i < kOperations; ++i) {
+    void* p = ::operator new(16);
+    benchmark::DoNotOptimize(p);
+    ::operator delete(p, 16);
+  }
+
+  ASSERT_TRUE(MallocHook::RemovePeriodicNewHook(every_100_new));
+  ASSERT_TRUE(MallocHook::RemovePeriodicNewHook(every_1000_new));
+  ASSERT_TRUE(MallocHook::RemovePeriodicDeleteHook(every_100_delete));
+  EXPECT_FALSE(MallocHook::RemovePeriodicNewHook(every_100_new));
+
+  constexpr int kRecheck =
+      tcmalloc_internal::PeriodicHookList<MallocHook::NewHook>::
+          kEmptyRecheckPeriod;
+  EXPECT_GE(every_100_news, (kOperations - kRecheck) / 100);
+  EXPECT_LE(every_100_news, kOperations / 100 + 1);
+  EXPECT_GE(every_1000_news, (kOperations - kRecheck) / 1000 - 1);
+  EXPECT_LE(every_1000_news, kOperations / 1000 + 1);
+  EXPECT_GE(every_100_deletes, (kOperations - kRecheck) / 100);
+  EXPECT_LE(every_100_deletes, kOperations / 100 + 1);
+}
+
 }  // namespace
 }  // namespace tcmalloc
@@ -0,0 +1,79 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Test tcmalloc::InlineNew and tcmalloc::InlineSizedDelete.  Linked against
+// //tcmalloc itself, as the inlined fast paths require.
+
+#include "tcmalloc/inline_fast_path.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <new>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "gtest/gtest.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/testing/testutil.h"
+
+namespace tcmalloc {
+namespace {
+
+constexpr size_t kSizes[] = {0, 1, 8, 17, 64, 1000, 1024, 1025, 4096, 65536,
+                             262144, 262145, size_t{1} << 20};
+
+TEST(InlineFastPathTest, MatchesOperatorNew) {
+  for (size_t size : kSizes) {
+    void* ptr = InlineNew(size);
+    ASSERT_NE(ptr, nullptr);
+    benchmark::DoNotOptimize(memset(ptr, 0xBF, size));
+    EXPECT_EQ(MallocExtension::GetAllocatedSize(ptr), nallocx(size, 0))
+        << size;
+    InlineSizedDelete(ptr, size);
+  }
+}
+
+TEST(InlineFastPathTest, MixesWithOperatorNew) {
+  std::vector<void*> inline_ptrs, ptrs;
+  for (int i = 0; i < 1000; ++i) {
+    for (size_t size : kSizes) {
+      inline_ptrs.push_back(InlineNew(size));
+      ptrs.push_back(::operator new(size));
+    }
+  }
+  size_t i = 0;
+  for (int j = 0; j < 1000; ++j) {
+    for (size_t size : kSizes) {
+      ::operator delete(inline_ptrs[i], size);
+      InlineSizedDelete(ptrs[i], size);
+      ++i;
+    }
+  }
+}
+
+TEST(InlineFastPathTest, Sampled) {
+  ScopedAlwaysSample always_sample;
+  for (size_t size : kSizes) {
+    void* ptr = InlineNew(size);
+    ASSERT_NE(ptr, nullptr);
+    benchmark::DoNotOptimize(memset(ptr, 0xBF, size));
+    InlineSizedDelete(ptr, size);
+  }
+}
+
+TEST(InlineFastPathTest, Nullptr) { InlineSizedDelete(nullptr, 0); }
+
+}  // namespace
+}  // namespace tcmalloc
@@ -0,0 +1,127 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "gtest/gtest.h"
+#include "absl/base/attributes.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/parameter_accessors.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/testing/testutil.h"
+
+namespace tcmalloc {
+namespace {
+
+// An unusual size, so that the samples of the test are easy to find.
+constexpr size_t kSize = 12345;
+
+class ScopedLeakCandidateMinAge {
+ public:
+  explicit ScopedLeakCandidateMinAge(absl::Duration temporary_value) {
+    TCMalloc_Internal_GetLeakCandidateMinAge(&previous_);
+    TCMalloc_Internal_SetLeakCandidateMinAge(temporary_value);
+  }
+
+  ~ScopedLeakCandidateMinAge() {
+    TCMalloc_Internal_SetLeakCandidateMinAge(previous_);
+  }
+
+ private:
+  absl::Duration previous_;
+};
+
+// Allocates from a single stack.
+ABSL_ATTRIBUTE_NOINLINE void Leak(int n, std::vector<void*>& leaked) {
+  for (int i = 0; i < n; ++i) {
+    void* ptr = ::operator new(kSize);
+    benchmark::DoNotOptimize(ptr);
+    leaked.push_back(ptr);
+  }
+}
+
+// Returns the samples of the objects allocated by Leak().
+std::vector<Profile::Sample> LeakSamples() {
+  Profile profile =
+      MallocExtension::SnapshotCurrent(ProfileType::kLeakCandidates);
+  EXPECT_EQ(profile.Type(), ProfileType::kLeakCandidates);
+  EXPECT_TRUE(profile.StartTime().has_value());
+  std::vector<Profile::Sample> samples;
+  profile.Iterate([&](const Profile::Sample& sample) {
+    if (sample.requested_size == kSize) samples.push_back(sample);
+  });
+  return samples;
+}
+
+class LeakCandidateProfilingTest : public testing::Test {
+ protected:
+  void TearDown() override {
+    for (void* ptr : leaked_) {
+      ::operator delete(ptr);
+    }
+  }
+
+  std::vector<void*> leaked_;
+};
+
+TEST_F(LeakCandidateProfilingTest, GroupsOldObjectsByStack) {
+  ScopedProfileSamplingInterval s(1);
+  ScopedLeakCandidateMinAge a(absl::ZeroDuration());
+  constexpr int kObjects = 100;
+  leaked_.reserve(kObjects);
+  Leak(kObjects, leaked_);
+
+  std::vector<Profile::Sample> samples = LeakSamples();
+  ASSERT_EQ(samples.size(), 1);
+  EXPECT_GE(samples[0].count, kObjects);
+  EXPECT_GE(samples[0].sum, kObjects * kSize);
+  EXPECT_GT(samples[0].depth, 0);
+  EXPECT_LE(samples[0].allocation_time, absl::Now());
+}
+
+TEST_F(LeakCandidateProfilingTest, SkipsYoungObjects) {
+  ScopedProfileSamplingInterval s(1);
+  ScopedLeakCandidateMinAge a(absl::Hours(1));
+  Leak(100, leaked_);
+
+  EXPECT_TRUE(LeakSamples().empty());
+}
+
+TEST_F(LeakCandidateProfilingTest, GrowthRate) {
+  ScopedProfileSamplingInterval s(1);
+  ScopedLeakCandidateMinAge a(absl::ZeroDuration());
+  constexpr int kObjects = 100;
+  leaked_.reserve(2 * kObjects);
+  Leak(kObjects, leaked_);
+  ASSERT_EQ(LeakSamples().size(), 1);
+
+  absl::SleepFor(absl::Milliseconds(100));
+  Leak(kObjects, leaked_);
+  std::vector<Profile::Sample> samples = LeakSamples();
+  ASSERT_EQ(samples.size(), 1);
+  EXPECT_GT(samples[0].growth_rate, 0);
+
+  // Nothing grew since.
+  samples = LeakSamples();
+  ASSERT_EQ(samples.size(), 1);
+  EXPECT_EQ(samples[0].growth_rate, 0);
+}
+
+}  // namespace
+}  // namespace tcmalloc
@@ -0,0 +1,59 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "gtest/gtest.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+TEST(LockContentionProfilingTest, Snapshot) {
+  // Hammer the page heap from several threads so that pageheap_lock is likely,
+  // but not guaranteed, to be contended.
+  constexpr int kThreads = 8;
+  constexpr int kIterations = 2000;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back([] {
+      for (int j = 0; j < kIterations; ++j) {
+        void* ptr = ::operator new(1 << 20);
+        benchmark::DoNotOptimize(ptr);
+        ::operator delete(ptr);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  Profile profile =
+      MallocExtension::SnapshotCurrent(ProfileType::kLockContention);
+  EXPECT_EQ(profile.Type(), ProfileType::kLockContention);
+  EXPECT_TRUE(profile.StartTime().has_value());
+  profile.Iterate([](const Profile::Sample& sample) {
+    EXPECT_GT(sample.count, 0);
+    EXPECT_GE(sample.sum, 0);
+    EXPECT_GT(sample.depth, 0);
+    EXPECT_LE(sample.depth, Profile::Sample::kMaxStackDepth);
+  });
+}
+
+}  // namespace
+}  // namespace tcmalloc
@@ -44,6 +44,8 @@ TEST(MallocExtension, SnapshotCurrentIsEmpty) {
       ProfileType::kFragmentation,
       ProfileType::kPeakHeap,
       ProfileType::kAllocations,
+      ProfileType::kRealizedFragmentation,
+      ProfileType::kLeakCandidates,
   };
 
   for (auto t : types) {
@@ -17,18 +17,25 @@
 #include "tcmalloc/malloc_extension.h"
 
 #include <stddef.h>
+#include <string.h>
 
 #include <map>
 #include <optional>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/strings/match.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "tcmalloc/allocation_rate_tracker.h"
 #include "tcmalloc/cpu_cache.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/parameters.h"
 #include "tcmalloc/static_vars.h"
 #include "tcmalloc/testing/testutil.h"
 
@@ -138,6 +145,7 @@ TEST(MallocExtension, Properties) {
             "tcmalloc.cpu_free",
             "tcmalloc.current_total_thread_cache_bytes",
             "tcmalloc.desired_usage_limit_bytes",
+            "tcmalloc.experiment_id",
             "tcmalloc.external_fragmentation_bytes",
             "tcmalloc.hard_limit_hits",
             "tcmalloc.hard_usage_limit_bytes",
@@ -198,6 +206,249 @@ TEST(MallocExtension, DynamicSlabMallocMetadata) {
       testing::Field(&MallocExtension::Property::value, testing::Gt(0)));
 }
 
+TEST(MallocExtension, StatsSnapshot) {
+  if (tcmalloc_internal::kSanitizerPresent) {
+    GTEST_SKIP() << "Running under sanitizers";
+  }
+
+  const MallocExtension::StatsSnapshot before =
+      MallocExtension::GetStatsSnapshot();
+  constexpr size_t kSize = 64 << 20;
+  void* ptr = ::operator new(kSize);
+  const MallocExtension::StatsSnapshot after =
+      MallocExtension::GetStatsSnapshot();
+  ::operator delete(ptr);
+
+  EXPECT_GE(after.in_use_by_app, before.in_use_by_app + kSize / 2);
+  EXPECT_GT(after.metadata, 0);
+  EXPECT_LE(after.physical_memory_used, after.virtual_memory_used);
+  EXPECT_GE(after.physical_memory_used, after.in_use_by_app);
+
+  // The large allocation comes from the HugeCache, which holds it at least
+  // until it is freed.
+  EXPECT_GE(after.huge_cache.system, kSize);
+  EXPECT_LE(after.huge_page_filler.free, after.huge_page_filler.system);
+  EXPECT_LE(after.huge_region_set.free, after.huge_region_set.system);
+}
+
+TEST(MallocExtension, StatsInOpenMetrics) {
+  if (tcmalloc_internal::kSanitizerPresent) {
+    GTEST_SKIP() << "Running under sanitizers";
+  }
+
+  std::vector<char> buffer(1 << 20);
+  const size_t length =
+      MallocExtension::GetStatsInOpenMetrics(absl::MakeSpan(buffer));
+  ASSERT_GT(length, 0);
+  ASSERT_LT(length, buffer.size());
+  const absl::string_view metrics(buffer.data(), length);
+  EXPECT_TRUE(absl::StartsWith(metrics, "# TYPE tcmalloc_in_use_by_app_bytes"))
+      << metrics;
+  EXPECT_TRUE(absl::EndsWith(metrics, "\n# EOF\n")) << metrics;
+  EXPECT_THAT(metrics,
+              testing::HasSubstr("tcmalloc_free_bytes{tier=\"central\"}"));
+  EXPECT_THAT(metrics, testing::HasSubstr(
+                           "tcmalloc_page_heap_bytes{memory_tag=\"normal\","
+                           "numa_partition=\"0\",state=\"used\"}"));
+  EXPECT_THAT(metrics, testing::HasSubstr("tcmalloc_size_class_free_bytes{"
+                                          "size_class=\"1\""));
+
+  // A short buffer is filled with a prefix of the output, and the length of
+  // the full output is returned.
+  std::vector<char> short_buffer(64);
+  const size_t short_length =
+      MallocExtension::GetStatsInOpenMetrics(absl::MakeSpan(short_buffer));
+  EXPECT_GT(short_length, short_buffer.size());
+  EXPECT_TRUE(absl::StartsWith(metrics, short_buffer.data()));
+  EXPECT_GT(MallocExtension::GetStatsInOpenMetrics(absl::Span<char>()), 0);
+}
+
+TEST(MallocExtension, HotStats) {
+  if (tcmalloc_internal::kSanitizerPresent) {
+    GTEST_SKIP() << "Running under sanitizers";
+  }
+
+  // Reading a property publishes fresh stats.
+  ASSERT_THAT(
+      MallocExtension::GetNumericProperty("generic.current_allocated_bytes"),
+      testing::Ne(std::nullopt));
+  const MallocExtension::HotStats before = MallocExtension::GetHotStats();
+  EXPECT_GT(before.current_allocated_bytes, 0);
+  EXPECT_GT(before.heap_size, 0);
+  EXPECT_GE(before.physical_memory_used, before.current_allocated_bytes);
+  EXPECT_EQ(before.per_cpu_caches_active,
+            MallocExtension::PerCpuCachesActive());
+
+  // Large allocations are reflected without stats being gathered.
+  constexpr size_t kSize = 64 << 20;
+  void* ptr = ::operator new(kSize);
+  const MallocExtension::HotStats after = MallocExtension::GetHotStats();
+  ::operator delete(ptr);
+  EXPECT_GE(after.current_allocated_bytes,
+            before.current_allocated_bytes + kSize / 2);
+}
+
+TEST(MallocExtension, MemoryBreakdown) {
+  if (tcmalloc_internal::kSanitizerPresent) {
+    GTEST_SKIP() << "Running under sanitizers";
+  }
+
+  constexpr size_t kSize = 64 << 20;
+  void* ptr = ::operator new(kSize);
+  const MallocExtension::MemoryBreakdown breakdown =
+      MallocExtension::GetMemoryBreakdown();
+  ::operator delete(ptr);
+
+  EXPECT_EQ(breakdown.name, "tcmalloc");
+  std::vector<std::string> names;
+  uint64_t bytes = 0;
+  uint64_t reclaimable_bytes = 0;
+  for (const MallocExtension::MemoryBreakdown& child : breakdown.children) {
+    names.push_back(child.name);
+    bytes += child.bytes;
+    reclaimable_bytes += child.reclaimable_bytes;
+    EXPECT_LE(child.reclaimable_bytes, child.bytes) << child.name;
+  }
+  EXPECT_THAT(names, testing::ElementsAre("in_use_by_app", "caches",
+                                          "page_heap", "metadata"));
+  EXPECT_EQ(breakdown.bytes, bytes);
+  EXPECT_EQ(breakdown.reclaimable_bytes, reclaimable_bytes);
+  EXPECT_GE(breakdown.children[0].bytes, kSize / 2);
+
+  const MallocExtension::MemoryBreakdown& page_heap = breakdown.children[2];
+  ASSERT_FALSE(page_heap.children.empty());
+  EXPECT_EQ(page_heap.children[0].name, "normal");
+  EXPECT_EQ(page_heap.reclaimable_bytes, page_heap.bytes);
+}
+
+TEST(MallocExtension, AllocationRateHistory) {
+  if (tcmalloc_internal::kSanitizerPresent) {
+    GTEST_SKIP() << "Running under sanitizers";
+  }
+
+  ScopedBackgroundProcessActionsEnabled background(false);
+  ScopedProfileSamplingInterval sampling(1024);
+  const bool old_history = Parameters::allocation_rate_history();
+  Parameters::set_allocation_rate_history(true);
+
+  // Drive the epochs with times of our own, past any the background thread
+  // may have used, so that the last epoch covers exactly the loop below.
+  AllocationRateTracker& tracker = tc_globals.allocation_rate_tracker();
+  const absl::Time start = absl::Now() + absl::Hours(1);
+  tracker.Update(start);
+
+  constexpr size_t kSize = 64;
+  std::vector<void*> ptrs;
+  ptrs.reserve(10000);
+  for (int i = 0; i < 10000; ++i) {
+    ptrs.push_back(::operator new(kSize));
+  }
+  for (void* ptr : ptrs) {
+    ::operator delete(ptr);
+  }
+  tracker.Update(start + AllocationRateTracker::kEpochLength);
+
+  const std::vector<MallocExtension::AllocationRateEpoch> history =
+      MallocExtension::GetAllocationRateHistory();
+  Parameters::set_allocation_rate_history(old_history);
+
+  ASSERT_FALSE(history.empty());
+  EXPECT_LE(history.size(), AllocationRateTracker::kEpochs);
+  const MallocExtension::AllocationRateEpoch& epoch = history.back();
+  EXPECT_EQ(epoch.start, start);
+  EXPECT_EQ(epoch.duration, AllocationRateTracker::kEpochLength);
+
+  uint64_t allocated_objects = 0, freed_objects = 0;
+  for (const auto& size_class : epoch.size_classes) {
+    if (size_class.size != kSize || size_class.cold) continue;
+    EXPECT_EQ(size_class.allocated_bytes,
+              size_class.allocated_objects * size_class.size);
+    allocated_objects += size_class.allocated_objects;
+    freed_objects += size_class.freed_objects;
+  }
+  EXPECT_GT(allocated_objects, 0);
+  EXPECT_GT(freed_objects, 0);
+
+  // The test is not built with alloc tokens, so all of the traffic is
+  // attributed to kNoAllocToken.
+  uint64_t token_allocated_bytes = 0;
+  for (const auto& token : epoch.alloc_tokens) {
+    EXPECT_EQ(token.token_id, TokenId::kNoAllocToken);
+    token_allocated_bytes += token.allocated_bytes;
+  }
+  EXPECT_GT(token_allocated_bytes, 0);
+}
+
+TEST(MallocExtension, Defragment) {
+  constexpr size_t kSize = 1000;
+  constexpr int kObjects = 10000;
+  constexpr int kKept = 16;
+
+  // Keep one object in kKept, so most spans of the size class are sparse.
+  std::vector<void*> ptrs;
+  for (int i = 0; i < kObjects; ++i) {
+    ptrs.push_back(::operator new(kSize));
+  }
+  absl::flat_hash_map<void*, int> live;
+  for (int i = 0; i < kObjects; ++i) {
+    if (i % kKept == 0) {
+      memset(ptrs[i], i & 0xff, kSize);
+      live[ptrs[i]] = i;
+    } else {
+      ::operator delete(ptrs[i]);
+    }
+  }
+
+  const MallocExtension::DefragmentationStats stats =
+      MallocExtension::Defragment(
+          [&](void* ptr, size_t size) {
+            auto it = live.find(ptr);
+            if (it == live.end()) return false;
+            EXPECT_GE(size, kSize);
+            const int value = it->second;
+            live.erase(it);
+            void* moved = ::operator new(kSize);
+            memcpy(moved, ptr, kSize);
+            ::operator delete(ptr);
+            live[moved] = value;
+            return true;
+          },
+          size_t{1} << 30);
+  EXPECT_GT(stats.spans, 0);
+  EXPECT_GE(stats.objects_offered, stats.objects_relocated);
+  EXPECT_GE(stats.bytes_offered, stats.bytes_relocated);
+  EXPECT_GT(stats.objects_relocated, 0);
+  EXPECT_GE(stats.bytes_relocated, stats.objects_relocated * kSize);
+
+  // The contents moved with the objects.
+  EXPECT_EQ(live.size(), (kObjects + kKept - 1) / kKept);
+  for (const auto& [ptr, value] : live) {
+    EXPECT_EQ(static_cast<unsigned char*>(ptr)[0], value & 0xff);
+    EXPECT_EQ(static_cast<unsigned char*>(ptr)[kSize - 1], value & 0xff);
+    ::operator delete(ptr);
+  }
+}
+
+TEST(MallocExtension, DefragmentBudget) {
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 1000; ++i) {
+    ptrs.push_back(::operator new(100));
+  }
+  for (int i = 0; i < 1000; ++i) {
+    if (i % 8 != 0) ::operator delete(ptrs[i]);
+  }
+
+  const MallocExtension::DefragmentationStats stats =
+      MallocExtension::Defragment([](void*, size_t) { return false; }, 4096);
+  EXPECT_LE(stats.bytes_offered, 4096);
+  EXPECT_EQ(stats.objects_relocated, 0);
+  EXPECT_EQ(stats.bytes_relocated, 0);
+
+  for (int i = 0; i < 1000; i += 8) {
+    ::operator delete(ptrs[i]);
+  }
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
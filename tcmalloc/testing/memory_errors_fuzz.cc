@@ -99,7 +99,7 @@ void WildPointerSizedDelete(uintptr_t ptr, size_t size) {
   // The pointer must either be non-normal or larger than kMaxSize.  We don't
   // expect to have lightweight checks otherwise.
   if (auto tag = GetMemoryTag(absl::bit_cast<void*>(ptr));
-      (tag == MemoryTag::kNormal || tag == MemoryTag::kNormalP1) &&
+      tag != MemoryTag::kSizeClassed && IsNormalPartitionTag(tag) &&
       size <= kMaxSize) {
     return;
   }
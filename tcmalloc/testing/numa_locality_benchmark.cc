@@ -0,0 +1,170 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures where the memory TCMalloc returns actually lives.  For each NUMA
+// node, the benchmark thread pins itself to a CPU of that node, allocates a
+// batch of objects, and asks the kernel with move_pages() which node backs the
+// first page of each.  Besides throughput, it reports the percentage of
+// objects backed by the allocating CPU's node, by another node of the same
+// NUMA partition, and by a node of another partition.
+//
+// Compare the numa_aware and numa_aware_disabled variants (or 8k_pages) to see
+// what NUMA awareness buys in locality and costs in throughput.  Sampling is
+// left on, as in production, although sampled allocations are not placed
+// NUMA-locally.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <new>
+#include <optional>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/affinity.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/numa.h"
+#include "tcmalloc/internal/page_size.h"
+#include "tcmalloc/static_vars.h"
+
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+constexpr size_t kMaxBatch = 1024;
+
+// One CPU for each NUMA node we may run on, keyed by node.
+const std::map<int, int>& NodeCpus() {
+  static const std::map<int, int>* node_cpus = [] {
+    auto* node_cpus = new std::map<int, int>;
+    for (int cpu : AllowedCpus()) {
+      ScopedAffinityMask mask(cpu);
+      unsigned int node;
+      TC_CHECK_EQ(syscall(__NR_getcpu, nullptr, &node, nullptr), 0);
+      if (!mask.Tampered()) node_cpus->emplace(node, cpu);
+    }
+    return node_cpus;
+  }();
+  return *node_cpus;
+}
+
+struct Placement {
+  int64_t local = 0;
+  int64_t same_partition = 0;
+  int64_t remote = 0;
+  // Pages the kernel could not report on.
+  int64_t unknown = 0;
+};
+
+// Classifies the node backing the first page of each object relative to
+// <local_node>.
+void CountPlacement(absl::Span<void* const> objects, int local_node,
+                    Placement& placement) {
+  static const uintptr_t page_mask = ~(GetPageSize() - 1);
+  std::vector<void*> pages(objects.size());
+  std::vector<int> status(objects.size(), -1);
+  for (size_t i = 0; i < objects.size(); ++i) {
+    pages[i] = reinterpret_cast<void*>(
+        reinterpret_cast<uintptr_t>(objects[i]) & page_mask);
+  }
+  // With nodes == nullptr, move_pages() moves nothing and reports the node
+  // backing each page in status.  It fails outright on kernels without NUMA
+  // support.
+  if (syscall(__NR_move_pages, /*pid=*/0, pages.size(), pages.data(),
+              /*nodes=*/nullptr, status.data(), /*flags=*/0) != 0) {
+    placement.unknown += objects.size();
+    return;
+  }
+  for (int node : status) {
+    if (node < 0) {
+      ++placement.unknown;
+    } else if (node == local_node) {
+      ++placement.local;
+    } else if (NodeToPartition(node, kNumaPartitions) ==
+               NodeToPartition(local_node, kNumaPartitions)) {
+      ++placement.same_partition;
+    } else {
+      ++placement.remote;
+    }
+  }
+}
+
+void BM_numa_locality(benchmark::State& state) {
+  const size_t size = state.range(0);
+  const std::map<int, int>& node_cpus = NodeCpus();
+  if (node_cpus.empty()) {
+    state.SkipWithError("cannot pin to any allowed CPU");
+    return;
+  }
+
+  // Keep batches of large objects within a few hundred MiB.
+  const size_t batch = std::clamp<size_t>((256 << 20) / size, 1, kMaxBatch);
+  std::vector<void*> objects(batch);
+  Placement placement;
+  int64_t tampered = 0;
+  for (auto _ : state) {
+    for (const auto& [node, cpu] : node_cpus) {
+      state.PauseTiming();
+      std::optional<ScopedAffinityMask> mask(std::in_place, cpu);
+      state.ResumeTiming();
+
+      for (void*& object : objects) {
+        object = ::operator new(size);
+        // Back the first page with memory, as the application would.
+        memset(object, 0, 1);
+      }
+
+      state.PauseTiming();
+      if (mask->Tampered()) {
+        // We may have run on another node part way through the batch.
+        ++tampered;
+      } else {
+        CountPlacement(objects, node, placement);
+      }
+      state.ResumeTiming();
+
+      for (void* object : objects) {
+        ::operator delete(object, size);
+      }
+
+      state.PauseTiming();
+      mask.reset();
+      state.ResumeTiming();
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * node_cpus.size() * batch * 2);
+  const double total = placement.local + placement.same_partition +
+                       placement.remote + placement.unknown;
+  if (total > 0) {
+    state.counters["local_pct"] = 100 * placement.local / total;
+    state.counters["same_partition_pct"] =
+        100 * placement.same_partition / total;
+    state.counters["remote_pct"] = 100 * placement.remote / total;
+    state.counters["unknown_pct"] = 100 * placement.unknown / total;
+  }
+  state.counters["nodes"] = node_cpus.size();
+  state.counters["numa_aware"] = tc_globals.numa_topology().numa_aware();
+  state.counters["tampered_batches"] = tampered;
+}
+BENCHMARK(BM_numa_locality)->Range(8, 8 << 20);
+
+}  // namespace
+}  // namespace tcmalloc::tcmalloc_internal
@@ -230,6 +230,31 @@ TEST(NumaLocalityTest, AllocationsAreLocal) {
 #endif  // TCMALLOC_TEST_DISABLE_FAKE_NUMA_FACTORY
 }
 
+// Test that allocations naming a NUMA node are backed by memory within that
+// node's partition, whichever CPU makes them.
+TEST(NumaLocalityTest, AllocationsFollowRequestedNode) {
+  if (!tc_globals.numa_topology().numa_aware()) {
+    GTEST_SKIP() << "NUMA awareness is disabled";
+  }
+
+  ScopedNeverSample never_sample;
+
+  absl::BitGen gen;
+  const size_t num_nodes = tc_globals.numa_topology().num_nodes();
+  constexpr size_t kIterations = 1000;
+  for (size_t i = 0; i < kIterations; i++) {
+    const size_t node = absl::Uniform(gen, 0ul, num_nodes);
+    const size_t alloc_size = absl::Uniform(gen, 1ul, 5ul << 20);
+    void* ptr = ::operator new(alloc_size, static_cast<numa_node_t>(node));
+    ASSERT_NE(ptr, nullptr);
+
+    EXPECT_EQ(NodeToPartition(BackingNode(ptr), kNumaPartitions),
+              NodeToPartition(node, kNumaPartitions));
+
+    ::operator delete(ptr);
+  }
+}
+
 #ifndef TCMALLOC_TEST_DISABLE_FAKE_NUMA_FACTORY
 static void install_factory() {
   // Install fake region factory to log hints for verification.
@@ -17,10 +17,12 @@
 
 #include <optional>
 #include <utility>
+#include <vector>
 
 #include "benchmark/benchmark.h"
 #include "gtest/gtest.h"
 #include "absl/log/check.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "tcmalloc/internal/parameter_accessors.h"
 #include "tcmalloc/malloc_extension.h"
@@ -59,6 +61,68 @@ class ScopedPeakGrowthFraction {
   double previous_;
 };
 
+class ScopedPeakHeapBucketInterval {
+ public:
+  explicit ScopedPeakHeapBucketInterval(absl::Duration temporary_value) {
+    TCMalloc_Internal_GetPeakHeapBucketInterval(&previous_);
+    TCMalloc_Internal_SetPeakHeapBucketInterval(temporary_value);
+  }
+
+  ~ScopedPeakHeapBucketInterval() {
+    TCMalloc_Internal_SetPeakHeapBucketInterval(previous_);
+  }
+
+ private:
+  absl::Duration previous_;
+};
+
+int64_t ProfileSize(const Profile& profile) {
+  int64_t total = 0;
+  profile.Iterate([&](const Profile::Sample& e) { total += e.sum; });
+  return total;
+}
+
+TEST(PeakHeapProfilingTest, BucketedPeaks) {
+  ScopedPeakGrowthFraction s(1.25);
+  ScopedPeakHeapBucketInterval b(absl::Hours(1));
+  const absl::Time start = absl::Now();
+
+  // Climb to a first peak, then drop far enough below it to close it.
+  void* first = ::operator new(100 << 20);
+  benchmark::DoNotOptimize(first);
+  ::operator delete(first);
+  void* small = ::operator new(10 << 20);
+  benchmark::DoNotOptimize(small);
+
+  // A second, lower peak.
+  void* second = ::operator new(50 << 20);
+  benchmark::DoNotOptimize(second);
+
+  const absl::Time end = absl::Now() + absl::Seconds(1);
+  std::vector<Profile> peaks = MallocExtension::SnapshotPeakHeaps(start, end);
+  ::operator delete(small);
+  ::operator delete(second);
+
+  // Both peaks are in the window even if they straddle a bucket boundary.
+  ASSERT_GE(peaks.size(), 2);
+  const int64_t first_size = ProfileSize(peaks[0]);
+  const int64_t second_size = ProfileSize(peaks[1]);
+  EXPECT_GE(first_size, 100 << 20);
+  EXPECT_GE(second_size, 60 << 20);
+  EXPECT_LT(second_size, first_size);
+  for (const Profile& peak : peaks) {
+    EXPECT_EQ(peak.Type(), ProfileType::kPeakHeap);
+    ASSERT_TRUE(peak.StartTime().has_value());
+    EXPECT_GE(*peak.StartTime(), start);
+    EXPECT_LT(*peak.StartTime(), end);
+  }
+
+  // Nothing was saved outside of the window.
+  EXPECT_TRUE(
+      MallocExtension::SnapshotPeakHeaps(start - absl::Hours(2), start)
+          .empty());
+}
+
 // NOTE: This test depends on being able to change the peak heap allocation.
 // If you allocate a lot of memory before running it, it won't work! Thus it is
 // in its own file.
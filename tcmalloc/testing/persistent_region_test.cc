@@ -0,0 +1,168 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Test tcmalloc::PersistentRegion functionality
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+using ::testing::HasSubstr;
+
+constexpr size_t kRegionSize = 16 << 20;
+
+struct Node {
+  Node* next;
+  int value;
+};
+
+class PersistentRegionTest : public testing::Test {
+ protected:
+  PersistentRegionTest()
+      : path_(absl::StrCat(testing::TempDir(), "/persistent_region_",
+                           getpid())) {
+    // Find an address range that is free, and leave it free for Attach().
+    void* p = mmap(nullptr, kRegionSize, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    EXPECT_NE(p, MAP_FAILED);
+    munmap(p, kRegionSize);
+    address_ = p;
+  }
+
+  ~PersistentRegionTest() override { unlink(path_.c_str()); }
+
+  std::string path_;
+  void* address_;
+};
+
+TEST_F(PersistentRegionTest, ObjectsSurviveReattach) {
+  {
+    PersistentRegion region;
+    ASSERT_EQ(region.Attach(path_.c_str(), address_, kRegionSize),
+              PersistentRegion::AttachResult::kCreated);
+    EXPECT_EQ(region.root(), nullptr);
+
+    Node* head = nullptr;
+    for (int i = 0; i < 100; ++i) {
+      auto* node =
+          static_cast<Node*>(region.Allocate(sizeof(Node), alignof(Node)));
+      ASSERT_NE(node, nullptr);
+      *node = {head, i};
+      head = node;
+    }
+    region.set_root(head);
+  }
+
+  PersistentRegion region;
+  ASSERT_EQ(region.Attach(path_.c_str(), address_, kRegionSize),
+            PersistentRegion::AttachResult::kReattached);
+  int expected = 99;
+  for (auto* node = static_cast<Node*>(region.root()); node != nullptr;
+       node = node->next) {
+    EXPECT_EQ(node->value, expected);
+    --expected;
+  }
+  EXPECT_EQ(expected, -1);
+}
+
+TEST_F(PersistentRegionTest, DeallocatedObjectsAreReused) {
+  PersistentRegion region;
+  ASSERT_NE(region.Attach(path_.c_str(), address_, kRegionSize),
+            PersistentRegion::AttachResult::kFailed);
+  for (size_t size : {1, 16, 100, 4096, 100000}) {
+    void* p = region.Allocate(size);
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignof(std::max_align_t), 0);
+    memset(p, 0xab, size);
+    region.Deallocate(p, size);
+    EXPECT_EQ(region.Allocate(size), p);
+    region.Deallocate(p, size);
+  }
+}
+
+TEST_F(PersistentRegionTest, Alignment) {
+  PersistentRegion region;
+  ASSERT_NE(region.Attach(path_.c_str(), address_, kRegionSize),
+            PersistentRegion::AttachResult::kFailed);
+  for (size_t alignment = 1; alignment <= 4096; alignment *= 2) {
+    void* p = region.Allocate(8, alignment);
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignment, 0);
+  }
+}
+
+TEST_F(PersistentRegionTest, FullRegion) {
+  PersistentRegion region;
+  ASSERT_NE(region.Attach(path_.c_str(), address_, kRegionSize),
+            PersistentRegion::AttachResult::kFailed);
+  EXPECT_EQ(region.Allocate(kRegionSize), nullptr);
+  EXPECT_NE(region.Allocate(kRegionSize / 4), nullptr);
+}
+
+TEST_F(PersistentRegionTest, MismatchedAddressReinitializes) {
+  {
+    PersistentRegion region;
+    ASSERT_EQ(region.Attach(path_.c_str(), address_, kRegionSize),
+              PersistentRegion::AttachResult::kCreated);
+    region.set_root(region.Allocate(64));
+  }
+
+  // Pointers in the region would be wrong at any other address.
+  PersistentRegion region;
+  ASSERT_EQ(region.Attach(path_.c_str(), address_, kRegionSize / 2),
+            PersistentRegion::AttachResult::kCreated);
+  EXPECT_EQ(region.root(), nullptr);
+}
+
+TEST_F(PersistentRegionTest, AttachFailures) {
+  PersistentRegion region;
+  ASSERT_NE(region.Attach(path_.c_str(), address_, kRegionSize),
+            PersistentRegion::AttachResult::kFailed);
+
+  // The file is attached already.
+  PersistentRegion other;
+  void* elsewhere = static_cast<char*>(address_) + kRegionSize / 2;
+  EXPECT_EQ(other.Attach(path_.c_str(), elsewhere, kRegionSize / 2),
+            PersistentRegion::AttachResult::kFailed);
+  EXPECT_FALSE(other.attached());
+
+  // The address range is in use.
+  const std::string path2 = absl::StrCat(path_, "_2");
+  EXPECT_EQ(other.Attach(path2.c_str(), address_, kRegionSize),
+            PersistentRegion::AttachResult::kFailed);
+  unlink(path2.c_str());
+}
+
+TEST_F(PersistentRegionTest, Stats) {
+  PersistentRegion region;
+  ASSERT_NE(region.Attach(path_.c_str(), address_, kRegionSize),
+            PersistentRegion::AttachResult::kFailed);
+  EXPECT_THAT(MallocExtension::GetStats(),
+              HasSubstr("Persistent regions: 1 attached"));
+}
+
+}  // namespace
+}  // namespace tcmalloc
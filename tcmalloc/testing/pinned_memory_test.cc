@@ -0,0 +1,87 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+using PinnedRanges = std::vector<std::pair<uintptr_t, uintptr_t>>;
+
+void RecordRange(void* arg, void* start, size_t length) {
+  auto* ranges = static_cast<PinnedRanges*>(arg);
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(start);
+  ranges->push_back({begin, begin + length});
+}
+
+bool Covered(const PinnedRanges& ranges, void* ptr, size_t size) {
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(ptr);
+  for (const auto& [start, end] : ranges) {
+    if (start <= begin && begin + size <= end) return true;
+  }
+  return false;
+}
+
+TEST(PinnedMemoryTest, RejectsBadSizes) {
+  EXPECT_EQ(MallocExtension::AllocatePinned(0), nullptr);
+  EXPECT_EQ(MallocExtension::AllocatePinned(size_t{2} << 30), nullptr);
+}
+
+TEST(PinnedMemoryTest, AllocateAndFree) {
+  constexpr size_t kSize = 64 << 10;
+  void* ptr = MallocExtension::AllocatePinned(kSize);
+  if (ptr == nullptr) {
+    GTEST_SKIP() << "mlock() failed, RLIMIT_MEMLOCK may be too low";
+  }
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % 4096, 0);
+  memset(ptr, 0xab, kSize);
+
+  void* other = MallocExtension::AllocatePinned(kSize);
+  ASSERT_NE(other, nullptr);
+  EXPECT_NE(other, ptr);
+  MallocExtension::FreePinned(other, kSize);
+  MallocExtension::FreePinned(ptr, kSize);
+}
+
+TEST(PinnedMemoryTest, CallbackCoversBuffers) {
+  constexpr size_t kSize = 3 << 20;
+  PinnedRanges ranges;
+  MallocExtension::SetPinnedMemoryCallback(RecordRange, &ranges);
+  void* ptr = MallocExtension::AllocatePinned(kSize);
+  if (ptr == nullptr) {
+    MallocExtension::SetPinnedMemoryCallback(nullptr, nullptr);
+    GTEST_SKIP() << "mlock() failed, RLIMIT_MEMLOCK may be too low";
+  }
+  EXPECT_TRUE(Covered(ranges, ptr, kSize));
+
+  // A new callback is told of the memory pinned so far.
+  PinnedRanges replayed;
+  MallocExtension::SetPinnedMemoryCallback(RecordRange, &replayed);
+  EXPECT_TRUE(Covered(replayed, ptr, kSize));
+
+  MallocExtension::SetPinnedMemoryCallback(nullptr, nullptr);
+  MallocExtension::FreePinned(ptr, kSize);
+}
+
+}  // namespace
+}  // namespace tcmalloc
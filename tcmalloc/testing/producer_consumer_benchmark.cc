@@ -0,0 +1,310 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks objects allocated on one set of threads and freed on another.
+//
+// Every object crosses from the per-CPU cache of a producer to the one of a
+// consumer, so that steady state exercises the per-CPU cache overflow and
+// underflow paths, the transfer caches and the central freelists, rather than
+// the per-CPU fast path covered by tcmalloc_benchmark.  Threads are pinned so
+// that producers and consumers share an L3 cache, sit on different L3 caches of
+// the same socket, or on different sockets.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <new>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/base/internal/cycleclock.h"
+#include "absl/base/optimization.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/internal/affinity.h"
+
+namespace tcmalloc {
+namespace {
+
+using tcmalloc_internal::AllowedCpus;
+using tcmalloc_internal::ScopedAffinityMask;
+
+enum Placement : int64_t {
+  kSameL3 = 0,
+  kCrossL3 = 1,
+  kCrossSocket = 2,
+};
+
+// Reads a single integer from a sysfs file, or returns std::nullopt.
+std::optional<int> ReadSysfsInt(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (f == nullptr) return std::nullopt;
+  int v;
+  const bool ok = fscanf(f, "%d", &v) == 1;
+  fclose(f);
+  if (!ok) return std::nullopt;
+  return v;
+}
+
+// Allowed cpus grouped by (socket, L3 cache).  Cpus whose L3 cache is unknown
+// are treated as sharing one L3 cache per socket.
+std::map<std::pair<int, int>, std::vector<int>> CpuGroups() {
+  std::map<std::pair<int, int>, std::vector<int>> groups;
+  char path[128];
+  for (int cpu : AllowedCpus()) {
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    const int socket = ReadSysfsInt(path).value_or(0);
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cache/index3/id", cpu);
+    const int l3 = ReadSysfsInt(path).value_or(-1);
+    groups[{socket, l3}].push_back(cpu);
+  }
+  return groups;
+}
+
+struct CpuAssignment {
+  std::vector<int> producers;
+  std::vector<int> consumers;
+};
+
+// Picks distinct cpus for the producers and the consumers, or returns
+// std::nullopt if the machine (or our affinity mask) does not allow the
+// requested placement.
+std::optional<CpuAssignment> AssignCpus(int producers, int consumers,
+                                        Placement placement) {
+  const auto groups = CpuGroups();
+  for (const auto& [p_key, p_cpus] : groups) {
+    if (placement == kSameL3) {
+      if (p_cpus.size() < static_cast<size_t>(producers + consumers)) continue;
+      return CpuAssignment{
+          {p_cpus.begin(), p_cpus.begin() + producers},
+          {p_cpus.begin() + producers,
+           p_cpus.begin() + producers + consumers}};
+    }
+    if (p_cpus.size() < static_cast<size_t>(producers)) continue;
+    for (const auto& [c_key, c_cpus] : groups) {
+      if (c_key == p_key || c_cpus.size() < static_cast<size_t>(consumers)) {
+        continue;
+      }
+      const bool same_socket = c_key.first == p_key.first;
+      if (same_socket != (placement == kCrossL3)) continue;
+      return CpuAssignment{{p_cpus.begin(), p_cpus.begin() + producers},
+                           {c_cpus.begin(), c_cpus.begin() + consumers}};
+    }
+  }
+  return std::nullopt;
+}
+
+// Single-producer single-consumer ring of pointers, one per producer/consumer
+// pair so that the hand-off itself does not become the bottleneck.
+class PointerRing {
+ public:
+  static constexpr size_t kCapacity = 1024;
+
+  bool Push(void* ptr) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == kCapacity) {
+      return false;
+    }
+    slots_[tail % kCapacity] = ptr;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  void* Pop() {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    void* ptr = slots_[head % kCapacity];
+    head_.store(head + 1, std::memory_order_release);
+    return ptr;
+  }
+
+ private:
+  std::array<void*, kCapacity> slots_;
+  alignas(ABSL_CACHELINE_SIZE) std::atomic<size_t> head_{0};
+  alignas(ABSL_CACHELINE_SIZE) std::atomic<size_t> tail_{0};
+};
+
+// Histogram of per-operation cycle counts with kBucketCycles resolution.
+// Samples past the last bucket are clamped into it.
+class CycleHistogram {
+ public:
+  static constexpr int64_t kBucketCycles = 8;
+  static constexpr size_t kNumBuckets = 4096;
+
+  void Record(int64_t cycles) {
+    const size_t bucket = std::min<size_t>(
+        std::max<int64_t>(cycles, 0) / kBucketCycles, kNumBuckets - 1);
+    ++buckets_[bucket];
+    ++count_;
+  }
+
+  void Merge(const CycleHistogram& other) {
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+  }
+
+  // Returns the upper bound, in cycles, of the bucket holding the given
+  // percentile.
+  double Percentile(double percentile) const {
+    if (count_ == 0) return 0;
+    const uint64_t rank = static_cast<uint64_t>(count_ * percentile / 100.);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      seen += buckets_[i];
+      if (seen > rank) return (i + 1) * kBucketCycles;
+    }
+    return kNumBuckets * kBucketCycles;
+  }
+
+ private:
+  std::array<uint64_t, kNumBuckets> buckets_ = {};
+  uint64_t count_ = 0;
+};
+
+inline void Pause() {
+#if defined(__x86_64__)
+  __builtin_ia32_pause();
+#else
+  std::this_thread::yield();
+#endif
+}
+
+// Args: number of producers, number of consumers, Placement, object size.
+//
+// In each iteration, every producer allocates kObjectsPerProducer objects and
+// hands them out round-robin to the consumers, which free them.  Reports the
+// pipeline throughput and the p50/p99 cycles spent in operator new on the
+// producers and in operator delete on the consumers.
+void BM_producer_consumer(benchmark::State& state) {
+  const int num_producers = state.range(0);
+  const int num_consumers = state.range(1);
+  const Placement placement = static_cast<Placement>(state.range(2));
+  const size_t size = state.range(3);
+
+  const std::optional<CpuAssignment> cpus =
+      AssignCpus(num_producers, num_consumers, placement);
+  if (!cpus.has_value()) {
+    state.SkipWithError("not enough cpus for the requested placement");
+    return;
+  }
+
+  // Round down so that each consumer gets the same number of objects from
+  // each producer.
+  constexpr int kObjectsPerProducer = 1 << 14;
+  const int per_producer =
+      kObjectsPerProducer / num_consumers * num_consumers;
+  const int per_consumer = per_producer / num_consumers * num_producers;
+
+  // rings[p * num_consumers + c] carries objects from producer p to consumer c.
+  auto rings = std::make_unique<PointerRing[]>(num_producers * num_consumers);
+  std::vector<CycleHistogram> new_cycles(num_producers);
+  std::vector<CycleHistogram> delete_cycles(num_consumers);
+
+  for (auto s : state) {
+    std::atomic<bool> start{false};
+    std::atomic<int> ready{0};
+    std::vector<std::thread> threads;
+    threads.reserve(num_producers + num_consumers);
+
+    for (int p = 0; p < num_producers; ++p) {
+      threads.emplace_back([&, p]() {
+        ScopedAffinityMask mask(cpus->producers[p]);
+        CycleHistogram& histogram = new_cycles[p];
+        ready.fetch_add(1, std::memory_order_relaxed);
+        while (!start.load(std::memory_order_acquire)) Pause();
+        for (int i = 0; i < per_producer; ++i) {
+          const int64_t before = absl::base_internal::CycleClock::Now();
+          void* ptr = ::operator new(size);
+          histogram.Record(absl::base_internal::CycleClock::Now() - before);
+          // Touch the object as an I/O thread filling a buffer would.
+          *static_cast<volatile char*>(ptr) = 1;
+          PointerRing& ring = rings[p * num_consumers + i % num_consumers];
+          while (!ring.Push(ptr)) Pause();
+        }
+      });
+    }
+    for (int c = 0; c < num_consumers; ++c) {
+      threads.emplace_back([&, c]() {
+        ScopedAffinityMask mask(cpus->consumers[c]);
+        CycleHistogram& histogram = delete_cycles[c];
+        ready.fetch_add(1, std::memory_order_relaxed);
+        while (!start.load(std::memory_order_acquire)) Pause();
+        int remaining = per_consumer;
+        while (remaining > 0) {
+          bool idle = true;
+          for (int p = 0; p < num_producers; ++p) {
+            void* ptr = rings[p * num_consumers + c].Pop();
+            if (ptr == nullptr) continue;
+            idle = false;
+            const int64_t before = absl::base_internal::CycleClock::Now();
+            ::operator delete(ptr, size);
+            histogram.Record(absl::base_internal::CycleClock::Now() - before);
+            --remaining;
+          }
+          if (idle) Pause();
+        }
+      });
+    }
+
+    while (ready.load(std::memory_order_relaxed) <
+           static_cast<int>(threads.size())) {
+      Pause();
+    }
+    const absl::Time begin = absl::Now();
+    start.store(true, std::memory_order_release);
+    for (std::thread& t : threads) {
+      t.join();
+    }
+    state.SetIterationTime(absl::ToDoubleSeconds(absl::Now() - begin));
+  }
+
+  CycleHistogram new_total, delete_total;
+  for (const CycleHistogram& h : new_cycles) new_total.Merge(h);
+  for (const CycleHistogram& h : delete_cycles) delete_total.Merge(h);
+
+  const int64_t objects =
+      static_cast<int64_t>(state.iterations()) * per_producer * num_producers;
+  state.SetItemsProcessed(objects);
+  state.SetBytesProcessed(objects * size);
+  state.counters["new_p50_cycles"] = new_total.Percentile(50);
+  state.counters["new_p99_cycles"] = new_total.Percentile(99);
+  state.counters["delete_p50_cycles"] = delete_total.Percentile(50);
+  state.counters["delete_p99_cycles"] = delete_total.Percentile(99);
+}
+BENCHMARK(BM_producer_consumer)
+    ->ArgNames({"producers", "consumers", "placement", "size"})
+    ->ArgsProduct({{1, 4},
+                   {1, 4},
+                   {kSameL3, kCrossL3, kCrossSocket},
+                   {16, 256, 4096, 32768}})
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace tcmalloc
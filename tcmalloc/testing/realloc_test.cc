@@ -96,5 +96,67 @@ TEST(ReallocTest, AlignedAllocRealloc) {
   }
 }
 
+TEST(ReallocTest, GrowLarge) {
+  // Grow a buffer in small steps, as a string builder would.  These reallocs
+  // may extend the buffer in place or move it.
+  constexpr int kStep = 20000;
+  int size = 300 << 10;
+  auto buf = static_cast<unsigned char*>(malloc(size));
+  ASSERT_NE(buf, nullptr);
+  Fill(buf, size);
+  for (; size < (4 << 20); size += kStep) {
+    buf = static_cast<unsigned char*>(realloc(buf, size + kStep));
+    ASSERT_NE(buf, nullptr);
+    ExpectValid(buf, size);
+    Fill(buf, size + kStep);
+  }
+  ExpectValid(buf, size);
+  free(buf);
+}
+
+TEST(ReallocTest, GrowHuge) {
+  // Buffers of whole hugepages may be moved by remapping their pages.  Keep
+  // another allocation alive meanwhile, so that they are not all reused in
+  // place.
+  int size = 16 << 20;
+  auto buf = static_cast<unsigned char*>(malloc(size));
+  ASSERT_NE(buf, nullptr);
+  Fill(buf, size);
+  for (; size < (128 << 20); size *= 2) {
+    void* other = malloc(size);
+    ASSERT_NE(other, nullptr);
+    buf = static_cast<unsigned char*>(realloc(buf, 2 * size));
+    ASSERT_NE(buf, nullptr);
+    free(other);
+    ExpectValid(buf, size);
+    Fill(buf, 2 * size);
+  }
+  ExpectValid(buf, size);
+  free(buf);
+}
+
+TEST(ReallocTest, ShrinkLarge) {
+  // Trim a buffer in large steps, as a parser would once done with it.  These
+  // reallocs may give the tail pages back in place or move the buffer.
+  const int kSizes[] = {(5 << 20) + 1, (2 << 20) + 3, 600 << 10, 300 << 10};
+  int size = 9 << 20;
+  auto buf = static_cast<unsigned char*>(malloc(size));
+  ASSERT_NE(buf, nullptr);
+  Fill(buf, size);
+  for (int new_size : kSizes) {
+    buf = static_cast<unsigned char*>(realloc(buf, new_size));
+    ASSERT_NE(buf, nullptr);
+    ExpectValid(buf, new_size);
+    size = new_size;
+  }
+  // The freed tails can be reused right away.
+  void* other = malloc(4 << 20);
+  ASSERT_NE(other, nullptr);
+  Fill(static_cast<unsigned char*>(other), 4 << 20);
+  ExpectValid(buf, size);
+  free(other);
+  free(buf);
+}
+
 }  // namespace
 }  // namespace tcmalloc
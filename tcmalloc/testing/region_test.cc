@@ -0,0 +1,113 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Test tcmalloc::Region functionality
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/container/flat_hash_set.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+using ::testing::HasSubstr;
+
+class RegionTest : public testing::TestWithParam<size_t> {};
+
+TEST_P(RegionTest, AllocateDistinctObjects) {
+  const size_t size = GetParam();
+  Region region;
+  absl::flat_hash_set<void*> seen;
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 200; ++i) {
+    void* ptr = region.Allocate(size);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignof(std::max_align_t),
+              0);
+    memset(ptr, i, size);
+    ptrs.push_back(ptr);
+    if (size > 0) {
+      EXPECT_TRUE(seen.insert(ptr).second);
+    }
+  }
+  // Objects do not overlap.
+  for (size_t i = 0; i < ptrs.size(); ++i) {
+    const auto* bytes = static_cast<const unsigned char*>(ptrs[i]);
+    for (size_t j = 0; j < size; ++j) {
+      ASSERT_EQ(bytes[j], static_cast<unsigned char>(i));
+    }
+  }
+}
+
+TEST_P(RegionTest, Reset) {
+  const size_t size = GetParam();
+  Region region;
+  for (int round = 0; round < 5; ++round) {
+    for (int i = 0; i < 100; ++i) {
+      void* ptr = region.Allocate(size);
+      ASSERT_NE(ptr, nullptr);
+      memset(ptr, round, size);
+    }
+    region.Reset();
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Sizes, RegionTest,
+                         testing::Values(0, 1, 8, 17, 64, 4096, 100000,
+                                         1 << 20));
+
+TEST(RegionTest, Alignment) {
+  Region region;
+  for (size_t alignment = 1; alignment <= (size_t{1} << 20); alignment <<= 1) {
+    SCOPED_TRACE(alignment);
+    for (size_t size : {size_t{1}, size_t{24}, alignment}) {
+      void* ptr = region.Allocate(size, alignment);
+      ASSERT_NE(ptr, nullptr);
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignment, 0);
+      memset(ptr, 0xab, size);
+    }
+  }
+}
+
+TEST(RegionTest, EmptyRegion) {
+  Region region;
+  region.Reset();
+}
+
+TEST(RegionTest, Stats) {
+  if (MallocExtension::GetStats().empty()) {
+    GTEST_SKIP() << "Not linked against TCMalloc";
+  }
+
+  {
+    Region region;
+    ASSERT_NE(region.Allocate(1000), nullptr);
+    ASSERT_NE(region.Allocate(1 << 20), nullptr);
+    std::string stats = MallocExtension::GetStats();
+    EXPECT_THAT(stats, HasSubstr("Regions: 1 live"));
+  }
+  EXPECT_THAT(MallocExtension::GetStats(), HasSubstr("Regions: 0 live"));
+}
+
+}  // namespace
+}  // namespace tcmalloc
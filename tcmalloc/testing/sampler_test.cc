@@ -24,6 +24,7 @@
 #include <vector>
 
 #include "gtest/gtest.h"
+#include "tcmalloc/internal/parameter_accessors.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/testing/testutil.h"
 
@@ -96,6 +97,21 @@ void TestPickNextSample(int n) {
   TestSampleAndersonDarling(sample_period, &int_random_sample);
 }
 
+// Tests that deterministic mode samples exactly once per interval.
+TEST(Sampler, Deterministic) {
+  const bool previous = TCMalloc_Internal_GetDeterministic();
+  TCMalloc_Internal_SetDeterministic(true);
+  Sampler sampler;
+  SamplerTest::Init(&sampler, 1);
+  const ssize_t first = sampler.PickNextSamplingPoint();
+  EXPECT_GT(first, 0);
+  EXPECT_LE(first, sampler.GetSampleInterval());
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(sampler.PickNextSamplingPoint(), first);
+  }
+  TCMalloc_Internal_SetDeterministic(previous);
+}
+
 TEST(Sampler, TestPickNextSample_MultipleValues) {
   TestPickNextSample(10);  // Make sure the first few are good (enough)
   TestPickNextSample(100);
@@ -147,7 +147,8 @@ bool RunTest(size_t size) {
 
   double expectedOverhead = 10.2;
   // Larger page sizes have larger sampling overhead.
-  if (tcmalloc_internal::kPageShift == 15) {
+  if (tcmalloc_internal::kPageShift == 15 ||
+      tcmalloc_internal::kPageShift == 16) {
     expectedOverhead *= 2;
   } else if (tcmalloc_internal::kPageShift == 18) {
     expectedOverhead *= 3;
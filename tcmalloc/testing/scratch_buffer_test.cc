@@ -0,0 +1,108 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Test tcmalloc::ScratchBuffer functionality
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+bool Aligned(const ScratchBuffer& buffer) {
+  return reinterpret_cast<uintptr_t>(buffer.data()) %
+             alignof(std::max_align_t) ==
+         0;
+}
+
+TEST(ScratchBufferTest, NestedBuffersDoNotOverlap) {
+  ScratchBuffer outer(100);
+  memset(outer.data(), 1, outer.size());
+  {
+    ScratchBuffer inner(1000);
+    EXPECT_TRUE(Aligned(inner));
+    memset(inner.data(), 2, inner.size());
+    const auto* bytes = static_cast<const unsigned char*>(outer.data());
+    for (size_t i = 0; i < outer.size(); ++i) {
+      ASSERT_EQ(bytes[i], 1);
+    }
+  }
+  EXPECT_TRUE(Aligned(outer));
+}
+
+TEST(ScratchBufferTest, LifoReuse) {
+  if (tcmalloc_internal::kSanitizerPresent) {
+    GTEST_SKIP() << "Skipping under sanitizers";
+  }
+  void* first;
+  {
+    ScratchBuffer buffer(64);
+    first = buffer.data();
+  }
+  ScratchBuffer buffer(64);
+  EXPECT_EQ(buffer.data(), first);
+}
+
+TEST(ScratchBufferTest, OutOfOrder) {
+  auto a = std::make_unique<ScratchBuffer>(32);
+  std::optional<ScratchBuffer> b(std::in_place, 32);
+  a.reset();
+  ScratchBuffer c(32);
+  EXPECT_NE(c.data(), b->data());
+  memset(c.data(), 3, c.size());
+  b.reset();
+}
+
+TEST(ScratchBufferTest, Large) {
+  // Falls back to separate allocations.
+  std::vector<std::unique_ptr<ScratchBuffer>> buffers;
+  for (int i = 0; i < 10; ++i) {
+    buffers.push_back(std::make_unique<ScratchBuffer>(100000));
+    memset(buffers.back()->data(), i, buffers.back()->size());
+    EXPECT_TRUE(Aligned(*buffers.back()));
+  }
+  ScratchBuffer empty(0);
+  EXPECT_NE(empty.data(), nullptr);
+}
+
+TEST(ScratchBufferTest, Threads) {
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([i]() {
+      for (int j = 0; j < 1000; ++j) {
+        ScratchBuffer a(64 + j);
+        ScratchBuffer b(4096);
+        memset(a.data(), i, a.size());
+        memset(b.data(), i, b.size());
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+}  // namespace
+}  // namespace tcmalloc
@@ -0,0 +1,102 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the allocation and sized deletion fast path as objects are spread
+// over more security partitions.  Each iteration allocates a batch of objects
+// through the alloc-token entry points, cycling through the partitions in a
+// fixed random order, and frees the batch with sized delete, which has to
+// recover each object's partition from its address.
+//
+// Run the partitioned_enabled_runtime and security_partitions_8 variants: the
+// cost per object should stay flat as the partition count grows.  Without
+// heap partitioning, every token lands in partition 0.
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+
+#define DECLARE_WEAK_ALLOC_TOKEN_NEW(id) \
+  extern "C" ABSL_ATTRIBUTE_WEAK void* __alloc_token_##id##__Znwm(size_t);
+
+DECLARE_WEAK_ALLOC_TOKEN_NEW(0)
+DECLARE_WEAK_ALLOC_TOKEN_NEW(1)
+DECLARE_WEAK_ALLOC_TOKEN_NEW(2)
+DECLARE_WEAK_ALLOC_TOKEN_NEW(3)
+DECLARE_WEAK_ALLOC_TOKEN_NEW(4)
+DECLARE_WEAK_ALLOC_TOKEN_NEW(5)
+DECLARE_WEAK_ALLOC_TOKEN_NEW(6)
+DECLARE_WEAK_ALLOC_TOKEN_NEW(7)
+
+namespace tcmalloc {
+namespace {
+
+using TokenNew = void* (*)(size_t);
+
+constexpr size_t kBatch = 1024;
+
+// The token entry points this build of TCMalloc provides, in token order.
+std::vector<TokenNew> TokenNews() {
+  std::vector<TokenNew> news;
+  for (TokenNew f :
+       {&__alloc_token_0__Znwm, &__alloc_token_1__Znwm, &__alloc_token_2__Znwm,
+        &__alloc_token_3__Znwm, &__alloc_token_4__Znwm, &__alloc_token_5__Znwm,
+        &__alloc_token_6__Znwm, &__alloc_token_7__Znwm}) {
+    if (f == nullptr) break;
+    news.push_back(f);
+  }
+  return news;
+}
+
+void BM_partitioned_new_sized_delete(benchmark::State& state) {
+  const size_t size = state.range(0);
+  const size_t partitions = state.range(1);
+  const std::vector<TokenNew> news = TokenNews();
+  if (news.size() < partitions) {
+    state.SkipWithError("not enough security partitions compiled in");
+    return;
+  }
+
+  // A random order keeps the branch predictor from learning the partition of
+  // the next object, as it could not for a real mix of types.
+  absl::BitGen rng;
+  std::vector<TokenNew> order(kBatch);
+  for (size_t i = 0; i < kBatch; ++i) {
+    order[i] = news[i % partitions];
+  }
+  std::shuffle(order.begin(), order.end(), rng);
+
+  std::vector<void*> objects(kBatch);
+  for (auto _ : state) {
+    for (size_t i = 0; i < kBatch; ++i) {
+      objects[i] = order[i](size);
+    }
+    benchmark::DoNotOptimize(objects.data());
+    for (void* object : objects) {
+      ::operator delete(object, size);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+
+BENCHMARK(BM_partitioned_new_sized_delete)
+    ->ArgsProduct({{8, 64, 1024}, {1, 2, 4, 8}});
+
+}  // namespace
+}  // namespace tcmalloc
@@ -0,0 +1,173 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Test tcmalloc::SharedRegion functionality
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+using ::testing::HasSubstr;
+
+constexpr size_t kRegionSize = 16 << 20;
+constexpr int kMessages = 100;
+
+int memfd_create(const char* name, unsigned int flags) {
+#ifdef __NR_memfd_create
+  return syscall(__NR_memfd_create, name, flags);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+struct Message {
+  int id;
+  char payload[1000];
+};
+
+class SharedRegionTest : public testing::Test {
+ protected:
+  SharedRegionTest() : fd_(memfd_create("shared_region_test", 0)) {
+    // Find an address range that is free, and leave it free for Attach().
+    void* p = mmap(nullptr, 2 * kRegionSize, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    EXPECT_NE(p, MAP_FAILED);
+    munmap(p, 2 * kRegionSize);
+    address_ = p;
+  }
+
+  void SetUp() override {
+    if (fd_ < 0) {
+      GTEST_SKIP() << "memfd is not supported";
+    }
+  }
+
+  ~SharedRegionTest() override {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  int fd_;
+  void* address_;
+};
+
+TEST_F(SharedRegionTest, ConsumerFreesProducerMessages) {
+  SharedRegion region;
+  ASSERT_TRUE(region.Attach(fd_, address_, kRegionSize));
+
+  int pipe_fds[2];
+  ASSERT_EQ(pipe(pipe_fds), 0);
+  const pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    // The producer attaches on its own, as an unrelated process would.
+    region.Detach();
+    SharedRegion producer;
+    if (!producer.Attach(fd_, address_, kRegionSize)) _exit(1);
+    for (int i = 0; i < kMessages; ++i) {
+      auto* message = static_cast<Message*>(producer.Allocate(sizeof(Message)));
+      if (message == nullptr) _exit(2);
+      message->id = i;
+      memset(message->payload, i, sizeof(message->payload));
+      if (write(pipe_fds[1], &message, sizeof(message)) != sizeof(message)) {
+        _exit(3);
+      }
+    }
+    _exit(0);
+  }
+  close(pipe_fds[1]);
+
+  for (int i = 0; i < kMessages; ++i) {
+    Message* message;
+    ASSERT_EQ(read(pipe_fds[0], &message, sizeof(message)), sizeof(message));
+    EXPECT_EQ(message->id, i);
+    EXPECT_EQ(message->payload[sizeof(message->payload) - 1],
+              static_cast<char>(i));
+    region.Deallocate(message, sizeof(Message));
+  }
+  close(pipe_fds[0]);
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+
+  // The producer's objects are reused by the consumer.
+  void* p = region.Allocate(sizeof(Message));
+  EXPECT_NE(p, nullptr);
+  EXPECT_GE(p, address_);
+  EXPECT_LT(p, static_cast<char*>(address_) + kRegionSize);
+}
+
+TEST_F(SharedRegionTest, Alignment) {
+  SharedRegion region;
+  ASSERT_TRUE(region.Attach(fd_, address_, kRegionSize));
+  for (size_t alignment = 1; alignment <= 4096; alignment *= 2) {
+    void* p = region.Allocate(8, alignment);
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignment, 0);
+  }
+  EXPECT_EQ(region.Allocate(kRegionSize), nullptr);
+}
+
+TEST_F(SharedRegionTest, AttachFailures) {
+  SharedRegion region;
+  ASSERT_TRUE(region.Attach(fd_, address_, kRegionSize));
+
+  // Pointers in the region would be wrong at any other address.
+  SharedRegion other;
+  void* elsewhere = static_cast<char*>(address_) + kRegionSize;
+  EXPECT_FALSE(other.Attach(fd_, elsewhere, kRegionSize));
+  EXPECT_FALSE(other.attached());
+
+  // The address range is in use.
+  const int fd2 = memfd_create("shared_region_test_2", 0);
+  ASSERT_GE(fd2, 0);
+  EXPECT_FALSE(other.Attach(fd2, address_, kRegionSize));
+  close(fd2);
+}
+
+TEST_F(SharedRegionTest, AbandonedFormatting) {
+  // A process that crashed while formatting the file leaves the state at the
+  // start of the header as "formatting".  Attaching gives up on it rather than
+  // waiting forever.
+  const uint32_t formatting = 1;
+  ASSERT_EQ(pwrite(fd_, &formatting, sizeof(formatting), 0),
+            sizeof(formatting));
+  SharedRegion region;
+  EXPECT_FALSE(region.Attach(fd_, address_, kRegionSize));
+  EXPECT_FALSE(region.attached());
+}
+
+TEST_F(SharedRegionTest, Stats) {
+  SharedRegion region;
+  ASSERT_TRUE(region.Attach(fd_, address_, kRegionSize));
+  EXPECT_THAT(MallocExtension::GetStats(),
+              HasSubstr("Shared regions: 1 attached"));
+}
+
+}  // namespace
+}  // namespace tcmalloc
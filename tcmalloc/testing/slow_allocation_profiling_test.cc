@@ -0,0 +1,102 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/parameter_accessors.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+// An unusual size, so that the samples of the test are easy to find.  It is
+// served by the page heap, so every allocation takes the slow path.
+constexpr size_t kSize = (1 << 20) + 12345;
+
+class ScopedSlowAllocationThreshold {
+ public:
+  explicit ScopedSlowAllocationThreshold(absl::Duration temporary_value) {
+    TCMalloc_Internal_GetSlowAllocationThreshold(&previous_);
+    TCMalloc_Internal_SetSlowAllocationThreshold(temporary_value);
+  }
+
+  ~ScopedSlowAllocationThreshold() {
+    TCMalloc_Internal_SetSlowAllocationThreshold(previous_);
+  }
+
+ private:
+  absl::Duration previous_;
+};
+
+void AllocateAndFree(int n) {
+  for (int i = 0; i < n; ++i) {
+    void* ptr = ::operator new(kSize);
+    benchmark::DoNotOptimize(ptr);
+    ::operator delete(ptr);
+  }
+}
+
+// Returns the samples of the allocations made by AllocateAndFree().
+std::vector<Profile::Sample> SlowSamples() {
+  Profile profile =
+      MallocExtension::SnapshotCurrent(ProfileType::kSlowAllocations);
+  EXPECT_EQ(profile.Type(), ProfileType::kSlowAllocations);
+  EXPECT_TRUE(profile.StartTime().has_value());
+  std::vector<Profile::Sample> samples;
+  profile.Iterate([&](const Profile::Sample& sample) {
+    if (sample.requested_size == kSize) samples.push_back(sample);
+  });
+  return samples;
+}
+
+TEST(SlowAllocationProfilingTest, RecordsAllocationsOverThreshold) {
+  constexpr int kAllocations = 10;
+  {
+    ScopedSlowAllocationThreshold t(absl::Nanoseconds(1));
+    AllocateAndFree(kAllocations);
+  }
+
+  std::vector<Profile::Sample> samples = SlowSamples();
+  EXPECT_GE(samples.size(), kAllocations);
+  for (const Profile::Sample& sample : samples) {
+    EXPECT_EQ(sample.count, 1);
+    EXPECT_GT(sample.sum, 0);
+    EXPECT_GT(sample.depth, 0);
+    EXPECT_LE(sample.depth, Profile::Sample::kMaxStackDepth);
+    EXPECT_LT(sample.slow_allocation_cause,
+              Profile::Sample::SlowAllocationCause::kDoNotUse);
+  }
+}
+
+TEST(SlowAllocationProfilingTest, DisabledAtZeroThreshold) {
+  ScopedSlowAllocationThreshold t(absl::ZeroDuration());
+  const size_t before = SlowSamples().size();
+  AllocateAndFree(10);
+  EXPECT_EQ(SlowSamples().size(), before);
+}
+
+TEST(SlowAllocationProfilingTest, SkipsFastAllocations) {
+  ScopedSlowAllocationThreshold t(absl::Hours(1));
+  const size_t before = SlowSamples().size();
+  AllocateAndFree(10);
+  EXPECT_EQ(SlowSamples().size(), before);
+}
+
+}  // namespace
+}  // namespace tcmalloc
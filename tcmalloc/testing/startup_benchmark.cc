@@ -0,0 +1,150 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures what starting to allocate costs a new process, as seen by
+// short-lived jobs.  Each iteration spawns this binary again; the child times
+// its first malloc and its first kMallocs mallocs from a static initializer
+// that runs before the others of the binary, reports them through a pipe, and
+// exits.  The iteration time is the child's whole lifetime.
+//
+// The C++ runtime may allocate before any static initializer of ours runs, in
+// which case Static::SlowInitIfNecessary() has already happened by the first
+// malloc we time; inited_before_first_malloc_pct reports how often.  The
+// lifetime of the child includes it either way.
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/static_vars.h"
+
+extern char** environ;
+
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+// Set in the environment of the child to the descriptor to report on.
+constexpr char kChildFdEnv[] = "TCMALLOC_STARTUP_BENCHMARK_FD";
+constexpr int kChildFd = 100;
+constexpr int kMallocs = 1000;
+
+struct StartupTimes {
+  int64_t first_malloc_ns;
+  int64_t first_mallocs_ns;
+  bool inited_before_first_malloc;
+};
+
+int64_t MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Static initializers of priority 101 run before those without a priority, so
+// absl and the benchmark library have not allocated yet.
+__attribute__((constructor(101))) void RunStartupChild() {
+  const char* fd = getenv(kChildFdEnv);
+  if (fd == nullptr) return;
+
+  void* ptrs[kMallocs];
+  StartupTimes times;
+  times.inited_before_first_malloc = tc_globals.IsInited();
+  const int64_t start = MonotonicNanos();
+  ptrs[0] = malloc(16);
+  benchmark::DoNotOptimize(ptrs[0]);
+  times.first_malloc_ns = MonotonicNanos() - start;
+  // Cycle through small sizes from 8 bytes to 4 KiB, as a program setting up
+  // its data structures might.
+  for (int i = 1; i < kMallocs; ++i) {
+    ptrs[i] = malloc(size_t{8} << (i % 10));
+    benchmark::DoNotOptimize(ptrs[i]);
+  }
+  times.first_mallocs_ns = MonotonicNanos() - start;
+  for (void* ptr : ptrs) {
+    free(ptr);
+  }
+
+  const bool ok = write(atoi(fd), &times, sizeof(times)) == sizeof(times);
+  _exit(ok ? 0 : 1);
+}
+
+void BM_startup(benchmark::State& state) {
+  std::vector<std::string> env_strings;
+  for (char** e = environ; *e != nullptr; ++e) {
+    env_strings.emplace_back(*e);
+  }
+  env_strings.push_back(absl::StrCat(kChildFdEnv, "=", kChildFd));
+  std::vector<char*> envp;
+  for (std::string& s : env_strings) {
+    envp.push_back(s.data());
+  }
+  envp.push_back(nullptr);
+  char exe[] = "/proc/self/exe";
+  char* argv[] = {exe, nullptr};
+
+  int64_t first_malloc_ns = 0;
+  int64_t first_mallocs_ns = 0;
+  int64_t inited_before = 0;
+  for (auto _ : state) {
+    int fds[2];
+    TC_CHECK_EQ(pipe2(fds, O_CLOEXEC), 0);
+    // dup2 clears O_CLOEXEC on the child's copy of the write end.
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], kChildFd);
+
+    const absl::Time start = absl::Now();
+    pid_t pid;
+    TC_CHECK_EQ(
+        posix_spawn(&pid, exe, &actions, nullptr, argv, envp.data()), 0);
+    close(fds[1]);
+    StartupTimes times;
+    const ssize_t n = read(fds[0], &times, sizeof(times));
+    int status;
+    TC_CHECK_EQ(waitpid(pid, &status, 0), pid);
+    state.SetIterationTime(absl::ToDoubleSeconds(absl::Now() - start));
+    close(fds[0]);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (n != sizeof(times) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      state.SkipWithError("child did not report its startup times");
+      return;
+    }
+    first_malloc_ns += times.first_malloc_ns;
+    first_mallocs_ns += times.first_mallocs_ns;
+    inited_before += times.inited_before_first_malloc;
+  }
+
+  const double iterations = state.iterations();
+  state.counters["first_malloc_ns"] = first_malloc_ns / iterations;
+  state.counters["first_1000_mallocs_ns"] = first_mallocs_ns / iterations;
+  state.counters["inited_before_first_malloc_pct"] =
+      100 * inited_before / iterations;
+}
+BENCHMARK(BM_startup)->UseManualTime()->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace tcmalloc::tcmalloc_internal
@@ -13,12 +13,16 @@
 // limitations under the License.
 
 #include <malloc.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <memory>
 #include <new>
 #include <string>
@@ -26,6 +30,7 @@
 #include <vector>
 
 #include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
 #include "absl/log/check.h"
 #include "absl/random/random.h"
 #include "absl/synchronization/notification.h"
@@ -33,6 +38,7 @@
 #include "absl/time/time.h"
 #include "benchmark/benchmark.h"
 #include "tcmalloc/common.h"
+#include "tcmalloc/internal/parameter_accessors.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/malloc_hook.h"
 #include "tcmalloc/malloc_hook_invoke.h"
@@ -69,6 +75,56 @@ BENCHMARK_TEMPLATE(BM_new_delete_fixed, 32);
 BENCHMARK_TEMPLATE(BM_new_delete_fixed, 512);
 BENCHMARK_TEMPLATE(BM_new_delete_fixed, 4096);
 
+// Like BM_new_delete_fixed, with the temporary taken from a ScratchBuffer.
+template <int size>
+static void BM_scratch_buffer_fixed(benchmark::State& state) {
+  for (auto s : state) {
+    ScratchBuffer buffer(size);
+    benchmark::DoNotOptimize(buffer.data());
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_scratch_buffer_fixed, 8);
+BENCHMARK_TEMPLATE(BM_scratch_buffer_fixed, 16);
+BENCHMARK_TEMPLATE(BM_scratch_buffer_fixed, 32);
+BENCHMARK_TEMPLATE(BM_scratch_buffer_fixed, 512);
+BENCHMARK_TEMPLATE(BM_scratch_buffer_fixed, 4096);
+
+// Like BM_new_delete_fixed, but the objects handed out are not in cache, as
+// the caches are flushed (untimed) between batches of allocations.  Each new
+// object is written to, so this shows how much of the miss the prefetch of
+// the next object in the per-cpu cache hides.
+template <int size>
+static void BM_new_delete_fixed_cold(benchmark::State& state) {
+  constexpr int kBatch = 64;
+  std::vector<char> evict(64 << 20);
+  void* ptrs[kBatch];
+  for (auto s : state) {
+    state.PauseTiming();
+    for (size_t i = 0; i < evict.size(); i += ABSL_CACHELINE_SIZE) {
+      ++evict[i];
+    }
+    benchmark::ClobberMemory();
+    state.ResumeTiming();
+
+    for (void*& ptr : ptrs) {
+      ptr = ::operator new(size);
+      *static_cast<volatile char*>(ptr) = 0;
+    }
+    // Free in reverse, so that the next batch pops the objects in the same
+    // order.
+    for (int i = kBatch - 1; i >= 0; --i) {
+      ::operator delete(ptrs[i], size);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+
+BENCHMARK_TEMPLATE(BM_new_delete_fixed_cold, 8);
+BENCHMARK_TEMPLATE(BM_new_delete_fixed_cold, 64);
+BENCHMARK_TEMPLATE(BM_new_delete_fixed_cold, 512);
+BENCHMARK_TEMPLATE(BM_new_delete_fixed_cold, 4096);
+
 static void BM_new_sized_delete(benchmark::State& state) {
   const int arg = state.range(0);
 
@@ -137,6 +193,28 @@ static void BM_new_hooked_sized_delete(benchmark::State& state) {
 }
 BENCHMARK(BM_new_hooked_sized_delete)->Range(1, 1 << 20);
 
+static void BM_periodic_hooked_new_sized_delete(benchmark::State& state) {
+  const int arg = state.range(0);
+
+  auto new_hook = [](const MallocHook::NewInfo& info) {
+    benchmark::DoNotOptimize(info.ptr);
+  };
+  auto delete_hook = [](const MallocHook::DeleteInfo& info) {
+    benchmark::DoNotOptimize(info.ptr);
+  };
+  CHECK(MallocHook::AddPeriodicNewHook(new_hook, 1000));
+  CHECK(MallocHook::AddPeriodicDeleteHook(delete_hook, 1000));
+
+  for (auto s : state) {
+    void* ptr = ::operator new(arg);
+    ::operator delete(ptr, arg);
+  }
+
+  CHECK(MallocHook::RemovePeriodicNewHook(new_hook));
+  CHECK(MallocHook::RemovePeriodicDeleteHook(delete_hook));
+}
+BENCHMARK(BM_periodic_hooked_new_sized_delete)->Range(1, 1 << 20);
+
 static void BM_size_returning_new_delete(benchmark::State& state) {
   const int arg = state.range(0);
 
@@ -168,23 +246,79 @@ static void BM_aligned_new(benchmark::State& state) {
     operator delete(ptr, size, static_cast<std::align_val_t>(alignment));
   }
 }
-BENCHMARK(BM_aligned_new)->RangePair(1, 1 << 20, 8, 64)->ArgPair(65, 64);
+BENCHMARK(BM_aligned_new)
+    ->RangePair(1, 1 << 20, 8, 64)
+    ->ArgPair(65, 64)
+    // Sizes whose natural size class is not aligned enough, as for SIMD
+    // scratch and DMA buffers.
+    ->ArgPair(80, 64)
+    ->ArgPair(100, 4096)
+    ->ArgPair(5000, 4096);
 
 static void BM_new_delete_slow_path(benchmark::State& state) {
   // The benchmark is intended to cover CpuCache overflow/underflow paths,
   // transfer cache and a bit of the central freelist.
   std::vector<void*> allocs((4 << 10) + 128);
   const size_t size = state.range(0);
+  // Number of objects prefetched on each per-cpu cache refill.
+  const int32_t prefetch = state.range(1);
+  int32_t old_prefetch = 0;
+  if (&TCMalloc_Internal_SetRefillPrefetchObjects != nullptr) {
+    old_prefetch = TCMalloc_Internal_GetRefillPrefetchObjects();
+    TCMalloc_Internal_SetRefillPrefetchObjects(prefetch);
+  } else if (prefetch != 0) {
+    state.SkipWithError("refill prefetching is not supported");
+    return;
+  }
   for (auto s : state) {
     for (void*& p : allocs) {
       p = ::operator new(size);
+      // Write to the object, as the caller of operator new would.
+      *static_cast<volatile char*>(p) = 0;
     }
     for (void* p : allocs) {
       ::operator delete(p, size);
     }
   }
+  if (&TCMalloc_Internal_SetRefillPrefetchObjects != nullptr) {
+    TCMalloc_Internal_SetRefillPrefetchObjects(old_prefetch);
+  }
+}
+BENCHMARK(BM_new_delete_slow_path)
+    ->ArgNames({"size", "prefetch"})
+    ->ArgsProduct({{8, 8192}, {0, 4, 16}});
+
+static void BM_sampled_alloc(benchmark::State& state) {
+  // Measures the cost of sampling, dominated by capturing the stack, at dense
+  // sampling intervals with either unwinder.
+  constexpr size_t kSize = 64;
+  const int64_t interval = state.range(0);
+  const bool frame_pointers = state.range(1);
+  bool old_frame_pointers = false;
+  if (&TCMalloc_Internal_SetFramePointerUnwinding != nullptr) {
+    old_frame_pointers = TCMalloc_Internal_GetFramePointerUnwinding();
+    TCMalloc_Internal_SetFramePointerUnwinding(frame_pointers);
+  } else if (frame_pointers) {
+    state.SkipWithError("frame pointer unwinding is not supported");
+    return;
+  }
+  const int64_t old_interval = MallocExtension::GetProfileSamplingInterval();
+  MallocExtension::SetProfileSamplingInterval(interval);
+
+  for (auto s : state) {
+    void* ptr = ::operator new(kSize);
+    benchmark::DoNotOptimize(ptr);
+    ::operator delete(ptr, kSize);
+  }
+
+  MallocExtension::SetProfileSamplingInterval(old_interval);
+  if (&TCMalloc_Internal_SetFramePointerUnwinding != nullptr) {
+    TCMalloc_Internal_SetFramePointerUnwinding(old_frame_pointers);
+  }
 }
-BENCHMARK(BM_new_delete_slow_path)->Arg(8)->Arg(8192);
+BENCHMARK(BM_sampled_alloc)
+    ->ArgNames({"interval", "frame_pointers"})
+    ->ArgsProduct({{1, 4096, 512 << 10}, {0, 1}});
 
 static void BM_new_delete_transfer_cache(benchmark::State& state) {
   // The benchmark is intended to cover CpuCache overflow/underflow paths
@@ -228,6 +362,42 @@ BENCHMARK(BM_malloc_pages)
     ->Arg(1 + 20 * 1024 * 1024 / (8 * 1024))
     ->Arg(256);
 
+// Measures allocating and then touching every page of a large allocation, with
+// and without asking operator new to prefault it.  The allocation is returned
+// to the OS between iterations so that each one starts from unbacked memory.
+static void BM_new_first_touch(benchmark::State& state) {
+  const size_t size = state.range(0);
+  const bool prefault = state.range(1);
+  const size_t page_size = getpagesize();
+
+  long faults = 0;
+  for (auto s : state) {
+    void* ret = prefault ? ::operator new(size, tcmalloc::prefault)
+                         : ::operator new(size);
+    char* ptr = static_cast<char*>(ret);
+    state.PauseTiming();
+    struct rusage populated;
+    getrusage(RUSAGE_SELF, &populated);
+    state.ResumeTiming();
+    for (size_t i = 0; i < size; i += page_size) {
+      ptr[i] = 1;
+    }
+    benchmark::DoNotOptimize(ptr);
+    state.PauseTiming();
+    struct rusage touched;
+    getrusage(RUSAGE_SELF, &touched);
+    faults += touched.ru_minflt - populated.ru_minflt;
+    ::operator delete(ptr);
+    MallocExtension::ReleaseMemoryToSystem(std::numeric_limits<size_t>::max());
+    state.ResumeTiming();
+  }
+  // Faults taken on first touch, after operator new has returned.
+  state.counters["touch_faults"] =
+      benchmark::Counter(faults, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_new_first_touch)
+    ->ArgsProduct({{1 << 20, 8 << 20, 64 << 20}, {0, 1}});
+
 static void BM_random_malloc_pages(benchmark::State& state) {
   const int kMaxOnHeap = 5000;
   const int kMaxRequestSizePages = 127;
@@ -501,6 +671,36 @@ BENCHMARK(BM_get_stats_pbtxt_pageheap_lock)
     ->UseRealTime()
     ->Unit(benchmark::kMillisecond);
 
+static void BM_get_stats_snapshot(benchmark::State& state) {
+  std::vector<std::unique_ptr<char[]>> allocations;
+  const int num_allocations = state.range(0);
+  allocations.reserve(num_allocations);
+
+  // Perform randomly sized allocations which will be kept live whilst we
+  // collect stats, allowing us to observe the impact of heap size on the time
+  // taken to collect stats.
+  absl::BitGen rand;
+  for (int i = 0; i < num_allocations; i++) {
+    const size_t size = absl::Uniform<size_t>(rand, 1, 1 << 20);
+    allocations.emplace_back(new char[size]);
+  }
+
+  for (auto s : state) {
+    const MallocExtension::StatsSnapshot snapshot =
+        MallocExtension::GetStatsSnapshot();
+    benchmark::DoNotOptimize(snapshot);
+  }
+}
+BENCHMARK(BM_get_stats_snapshot)->Range(1, 1 << 20);
+
+static void BM_get_hot_stats(benchmark::State& state) {
+  for (auto s : state) {
+    const MallocExtension::HotStats stats = MallocExtension::GetHotStats();
+    benchmark::DoNotOptimize(stats);
+  }
+}
+BENCHMARK(BM_get_hot_stats);
+
 static void BM_get_heap_profile(benchmark::State& state) {
   std::vector<std::unique_ptr<char[]>> allocations;
   const int num_allocations = state.range(0);
@@ -561,5 +761,65 @@ static void BM_get_heap_profile_while_allocating(benchmark::State& state) {
 }
 BENCHMARK(BM_get_heap_profile_while_allocating)->Range(1, 1 << 18);
 
+// Collects the heap profile of a process whose heap is state.range(0) GiB, by
+// sampling small objects until the profile holds as many samples as such a
+// heap would at the default sampling interval, and reports the latency of
+// large allocations made meanwhile by another thread.
+static void BM_get_heap_profile_heap_scaling(benchmark::State& state) {
+  const int64_t interval = MallocExtension::GetProfileSamplingInterval();
+  if (interval <= 0) {
+    state.SkipWithError("sampling is disabled");
+    return;
+  }
+  const int64_t num_samples =
+      (static_cast<int64_t>(state.range(0)) << 30) / interval;
+
+  std::vector<std::unique_ptr<char[]>> allocations;
+  allocations.reserve(num_samples);
+  MallocExtension::SetProfileSamplingInterval(1);
+  for (int64_t i = 0; i < num_samples; i++) {
+    allocations.emplace_back(new char[64]);
+  }
+  MallocExtension::SetProfileSamplingInterval(interval);
+
+  absl::Notification done;
+  std::vector<int64_t> latencies_ns;
+  std::thread alloc_thread([&] {
+    absl::BitGen rand;
+    while (!done.HasBeenNotified()) {
+      const size_t size = absl::Uniform<size_t>(rand, 256 * 1024, 1 << 20);
+      const absl::Time start = absl::Now();
+      ::operator delete(::operator new(size));
+      latencies_ns.push_back(absl::ToInt64Nanoseconds(absl::Now() - start));
+    }
+  });
+
+  for (auto s : state) {
+    benchmark::DoNotOptimize(
+        MallocExtension::SnapshotCurrent(ProfileType::kHeap));
+  }
+
+  done.Notify();
+  alloc_thread.join();
+
+  state.counters["samples"] = num_samples;
+  if (!latencies_ns.empty()) {
+    std::sort(latencies_ns.begin(), latencies_ns.end());
+    auto percentile = [&](double p) {
+      return latencies_ns[static_cast<size_t>(p * (latencies_ns.size() - 1))];
+    };
+    state.counters["alloc_p50_ns"] = percentile(0.5);
+    state.counters["alloc_p99_ns"] = percentile(0.99);
+    state.counters["alloc_p999_ns"] = percentile(0.999);
+    state.counters["alloc_max_ns"] = latencies_ns.back();
+  }
+}
+BENCHMARK(BM_get_heap_profile_heap_scaling)
+    ->Arg(1)
+    ->Arg(10)
+    ->Arg(100)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
 }  // namespace
 }  // namespace tcmalloc
@@ -0,0 +1,121 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replays an allocation trace recorded by AllocationTraceRecorder, and reports
+// throughput, the physical memory used over the replay, and fragmentation at
+// the end of the trace.  Linking it against different allocator variants (or
+// running it with different TCMALLOC_* settings) compares them on the same
+// allocation stream.
+//
+// Usage: tcmalloc_replay --trace=trace [--rss_sample_interval=10ms]
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/statusor.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/testing/allocation_trace.h"
+
+ABSL_FLAG(std::string, trace, "", "Allocation trace to replay.");
+ABSL_FLAG(absl::Duration, rss_sample_interval, absl::Milliseconds(10),
+          "How often to sample physical memory use during the replay.");
+
+namespace {
+
+size_t Property(const char* name) {
+  std::optional<size_t> value =
+      tcmalloc::MallocExtension::GetNumericProperty(name);
+  return value.value_or(0);
+}
+
+struct Sample {
+  absl::Duration time;
+  size_t physical;
+  size_t in_use;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  using tcmalloc::tcmalloc_testing::AllocationTrace;
+  using tcmalloc::tcmalloc_testing::AllocationTraceReplayer;
+
+  absl::ParseCommandLine(argc, argv);
+  const std::string path = absl::GetFlag(FLAGS_trace);
+  if (path.empty()) {
+    fprintf(stderr, "usage: %s --trace=trace\n", argv[0]);
+    return 1;
+  }
+  absl::StatusOr<AllocationTrace> trace = AllocationTrace::ReadFromFile(path);
+  if (!trace.ok()) {
+    fprintf(stderr, "%s\n", trace.status().ToString().c_str());
+    return 1;
+  }
+
+  AllocationTraceReplayer replayer(*trace);
+  std::vector<Sample> samples;
+  samples.reserve(1024);
+  std::atomic<bool> done{false};
+  const absl::Time start = absl::Now();
+  std::thread sampler([&] {
+    const absl::Duration interval = absl::GetFlag(FLAGS_rss_sample_interval);
+    while (!done.load(std::memory_order_acquire)) {
+      samples.push_back({absl::Now() - start,
+                         Property("generic.physical_memory_used"),
+                         Property("generic.current_allocated_bytes")});
+      absl::SleepFor(interval);
+    }
+  });
+  const absl::Duration elapsed = replayer.Run();
+  done.store(true, std::memory_order_release);
+  sampler.join();
+
+  const size_t physical = Property("generic.physical_memory_used");
+  const size_t in_use = Property("generic.current_allocated_bytes");
+  size_t peak = physical;
+  for (const Sample& s : samples) {
+    peak = std::max(peak, s.physical);
+  }
+
+  printf("events: %zu threads: %u objects: %llu\n", trace->events.size(),
+         trace->num_threads,
+         static_cast<unsigned long long>(trace->num_objects));
+  printf("elapsed: %s (%.0f events/s)\n", absl::FormatDuration(elapsed).c_str(),
+         trace->events.size() / absl::ToDoubleSeconds(elapsed));
+  printf("physical memory: %zu bytes at end, %zu bytes peak\n", physical,
+         peak);
+  printf("in use by application: %zu bytes\n", in_use);
+  printf("fragmentation: %zu bytes (%.2f%%)\n",
+         physical > in_use ? physical - in_use : 0,
+         physical > 0 && physical > in_use
+             ? 100.0 * (physical - in_use) / physical
+             : 0.0);
+  printf("\ntime_ms physical_bytes in_use_bytes\n");
+  for (const Sample& s : samples) {
+    printf("%.1f %zu %zu\n", absl::ToDoubleMilliseconds(s.time), s.physical,
+           s.in_use);
+  }
+  return 0;
+}
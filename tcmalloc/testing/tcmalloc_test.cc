@@ -792,6 +792,21 @@ TEST(TCMallocTest, nallocx) {
   }
 }
 
+TEST(TCMallocTest, GoodSize) {
+  for (size_t size = 0; size <= kMaxTestAllocSize; size += 31) {
+    for (size_t hint : {size_t{0}, size + 1, size * 3 / 2, size * 2}) {
+      const size_t target = std::max(size, hint);
+      const size_t good = GoodSize(size, hint);
+      ASSERT_GE(good, size) << hint;
+      // No memory is wasted to rounding, and the result is no farther from
+      // the target than simply rounding it up.
+      ASSERT_EQ(nallocx(good, 0), good) << size << " " << hint;
+      const size_t distance = good > target ? good - target : target - good;
+      ASSERT_LE(distance, nallocx(target, 0) - target) << size << " " << hint;
+    }
+  }
+}
+
 TEST(TCMallocTest, nallocx_alignment) {
   // Guarded allocations may have a smaller allocated size than nallocx
   // predicts.  So we disable guarded allocations.
@@ -1786,6 +1801,30 @@ TEST(MallocExtension, SizeReturningNewAndSizedDelete) {
 #endif
 }
 
+TEST(MallocExtension, LifetimeHint) {
+  for (lifetime_t lifetime :
+       {lifetime_t::kShortLived, lifetime_t::kLongLived}) {
+    for (size_t size : {size_t{1}, size_t{100}, size_t{10000}, size_t{100000},
+                        size_t{1} << 20}) {
+      SCOPED_TRACE(size);
+      void* ptr = ::operator new(size, lifetime);
+      memset(ptr, 0xab, size);
+      EXPECT_GE(MallocExtension::GetAllocatedSize(ptr).value_or(size), size);
+      ::operator delete(ptr);
+
+      ptr = ::operator new[](size, std::nothrow, lifetime);
+      ASSERT_NE(ptr, nullptr);
+      memset(ptr, 0xab, size);
+      ::operator delete[](ptr);
+
+      sized_ptr_t res = __size_returning_new_lifetime(size, lifetime);
+      EXPECT_GE(res.n, size);
+      memset(res.p, 0xab, res.n);
+      ::operator delete(res.p);
+    }
+  }
+}
+
 TEST(TCMalloc, malloc_info) {
   char* buf = nullptr;
   size_t size = 0;
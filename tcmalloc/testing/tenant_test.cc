@@ -0,0 +1,150 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stddef.h>
+
+#include <new>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/testing/testutil.h"
+
+namespace tcmalloc {
+namespace {
+
+// An unusual size, so that the samples of the test are easy to find.
+constexpr size_t kSize = 12347;
+constexpr MallocExtension::TenantId kTenant = 4711;
+
+std::optional<MallocExtension::TenantStats> Stats(
+    MallocExtension::TenantId tenant) {
+  for (const auto& s : MallocExtension::GetTenantStats()) {
+    if (s.tenant == tenant) return s;
+  }
+  return std::nullopt;
+}
+
+class TenantTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    if (MallocExtension::GetStats().empty()) {
+      GTEST_SKIP() << "Not linked against TCMalloc";
+    }
+  }
+
+  void Allocate(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      void* ptr = ::operator new(kSize);
+      benchmark::DoNotOptimize(ptr);
+      objects_.push_back(ptr);
+    }
+  }
+
+  void Free() {
+    for (void* ptr : objects_) {
+      ::operator delete(ptr);
+    }
+    objects_.clear();
+  }
+
+  void TearDown() override { Free(); }
+
+  std::vector<void*> objects_;
+};
+
+TEST_F(TenantTest, ScopesNest) {
+  EXPECT_EQ(MallocExtension::GetCurrentTenant(), MallocExtension::kNoTenant);
+  {
+    ScopedTenant a(1);
+    EXPECT_EQ(MallocExtension::GetCurrentTenant(), 1);
+    {
+      ScopedTenant b(2);
+      EXPECT_EQ(MallocExtension::GetCurrentTenant(), 2);
+    }
+    EXPECT_EQ(MallocExtension::GetCurrentTenant(), 1);
+  }
+  EXPECT_EQ(MallocExtension::GetCurrentTenant(), MallocExtension::kNoTenant);
+}
+
+TEST_F(TenantTest, AttributesLiveBytes) {
+  ScopedProfileSamplingInterval s(1);
+  constexpr size_t kObjects = 100;
+  const std::optional<MallocExtension::TenantStats> prior = Stats(kTenant);
+  const size_t before = prior.has_value() ? prior->live_bytes : 0;
+  {
+    ScopedTenant tenant(kTenant);
+    Allocate(kObjects);
+  }
+  std::optional<MallocExtension::TenantStats> stats = Stats(kTenant);
+  ASSERT_TRUE(stats.has_value());
+  EXPECT_GE(stats->live_bytes, before + kObjects * kSize);
+  EXPECT_GE(stats->allocated_bytes, kObjects * kSize);
+
+  // Heap profiles report the tenant.
+  size_t tenant_samples = 0;
+  MallocExtension::SnapshotCurrent(ProfileType::kHeap)
+      .Iterate([&](const Profile::Sample& sample) {
+        if (sample.requested_size == kSize && sample.tenant == kTenant) {
+          tenant_samples += sample.count;
+        }
+      });
+  EXPECT_GE(tenant_samples, kObjects);
+
+  // Freed outside of the scope, the bytes are still credited to the tenant.
+  Free();
+  stats = Stats(kTenant);
+  ASSERT_TRUE(stats.has_value());
+  EXPECT_EQ(stats->live_bytes, before);
+}
+
+TEST_F(TenantTest, Limit) {
+  ScopedProfileSamplingInterval s(1);
+  constexpr MallocExtension::TenantId kLimited = kTenant + 1;
+  MallocExtension::SetTenantLimit(kLimited, 10 * kSize);
+  EXPECT_FALSE(MallocExtension::IsTenantOverLimit(kLimited));
+
+  {
+    ScopedTenant tenant(kLimited);
+    Allocate(100);
+  }
+  EXPECT_TRUE(MallocExtension::IsTenantOverLimit(kLimited));
+  std::optional<MallocExtension::TenantStats> stats = Stats(kLimited);
+  ASSERT_TRUE(stats.has_value());
+  EXPECT_EQ(stats->limit, 10 * kSize);
+  EXPECT_EQ(stats->limit_exceeded, 1);
+
+  Free();
+  EXPECT_FALSE(MallocExtension::IsTenantOverLimit(kLimited));
+  MallocExtension::SetTenantLimit(kLimited, 0);
+}
+
+TEST_F(TenantTest, Stats) {
+  ScopedProfileSamplingInterval s(1);
+  {
+    ScopedTenant tenant(kTenant);
+    Allocate(10);
+  }
+  const std::string stats = MallocExtension::GetStats();
+  EXPECT_THAT(stats, testing::HasSubstr("Tenant usage"));
+  EXPECT_THAT(stats, testing::ContainsRegex("tenant +4711: "));
+}
+
+}  // namespace
+}  // namespace tcmalloc
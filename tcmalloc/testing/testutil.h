@@ -19,6 +19,7 @@
 #include <sys/syscall.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <new>
@@ -33,6 +34,7 @@
 #include "absl/time/time.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/percpu.h"
+#include "tcmalloc/internal/sysinfo.h"
 #include "tcmalloc/malloc_extension.h"
 
 // When compiled 64-bit and run on systems with swap several unittests will end
@@ -279,6 +281,25 @@ class ScopedFakeCpuId {
   friend class tcmalloc_internal::subtle::percpu::VirtualCpu;
 };
 
+// Makes NumCPUs() report <num_cpus> while in scope, to size per-CPU structures
+// for a larger machine than the one the test runs on.  Combine with
+// ScopedFakeCpuId to use the extra CPUs.  Anything sized by NumCPUs() in scope
+// must be torn down before the scope ends.
+class ScopedFakeNumCPUs {
+ public:
+  explicit ScopedFakeNumCPUs(int num_cpus)
+      : previous_(tcmalloc_internal::sysinfo_internal::num_cpus_for_testing
+                      .exchange(num_cpus, std::memory_order_relaxed)) {}
+
+  ~ScopedFakeNumCPUs() {
+    tcmalloc_internal::sysinfo_internal::num_cpus_for_testing.store(
+        previous_, std::memory_order_relaxed);
+  }
+
+ private:
+  const int previous_;
+};
+
 // This pragma ensures that a loop does not get unrolled, in which case the
 // different loop iterations would map to different call sites instead of the
 // same ones as expected by some tests. Supported pragmas differ between GCC and
@@ -0,0 +1,142 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Test MallocExtension::SetThreadAllocationBudget functionality
+
+#include <stddef.h>
+
+#include <new>
+#include <optional>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "gtest/gtest.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+// The budget is brought up to date at least this often.
+constexpr size_t kSlack = 256 << 10;
+
+struct Exceeded {
+  int calls = 0;
+  size_t allocated_bytes = 0;
+};
+
+void RecordExceeded(void* arg, size_t allocated_bytes) {
+  auto* exceeded = static_cast<Exceeded*>(arg);
+  ++exceeded->calls;
+  exceeded->allocated_bytes = allocated_bytes;
+}
+
+// Allocates and frees `n` objects of `size` bytes.
+void Allocate(size_t size, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    void* ptr = ::operator new(size);
+    benchmark::DoNotOptimize(ptr);
+    ::operator delete(ptr);
+  }
+}
+
+class ThreadAllocationBudgetTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    if (MallocExtension::GetStats().empty()) {
+      GTEST_SKIP() << "Not linked against TCMalloc";
+    }
+  }
+
+  void TearDown() override { MallocExtension::ClearThreadAllocationBudget(); }
+};
+
+TEST_F(ThreadAllocationBudgetTest, CallbackAfterBudgetIsCrossed) {
+  constexpr size_t kBudget = 16 << 20;
+  constexpr size_t kSize = 1000;
+  Exceeded exceeded;
+  MallocExtension::SetThreadAllocationBudget(kBudget, RecordExceeded,
+                                             &exceeded);
+
+  // Stay short of the budget, including the byte counted per allocation.
+  Allocate(kSize, kBudget / (2 * (kSize + 1)));
+  EXPECT_EQ(exceeded.calls, 0);
+  std::optional<size_t> allocated = MallocExtension::GetThreadAllocatedBytes();
+  ASSERT_TRUE(allocated.has_value());
+  EXPECT_GE(*allocated, kBudget / 2 - kSize);
+  EXPECT_LE(*allocated, kBudget / 2 + kSize);
+
+  Allocate(kSize, (kBudget / 2 + kSlack) / kSize + 1);
+  EXPECT_EQ(exceeded.calls, 1);
+  EXPECT_GT(exceeded.allocated_bytes, kBudget);
+  EXPECT_LE(exceeded.allocated_bytes, kBudget + kSlack + kSize + 1);
+
+  // The callback runs once per budget.
+  Allocate(kSize, 2 * kBudget / kSize);
+  EXPECT_EQ(exceeded.calls, 1);
+}
+
+TEST_F(ThreadAllocationBudgetTest, LargeAllocations) {
+  constexpr size_t kBudget = 8 << 20;
+  Exceeded exceeded;
+  MallocExtension::SetThreadAllocationBudget(kBudget, RecordExceeded,
+                                             &exceeded);
+  Allocate(1 << 20, 7);
+  EXPECT_EQ(exceeded.calls, 0);
+  Allocate(1 << 20, 2);
+  EXPECT_EQ(exceeded.calls, 1);
+}
+
+TEST_F(ThreadAllocationBudgetTest, SetRestartsCount) {
+  Exceeded exceeded;
+  MallocExtension::SetThreadAllocationBudget(1 << 20, RecordExceeded,
+                                             &exceeded);
+  Allocate(1000, 2000);
+  EXPECT_EQ(exceeded.calls, 1);
+
+  MallocExtension::SetThreadAllocationBudget(1 << 20, RecordExceeded,
+                                             &exceeded);
+  std::optional<size_t> allocated = MallocExtension::GetThreadAllocatedBytes();
+  ASSERT_TRUE(allocated.has_value());
+  EXPECT_LT(*allocated, 1000);
+  Allocate(1000, 2000);
+  EXPECT_EQ(exceeded.calls, 2);
+}
+
+TEST_F(ThreadAllocationBudgetTest, PerThread) {
+  Exceeded exceeded;
+  MallocExtension::SetThreadAllocationBudget(1 << 20, RecordExceeded,
+                                             &exceeded);
+  std::thread other([] {
+    EXPECT_EQ(MallocExtension::GetThreadAllocatedBytes(), std::nullopt);
+    Allocate(1000, 10000);
+  });
+  other.join();
+  EXPECT_EQ(exceeded.calls, 0);
+  std::optional<size_t> allocated = MallocExtension::GetThreadAllocatedBytes();
+  ASSERT_TRUE(allocated.has_value());
+  EXPECT_LT(*allocated, 1 << 20);
+}
+
+TEST_F(ThreadAllocationBudgetTest, Clear) {
+  Exceeded exceeded;
+  MallocExtension::SetThreadAllocationBudget(1 << 20, RecordExceeded,
+                                             &exceeded);
+  MallocExtension::ClearThreadAllocationBudget();
+  EXPECT_EQ(MallocExtension::GetThreadAllocatedBytes(), std::nullopt);
+  Allocate(1000, 10000);
+  EXPECT_EQ(exceeded.calls, 0);
+}
+
+}  // namespace
+}  // namespace tcmalloc
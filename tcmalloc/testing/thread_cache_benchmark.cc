@@ -0,0 +1,76 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks how thread caches scale with the number of threads.
+//
+// Like threadcachesize_test, every thread cycles through many size classes so
+// that its cache keeps outgrowing its budget and has to claim more from other
+// threads.  The variants without per-CPU caches are the interesting ones.
+
+#include <stddef.h>
+
+#include <new>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+void CycleSizes(int allocations) {
+  size_t size = 0;
+  for (int i = 0; i < allocations; ++i) {
+    void* p = ::operator new(size);
+    benchmark::DoNotOptimize(p);
+    ::operator delete(p, size);
+    size += 64;
+    if (size > (32 << 10)) size = 0;
+  }
+}
+
+// Long-lived threads, all growing their caches at once.
+void BM_ThreadCacheGrowth(benchmark::State& state) {
+  constexpr int kAllocations = 1000;
+  for (auto _ : state) {
+    CycleSizes(kAllocations);
+  }
+  state.SetItemsProcessed(state.iterations() * kAllocations);
+}
+BENCHMARK(BM_ThreadCacheGrowth)->ThreadRange(1, 256)->UseRealTime();
+
+// Short-lived threads, whose budget returns to the pool when they exit and
+// is claimed by the next ones.
+void BM_ThreadCacheChurn(benchmark::State& state) {
+  const int num_threads = state.range(0);
+  constexpr int kAllocations = 1000;
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads);
+  for (auto _ : state) {
+    for (int i = 0; i < num_threads; ++i) {
+      threads.emplace_back(CycleSizes, kAllocations);
+    }
+    for (std::thread& t : threads) {
+      t.join();
+    }
+    threads.clear();
+  }
+  state.SetItemsProcessed(state.iterations() * num_threads * kAllocations);
+  state.counters["per_cpu_caches"] = MallocExtension::PerCpuCachesActive();
+}
+BENCHMARK(BM_ThreadCacheChurn)->Range(1, 256)->UseRealTime();
+
+}  // namespace
+}  // namespace tcmalloc
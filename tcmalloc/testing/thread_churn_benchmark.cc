@@ -0,0 +1,64 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures what a thread pays for its allocator state in thread-per-request
+// servers, where threads live only long enough to make a few allocations.
+//
+// Every iteration starts a thread that makes and frees the given number of
+// small allocations, and joins it, so the iteration time covers the thread's
+// first-allocation setup (per-CPU registration, Sampler seeding, or a
+// ThreadCache when per-CPU caches are off) and its teardown.  The variant
+// without allocations is the cost of the thread itself, to compare against.
+
+#include <stddef.h>
+
+#include <new>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "benchmark/benchmark.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+void HandleRequest(int allocations) {
+  for (int i = 0; i < allocations; ++i) {
+    // Cycle through small sizes from 16 bytes to 2 KiB.
+    const size_t size = size_t{16} << (i % 8);
+    void* p = ::operator new(size);
+    benchmark::DoNotOptimize(p);
+    ::operator delete(p, size);
+  }
+}
+
+void BM_ThreadChurn(benchmark::State& state) {
+  const int allocations = state.range(0);
+  for (auto _ : state) {
+    std::thread t(HandleRequest, allocations);
+    t.join();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["per_cpu_caches"] = MallocExtension::PerCpuCachesActive();
+}
+BENCHMARK(BM_ThreadChurn)
+    ->ArgName("allocations")
+    ->Arg(0)
+    ->Arg(1)
+    ->Arg(16)
+    ->Arg(256)
+    ->ThreadRange(1, 32)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace tcmalloc
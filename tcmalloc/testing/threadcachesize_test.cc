@@ -16,9 +16,11 @@
 
 #include <stddef.h>
 
+#include <string>
 #include <thread>  // NOLINT(build/c++11)
 #include <vector>
 
+#include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/base/attributes.h"
 #include "absl/base/const_init.h"
@@ -103,5 +105,24 @@ TEST(ThreadCache, MaxCacheHonored) {
   }
 }
 
+TEST(ThreadCache, MissStats) {
+  if (MallocExtension::PerCpuCachesActive()) {
+    GTEST_SKIP() << "Thread caches are not in use";
+  }
+
+  absl::Barrier startfill(2);
+  absl::Barrier filled(2);
+  std::thread filler(Filler, &startfill, &filled);
+  startfill.Block();
+  filled.Block();
+  filler.join();
+
+  // The filler cycles through many size classes, so it must have missed.
+  const std::string stats = MallocExtension::GetStats();
+  EXPECT_THAT(stats, testing::HasSubstr("Thread cache misses:"));
+  EXPECT_THAT(stats, testing::Not(testing::HasSubstr(
+                         "Thread cache misses: 0 underflows")));
+}
+
 }  // namespace
 }  // namespace tcmalloc
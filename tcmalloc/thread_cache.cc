@@ -18,6 +18,7 @@
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <utility>
 
 #include "absl/base/attributes.h"
 #include "absl/base/const_init.h"
@@ -45,6 +46,9 @@ int64_t ThreadCache::unclaimed_cache_space_ = kDefaultOverallThreadCacheSize;
 ThreadCache* ThreadCache::thread_heaps_ = nullptr;
 int ThreadCache::thread_heap_count_ = 0;
 ThreadCache* ThreadCache::next_memory_steal_ = nullptr;
+ThreadCache::ThreadCacheMissStats ThreadCache::retired_misses_;
+ABSL_CONST_INIT ThreadCache::DonationShard
+    ThreadCache::donations_[kDonationShards] = {};
 ABSL_CONST_INIT thread_local ThreadCache* ThreadCache::thread_local_data_
     ABSL_ATTRIBUTE_INITIAL_EXEC = nullptr;
 ABSL_CONST_INIT bool ThreadCache::tsd_inited_ = false;
@@ -55,12 +59,14 @@ ThreadCache::ThreadCache(pthread_t tid) {
   threadcache_lock_.AssertHeld();
   size_ = 0;
 
-  max_size_ = 0;
+  max_size_.store(0, std::memory_order_relaxed);
+  // Spread threads across the donation shards.
+  donation_shard_ = thread_heap_count_ % kDonationShards;
   IncreaseCacheLimitLocked();
-  if (max_size_ == 0) {
+  if (max_size_.load(std::memory_order_relaxed) == 0) {
     // There isn't enough memory to go around.  Just give the minimum to
     // this thread.
-    max_size_ = kMinThreadCacheSize;
+    max_size_.store(kMinThreadCacheSize, std::memory_order_relaxed);
 
     // Take unclaimed_cache_space_ negative.
     unclaimed_cache_space_ -= kMinThreadCacheSize;
@@ -71,6 +77,9 @@ ThreadCache::ThreadCache(pthread_t tid) {
   prev_ = nullptr;
   tid_ = tid;
   in_setspecific_ = false;
+  underflows_.store(0, std::memory_order_relaxed);
+  overflows_.store(0, std::memory_order_relaxed);
+  resize_misses_ = 0;
   for (size_t size_class = 0; size_class < kNumClasses; ++size_class) {
     list_[size_class].Init();
   }
@@ -92,6 +101,7 @@ void ThreadCache::Cleanup() {
 void* ThreadCache::FetchFromTransferCache(size_t size_class, size_t byte_size) {
   FreeList* list = &list_[size_class];
   TC_ASSERT(list->empty());
+  RecordMiss(underflows_);
   const int batch_size = tc_globals.sizemap().num_objects_to_move(size_class);
 
   const int num_to_move = std::min<int>(list->max_length(), batch_size);
@@ -213,15 +223,49 @@ void ThreadCache::Scavenge() {
 }
 
 void ThreadCache::DeallocateSlow(void* ptr, FreeList* list, size_t size_class) {
+  RecordMiss(overflows_);
   if (ABSL_PREDICT_FALSE(list->length() > list->max_length())) {
     ListTooLong(list, size_class);
   }
-  if (size_ >= max_size_) {
+  if (size_ >= max_size_.load(std::memory_order_relaxed)) {
     Scavenge();
   }
 }
 
+bool ThreadCache::TakeDonation() {
+  for (int i = 0; i < kDonationShards; ++i) {
+    std::atomic<int64_t>& bytes =
+        donations_[(donation_shard_ + i) % kDonationShards].bytes;
+    int64_t available = bytes.load(std::memory_order_relaxed);
+    while (available >= static_cast<int64_t>(kStealAmount)) {
+      if (bytes.compare_exchange_weak(available, available - kStealAmount,
+                                      std::memory_order_relaxed)) {
+        max_size_.fetch_add(kStealAmount, std::memory_order_relaxed);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+int64_t ThreadCache::DrainDonations() {
+  int64_t total = 0;
+  for (DonationShard& shard : donations_) {
+    total += shard.bytes.exchange(0, std::memory_order_relaxed);
+  }
+  return total;
+}
+
+int64_t ThreadCache::DonatedBytes() {
+  int64_t total = 0;
+  for (const DonationShard& shard : donations_) {
+    total += shard.bytes.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
 void ThreadCache::IncreaseCacheLimit() {
+  if (TakeDonation()) return;
   AllocationGuardSpinLockHolder l(threadcache_lock_);
   IncreaseCacheLimitLocked();
 }
@@ -230,9 +274,10 @@ void ThreadCache::IncreaseCacheLimitLocked() {
   if (unclaimed_cache_space_ > 0) {
     // Possibly make unclaimed_cache_space_ negative.
     unclaimed_cache_space_ -= kStealAmount;
-    max_size_ += kStealAmount;
+    max_size_.fetch_add(kStealAmount, std::memory_order_relaxed);
     return;
   }
+  if (TakeDonation()) return;
   // Don't hold pageheap_lock too long.  Try to steal from 10 other
   // threads before giving up.  The i < 10 condition also prevents an
   // infinite loop in case none of the existing thread heaps are
@@ -244,11 +289,13 @@ void ThreadCache::IncreaseCacheLimitLocked() {
       next_memory_steal_ = thread_heaps_;
     }
     if (next_memory_steal_ == this ||
-        next_memory_steal_->max_size_ <= kMinThreadCacheSize) {
+        next_memory_steal_->max_size_.load(std::memory_order_relaxed) <=
+            kMinThreadCacheSize) {
       continue;
     }
-    next_memory_steal_->max_size_ -= kStealAmount;
-    max_size_ += kStealAmount;
+    next_memory_steal_->max_size_.fetch_sub(kStealAmount,
+                                            std::memory_order_relaxed);
+    max_size_.fetch_add(kStealAmount, std::memory_order_relaxed);
 
     next_memory_steal_ = next_memory_steal_->next_;
     return;
@@ -377,7 +424,11 @@ void ThreadCache::DeleteCache(ThreadCache* heap) {
 
     if (next_memory_steal_ == heap) next_memory_steal_ = heap->next_;
     if (next_memory_steal_ == nullptr) next_memory_steal_ = thread_heaps_;
-    unclaimed_cache_space_ += heap->max_size_;
+    retired_misses_ += heap->miss_stats();
+    // Leave the budget for other threads to claim without the lock.  This
+    // happens under the lock so that RecomputePerThreadCacheSize sees it
+    // either in max_size_ or in the pool.
+    heap->Donate(heap->max_size_.load(std::memory_order_relaxed));
   }
 
   tc_globals.threadcache_allocator().Delete(heap);
@@ -393,14 +444,18 @@ void ThreadCache::RecomputePerThreadCacheSize() {
   if (space > kMaxThreadCacheSize) space = kMaxThreadCacheSize;
 
   double ratio = space / std::max<double>(1, per_thread_cache_size_);
+  // Fold the donated budget back into unclaimed_cache_space_ below.
+  DrainDonations();
   size_t claimed = 0;
   for (ThreadCache* h = thread_heaps_; h != nullptr; h = h->next_) {
+    size_t max_size = h->max_size_.load(std::memory_order_relaxed);
     // Increasing the total cache size should not circumvent the
     // slow-start growth of max_size_.
     if (ratio < 1.0) {
-      h->max_size_ *= ratio;
+      max_size *= ratio;
+      h->max_size_.store(max_size, std::memory_order_relaxed);
     }
-    claimed += h->max_size_;
+    claimed += max_size;
   }
   unclaimed_cache_space_ =
       overall_thread_cache_size_.load(std::memory_order_relaxed) - claimed;
@@ -422,6 +477,89 @@ AllocatorStats ThreadCache::GetStats(uint64_t* total_bytes,
   return tc_globals.threadcache_allocator().stats();
 }
 
+ThreadCache::ThreadCacheMissStats ThreadCache::GetMissStats() {
+  AllocationGuardSpinLockHolder l(threadcache_lock_);
+
+  ThreadCacheMissStats total = retired_misses_;
+  for (ThreadCache* h = thread_heaps_; h != nullptr; h = h->next_) {
+    total += h->miss_stats();
+  }
+  return total;
+}
+
+void ThreadCache::ResizeThreadCaches() {
+  // Like CpuCache::ShuffleCpuCaches, only grow the few caches that missed the
+  // most, so that the budget isn't spread thinly across every thread.
+  constexpr int kMaxCachesToGrow = 5;
+  ThreadCache* grow[kMaxCachesToGrow] = {};
+  size_t grow_misses[kMaxCachesToGrow] = {};
+
+  AllocationGuardSpinLockHolder l(threadcache_lock_);
+  for (ThreadCache* h = thread_heaps_; h != nullptr; h = h->next_) {
+    const ThreadCacheMissStats stats = h->miss_stats();
+    const size_t total = stats.underflows + stats.overflows;
+    size_t misses = total - h->resize_misses_;
+    h->resize_misses_ = total;
+
+    if (misses == 0) {
+      // The thread was idle, or its cache was big enough.  Either way it can
+      // do with less, and shrinking max_size_ below size_ makes it scavenge.
+      const size_t max_size = h->max_size_.load(std::memory_order_relaxed);
+      if (max_size > kMinThreadCacheSize) {
+        const size_t reclaim = (max_size - kMinThreadCacheSize) / 2;
+        h->max_size_.fetch_sub(reclaim, std::memory_order_relaxed);
+        h->Donate(reclaim);
+      }
+      continue;
+    }
+
+    // Keep grow[] sorted by descending misses.
+    ThreadCache* candidate = h;
+    for (int i = 0; i < kMaxCachesToGrow && candidate != nullptr; ++i) {
+      if (misses > grow_misses[i]) {
+        std::swap(misses, grow_misses[i]);
+        std::swap(candidate, grow[i]);
+      }
+    }
+  }
+
+  for (int i = 0; i < kMaxCachesToGrow && grow[i] != nullptr; ++i) {
+    if (grow[i]->max_size_.load(std::memory_order_relaxed) + kStealAmount >
+        kMaxThreadCacheSize) {
+      continue;
+    }
+    if (unclaimed_cache_space_ >= static_cast<int64_t>(kStealAmount)) {
+      grow[i]->max_size_.fetch_add(kStealAmount, std::memory_order_relaxed);
+      unclaimed_cache_space_ -= kStealAmount;
+    } else if (!grow[i]->TakeDonation()) {
+      break;
+    }
+  }
+}
+
+void ThreadCache::Print(Printer& out) {
+  const ThreadCacheMissStats misses = GetMissStats();
+  AllocationGuardSpinLockHolder l(threadcache_lock_);
+  out.printf("------------------------------------------------\n");
+  out.printf(
+      "Thread caches: %d caches, %lld bytes unclaimed, %lld bytes donated\n",
+      thread_heap_count_, unclaimed_cache_space_, DonatedBytes());
+  out.printf("------------------------------------------------\n");
+  out.printf("Thread cache misses: %zu underflows, %zu overflows\n",
+             misses.underflows, misses.overflows);
+}
+
+void ThreadCache::PrintInPbtxt(PbtxtRegion& region) {
+  const ThreadCacheMissStats misses = GetMissStats();
+  AllocationGuardSpinLockHolder l(threadcache_lock_);
+  PbtxtRegion entry = region.CreateSubRegion("thread_cache");
+  entry.PrintI64("caches", thread_heap_count_);
+  entry.PrintI64("unclaimed_bytes", unclaimed_cache_space_);
+  entry.PrintI64("donated_bytes", DonatedBytes());
+  entry.PrintI64("underflows", misses.underflows);
+  entry.PrintI64("overflows", misses.overflows);
+}
+
 void ThreadCache::set_overall_thread_cache_size(size_t new_size) {
   // Clip the value to a reasonable minimum
   if (new_size < kMinThreadCacheSize) new_size = kMinThreadCacheSize;
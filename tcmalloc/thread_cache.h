@@ -20,12 +20,15 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <atomic>
+
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/linked_list.h"
+#include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/percpu_state.h"
 #include "tcmalloc/metadata_object_allocator.h"
 #include "tcmalloc/static_vars.h"
@@ -72,6 +75,36 @@ class ABSL_CACHELINE_ALIGNED ThreadCache {
     return overall_thread_cache_size_.load(std::memory_order_relaxed);
   }
 
+  // Counterpart of CpuCache::CpuCacheMissStats.  An underflow is an
+  // allocation that found its freelist empty, an overflow a deallocation that
+  // took a list past its max length or the cache past its max size.
+  struct ThreadCacheMissStats {
+    size_t underflows = 0;
+    size_t overflows = 0;
+
+    ThreadCacheMissStats& operator+=(const ThreadCacheMissStats rhs) {
+      underflows += rhs.underflows;
+      overflows += rhs.overflows;
+      return *this;
+    }
+  };
+
+  // Reports total underflows and overflows of all thread caches, including
+  // those of exited threads.
+  static ThreadCacheMissStats GetMissStats()
+      ABSL_LOCKS_EXCLUDED(threadcache_lock_);
+
+  // Moves cache size budget towards the threads that missed the most since
+  // the last call.  Threads that did not miss at all give back half of their
+  // budget above kMinThreadCacheSize, which makes them scavenge on their next
+  // deallocation.  Called periodically by the background thread when per-cpu
+  // caches are not in use.
+  static void ResizeThreadCaches() ABSL_LOCKS_EXCLUDED(threadcache_lock_);
+
+  static void Print(Printer& out) ABSL_LOCKS_EXCLUDED(threadcache_lock_);
+  static void PrintInPbtxt(PbtxtRegion& region)
+      ABSL_LOCKS_EXCLUDED(threadcache_lock_);
+
  private:
   friend void TCMalloc_Internal_DestroyThreadCache(ThreadCache* absl_nullable);
 
@@ -138,11 +171,34 @@ class ABSL_CACHELINE_ALIGNED ThreadCache {
   // Releases N items from this thread cache.
   void ReleaseToTransferCache(FreeList* src, size_t size_class, int N);
 
-  // Increase max_size_ by reducing unclaimed_cache_space_ or by
-  // reducing the max_size_ of some other thread.  In both cases,
-  // the delta is kStealAmount.
+  // Increase max_size_ by taking from the donation pool, by reducing
+  // unclaimed_cache_space_ or by reducing the max_size_ of some other thread.
+  // In all cases, the delta is kStealAmount.
   void IncreaseCacheLimit();
 
+  // Budget given up by exiting and idle threads, sharded so that threads
+  // growing their caches can claim it with a CAS rather than
+  // threadcache_lock_.  Counts towards overall_thread_cache_size_ alongside
+  // unclaimed_cache_space_.
+  static constexpr int kDonationShards = 16;
+  struct ABSL_CACHELINE_ALIGNED DonationShard {
+    std::atomic<int64_t> bytes;
+  };
+  static DonationShard donations_[kDonationShards];
+
+  void Donate(size_t bytes) {
+    donations_[donation_shard_].bytes.fetch_add(bytes,
+                                                std::memory_order_relaxed);
+  }
+
+  // Claims kStealAmount from the donation pool, starting at this thread's
+  // shard.  Returns false if no shard has enough.
+  bool TakeDonation();
+
+  // Returns the donated budget, resetting the pool.
+  static int64_t DrainDonations();
+  static int64_t DonatedBytes();
+
   static absl::base_internal::SpinLock threadcache_lock_;
 
   // Same as above but called with threadcache_lock_ held.
@@ -201,7 +257,20 @@ class ABSL_CACHELINE_ALIGNED ThreadCache {
   FreeList list_[kNumClasses];  // Array indexed by size-class
 
   size_t size_;      // Combined size of data
-  size_t max_size_;  // size_ > max_size_ --> Scavenge()
+  // size_ > max_size_ --> Scavenge().  Other threads shrink it while stealing.
+  std::atomic<size_t> max_size_;
+  uint8_t donation_shard_;
+
+  // Written only by the owning thread, read by GetMissStats() and
+  // ResizeThreadCaches().
+  std::atomic<size_t> underflows_;
+  std::atomic<size_t> overflows_;
+  // underflows_ + overflows_ as of the last ResizeThreadCaches().
+  size_t resize_misses_ ABSL_GUARDED_BY(threadcache_lock_);
+
+  // Misses of the thread caches that have been deleted.
+  static ThreadCacheMissStats retired_misses_
+      ABSL_GUARDED_BY(threadcache_lock_);
 
   pthread_t tid_;
   bool in_setspecific_;
@@ -214,6 +283,16 @@ class ABSL_CACHELINE_ALIGNED ThreadCache {
   static void DestroyThreadCache(ThreadCache* ptr);
 
   static void DeleteCache(ThreadCache* heap);
+
+  static void RecordMiss(std::atomic<size_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+
+  ThreadCacheMissStats miss_stats() const {
+    return {underflows_.load(std::memory_order_relaxed),
+            overflows_.load(std::memory_order_relaxed)};
+  }
   static void RecomputePerThreadCacheSize()
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(threadcache_lock_);
 
@@ -240,7 +319,8 @@ inline void ABSL_ATTRIBUTE_ALWAYS_INLINE
 ThreadCache::Deallocate(void* ptr, size_t size_class) {
   FreeList* list = &list_[size_class];
   size_ += tc_globals.sizemap().class_to_size(size_class);
-  ssize_t size_headroom = max_size_ - size_ - 1;
+  ssize_t size_headroom =
+      max_size_.load(std::memory_order_relaxed) - size_ - 1;
 
   list->Push(ptr);
   ssize_t list_headroom =
@@ -16,12 +16,15 @@
 
 #include <fcntl.h>
 #include <string.h>
+#include <strings.h>
 
 #include <new>
 
 #include "absl/base/attributes.h"
 #include "absl/types/span.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/environment.h"
+#include "tcmalloc/parameters.h"
 #include "tcmalloc/static_vars.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
@@ -39,10 +42,21 @@ size_t StaticForwarder::num_objects_to_move(int size_class) {
 void* StaticForwarder::Alloc(size_t size, std::align_val_t alignment) {
   return tc_globals.arena().Alloc(size, alignment);
 }
+int StaticForwarder::numa_borrow_batches() {
+  if (!tc_globals.numa_topology().numa_aware()) return 0;
+  return Parameters::numa_remote_borrow_batches();
+}
 
 ABSL_CONST_INIT bool ShardedStaticForwarder::use_generic_cache_(false);
 ABSL_CONST_INIT bool
     ShardedStaticForwarder::enable_cache_for_large_classes_only_(false);
+ABSL_CONST_INIT bool ShardedStaticForwarder::use_adaptive_cache_(false);
+
+bool ShardedStaticForwarder::AdaptiveCacheRequested() {
+  const char* e =
+      thread_safe_getenv("TCMALLOC_ADAPTIVE_SHARDED_TRANSFER_CACHE");
+  return e != nullptr && (strcmp(e, "1") == 0 || strcasecmp(e, "true") == 0);
+}
 
 void BackingTransferCache::InsertRange(absl::Span<void*> batch) const {
   tc_globals.transfer_cache().InsertRange(size_class_, batch);
@@ -34,6 +34,7 @@
 #include "tcmalloc/experiment.h"
 #include "tcmalloc/experiment_config.h"
 #include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
 #include "tcmalloc/internal/cache_topology.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -65,9 +66,15 @@ class StaticForwarder {
       tcmalloc::tcmalloc_internal::kHasExpandedClasses;
   static constexpr size_t kExpandedClassesStart =
       tcmalloc::tcmalloc_internal::kExpandedClassesStart;
+  static constexpr size_t kNumaPartitions =
+      tcmalloc::tcmalloc_internal::kNumaPartitions;
 
   static size_t class_to_size(int size_class);
   static size_t num_objects_to_move(int size_class);
+  // Returns the number of batches the remote NUMA partition's transfer cache
+  // must hold before an empty local one may borrow from it, or 0 if borrowing
+  // is disabled or NUMA awareness is off.
+  static int numa_borrow_batches();
   static void* absl_nonnull Alloc(size_t size,
                                   std::align_val_t alignment = kAlignment);
 };
@@ -86,6 +93,9 @@ class ShardedStaticForwarder : public StaticForwarder {
     // classes alone.
     enable_cache_for_large_classes_only_ = IsExperimentActive(
         Experiment::TEST_ONLY_TCMALLOC_SHARDED_TRANSFER_CACHE);
+    // The adaptive configuration builds on the generic cache and picks the
+    // number of shards of each size class at runtime.
+    use_adaptive_cache_ = use_generic_cache_ && AdaptiveCacheRequested();
   }
 
   static bool UseGenericCache() { return use_generic_cache_; }
@@ -94,9 +104,15 @@ class ShardedStaticForwarder : public StaticForwarder {
     return enable_cache_for_large_classes_only_;
   }
 
+  static bool UseAdaptiveCache() { return use_adaptive_cache_; }
+
  private:
+  // Returns true if TCMALLOC_ADAPTIVE_SHARDED_TRANSFER_CACHE is set.
+  static bool AdaptiveCacheRequested();
+
   static bool use_generic_cache_;
   static bool enable_cache_for_large_classes_only_;
+  static bool use_adaptive_cache_;
 };
 
 class ProdCpuLayout {
@@ -136,6 +152,18 @@ class ShardedTransferCacheManagerBase {
   // NUMA nodes to disable cache when we have only one cache domain per NUMA
   // node. kMinShardsAllowed is a workaround for now that hardcodes this.
   static constexpr int kMinShardsAllowed = 3;
+  // The adaptive cache only shards size classes that benefit from it, so it
+  // is also worthwhile on hosts with two cache domains, e.g. two sockets.
+  static constexpr int kMinShardsAllowedForAdaptive = 2;
+
+  // Thresholds used by AdaptShards, per adaptation interval.  A size class is
+  // spread over more shards when at least kMinTransfersToShard batches moved
+  // through the transfer caches and 1 in kContentionRatio of them found the
+  // cache lock held.  It collapses back to the unsharded transfer cache, one
+  // halving at a time, when fewer than kIdleTransfers batches moved.
+  static constexpr uint64_t kMinTransfersToShard = 1024;
+  static constexpr uint64_t kContentionRatio = 32;
+  static constexpr uint64_t kIdleTransfers = 16;
 
   void Init() {
     owner_->Init();
@@ -147,6 +175,8 @@ class ShardedTransferCacheManagerBase {
     for (int shard = 0; shard < num_shards_; ++shard) {
       new (&shards_[shard]) Shard;
     }
+    adaptive_ = UseAdaptiveCache() && !UseCacheForLargeClassesOnly() &&
+                num_shards_ >= kMinShardsAllowedForAdaptive;
     for (int size_class = 0; size_class < kNumClasses; ++size_class) {
       const int size_per_object = Manager::class_to_size(size_class);
       // We enable sharded transfer cache for all the size classes when a
@@ -159,15 +189,72 @@ class ShardedTransferCacheManagerBase {
       // cache domains, the traditional LIFO transfer cache should suffice.
       int min_size = UseGenericCache() ? 0 : 4096;
       bool use_sharded_cache =
-          UseCacheForLargeClassesOnly() ||
+          UseCacheForLargeClassesOnly() || adaptive_ ||
           (UseGenericCache() && (num_shards_ >= kMinShardsAllowed));
       active_for_class_[size_class] =
           use_sharded_cache && size_per_object >= min_size;
+      // Adaptive size classes start out unsharded and are spread out by
+      // AdaptShards once they show contention.
+      class_shards_[size_class].store(
+          active_for_class_[size_class] && !adaptive_ ? num_shards_ : 0,
+          std::memory_order_relaxed);
     }
   }
 
   bool should_use(int size_class) const {
-    return active_for_class_[size_class];
+    return class_shards_[size_class].load(std::memory_order_relaxed) != 0;
+  }
+
+  bool adaptive() const { return adaptive_; }
+
+  // Returns the number of shards size_class is currently spread over, or 0 if
+  // it uses the unsharded transfer cache.
+  int ShardsForClass(int size_class) const {
+    return class_shards_[size_class].load(std::memory_order_relaxed);
+  }
+
+  // Returns the shard count a size class should use for the next interval,
+  // given the batches that moved through its transfer caches and how many of
+  // them found the cache lock held during the last interval.
+  static int NextShardCount(int current, uint64_t transfers,
+                            uint64_t contentions, int max_shards) {
+    if (max_shards < kMinShardsAllowedForAdaptive) return 0;
+    if (transfers >= kMinTransfersToShard &&
+        contentions * kContentionRatio >= transfers) {
+      return current == 0 ? kMinShardsAllowedForAdaptive
+                          : std::min(current * 2, max_shards);
+    }
+    if (transfers < kIdleTransfers) {
+      const int halved = current / 2;
+      return halved < kMinShardsAllowedForAdaptive ? 0 : halved;
+    }
+    return current;
+  }
+
+  // When the adaptive cache is enabled, updates the number of shards of each
+  // size class based on the traffic seen since the previous call.  backing is
+  // the unsharded transfer cache manager.  Objects left in shards that are no
+  // longer used return to the backing cache through Plunder.
+  template <typename BackingManager>
+  void AdaptShards(const BackingManager& backing) {
+    if (!adaptive_) return;
+    for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+      if (!active_for_class_[size_class]) continue;
+      const TransferCacheStats b = backing.GetStats(size_class);
+      const TransferCacheStats s = GetStats(size_class);
+      // Misses of the sharded caches are also seen by the backing cache, so
+      // only count the sharded hits.
+      const uint64_t transfers = b.insert_hits + b.insert_misses +
+                                 b.remove_hits + b.remove_misses +
+                                 s.insert_hits + s.remove_hits;
+      const uint64_t contentions = b.lock_contentions + s.lock_contentions;
+      AdaptiveSample& last = last_sample_[size_class];
+      const int next = NextShardCount(
+          ShardsForClass(size_class), transfers - last.transfers,
+          contentions - last.contentions, num_shards_);
+      last = {transfers, contentions};
+      class_shards_[size_class].store(next, std::memory_order_relaxed);
+    }
   }
 
   size_t TotalBytes() const {
@@ -215,9 +302,10 @@ class ShardedTransferCacheManagerBase {
     out.printf("of the sharded transfer cache freelists.\n");
     out.printf("It also reports insert/remove hits/misses by size class.\n");
     out.printf("------------------------------------------------\n");
-    out.printf("Sharded transfer cache state: %s\n",
+    out.printf("Sharded transfer cache state: %s%s\n",
                UseCacheForLargeClassesOnly() || UseGenericCache() ? "ACTIVE"
-                                                                  : "INACTIVE");
+                                                                  : "INACTIVE",
+               adaptive_ ? " (adaptive)" : "");
     out.printf("Number of active sharded transfer caches: %3d\n",
                NumActiveShards());
     out.printf("------------------------------------------------\n");
@@ -243,12 +331,14 @@ class ShardedTransferCacheManagerBase {
           " objs; %5.1f MiB; %6.1f cum MiB; %5u capacity; %8u"
           " max_capacity; %8u insert hits; %8u"
           " insert misses (%10lu object misses); %8u remove hits; %8u"
-          " remove misses (%10lu object misses); %3.5f frontline hit rate\n",
+          " remove misses (%10lu object misses); %3.5f frontline hit rate;"
+          " %8u lock contentions; %3d shards\n",
           size_class, Manager::class_to_size(size_class), stats.used,
           class_bytes / MiB, sharded_cumulative_bytes / MiB, stats.capacity,
           stats.max_capacity, stats.insert_hits, stats.insert_misses,
           stats.insert_object_misses, stats.remove_hits, stats.remove_misses,
-          stats.remove_object_misses, hit_rate);
+          stats.remove_object_misses, hit_rate, stats.lock_contentions,
+          ShardsForClass(size_class));
     }
   }
 
@@ -267,9 +357,12 @@ class ShardedTransferCacheManagerBase {
       entry.PrintI64("used", stats.used);
       entry.PrintI64("capacity", stats.capacity);
       entry.PrintI64("max_capacity", stats.max_capacity);
+      entry.PrintI64("lock_contentions", stats.lock_contentions);
+      entry.PrintI64("shards", ShardsForClass(size_class));
       entry.PrintI64("frontend_allocations", counts[size_class].value());
     }
     region.PrintI64("active_sharded_transfer_caches", NumActiveShards());
+    region.PrintBool("adaptive_sharded_transfer_cache", adaptive_);
   }
 
   // Returns cumulative stats over all the shards of the sharded transfer cache.
@@ -289,6 +382,10 @@ class ShardedTransferCacheManagerBase {
       stats.used += shard_stats.used;
       stats.capacity += shard_stats.capacity;
       stats.max_capacity += shard_stats.max_capacity;
+      stats.lock_contentions += shard_stats.lock_contentions;
+      stats.interval_inserted += shard_stats.interval_inserted;
+      stats.interval_removed += shard_stats.interval_removed;
+      stats.interval_misses += shard_stats.interval_misses;
     }
     return stats;
   }
@@ -316,7 +413,8 @@ class ShardedTransferCacheManagerBase {
 
   int tc_length(int cpu, int size_class) const {
     if (shards_ == nullptr) return 0;
-    const uint8_t shard = cpu_layout_->CpuShard(cpu);
+    const uint8_t shard =
+        ShardForClass(size_class, cpu_layout_->CpuShard(cpu));
     TC_ASSERT_LT(shard, num_shards_);
     if (!shard_initialized(shard)) return 0;
     return shards_[shard].transfer_caches[size_class].tc_length();
@@ -340,7 +438,7 @@ class ShardedTransferCacheManagerBase {
 
  private:
   using TransferCache =
-      internal_transfer_cache::TransferCache<FreeList, Manager>;
+      internal_transfer_cache::DefaultTransferCache<FreeList, Manager>;
 
   // Store the transfer cache pointers and information about whether they are
   // initialized next to each other.
@@ -365,12 +463,13 @@ class ShardedTransferCacheManagerBase {
   Capacity LargeCacheCapacity(size_t size_class) const {
     const int size_per_object = Manager::class_to_size(size_class);
     static constexpr int k12MB = 12 << 20;
-    const int capacity = should_use(size_class) ? k12MB / size_per_object : 0;
+    const int capacity =
+        active_for_class_[size_class] ? k12MB / size_per_object : 0;
     return {capacity, capacity};
   }
 
   Capacity ScaledCacheCapacity(size_t size_class) const {
-    if (!should_use(size_class)) return {0, 0};
+    if (!active_for_class_[size_class]) return {0, 0};
     auto [capacity, max_capacity] = TransferCache::CapacityNeeded(size_class);
     return {capacity, max_capacity};
   }
@@ -394,11 +493,20 @@ class ShardedTransferCacheManagerBase {
     shard.initialized.store(true, std::memory_order_release);
   }
 
+  // Maps the cache domain of a CPU to the shard it uses for size_class.  When
+  // a size class uses fewer shards than there are cache domains, neighbouring
+  // domains share a shard.
+  uint8_t ShardForClass(int size_class, uint8_t domain) const {
+    const int n = class_shards_[size_class].load(std::memory_order_relaxed);
+    if (n == 0 || n >= num_shards_) return domain;
+    return domain * n / num_shards_;
+  }
+
   // Returns the cache shard corresponding to the given size class and the
   // current cpu's L3 node. The cache will be initialized if required.
   TransferCache& get_cache(int size_class) {
-    const uint8_t shard_index =
-        cpu_layout_->CpuShard(cpu_layout_->CurrentCpu());
+    const uint8_t shard_index = ShardForClass(
+        size_class, cpu_layout_->CpuShard(cpu_layout_->CurrentCpu()));
     TC_ASSERT_LT(shard_index, num_shards_);
     Shard& shard = shards_[shard_index];
     absl::base_internal::LowLevelCallOnce(
@@ -409,7 +517,18 @@ class ShardedTransferCacheManagerBase {
   Shard* shards_ = nullptr;
   int num_shards_ = 0;
   std::atomic<int> active_shards_ = 0;
+  // Whether a sharded cache is configured for each size class.
   bool active_for_class_[kNumClasses] = {false};
+  // Number of shards each size class currently uses; 0 routes the size class
+  // to the unsharded transfer cache.  Fixed at Init unless adaptive_.
+  std::atomic<int> class_shards_[kNumClasses] = {};
+  bool adaptive_ = false;
+  // Cumulative counters observed by the previous AdaptShards call.
+  struct AdaptiveSample {
+    uint64_t transfers;
+    uint64_t contentions;
+  };
+  AdaptiveSample last_sample_[kNumClasses] = {};
   Manager* const owner_;
   CpuLayout* const cpu_layout_;
 };
@@ -421,9 +540,10 @@ using ShardedTransferCacheManager =
 class TransferCacheManager : public StaticForwarder {
   template <typename CentralFreeList, typename Manager>
   friend class internal_transfer_cache::TransferCache;
-  using TransferCache =
-      internal_transfer_cache::TransferCache<tcmalloc_internal::CentralFreeList,
-                                             TransferCacheManager>;
+  template <typename CentralFreeList, typename Manager>
+  friend class internal_transfer_cache::RingTransferCache;
+  using TransferCache = internal_transfer_cache::DefaultTransferCache<
+      tcmalloc_internal::CentralFreeList, TransferCacheManager>;
 
   friend class FakeMultiClassTransferCacheManager;
 
@@ -440,9 +560,52 @@ class TransferCacheManager : public StaticForwarder {
   }
 
   [[nodiscard]] int RemoveRange(int size_class, absl::Span<void*> batch) {
+    if constexpr (kNumaPartitions > 1) {
+      const int got = TryBorrowFromRemoteNuma(size_class, batch);
+      if (got > 0) return got;
+    }
     return cache_[size_class].tc.RemoveRange(size_class, batch);
   }
 
+  // Returns whether `size_class` has a copy on the other NUMA partition.
+  // Class 0 and the expanded classes are shared by all partitions.
+  static constexpr bool HasRemoteNumaClass(int size_class) {
+    return kNumaPartitions > 1 && size_class > 0 &&
+           size_class < kExpandedClassesStart &&
+           size_class % kNumBaseClasses != 0;
+  }
+
+  // Returns the size class holding objects of the same size as `size_class`
+  // on the other NUMA partition.  Requires HasRemoteNumaClass(size_class).
+  static constexpr int RemoteNumaClass(int size_class) {
+    return size_class < kNumBaseClasses ? size_class + kNumBaseClasses
+                                        : size_class - kNumBaseClasses;
+  }
+
+  // Returns whether a partition should borrow from the remote partition's
+  // transfer cache rather than fall back to its own central freelist.  We only
+  // borrow when the local cache is empty, so that a miss would otherwise reach
+  // the page heap, and when the remote one holds enough batches that taking
+  // one is unlikely to push the remote partition to its own freelist.
+  static constexpr bool ShouldBorrowFromRemote(size_t local_length,
+                                               size_t remote_length,
+                                               size_t batch_size,
+                                               int borrow_batches) {
+    return borrow_batches > 0 && local_length == 0 &&
+           remote_length >= static_cast<size_t>(borrow_batches) * batch_size;
+  }
+
+  // Returns the number of batches and objects that `partition` borrowed from
+  // the other NUMA partition's transfer caches.
+  size_t numa_borrowed_batches(int partition) const {
+    TC_ASSERT_LT(partition, kNumaPartitions);
+    return numa_borrowed_batches_[partition].value();
+  }
+  size_t numa_borrowed_objects(int partition) const {
+    TC_ASSERT_LT(partition, kNumaPartitions);
+    return numa_borrowed_objects_[partition].value();
+  }
+
   // This is not const because the underlying ring-buffer transfer cache
   // function requires acquiring a lock.
   size_t tc_length(int size_class) const {
@@ -500,6 +663,11 @@ class TransferCacheManager : public StaticForwarder {
     return cache_[size_class].tc.FetchCommitIntervalMisses();
   }
 
+  internal_transfer_cache::IntervalFlow FetchCommitIntervalFlow(
+      int size_class) {
+    return cache_[size_class].tc.FetchCommitIntervalFlow();
+  }
+
   void Print(const StatsCounters<kNumClasses>& counts, Printer& out) const {
     out.printf("------------------------------------------------\n");
     out.printf("Used bytes, current capacity, and maximum allowed capacity\n");
@@ -535,6 +703,37 @@ class TransferCacheManager : public StaticForwarder {
           tc_stats.insert_object_misses, tc_stats.remove_hits,
           tc_stats.remove_misses, tc_stats.remove_object_misses, hit_rate);
     }
+    if (Parameters::transfer_cache_flow_sizing()) {
+      out.printf("------------------------------------------------\n");
+      out.printf("Transfer cache flow during the last resize interval,\n");
+      out.printf("sized for a %.0f%% hit rate.\n",
+                 100 * internal_transfer_cache::kFlowTargetHitRate);
+      out.printf("------------------------------------------------\n");
+      for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+        const TransferCacheStats tc_stats = GetStats(size_class);
+        const size_t objects =
+            tc_stats.interval_inserted + tc_stats.interval_removed;
+        if (objects == 0) continue;
+        const double hit_rate =
+            100. *
+            (objects - std::min(objects, tc_stats.interval_misses)) /
+            objects;
+        out.printf(
+            "class %3d [ %8zu bytes ] : %8u objs inserted; %8u objs removed;"
+            " %5.1f%% hit rate; %5u capacity\n",
+            size_class, class_to_size(size_class), tc_stats.interval_inserted,
+            tc_stats.interval_removed, hit_rate, tc_stats.capacity);
+      }
+    }
+    if constexpr (kNumaPartitions > 1) {
+      for (int partition = 0; partition < kNumaPartitions; ++partition) {
+        out.printf(
+            "NUMA partition %d: %8zu batches (%10zu objects) borrowed from "
+            "remote transfer caches\n",
+            partition, numa_borrowed_batches(partition),
+            numa_borrowed_objects(partition));
+      }
+    }
   }
 
   void PrintInPbtxt(const StatsCounters<kNumClasses>& counts,
@@ -554,6 +753,17 @@ class TransferCacheManager : public StaticForwarder {
       entry.PrintI64("capacity", tc_stats.capacity);
       entry.PrintI64("max_capacity", tc_stats.max_capacity);
       entry.PrintI64("frontend_allocations", counts[size_class].value());
+      entry.PrintI64("interval_inserted", tc_stats.interval_inserted);
+      entry.PrintI64("interval_removed", tc_stats.interval_removed);
+      entry.PrintI64("interval_misses", tc_stats.interval_misses);
+    }
+    if constexpr (kNumaPartitions > 1) {
+      for (int partition = 0; partition < kNumaPartitions; ++partition) {
+        PbtxtRegion entry = region.CreateSubRegion("numa_spill");
+        entry.PrintI64("partition", partition);
+        entry.PrintI64("borrowed_batches", numa_borrowed_batches(partition));
+        entry.PrintI64("borrowed_objects", numa_borrowed_objects(partition));
+      }
     }
   }
 
@@ -565,7 +775,35 @@ class TransferCacheManager : public StaticForwarder {
     TransferCache tc;
     bool dummy;
   };
+
+  // Hands out objects of `size_class` from the other NUMA partition's transfer
+  // cache when the spill policy allows it.  Borrowed objects keep belonging to
+  // the remote partition, so freeing them returns them to their home caches.
+  // Those still cached under `size_class` when the caches drain are sorted
+  // out by its central freelist, which returns them to the remote one.
+  int TryBorrowFromRemoteNuma(int size_class, absl::Span<void*> batch) {
+    if (!HasRemoteNumaClass(size_class)) return 0;
+    const int borrow_batches = numa_borrow_batches();
+    if (borrow_batches == 0) return 0;
+    const int remote = RemoteNumaClass(size_class);
+    if (!ShouldBorrowFromRemote(tc_length(size_class), tc_length(remote),
+                                num_objects_to_move(size_class),
+                                borrow_batches)) {
+      return 0;
+    }
+    const int got = cache_[remote].tc.TryRemoveRange(remote, batch);
+    if (got > 0) {
+      central_freelist(size_class).set_numa_lender(&central_freelist(remote));
+      const int partition = size_class / kNumBaseClasses;
+      numa_borrowed_batches_[partition].LossyAdd(1);
+      numa_borrowed_objects_[partition].LossyAdd(got);
+    }
+    return got;
+  }
+
   Cache cache_[kNumClasses];
+  StatsCounter numa_borrowed_batches_[kNumaPartitions];
+  StatsCounter numa_borrowed_objects_[kNumaPartitions];
 } ABSL_CACHELINE_ALIGNED;
 
 #else
@@ -625,6 +863,8 @@ struct ShardedTransferCacheManager {
   static constexpr void InsertRange(int size_class, absl::Span<void*> batch) {}
   static constexpr size_t TotalBytes() { return 0; }
   static constexpr void Plunder() {}
+  template <typename BackingManager>
+  static constexpr void AdaptShards(const BackingManager&) {}
   static int tc_length(int cpu, int size_class) { return 0; }
   static int TotalObjectsOfClass(int size_class) { return 0; }
   static constexpr TransferCacheStats GetStats(int size_class) { return {}; }
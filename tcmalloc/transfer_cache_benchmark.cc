@@ -35,6 +35,9 @@ using TransferCacheWithRealCFLEnv =
 using TransferCacheEnv =
     FakeTransferCacheEnvironment<internal_transfer_cache::TransferCache<
         MinimalFakeCentralFreeList, FakeTransferCacheManager>>;
+using RingTransferCacheEnv =
+    FakeTransferCacheEnvironment<internal_transfer_cache::RingTransferCache<
+        MinimalFakeCentralFreeList, FakeTransferCacheManager>>;
 static constexpr int kSizeClass = 0;
 
 template <typename Env>
@@ -223,6 +226,67 @@ void BM_RealisticHitRate(benchmark::State& state) {
       static_cast<double>(stats.remove_misses) / total_removes;
 }
 
+// All threads share a single cache and move batches in and out of it, which
+// is the access pattern where the spinlock of TransferCache is contended.
+// state.range(0) is the percentage of operations that are inserts; the
+// remaining ones are removes.
+template <typename Env>
+void BM_SharedCacheContention(benchmark::State& state) {
+  using Cache = typename Env::TransferCache;
+  const int kBatchSize = Env::kBatchSize;
+  const int kMaxObjectsToMove = Env::kMaxObjectsToMove;
+  void* batch[kMaxObjectsToMove];
+
+  struct SharedState {
+    SharedState() : m{}, c(&m, 1) {}
+    FakeTransferCacheManager m;
+    Cache c;
+  };
+
+  static SharedState* s = nullptr;
+  if (state.thread_index() == 0) {
+    s = new SharedState();
+    // Start half full, so that both inserts and removes can hit.
+    while (s->c.tc_length() < s->c.GetStats().capacity / 2) {
+      s->c.freelist().AllocateBatch({batch, kBatchSize});
+      s->c.InsertRange(kSizeClass, {batch, kBatchSize});
+    }
+  }
+
+  const int insert_percent = state.range(0);
+  absl::BitGen gen;
+  int held = 0;
+  for (auto iter : state) {
+    const bool insert =
+        held > 0 && absl::Uniform(gen, 0, 100) < insert_percent;
+    if (insert) {
+      s->c.InsertRange(kSizeClass, {batch, static_cast<size_t>(held)});
+      held = 0;
+    } else {
+      if (held > 0) {
+        s->c.freelist().FreeBatch({batch, static_cast<size_t>(held)});
+      }
+      held = s->c.RemoveRange(kSizeClass, {batch, kBatchSize});
+    }
+    benchmark::DoNotOptimize(batch);
+  }
+  if (held > 0) {
+    s->c.freelist().FreeBatch({batch, static_cast<size_t>(held)});
+  }
+
+  if (state.thread_index() == 0) {
+    TransferCacheStats stats = s->c.GetStats();
+    state.counters["insert_hit_ratio"] =
+        static_cast<double>(stats.insert_hits) /
+        (stats.insert_hits + stats.insert_misses);
+    state.counters["remove_hit_ratio"] =
+        static_cast<double>(stats.remove_hits) /
+        (stats.remove_hits + stats.remove_misses);
+    delete s;
+    s = nullptr;
+  }
+}
+
 BENCHMARK_TEMPLATE(BM_CrossThread, TransferCacheEnv)->ThreadRange(2, 64);
 BENCHMARK_TEMPLATE(BM_InsertRange, TransferCacheEnv);
 BENCHMARK_TEMPLATE(BM_RemoveRange, TransferCacheEnv);
@@ -230,6 +294,20 @@ BENCHMARK_TEMPLATE(BM_RealisticBatchNonBatchMutations, TransferCacheEnv);
 BENCHMARK_TEMPLATE(BM_RealisticHitRate, TransferCacheEnv);
 BENCHMARK_TEMPLATE(BM_RealisticHitRate, TransferCacheWithRealCFLEnv);
 
+BENCHMARK_TEMPLATE(BM_CrossThread, RingTransferCacheEnv)->ThreadRange(2, 64);
+BENCHMARK_TEMPLATE(BM_InsertRange, RingTransferCacheEnv);
+BENCHMARK_TEMPLATE(BM_RemoveRange, RingTransferCacheEnv);
+BENCHMARK_TEMPLATE(BM_RealisticHitRate, RingTransferCacheEnv);
+
+BENCHMARK_TEMPLATE(BM_SharedCacheContention, TransferCacheEnv)
+    ->ThreadRange(1, 64)
+    ->Arg(50)
+    ->Arg(90);
+BENCHMARK_TEMPLATE(BM_SharedCacheContention, RingTransferCacheEnv)
+    ->ThreadRange(1, 64)
+    ->Arg(50)
+    ->Arg(90);
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -24,6 +24,7 @@
 #include <atomic>
 #include <cstddef>
 #include <cstring>
+#include <new>
 
 #include "absl/base/attributes.h"
 #include "absl/base/const_init.h"
@@ -31,12 +32,15 @@
 #include "absl/base/nullability.h"
 #include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/numeric/bits.h"
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/atomic_stats_counter.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/probes.h"
+#include "tcmalloc/lock_contention_profiler.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/transfer_cache_stats.h"
 
@@ -76,6 +80,53 @@ class MissCounts {
   std::atomic<size_t> total_committed_ = {0};
 };
 
+// Objects inserted into and removed from a transfer cache, and those that
+// missed, during a resize interval.
+struct IntervalFlow {
+  size_t inserted;
+  size_t removed;
+  size_t misses;
+};
+
+// Turns the total objects inserted into and removed from a transfer cache into
+// the flow of the latest resize interval.
+class IntervalFlowCounter {
+ public:
+  // Returns the flow since the previous call, given the totals and the misses
+  // of the interval, and keeps it for Last().  Only called by the thread
+  // resizing the caches.
+  IntervalFlow Commit(size_t inserted, size_t removed, size_t misses) {
+    // Lossy counters may lag behind a previous read.
+    const IntervalFlow flow = {
+        .inserted = inserted > committed_inserted_
+                        ? inserted - committed_inserted_
+                        : 0,
+        .removed =
+            removed > committed_removed_ ? removed - committed_removed_ : 0,
+        .misses = misses,
+    };
+    committed_inserted_ = std::max(committed_inserted_, inserted);
+    committed_removed_ = std::max(committed_removed_, removed);
+    last_inserted_.store(flow.inserted, std::memory_order_relaxed);
+    last_removed_.store(flow.removed, std::memory_order_relaxed);
+    last_misses_.store(flow.misses, std::memory_order_relaxed);
+    return flow;
+  }
+
+  IntervalFlow Last() const {
+    return {last_inserted_.load(std::memory_order_relaxed),
+            last_removed_.load(std::memory_order_relaxed),
+            last_misses_.load(std::memory_order_relaxed)};
+  }
+
+ private:
+  size_t committed_inserted_ = 0;
+  size_t committed_removed_ = 0;
+  std::atomic<size_t> last_inserted_ = {0};
+  std::atomic<size_t> last_removed_ = {0};
+  std::atomic<size_t> last_misses_ = {0};
+};
+
 // TransferCache is used to cache transfers of
 // sizemap.num_objects_to_move(size_class) back and forth between
 // thread caches and the central cache for a given size class.
@@ -155,7 +206,9 @@ class TransferCache {
     TC_ASSERT(0 < N && N <= kMaxObjectsToMove);
     auto info = slot_info_.load(std::memory_order_relaxed);
     if (info.capacity > info.used) {
+      LockContentionTimer contention(lock_);
       AllocationGuardSpinLockHolder h(lock_);
+      RecordLockContention(contention);
       // As caches are resized in the background, we do not attempt to grow
       // them here. Instead, we just check if they have spare free capacity.
       info = slot_info_.load(std::memory_order_relaxed);
@@ -166,6 +219,7 @@ class TransferCache {
         void** entry = GetSlot(info.used - got);
         memcpy(entry, batch.data(), sizeof(void*) * got);
         insert_hits_.LossyAdd(1);
+        insert_object_hits_.LossyAdd(got);
         if (got == N) {
           return;
         }
@@ -175,6 +229,7 @@ class TransferCache {
 
     insert_misses_.LossyAdd(1);
     insert_object_misses_.Inc(batch.size());
+    TCMALLOC_PROBE(transfer_cache_insert_miss, size_class, batch.size());
 
     freelist().InsertRange(batch);
   }
@@ -183,11 +238,28 @@ class TransferCache {
   // batch.
   [[nodiscard]] int RemoveRange(int size_class, const absl::Span<void*> batch)
       ABSL_LOCKS_EXCLUDED(lock_) {
+    const int got = TryRemoveRange(size_class, batch);
+    if (got > 0) return got;
+
+    remove_misses_.LossyAdd(1);
+    remove_object_misses_.Inc(batch.size());
+    TCMALLOC_PROBE(transfer_cache_remove_miss, size_class, batch.size());
+    return freelist().RemoveRange(batch);
+  }
+
+  // As RemoveRange, but only hands out objects already held by this cache: it
+  // never falls back to the freelist and does not count a miss.  Returns 0 if
+  // the cache is empty.
+  [[nodiscard]] int TryRemoveRange(int size_class,
+                                   const absl::Span<void*> batch)
+      ABSL_LOCKS_EXCLUDED(lock_) {
     TC_ASSERT(!batch.empty());
     TC_ASSERT_LE(batch.size(), kMaxObjectsToMove);
     auto info = slot_info_.load(std::memory_order_relaxed);
     if (info.used) {
+      LockContentionTimer contention(lock_);
       AllocationGuardSpinLockHolder h(lock_);
+      RecordLockContention(contention);
       // Refetch with the lock
       info = slot_info_.load(std::memory_order_relaxed);
       int got = std::min<int>(batch.size(), info.used);
@@ -202,10 +274,7 @@ class TransferCache {
         return got;
       }
     }
-
-    remove_misses_.LossyAdd(1);
-    remove_object_misses_.Inc(batch.size());
-    return freelist().RemoveRange(batch);
+    return 0;
   }
 
   // We record the lowest value of info.used in a low water mark since the last
@@ -252,6 +321,15 @@ class TransferCache {
     return insert_object_misses_.Commit() + remove_object_misses_.Commit();
   }
 
+  // Fetches the objects inserted, removed and missed during the latest
+  // interval.  Commits the misses like FetchCommitIntervalMisses.
+  IntervalFlow FetchCommitIntervalFlow() ABSL_LOCKS_EXCLUDED(lock_) {
+    const size_t misses = FetchCommitIntervalMisses();
+    return flow_.Commit(
+        insert_object_hits_.value() + insert_object_misses_.Total(),
+        remove_object_hits_.value() + remove_object_misses_.Total(), misses);
+  }
+
   // Returns the number of transfer cache insert/remove hits/misses.
   TransferCacheStats GetStats() const ABSL_LOCKS_EXCLUDED(lock_) {
     TransferCacheStats stats;
@@ -268,6 +346,12 @@ class TransferCache {
     stats.used = info.used;
     stats.capacity = info.capacity;
     stats.max_capacity = max_capacity_;
+    stats.lock_contentions = lock_contentions_.value();
+
+    const IntervalFlow flow = flow_.Last();
+    stats.interval_inserted = flow.inserted;
+    stats.interval_removed = flow.removed;
+    stats.interval_misses = flow.misses;
 
     return stats;
   }
@@ -358,6 +442,17 @@ class TransferCache {
     return slots_ + i;
   }
 
+  // Counts acquisitions that had to wait for another thread.  The check made by
+  // `contention` is racy, but only feeds the adaptive sharding heuristics and
+  // the sampled lock contention profile.
+  void RecordLockContention(LockContentionTimer& contention)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    contention.Acquired();
+    if (ABSL_PREDICT_FALSE(contention.contended())) {
+      lock_contentions_.LossyAdd(1);
+    }
+  }
+
   void SetSlotInfo(SizeInfo info) {
     TC_ASSERT_LE(0, info.used);
     TC_ASSERT_LE(info.used, info.capacity);
@@ -384,6 +479,7 @@ class TransferCache {
   // and use LossyAdd, but the thread annotations cannot indicate that we do not
   // need a lock for reads.
   StatsCounter insert_hits_;
+  StatsCounter insert_object_hits_;
   StatsCounter remove_hits_;
   StatsCounter remove_object_hits_;
 
@@ -410,13 +506,500 @@ class TransferCache {
   // For these we are deliberately fast-and-loose. Some increments may be lost.
   StatsCounter insert_misses_;
   StatsCounter remove_misses_;
+  StatsCounter lock_contentions_;
+
+  MissCounts insert_object_misses_;
+  MissCounts remove_object_misses_;
+
+  // Only updated by the thread resizing the caches.
+  IntervalFlowCounter flow_;
+} ABSL_CACHELINE_ALIGNED;
+
+// RingTransferCache is an alternative to TransferCache that keeps batches in
+// a bounded multi-producer/multi-consumer ring instead of a spinlock guarded
+// stack.  InsertRange and RemoveRange never take a lock, so threads moving
+// batches of the same size class in and out of the cache do not serialize on
+// each other.
+//
+// Each ring cell holds up to num_objects_to_move(size_class) objects.  The
+// number of cached objects is tracked in slot_info_ exactly like TransferCache
+// does, and objects are reserved in slot_info_ before they are published in
+// the ring, so slot_info_.used is always an upper bound of the number of
+// objects held by the ring.  Unlike TransferCache, objects are handed out in
+// FIFO rather than LIFO order.
+//
+// Selected by building with TCMALLOC_INTERNAL_RING_TRANSFER_CACHE.
+template <typename CentralFreeList, typename TransferCacheManager>
+class RingTransferCache {
+ public:
+  using Manager = TransferCacheManager;
+  using FreeList = CentralFreeList;
+  using Capacity =
+      typename TransferCache<CentralFreeList, TransferCacheManager>::Capacity;
+
+  RingTransferCache(Manager* owner, int size_class)
+      : RingTransferCache(owner, size_class, CapacityNeeded(size_class)) {}
+
+  RingTransferCache(Manager* owner, int size_class, Capacity capacity)
+      : plunder_lock_(absl::base_internal::SCHEDULE_KERNEL_ONLY),
+        low_water_mark_(0),
+        slot_info_(SizeInfo({0, capacity.capacity})),
+        freelist_do_not_access_directly_(),
+        owner_(owner),
+        max_capacity_(capacity.max_capacity),
+        batch_size_(
+            max_capacity_ != 0 ? Manager::num_objects_to_move(size_class) : 0),
+        cell_stride_(sizeof(CellHeader) + batch_size_ * sizeof(void*)),
+        cell_mask_(0),
+        cells_(nullptr) {
+    freelist().Init(size_class);
+    if (max_capacity_ == 0) return;
+
+    TC_ASSERT_GT(batch_size_, 0);
+    TC_ASSERT_LE(batch_size_, kMaxObjectsToMove);
+    // Partially filled batches occupy a whole cell, so provision twice as many
+    // cells as full batches fit in max_capacity_.  When the ring runs out of
+    // cells, inserts spill to the freelist like they do on a full cache.
+    const size_t num_cells = absl::bit_ceil(
+        2 * static_cast<size_t>((max_capacity_ + batch_size_ - 1) /
+                                batch_size_));
+    cell_mask_ = num_cells - 1;
+    cells_ = reinterpret_cast<char*>(owner_->Alloc(num_cells * cell_stride_));
+    for (size_t i = 0; i < num_cells; ++i) {
+      new (GetCell(i)) CellHeader();
+      GetCell(i)->sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  RingTransferCache(const RingTransferCache&) = delete;
+  RingTransferCache& operator=(const RingTransferCache&) = delete;
+
+  static Capacity CapacityNeeded(size_t size_class) {
+    return TransferCache<CentralFreeList,
+                         TransferCacheManager>::CapacityNeeded(size_class);
+  }
+
+  // Insert the specified batch into the transfer cache.  N is the number of
+  // elements in the range.  RemoveRange() is the opposite operation.
+  void InsertRange(int size_class, absl::Span<void* absl_nonnull> batch) {
+    const int N = batch.size();
+    TC_ASSERT(0 < N && N <= kMaxObjectsToMove);
+    const int got = ReserveUsed(N);
+    if (got > 0) {
+      int pushed = 0;
+      while (pushed < got) {
+        const int n = std::min(got - pushed, batch_size_);
+        if (!Push(batch.data() + pushed, n)) break;
+        pushed += n;
+      }
+      // Out of cells: hand back the part of the reservation we did not use.
+      if (pushed < got) ReleaseUsed(got - pushed);
+      if (pushed > 0) {
+        insert_hits_.LossyAdd(1);
+        insert_object_hits_.LossyAdd(pushed);
+        if (pushed == N) {
+          return;
+        }
+        batch = batch.subspan(pushed);
+      }
+    }
+
+    insert_misses_.LossyAdd(1);
+    insert_object_misses_.Inc(batch.size());
+    TCMALLOC_PROBE(transfer_cache_insert_miss, size_class, batch.size());
+
+    freelist().InsertRange(batch);
+  }
+
+  // Returns the actual number of fetched elements and stores elements in the
+  // batch.
+  [[nodiscard]] int RemoveRange(int size_class, const absl::Span<void*> batch) {
+    const int got = TryRemoveRange(size_class, batch);
+    if (got > 0) return got;
+
+    remove_misses_.LossyAdd(1);
+    remove_object_misses_.Inc(batch.size());
+    TCMALLOC_PROBE(transfer_cache_remove_miss, size_class, batch.size());
+    return freelist().RemoveRange(batch);
+  }
+
+  // See TransferCache::TryRemoveRange.
+  [[nodiscard]] int TryRemoveRange(int size_class,
+                                   const absl::Span<void*> batch) {
+    TC_ASSERT(!batch.empty());
+    TC_ASSERT_LE(batch.size(), kMaxObjectsToMove);
+    if (GetSlotInfo().used > 0) {
+      SizeInfo info;
+      const int got = TakeObjects(batch.data(), batch.size(), &info);
+      if (got > 0) {
+        remove_hits_.LossyAdd(1);
+        remove_object_hits_.LossyAdd(got);
+        UpdateLowWaterMark(info.used);
+        return got;
+      }
+    }
+    return 0;
+  }
+
+  // Returns the objects that stayed in the cache since the previous call to
+  // the freelist.  See TransferCache::TryPlunder.
+  void TryPlunder(int size_class) ABSL_LOCKS_EXCLUDED(plunder_lock_) {
+    if (max_capacity_ == 0) return;
+    if (!plunder_lock_.try_lock()) return;
+
+    int to_return = low_water_mark_.load(std::memory_order_relaxed);
+    low_water_mark_.store(GetSlotInfo().used, std::memory_order_relaxed);
+    while (to_return > 0) {
+      void* buf[kMaxObjectsToMove];
+      SizeInfo info;
+      const int got = TakeObjects(buf, std::min(batch_size_, to_return), &info);
+      if (got == 0) break;
+      to_return -= got;
+      low_water_mark_.store(info.used, std::memory_order_relaxed);
+      plunder_lock_.unlock();
+
+      freelist().InsertRange({buf, static_cast<size_t>(got)});
+      if (!plunder_lock_.try_lock()) return;
+    }
+    plunder_lock_.unlock();
+  }
+
+  // Returns the number of free objects in the transfer cache.
+  size_t tc_length() const {
+    return static_cast<size_t>(GetSlotInfo().used);
+  }
+
+  // Fetches the misses for the latest interval and commits them to the total.
+  size_t FetchCommitIntervalMisses() {
+    return insert_object_misses_.Commit() + remove_object_misses_.Commit();
+  }
+
+  // See TransferCache::FetchCommitIntervalFlow.
+  IntervalFlow FetchCommitIntervalFlow() {
+    const size_t misses = FetchCommitIntervalMisses();
+    return flow_.Commit(
+        insert_object_hits_.value() + insert_object_misses_.Total(),
+        remove_object_hits_.value() + remove_object_misses_.Total(), misses);
+  }
+
+  // Returns the number of transfer cache insert/remove hits/misses.
+  TransferCacheStats GetStats() const {
+    TransferCacheStats stats;
+
+    stats.insert_hits = insert_hits_.value();
+    stats.remove_hits = remove_hits_.value();
+    stats.remove_object_hits = remove_object_hits_.value();
+    stats.insert_misses = insert_misses_.value();
+    stats.insert_object_misses = insert_object_misses_.Total();
+    stats.remove_misses = remove_misses_.value();
+    stats.remove_object_misses = remove_object_misses_.Total();
+
+    auto info = GetSlotInfo();
+    stats.used = info.used;
+    stats.capacity = info.capacity;
+    stats.max_capacity = max_capacity_;
+    // There is no lock to contend on.
+    stats.lock_contentions = 0;
+
+    const IntervalFlow flow = flow_.Last();
+    stats.interval_inserted = flow.inserted;
+    stats.interval_removed = flow.removed;
+    stats.interval_misses = flow.misses;
+
+    return stats;
+  }
+
+  SizeInfo GetSlotInfo() const {
+    return slot_info_.load(std::memory_order_relaxed);
+  }
+
+  // Increases capacity of the cache by a batch size. Returns true if it
+  // succeeded at growing the cache by a batch size. Else, returns false.
+  bool IncreaseCacheCapacity(int size_class) {
+    const int n = Manager::num_objects_to_move(size_class);
+    SizeInfo info = GetSlotInfo();
+    do {
+      if (info.capacity + n > max_capacity_) return false;
+    } while (!slot_info_.compare_exchange_weak(
+        info, SizeInfo({info.used, info.capacity + n}),
+        std::memory_order_relaxed));
+    return true;
+  }
+
+  // Checks if the cache capacity may be increased by a batch size.
+  bool CanIncreaseCapacity(int size_class) const {
+    int n = Manager::num_objects_to_move(size_class);
+    auto info = GetSlotInfo();
+    return max_capacity_ - info.capacity >= n;
+  }
+
+  // Checks if the cache has at least batch size number of free slots. Returns
+  // false if (capacity - used) slots is less than the batch size.
+  bool HasSpareCapacity(int size_class) const {
+    int n = Manager::num_objects_to_move(size_class);
+    auto info = GetSlotInfo();
+    return info.capacity - info.used >= n;
+  }
+
+  // Tries to shrink the Cache by a batch size, evicting objects to the
+  // freelist if the cache does not have enough spare capacity.  Returns false
+  // if it failed to shrink the cache.
+  bool ShrinkCache(int size_class) {
+    const int N = Manager::num_objects_to_move(size_class);
+
+    SizeInfo info = GetSlotInfo();
+    while (true) {
+      if (info.capacity <= N) return false;
+      const int unused = info.capacity - info.used;
+      if (N <= unused) {
+        if (slot_info_.compare_exchange_weak(
+                info, SizeInfo({info.used, info.capacity - N}),
+                std::memory_order_relaxed)) {
+          return true;
+        }
+        continue;
+      }
+
+      void* to_free[kMaxObjectsToMove];
+      const int got = TakeObjects(to_free, N - unused, &info);
+      // The remaining objects are still being published by concurrent
+      // inserts; there is nothing we can evict right now.
+      if (got == 0) return false;
+      UpdateLowWaterMark(info.used);
+      freelist().InsertRange({to_free, static_cast<size_t>(got)});
+      info = GetSlotInfo();
+    }
+  }
+
+  // This is a thin wrapper for the CentralFreeList.
+  ABSL_ATTRIBUTE_ALWAYS_INLINE FreeList& freelist() {
+    return freelist_do_not_access_directly_;
+  }
+
+  int32_t max_capacity() const { return max_capacity_; }
+
+ private:
+  // Every cell starts with this header, followed by batch_size_ object
+  // pointers.  A cell at ring position pos is free for the producer of pos
+  // when sequence == pos and holds a batch for the consumer of pos when
+  // sequence == pos + 1.
+  struct CellHeader {
+    std::atomic<uint64_t> sequence{0};
+    int32_t count = 0;
+  };
+  static_assert(sizeof(CellHeader) % alignof(void*) == 0);
+
+  CellHeader* GetCell(uint64_t pos) const {
+    return reinterpret_cast<CellHeader*>(cells_ +
+                                         (pos & cell_mask_) * cell_stride_);
+  }
+
+  static void** CellObjects(CellHeader* cell) {
+    return reinterpret_cast<void**>(cell + 1);
+  }
+
+  // Publishes n <= batch_size_ objects in a single cell.  Returns false if the
+  // ring has no free cell.
+  bool Push(void* const* objects, int n) {
+    TC_ASSERT_GT(n, 0);
+    TC_ASSERT_LE(n, batch_size_);
+    if (cells_ == nullptr) return false;
+    uint64_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    CellHeader* cell;
+    while (true) {
+      cell = GetCell(pos);
+      const uint64_t seq = cell->sequence.load(std::memory_order_acquire);
+      const int64_t diff = static_cast<int64_t>(seq - pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->count = n;
+    memcpy(CellObjects(cell), objects, sizeof(void*) * n);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumes one cell, storing up to max of its objects in out and the rest
+  // in leftover.  Returns the number of objects stored in out, or 0 if the
+  // ring is empty.
+  int Pop(void** out, int max, void** leftover, int* leftover_count) {
+    if (cells_ == nullptr) return 0;
+    uint64_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    CellHeader* cell;
+    while (true) {
+      cell = GetCell(pos);
+      const uint64_t seq = cell->sequence.load(std::memory_order_acquire);
+      const int64_t diff = static_cast<int64_t>(seq - (pos + 1));
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return 0;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    const int count = cell->count;
+    const int got = std::min(count, max);
+    void** objects = CellObjects(cell);
+    memcpy(out, objects, sizeof(void*) * got);
+    *leftover_count = count - got;
+    memcpy(leftover, objects + got, sizeof(void*) * *leftover_count);
+    cell->sequence.store(pos + cell_mask_ + 1, std::memory_order_release);
+    return got;
+  }
+
+  // Removes up to n objects from the ring into out and releases them from
+  // slot_info_.  Stores the updated slot info in info if any objects were
+  // taken.  Returns the number of objects taken.
+  int TakeObjects(void** out, int n, SizeInfo* info) {
+    int taken = 0;
+    int spilled = 0;
+    void* leftover[kMaxObjectsToMove];
+    while (taken < n) {
+      int leftover_count = 0;
+      const int got = Pop(out + taken, n - taken, leftover, &leftover_count);
+      if (got == 0) break;
+      taken += got;
+      if (leftover_count > 0) {
+        // We only get leftovers once the request is satisfied.  If the ring
+        // filled up while we held the cell, the leftovers go to the freelist.
+        if (!Push(leftover, leftover_count)) spilled = leftover_count;
+        break;
+      }
+    }
+    if (taken + spilled > 0) {
+      *info = ReleaseUsed(taken + spilled);
+    }
+    if (ABSL_PREDICT_FALSE(spilled > 0)) {
+      freelist().InsertRange({leftover, static_cast<size_t>(spilled)});
+    }
+    return taken;
+  }
+
+  // Reserves up to n objects worth of capacity.  Returns the number of objects
+  // reserved.
+  int ReserveUsed(int n) {
+    SizeInfo info = GetSlotInfo();
+    int got;
+    do {
+      got = std::min(n, info.capacity - info.used);
+      if (got <= 0) return 0;
+    } while (!slot_info_.compare_exchange_weak(
+        info, SizeInfo({info.used + got, info.capacity}),
+        std::memory_order_relaxed));
+    return got;
+  }
+
+  SizeInfo ReleaseUsed(int n) {
+    SizeInfo info = GetSlotInfo();
+    SizeInfo updated;
+    do {
+      TC_ASSERT_LE(n, info.used);
+      updated = {info.used - n, info.capacity};
+    } while (!slot_info_.compare_exchange_weak(info, updated,
+                                               std::memory_order_relaxed));
+    return updated;
+  }
+
+  // Lossy: concurrent updates may overwrite a lower value, which only makes
+  // the next TryPlunder return fewer objects.
+  void UpdateLowWaterMark(int used) {
+    if (used < low_water_mark_.load(std::memory_order_relaxed)) {
+      low_water_mark_.store(used, std::memory_order_relaxed);
+    }
+  }
+
+  // Serializes TryPlunder calls; never taken by InsertRange or RemoveRange.
+  absl::base_internal::SpinLock plunder_lock_;
+
+  // Lowest value of "slot_info_.used" since last call to TryPlunder.
+  std::atomic<int> low_water_mark_;
+
+  StatsCounter insert_hits_;
+  StatsCounter insert_object_hits_;
+  StatsCounter remove_hits_;
+  StatsCounter remove_object_hits_;
+
+  // Number of reserved and available cached entries.
+  // INVARIANT: [0 <= slot_info_.used <= slot_info.capacity <= max_capacity_]
+  std::atomic<SizeInfo> slot_info_;
+
+  FreeList freelist_do_not_access_directly_;
+
+  Manager* const owner_;
+
+  // Maximum size of the cache.
+  const int32_t max_capacity_;
+
+  // Geometry of the ring.  cells_ holds cell_mask_ + 1 cells of cell_stride_
+  // bytes each.
+  const int batch_size_;
+  const size_t cell_stride_;
+  uint64_t cell_mask_;
+  char* cells_;
+
+  // Producers and consumers advance these independently, so keep them on
+  // separate cache lines.
+  alignas(ABSL_CACHELINE_SIZE) std::atomic<uint64_t> enqueue_pos_{0};
+  alignas(ABSL_CACHELINE_SIZE) std::atomic<uint64_t> dequeue_pos_{0};
+
+  alignas(ABSL_CACHELINE_SIZE) StatsCounter insert_misses_;
+  StatsCounter remove_misses_;
 
   MissCounts insert_object_misses_;
   MissCounts remove_object_misses_;
+
+  // Only updated by the thread resizing the caches.
+  IntervalFlowCounter flow_;
 } ABSL_CACHELINE_ALIGNED;
 
+#ifdef TCMALLOC_INTERNAL_RING_TRANSFER_CACHE
+template <typename CentralFreeList, typename Manager>
+using DefaultTransferCache = RingTransferCache<CentralFreeList, Manager>;
+#else
+template <typename CentralFreeList, typename Manager>
+using DefaultTransferCache = TransferCache<CentralFreeList, Manager>;
+#endif
+
+// The hit rate that transfer caches sized by their flow aim for.
+static constexpr double kFlowTargetHitRate = 0.95;
+
+// Returns the misses of <flow> that a larger cache could have avoided, beyond
+// those allowed by kFlowTargetHitRate.  Only objects that flow from freeing to
+// allocating cpus count: when more objects are inserted than removed, or the
+// other way around, the difference has to go to or come from the central
+// freelist however large the cache is.
+inline uint64_t ExcessFlowMisses(const IntervalFlow& flow) {
+  const uint64_t through = std::min(flow.inserted, flow.removed);
+  const uint64_t imbalance = std::max(flow.inserted, flow.removed) - through;
+  const uint64_t misses =
+      std::min(flow.misses - std::min<uint64_t>(flow.misses, imbalance),
+               2 * through);
+  const uint64_t allowed =
+      static_cast<uint64_t>((1 - kFlowTargetHitRate) * 2 * through);
+  return misses > allowed ? misses - allowed : 0;
+}
+
+// Moves a batch of capacity at a time from the caches of
+// [start_size_class, start_size_class + kNumBaseClasses) with the fewest
+// misses during the previous resize interval to those with the most.
+//
+// With <flow_sizing>, caches are ranked by ExcessFlowMisses instead, and only
+// caches that met kFlowTargetHitRate give up capacity, those with the least
+// flow first.
 template <typename Manager>
-void ResizeCaches(Manager& manager, int start_size_class) {
+void ResizeCaches(Manager& manager, int start_size_class, bool flow_sizing) {
   TC_ASSERT_GE(start_size_class, 0);
   TC_ASSERT_LE(start_size_class + Manager::kNumBaseClasses,
                Manager::kNumClasses);
@@ -424,6 +1007,8 @@ void ResizeCaches(Manager& manager, int start_size_class) {
   struct MissInfo {
     int size_class;
     uint64_t misses;
+    // Objects that flowed through the cache, with flow sizing.
+    uint64_t flow;
   };
 
   std::array<MissInfo, Manager::kNumBaseClasses> misses;
@@ -432,14 +1017,24 @@ void ResizeCaches(Manager& manager, int start_size_class) {
   // previous resize interval.
   for (int i = 0; i < Manager::kNumBaseClasses; ++i) {
     int size_class = start_size_class + i;
-    size_t miss = manager.FetchCommitIntervalMisses(size_class);
-    misses[i] = {.size_class = size_class, .misses = miss};
+    if (flow_sizing) {
+      const IntervalFlow flow = manager.FetchCommitIntervalFlow(size_class);
+      misses[i] = {.size_class = size_class,
+                   .misses = ExcessFlowMisses(flow),
+                   .flow = std::min(flow.inserted, flow.removed)};
+    } else {
+      size_t miss = manager.FetchCommitIntervalMisses(size_class);
+      misses[i] = {.size_class = size_class, .misses = miss, .flow = 0};
+    }
   }
 
   // Prioritize shrinking cache that had least number of misses.
   std::sort(misses.begin(), misses.end(),
             [](const MissInfo& a, const MissInfo& b) {
               if (a.misses == b.misses) {
+                if (a.flow != b.flow) {
+                  return a.flow > b.flow;
+                }
                 return a.size_class < b.size_class;
               }
               return a.misses > b.misses;
@@ -459,13 +1054,18 @@ void ResizeCaches(Manager& manager, int start_size_class) {
     // No one else wants to grow, so stop here.
     if (misses[to_grow].misses == 0) break;
 
+    bool shrunk = false;
     for (; to_grow < to_shrink; --to_shrink) {
+      // Caches below the target hit rate keep their capacity.
+      if (flow_sizing && misses[to_shrink].misses != 0) break;
       int shrink_size_class = misses[to_shrink].size_class;
       if (manager.ShrinkCache(shrink_size_class)) {
         ++total_shrunk;
+        shrunk = true;
         break;
       }
     }
+    if (!shrunk) break;
 
     for (; to_grow < to_shrink; ++to_grow) {
       int grow_size_class = misses[to_grow].size_class;
@@ -498,11 +1098,12 @@ void TryResizingCaches(Manager& manager) {
       Parameters::heap_partitioning_mode() != HeapPartitioningMode::kOff
           ? Manager::kNormalPartitions
           : Manager::kNormalPartitions / Manager::kSecurityPartitions;
+  const bool flow_sizing = Parameters::transfer_cache_flow_sizing();
   for (int i = 0; i < num_partitions; ++i) {
-    ResizeCaches(manager, i * Manager::kNumBaseClasses);
+    ResizeCaches(manager, i * Manager::kNumBaseClasses, flow_sizing);
   }
   if (Manager::kHasExpandedClasses) {
-    ResizeCaches(manager, Manager::kExpandedClassesStart);
+    ResizeCaches(manager, Manager::kExpandedClassesStart, flow_sizing);
   }
 }
 
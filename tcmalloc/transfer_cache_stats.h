@@ -31,6 +31,13 @@ struct TransferCacheStats {
   size_t used;
   size_t capacity;
   size_t max_capacity;
+  // Number of inserts/removes that found the cache lock already held.
+  size_t lock_contentions;
+  // Objects inserted, removed and missed during the last resize interval.
+  // Only measured with transfer_cache_flow_sizing.
+  size_t interval_inserted;
+  size_t interval_removed;
+  size_t interval_misses;
 };
 
 }  // namespace tcmalloc_internal
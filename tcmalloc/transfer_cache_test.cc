@@ -226,6 +226,29 @@ TYPED_TEST_P(TransferCacheTest, PartialFetchFromFreelist) {
             batch_size + batch_size / 2);
 }
 
+TYPED_TEST_P(TransferCacheTest, TryRemoveRangeSkipsFreelist) {
+  const int batch_size = TypeParam::kBatchSize;
+  TypeParam e;
+  EXPECT_CALL(e.central_freelist(), InsertRange).Times(0);
+  EXPECT_CALL(e.central_freelist(), RemoveRange).Times(0);
+
+  std::vector<void*> batch(batch_size);
+  // An empty cache hands out nothing and does not count a miss.
+  EXPECT_EQ(e.transfer_cache().TryRemoveRange(kSizeClass,
+                                              absl::MakeSpan(batch)),
+            0);
+  EXPECT_EQ(e.transfer_cache().GetStats().remove_misses, 0);
+
+  e.Insert(batch_size);
+  EXPECT_EQ(e.transfer_cache().TryRemoveRange(kSizeClass,
+                                              absl::MakeSpan(batch)),
+            batch_size);
+  EXPECT_EQ(e.transfer_cache().GetStats().remove_hits, 1);
+  EXPECT_EQ(e.transfer_cache().GetStats().remove_misses, 0);
+  EXPECT_EQ(e.transfer_cache().tc_length(), 0);
+  e.transfer_cache().InsertRange(kSizeClass, absl::MakeSpan(batch));
+}
+
 TYPED_TEST_P(TransferCacheTest, PushesToFreelist) {
   const int batch_size = TypeParam::kBatchSize;
   TypeParam e;
@@ -416,8 +439,9 @@ TYPED_TEST_P(TransferCacheTest, b172283201) {
 
 REGISTER_TYPED_TEST_SUITE_P(TransferCacheTest, IsolatedSmoke, ReadStats,
                             FetchesFromFreelist, PartialFetchFromFreelist,
-                            PushesToFreelist, WrappingWorks, SingleItemSmoke,
-                            Plunder, b172283201);
+                            TryRemoveRangeSkipsFreelist, PushesToFreelist,
+                            WrappingWorks, SingleItemSmoke, Plunder,
+                            b172283201);
 
 template <typename Env>
 using FuzzTest = ::testing::Test;
@@ -668,6 +692,89 @@ TEST(ShardedTransferCacheManagerTest, ShardsOnDemand) {
   }
 }
 
+TEST(ShardedTransferCacheManagerTest, NextShardCount) {
+  using ShardedManager = FakeShardedTransferCacheEnvironment::ShardedManager;
+  constexpr uint64_t kBusy = ShardedManager::kMinTransfersToShard;
+  constexpr uint64_t kContended = kBusy / ShardedManager::kContentionRatio;
+  constexpr uint64_t kIdle = ShardedManager::kIdleTransfers - 1;
+
+  // Contended size classes double their shard count up to the number of
+  // cache domains.
+  EXPECT_EQ(ShardedManager::NextShardCount(0, kBusy, kContended, 8), 2);
+  EXPECT_EQ(ShardedManager::NextShardCount(2, kBusy, kContended, 8), 4);
+  EXPECT_EQ(ShardedManager::NextShardCount(4, kBusy, kContended, 8), 8);
+  EXPECT_EQ(ShardedManager::NextShardCount(8, kBusy, kContended, 8), 8);
+  EXPECT_EQ(ShardedManager::NextShardCount(4, kBusy, kContended, 6), 6);
+
+  // Busy but uncontended size classes, and low traffic, keep their shards.
+  EXPECT_EQ(ShardedManager::NextShardCount(0, kBusy, kContended - 1, 8), 0);
+  EXPECT_EQ(ShardedManager::NextShardCount(4, kBusy, 0, 8), 4);
+  EXPECT_EQ(ShardedManager::NextShardCount(4, kBusy - 1, kBusy, 8), 4);
+
+  // Idle size classes collapse back to the unsharded cache.
+  EXPECT_EQ(ShardedManager::NextShardCount(8, kIdle, 0, 8), 4);
+  EXPECT_EQ(ShardedManager::NextShardCount(2, kIdle, 0, 8), 0);
+  EXPECT_EQ(ShardedManager::NextShardCount(0, kIdle, 0, 8), 0);
+
+  // A single cache domain never shards.
+  EXPECT_EQ(ShardedManager::NextShardCount(0, kBusy, kBusy, 1), 0);
+}
+
+TEST(ShardedTransferCacheManagerTest, AdaptiveShards) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  struct FakeBackingManager {
+    TransferCacheStats GetStats(int size_class) const { return stats; }
+    TransferCacheStats stats = {};
+  };
+
+  using ShardedManager = FakeShardedTransferCacheEnvironment::ShardedManager;
+  constexpr int kNumShards = ShardedManager::kMinShardsAllowedForAdaptive;
+  FakeShardedTransferCacheEnvironment env(kNumShards,
+                                          /*use_generic_cache=*/true,
+                                          /*use_adaptive_cache=*/true);
+  ShardedManager& manager = env.sharded_manager();
+  env.transfer_cache_manager().SetPartialLegacyTransferCache(true);
+
+  // Size classes start out on the unsharded cache.
+  EXPECT_TRUE(manager.adaptive());
+  EXPECT_FALSE(manager.should_use(kSizeClass));
+  EXPECT_EQ(manager.ShardsForClass(kSizeClass), 0);
+
+  // Contention on the backing cache spreads the size class out.
+  FakeBackingManager backing;
+  backing.stats.insert_hits = ShardedManager::kMinTransfersToShard;
+  backing.stats.lock_contentions = ShardedManager::kMinTransfersToShard;
+  manager.AdaptShards(backing);
+  EXPECT_TRUE(manager.should_use(kSizeClass));
+  EXPECT_EQ(manager.ShardsForClass(kSizeClass), kNumShards);
+
+  // CPUs in different cache domains now use different shards.
+  void* ptr0;
+  env.central_freelist().AllocateBatch({&ptr0, 1});
+  env.SetCurrentCpu(0);
+  manager.Push(kSizeClass, ptr0);
+  void* ptr1;
+  env.central_freelist().AllocateBatch({&ptr1, 1});
+  env.SetCurrentCpu(2);
+  manager.Push(kSizeClass, ptr1);
+  EXPECT_TRUE(manager.shard_initialized(0));
+  EXPECT_TRUE(manager.shard_initialized(1));
+  EXPECT_EQ(manager.tc_length(0, kSizeClass), 1);
+  EXPECT_EQ(manager.tc_length(2, kSizeClass), 1);
+
+  // Without further traffic, the size class collapses again.  Plundering
+  // returns the cached objects to the backing cache.
+  manager.AdaptShards(backing);
+  EXPECT_FALSE(manager.should_use(kSizeClass));
+  EXPECT_EQ(manager.ShardsForClass(kSizeClass), 0);
+  manager.Plunder();
+  manager.Plunder();
+  EXPECT_EQ(manager.TotalObjectsOfClass(kSizeClass), 0);
+}
+
 TEST(ShardedTransferCacheManagerTest, PrintTelemetry) {
   if (!subtle::percpu::IsFast()) {
     return;
@@ -736,6 +843,12 @@ using Env = FakeTransferCacheEnvironment<internal_transfer_cache::TransferCache<
 INSTANTIATE_TYPED_TEST_SUITE_P(TransferCache, TransferCacheTest,
                                ::testing::Types<Env>);
 
+using RingEnv =
+    FakeTransferCacheEnvironment<internal_transfer_cache::RingTransferCache<
+        MockCentralFreeList, FakeTransferCacheManager>>;
+INSTANTIATE_TYPED_TEST_SUITE_P(RingTransferCache, TransferCacheTest,
+                               ::testing::Types<RingEnv>);
+
 }  // namespace unit_tests
 
 namespace fuzz_tests {
@@ -746,6 +859,12 @@ using Env = FakeTransferCacheEnvironment<internal_transfer_cache::TransferCache<
     MockCentralFreeList, FakeTransferCacheManager>>;
 INSTANTIATE_TYPED_TEST_SUITE_P(TransferCache, FuzzTest, ::testing::Types<Env>);
 
+using RingEnv =
+    FakeTransferCacheEnvironment<internal_transfer_cache::RingTransferCache<
+        MockCentralFreeList, FakeTransferCacheManager>>;
+INSTANTIATE_TYPED_TEST_SUITE_P(RingTransferCache, FuzzTest,
+                               ::testing::Types<RingEnv>);
+
 }  // namespace fuzz_tests
 
 namespace resize_tests {
@@ -763,6 +882,8 @@ struct MockTransferCacheManager {
   MOCK_METHOD(bool, CanIncreaseCapacity, (int size_class));
   MOCK_METHOD(bool, IncreaseCacheCapacity, (int size_class));
   MOCK_METHOD(size_t, FetchCommitIntervalMisses, (int size_class));
+  MOCK_METHOD(internal_transfer_cache::IntervalFlow, FetchCommitIntervalFlow,
+              (int size_class));
 };
 
 TEST(RealTransferCacheTest, ResizeOccurs) {
@@ -834,6 +955,55 @@ TEST(RealTransferCacheTest, DoesNotLeakCapacity) {
   testing::Mock::VerifyAndClear(&m);
 }
 
+TEST(RealTransferCacheTest, ExcessFlowMisses) {
+  using internal_transfer_cache::ExcessFlowMisses;
+  // 5% of the 2000 objects moving through the cache may miss.
+  EXPECT_EQ(
+      ExcessFlowMisses({.inserted = 1000, .removed = 1000, .misses = 100}),
+      0);
+  EXPECT_EQ(
+      ExcessFlowMisses({.inserted = 1000, .removed = 1000, .misses = 500}),
+      400);
+  // Objects that are only freed, and never allocated again, miss regardless of
+  // the capacity of the cache.
+  EXPECT_EQ(
+      ExcessFlowMisses({.inserted = 10000, .removed = 0, .misses = 9000}), 0);
+  EXPECT_EQ(
+      ExcessFlowMisses({.inserted = 3000, .removed = 1000, .misses = 2500}),
+      400);
+}
+
+TEST(RealTransferCacheTest, ResizeByFlow) {
+  testing::StrictMock<MockTransferCacheManager> m;
+  {
+    testing::InSequence seq;
+    // Size class 0 carries no flow, 1 meets the target hit rate and 2 misses
+    // it, so 0 gives up capacity to 2.
+    EXPECT_CALL(m, FetchCommitIntervalFlow(0))
+        .WillOnce(Return(internal_transfer_cache::IntervalFlow{
+            .inserted = 1000, .removed = 0, .misses = 1000}));
+    EXPECT_CALL(m, FetchCommitIntervalFlow(1))
+        .WillOnce(Return(internal_transfer_cache::IntervalFlow{
+            .inserted = 1000, .removed = 1000, .misses = 0}));
+    EXPECT_CALL(m, FetchCommitIntervalFlow(2))
+        .WillOnce(Return(internal_transfer_cache::IntervalFlow{
+            .inserted = 1000, .removed = 1000, .misses = 1000}));
+    EXPECT_CALL(m, CanIncreaseCapacity(2)).WillOnce(Return(true));
+    EXPECT_CALL(m, ShrinkCache(0)).WillOnce(Return(true));
+    EXPECT_CALL(m, IncreaseCacheCapacity(2)).WillOnce(Return(true));
+
+    // When every cache misses the target, none of them shrinks.
+    EXPECT_CALL(m, FetchCommitIntervalFlow)
+        .Times(3)
+        .WillRepeatedly(Return(internal_transfer_cache::IntervalFlow{
+            .inserted = 1000, .removed = 1000, .misses = 1000}));
+    EXPECT_CALL(m, CanIncreaseCapacity(3)).WillOnce(Return(true));
+  }
+  internal_transfer_cache::ResizeCaches(m, 0, /*flow_sizing=*/true);
+  internal_transfer_cache::ResizeCaches(m, 3, /*flow_sizing=*/true);
+  testing::Mock::VerifyAndClear(&m);
+}
+
 template <typename Env>
 using RealTransferCacheTest = ::testing::Test;
 TYPED_TEST_SUITE_P(RealTransferCacheTest);
@@ -876,6 +1046,34 @@ using TransferCacheRealEnv = MultiSizeClassTransferCacheEnvironment<
                                            FakeMultiClassTransferCacheManager>>;
 INSTANTIATE_TYPED_TEST_SUITE_P(TransferCache, RealTransferCacheTest,
                                ::testing::Types<TransferCacheRealEnv>);
+TEST(TransferCacheManagerTest, NumaSpillPolicy) {
+  using Manager = TransferCacheManager;
+  constexpr int kBatch = 32;
+
+  // Only an empty local cache borrows, and only from a remote cache holding
+  // enough batches.
+  EXPECT_FALSE(Manager::ShouldBorrowFromRemote(0, 4 * kBatch, kBatch, 0));
+  EXPECT_TRUE(Manager::ShouldBorrowFromRemote(0, 4 * kBatch, kBatch, 4));
+  EXPECT_FALSE(Manager::ShouldBorrowFromRemote(0, 4 * kBatch - 1, kBatch, 4));
+  EXPECT_FALSE(Manager::ShouldBorrowFromRemote(1, 4 * kBatch, kBatch, 4));
+  EXPECT_TRUE(Manager::ShouldBorrowFromRemote(0, kBatch, kBatch, 1));
+
+  EXPECT_FALSE(Manager::HasRemoteNumaClass(0));
+  EXPECT_FALSE(Manager::HasRemoteNumaClass(kExpandedClassesStart));
+  if (kNumaPartitions == 1) {
+    EXPECT_FALSE(Manager::HasRemoteNumaClass(1));
+    return;
+  }
+  EXPECT_FALSE(Manager::HasRemoteNumaClass(kNumBaseClasses));
+  for (int size_class = 1; size_class < kNumBaseClasses; ++size_class) {
+    const int remote = size_class + kNumBaseClasses;
+    ASSERT_TRUE(Manager::HasRemoteNumaClass(size_class));
+    ASSERT_TRUE(Manager::HasRemoteNumaClass(remote));
+    EXPECT_EQ(Manager::RemoteNumaClass(size_class), remote);
+    EXPECT_EQ(Manager::RemoteNumaClass(remote), size_class);
+  }
+}
+
 TEST(TransferCacheManagerTest, PrintTelemetry) {
   TransferCacheRealEnv env;
   auto& manager = env.transfer_cache_manager();
@@ -32,6 +32,10 @@ build_variants = [
         "name": "large_pages",
         "copts": ["-DTCMALLOC_INTERNAL_32K_PAGES"],
     },
+    {
+        "name": "64k_pages",
+        "copts": ["-DTCMALLOC_INTERNAL_64K_PAGES"],
+    },
     {
         "name": "256k_pages",
         "copts": ["-DTCMALLOC_INTERNAL_256K_PAGES"],
@@ -56,6 +60,10 @@ build_variants = [
         "name": "latency_injection",
         "copts": ["-DTCMALLOC_INTERNAL_8K_PAGES", "-DTCMALLOC_INTERNAL_LATENCY_INJECTION"],
     },
+    {
+        "name": "security_partitions_8",
+        "copts": ["-DTCMALLOC_INTERNAL_8K_PAGES", "-DTCMALLOC_INTERNAL_SECURITY_PARTITIONS=8"],
+    },
 ]
 
 test_variants = [
@@ -253,7 +261,7 @@ test_variants = [
             "//tcmalloc:common_8k_pages",
         ],
         "env": {
-            "BORG_EXPERIMENTS": "TEST_ONLY_MM_VCPU",
+            "TCMALLOC_RSEQ_VIRTUAL_CPUS": "1",
             "GLIBC_TUNABLES": "glibc.pthread.rseq=0",
         },
     },
@@ -271,6 +279,15 @@ test_variants = [
         "copts": ["-DTCMALLOC_INTERNAL_8K_PAGES", "-DTCMALLOC_INTERNAL_LATENCY_INJECTION"],
         "tags": ["noubsan"],
     },
+    {
+        "name": "security_partitions_8",
+        "malloc": "//tcmalloc:tcmalloc_security_partitions_8",
+        "deps": ["//tcmalloc:common_security_partitions_8"],
+        "copts": ["-DTCMALLOC_INTERNAL_8K_PAGES", "-DTCMALLOC_INTERNAL_SECURITY_PARTITIONS=8"],
+        "env": {"TCMALLOC_HEAP_PARTITIONING": "true"},
+        # sanitizers disable heap partitioning & the environment variable is ignored.
+        "tags": ["noubsan", "noasan", "nomsan", "notsan"],
+    },
     {
         "name": "tcmalloc_eager_backing_v2",
         "malloc": "//tcmalloc",
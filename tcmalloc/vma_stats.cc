@@ -0,0 +1,148 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/vma_stats.h"
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "absl/base/attributes.h"
+#include "absl/base/call_once.h"
+#include "absl/strings/match.h"
+#include "absl/strings/string_view.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/proc_maps.h"
+#include "tcmalloc/internal/sysinfo.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+ABSL_CONST_INIT std::atomic<int64_t> merged_vmas{0};
+
+constexpr absl::string_view kRegionPrefix = "[anon:tcmalloc_region_";
+// HugePageFiller's names for sampled trackers continue with the page size.
+constexpr absl::string_view kTelemetryInfix = "_page_";
+
+bool IsTcmallocVma(absl::string_view name) {
+  return absl::StartsWith(name, kRegionPrefix);
+}
+
+bool IsTelemetryVma(absl::string_view name) {
+  return IsTcmallocVma(name) &&
+         absl::StrContains(name.substr(kRegionPrefix.size()), kTelemetryInfix);
+}
+
+int64_t MaxMapCount() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static int64_t max_map_count = 0;
+  absl::base_internal::LowLevelCallOnce(
+      &flag, [&]() { max_map_count = ReadMaxMapCount().value_or(0); });
+  return max_map_count;
+}
+
+// Calls f(start, end, name) for every VMA of the process.  Returns false if
+// /proc/self/maps could not be read.
+template <typename F>
+bool ForEachVma(F f) {
+  ProcMapsIterator::Buffer buffer;
+  ProcMapsIterator it(&buffer);
+  if (!it.Valid()) return false;
+  uint64_t start, end, offset;
+  int64_t inode;
+  char *flags, *filename;
+  while (it.NextExt(&start, &end, &flags, &offset, &inode, &filename,
+                    nullptr)) {
+    f(start, end, absl::string_view(filename));
+  }
+  return true;
+}
+
+}  // namespace
+
+VmaStats GetVmaStats() {
+  VmaStats stats;
+  ForEachVma([&](uint64_t, uint64_t, absl::string_view name) {
+    ++stats.total;
+    if (IsTcmallocVma(name)) {
+      ++stats.tcmalloc;
+      if (IsTelemetryVma(name)) ++stats.tcmalloc_telemetry;
+    }
+  });
+  stats.max_map_count = MaxMapCount();
+  stats.merged = merged_vmas.load(std::memory_order_relaxed);
+  return stats;
+}
+
+int64_t MergeVmas() {
+  const VmaStats stats = GetVmaStats();
+  if (stats.max_map_count == 0 || stats.tcmalloc_telemetry == 0 ||
+      stats.total <= stats.max_map_count / 2) {
+    return 0;
+  }
+
+  // Renaming changes /proc/self/maps, so collect the ranges first.  Whatever
+  // does not fit is left for the next pass.
+  constexpr int kMaxRanges = 64;
+  struct {
+    uint64_t start;
+    uint64_t end;
+  } ranges[kMaxRanges];
+  int num_ranges = 0;
+  ForEachVma([&](uint64_t start, uint64_t end, absl::string_view name) {
+    if (num_ranges < kMaxRanges && IsTelemetryVma(name)) {
+      ranges[num_ranges++] = {start, end};
+    }
+  });
+
+  for (int i = 0; i < num_ranges; ++i) {
+    tc_globals.system_allocator().SetAnonVmaName(
+        reinterpret_cast<void*>(ranges[i].start),
+        ranges[i].end - ranges[i].start, /*name=*/std::nullopt);
+  }
+  merged_vmas.fetch_add(num_ranges, std::memory_order_relaxed);
+  return num_ranges;
+}
+
+void PrintVmaStats(Printer& out) {
+  const VmaStats stats = GetVmaStats();
+  out.printf("------------------------------------------------\n");
+  out.printf("VMAs: %lld total, %lld max\n", stats.total, stats.max_map_count);
+  out.printf("------------------------------------------------\n");
+  out.printf("VMAs: %12lld named by tcmalloc\n", stats.tcmalloc);
+  out.printf("VMAs: %12lld split off for hugepage telemetry\n",
+             stats.tcmalloc_telemetry);
+  out.printf("VMAs: %12lld merged back by the background thread\n",
+             stats.merged);
+}
+
+void PrintVmaStatsInPbtxt(PbtxtRegion& region) {
+  const VmaStats stats = GetVmaStats();
+  region.PrintI64("total", stats.total);
+  region.PrintI64("max_map_count", stats.max_map_count);
+  region.PrintI64("tcmalloc", stats.tcmalloc);
+  region.PrintI64("tcmalloc_telemetry", stats.tcmalloc_telemetry);
+  region.PrintI64("merged", stats.merged);
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,60 @@
+// Copyright 2026 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_VMA_STATS_H_
+#define TCMALLOC_VMA_STATS_H_
+
+#include <cstdint>
+
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Counts of the VMAs of the process, from /proc/self/maps.  TCMalloc's own
+// VMAs are recognized by their tcmalloc_region_* names, so they are only
+// counted on kernels with CONFIG_ANON_VMA_NAME.
+struct VmaStats {
+  int64_t total = 0;
+  int64_t tcmalloc = 0;
+  // TCMalloc VMAs split off to carry the per-hugepage names given to sampled
+  // HugePageFiller trackers.
+  int64_t tcmalloc_telemetry = 0;
+  // vm.max_map_count, or 0 if unknown.
+  int64_t max_map_count = 0;
+  // VMAs renamed by MergeVmas() so far.
+  int64_t merged = 0;
+};
+
+// Walks /proc/self/maps.  This does not allocate, but takes time linear in
+// the number of VMAs, so it is only used for stats and by the background
+// thread.
+VmaStats GetVmaStats();
+
+// Once the process uses more than half of vm.max_map_count, renames TCMalloc
+// VMAs carrying per-hugepage telemetry names back to their region's name, so
+// that the kernel merges them with their neighbours.  Returns the number of
+// VMAs renamed.
+int64_t MergeVmas();
+
+void PrintVmaStats(Printer& out);
+void PrintVmaStatsInPbtxt(PbtxtRegion& region);
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_VMA_STATS_H_